@@ -45,6 +45,8 @@ struct animation_t {
     bool is_transition; /* is this a transition animation? */
     char* prog_anim_name; /* name of a keyframe-based animation (or NULL if none is used) */
     const proganim_t* prog_anim; /* cached pointer (possibly NULL) */
+    double loop_start; /* the time in which the loop starts, i.e., the start time of frame repeat_from */
+    double loop_end; /* the time in which the loop ends, i.e., the duration of the frames */
 };
 
 /* constants */
@@ -220,6 +222,29 @@ int animation_frame_at_time(const animation_t* anim, double seconds)
     return frame_number;
 }
 
+/*
+ * animation_advance()
+ * Advances the time of an animation by dt seconds and returns the frame
+ * number at the new time. The time of a looping animation is wrapped
+ * around, so that it stays bounded and no precision is lost in long
+ * sessions. This is cheaper than animation_frame_at_time()
+ */
+int animation_advance(const animation_t* anim, double* seconds, double dt)
+{
+    double t = *seconds + dt;
+
+    /* wrap around, keeping the phase. We don't wrap keyframe-based
+       animations, as they may loop with a different period */
+    if(t >= anim->loop_end && anim->repeat && anim->prog_anim == NULL)
+        t = anim->loop_start + fmod(t - anim->loop_start, anim->loop_end - anim->loop_start);
+
+    *seconds = t;
+
+    /* no modulo is needed */
+    int frame_number = (int)(t * (double)anim->fps);
+    return clip(frame_number, 0, anim->frame_count - 1);
+}
+
 /*
  * animation_start_time_of_frame()
  * The time in which the given animation frame starts playing,
@@ -384,6 +409,8 @@ animation_t *animation_create(const spriteinfo_t *sprite, int anim_id, bool is_t
     anim->is_transition = is_transition;
     anim->prog_anim_name = NULL;
     anim->prog_anim = NULL;
+    anim->loop_start = 0.0;
+    anim->loop_end = 0.0;
 
     return anim;
 }
@@ -453,6 +480,10 @@ void animation_validate(animation_t *anim, int number_of_frames_in_the_sheet)
 
         anim->prog_anim = prog_anim; /* cache the entry */
     }
+
+    /* precompute the loop */
+    anim->loop_start = (double)anim->repeat_from / (double)anim->fps;
+    anim->loop_end = (double)anim->frame_count / (double)anim->fps;
 }
 
 /*
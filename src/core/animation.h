@@ -78,6 +78,9 @@ const struct image_t* animation_image_at_time(const animation_t* anim, double se
 /* the frame number at a given time in seconds (start time is zero) */
 int animation_frame_at_time(const animation_t* anim, double seconds);
 
+/* advances the time of an animation by dt seconds, keeping it bounded, and returns the frame number at the new time */
+int animation_advance(const animation_t* anim, double* seconds, double dt);
+
 /* the time in which the given animation frame starts playing, in seconds */
 double animation_start_time_of_frame(const animation_t* anim, int frame_number);
 
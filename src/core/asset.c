@@ -32,8 +32,20 @@
 #include "config.h"
 #include "../util/util.h"
 #include "../util/stringutil.h"
+#include "../util/darray.h"
 #include "../third_party/ignorecase.h"
 
+/* Memory-map archived gamedirs? */
+#if !defined(_WIN32) && !defined(__ANDROID__) && !defined(__EMSCRIPTEN__)
+#define WANT_MMAP                       1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#define WANT_MMAP                       0
+#endif
+
 /* The default directory of the game assets provided by upstream (*nix only) */
 #ifndef GAME_DATADIR
 #define GAME_DATADIR                    "/usr/share/games/" GAME_UNIXNAME
@@ -78,6 +90,30 @@ static char user_datadirname[256] = DEFAULT_USER_DATADIRNAME;
 #define DEFAULT_COMPATIBILITY_VERSION_CODE VERSION_CODE_EX(GAME_VERSION_SUP, GAME_VERSION_SUB, GAME_VERSION_WIP, GAME_VERSION_FIX)
 static char* gamedir = NULL; /* custom asset folder specified by the user */
 static char* writedir = NULL;
+static size_t mapped_archive_size = 0; /* size of the memory-mapped gamedir, if any */
+
+/* An index of the files of the virtual filesystem, built on first enumeration
+   after asset_init(). Enumerations and positive existence checks are answered
+   from it. Paths not found in the index are looked up in the regular way */
+typedef struct vfsindex_t vfsindex_t;
+struct vfsindex_t {
+    DARRAY(char*, path); /* all files in the order enumerated by foreach_file() */
+    int* by_path; /* indices of path[] sorted by path */
+    int* by_folded_path; /* indices of path[] sorted by case-insensitive path */
+};
+
+static vfsindex_t* vfs_index = NULL;
+static bool can_use_index = false; /* the index is not used while the filesystem is being set up */
+static int index_iterations = 0; /* the index can't be released while iterating over it */
+static bool is_index_stale = false;
+static void build_index();
+static void release_index();
+static void invalidate_index();
+static void index_directory(char* buffer, size_t length);
+static const char* index_find(const char* virtual_path);
+static bool index_foreach(const char* virtual_dirpath, const char* extension_filter, int (*callback)(const char* virtual_path, void* user_data), void* user_data, bool recursive);
+static int index_path_cmp(const void* a, const void* b);
+static int index_folded_path_cmp(const void* a, const void* b);
 
 static ALLEGRO_STATE state;
 static ALLEGRO_PATH* find_exedir();
@@ -98,10 +134,43 @@ static char* generate_user_datadirname(const char* game_name, char* buffer, size
 static bool is_valid_root_folder();
 static char* find_root_directory(const char* mount_point, char* buffer, size_t buffer_size);
 static bool is_writable_folder(const char* absolute_path);
+static bool mount_mapped_archive(const char* fullpath, const char* mount_point);
+static void unmap_archive(void* data);
 
 static ALLEGRO_PATH* create_path_at_cache(const char* filename, const char* dirpath);
-static bool clear_cached_games();
-static bool clear_cached_files(const char* folder_name, time_t time_to_live);
+
+/* Application cache manager */
+#define CACHE_INDEX_FILE                "cache.index" /* at the root of the cache */
+#define CACHE_INDEX_VERSION             "#cacheindex 1"
+#define CACHE_DEFAULT_BUDGET            (256 * 1024 * 1024) /* disk budget, in bytes */
+#define CACHE_TIME_TO_LIVE              (3 * 86400) /* evict files that haven't been accessed in 3 days */
+#define CACHE_CLEANUP_DELAY             5.0 /* start cleaning up after the boot, in seconds */
+typedef struct cacheentry_t cacheentry_t;
+struct cacheentry_t {
+    char* relative_path; /* relative to the root of the cache, using '/' as the separator */
+    int64_t size; /* file size in bytes */
+    time_t last_access;
+};
+static DARRAY(cacheentry_t, cache_entries); /* owned by the cache thread until it's joined */
+static DARRAY(char*, cache_accesses); /* relative paths requested in this session; guarded by cache_mutex */
+static ALLEGRO_THREAD* cache_thread = NULL;
+static ALLEGRO_MUTEX* cache_mutex = NULL;
+static char cache_root[1024] = ""; /* absolute path of the cache, without a trailing separator */
+static int64_t cache_budget = CACHE_DEFAULT_BUDGET;
+static time_t session_time = 0;
+static bool is_cache_index_loaded = false;
+static void start_cache_manager();
+static void stop_cache_manager();
+static void* cache_manager_thread(ALLEGRO_THREAD* thread, void* arg);
+static void record_cache_access(const char* relative_path);
+static bool was_accessed_in_this_session(const char* relative_path);
+static void load_cache_index();
+static bool save_cache_index();
+static void scan_cache_dir(ALLEGRO_FS_ENTRY* entry, const cacheentry_t* index, size_t index_length, ALLEGRO_THREAD* thread);
+static int evict_cached_files(ALLEGRO_THREAD* thread);
+static void release_cache_entries();
+static int cache_entry_path_cmp(const void* a, const void* b);
+static int cache_entry_access_cmp(const void* a, const void* b);
 
 static bool is_uncompressed_gamedir(const char* fullpath, bool* is_legacy_gamedir);
 static bool is_compressed_gamedir(const char* fullpath, bool* is_legacy_gamedir);
@@ -109,7 +178,17 @@ static bool is_gamedir(const char* root, bool (*file_exists)(const char*,void*),
 static bool actual_file_exists(const char* filepath, void* context);
 static bool virtual_file_exists(const char* filepath, void* context);
 
+/* Compatibility pack */
+#define COMPATIBILITY_PACK_FILE         "compatibility.pak" /* in the write directory */
+#define COMPATIBILITY_PACK_KEY_FILE     "compatibility.pak.key"
+#define COMPATIBILITY_PACK_VERSION      "1" /* change when modifying the contents of the pack */
 static void setup_compatibility_pack(const char* shared_dirpath, const char* engine_version, uint32_t game_id, const char* guessed_game_title);
+static uint64_t compatibility_pack_key(const char* shared_dirpath, const char* engine_version, uint32_t game_id, const char* guessed_game_title);
+static bool mount_cached_compatibility_pack(uint64_t key);
+static bool cache_compatibility_pack(uint64_t key, const void* pack_data, size_t pack_size);
+static char* compatibility_pack_path(const char* filename, char* buffer, size_t buffer_size);
+static int hash_compatibility_file(const char* vpath, void* context);
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t size);
 static int scan_translations(const char* vpath, void* context);
 static int append_translations(const char* vpath, void* context);
 static size_t crlf_to_lf(uint8_t* data, size_t size);
@@ -189,8 +268,11 @@ void asset_init(const char* argv0, const char* optional_gamedir, const char* com
         /* Get the name of the folder of the game */
         find_gamedirname(gamedir, game_dirname, sizeof(game_dirname));
 
-        /* mount gamedir to the root */
-        if(!PHYSFS_mount(gamedir, "/", 1))
+        /* mount gamedir to the root. Archives are memory-mapped if possible,
+           so that physfs reads their contents without extra I/O calls */
+        if(!(mode & ALLEGRO_FILEMODE_ISDIR) && mount_mapped_archive(gamedir, "/"))
+            LOG("Mapped the game archive to memory");
+        else if(!PHYSFS_mount(gamedir, "/", 1))
             CRASH("Can't mount the game directory at %s. Error: %s", gamedir, PHYSFSx_getLastErrorMessage());
         LOG("Mounting gamedir: %s", gamedir);
 
@@ -435,8 +517,11 @@ void asset_init(const char* argv0, const char* optional_gamedir, const char* com
     if(out_compatibility_version_code != NULL)
         *out_compatibility_version_code = compatibility_version_code;
 
-    /* clear cached games */
-    clear_cached_games();
+    /* start the cache manager. Old cached files are evicted on a background thread */
+    start_cache_manager();
+
+    /* the virtual filesystem is set up */
+    can_use_index = true;
 
     /* enable the physfs file interface. This should be the last task
        performed in this function (e.g., see create_dir()) */
@@ -459,6 +544,13 @@ void asset_release()
     /* log */
     LOG("Releasing the asset manager...");
 
+    /* stop the cache manager */
+    stop_cache_manager();
+
+    /* release the index */
+    can_use_index = false;
+    release_index();
+
     /* release the gamedir string, if any */
     if(gamedir != NULL) {
         free(gamedir);
@@ -503,6 +595,9 @@ bool asset_is_init()
  */
 bool asset_exists(const char* virtual_path)
 {
+    if(index_find(virtual_path) != NULL)
+        return true;
+
     if(PHYSFS_exists(virtual_path))
         return true;
 
@@ -520,6 +615,11 @@ bool asset_exists(const char* virtual_path)
  */
 const char* asset_path(const char* virtual_path)
 {
+    /* the virtual path is indexed */
+    const char* indexed_path = index_find(virtual_path);
+    if(indexed_path != NULL)
+        return indexed_path; /* valid until the index is invalidated */
+
     /* the virtual path exists on the virtual filesystem */
     if(PHYSFS_exists(virtual_path))
         return virtual_path;
@@ -545,10 +645,31 @@ const char* asset_path(const char* virtual_path)
 void asset_foreach_file(const char* virtual_path_of_directory, const char* extension_filter, int (*callback)(const char* virtual_path, void* user_data), void* user_data, bool recursive)
 {
     ALLEGRO_PATH* dirpath = al_create_path_for_directory(virtual_path_of_directory);
-    foreach_file(dirpath, extension_filter, callback, user_data, recursive);
+    const char* virtual_dirpath = al_path_cstr(dirpath, '/');
+
+    /* build the index on first use */
+    if(vfs_index == NULL && can_use_index)
+        build_index();
+
+    /* enumerate the files using the index, if possible */
+    if(vfs_index == NULL || *virtual_dirpath == '/') /* absolute paths are not indexed */
+        foreach_file(dirpath, extension_filter, callback, user_data, recursive);
+    else
+        index_foreach(virtual_dirpath, extension_filter, callback, user_data, recursive);
+
     al_destroy_path(dirpath);
 }
 
+/*
+ * asset_invalidate_index()
+ * Call this after creating or removing files of the virtual
+ * filesystem, so that enumerations will find them
+ */
+void asset_invalidate_index()
+{
+    invalidate_index();
+}
+
 /*
  * asset_purge_user_data()
  * Purge the user-space data. Return false on error.
@@ -714,7 +835,9 @@ bool asset_is_valid_gamedir(const char* fullpath, bool* is_legacy_gamedir)
  * asset_cache_path()
  * Generate the absolute path of a file or directory stored in the application cache.
  * If a directory is requested, its relative_path must include a trailing directory
- * separator (slash). Subdirectories will be created as needed.
+ * separator (slash). Subdirectories will be created as needed. The access is
+ * recorded by the cache manager, which won't evict the file in this session.
+ * Returns an empty string if there is no application cache.
  */
 char* asset_cache_path(const char* relative_path, char* buffer, size_t buffer_size)
 {
@@ -725,6 +848,13 @@ char* asset_cache_path(const char* relative_path, char* buffer, size_t buffer_si
         return buffer;
     *buffer = '\0';
 
+#if !(HAVE_CACHE_DIR)
+    /* there is no application cache */
+    (void)path;
+    (void)relative_path;
+    return buffer;
+#endif
+
     /* do we just want the absolute path of the cache directory? */
     if(relative_path == NULL || *relative_path == '\0')
         relative_path = "/";
@@ -755,10 +885,32 @@ char* asset_cache_path(const char* relative_path, char* buffer, size_t buffer_si
         al_destroy_path(cache);
     }
 
+    /* protect the file from eviction */
+    record_cache_access(relative_path);
+
     /* done! */
     return buffer;
 }
 
+/*
+ * asset_set_cache_budget()
+ * Set the disk budget of the application cache, in bytes. The least recently
+ * used files are evicted when the cache exceeds its budget. Call before asset_init()
+ */
+void asset_set_cache_budget(size_t budget)
+{
+    cache_budget = (int64_t)budget;
+}
+
+/*
+ * asset_cache_budget()
+ * The disk budget of the application cache, in bytes
+ */
+size_t asset_cache_budget()
+{
+    return (size_t)cache_budget;
+}
+
 
 
 /*
@@ -1018,30 +1170,6 @@ bool clear_dir_predicate_true(ALLEGRO_FS_ENTRY* entry, void* context)
     return true;
 }
 
-/*
- * clear_dir_predicate_coldfile()
- * A predicate for clear_dir_ex() that checks if an entry is a regular file
- * that hasn't been accessed lately
- */
-bool clear_dir_predicate_coldfile(ALLEGRO_FS_ENTRY* entry, void* context)
-{
-    uint32_t mode = al_get_fs_entry_mode(entry);
-
-#if 0
-    if(!(mode & ALLEGRO_FILEMODE_ISFILE)) /* ISFILE not reliable on Android?! */
-        return false;
-#else
-    if(mode & ALLEGRO_FILEMODE_ISDIR)
-        return false;
-#endif
-
-    time_t time_to_live = *((time_t*)context); /* given in seconds */
-    time_t last_access = al_get_fs_entry_atime(entry);
-    time_t current_time = time(NULL); /* y2k38 */
-
-    return current_time > last_access + time_to_live;
-}
-
 /*
  * get_fs_mode()
  * Returns the mode flags (ALLEGRO_FILE_MODE) of a filesystem entry
@@ -1302,84 +1430,455 @@ ALLEGRO_PATH* create_path_at_cache(const char* filename, const char* dirpath)
     return cache;
 }
 
+
+
+
 /*
- * clear_cached_games()
- * Clear games that have not been accessed lately from the application cache.
- * Return true on success.
+ *
+ * cache manager
+ *
  */
-bool clear_cached_games()
+
+/*
+ * THE CACHE MANAGER
+ *
+ * The application cache is shared by the mod loader (cached games), the
+ * lexer (cached tokens of the scripts), the shaders (program binaries), the
+ * images (LODs) and the stage select screen (metadata of the levels). It
+ * used to be cleared synchronously when initializing the asset manager: a
+ * large cache would slow down the boot.
+ *
+ * We keep a persistent index with the size and the last access time of each
+ * cached file. We don't rely on the atime of the filesystem, which is often
+ * mounted with noatime. After the boot, a background thread scans the cache,
+ * merges it with the index, evicts the files that haven't been accessed for
+ * a while and then evicts the least recently used files until the cache fits
+ * its disk budget. Files requested via asset_cache_path() in this session
+ * are never evicted. The index is saved when releasing the asset manager.
+ */
+
+/*
+ * start_cache_manager()
+ * Start the cache manager
+ */
+void start_cache_manager()
 {
-    const time_t MAX_DAYS = 3;
-    const time_t SECONDS_IN_A_DAY = 86400;
-    const time_t TIME_TO_LIVE = MAX_DAYS * SECONDS_IN_A_DAY;
+#if HAVE_CACHE_DIR
+    ALLEGRO_PATH* path;
+
+    assertx(cache_thread == NULL);
+
+    darray_init(cache_entries);
+    darray_init(cache_accesses);
+    is_cache_index_loaded = false;
+    session_time = time(NULL); /* y2k38 */
+
+    /* find the cache directory on the main thread */
+    if(NULL == (path = create_path_at_cache(NULL, ""))) {
+        WARN("No cache directory was found");
+        return;
+    }
 
-    return clear_cached_files("games", TIME_TO_LIVE);
+    al_set_path_filename(path, NULL);
+    str_cpy(cache_root, al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP), sizeof(cache_root));
+    al_destroy_path(path);
+
+    size_t len = strlen(cache_root);
+    while(len > 1 && cache_root[len-1] == ALLEGRO_NATIVE_PATH_SEP)
+        cache_root[--len] = '\0';
+
+    /* start the background thread */
+    if(NULL == (cache_mutex = al_create_mutex())) {
+        WARN("Can't create the mutex of the cache manager");
+        return;
+    }
+
+    if(NULL == (cache_thread = al_create_thread(cache_manager_thread, NULL))) {
+        WARN("Can't create the thread of the cache manager");
+        return;
+    }
+
+    LOG("Starting the cache manager with a budget of %lld KB...", (long long)(cache_budget / 1024));
+    al_start_thread(cache_thread);
+#else
+    LOG("The cache manager is unsupported");
+#endif
 }
 
 /*
- * clear_cached_files()
- * Clear all files from a sub-folder of the application cache directory that
- * have not been accessed for time_to_live seconds. Return true on success.
+ * stop_cache_manager()
+ * Stop the cache manager, saving the index of the cache
  */
-bool clear_cached_files(const char* folder_name, time_t time_to_live)
+void stop_cache_manager()
 {
 #if HAVE_CACHE_DIR
+    /* wait for the background thread. It checks al_get_thread_should_stop() often */
+    if(cache_thread != NULL) {
+        al_join_thread(cache_thread, NULL);
+        al_destroy_thread(cache_thread);
+        cache_thread = NULL;
+
+        /* record the accesses of this session */
+        if(is_cache_index_loaded)
+            save_cache_index();
+    }
 
+    /* release the data */
+    release_cache_entries();
+
+    for(size_t i = 0; i < darray_length(cache_accesses); i++)
+        free(cache_accesses[i]);
+    darray_release(cache_accesses);
+
+    if(cache_mutex != NULL) {
+        al_destroy_mutex(cache_mutex);
+        cache_mutex = NULL;
+    }
+
+    *cache_root = '\0';
+#endif
+}
+
+/*
+ * cache_manager_thread()
+ * Cleans up the application cache in the background
+ */
+void* cache_manager_thread(ALLEGRO_THREAD* thread, void* arg)
+{
     ALLEGRO_STATE state;
-    bool error = true;
+    ALLEGRO_FS_ENTRY* entry;
+    const double dt = 0.1;
     int n = 0;
 
-    assertx(al_is_system_installed());
+    (void)arg;
+
+    /* don't compete with the I/O of the boot */
+    for(double t = 0.0; t < CACHE_CLEANUP_DELAY; t += dt) {
+        if(al_get_thread_should_stop(thread))
+            return NULL;
+        al_rest(dt);
+    }
+
+    /* the file interface is thread-local. Use the native filesystem */
     al_store_state(&state, ALLEGRO_STATE_NEW_FILE_INTERFACE);
     al_set_standard_file_interface();
+    al_set_standard_fs_interface();
 
-    ALLEGRO_PATH* path = create_path_at_cache(NULL, folder_name);
-    if(path == NULL) {
-        WARN("No cache directory was found");
-        goto finally;
+    /* load the index of the cache */
+    load_cache_index();
+    is_cache_index_loaded = true;
+
+    /* scan the cache, keeping the last access times of the index */
+    if(NULL != (entry = al_create_fs_entry(cache_root))) {
+        cacheentry_t* index = cache_entries;
+        size_t index_length = darray_length(cache_entries);
+
+        qsort(index, index_length, sizeof(*index), cache_entry_path_cmp);
+        darray_init(cache_entries);
+
+        if(al_fs_entry_exists(entry))
+            scan_cache_dir(entry, index, index_length, thread);
+
+        for(size_t i = 0; i < index_length; i++)
+            free(index[i].relative_path);
+        free(index);
+
+        al_destroy_fs_entry(entry);
     }
 
-    ALLEGRO_FS_ENTRY* entry = al_create_fs_entry(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
-    if(entry == NULL) {
-        WARN("No cache filesystem entry was found");
-        goto finally;
+    /* evict old files */
+    if(!al_get_thread_should_stop(thread)) {
+        if((n = evict_cached_files(thread)) > 0)
+            LOG("Removed %d cached file%s", n, n != 1 ? "s" : "");
+        else
+            LOG("No cached files to clear");
+    }
+
+    /* save the index now, in case the app gets killed */
+    save_cache_index();
+
+    /* done */
+    al_restore_state(&state);
+    return NULL;
+}
+
+/*
+ * record_cache_access()
+ * Record that a file or a directory of the cache was requested in this session
+ */
+void record_cache_access(const char* relative_path)
+{
+    while(*relative_path == '/' || *relative_path == '\\')
+        relative_path++;
+
+    /* the root of the cache doesn't count */
+    if(*relative_path == '\0' || cache_mutex == NULL)
+        return;
+
+    al_lock_mutex(cache_mutex);
+
+    if(!was_accessed_in_this_session(relative_path))
+        darray_push(cache_accesses, str_dup(relative_path));
+
+    al_unlock_mutex(cache_mutex);
+}
+
+/*
+ * was_accessed_in_this_session()
+ * Checks if a file of the cache was requested in this session. A requested
+ * directory also covers its contents, and a requested file also covers its
+ * sidecar files (e.g., "game.zip" covers "game.zip.hash"). Lock cache_mutex
+ */
+bool was_accessed_in_this_session(const char* relative_path)
+{
+    for(size_t i = 0; i < darray_length(cache_accesses); i++) {
+        if(str_startswith(relative_path, cache_accesses[i]))
+            return true;
     }
 
-    if(al_fs_entry_exists(entry)) {
-        LOG("Clearing cached files at %s/...", folder_name);
-        clear_dir_ex(entry, &n, clear_dir_predicate_coldfile, &time_to_live);
+    return false;
+}
+
+/*
+ * load_cache_index()
+ * Load the persistent index of the cache into cache_entries
+ */
+void load_cache_index()
+{
+    char path[sizeof(cache_root) + 64], line[1024 + 64];
+    long long size, last_access;
+    int offset;
+    FILE* fp;
+
+    snprintf(path, sizeof(path), "%s%c%s", cache_root, ALLEGRO_NATIVE_PATH_SEP, CACHE_INDEX_FILE);
+    if(NULL == (fp = fopen_utf8(path, "r")))
+        return;
+
+    /* check the version */
+    if(fgets(line, sizeof(line), fp) == NULL || 0 != strncmp(line, CACHE_INDEX_VERSION, strlen(CACHE_INDEX_VERSION))) {
+        LOG("Ignoring an incompatible cache index");
+        fclose(fp);
+        return;
     }
 
-    if(n > 0)
-        LOG("Removed %d cached file%s at %s/", n, n != 1 ? "s" : "", folder_name);
-    else
-        LOG("No cached files to clear at %s/", folder_name);
+    /* read the entries: size last_access relative_path */
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = '\0';
 
-    error = false; /* success! */
+        if(sscanf(line, "%lld %lld %n", &size, &last_access, &offset) < 2 || line[offset] == '\0')
+            continue;
 
+        cacheentry_t entry = {
+            .relative_path = str_dup(line + offset),
+            .size = size,
+            .last_access = (time_t)last_access
+        };
 
+        darray_push(cache_entries, entry);
+    }
 
-    finally:
+    fclose(fp);
+}
 
-    if(entry != NULL)
-        al_destroy_fs_entry(entry);
+/*
+ * save_cache_index()
+ * Save cache_entries to the persistent index of the cache. Returns true on success
+ */
+bool save_cache_index()
+{
+    char path[sizeof(cache_root) + 64], tmp_path[sizeof(path) + 8];
+    bool success = true;
+    FILE* fp;
 
-    if(path != NULL)
-        al_destroy_path(path);
+    snprintf(path, sizeof(path), "%s%c%s", cache_root, ALLEGRO_NATIVE_PATH_SEP, CACHE_INDEX_FILE);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
 
-    al_restore_state(&state);
-    return !error;
+    if(NULL == (fp = fopen_utf8(tmp_path, "w"))) {
+        LOG("Can't write the cache index to %s", tmp_path);
+        return false;
+    }
 
-#else
+    /* the files requested in this session were just accessed */
+    if(cache_mutex != NULL)
+        al_lock_mutex(cache_mutex);
+
+    fprintf(fp, "%s\n", CACHE_INDEX_VERSION);
+    for(size_t i = 0; i < darray_length(cache_entries); i++) {
+        const cacheentry_t* entry = &cache_entries[i];
+        time_t last_access = was_accessed_in_this_session(entry->relative_path) ? session_time : entry->last_access;
 
-    (void)folder_name;
-    (void)time_to_live;
+        fprintf(fp, "%lld %lld %s\n", (long long)entry->size, (long long)last_access, entry->relative_path);
+    }
 
-    LOG("%s: unsupported", __func__);
+    if(cache_mutex != NULL)
+        al_unlock_mutex(cache_mutex);
+
+    /* replace the index atomically */
+    success = (0 == ferror(fp));
+    success = (0 == fclose(fp)) && success;
+    if(!success || 0 != rename(tmp_path, path)) {
+        LOG("Can't save the cache index to %s", path);
+        remove(tmp_path);
+        return false;
+    }
 
     return true;
+}
 
-#endif
+/*
+ * scan_cache_dir()
+ * Add the files of a directory of the cache to cache_entries, recursively.
+ * The last access times are taken from the (sorted) index, when available
+ */
+void scan_cache_dir(ALLEGRO_FS_ENTRY* entry, const cacheentry_t* index, size_t index_length, ALLEGRO_THREAD* thread)
+{
+    size_t root_length = strlen(cache_root);
+    ALLEGRO_FS_ENTRY* next;
+
+    if(!al_open_directory(entry)) {
+        WARN("Can't open directory %s. %s. errno = %d", al_get_fs_entry_name(entry), strerror(al_get_errno()), al_get_errno());
+        return;
+    }
+
+    while(NULL != (next = al_read_directory(entry))) {
+        uint32_t mode = al_get_fs_entry_mode(next);
+        const char* name = al_get_fs_entry_name(next);
+
+        /* stop early if requested */
+        if(al_get_thread_should_stop(thread)) {
+            al_destroy_fs_entry(next);
+            break;
+        }
+
+        /* recurse on directories */
+        if(mode & ALLEGRO_FILEMODE_ISDIR) {
+            scan_cache_dir(next, index, index_length, thread);
+            al_destroy_fs_entry(next);
+            continue;
+        }
+
+        /* find the path relative to the root of the cache */
+        const char* relative_path = name;
+        if(0 == strncmp(name, cache_root, root_length))
+            relative_path += root_length;
+        while(*relative_path == ALLEGRO_NATIVE_PATH_SEP)
+            relative_path++;
+
+        /* skip the index */
+        if(0 == strcmp(relative_path, CACHE_INDEX_FILE) || str_startswith(relative_path, CACHE_INDEX_FILE ".")) {
+            al_destroy_fs_entry(next);
+            continue;
+        }
+
+        /* add the file. We take the modification time into account, because
+           cached files may be rewritten without going through the index */
+        cacheentry_t key = { .relative_path = (char*)relative_path };
+        const cacheentry_t* indexed = bsearch(&key, index, index_length, sizeof(*index), cache_entry_path_cmp);
+        time_t last_access = (indexed != NULL) ? indexed->last_access : al_get_fs_entry_atime(next);
+        time_t mtime = al_get_fs_entry_mtime(next);
+
+        cacheentry_t file = {
+            .relative_path = str_dup(relative_path),
+            .size = (int64_t)al_get_fs_entry_size(next),
+            .last_access = (mtime > last_access) ? mtime : last_access
+        };
+
+        darray_push(cache_entries, file);
+
+        /* we're done with this entry */
+        al_destroy_fs_entry(next);
+    }
+
+    if(!al_close_directory(entry))
+        WARN("Can't close directory %s. %s. errno = %d", al_get_fs_entry_name(entry), strerror(al_get_errno()), al_get_errno());
+}
+
+/*
+ * evict_cached_files()
+ * Remove the files that haven't been accessed for a while and then the least
+ * recently used files until the cache fits its budget. Returns the number of
+ * removed files
+ */
+int evict_cached_files(ALLEGRO_THREAD* thread)
+{
+    char path[2048];
+    int64_t total_size = 0;
+    size_t i, j, n = 0;
+
+    /* sort the files from the least to the most recently used */
+    qsort(cache_entries, darray_length(cache_entries), sizeof(*cache_entries), cache_entry_access_cmp);
+
+    for(i = 0; i < darray_length(cache_entries); i++)
+        total_size += cache_entries[i].size;
+
+    LOG("The application cache has %d file%s using %lld KB", (int)darray_length(cache_entries), darray_length(cache_entries) != 1 ? "s" : "", (long long)(total_size / 1024));
+
+    for(i = 0; i < darray_length(cache_entries) && !al_get_thread_should_stop(thread); i++) {
+        cacheentry_t* entry = &cache_entries[i];
+        bool is_expired = (session_time > entry->last_access + CACHE_TIME_TO_LIVE);
+
+        /* the remaining files are recent and fit the budget */
+        if(!is_expired && total_size <= cache_budget)
+            break;
+
+        /* files requested in this session are kept. We hold the lock while
+           removing, so that asset_cache_path() won't hand out removed files */
+        al_lock_mutex(cache_mutex);
+        if(!was_accessed_in_this_session(entry->relative_path)) {
+            snprintf(path, sizeof(path), "%s%c%s", cache_root, ALLEGRO_NATIVE_PATH_SEP, entry->relative_path);
+
+            if(al_remove_filename(path)) {
+                total_size -= entry->size;
+                entry->size = -1; /* mark as removed */
+                n++;
+            }
+            else
+                WARN("Can't remove %s. %s. errno = %d", path, strerror(al_get_errno()), al_get_errno());
+        }
+        al_unlock_mutex(cache_mutex);
+    }
+
+    /* drop the removed files from the index */
+    for(i = j = 0; i < darray_length(cache_entries); i++) {
+        if(cache_entries[i].size >= 0)
+            cache_entries[j++] = cache_entries[i];
+        else
+            free(cache_entries[i].relative_path);
+    }
+    darray_resize(cache_entries, j);
+
+    return (int)n;
+}
+
+/*
+ * release_cache_entries()
+ * Release the entries of the cache index
+ */
+void release_cache_entries()
+{
+    for(size_t i = 0; i < darray_length(cache_entries); i++)
+        free(cache_entries[i].relative_path);
+
+    darray_release(cache_entries);
+}
+
+/* compare cache entries by relative path */
+int cache_entry_path_cmp(const void* a, const void* b)
+{
+    const cacheentry_t* x = (const cacheentry_t*)a;
+    const cacheentry_t* y = (const cacheentry_t*)b;
+
+    return strcmp(x->relative_path, y->relative_path);
+}
+
+/* compare cache entries by last access time */
+int cache_entry_access_cmp(const void* a, const void* b)
+{
+    const cacheentry_t* x = (const cacheentry_t*)a;
+    const cacheentry_t* y = (const cacheentry_t*)b;
+
+    return (x->last_access > y->last_access) - (x->last_access < y->last_access);
 }
 
 
@@ -1431,6 +1930,9 @@ bool is_compressed_gamedir(const char* fullpath, bool* is_legacy_gamedir)
         logfile_message("%s: can't unmount %s. %s", __func__, fullpath, err);
     }
 
+    /* the mount points have changed */
+    invalidate_index();
+
     return ret;
 }
 
@@ -1541,6 +2043,12 @@ void setup_compatibility_pack(const char* shared_dirpath, const char* engine_ver
     if(!has_pak_support())
         CRASH("Compatibility mode is not available because PhysFS has been compiled without PAK support.");
 
+    /* reuse the compatibility pack of a previous launch if it's up to date.
+       This spares us from reading all the files again */
+    uint64_t key = compatibility_pack_key(shared_dirpath, engine_version, game_id, guessed_game_title);
+    if(mount_cached_compatibility_pack(key))
+        return;
+
 
 
     /*
@@ -1677,17 +2185,16 @@ void setup_compatibility_pack(const char* shared_dirpath, const char* engine_ver
     if(!generate_pak_file((const char**)file_vpath, file_count, (const void**)file_data, file_size, &pack_data, &pack_size))
         CRASH("Can't build a compatibility pack from %s", shared_dirpath);
 
-    /* mount the compatibility pack with higher precedence */
-    if(!PHYSFS_mountMemory(pack_data, pack_size, release_pak_file, "compatibility.pak", "/", 0)) {
+    /* write the compatibility pack to secondary storage and mount it from
+       there with higher precedence. If we can't, mount it from memory */
+    if(cache_compatibility_pack(key, pack_data, pack_size) && mount_cached_compatibility_pack(key)) {
+        release_pak_file(pack_data);
+    }
+    else if(!PHYSFS_mountMemory(pack_data, pack_size, release_pak_file, COMPATIBILITY_PACK_FILE, "/", 0)) {
         release_pak_file(pack_data);
         CRASH("Can't mount the compatibility pack. Error: %s", PHYSFSx_getLastErrorMessage());
     }
 
-    /* write the compatibility pack to secondary storage
-       (for debugging purposes) */
-    if(!write_file("compatibility.pak", pack_data, pack_size))
-        WARN("Can't write the compatibility pack to the disk!");
-
     /* cleanup */
     if(file_size != NULL)
         free(file_size);
@@ -1709,6 +2216,167 @@ void setup_compatibility_pack(const char* shared_dirpath, const char* engine_ver
     }
 }
 
+/*
+ * compatibility_pack_key()
+ * A key that identifies the contents of the compatibility pack. It changes
+ * whenever the engine, the game or the source files of the pack change
+ */
+uint64_t compatibility_pack_key(const char* shared_dirpath, const char* engine_version, uint32_t game_id, const char* guessed_game_title)
+{
+    uint64_t hash = UINT64_C(14695981039346656037);
+
+    /* the parameters of the pack */
+    hash = fnv1a(hash, COMPATIBILITY_PACK_VERSION, sizeof(COMPATIBILITY_PACK_VERSION));
+    hash = fnv1a(hash, GAME_VERSION_STRING, sizeof(GAME_VERSION_STRING));
+    hash = fnv1a(hash, engine_version, strlen(engine_version) + 1);
+    hash = fnv1a(hash, &game_id, sizeof(game_id));
+    hash = fnv1a(hash, guessed_game_title, strlen(guessed_game_title) + 1);
+
+    /* the size and the modification time of the source files. We don't hash
+       their contents, as that would mean reading all of them again */
+    asset_foreach_file("languages/", ".lng", hash_compatibility_file, &hash, true);
+    hash_compatibility_file("surge.cfg", &hash);
+
+    /* mount the default shared data directory with higher precedence */
+    if(!PHYSFS_mount(shared_dirpath, "/", 0))
+        CRASH("Can't mount the shared data directory at %s. Error: %s", shared_dirpath, PHYSFSx_getLastErrorMessage());
+
+#if defined(__ANDROID__)
+    /* on Android, read from the assets/ folder inside the .apk */
+    PHYSFS_setRoot(shared_dirpath, "/assets");
+#endif
+
+    asset_foreach_file("languages/", ".lng", hash_compatibility_file, &hash, true);
+
+    const char** file_list = select_files_for_compatibility_pack(engine_version, game_id);
+    for(const char** vpath = file_list; *vpath != NULL; vpath++)
+        hash_compatibility_file(*vpath, &hash);
+
+    /* unmount the default shared data directory */
+    if(!PHYSFS_unmount(shared_dirpath))
+        CRASH("Can't unmount the shared data directory at %s. Error: %s", shared_dirpath, PHYSFSx_getLastErrorMessage());
+
+    /* done! */
+    return hash;
+}
+
+/*
+ * mount_cached_compatibility_pack()
+ * Mount the compatibility pack stored in the write directory if its key
+ * matches the given key. Returns true on success
+ */
+bool mount_cached_compatibility_pack(uint64_t key)
+{
+    char pack_path[ASSET_PATH_MAX], key_path[ASSET_PATH_MAX], line[32];
+    unsigned long long stored_key = 0;
+    bool matches = false;
+    FILE* fp;
+
+    /* read the stored key */
+    if(NULL == (fp = fopen_utf8(compatibility_pack_path(COMPATIBILITY_PACK_KEY_FILE, key_path, sizeof(key_path)), "r")))
+        return false;
+
+    if(fgets(line, sizeof(line), fp) != NULL && sscanf(line, "%llx", &stored_key) == 1)
+        matches = ((uint64_t)stored_key == key);
+
+    fclose(fp);
+
+    if(!matches) {
+        LOG("The cached compatibility pack is outdated");
+        return false;
+    }
+
+    /* mount the compatibility pack with higher precedence */
+    compatibility_pack_path(COMPATIBILITY_PACK_FILE, pack_path, sizeof(pack_path));
+    if(!PHYSFS_mount(pack_path, "/", 0)) {
+        LOG("Can't mount the cached compatibility pack at %s. Error: %s", pack_path, PHYSFSx_getLastErrorMessage());
+        return false;
+    }
+
+    LOG("Mounted the compatibility pack at %s", pack_path);
+    return true;
+}
+
+/*
+ * cache_compatibility_pack()
+ * Write the compatibility pack and its key to the write directory.
+ * Returns true on success
+ */
+bool cache_compatibility_pack(uint64_t key, const void* pack_data, size_t pack_size)
+{
+    char buffer[32];
+
+    /* invalidate the previous pack before overwriting it */
+    PHYSFS_delete(COMPATIBILITY_PACK_KEY_FILE);
+
+    if(!write_file(COMPATIBILITY_PACK_FILE, (void*)pack_data, pack_size)) {
+        WARN("Can't write the compatibility pack to the disk!");
+        return false;
+    }
+
+    /* the key is written last; it validates the pack */
+    int length = snprintf(buffer, sizeof(buffer), "%016llx\n", (unsigned long long)key);
+    if(!write_file(COMPATIBILITY_PACK_KEY_FILE, buffer, length)) {
+        WARN("Can't write the key of the compatibility pack to the disk!");
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * compatibility_pack_path()
+ * The absolute path of a file of the compatibility pack in the write directory
+ */
+char* compatibility_pack_path(const char* filename, char* buffer, size_t buffer_size)
+{
+    const char* write_dir = PHYSFS_getWriteDir();
+    const char* separator = PHYSFS_getDirSeparator();
+    size_t len = (write_dir != NULL) ? strlen(write_dir) : 0;
+
+    /* PHYSFS_getWriteDir() may or may not include a trailing separator */
+    if(len > 0 && 0 == strcmp(write_dir + len - strlen(separator), separator))
+        separator = "";
+
+    snprintf(buffer, buffer_size, "%s%s%s", write_dir != NULL ? write_dir : "", separator, filename);
+    return buffer;
+}
+
+/*
+ * hash_compatibility_file()
+ * Hash the virtual path, the size and the modification time of a source
+ * file of the compatibility pack. Also a callback for asset_foreach_file()
+ */
+int hash_compatibility_file(const char* vpath, void* context)
+{
+    uint64_t* hash = (uint64_t*)context;
+    PHYSFS_Stat stat;
+
+    *hash = fnv1a(*hash, vpath, strlen(vpath) + 1);
+
+    if(PHYSFS_stat(vpath, &stat)) {
+        int64_t size = stat.filesize, mtime = stat.modtime;
+        *hash = fnv1a(*hash, &size, sizeof(size));
+        *hash = fnv1a(*hash, &mtime, sizeof(mtime));
+    }
+
+    return 0;
+}
+
+/*
+ * fnv1a()
+ * FNV-1a hash function
+ */
+uint64_t fnv1a(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+
+    while(size-- > 0)
+        hash = (hash ^ *(p++)) * UINT64_C(1099511628211);
+
+    return hash;
+}
+
 /*
  * scan_translation()
  * This callback for asset_foreach_file() scans the .lng files
@@ -1952,6 +2620,287 @@ bool generate_pak_file(const char** vpath, int file_count, const void** file_dat
     return false;
 }
 
+/*
+ * build_index()
+ * Indexes all files of the virtual filesystem
+ */
+void build_index()
+{
+    char buffer[ASSET_PATH_MAX] = "";
+
+    assertx(vfs_index == NULL);
+    vfs_index = mallocx(sizeof *vfs_index);
+    darray_init_ex(vfs_index->path, 1024);
+
+    /* scan the virtual filesystem, starting at the root */
+    index_directory(buffer, 0);
+
+    /* sort the paths */
+    int count = darray_length(vfs_index->path);
+    vfs_index->by_path = mallocx((1 + count) * sizeof(int));
+    vfs_index->by_folded_path = mallocx((1 + count) * sizeof(int));
+    for(int i = 0; i < count; i++)
+        vfs_index->by_path[i] = vfs_index->by_folded_path[i] = i;
+
+    qsort(vfs_index->by_path, count, sizeof(int), index_path_cmp);
+    qsort(vfs_index->by_folded_path, count, sizeof(int), index_folded_path_cmp);
+
+    /* done! */
+    is_index_stale = false;
+    LOG("Indexed %d files", count);
+}
+
+/*
+ * release_index()
+ * Releases the index of the virtual filesystem
+ */
+void release_index()
+{
+    if(vfs_index == NULL)
+        return;
+
+    for(int i = darray_length(vfs_index->path) - 1; i >= 0; i--)
+        free(vfs_index->path[i]);
+    darray_release(vfs_index->path);
+
+    free(vfs_index->by_folded_path);
+    free(vfs_index->by_path);
+    free(vfs_index);
+    vfs_index = NULL;
+}
+
+/*
+ * invalidate_index()
+ * Invalidates the index. It will be rebuilt on the next enumeration
+ */
+void invalidate_index()
+{
+    if(index_iterations > 0)
+        is_index_stale = true; /* release it later */
+    else
+        release_index();
+}
+
+/*
+ * index_directory()
+ * Recursively indexes a directory whose path, either empty (root) or
+ * ending with '/', is stored in buffer[0..length-1]
+ */
+void index_directory(char* buffer, size_t length)
+{
+    char** list = PHYSFS_enumerateFiles(buffer); /* sorted items without duplicates */
+    if(list == NULL)
+        return;
+
+    /* for each entry */
+    for(char** it = list; *it != NULL; it++) {
+        size_t name_length = strlen(*it);
+        PHYSFS_Stat stat;
+
+        /* update the path */
+        if(length + name_length + 2 > ASSET_PATH_MAX)
+            continue;
+        memcpy(buffer + length, *it, name_length + 1);
+
+        /* get information about the entry */
+        if(!PHYSFS_stat(buffer, &stat))
+            continue;
+
+        /* index a directory or a regular file */
+        if(stat.filetype == PHYSFS_FILETYPE_DIRECTORY) {
+            buffer[length + name_length] = '/';
+            buffer[length + name_length + 1] = '\0';
+            index_directory(buffer, length + name_length + 1);
+        }
+        else if(stat.filetype == PHYSFS_FILETYPE_REGULAR)
+            darray_push(vfs_index->path, str_dup(buffer));
+    }
+
+    /* cleanup */
+    buffer[length] = '\0';
+    PHYSFS_freeList(list);
+}
+
+/*
+ * index_find()
+ * Finds a file in the index, returning its actual path. A case-sensitive
+ * match is preferred. Returns NULL if the path is not indexed
+ */
+const char* index_find(const char* virtual_path)
+{
+    if(vfs_index == NULL || is_index_stale)
+        return NULL;
+
+    int count = darray_length(vfs_index->path);
+    char* const* path = vfs_index->path;
+
+    /* case-sensitive search */
+    for(int lo = 0, hi = count - 1; lo <= hi; ) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(virtual_path, path[vfs_index->by_path[mid]]);
+
+        if(cmp == 0)
+            return path[vfs_index->by_path[mid]];
+        else if(cmp < 0)
+            hi = mid - 1;
+        else
+            lo = mid + 1;
+    }
+
+    /* case-insensitive search */
+    for(int lo = 0, hi = count - 1; lo <= hi; ) {
+        int mid = (lo + hi) / 2;
+        int cmp = str_icmp(virtual_path, path[vfs_index->by_folded_path[mid]]);
+
+        if(cmp == 0)
+            return path[vfs_index->by_folded_path[mid]];
+        else if(cmp < 0)
+            hi = mid - 1;
+        else
+            lo = mid + 1;
+    }
+
+    /* not found */
+    return NULL;
+}
+
+/*
+ * index_foreach()
+ * Enumerates the indexed files of a directory, in the same order as foreach_file()
+ * virtual_dirpath must be empty or end with '/'
+ */
+bool index_foreach(const char* virtual_dirpath, const char* extension_filter, int (*callback)(const char* virtual_path, void* user_data), void* user_data, bool recursive)
+{
+    size_t prefix_length = strlen(virtual_dirpath);
+    int count = darray_length(vfs_index->path);
+    char* const* path = vfs_index->path;
+    int first = count, last = -1;
+    bool stop = false;
+
+    /* find the first path with the given prefix */
+    int lo = 0, hi = count;
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+        if(strcmp(path[vfs_index->by_path[mid]], virtual_dirpath) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    /* the files of a directory are contiguous in the depth-first order */
+    for(int j = lo; j < count && 0 == strncmp(path[vfs_index->by_path[j]], virtual_dirpath, prefix_length); j++) {
+        first = min(first, vfs_index->by_path[j]);
+        last = max(last, vfs_index->by_path[j]);
+    }
+
+    /* for each file */
+    index_iterations++;
+    for(int i = first; i <= last && !stop; i++) {
+        const char* relative_path = path[i] + prefix_length;
+        const char* filename = strrchr(path[i], '/');
+        filename = (filename != NULL) ? filename + 1 : path[i];
+
+        /* skip the files of sub-folders */
+        if(!recursive && filename != relative_path)
+            continue;
+
+        /* does the extension filter match the name of the file? */
+        if(extension_filter != NULL) {
+            if(str_icmp(extension_filter, find_extension(filename)) != 0)
+                continue;
+        }
+
+        /* invoke the callback */
+        stop = (0 != callback(path[i], user_data));
+    }
+    index_iterations--;
+
+    /* the index was invalidated during the iteration */
+    if(index_iterations == 0 && is_index_stale)
+        release_index();
+
+    return stop;
+}
+
+/* compare paths of the index */
+int index_path_cmp(const void* a, const void* b)
+{
+    int i = *((const int*)a), j = *((const int*)b);
+    return strcmp(vfs_index->path[i], vfs_index->path[j]);
+}
+
+/* compare paths of the index, ignoring case */
+int index_folded_path_cmp(const void* a, const void* b)
+{
+    int i = *((const int*)a), j = *((const int*)b);
+    return str_icmp(vfs_index->path[i], vfs_index->path[j]);
+}
+
+/*
+ * mount_mapped_archive()
+ * Maps an archive to memory and mounts it with physfs. The archive is
+ * identified by its fullpath, as if it had been mounted with PHYSFS_mount()
+ * Returns false if the archive can't be mapped; the caller should mount it
+ * in the regular way
+ */
+bool mount_mapped_archive(const char* fullpath, const char* mount_point)
+{
+#if WANT_MMAP
+    struct stat st;
+    void* data;
+    int fd;
+
+    /* open the archive */
+    if((fd = open(fullpath, O_RDONLY)) < 0) {
+        LOG("Can't open %s for mapping", fullpath);
+        return false;
+    }
+
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        LOG("Can't map %s: not a regular file", fullpath);
+        close(fd);
+        return false;
+    }
+
+    /* map it; the mapping remains valid after closing the file */
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(data == MAP_FAILED) {
+        LOG("Can't map %s", fullpath);
+        return false;
+    }
+
+    /* physfs takes ownership of the mapping */
+    mapped_archive_size = (size_t)st.st_size;
+    if(!PHYSFS_mountMemory(data, mapped_archive_size, unmap_archive, fullpath, mount_point, 1)) {
+        LOG("Can't mount the mapped archive %s. %s", fullpath, PHYSFSx_getLastErrorMessage());
+        munmap(data, mapped_archive_size);
+        mapped_archive_size = 0;
+        return false;
+    }
+
+    return true;
+#else
+    (void)unmap_archive;
+    return false;
+#endif
+}
+
+/*
+ * unmap_archive()
+ * Unmaps an archive mapped by mount_mapped_archive(). Called by physfs
+ */
+void unmap_archive(void* data)
+{
+#if WANT_MMAP
+    if(data != NULL) {
+        munmap(data, mapped_archive_size);
+        mapped_archive_size = 0;
+    }
+#endif
+}
+
 /*
  * release_pak_file()
  * Releases a .pak file previously generated with generate_pak_file()
@@ -2059,6 +3008,9 @@ bool write_file(const char* vpath, void* file_data, size_t file_size)
     /* close the file */
     al_fclose(fp);
 
+    /* a new file may have been created */
+    invalidate_index();
+
     /* success! */
     return true;
 
@@ -32,12 +32,15 @@ bool asset_is_init();
 bool asset_exists(const char* virtual_path);
 const char* asset_path(const char* virtual_path);
 void asset_foreach_file(const char* virtual_path_of_directory, const char* extension_filter, int (*callback)(const char* virtual_path, void* user_data), void* user_data, bool recursive);
+void asset_invalidate_index(); /* call after creating files */
 
 char* asset_user_datadir(char* dest, size_t dest_size);
 char* asset_shared_datadir(char* dest, size_t dest_size);
 bool asset_purge_user_data();
 
 char* asset_cache_path(const char* relative_path, char* buffer, size_t buffer_size);
+void asset_set_cache_budget(size_t budget); /* disk budget of the application cache, in bytes */
+size_t asset_cache_budget();
 
 const char* asset_writedir();
 const char* asset_gamedir();
@@ -19,11 +19,13 @@
  */
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include "audio.h"
 #include "asset.h"
 #include "resourcemanager.h"
+#include "startuptrace.h"
 #include "logfile.h"
-#include "timer.h"
 #include "video.h"
 #include "../util/util.h"
 #include "../util/stringutil.h"
@@ -32,27 +34,149 @@
 #include <allegro5/allegro.h>
 #include <allegro5/allegro_audio.h>
 #include <allegro5/allegro_acodec.h>
+#include <allegro5/allegro_physfs.h>
 
 /* music structure */
 struct music_t {
     ALLEGRO_AUDIO_STREAM* stream;
     bool is_paused;
+    float volume; /* gain of the stream, unless it's crossfading */
     char* filepath; /* relative path */
+    size_t size; /* size of the buffers of the stream, in bytes */
 };
 
 /* sound structure */
 struct sound_t {
     ALLEGRO_SAMPLE* sample;
-    ALLEGRO_SAMPLE_ID id;
-    bool valid_id;
-    float duration;
-    float end_time;
+    int voice; /* the voice that played the sample most recently, or -1 */
+    uint32_t serial; /* serial number of that playback; see voice_t */
+    int priority; /* sounds of lower priority give up their voices first */
+    int max_voices; /* how many voices may play the sample at the same time */
     float volume; /* 0: silence; 1: default */
     char* filepath; /* relative path */
+    size_t size; /* size of the PCM data, in bytes */
+    bool is_cached; /* is the sample in the sample cache? */
+    sound_t* prev; /* sample cache: more recently played */
+    sound_t* next; /* sample cache: less recently played */
 };
 
 /* private stuff */
 static const int PREFERRED_NUMBER_OF_SAMPLES = 16; /* how many samples can be played at the same time */
+#define DEFAULT_MAX_VOICES_PER_SAMPLE 4
+#define MUSIC_BUFFER_COUNT 4 /* default number of buffers of an audio stream */
+#define MUSIC_SAMPLES_PER_BUFFER 1024 /* default size of each buffer */
+static int music_buffer_count = MUSIC_BUFFER_COUNT;
+static int music_samples_per_buffer = MUSIC_SAMPLES_PER_BUFFER;
+
+/* sample cache: the most recently played samples are kept in memory. The
+   cache holds a reference to each of its samples; evicted samples are
+   released by the resource manager when they're no longer referenced */
+#if defined(__ANDROID__)
+#define SAMPLE_CACHE_BUDGET (16 * 1024 * 1024) /* in bytes */
+#else
+#define SAMPLE_CACHE_BUDGET (64 * 1024 * 1024)
+#endif
+static size_t sample_cache_budget = SAMPLE_CACHE_BUDGET;
+static size_t sample_cache_size = 0; /* bytes in the cache */
+static sound_t* sample_cache_head = NULL; /* most recently played */
+static sound_t* sample_cache_tail = NULL; /* least recently played */
+static void cache_sample(sound_t* sample);
+static void uncache_sample(sound_t* sample);
+static void touch_sample(sound_t* sample);
+static void evict_samples();
+
+/*
+
+VOICE MANAGER
+-------------
+
+Sound effects are played on a fixed pool of sample instances (voices) attached
+to the default mixer. This bounds the cost of mixing. When a sample is played:
+
+1. identical triggers in the same frame are merged (e.g., a spill of rings);
+2. if the sample is already playing on max_voices voices, the oldest of those
+   voices is restarted;
+3. otherwise, a free voice is used;
+4. otherwise, a voice playing a sample of equal or lower priority is stolen:
+   the one with the lowest priority, then the quietest, then the oldest.
+
+If all voices play samples of higher priority, the new sample is not played.
+
+*/
+typedef struct voice_t voice_t;
+struct voice_t {
+    ALLEGRO_SAMPLE_INSTANCE* instance;
+    sound_t* sound; /* the sound played by this voice, if any */
+    uint32_t serial; /* increases whenever a voice starts playing; larger is newer */
+    uint32_t frame; /* the frame in which the voice started playing */
+    float gain;
+
+    /* positioned sounds */
+    bool is_spatial; /* is the gain and the pan computed from a position in the world? */
+    v2d_t position; /* in world coordinates */
+    float range; /* in pixels */
+    float volume; /* gain before attenuation */
+};
+
+static voice_t* voice = NULL;
+static int voice_count = 0;
+static uint32_t voice_serial = 0;
+static uint32_t audio_frame = 0; /* incremented by audio_update() */
+static void create_voices(int count);
+static void destroy_voices();
+static int find_voice(const sound_t* sample);
+static bool start_voice(int v, sound_t* sample, float vol, float pan, float freq);
+static inline bool is_voice_playing(int v);
+static inline voice_t* current_voice(const sound_t* sample);
+static int play_sample(sound_t* sample, float vol, float pan, float freq);
+
+/* spatial audio */
+static v2d_t listener = { 0.0f, 0.0f }; /* position of the listener in the world */
+static bool spatialize(v2d_t position, float range, float* attenuation, float* pan);
+static void update_spatial_voices();
+
+/*
+
+MUSIC PREFETCH
+--------------
+
+Opening an audio stream reads and decodes the beginning of the file, which may
+cause a hitch when the music changes during gameplay. music_prefetch() opens a
+stream in a worker thread; a subsequent music_load() of the same path adopts
+it, waiting for the worker if needed. Prefetched streams that are never loaded
+are discarded when the number of pending prefetches exceeds a limit.
+
+*/
+#if defined(__EMSCRIPTEN__)
+#define WANT_MUSIC_PREFETCH 0 /* no threads */
+#else
+#define WANT_MUSIC_PREFETCH 1
+#endif
+
+#define MAX_PREFETCHED_MUSICS 4
+
+typedef struct musicprefetch_t musicprefetch_t;
+struct musicprefetch_t {
+    char* filepath; /* relative path */
+    char* fullpath;
+    int buffer_count;
+    int samples_per_buffer;
+    ALLEGRO_AUDIO_STREAM* stream; /* written by the worker */
+    ALLEGRO_THREAD* thread;
+    musicprefetch_t* next;
+};
+
+static musicprefetch_t* prefetch_list = NULL; /* most recent first */
+static ALLEGRO_AUDIO_STREAM* adopt_prefetched_stream(const char* path);
+static void discard_prefetched_musics(int max_count);
+static void* prefetch_worker(ALLEGRO_THREAD* thread, void* arg);
+
+/* crossfade: the previous music fades out as the current one fades in */
+static music_t* fading_music = NULL; /* NULL if not crossfading */
+static double crossfade_start_time = 0.0;
+static float crossfade_duration = 0.0f; /* in seconds */
+static void update_crossfade();
+static void stop_crossfade();
 
 static music_t *current_music = NULL; /* music being played at the moment (NULL if none) */
 static float master_volume = 1.0f; /* a value in [0,1] affecting all musics and sounds */
@@ -74,14 +198,22 @@ music_t *music_load(const char *path)
 
     if(NULL == (m = resourcemanager_find_music(path))) {
         const char* fullpath = asset_path(path);
+        double start_time = startuptrace_clock();
         logfile_message("Loading music \"%s\"...", fullpath);
 
         /* build the music object */
         m = mallocx(sizeof *m);
         m->is_paused = false;
+        m->volume = 1.0f;
         m->filepath = str_dup(path);
-        if(NULL == (m->stream = al_load_audio_stream(fullpath, 4, 1024)))
+        if(NULL == (m->stream = adopt_prefetched_stream(path)) && NULL == (m->stream = al_load_audio_stream(fullpath, music_buffer_count, music_samples_per_buffer)))
             fatal_error("Can't load music \"%s\"", path);
+
+        /* compute the size of its buffers */
+        m->size = al_get_audio_stream_fragments(m->stream) * al_get_audio_stream_length(m->stream) *
+                  al_get_channel_count(al_get_audio_stream_channels(m->stream)) *
+                  al_get_audio_depth_size(al_get_audio_stream_depth(m->stream));
+        resourcemanager_track_memory(RESOURCE_MUSIC, m->size);
         
         /* configure the audio stream */
         al_attach_audio_stream_to_mixer(m->stream, al_get_default_mixer());
@@ -91,6 +223,8 @@ music_t *music_load(const char *path)
         /* adding it to the resource manager */
         resourcemanager_add_music(path, m);
         resourcemanager_ref_music(path);
+
+        startuptrace_add_asset("music", path, start_time);
     }
     else
         resourcemanager_ref_music(path);
@@ -98,6 +232,50 @@ music_t *music_load(const char *path)
     return m;
 }
 
+/*
+ * music_prefetch()
+ * Opens a music in the background, so that a subsequent
+ * music_load() of the same path doesn't cause a hitch
+ */
+void music_prefetch(const char *path)
+{
+#if WANT_MUSIC_PREFETCH
+    if(*path == '\0' || resourcemanager_find_music(path) != NULL)
+        return;
+
+    /* already prefetched? */
+    for(musicprefetch_t* job = prefetch_list; job != NULL; job = job->next) {
+        if(0 == strcmp(job->filepath, path))
+            return;
+    }
+
+    /* start a worker */
+    musicprefetch_t* job = mallocx(sizeof *job);
+    job->filepath = str_dup(path);
+    job->fullpath = str_dup(asset_path(path));
+    job->buffer_count = music_buffer_count;
+    job->samples_per_buffer = music_samples_per_buffer;
+    job->stream = NULL;
+    if(NULL == (job->thread = al_create_thread(prefetch_worker, job))) {
+        logfile_message("Can't prefetch music \"%s\"", path);
+        free(job->fullpath);
+        free(job->filepath);
+        free(job);
+        return;
+    }
+
+    logfile_message("Prefetching music \"%s\"...", job->fullpath);
+    job->next = prefetch_list;
+    prefetch_list = job;
+    al_start_thread(job->thread);
+
+    /* limit the number of pending prefetches */
+    discard_prefetched_musics(MAX_PREFETCHED_MUSICS);
+#else
+    (void)path;
+#endif
+}
+
 
 /*
  * music_unref()
@@ -133,8 +311,11 @@ void music_destroy(music_t *music)
             music_stop();
             current_music = NULL;
         }
+        else if(music == fading_music)
+            stop_crossfade();
 
         al_destroy_audio_stream(music->stream);
+        resourcemanager_track_memory(RESOURCE_MUSIC, -(int64_t)music->size);
         free(music->filepath);
         free(music);
     }
@@ -161,12 +342,42 @@ void music_play(music_t *music, bool loop)
     music_set_volume(1.0f);
 }
 
+/*
+ * music_crossfade()
+ * Plays a music while the current one fades out,
+ * fading in the new music over the given number of seconds
+ */
+void music_crossfade(music_t *music, bool loop, float seconds)
+{
+    /* nothing to fade */
+    if(seconds <= 0.0f || current_music == NULL || current_music == music || current_music->is_paused || music == NULL) {
+        music_play(music, loop);
+        return;
+    }
+
+    /* a single crossfade at a time */
+    stop_crossfade();
+    fading_music = current_music;
+    crossfade_start_time = al_get_time();
+    crossfade_duration = seconds;
+
+    /* start the new music silently */
+    al_set_audio_stream_playmode(music->stream, loop ? ALLEGRO_PLAYMODE_LOOP : ALLEGRO_PLAYMODE_ONCE);
+    al_set_audio_stream_gain(music->stream, 0.0f);
+    al_set_audio_stream_playing(music->stream, true);
+    music->is_paused = false;
+    music->volume = 1.0f;
+    current_music = music;
+}
+
 /*
  * music_stop()
  * Stops the current music (if any)
  */
 void music_stop()
 {
+    stop_crossfade();
+
     if(current_music != NULL) {
         al_set_audio_stream_playing(current_music->stream, false);
         al_rewind_audio_stream(current_music->stream);
@@ -182,6 +393,8 @@ void music_stop()
  */
 void music_pause()
 {
+    stop_crossfade();
+
     if(current_music != NULL && !(current_music->is_paused)) {
         al_set_audio_stream_playing(current_music->stream, false);
         current_music->is_paused = true;
@@ -208,8 +421,11 @@ void music_resume()
 void music_set_volume(float volume)
 {
     if(current_music != NULL) {
-        float gain = max(volume, 0.0f);
-        al_set_audio_stream_gain(current_music->stream, gain);
+        current_music->volume = max(volume, 0.0f);
+
+        /* the gain of a crossfading music is set by update_crossfade() */
+        if(fading_music == NULL)
+            al_set_audio_stream_gain(current_music->stream, current_music->volume);
     }
 }
 
@@ -220,7 +436,7 @@ void music_set_volume(float volume)
 float music_get_volume()
 {
     if(current_music != NULL)
-        return al_get_audio_stream_gain(current_music->stream);
+        return current_music->volume;
     else
         return 0.0f;
 }
@@ -291,33 +507,44 @@ sound_t *sound_load(const char *path)
     sound_t *s;
 
     if(NULL == (s = resourcemanager_find_sample(path))) {
-        ALLEGRO_SAMPLE_INSTANCE* spl;
         const char* fullpath = asset_path(path);
+        double start_time = startuptrace_clock();
         logfile_message("Loading sound \"%s\"...", fullpath);
 
         /* build the sound object */
         s = mallocx(sizeof *s);
-        s->duration = 0.0f;
-        s->end_time = 0.0f;
-        s->valid_id = false;
+        s->voice = -1;
+        s->serial = 0;
+        s->priority = 0;
+        s->max_voices = DEFAULT_MAX_VOICES_PER_SAMPLE;
         s->volume = 1.0f;
         s->filepath = str_dup(path);
+        s->is_cached = false;
+        s->prev = s->next = NULL;
         if(NULL == (s->sample = al_load_sample(fullpath)))
             fatal_error("Can't load sound \"%s\"", path);
 
-        /* compute its duration */
-        if(NULL != (spl = al_create_sample_instance(s->sample))) {
-            s->duration = al_get_sample_instance_time(spl);
-            al_destroy_sample_instance(spl);
-        }
+        /* compute its size */
+        s->size = al_get_sample_length(s->sample) *
+                  al_get_channel_count(al_get_sample_channels(s->sample)) *
+                  al_get_audio_depth_size(al_get_sample_depth(s->sample));
+        resourcemanager_track_memory(RESOURCE_SAMPLE, s->size);
 
         /* adding it to the resource manager */
         resourcemanager_add_sample(path, s);
         resourcemanager_ref_sample(path);
+
+        startuptrace_add_asset("sound", path, start_time);
     }
     else
         resourcemanager_ref_sample(path);
 
+    /* keep it in memory for a while */
+    if(!s->is_cached) {
+        cache_sample(s);
+        evict_samples();
+    }
+
     return s;
 }
 
@@ -348,8 +575,19 @@ int sound_unref(sound_t* sample)
 void sound_destroy(sound_t *sample)
 {
     if(sample != NULL) {
-        sound_stop(sample);
+        if(sample->is_cached)
+            uncache_sample(sample); /* the resource manager is being released */
+
+        /* stop all voices that play the sample */
+        for(int v = 0; v < voice_count; v++) {
+            if(voice[v].sound == sample) {
+                al_stop_sample_instance(voice[v].instance);
+                voice[v].sound = NULL;
+            }
+        }
+
         al_destroy_sample(sample->sample);
+        resourcemanager_track_memory(RESOURCE_SAMPLE, -(int64_t)sample->size);
         free(sample->filepath);
         free(sample);
     }
@@ -368,6 +606,7 @@ void sound_play(sound_t *sample)
 /*
  * sound_play_ex()
  * Plays the given sample with extra options! :)
+ * The sample may not be played if all voices are busy (see above)
  *
  * 0.0 <= volume (defaults to 1.0)
  * (left speaker) -1.0 <= pan <= 1.0 (right speaker)
@@ -381,16 +620,36 @@ void sound_play_ex(sound_t *sample, float vol, float pan, float freq)
         pan = clip(pan, -1.0f, 1.0f);
         freq = max(freq, 0.0f);
 
-        /* play the sample */
-        if(al_play_sample(sample->sample, vol, pan, freq, ALLEGRO_PLAYMODE_ONCE, &sample->id)) {
-            sample->end_time = timer_get_elapsed() + sample->duration; /* when does it end? */
-            sample->valid_id = true;
-            sample->volume = vol;
-        }
-        else {
-            sample->end_time = 0.0f;
-            sample->valid_id = false;
-            sample->volume = vol;
+        play_sample(sample, vol, pan, freq);
+        sample->volume = vol;
+    }
+}
+
+/*
+ * sound_play_at()
+ * Plays a sample positioned in the world. Its volume and pan are computed
+ * against the listener (see audio_set_listener) and updated while it plays.
+ * The sample is not played if it's farther than range pixels from the listener
+ */
+void sound_play_at(sound_t *sample, v2d_t position, float range, float vol)
+{
+    float attenuation, pan;
+
+    if(sample != NULL) {
+        vol = max(vol, 0.0f);
+        sample->volume = vol;
+
+        /* inaudible sounds don't take a voice */
+        if(!spatialize(position, range, &attenuation, &pan))
+            return;
+
+        /* voices that play positioned sounds are updated in audio_update() */
+        int v = play_sample(sample, vol * attenuation, pan, 1.0f);
+        if(v >= 0 && voice[v].gain == vol * attenuation) {
+            voice[v].is_spatial = true;
+            voice[v].position = position;
+            voice[v].range = range;
+            voice[v].volume = vol;
         }
     }
 }
@@ -402,42 +661,30 @@ void sound_play_ex(sound_t *sample, float vol, float pan, float freq)
 void sound_stop(sound_t *sample)
 {
     if(sample != NULL) {
-        if(sample->valid_id) {
-            al_stop_sample(&sample->id);
-            sample->valid_id = false;
-            sample->end_time = 0.0f;
+        voice_t* current = current_voice(sample);
+        if(current != NULL) {
+            al_stop_sample_instance(current->instance);
+            current->sound = NULL;
         }
+
+        sample->voice = -1;
     }
 }
 
 /*
  * sound_is_playing()
- * Checks if a given sound is playing or not
+ * Checks if the most recent playback of a given sound is still playing.
+ * This reads the state of its voice, so pitch changes are accounted for
  */
 bool sound_is_playing(sound_t *sample)
 {
-    if(sample != NULL)
-        return timer_get_elapsed() < sample->end_time;
-    else
-        return false;
-
-#if 0
-    /* Unstable API (Allegro 5.2.3) */
+    /* the voice of the sample may have been stolen */
     if(sample != NULL) {
-        if(sample->valid_id) {
-            ALLEGRO_SAMPLE_INSTANCE* instance = al_lock_sample_id(&sample->id);
-            if(instance != NULL) {
-                bool is_playing = al_get_sample_instance_playing(instance);
-                al_unlock_sample_id(&sample->id);
-                return is_playing;
-            }
-            else
-                return false;
-        }
+        const voice_t* current = current_voice(sample);
+        return current != NULL && al_get_sample_instance_playing(current->instance);
     }
-
-    return false;
-#endif
+    else
+        return false;
 }
 
 /*
@@ -459,20 +706,50 @@ float sound_get_volume(sound_t *sample)
  */
 void sound_set_volume(sound_t *sample, float volume)
 {
-    /* Unstable API (since Allegro 5.2.3) */
     if(sample != NULL) {
+        voice_t* current = current_voice(sample);
+
         sample->volume = max(0.0f, volume);
-        if(sample->valid_id) {
-            ALLEGRO_SAMPLE_INSTANCE* instance = al_lock_sample_id(&sample->id);
-            if(instance != NULL) {
-                if(al_get_sample_instance_playing(instance))
-                    al_set_sample_instance_gain(instance, sample->volume);
-                al_unlock_sample_id(&sample->id);
-            }
+        if(current != NULL && al_get_sample_instance_playing(current->instance)) {
+            al_set_sample_instance_gain(current->instance, sample->volume);
+            current->gain = sample->volume;
         }
     }
 }
 
+/*
+ * sound_get_priority()
+ * Gets the priority of a sound
+ */
+int sound_get_priority(sound_t *sample)
+{
+    if(sample != NULL)
+        return sample->priority;
+    else
+        return 0;
+}
+
+/*
+ * sound_set_priority()
+ * Sets the priority of a sound. When all voices are busy, sounds
+ * of lower priority give up their voices first. Defaults to zero
+ */
+void sound_set_priority(sound_t *sample, int priority)
+{
+    if(sample != NULL)
+        sample->priority = priority;
+}
+
+/*
+ * sound_set_max_voices()
+ * Limits the number of voices that may play a sound at the same time
+ */
+void sound_set_max_voices(sound_t *sample, int max_voices)
+{
+    if(sample != NULL)
+        sample->max_voices = max(1, max_voices);
+}
+
 
 
 
@@ -499,14 +776,11 @@ void audio_init()
             fatal_error("Can't initialize Allegro's acodec addon");
     }
 
-    for(int samples = PREFERRED_NUMBER_OF_SAMPLES; samples > 0; samples /= 2) {
-        if(al_reserve_samples(samples)) {
-            logfile_message("Reserved %d samples", samples);
-            break;
-        }
-        else
-            logfile_message("Can't reserve %d samples", samples);
-    }
+    /* create the default mixer; we use our own voices */
+    if(!al_reserve_samples(0))
+        logfile_message("Can't create the default mixer");
+
+    create_voices(PREFERRED_NUMBER_OF_SAMPLES);
 }
 
 /*
@@ -516,6 +790,8 @@ void audio_init()
 void audio_release()
 {
     logfile_message("audio_release()");
+    discard_prefetched_musics(0);
+    destroy_voices();
     logfile_message("audio_release() ok");
 }
 
@@ -525,6 +801,16 @@ void audio_release()
  */
 void audio_update()
 {
+    /* a new frame for the voice manager */
+    audio_frame++;
+
+    /* crossfade musics */
+    if(fading_music != NULL)
+        update_crossfade();
+
+    /* follow the listener */
+    update_spatial_voices();
+
     /* when the music finishes, set current_music to NULL */
     if(current_music != NULL && !(current_music->is_paused)) {
         if(!music_is_playing()) {
@@ -543,9 +829,54 @@ void audio_preload()
     assertx(resourcemanager_is_initialized());
     logfile_message("Preloading samples...");
 
-    /* preload the samples, so that we don't access the disk during gameplay */
+    /* preload the samples, so that we don't access the disk during gameplay.
+       We stop when the sample cache is full; other samples load on demand */
     asset_foreach_file("samples/", ".wav", preload_sample, NULL, true);
     /*asset_foreach_file("samples/", ".ogg", preload_sample, NULL, true);*/
+
+    logfile_message("Preloaded %zu KB of samples", sample_cache_size / 1024);
+}
+
+/*
+ * audio_set_sample_cache_budget()
+ * Sets the maximum size, in bytes, of the samples kept in memory
+ * by the sample cache. Samples referenced elsewhere aren't released
+ */
+void audio_set_sample_cache_budget(size_t bytes)
+{
+    sample_cache_budget = bytes;
+    evict_samples();
+}
+
+/*
+ * audio_sample_cache_budget()
+ * The maximum size, in bytes, of the samples kept in memory by the sample cache
+ */
+size_t audio_sample_cache_budget()
+{
+    return sample_cache_budget;
+}
+
+/*
+ * audio_set_music_buffers()
+ * Sets the number of buffers and the number of samples per buffer of the
+ * musics loaded afterwards. More or larger buffers tolerate a higher audio
+ * latency (e.g., certain mobile devices) at the expense of memory
+ */
+void audio_set_music_buffers(int buffer_count, int samples_per_buffer)
+{
+    music_buffer_count = max(2, buffer_count);
+    music_samples_per_buffer = max(256, samples_per_buffer);
+}
+
+/*
+ * audio_set_listener()
+ * Sets the position of the listener of the positioned sounds, in world
+ * coordinates (usually the position of the camera)
+ */
+void audio_set_listener(v2d_t position)
+{
+    listener = position;
 }
 
 /*
@@ -593,10 +924,388 @@ void audio_set_muted(bool muted)
 
 int preload_sample(const char* vpath, void* data)
 {
+    /* the cache is full */
+    if(sample_cache_size >= sample_cache_budget)
+        return 1;
+
     sound_load(vpath);
     return 0;
 }
 
+/* adds a sample to the cache as the most recently played one */
+void cache_sample(sound_t* sample)
+{
+    assertx(!sample->is_cached);
+
+    sample->prev = NULL;
+    sample->next = sample_cache_head;
+    if(sample_cache_head != NULL)
+        sample_cache_head->prev = sample;
+    else
+        sample_cache_tail = sample;
+    sample_cache_head = sample;
+
+    sample->is_cached = true;
+    sample_cache_size += sample->size;
+    resourcemanager_ref_sample(sample->filepath);
+}
+
+/* removes a sample from the cache without releasing its reference */
+void uncache_sample(sound_t* sample)
+{
+    assertx(sample->is_cached);
+
+    if(sample->prev != NULL)
+        sample->prev->next = sample->next;
+    else
+        sample_cache_head = sample->next;
+
+    if(sample->next != NULL)
+        sample->next->prev = sample->prev;
+    else
+        sample_cache_tail = sample->prev;
+
+    sample->prev = sample->next = NULL;
+    sample->is_cached = false;
+    sample_cache_size -= sample->size;
+}
+
+/* marks a cached sample as the most recently played one */
+void touch_sample(sound_t* sample)
+{
+    if(sample == sample_cache_head)
+        return;
+
+    /* unlink */
+    sample->prev->next = sample->next;
+    if(sample->next != NULL)
+        sample->next->prev = sample->prev;
+    else
+        sample_cache_tail = sample->prev;
+
+    /* move to the head */
+    sample->prev = NULL;
+    sample->next = sample_cache_head;
+    sample_cache_head->prev = sample;
+    sample_cache_head = sample;
+}
+
+/* evicts the least recently played samples until the cache fits its budget */
+void evict_samples()
+{
+    sound_t* sample = sample_cache_tail;
+
+    while(sample_cache_size > sample_cache_budget && sample != NULL && sample != sample_cache_head) {
+        sound_t* prev = sample->prev;
+
+        /* don't cut a sample that is playing */
+        if(!sound_is_playing(sample)) {
+            uncache_sample(sample);
+            resourcemanager_unref_sample(sample->filepath); /* may be released later */
+        }
+
+        sample = prev;
+    }
+}
+
+/* takes the stream of a prefetched music, waiting for its worker if needed. Returns NULL if there is none */
+ALLEGRO_AUDIO_STREAM* adopt_prefetched_stream(const char* path)
+{
+    ALLEGRO_AUDIO_STREAM* stream = NULL;
+
+    for(musicprefetch_t **job = &prefetch_list; *job != NULL; job = &((*job)->next)) {
+        if(0 == strcmp((*job)->filepath, path)) {
+            musicprefetch_t* adopted = *job;
+            *job = adopted->next;
+
+            al_join_thread(adopted->thread, NULL);
+            al_destroy_thread(adopted->thread);
+            stream = adopted->stream;
+
+            free(adopted->fullpath);
+            free(adopted->filepath);
+            free(adopted);
+            break;
+        }
+    }
+
+    return stream;
+}
+
+/* discards the least recent prefetched musics, keeping at most max_count */
+void discard_prefetched_musics(int max_count)
+{
+    musicprefetch_t **job = &prefetch_list;
+
+    for(int count = 0; *job != NULL && count < max_count; count++)
+        job = &((*job)->next);
+
+    while(*job != NULL) {
+        musicprefetch_t* discarded = *job;
+        *job = discarded->next;
+
+        al_join_thread(discarded->thread, NULL);
+        al_destroy_thread(discarded->thread);
+        if(discarded->stream != NULL)
+            al_destroy_audio_stream(discarded->stream);
+
+        free(discarded->fullpath);
+        free(discarded->filepath);
+        free(discarded);
+    }
+}
+
+/* opens the stream of a prefetched music */
+void* prefetch_worker(ALLEGRO_THREAD* thread, void* arg)
+{
+    musicprefetch_t* job = (musicprefetch_t*)arg;
+
+    /* use the physfs file interface in this thread */
+    al_set_physfs_file_interface();
+
+    /* this primes the buffers of the stream */
+    job->stream = al_load_audio_stream(job->fullpath, job->buffer_count, job->samples_per_buffer);
+    return NULL;
+}
+
+/* updates the gains of the musics during a crossfade */
+void update_crossfade()
+{
+    float t = crossfade_duration > 0.0f ? (al_get_time() - crossfade_start_time) / crossfade_duration : 1.0f;
+    t = clip01(t);
+
+    al_set_audio_stream_gain(fading_music->stream, fading_music->volume * (1.0f - t));
+    if(current_music != NULL)
+        al_set_audio_stream_gain(current_music->stream, current_music->volume * t);
+
+    if(t >= 1.0f)
+        stop_crossfade();
+}
+
+/* stops the music that fades out, if any */
+void stop_crossfade()
+{
+    if(fading_music == NULL)
+        return;
+
+    al_set_audio_stream_playing(fading_music->stream, false);
+    al_rewind_audio_stream(fading_music->stream);
+    al_set_audio_stream_gain(fading_music->stream, fading_music->volume);
+    fading_music->is_paused = false;
+    fading_music = NULL;
+
+    if(current_music != NULL)
+        al_set_audio_stream_gain(current_music->stream, current_music->volume);
+}
+
+/* creates the voices of the voice manager, halving their number until it succeeds */
+void create_voices(int count)
+{
+    ALLEGRO_MIXER* mixer = al_get_default_mixer();
+
+    voice = mallocx(count * sizeof(*voice));
+    voice_count = 0;
+
+    while(voice_count < count && mixer != NULL) {
+        ALLEGRO_SAMPLE_INSTANCE* instance = al_create_sample_instance(NULL);
+
+        if(instance == NULL || !al_attach_sample_instance_to_mixer(instance, mixer)) {
+            if(instance != NULL)
+                al_destroy_sample_instance(instance);
+
+            logfile_message("Can't create %d voices", count);
+            count /= 2;
+            continue;
+        }
+
+        voice[voice_count].instance = instance;
+        voice[voice_count].sound = NULL;
+        voice[voice_count].serial = 0;
+        voice[voice_count].frame = 0;
+        voice[voice_count].gain = 0.0f;
+        voice[voice_count].is_spatial = false;
+        voice[voice_count].position = v2d_new(0.0f, 0.0f);
+        voice[voice_count].range = 0.0f;
+        voice[voice_count].volume = 0.0f;
+        voice_count++;
+    }
+
+    /* destroy the voices that exceed the reduced count */
+    while(voice_count > count)
+        al_destroy_sample_instance(voice[--voice_count].instance);
+
+    logfile_message("Created %d voices", voice_count);
+}
+
+/* destroys the voices of the voice manager */
+void destroy_voices()
+{
+    for(int v = 0; v < voice_count; v++)
+        al_destroy_sample_instance(voice[v].instance);
+
+    free(voice);
+    voice = NULL;
+    voice_count = 0;
+}
+
+/* picks a voice to play a sample. Returns -1 if all voices play samples of higher priority */
+int find_voice(const sound_t* sample)
+{
+    int oldest = -1, count = 0;
+    int victim = -1;
+
+    /* limit the number of voices that play the sample */
+    for(int v = 0; v < voice_count; v++) {
+        if(voice[v].sound == sample && is_voice_playing(v)) {
+            if(oldest < 0 || voice[v].serial < voice[oldest].serial)
+                oldest = v;
+            count++;
+        }
+    }
+
+    if(count >= sample->max_voices)
+        return oldest;
+
+    /* find a free voice, or else a voice to be stolen */
+    for(int v = 0; v < voice_count; v++) {
+        if(!is_voice_playing(v))
+            return v;
+        else if(voice[v].sound->priority > sample->priority)
+            continue;
+
+        if(victim < 0)
+            victim = v;
+        else if(voice[v].sound->priority != voice[victim].sound->priority) {
+            if(voice[v].sound->priority < voice[victim].sound->priority)
+                victim = v;
+        }
+        else if(voice[v].gain != voice[victim].gain) {
+            if(voice[v].gain < voice[victim].gain)
+                victim = v;
+        }
+        else if(voice[v].serial < voice[victim].serial)
+            victim = v;
+    }
+
+    return victim;
+}
+
+/* plays a sample on a voice, stopping whatever it was playing */
+bool start_voice(int v, sound_t* sample, float vol, float pan, float freq)
+{
+    ALLEGRO_SAMPLE_INSTANCE* instance = voice[v].instance;
+
+    voice[v].sound = NULL;
+    al_stop_sample_instance(instance);
+    if(!al_set_sample(instance, sample->sample))
+        return false;
+
+    /* changing the sample may detach the instance */
+    if(!al_get_sample_instance_attached(instance) && !al_attach_sample_instance_to_mixer(instance, al_get_default_mixer()))
+        return false;
+
+    al_set_sample_instance_playmode(instance, ALLEGRO_PLAYMODE_ONCE);
+    al_set_sample_instance_gain(instance, vol);
+    al_set_sample_instance_pan(instance, pan);
+    al_set_sample_instance_speed(instance, freq);
+    if(!al_play_sample_instance(instance))
+        return false;
+
+    voice[v].sound = sample;
+    voice[v].serial = ++voice_serial;
+    voice[v].frame = audio_frame;
+    voice[v].gain = vol;
+    voice[v].is_spatial = false;
+    return true;
+}
+
+/* plays a sample, merging identical triggers in the same frame.
+   Returns the voice that plays it, or -1 if there is none */
+int play_sample(sound_t* sample, float vol, float pan, float freq)
+{
+    /* the sample has been recently played */
+    if(sample->is_cached)
+        touch_sample(sample);
+
+    /* the sample has already been triggered in this frame */
+    voice_t* current = current_voice(sample);
+    if(current != NULL && current->frame == audio_frame) {
+        if(vol > current->gain) {
+            al_set_sample_instance_gain(current->instance, vol);
+            al_set_sample_instance_pan(current->instance, pan);
+            current->gain = vol;
+        }
+        return sample->voice;
+    }
+
+    /* play the sample */
+    int v = find_voice(sample);
+    if(v >= 0 && start_voice(v, sample, vol, pan, freq)) {
+        sample->voice = v;
+        sample->serial = voice[v].serial;
+        return v;
+    }
+
+    sample->voice = -1;
+    return -1;
+}
+
+/* computes the attenuation and the pan of a sound at a position in the
+   world, given the listener. Returns false if the sound isn't audible */
+bool spatialize(v2d_t position, float range, float* attenuation, float* pan)
+{
+    v2d_t d = v2d_subtract(position, listener);
+
+    /* culling */
+    if(range <= 0.0f || d.x * d.x + d.y * d.y >= range * range)
+        return false;
+
+    /* linear falloff */
+    *attenuation = 1.0f - v2d_magnitude(d) / range;
+    *pan = clip(d.x / range, -1.0f, 1.0f);
+    return true;
+}
+
+/* updates the gain and the pan of the voices that play positioned sounds */
+void update_spatial_voices()
+{
+    float attenuation, pan;
+
+    for(int v = 0; v < voice_count; v++) {
+        if(!voice[v].is_spatial || !is_voice_playing(v))
+            continue;
+
+        /* free the voices that are no longer audible */
+        if(!spatialize(voice[v].position, voice[v].range, &attenuation, &pan)) {
+            al_stop_sample_instance(voice[v].instance);
+            voice[v].sound = NULL;
+            continue;
+        }
+
+        voice[v].gain = voice[v].volume * attenuation;
+        al_set_sample_instance_gain(voice[v].instance, voice[v].gain);
+        al_set_sample_instance_pan(voice[v].instance, pan);
+    }
+}
+
+/* is a voice playing a sample? */
+bool is_voice_playing(int v)
+{
+    return voice[v].sound != NULL && al_get_sample_instance_playing(voice[v].instance);
+}
+
+/* the voice that plays a sample, unless it has been stolen. May be NULL */
+voice_t* current_voice(const sound_t* sample)
+{
+    if(sample->voice >= 0 && sample->voice < voice_count) {
+        voice_t* v = &voice[sample->voice];
+        if(v->sound == sample && v->serial == sample->serial)
+            return v;
+    }
+
+    return NULL;
+}
+
 void set_global_gain(float gain)
 {
     ALLEGRO_MIXER* mixer = al_get_default_mixer();
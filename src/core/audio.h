@@ -22,6 +22,8 @@
 #define _AUDIO_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include "../util/v2d.h"
 
 /* forward declarations */
 typedef struct music_t music_t;
@@ -32,6 +34,10 @@ void audio_init();
 void audio_update();
 void audio_release();
 void audio_preload();
+void audio_set_sample_cache_budget(size_t bytes); /* max. size, in bytes, of the samples kept in memory */
+size_t audio_sample_cache_budget();
+void audio_set_music_buffers(int buffer_count, int samples_per_buffer); /* affects the musics loaded afterwards */
+void audio_set_listener(v2d_t position); /* position of the listener of the positioned sounds, in world coordinates */
 
 float audio_get_master_volume();
 void audio_set_master_volume(float volume); /* 0.0 <= volume <= 1.0 (default) */
@@ -41,7 +47,9 @@ void audio_set_muted(bool muted); /* global mute / unmute */
 /* music management */
 music_t *music_load(const char *path); /* will be unloaded automatically */
 void music_destroy(music_t *music); /* you don't usually need to bother with this. */
+void music_prefetch(const char *path); /* opens a music in the background; music_load() it later */
 void music_play(music_t *music, bool loop); /* plays a music. Set loop to TRUE to make it loop continuously. */
+void music_crossfade(music_t *music, bool loop, float seconds); /* plays a music while the current one fades out */
 void music_stop();
 void music_pause();
 void music_resume();
@@ -59,10 +67,14 @@ sound_t *sound_load(const char *path); /* will be unloaded automatically */
 void sound_destroy(sound_t *sample);
 void sound_play(sound_t *sample);
 void sound_play_ex(sound_t *sample, float vol, float pan, float freq); /* 0.0<=volume<=1.0; (left) -1.0<=pan<=1.0 (right); 1.0 = default frequency */
+void sound_play_at(sound_t *sample, v2d_t position, float range, float vol); /* plays a sound positioned in the world, audible within range pixels of the listener */
 void sound_stop(sound_t *sample);
 bool sound_is_playing(sound_t *sample);
 int sound_unref(sound_t *sample); /* returns the number of active references */
 float sound_get_volume(sound_t *sample);
 void sound_set_volume(sound_t *sample, float volume); /* volume is in the [0,1] range */
+int sound_get_priority(sound_t *sample);
+void sound_set_priority(sound_t *sample, int priority); /* sounds of higher priority steal the voices of others */
+void sound_set_max_voices(sound_t *sample, int max_voices); /* max. number of simultaneous playbacks of the sample */
 
 #endif
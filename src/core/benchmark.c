@@ -0,0 +1,305 @@
+/*
+ * Open Surge Engine
+ * benchmark.c - benchmark mode: input replays & frame-time stats
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <allegro5/allegro.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "benchmark.h"
+#include "engine.h"
+#include "input.h"
+#include "logfile.h"
+#include "../util/darray.h"
+#include "../util/util.h"
+
+/*
+
+Replay files are recorded with --record. They store the raw input and the
+timing of each framestep in a compact binary stream (see input.c), so that
+the exact same gameplay can be profiled on different builds and devices.
+
+*/
+
+/* how many framesteps we benchmark if there is no replay */
+#define DEFAULT_BENCHMARK_FRAMES 3600 /* one minute at 60 fps */
+
+/* the measured time of each section of a framestep */
+typedef struct framesample_t framesample_t;
+struct framesample_t {
+    float ms[BENCHMARK_MAX_SECTIONS]; /* in milliseconds */
+};
+
+static const char* SECTION_NAME[BENCHMARK_MAX_SECTIONS] = {
+    [BENCHMARK_UPDATE] = "update",
+    [BENCHMARK_RENDER] = "render",
+    [BENCHMARK_PHYSICS] = "physics",
+    [BENCHMARK_SCRIPTING] = "scripting"
+};
+
+/* benchmark state */
+static bool is_enabled = false;
+static bool wants_render = true;
+static int frame_count = 0; /* number of started framesteps */
+static int max_frames = 0;
+static double start_time = 0.0; /* wall-clock time */
+
+/* frame-time stats */
+STATIC_DARRAY(framesample_t, samples);
+static framesample_t current_sample;
+static framesample_t last_sample; /* the last complete framestep */
+static bool is_measuring = false; /* measure the sections outside of benchmark mode */
+static double section_start[BENCHMARK_MAX_SECTIONS];
+
+static void close_frame();
+static void report();
+static int compare_floats(const void* a, const void* b);
+static float percentile(float* sorted_values, int count, int p);
+
+
+
+/*
+ * benchmark_init()
+ * Initializes the benchmark module. In benchmark mode, the engine
+ * runs with a fixed timestep and, if replay_filepath isn't NULL,
+ * with recorded input. record_filepath, which may be NULL, is used
+ * to record input in any mode
+ */
+void benchmark_init(bool enabled, bool render, const char* replay_filepath, const char* record_filepath)
+{
+    is_enabled = enabled;
+    wants_render = render || !enabled;
+    frame_count = 0;
+    max_frames = enabled ? DEFAULT_BENCHMARK_FRAMES : 0;
+    start_time = al_get_time();
+
+    darray_init(samples);
+    memset(&current_sample, 0, sizeof(current_sample));
+    memset(&last_sample, 0, sizeof(last_sample));
+
+    /* load the replay */
+    if(replay_filepath != NULL) {
+        if(!input_start_replay(replay_filepath))
+            fatal_error("Can't load the replay file \"%s\"", replay_filepath);
+
+        if(enabled)
+            max_frames = input_replay_length();
+    }
+
+    /* start recording */
+    if(record_filepath != NULL) {
+        if(!input_start_recording(record_filepath))
+            fatal_error("Can't record input to \"%s\"", record_filepath);
+    }
+
+    if(enabled)
+        logfile_message("Benchmark mode: running %d frames%s", max_frames, wants_render ? "" : " without rendering");
+}
+
+/*
+ * benchmark_release()
+ * Releases the benchmark module, reporting the stats
+ */
+void benchmark_release()
+{
+    /* close the last framestep */
+    if(frame_count > 0)
+        close_frame();
+
+    /* report */
+    if(is_enabled)
+        report();
+
+    /* stop recording & replaying */
+    input_stop_replay();
+
+    darray_release(samples);
+    is_enabled = false;
+    is_measuring = false;
+}
+
+/*
+ * benchmark_is_enabled()
+ * Are we in benchmark mode?
+ */
+bool benchmark_is_enabled()
+{
+    return is_enabled;
+}
+
+/*
+ * benchmark_wants_render()
+ * Should we render the scenes?
+ */
+bool benchmark_wants_render()
+{
+    return wants_render;
+}
+
+/*
+ * benchmark_frame()
+ * Closes the previous framestep and starts a new one
+ */
+void benchmark_frame()
+{
+    /* measuring the sections outside of benchmark mode */
+    if(!is_enabled) {
+        if(is_measuring) {
+            last_sample = current_sample;
+            memset(&current_sample, 0, sizeof(current_sample));
+        }
+
+        return;
+    }
+
+    /* close the previous framestep */
+    if(frame_count > 0)
+        close_frame();
+
+    /* are we done? */
+    if(is_enabled && frame_count >= max_frames) {
+        engine_quit();
+        return;
+    }
+
+    /* start a new framestep */
+    memset(&current_sample, 0, sizeof(current_sample));
+    frame_count++;
+}
+
+/*
+ * benchmark_begin()
+ * Starts measuring a section of the current framestep
+ */
+void benchmark_begin(benchmarksection_t section)
+{
+    if(is_enabled || is_measuring)
+        section_start[section] = al_get_time();
+}
+
+/*
+ * benchmark_end()
+ * Stops measuring a section of the current framestep. A section
+ * may be measured multiple times per framestep (e.g., per player)
+ */
+void benchmark_end(benchmarksection_t section)
+{
+    if(is_enabled || is_measuring)
+        current_sample.ms[section] += (float)(1000.0 * (al_get_time() - section_start[section]));
+}
+
+/*
+ * benchmark_measure_sections()
+ * Measure the sections of the framesteps outside of benchmark mode as well,
+ * so that benchmark_section_time() may be sampled (see metrics.c)
+ */
+void benchmark_measure_sections(bool measure)
+{
+    is_measuring = measure;
+    memset(&current_sample, 0, sizeof(current_sample));
+    memset(&last_sample, 0, sizeof(last_sample));
+}
+
+/*
+ * benchmark_section_time()
+ * The measured time of a section in the last complete framestep, in milliseconds
+ */
+float benchmark_section_time(benchmarksection_t section)
+{
+    return last_sample.ms[section];
+}
+
+/*
+ * benchmark_section_name()
+ * The name of a section
+ */
+const char* benchmark_section_name(benchmarksection_t section)
+{
+    return SECTION_NAME[section];
+}
+
+/* private stuff */
+
+/* closes the current framestep */
+void close_frame()
+{
+    /* store the stats */
+    if(is_enabled)
+        darray_push(samples, current_sample);
+
+    last_sample = current_sample;
+}
+
+/* prints the frame-time stats */
+void report()
+{
+    int count = darray_length(samples);
+    double elapsed = al_get_time() - start_time;
+    float* values;
+
+    if(count == 0)
+        return;
+
+    printf("Benchmark: %d frames in %.2f seconds (%.1f fps)\n", count, elapsed, count / max(elapsed, 1e-6));
+    printf("%-12s %10s %10s %10s %10s %10s\n", "section", "mean (ms)", "p50 (ms)", "p95 (ms)", "p99 (ms)", "max (ms)");
+    logfile_message("Benchmark: %d frames in %.2f seconds", count, elapsed);
+
+    values = mallocx(count * sizeof(*values));
+    for(int s = 0; s < BENCHMARK_MAX_SECTIONS; s++) {
+        double sum = 0.0;
+
+        for(int i = 0; i < count; i++) {
+            values[i] = samples[i].ms[s];
+            sum += values[i];
+        }
+
+        qsort(values, count, sizeof(*values), compare_floats);
+
+        printf("%-12s %10.3f %10.3f %10.3f %10.3f %10.3f\n", SECTION_NAME[s],
+            sum / count,
+            percentile(values, count, 50),
+            percentile(values, count, 95),
+            percentile(values, count, 99),
+            values[count - 1]
+        );
+
+        logfile_message("Benchmark: %s p50 %.3f p95 %.3f p99 %.3f (ms)", SECTION_NAME[s],
+            percentile(values, count, 50),
+            percentile(values, count, 95),
+            percentile(values, count, 99)
+        );
+    }
+
+    free(values);
+    fflush(stdout);
+}
+
+/* the p-th percentile of a sorted array (nearest-rank method) */
+float percentile(float* sorted_values, int count, int p)
+{
+    int rank = (p * count + 99) / 100; /* ceil(p/100 * count) */
+    return sorted_values[clip(rank, 1, count) - 1];
+}
+
+/* compare two floats */
+int compare_floats(const void* a, const void* b)
+{
+    float x = *((const float*)a), y = *((const float*)b);
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,53 @@
+/*
+ * Open Surge Engine
+ * benchmark.h - benchmark mode: input replays & frame-time stats
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCHMARK_H
+#define _BENCHMARK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* measured sections of a frame */
+typedef enum benchmarksection_t {
+    BENCHMARK_UPDATE,       /* the update of the scene */
+    BENCHMARK_RENDER,       /* the rendering of the scene */
+    BENCHMARK_PHYSICS,      /* the physics of the players */
+    BENCHMARK_SCRIPTING,    /* the update of the SurgeScript VM */
+
+    BENCHMARK_MAX_SECTIONS
+} benchmarksection_t;
+
+/* initialization */
+void benchmark_init(bool enabled, bool render, const char* replay_filepath, const char* record_filepath);
+void benchmark_release(); /* reports the stats */
+
+/* benchmark mode */
+bool benchmark_is_enabled(); /* run with a fixed timestep, as fast as possible */
+bool benchmark_wants_render();
+
+/* frame-time stats */
+void benchmark_frame(); /* call at the beginning of each framestep */
+void benchmark_begin(benchmarksection_t section);
+void benchmark_end(benchmarksection_t section);
+void benchmark_measure_sections(bool measure); /* measure the sections outside of benchmark mode as well */
+float benchmark_section_time(benchmarksection_t section); /* in the last complete framestep, in milliseconds */
+const char* benchmark_section_name(benchmarksection_t section);
+
+#endif
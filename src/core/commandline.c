@@ -29,6 +29,7 @@
 #include "video.h"
 #include "asset.h"
 #include "import.h"
+#include "resourcemanager.h"
 #include "../util/stringutil.h"
 #include "../util/util.h"
 
@@ -65,6 +66,7 @@ commandline_t commandline_parse(int argc, char **argv)
     /* initialize values */
     cmd.video_resolution = COMMANDLINE_UNDEFINED;
     cmd.video_quality = COMMANDLINE_UNDEFINED;
+    cmd.texture_detail = COMMANDLINE_UNDEFINED;
     cmd.fullscreen = COMMANDLINE_UNDEFINED;
     cmd.show_fps = COMMANDLINE_UNDEFINED;
     cmd.hide_fps = COMMANDLINE_UNDEFINED;
@@ -73,6 +75,22 @@ commandline_t commandline_parse(int argc, char **argv)
     cmd.verbose = COMMANDLINE_UNDEFINED;
     cmd.compatibility_mode = COMMANDLINE_UNDEFINED;
     cmd.compatibility_version[0] = '\0';
+    cmd.startup_trace_filepath[0] = '\0';
+
+    cmd.benchmark = COMMANDLINE_UNDEFINED;
+    cmd.benchmark_render = COMMANDLINE_UNDEFINED;
+    cmd.replay_filepath[0] = '\0';
+    cmd.record_filepath[0] = '\0';
+    cmd.fixed_timestep = COMMANDLINE_UNDEFINED;
+    cmd.headless = COMMANDLINE_UNDEFINED;
+    cmd.max_frames = COMMANDLINE_UNDEFINED;
+    cmd.random_seed = COMMANDLINE_UNDEFINED;
+    cmd.pipelined_rendering = COMMANDLINE_UNDEFINED;
+    cmd.low_latency = COMMANDLINE_UNDEFINED;
+    cmd.compress_textures = COMMANDLINE_UNDEFINED;
+    cmd.parallel_physics = COMMANDLINE_UNDEFINED;
+    cmd.stream_levels = COMMANDLINE_UNDEFINED;
+    cmd.metrics = COMMANDLINE_UNDEFINED;
 
     cmd.custom_level_path[0] = '\0';
     cmd.custom_quest_path[0] = '\0';
@@ -103,6 +121,7 @@ commandline_t commandline_parse(int argc, char **argv)
                 "    --windowed                       windowed mode\n"
                 "    --resolution X                   set the scale of the window size, where X = 1, 2, 3 or 4\n"
                 "    --quality Q                      set the video quality Q to \"low\", \"medium\" or \"high\"\n"
+                "    --texture-detail D               use the large images at \"full\" or \"half\" resolution. Defaults to half with --quality low\n"
                 "    --show-fps                       show the FPS (frames per second) counter\n"
                 "    --hide-fps                       hide the FPS counter\n"
                 "    --level \"filepath\"               run the specified level (e.g., levels/my_level.lev)\n"
@@ -114,8 +133,23 @@ commandline_t commandline_parse(int argc, char **argv)
                 "    --reset                          factory reset: clear all user-space files & changes\n"
                 "    --import \"/path/to/game\"         import an Open Surge game from the specified folder\n"
                 "    --import-wizard                  import an Open Surge game using a wizard\n"
+                "    --benchmark \"filepath\"           benchmark the specified level with a fixed timestep and report frame-time stats\n"
+                "    --replay \"filepath\"              replay input recorded in the specified file. To be combined with --benchmark\n"
+                "    --record \"filepath\"              record input to the specified file\n"
+                "    --no-render                      skip rendering in benchmark mode\n"
+                "    --fixed-timestep                 run the simulation with a fixed timestep and interpolate rendering\n"
+                "    --headless                       run the simulation with a fixed timestep, as fast as possible and without rendering (automated tests)\n"
+                "    --max-frames N                   stop after N frames in headless mode, exiting with status 2\n"
+                "    --seed N                         seed the random number generator with N, so that parallel runs may differ\n"
+                "    --pipelined-rendering            update the next frame while the graphics driver presents the current one\n"
+                "    --low-latency                    sample input as late as possible, just before updating the scene\n"
+                "    --compress-textures              convert the large images of the game to compressed textures (DDS) in the user space\n"
+                "    --parallel-physics               step the physics of the players on multiple threads\n"
+                "    --stream-levels                  keep in memory only the parts of the levels that are near the camera (very large levels)\n"
+                "    --metrics                        write frame times, counters and memory usage to metrics.bin in the user space once per second\n"
                 "    --mobile                         enable mobile device simulation\n"
                 "    --verbose                        enable verbose logging with debug messages\n"
+                "    --startup-trace \"filepath\"       trace the loading time of the startup and export it to the specified JSON file\n"
                 "    -- -arg1 -arg2 -arg3...          user-defined arguments to be used in the scripting layer",
                 GAME_COPYRIGHT, program
             );
@@ -172,6 +206,19 @@ commandline_t commandline_parse(int argc, char **argv)
                 crash("%s: missing --quality parameter", program);
         }
 
+        else if(strcmp(argv[i], "--texture-detail") == 0) {
+            if(++i < argc && *(argv[i]) != '-') {
+                if(strcmp(argv[i], "full") == 0)
+                    cmd.texture_detail = TEXTUREDETAIL_FULL;
+                else if(strcmp(argv[i], "half") == 0)
+                    cmd.texture_detail = TEXTUREDETAIL_HALF;
+                else
+                    crash("Invalid texture detail: %s", argv[i]);
+            }
+            else
+                crash("%s: missing --texture-detail parameter", program);
+        }
+
         else if(strcmp(argv[i], "--fullscreen") == 0)
             cmd.fullscreen = TRUE;
 
@@ -190,6 +237,13 @@ commandline_t commandline_parse(int argc, char **argv)
         else if(strcmp(argv[i], "--verbose") == 0)
             cmd.verbose = TRUE;
 
+        else if(strcmp(argv[i], "--startup-trace") == 0) {
+            if(++i < argc && *(argv[i]) != '-')
+                str_cpy(cmd.startup_trace_filepath, argv[i], sizeof(cmd.startup_trace_filepath));
+            else
+                crash("%s: missing --startup-trace parameter", program);
+        }
+
         else if(strcmp(argv[i], "--level") == 0) {
             if(++i < argc && *(argv[i]) != '-')
                 str_cpy(cmd.custom_level_path, argv[i], sizeof(cmd.custom_level_path));
@@ -197,6 +251,72 @@ commandline_t commandline_parse(int argc, char **argv)
                 crash("%s: missing --level parameter", program);
         }
 
+        else if(strcmp(argv[i], "--benchmark") == 0) {
+            if(++i < argc && *(argv[i]) != '-') {
+                str_cpy(cmd.custom_level_path, argv[i], sizeof(cmd.custom_level_path));
+                cmd.benchmark = TRUE;
+            }
+            else
+                crash("%s: missing --benchmark parameter", program);
+        }
+
+        else if(strcmp(argv[i], "--replay") == 0) {
+            if(++i < argc && *(argv[i]) != '-')
+                str_cpy(cmd.replay_filepath, argv[i], sizeof(cmd.replay_filepath));
+            else
+                crash("%s: missing --replay parameter", program);
+        }
+
+        else if(strcmp(argv[i], "--record") == 0) {
+            if(++i < argc && *(argv[i]) != '-')
+                str_cpy(cmd.record_filepath, argv[i], sizeof(cmd.record_filepath));
+            else
+                crash("%s: missing --record parameter", program);
+        }
+
+        else if(strcmp(argv[i], "--no-render") == 0)
+            cmd.benchmark_render = FALSE;
+
+        else if(strcmp(argv[i], "--fixed-timestep") == 0)
+            cmd.fixed_timestep = TRUE;
+
+        else if(strcmp(argv[i], "--headless") == 0)
+            cmd.headless = TRUE;
+
+        else if(strcmp(argv[i], "--max-frames") == 0) {
+            if(++i < argc && *(argv[i]) != '-') {
+                if((cmd.max_frames = atoi(argv[i])) <= 0)
+                    crash("Invalid number of frames: %s", argv[i]);
+            }
+            else
+                crash("%s: missing --max-frames parameter", program);
+        }
+
+        else if(strcmp(argv[i], "--seed") == 0) {
+            if(++i < argc && *(argv[i]) != '-')
+                cmd.random_seed = (int)strtoul(argv[i], NULL, 10) & 0x7FFFFFFF;
+            else
+                crash("%s: missing --seed parameter", program);
+        }
+
+        else if(strcmp(argv[i], "--pipelined-rendering") == 0)
+            cmd.pipelined_rendering = TRUE;
+
+        else if(strcmp(argv[i], "--low-latency") == 0)
+            cmd.low_latency = TRUE;
+
+        else if(strcmp(argv[i], "--compress-textures") == 0)
+            cmd.compress_textures = TRUE;
+
+        else if(strcmp(argv[i], "--parallel-physics") == 0)
+            cmd.parallel_physics = TRUE;
+
+        else if(strcmp(argv[i], "--stream-levels") == 0)
+            cmd.stream_levels = TRUE;
+
+        else if(strcmp(argv[i], "--metrics") == 0)
+            cmd.metrics = TRUE;
+
         else if(strcmp(argv[i], "--quest") == 0) {
             if(++i < argc && *(argv[i]) != '-')
                 str_cpy(cmd.custom_quest_path, argv[i], sizeof(cmd.custom_quest_path));
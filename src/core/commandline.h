@@ -30,6 +30,7 @@ struct commandline_t
     /* video options */
     int video_resolution;
     int video_quality;
+    int texture_detail;
     int fullscreen;
     int show_fps;
     int hide_fps;
@@ -39,6 +40,23 @@ struct commandline_t
     int verbose;
     int compatibility_mode;
     char compatibility_version[16];
+    char startup_trace_filepath[COMMANDLINE_PATHMAX];
+
+    /* benchmark mode */
+    int benchmark;
+    int benchmark_render;
+    char replay_filepath[COMMANDLINE_PATHMAX];
+    char record_filepath[COMMANDLINE_PATHMAX];
+    int fixed_timestep;
+    int headless;
+    int max_frames;
+    int random_seed;
+    int pipelined_rendering;
+    int low_latency;
+    int compress_textures;
+    int parallel_physics;
+    int stream_levels;
+    int metrics;
 
     /* filepaths */
     char gamedir[COMMANDLINE_PATHMAX];
@@ -22,6 +22,7 @@
 #include <string.h>
 #include <locale.h>
 #include <time.h>
+#include <math.h>
 #include "engine.h"
 #include "global.h"
 #include "scene.h"
@@ -34,6 +35,7 @@
 #include "audio.h"
 #include "input.h"
 #include "font.h"
+#include "image.h"
 #include "sprite.h"
 #include "lang.h"
 #include "screenshot.h"
@@ -43,7 +45,14 @@
 #include "modutils.h"
 #include "nanoparser.h"
 #include "config.h"
+#include "benchmark.h"
+#include "metrics.h"
+#include "profiler.h"
+#include "jobs.h"
+#include "texcompress.h"
+#include "startuptrace.h"
 #include "../util/util.h"
+#include "../util/darray.h"
 #include "../util/stringutil.h"
 #include "../entities/legacy/enemy.h"
 #include "../entities/legacy/nanocalc/nanocalc.h"
@@ -56,8 +65,12 @@
 #include "../entities/mobilegamepad.h"
 #include "../scripting/scripting.h"
 #include "../scripting/loaderthread.h"
+#include "../scripting/util/classprofiler.h"
 #include "../scenes/quest.h"
 #include "../scenes/level.h"
+#include "../scenes/util/levparser.h"
+#include "../scenes/util/levpreload.h"
+#include "../physics/physicsactor.h"
 
 #include <allegro5/allegro.h>
 #include <allegro5/allegro_audio.h>
@@ -83,20 +96,26 @@ struct event_listener_t {
     void (*callback)(const ALLEGRO_EVENT*,void*);
 };
 
-typedef struct event_listener_list_t event_listener_list_t;
-struct event_listener_list_t {
-    event_listener_t event_listener;
-    event_listener_list_t* next;
+/* a bucket of event listeners. Listeners are stored contiguously in order of
+   registration. Listeners removed while dispatching an event are marked with
+   a NULL callback and compacted after the dispatch */
+typedef struct event_listener_bucket_t event_listener_bucket_t;
+struct event_listener_bucket_t {
+    DARRAY(event_listener_t, listener);
+    int live_count; /* number of listeners that haven't been removed */
+    int removed_count; /* number of listeners pending removal */
+    int dispatch_depth; /* greater than zero while dispatching */
 };
 
 #define EVENT_LISTENER_TABLE_SIZE 64
-static event_listener_list_t* event_listener_table[EVENT_LISTENER_TABLE_SIZE];
+static event_listener_bucket_t event_listener_table[EVENT_LISTENER_TABLE_SIZE];
 
 static void init_event_listener_table();
 static void release_event_listener_table();
 static void add_to_event_listener_table(event_listener_t event_listener);
 static bool remove_from_event_listener_table(event_listener_t event_listener);
 static void call_event_listeners(const ALLEGRO_EVENT* event);
+static void compact_event_listener_bucket(event_listener_bucket_t* bucket);
 
 static ALLEGRO_EVENT_QUEUE* a5_event_queue = NULL;
 static void a5_handle_timer_event(const ALLEGRO_EVENT* event, void* data);
@@ -104,11 +123,23 @@ static void a5_handle_haltresume_event(const ALLEGRO_EVENT* event, void* data);
 static void a5_handle_hotkey(const ALLEGRO_EVENT* event, void* data);
 
 static void a5_handle_remaining_display_events();
+static void benchmark_mainloop(bool* can_draw);
+static void fixed_timestep_mainloop(bool* can_draw);
+static void headless_mainloop();
+static bool wants_to_render();
+static void adjust_tick_rate(const ALLEGRO_EVENT* event);
+static bool is_input_event(const ALLEGRO_EVENT* event);
+static void coalesce_motion_events(ALLEGRO_EVENT* event);
+static bool can_coalesce_motion_events(const ALLEGRO_EVENT* event, const ALLEGRO_EVENT* next_event);
+static void track_input_event(const ALLEGRO_EVENT* event);
+static void measure_input_latency();
 
 
 
 /* private stuff ;) */
 static void clean_garbage();
+static void update_frame();
+static void render_frame();
 static void render_overlay();
 static void init_basic_stuff(const commandline_t* cmd);
 static void init_managers(const commandline_t* cmd);
@@ -126,8 +157,29 @@ static void calc_error(const char *msg);
 static void perform_extra_validation(const commandline_t* cmd);
 static const char* INTRO_QUEST = "quests/intro.qst";
 static const char* SSAPP_LEVEL = "levels/surgescript.lev";
+static const char* PROFILE_FILE = "profile.json";
 static const double TARGET_FPS = 60.0; /* frames per second */
-static const double GC_INTERVAL = 10.0; /* in seconds (garbage collector) */
+static const double MAX_RENDER_FPS = 240.0; /* cap the rendering rate in fixed timestep mode */
+static const double MAX_FRAME_TIME = 0.25; /* in seconds; avoid the spiral of death */
+static const int MAX_UPDATES_PER_FRAME = 4; /* simulation steps per rendered frame */
+static bool is_fixed_timestep = false;
+static bool is_headless = false; /* no rendering; the simulation runs as fast as possible */
+static int max_headless_frames = 0; /* headless mode: stop after this many frames; 0 means no limit */
+static int exit_status = 0;
+static bool is_low_latency = false; /* sample input just before updating the scene, not at the tick */
+static bool is_update_pending = false; /* low latency mode: the tick has come, but we haven't updated yet */
+static const double LATENCY_REPORT_INTERVAL = 0.5; /* in seconds */
+static double pending_input_time = 0.0; /* timestamp of the oldest input event not yet seen by the scene */
+static double sampled_input_time = 0.0; /* timestamp of the oldest input event seen by the scene, but not yet rendered */
+static double input_latency = 0.0; /* smoothed input-to-flip latency, in seconds */
+static double last_latency_report_time = 0.0;
+static const double IDLE_FPS = 20.0; /* tick rate of static scenes */
+static const double IDLE_REDRAW_INTERVAL = 0.25; /* in seconds; static scenes are still redrawn from time to time */
+static const int IDLE_THRESHOLD = 30; /* number of consecutive static frames before lowering the tick rate */
+static bool is_static_frame = false; /* hinted by the current scene */
+static bool needs_redraw = true; /* something changed since the last rendered frame */
+static int static_frame_count = 0; /* number of consecutive static frames */
+static double last_render_time = 0.0;
 static ALLEGRO_TIMER* a5_timer = NULL;
 static bool wants_to_quit = false;
 static bool wants_to_restart = false;
@@ -154,22 +206,34 @@ static uint32_t game_id = GAME_ID_UNAVAILABLE;
 void engine_init(const commandline_t* cmd)
 {
     /* initialize subsystems */
-    init_basic_stuff(cmd);
+    init_basic_stuff(cmd); /* starts the startup trace */
+
+    startuptrace_begin("init_managers");
     init_managers(cmd);
+    startuptrace_end();
+
+    startuptrace_begin("init_accessories");
     init_accessories(cmd);
+    startuptrace_end();
 
     is_initialized = true;
 
     /* initialize game data */
     player_set_lives(PLAYER_INITIAL_LIVES);
     player_set_score(0);
+
+    startuptrace_begin("push_initial_scene");
     push_initial_scene(cmd);
+    startuptrace_end();
 
     /* initialize in immersive mode */
     video_set_immersive(true);
 
     /* perform extra validation */
     perform_extra_validation(cmd);
+
+    /* report the loading time */
+    startuptrace_stop(commandline_getstring(cmd->startup_trace_filepath, NULL));
 }
 
 
@@ -204,6 +268,27 @@ void engine_mainloop()
     engine_add_event_listener(ALLEGRO_EVENT_DISPLAY_RESUME_DRAWING, &can_draw, a5_handle_haltresume_event);
     engine_add_event_listener(ALLEGRO_EVENT_KEY_DOWN, NULL, a5_handle_hotkey);
 
+    /* headless mode: run as fast as possible without rendering */
+    if(is_headless) {
+        headless_mainloop();
+        a5_handle_remaining_display_events();
+        return;
+    }
+
+    /* benchmark mode: run as fast as possible */
+    if(benchmark_is_enabled()) {
+        benchmark_mainloop(&can_draw);
+        a5_handle_remaining_display_events();
+        return;
+    }
+
+    /* fixed timestep mode: decouple rendering from the simulation */
+    if(is_fixed_timestep) {
+        fixed_timestep_mainloop(&can_draw);
+        a5_handle_remaining_display_events();
+        return;
+    }
+
     /* initialize the timer */
     if(NULL == (a5_timer = al_create_timer(1.0 / TARGET_FPS)))
         fatal_error("Can't create an Allegro timer");
@@ -211,6 +296,7 @@ void engine_mainloop()
     engine_add_event_source(al_get_timer_event_source(a5_timer));
     engine_add_event_listener(ALLEGRO_EVENT_TIMER, &is_ready_to_draw, a5_handle_timer_event);
     al_start_timer(a5_timer);
+    is_update_pending = false;
 
     /* game loop */
     while(!wants_to_quit && !wants_to_restart && !scenestack_empty()) {
@@ -218,19 +304,31 @@ void engine_mainloop()
 
         /* handle events & update game logic */
         al_wait_for_event(a5_event_queue, &event);
+        coalesce_motion_events(&event);
         call_event_listeners(&event);
 
+        /* lower the tick rate if nothing changes */
+        adjust_tick_rate(&event);
+
         /* skip rendering if the scene changed */
         scene_t* current_scene = scenestack_top();
         if(current_scene != scene)
             continue;
 
+        /* low latency mode: update the game after handling all pending events,
+           just before rendering */
+        if(is_update_pending && al_is_event_queue_empty(a5_event_queue)) {
+            is_update_pending = false;
+            update_frame();
+
+            if(scenestack_top() != scene)
+                continue;
+        }
+
         /* render */
         if(can_draw && is_ready_to_draw && al_is_event_queue_empty(a5_event_queue)) {
-            current_scene->render();
-            fadefx_update();
-            video_render(render_overlay);
-            screenshot_update();
+            if(wants_to_render())
+                render_frame();
             is_ready_to_draw = false;
         }
     }
@@ -252,6 +350,16 @@ void engine_quit()
     wants_to_quit = true;
 }
 
+/*
+ * engine_exit_status()
+ * The exit status of the program: 0 on success. In headless mode, it's 2
+ * if the run hasn't finished within the maximum number of frames
+ */
+int engine_exit_status()
+{
+    return exit_status;
+}
+
 /*
  * engine_restart()
  * Schedules an engine restart with the given command line arguments
@@ -355,6 +463,17 @@ void engine_remove_event_source(ALLEGRO_EVENT_SOURCE* event_source)
     al_unregister_event_source(a5_event_queue, event_source);
 }
 
+/*
+ * engine_hint_static_frame()
+ * Scenes may call this in their update function to hint the engine that
+ * nothing has changed since the previous frame. The engine will then skip
+ * rendering and lower its tick rate, saving power on idle scenes
+ */
+void engine_hint_static_frame()
+{
+    is_static_frame = true;
+}
+
 /*
  * engine_game_id()
  * A number that uniquely identifies the current release of the
@@ -386,20 +505,12 @@ int engine_compatibility_version_code()
 
 /*
  * clean_garbage()
- * Runs the garbage collector.
+ * Runs the garbage collector. We sweep a few
+ * resources per frame to avoid stalls
  */
 void clean_garbage()
 {
-    static double last = 0.0;
-    double now = timer_get_elapsed();
-
-    /* run the GC every GC_INTERVAL seconds (approximately) */
-    if(now >= last + GC_INTERVAL) {
-        last = now;
-        resourcemanager_release_unused_resources();
-    }
-    else if(now < last)
-        last = now; /* time overflow... really?! */
+    resourcemanager_sweep_unused_resources();
 }
 
 /*
@@ -409,6 +520,8 @@ void clean_garbage()
 void render_overlay()
 {
     mobilegamepad_render();
+    profiler_render();
+    classprofiler_render();
 }
 
 /*
@@ -425,10 +538,19 @@ void init_basic_stuff(const commandline_t* cmd)
     /* basic initialization */
     wants_to_quit = false;
     wants_to_restart = false;
+    exit_status = 0;
     stored_cmd = *cmd;
 
-    /* randomize */
-    srand(time(NULL));
+    /* headless mode: unattended runs must not block on message boxes */
+    is_headless = commandline_getint(cmd->headless, FALSE);
+    max_headless_frames = commandline_getint(cmd->max_frames, 0);
+    enable_message_boxes(!is_headless);
+
+    /* randomize (benchmarks, headless runs and input replays must be reproducible) */
+    bool reproducible = commandline_getint(cmd->benchmark, FALSE) || is_headless ||
+                        commandline_getstring(cmd->replay_filepath, NULL) != NULL ||
+                        commandline_getstring(cmd->record_filepath, NULL) != NULL;
+    srand(commandline_getint(cmd->random_seed, reproducible ? 0 : (int)time(NULL)));
 
     /* set Allegro's trace level to debug before calling al_init() */
     if(commandline_getint(cmd->verbose, FALSE))
@@ -443,6 +565,10 @@ void init_basic_stuff(const commandline_t* cmd)
             fatal_error("Can't initialize Allegro");
     }
 
+    /* trace the startup (al_get_time() is available after al_init()) */
+    startuptrace_start();
+    startuptrace_begin("init_basic_stuff");
+
     if(!al_is_native_dialog_addon_initialized()) {
         if(!al_init_native_dialog_addon())
             fatal_error("Can't initialize Allegro's native dialog addon");
@@ -486,6 +612,8 @@ void init_basic_stuff(const commandline_t* cmd)
 
     logfile_message("Game title: %s", config_game_title("(null)"));
     logfile_message("Game version: %s", config_game_version("(null)"));
+
+    startuptrace_end();
 }
 
 
@@ -496,13 +624,55 @@ void init_basic_stuff(const commandline_t* cmd)
 void init_managers(const commandline_t* cmd)
 {
     timer_init();
+
+    startuptrace_begin("video_init");
     video_init();
+    startuptrace_end();
+
+    profiler_init();
+    jobs_init();
+
+    startuptrace_begin("audio_init");
     audio_init();
+    startuptrace_end();
+
+    startuptrace_begin("input_init");
     input_init();
+    startuptrace_end();
+
     resourcemanager_init();
     lang_init();
 
+    /* convert the images to compressed textures */
+    if(commandline_getint(cmd->compress_textures, FALSE))
+        texcompress_convert_all();
+
+    /* benchmark mode */
+    bool benchmark = commandline_getint(cmd->benchmark, FALSE);
+    benchmark_init(
+        benchmark,
+        commandline_getint(cmd->benchmark_render, TRUE),
+        commandline_getstring(cmd->replay_filepath, NULL),
+        commandline_getstring(cmd->record_filepath, NULL)
+    );
+
+    /* live metrics */
+    metrics_init(commandline_getint(cmd->metrics, FALSE));
+
+    /* fixed timestep mode */
+    is_fixed_timestep = !benchmark && commandline_getint(cmd->fixed_timestep, FALSE);
+    timer_set_fixed_delta((benchmark || is_fixed_timestep || is_headless) ? 1.0 / TARGET_FPS : 0.0);
+    if(is_headless)
+        logfile_message("Headless mode: running %s", max_headless_frames > 0 ? "with a limited number of frames" : "until the game quits");
+
+    /* low latency mode */
+    is_low_latency = !benchmark && commandline_getint(cmd->low_latency, FALSE);
+    if(is_low_latency)
+        logfile_message("Sampling input just before updating the scene");
+
+    startuptrace_begin("load_managers_preferences");
     load_managers_preferences(cmd);
+    startuptrace_end();
 }
 
 /*
@@ -572,11 +742,19 @@ void load_managers_preferences(const commandline_t* cmd)
 
     master_volume = clip(master_volume, 0, 100);
 
+    /* large images are downscaled in low quality mode, unless specified otherwise.
+       The level of detail is fixed at startup, as the images are loaded once */
+    texturedetail_t texture_detail = (texturedetail_t)commandline_getint(cmd->texture_detail,
+        quality == VIDEOQUALITY_LOW ? TEXTUREDETAIL_HALF : TEXTUREDETAIL_FULL
+    );
+
     /* apply preferences */
     video_set_resolution(resolution);
     video_set_quality(quality);
+    resourcemanager_set_texture_detail(texture_detail);
     video_set_fullscreen(fullscreen);
     video_set_fps_visible(show_fps);
+    video_set_pipelined(commandline_getint(cmd->pipelined_rendering, FALSE));
 
     audio_set_master_volume(0.01f * (float)master_volume);
 
@@ -595,23 +773,47 @@ void init_accessories(const commandline_t* cmd)
     ALLEGRO_THREAD* surgescript_thread = surgescriptloaderthread_create(cmd->user_argc, cmd->user_argv);
 
     /* load fonts and display a loading screen */
+    startuptrace_begin("font_init");
     font_init();
+    startuptrace_end();
+
+    startuptrace_begin("loading screen");
     video_display_loading_screen();
+    startuptrace_end();
 
     /* load sprites & images */
+    startuptrace_begin("sprite_init");
     sprite_init(); /* load images in the same thread of the ALLEGRO_DISPLAY */
+    startuptrace_end();
 
     /* wait for the SurgeScript loading thread & release it */
+    startuptrace_begin("wait for scripts");
     surgescriptloaderthread_destroy(surgescript_thread); /* show potential scripting errors before loading the other accessories */
+    startuptrace_end();
 
     /* load various accessories */
     storyboard_init();
     scenestack_init();
     screenshot_init();
     fadefx_init();
+
+    startuptrace_begin("audio_preload");
     audio_preload(); /* preload audio samples */
+    startuptrace_end();
+
+    startuptrace_begin("charactersystem_init");
     charactersystem_init();
+    startuptrace_end();
+
+    startuptrace_begin("objects_init");
     objects_init(); /* legacy scripting */
+    startuptrace_end();
+
+    /* parallel physics */
+    physicsactor_set_parallel((bool)commandline_getint(cmd->parallel_physics, FALSE));
+
+    /* level streaming */
+    level_set_streaming((bool)commandline_getint(cmd->stream_levels, FALSE));
 
     /* mobile gamepad */
     bool mobile_mode = (bool)commandline_getint(cmd->mobile, FALSE);
@@ -623,7 +825,9 @@ void init_accessories(const commandline_t* cmd)
     }
 
     /* launch the SurgeScript Virtual Machine */
+    startuptrace_begin("scripting_launch_vm");
     scripting_launch_vm();
+    startuptrace_end();
 }
 
 
@@ -674,6 +878,9 @@ void release_accessories()
     font_release();
     mobilegamepad_release();
     sprite_release();
+    levpreload_release();
+    levparser_release();
+    physicsactor_set_parallel(false); /* no more physics jobs */
 }
 
 /*
@@ -682,7 +889,13 @@ void release_accessories()
  */
 void release_managers()
 {
+    metrics_release();
+    benchmark_release(); /* report the stats */
     resourcemanager_release(); /* release bitmaps BEFORE the display! */
+    image_release_async();
+    image_release_pool(); /* before destroying the display */
+    jobs_release();
+    profiler_release();
     video_release(); /* release the display */
     audio_release();
     input_release();
@@ -709,6 +922,9 @@ void release_basic_stuff()
     /* Release the table of event listeners */
     release_event_listener_table();
 
+    /* Release the interned strings */
+    str_intern_release();
+
     /* Release Allegro */
     al_destroy_event_queue(a5_event_queue);
     a5_event_queue = NULL;
@@ -792,10 +1008,13 @@ void perform_extra_validation(const commandline_t* cmd)
 void init_event_listener_table()
 {
     for(int i = 0; i < EVENT_LISTENER_TABLE_SIZE; i++) {
+        event_listener_bucket_t* bucket = &event_listener_table[i];
 
-        /* initialize linked lists */
-        event_listener_table[i] = NULL;
-
+        /* initialize the buckets */
+        darray_init(bucket->listener);
+        bucket->live_count = 0;
+        bucket->removed_count = 0;
+        bucket->dispatch_depth = 0;
     }
 }
 
@@ -806,14 +1025,12 @@ void init_event_listener_table()
 void release_event_listener_table()
 {
     for(int i = 0; i < EVENT_LISTENER_TABLE_SIZE; i++) {
+        event_listener_bucket_t* bucket = &event_listener_table[i];
 
-        /* release linked lists */
-        for(event_listener_list_t *next, *it = event_listener_table[i]; it != NULL; it = next) {
-            next = it->next;
-            free(it);
-        }
-
-        event_listener_table[i] = NULL;
+        /* release the buckets */
+        darray_release(bucket->listener);
+        bucket->live_count = 0;
+        bucket->removed_count = 0;
     }
 }
 
@@ -823,22 +1040,13 @@ void release_event_listener_table()
  */
 void add_to_event_listener_table(event_listener_t event_listener)
 {
-    /* create a new node */
-    event_listener_list_t* node = mallocx(sizeof *node);
-    node->event_listener = event_listener;
-    node->next = NULL;
-
-    /* add the node to the last position of the list, so that the listeners
-       that are registered first are executed first */
-    int index = event_listener.event_type % EVENT_LISTENER_TABLE_SIZE;
-    if(event_listener_table[index] != NULL) {
-        event_listener_list_t* last = event_listener_table[index];
-        while(last->next != NULL)
-            last = last->next;
-        last->next = node;
-    }
-    else
-        event_listener_table[index] = node;
+    event_listener_bucket_t* bucket = &event_listener_table[event_listener.event_type % EVENT_LISTENER_TABLE_SIZE];
+
+    /* add the listener to the last position of the bucket, so that the
+       listeners that are registered first are executed first. Listeners
+       added while dispatching an event will be called for that event */
+    darray_push(bucket->listener, event_listener);
+    bucket->live_count++;
 
     /* note: repeated elements are not handled */
 }
@@ -849,40 +1057,29 @@ void add_to_event_listener_table(event_listener_t event_listener)
  */
 bool remove_from_event_listener_table(event_listener_t event_listener)
 {
-    int index = event_listener.event_type % EVENT_LISTENER_TABLE_SIZE;
-    event_listener_list_t *node, *next;
+    event_listener_bucket_t* bucket = &event_listener_table[event_listener.event_type % EVENT_LISTENER_TABLE_SIZE];
 
     #define is_the_same_event_listener(e1, e2) \
         (((e1).event_type == (e2).event_type) && ((e1).callback == (e2).callback) && ((e1).data == (e2).data))
 
-    node = event_listener_table[index];
-    if(node == NULL) {
-        /* empty list */
-        return false; /* not found */
-    }
-    else if(is_the_same_event_listener(node->event_listener, event_listener)) {
-        /* first node */
-        next = node->next;
-        free(node);
-        event_listener_table[index] = next;
-        return true;
-    }
-    else {
-        /* not the first node */
-        while(node->next != NULL) {
-            if(is_the_same_event_listener(node->next->event_listener, event_listener)) {
-                next = node->next->next;
-                free(node->next);
-                node->next = next;
-                return true;
+    for(int i = 0; i < darray_length(bucket->listener); i++) {
+        if(is_the_same_event_listener(bucket->listener[i], event_listener)) {
+            bucket->live_count--;
+
+            /* we can't move the listeners while dispatching an event */
+            if(bucket->dispatch_depth > 0) {
+                bucket->listener[i].callback = NULL;
+                bucket->removed_count++;
             }
+            else
+                darray_remove(bucket->listener, i);
 
-            node = node->next;
+            return true;
         }
-
-        return false; /* not found */
     }
 
+    return false; /* not found */
+
     #undef is_the_same_event_listener
 }
 
@@ -892,12 +1089,45 @@ bool remove_from_event_listener_table(event_listener_t event_listener)
  */
 void call_event_listeners(const ALLEGRO_EVENT* event)
 {
-    int index = event->type % EVENT_LISTENER_TABLE_SIZE;
+    event_listener_bucket_t* bucket = &event_listener_table[event->type % EVENT_LISTENER_TABLE_SIZE];
+
+    track_input_event(event);
+
+    /* drop the event immediately if there are no listeners */
+    if(bucket->live_count == 0)
+        return;
+
+    /* call the listeners. The bucket may grow while we iterate,
+       so we read the listener by value at each step */
+    bucket->dispatch_depth++;
+    for(int i = 0; i < darray_length(bucket->listener); i++) {
+        event_listener_t listener = bucket->listener[i];
 
-    for(event_listener_list_t *it = event_listener_table[index]; it != NULL; it = it->next) {
-        if(it->event_listener.event_type == event->type)
-            it->event_listener.callback(event, it->event_listener.data);
+        if(listener.event_type == event->type && listener.callback != NULL)
+            listener.callback(event, listener.data);
     }
+    bucket->dispatch_depth--;
+
+    /* remove the listeners that were removed during the dispatch */
+    if(bucket->dispatch_depth == 0 && bucket->removed_count > 0)
+        compact_event_listener_bucket(bucket);
+}
+
+/*
+ * compact_event_listener_bucket()
+ * Removes the listeners marked for removal, preserving the order of the others
+ */
+void compact_event_listener_bucket(event_listener_bucket_t* bucket)
+{
+    int n = 0;
+
+    for(int i = 0; i < darray_length(bucket->listener); i++) {
+        if(bucket->listener[i].callback != NULL)
+            bucket->listener[n++] = bucket->listener[i];
+    }
+
+    darray_resize(bucket->listener, n);
+    bucket->removed_count = 0;
 }
 
 /*
@@ -987,6 +1217,21 @@ void a5_handle_hotkey(const ALLEGRO_EVENT* event, void* data)
             video_showmessage("%s", audio_is_muted() ? "Muted" : "Unmuted");
             break;
 
+        /* F6: toggle the profiler. Export the captured frames when done */
+        case ALLEGRO_KEY_F6:
+            if(profiler_toggle())
+                video_showmessage("Profiling...");
+            else if(profiler_export(PROFILE_FILE))
+                video_showmessage("Exported %s", PROFILE_FILE);
+            else
+                video_showmessage("Can't export the profile");
+            break;
+
+        /* F5: start/stop capturing frames */
+        case ALLEGRO_KEY_F5:
+            screenshot_toggle_capture();
+            break;
+
         /* F7: reconfigure joysticks */
         case ALLEGRO_KEY_F7:
             input_reconfigure_joysticks();
@@ -1005,6 +1250,263 @@ void a5_handle_timer_event(const ALLEGRO_EVENT* event, void* data)
 {
     bool* is_ready_to_draw = (bool*)data;
 
+    /* update the game. In low latency mode, the update is deferred until
+       the other pending events, possibly input events, have been handled */
+    if(is_low_latency)
+        is_update_pending = true;
+    else
+        update_frame();
+    *is_ready_to_draw = true;
+
+    /* prevent locking */
+    ALLEGRO_EVENT next_event;
+    while(al_peek_next_event(a5_event_queue, &next_event) && next_event.type == ALLEGRO_EVENT_TIMER && next_event.timer.source == event->timer.source)
+        al_drop_next_event(a5_event_queue);
+}
+
+/* runs the game loop with a fixed timestep, as fast as possible */
+void benchmark_mainloop(bool* can_draw)
+{
+    ALLEGRO_EVENT event;
+
+    while(!wants_to_quit && !wants_to_restart && !scenestack_empty()) {
+        const scene_t* scene = scenestack_top();
+
+        /* handle the pending events */
+        while(al_get_next_event(a5_event_queue, &event)) {
+            coalesce_motion_events(&event);
+            call_event_listeners(&event);
+        }
+
+        /* update game logic */
+        update_frame();
+
+        /* skip rendering if the scene changed */
+        if(scenestack_top() != scene || scenestack_empty())
+            continue;
+
+        /* render */
+        if(*can_draw && benchmark_wants_render())
+            render_frame();
+    }
+}
+
+/* runs the simulation with a fixed timestep, as fast as possible, without
+   rendering. The display is still created: images, fonts and shaders live
+   in the GPU. Nothing is flipped, so vsync doesn't throttle the loop */
+void headless_mainloop()
+{
+    ALLEGRO_EVENT event;
+    int frame_count = 0;
+
+    while(!wants_to_quit && !wants_to_restart && !scenestack_empty()) {
+        /* handle the pending events */
+        while(al_get_next_event(a5_event_queue, &event)) {
+            coalesce_motion_events(&event);
+            call_event_listeners(&event);
+        }
+
+        /* update game logic */
+        update_frame();
+
+        /* the run hasn't finished in time */
+        if(++frame_count == max_headless_frames && !wants_to_quit) {
+            logfile_message("Headless mode: stopping after %d frames", frame_count);
+            exit_status = 2;
+            wants_to_quit = true;
+        }
+    }
+}
+
+/* runs the simulation with a fixed timestep and renders at the display rate,
+   interpolating between the last two simulation steps */
+void fixed_timestep_mainloop(bool* can_draw)
+{
+    const double step = 1.0 / TARGET_FPS;
+    double accumulator = 0.0;
+    double previous_time = al_get_time();
+    ALLEGRO_EVENT event;
+
+    while(!wants_to_quit && !wants_to_restart && !scenestack_empty()) {
+        const scene_t* scene = scenestack_top();
+        double current_time = al_get_time();
+        int updates = 0;
+
+        /* accumulate the elapsed time */
+        accumulator += min(current_time - previous_time, MAX_FRAME_TIME);
+        previous_time = current_time;
+
+        /* handle the pending events */
+        while(al_get_next_event(a5_event_queue, &event)) {
+            coalesce_motion_events(&event);
+            call_event_listeners(&event);
+            if(is_input_event(&event))
+                needs_redraw = true;
+        }
+
+        /* update game logic in fixed steps */
+        while(accumulator >= step && updates++ < MAX_UPDATES_PER_FRAME) {
+            update_frame();
+            accumulator -= step;
+
+            if(scenestack_top() != scene || wants_to_quit || wants_to_restart)
+                break;
+        }
+
+        /* we're too slow: drop the excess time */
+        if(accumulator >= step)
+            accumulator = fmod(accumulator, step);
+
+        /* skip rendering if the scene changed */
+        if(scenestack_top() != scene || scenestack_empty()) {
+            accumulator = 0.0;
+            continue;
+        }
+
+        /* render, interpolating between simulation steps */
+        bool will_render = *can_draw && wants_to_render();
+        if(will_render) {
+            timer_set_interpolation(accumulator / step);
+            render_frame();
+            timer_set_interpolation(1.0f);
+        }
+
+        /* don't render faster than the display can show */
+        int refresh_rate = video_get_refresh_rate();
+        double max_render_fps = refresh_rate > 0 ? min(refresh_rate, MAX_RENDER_FPS) : MAX_RENDER_FPS;
+        double elapsed_time = al_get_time() - current_time;
+        double min_frame_time = will_render ? 1.0 / max_render_fps : step;
+        if(elapsed_time < min_frame_time)
+            al_rest(min_frame_time - elapsed_time);
+    }
+}
+
+/* checks if a new frame should be rendered, given the hints of the current scene */
+bool wants_to_render()
+{
+    /* something changed */
+    if(!is_static_frame || needs_redraw)
+        return true;
+
+    /* effects not controlled by the scene */
+    if(fadefx_is_fading() || mobilegamepad_is_fading())
+        return true;
+
+    /* redraw static frames once in a while, so that the overlay is kept up to date */
+    return al_get_time() - last_render_time >= IDLE_REDRAW_INTERVAL;
+}
+
+/* merges a motion event with the pending motion events of the same kind that
+   immediately follow it in the queue, keeping the latest position and axis
+   values and accumulating the relative motion. Other events, such as button
+   presses and releases, stop the merging, so they are kept in order */
+void coalesce_motion_events(ALLEGRO_EVENT* event)
+{
+    const int MAX_COALESCED_EVENTS = 256; /* don't starve the update tick */
+    ALLEGRO_EVENT next_event;
+
+    for(int i = 0; i < MAX_COALESCED_EVENTS; i++) {
+        if(!al_peek_next_event(a5_event_queue, &next_event))
+            break;
+        else if(!can_coalesce_motion_events(event, &next_event))
+            break;
+
+        /* accumulate the relative motion */
+        if(next_event.type == ALLEGRO_EVENT_MOUSE_AXES) {
+            next_event.mouse.dx += event->mouse.dx;
+            next_event.mouse.dy += event->mouse.dy;
+            next_event.mouse.dz += event->mouse.dz;
+            next_event.mouse.dw += event->mouse.dw;
+        }
+        else if(next_event.type == ALLEGRO_EVENT_TOUCH_MOVE) {
+            next_event.touch.dx += event->touch.dx;
+            next_event.touch.dy += event->touch.dy;
+        }
+
+        /* keep the latest event */
+        *event = next_event;
+        al_drop_next_event(a5_event_queue);
+    }
+}
+
+/* checks if two consecutive motion events can be merged */
+bool can_coalesce_motion_events(const ALLEGRO_EVENT* event, const ALLEGRO_EVENT* next_event)
+{
+    if(event->type != next_event->type || event->any.source != next_event->any.source)
+        return false;
+
+    switch(event->type) {
+        case ALLEGRO_EVENT_MOUSE_AXES:
+            return event->mouse.display == next_event->mouse.display;
+
+        case ALLEGRO_EVENT_TOUCH_MOVE:
+            return event->touch.display == next_event->touch.display && event->touch.id == next_event->touch.id;
+
+        case ALLEGRO_EVENT_JOYSTICK_AXIS:
+            return
+                event->joystick.id == next_event->joystick.id &&
+                event->joystick.stick == next_event->joystick.stick &&
+                event->joystick.axis == next_event->joystick.axis
+            ;
+
+        default:
+            return false;
+    }
+}
+
+/* lowers the tick rate of the main loop if the scene has been static for a while */
+void adjust_tick_rate(const ALLEGRO_EVENT* event)
+{
+    /* react to user input immediately */
+    if(is_input_event(event)) {
+        static_frame_count = 0;
+        needs_redraw = true;
+    }
+
+    /* change the speed of the timer */
+    double speed = (static_frame_count >= IDLE_THRESHOLD) ? 1.0 / IDLE_FPS : 1.0 / TARGET_FPS;
+    if(al_get_timer_speed(a5_timer) != speed)
+        al_set_timer_speed(a5_timer, speed);
+}
+
+/* checks if an Allegro event is triggered by user input */
+bool is_input_event(const ALLEGRO_EVENT* event)
+{
+    switch(event->type) {
+        case ALLEGRO_EVENT_KEY_DOWN:
+        case ALLEGRO_EVENT_KEY_CHAR:
+        case ALLEGRO_EVENT_KEY_UP:
+        case ALLEGRO_EVENT_JOYSTICK_AXIS:
+        case ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN:
+        case ALLEGRO_EVENT_JOYSTICK_BUTTON_UP:
+        case ALLEGRO_EVENT_JOYSTICK_CONFIGURATION:
+        case ALLEGRO_EVENT_MOUSE_AXES:
+        case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+        case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
+        case ALLEGRO_EVENT_TOUCH_BEGIN:
+        case ALLEGRO_EVENT_TOUCH_END:
+        case ALLEGRO_EVENT_TOUCH_MOVE:
+        case ALLEGRO_EVENT_TOUCH_CANCEL:
+        case ALLEGRO_EVENT_DISPLAY_RESIZE:
+        case ALLEGRO_EVENT_DISPLAY_EXPOSE:
+        case ALLEGRO_EVENT_DISPLAY_SWITCH_IN:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/* updates the managers and the current scene */
+void update_frame()
+{
+    /* start a new framestep */
+    benchmark_frame();
+    metrics_frame();
+    profiler_frame();
+    classprofiler_frame();
+    profiler_begin("update_frame");
+
     /* update the managers */
     timer_update();
     audio_update();
@@ -1012,13 +1514,87 @@ void a5_handle_timer_event(const ALLEGRO_EVENT* event, void* data)
     input_update();
     clean_garbage();
 
+    /* the scene will see the pending input events */
+    if(sampled_input_time == 0.0)
+        sampled_input_time = pending_input_time;
+    pending_input_time = 0.0;
+    image_update_async();
+    jobs_pump();
+    prefs_update(prefs);
+
     /* update the current scene */
     scene_t* current_scene = scenestack_top();
+    is_static_frame = false;
+    benchmark_begin(BENCHMARK_UPDATE);
     current_scene->update();
-    *is_ready_to_draw = true;
+    benchmark_end(BENCHMARK_UPDATE);
 
-    /* prevent locking */
-    ALLEGRO_EVENT next_event;
-    while(al_peek_next_event(a5_event_queue, &next_event) && next_event.type == ALLEGRO_EVENT_TIMER && next_event.timer.source == event->timer.source)
-        al_drop_next_event(a5_event_queue);
+    /* did anything change? */
+    if(is_static_frame && scenestack_top() == current_scene) {
+        static_frame_count++;
+    }
+    else {
+        is_static_frame = false;
+        static_frame_count = 0;
+        needs_redraw = true;
+    }
+
+    profiler_end();
+}
+
+/* renders the current scene */
+void render_frame()
+{
+    scene_t* current_scene = scenestack_top();
+
+    profiler_begin("render_frame");
+    benchmark_begin(BENCHMARK_RENDER);
+    current_scene->render();
+    fadefx_update();
+    video_render(render_overlay);
+    benchmark_end(BENCHMARK_RENDER);
+    profiler_end();
+
+    needs_redraw = false;
+    last_render_time = al_get_time();
+    measure_input_latency();
+
+    screenshot_update();
+}
+
+/* remember the time of the oldest input event not yet seen by the scene */
+void track_input_event(const ALLEGRO_EVENT* event)
+{
+    switch(event->type) {
+        case ALLEGRO_EVENT_KEY_DOWN:
+        case ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN:
+        case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+        case ALLEGRO_EVENT_TOUCH_BEGIN:
+            if(pending_input_time == 0.0)
+                pending_input_time = event->any.timestamp;
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* measure the time elapsed between an input event and the flip of the
+   display of the first frame that reflects it. With pipelined rendering,
+   add one frame to get the actual latency. Call after rendering a frame */
+void measure_input_latency()
+{
+    if(sampled_input_time == 0.0)
+        return;
+
+    /* smooth the measurements */
+    double latency = last_render_time - sampled_input_time;
+    input_latency = (input_latency > 0.0) ? input_latency + 0.25 * (latency - input_latency) : latency;
+    sampled_input_time = 0.0;
+
+    /* report it in the debug overlay once in a while */
+    if(last_render_time - last_latency_report_time >= LATENCY_REPORT_INTERVAL) {
+        video_set_input_latency(input_latency);
+        last_latency_report_time = last_render_time;
+    }
 }
@@ -33,6 +33,7 @@ void engine_release();
 
 void engine_quit();
 bool engine_must_quit();
+int engine_exit_status(); /* call after engine_release() */
 
 void engine_restart(const struct commandline_t* cmd);
 bool engine_must_restart(struct commandline_t* cmd);
@@ -42,6 +43,8 @@ bool engine_remove_event_listener(ALLEGRO_EVENT_TYPE event_type, void* data, voi
 void engine_add_event_source(ALLEGRO_EVENT_SOURCE* event_source);
 void engine_remove_event_source(ALLEGRO_EVENT_SOURCE* event_source);
 
+void engine_hint_static_frame(); /* nothing changed since the previous frame */
+
 uint32_t engine_game_id();
 int engine_compatibility_version_code();
 
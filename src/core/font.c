@@ -31,10 +31,12 @@
 #include "global.h"
 #include "video.h"
 #include "image.h"
+#include "shader.h"
 #include "color.h"
 #include "asset.h"
 #include "lang.h"
 #include "logfile.h"
+#include "startuptrace.h"
 #include "nanoparser.h"
 #include "input.h"
 #include "../util/stringutil.h"
@@ -114,6 +116,7 @@ struct fontscript_t {
 /* ------------------------------- */
 
 /* fontdrv_t: a font driver stores the attributes the font class (bmp, ttf) */
+struct fonttext_t;
 typedef struct fontdrv_t fontdrv_t;
 struct fontdrv_t { /* abstract font: base class */
     void (*textout)(const fontdrv_t*,const char*,int,int,color_t); /* prints an unformatted line of text */
@@ -121,17 +124,24 @@ struct fontdrv_t { /* abstract font: base class */
     int (*line_height)(const fontdrv_t*); /* height in pixels of any line of text */
     const char* (*filepath)(const fontdrv_t*); /* relative path of the font */
     const image_t* (*image)(const fontdrv_t*); /* image atlas (if any) */
+    bool (*layout)(const fontdrv_t*,const char*,int,int,color_t,struct fonttext_t*); /* lays out the glyphs of an unformatted line of text; returns false if unsupported */
     void (*release)(fontdrv_t*); /* release the fontdrv_t */
 };
 static fontdrv_t* fontdrv_bmp_new(const char* source_file, charproperties_t chr[], int spacing[2]);
 static fontdrv_t* fontdrv_ttf_new(const char* source_file, int size, bool antialias, bool shadow);
 
+typedef struct bmpglyph_t bmpglyph_t;
+struct bmpglyph_t { /* a glyph of a bitmap font */
+    image_t* image; /* NULL if the glyph is undefined */
+    point2d_t offset; /* defaults to zero */
+    int width, height; /* size of the image, queried once */
+};
+
 typedef struct fontdrv_bmp_t fontdrv_bmp_t;
 struct fontdrv_bmp_t { /* bitmap font */
     fontdrv_t base;
     const image_t* atlas; /* image atlas */
-    image_t* glyph[FONT_MAXBITMAPGLYPHS]; /* glyph indexed by codepoint */
-    point2d_t glyph_offset[FONT_MAXBITMAPGLYPHS]; /* offset of a glyph (defaults to zero) */
+    bmpglyph_t glyph[FONT_MAXBITMAPGLYPHS]; /* dense table of glyphs indexed by codepoint */
     v2d_t spacing; /* character spacing */
     int line_height; /* max({ image_height(glyph[j]) | j >= 0 }) */
     char* filepath; /* relative path */
@@ -141,13 +151,73 @@ static int fontdrv_bmp_linewidth(const fontdrv_t* fnt, const char* text);
 static int fontdrv_bmp_lineheight(const fontdrv_t* fnt);
 static const char* fontdrv_bmp_filepath(const fontdrv_t* fnt);
 static const image_t* fontdrv_bmp_image(const fontdrv_t* fnt);
+static bool fontdrv_bmp_layout(const fontdrv_t* fnt, const char* text, int x, int y, color_t color, struct fonttext_t* out);
 static void fontdrv_bmp_release(fontdrv_t* fnt);
-static inline const image_t* find_bmp_glyph(const fontdrv_bmp_t* f, uint32_t codepoint, point2d_t* out_offset);
+static inline const bmpglyph_t* find_bmp_glyph(const fontdrv_bmp_t* f, uint32_t codepoint);
+static inline uint32_t next_codepoint(const char* text, size_t* i);
+
+/*
+
+TTF GLYPH ATLAS
+
+Allegro rasterizes the glyphs of each TrueType font on its own, and every font
+driver would load its own face. Instead, we share a glyph atlas among all the
+TrueType fonts with the same (face, size, antialias). The atlas pre-rasterizes
+common glyph ranges into a single texture, so that text can be laid out as a
+glyph run and rendered just like bitmap fonts, in a few batched draws. Text with
+glyphs outside of these ranges falls back to al_draw_text().
+
+*/
+#define TTF_ATLAS_WIDTH 1024
+#define TTF_ATLAS_MAX_HEIGHT 2048
+#define TTF_ATLAS_PADDING 1 /* spacing between glyphs, so that they don't bleed */
+
+typedef struct ttfrange_t ttfrange_t;
+struct ttfrange_t { /* a range of codepoints */
+    uint32_t first, last;
+};
+
+static const ttfrange_t TTF_ATLAS_RANGE[] = {
+    { 0x0020, 0x007E }, /* Basic Latin */
+    { 0x00A0, 0x00FF }, /* Latin-1 Supplement */
+    { 0x0100, 0x017F }, /* Latin Extended-A */
+    { 0x0370, 0x03FF }, /* Greek */
+    { 0x0400, 0x04FF }, /* Cyrillic */
+    { 0x2010, 0x205E }  /* General Punctuation */
+};
+
+typedef struct ttfglyph_t ttfglyph_t;
+struct ttfglyph_t { /* a glyph of the atlas */
+    bool valid; /* is the glyph in the atlas? */
+    image_t* image; /* NULL if the glyph is blank (e.g., space) */
+    point2d_t offset; /* offset relative to the pen position */
+};
+
+typedef struct ttfatlas_t ttfatlas_t;
+struct ttfatlas_t { /* glyph atlas of a TrueType face */
+    char* filepath; /* relative path of the face */
+    int size; /* font size */
+    bool antialias; /* enable antialiasing? */
+    int reference_count; /* the number of font drivers that use this atlas */
+    ALLEGRO_FONT* font; /* shared TrueType font */
+    image_t* image; /* texture of the atlas; NULL if not available */
+    ttfglyph_t* glyph; /* glyphs of TTF_ATLAS_RANGE[] */
+    bool is_baked; /* have we rasterized the glyphs? */
+    ttfatlas_t* next; /* linked list */
+};
+
+static ttfatlas_t* ttfatlas_list = NULL;
+static ttfatlas_t* ttfatlas_acquire(const char* filepath, int size, bool antialias);
+static void ttfatlas_release(ttfatlas_t* atlas);
+static void ttfatlas_bake(ttfatlas_t* atlas);
+static const ttfglyph_t* ttfatlas_find_glyph(const ttfatlas_t* atlas, uint32_t codepoint);
+static int ttfatlas_glyph_count();
 
 typedef struct fontdrv_ttf_t fontdrv_ttf_t;
 struct fontdrv_ttf_t { /* truetype font */
     fontdrv_t base;
-    ALLEGRO_FONT* font; /* TrueType font */
+    ALLEGRO_FONT* font; /* TrueType font (shared) */
+    ttfatlas_t* atlas; /* glyph atlas (shared) */
     int size; /* font size */
     bool antialias; /* enable antialiasing? */
     bool shadow; /* enable shadow? */
@@ -159,6 +229,7 @@ static int fontdrv_ttf_linewidth(const fontdrv_t* fnt, const char* text);
 static int fontdrv_ttf_lineheight(const fontdrv_t* fnt);
 static const char* fontdrv_ttf_filepath(const fontdrv_t* fnt);
 static const image_t* fontdrv_ttf_image(const fontdrv_t* fnt);
+static bool fontdrv_ttf_layout(const fontdrv_t* fnt, const char* text, int x, int y, color_t color, struct fonttext_t* out);
 static void fontdrv_ttf_release(fontdrv_t* fnt);
 
 /* ------------------------------- */
@@ -186,6 +257,24 @@ typedef char* fontargs_t[FONTARGS_MAX];
 
 /* ------------------------------- */
 
+/* a glyph laid out in text space */
+typedef struct fontglyph_t fontglyph_t;
+struct fontglyph_t
+{
+    const image_t* image; /* the image of the glyph */
+    point2d_t offset; /* (x,y) offset relative to the position of the text */
+    color_t color; /* the color of the glyph */
+};
+
+/* a cached reference to a $VARIABLE */
+typedef struct fontvar_t fontvar_t;
+struct fontvar_t
+{
+    char* name; /* name of the variable */
+    fontcallback_t callback; /* predefined variable; NULL if the variable is a string of the language file */
+    langkey_t key; /* the id of the string of the language file, valid in all languages */
+};
+
 /* preprocessed font text */
 typedef struct fonttext_t fonttext_t;
 struct fonttext_t
@@ -196,22 +285,73 @@ struct fonttext_t
     DARRAY(point2d_t, offset); /* (x,y) offset to be applied before each segment is rendered */
     DARRAY(v2d_t, size); /* the size in pixels of each segment */
 
+    /* glyph run: the laid out glyphs of all segments (if supported by the font driver) */
+    DARRAY(fontglyph_t, glyph); /* glyphs in rendering order */
+    bool has_glyph_run; /* if false, we render the text segments instead of the glyphs */
+
     /* helpers */
     DARRAY(color_t, color_sequence); /* auxiliary array */
     DARRAY(int, line_width); /* the width in pixels of each line */
     DARRAY(char, buffer); /* string buffer */
+    DARRAY(fontvar_t, variable); /* cached references to the variables of the text */
 
     /* misc */
     bool is_dirty; /* do we need to preprocess the text? */
     v2d_t total_size; /* total size of the text, in pixels */
+    uint32_t version; /* incremented whenever the text is preprocessed */
+};
+
+/* a token of a compiled text */
+typedef enum fonttokentype_t fonttokentype_t;
+enum fonttokentype_t
+{
+    FONTTOKEN_LITERAL, /* a piece of text without variables */
+    FONTTOKEN_ARGUMENT, /* $1, $2 ... $9 */
+    FONTTOKEN_VARIABLE, /* $IDENTIFIER or ${IDENTIFIER} */
+    FONTTOKEN_EXPRESSION /* ${EXPRESSION} with variables of its own */
+};
+
+typedef struct fonttoken_t fonttoken_t;
+struct fonttoken_t
+{
+    fonttokentype_t type; /* the type of the token */
+    int start, length; /* substring of the text: the literal, the name of the variable or the expression */
+    int argument; /* zero-based index of a FONTTOKEN_ARGUMENT */
+    fontvar_t var; /* a resolved FONTTOKEN_VARIABLE (the name is not stored) */
+    char* value; /* the last value of the slot, if it's not a literal; NULL if not evaluated yet */
+};
+
+/* a text compiled into literals and variable slots when it's set. When the
+   text is (re)processed, we evaluate the slots only, and we reuse the last
+   expansion of the text if the values of the slots haven't changed */
+typedef struct fonttemplate_t fonttemplate_t;
+struct fonttemplate_t
+{
+    DARRAY(fonttoken_t, token); /* tokens of the text */
+    char* expansion; /* the last expansion of the text; NULL if not available */
 };
 
-static void preprocess_expand(char* dest, char* tmp, size_t dest_size, fontargs_t args);
+static void compile_template(fonttemplate_t* tpl, const char* text);
+static const char* expand_template(fonttemplate_t* tpl, const char* text, fontargs_t args, fonttext_t* out);
+static const char* evaluate_token(const fonttoken_t* token, const char* text, const void* context);
+static void push_token(fonttemplate_t* tpl, const char* text, fonttokentype_t type, int start, int length);
+static void clear_template(fonttemplate_t* tpl);
+
+/* the data passed to read_variable() when expanding variables */
+typedef struct fontvarcontext_t fontvarcontext_t;
+struct fontvarcontext_t
+{
+    char** args; /* text arguments */
+    fonttext_t* out; /* holds the cached references to the variables */
+};
+
+static void preprocess_expand(char* dest, char* tmp, size_t dest_size, fontargs_t args, fonttext_t* out, int max_passes);
 static char* preprocess_substring(char* text, int index_of_first_char, int max_length);
 static void preprocess_colors(fonttext_t* out, const char* text);
 static void preprocess_wordwrap(fonttext_t* out, const fontdrv_t* drv, int max_width);
 static void preprocess_split(fonttext_t* out, const fontdrv_t* drv, fontalign_t align);
-static void preprocess_text(fonttext_t* out, const fontdrv_t* drv, const char* text, int max_width, fontalign_t align, fontargs_t argument, int index_of_first_char, int max_length);
+static void preprocess_layout(fonttext_t* out, const fontdrv_t* drv);
+static void preprocess_text(fonttext_t* out, const fontdrv_t* drv, const char* expanded_text, int max_width, fontalign_t align, int index_of_first_char, int max_length);
 static void preprocess(font_t* f);
 
 /* ------------------------------- */
@@ -220,6 +360,7 @@ static void preprocess(font_t* f);
 struct font_t {
     fontdrv_t* drv; /* font driver */
     char* text; /* unprocessed text */
+    fonttemplate_t text_template; /* compiled text */
     v2d_t position; /* position */
     int max_width; /* width (in pixels) for wordwrap */
     bool visible; /* is this font visible? */
@@ -229,11 +370,20 @@ struct font_t {
     fonttext_t preprocessed_text; /* preprocessed text */
     char* lang_id; /* current language ID (multilingual support) */
     char* name; /* font name (not language specific) */
+
+    /* static mode: the glyph run is rendered to an offscreen texture,
+       which is updated only when the preprocessed text changes */
+    bool is_static;
+    image_t* cached_image; /* NULL if not available */
+    point2d_t cached_offset; /* position of the cached image relative to the text */
+    uint32_t cached_version; /* the version of the preprocessed text that was cached */
 };
 
 /* misc */
 static void register_predefined_vars();
 static const char* read_variable(const char* key, void* data);
+static const fontvar_t* find_variable(fonttext_t* out, const char* name);
+static void clear_variables(fonttext_t* out);
 static int expand_vars(char* dest, const char* src, size_t dest_size, const char* (*callback)(const char*,void*), void* data);
 static inline bool has_vars_to_expand(const char* str);
 static char* convert_to_ascii(char* str);
@@ -246,6 +396,9 @@ static void refresh_driver(font_t* fnt);
 static inline bool has_loaded_ttf(const fontdrv_ttf_t* f);
 static void load_ttf(fontdrv_ttf_t* f);
 static void unload_ttf(fontdrv_ttf_t* f);
+static bool layout_ttf(const fontdrv_ttf_t* f, const char* text, int x, int y, color_t color, struct fonttext_t* out);
+static void update_cached_image(font_t* f);
+static void discard_cached_image(font_t* f);
 
 /*
  * font_init()
@@ -326,6 +479,9 @@ font_t* font_create(const char* font_name)
     font_t* f = mallocx(sizeof *f);
 
     f->text = str_dup("");
+    darray_init(f->text_template.token);
+    f->text_template.expansion = NULL;
+    compile_template(&f->text_template, f->text);
     f->max_width = 0;
     f->visible = true;
     f->position = v2d_new(0, 0);
@@ -346,11 +502,20 @@ font_t* font_create(const char* font_name)
     darray_init_ex(f->preprocessed_text.color, 16);
     darray_init_ex(f->preprocessed_text.offset, 16);
     darray_init_ex(f->preprocessed_text.size, 16);
+    darray_init_ex(f->preprocessed_text.glyph, 64);
     darray_init_ex(f->preprocessed_text.color_sequence, 16);
     darray_init_ex(f->preprocessed_text.line_width, 4);
     darray_init_ex(f->preprocessed_text.buffer, 64);
+    darray_init_ex(f->preprocessed_text.variable, 4);
+    f->preprocessed_text.has_glyph_run = false;
     f->preprocessed_text.is_dirty = true;
     f->preprocessed_text.total_size = v2d_new(0, 0);
+    f->preprocessed_text.version = 0;
+
+    f->is_static = false;
+    f->cached_image = NULL;
+    f->cached_offset = point2d_new(0, 0);
+    f->cached_version = 0;
 
     return f;
 }
@@ -364,9 +529,14 @@ font_t* font_create(const char* font_name)
  */
 void font_destroy(font_t* f)
 {
+    discard_cached_image(f);
+
+    clear_variables(&f->preprocessed_text);
+    darray_release(f->preprocessed_text.variable);
     darray_release(f->preprocessed_text.buffer);
     darray_release(f->preprocessed_text.line_width);
     darray_release(f->preprocessed_text.color_sequence);
+    darray_release(f->preprocessed_text.glyph);
     darray_release(f->preprocessed_text.size);
     darray_release(f->preprocessed_text.offset);
     darray_release(f->preprocessed_text.color);
@@ -377,6 +547,9 @@ void font_destroy(font_t* f)
             free(f->argument[i]);
     }
 
+    clear_template(&f->text_template);
+    darray_release(f->text_template.token);
+
     free(f->lang_id);
     free(f->name);
     free(f->text);
@@ -410,6 +583,7 @@ void font_set_text(font_t* f, const char* fmt, ...)
         free(f->text);
     }
     f->text = str_dup(buf);
+    compile_template(&f->text_template, f->text);
 
     /* preprocess text */
     f->preprocessed_text.is_dirty = true;
@@ -515,6 +689,10 @@ void font_render(font_t* f, v2d_t camera_position)
     if(f->preprocessed_text.is_dirty)
         preprocess(f);
 
+    /* static mode: update the cached image if the text has changed */
+    if(f->is_static && f->cached_version != f->preprocessed_text.version)
+        update_cached_image(f);
+
     /* compute the position of the text in screen space */
     v2d_t half_screen_size = v2d_multiply(video_get_screen_size(), 0.5f);
     v2d_t topleft = v2d_subtract(camera_position, half_screen_size);
@@ -536,6 +714,31 @@ void font_render(font_t* f, v2d_t camera_position)
         if(!rect_overlaps(target_rect, bounding_box))
             break;
 
+        /* render the cached image, if available */
+        if(f->is_static && f->cached_image != NULL) {
+            point2d_t image_position = point2d_add(initial_position, f->cached_offset);
+            image_draw(f->cached_image, image_position.x, image_position.y, IF_NONE);
+            break;
+        }
+
+        /* render the cached glyph run, if available */
+        if(f->preprocessed_text.has_glyph_run) {
+            for(int i = 0; i < darray_length(f->preprocessed_text.glyph); i++) {
+                const fontglyph_t* glyph = &(f->preprocessed_text.glyph[i]);
+                point2d_t glyph_position = point2d_add(initial_position, glyph->offset);
+                rect_t glyph_rect = rect_new(glyph_position.x, glyph_position.y, image_width(glyph->image), image_height(glyph->image));
+
+                /* clip out the glyph if possible */
+                if(!rect_overlaps(target_rect, glyph_rect))
+                    continue;
+
+                /* render the glyph */
+                image_draw_tinted(glyph->image, glyph_position.x, glyph_position.y, glyph->color, IF_NONE);
+            }
+
+            break;
+        }
+
         /* for each preprocessed text segment */
         for(int i = 0; i < darray_length(f->preprocessed_text.text_segment); i++) {
             const char* text_segment = f->preprocessed_text.text_segment[i];
@@ -621,6 +824,32 @@ void font_set_visible(font_t* f, bool is_visible)
 }
 
 
+/*
+ * font_is_static()
+ * Is the font in static mode?
+ */
+bool font_is_static(const font_t* f)
+{
+    return f->is_static;
+}
+
+
+/*
+ * font_set_static()
+ * In static mode, the text is rendered from an offscreen texture that is
+ * updated only when the text changes. Use it for texts that rarely change
+ */
+void font_set_static(font_t* f, bool is_static)
+{
+    if(!is_static) {
+        discard_cached_image(f);
+        f->cached_version = 0;
+    }
+
+    f->is_static = is_static;
+}
+
+
 /*
  * font_use_substring()
  * Since fonts may have color tags, variables, etc. , use this
@@ -733,11 +962,12 @@ const image_t* font_get_image(const font_t* f)
 /* returns a static char* (case insensitive search) */
 const char* read_variable(const char* key, void* data)
 {
+    const fontvarcontext_t* context = (const fontvarcontext_t*)data;
     const char* value = NULL;
 
     if(key[0] >= '1' && key[0] <= '9') {
         /* read $1, $2 ... $9 */
-        const char** args = (const char**)data;
+        const char** args = (const char**)(context->args);
         int index = key[0] - '1';
 
         if(index >= 0 && index < FONTARGS_MAX)
@@ -745,18 +975,52 @@ const char* read_variable(const char* key, void* data)
     }
     else {
         /* read $IDENTIFIER */
-        fontcallback_t fun = callbacktable_find(key);
-        static char buf[1024];
+        const fontvar_t* var = find_variable(context->out, key);
 
-        if(fun != NULL)
-            value = fun();
+        if(var->callback != NULL)
+            value = var->callback();
         else
-            value = lang_getstring(key, buf, sizeof(buf));
+            value = lang_getbykey(var->key);
     }
 
     return value != NULL ? value : "null";
 }
 
+/* find a cached reference to a variable, resolving it if needed */
+const fontvar_t* find_variable(fonttext_t* out, const char* name)
+{
+    const int MAX_CACHED_VARIABLES = 16;
+
+    /* fonts reference only a handful of variables */
+    for(int i = 0; i < darray_length(out->variable); i++) {
+        if(0 == str_icmp(out->variable[i].name, name))
+            return &(out->variable[i]);
+    }
+
+    /* don't let the cache grow indefinitely if the text changes a lot */
+    if(darray_length(out->variable) >= MAX_CACHED_VARIABLES)
+        clear_variables(out);
+
+    /* resolve the variable: predefined variables take precedence */
+    fontvar_t var = {
+        .name = str_dup(name),
+        .callback = callbacktable_find(name),
+        .key = lang_key(name)
+    };
+
+    darray_push(out->variable, var);
+    return &(out->variable[darray_length(out->variable) - 1]);
+}
+
+/* clear the cached references to variables */
+void clear_variables(fonttext_t* out)
+{
+    for(int i = 0; i < darray_length(out->variable); i++)
+        free(out->variable[i].name);
+
+    darray_clear(out->variable);
+}
+
 /*
 
 expands the variables, e.g.,
@@ -1058,15 +1322,15 @@ char* join_names(const char* name, const char* lang_id)
 /* ------------------------------------------------- */
 
 /* expand variables */
-void preprocess_expand(char* dest, char* tmp, size_t dest_size, fontargs_t args)
+void preprocess_expand(char* dest, char* tmp, size_t dest_size, fontargs_t args, fonttext_t* out, int max_passes)
 {
-    const int MAX_PASSES = 3;
+    fontvarcontext_t context = { .args = args, .out = out };
 
     /* expand variables */
-    for(int k = 0; k < MAX_PASSES && has_vars_to_expand(dest); k++) {
+    for(int k = 0; k < max_passes && has_vars_to_expand(dest); k++) {
         int len = strlen(dest);
         memcpy(tmp, dest, len+1);
-        expand_vars(dest, tmp, dest_size, read_variable, (void*)args);
+        expand_vars(dest, tmp, dest_size, read_variable, (void*)(&context));
     }
 
     /* utf8 check */
@@ -1248,6 +1512,7 @@ void preprocess_split(fonttext_t* out, const fontdrv_t* drv, fontalign_t align)
     darray_clear(out->text_segment);
     darray_clear(out->color);
     darray_clear(out->offset);
+    darray_clear(out->size);
     out->total_size = v2d_new(0, 0);
 
     color = out->color_sequence[0];
@@ -1345,25 +1610,44 @@ void preprocess_split(fonttext_t* out, const fontdrv_t* drv, fontalign_t align)
     }
 }
 
+/* lay out the glyphs of the text segments, so that we don't need to
+   decode the text and look up the glyphs whenever we render it */
+void preprocess_layout(fonttext_t* out, const fontdrv_t* drv)
+{
+    darray_clear(out->glyph);
+    out->has_glyph_run = true;
+
+    for(int i = 0; i < darray_length(out->text_segment); i++) {
+        const char* text_segment = out->text_segment[i];
+        point2d_t offset = out->offset[i];
+        color_t color = out->color[i];
+
+        if(!drv->layout(drv, text_segment, offset.x, offset.y, color, out)) {
+            darray_clear(out->glyph);
+            out->has_glyph_run = false;
+            return;
+        }
+    }
+}
+
 /* preprocess a text for rendering */
-void preprocess_text(fonttext_t* out, const fontdrv_t* drv, const char* text, int max_width, fontalign_t align, fontargs_t args, int index_of_first_char, int max_length)
+void preprocess_text(fonttext_t* out, const fontdrv_t* drv, const char* expanded_text, int max_width, fontalign_t align, int index_of_first_char, int max_length)
 {
-    static char buf[FONT_TEXTMAXSIZE], tmp[FONT_TEXTMAXSIZE];
+    static char buf[FONT_TEXTMAXSIZE];
     char* substr;
 
     /* reset arrays */
     darray_clear(out->text_segment);
     darray_clear(out->color);
     darray_clear(out->offset);
+    darray_clear(out->size);
+    darray_clear(out->glyph);
     darray_clear(out->line_width);
     darray_clear(out->color_sequence);
     darray_clear(out->buffer);
 
-    /* copy text to a temporary buffer */
-    str_cpy(buf, text, sizeof(buf));
-
-    /* expand variables */
-    preprocess_expand(buf, tmp, sizeof(buf), args);
+    /* copy the expanded text to a temporary buffer */
+    str_cpy(buf, expanded_text, sizeof(buf));
 
     /* preprocess substring */
     substr = preprocess_substring(buf, index_of_first_char, max_length);
@@ -1377,6 +1661,9 @@ void preprocess_text(fonttext_t* out, const fontdrv_t* drv, const char* text, in
     /* split the text into segments */
     preprocess_split(out, drv, align);
 
+    /* lay out the glyphs of the segments */
+    preprocess_layout(out, drv);
+
 #if 0
     /* test */
     for(int i = 0; i < darray_length(out->text_segment); i++) {
@@ -1397,9 +1684,300 @@ void preprocess(font_t* f)
     if(!f->preprocessed_text.is_dirty)
         return;
 
+    /* expand the variables of the compiled text */
+    const char* expanded_text = expand_template(&f->text_template, f->text, f->argument, &f->preprocessed_text);
+
     /* preprocess the font and clear up the is_dirty flag */
-    preprocess_text(&f->preprocessed_text, f->drv, f->text, f->max_width, f->align, f->argument, f->index_of_first_char, f->max_length);
+    preprocess_text(&f->preprocessed_text, f->drv, expanded_text, f->max_width, f->align, f->index_of_first_char, f->max_length);
     f->preprocessed_text.is_dirty = false;
+    f->preprocessed_text.version++;
+}
+
+/* render the glyph run of a font in static mode to its cached image */
+void update_cached_image(font_t* f)
+{
+    const int MAX_CACHED_IMAGE_SIZE = 1024; /* larger texts are rendered glyph by glyph */
+    const fonttext_t* text = &(f->preprocessed_text);
+    int left = 0, top = 0, right = 0, bottom = 0;
+
+    /* the cached image won't be updated until the text changes */
+    f->cached_version = text->version;
+
+    /* we need a glyph run */
+    if(!text->has_glyph_run || darray_length(text->glyph) == 0) {
+        discard_cached_image(f);
+        return;
+    }
+
+    /* find the bounding box of the glyphs */
+    for(int i = 0; i < darray_length(text->glyph); i++) {
+        const fontglyph_t* glyph = &(text->glyph[i]);
+        int x = glyph->offset.x, y = glyph->offset.y;
+        int w = image_width(glyph->image), h = image_height(glyph->image);
+
+        if(i == 0 || x < left)
+            left = x;
+        if(i == 0 || y < top)
+            top = y;
+        if(i == 0 || x + w > right)
+            right = x + w;
+        if(i == 0 || y + h > bottom)
+            bottom = y + h;
+    }
+
+    int width = right - left, height = bottom - top;
+    if(width <= 0 || height <= 0 || width > MAX_CACHED_IMAGE_SIZE || height > MAX_CACHED_IMAGE_SIZE) {
+        discard_cached_image(f);
+        return;
+    }
+
+    /* reuse the image if it's large enough, so that texts that
+       change from time to time don't recreate their textures */
+    if(f->cached_image != NULL && (image_width(f->cached_image) < width || image_height(f->cached_image) < height))
+        discard_cached_image(f);
+
+    if(f->cached_image == NULL) {
+        if(NULL == (f->cached_image = image_create(width, height))) {
+            logfile_message("Can't create the cached image of font \"%s\"", f->name);
+            return;
+        }
+    }
+
+    /* render the glyph run */
+    image_t* prev_target = image_drawing_target();
+    const shader_t* prev_shader = shader_get_active();
+
+    image_set_drawing_target(f->cached_image);
+    shader_set_active(shader_get_default());
+    image_clear(color_rgba(0, 0, 0, 0));
+
+    image_hold_drawing(true);
+    for(int i = 0; i < darray_length(text->glyph); i++) {
+        const fontglyph_t* glyph = &(text->glyph[i]);
+        image_draw_tinted(glyph->image, glyph->offset.x - left, glyph->offset.y - top, glyph->color, IF_NONE);
+    }
+    image_hold_drawing(false);
+
+    image_set_drawing_target(prev_target);
+    shader_set_active(prev_shader);
+
+    f->cached_offset = point2d_new(left, top);
+}
+
+/* release the cached image of a font in static mode */
+void discard_cached_image(font_t* f)
+{
+    if(f->cached_image != NULL) {
+        image_destroy(f->cached_image);
+        f->cached_image = NULL;
+    }
+}
+
+/* ------------------------------------------------- */
+/* text templates */
+/* ------------------------------------------------- */
+
+/* compile a text into literals and variable slots; this must match expand_vars() */
+void compile_template(fonttemplate_t* tpl, const char* text)
+{
+    const int MAX_LENGTH = 255; /* the size of the accumulator of expand_vars() */
+    int literal_start = 0;
+    int i = 0;
+
+    clear_template(tpl);
+
+    while(text[i] != '\0') {
+        char next_char = text[i+1];
+        int start = i + 2, end = start;
+
+        /* copy char */
+        if(text[i] != '$') {
+            i++;
+            continue;
+        }
+
+        /* match ${EXPRESSION} */
+        if(next_char == '{') {
+            for(int curly_counter = 0; text[end] != '\0' && (text[end] != '}' || curly_counter > 0); end++) {
+                if(text[end] == '{')
+                    ++curly_counter;
+                else if(text[end] == '}')
+                    --curly_counter;
+            }
+
+            push_token(tpl, text, FONTTOKEN_LITERAL, literal_start, i - literal_start);
+            if(end > start) { /* "${" at the end of the text expands to nothing */
+                int length = min(end - start, MAX_LENGTH);
+                bool is_identifier = true;
+
+                /* ${IDENTIFIER} is just a variable */
+                for(int k = start; k < start + length && is_identifier; k++)
+                    is_identifier = (isalnum((unsigned char)text[k]) || text[k] == '_') && !(k == start && isdigit((unsigned char)text[k]));
+                push_token(tpl, text, is_identifier ? FONTTOKEN_VARIABLE : FONTTOKEN_EXPRESSION, start, length);
+            }
+
+            i = literal_start = (text[end] == '}') ? end + 1 : end;
+        }
+
+        /* match $1, $2 ... $9 */
+        else if(next_char >= '1' && next_char <= '9') {
+            push_token(tpl, text, FONTTOKEN_LITERAL, literal_start, i - literal_start);
+            push_token(tpl, text, FONTTOKEN_ARGUMENT, i + 1, 1);
+            i = literal_start = i + 2;
+        }
+
+        /* match $IDENTIFIER */
+        else if(isalpha((unsigned char)next_char) || next_char == '_') {
+            for(start = end = i + 1; isalnum((unsigned char)text[end]) || text[end] == '_'; end++);
+
+            push_token(tpl, text, FONTTOKEN_LITERAL, literal_start, i - literal_start);
+            push_token(tpl, text, FONTTOKEN_VARIABLE, start, min(end - start, MAX_LENGTH));
+            i = literal_start = end;
+        }
+
+        /* just a dollar sign */
+        else
+            i++;
+    }
+
+    push_token(tpl, text, FONTTOKEN_LITERAL, literal_start, i - literal_start);
+}
+
+/* expand a compiled text, reusing the last expansion if the values of the slots haven't changed */
+const char* expand_template(fonttemplate_t* tpl, const char* text, fontargs_t args, fonttext_t* out)
+{
+    const int MAX_PASSES = 3; /* including the expansion of the template */
+    static char buf[FONT_TEXTMAXSIZE], tmp[FONT_TEXTMAXSIZE];
+    fontvarcontext_t context = { .args = args, .out = out };
+    bool has_changed = (tpl->expansion == NULL);
+    int m = sizeof(buf) - 1, j = 0;
+
+    /* evaluate the slots */
+    for(int i = 0; i < darray_length(tpl->token); i++) {
+        fonttoken_t* token = &(tpl->token[i]);
+        const char* value;
+
+        if(token->type == FONTTOKEN_LITERAL)
+            continue;
+
+        value = evaluate_token(token, text, &context);
+        if(token->value == NULL || 0 != strcmp(token->value, value)) {
+            free(token->value);
+            token->value = str_dup(value);
+            has_changed = true;
+        }
+    }
+
+    /* nothing has changed */
+    if(!has_changed)
+        return tpl->expansion;
+
+    /* concatenate the tokens */
+    for(int i = 0; i < darray_length(tpl->token) && j < m; i++) {
+        const fonttoken_t* token = &(tpl->token[i]);
+
+        if(token->type == FONTTOKEN_LITERAL) {
+            int length = min(token->length, m - j);
+            memcpy(buf + j, text + token->start, length);
+            j += length;
+        }
+        else {
+            for(const char* p = token->value; *p && j < m; )
+                buf[j++] = *(p++);
+        }
+    }
+    buf[j] = '\0';
+
+    /* the values of the slots may have variables of their own */
+    preprocess_expand(buf, tmp, sizeof(buf), args, out, MAX_PASSES - 1);
+
+    /* store the expansion */
+    free(tpl->expansion);
+    tpl->expansion = str_dup(buf);
+    return tpl->expansion;
+}
+
+/* evaluate a variable slot of a compiled text */
+const char* evaluate_token(const fonttoken_t* token, const char* text, const void* context)
+{
+    const fontvarcontext_t* ctx = (const fontvarcontext_t*)context;
+    const char* value = NULL;
+
+    switch(token->type) {
+        case FONTTOKEN_ARGUMENT:
+            if(token->argument < FONTARGS_MAX)
+                value = ctx->args[token->argument]; /* may be NULL */
+            break;
+
+        case FONTTOKEN_VARIABLE:
+            if(token->var.callback != NULL)
+                value = token->var.callback();
+            else
+                value = lang_getbykey(token->var.key);
+            break;
+
+        case FONTTOKEN_EXPRESSION: {
+            char acc[256], expr[256];
+
+            memcpy(acc, text + token->start, token->length);
+            acc[token->length] = '\0';
+
+            expand_vars(expr, acc, sizeof(expr), read_variable, (void*)ctx);
+            value = read_variable(expr, (void*)ctx);
+            break;
+        }
+
+        case FONTTOKEN_LITERAL:
+            break;
+    }
+
+    return value != NULL ? value : "null";
+}
+
+/* add a token to a compiled text */
+void push_token(fonttemplate_t* tpl, const char* text, fonttokentype_t type, int start, int length)
+{
+    fonttoken_t token = {
+        .type = type,
+        .start = start,
+        .length = length,
+        .argument = 0,
+        .var = { .name = NULL, .callback = NULL, .key = -1 },
+        .value = NULL
+    };
+
+    /* skip empty literals */
+    if(type == FONTTOKEN_LITERAL && length <= 0)
+        return;
+
+    /* resolve the slot */
+    if(type == FONTTOKEN_ARGUMENT) {
+        token.argument = text[start] - '1';
+    }
+    else if(type == FONTTOKEN_VARIABLE) {
+        char name[256];
+
+        memcpy(name, text + start, length);
+        name[length] = '\0';
+
+        /* predefined variables take precedence */
+        token.var.callback = callbacktable_find(name);
+        token.var.key = lang_key(name);
+    }
+
+    darray_push(tpl->token, token);
+}
+
+/* clear a compiled text */
+void clear_template(fonttemplate_t* tpl)
+{
+    for(int i = 0; i < darray_length(tpl->token); i++)
+        free(tpl->token[i].value);
+
+    darray_clear(tpl->token);
+
+    free(tpl->expansion);
+    tpl->expansion = NULL;
 }
 
 /* ------------------------------------------------- */
@@ -1725,9 +2303,11 @@ int dirfill(const char* vpath, void* param)
     (void)param;
 
     const char* fullpath = asset_path(vpath);
+    double start_time = startuptrace_clock();
     parsetree_program_t* p = nanoparser_construct_tree(fullpath);
     nanoparser_traverse_program(p, traverse);
     nanoparser_deconstruct_tree(p);
+    startuptrace_add_asset("font", vpath, start_time);
     return 0;
 }
 
@@ -1804,11 +2384,12 @@ fontdrv_t* fontdrv_bmp_new(const char* source_file, charproperties_t chr[], int
     ((fontdrv_t*)f)->line_height = fontdrv_bmp_lineheight;
     ((fontdrv_t*)f)->filepath = fontdrv_bmp_filepath;
     ((fontdrv_t*)f)->image = fontdrv_bmp_image;
+    ((fontdrv_t*)f)->layout = fontdrv_bmp_layout;
     ((fontdrv_t*)f)->release = fontdrv_bmp_release;
 
     /* initialize the glyphs */
     for(int j = 0; j < FONT_MAXBITMAPGLYPHS; j++)
-        f->glyph[j] = NULL;
+        f->glyph[j] = (bmpglyph_t){ .image = NULL, .offset = point2d_new(0, 0), .width = 0, .height = 0 };
 
     /* set the image atlas */
     f->atlas = img;
@@ -1817,8 +2398,11 @@ fontdrv_t* fontdrv_bmp_new(const char* source_file, charproperties_t chr[], int
     f->line_height = 0;
     for(int j = 1 + FONT_COLORBREAKPOINT; j < FONT_MAXBITMAPGLYPHS; j++) {
         if(chr[j].valid) {
-            f->glyph[j] = image_create_shared(img, chr[j].source_rect.x, chr[j].source_rect.y, chr[j].source_rect.width, chr[j].source_rect.height);
-            f->glyph_offset[j] = chr[j].offset;
+            bmpglyph_t* glyph = &f->glyph[j];
+            glyph->image = image_create_shared(img, chr[j].source_rect.x, chr[j].source_rect.y, chr[j].source_rect.width, chr[j].source_rect.height);
+            glyph->offset = chr[j].offset;
+            glyph->width = image_width(glyph->image);
+            glyph->height = image_height(glyph->image);
             f->line_height = max(f->line_height, chr[j].source_rect.height);
         }
     }
@@ -1841,8 +2425,8 @@ void fontdrv_bmp_release(fontdrv_t* fnt)
     fontdrv_bmp_t* f = (fontdrv_bmp_t*)fnt;
 
     for(int i = 0; i < FONT_MAXBITMAPGLYPHS; i++) {
-        if(f->glyph[i] != NULL)
-            image_destroy(f->glyph[i]);
+        if(f->glyph[i].image != NULL)
+            image_destroy(f->glyph[i].image);
     }
 
     image_unload(f->atlas);
@@ -1858,15 +2442,40 @@ void fontdrv_bmp_textout(const fontdrv_t* fnt, const char* text, int x, int y, c
     int vsp = f->spacing.y;
     uint32_t c = 0;
 
-    for(size_t i = 0; (c = u8_nextchar(text, &i)) != 0; ) {
-        point2d_t glyph_offset;
-        const image_t* glyph = find_bmp_glyph(f, c, &glyph_offset);
+    for(size_t i = 0; (c = next_codepoint(text, &i)) != 0; ) {
+        const bmpglyph_t* glyph = find_bmp_glyph(f, c);
+        if(glyph != NULL) {
+            int dy = f->line_height - vsp - glyph->height;
+            image_draw_tinted(glyph->image, x + glyph->offset.x, y + dy + glyph->offset.y, color, IF_NONE);
+            x += glyph->width + hsp;
+        }
+    }
+}
+
+bool fontdrv_bmp_layout(const fontdrv_t* fnt, const char* text, int x, int y, color_t color, struct fonttext_t* out)
+{
+    const fontdrv_bmp_t* f = (const fontdrv_bmp_t*)fnt;
+    int hsp = f->spacing.x;
+    int vsp = f->spacing.y;
+    uint32_t c = 0;
+
+    /* this must match fontdrv_bmp_textout() */
+    for(size_t i = 0; (c = next_codepoint(text, &i)) != 0; ) {
+        const bmpglyph_t* glyph = find_bmp_glyph(f, c);
         if(glyph != NULL) {
-            int dy = f->line_height - vsp - image_height(glyph);
-            image_draw_tinted(glyph, x + glyph_offset.x, y + dy + glyph_offset.y, color, IF_NONE);
-            x += image_width(glyph) + hsp;
+            int dy = f->line_height - vsp - glyph->height;
+            fontglyph_t g = {
+                .image = glyph->image,
+                .offset = point2d_new(x + glyph->offset.x, y + dy + glyph->offset.y),
+                .color = color
+            };
+
+            darray_push(out->glyph, g);
+            x += glyph->width + hsp;
         }
     }
+
+    return true;
 }
 
 int fontdrv_bmp_lineheight(const fontdrv_t* fnt)
@@ -1883,10 +2492,10 @@ int fontdrv_bmp_linewidth(const fontdrv_t* fnt, const char* text)
     int line_width = 0;
     uint32_t c = 0;
 
-    for(size_t i = 0; (c = u8_nextchar(text, &i)) != 0; ) {
-        const image_t* glyph = find_bmp_glyph(f, c, NULL);
+    for(size_t i = 0; (c = next_codepoint(text, &i)) != 0; ) {
+        const bmpglyph_t* glyph = find_bmp_glyph(f, c);
         if(glyph != NULL) {
-            line_width += image_width(glyph) + space;
+            line_width += glyph->width + space;
             space = (text[i] != '\0') ? hsp : 0;
         }
     }
@@ -1906,18 +2515,27 @@ const image_t* fontdrv_bmp_image(const fontdrv_t* fnt)
     return f->atlas;
 }
 
-const image_t* find_bmp_glyph(const fontdrv_bmp_t* f, uint32_t codepoint, point2d_t* out_offset)
+/* the glyph of a codepoint, or NULL if it's undefined */
+const bmpglyph_t* find_bmp_glyph(const fontdrv_bmp_t* f, uint32_t codepoint)
 {
-    if(codepoint < FONT_MAXBITMAPGLYPHS) {
-        const image_t* glyph = f->glyph[codepoint]; /* possibly NULL */
+    if(codepoint < FONT_MAXBITMAPGLYPHS && f->glyph[codepoint].image != NULL)
+        return &f->glyph[codepoint];
+
+    return NULL;
+}
 
-        if(out_offset != NULL && glyph != NULL)
-            *out_offset = f->glyph_offset[codepoint];
+/* read the next codepoint of a UTF-8 string, like u8_nextchar().
+   ASCII characters, by far the most common, skip the decoder */
+uint32_t next_codepoint(const char* text, size_t* i)
+{
+    uint8_t c = (uint8_t)text[*i];
 
-        return glyph;
+    if(c < 0x80) {
+        *i += (c != 0);
+        return c;
     }
 
-    return NULL;
+    return u8_nextchar(text, i);
 }
 
 /* ------------------------------------------------- */
@@ -1933,6 +2551,7 @@ fontdrv_t* fontdrv_ttf_new(const char* source_file, int size, bool antialias, bo
     ((fontdrv_t*)f)->line_height = fontdrv_ttf_lineheight;
     ((fontdrv_t*)f)->filepath = fontdrv_ttf_filepath;
     ((fontdrv_t*)f)->image = fontdrv_ttf_image;
+    ((fontdrv_t*)f)->layout = fontdrv_ttf_layout;
     ((fontdrv_t*)f)->release = fontdrv_ttf_release;
 
     /* store font attributes */
@@ -1944,6 +2563,7 @@ fontdrv_t* fontdrv_ttf_new(const char* source_file, int size, bool antialias, bo
 
     /* lazy loading */
     f->font = NULL;
+    f->atlas = NULL;
 
     /* done! */
     return (fontdrv_t*)f;
@@ -2021,10 +2641,45 @@ const char* fontdrv_ttf_filepath(const fontdrv_t* fnt)
 
 const image_t* fontdrv_ttf_image(const fontdrv_t* fnt)
 {
-    /* there is no image atlas */
+    const fontdrv_ttf_t* f = (const fontdrv_ttf_t*)fnt;
+
+    /* the atlas is shared with other fonts of the same face */
+    if(has_loaded_ttf(f))
+        return f->atlas->image;
+
     return NULL;
 }
 
+bool fontdrv_ttf_layout(const fontdrv_t* fnt, const char* text, int x, int y, color_t color, struct fonttext_t* out)
+{
+    const fontdrv_ttf_t* f = (const fontdrv_ttf_t*)fnt;
+    color_t black = color_rgb(0, 0, 0);
+
+    /* lazily load the font */
+    if(!has_loaded_ttf(f))
+        load_ttf((fontdrv_ttf_t*)f);
+
+    /* rasterize the glyphs of the atlas */
+    if(!f->atlas->is_baked)
+        ttfatlas_bake(f->atlas);
+
+    /* the atlas is not available */
+    if(f->atlas->image == NULL)
+        return false;
+
+    /* this must match fontdrv_ttf_textout() */
+    if(f->shadow) {
+        if(!layout_ttf(f, text, x, y + 1, black, out))
+            return false;
+        if(!layout_ttf(f, text, x + 1, y + 1, black, out))
+            return false;
+        if(f->size >= 18 && !layout_ttf(f, text, x + 2, y + 2, black, out))
+            return false;
+    }
+
+    return layout_ttf(f, text, x, y, color, out);
+}
+
 bool has_loaded_ttf(const fontdrv_ttf_t* f)
 {
     return f->font != NULL;
@@ -2032,20 +2687,243 @@ bool has_loaded_ttf(const fontdrv_ttf_t* f)
 
 void load_ttf(fontdrv_ttf_t* f)
 {
-    const char* fullpath = asset_path(f->filepath);
+    f->atlas = ttfatlas_acquire(f->filepath, f->size, f->antialias);
+    f->font = f->atlas->font;
+    f->line_height = al_get_font_line_height(f->font);
+}
+
+void unload_ttf(fontdrv_ttf_t* f)
+{
+    ttfatlas_release(f->atlas);
+    f->atlas = NULL;
+    f->font = NULL;
+}
+
+/* lay out a line of text using the glyph atlas. Returns false if a glyph isn't in the atlas */
+bool layout_ttf(const fontdrv_ttf_t* f, const char* text, int x, int y, color_t color, struct fonttext_t* out)
+{
+    uint32_t c = 0;
+
+    for(size_t i = 0; (c = next_codepoint(text, &i)) != 0; ) {
+        const ttfglyph_t* glyph = ttfatlas_find_glyph(f->atlas, c);
+        size_t j = i;
+        uint32_t next = next_codepoint(text, &j);
+
+        /* the glyph isn't in the atlas; we'll render the text segments instead */
+        if(glyph == NULL)
+            return false;
+
+        /* blank glyphs have no image */
+        if(glyph->image != NULL) {
+            fontglyph_t g = {
+                .image = glyph->image,
+                .offset = point2d_new(x + glyph->offset.x, y + glyph->offset.y),
+                .color = color
+            };
+
+            darray_push(out->glyph, g);
+        }
+
+        /* advance the pen, taking kerning into account */
+        x += al_get_glyph_advance(f->font, c, next != 0 ? (int)next : ALLEGRO_NO_KERNING);
+    }
+
+    return true;
+}
+
+/* ------------------------------------------------- */
+/* ttf glyph atlas */
+/* ------------------------------------------------- */
+
+/* get a shared atlas of the given face, loading it if necessary */
+ttfatlas_t* ttfatlas_acquire(const char* filepath, int size, bool antialias)
+{
+    /* look for an existing atlas */
+    for(ttfatlas_t* it = ttfatlas_list; it != NULL; it = it->next) {
+        if(it->size == size && it->antialias == antialias && 0 == strcmp(it->filepath, filepath)) {
+            it->reference_count++;
+            return it;
+        }
+    }
+
+    /* load the face */
+    const char* fullpath = asset_path(filepath);
+    double start_time = startuptrace_clock();
 
     logfile_message("Loading TrueType font \"%s\"...", fullpath);
 
-    f->font = al_load_ttf_font(fullpath, -(f->size), !(f->antialias) ? ALLEGRO_TTF_MONOCHROME : 0);
-    if(f->font == NULL)
+    ALLEGRO_FONT* font = al_load_ttf_font(fullpath, -size, !antialias ? ALLEGRO_TTF_MONOCHROME : 0);
+    if(font == NULL)
         fatal_error("Failed to load TrueType font \"%s\"", fullpath);
 
-    f->line_height = al_get_font_line_height(f->font);
+    startuptrace_add_asset("ttf", filepath, start_time);
+
+    /* create a new atlas. We rasterize the glyphs lazily, when laying out
+       text, because we may be loading the font while holding the drawing */
+    ttfatlas_t* atlas = mallocx(sizeof *atlas);
+    atlas->filepath = str_dup(filepath);
+    atlas->size = size;
+    atlas->antialias = antialias;
+    atlas->reference_count = 1;
+    atlas->font = font;
+    atlas->image = NULL;
+    atlas->glyph = NULL;
+    atlas->is_baked = false;
+    atlas->next = ttfatlas_list;
+    ttfatlas_list = atlas;
+
+    return atlas;
 }
 
-void unload_ttf(fontdrv_ttf_t* f)
+/* release a shared atlas */
+void ttfatlas_release(ttfatlas_t* atlas)
+{
+    /* the atlas is still in use */
+    if(--atlas->reference_count > 0)
+        return;
+
+    /* remove the atlas from the list */
+    for(ttfatlas_t** it = &ttfatlas_list; *it != NULL; it = &((*it)->next)) {
+        if(*it == atlas) {
+            *it = atlas->next;
+            break;
+        }
+    }
+
+    /* destroy the glyphs */
+    if(atlas->glyph != NULL) {
+        int count = ttfatlas_glyph_count();
+        for(int k = 0; k < count; k++) {
+            if(atlas->glyph[k].image != NULL)
+                image_destroy(atlas->glyph[k].image);
+        }
+        free(atlas->glyph);
+    }
+
+    /* destroy the atlas */
+    if(atlas->image != NULL)
+        image_destroy(atlas->image);
+
+    al_destroy_font(atlas->font);
+    free(atlas->filepath);
+    free(atlas);
+}
+
+/* rasterize the glyphs of TTF_ATLAS_RANGE[] into the texture of the atlas */
+void ttfatlas_bake(ttfatlas_t* atlas)
 {
-    al_destroy_font(f->font);
+    int count = ttfatlas_glyph_count();
+    rect_t* cell = mallocx(count * sizeof *cell);
+    int x = TTF_ATLAS_PADDING, y = TTF_ATLAS_PADDING, row_height = 0;
+    int k = 0;
+
+    atlas->is_baked = true;
+    atlas->glyph = mallocx(count * sizeof *(atlas->glyph));
+
+    /* pack the glyphs in rows */
+    for(int r = 0; r < sizeof(TTF_ATLAS_RANGE) / sizeof(TTF_ATLAS_RANGE[0]); r++) {
+        for(uint32_t c = TTF_ATLAS_RANGE[r].first; c <= TTF_ATLAS_RANGE[r].last; c++, k++) {
+            ttfglyph_t* glyph = &(atlas->glyph[k]);
+            int bbx = 0, bby = 0, bbw = 0, bbh = 0;
+
+            glyph->valid = al_get_glyph_dimensions(atlas->font, c, &bbx, &bby, &bbw, &bbh);
+            glyph->image = NULL;
+            glyph->offset = point2d_new(bbx, bby);
+            cell[k] = rect_new(0, 0, 0, 0);
+
+            /* blank glyph or glyph not in the face */
+            if(!glyph->valid || bbw <= 0 || bbh <= 0)
+                continue;
+
+            /* the glyph is too large for the atlas */
+            if(bbw + 2 * TTF_ATLAS_PADDING > TTF_ATLAS_WIDTH) {
+                glyph->valid = false;
+                continue;
+            }
+
+            /* start a new row */
+            if(x + bbw + TTF_ATLAS_PADDING > TTF_ATLAS_WIDTH) {
+                x = TTF_ATLAS_PADDING;
+                y += row_height;
+                row_height = 0;
+            }
+
+            cell[k] = rect_new(x, y, bbw, bbh);
+            x += bbw + TTF_ATLAS_PADDING;
+            row_height = max(row_height, bbh + TTF_ATLAS_PADDING);
+        }
+    }
+
+    /* create the texture */
+    int height = y + row_height;
+    if(height > TTF_ATLAS_MAX_HEIGHT || NULL == (atlas->image = image_create(TTF_ATLAS_WIDTH, max(height, 1)))) {
+        logfile_message("Can't create a glyph atlas for TrueType font \"%s\" (size %d)", atlas->filepath, atlas->size);
+        atlas->image = NULL;
+        free(cell);
+        return;
+    }
+
+    /* rasterize the glyphs */
+    image_t* prev_target = image_drawing_target();
+    const shader_t* prev_shader = shader_get_active();
+    ALLEGRO_COLOR white = al_map_rgb(255, 255, 255);
+
+    image_set_drawing_target(atlas->image);
+    shader_set_active(shader_get_default());
+    image_clear(color_rgba(0, 0, 0, 0));
+
+    k = 0;
+    for(int r = 0; r < sizeof(TTF_ATLAS_RANGE) / sizeof(TTF_ATLAS_RANGE[0]); r++) {
+        for(uint32_t c = TTF_ATLAS_RANGE[r].first; c <= TTF_ATLAS_RANGE[r].last; c++, k++) {
+            if(cell[k].width > 0) {
+                const ttfglyph_t* glyph = &(atlas->glyph[k]);
+                al_draw_glyph(atlas->font, white, cell[k].x - glyph->offset.x, cell[k].y - glyph->offset.y, c);
+            }
+        }
+    }
+
+    image_set_drawing_target(prev_target);
+    shader_set_active(prev_shader);
+
+    /* create the images of the glyphs */
+    for(k = 0; k < count; k++) {
+        if(cell[k].width > 0)
+            atlas->glyph[k].image = image_create_shared(atlas->image, cell[k].x, cell[k].y, cell[k].width, cell[k].height);
+    }
+
+    /* done */
+    logfile_message("Created a %dx%d glyph atlas for TrueType font \"%s\" (size %d)", TTF_ATLAS_WIDTH, height, atlas->filepath, atlas->size);
+    free(cell);
+}
+
+/* find a glyph of the atlas. Returns NULL if the glyph isn't in the atlas */
+const ttfglyph_t* ttfatlas_find_glyph(const ttfatlas_t* atlas, uint32_t codepoint)
+{
+    int base = 0;
+
+    for(int r = 0; r < sizeof(TTF_ATLAS_RANGE) / sizeof(TTF_ATLAS_RANGE[0]); r++) {
+        const ttfrange_t* range = &TTF_ATLAS_RANGE[r];
+
+        if(codepoint >= range->first && codepoint <= range->last) {
+            const ttfglyph_t* glyph = &(atlas->glyph[base + (codepoint - range->first)]);
+            return glyph->valid ? glyph : NULL;
+        }
+
+        base += range->last - range->first + 1;
+    }
+
+    return NULL;
+}
+
+/* the number of glyphs of TTF_ATLAS_RANGE[] */
+int ttfatlas_glyph_count()
+{
+    int count = 0;
+
+    for(int r = 0; r < sizeof(TTF_ATLAS_RANGE) / sizeof(TTF_ATLAS_RANGE[0]); r++)
+        count += TTF_ATLAS_RANGE[r].last - TTF_ATLAS_RANGE[r].first + 1;
+
+    return count;
 }
 
 /* ------------------------------------------------- */
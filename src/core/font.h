@@ -46,6 +46,8 @@ v2d_t font_get_textsize(const font_t* f); /* returns the size, in pixels, of the
 void font_set_width(font_t* f, int w); /* wordwrap (w is given in pixels) */
 bool font_is_visible(const font_t* f); /* is the font visible? */
 void font_set_visible(font_t* f, bool is_visible); /* show/hide font */
+bool font_is_static(const font_t* f); /* is the font in static mode? */
+void font_set_static(font_t* f, bool is_static); /* static mode: render the text from a cached texture, updated only when the text changes */
 void font_use_substring(font_t* f, int index_of_first_char, int length); /* since fonts may have color tags, variables, etc. , use this to display a substring of the font (not the whole text) */
 fontalign_t font_get_align(const font_t* f); /* get the current align */
 void font_set_align(font_t* f, fontalign_t align); /* set the align */
@@ -0,0 +1,415 @@
+/*
+ * Open Surge Engine
+ * gputimer.c - GPU timer queries
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_opengl.h>
+#include <stdint.h>
+#include <string.h>
+#include "gputimer.h"
+#include "logfile.h"
+
+/*
+
+The GPU timer measures the time taken by the GPU to execute the commands
+issued between gputimer_begin() and gputimer_end(). It writes OpenGL
+timestamp queries to the command stream. The results become available a
+few frames later, when the GPU is done with them.
+
+In order to avoid stalling the pipeline, the queries of the last
+GPUTIMER_FRAMES frames are kept in a ring. We read the results of the
+oldest frame only, and only if they are available. Otherwise we keep the
+results we have and try again later.
+
+Timer queries are available in OpenGL 3.3+ (or with ARB_timer_query) and
+in OpenGL ES with EXT_disjoint_timer_query. Nothing is recorded unless the
+GPU timer is enabled.
+
+*/
+
+#define GPUTIMER_FRAMES         3   /* size of the ring of query sets */
+#define GPUTIMER_MAX_ZONES      32  /* maximum number of zones per frame */
+#define GPUTIMER_MAX_RESULTS    16  /* maximum number of distinct zone names */
+#define GPUTIMER_MAX_DEPTH      8   /* maximum nesting depth */
+#define LOG(...)                logfile_message("GPU timer - " __VA_ARGS__)
+
+#ifndef GL_TIMESTAMP
+#define GL_TIMESTAMP 0x8E28
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+
+/* OpenGL symbols */
+ALLEGRO_DEFINE_PROC_TYPE(void, fun_glgenqueries_t, (GLsizei, GLuint*));
+ALLEGRO_DEFINE_PROC_TYPE(void, fun_gldeletequeries_t, (GLsizei, const GLuint*));
+ALLEGRO_DEFINE_PROC_TYPE(void, fun_glquerycounter_t, (GLuint, GLenum));
+ALLEGRO_DEFINE_PROC_TYPE(void, fun_glgetqueryobjectuiv_t, (GLuint, GLenum, GLuint*));
+ALLEGRO_DEFINE_PROC_TYPE(void, fun_glgetqueryobjectui64v_t, (GLuint, GLenum, GLuint64*));
+ALLEGRO_DEFINE_PROC_TYPE(void, fun_glgetintegerv_t, (GLenum, GLint*));
+static fun_glgenqueries_t _glGenQueries = NULL;
+static fun_gldeletequeries_t _glDeleteQueries = NULL;
+static fun_glquerycounter_t _glQueryCounter = NULL;
+static fun_glgetqueryobjectuiv_t _glGetQueryObjectuiv = NULL;
+static fun_glgetqueryobjectui64v_t _glGetQueryObjectui64v = NULL;
+static fun_glgetintegerv_t _glGetIntegerv = NULL;
+
+/* the queries of a frame: query[2*i] and query[2*i+1] delimit the i-th zone */
+typedef struct gputimerframe_t gputimerframe_t;
+struct gputimerframe_t {
+    GLuint query[2 * GPUTIMER_MAX_ZONES];
+    const char* zone_name[GPUTIMER_MAX_ZONES]; /* string literals */
+    int zone_count;
+    bool has_queries; /* have the query objects been generated? */
+};
+
+/* the GPU time of the zones with a given name */
+typedef struct gputimerresult_t gputimerresult_t;
+struct gputimerresult_t {
+    const char* name;
+    double time; /* in milliseconds */
+};
+
+/* GPU timer state */
+static bool is_available = false;
+static bool is_gles = false;
+static int enable_count = 0;
+static gputimerframe_t frame[GPUTIMER_FRAMES];
+static int current_frame = 0;
+static int stack[GPUTIMER_MAX_DEPTH]; /* indices of the open zones of the current frame */
+static int stack_size = 0;
+static gputimerresult_t result[GPUTIMER_MAX_RESULTS];
+static int result_count = 0;
+
+static void import_symbols();
+static void clear_frames();
+static bool collect_results(gputimerframe_t* f);
+static void add_result(const char* name, double time);
+
+
+
+/*
+ * gputimer_init()
+ * Initializes the GPU timer. Call it after creating the display
+ */
+void gputimer_init()
+{
+    LOG("Initializing...");
+
+    enable_count = 0;
+    result_count = 0;
+    current_frame = 0;
+    stack_size = 0;
+    memset(frame, 0, sizeof(frame));
+
+    import_symbols();
+    LOG("Timer queries are %s", is_available ? "available" : "not available");
+}
+
+/*
+ * gputimer_release()
+ * Releases the GPU timer
+ */
+void gputimer_release()
+{
+    LOG("Releasing...");
+
+    clear_frames();
+    result_count = 0;
+    enable_count = 0;
+    is_available = false;
+}
+
+/*
+ * gputimer_discard()
+ * Forgets the query objects after the OpenGL context has been lost.
+ * They will be generated again when needed
+ */
+void gputimer_discard()
+{
+    for(int i = 0; i < GPUTIMER_FRAMES; i++) {
+        frame[i].has_queries = false;
+        frame[i].zone_count = 0;
+    }
+
+    stack_size = 0;
+}
+
+/*
+ * gputimer_begin()
+ * Opens a zone. zone_name must be a string literal
+ */
+void gputimer_begin(const char* zone_name)
+{
+    if(enable_count <= 0 || !is_available)
+        return;
+
+    if(stack_size >= GPUTIMER_MAX_DEPTH) {
+        stack_size++; /* keep the calls to gputimer_end() paired */
+        return;
+    }
+
+    gputimerframe_t* f = &frame[current_frame];
+    if(f->zone_count >= GPUTIMER_MAX_ZONES) {
+        stack[stack_size++] = -1; /* skip this zone */
+        return;
+    }
+
+    /* generate the query objects of this frame */
+    if(!f->has_queries) {
+        _glGenQueries(2 * GPUTIMER_MAX_ZONES, f->query);
+        f->has_queries = true;
+    }
+
+    /* write a timestamp */
+    int i = f->zone_count++;
+    f->zone_name[i] = zone_name;
+    _glQueryCounter(f->query[2 * i], GL_TIMESTAMP);
+
+    stack[stack_size++] = i;
+}
+
+/*
+ * gputimer_end()
+ * Closes the zone opened by the last call to gputimer_begin()
+ */
+void gputimer_end()
+{
+    if(stack_size == 0) /* zones are only opened if enabled */
+        return;
+
+    if(--stack_size >= GPUTIMER_MAX_DEPTH)
+        return;
+
+    int i = stack[stack_size];
+    if(i < 0)
+        return;
+
+    _glQueryCounter(frame[current_frame].query[2 * i + 1], GL_TIMESTAMP);
+}
+
+/*
+ * gputimer_frame()
+ * Call it after rendering each frame. Collects the results of the
+ * oldest frame of the ring, if they are available
+ */
+void gputimer_frame()
+{
+    if(!is_available)
+        return;
+
+    /* close any unpaired zones */
+    while(stack_size > 0)
+        gputimer_end();
+
+    /* move to the next frame of the ring, which is the oldest one */
+    current_frame = (current_frame + 1) % GPUTIMER_FRAMES;
+    gputimerframe_t* f = &frame[current_frame];
+
+    /* collect its results without stalling. If they are not yet
+       available, we keep the results we have and discard the frame */
+    if(f->zone_count > 0 && f->has_queries)
+        collect_results(f);
+
+    f->zone_count = 0;
+}
+
+/*
+ * gputimer_enable()
+ * The GPU timer is enabled while there are clients that want it
+ * enabled. Pair gputimer_enable(true) with gputimer_enable(false)
+ */
+void gputimer_enable(bool enable)
+{
+    if(enable) {
+        if(enable_count++ == 0)
+            result_count = 0;
+    }
+    else if(enable_count > 0)
+        enable_count--;
+}
+
+/*
+ * gputimer_is_enabled()
+ * Are we measuring GPU time?
+ */
+bool gputimer_is_enabled()
+{
+    return enable_count > 0 && is_available;
+}
+
+/*
+ * gputimer_is_available()
+ * Are timer queries supported by the driver?
+ */
+bool gputimer_is_available()
+{
+    return is_available;
+}
+
+/*
+ * gputimer_zone_count()
+ * The number of distinct zones of the last measured frame
+ */
+int gputimer_zone_count()
+{
+    return result_count;
+}
+
+/*
+ * gputimer_zone_name()
+ * The name of the index-th zone of the last measured frame
+ */
+const char* gputimer_zone_name(int index)
+{
+    return (index >= 0 && index < result_count) ? result[index].name : "";
+}
+
+/*
+ * gputimer_zone_time()
+ * The GPU time, in milliseconds, of the index-th zone of the last
+ * measured frame. Zones with the same name are added
+ */
+double gputimer_zone_time(int index)
+{
+    return (index >= 0 && index < result_count) ? result[index].time : 0.0;
+}
+
+/*
+ * gputimer_time()
+ * The GPU time, in milliseconds, of the zones with the given name
+ * in the last measured frame. Returns zero if there is no such zone
+ */
+double gputimer_time(const char* zone_name)
+{
+    for(int i = 0; i < result_count; i++) {
+        if(strcmp(result[i].name, zone_name) == 0)
+            return result[i].time;
+    }
+
+    return 0.0;
+}
+
+
+
+/* private stuff */
+
+/* imports the OpenGL symbols of the timer queries */
+void import_symbols()
+{
+    is_gles = (al_get_opengl_variant() == ALLEGRO_OPENGL_ES);
+
+    if(is_gles) {
+        if(!al_have_opengl_extension("GL_EXT_disjoint_timer_query"))
+            return;
+
+        _glGenQueries = (fun_glgenqueries_t)al_get_opengl_proc_address("glGenQueriesEXT");
+        _glDeleteQueries = (fun_gldeletequeries_t)al_get_opengl_proc_address("glDeleteQueriesEXT");
+        _glQueryCounter = (fun_glquerycounter_t)al_get_opengl_proc_address("glQueryCounterEXT");
+        _glGetQueryObjectuiv = (fun_glgetqueryobjectuiv_t)al_get_opengl_proc_address("glGetQueryObjectuivEXT");
+        _glGetQueryObjectui64v = (fun_glgetqueryobjectui64v_t)al_get_opengl_proc_address("glGetQueryObjectui64vEXT");
+    }
+    else {
+        if(al_get_opengl_version() < 0x03030000 && !al_have_opengl_extension("GL_ARB_timer_query"))
+            return;
+
+        _glGenQueries = (fun_glgenqueries_t)al_get_opengl_proc_address("glGenQueries");
+        _glDeleteQueries = (fun_gldeletequeries_t)al_get_opengl_proc_address("glDeleteQueries");
+        _glQueryCounter = (fun_glquerycounter_t)al_get_opengl_proc_address("glQueryCounter");
+        _glGetQueryObjectuiv = (fun_glgetqueryobjectuiv_t)al_get_opengl_proc_address("glGetQueryObjectuiv");
+        _glGetQueryObjectui64v = (fun_glgetqueryobjectui64v_t)al_get_opengl_proc_address("glGetQueryObjectui64v");
+    }
+
+    _glGetIntegerv = (fun_glgetintegerv_t)al_get_opengl_proc_address("glGetIntegerv");
+
+    is_available = (
+        _glGenQueries != NULL && _glDeleteQueries != NULL && _glQueryCounter != NULL &&
+        _glGetQueryObjectuiv != NULL && _glGetQueryObjectui64v != NULL && _glGetIntegerv != NULL
+    );
+}
+
+/* deletes the query objects of all frames */
+void clear_frames()
+{
+    for(int i = 0; i < GPUTIMER_FRAMES; i++) {
+        if(frame[i].has_queries && _glDeleteQueries != NULL)
+            _glDeleteQueries(2 * GPUTIMER_MAX_ZONES, frame[i].query);
+
+        frame[i].has_queries = false;
+        frame[i].zone_count = 0;
+    }
+
+    stack_size = 0;
+}
+
+/* reads the results of a frame, if they are available */
+bool collect_results(gputimerframe_t* f)
+{
+    GLuint available = GL_FALSE;
+    GLint disjoint = GL_FALSE;
+
+    /* queries complete in order: checking the last one is enough */
+    _glGetQueryObjectuiv(f->query[2 * f->zone_count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available)
+        return false;
+
+    /* the timestamps are meaningless if a disjoint operation took place */
+    if(is_gles) {
+        _glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+        if(disjoint)
+            return false;
+    }
+
+    /* read the timestamps */
+    result_count = 0;
+    for(int i = 0; i < f->zone_count; i++) {
+        GLuint64 start_time = 0, end_time = 0;
+
+        _glGetQueryObjectui64v(f->query[2 * i], GL_QUERY_RESULT, &start_time);
+        _glGetQueryObjectui64v(f->query[2 * i + 1], GL_QUERY_RESULT, &end_time);
+
+        if(end_time >= start_time)
+            add_result(f->zone_name[i], (double)(end_time - start_time) * 1e-6); /* nanoseconds to ms */
+    }
+
+    return true;
+}
+
+/* adds the time of a zone to the results */
+void add_result(const char* name, double time)
+{
+    for(int i = 0; i < result_count; i++) {
+        if(result[i].name == name || strcmp(result[i].name, name) == 0) {
+            result[i].time += time;
+            return;
+        }
+    }
+
+    if(result_count < GPUTIMER_MAX_RESULTS) {
+        result[result_count].name = name;
+        result[result_count].time = time;
+        result_count++;
+    }
+}
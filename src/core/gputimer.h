@@ -0,0 +1,47 @@
+/*
+ * Open Surge Engine
+ * gputimer.h - GPU timer queries
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GPUTIMER_H
+#define _GPUTIMER_H
+
+#include <stdbool.h>
+
+/* initialization */
+void gputimer_init(); /* call after creating the display */
+void gputimer_release();
+void gputimer_discard(); /* forget the query objects after losing the OpenGL context */
+
+/* zones: pass a string literal to gputimer_begin() and pair it with gputimer_end() */
+void gputimer_begin(const char* zone_name);
+void gputimer_end();
+void gputimer_frame(); /* call after rendering each frame */
+
+/* enable & disable */
+void gputimer_enable(bool enable); /* pair gputimer_enable(true) with gputimer_enable(false) */
+bool gputimer_is_enabled();
+bool gputimer_is_available(); /* are timer queries supported by the driver? */
+
+/* results of a recent frame, in milliseconds. Zones with the same name are added */
+int gputimer_zone_count();
+const char* gputimer_zone_name(int index);
+double gputimer_zone_time(int index);
+double gputimer_time(const char* zone_name); /* returns zero if there is no such zone */
+
+#endif
@@ -23,16 +23,28 @@
 #include <allegro5/allegro_image.h>
 #include <allegro5/allegro_primitives.h>
 #include <allegro5/allegro_opengl.h>
+#include <allegro5/allegro_physfs.h>
 
+#include <stdio.h>
 #include <string.h>
+#include <math.h>
 #include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 #include "image.h"
 #include "video.h"
 #include "logfile.h"
 #include "asset.h"
 #include "resourcemanager.h"
+#include "startuptrace.h"
+#include "texcompress.h"
 #include "../util/util.h"
 #include "../util/stringutil.h"
+#include "../util/darray.h"
+#include "../util/fasthash.h"
 
 #if defined(ALLEGRO_VERSION_INT) && defined(AL_ID) && ALLEGRO_VERSION_INT >= AL_ID(5,2,8,0)
 #define WANT_WRAP 1
@@ -46,21 +58,305 @@
 /* check if an expression is a power of two */
 #define IS_POWER_OF_TWO(n) (((n) & ((n) - 1)) == 0)
 
+/* pack small images loaded from files into shared textures, so that more draws can be batched */
+#define WANT_TEXTURE_ATLAS 1
+
+/* decode images loaded asynchronously in a background thread */
+#if defined(__EMSCRIPTEN__)
+#define WANT_ASYNC_DECODING 0 /* decode them in the main thread, one per frame */
+#else
+#define WANT_ASYNC_DECODING 1
+#endif
+
+/* don't back up the textures of images loaded from files; decode their files again when the textures are lost */
+#if defined(__ANDROID__)
+#define WANT_MANAGED_TEXTURES 1
+#else
+#define WANT_MANAGED_TEXTURES 0
+#endif
+
+/* the parameters a bitmap is created with; see RENDER TARGET POOL */
+typedef struct imagepoolkey_t imagepoolkey_t;
+struct imagepoolkey_t {
+    int width, height;
+    int flags, format, depth; /* new bitmap parameters */
+    int wrap_u, wrap_v;
+};
+
 /* image type */
 struct image_t {
     ALLEGRO_BITMAP* data; /* this must be the first field */
     int w, h;
-    char* path; /* relative path */
+    const char* path; /* relative path; an interned string */
+    struct atlaspage_t* atlas; /* the page of the texture atlas that stores this image, if any */
+    struct imagejob_t* job; /* pending asynchronous load, if any */
+    ALLEGRO_BITMAP* trimmed; /* a sub-bitmap enclosing the visible pixels of the image, if trimmed */
+    int trim_x, trim_y; /* position of the trimmed sub-bitmap in the bitmap, in texels */
+    int texel_size; /* size of a texel in image space: 1 at full resolution, 2 if downscaled */
+    int origin_x, origin_y; /* position of the image in the file it was loaded from */
+    ALLEGRO_BITMAP* pixels; /* the original pixels of a downscaled image while it's locked */
+    ALLEGRO_LOCKED_REGION* locked; /* the pixels of a locked image in LOCKED_FORMAT, or NULL */
+    int managed_index; /* position in the list of managed images, or -1 */
+    imagepoolkey_t pool_key; /* how the bitmap was created, if poolable */
+    int pool_bitmap_flags; /* the flags of the bitmap when created; -1 if not poolable */
 };
 
+/* reading pixels in bulk: images locked for reading use this format (R, G, B, A bytes) */
+#define LOCKED_FORMAT ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE
+static void find_opaque_pixels(const uint8_t* pixels, int count, uint8_t* out);
+
 /* misc */
 static image_t* target = NULL; /* drawing target */
 static const int MAX_IMAGE_SIZE = 4096; /* maximum image size for broad compatibility with video cards */
 
+/*
+
+TEXTURE ATLAS
+-------------
+
+The render queue batches consecutive draws that share the same texture. Games
+often spread their art across many small image files, so the batches end up
+being short. In order to improve batching, small images loaded from files are
+packed into shared textures called pages. A packed image is a sub-bitmap of
+its page, as are the sub-images created from it with image_create_shared().
+
+Images are packed into horizontal shelves. A page is kept for as long as any
+image refers to it; the space of individual images is not reclaimed.
+
+*/
+typedef struct atlaspage_t atlaspage_t;
+typedef struct atlasshelf_t atlasshelf_t;
+
+#define ATLAS_PAGE_SIZE         1024 /* width and height of a page */
+#define ATLAS_MAX_ENTRY_SIZE    256 /* larger images are not packed */
+#define ATLAS_MAX_SHELVES       128 /* per page */
+#define ATLAS_MAX_PAGES         16
+#define ATLAS_PADDING           1 /* transparent gap between packed images */
+
+struct atlasshelf_t {
+    int y; /* top */
+    int height;
+    int x; /* next free position */
+};
+
+struct atlaspage_t {
+    ALLEGRO_BITMAP* bitmap;
+    atlasshelf_t shelf[ATLAS_MAX_SHELVES];
+    int shelf_count;
+    int ref_count; /* number of images that refer to this page */
+    atlaspage_t* next;
+};
+
+static atlaspage_t* atlas = NULL; /* linked list of pages */
+static int atlas_page_count = 0;
+static ALLEGRO_BITMAP* atlas_pack(ALLEGRO_BITMAP* bmp, atlaspage_t** out_page);
+static void atlas_unref(atlaspage_t* page);
+static bool atlas_find_room(atlaspage_t* page, int width, int height, int* x, int* y);
+static atlaspage_t* atlas_create_page();
+
+/*
+
+ASYNCHRONOUS LOADING
+--------------------
+
+image_load() decodes the file in the main thread, which may cause hitches when
+large images are loaded during gameplay. image_load_async() returns an image
+that is a transparent 1x1 placeholder until it's ready. Files are decoded into
+memory bitmaps by a background thread, and then uploaded to the GPU by the main
+thread in image_update_async() under a per-frame budget.
+
+Asynchronous images are stored in the resource manager the same way as images
+loaded synchronously. If image_load() or image_create_shared() is called on an
+image that is not ready, the loading is completed right away.
+
+*/
+typedef struct imagejob_t imagejob_t;
+typedef enum imagejobstate_t imagejobstate_t;
+
+#define ASYNC_UPLOAD_BUDGET     (1024 * 1024) /* pixels uploaded to the GPU per frame */
+
+enum imagejobstate_t {
+    JOB_QUEUED,
+    JOB_DECODING,
+    JOB_DECODED
+};
+
+struct imagejob_t {
+    image_t* img; /* NULL if the image was destroyed while decoding */
+    char* fullpath;
+    ALLEGRO_BITMAP* bitmap; /* decoded memory bitmap; NULL on failure */
+    imagejobstate_t state;
+    imagejob_t* next;
+};
+
+static imagejob_t* async_queue = NULL; /* jobs to be decoded (FIFO) */
+static imagejob_t* async_done = NULL; /* decoded jobs to be uploaded (FIFO) */
+static ALLEGRO_BITMAP* async_placeholder = NULL;
+static bool async_initialized = false;
+#if WANT_ASYNC_DECODING
+static ALLEGRO_THREAD* async_thread = NULL;
+static ALLEGRO_MUTEX* async_mutex = NULL;
+static ALLEGRO_COND* async_cond = NULL;
+#define async_lock() al_lock_mutex(async_mutex)
+#define async_unlock() al_unlock_mutex(async_mutex)
+#else
+#define async_lock() (void)0
+#define async_unlock() (void)0
+#endif
+static void async_init();
+static void async_wait(image_t* img);
+static void async_cancel(image_t* img);
+static int async_finish(imagejob_t* job);
+static ALLEGRO_BITMAP* async_decode(const char* fullpath);
+static void async_push(imagejob_t** list, imagejob_t* job);
+static bool async_unlink(imagejob_t** list, imagejob_t* job);
+#if WANT_ASYNC_DECODING
+static void* async_decoder(ALLEGRO_THREAD* thread, void* arg);
+#endif
+/*
+
+LEVEL OF DETAIL
+---------------
+
+With TEXTUREDETAIL_HALF, large images are loaded at half resolution in order to
+save memory and fill rate on low-end devices. A pre-generated variant such as
+images/foo@0.5x.png is used if it exists. Otherwise, the image is downscaled
+with a box filter when it's first loaded and the result is stored in the
+application cache.
+
+The image space doesn't change: a texel of a downscaled image covers 2x2 pixels
+of image space, and the drawing functions scale it transparently. Locking a
+downscaled image for reading decodes its original file, so that collision masks
+and other computations on its pixels are not affected.
+
+*/
+#define LOD_MIN_SIZE            512 /* images at least this wide or tall are downscaled */
+#define LOD_VARIANT_SUFFIX      "@0.5x" /* suffix of the pre-generated variants */
+#define LOD_CACHE_DIR           "lod/" /* inside the application cache */
+
+static ALLEGRO_BITMAP* load_downscaled(const char* path);
+static void downscale_loaded_image(image_t* img);
+static ALLEGRO_BITMAP* downscale(ALLEGRO_BITMAP* bmp);
+static ALLEGRO_BITMAP* load_original_pixels(const char* path);
+static const char* downscaled_variant(const char* path, char* buffer, size_t buffer_size);
+static const char* downscaled_cache_path(const char* path, char* buffer, size_t buffer_size);
+static inline int to_texels(const image_t* img, int x);
+
+/*
+
+RESTORING TEXTURES
+------------------
+
+On Android, the OpenGL context is lost when the app goes to the background.
+Allegro keeps a copy of the pixels of each texture in memory in order to
+restore it when the display resumes drawing, unless the texture is created
+with ALLEGRO_NO_PRESERVE_TEXTURE. Those backups double the memory used by
+images and make resuming slow, since all textures are uploaded at once.
+
+With WANT_MANAGED_TEXTURES, the textures of uncompressed images loaded from
+files (and the pages of the atlas) are not preserved. These images are said
+to be managed: they are read-only, so their files can be decoded again. When
+the display resumes drawing, the textures of the managed images are marked as
+lost. A lost texture is restored when any of its images is about to be used,
+so that the visible images come first, and the others are restored under a
+per-frame budget in image_update_async(). Compressed textures and drawing
+targets are still preserved by Allegro.
+
+*/
+#define RESTORE_BUDGET          (1024 * 1024) /* pixels restored per frame in the background */
+
+STATIC_DARRAY(image_t*, managed_images);
+static fasthash_t* lost_textures = NULL; /* root bitmaps whose contents are undefined */
+static int lost_texture_count = 0;
+static void manage_image(image_t* img);
+static void unmanage_image(image_t* img);
+static void forget_lost_texture(ALLEGRO_BITMAP* root);
+static int restore_lost_texture(ALLEGRO_BITMAP* bmp);
+static void reload_managed_image(const image_t* img, ALLEGRO_LOCKED_REGION* dst, int x, int y);
+static inline ALLEGRO_BITMAP* root_bitmap(ALLEGRO_BITMAP* bmp);
+#define restore_if_lost(bmp) do { if(lost_texture_count > 0) restore_lost_texture(bmp); } while(0)
+
+/*
+
+RENDER TARGET POOL
+------------------
+
+Offscreen images created with image_create() and image_create_ex() are often
+destroyed soon after: think of the targets of post-processing effects and of
+UI elements. Creating a video bitmap allocates a texture and a framebuffer
+object, which is expensive on mobile drivers.
+
+When such an image is destroyed, we keep its bitmap in a pool. A new image
+created with the same size and the same bitmap parameters takes a bitmap from
+the pool and clears it. Bitmaps that aren't reused within a window of frames
+are destroyed in image_update_async(), and so are the oldest ones if the pool
+grows too large. The memory of the pooled bitmaps is accounted separately
+from the memory of the images (see RESOURCE_IMAGE_POOL).
+
+*/
+#define POOL_FRAME_WINDOW       120 /* frames a pooled bitmap is kept */
+#define POOL_MAX_MEMORY         (32 * 1024 * 1024) /* in bytes */
+
+typedef struct pooledbitmap_t pooledbitmap_t;
+struct pooledbitmap_t {
+    ALLEGRO_BITMAP* bitmap;
+    imagepoolkey_t key;
+    int64_t memory;
+    uint32_t frame; /* when the bitmap was pooled */
+};
+
+STATIC_DARRAY(pooledbitmap_t, pool); /* oldest first */
+static int64_t pool_memory = 0;
+static uint32_t pool_frame = 0;
+static bool pool_closed = false;
+static int pool_hits = 0, pool_misses = 0;
+static void make_pool_key(imagepoolkey_t* key, int width, int height);
+static ALLEGRO_BITMAP* pool_take(const imagepoolkey_t* key);
+static bool pool_put(const image_t* img);
+static void pool_evict(int index);
+static void pool_trim();
+
+/*
+
+PRIMITIVE ACCUMULATOR
+---------------------
+
+Debug visualizations, such as the gizmos of the colliders and of the sensors,
+draw hundreds of lines, rectangles and ellipses per frame. Drawing each of
+them with its own call is slow. While primitives are held with
+image_hold_primitives(), image_line(), image_rect(), image_ellipse() and their
+filled variants append vertices to a vertex array per primitive type instead.
+Each array is drawn with a single call to al_draw_prim() when the hold is
+released, when the drawing target changes or when the arrays are full.
+
+Filled shapes are drawn before the outlines. Bitmaps drawn while primitives
+are held appear below the held primitives.
+
+*/
+#define PRIMITIVE_MAX_VERTICES  6144 /* per primitive type */
+
+static ALLEGRO_VERTEX line_vertex[PRIMITIVE_MAX_VERTICES]; /* a line list */
+static ALLEGRO_VERTEX fill_vertex[PRIMITIVE_MAX_VERTICES]; /* a triangle list */
+static int line_vertex_count = 0, fill_vertex_count = 0;
+static int primitive_hold_count = 0;
+static void hold_line(float x1, float y1, float x2, float y2, ALLEGRO_COLOR color);
+static void hold_triangle(float x1, float y1, float x2, float y2, float x3, float y3, ALLEGRO_COLOR color);
+static void hold_ellipse(float cx, float cy, float rx, float ry, ALLEGRO_COLOR color, bool filled);
+static void flush_primitives();
+
+static void setup_loaded_image(image_t* img, const char* path);
+static void draw_tinted_bitmap(const image_t* img, ALLEGRO_BITMAP* bmp, ALLEGRO_COLOR tint, int x, int y, int flags);
+static inline ALLEGRO_BITMAP* visible_bitmap(const image_t* img, int flags, int* offset_x, int* offset_y);
+static int64_t bitmap_memory(ALLEGRO_BITMAP* bmp);
+static ALLEGRO_BITMAP* load_compressed(const char* path);
+static const char* compressed_variant(const char* path, char* buffer, size_t buffer_size);
+
 /*
  * image_load()
  * Loads a image from a file.
  * Supported types: PNG, JPG, BMP, PCX, TGA
+ * A compressed variant of the image is used if available (see texcompress.c)
+ * Large images may be downscaled depending on the texture detail
  */
 image_t* image_load(const char* path)
 {
@@ -68,31 +364,118 @@ image_t* image_load(const char* path)
 
     if(NULL == (img = resourcemanager_find_image(path))) {
         const char* fullpath = asset_path(path);
+        double start_time = startuptrace_clock();
         logfile_message("Loading image \"%s\"...", fullpath);
 
         /* build the image object */
         img = mallocx(sizeof *img);
-
-        /* loading the image */
-        if(NULL == (img->data = al_load_bitmap(fullpath))) {
+        img->job = NULL;
+        img->trimmed = NULL;
+        img->texel_size = 1;
+        img->origin_x = img->origin_y = 0;
+        img->pixels = NULL;
+        img->locked = NULL;
+        img->managed_index = -1;
+        img->pool_bitmap_flags = -1;
+
+        /* loading the image: prefer its downscaled or compressed variants, if any */
+        ALLEGRO_STATE state;
+        al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+        if(WANT_MANAGED_TEXTURES)
+            al_set_new_bitmap_flags(al_get_new_bitmap_flags() | ALLEGRO_NO_PRESERVE_TEXTURE);
+
+        if(NULL != (img->data = load_downscaled(path)))
+            img->texel_size = 2;
+        else if(NULL == (img->data = load_compressed(path)) && NULL == (img->data = al_load_bitmap(fullpath))) {
+            al_restore_state(&state);
             fatal_error("Failed to load image \"%s\"", fullpath);
             free(img);
             return NULL;
         }
+        else
+            downscale_loaded_image(img);
 
-        /* checking the size */
-        img->w = al_get_bitmap_width(img->data);
-        img->h = al_get_bitmap_height(img->data);
-        if(img->w > MAX_IMAGE_SIZE || img->h > MAX_IMAGE_SIZE) {
-            /* ensure broad compatibility with video cards */
-            al_destroy_bitmap(img->data);
-            free(img);
-            fatal_error("Failed to load \"%s\": images can't be larger than %dx%d", path, MAX_IMAGE_SIZE, MAX_IMAGE_SIZE);
-            return NULL;
-        }
+        al_restore_state(&state);
+
+        /* check the size & pack the image */
+        setup_loaded_image(img, path);
+
+        /* adding the image to the resource manager */
+        img->path = str_intern(path);
+        resourcemanager_add_image(img->path, img);
+        resourcemanager_ref_image(img->path);
+
+        startuptrace_add_asset("image", path, start_time);
+    }
+    else {
+        /* the image is being loaded asynchronously; we need it now */
+        if(img->job != NULL)
+            async_wait(img);
+
+        resourcemanager_ref_image(path);
+    }
+
+    return img;
+}
+
+/*
+ * image_load_async()
+ * Loads an image from a file in the background. The returned
+ * image is a transparent placeholder until it's ready. Use it
+ * as you would use an image returned by image_load()
+ */
+image_t* image_load_async(const char* path)
+{
+    image_t* img;
+    char compressed_path[1024], downscaled_path[1024];
+
+    /* compressed textures need no decoding; they're uploaded as they are.
+       Pre-generated downscaled variants are small */
+    if(resourcemanager_find_image(path) == NULL && compressed_variant(path, compressed_path, sizeof(compressed_path)) != NULL)
+        return image_load(path);
+    else if(resourcemanager_find_image(path) == NULL && downscaled_variant(path, downscaled_path, sizeof(downscaled_path)) != NULL)
+        return image_load(path);
+
+    if(NULL == (img = resourcemanager_find_image(path))) {
+        const char* fullpath = asset_path(path);
+        logfile_message("Loading image \"%s\" asynchronously...", fullpath);
+
+        /* initialize the loader */
+        if(!async_initialized)
+            async_init();
+
+        /* build the image object */
+        img = mallocx(sizeof *img);
+        img->w = img->h = 1;
+        img->atlas = NULL;
+        img->trimmed = NULL;
+        img->texel_size = 1;
+        img->origin_x = img->origin_y = 0;
+        img->pixels = NULL;
+        img->locked = NULL;
+        img->managed_index = -1;
+        img->pool_bitmap_flags = -1;
+        if(NULL == (img->data = al_create_sub_bitmap(async_placeholder, 0, 0, 1, 1)))
+            fatal_error("Failed to create a placeholder for image \"%s\"", fullpath);
+
+        /* enqueue a job */
+        imagejob_t* job = mallocx(sizeof *job);
+        job->img = img;
+        job->fullpath = str_dup(fullpath);
+        job->bitmap = NULL;
+        job->state = JOB_QUEUED;
+        job->next = NULL;
+        img->job = job;
+
+        async_lock();
+        async_push(&async_queue, job);
+#if WANT_ASYNC_DECODING
+        al_broadcast_cond(async_cond);
+#endif
+        async_unlock();
 
         /* adding the image to the resource manager */
-        img->path = str_dup(path);
+        img->path = str_intern(path);
         resourcemanager_add_image(img->path, img);
         resourcemanager_ref_image(img->path);
     }
@@ -102,6 +485,161 @@ image_t* image_load(const char* path)
     return img;
 }
 
+/*
+ * image_is_ready()
+ * Checks if an image has finished loading. Only images
+ * returned by image_load_async() may not be ready
+ */
+bool image_is_ready(const image_t* img)
+{
+    return img->job == NULL;
+}
+
+/*
+ * image_update_async()
+ * Uploads the images that have been decoded in the
+ * background to the GPU. Call it once per frame
+ */
+void image_update_async()
+{
+    int budget = ASYNC_UPLOAD_BUDGET;
+    imagejob_t* job;
+
+    /* restore lost textures in the background */
+    for(int i = 0, restored = 0; lost_texture_count > 0 && restored < RESTORE_BUDGET && i < (int)darray_length(managed_images); i++)
+        restored += restore_lost_texture(managed_images[i]->data);
+
+    /* destroy the render targets that haven't been recycled */
+    pool_trim();
+
+    if(!async_initialized)
+        return;
+
+#if !WANT_ASYNC_DECODING
+    /* decode a single image per frame in this thread */
+    if(NULL != (job = async_queue)) {
+        async_unlink(&async_queue, job);
+        job->bitmap = async_decode(job->fullpath);
+        job->state = JOB_DECODED;
+        async_push(&async_done, job);
+    }
+#endif
+
+    /* upload decoded images, at least one per frame */
+    while(budget > 0) {
+        async_lock();
+        if(NULL != (job = async_done))
+            async_unlink(&async_done, job);
+        async_unlock();
+
+        if(job == NULL)
+            break;
+
+        budget -= async_finish(job);
+    }
+}
+
+/*
+ * image_release_async()
+ * Releases the asynchronous loader. Call it after
+ * the images have been released
+ */
+void image_release_async()
+{
+    imagejob_t* job;
+
+    if(!async_initialized)
+        return;
+
+#if WANT_ASYNC_DECODING
+    /* stop the decoder */
+    async_lock();
+    al_set_thread_should_stop(async_thread);
+    al_broadcast_cond(async_cond);
+    async_unlock();
+
+    al_join_thread(async_thread, NULL);
+    al_destroy_thread(async_thread);
+    async_thread = NULL;
+#endif
+
+    /* discard remaining jobs */
+    while(NULL != (job = async_queue)) {
+        async_queue = job->next;
+        if(job->img != NULL)
+            job->img->job = NULL;
+        free(job->fullpath);
+        free(job);
+    }
+
+    while(NULL != (job = async_done)) {
+        async_done = job->next;
+        if(job->img != NULL)
+            job->img->job = NULL;
+        if(job->bitmap != NULL)
+            al_destroy_bitmap(job->bitmap);
+        free(job->fullpath);
+        free(job);
+    }
+
+    /* release the placeholder */
+    al_destroy_bitmap(async_placeholder);
+    async_placeholder = NULL;
+
+#if WANT_ASYNC_DECODING
+    al_destroy_cond(async_cond);
+    al_destroy_mutex(async_mutex);
+    async_cond = NULL;
+    async_mutex = NULL;
+#endif
+
+    async_initialized = false;
+}
+
+
+
+/*
+ * image_release_pool()
+ * Destroys the recycled render targets. Images destroyed
+ * afterwards are no longer recycled
+ */
+void image_release_pool()
+{
+    if(pool_hits + pool_misses > 0)
+        logfile_message("Render target pool: %d hits, %d misses", pool_hits, pool_misses);
+
+    while(darray_length(pool) > 0)
+        pool_evict(darray_length(pool) - 1);
+
+    darray_release(pool);
+    pool_memory = 0;
+    pool_closed = true;
+}
+
+/*
+ * image_restore_all()
+ * Marks the textures that were not preserved as lost. Call it after
+ * the display resumes drawing. They are restored progressively
+ */
+void image_restore_all()
+{
+    for(size_t i = 0; i < darray_length(managed_images); i++) {
+        ALLEGRO_BITMAP* root = root_bitmap(managed_images[i]->data);
+        uint64_t key = (uint64_t)(uintptr_t)root;
+
+        if(lost_textures == NULL)
+            lost_textures = fasthash_create(NULL, 8);
+
+        if(fasthash_get(lost_textures, key) == NULL) {
+            fasthash_put(lost_textures, key, root);
+            lost_texture_count++;
+        }
+    }
+
+    if(lost_texture_count > 0)
+        logfile_message("Restoring %d textures of %d images", lost_texture_count, (int)darray_length(managed_images));
+}
+
 
 
 /*
@@ -111,6 +649,7 @@ image_t* image_load(const char* path)
 void image_save(const image_t* img, const char *path)
 {
     const char* fullpath = asset_path(path);
+    restore_if_lost(img->data);
 
     if(al_save_bitmap(fullpath, img->data))
         logfile_message("Saved image to \"%s\"", fullpath);
@@ -118,6 +657,101 @@ void image_save(const image_t* img, const char *path)
         logfile_message("Failed to save image to \"%s\"", fullpath);
 }
 
+/*
+ * image_load_cached()
+ * Loads an image previously stored in the application cache with
+ * image_save_cached(). Returns NULL if there is no such image or if
+ * there is no application cache. Call image_destroy() after usage
+ */
+image_t* image_load_cached(const char* relative_path)
+{
+    char cache_path[1024];
+    ALLEGRO_BITMAP* bmp;
+    ALLEGRO_STATE state;
+    image_t* img;
+
+    if(*asset_cache_path(relative_path, cache_path, sizeof(cache_path)) == '\0')
+        return NULL;
+
+    al_store_state(&state, ALLEGRO_STATE_NEW_FILE_INTERFACE);
+    al_set_standard_file_interface();
+    bmp = al_load_bitmap(cache_path); /* NULL if not cached */
+    al_restore_state(&state);
+
+    if(bmp == NULL)
+        return NULL;
+
+    img = mallocx(sizeof *img);
+    img->data = bmp;
+    img->w = al_get_bitmap_width(bmp);
+    img->h = al_get_bitmap_height(bmp);
+    img->path = NULL;
+    img->atlas = NULL;
+    img->job = NULL;
+    img->trimmed = NULL;
+    img->texel_size = 1;
+    img->origin_x = 0;
+    img->origin_y = 0;
+    img->pixels = NULL;
+    img->locked = NULL;
+    img->managed_index = -1;
+    img->pool_bitmap_flags = -1;
+    resourcemanager_track_memory(RESOURCE_IMAGE, bitmap_memory(img->data));
+
+    return img;
+}
+
+/*
+ * image_save_cached()
+ * Stores an image in the application cache as a PNG file.
+ * Returns true on success
+ */
+bool image_save_cached(const image_t* img, const char* relative_path)
+{
+    char cache_path[1024];
+    ALLEGRO_BITMAP* copy;
+    ALLEGRO_STATE state;
+    bool success;
+
+    if(*asset_cache_path(relative_path, cache_path, sizeof(cache_path)) == '\0')
+        return false;
+
+    /* copy the pixels to memory */
+    restore_if_lost(img->data);
+    al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS | ALLEGRO_STATE_NEW_FILE_INTERFACE);
+    al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+    al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE);
+    copy = al_clone_bitmap(img->data);
+
+    if(copy == NULL) {
+        al_restore_state(&state);
+        return false;
+    }
+
+    /* the cache stores non-premultiplied alpha, as any PNG file */
+    ALLEGRO_LOCKED_REGION* region = al_lock_bitmap(copy, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READWRITE);
+    for(int y = 0; y < img->h && region != NULL; y++) {
+        uint8_t* p = (uint8_t*)region->data + y * region->pitch;
+        for(int x = 0; x < img->w; x++, p += 4) {
+            if(p[3] != 0) {
+                p[0] = min(255, (p[0] * 255 + p[3] / 2) / p[3]);
+                p[1] = min(255, (p[1] * 255 + p[3] / 2) / p[3]);
+                p[2] = min(255, (p[2] * 255 + p[3] / 2) / p[3]);
+            }
+        }
+    }
+    if(region != NULL)
+        al_unlock_bitmap(copy);
+
+    al_set_standard_file_interface();
+    if(!(success = al_save_bitmap(cache_path, copy)))
+        logfile_message("WARNING: can't cache an image at \"%s\"", cache_path);
+
+    al_destroy_bitmap(copy);
+    al_restore_state(&state);
+    return success;
+}
+
 
 
 /*
@@ -128,6 +762,7 @@ image_t* image_create(int width, int height)
 {
     ALLEGRO_BITMAP* bmp;
     ALLEGRO_STATE state;
+    imagepoolkey_t key;
     image_t* img;
 
     if(width > MAX_IMAGE_SIZE || height > MAX_IMAGE_SIZE)
@@ -138,7 +773,9 @@ image_t* image_create(int width, int height)
         return NULL;
     }
 
-    if(NULL == (bmp = al_create_bitmap(width, height))) {
+    /* recycle a render target or create a new bitmap */
+    make_pool_key(&key, width, height);
+    if(NULL == (bmp = pool_take(&key)) && NULL == (bmp = al_create_bitmap(width, height))) {
         logfile_message("ERROR: image_create(%d,%d) failed", width, height);
         return NULL;
     }
@@ -147,13 +784,24 @@ image_t* image_create(int width, int height)
     al_set_target_bitmap(bmp);
     al_clear_to_color(al_map_rgb(0, 0, 0));
     al_restore_state(&state);
+    resourcemanager_track_memory(RESOURCE_IMAGE, bitmap_memory(bmp));
 
     img = mallocx(sizeof *img);
     img->data = bmp;
     img->w = width;
     img->h = height;
     img->path = NULL;
-    
+    img->atlas = NULL;
+    img->job = NULL;
+    img->trimmed = NULL;
+    img->texel_size = 1;
+    img->origin_x = img->origin_y = 0;
+    img->pixels = NULL;
+    img->locked = NULL;
+    img->managed_index = -1;
+    img->pool_key = key;
+    img->pool_bitmap_flags = (al_get_bitmap_flags(bmp) & ALLEGRO_MEMORY_BITMAP) ? -1 : al_get_bitmap_flags(bmp);
+
     return img;
 }
 
@@ -165,11 +813,28 @@ image_t* image_create(int width, int height)
  */
 void image_destroy(image_t* img)
 {
-    if(img->data != NULL)
-        al_destroy_bitmap(img->data);
+    if(img->job != NULL)
+        async_cancel(img);
 
-    if(img->path != NULL)
-        free(img->path);
+    if(img->trimmed != NULL)
+        al_destroy_bitmap(img->trimmed);
+
+    if(img->pixels != NULL)
+        al_destroy_bitmap(img->pixels);
+
+    if(img->managed_index >= 0)
+        unmanage_image(img);
+
+    if(img->data != NULL) {
+        if(al_get_parent_bitmap(img->data) == NULL)
+            forget_lost_texture(img->data);
+        resourcemanager_track_memory(RESOURCE_IMAGE, -bitmap_memory(img->data));
+        if(!pool_put(img))
+            al_destroy_bitmap(img->data);
+    }
+
+    if(img->atlas != NULL)
+        atlas_unref(img->atlas); /* after destroying the sub-bitmap */
 
     if(target == img)
         target = NULL;
@@ -195,6 +860,10 @@ image_t* image_create_shared(const image_t* parent, int x, int y, int width, int
         return NULL;
     }
 
+    /* a sub-image of a placeholder would be useless */
+    if(parent->job != NULL)
+        async_wait((image_t*)parent);
+
     pw = parent->w;
     ph = parent->h;
     x = clip(x, 0, pw-1);
@@ -205,15 +874,34 @@ image_t* image_create_shared(const image_t* parent, int x, int y, int width, int
     img = mallocx(sizeof *img);
     img->w = width;
     img->h = height;
-    if(NULL == (img->data = al_create_sub_bitmap(parent->data, x, y, width, height)))
+    img->texel_size = parent->texel_size;
+    img->origin_x = parent->origin_x + x;
+    img->origin_y = parent->origin_y + y;
+    img->pixels = NULL;
+    img->locked = NULL;
+    img->managed_index = -1;
+    img->pool_bitmap_flags = -1;
+
+    /* the texels of adjacent sub-images don't overlap */
+    int texel_x = to_texels(parent, x), texel_y = to_texels(parent, y);
+    int texel_width = max(1, to_texels(parent, x + width) - texel_x);
+    int texel_height = max(1, to_texels(parent, y + height) - texel_y);
+    if(NULL == (img->data = al_create_sub_bitmap(parent->data, texel_x, texel_y, texel_width, texel_height)))
         fatal_error("Failed to create shared image of \"%s\": %d, %d, %d, %d", parent->path ? parent->path : "", x, y, width, height);
 
     img->path = NULL;
     if(parent->path != NULL) {
-        img->path = str_dup(parent->path);
+        img->path = parent->path;
         resourcemanager_ref_image(img->path); /* reference it, otherwise the parent may be destroyed */
     }
 
+    /* the sub-image keeps the page of the atlas alive */
+    img->job = NULL;
+    img->trimmed = NULL;
+    img->atlas = parent->atlas;
+    if(img->atlas != NULL)
+        img->atlas->ref_count++;
+
     return img;
 }
 
@@ -314,8 +1002,20 @@ image_t* image_clone(const image_t* src)
     img->w = src->w;
     img->h = src->h;
     img->path = NULL;
+    img->atlas = NULL; /* a clone is a standalone bitmap */
+    img->job = NULL;
+    img->trimmed = NULL;
+    img->texel_size = src->texel_size;
+    img->origin_x = src->origin_x;
+    img->origin_y = src->origin_y;
+    img->pixels = NULL;
+    img->locked = NULL;
+    img->managed_index = -1;
+    img->pool_bitmap_flags = -1;
+    restore_if_lost(src->data);
     if(NULL == (img->data = al_clone_bitmap(src->data)))
         fatal_error("Failed to clone image \"%s\" sized %dx%d", src->path ? src->path : "", src->w, src->h);
+    resourcemanager_track_memory(RESOURCE_IMAGE, bitmap_memory(img->data));
 
     return img;
 }
@@ -328,6 +1028,37 @@ void image_enable_linear_filtering(image_t* img)
 {
     ALLEGRO_STATE state;
     al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+    restore_if_lost(img->data);
+
+    /* converting a packed image would convert its entire page.
+       Move the image out of the atlas. Besides, linear filtering
+       would sample the neighbors of the image */
+    if(img->atlas != NULL) {
+        ALLEGRO_BITMAP* standalone = al_clone_bitmap(img->data);
+
+        if(standalone != NULL) {
+            resourcemanager_track_memory(RESOURCE_IMAGE, bitmap_memory(standalone));
+            if(img->trimmed != NULL) {
+                /* the trimmed sub-bitmap must follow the new bitmap */
+                ALLEGRO_BITMAP* trimmed = al_create_sub_bitmap(standalone, img->trim_x, img->trim_y, al_get_bitmap_width(img->trimmed), al_get_bitmap_height(img->trimmed));
+                al_destroy_bitmap(img->trimmed);
+                img->trimmed = trimmed;
+            }
+            al_destroy_bitmap(img->data);
+            atlas_unref(img->atlas);
+            img->data = standalone;
+            img->atlas = NULL;
+
+            /* the clone is preserved */
+            if(img->managed_index >= 0)
+                unmanage_image(img);
+        }
+        else {
+            logfile_message("WARNING: can't enable linear filtering of \"%s\"", img->path != NULL ? img->path : "");
+            al_restore_state(&state);
+            return;
+        }
+    }
 
     ALLEGRO_BITMAP* root = img->data;
     while(al_get_parent_bitmap(root) != NULL)
@@ -366,7 +1097,12 @@ void image_enable_linear_filtering(image_t* img)
 void image_disable_linear_filtering(image_t* img)
 {
     ALLEGRO_STATE state;
+
+    /* the pages of the atlas are never filtered */
+    if(img->atlas != NULL)
+        return;
     al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+    restore_if_lost(img->data);
 
     int flags = al_get_bitmap_flags(img->data);
     al_set_new_bitmap_flags(flags & ~(ALLEGRO_MIPMAP | ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR));
@@ -410,9 +1146,30 @@ void image_lock(image_t* img, const char* mode)
             break;
     }
 
-    /* lock the bitmap */
-    if(!al_lock_bitmap(img->data, al_get_bitmap_format(img->data), flags))
+    /* the pixels of a managed image are not ready until its texture is restored */
+    restore_if_lost(img->data);
+
+    /* read the original pixels of a downscaled image */
+    if(img->texel_size > 1 && flags == ALLEGRO_LOCK_READONLY && img->path != NULL && img->pixels == NULL) {
+        if(NULL != (img->pixels = load_original_pixels(img->path))) {
+            img->locked = al_lock_bitmap(img->pixels, LOCKED_FORMAT, ALLEGRO_LOCK_READONLY);
+            return;
+        }
+    }
+
+    /* lock the bitmap. Compressed textures are decompressed by Allegro.
+       Pixels are read in a known format, so that they can be read in bulk */
+    int format = al_get_bitmap_format(img->data);
+    if(flags == ALLEGRO_LOCK_READONLY)
+        format = LOCKED_FORMAT;
+    else if(format == ALLEGRO_PIXEL_FORMAT_COMPRESSED_RGBA_DXT1 || format == ALLEGRO_PIXEL_FORMAT_COMPRESSED_RGBA_DXT3 || format == ALLEGRO_PIXEL_FORMAT_COMPRESSED_RGBA_DXT5)
+        format = ALLEGRO_PIXEL_FORMAT_ANY_32_WITH_ALPHA;
+
+    ALLEGRO_LOCKED_REGION* region = al_lock_bitmap(img->data, format, flags);
+    if(region == NULL)
         logfile_message("WARNING: can't lock image \"%s\" (mode: %s)", img->path, mode);
+    else if(region->format == LOCKED_FORMAT)
+        img->locked = region;
 }
 
 /*
@@ -421,6 +1178,15 @@ void image_lock(image_t* img, const char* mode)
  */
 void image_unlock(image_t* img)
 {
+    img->locked = NULL;
+
+    if(img->pixels != NULL) {
+        al_unlock_bitmap(img->pixels);
+        al_destroy_bitmap(img->pixels);
+        img->pixels = NULL;
+        return;
+    }
+
     al_unlock_bitmap(img->data);
 }
 
@@ -431,7 +1197,7 @@ void image_unlock(image_t* img)
 bool image_is_locked(const image_t* img)
 {
     /* this may not work properly if the input is a sub-image */
-    return al_is_bitmap_locked(img->data);
+    return al_is_bitmap_locked(img->pixels != NULL ? img->pixels : img->data);
 }
 
 /*
@@ -460,7 +1226,48 @@ int image_height(const image_t* img)
  */
 color_t image_getpixel(const image_t* img, int x, int y)
 {
-    return (color_t){ al_get_pixel(img->data, x, y) };
+    if(img->pixels != NULL)
+        return (color_t){ al_get_pixel(img->pixels, img->origin_x + x, img->origin_y + y) };
+
+    return (color_t){ al_get_pixel(img->data, to_texels(img, x), to_texels(img, y)) };
+}
+
+
+/*
+ * image_read_opaque_row()
+ * Reads width pixels of row y of a locked image, starting at column x.
+ * Writes 1 to out[i] if pixel (x+i, y) is opaque, or 0 if it's transparent
+ * (see color_is_transparent). This is much faster than image_getpixel().
+ * Returns false if the pixels can't be read in bulk
+ */
+bool image_read_opaque_row(const image_t* img, int x, int y, int width, uint8_t* out)
+{
+    const ALLEGRO_LOCKED_REGION* region = img->locked;
+
+    if(region == NULL)
+        return false;
+    else if(x < 0 || y < 0 || width < 0 || x + width > img->w || y >= img->h)
+        return false;
+
+    /* the original pixels of a downscaled image */
+    if(img->pixels != NULL) {
+        const uint8_t* row = (const uint8_t*)region->data + (img->origin_y + y) * region->pitch;
+        find_opaque_pixels(row + (img->origin_x + x) * 4, width, out);
+        return true;
+    }
+
+    /* full resolution */
+    const uint8_t* row = (const uint8_t*)region->data + to_texels(img, y) * region->pitch;
+    if(img->texel_size == 1) {
+        find_opaque_pixels(row + x * 4, width, out);
+        return true;
+    }
+
+    /* downscaled image */
+    for(int i = 0; i < width; i++)
+        find_opaque_pixels(row + to_texels(img, x + i) * 4, 1, out + i);
+
+    return true;
 }
 
 
@@ -480,7 +1287,10 @@ void image_putpixel(int x, int y, color_t color)
  */
 void image_line(int x1, int y1, int x2, int y2, color_t color)
 {
-    al_draw_line(x1 + 0.5f, y1 + 0.5f, x2 + 0.5f, y2 + 0.5f, color._color, 0.0f);
+    if(primitive_hold_count > 0)
+        hold_line(x1 + 0.5f, y1 + 0.5f, x2 + 0.5f, y2 + 0.5f, color._color);
+    else
+        al_draw_line(x1 + 0.5f, y1 + 0.5f, x2 + 0.5f, y2 + 0.5f, color._color, 0.0f);
 }
 
 
@@ -490,7 +1300,10 @@ void image_line(int x1, int y1, int x2, int y2, color_t color)
  */
 void image_ellipse(int cx, int cy, int radius_x, int radius_y, color_t color)
 {
-    al_draw_ellipse(cx + 0.5f, cy + 0.5f, radius_x, radius_y, color._color, 0.0f);
+    if(primitive_hold_count > 0)
+        hold_ellipse(cx + 0.5f, cy + 0.5f, radius_x, radius_y, color._color, false);
+    else
+        al_draw_ellipse(cx + 0.5f, cy + 0.5f, radius_x, radius_y, color._color, 0.0f);
 }
 
 
@@ -500,7 +1313,10 @@ void image_ellipse(int cx, int cy, int radius_x, int radius_y, color_t color)
  */
 void image_ellipsefill(int cx, int cy, int radius_x, int radius_y, color_t color)
 {
-    al_draw_filled_ellipse(cx + 0.5f, cy + 0.5f, radius_x, radius_y, color._color);
+    if(primitive_hold_count > 0)
+        hold_ellipse(cx + 0.5f, cy + 0.5f, radius_x, radius_y, color._color, true);
+    else
+        al_draw_filled_ellipse(cx + 0.5f, cy + 0.5f, radius_x, radius_y, color._color);
 }
 
 
@@ -510,7 +1326,15 @@ void image_ellipsefill(int cx, int cy, int radius_x, int radius_y, color_t color
  */
 void image_rect(int x1, int y1, int x2, int y2, color_t color)
 {
-    al_draw_rectangle(x1 + 0.5f, y1 + 0.5f, x2 + 0.5f, y2 + 0.5f, color._color, 0.0f);
+    if(primitive_hold_count > 0) {
+        float l = x1 + 0.5f, t = y1 + 0.5f, r = x2 + 0.5f, b = y2 + 0.5f;
+        hold_line(l, t, r, t, color._color);
+        hold_line(r, t, r, b, color._color);
+        hold_line(r, b, l, b, color._color);
+        hold_line(l, b, l, t, color._color);
+    }
+    else
+        al_draw_rectangle(x1 + 0.5f, y1 + 0.5f, x2 + 0.5f, y2 + 0.5f, color._color, 0.0f);
 }
 
 
@@ -520,7 +1344,13 @@ void image_rect(int x1, int y1, int x2, int y2, color_t color)
  */
 void image_rectfill(int x1, int y1, int x2, int y2, color_t color)
 {
-    al_draw_filled_rectangle(x1, y1, x2 + 1.0f, y2 + 1.0f, color._color);
+    if(primitive_hold_count > 0) {
+        float l = x1, t = y1, r = x2 + 1.0f, b = y2 + 1.0f;
+        hold_triangle(l, t, r, t, r, b, color._color);
+        hold_triangle(l, t, r, b, l, b, color._color);
+    }
+    else
+        al_draw_filled_rectangle(x1, y1, x2 + 1.0f, y2 + 1.0f, color._color);
 }
 
 
@@ -540,9 +1370,26 @@ void image_clear(color_t color)
  */
 void image_blit(const image_t* src, int src_x, int src_y, int dest_x, int dest_y, int width, int height)
 {
+    if(src->texel_size > 1) {
+        image_blit_scaled(src, src_x, src_y, width, height, dest_x, dest_y, width, height);
+        return;
+    }
+
+    restore_if_lost(src->data);
     al_draw_bitmap_region(src->data, src_x, src_y, width, height, dest_x, dest_y, 0);
 }
 
+/*
+ * image_blit_scaled()
+ * Blits a region of a surface onto another, scaling it to the destination size
+ */
+void image_blit_scaled(const image_t* src, int src_x, int src_y, int src_width, int src_height, int dest_x, int dest_y, int dest_width, int dest_height)
+{
+    float s = src->texel_size;
+    restore_if_lost(src->data);
+    al_draw_scaled_bitmap(src->data, src_x / s, src_y / s, src_width / s, src_height / s, dest_x, dest_y, dest_width, dest_height, 0);
+}
+
 
 /*
  * image_draw()
@@ -553,7 +1400,10 @@ void image_blit(const image_t* src, int src_x, int src_y, int dest_x, int dest_y
  */
 void image_draw(const image_t* src, int x, int y, int flags)
 {
-    al_draw_bitmap(src->data, x, y, FLIPPY(flags));
+    int ox, oy;
+    ALLEGRO_BITMAP* bmp = visible_bitmap(src, flags, &ox, &oy);
+
+    draw_tinted_bitmap(src, bmp, al_map_rgb_f(1.0f, 1.0f, 1.0f), x + ox, y + oy, FLIPPY(flags));
 }
 
 
@@ -568,11 +1418,16 @@ void image_draw(const image_t* src, int x, int y, int flags)
  *        (0.5, 0.5) stands for a smaller image
  */
 void image_draw_scaled(const image_t* src, int x, int y, v2d_t scale, int flags)
-{ 
+{
+    int ox, oy;
+    ALLEGRO_BITMAP* bmp = visible_bitmap(src, flags, &ox, &oy);
+    int w = al_get_bitmap_width(bmp), h = al_get_bitmap_height(bmp);
+    float s = src->texel_size;
+
     al_draw_scaled_bitmap(
-        src->data,
-        0.0f, 0.0f, src->w, src->h,
-        x, y, scale.x * src->w, scale.y * src->h,
+        bmp,
+        0.0f, 0.0f, w, h,
+        x + scale.x * ox, y + scale.y * oy, scale.x * s * w, scale.y * s * h,
         FLIPPY(flags)
     );
 }
@@ -585,11 +1440,15 @@ void image_draw_scaled_trans(const image_t* src, int x, int y, v2d_t scale, floa
 {
     float a = clip01(alpha);
     ALLEGRO_COLOR tint = al_map_rgba_f(a, a, a, a);
+    int ox, oy;
+    ALLEGRO_BITMAP* bmp = visible_bitmap(src, flags, &ox, &oy);
+    int w = al_get_bitmap_width(bmp), h = al_get_bitmap_height(bmp);
+    float s = src->texel_size;
 
     al_draw_tinted_scaled_bitmap(
-        src->data, tint,
-        0.0f, 0.0f, src->w, src->h,
-        x, y, scale.x * src->w, scale.y * src->h,
+        bmp, tint,
+        0.0f, 0.0f, w, h,
+        x + scale.x * ox, y + scale.y * oy, scale.x * s * w, scale.y * s * h,
         FLIPPY(flags)
     );
 }
@@ -602,7 +1461,12 @@ void image_draw_scaled_trans(const image_t* src, int x, int y, v2d_t scale, floa
  */
 void image_draw_rotated(const image_t* src, int x, int y, int cx, int cy, float radians, int flags)
 {
-    al_draw_rotated_bitmap(src->data, cx, cy, x, y, -radians, FLIPPY(flags));
+    int ox, oy;
+    ALLEGRO_BITMAP* bmp = visible_bitmap(src, flags, &ox, &oy);
+
+    float s = src->texel_size;
+
+    al_draw_scaled_rotated_bitmap(bmp, (cx - ox) / s, (cy - oy) / s, x, y, s, s, -radians, FLIPPY(flags));
 }
 
 /*
@@ -613,8 +1477,12 @@ void image_draw_rotated_trans(const image_t* src, int x, int y, int cx, int cy,
 {
     float a = clip01(alpha);
     ALLEGRO_COLOR tint = al_map_rgba_f(a, a, a, a);
+    int ox, oy;
+    ALLEGRO_BITMAP* bmp = visible_bitmap(src, flags, &ox, &oy);
+
+    float s = src->texel_size;
 
-    al_draw_tinted_rotated_bitmap(src->data, tint, cx, cy, x, y, -radians, FLIPPY(flags));
+    al_draw_tinted_scaled_rotated_bitmap(bmp, tint, (cx - ox) / s, (cy - oy) / s, x, y, s, s, -radians, FLIPPY(flags));
 }
 
 /*
@@ -623,7 +1491,12 @@ void image_draw_rotated_trans(const image_t* src, int x, int y, int cx, int cy,
  */
 void image_draw_scaled_rotated(const image_t* src, int x, int y, int cx, int cy, v2d_t scale, float radians, int flags)
 {
-    al_draw_scaled_rotated_bitmap(src->data, cx, cy, x, y, scale.x, scale.y, -radians, FLIPPY(flags));
+    int ox, oy;
+    ALLEGRO_BITMAP* bmp = visible_bitmap(src, flags, &ox, &oy);
+
+    float s = src->texel_size;
+
+    al_draw_scaled_rotated_bitmap(bmp, (cx - ox) / s, (cy - oy) / s, x, y, scale.x * s, scale.y * s, -radians, FLIPPY(flags));
 }
 
 /*
@@ -634,8 +1507,12 @@ void image_draw_scaled_rotated_trans(const image_t* src, int x, int y, int cx, i
 {
     float a = clip01(alpha);
     ALLEGRO_COLOR tint = al_map_rgba_f(a, a, a, a);
+    int ox, oy;
+    ALLEGRO_BITMAP* bmp = visible_bitmap(src, flags, &ox, &oy);
 
-    al_draw_tinted_scaled_rotated_bitmap(src->data, tint, cx, cy, x, y, scale.x, scale.y, -radians, FLIPPY(flags));
+    float s = src->texel_size;
+
+    al_draw_tinted_scaled_rotated_bitmap(bmp, tint, (cx - ox) / s, (cy - oy) / s, x, y, scale.x * s, scale.y * s, -radians, FLIPPY(flags));
 }
  
 /*
@@ -647,8 +1524,10 @@ void image_draw_trans(const image_t* src, int x, int y, float alpha, int flags)
 {
     float a = clip01(alpha);
     ALLEGRO_COLOR tint = al_map_rgba_f(a, a, a, a);
+    int ox, oy;
+    ALLEGRO_BITMAP* bmp = visible_bitmap(src, flags, &ox, &oy);
 
-    al_draw_tinted_bitmap(src->data, tint, x, y, FLIPPY(flags));
+    draw_tinted_bitmap(src, bmp, tint, x + ox, y + oy, FLIPPY(flags));
 }
 
 /*
@@ -659,113 +1538,58 @@ void image_draw_lit(const image_t* src, int x, int y, color_t color, int flags)
 {
     /*
 
-    "While deferred bitmap drawing is enabled, the only functions that can be
-    used are the bitmap drawing functions and font drawing functions. Changing
-    the state such as the blending modes will result in undefined behaviour."
-
-    source: Allegro manual at
-    https://liballeg.org/a5docs/trunk/graphics.html#al_hold_bitmap_drawing
-
-    */
-
-    /* temporarily disable deferred drawing if it's activated */
-    bool is_held = al_is_bitmap_drawing_held();
-    if(is_held)
-        al_hold_bitmap_drawing(false);
-
-    /* store the blend state */
-    ALLEGRO_STATE state;
-    al_store_state(&state, ALLEGRO_STATE_BLENDER);
-
-    /* blending magic */
-    al_set_blend_color(color._color);
-    al_set_blender(
+    This used to be done with two passes of al_draw_bitmap() using custom
+    blenders, which required disabling deferred drawing and changing the
+    blend state on every call - breaking batches in the render queue.
 
-        /*
+    We now carry the color in the tint of the vertices, which is consumed by
+    the fragment shader (color = v_color * p) using the usual pre-multiplied
+    alpha blender (ONE, INVERSE_ALPHA). Given a tint t, we get:
 
-        this works with a source image with pre-multiplied alpha:
+        x = dx * (1 - sa) + (sx * sa) * t
 
-            x = dx * (1 - sa) + (sx * sa) * cc
+    replace x by r, g, b (the notation follows the former implementation:
+    dx is the destination color, sx is the source color, sa is the source
+    alpha and cc is the lit color)
 
-        replace x by r, g, b, a
+    The former two-pass approach resulted in:
 
-        x is the result of the blending
-        dx is destination color
-        sx is the source color
-        sa is the source alpha
-        (sx * sa) is the source color with pre-multiplied alpha
-        cc is a constant color
+        x = dx * (1 - sa) + 2 * (sx * sa) * cc
 
-        if sa = 1 (fully opaque), then we'll have x = sx * cc
-        if sa = 0 (fully transparent), then we'll have x = dx
+    which means that t = 2 * cc for the r, g, b components and t = 1 for
+    the alpha component. If sa = 1 (fully opaque), we get x = 2 * sx * cc,
+    a colored effect with both additive and multiplicative blending. If
+    sa = 0 (fully transparent), we get x = dx, preserving the background.
 
-        */
+    Vertex colors are not clamped to [0,1] when passed to the shaders, so
+    this works in batched mode together with regular draw calls.
 
-        ALLEGRO_ADD, ALLEGRO_CONST_COLOR, ALLEGRO_INVERSE_ALPHA
+    */
+    ALLEGRO_COLOR tint = al_map_rgba_f(
+        2.0f * color._color.r,
+        2.0f * color._color.g,
+        2.0f * color._color.b,
+        1.0f
     );
-    al_draw_bitmap(src->data, x, y, FLIPPY(flags));
-
-    al_set_blender(
-
-        /*
 
-        this second equation works as follows:
+    int ox, oy;
+    ALLEGRO_BITMAP* bmp = visible_bitmap(src, flags, &ox, &oy);
 
-            y = dy + (sy * sa) * cc
-
-        where dy = x is the result of the previous call to al_draw_bitmap()
-        and sy = sx is the source pixel of the bitmap that is being drawn.
-        Replace y by r, g, b, a.
-
-        let's analyze two cases:
-
-        1) suppose that sa = 1.0 (fully opaque pixel). This means that,
-           in the previous call to al_draw_bitmap(), we had x = sx * cc
-           as the result. Therefore, we'll have y = sx * cc + sx * cc =
-           2 * sx * cc now, which will give us a nice colored effect with
-           both additive and multiplicative blending.
+    draw_tinted_bitmap(src, bmp, tint, x + ox, y + oy, FLIPPY(flags));
+}
 
-        2) suppose that sa = 0.0 (fully transparent pixel). This means that,
-           in the previous call to al_draw_bitmap(), we had x = dx as the
-           result. Therefore, we'll have y = dx now, which means that we'll
-           be preserving the background as-is.
+/*
+ * image_draw_tinted()
+ * Image blending: multiplication mode
+ * 0.0 <= alpha <= 1.0
+ */
+void image_draw_tinted(const image_t* src, int x, int y, color_t color, int flags)
+{
+    int ox, oy;
+    ALLEGRO_BITMAP* bmp = visible_bitmap(src, flags, &ox, &oy);
 
-        we could modify the cc variable of this second equation for a more
-        refined control of the color. If we had two separate colors for each
-        equation, cc1 and cc2, then the result would be y = sx * (cc1 + cc2).
-        If cc2 = t * cc1 for some 0 < t < 1, then y' = (1 + t) * sx * cc1 <
-        2 * sx * cc1. Seems like overkill, though.
-
-        perhaps a better result would be achieved with y' = sx * cc + cc,
-        because multiplicative blending doesn't always look great depending
-        on the colors. How can we draw y'' = cc * sa? So far I don't see in
-        Allegro an op with a constant offset, neither a way to compute 1/sx.
-        Creating a temporary, single-colored bitmap could work. Is there an
-        easier way? We can draw a black silhouette with blending alone.
-
-        */
-
-        ALLEGRO_ADD, ALLEGRO_CONST_COLOR, ALLEGRO_ONE
-    );
-    al_draw_bitmap(src->data, x, y, FLIPPY(flags));
-
-    /* restore the blending state */
-    al_restore_state(&state);
-
-    /* re-enable deferred drawing if it was activated */
-    if(is_held)
-        al_hold_bitmap_drawing(true);
-}
-
-/*
- * image_draw_tinted()
- * Image blending: multiplication mode
- * 0.0 <= alpha <= 1.0
- */
-void image_draw_tinted(const image_t* src, int x, int y, color_t color, int flags)
-{
-    al_draw_tinted_bitmap(src->data, color._color, x, y, FLIPPY(flags));
-}
+    draw_tinted_bitmap(src, bmp, color._color, x + ox, y + oy, FLIPPY(flags));
+}
 
 /*
  * image_set_drawing_target()
@@ -773,6 +1597,7 @@ void image_draw_tinted(const image_t* src, int x, int y, color_t color, int flag
  */
 void image_set_drawing_target(image_t* new_target)
 {
+    flush_primitives();
     target = (new_target != video_get_backbuffer()) ? new_target : NULL;
     al_set_target_bitmap(image_drawing_target()->data);
 }
@@ -817,6 +1642,20 @@ void image_hold_drawing(bool hold)
     }
 }
 
+/*
+ * image_hold_primitives()
+ * Accumulate lines, rectangles and ellipses and draw them in bulk when the
+ * hold is released. Pair image_hold_primitives(true) with
+ * image_hold_primitives(false). Meant for debug visualizations
+ */
+void image_hold_primitives(bool hold)
+{
+    if(hold)
+        primitive_hold_count++;
+    else if(primitive_hold_count > 0 && --primitive_hold_count == 0)
+        flush_primitives();
+}
+
 /*
  * image_filepath()
  * The relative path to the file of this image, if it exists.
@@ -834,6 +1673,1101 @@ const char* image_filepath(const image_t* img)
 texturehandle_t image_texture(const image_t* img)
 {
     /* we require ALLEGRO_OPENGL to be a display flag */
+    restore_if_lost(img->data);
     texturehandle_t tex = al_get_opengl_texture(img->data);
     return tex;
-}
\ No newline at end of file
+}
+
+/*
+ * image_texture_region()
+ * Gets the rectangle of the texture that stores the image, in texels. Allegro
+ * stores bitmaps upside down, so (*x, *y) is the bottom-left corner of the image
+ * in the texture, following the OpenGL convention. Use it to sample the image
+ * in a shader with texelFetch() or with coordinates normalized by textureSize()
+ */
+void image_texture_region(const image_t* img, int* x, int* y, int* width, int* height)
+{
+    ALLEGRO_BITMAP* parent = al_get_parent_bitmap(img->data); /* sub-bitmaps are never nested */
+    int w = al_get_bitmap_width(img->data);
+    int h = al_get_bitmap_height(img->data);
+
+    if(parent != NULL) {
+        *x = al_get_bitmap_x(img->data);
+        *y = al_get_bitmap_height(parent) - (al_get_bitmap_y(img->data) + h);
+    }
+    else
+        *x = *y = 0;
+
+    *width = w;
+    *height = h;
+}
+
+/*
+ * image_trim()
+ * Restricts the drawing of the image to a rectangle, given in image
+ * space, that encloses all of its visible pixels. The pixels outside of
+ * the rectangle must be fully transparent. This saves fill rate when
+ * drawing large images that are mostly transparent; the results don't
+ * change. Pass the full size of the image to undo the trimming
+ */
+void image_trim(image_t* img, int x, int y, int width, int height)
+{
+    /* clip the rectangle */
+    x = clip(x, 0, img->w - 1);
+    y = clip(y, 0, img->h - 1);
+    width = clip(width, 0, img->w - x);
+    height = clip(height, 0, img->h - y);
+
+    /* undo any previous trimming */
+    if(img->trimmed != NULL) {
+        al_destroy_bitmap(img->trimmed);
+        img->trimmed = NULL;
+    }
+
+    /* nothing to trim */
+    if(width <= 0 || height <= 0 || (width == img->w && height == img->h))
+        return;
+
+    /* convert the rectangle to texels, enclosing it */
+    int s = img->texel_size;
+    int texel_x = x / s, texel_y = y / s;
+    int texel_width = min((x + width + s - 1) / s, al_get_bitmap_width(img->data)) - texel_x;
+    int texel_height = min((y + height + s - 1) / s, al_get_bitmap_height(img->data)) - texel_y;
+    if(texel_width <= 0 || texel_height <= 0)
+        return;
+
+    /* the trimmed sub-bitmap shares the texture of the image */
+    if(NULL == (img->trimmed = al_create_sub_bitmap(img->data, texel_x, texel_y, texel_width, texel_height))) {
+        logfile_message("WARNING: can't trim image \"%s\"", img->path != NULL ? img->path : "");
+        return;
+    }
+
+    img->trim_x = texel_x;
+    img->trim_y = texel_y;
+}
+
+
+
+/*
+ * private stuff
+ */
+
+/* checks the size of an image whose bitmap has just been loaded and packs it into the texture atlas */
+void setup_loaded_image(image_t* img, const char* path)
+{
+    /* checking the size */
+    img->w = al_get_bitmap_width(img->data) * img->texel_size;
+    img->h = al_get_bitmap_height(img->data) * img->texel_size;
+    if(img->w > MAX_IMAGE_SIZE || img->h > MAX_IMAGE_SIZE) {
+        /* ensure broad compatibility with video cards */
+        fatal_error("Failed to load \"%s\": images can't be larger than %dx%d", path, MAX_IMAGE_SIZE, MAX_IMAGE_SIZE);
+        return;
+    }
+
+    /* pack small images into the texture atlas */
+    img->atlas = NULL;
+#if WANT_TEXTURE_ATLAS
+    ALLEGRO_BITMAP* packed = atlas_pack(img->data, &img->atlas);
+    if(packed != NULL) {
+        al_destroy_bitmap(img->data);
+        img->data = packed;
+    }
+#endif
+
+    /* memory usage (packed images are accounted in their pages) */
+    resourcemanager_track_memory(RESOURCE_IMAGE, bitmap_memory(img->data));
+
+    /* textures that are not preserved are restored from the file */
+    manage_image(img);
+}
+
+/* the parameters of a bitmap that would be created now */
+void make_pool_key(imagepoolkey_t* key, int width, int height)
+{
+    memset(key, 0, sizeof(*key)); /* memcmp() */
+    key->width = width;
+    key->height = height;
+    key->flags = al_get_new_bitmap_flags();
+    key->format = al_get_new_bitmap_format();
+    key->depth = al_get_new_bitmap_depth();
+
+#if WANT_WRAP
+    ALLEGRO_BITMAP_WRAP u, v;
+    al_get_new_bitmap_wrap(&u, &v);
+    key->wrap_u = (int)u;
+    key->wrap_v = (int)v;
+#endif
+}
+
+/* takes the most recently pooled bitmap created with the given parameters, or returns NULL */
+ALLEGRO_BITMAP* pool_take(const imagepoolkey_t* key)
+{
+    if(key->flags & ALLEGRO_MEMORY_BITMAP)
+        return NULL;
+
+    for(int i = (int)darray_length(pool) - 1; i >= 0; i--) {
+        if(memcmp(&pool[i].key, key, sizeof(*key)) == 0) {
+            ALLEGRO_BITMAP* bmp = pool[i].bitmap;
+
+            resourcemanager_track_memory(RESOURCE_IMAGE_POOL, -pool[i].memory);
+            pool_memory -= pool[i].memory;
+            darray_remove(pool, i);
+            pool_hits++;
+
+            return bmp;
+        }
+    }
+
+    pool_misses++;
+    return NULL;
+}
+
+/* keeps the bitmap of an image that is being destroyed for recycling. Returns false if it's not poolable */
+bool pool_put(const image_t* img)
+{
+    ALLEGRO_BITMAP* bmp = img->data;
+
+    /* only standalone render targets created by image_create()
+       that haven't been modified afterwards are recycled */
+    if(pool_closed || img->pool_bitmap_flags < 0)
+        return false;
+    else if(al_get_parent_bitmap(bmp) != NULL || al_is_bitmap_locked(bmp))
+        return false;
+    else if(al_get_bitmap_flags(bmp) != img->pool_bitmap_flags) /* e.g., linear filtering */
+        return false;
+
+    int64_t memory = bitmap_memory(bmp);
+    if(memory > POOL_MAX_MEMORY)
+        return false;
+
+    /* as when destroying the bitmap, unset it as the drawing target */
+    if(al_get_target_bitmap() == bmp)
+        al_set_target_bitmap(NULL);
+
+    pooledbitmap_t entry = {
+        .bitmap = bmp,
+        .key = img->pool_key,
+        .memory = memory,
+        .frame = pool_frame
+    };
+
+    if(pool == NULL)
+        darray_init(pool);
+
+    darray_push(pool, entry);
+    pool_memory += memory;
+    resourcemanager_track_memory(RESOURCE_IMAGE_POOL, memory);
+
+    /* limit the memory of the pool */
+    while(pool_memory > POOL_MAX_MEMORY)
+        pool_evict(0);
+
+    return true;
+}
+
+/* destroys the index-th pooled bitmap */
+void pool_evict(int index)
+{
+    resourcemanager_track_memory(RESOURCE_IMAGE_POOL, -pool[index].memory);
+    pool_memory -= pool[index].memory;
+    al_destroy_bitmap(pool[index].bitmap);
+    darray_remove(pool, index);
+}
+
+/* destroys the bitmaps that haven't been recycled within the frame window */
+void pool_trim()
+{
+    pool_frame++;
+
+    while(darray_length(pool) > 0 && pool_frame - pool[0].frame > POOL_FRAME_WINDOW)
+        pool_evict(0);
+}
+
+/* adds an image loaded from a file to the list of managed images if its texture is not preserved */
+void manage_image(image_t* img)
+{
+    if(!(al_get_bitmap_flags(root_bitmap(img->data)) & ALLEGRO_NO_PRESERVE_TEXTURE))
+        return;
+
+    if(managed_images == NULL)
+        darray_init(managed_images);
+
+    img->managed_index = (int)darray_length(managed_images);
+    darray_push(managed_images, img);
+}
+
+/* removes an image from the list of managed images */
+void unmanage_image(image_t* img)
+{
+    int index = img->managed_index;
+    int last = (int)darray_length(managed_images) - 1;
+
+    managed_images[last]->managed_index = index;
+    darray_remove_unordered(managed_images, index);
+    img->managed_index = -1;
+
+    if(darray_length(managed_images) == 0)
+        darray_release(managed_images);
+}
+
+/* the texture of a root bitmap is no longer lost */
+void forget_lost_texture(ALLEGRO_BITMAP* root)
+{
+    if(lost_texture_count == 0 || !fasthash_delete(lost_textures, (uint64_t)(uintptr_t)root))
+        return;
+
+    if(--lost_texture_count == 0) {
+        lost_textures = fasthash_destroy(lost_textures);
+        logfile_message("Restored the textures");
+    }
+}
+
+/* restores the texture of a bitmap if it was lost, decoding the files of the
+   managed images it stores. Returns the number of restored pixels */
+int restore_lost_texture(ALLEGRO_BITMAP* bmp)
+{
+    ALLEGRO_BITMAP* root = root_bitmap(bmp);
+    if(fasthash_get(lost_textures, (uint64_t)(uintptr_t)root) == NULL)
+        return 0;
+
+    /* it's no longer lost, even if we fail to restore it */
+    forget_lost_texture(root);
+
+    /* flush the batched draws before modifying the texture */
+    bool was_held = al_is_bitmap_drawing_held();
+    if(was_held)
+        al_hold_bitmap_drawing(false);
+
+    /* upload the whole texture at once. Pixels not covered by images are transparent */
+    int width = al_get_bitmap_width(root), height = al_get_bitmap_height(root);
+    ALLEGRO_LOCKED_REGION* dst = al_lock_bitmap(root, LOCKED_FORMAT, ALLEGRO_LOCK_WRITEONLY);
+    if(dst != NULL) {
+        for(int y = 0; y < height; y++)
+            memset((uint8_t*)dst->data + y * dst->pitch, 0, width * 4);
+
+        for(size_t i = 0; i < darray_length(managed_images); i++) {
+            const image_t* img = managed_images[i];
+            if(root_bitmap(img->data) == root)
+                reload_managed_image(img, dst, al_get_bitmap_x(img->data), al_get_bitmap_y(img->data));
+        }
+
+        al_unlock_bitmap(root);
+    }
+    else
+        logfile_message("WARNING: can't restore a texture sized %dx%d", width, height);
+
+    if(was_held)
+        al_hold_bitmap_drawing(true);
+
+    return width * height;
+}
+
+/* decodes the file of a managed image again, writing its pixels, as they
+   were uploaded to the GPU, to position (x,y) of a locked texture */
+void reload_managed_image(const image_t* img, ALLEGRO_LOCKED_REGION* dst, int x, int y)
+{
+    int width = al_get_bitmap_width(img->data), height = al_get_bitmap_height(img->data);
+    ALLEGRO_BITMAP* bmp = NULL;
+    ALLEGRO_STATE state;
+
+    /* decode a downscaled image the same way as it was loaded */
+    if(img->texel_size > 1) {
+        al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+        al_set_new_bitmap_flags((al_get_new_bitmap_flags() & ~ALLEGRO_VIDEO_BITMAP) | ALLEGRO_MEMORY_BITMAP);
+        bmp = load_downscaled(img->path);
+        al_restore_state(&state);
+    }
+
+    if(bmp == NULL && NULL != (bmp = load_original_pixels(img->path)) && img->texel_size > 1) {
+        image_t tmp = { .data = bmp, .path = NULL, .texel_size = 1 }; /* don't cache it again */
+        downscale_loaded_image(&tmp);
+        bmp = tmp.data;
+    }
+
+    if(bmp == NULL)
+        return;
+
+    /* copy the pixels */
+    ALLEGRO_LOCKED_REGION* src = NULL;
+    if(al_get_bitmap_width(bmp) != width || al_get_bitmap_height(bmp) != height)
+        logfile_message("WARNING: can't restore \"%s\": its size has changed", img->path);
+    else if(NULL == (src = al_lock_bitmap(bmp, LOCKED_FORMAT, ALLEGRO_LOCK_READONLY)))
+        logfile_message("WARNING: can't restore \"%s\"", img->path);
+
+    for(int j = 0; j < height && src != NULL; j++)
+        memcpy((uint8_t*)dst->data + (y + j) * dst->pitch + x * 4, (const uint8_t*)src->data + j * src->pitch, width * 4);
+
+    if(src != NULL)
+        al_unlock_bitmap(bmp);
+    al_destroy_bitmap(bmp);
+}
+
+/* the bitmap that owns the texture of a bitmap */
+ALLEGRO_BITMAP* root_bitmap(ALLEGRO_BITMAP* bmp)
+{
+    while(al_get_parent_bitmap(bmp) != NULL)
+        bmp = al_get_parent_bitmap(bmp);
+
+    return bmp;
+}
+
+/* an estimate of the memory used by a bitmap, in bytes. Sub-bitmaps share memory with their parents */
+int64_t bitmap_memory(ALLEGRO_BITMAP* bmp)
+{
+    if(al_get_parent_bitmap(bmp) != NULL)
+        return 0;
+
+    int64_t pixels = (int64_t)al_get_bitmap_width(bmp) * (int64_t)al_get_bitmap_height(bmp);
+    switch(al_get_bitmap_format(bmp)) {
+        case ALLEGRO_PIXEL_FORMAT_COMPRESSED_RGBA_DXT1:
+            return pixels / 2; /* 4 bits per pixel */
+
+        case ALLEGRO_PIXEL_FORMAT_COMPRESSED_RGBA_DXT3:
+        case ALLEGRO_PIXEL_FORMAT_COMPRESSED_RGBA_DXT5:
+            return pixels; /* 8 bits per pixel */
+
+        default:
+            return pixels * 4; /* 32 bits per pixel */
+    }
+}
+
+/* loads the compressed variant of an image, if it exists and if the GPU supports it.
+   Returns NULL otherwise. See texcompress.c */
+ALLEGRO_BITMAP* load_compressed(const char* path)
+{
+    char compressed_path[1024];
+    ALLEGRO_BITMAP* bmp;
+    ALLEGRO_STATE state;
+
+    if(compressed_variant(path, compressed_path, sizeof(compressed_path)) == NULL)
+        return NULL;
+
+    /* compressed textures are preserved; we don't decode them */
+    al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+    al_set_new_bitmap_flags(al_get_new_bitmap_flags() & ~ALLEGRO_NO_PRESERVE_TEXTURE);
+    bmp = al_load_bitmap(asset_path(compressed_path));
+    al_restore_state(&state);
+
+    if(bmp == NULL) {
+        logfile_message("WARNING: can't load \"%s\". Using \"%s\" instead", compressed_path, path);
+        return NULL;
+    }
+
+    logfile_message("Using the compressed texture \"%s\"", compressed_path);
+    return bmp;
+}
+
+/* the virtual path of the compressed variant of an image, if it should be
+   used. Returns NULL if the texture format is uncompressed, if the GPU
+   doesn't support compressed textures or if there is no such variant */
+const char* compressed_variant(const char* path, char* buffer, size_t buffer_size)
+{
+    if(resourcemanager_texture_format() == TEXTUREFORMAT_UNCOMPRESSED || !texcompress_is_supported())
+        return NULL;
+
+    texcompress_path(path, buffer, buffer_size);
+    return asset_exists(buffer) ? buffer : NULL;
+}
+
+/* initializes the asynchronous loader */
+void async_init()
+{
+    ALLEGRO_STATE state;
+
+    /* create a transparent placeholder */
+    al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP);
+    if(NULL == (async_placeholder = al_create_bitmap(1, 1)))
+        fatal_error("Can't create the placeholder of the asynchronous image loader");
+    al_set_target_bitmap(async_placeholder);
+    al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+    al_restore_state(&state);
+
+#if WANT_ASYNC_DECODING
+    /* start the decoder */
+    if(NULL == (async_mutex = al_create_mutex()))
+        fatal_error("Can't create a mutex for the asynchronous image loader");
+    if(NULL == (async_cond = al_create_cond()))
+        fatal_error("Can't create a condition variable for the asynchronous image loader");
+    if(NULL == (async_thread = al_create_thread(async_decoder, NULL)))
+        fatal_error("Can't create a thread for the asynchronous image loader");
+
+    al_start_thread(async_thread);
+#endif
+
+    async_initialized = true;
+}
+
+#if WANT_ASYNC_DECODING
+/* decodes queued images in the background */
+void* async_decoder(ALLEGRO_THREAD* thread, void* arg)
+{
+    /* use the physfs file interface in this thread */
+    al_set_physfs_file_interface();
+
+    async_lock();
+    while(!al_get_thread_should_stop(thread)) {
+        imagejob_t* job = async_queue;
+
+        /* wait for a job */
+        if(job == NULL) {
+            al_wait_cond(async_cond, async_mutex);
+            continue;
+        }
+
+        async_unlink(&async_queue, job);
+        job->state = JOB_DECODING;
+
+        /* decode the image without holding the lock */
+        async_unlock();
+        ALLEGRO_BITMAP* bitmap = async_decode(job->fullpath);
+        async_lock();
+
+        /* the image will be uploaded in the main thread */
+        job->bitmap = bitmap;
+        job->state = JOB_DECODED;
+        async_push(&async_done, job);
+        al_broadcast_cond(async_cond);
+    }
+    async_unlock();
+
+    return NULL;
+}
+#endif
+
+/* decodes an image file into a memory bitmap. Returns NULL on failure */
+ALLEGRO_BITMAP* async_decode(const char* fullpath)
+{
+    ALLEGRO_STATE state;
+    ALLEGRO_BITMAP* bitmap;
+
+    al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+    al_set_new_bitmap_flags((al_get_new_bitmap_flags() & ~ALLEGRO_VIDEO_BITMAP) | ALLEGRO_MEMORY_BITMAP);
+    bitmap = al_load_bitmap(fullpath);
+    al_restore_state(&state);
+
+    return bitmap;
+}
+
+/* uploads a decoded image to the GPU and releases its job. Returns the number of uploaded pixels */
+int async_finish(imagejob_t* job)
+{
+    image_t* img = job->img;
+    int pixels = 0;
+
+    /* the image was destroyed while decoding */
+    if(img == NULL) {
+        if(job->bitmap != NULL)
+            al_destroy_bitmap(job->bitmap);
+        free(job->fullpath);
+        free(job);
+        return 0;
+    }
+
+    /* report failure the same way as image_load() */
+    if(job->bitmap == NULL) {
+        fatal_error("Failed to load image \"%s\"", job->fullpath);
+        return 0;
+    }
+
+    /* replace the placeholder */
+    al_destroy_bitmap(img->data);
+    img->data = job->bitmap;
+    img->job = NULL;
+
+    /* downscale before uploading, if needed */
+    downscale_loaded_image(img);
+
+    /* convert the memory bitmap to a video bitmap */
+    ALLEGRO_STATE state;
+    al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+    if(WANT_MANAGED_TEXTURES)
+        al_set_new_bitmap_flags(al_get_new_bitmap_flags() | ALLEGRO_NO_PRESERVE_TEXTURE);
+    al_convert_bitmap(img->data);
+    al_restore_state(&state);
+    setup_loaded_image(img, img->path);
+    pixels = img->w * img->h;
+
+    /* done */
+    logfile_message("Loaded image \"%s\"", job->fullpath);
+    free(job->fullpath);
+    free(job);
+    return pixels;
+}
+
+/* completes the asynchronous loading of an image right away */
+void async_wait(image_t* img)
+{
+    imagejob_t* job = img->job;
+
+    async_lock();
+    if(job->state == JOB_QUEUED) {
+        /* decode the image in this thread */
+        async_unlink(&async_queue, job);
+        async_unlock();
+
+        job->bitmap = async_decode(job->fullpath);
+        job->state = JOB_DECODED;
+    }
+    else {
+#if WANT_ASYNC_DECODING
+        /* wait for the decoder */
+        while(job->state != JOB_DECODED)
+            al_wait_cond(async_cond, async_mutex);
+#endif
+
+        async_unlink(&async_done, job);
+        async_unlock();
+    }
+
+    async_finish(job);
+}
+
+/* cancels the asynchronous loading of an image that is being destroyed */
+void async_cancel(image_t* img)
+{
+    imagejob_t* job = img->job;
+    img->job = NULL;
+
+    async_lock();
+    switch(job->state) {
+        case JOB_QUEUED:
+            async_unlink(&async_queue, job);
+            free(job->fullpath);
+            free(job);
+            break;
+
+        case JOB_DECODING:
+            /* the job will be discarded after decoding */
+            job->img = NULL;
+            break;
+
+        case JOB_DECODED:
+            async_unlink(&async_done, job);
+            if(job->bitmap != NULL)
+                al_destroy_bitmap(job->bitmap);
+            free(job->fullpath);
+            free(job);
+            break;
+    }
+    async_unlock();
+}
+
+/* appends a job to a list */
+void async_push(imagejob_t** list, imagejob_t* job)
+{
+    while(*list != NULL)
+        list = &((*list)->next);
+
+    job->next = NULL;
+    *list = job;
+}
+
+/* removes a job from a list. Returns true if the job was found */
+bool async_unlink(imagejob_t** list, imagejob_t* job)
+{
+    for(; *list != NULL; list = &((*list)->next)) {
+        if(*list == job) {
+            *list = job->next;
+            job->next = NULL;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* packs a bitmap into the texture atlas, returning a sub-bitmap of a page or NULL if it's not packed */
+ALLEGRO_BITMAP* atlas_pack(ALLEGRO_BITMAP* bmp, atlaspage_t** out_page)
+{
+    int width = al_get_bitmap_width(bmp);
+    int height = al_get_bitmap_height(bmp);
+    atlaspage_t* page;
+    int x = 0, y = 0;
+
+    /* only small video bitmaps are packed */
+    if(width > ATLAS_MAX_ENTRY_SIZE || height > ATLAS_MAX_ENTRY_SIZE)
+        return NULL;
+    else if(al_get_bitmap_flags(bmp) & ALLEGRO_MEMORY_BITMAP)
+        return NULL;
+
+    /* we can't change the drawing target while drawing is held */
+    if(al_is_bitmap_drawing_held())
+        return NULL;
+
+    /* find room in an existing page */
+    for(page = atlas; page != NULL; page = page->next) {
+        if(atlas_find_room(page, width + ATLAS_PADDING, height + ATLAS_PADDING, &x, &y))
+            break;
+    }
+
+    /* create a new page if necessary */
+    if(page == NULL) {
+        if(NULL == (page = atlas_create_page()))
+            return NULL;
+        else if(!atlas_find_room(page, width + ATLAS_PADDING, height + ATLAS_PADDING, &x, &y))
+            return NULL; /* this shouldn't happen */
+    }
+
+    /* copy the pixels to the page */
+    ALLEGRO_STATE state;
+    al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER);
+    al_set_target_bitmap(page->bitmap);
+    al_use_shader(NULL); /* don't apply the mask color */
+    al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO); /* exact copy */
+    al_draw_bitmap(bmp, x, y, 0);
+    al_restore_state(&state);
+
+    /* create a sub-bitmap */
+    ALLEGRO_BITMAP* sub = al_create_sub_bitmap(page->bitmap, x, y, width, height);
+    if(sub == NULL)
+        return NULL; /* the space is lost */
+
+    /* done */
+    page->ref_count++;
+    *out_page = page;
+    return sub;
+}
+
+/* releases a reference to a page, destroying it if it's no longer used */
+void atlas_unref(atlaspage_t* page)
+{
+    if(--page->ref_count > 0)
+        return;
+
+    /* remove the page from the list */
+    for(atlaspage_t** p = &atlas; *p != NULL; p = &((*p)->next)) {
+        if(*p == page) {
+            *p = page->next;
+            break;
+        }
+    }
+
+    /* destroy the page */
+    forget_lost_texture(page->bitmap);
+    resourcemanager_track_memory(RESOURCE_IMAGE, -bitmap_memory(page->bitmap));
+    al_destroy_bitmap(page->bitmap);
+    free(page);
+    atlas_page_count--;
+}
+
+/* finds room for a rectangle in a page using a shelf packing algorithm */
+bool atlas_find_room(atlaspage_t* page, int width, int height, int* x, int* y)
+{
+    atlasshelf_t* best = NULL;
+
+    /* find the shelf with the least wasted height */
+    for(int i = 0; i < page->shelf_count; i++) {
+        atlasshelf_t* shelf = &page->shelf[i];
+
+        if(shelf->height >= height && shelf->x + width <= ATLAS_PAGE_SIZE) {
+            if(best == NULL || shelf->height < best->height)
+                best = shelf;
+        }
+    }
+
+    /* open a new shelf if the best one would waste too much space */
+    if(best == NULL || best->height > 2 * height) {
+        const atlasshelf_t* last = (page->shelf_count > 0) ? &page->shelf[page->shelf_count - 1] : NULL;
+        int top = (last != NULL) ? last->y + last->height : 0;
+
+        if(page->shelf_count < ATLAS_MAX_SHELVES && top + height <= ATLAS_PAGE_SIZE) {
+            best = &page->shelf[page->shelf_count++];
+            best->y = top;
+            best->height = height;
+            best->x = 0;
+        }
+        else if(best == NULL)
+            return false;
+    }
+
+    /* use the shelf */
+    *x = best->x;
+    *y = best->y;
+    best->x += width;
+    return true;
+}
+
+/* creates a new page of the atlas */
+atlaspage_t* atlas_create_page()
+{
+    if(atlas_page_count >= ATLAS_MAX_PAGES)
+        return NULL;
+
+    /* create a video bitmap without filtering. Its images restore it */
+    ALLEGRO_STATE state;
+    al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS | ALLEGRO_STATE_TARGET_BITMAP);
+    al_set_new_bitmap_flags(ALLEGRO_VIDEO_BITMAP | (WANT_MANAGED_TEXTURES ? ALLEGRO_NO_PRESERVE_TEXTURE : 0));
+    ALLEGRO_BITMAP* bmp = al_create_bitmap(ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+    if(bmp != NULL) {
+        al_set_target_bitmap(bmp);
+        al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+    }
+    al_restore_state(&state);
+
+    if(bmp == NULL) {
+        logfile_message("WARNING: can't create a page of the texture atlas");
+        return NULL;
+    }
+    resourcemanager_track_memory(RESOURCE_IMAGE, bitmap_memory(bmp));
+
+    /* add the page to the list */
+    atlaspage_t* page = mallocx(sizeof *page);
+    page->bitmap = bmp;
+    page->shelf_count = 0;
+    page->ref_count = 0;
+    page->next = atlas;
+    atlas = page;
+    atlas_page_count++;
+
+    logfile_message("Created page %d of the texture atlas", atlas_page_count);
+    return page;
+}
+
+/* the bitmap to be drawn and its offset in image space, given the flip flags */
+ALLEGRO_BITMAP* visible_bitmap(const image_t* img, int flags, int* offset_x, int* offset_y)
+{
+    restore_if_lost(img->data);
+
+    if(img->trimmed == NULL) {
+        *offset_x = *offset_y = 0;
+        return img->data;
+    }
+
+    /* flipping mirrors the position of the trimmed sub-bitmap */
+    int width = al_get_bitmap_width(img->data), height = al_get_bitmap_height(img->data);
+    *offset_x = img->texel_size * ((flags & IF_HFLIP) ? width - (img->trim_x + al_get_bitmap_width(img->trimmed)) : img->trim_x);
+    *offset_y = img->texel_size * ((flags & IF_VFLIP) ? height - (img->trim_y + al_get_bitmap_height(img->trimmed)) : img->trim_y);
+
+    return img->trimmed;
+}
+
+/* draws a bitmap of an image with its size in image space */
+void draw_tinted_bitmap(const image_t* img, ALLEGRO_BITMAP* bmp, ALLEGRO_COLOR tint, int x, int y, int flags)
+{
+    if(img->texel_size == 1) {
+        al_draw_tinted_bitmap(bmp, tint, x, y, flags);
+        return;
+    }
+
+    int w = al_get_bitmap_width(bmp), h = al_get_bitmap_height(bmp);
+    al_draw_tinted_scaled_bitmap(bmp, tint, 0.0f, 0.0f, w, h, x, y, w * img->texel_size, h * img->texel_size, flags);
+}
+
+/* converts a coordinate in image space to texels */
+int to_texels(const image_t* img, int x)
+{
+    return x / img->texel_size;
+}
+
+/* finds the opaque pixels of a sequence of pixels in LOCKED_FORMAT. Writes 1
+   to out[i] if the i-th pixel is opaque, or 0 if it's transparent. A pixel is
+   transparent if its alpha is zero or if it's bright pink (the mask color) */
+void find_opaque_pixels(const uint8_t* pixels, int count, uint8_t* out)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    /* 8 pixels at a time. Read as little-endian 32-bit words, the
+       pixels are 0xAABBGGRR; bright pink is 0x??FF00FF */
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i pink = _mm_set1_epi32(0x00FF00FF);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+
+    for(; i + 8 <= count; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(pixels + 4 * i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(pixels + 4 * i + 16));
+        __m128i ta = _mm_or_si128(_mm_cmpeq_epi32(_mm_and_si128(a, alpha), zero), _mm_cmpeq_epi32(_mm_and_si128(a, rgb), pink));
+        __m128i tb = _mm_or_si128(_mm_cmpeq_epi32(_mm_and_si128(b, alpha), zero), _mm_cmpeq_epi32(_mm_and_si128(b, rgb), pink));
+        __m128i transparent = _mm_packs_epi16(_mm_packs_epi32(ta, tb), zero); /* 0xFF if transparent, 0 otherwise */
+        _mm_storel_epi64((__m128i*)(out + i), _mm_andnot_si128(transparent, one));
+    }
+#elif defined(__ARM_NEON)
+    /* 8 pixels at a time, deinterleaved into R, G, B, A lanes */
+    const uint8x8_t zero = vdup_n_u8(0);
+    const uint8x8_t full = vdup_n_u8(255);
+    const uint8x8_t one = vdup_n_u8(1);
+
+    for(; i + 8 <= count; i += 8) {
+        uint8x8x4_t px = vld4_u8(pixels + 4 * i);
+        uint8x8_t is_pink = vand_u8(vand_u8(vceq_u8(px.val[0], full), vceq_u8(px.val[1], zero)), vceq_u8(px.val[2], full));
+        uint8x8_t transparent = vorr_u8(vceq_u8(px.val[3], zero), is_pink);
+        vst1_u8(out + i, vbic_u8(one, transparent));
+    }
+#endif
+
+    /* remaining pixels */
+    for(; i < count; i++) {
+        const uint8_t* p = pixels + 4 * i;
+        bool is_pink = (p[0] == 255 && p[1] == 0 && p[2] == 255);
+        out[i] = (p[3] != 0 && !is_pink);
+    }
+}
+
+/* loads a downscaled variant of an image, pre-generated or cached, if the
+   texture detail requires it. Returns NULL if there is no such variant */
+ALLEGRO_BITMAP* load_downscaled(const char* path)
+{
+    char variant_path[1024], cache_path[1024];
+    ALLEGRO_BITMAP* bmp = NULL;
+    ALLEGRO_STATE state;
+
+    if(resourcemanager_texture_detail() != TEXTUREDETAIL_HALF)
+        return NULL;
+
+    /* pre-generated variant */
+    if(downscaled_variant(path, variant_path, sizeof(variant_path)) != NULL) {
+        if(NULL != (bmp = al_load_bitmap(asset_path(variant_path))))
+            logfile_message("Using the downscaled image \"%s\"", variant_path);
+        else
+            logfile_message("WARNING: can't load \"%s\". Using \"%s\" instead", variant_path, path);
+
+        return bmp;
+    }
+
+    /* downscaled previously */
+    if(*downscaled_cache_path(path, cache_path, sizeof(cache_path)) == '\0')
+        return NULL;
+
+    al_store_state(&state, ALLEGRO_STATE_NEW_FILE_INTERFACE);
+    al_set_standard_file_interface();
+    bmp = al_load_bitmap(cache_path); /* NULL if not cached */
+    al_restore_state(&state);
+
+    if(bmp != NULL)
+        logfile_message("Using the downscaled image at \"%s\"", cache_path);
+
+    return bmp;
+}
+
+/* downscales the bitmap of a large image that has just been loaded at full
+   resolution, if the texture detail requires it, and caches the result */
+void downscale_loaded_image(image_t* img)
+{
+    char cache_path[1024];
+    ALLEGRO_BITMAP* downscaled;
+    ALLEGRO_STATE state;
+
+    if(resourcemanager_texture_detail() != TEXTUREDETAIL_HALF || img->texel_size != 1)
+        return;
+    else if(al_get_bitmap_width(img->data) < LOD_MIN_SIZE && al_get_bitmap_height(img->data) < LOD_MIN_SIZE)
+        return;
+
+    /* compressed textures are kept as they are */
+    int format = al_get_bitmap_format(img->data);
+    if(format == ALLEGRO_PIXEL_FORMAT_COMPRESSED_RGBA_DXT1 || format == ALLEGRO_PIXEL_FORMAT_COMPRESSED_RGBA_DXT3 || format == ALLEGRO_PIXEL_FORMAT_COMPRESSED_RGBA_DXT5)
+        return;
+
+    if(NULL == (downscaled = downscale(img->data))) {
+        logfile_message("WARNING: can't downscale image \"%s\"", img->path != NULL ? img->path : "");
+        return;
+    }
+
+    /* the cache stores non-premultiplied alpha, as any PNG file */
+    if(img->path != NULL && *downscaled_cache_path(img->path, cache_path, sizeof(cache_path)) != '\0') {
+        al_store_state(&state, ALLEGRO_STATE_NEW_FILE_INTERFACE);
+        al_set_standard_file_interface();
+        if(!al_save_bitmap(cache_path, downscaled))
+            logfile_message("WARNING: can't cache the downscaled image at \"%s\"", cache_path);
+        al_restore_state(&state);
+    }
+
+    /* premultiply alpha, as al_load_bitmap() does */
+    ALLEGRO_LOCKED_REGION* region = al_lock_bitmap(downscaled, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READWRITE);
+    int width = al_get_bitmap_width(downscaled), height = al_get_bitmap_height(downscaled);
+    for(int y = 0; y < height && region != NULL; y++) {
+        uint8_t* p = (uint8_t*)region->data + y * region->pitch;
+        for(int x = 0; x < width; x++, p += 4) {
+            p[0] = (p[0] * p[3] + 127) / 255;
+            p[1] = (p[1] * p[3] + 127) / 255;
+            p[2] = (p[2] * p[3] + 127) / 255;
+        }
+    }
+    if(region != NULL)
+        al_unlock_bitmap(downscaled);
+
+    /* keep the kind of the original bitmap (video or memory) */
+    al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+    al_set_new_bitmap_flags(al_get_bitmap_flags(img->data));
+    al_convert_bitmap(downscaled);
+    al_restore_state(&state);
+
+    logfile_message("Downscaled image \"%s\" to %dx%d", img->path != NULL ? img->path : "", width, height);
+    al_destroy_bitmap(img->data);
+    img->data = downscaled;
+    img->texel_size = 2;
+}
+
+/* downscales a bitmap by a factor of two using a box filter. The input has
+   premultiplied alpha; the output is a memory bitmap with straight alpha */
+ALLEGRO_BITMAP* downscale(ALLEGRO_BITMAP* bmp)
+{
+    ALLEGRO_STATE state;
+    ALLEGRO_BITMAP* downscaled;
+    int width = al_get_bitmap_width(bmp), height = al_get_bitmap_height(bmp);
+    int half_width = (width + 1) / 2, half_height = (height + 1) / 2;
+
+    al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+    al_set_new_bitmap_flags((al_get_new_bitmap_flags() & ~ALLEGRO_VIDEO_BITMAP) | ALLEGRO_MEMORY_BITMAP);
+    al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE);
+    downscaled = al_create_bitmap(half_width, half_height);
+    al_restore_state(&state);
+
+    if(downscaled == NULL)
+        return NULL;
+
+    ALLEGRO_LOCKED_REGION* src = al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY);
+    ALLEGRO_LOCKED_REGION* dst = al_lock_bitmap(downscaled, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+    if(src == NULL || dst == NULL) {
+        if(src != NULL)
+            al_unlock_bitmap(bmp);
+        al_destroy_bitmap(downscaled);
+        return NULL;
+    }
+
+    for(int y = 0; y < half_height; y++) {
+        uint8_t* q = (uint8_t*)dst->data + y * dst->pitch;
+        for(int x = 0; x < half_width; x++, q += 4) {
+            int sum[4] = { 0, 0, 0, 0 }, n = 0;
+
+            /* average the 2x2 block, clipped to the bitmap */
+            for(int j = 2*y; j < min(2*y + 2, height); j++) {
+                const uint8_t* p = (const uint8_t*)src->data + j * src->pitch + 2*x * 4;
+                for(int i = 2*x; i < min(2*x + 2, width); i++, p += 4, n++) {
+                    sum[0] += p[0];
+                    sum[1] += p[1];
+                    sum[2] += p[2];
+                    sum[3] += p[3];
+                }
+            }
+
+            /* un-premultiply */
+            q[3] = (sum[3] + n/2) / n;
+            for(int c = 0; c < 3; c++)
+                q[c] = sum[3] > 0 ? min(255, (sum[c] * 255 + sum[3]/2) / sum[3]) : 0;
+        }
+    }
+
+    al_unlock_bitmap(downscaled);
+    al_unlock_bitmap(bmp);
+    return downscaled;
+}
+
+/* decodes the original file of an image into a memory bitmap */
+ALLEGRO_BITMAP* load_original_pixels(const char* path)
+{
+    ALLEGRO_STATE state;
+    ALLEGRO_BITMAP* bmp;
+
+    al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+    al_set_new_bitmap_flags((al_get_new_bitmap_flags() & ~ALLEGRO_VIDEO_BITMAP) | ALLEGRO_MEMORY_BITMAP);
+    bmp = al_load_bitmap(asset_path(path));
+    al_restore_state(&state);
+
+    if(bmp == NULL)
+        logfile_message("WARNING: can't read the original pixels of \"%s\"", path);
+
+    return bmp;
+}
+
+/* the virtual path of the pre-generated downscaled variant of an image, if
+   it should be used. Returns NULL if the texture detail is full or if there
+   is no such variant. Example: images/foo.png -> images/foo@0.5x.png */
+const char* downscaled_variant(const char* path, char* buffer, size_t buffer_size)
+{
+    if(resourcemanager_texture_detail() != TEXTUREDETAIL_HALF)
+        return NULL;
+
+    const char* dot = strrchr(path, '.');
+    const char* slash = strrchr(path, '/');
+    int length = (dot != NULL && (slash == NULL || dot > slash)) ? (int)(dot - path) : (int)strlen(path);
+
+    snprintf(buffer, buffer_size, "%.*s" LOD_VARIANT_SUFFIX "%s", length, path, path + length);
+    return asset_exists(buffer) ? buffer : NULL;
+}
+
+/* the absolute path of the cached downscaled variant of an image. The name
+   of the file depends on the modification time and on the size of the
+   original, so that stale variants are not used. Returns an empty string
+   if there is no application cache */
+const char* downscaled_cache_path(const char* path, char* buffer, size_t buffer_size)
+{
+    char relative_path[64];
+    uint64_t hash = 5381;
+    ALLEGRO_FS_ENTRY* entry;
+
+    /* djb2 */
+    for(const char* p = path; *p; p++)
+        hash = ((hash << 5) + hash) ^ (unsigned char)(*p);
+
+    if(NULL != (entry = al_create_fs_entry(asset_path(path)))) {
+        hash = ((hash << 5) + hash) ^ (uint64_t)al_get_fs_entry_mtime(entry);
+        hash = ((hash << 5) + hash) ^ (uint64_t)al_get_fs_entry_size(entry);
+        al_destroy_fs_entry(entry);
+    }
+
+    snprintf(relative_path, sizeof(relative_path), LOD_CACHE_DIR "%016llx.png", (unsigned long long)hash);
+    return asset_cache_path(relative_path, buffer, buffer_size);
+}
+
+
+
+/* holds a line of the primitive accumulator */
+void hold_line(float x1, float y1, float x2, float y2, ALLEGRO_COLOR color)
+{
+    if(line_vertex_count + 2 > PRIMITIVE_MAX_VERTICES)
+        flush_primitives();
+
+    line_vertex[line_vertex_count++] = (ALLEGRO_VERTEX){ .x = x1, .y = y1, .color = color };
+    line_vertex[line_vertex_count++] = (ALLEGRO_VERTEX){ .x = x2, .y = y2, .color = color };
+}
+
+/* holds a filled triangle of the primitive accumulator */
+void hold_triangle(float x1, float y1, float x2, float y2, float x3, float y3, ALLEGRO_COLOR color)
+{
+    if(fill_vertex_count + 3 > PRIMITIVE_MAX_VERTICES)
+        flush_primitives();
+
+    fill_vertex[fill_vertex_count++] = (ALLEGRO_VERTEX){ .x = x1, .y = y1, .color = color };
+    fill_vertex[fill_vertex_count++] = (ALLEGRO_VERTEX){ .x = x2, .y = y2, .color = color };
+    fill_vertex[fill_vertex_count++] = (ALLEGRO_VERTEX){ .x = x3, .y = y3, .color = color };
+}
+
+/* holds an ellipse of the primitive accumulator, tessellated
+   with as many segments as Allegro would use to draw it */
+void hold_ellipse(float cx, float cy, float rx, float ry, ALLEGRO_COLOR color, bool filled)
+{
+    if(rx <= 0.0f && ry <= 0.0f)
+        return;
+
+    int segments = clip((int)(10.0f * sqrtf(0.5f * (rx + ry))), 8, 256);
+    float c = cosf(2.0f * ALLEGRO_PI / segments), s = sinf(2.0f * ALLEGRO_PI / segments);
+    float ux = 1.0f, uy = 0.0f; /* a unit vector rotated by each segment */
+
+    for(int i = 0; i < segments; i++) {
+        float vx = ux * c - uy * s, vy = ux * s + uy * c;
+
+        if(filled)
+            hold_triangle(cx, cy, cx + rx * ux, cy + ry * uy, cx + rx * vx, cy + ry * vy, color);
+        else
+            hold_line(cx + rx * ux, cy + ry * uy, cx + rx * vx, cy + ry * vy, color);
+
+        ux = vx;
+        uy = vy;
+    }
+}
+
+/* draws the primitives held by the accumulator */
+void flush_primitives()
+{
+    if(fill_vertex_count > 0) {
+        al_draw_prim(fill_vertex, NULL, NULL, 0, fill_vertex_count, ALLEGRO_PRIM_TRIANGLE_LIST);
+        fill_vertex_count = 0;
+    }
+
+    if(line_vertex_count > 0) {
+        al_draw_prim(line_vertex, NULL, NULL, 0, line_vertex_count, ALLEGRO_PRIM_LINE_LIST);
+        line_vertex_count = 0;
+    }
+}
@@ -58,27 +58,45 @@ void image_destroy(image_t* img); /* call this after image_create() */
 image_t* image_load(const char* path); /* will be unloaded automatically */
 int image_unload(const image_t* img); /* use if you want to save memory... */
 
+/* asynchronous loading */
+image_t* image_load_async(const char* path); /* shows a placeholder until the image is ready */
+bool image_is_ready(const image_t* img); /* has the image finished loading? */
+void image_update_async(); /* uploads decoded images to the GPU; call once per frame */
+void image_release_async(); /* call after releasing the resource manager */
+
+/* recycling of render targets */
+void image_release_pool(); /* call after releasing the resource manager */
+
+/* lost textures */
+void image_restore_all(); /* call after the display resumes drawing */
+
 /* utilities */
 int image_width(const image_t* img); /* the width of the image */
 int image_height(const image_t* img); /* the height of the image */
 void image_save(const image_t* img, const char *path); /* saves the image to a file */
 image_t* image_clone(const image_t* src); /* clones an image */
+image_t* image_load_cached(const char* relative_path); /* loads an image stored in the application cache; NULL if not cached */
+bool image_save_cached(const image_t* img, const char* relative_path); /* stores an image in the application cache */
 void image_enable_linear_filtering(image_t* img); /* enable linear filtering */
 void image_disable_linear_filtering(image_t* img); /* disable linear filtering */
 const char* image_filepath(const image_t* img); /* relative path of the originating file, if defined */
 texturehandle_t image_texture(const image_t* img); /* get texture handle */
+void image_texture_region(const image_t* img, int* x, int* y, int* width, int* height); /* the rectangle of the texture that stores the image, in texels; the origin is at the bottom-left */
+void image_trim(image_t* img, int x, int y, int width, int height); /* draw only the rectangle that encloses the visible pixels */
 
 /* pixel manipulation */
 void image_lock(image_t* img, const char* mode);
 void image_unlock(image_t* img);
 bool image_is_locked(const image_t* img);
 color_t image_getpixel(const image_t* img, int x, int y);
+bool image_read_opaque_row(const image_t* img, int x, int y, int width, uint8_t* out); /* fast; returns false if it can't read the row */
 void image_putpixel(int x, int y, color_t color);
 
 /* drawing target */
 void image_set_drawing_target(image_t* new_target);
 image_t* image_drawing_target();
 void image_hold_drawing(bool hold);
+void image_hold_primitives(bool hold); /* accumulate lines, rectangles and ellipses and draw them in bulk */
 
 /* drawing primitives */
 void image_clear(color_t color);
@@ -90,6 +108,7 @@ void image_rectfill(int x1, int y1, int x2, int y2, color_t color);
 
 /* rendering */
 void image_blit(const image_t* src, int src_x, int src_y, int dest_x, int dest_y, int width, int height);
+void image_blit_scaled(const image_t* src, int src_x, int src_y, int src_width, int src_height, int dest_x, int dest_y, int dest_width, int dest_height);
 void image_draw(const image_t* src, int x, int y, int flags);
 void image_draw_scaled(const image_t* src, int x, int y, v2d_t scale, int flags);
 void image_draw_scaled_trans(const image_t* src, int x, int y, v2d_t scale, float alpha, int flags);
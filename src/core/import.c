@@ -28,7 +28,9 @@
 #include "import.h"
 #include "global.h"
 #include "asset.h"
+#include "../util/util.h"
 #include "../util/stringutil.h"
+#include "../util/fasthash.h"
 
 /*
 
@@ -59,6 +61,7 @@ the directory of the executable (which is the default behavior). Simply put,
 
 /* utility macros */
 #define IMPORT_LOGFILE_NAME         "import_log.txt"
+#define MANIFEST_FILE_NAME          "import_hashes.txt" /* hashes of the imported files */
 #define ENVIRONMENT_VARIABLE_NAME   "OPENSURGE_USER_PATH" /* FIXME: duplicated string from asset.c */
 
 #define DRY_RUN                     0 /* don't actually copy any files; for testing purposes only */
@@ -144,6 +147,7 @@ static const char* BLACKLIST[] = {
     EXACT("opensurge"),
     EXACT("logfile.txt"),
     EXACT(IMPORT_LOGFILE_NAME),
+    EXACT(MANIFEST_FILE_NAME),
     EXACT("surge.rocks"),
 
     EXACT("CMakeLists.txt"),
@@ -271,6 +275,49 @@ static ALLEGRO_FILE* close_import_logfile(ALLEGRO_FILE* fp);
 static ALLEGRO_FILE* import_logfile = NULL;
 static ALLEGRO_TEXTLOG* textlog = NULL;
 
+/*
+
+   pipelined copying
+
+   Scanning src/ and deciding what to import is done in the calling thread,
+   as the user may be asked questions. The files are copied by worker threads
+   that take jobs from a bounded queue. A manifest stored in dest/ keeps the
+   hashes of the imported files, so that importing the same game again skips
+   the files that haven't changed on either side.
+
+*/
+#define MAX_WORKERS                 4
+#define MAX_QUEUED_JOBS             64
+
+typedef struct importjob_t importjob_t;
+struct importjob_t {
+    char* src_path; /* absolute path */
+    char* dest_path; /* absolute path */
+    char* vpath; /* relative path with '/' as the separator */
+    const uint64_t* previous_hash; /* hash of the file as of the previous import, if any */
+    importjob_t* next;
+};
+
+static importjob_t* job_queue = NULL; /* FIFO */
+static importjob_t* job_queue_tail = NULL;
+static int queued_jobs = 0, total_jobs = 0, finished_jobs = 0, unchanged_files = 0;
+static int copy_error_count = 0;
+static bool is_scanning_done = false;
+static ALLEGRO_MUTEX* job_mutex = NULL;
+static ALLEGRO_COND* job_cond = NULL; /* signaled whenever the state of the jobs changes */
+static ALLEGRO_THREAD* worker[MAX_WORKERS];
+static int worker_count = 0;
+static fasthash_t* old_manifest = NULL; /* hash of vpath -> hash of the file, as of the previous import */
+static ALLEGRO_FILE* new_manifest = NULL;
+
+static void start_workers(const char* dest_dir);
+static void stop_workers();
+static void enqueue_job(const char* src_path, const char* dest_path, const char* vpath);
+static void run_job(importjob_t* job);
+static void* worker_thread(ALLEGRO_THREAD* thread, void* arg);
+static bool hash_file(const char* path, uint64_t* hash);
+static uint64_t hash_string(const char* str);
+
 
 
 
@@ -661,9 +708,13 @@ int import_files(ALLEGRO_FS_ENTRY* dest, ALLEGRO_FS_ENTRY* src)
     ALLEGRO_PATH* src_path = al_create_path_for_directory(src_dir);
     ALLEGRO_PATH* dest_path = al_create_path_for_directory(dest_dir);
 
-    /* call import_file() for each entry of the src folder */
-    void* extra[] = { src_path, dest_path, &error_count };
+    /* call import_file() for each entry of the src folder.
+       The files are copied in the background */
+    void* extra[] = { src_path, dest_path };
+    start_workers(dest_dir);
     my_for_each_fs_entry(src, import_file, extra);
+    stop_workers();
+    error_count += copy_error_count;
 
     /* clean up */
     al_destroy_path(dest_path);
@@ -678,7 +729,6 @@ int import_file(ALLEGRO_FS_ENTRY* e, void* extra)
 {
     const ALLEGRO_PATH* src_path = (ALLEGRO_PATH*)(((void**)extra)[0]);
     const ALLEGRO_PATH* dest_path = (ALLEGRO_PATH*)(((void**)extra)[1]);
-    int* error_count = (int*)(((void**)extra)[2]);
     int result = ALLEGRO_FOR_EACH_FS_ENTRY_OK; /* continue iteration */
 
     /* find e_path, the absolute path of the current entry e */
@@ -745,16 +795,8 @@ int import_file(ALLEGRO_FS_ENTRY* e, void* extra)
         }
 
         /* import the file */
-        if(import) {
-            ALLEGRO_FS_ENTRY* d = al_create_fs_entry(al_path_cstr(d_path, ALLEGRO_NATIVE_PATH_SEP));
-
-            if(!copy_file(d, e)) {
-                PRINT("!   ERROR: can't copy %s", vpath);
-                ++(*error_count);
-            }
-
-            al_destroy_fs_entry(d);
-        }
+        if(import)
+            enqueue_job(al_get_fs_entry_name(e), al_path_cstr(d_path, ALLEGRO_NATIVE_PATH_SEP), vpath);
 
     }
     else {
@@ -921,6 +963,251 @@ bool copy_file(ALLEGRO_FS_ENTRY* dest, ALLEGRO_FS_ENTRY* src)
 #endif
 }
 
+/* loads the manifest of the previous import and starts the worker threads */
+void start_workers(const char* dest_dir)
+{
+    ALLEGRO_PATH* path = al_create_path_for_directory(dest_dir);
+    al_set_path_filename(path, MANIFEST_FILE_NAME);
+    const char* manifest_path = al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP);
+
+    /* load the manifest: "file_hash path_hash vpath" per line */
+    old_manifest = fasthash_create(free, 10);
+    ALLEGRO_FILE* fp = al_fopen(manifest_path, "r");
+    if(fp != NULL) {
+        char line[PATH_MAXSIZE + 64];
+        unsigned long long file_hash, path_hash;
+
+        while(al_fgets(fp, line, sizeof(line)) != NULL) {
+            if(2 == sscanf(line, "%16llx %16llx", &file_hash, &path_hash)) {
+                uint64_t* value = mallocx(sizeof *value);
+                *value = file_hash;
+                fasthash_put(old_manifest, path_hash, value);
+            }
+        }
+
+        al_fclose(fp);
+    }
+
+    /* the new manifest records the files imported now */
+    new_manifest = (DRY_RUN) ? NULL : al_fopen(manifest_path, "w");
+    al_destroy_path(path);
+
+    /* start the workers. If we can't, the files are copied in this thread */
+    job_queue = job_queue_tail = NULL;
+    queued_jobs = total_jobs = finished_jobs = unchanged_files = 0;
+    copy_error_count = 0;
+    is_scanning_done = false;
+    job_mutex = al_create_mutex();
+    job_cond = al_create_cond();
+
+    for(worker_count = 0; worker_count < MAX_WORKERS && job_mutex != NULL && job_cond != NULL; worker_count++) {
+        if(NULL == (worker[worker_count] = al_create_thread(worker_thread, NULL)))
+            break;
+        al_start_thread(worker[worker_count]);
+    }
+}
+
+/* waits for the pending jobs, reporting progress, and stops the worker threads */
+void stop_workers()
+{
+    if(worker_count > 0) {
+        int reported_progress = -1;
+
+        al_lock_mutex(job_mutex);
+        is_scanning_done = true;
+        al_broadcast_cond(job_cond);
+
+        while(finished_jobs < total_jobs) {
+            int progress = (100 * finished_jobs) / total_jobs;
+            if(progress / 10 != reported_progress / 10) {
+                PRINT("    Copying files... %d%% (%d of %d)", progress, finished_jobs, total_jobs);
+                reported_progress = progress;
+            }
+
+            al_wait_cond(job_cond, job_mutex);
+        }
+
+        al_unlock_mutex(job_mutex);
+
+        for(int i = 0; i < worker_count; i++) {
+            al_join_thread(worker[i], NULL);
+            al_destroy_thread(worker[i]);
+        }
+        worker_count = 0;
+    }
+
+    if(unchanged_files > 0)
+        PRINT("    %d files haven't changed since the previous import", unchanged_files);
+
+    /* clean up */
+    if(job_cond != NULL)
+        al_destroy_cond(job_cond);
+    if(job_mutex != NULL)
+        al_destroy_mutex(job_mutex);
+    job_cond = NULL;
+    job_mutex = NULL;
+
+    if(new_manifest != NULL)
+        al_fclose(new_manifest);
+    new_manifest = NULL;
+    old_manifest = fasthash_destroy(old_manifest);
+}
+
+/* adds a file to be copied to the queue, waiting if it's full */
+void enqueue_job(const char* src_path, const char* dest_path, const char* vpath)
+{
+    importjob_t* job = mallocx(sizeof *job);
+    job->src_path = str_dup(src_path);
+    job->dest_path = str_dup(dest_path);
+    job->vpath = str_dup(vpath);
+    job->previous_hash = fasthash_get(old_manifest, hash_string(vpath)); /* not thread-safe */
+    job->next = NULL;
+
+    /* no workers */
+    if(worker_count == 0) {
+        total_jobs++;
+        run_job(job);
+        return;
+    }
+
+    al_lock_mutex(job_mutex);
+
+    while(queued_jobs >= MAX_QUEUED_JOBS)
+        al_wait_cond(job_cond, job_mutex);
+
+    if(job_queue_tail != NULL)
+        job_queue_tail->next = job;
+    else
+        job_queue = job;
+    job_queue_tail = job;
+
+    queued_jobs++;
+    total_jobs++;
+    al_broadcast_cond(job_cond);
+
+    al_unlock_mutex(job_mutex);
+}
+
+/* copies a file, unless it's the same as in the previous import, and releases the job */
+void run_job(importjob_t* job)
+{
+    uint64_t src_hash = 0, dest_hash = 0;
+    bool unchanged = false, success = true;
+
+    /* skip files that haven't changed on either side */
+    if(hash_file(job->src_path, &src_hash)) {
+        unchanged = job->previous_hash != NULL && *(job->previous_hash) == src_hash &&
+                    hash_file(job->dest_path, &dest_hash) && dest_hash == src_hash;
+    }
+    else
+        success = false;
+
+    /* copy the file */
+    if(success && !unchanged) {
+        ALLEGRO_FS_ENTRY* s = al_create_fs_entry(job->src_path);
+        ALLEGRO_FS_ENTRY* d = al_create_fs_entry(job->dest_path);
+
+        success = copy_file(d, s);
+
+        al_destroy_fs_entry(d);
+        al_destroy_fs_entry(s);
+    }
+
+    /* report */
+    if(job_mutex != NULL)
+        al_lock_mutex(job_mutex);
+
+    if(!success) {
+        PRINT("!   ERROR: can't copy %s", job->vpath);
+        copy_error_count++;
+    }
+    else {
+        unchanged_files += unchanged ? 1 : 0;
+        if(new_manifest != NULL)
+            al_fprintf(new_manifest, "%016llx %016llx %s\n", (unsigned long long)src_hash, (unsigned long long)hash_string(job->vpath), job->vpath);
+    }
+
+    finished_jobs++;
+
+    if(job_mutex != NULL) {
+        al_broadcast_cond(job_cond);
+        al_unlock_mutex(job_mutex);
+    }
+
+    /* release the job */
+    free(job->vpath);
+    free(job->dest_path);
+    free(job->src_path);
+    free(job);
+}
+
+/* a worker thread copies the files of the queue */
+void* worker_thread(ALLEGRO_THREAD* thread, void* arg)
+{
+    for(;;) {
+        importjob_t* job;
+
+        /* take a job */
+        al_lock_mutex(job_mutex);
+
+        while(job_queue == NULL && !is_scanning_done)
+            al_wait_cond(job_cond, job_mutex);
+
+        if(NULL != (job = job_queue)) {
+            if(NULL == (job_queue = job->next))
+                job_queue_tail = NULL;
+
+            queued_jobs--;
+            al_broadcast_cond(job_cond);
+        }
+
+        al_unlock_mutex(job_mutex);
+
+        /* there are no more jobs */
+        if(job == NULL)
+            break;
+
+        run_job(job);
+    }
+
+    (void)thread;
+    (void)arg;
+    return NULL;
+}
+
+/* computes the FNV-1a hash of the contents of a file */
+bool hash_file(const char* path, uint64_t* hash)
+{
+    ALLEGRO_FILE* fp = al_fopen(path, "rb");
+    if(fp == NULL)
+        return false;
+
+    unsigned char buffer[4096];
+    size_t num_bytes;
+    *hash = UINT64_C(14695981039346656037);
+
+    while(0 < (num_bytes = al_fread(fp, buffer, sizeof(buffer)))) {
+        for(size_t i = 0; i < num_bytes; i++)
+            *hash = (*hash ^ buffer[i]) * UINT64_C(1099511628211);
+    }
+
+    bool success = !al_ferror(fp);
+    al_fclose(fp);
+
+    return success;
+}
+
+/* computes the FNV-1a hash of a string */
+uint64_t hash_string(const char* str)
+{
+    uint64_t hash = UINT64_C(14695981039346656037);
+
+    while(*str)
+        hash = (hash ^ (unsigned char)(*str++)) * UINT64_C(1099511628211);
+
+    return hash;
+}
+
 /* create a directory (and parent directories, if needed) to store a file */
 bool make_directory_for_file(ALLEGRO_FS_ENTRY* e)
 {
@@ -19,6 +19,8 @@
  */
 
 #include <allegro5/allegro.h>
+#include <stdio.h>
+#include <string.h>
 #include "input.h"
 #include "engine.h"
 #include "video.h"
@@ -34,7 +36,7 @@
 struct input_t {
     bool enabled; /* is this input object enabled? */
     bool blocked; /* is this input object blocked for user input? */
-    bool state[IB_MAX], oldstate[IB_MAX]; /* state of the buttons */
+    uint32_t state, oldstate; /* state of the buttons: bit i is set if button i is down */
     void (*update)(input_t*); /* update method */
 };
 
@@ -58,6 +60,7 @@ struct inputuserdefined_t {
     const inputmap_t *inputmap; /* input mapping */
 };
 static void inputuserdefined_update(input_t* in);
+static uint32_t derive_state(const inputmap_t* im);
 
 /* list of inputs */
 typedef struct input_list_t input_list_t;
@@ -68,9 +71,21 @@ struct input_list_t {
 
 
 
+/* bit vectors of buttons */
+#define BUTTON_BIT(button) (UINT32_C(1) << (button)) /* IB_MAX <= 32 */
+
 /* keyboard input */
 static bool a5_key[ALLEGRO_KEY_MAX] = { false };
 
+/* the state of the buttons of each input map is derived once per framestep
+   and shared by all user-defined inputs that refer to the same map */
+#define MAX_DERIVED_STATES 8
+static struct {
+    const inputmap_t* inputmap;
+    uint32_t state;
+} derived_state[MAX_DERIVED_STATES];
+static int derived_state_count = 0;
+
 /* mouse input */
 #define LEFT_MOUSE_BUTTON   1 /* primary button, 1 << 0 */
 #define RIGHT_MOUSE_BUTTON  2 /* secondary button, 1 << 1 */
@@ -98,6 +113,9 @@ static joystick_input_t *wanted_joy[MAX_JOYS];
 
 static bool ignore_joystick = false;
 
+/* mobile gamepad input, read once per framestep */
+static mobilegamepad_state_t mobile_state = { 0 };
+
 /* dead-zone for analog input */
 static const float DEADZONE_THRESHOLD = 0.2f;
 
@@ -122,6 +140,56 @@ static void refresh_joystick_pool();
 static void clear_joystick_pool();
 static int joystick_pool_size();
 
+/* input replays: we record the raw input and the timing of each framestep,
+   so that the input objects behave exactly the same way on playback */
+#define REPLAY_MAGIC        "OSIR"
+#define REPLAY_VERSION      1
+enum {
+    REPLAY_DELTA        = 0x01, /* the delta time has changed */
+    REPLAY_ELAPSED      = 0x02, /* the elapsed time isn't the previous one plus the delta time */
+    REPLAY_SMOOTH_DELTA = 0x04, /* the smooth delta time has changed */
+    REPLAY_KEYBOARD     = 0x08, /* some keys have been toggled */
+    REPLAY_MOUSE        = 0x10, /* the mouse has changed */
+    REPLAY_JOYSTICKS    = 0x20, /* the joysticks have changed */
+    REPLAY_MOBILE       = 0x40  /* the mobile gamepad has changed */
+};
+
+typedef struct inputsnapshot_t inputsnapshot_t;
+struct inputsnapshot_t {
+    double elapsed, delta, smooth_delta; /* timer */
+    bool key[ALLEGRO_KEY_MAX]; /* keyboard */
+    int mouse[7]; /* x, y, z, dx, dy, dz, b */
+    joystick_input_t joy[MAX_JOYS]; /* indexed by joystick ID */
+    uint8_t joy_mask; /* bit j is set if joystick ID j is connected */
+    int num_joys; /* number of valid joysticks */
+    mobilegamepad_state_t mobile; /* mobile gamepad */
+};
+
+static FILE* record_fp = NULL;
+static uint8_t* replay_data = NULL; /* the replay being played */
+static size_t replay_size = 0;
+static size_t replay_offset = 0;
+static int replay_length = 0; /* in framesteps */
+static inputsnapshot_t recorded_snapshot; /* the raw input of the last recorded framestep */
+static inputsnapshot_t replayed_snapshot; /* the raw input of the last replayed framestep */
+static joystick_input_t replayed_joy[MAX_JOYS];
+
+static void clear_snapshot(inputsnapshot_t* s);
+static void take_snapshot(inputsnapshot_t* s);
+static void apply_snapshot(const inputsnapshot_t* s);
+static void write_snapshot(FILE* fp, const inputsnapshot_t* s, const inputsnapshot_t* prev);
+static bool read_snapshot(inputsnapshot_t* s, const uint8_t* data, size_t size, size_t* offset);
+static void record_framestep();
+static void replay_framestep();
+static void stop_replay();
+static void put_u32(FILE* fp, uint32_t x);
+static void put_f32(FILE* fp, float x);
+static void put_f64(FILE* fp, double x);
+static bool get_u8(const uint8_t* data, size_t size, size_t* offset, uint8_t* x);
+static bool get_u32(const uint8_t* data, size_t size, size_t* offset, uint32_t* x);
+static bool get_f32(const uint8_t* data, size_t size, size_t* offset, float* x);
+static bool get_f64(const uint8_t* data, size_t size, size_t* offset, double* x);
+
 /* private data */
 static const char DEFAULT_INPUTMAP_NAME[] = "default";
 static input_list_t* input_list = NULL;
@@ -374,16 +442,27 @@ void input_update()
         }
     }
 
+    /* read the mobile gamepad */
+    mobilegamepad_get_state(&mobile_state);
+
+    /* record or replay the raw input of this framestep */
+    if(replay_data != NULL)
+        replay_framestep();
+    if(record_fp != NULL)
+        record_framestep();
+
+    /* the raw input has changed */
+    derived_state_count = 0;
+
     /* update the input objects */
     for(input_list_t* it = input_list; it; it = it->next) {
         input_t* in = it->data;
 
         /* save the previous state of the buttons */
-        memcpy(in->oldstate, in->state, sizeof(in->oldstate));
+        in->oldstate = in->state;
 
         /* clear the current state of the buttons */
-        for(inputbutton_t button = 0; button < IB_MAX; button++)
-            in->state[button] = false;
+        in->state = 0;
 
         /* accept user input */
         if(!in->blocked)
@@ -400,6 +479,8 @@ void input_release()
 {
     logfile_message("input_release()");
 
+    input_stop_replay();
+
     logfile_message("Releasing registered input objects...");
     for(input_list_t *next, *it = input_list; it; it = next) {
         next = it->next;
@@ -424,7 +505,7 @@ void input_release()
  */
 bool input_button_down(const input_t *in, inputbutton_t button)
 {
-    return in->enabled && in->state[button];
+    return in->enabled && (in->state & BUTTON_BIT(button)) != 0;
 }
 
 
@@ -434,7 +515,7 @@ bool input_button_down(const input_t *in, inputbutton_t button)
  */
 bool input_button_pressed(const input_t *in, inputbutton_t button)
 {
-    return in->enabled && (in->state[button] && !in->oldstate[button]);
+    return in->enabled && (in->state & ~(in->oldstate) & BUTTON_BIT(button)) != 0;
 }
 
 
@@ -444,7 +525,7 @@ bool input_button_pressed(const input_t *in, inputbutton_t button)
  */
 bool input_button_released(const input_t *in, inputbutton_t button)
 {
-    return in->enabled && (!in->state[button] && in->oldstate[button]);
+    return in->enabled && (~(in->state) & in->oldstate & BUTTON_BIT(button)) != 0;
 }
 
 
@@ -596,8 +677,8 @@ void input_unblock(input_t *in)
  */
 void input_simulate_button_down(input_t *in, inputbutton_t button)
 {
-    /*in->oldstate[button] = in->state[button];*/ /* this logic creates issues between frames */
-    in->state[button] = true;
+    /*in->oldstate = (in->oldstate & ~BUTTON_BIT(button)) | (in->state & BUTTON_BIT(button));*/ /* this logic creates issues between frames */
+    in->state |= BUTTON_BIT(button);
 }
 
 
@@ -608,7 +689,7 @@ void input_simulate_button_down(input_t *in, inputbutton_t button)
  */
 void input_simulate_button_up(input_t *in, inputbutton_t button)
 {
-    in->state[button] = false;
+    in->state &= ~BUTTON_BIT(button);
 }
 
 
@@ -619,8 +700,8 @@ void input_simulate_button_up(input_t *in, inputbutton_t button)
  */
 void input_simulate_button_press(input_t *in, inputbutton_t button)
 {
-    in->oldstate[button] = false;
-    in->state[button] = true;
+    in->oldstate &= ~BUTTON_BIT(button);
+    in->state |= BUTTON_BIT(button);
 }
 
 
@@ -630,8 +711,7 @@ void input_simulate_button_press(input_t *in, inputbutton_t button)
  */
 void input_reset(input_t *in)
 {
-    for(inputbutton_t button = 0; button < IB_MAX; button++)
-        input_simulate_button_up(in, button);
+    in->state = 0;
 }
 
 
@@ -643,12 +723,12 @@ void input_copy(input_t *dest, const input_t *src)
 {
     /* we just copy the buttons, not the enabled/blocked flags */
     if(src->enabled) {
-        memcpy(dest->state, src->state, sizeof(src->state));
-        memcpy(dest->oldstate, src->oldstate, sizeof(src->oldstate));
+        dest->state = src->state;
+        dest->oldstate = src->oldstate;
     }
     else {
-        memset(dest->state, 0, sizeof(dest->state));
-        memset(dest->oldstate, 0, sizeof(dest->oldstate));
+        dest->state = 0;
+        dest->oldstate = 0;
     }
 }
 
@@ -702,6 +782,9 @@ int input_number_of_joysticks()
 {
     int n = 0;
 
+    if(replay_data != NULL)
+        return replayed_snapshot.num_joys;
+
     for(int p = 0; p < POOL_CAPACITY && joystick_pool[p] != NULL; p++) {
         ALLEGRO_JOYSTICK* joystick = joystick_pool[p];
         if(al_get_joystick_active(joystick))
@@ -747,6 +830,121 @@ void input_print_joysticks()
 }
 
 
+/*
+ * input_start_recording()
+ * Records the raw input of each framestep, as well as its timing,
+ * to a binary file. Returns true on success
+ */
+bool input_start_recording(const char* filepath)
+{
+    if(record_fp != NULL)
+        fclose(record_fp);
+
+    if(NULL == (record_fp = fopen(filepath, "wb"))) {
+        logfile_message("Can't record input to \"%s\"", filepath);
+        return false;
+    }
+
+    /* write the header */
+    fwrite(REPLAY_MAGIC, 1, 4, record_fp);
+    fputc(REPLAY_VERSION, record_fp);
+    fputc(ALLEGRO_KEY_MAX & 0xFF, record_fp);
+    fputc((ALLEGRO_KEY_MAX >> 8) & 0xFF, record_fp);
+
+    clear_snapshot(&recorded_snapshot);
+    logfile_message("Recording input to \"%s\"", filepath);
+    return true;
+}
+
+/*
+ * input_start_replay()
+ * Replays input recorded with input_start_recording(). The recorded
+ * input overrides the input devices and the timer until the replay
+ * is over. Returns true on success
+ */
+bool input_start_replay(const char* filepath)
+{
+    inputsnapshot_t s;
+    FILE* fp;
+    long size;
+
+    stop_replay();
+
+    /* read the file */
+    if(NULL == (fp = fopen(filepath, "rb"))) {
+        logfile_message("Can't open the replay file \"%s\"", filepath);
+        return false;
+    }
+
+    if(fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 7 || fseek(fp, 0, SEEK_SET) != 0) {
+        logfile_message("Invalid replay file \"%s\"", filepath);
+        fclose(fp);
+        return false;
+    }
+
+    replay_data = mallocx(size);
+    replay_size = fread(replay_data, 1, size, fp);
+    fclose(fp);
+
+    /* validate the header */
+    if(
+        replay_size != (size_t)size ||
+        memcmp(replay_data, REPLAY_MAGIC, 4) != 0 ||
+        replay_data[4] != REPLAY_VERSION ||
+        (replay_data[5] | (replay_data[6] << 8)) != ALLEGRO_KEY_MAX
+    ) {
+        logfile_message("Invalid replay file \"%s\"", filepath);
+        stop_replay();
+        return false;
+    }
+
+    /* count the framesteps */
+    replay_length = 0;
+    replay_offset = 7;
+    clear_snapshot(&s);
+    while(read_snapshot(&s, replay_data, replay_size, &replay_offset))
+        replay_length++;
+
+    /* ready to play */
+    replay_offset = 7;
+    clear_snapshot(&replayed_snapshot);
+    logfile_message("Replaying %d framesteps of input from \"%s\"", replay_length, filepath);
+    return true;
+}
+
+/*
+ * input_stop_replay()
+ * Stops recording and replaying input
+ */
+void input_stop_replay()
+{
+    if(record_fp != NULL) {
+        fclose(record_fp);
+        record_fp = NULL;
+    }
+
+    stop_replay();
+}
+
+/*
+ * input_is_replaying()
+ * Are we replaying recorded input?
+ */
+bool input_is_replaying()
+{
+    return replay_data != NULL;
+}
+
+/*
+ * input_replay_length()
+ * The number of framesteps of the replay being played, or zero
+ */
+int input_replay_length()
+{
+    return replay_length;
+}
+
+
 /*
  * input_get_xy()
  * Gets the xy coordinates (this will only work for a mouse device)
@@ -829,8 +1027,7 @@ void input_unregister(input_t *in)
 /* clears all the input buttons */
 void input_clear(input_t *in)
 {
-    for(inputbutton_t button = 0; button < IB_MAX; button++)
-        in->state[button] = in->oldstate[button] = false;
+    in->state = in->oldstate = 0;
 }
 
 /* update specific input devices */
@@ -844,18 +1041,12 @@ void inputmouse_update(input_t* in)
     mouse->dy = a5_mouse.dy;
     mouse->dz = a5_mouse.dz;
 
-    in->state[IB_UP] = (mouse->dz > 0);
-    in->state[IB_DOWN] = (mouse->dz < 0);
-    in->state[IB_LEFT] = false;
-    in->state[IB_RIGHT] = false;
-    in->state[IB_FIRE1] = (a5_mouse.b & LEFT_MOUSE_BUTTON);
-    in->state[IB_FIRE2] = (a5_mouse.b & RIGHT_MOUSE_BUTTON);
-    in->state[IB_FIRE3] = (a5_mouse.b & MIDDLE_MOUSE_BUTTON);
-    in->state[IB_FIRE4] = false;
-    in->state[IB_FIRE5] = false;
-    in->state[IB_FIRE6] = false;
-    in->state[IB_FIRE7] = false;
-    in->state[IB_FIRE8] = false;
+    in->state =
+        ((mouse->dz > 0) ? BUTTON_BIT(IB_UP) : 0) |
+        ((mouse->dz < 0) ? BUTTON_BIT(IB_DOWN) : 0) |
+        ((a5_mouse.b & LEFT_MOUSE_BUTTON) ? BUTTON_BIT(IB_FIRE1) : 0) |
+        ((a5_mouse.b & RIGHT_MOUSE_BUTTON) ? BUTTON_BIT(IB_FIRE2) : 0) |
+        ((a5_mouse.b & MIDDLE_MOUSE_BUTTON) ? BUTTON_BIT(IB_FIRE3) : 0);
 }
 
 void inputcomputer_update(input_t* in)
@@ -868,10 +1059,36 @@ void inputuserdefined_update(input_t* in)
     inputuserdefined_t *me = (inputuserdefined_t*)in;
     const inputmap_t *im = me->inputmap;
 
+    /* has the state of this input map been derived in this framestep? */
+    for(int i = 0; i < derived_state_count; i++) {
+        if(derived_state[i].inputmap == im) {
+            in->state = derived_state[i].state;
+            return;
+        }
+    }
+
+    /* derive it now */
+    in->state = derive_state(im);
+
+    if(derived_state_count < MAX_DERIVED_STATES) {
+        derived_state[derived_state_count].inputmap = im;
+        derived_state[derived_state_count].state = in->state;
+        derived_state_count++;
+    }
+}
+
+/* derive the state of the buttons from the raw input and an input map */
+uint32_t derive_state(const inputmap_t* im)
+{
+    uint32_t state = 0;
+
     /* read keyboard input */
     if(im->keyboard.enabled) {
-        for(inputbutton_t button = 0; button < IB_MAX; button++)
-            in->state[button] = (im->keyboard.scancode[button] > 0) && a5_key[im->keyboard.scancode[button]];
+        for(inputbutton_t button = 0; button < IB_MAX; button++) {
+            int scancode = im->keyboard.scancode[button];
+            if(scancode > 0 && a5_key[scancode])
+                state |= BUTTON_BIT(button);
+        }
     }
 
     /* read joystick input */
@@ -885,34 +1102,38 @@ void inputuserdefined_update(input_t* in)
             if(norm_inf >= ANALOG_SENSITIVITY_THRESHOLD) {
                 v2d_t normalized_axis = v2d_normalize(axis);
 
-                in->state[IB_UP] = in->state[IB_UP] || (normalized_axis.y <= -ANALOG_AXIS_THRESHOLD[AXIS_Y]);
-                in->state[IB_DOWN] = in->state[IB_DOWN] || (normalized_axis.y >= ANALOG_AXIS_THRESHOLD[AXIS_Y]);
-                in->state[IB_LEFT] = in->state[IB_LEFT] || (normalized_axis.x <= -ANALOG_AXIS_THRESHOLD[AXIS_X]);
-                in->state[IB_RIGHT] = in->state[IB_RIGHT] || (normalized_axis.x >= ANALOG_AXIS_THRESHOLD[AXIS_X]);
+                state |= (normalized_axis.y <= -ANALOG_AXIS_THRESHOLD[AXIS_Y]) ? BUTTON_BIT(IB_UP) : 0;
+                state |= (normalized_axis.y >= ANALOG_AXIS_THRESHOLD[AXIS_Y]) ? BUTTON_BIT(IB_DOWN) : 0;
+                state |= (normalized_axis.x <= -ANALOG_AXIS_THRESHOLD[AXIS_X]) ? BUTTON_BIT(IB_LEFT) : 0;
+                state |= (normalized_axis.x >= ANALOG_AXIS_THRESHOLD[AXIS_X]) ? BUTTON_BIT(IB_RIGHT) : 0;
 
                 /*video_showmessage("%f,%f => %f", normalized_axis.x, normalized_axis.y, RAD2DEG * atan2f(normalized_axis.y, normalized_axis.x));*/
             }
 
-            for(inputbutton_t button = 0; button < IB_MAX; button++) {
-                uint32_t button_mask = im->joystick.button_mask[(int)button];
-                in->state[button] = in->state[button] || ((wanted_joy[joy_id]->button & button_mask) != 0);
+            uint32_t joy_button = wanted_joy[joy_id]->button;
+            if(joy_button != 0) {
+                for(inputbutton_t button = 0; button < IB_MAX; button++) {
+                    if((joy_button & im->joystick.button_mask[(int)button]) != 0)
+                        state |= BUTTON_BIT(button);
+                }
             }
         }
     }
 
     /* read the mobile gamepad as the first joystick (always enabled) */
     if(im->joystick.enabled && im->joystick.number == 1) {
-        mobilegamepad_state_t mobile;
-        mobilegamepad_get_state(&mobile);
+        const mobilegamepad_state_t* mobile = &mobile_state;
 
-        in->state[IB_UP] = in->state[IB_UP] || ((mobile.dpad & MOBILEGAMEPAD_DPAD_UP) != 0);
-        in->state[IB_DOWN] = in->state[IB_DOWN] || ((mobile.dpad & MOBILEGAMEPAD_DPAD_DOWN) != 0);
-        in->state[IB_LEFT] = in->state[IB_LEFT] || ((mobile.dpad & MOBILEGAMEPAD_DPAD_LEFT) != 0);
-        in->state[IB_RIGHT] = in->state[IB_RIGHT] || ((mobile.dpad & MOBILEGAMEPAD_DPAD_RIGHT) != 0);
+        state |= ((mobile->dpad & MOBILEGAMEPAD_DPAD_UP) != 0) ? BUTTON_BIT(IB_UP) : 0;
+        state |= ((mobile->dpad & MOBILEGAMEPAD_DPAD_DOWN) != 0) ? BUTTON_BIT(IB_DOWN) : 0;
+        state |= ((mobile->dpad & MOBILEGAMEPAD_DPAD_LEFT) != 0) ? BUTTON_BIT(IB_LEFT) : 0;
+        state |= ((mobile->dpad & MOBILEGAMEPAD_DPAD_RIGHT) != 0) ? BUTTON_BIT(IB_RIGHT) : 0;
 
-        in->state[IB_FIRE1] = in->state[IB_FIRE1] || ((mobile.buttons & MOBILEGAMEPAD_BUTTON_ACTION) != 0);
-        in->state[IB_FIRE4] = in->state[IB_FIRE4] || ((mobile.buttons & MOBILEGAMEPAD_BUTTON_BACK) != 0);
+        state |= ((mobile->buttons & MOBILEGAMEPAD_BUTTON_ACTION) != 0) ? BUTTON_BIT(IB_FIRE1) : 0;
+        state |= ((mobile->buttons & MOBILEGAMEPAD_BUTTON_BACK) != 0) ? BUTTON_BIT(IB_FIRE4) : 0;
     }
+
+    return state;
 }
 
 /* remap joystick buttons according to the underlying platform.
@@ -1345,3 +1566,318 @@ void log_joystick(ALLEGRO_JOYSTICK* joystick)
     for(int b = 0; b < al_get_joystick_num_buttons(joystick); b++)
         logfile_message("-- button %d (\"%s\")", b, al_get_joystick_button_name(joystick, b));
 }
+
+/* records the raw input of the current framestep */
+void record_framestep()
+{
+    inputsnapshot_t s;
+
+    take_snapshot(&s);
+    write_snapshot(record_fp, &s, &recorded_snapshot);
+    recorded_snapshot = s;
+}
+
+/* replays the raw input of the current framestep */
+void replay_framestep()
+{
+    inputsnapshot_t s = replayed_snapshot;
+
+    if(!read_snapshot(&s, replay_data, replay_size, &replay_offset)) {
+        logfile_message("The input replay is over");
+        stop_replay();
+        return;
+    }
+
+    replayed_snapshot = s;
+    apply_snapshot(&replayed_snapshot);
+}
+
+/* stops replaying input */
+void stop_replay()
+{
+    if(replay_data == NULL)
+        return;
+
+    free(replay_data);
+    replay_data = NULL;
+    replay_size = replay_offset = 0;
+    replay_length = 0;
+
+    /* the joysticks will be remapped in the next framestep */
+    for(int j = 0; j < MAX_JOYS; j++)
+        wanted_joy[j] = NULL;
+}
+
+/* clears a snapshot of the raw input */
+void clear_snapshot(inputsnapshot_t* s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+/* takes a snapshot of the raw input of the current framestep */
+void take_snapshot(inputsnapshot_t* s)
+{
+    clear_snapshot(s);
+
+    timer_get_framestep(&s->elapsed, &s->delta, &s->smooth_delta);
+
+    memcpy(s->key, a5_key, sizeof(s->key));
+
+    s->mouse[0] = a5_mouse.x;
+    s->mouse[1] = a5_mouse.y;
+    s->mouse[2] = a5_mouse.z;
+    s->mouse[3] = a5_mouse.dx;
+    s->mouse[4] = a5_mouse.dy;
+    s->mouse[5] = a5_mouse.dz;
+    s->mouse[6] = a5_mouse.b;
+
+    for(int j = 0; j < MAX_JOYS; j++) {
+        if(wanted_joy[j] != NULL) {
+            s->joy[j] = *(wanted_joy[j]);
+            s->joy_mask |= 1 << j;
+        }
+    }
+    s->num_joys = input_number_of_joysticks();
+
+    s->mobile = mobile_state;
+}
+
+/* overrides the input devices and the timer with a snapshot */
+void apply_snapshot(const inputsnapshot_t* s)
+{
+    timer_replay_framestep(s->elapsed, s->delta, s->smooth_delta);
+
+    memcpy(a5_key, s->key, sizeof(a5_key));
+
+    a5_mouse.x = s->mouse[0];
+    a5_mouse.y = s->mouse[1];
+    a5_mouse.z = s->mouse[2];
+    a5_mouse.dx = s->mouse[3];
+    a5_mouse.dy = s->mouse[4];
+    a5_mouse.dz = s->mouse[5];
+    a5_mouse.b = s->mouse[6];
+
+    for(int j = 0; j < MAX_JOYS; j++) {
+        replayed_joy[j] = s->joy[j];
+        wanted_joy[j] = (s->joy_mask & (1 << j)) ? &replayed_joy[j] : NULL;
+    }
+
+    mobile_state = s->mobile;
+}
+
+/* binary I/O (little-endian) */
+void put_u32(FILE* fp, uint32_t x)
+{
+    fputc(x & 0xFF, fp);
+    fputc((x >> 8) & 0xFF, fp);
+    fputc((x >> 16) & 0xFF, fp);
+    fputc((x >> 24) & 0xFF, fp);
+}
+
+void put_f32(FILE* fp, float x)
+{
+    uint32_t u;
+    memcpy(&u, &x, sizeof(u));
+    put_u32(fp, u);
+}
+
+void put_f64(FILE* fp, double x)
+{
+    uint64_t u;
+    memcpy(&u, &x, sizeof(u));
+    put_u32(fp, (uint32_t)u);
+    put_u32(fp, (uint32_t)(u >> 32));
+}
+
+bool get_u8(const uint8_t* data, size_t size, size_t* offset, uint8_t* x)
+{
+    if(*offset + 1 > size)
+        return false;
+
+    *x = data[(*offset)++];
+    return true;
+}
+
+bool get_u32(const uint8_t* data, size_t size, size_t* offset, uint32_t* x)
+{
+    if(*offset + 4 > size)
+        return false;
+
+    const uint8_t* p = data + *offset;
+    *x = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    *offset += 4;
+    return true;
+}
+
+bool get_f32(const uint8_t* data, size_t size, size_t* offset, float* x)
+{
+    uint32_t u;
+    if(!get_u32(data, size, offset, &u))
+        return false;
+
+    memcpy(x, &u, sizeof(u));
+    return true;
+}
+
+bool get_f64(const uint8_t* data, size_t size, size_t* offset, double* x)
+{
+    uint32_t lo, hi;
+    if(!get_u32(data, size, offset, &lo) || !get_u32(data, size, offset, &hi))
+        return false;
+
+    uint64_t u = (uint64_t)lo | ((uint64_t)hi << 32);
+    memcpy(x, &u, sizeof(u));
+    return true;
+}
+
+/* writes a snapshot as a difference to the previous one. Each
+   framestep is stored in a single byte if nothing has changed */
+void write_snapshot(FILE* fp, const inputsnapshot_t* s, const inputsnapshot_t* prev)
+{
+    uint8_t flags = 0;
+    int toggled_keys = 0;
+
+    /* what has changed? */
+    if(s->delta != prev->delta)
+        flags |= REPLAY_DELTA;
+    if(s->elapsed != prev->elapsed + s->delta)
+        flags |= REPLAY_ELAPSED;
+    if(s->smooth_delta != prev->smooth_delta)
+        flags |= REPLAY_SMOOTH_DELTA;
+
+    for(int k = 0; k < ALLEGRO_KEY_MAX; k++)
+        toggled_keys += (s->key[k] != prev->key[k]);
+    if(toggled_keys > 0)
+        flags |= REPLAY_KEYBOARD;
+
+    if(memcmp(s->mouse, prev->mouse, sizeof(s->mouse)) != 0)
+        flags |= REPLAY_MOUSE;
+
+    if(s->joy_mask != prev->joy_mask || s->num_joys != prev->num_joys)
+        flags |= REPLAY_JOYSTICKS;
+    for(int j = 0; j < MAX_JOYS && !(flags & REPLAY_JOYSTICKS); j++) {
+        if((s->joy_mask & (1 << j)) && memcmp(&s->joy[j], &prev->joy[j], sizeof(s->joy[j])) != 0)
+            flags |= REPLAY_JOYSTICKS;
+    }
+
+    if(s->mobile.dpad != prev->mobile.dpad || s->mobile.buttons != prev->mobile.buttons)
+        flags |= REPLAY_MOBILE;
+
+    /* write the changes */
+    fputc(flags, fp);
+
+    if(flags & REPLAY_DELTA)
+        put_f64(fp, s->delta);
+    if(flags & REPLAY_ELAPSED)
+        put_f64(fp, s->elapsed);
+    if(flags & REPLAY_SMOOTH_DELTA)
+        put_f64(fp, s->smooth_delta);
+
+    if(flags & REPLAY_KEYBOARD) {
+        /* ALLEGRO_KEY_MAX is less than 256 */
+        fputc(toggled_keys, fp);
+        for(int k = 0; k < ALLEGRO_KEY_MAX; k++) {
+            if(s->key[k] != prev->key[k])
+                fputc(k, fp);
+        }
+    }
+
+    if(flags & REPLAY_MOUSE) {
+        for(int i = 0; i < 7; i++)
+            put_u32(fp, (uint32_t)s->mouse[i]);
+    }
+
+    if(flags & REPLAY_JOYSTICKS) {
+        fputc(s->joy_mask, fp);
+        fputc(s->num_joys, fp);
+        for(int j = 0; j < MAX_JOYS; j++) {
+            if(s->joy_mask & (1 << j)) {
+                put_f32(fp, s->joy[j].axis[AXIS_X]);
+                put_f32(fp, s->joy[j].axis[AXIS_Y]);
+                put_u32(fp, s->joy[j].button);
+            }
+        }
+    }
+
+    if(flags & REPLAY_MOBILE) {
+        fputc(s->mobile.dpad, fp);
+        fputc(s->mobile.buttons, fp);
+    }
+}
+
+/* reads a snapshot written by write_snapshot(). s must hold the
+   previous snapshot. Returns false at the end of the data */
+bool read_snapshot(inputsnapshot_t* s, const uint8_t* data, size_t size, size_t* offset)
+{
+    uint8_t flags, byte;
+    uint32_t u;
+
+    if(!get_u8(data, size, offset, &flags))
+        return false;
+
+    /* timer */
+    if(flags & REPLAY_DELTA) {
+        if(!get_f64(data, size, offset, &s->delta))
+            return false;
+    }
+
+    if(flags & REPLAY_ELAPSED) {
+        if(!get_f64(data, size, offset, &s->elapsed))
+            return false;
+    }
+    else
+        s->elapsed += s->delta;
+
+    if(flags & REPLAY_SMOOTH_DELTA) {
+        if(!get_f64(data, size, offset, &s->smooth_delta))
+            return false;
+    }
+
+    /* keyboard */
+    if(flags & REPLAY_KEYBOARD) {
+        uint8_t toggled_keys;
+        if(!get_u8(data, size, offset, &toggled_keys))
+            return false;
+
+        for(int i = 0; i < toggled_keys; i++) {
+            if(!get_u8(data, size, offset, &byte) || byte >= ALLEGRO_KEY_MAX)
+                return false;
+            s->key[byte] = !s->key[byte];
+        }
+    }
+
+    /* mouse */
+    if(flags & REPLAY_MOUSE) {
+        for(int i = 0; i < 7; i++) {
+            if(!get_u32(data, size, offset, &u))
+                return false;
+            s->mouse[i] = (int)(int32_t)u;
+        }
+    }
+
+    /* joysticks */
+    if(flags & REPLAY_JOYSTICKS) {
+        if(!get_u8(data, size, offset, &s->joy_mask) || !get_u8(data, size, offset, &byte))
+            return false;
+        s->num_joys = byte;
+
+        for(int j = 0; j < MAX_JOYS; j++) {
+            if(s->joy_mask & (1 << j)) {
+                if(
+                    !get_f32(data, size, offset, &s->joy[j].axis[AXIS_X]) ||
+                    !get_f32(data, size, offset, &s->joy[j].axis[AXIS_Y]) ||
+                    !get_u32(data, size, offset, &s->joy[j].button)
+                )
+                    return false;
+            }
+        }
+    }
+
+    /* mobile gamepad */
+    if(flags & REPLAY_MOBILE) {
+        if(!get_u8(data, size, offset, &s->mobile.dpad) || !get_u8(data, size, offset, &s->mobile.buttons))
+            return false;
+    }
+
+    return true;
+}
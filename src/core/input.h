@@ -69,6 +69,13 @@ int input_number_of_joysticks();
 void input_reconfigure_joysticks();
 void input_print_joysticks();
 
+/* deterministic replays: the raw input and the timing of each framestep */
+bool input_start_recording(const char* filepath);
+bool input_start_replay(const char* filepath);
+void input_stop_replay(); /* stops recording & replaying */
+bool input_is_replaying();
+int input_replay_length(); /* in framesteps */
+
 input_t *input_create_user(const char* inputmap_name); /* user's custom input device (set inputmap_name to NULL to use a default mapping) */
 input_t *input_create_computer(); /* computer-controlled "input": will return an inputcomputer_t*, which is also an input_t* */
 input_t *input_create_mouse(); /* mouse */
@@ -0,0 +1,579 @@
+/*
+ * Open Surge Engine
+ * jobs.c - a work-stealing job system shared by the engine
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_physfs.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "jobs.h"
+#include "profiler.h"
+#include "logfile.h"
+#include "../util/util.h"
+#include "../util/darray.h"
+
+/*
+
+JOB SYSTEM
+----------
+
+There is one worker thread per core, except the core of the main thread.
+Each worker owns a deque of jobs. A worker pushes the jobs it schedules to
+the tail of its own deque and takes jobs from there (LIFO: the data of the
+newest job is likely in the cache). When its deque is empty, it steals the
+oldest job at the head of the deque of another worker. Jobs scheduled by
+other threads, such as the main thread, are dealt to the deques in
+round-robin.
+
+A job is queued only when all of its dependencies are done. A thread that
+waits for a job doesn't sleep while there are queued jobs: it runs them.
+This is what makes nested waits safe.
+
+The job graph (dependencies, completion) and the sleeping of the threads
+are protected by graph_mutex. Each deque has its own lock. When both locks
+are needed, graph_mutex is locked first.
+
+Without workers (e.g., on Emscripten), jobs run in the scheduling thread.
+
+*/
+
+#if defined(__EMSCRIPTEN__)
+#define MAX_WORKERS 0 /* run the jobs in the calling thread */
+#else
+#define MAX_WORKERS 7
+#endif
+#define MAX_BATCHES_PER_THREAD 4 /* batches of a parallel for, for load balancing */
+#define MAX_BATCHES ((MAX_WORKERS + 1) * MAX_BATCHES_PER_THREAD)
+
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/* a job */
+struct job_t {
+    jobfun_t fun;
+    void* data;
+    int unfinished_dependencies;
+    bool is_done;
+    DARRAY(job_t*, dependent); /* jobs waiting for this one */
+};
+
+/* a deque of jobs */
+typedef struct jobdeque_t jobdeque_t;
+struct jobdeque_t {
+    ALLEGRO_MUTEX* mutex;
+    job_t** job; /* ring buffer */
+    int head; /* index of the oldest job */
+    int count;
+    int capacity; /* a power of two */
+};
+
+/* a batch of a parallel for */
+typedef struct jobrange_t jobrange_t;
+struct jobrange_t {
+    jobrangefun_t fun;
+    void* data;
+    int first;
+    int last;
+};
+
+/* a continuation in the main thread */
+typedef struct jobcontinuation_t jobcontinuation_t;
+struct jobcontinuation_t {
+    jobfun_t fun;
+    void* data;
+};
+
+/* state */
+static ALLEGRO_THREAD* worker[MAX_WORKERS + 1];
+static jobdeque_t deque[MAX_WORKERS + 1];
+static int worker_count = 0;
+static int next_deque = 0; /* round-robin; protected by graph_mutex */
+static bool should_stop = false;
+static ALLEGRO_MUTEX* graph_mutex = NULL;
+static ALLEGRO_COND* graph_cond = NULL; /* signaled when a job is queued or done */
+static ALLEGRO_MUTEX* main_mutex = NULL; /* protects the continuations */
+STATIC_DARRAY(jobcontinuation_t, continuation);
+STATIC_DARRAY(jobcontinuation_t, running_continuation);
+static THREAD_LOCAL int worker_index = -1; /* -1 if this thread is not a worker */
+static THREAD_LOCAL bool is_main_thread = false;
+
+static void* run_worker(ALLEGRO_THREAD* thread, void* arg);
+static void run_job(job_t* job);
+static job_t* take_job(int self);
+static void enqueue(job_t* job);
+static bool is_any_job_queued();
+static void run_range(void* data);
+
+static void deque_init(jobdeque_t* q);
+static void deque_release(jobdeque_t* q);
+static void deque_push_tail(jobdeque_t* q, job_t* job);
+static job_t* deque_pop_tail(jobdeque_t* q);
+static job_t* deque_pop_head(jobdeque_t* q);
+
+
+
+/*
+ * jobs_init()
+ * Starts the workers. Call it in the main thread
+ */
+void jobs_init()
+{
+    int cpu_count = al_get_cpu_count(); /* -1 if unknown */
+    int wanted_workers = min(3, MAX_WORKERS);
+
+    /* leave a core for the main thread */
+    if(MAX_WORKERS > 0 && cpu_count > 0)
+        wanted_workers = clip(cpu_count - 1, 1, MAX_WORKERS);
+
+    /* initialize */
+    is_main_thread = true;
+    should_stop = false;
+    next_deque = 0;
+    worker_count = 0;
+    darray_init(continuation);
+    darray_init(running_continuation);
+
+    if(NULL == (graph_mutex = al_create_mutex()))
+        fatal_error("Can't create a mutex for the jobs");
+    if(NULL == (graph_cond = al_create_cond()))
+        fatal_error("Can't create a condition variable for the jobs");
+    if(NULL == (main_mutex = al_create_mutex()))
+        fatal_error("Can't create a mutex for the jobs");
+
+    /* start the workers */
+    for(int i = 0; i < wanted_workers; i++) {
+        deque_init(&deque[i]);
+        if(NULL == (worker[i] = al_create_thread(run_worker, (void*)(intptr_t)i))) {
+            deque_release(&deque[i]);
+            break;
+        }
+
+        worker_count++;
+    }
+
+    for(int i = 0; i < worker_count; i++)
+        al_start_thread(worker[i]);
+
+    logfile_message("Running the jobs on %d worker threads", worker_count);
+}
+
+/*
+ * jobs_release()
+ * Stops the workers. All scheduled jobs must have been waited for
+ */
+void jobs_release()
+{
+    /* stop the workers */
+    al_lock_mutex(graph_mutex);
+    should_stop = true;
+    al_broadcast_cond(graph_cond);
+    al_unlock_mutex(graph_mutex);
+
+    for(int i = 0; i < worker_count; i++) {
+        al_join_thread(worker[i], NULL);
+        al_destroy_thread(worker[i]);
+        deque_release(&deque[i]);
+    }
+    worker_count = 0;
+
+    /* run the pending continuations */
+    jobs_pump();
+
+    /* release */
+    darray_release(running_continuation);
+    darray_release(continuation);
+
+    al_destroy_mutex(main_mutex);
+    al_destroy_cond(graph_cond);
+    al_destroy_mutex(graph_mutex);
+    main_mutex = NULL;
+    graph_cond = NULL;
+    graph_mutex = NULL;
+}
+
+/*
+ * jobs_worker_count()
+ * The number of worker threads. If zero, the jobs run in the calling thread
+ */
+int jobs_worker_count()
+{
+    return worker_count;
+}
+
+/*
+ * jobs_schedule()
+ * Schedules a job that calls fun(data) after all of its dependencies are
+ * done. The dependencies must not have been waited for yet. Returns a
+ * handle that must be passed to jobs_wait()
+ */
+job_t* jobs_schedule(jobfun_t fun, void* data, job_t* const* dependency, int dependency_count)
+{
+    job_t* job = mallocx(sizeof *job);
+
+    job->fun = fun;
+    job->data = data;
+    job->unfinished_dependencies = 0;
+    job->is_done = false;
+    darray_init(job->dependent);
+
+    /* run the job in the calling thread. Its
+       dependencies are done, since they have run before */
+    if(worker_count == 0) {
+        job->fun(job->data);
+        job->is_done = true;
+        return job;
+    }
+
+    /* wait for the dependencies */
+    al_lock_mutex(graph_mutex);
+
+    for(int i = 0; i < dependency_count; i++) {
+        if(!dependency[i]->is_done) {
+            darray_push(dependency[i]->dependent, job);
+            job->unfinished_dependencies++;
+        }
+    }
+
+    if(job->unfinished_dependencies == 0)
+        enqueue(job);
+
+    al_unlock_mutex(graph_mutex);
+
+    /* done */
+    return job;
+}
+
+/*
+ * jobs_wait()
+ * Waits for a job and disposes it. Instead of sleeping, the calling
+ * thread runs queued jobs while the job isn't done
+ */
+void jobs_wait(job_t* job)
+{
+    bool is_profiled = false;
+
+    for(;;) {
+        /* is the job done? */
+        al_lock_mutex(graph_mutex);
+        bool is_done = job->is_done;
+        al_unlock_mutex(graph_mutex);
+
+        if(is_done)
+            break;
+
+        /* the profiler records the main thread only */
+        if(!is_profiled && is_main_thread) {
+            profiler_begin("jobs_wait");
+            is_profiled = true;
+        }
+
+        /* help with the queued jobs */
+        job_t* other = take_job(worker_index);
+        if(other != NULL) {
+            run_job(other);
+            continue;
+        }
+
+        /* sleep until a job is queued or done */
+        al_lock_mutex(graph_mutex);
+        while(!job->is_done && !is_any_job_queued())
+            al_wait_cond(graph_cond, graph_mutex);
+        al_unlock_mutex(graph_mutex);
+    }
+
+    if(is_profiled)
+        profiler_end();
+
+    /* dispose the job */
+    darray_release(job->dependent);
+    free(job);
+}
+
+/*
+ * jobs_parallel_for()
+ * Calls fun(first, last, data) for disjoint ranges that cover the indices
+ * [0, count). Ranges have at least min_batch_size indices, except possibly
+ * the last one, and are processed in parallel. The calling thread processes
+ * a range as well
+ */
+void jobs_parallel_for(int count, int min_batch_size, jobrangefun_t fun, void* data)
+{
+    jobrange_t range[MAX_BATCHES];
+    job_t* job[MAX_BATCHES];
+
+    if(count <= 0)
+        return;
+
+    /* divide the work */
+    int max_batches = (worker_count + 1) * MAX_BATCHES_PER_THREAD;
+    int batch_count = clip(count / max(1, min_batch_size), 1, max_batches);
+    if(worker_count == 0 || batch_count == 1) {
+        fun(0, count, data);
+        return;
+    }
+
+    /* schedule all but the first batch */
+    for(int i = 0; i < batch_count; i++) {
+        range[i] = (jobrange_t){
+            .fun = fun, .data = data,
+            .first = (int)((int64_t)count * i / batch_count),
+            .last = (int)((int64_t)count * (i + 1) / batch_count)
+        };
+    }
+
+    for(int i = 1; i < batch_count; i++)
+        job[i] = jobs_schedule(run_range, &range[i], NULL, 0);
+
+    /* process the first batch in this thread */
+    run_range(&range[0]);
+
+    /* wait for the others */
+    for(int i = 1; i < batch_count; i++)
+        jobs_wait(job[i]);
+}
+
+/*
+ * jobs_run_on_main_thread()
+ * Calls fun(data) in the main thread, in the next call to jobs_pump().
+ * This is meant for continuations that need the main thread, such as
+ * uploading the results of a job to the GPU
+ */
+void jobs_run_on_main_thread(jobfun_t fun, void* data)
+{
+    jobcontinuation_t c = { .fun = fun, .data = data };
+
+    al_lock_mutex(main_mutex);
+    darray_push(continuation, c);
+    al_unlock_mutex(main_mutex);
+}
+
+/*
+ * jobs_pump()
+ * Runs the continuations queued for the main thread. The continuations
+ * queued by the ones that are running now will run in the next call
+ */
+void jobs_pump()
+{
+    assertx(is_main_thread);
+
+    al_lock_mutex(main_mutex);
+    darray_swap(continuation, running_continuation);
+    al_unlock_mutex(main_mutex);
+
+    int count = darray_length(running_continuation);
+    if(count == 0)
+        return;
+
+    profiler_begin("jobs_pump");
+
+    for(int i = 0; i < count; i++)
+        running_continuation[i].fun(running_continuation[i].data);
+    running_continuation_len = 0;
+
+    profiler_end();
+}
+
+
+
+/* private */
+
+/* the main loop of a worker thread */
+void* run_worker(ALLEGRO_THREAD* thread, void* arg)
+{
+    int self = (int)(intptr_t)arg;
+
+    /* jobs may read files of the virtual filesystem */
+    al_set_physfs_file_interface();
+    worker_index = self;
+
+    for(;;) {
+        /* run the queued jobs */
+        job_t* job = take_job(self);
+        if(job != NULL) {
+            run_job(job);
+            continue;
+        }
+
+        /* sleep until a job is queued */
+        al_lock_mutex(graph_mutex);
+        while(!should_stop && !is_any_job_queued())
+            al_wait_cond(graph_cond, graph_mutex);
+        bool stop = should_stop && !is_any_job_queued();
+        al_unlock_mutex(graph_mutex);
+
+        if(stop)
+            break;
+    }
+
+    (void)thread;
+    return NULL;
+}
+
+/* runs a job and queues the jobs that depend on it */
+void run_job(job_t* job)
+{
+    job->fun(job->data);
+
+    /* the job may be disposed as soon as the lock is released */
+    al_lock_mutex(graph_mutex);
+
+    for(int i = 0; i < darray_length(job->dependent); i++) {
+        job_t* dependent = job->dependent[i];
+        if(--dependent->unfinished_dependencies == 0)
+            enqueue(dependent);
+    }
+
+    job->is_done = true;
+    al_broadcast_cond(graph_cond);
+    al_unlock_mutex(graph_mutex);
+}
+
+/* takes a job from the deque of worker self (newest first) or
+   steals one from another deque (oldest first). self may be -1 */
+job_t* take_job(int self)
+{
+    job_t* job = NULL;
+
+    if(self >= 0 && NULL != (job = deque_pop_tail(&deque[self])))
+        return job;
+
+    for(int i = 1; i <= worker_count; i++) {
+        int victim = (max(self, 0) + i) % worker_count;
+        if(NULL != (job = deque_pop_head(&deque[victim])))
+            return job;
+    }
+
+    return NULL;
+}
+
+/* queues a job whose dependencies are done. Call with graph_mutex locked */
+void enqueue(job_t* job)
+{
+    /* a worker keeps the jobs it schedules */
+    int index = worker_index;
+    if(index < 0) {
+        index = next_deque;
+        next_deque = (next_deque + 1) % worker_count;
+    }
+
+    deque_push_tail(&deque[index], job);
+    al_broadcast_cond(graph_cond);
+}
+
+/* checks if there is any queued job. Call with graph_mutex locked */
+bool is_any_job_queued()
+{
+    for(int i = 0; i < worker_count; i++) {
+        al_lock_mutex(deque[i].mutex);
+        int count = deque[i].count;
+        al_unlock_mutex(deque[i].mutex);
+
+        if(count > 0)
+            return true;
+    }
+
+    return false;
+}
+
+/* runs a batch of a parallel for */
+void run_range(void* data)
+{
+    const jobrange_t* range = (const jobrange_t*)data;
+    range->fun(range->first, range->last, range->data);
+}
+
+/* initializes a deque */
+void deque_init(jobdeque_t* q)
+{
+    if(NULL == (q->mutex = al_create_mutex()))
+        fatal_error("Can't create a mutex for the jobs");
+
+    q->capacity = 64;
+    q->job = mallocx(q->capacity * sizeof(*(q->job)));
+    q->head = 0;
+    q->count = 0;
+}
+
+/* releases a deque */
+void deque_release(jobdeque_t* q)
+{
+    assertx(q->count == 0);
+
+    free(q->job);
+    al_destroy_mutex(q->mutex);
+    q->job = NULL;
+    q->mutex = NULL;
+}
+
+/* pushes a job to the tail of a deque */
+void deque_push_tail(jobdeque_t* q, job_t* job)
+{
+    al_lock_mutex(q->mutex);
+
+    /* grow the ring buffer, unwrapping it */
+    if(q->count == q->capacity) {
+        job_t** grown = mallocx(2 * q->capacity * sizeof(*grown));
+        for(int i = 0; i < q->count; i++)
+            grown[i] = q->job[(q->head + i) & (q->capacity - 1)];
+
+        free(q->job);
+        q->job = grown;
+        q->capacity *= 2;
+        q->head = 0;
+    }
+
+    q->job[(q->head + q->count) & (q->capacity - 1)] = job;
+    q->count++;
+
+    al_unlock_mutex(q->mutex);
+}
+
+/* pops the newest job of a deque, or returns NULL if the deque is empty */
+job_t* deque_pop_tail(jobdeque_t* q)
+{
+    job_t* job = NULL;
+
+    al_lock_mutex(q->mutex);
+    if(q->count > 0) {
+        q->count--;
+        job = q->job[(q->head + q->count) & (q->capacity - 1)];
+    }
+    al_unlock_mutex(q->mutex);
+
+    return job;
+}
+
+/* pops the oldest job of a deque, or returns NULL if the deque is empty */
+job_t* deque_pop_head(jobdeque_t* q)
+{
+    job_t* job = NULL;
+
+    al_lock_mutex(q->mutex);
+    if(q->count > 0) {
+        job = q->job[q->head];
+        q->head = (q->head + 1) & (q->capacity - 1);
+        q->count--;
+    }
+    al_unlock_mutex(q->mutex);
+
+    return job;
+}
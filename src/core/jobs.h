@@ -0,0 +1,43 @@
+/*
+ * Open Surge Engine
+ * jobs.h - a work-stealing job system shared by the engine
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JOBS_H
+#define _JOBS_H
+
+/* jobs */
+typedef struct job_t job_t;
+typedef void (*jobfun_t)(void* data);
+typedef void (*jobrangefun_t)(int first, int last, void* data); /* processes the indices [first, last) */
+
+/* initialization: call jobs_init() in the main thread */
+void jobs_init();
+void jobs_release();
+int jobs_worker_count(); /* zero if the jobs run in the calling thread */
+
+/* scheduling */
+job_t* jobs_schedule(jobfun_t fun, void* data, job_t* const* dependency, int dependency_count); /* the job runs after its dependencies */
+void jobs_wait(job_t* job); /* waits for a scheduled job and disposes it. Call it exactly once per job */
+void jobs_parallel_for(int count, int min_batch_size, jobrangefun_t fun, void* data); /* returns when all indices have been processed */
+
+/* continuations in the main thread (e.g., uploading to the GPU) */
+void jobs_run_on_main_thread(jobfun_t fun, void* data); /* may be called from any thread */
+void jobs_pump(); /* call in the main thread once per framestep */
+
+#endif
@@ -29,8 +29,24 @@
 #include "../util/util.h"
 
 typedef struct proganim_keyframe_t proganim_keyframe_t;
+typedef struct proganim_segment_t proganim_segment_t;
 typedef double (*proganim_easing_t)(double,const double*);
 
+/*
+
+KEYFRAME LOOKUP
+
+Keyframe percentages are integers in [0,100], so we precompute the segment
+(pair of consecutive keyframes) that corresponds to each integer percentage
+when validating the animation. Finding the keyframes suitable for
+interpolation is then a table lookup, regardless of the number of keyframes.
+
+segment[] has keyframe_count + 1 entries: segment[0] is a degenerate segment
+used before the first keyframe, segment[k] goes from keyframe k-1 to
+keyframe k for 1 <= k < keyframe_count, and segment[keyframe_count] is a
+degenerate segment used after the last keyframe.
+
+*/
 
 /* programmatic animation */
 struct proganim_t {
@@ -38,6 +54,8 @@ struct proganim_t {
     proganim_easing_t easing; /* easing function */
     proganim_keyframe_t* keyframe; /* array of keyframes */
     int keyframe_count; /* length of keyframe[] */
+    proganim_segment_t* segment; /* precomputed segments; NULL if there are less than 2 keyframes */
+    short segment_at[101]; /* segment_at[p] is the index of the segment at percentage p% */
 };
 
 /* keyframe struct */
@@ -56,6 +74,16 @@ struct proganim_keyframe_t {
 
 };
 
+/* a pair of consecutive keyframes with precomputed interpolation coefficients */
+struct proganim_segment_t {
+    const proganim_keyframe_t* a; /* start */
+    const proganim_keyframe_t* b; /* end */
+    float start; /* percentage of a, in [0,1] */
+    float length; /* percentage of b minus percentage of a, in [0,1] */
+    float rotation_a, rotation_b; /* in radians */
+    float opacity_a, opacity_b; /* in [0,1] */
+};
+
 /* easing functions */
 static double easing_linear(double t, const double* p);
 static double easing_in_quadratic(double t, const double* p);
@@ -77,7 +105,8 @@ static const proganim_t DEFAULT_PROGANIM = {
     .duration = 0.0,
     .easing = easing_linear,
     .keyframe = NULL,
-    .keyframe_count = 0
+    .keyframe_count = 0,
+    .segment = NULL
 };
 
 static const double DURATION_EPSILON = 1e-5;
@@ -85,9 +114,11 @@ static const double DURATION_EPSILON = 1e-5;
 
 /* helpers */
 static void proganim_add_keyframe(proganim_t* prog_anim, proganim_keyframe_t keyframe);
-static void find_keyframes_suitable_for_interpolation(const proganim_t* prog_anim, double percentage, const proganim_keyframe_t** out_a, const proganim_keyframe_t** out_b);
+static const proganim_segment_t* find_segment_suitable_for_interpolation(const proganim_t* prog_anim, double percentage);
+static void build_segments(proganim_t* prog_anim);
+static proganim_segment_t make_segment(const proganim_keyframe_t* a, const proganim_keyframe_t* b);
 static int compare_keyframes(const void* a, const void* b);
-static float normalized_percentage(float percentage, const proganim_keyframe_t* a, const proganim_keyframe_t* b);
+static float normalized_percentage(float percentage, const proganim_segment_t* segment);
 static int parse_percentage(const parsetree_parameter_t* param);
 static proganim_easing_t parse_easing_function(const parsetree_parameter_t* param);
 static int traverse_keyframe(const parsetree_statement_t *stmt, void *context);
@@ -149,14 +180,13 @@ transform_t* proganim_interpolated_transform(const proganim_t* prog_anim, double
     percentage = prog_anim->easing(percentage, NULL);
 
     /* get two keyframes suitable for interpolation */
-    const proganim_keyframe_t *keyframe_a, *keyframe_b;
-    find_keyframes_suitable_for_interpolation(prog_anim, percentage, &keyframe_a, &keyframe_b);
+    const proganim_segment_t* segment = find_segment_suitable_for_interpolation(prog_anim, percentage);
 
     /* interpolate */
-    float p = normalized_percentage(percentage, keyframe_a, keyframe_b);
-    v2d_t interpolated_translation = v2d_lerp(keyframe_a->translation, keyframe_b->translation, p);
-    float interpolated_rotation = lerp_angle(keyframe_a->rotation * DEG2RAD, keyframe_b->rotation * DEG2RAD, p);
-    v2d_t interpolated_scale = v2d_lerp(keyframe_a->scale, keyframe_b->scale, p);
+    float p = normalized_percentage(percentage, segment);
+    v2d_t interpolated_translation = v2d_lerp(segment->a->translation, segment->b->translation, p);
+    float interpolated_rotation = lerp_angle(segment->rotation_a, segment->rotation_b, p);
+    v2d_t interpolated_scale = v2d_lerp(segment->a->scale, segment->b->scale, p);
 
     /* use integer coordinates */
     interpolated_translation.x = floorf(interpolated_translation.x);
@@ -200,57 +230,33 @@ float proganim_interpolated_opacity(const proganim_t* prog_anim, double seconds,
     percentage = clip01(percentage); /* no opacity values outside [0,1] */
 
     /* get two keyframes suitable for interpolation */
-    const proganim_keyframe_t *keyframe_a, *keyframe_b;
-    find_keyframes_suitable_for_interpolation(prog_anim, percentage, &keyframe_a, &keyframe_b);
+    const proganim_segment_t* segment = find_segment_suitable_for_interpolation(prog_anim, percentage);
 
     /* interpolate */
-    float p = normalized_percentage(percentage, keyframe_a, keyframe_b);
-    float a = (float)keyframe_a->opacity * 0.01f;
-    float b = (float)keyframe_b->opacity * 0.01f;
-    float interpolated_opacity = lerp(a, b, p);
+    float p = normalized_percentage(percentage, segment);
+    float interpolated_opacity = lerp(segment->opacity_a, segment->opacity_b, p);
     return interpolated_opacity;
 }
 
 /*
- * find_keyframes_suitable_for_interpolation()
- * Find keyframes out_a and out_b suitable for interpolation at the given percentage
+ * find_segment_suitable_for_interpolation()
+ * Find a pair of keyframes suitable for interpolation at the given percentage
  */
-void find_keyframes_suitable_for_interpolation(const proganim_t* prog_anim, double percentage, const proganim_keyframe_t** out_a, const proganim_keyframe_t** out_b)
+const proganim_segment_t* find_segment_suitable_for_interpolation(const proganim_t* prog_anim, double percentage)
 {
     int p = (int)floor(100.0 * percentage);
 
     /* make sure that we have at least 2 keyframes */
-    assertx(prog_anim->keyframe_count >= 2);
-
-    /* keyframes are sorted by percentages */
-
-    /* out of bounds check */
-    if(p < prog_anim->keyframe[0].percentage) {
-        *out_a = &prog_anim->keyframe[0];
-        *out_b = &prog_anim->keyframe[0];
-        return;
-    }
-    else if(p > prog_anim->keyframe[prog_anim->keyframe_count - 1].percentage) {
-        *out_a = &prog_anim->keyframe[prog_anim->keyframe_count - 1];
-        *out_b = &prog_anim->keyframe[prog_anim->keyframe_count - 1];
-        return;
-    }
+    assertx(prog_anim->keyframe_count >= 2 && prog_anim->segment != NULL);
 
-    /* find a suitable interval */
-    for(int k = 0; k+1 < prog_anim->keyframe_count; k++) {
-        int start_percentage = prog_anim->keyframe[k].percentage;
-        int end_percentage = prog_anim->keyframe[k+1].percentage;
+    /* out of bounds check. Keyframe percentages are in [0,100] */
+    if(p < 0)
+        return &prog_anim->segment[0];
+    else if(p > 100)
+        return &prog_anim->segment[prog_anim->keyframe_count];
 
-        if(p >= start_percentage && p <= end_percentage) {
-            *out_a = &prog_anim->keyframe[k];
-            *out_b = &prog_anim->keyframe[k+1];
-            return;
-        }
-    }
-
-    /* can't find an interval (this shouldn't happen) */
-    *out_a = &prog_anim->keyframe[prog_anim->keyframe_count - 1];
-    *out_b = &prog_anim->keyframe[prog_anim->keyframe_count - 1];
+    /* lookup */
+    return &prog_anim->segment[prog_anim->segment_at[p]];
 }
 
 
@@ -285,6 +291,9 @@ proganim_t* proganim_destroy(proganim_t* prog_anim)
     if(prog_anim->keyframe != NULL)
         free(prog_anim->keyframe);
 
+    if(prog_anim->segment != NULL)
+        free(prog_anim->segment);
+
     free(prog_anim);
     return NULL;
 }
@@ -337,6 +346,9 @@ void proganim_validate(proganim_t* prog_anim)
     /* keyframes are already declared in a sorted way */
     (void)compare_keyframes;
 #endif
+
+    /* precompute the segments */
+    build_segments(prog_anim);
 }
 
 /*
@@ -463,20 +475,78 @@ void proganim_add_keyframe(proganim_t* prog_anim, proganim_keyframe_t keyframe)
 }
 
 
+/*
+ * build_segments()
+ * Precompute the segments of a programmatic animation and the lookup table.
+ * Keyframes must be sorted by percentage
+ */
+void build_segments(proganim_t* prog_anim)
+{
+    int n = prog_anim->keyframe_count;
+    const proganim_keyframe_t* keyframe = prog_anim->keyframe;
+
+    if(prog_anim->segment != NULL) {
+        free(prog_anim->segment);
+        prog_anim->segment = NULL;
+    }
+
+    /* nothing to interpolate */
+    if(n < 2)
+        return;
+
+    /* create the segments */
+    prog_anim->segment = mallocx((n + 1) * sizeof(*(prog_anim->segment)));
+    prog_anim->segment[0] = make_segment(&keyframe[0], &keyframe[0]);
+    for(int k = 1; k < n; k++)
+        prog_anim->segment[k] = make_segment(&keyframe[k-1], &keyframe[k]);
+    prog_anim->segment[n] = make_segment(&keyframe[n-1], &keyframe[n-1]);
+
+    /* for each percentage p, pick the first segment [a,b] such that a <= p <= b */
+    for(int p = 0, k = 1; p <= 100; p++) {
+        if(p < keyframe[0].percentage)
+            prog_anim->segment_at[p] = 0;
+        else if(p > keyframe[n-1].percentage)
+            prog_anim->segment_at[p] = n;
+        else {
+            while(p > keyframe[k].percentage)
+                k++;
+            prog_anim->segment_at[p] = k;
+        }
+    }
+}
+
+/*
+ * make_segment()
+ * Create a segment between keyframes a and b
+ */
+proganim_segment_t make_segment(const proganim_keyframe_t* a, const proganim_keyframe_t* b)
+{
+    return (proganim_segment_t){
+        .a = a,
+        .b = b,
+        .start = (float)a->percentage * 0.01f,
+        .length = (float)(b->percentage - a->percentage) * 0.01f,
+        .rotation_a = a->rotation * DEG2RAD,
+        .rotation_b = b->rotation * DEG2RAD,
+        .opacity_a = (float)a->opacity * 0.01f,
+        .opacity_b = (float)b->opacity * 0.01f
+    };
+}
+
 /*
  * normalized_percentage()
- * Input: a->percentage <= percentage <= b->percentage
+ * Input: segment->a->percentage <= percentage <= segment->b->percentage
  * Output: input percentage normalized to [0,1]
  */
-float normalized_percentage(float percentage, const proganim_keyframe_t* a, const proganim_keyframe_t* b)
+float normalized_percentage(float percentage, const proganim_segment_t* segment)
 {
     /* we assume that a->percentage <= b->percentage */
-    if(a->percentage == b->percentage) {
+    if(segment->a->percentage == segment->b->percentage) {
         return 1.0f; /* prioritize b. If a and b have the same percentage, this is probably intended by the user. */
         /*return 0.5f;*/
     }
 
-    percentage = (percentage - (float)a->percentage * 0.01f) / ((float)(b->percentage - a->percentage) * 0.01f);
+    percentage = (percentage - segment->start) / segment->length;
     return clip01(percentage);
 }
 
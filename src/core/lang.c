@@ -28,17 +28,51 @@
 #include "../util/util.h"
 #include "../util/stringutil.h"
 #include "../util/hashtable.h"
+#include "../util/darray.h"
 
-/* fake string type */
-typedef struct { char* data; } stringadapter_t;
-static stringadapter_t* stringadapter_create(const char* data);
-static const char* stringadapter_get_data(const stringadapter_t *s);
-static void stringadapter_set_data(stringadapter_t *s, const char* data);
-static void stringadapter_destroy(stringadapter_t *s);
+/*
 
-/* hash table */
-HASHTABLE_GENERATE_CODE(stringadapter_t, stringadapter_destroy);
-static HASHTABLE(stringadapter_t, strings);
+COMPILED STRING TABLES
+
+The keys of the language files are interned to integer ids (langkey_t) when the
+files are loaded. The ids are shared by all languages, so that a string table is
+just an array of values indexed by id. Fonts cache the ids of the variables they
+reference, and a lookup becomes an array access.
+
+A language file is compiled to a string table the first time it's loaded. The
+table incorporates the strings of the default language file and those of the
+language extension, if any. Switching to a language that has been loaded before
+just swaps the table pointer, with no reparsing.
+
+*/
+
+/* interned keys */
+typedef struct { langkey_t id; } langkeyid_t;
+static langkeyid_t* langkeyid_create(langkey_t id);
+static void langkeyid_destroy(langkeyid_t* k);
+HASHTABLE_GENERATE_CODE(langkeyid_t, langkeyid_destroy);
+static HASHTABLE(langkeyid_t, keys);
+static int key_count = 0;
+static langkey_t find_key(const char* key);
+
+/* string tables */
+typedef struct langtable_t langtable_t;
+struct langtable_t {
+    char* filepath; /* path of the language file */
+    char lang_id[32]; /* LANG_ID */
+    DARRAY(char*, value); /* strings indexed by langkey_t; NULL if not defined */
+    langtable_t* next; /* linked list */
+};
+static langtable_t* table = NULL; /* the current string table */
+static langtable_t* compiled_tables = NULL; /* all compiled tables */
+static langtable_t* create_table(const char* filepath);
+static void destroy_table(langtable_t* t);
+static langtable_t* find_table(const char* filepath);
+static langtable_t* compile_table(const char* filepath, bool is_language_extension);
+static void read_language_file(langtable_t* t, const char* filepath);
+static void use_table(langtable_t* t);
+static const char* table_get(const langtable_t* t, langkey_t key);
+static void table_set(langtable_t* t, langkey_t key, const char* value);
 
 /* private stuff */
 #define NULL_STRING "null"
@@ -50,7 +84,7 @@ static const char EXTENDS_FOLDER[] = "extends/";
 
 static char lang_id[32] = NULL_STRING;
 typedef struct { const char* key; const char* value; } inout_t;
-static int traverse(const parsetree_statement_t *stmt);
+static int traverse(const parsetree_statement_t *stmt, void *string_table);
 static int traverse_inout(const parsetree_statement_t *stmt, void *inout);
 static int traverse_count(const parsetree_statement_t *stmt, void *counters);
 static bool is_untranslated_entry(const parsetree_statement_t *stmt);
@@ -67,7 +101,8 @@ static char* path_to_language_extension(const char* path);
 void lang_init()
 {
     logfile_message("Initializing the language module");
-    strings = hashtable_stringadapter_t_create();
+    keys = hashtable_langkeyid_t_create();
+    key_count = 0;
     lang_loadfile(DEFAULT_LANGUAGE_FILEPATH);
     logfile_message("The language module has been initialized");
 
@@ -82,7 +117,15 @@ void lang_init()
 void lang_release()
 {
     logfile_message("Releasing the language module...");
-    strings = hashtable_stringadapter_t_destroy(strings);
+
+    while(compiled_tables != NULL) {
+        langtable_t* next = compiled_tables->next;
+        destroy_table(compiled_tables);
+        compiled_tables = next;
+    }
+
+    table = NULL;
+    keys = hashtable_langkeyid_t_destroy(keys);
 }
 
 
@@ -93,16 +136,16 @@ void lang_release()
 void lang_loadfile(const char* filepath)
 {
     char* path = pathify(filepath);
+    langtable_t* t = NULL;
     int supver, subver, wipver;
 
-    #define READ_LANGUAGE_FILE(path_to_lng_file) do { \
-        const char* fullpath = asset_path(path_to_lng_file); \
-        parsetree_program_t* prog = nanoparser_construct_tree(fullpath); \
-        nanoparser_traverse_program(prog, traverse); \
-        prog = nanoparser_deconstruct_tree(prog); \
-    } while(0)
-
-
+    /* Swap the string table if the language file has been compiled before */
+    if(NULL != (t = find_table(path))) {
+        logfile_message("Switching to language file \"%s\"", path);
+        use_table(t);
+        free(path);
+        return;
+    }
 
     /* log */
     logfile_message("Loading language file \"%s\"...", path);
@@ -122,6 +165,7 @@ void lang_loadfile(const char* filepath)
            otherwise the player may get locked due to a corrupted save state */
         logfile_message("Missing language file: \"%s\"", path);
         lang_loadfile(DEFAULT_LANGUAGE_FILEPATH);
+        free(path);
         return;
 
     }
@@ -139,33 +183,9 @@ void lang_loadfile(const char* filepath)
     if(game_version_compare(supver, subver, wipver) < 0) /* backwards compatibility */
         fatal_error("Language file \"%s\" (version %d.%d.%d) is not compatible with this version of the engine (%s)!", path, supver, subver, wipver, GAME_VERSION_STRING);
 
-    /* Read the default language file to fill in any missing strings */
-    if(str_icmp(path, DEFAULT_LANGUAGE_FILEPATH) != 0)
-        lang_loadfile(DEFAULT_LANGUAGE_FILEPATH);
-
-    /* Read language file to memory */
-    READ_LANGUAGE_FILE(path);
-
-    /* Check if there is a language extension available */
-    if(!is_language_extension) {
-        char* extpath = path_to_language_extension(path);
-
-        /* There is a language extension */
-        if(asset_exists(extpath)) {
-
-            /* Load language extension */
-            logfile_message("Loading language extension at \"%s\"...", extpath);
-            READ_LANGUAGE_FILE(extpath);
-
-        }
-        else
-            logfile_message("No language extension found at \"%s\"", extpath);
-
-        free(extpath);
-    }
-
-    /* Update language ID */
-    lang_getstring("LANG_ID", lang_id, sizeof(lang_id));
+    /* Compile the language file */
+    t = compile_table(path, is_language_extension);
+    use_table(t);
 
     /* done! */
     logfile_message("Language file \"%s\" has been loaded successfully!", path);
@@ -202,10 +222,10 @@ char* lang_metadata(const char* filepath, const char* desired_key, char* dest, s
  */
 char* lang_getstring(const char* desired_key, char* dest, size_t dest_size)
 {
-    const stringadapter_t *s = hashtable_stringadapter_t_find(strings, desired_key);
+    const char* value = table_get(table, find_key(desired_key));
 
-    if(s != NULL)
-        return str_cpy(dest, stringadapter_get_data(s), dest_size);
+    if(value != NULL)
+        return str_cpy(dest, value, dest_size);
     else
         return str_cpy(dest, NULL_STRING, dest_size);
 }
@@ -253,20 +273,49 @@ void lang_compatibility(const char* filepath, int* supver, int* subver, int* wip
  */
 bool lang_haskey(const char* desired_key)
 {
-    const stringadapter_t *s = hashtable_stringadapter_t_find(strings, desired_key);
-    return s != NULL;
+    return table_get(table, find_key(desired_key)) != NULL;
+}
+
+
+/*
+ * lang_key()
+ * Interns a key of the language files, returning its id.
+ * Ids are valid in all languages, even if the key isn't defined
+ */
+langkey_t lang_key(const char* key)
+{
+    langkeyid_t* k = hashtable_langkeyid_t_find(keys, key);
+
+    if(k == NULL) {
+        k = langkeyid_create(key_count++);
+        hashtable_langkeyid_t_add(keys, key, k);
+    }
+
+    return k->id;
+}
+
+
+/*
+ * lang_getbykey()
+ * Retrieves a string of the current language given the id of its key.
+ * The returned pointer is valid until the language module is released
+ */
+const char* lang_getbykey(langkey_t key)
+{
+    const char* value = table_get(table, key);
+    return value != NULL ? value : NULL_STRING;
 }
 
 
 /* private stuff */
 
-int traverse(const parsetree_statement_t *stmt)
+int traverse(const parsetree_statement_t *stmt, void *string_table)
 {
+    langtable_t* t = (langtable_t*)string_table;
     const char* id = nanoparser_get_identifier(stmt);
     const parsetree_parameter_t *param_list = nanoparser_get_parameter_list(stmt);
     const parsetree_parameter_t *p = nanoparser_get_nth_parameter(param_list, 1);
     const char* key, *value;
-    stringadapter_t *s;
 
     if(is_untranslated_entry(stmt))
         return 0;
@@ -278,10 +327,7 @@ int traverse(const parsetree_statement_t *stmt)
     key = id;
     value = nanoparser_get_string(p);
 
-    if(NULL == (s = hashtable_stringadapter_t_find(strings, key)))
-        hashtable_stringadapter_t_add(strings, key, stringadapter_create(value));
-    else
-        stringadapter_set_data(s, value);
+    table_set(t, lang_key(key), value);
 
     return 0;
 }
@@ -326,28 +372,146 @@ bool is_untranslated_entry(const parsetree_statement_t *stmt)
     return (0 == str_icmp(id, UNTRANSLATED_STRING));
 }
 
-stringadapter_t* stringadapter_create(const char* data)
+langkeyid_t* langkeyid_create(langkey_t id)
+{
+    langkeyid_t* k = mallocx(sizeof *k);
+    k->id = id;
+    return k;
+}
+
+void langkeyid_destroy(langkeyid_t* k)
 {
-    stringadapter_t *s = mallocx(sizeof *s);
-    s->data = str_dup(data);
-    return s;
+    free(k);
 }
 
-void stringadapter_destroy(stringadapter_t *s)
+/* find the id of an interned key; returns -1 if there is no such key */
+langkey_t find_key(const char* key)
 {
-    free(s->data);
-    free(s);
+    const langkeyid_t* k = hashtable_langkeyid_t_find(keys, key);
+    return k != NULL ? k->id : -1;
 }
 
-const char* stringadapter_get_data(const stringadapter_t *s)
+/* create an empty string table */
+langtable_t* create_table(const char* filepath)
 {
-    return s->data;
+    langtable_t* t = mallocx(sizeof *t);
+
+    t->filepath = str_dup(filepath);
+    str_cpy(t->lang_id, NULL_STRING, sizeof(t->lang_id));
+    darray_init_ex(t->value, key_count);
+    t->next = NULL;
+
+    return t;
 }
 
-void stringadapter_set_data(stringadapter_t *s, const char* data)
+/* destroy a string table */
+void destroy_table(langtable_t* t)
 {
-    free(s->data);
-    s->data = str_dup(data);
+    for(int i = 0; i < darray_length(t->value); i++)
+        free(t->value[i]);
+
+    darray_release(t->value);
+    free(t->filepath);
+    free(t);
+}
+
+/* find a compiled string table */
+langtable_t* find_table(const char* filepath)
+{
+    for(langtable_t* t = compiled_tables; t != NULL; t = t->next) {
+        if(0 == str_icmp(t->filepath, filepath))
+            return t;
+    }
+
+    return NULL;
+}
+
+/* compile a language file that has gone through validation */
+langtable_t* compile_table(const char* filepath, bool is_language_extension)
+{
+    langtable_t* t = create_table(filepath);
+
+    /* Copy the strings of the default language file to fill in any missing strings */
+    if(str_icmp(filepath, DEFAULT_LANGUAGE_FILEPATH) != 0) {
+        const langtable_t* default_table = find_table(DEFAULT_LANGUAGE_FILEPATH);
+
+        if(default_table == NULL) {
+            lang_loadfile(DEFAULT_LANGUAGE_FILEPATH);
+            default_table = table;
+        }
+
+        for(int i = 0; i < darray_length(default_table->value); i++) {
+            if(default_table->value[i] != NULL)
+                table_set(t, i, default_table->value[i]);
+        }
+    }
+
+    /* Read language file to memory */
+    read_language_file(t, filepath);
+
+    /* Check if there is a language extension available */
+    if(!is_language_extension) {
+        char* extpath = path_to_language_extension(filepath);
+
+        /* There is a language extension */
+        if(asset_exists(extpath)) {
+
+            /* Load language extension */
+            logfile_message("Loading language extension at \"%s\"...", extpath);
+            read_language_file(t, extpath);
+
+        }
+        else
+            logfile_message("No language extension found at \"%s\"", extpath);
+
+        free(extpath);
+    }
+
+    /* Store the language ID */
+    const char* id = table_get(t, find_key("LANG_ID"));
+    str_cpy(t->lang_id, id != NULL ? id : NULL_STRING, sizeof(t->lang_id));
+
+    /* Add the table to the list */
+    t->next = compiled_tables;
+    compiled_tables = t;
+
+    /* done */
+    return t;
+}
+
+/* read the strings of a language file into a string table */
+void read_language_file(langtable_t* t, const char* filepath)
+{
+    const char* fullpath = asset_path(filepath);
+    parsetree_program_t* prog = nanoparser_construct_tree(fullpath);
+    nanoparser_traverse_program_ex(prog, (void*)t, traverse);
+    prog = nanoparser_deconstruct_tree(prog);
+}
+
+/* set the current string table */
+void use_table(langtable_t* t)
+{
+    table = t;
+    str_cpy(lang_id, t->lang_id, sizeof(lang_id));
+}
+
+/* get a string of a table; returns NULL if there is no such string */
+const char* table_get(const langtable_t* t, langkey_t key)
+{
+    if(t == NULL || key < 0 || key >= darray_length(t->value))
+        return NULL;
+
+    return t->value[key];
+}
+
+/* set a string of a table */
+void table_set(langtable_t* t, langkey_t key, const char* value)
+{
+    while(darray_length(t->value) <= key)
+        darray_push(t->value, NULL);
+
+    free(t->value[key]);
+    t->value[key] = str_dup(value);
 }
 
 /* replace backslashes by slashes; you'll have to free this string afterwards */
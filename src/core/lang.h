@@ -35,4 +35,9 @@ bool lang_haskey(const char* desired_key);
 void lang_compatibility(const char* filepath, int* supver, int* subver, int* wipver);
 char* lang_metadata(const char* filepath, const char* desired_key, char* dest, size_t dest_size);
 
+/* compiled string tables: keys are interned to integer ids that are valid in all languages */
+typedef int langkey_t;
+langkey_t lang_key(const char* key); /* interns a key; case-insensitive */
+const char* lang_getbykey(langkey_t key); /* O(1) lookup; returns "null" if there is no such string */
+
 #endif
@@ -20,7 +20,9 @@
 
 #include <allegro5/allegro.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include "logfile.h"
 #include "global.h"
 #include "asset.h"
@@ -51,6 +53,33 @@
 /* name of the logfile */
 #define LOGFILE_NAME            "logfile.txt"
 
+/*
+
+ASYNCHRONOUS LOGGING
+
+Writing to the logfile on the main thread is slow: it goes through PhysFS
+and used to be flushed after every message. Instead, logfile_message() only
+formats the message and appends it to a ring buffer. A logger thread drains
+the ring buffer in batches, flushing the streams periodically or whenever
+the buffer is getting full.
+
+The ring buffer is protected by a mutex that is held just for copying bytes;
+no I/O takes place while holding it. The output streams are protected by a
+separate mutex, which is held by whoever drains the ring buffer. Since only
+one thread drains at a time, the order of the messages is preserved.
+
+If the logger thread isn't running, messages are written synchronously.
+logfile_flush() writes everything synchronously, and it's used when the
+application is about to crash.
+
+*/
+
+/* ring buffer */
+#define RING_SIZE               65536 /* in bytes; a power of two */
+#define RING_HIGH_WATER         (RING_SIZE / 2) /* wake up the logger thread */
+#define FLUSH_INTERVAL          0.5 /* in seconds */
+#define DRAIN_CHUNK             4096 /* in bytes */
+
 /* error macro */
 #define ERROR(...)              fprintf(stderr, __VA_ARGS__)
 
@@ -76,7 +105,25 @@ static ALLEGRO_FILE* console = NULL;
 static bool open_console();
 static void close_console();
 
-static ALLEGRO_MUTEX* mutex = NULL;
+static ALLEGRO_MUTEX* io_mutex = NULL; /* protects the output streams */
+
+static char ring[RING_SIZE];
+static size_t ring_head = 0; /* write position */
+static size_t ring_len = 0; /* number of pending bytes */
+static bool ring_wake = false;
+static bool ring_quit = false;
+static ALLEGRO_MUTEX* ring_mutex = NULL; /* protects the ring buffer */
+static ALLEGRO_COND* ring_cond = NULL;
+static ALLEGRO_THREAD* logger = NULL;
+
+static void enqueue(const char* data, size_t size);
+static size_t dequeue(char* buffer, size_t buffer_size);
+static void drain(bool flush);
+static void drain_locked(bool flush);
+static void write_streams(const char* data, size_t size);
+static void* logger_thread(ALLEGRO_THREAD* thread, void* arg);
+static void start_logger();
+static void stop_logger();
 
 
 
@@ -91,9 +138,14 @@ static ALLEGRO_MUTEX* mutex = NULL;
  */
 void logfile_init(int flags)
 {
-    /* create a mutex */
-    if(mutex == NULL)
-        mutex = al_create_mutex();
+    /* create the mutexes */
+    if(io_mutex == NULL)
+        io_mutex = al_create_mutex();
+
+    if(ring_mutex == NULL) {
+        ring_mutex = al_create_mutex();
+        ring_cond = al_create_cond();
+    }
 
 #if !defined(__ANDROID__)
     /* open the output streams */
@@ -102,6 +154,9 @@ void logfile_init(int flags)
 
     if(flags & LOGFILE_CONSOLE)
         open_console();
+
+    /* start the logger thread */
+    start_logger();
 #else
     (void)open_logfile;
     (void)open_console;
@@ -134,30 +189,42 @@ void logfile_init(int flags)
 void logfile_message(const char* fmt, ...)
 {
 #if !defined(__ANDROID__)
-#define LOCK(mutex)     do { if((mutex) != NULL) al_lock_mutex(mutex); } while(0)
-#define UNLOCK(mutex)   do { if((mutex) != NULL) al_unlock_mutex(mutex); } while(0)
 
-    LOCK(mutex);
-    {
-        va_list args;
+    const size_t line_break_len = sizeof(LINE_BREAK) - 1;
+    char buf[1024], *line = buf;
+    va_list args, args_copy;
+    int len;
 
-        /* print the message */
-        va_start(args, fmt);
-        CALL(al_vfprintf, fmt, args);
+    /* format the message. We do this without holding any locks */
+    va_start(args, fmt);
+    va_copy(args_copy, args);
+    len = vsnprintf(buf, sizeof(buf), fmt, args);
+    if(len < 0) {
+        va_end(args_copy);
         va_end(args);
+        return;
+    }
+    else if((size_t)len + line_break_len >= sizeof(buf)) {
+        /* long message */
+        if(NULL != (line = malloc(len + line_break_len + 1)))
+            vsnprintf(line, len + 1, fmt, args_copy);
+        else
+            len = (line = buf, sizeof(buf) - line_break_len - 1); /* truncate */
+    }
+    va_end(args_copy);
+    va_end(args);
 
-        /* break line */
-        CALL(al_fputs, LINE_BREAK);
-        CALL(al_fflush);
+    /* break line.
+       "PhysFS does not support the text-mode reading and writing,
+        which means that Windows-style newlines will not be preserved."
+        https://liballeg.org/a5docs/trunk/physfs.html */
+    memcpy(line + len, LINE_BREAK, line_break_len + 1);
 
-        /* "PhysFS does not support the text-mode reading and writing,
-            which means that Windows-style newlines will not be preserved."
-            https://liballeg.org/a5docs/trunk/physfs.html */
-    }
-    UNLOCK(mutex);
+    /* enqueue the message */
+    enqueue(line, len + line_break_len);
+    if(line != buf)
+        free(line);
 
-#undef UNLOCK
-#undef LOCK
 #else
 
     va_list args;
@@ -182,20 +249,50 @@ void logfile_release(int flags)
 {
     logfile_message("tchau!");
 
+#if !defined(__ANDROID__)
+    /* write the pending messages before closing the streams */
+    drain(true);
+#endif
+
     if(flags & LOGFILE_TXT)
         close_logfile();
 
     if(flags & LOGFILE_CONSOLE)
         close_console();
 
-    if(mutex != NULL) {
-        al_destroy_mutex(mutex);
-        mutex = NULL;
+    /* we're done when no streams are left */
+    if(logfile == NULL && console == NULL) {
+        stop_logger();
+
+        if(ring_mutex != NULL) {
+            al_destroy_cond(ring_cond);
+            al_destroy_mutex(ring_mutex);
+            ring_cond = NULL;
+            ring_mutex = NULL;
+        }
+
+        if(io_mutex != NULL) {
+            al_destroy_mutex(io_mutex);
+            io_mutex = NULL;
+        }
     }
 }
 
 
 
+/*
+ * logfile_flush()
+ * Synchronously writes all pending messages. Call this before crashing
+ */
+void logfile_flush()
+{
+#if !defined(__ANDROID__)
+    drain(true);
+#endif
+}
+
+
+
 
 
 
@@ -237,10 +334,16 @@ bool open_logfile()
  */
 void close_logfile()
 {
+    if(io_mutex != NULL)
+        al_lock_mutex(io_mutex);
+
     if(logfile != NULL) {
         al_fclose(logfile);
         logfile = NULL;
     }
+
+    if(io_mutex != NULL)
+        al_unlock_mutex(io_mutex);
 }
 
 /*
@@ -278,8 +381,211 @@ bool open_console()
  */
 void close_console()
 {
+    if(io_mutex != NULL)
+        al_lock_mutex(io_mutex);
+
     if(console != NULL) {
         al_fclose(console);
         console = NULL;
     }
+
+    if(io_mutex != NULL)
+        al_unlock_mutex(io_mutex);
+}
+
+/*
+ * enqueue()
+ * Appends data to the ring buffer. If the logger thread isn't running,
+ * the data is written synchronously
+ */
+void enqueue(const char* data, size_t size)
+{
+    bool wake = false;
+
+    /* no ring buffer */
+    if(ring_mutex == NULL) {
+        write_streams(data, size);
+        return;
+    }
+
+    /* the data doesn't fit the ring buffer */
+    if(size > RING_SIZE) {
+        al_lock_mutex(io_mutex);
+        drain_locked(false);
+        write_streams(data, size);
+        al_unlock_mutex(io_mutex);
+        return;
+    }
+
+    al_lock_mutex(ring_mutex);
+
+    /* the ring buffer is full; make room on the calling thread */
+    while(size > RING_SIZE - ring_len) {
+        al_unlock_mutex(ring_mutex);
+        drain(false);
+        al_lock_mutex(ring_mutex);
+    }
+
+    /* copy the data, wrapping around the end of the buffer */
+    size_t start = ring_head;
+    size_t first = min(size, RING_SIZE - start);
+    memcpy(ring + start, data, first);
+    memcpy(ring, data + first, size - first);
+    ring_head = (start + size) & (RING_SIZE - 1);
+    ring_len += size;
+
+    /* wake up the logger thread if the buffer is getting full */
+    if(ring_len >= RING_HIGH_WATER && !ring_wake) {
+        ring_wake = true;
+        wake = true;
+    }
+
+    if(wake && logger != NULL)
+        al_signal_cond(ring_cond);
+
+    al_unlock_mutex(ring_mutex);
+
+    /* logger thread not running */
+    if(logger == NULL)
+        drain(true);
+}
+
+/*
+ * dequeue()
+ * Moves up to buffer_size bytes from the ring buffer to the given buffer.
+ * Returns the number of bytes moved. Call with ring_mutex locked
+ */
+size_t dequeue(char* buffer, size_t buffer_size)
+{
+    size_t size = min(ring_len, buffer_size);
+    size_t start = (ring_head - ring_len) & (RING_SIZE - 1);
+    size_t first = min(size, RING_SIZE - start);
+
+    memcpy(buffer, ring + start, first);
+    memcpy(buffer + first, ring, size - first);
+    ring_len -= size;
+
+    return size;
+}
+
+/*
+ * drain()
+ * Writes the contents of the ring buffer to the output streams
+ */
+void drain(bool flush)
+{
+    if(io_mutex == NULL)
+        return;
+
+    al_lock_mutex(io_mutex);
+    drain_locked(flush);
+    al_unlock_mutex(io_mutex);
+}
+
+/*
+ * drain_locked()
+ * Writes the contents of the ring buffer to the output streams.
+ * Call with io_mutex locked
+ */
+void drain_locked(bool flush)
+{
+    char chunk[DRAIN_CHUNK];
+    bool wrote = false;
+
+    if(ring_mutex == NULL)
+        return;
+
+    for(;;) {
+        al_lock_mutex(ring_mutex);
+        size_t size = dequeue(chunk, sizeof(chunk));
+        al_unlock_mutex(ring_mutex);
+
+        if(size == 0)
+            break;
+
+        write_streams(chunk, size);
+        wrote = true;
+    }
+
+    if(flush && wrote)
+        CALL(al_fflush);
+}
+
+/*
+ * write_streams()
+ * Writes data to the output streams
+ */
+void write_streams(const char* data, size_t size)
+{
+    CALL(al_fwrite, data, size);
+}
+
+/*
+ * logger_thread()
+ * Drains the ring buffer periodically or when it's getting full
+ */
+void* logger_thread(ALLEGRO_THREAD* thread, void* arg)
+{
+    (void)thread;
+    (void)arg;
+
+    al_lock_mutex(ring_mutex);
+    while(!ring_quit) {
+        ALLEGRO_TIMEOUT timeout;
+
+        /* wait */
+        al_init_timeout(&timeout, FLUSH_INTERVAL);
+        while(!ring_quit && !ring_wake) {
+            if(al_wait_cond_until(ring_cond, ring_mutex, &timeout) != 0)
+                break; /* timed out */
+        }
+        ring_wake = false;
+
+        /* write in batches */
+        al_unlock_mutex(ring_mutex);
+        drain(true);
+        al_lock_mutex(ring_mutex);
+    }
+    al_unlock_mutex(ring_mutex);
+
+    /* write any remaining messages */
+    drain(true);
+    return NULL;
+}
+
+/*
+ * start_logger()
+ * Starts the logger thread
+ */
+void start_logger()
+{
+    if(logger != NULL || ring_mutex == NULL)
+        return;
+
+    ring_quit = false;
+    ring_wake = false;
+
+    if(NULL != (logger = al_create_thread(logger_thread, NULL)))
+        al_start_thread(logger);
+    else
+        ERROR("Can't create the logger thread; logging synchronously\n");
+}
+
+/*
+ * stop_logger()
+ * Stops the logger thread, writing any pending messages
+ */
+void stop_logger()
+{
+    if(logger == NULL)
+        return;
+
+    al_lock_mutex(ring_mutex);
+    ring_quit = true;
+    al_signal_cond(ring_cond);
+    al_unlock_mutex(ring_mutex);
+
+    al_join_thread(logger, NULL);
+    al_destroy_thread(logger);
+    logger = NULL;
 }
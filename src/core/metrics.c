@@ -0,0 +1,344 @@
+/*
+ * Open Surge Engine
+ * metrics.c - live metrics for external dashboards
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <allegro5/allegro.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "metrics.h"
+#include "benchmark.h"
+#include "resourcemanager.h"
+#include "asset.h"
+#include "jobs.h"
+#include "logfile.h"
+#include "../util/util.h"
+
+/*
+
+METRICS FILE
+------------
+
+Soak tests read the metrics while the game is running. Once per second, a
+compact binary record is appended to METRICS_FILE in the user space. The file
+starts with a header that names the fields of the records:
+
+    "OSMT"                  magic (4 bytes)
+    version                 u16
+    field count             u16
+    for each field:
+        name length         u8
+        name                (name length) bytes, not terminated
+
+The header is followed by the records:
+
+    time                    f64, in seconds since the metrics were started
+    values                  f32 each, in the order of the fields
+
+All values are little-endian. Timings are averages over the sampling period,
+in milliseconds; counters have their latest values; memory is in kilobytes.
+A dashboard may follow the file as it grows. The records are written by the
+job system, so that the game thread doesn't wait for file I/O.
+
+*/
+#define METRICS_FILE            "metrics.bin"
+#define METRICS_MAGIC           "OSMT"
+#define METRICS_VERSION         1
+#define SAMPLING_PERIOD         1.0 /* in seconds */
+
+/* the fields of a record */
+enum {
+    FIELD_FRAMES,                                           /* framesteps of the sampling period */
+    FIELD_FRAME_TIME,                                       /* average frame time */
+    FIELD_MAX_FRAME_TIME,                                   /* longest frame time */
+    FIELD_SECTION,                                          /* average time of each benchmark section */
+    FIELD_COUNTER = FIELD_SECTION + BENCHMARK_MAX_SECTIONS, /* each counter */
+    FIELD_MEMORY = FIELD_COUNTER + METRIC_COUNTER_COUNT,    /* memory of each resource type */
+    FIELD_TOTAL_MEMORY = FIELD_MEMORY + RESOURCE_TYPE_COUNT,
+
+    FIELD_COUNT
+};
+
+#define RECORD_SIZE             (8 + 4 * FIELD_COUNT)
+
+static const char* COUNTER_NAME[METRIC_COUNTER_COUNT] = {
+    [METRIC_ENTITIES] = "entities",
+    [METRIC_BRICKS] = "bricks",
+    [METRIC_COLLIDERS] = "colliders",
+    [METRIC_COLLISION_PAIRS] = "collision pairs",
+    [METRIC_RENDER_ENTRIES] = "render entries",
+    [METRIC_RENDER_BATCHES] = "render batches"
+};
+
+/* metrics state */
+static bool is_enabled = false;
+static ALLEGRO_FILE* file = NULL;
+static double start_time = 0.0;
+static double period_start = 0.0;
+static double last_frame_start = 0.0;
+
+/* the sampling period */
+static int frame_count = 0;
+static double frame_time_sum = 0.0, frame_time_max = 0.0;
+static double section_time_sum[BENCHMARK_MAX_SECTIONS];
+static int counter[METRIC_COUNTER_COUNT];
+
+/* the record being written */
+static uint8_t record[RECORD_SIZE];
+static job_t* writer = NULL;
+
+static void sample(double now);
+static void write_record(void* data);
+static bool write_header();
+static const char* field_name(int field, char* buffer, size_t buffer_size);
+static uint8_t* put_f32(uint8_t* p, float value);
+static uint8_t* put_f64(uint8_t* p, double value);
+
+
+
+/*
+ * metrics_init()
+ * Initializes the metrics. If enabled, they are
+ * written to a file in the user space
+ */
+void metrics_init(bool enabled)
+{
+    is_enabled = false;
+    file = NULL;
+    writer = NULL;
+
+    if(!enabled)
+        return;
+
+    /* open the file */
+    const char* fullpath = asset_path(METRICS_FILE);
+    if(NULL == (file = al_fopen(fullpath, "wb"))) {
+        logfile_message("Can't write the metrics to %s", fullpath);
+        return;
+    }
+
+    if(!write_header()) {
+        logfile_message("Can't write the metrics to %s", fullpath);
+        al_fclose(file);
+        file = NULL;
+        return;
+    }
+
+    /* start sampling */
+    is_enabled = true;
+    start_time = period_start = al_get_time();
+    last_frame_start = 0.0;
+    frame_count = 0;
+    frame_time_sum = frame_time_max = 0.0;
+    memset(section_time_sum, 0, sizeof(section_time_sum));
+    memset(counter, 0, sizeof(counter));
+    benchmark_measure_sections(true);
+
+    logfile_message("Writing metrics to %s", fullpath);
+}
+
+/*
+ * metrics_release()
+ * Releases the metrics
+ */
+void metrics_release()
+{
+    if(!is_enabled)
+        return;
+
+    if(writer != NULL) {
+        jobs_wait(writer);
+        writer = NULL;
+    }
+
+    benchmark_measure_sections(false);
+    al_fclose(file);
+    file = NULL;
+    is_enabled = false;
+}
+
+/*
+ * metrics_is_enabled()
+ * Are we writing the metrics?
+ */
+bool metrics_is_enabled()
+{
+    return is_enabled;
+}
+
+/*
+ * metrics_frame()
+ * Samples the previous framestep. Call it after benchmark_frame()
+ */
+void metrics_frame()
+{
+    if(!is_enabled)
+        return;
+
+    double now = al_get_time();
+
+    /* sample the previous framestep */
+    if(last_frame_start > 0.0) {
+        double frame_time = 1000.0 * (now - last_frame_start);
+        frame_time_sum += frame_time;
+        frame_time_max = max(frame_time_max, frame_time);
+        frame_count++;
+
+        for(int i = 0; i < BENCHMARK_MAX_SECTIONS; i++)
+            section_time_sum[i] += benchmark_section_time((benchmarksection_t)i);
+    }
+    last_frame_start = now;
+
+    /* close the sampling period */
+    if(now - period_start >= SAMPLING_PERIOD) {
+        sample(now);
+
+        period_start = now;
+        frame_count = 0;
+        frame_time_sum = frame_time_max = 0.0;
+        memset(section_time_sum, 0, sizeof(section_time_sum));
+    }
+}
+
+/*
+ * metrics_count()
+ * Sets the current value of a counter
+ */
+void metrics_count(metriccounter_t counter_id, int value)
+{
+    if(is_enabled)
+        counter[counter_id] = value;
+}
+
+
+
+/* private stuff */
+
+/* fills the record of the sampling period and writes it in a job */
+void sample(double now)
+{
+    float value[FIELD_COUNT];
+    double n = max(frame_count, 1);
+    size_t total_memory = 0;
+
+    /* the previous record must have been written */
+    if(writer != NULL) {
+        jobs_wait(writer);
+        writer = NULL;
+    }
+
+    /* sample */
+    value[FIELD_FRAMES] = frame_count;
+    value[FIELD_FRAME_TIME] = frame_time_sum / n;
+    value[FIELD_MAX_FRAME_TIME] = frame_time_max;
+
+    for(int i = 0; i < BENCHMARK_MAX_SECTIONS; i++)
+        value[FIELD_SECTION + i] = section_time_sum[i] / n;
+
+    for(int i = 0; i < METRIC_COUNTER_COUNT; i++)
+        value[FIELD_COUNTER + i] = counter[i];
+
+    for(int i = 0; i < RESOURCE_TYPE_COUNT; i++) {
+        size_t memory = resourcemanager_memory_usage((resourcetype_t)i);
+        value[FIELD_MEMORY + i] = memory / 1024.0;
+        total_memory += memory;
+    }
+
+    value[FIELD_TOTAL_MEMORY] = total_memory / 1024.0;
+
+    /* encode the record */
+    uint8_t* p = put_f64(record, now - start_time);
+    for(int i = 0; i < FIELD_COUNT; i++)
+        p = put_f32(p, value[i]);
+
+    /* write it */
+    writer = jobs_schedule(write_record, NULL, NULL, 0);
+}
+
+/* appends the record to the file. This runs in a job */
+void write_record(void* data)
+{
+    if(al_fwrite(file, record, RECORD_SIZE) == RECORD_SIZE)
+        al_fflush(file);
+
+    (void)data;
+}
+
+/* writes the header of the file */
+bool write_header()
+{
+    char name[64];
+
+    al_fwrite(file, METRICS_MAGIC, 4);
+    al_fwrite16le(file, METRICS_VERSION);
+    al_fwrite16le(file, FIELD_COUNT);
+
+    for(int i = 0; i < FIELD_COUNT; i++) {
+        size_t length = strlen(field_name(i, name, sizeof(name)));
+        al_fputc(file, (int)length);
+        al_fwrite(file, name, length);
+    }
+
+    return !al_ferror(file) && al_fflush(file);
+}
+
+/* the name of a field of the records */
+const char* field_name(int field, char* buffer, size_t buffer_size)
+{
+    if(field == FIELD_FRAMES)
+        snprintf(buffer, buffer_size, "frames");
+    else if(field == FIELD_FRAME_TIME)
+        snprintf(buffer, buffer_size, "frame time");
+    else if(field == FIELD_MAX_FRAME_TIME)
+        snprintf(buffer, buffer_size, "max frame time");
+    else if(field < FIELD_COUNTER)
+        snprintf(buffer, buffer_size, "%s time", benchmark_section_name((benchmarksection_t)(field - FIELD_SECTION)));
+    else if(field < FIELD_MEMORY)
+        snprintf(buffer, buffer_size, "%s", COUNTER_NAME[field - FIELD_COUNTER]);
+    else if(field < FIELD_TOTAL_MEMORY)
+        snprintf(buffer, buffer_size, "%s memory", resourcemanager_type_name((resourcetype_t)(field - FIELD_MEMORY)));
+    else
+        snprintf(buffer, buffer_size, "total memory");
+
+    return buffer;
+}
+
+/* writes a little-endian float */
+uint8_t* put_f32(uint8_t* p, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    for(int i = 0; i < 4; i++)
+        *(p++) = (bits >> (8 * i)) & 0xFF;
+
+    return p;
+}
+
+/* writes a little-endian double */
+uint8_t* put_f64(uint8_t* p, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    for(int i = 0; i < 8; i++)
+        *(p++) = (bits >> (8 * i)) & 0xFF;
+
+    return p;
+}
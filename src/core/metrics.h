@@ -0,0 +1,47 @@
+/*
+ * Open Surge Engine
+ * metrics.h - live metrics for external dashboards
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <stdbool.h>
+
+/* counters reported by the subsystems */
+typedef enum metriccounter_t {
+    METRIC_ENTITIES,            /* SurgeScript entities of the level */
+    METRIC_BRICKS,              /* bricks of the level */
+    METRIC_COLLIDERS,           /* colliders tested in a framestep */
+    METRIC_COLLISION_PAIRS,     /* candidate pairs of colliders of the broadphase */
+    METRIC_RENDER_ENTRIES,      /* entries of the render queue */
+    METRIC_RENDER_BATCHES,      /* batches of the render queue */
+
+    METRIC_COUNTER_COUNT
+} metriccounter_t;
+
+/* initialization */
+void metrics_init(bool enabled); /* writes the metrics to a file in the user space if enabled */
+void metrics_release();
+bool metrics_is_enabled();
+
+/* sampling */
+void metrics_frame(); /* call at the beginning of each framestep */
+void metrics_count(metriccounter_t counter, int value); /* sets the current value of a counter */
+
+#endif
@@ -29,9 +29,11 @@
 #include "nanoparser.h"
 #include "engine.h"
 #include "global.h"
+#include "asset.h"
 #include "../util/darray.h"
 #include "../util/util.h"
 #include "../util/stringutil.h"
+#include "../util/arena.h"
 
 /*
  * nanoparser v2
@@ -99,12 +101,17 @@ struct parsetree_program_t
 };
 
 /* The root of a parse tree, which corresponds to a file. It's a program.
-   This is for backwards compatibility with the nanoparser v1 API */
+   This is for backwards compatibility with the nanoparser v1 API.
+
+   All nodes of a parse tree, including its strings, are allocated in a
+   single arena that is owned by the root. Releasing the tree is a matter
+   of destroying the arena. */
 typedef struct parsetree_root_t parsetree_root_t;
 struct parsetree_root_t
 {
     parsetree_program_t program; /* base class */
     char* filepath; /* path to the source file */
+    arena_t* arena; /* where the tree lives */
 };
 
 /* A statement is an identifier followed by a (possibly empty) list of parameters */
@@ -139,9 +146,6 @@ static const parsetree_parameter_t NULL_PARAMETER = {
 };
 
 static int traverse_adapter(const parsetree_statement_t* statement, void* user_data);
-static parsetree_program_t* release_program(parsetree_program_t* program);
-static parsetree_statement_t* release_statement(parsetree_statement_t* statement);
-static parsetree_parameter_t* release_parameter(parsetree_parameter_t* parameter);
 
 
 
@@ -170,18 +174,17 @@ static const char* TOKEN_NAME[] =
     FOREACH_TOKEN(WRITE_TOKEN_NAME)
 };
 
+/* The value of a token is a slice of the text of the lexer: it's stored as an
+   offset, because the text is a growing array. Values are null-terminated */
 typedef struct nanotoken_t nanotoken_t;
 struct nanotoken_t
 {
     nanotokentype_t type;
     int line;
-    char* value;
-    size_t value_size;
+    size_t value; /* offset in the text of the lexer */
+    size_t value_size; /* including the '\0' */
 };
 
-#define token_create(type, value, value_size, line) (nanotoken_t){ (type), (line), memcpy(malloc(value_size), (value), (value_size)), (value_size) }
-#define token_destroy(token) do { free((token).value); (token).value = NULL; } while(0)
-
 
 
 /*
@@ -194,9 +197,8 @@ struct nanotoken_t
 typedef struct nanofilestate_t nanofilestate_t;
 struct nanofilestate_t
 {
-    ALLEGRO_FILE* fp;
-    int cursor;
-    char buffer[2 * LEXER_BUFFER_SIZE];
+    const char* data; /* the contents of the file, null-terminated */
+    size_t cursor;
     int line;
     int last;
     bool locked;
@@ -207,17 +209,52 @@ struct nanolexer_t
 {
     char* filepath;
     DARRAY(nanotoken_t, token);
+    DARRAY(char, text); /* the values of all tokens, one after the other */
 };
 
 static nanolexer_t* lexer_create(const char* filepath);
 static nanolexer_t* lexer_destroy(nanolexer_t* lexer);
 
-static bool lexer_read(nanolexer_t* lexer, ALLEGRO_FILE* fp);
+static bool lexer_read(nanolexer_t* lexer, const char* data);
+static char* lexer_load(ALLEGRO_FILE* fp);
+static void lexer_push(nanolexer_t* lexer, nanotokentype_t type, const char* value, size_t value_size, int line);
 static int lexer_getc(nanofilestate_t* state);
 static int lexer_ungetc(nanofilestate_t* state);
 
 
 
+/*
+ * TOKEN CACHE
+ *
+ * The tokens of large files are stored in the application cache, keyed by
+ * a hash of the contents of the file. If the file hasn't changed, we load
+ * its tokens in bulk and skip the lexical analysis, which reads the file
+ * character by character. Small files are lexed faster than we can open
+ * a file in the cache.
+ */
+
+#define TOKEN_CACHE_DIR "scripts/" /* inside the application cache */
+#define TOKEN_CACHE_MAGIC "OSNT" /* 4 characters */
+#define TOKEN_CACHE_VERSION 1 /* increment when changing the lexer or the file format */
+#define TOKEN_CACHE_MIN_FILE_SIZE 4096 /* in bytes */
+#define TOKEN_CACHE_MAXSIZE (64 * 1024 * 1024) /* in bytes */
+
+typedef struct nanocachedtoken_t nanocachedtoken_t;
+struct nanocachedtoken_t
+{
+    uint32_t type;
+    uint32_t line;
+    uint32_t value;
+    uint32_t value_size;
+};
+
+static bool lexer_read_cache(nanolexer_t* lexer, uint64_t hash, size_t file_size);
+static void lexer_write_cache(const nanolexer_t* lexer, uint64_t hash, size_t file_size);
+static const char* token_cache_path(uint64_t hash, char* buffer, size_t buffer_size);
+static uint64_t hash_contents(const char* data, size_t size);
+
+
+
 /*
  * SYNTAX ANALYSIS
  */
@@ -227,6 +264,8 @@ struct nanoparser_t
 {
     const nanolexer_t* lexer;
     int cursor;
+    arena_t* arena; /* where the parse tree is built */
+    const char* text; /* a copy of the text of the lexer, stored in the arena */
 };
 
 static nanoparser_t* parser_create(const nanolexer_t* lexer);
@@ -276,64 +315,8 @@ parsetree_program_t* nanoparser_construct_tree(const char* filepath)
  */
 parsetree_program_t* nanoparser_deconstruct_tree(parsetree_program_t* root)
 {
-    free(((parsetree_root_t*)root)->filepath);
-    return release_program(root);
-}
-
-/*
- * release_program()
- * Release a program
- */
-parsetree_program_t* release_program(parsetree_program_t* program)
-{
-    release_statement(program->statement);
-    free(program);
-
-    return NULL;
-}
-
-/*
- * release_statement()
- * Release a list of statements
- */
-parsetree_statement_t* release_statement(parsetree_statement_t* statement)
-{
-    while(statement != NULL) {
-        parsetree_statement_t* next = statement->next;
-
-        release_parameter(statement->parameter);
-        free(statement->identifier);
-        free(statement);
-
-        statement = next;
-    }
-
-    return NULL;
-}
-
-/*
- * release_parameter()
- * Release a list of parameters
- */
-parsetree_parameter_t* release_parameter(parsetree_parameter_t* parameter)
-{
-    while(parameter != NULL) {
-        parsetree_parameter_t* next = parameter->next;
-
-        switch(parameter->type) {
-            case PARAMETER_STRING:
-                free(parameter->string);
-                break;
-
-            case PARAMETER_BLOCK:
-                release_program(parameter->program);
-                break;
-        }
-
-        free(parameter);
-        parameter = next;
-    }
-
+    /* the whole tree lives in the arena */
+    arena_destroy(((parsetree_root_t*)root)->arena);
     return NULL;
 }
 
@@ -550,27 +533,45 @@ nanolexer_t* lexer_create(const char* filepath)
         return NULL;
     }
 
+    /* read the entire file into a buffer */
+    char* data = lexer_load(fp);
+    al_fclose(fp);
+
     /* initialize the lexer */
     nanolexer_t* lexer = mallocx(sizeof *lexer);
     lexer->filepath = str_dup(filepath);
     darray_init(lexer->token);
+    darray_init(lexer->text);
+
+    /* are the tokens in the cache? */
+    size_t file_size = strlen(data);
+    bool want_cache = (file_size >= TOKEN_CACHE_MIN_FILE_SIZE && asset_is_init());
+    uint64_t hash = want_cache ? hash_contents(data, file_size) : 0;
+    if(want_cache && lexer_read_cache(lexer, hash, file_size)) {
+        free(data);
+        return lexer;
+    }
 
     /* read the tokens */
-    if(!lexer_read(lexer, fp)) {
+    if(!lexer_read(lexer, data)) {
         lexer = lexer_destroy(lexer);
-        al_fclose(fp);
+        free(data);
         crash("Can't read the tokens of %s", filepath);
         return NULL;
     }
 
+    /* store the tokens in the cache */
+    if(want_cache)
+        lexer_write_cache(lexer, hash, file_size);
+
     #if 0
     /* list tokens */
     for(int i = 0; i < darray_length(lexer->token); i++)
-        printf("% 3d. (%d,<%s>)\n", lexer->token[i].line, lexer->token[i].type, lexer->token[i].value);
+        printf("% 3d. (%d,<%s>)\n", lexer->token[i].line, lexer->token[i].type, lexer->text + lexer->token[i].value);
     #endif
 
     /* done! */
-    al_fclose(fp);
+    free(data);
     return lexer;
 }
 
@@ -580,9 +581,7 @@ nanolexer_t* lexer_create(const char* filepath)
  */
 nanolexer_t* lexer_destroy(nanolexer_t* lexer)
 {
-    for(int i = darray_length(lexer->token) - 1; i >= 0; i--)
-        token_destroy(lexer->token[i]);
-
+    darray_release(lexer->text);
     darray_release(lexer->token);
     free(lexer->filepath);
     free(lexer);
@@ -596,8 +595,6 @@ nanolexer_t* lexer_destroy(nanolexer_t* lexer)
  */
 int lexer_getc(nanofilestate_t* state)
 {
-    int* j = &(state->cursor);
-    size_t read_bytes;
     char c;
 
     if(state->locked) {
@@ -608,47 +605,208 @@ int lexer_getc(nanofilestate_t* state)
     if(state->last == '\n')
         ++state->line;
 
-    while(true) {
+    while(0 != (c = state->data[state->cursor])) {
+        ++state->cursor;
 
-        if(0 == (c = state->buffer[(*j)++])) { /* end of buffer or file */
+        /* ignore CR; physfs reads files in binary mode only */
+        if(c == '\r')
+            continue;
 
-            if(*j == LEXER_BUFFER_SIZE) {
-                /* the first buffer has been processed; now read to the second buffer */
-                /*memset(state->buffer + LEXER_BUFFER_SIZE, 0, LEXER_BUFFER_SIZE);*/
-                read_bytes = al_fread(state->fp, state->buffer + LEXER_BUFFER_SIZE, LEXER_BUFFER_SIZE - 1);
-                state->buffer[LEXER_BUFFER_SIZE + read_bytes] = 0;
-            }
-            else if(*j == 2 * LEXER_BUFFER_SIZE) {
-                /* the second buffer has been processed; now read to the first buffer */
-                /*memset(state->buffer, 0, LEXER_BUFFER_SIZE);*/
-                read_bytes = al_fread(state->fp, state->buffer, LEXER_BUFFER_SIZE - 1);
-                state->buffer[read_bytes] = 0;
-                *j = 0;
-            }
-            else {
-                /* end of file */
-                return (state->last = EOF);
-            }
+        /* we're not done reading yet */
+        return (state->last = (int)c); /* not 0 */
+    }
+
+    /* end of file */
+    return (state->last = EOF);
+}
+
+/*
+ * lexer_load()
+ * Reads the entire file into a null-terminated buffer
+ */
+char* lexer_load(ALLEGRO_FILE* fp)
+{
+    int64_t file_size = al_fsize(fp); /* may be unknown */
+    size_t capacity = (file_size >= 0 ? (size_t)file_size : LEXER_BUFFER_SIZE) + 1;
+    char* data = mallocx(capacity);
+    size_t size = 0, read_bytes;
+
+    while((read_bytes = al_fread(fp, data + size, capacity - 1 - size)) > 0) {
+        size += read_bytes;
 
-            /* end of buffer: read next char */
-            /* loop */ ;
+        if(size == capacity - 1) {
+            if(al_feof(fp))
+                break;
 
+            capacity = 2 * capacity;
+            data = reallocx(data, capacity);
         }
-        else {
+    }
 
-            /* ignore CR; physfs reads files in binary mode only */
-            if(c == '\r')
-                continue;
+    data[size] = '\0';
+    return data;
+}
 
-            /* we're not done reading yet */
-            /*putchar(c);*/
-            return (state->last = (int)c); /* not 0 */
+/*
+ * lexer_read_cache()
+ * Reads the tokens of a file from the cache. Returns false if they're not there
+ */
+bool lexer_read_cache(nanolexer_t* lexer, uint64_t hash, size_t file_size)
+{
+    char filepath[1024];
+    char magic[4];
+    uint32_t version = 0, token_count = 0, text_size = 0;
+    uint64_t stored_hash = 0, stored_file_size = 0;
+    bool success = false;
+    FILE* fp;
+
+    if(*token_cache_path(hash, filepath, sizeof(filepath)) == '\0')
+        return false;
+    else if(NULL == (fp = fopen_utf8(filepath, "rb")))
+        return false;
+
+    /* read the header */
+    if(
+        fread(magic, sizeof(magic), 1, fp) == 1 && memcmp(magic, TOKEN_CACHE_MAGIC, sizeof(magic)) == 0 &&
+        fread(&version, sizeof(version), 1, fp) == 1 && version == TOKEN_CACHE_VERSION &&
+        fread(&stored_hash, sizeof(stored_hash), 1, fp) == 1 && stored_hash == hash &&
+        fread(&stored_file_size, sizeof(stored_file_size), 1, fp) == 1 && stored_file_size == file_size &&
+        fread(&token_count, sizeof(token_count), 1, fp) == 1 && token_count > 0 &&
+        fread(&text_size, sizeof(text_size), 1, fp) == 1 && text_size > 0 &&
+        (uint64_t)token_count * sizeof(nanocachedtoken_t) + text_size <= TOKEN_CACHE_MAXSIZE
+    ) {
+        nanocachedtoken_t* cached_token = mallocx(token_count * sizeof(*cached_token));
+
+        /* read the tokens and their values */
+        darray_resize(lexer->text, text_size);
+        darray_reserve(lexer->token, token_count);
+        if(
+            fread(cached_token, sizeof(*cached_token), token_count, fp) == token_count &&
+            fread(lexer->text, 1, text_size, fp) == text_size
+        ) {
+            success = true;
+
+            /* validate */
+            for(uint32_t i = 0; i < token_count && success; i++) {
+                const nanocachedtoken_t* t = &cached_token[i];
+                nanotoken_t token = { (nanotokentype_t)t->type, (int)t->line, t->value, t->value_size };
+
+                success = (
+                    t->type < sizeof(TOKEN_NAME) / sizeof(TOKEN_NAME[0]) &&
+                    t->value_size > 0 && (uint64_t)t->value + t->value_size <= text_size &&
+                    lexer->text[t->value + t->value_size - 1] == '\0'
+                );
+
+                darray_push(lexer->token, token);
+            }
 
+            /* the syntax analysis expects an EOF token at the end */
+            success = success && lexer->token[token_count - 1].type == TOKEN_EOF;
         }
 
+        free(cached_token);
     }
 
-    return EOF;
+    fclose(fp);
+
+    /* discard invalid files */
+    if(!success) {
+        warning("Discarding an invalid cache file: %s", filepath);
+        darray_clear(lexer->token);
+        darray_clear(lexer->text);
+        al_remove_filename(filepath);
+    }
+
+    return success;
+}
+
+/*
+ * lexer_write_cache()
+ * Stores the tokens of a file in the cache
+ */
+void lexer_write_cache(const nanolexer_t* lexer, uint64_t hash, size_t file_size)
+{
+    char filepath[1024];
+    uint32_t version = TOKEN_CACHE_VERSION;
+    uint32_t token_count = darray_length(lexer->token);
+    uint32_t text_size = darray_length(lexer->text);
+    uint64_t u64_file_size = file_size;
+    FILE* fp;
+
+    if((uint64_t)token_count * sizeof(nanocachedtoken_t) + text_size > TOKEN_CACHE_MAXSIZE)
+        return;
+    else if(*token_cache_path(hash, filepath, sizeof(filepath)) == '\0')
+        return;
+    else if(NULL == (fp = fopen_utf8(filepath, "wb")))
+        return;
+
+    /* write the header */
+    bool success =
+        fwrite(TOKEN_CACHE_MAGIC, 4, 1, fp) == 1 &&
+        fwrite(&version, sizeof(version), 1, fp) == 1 &&
+        fwrite(&hash, sizeof(hash), 1, fp) == 1 &&
+        fwrite(&u64_file_size, sizeof(u64_file_size), 1, fp) == 1 &&
+        fwrite(&token_count, sizeof(token_count), 1, fp) == 1 &&
+        fwrite(&text_size, sizeof(text_size), 1, fp) == 1;
+
+    /* write the tokens and their values */
+    for(uint32_t i = 0; i < token_count && success; i++) {
+        const nanotoken_t* token = &lexer->token[i];
+        nanocachedtoken_t t = { token->type, token->line, token->value, token->value_size };
+        success = (fwrite(&t, sizeof(t), 1, fp) == 1);
+    }
+
+    success = success && (fwrite(lexer->text, 1, text_size, fp) == text_size);
+    fclose(fp);
+
+    /* don't keep partial files */
+    if(!success) {
+        warning("Can't write the cache file %s", filepath);
+        al_remove_filename(filepath);
+    }
+}
+
+/*
+ * token_cache_path()
+ * The absolute path of a file of the token cache. Returns an empty string on error
+ */
+const char* token_cache_path(uint64_t hash, char* buffer, size_t buffer_size)
+{
+    char relative_path[64];
+
+    snprintf(relative_path, sizeof(relative_path), TOKEN_CACHE_DIR "%016llx.bin", (unsigned long long)hash);
+    return asset_cache_path(relative_path, buffer, buffer_size);
+}
+
+/*
+ * hash_contents()
+ * A 64-bit FNV-1a hash of the contents of a file. The compatibility mode
+ * changes the lexical analysis, so it's part of the hash
+ */
+uint64_t hash_contents(const char* data, size_t size)
+{
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    bool legacy_mode = (engine_compatibility_version_code() < VERSION_CODE(0,6,1));
+
+    hash = (hash ^ (uint64_t)legacy_mode) * UINT64_C(0x100000001b3);
+    for(size_t i = 0; i < size; i++)
+        hash = (hash ^ (unsigned char)data[i]) * UINT64_C(0x100000001b3);
+
+    return hash;
+}
+
+/*
+ * lexer_push()
+ * Adds a token to the lexer
+ */
+void lexer_push(nanolexer_t* lexer, nanotokentype_t type, const char* value, size_t value_size, int line)
+{
+    nanotoken_t token = { type, line, darray_length(lexer->text), value_size };
+
+    for(size_t i = 0; i < value_size; i++)
+        darray_push(lexer->text, value[i]);
+
+    darray_push(lexer->token, token);
 }
 
 /*
@@ -666,25 +824,21 @@ int lexer_ungetc(nanofilestate_t* state)
  * lexer_read()
  * Reads all tokens from the file
  */
-bool lexer_read(nanolexer_t* lexer, ALLEGRO_FILE* fp)
+bool lexer_read(nanolexer_t* lexer, const char* data)
 {
     char symbol_buffer[LEXER_SYMBOL_MAXLENGTH + 1];
     int symbol_length;
     int peek, next;
-    nanotoken_t token;
     nanofilestate_t state = {
-        .fp = fp,
+        .data = data,
         .cursor = 0,
-        .buffer = { 0 },
         .line = 1,
         .last = EOF,
         .locked = false
     };
 
-    /* initialize */
-    /*memset(state.buffer, 0, LEXER_BUFFER_SIZE);*/
-    size_t read_bytes = al_fread(fp, state.buffer, LEXER_BUFFER_SIZE - 1);
-    state.buffer[read_bytes] = state.buffer[LEXER_BUFFER_SIZE - 1] = state.buffer[2 * LEXER_BUFFER_SIZE - 1] = 0;
+    /* the values of the tokens take about as much space as the file */
+    darray_reserve(lexer->text, strlen(data) + 1);
 
     /* legacy mode for backwards compatibility with nanoparser v1;
        nanoparser was rewritten on Open Surge 0.6.1 with a stricter syntax */
@@ -702,8 +856,7 @@ bool lexer_read(nanolexer_t* lexer, ALLEGRO_FILE* fp)
         /* skip spaces */
         while(EOF != (peek = lexer_getc(&state)) && isspace(peek)) {
             if(peek == '\n') {
-                token = token_create(TOKEN_LINEBREAK, "\n", 2, state.line);
-                darray_push(lexer->token, token);
+                lexer_push(lexer, TOKEN_LINEBREAK, "\n", 2, state.line);
             }
         }
 
@@ -791,14 +944,12 @@ bool lexer_read(nanolexer_t* lexer, ALLEGRO_FILE* fp)
 
             case '{':
                 /* open block */
-                token = token_create(TOKEN_BLOCKSTART, "{", 2, state.line);
-                darray_push(lexer->token, token);
+                lexer_push(lexer, TOKEN_BLOCKSTART, "{", 2, state.line);
                 break;
 
             case '}':
                 /* close block */
-                token = token_create(TOKEN_BLOCKEND, "}", 2, state.line);
-                darray_push(lexer->token, token);
+                lexer_push(lexer, TOKEN_BLOCKEND, "}", 2, state.line);
                 break;
 
             case '"':
@@ -919,8 +1070,7 @@ bool lexer_read(nanolexer_t* lexer, ALLEGRO_FILE* fp)
                 }
 
                 /* add token */
-                token = token_create(TOKEN_STRING, symbol_buffer, symbol_length, state.line);
-                darray_push(lexer->token, token);
+                lexer_push(lexer, TOKEN_STRING, symbol_buffer, symbol_length, state.line);
                 break;
             }
 
@@ -961,8 +1111,7 @@ bool lexer_read(nanolexer_t* lexer, ALLEGRO_FILE* fp)
 
                 /* add token */
                 nanotokentype_t token_type = is_identifier ? TOKEN_IDENTIFIER : TOKEN_STRING;
-                token = token_create(token_type, symbol_buffer, symbol_length, state.line);
-                darray_push(lexer->token, token);
+                lexer_push(lexer, token_type, symbol_buffer, symbol_length, state.line);
                 break;
             }
         }
@@ -970,12 +1119,10 @@ bool lexer_read(nanolexer_t* lexer, ALLEGRO_FILE* fp)
     }
 
     /* add a line break at the end to simplify the syntax analysis */
-    token = token_create(TOKEN_LINEBREAK, "\n", 2, state.line);
-    darray_push(lexer->token, token);
+    lexer_push(lexer, TOKEN_LINEBREAK, "\n", 2, state.line);
 
     /* EOF */
-    token = token_create(TOKEN_EOF, "EOF", 4, state.line);
-    darray_push(lexer->token, token);
+    lexer_push(lexer, TOKEN_EOF, "EOF", 4, state.line);
 
     /* success */
     return true;
@@ -996,6 +1143,8 @@ nanoparser_t* parser_create(const nanolexer_t* lexer)
 
     parser->lexer = lexer;
     parser->cursor = 0;
+    parser->arena = NULL;
+    parser->text = NULL;
 
     return parser;
 }
@@ -1077,9 +1226,22 @@ void parser_unmatch(nanoparser_t* parser, nanotokentype_t token_type)
  */
 parsetree_root_t* parser_parse_root(nanoparser_t* parser)
 {
+    const nanolexer_t* lexer = parser->lexer;
+    size_t filepath_size = strlen(lexer->filepath) + 1;
+
+    /* create an arena that fits the whole tree in a single block. Each token
+       generates at most one node, plus padding due to alignment */
+    size_t node_size = max(sizeof(parsetree_statement_t), sizeof(parsetree_parameter_t));
+    size_t tree_size = sizeof(parsetree_root_t) + filepath_size + darray_length(lexer->text) + darray_length(lexer->token) * (node_size + 16);
+    parser->arena = arena_create(tree_size + 64);
+
+    /* copy the values of the tokens to the arena; the nodes will reference them */
+    parser->text = memcpy(arena_alloc(parser->arena, darray_length(lexer->text)), lexer->text, darray_length(lexer->text));
+
     /* create root program */
-    parsetree_root_t* root = mallocx(sizeof *root);
-    root->filepath = str_dup(parser->lexer->filepath);
+    parsetree_root_t* root = arena_alloc(parser->arena, sizeof *root);
+    root->filepath = memcpy(arena_alloc(parser->arena, filepath_size), lexer->filepath, filepath_size);
+    root->arena = parser->arena;
 
 
 
@@ -1113,7 +1275,7 @@ parsetree_root_t* parser_parse_root(nanoparser_t* parser)
 parsetree_program_t* parser_parse_program(nanoparser_t* parser, const parsetree_program_t* parent)
 {
     /* create program */
-    parsetree_program_t* program = mallocx(sizeof *program);
+    parsetree_program_t* program = arena_alloc(parser->arena, sizeof *program);
     program->parent = parent;
 
     /* skip empty lines */
@@ -1141,14 +1303,14 @@ parsetree_statement_t* parser_parse_statement(nanoparser_t* parser, const parset
     parser_expect(parser, TOKEN_IDENTIFIER);
 
     /* read statement(s) */
-    parsetree_statement_t* head = mallocx(sizeof *head);
+    parsetree_statement_t* head = arena_alloc(parser->arena, sizeof *head);
     parsetree_statement_t* statement = head;
     do {
         const nanotoken_t* lookahead = parser_lookahead(parser);
 
         /* read the identifier */
         statement->program = program;
-        statement->identifier = memcpy(mallocx(lookahead->value_size), lookahead->value, lookahead->value_size);
+        statement->identifier = (char*)(parser->text + lookahead->value);
         statement->line = lookahead->line;
         statement->next = NULL;
         parser_match(parser, TOKEN_IDENTIFIER);
@@ -1163,7 +1325,7 @@ parsetree_statement_t* parser_parse_statement(nanoparser_t* parser, const parset
 
         /* prepare to read the next statement */
         if(parser_check(parser, TOKEN_IDENTIFIER))
-            statement->next = mallocx(sizeof *(statement->next));
+            statement->next = arena_alloc(parser->arena, sizeof *(statement->next));
 
         /* next node */
         statement = statement->next;
@@ -1190,11 +1352,11 @@ parsetree_parameter_t* parser_parse_parameter(nanoparser_t* parser, const parset
 
     if(parser_check(parser, TOKEN_STRING)) {
         /* read string */
-        parsetree_parameter_t* parameter = mallocx(sizeof *parameter);
+        parsetree_parameter_t* parameter = arena_alloc(parser->arena, sizeof *parameter);
 
         parameter->type = PARAMETER_STRING;
         parameter->statement = statement;
-        parameter->string = memcpy(mallocx(lookahead->value_size), lookahead->value, lookahead->value_size);
+        parameter->string = (char*)(parser->text + lookahead->value);
         parser_match(parser, TOKEN_STRING);
         parameter->next = parser_parse_parameter(parser, statement);
 
@@ -1202,11 +1364,11 @@ parsetree_parameter_t* parser_parse_parameter(nanoparser_t* parser, const parset
     }
     else if(parser_check(parser, TOKEN_IDENTIFIER)) {
         /* read identifier */
-        parsetree_parameter_t* parameter = mallocx(sizeof *parameter);
+        parsetree_parameter_t* parameter = arena_alloc(parser->arena, sizeof *parameter);
 
         parameter->type = PARAMETER_STRING;
         parameter->statement = statement;
-        parameter->string = memcpy(mallocx(lookahead->value_size), lookahead->value, lookahead->value_size);
+        parameter->string = (char*)(parser->text + lookahead->value);
         parser_match(parser, TOKEN_IDENTIFIER);
         parameter->next = parser_parse_parameter(parser, statement);
 
@@ -1221,7 +1383,7 @@ parsetree_parameter_t* parser_parse_parameter(nanoparser_t* parser, const parset
 
         /* read block */
         if(parser_check(parser, TOKEN_BLOCKSTART)) {
-            parsetree_parameter_t* parameter = mallocx(sizeof *parameter);
+            parsetree_parameter_t* parameter = arena_alloc(parser->arena, sizeof *parameter);
 
             parameter->type = PARAMETER_BLOCK;
             parameter->statement = statement;
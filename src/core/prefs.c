@@ -19,6 +19,8 @@
  */
 
 #include <allegro5/allegro.h>
+#include <allegro5/allegro_memfile.h>
+#include <physfs.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -38,6 +40,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
 #endif
 
 /* macros */
@@ -48,6 +52,16 @@
 /* Where are the prefs stored? */
 #define PREFS_FILE "surge.prefs"
 
+/* Changes are coalesced and written to the disk at most once per interval */
+#define PREFS_FLUSH_INTERVAL 5.0 /* in seconds */
+
+/* write the prefs in a background thread */
+#if defined(__EMSCRIPTEN__)
+#define WANT_BACKGROUND_WRITES 0
+#else
+#define WANT_BACKGROUND_WRITES 1
+#endif
+
 /* prefs structure */
 typedef enum prefstype_t prefstype_t;
 typedef struct prefslist_t prefslist_t;
@@ -81,11 +95,29 @@ struct prefslist_t
     prefslist_t* next;
 };
 
+/* a flush of the prefs in progress */
+typedef struct prefswriter_t prefswriter_t;
+struct prefswriter_t
+{
+    uint8_t* data; /* serialized prefs */
+    size_t size; /* size of data, in bytes */
+    char* fullpath; /* absolute path of the prefs file */
+#if WANT_BACKGROUND_WRITES
+    ALLEGRO_THREAD* thread;
+    ALLEGRO_MUTEX* mutex;
+    bool done;
+#endif
+};
+
 #define PREFS_MAXBUCKETS 31
 struct prefs_t
 {
     char* prefsid;
     prefslist_t* bucket[PREFS_MAXBUCKETS];
+    bool is_dirty; /* modified since the last flush? */
+    bool wants_flush; /* prefs_save() has been called since the last flush? */
+    double last_flush; /* when the prefs were last flushed, in seconds */
+    prefswriter_t* writer; /* a flush in progress, or NULL */
 };
 
 /* prefs file format */
@@ -111,7 +143,18 @@ struct pfentry_t
 
 /* private stuff */
 static int load(prefs_t* prefs);
-static int save(const prefs_t* prefs);
+static int save(prefs_t* prefs);
+static void flush(prefs_t* prefs);
+static uint8_t* serialize(const prefs_t* prefs, size_t* size);
+static char* prefs_fullpath(const char* filename);
+static bool write_atomically(const char* fullpath, const uint8_t* data, size_t size);
+static bool is_writing(prefs_t* prefs);
+static void wait_for_writer(prefs_t* prefs);
+static prefswriter_t* new_writer(uint8_t* data, size_t size, char* fullpath);
+static prefswriter_t* delete_writer(prefswriter_t* writer);
+#if WANT_BACKGROUND_WRITES
+static void* writer_thread(ALLEGRO_THREAD* thread, void* arg);
+#endif
 static uint32_t hash(const char* str);
 static int is_valid_id(const char* key);
 static inline char* clone_str(const char* str);
@@ -121,6 +164,7 @@ static prefsentry_t* new_double_entry(const char* key, double value);
 static prefsentry_t* new_null_entry(const char* key);
 static prefsentry_t* new_bool_entry(const char* key, uint8_t value);
 static prefsentry_t* delete_entry(prefsentry_t* entry);
+static bool same_entry(const prefsentry_t* a, const prefsentry_t* b);
 static prefslist_t* new_list(prefsentry_t* entry, prefslist_t* next);
 static prefslist_t* delete_list(prefslist_t* list);
 static prefsentry_t* prefs_find_entry(prefs_t* prefs, const char* key);
@@ -167,9 +211,13 @@ prefs_t* prefs_create(const char* prefsid)
     prefs->prefsid = clone_str(prefsid);
     for(i = 0; i < PREFS_MAXBUCKETS; i++)
         prefs->bucket[i] = NULL;
+    prefs->writer = NULL;
+    prefs->wants_flush = false;
+    prefs->last_flush = al_get_time();
 
     /* Load from the disk */
     load(prefs);
+    prefs->is_dirty = false;
     return prefs;
 }
 
@@ -179,8 +227,12 @@ prefs_t* prefs_create(const char* prefsid)
  */
 prefs_t* prefs_destroy(prefs_t* prefs)
 {
+    /* Wait for any pending writes */
+    wait_for_writer(prefs);
+
     /* Save to the disk */
-    save(prefs);
+    if(prefs->is_dirty)
+        save(prefs);
 
     /* Delete the instance */
     for(int i = 0; i < PREFS_MAXBUCKETS; i++)
@@ -326,6 +378,8 @@ void prefs_clear(prefs_t* prefs)
 {
     for(int i = 0; i < PREFS_MAXBUCKETS; i++)
         prefs->bucket[i] = delete_list(prefs->bucket[i]);
+
+    prefs->is_dirty = true;
 }
 
 /*
@@ -339,11 +393,57 @@ const char* prefs_id(const prefs_t* prefs)
 
 /*
  * prefs_save()
- * Saves the prefs to the disk
+ * Requests the prefs to be saved to the disk. Changes are coalesced:
+ * the actual write happens at most once every PREFS_FLUSH_INTERVAL
+ * seconds, in the background
  */
-void prefs_save(const prefs_t* prefs)
+void prefs_save(prefs_t* prefs)
 {
-    save(prefs);
+    if(!prefs->is_dirty)
+        return;
+
+    prefs->wants_flush = true;
+    prefs_update(prefs);
+}
+
+/*
+ * prefs_flush()
+ * Writes the pending changes to the disk now, without waiting for the
+ * flush interval. Call it at scene transitions
+ */
+void prefs_flush(prefs_t* prefs)
+{
+    if(!prefs->is_dirty)
+        return;
+
+    /* a previous flush is still in progress */
+    wait_for_writer(prefs);
+
+    /* flush */
+    flush(prefs);
+}
+
+/*
+ * prefs_update()
+ * Flushes the changes requested by prefs_save() when it's time to.
+ * Call it every frame
+ */
+void prefs_update(prefs_t* prefs)
+{
+    /* nothing to do */
+    if(!prefs->wants_flush || !prefs->is_dirty)
+        return;
+
+    /* coalesce changes */
+    if(al_get_time() - prefs->last_flush < PREFS_FLUSH_INTERVAL)
+        return;
+
+    /* a previous flush is still in progress */
+    if(is_writing(prefs))
+        return;
+
+    /* flush */
+    flush(prefs);
 }
 
 
@@ -413,6 +513,22 @@ prefsentry_t* new_bool_entry(const char* key, uint8_t value)
     return entry;
 }
 
+bool same_entry(const prefsentry_t* a, const prefsentry_t* b)
+{
+    if(a->type != b->type)
+        return false;
+
+    switch(a->type) {
+        case PREFS_NULL:    return true;
+        case PREFS_INT32:   return a->value.integer == b->value.integer;
+        case PREFS_FLOAT64: return a->value.real == b->value.real;
+        case PREFS_STRING:  return strcmp(a->value.text, b->value.text) == 0;
+        case PREFS_BOOL:    return a->value.boolean == b->value.boolean;
+    }
+
+    return false;
+}
+
 prefsentry_t* delete_entry(prefsentry_t* entry)
 {
     if(entry->type == PREFS_STRING)
@@ -482,6 +598,7 @@ int prefs_remove_entry(prefs_t* prefs, const char* key)
                 prev->next = l->next;
             l->next = NULL;
             delete_list(l);
+            prefs->is_dirty = true;
             return 1;
         }
         prev = l;
@@ -494,14 +611,23 @@ int prefs_remove_entry(prefs_t* prefs, const char* key)
 void prefs_add_entry(prefs_t* prefs, prefsentry_t* entry)
 {
     uint32_t h = hash(entry->key);
-    prefslist_t* l = new_list(entry, NULL);
+    prefslist_t* l;
+
+    /* Nothing has changed? Scripts often store the same value repeatedly */
+    prefsentry_t* old_entry = prefs_find_entry(prefs, entry->key);
+    if(old_entry != NULL && same_entry(old_entry, entry)) {
+        delete_entry(entry);
+        return;
+    }
 
     /* No duplicate keys are allowed */
     prefs_remove_entry(prefs, entry->key);
 
     /* setup new entry */
+    l = new_list(entry, NULL);
     l->next = prefs->bucket[h % PREFS_MAXBUCKETS];
     prefs->bucket[h % PREFS_MAXBUCKETS] = l;
+    prefs->is_dirty = true;
 }
 
 int prefs_count_entries(const prefs_t* prefs)
@@ -1036,34 +1162,275 @@ int load(prefs_t* prefs)
     return success;
 }
 
-/* save prefs to the disk */
-int save(const prefs_t* prefs)
+/* save prefs to the disk, synchronously */
+int save(prefs_t* prefs)
 {
-    const char* fullpath = asset_path(PREFS_FILE);
-    ALLEGRO_FILE* fp = al_fopen(fullpath, "wb");
+    char* fullpath = prefs_fullpath(PREFS_FILE);
+    size_t size = 0;
+    uint8_t* data = serialize(prefs, &size);
     int success = 0;
 
-    prefs_log("Saving prefs to \"%s\"...", fullpath);
+    prefs_log("Saving prefs to \"%s\"...", fullpath != NULL ? fullpath : PREFS_FILE);
 
     /* save file */
-    if(fp != NULL) {
-        if(write_header(fp, prefs)) {
-            int good = 1;
-            for(int i = 0; i < PREFS_MAXBUCKETS && good; i++) {
-                for(prefslist_t* l = prefs->bucket[i]; l != NULL && good; l = l->next)
-                    good = good && write_entry(fp, l->entry);
+    if(data != NULL) {
+        if(fullpath != NULL)
+            success = write_atomically(fullpath, data, size);
+        else {
+            /* no write dir; write to the virtual filesystem in place */
+            ALLEGRO_FILE* fp = al_fopen(asset_path(PREFS_FILE), "wb");
+            if(fp != NULL) {
+                success = (size == al_fwrite(fp, data, size));
+                al_fclose(fp);
             }
-            success = good;
+            else
+                prefs_log("Can't open prefs file for writing!");
         }
-        al_fclose(fp);
     }
-    else
-        prefs_log("Can't open prefs file for writing!");
 
     /* error? */
     if(!success)
         prefs_log("Can't save prefs to file.");
+    else
+        prefs->is_dirty = false;
+
+    /* done */
+    prefs->wants_flush = false;
+    prefs->last_flush = al_get_time();
+    free(data);
+    free(fullpath);
+    return success;
+}
+
+/* write the pending changes to the disk, in the background if possible */
+void flush(prefs_t* prefs)
+{
+    char* fullpath = prefs_fullpath(PREFS_FILE);
+    size_t size = 0;
+    uint8_t* data;
+
+    assertx(prefs->writer == NULL);
+
+    /* can't write in the background */
+    if(!WANT_BACKGROUND_WRITES || fullpath == NULL) {
+        free(fullpath);
+        save(prefs);
+        return;
+    }
+
+    /* take a snapshot of the prefs */
+    if(NULL == (data = serialize(prefs, &size))) {
+        prefs_log("Can't save prefs to file.");
+        free(fullpath);
+        return;
+    }
+
+    /* write the snapshot; the writer takes ownership of data and fullpath */
+    prefs_log("Saving prefs to \"%s\" in the background...", fullpath);
+    prefs->writer = new_writer(data, size, fullpath);
+    prefs->is_dirty = false;
+    prefs->wants_flush = false;
+    prefs->last_flush = al_get_time();
+}
+
+/* serialize the prefs to a new memory buffer */
+uint8_t* serialize(const prefs_t* prefs, size_t* size)
+{
+    const size_t header_size = 10 + 2 + 3 * sizeof(uint32_t);
+    size_t capacity = header_size;
+    int success = 1;
+
+    /* compute an upper bound for the size of the data */
+    for(int i = 0; i < PREFS_MAXBUCKETS; i++) {
+        for(prefslist_t* l = prefs->bucket[i]; l != NULL; l = l->next) {
+            const prefsentry_t* entry = l->entry;
+            size_t value_size = (entry->type == PREFS_STRING) ? strlen(entry->value.text) : 32;
+            capacity += 1 + sizeof(uint32_t) + strlen(entry->key) + 1 + value_size;
+        }
+    }
+
+    /* write to memory */
+    uint8_t* data = mallocx(capacity);
+    ALLEGRO_FILE* fp = al_open_memfile(data, capacity, "wb");
+    if(fp == NULL) {
+        free(data);
+        return NULL;
+    }
+
+    if(write_header(fp, prefs)) {
+        for(int i = 0; i < PREFS_MAXBUCKETS && success; i++) {
+            for(prefslist_t* l = prefs->bucket[i]; l != NULL && success; l = l->next)
+                success = success && write_entry(fp, l->entry);
+        }
+    }
+    else
+        success = 0;
+
+    *size = al_ftell(fp);
+    al_fclose(fp);
+
+    /* error? */
+    if(!success) {
+        free(data);
+        return NULL;
+    }
 
     /* done */
+    return data;
+}
+
+/* the absolute path of a file in the write dir, or NULL if there is none.
+   The returned string must be freed */
+char* prefs_fullpath(const char* filename)
+{
+    const char* writedir = PHYSFS_getWriteDir();
+    if(writedir == NULL)
+        return NULL;
+
+    const char* separator = PHYSFS_getDirSeparator();
+    size_t writedir_length = strlen(writedir);
+    size_t separator_length = strlen(separator);
+    size_t filename_length = strlen(filename);
+    char* fullpath = mallocx(writedir_length + separator_length + filename_length + 1);
+
+    memcpy(fullpath, writedir, writedir_length);
+    if(writedir_length < separator_length || 0 != strcmp(writedir + writedir_length - separator_length, separator)) {
+        memcpy(fullpath + writedir_length, separator, separator_length);
+        writedir_length += separator_length;
+    }
+    memcpy(fullpath + writedir_length, filename, filename_length + 1);
+
+    return fullpath;
+}
+
+/* write data to a temporary file and then replace the prefs file with it.
+   The prefs file is never left half-written. This is thread-safe */
+bool write_atomically(const char* fullpath, const uint8_t* data, size_t size)
+{
+    size_t length = strlen(fullpath);
+    char* tmppath = mallocx(length + 5);
+    bool success = false;
+    FILE* fp;
+
+    memcpy(tmppath, fullpath, length);
+    memcpy(tmppath + length, ".tmp", 5);
+
+    /* write the temporary file */
+    if(NULL != (fp = fopen(tmppath, "wb"))) {
+        success = (size == fwrite(data, 1, size, fp));
+        success = (0 == fflush(fp)) && success;
+#if defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__))
+        success = (0 == fsync(fileno(fp))) && success;
+#endif
+        success = (0 == fclose(fp)) && success;
+    }
+
+    /* replace the prefs file */
+    if(success) {
+#if defined(_WIN32)
+        success = (0 != MoveFileExA(tmppath, fullpath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH));
+#else
+        success = (0 == rename(tmppath, fullpath));
+#endif
+    }
+
+    /* error? */
+    if(!success) {
+        prefs_log("Can't write prefs file \"%s\": %s", tmppath, strerror(errno));
+        remove(tmppath);
+    }
+
+    /* done */
+    free(tmppath);
     return success;
-}
\ No newline at end of file
+}
+
+/* is a flush in progress? Finished flushes are cleaned up */
+bool is_writing(prefs_t* prefs)
+{
+    if(prefs->writer == NULL)
+        return false;
+
+#if WANT_BACKGROUND_WRITES
+    bool done;
+    al_lock_mutex(prefs->writer->mutex);
+    done = prefs->writer->done;
+    al_unlock_mutex(prefs->writer->mutex);
+
+    if(!done)
+        return true;
+#endif
+
+    prefs->writer = delete_writer(prefs->writer);
+    return false;
+}
+
+/* wait for a flush in progress, if any */
+void wait_for_writer(prefs_t* prefs)
+{
+    if(prefs->writer != NULL)
+        prefs->writer = delete_writer(prefs->writer);
+}
+
+/* start writing data to fullpath. Takes ownership of both */
+prefswriter_t* new_writer(uint8_t* data, size_t size, char* fullpath)
+{
+    prefswriter_t* writer = mallocx(sizeof *writer);
+
+    writer->data = data;
+    writer->size = size;
+    writer->fullpath = fullpath;
+
+#if WANT_BACKGROUND_WRITES
+    writer->done = false;
+    writer->mutex = al_create_mutex();
+    writer->thread = al_create_thread(writer_thread, writer);
+    if(writer->thread != NULL && writer->mutex != NULL) {
+        al_start_thread(writer->thread);
+        return writer;
+    }
+
+    /* can't create a thread; write now */
+    prefs_log("Can't create the prefs writer thread");
+    if(writer->thread != NULL) {
+        al_destroy_thread(writer->thread);
+        writer->thread = NULL;
+    }
+    writer->done = true;
+#endif
+
+    write_atomically(writer->fullpath, writer->data, writer->size);
+    return writer;
+}
+
+/* wait for the writer to finish and destroy it */
+prefswriter_t* delete_writer(prefswriter_t* writer)
+{
+#if WANT_BACKGROUND_WRITES
+    if(writer->thread != NULL)
+        al_destroy_thread(writer->thread); /* joins the thread */
+    if(writer->mutex != NULL)
+        al_destroy_mutex(writer->mutex);
+#endif
+
+    free(writer->fullpath);
+    free(writer->data);
+    free(writer);
+    return NULL;
+}
+
+#if WANT_BACKGROUND_WRITES
+/* the writer thread */
+void* writer_thread(ALLEGRO_THREAD* thread, void* arg)
+{
+    prefswriter_t* writer = (prefswriter_t*)arg;
+
+    write_atomically(writer->fullpath, writer->data, writer->size);
+
+    al_lock_mutex(writer->mutex);
+    writer->done = true;
+    al_unlock_mutex(writer->mutex);
+
+    return NULL;
+}
+#endif
@@ -41,7 +41,9 @@ void prefs_set_bool(prefs_t* prefs, const char* key, bool value);
 
 /* utilities */
 const char* prefs_id(const prefs_t* prefs);
-void prefs_save(const prefs_t* prefs); /* persist the data */
+void prefs_save(prefs_t* prefs); /* persist the data (changes are coalesced and written in the background) */
+void prefs_flush(prefs_t* prefs); /* persist the data now */
+void prefs_update(prefs_t* prefs); /* call every frame */
 char prefs_item_type(prefs_t* prefs, const char* key); /* '\0', 's', 'i', 'f', 'b', '?' (unknown), '-' (not found) */
 bool prefs_has_item(prefs_t* prefs, const char* key);
 bool prefs_delete_item(prefs_t* prefs, const char* key);
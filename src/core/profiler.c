@@ -0,0 +1,365 @@
+/*
+ * Open Surge Engine
+ * profiler.c - a lightweight frame profiler
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_primitives.h>
+#include <allegro5/allegro_font.h>
+#include <stdint.h>
+#include <string.h>
+#include "profiler.h"
+#include "resourcemanager.h"
+#include "gputimer.h"
+#include "logfile.h"
+#include "../util/util.h"
+
+/*
+
+The profiler records nested zones delimited by profiler_begin() and
+profiler_end(). The zones of the last PROFILER_FRAMES framesteps are kept
+in a ring buffer. Nothing is recorded unless the profiler is enabled.
+
+*/
+
+#define PROFILER_FRAMES         120 /* number of framesteps kept in the ring buffer */
+#define PROFILER_MAX_ZONES      256 /* maximum number of zones per framestep */
+#define PROFILER_MAX_DEPTH      16  /* maximum nesting depth */
+#define TARGET_FRAME_TIME       (1.0 / 60.0) /* in seconds */
+
+/* a zone of a framestep */
+typedef struct profilerzone_t profilerzone_t;
+struct profilerzone_t {
+    const char* name; /* a string literal */
+    double start_time; /* in seconds */
+    double end_time;
+    int depth;
+};
+
+/* a framestep */
+typedef struct profilerframe_t profilerframe_t;
+struct profilerframe_t {
+    double start_time; /* in seconds */
+    double end_time;
+    profilerzone_t zone[PROFILER_MAX_ZONES];
+    int zone_count;
+};
+
+/* profiler state */
+static bool is_enabled = false;
+static profilerframe_t* frame = NULL; /* ring buffer */
+static int current_frame = 0; /* index of the frame being recorded */
+static int frame_count = 0; /* number of recorded frames, up to PROFILER_FRAMES */
+static int stack[PROFILER_MAX_DEPTH]; /* indices of the open zones of the current frame */
+static int stack_size = 0;
+static int skipped_zones = 0; /* zones that did not fit the current frame */
+static ALLEGRO_FONT* font = NULL;
+
+static void clear_frames();
+static ALLEGRO_COLOR zone_color(const char* name);
+
+
+
+/*
+ * profiler_init()
+ * Initializes the profiler
+ */
+void profiler_init()
+{
+    logfile_message("Initializing the profiler...");
+
+    frame = mallocx(PROFILER_FRAMES * sizeof(*frame));
+    clear_frames();
+    is_enabled = false;
+    font = NULL;
+}
+
+/*
+ * profiler_release()
+ * Releases the profiler
+ */
+void profiler_release()
+{
+    logfile_message("Releasing the profiler...");
+
+    if(font != NULL) {
+        al_destroy_font(font);
+        font = NULL;
+    }
+
+    if(is_enabled)
+        gputimer_enable(false);
+
+    free(frame);
+    frame = NULL;
+    is_enabled = false;
+}
+
+/*
+ * profiler_begin()
+ * Opens a zone of the current framestep
+ */
+void profiler_begin(const char* zone_name)
+{
+    if(!is_enabled)
+        return;
+
+    profilerframe_t* f = &frame[current_frame];
+
+    /* no room for this zone */
+    if(f->zone_count >= PROFILER_MAX_ZONES || stack_size >= PROFILER_MAX_DEPTH) {
+        skipped_zones++;
+        return;
+    }
+
+    /* open the zone */
+    profilerzone_t* zone = &f->zone[f->zone_count];
+    zone->name = zone_name;
+    zone->depth = stack_size;
+    zone->start_time = zone->end_time = al_get_time();
+    stack[stack_size++] = f->zone_count++;
+}
+
+/*
+ * profiler_end()
+ * Closes the innermost open zone of the current framestep
+ */
+void profiler_end()
+{
+    if(!is_enabled)
+        return;
+
+    /* this zone was skipped */
+    if(skipped_zones > 0) {
+        skipped_zones--;
+        return;
+    }
+
+    /* close the zone */
+    if(stack_size > 0) {
+        profilerframe_t* f = &frame[current_frame];
+        f->zone[stack[--stack_size]].end_time = al_get_time();
+    }
+}
+
+/*
+ * profiler_frame()
+ * Closes the current framestep and starts a new one
+ */
+void profiler_frame()
+{
+    if(!is_enabled)
+        return;
+
+    double now = al_get_time();
+
+    /* close the open zones */
+    while(stack_size > 0)
+        frame[current_frame].zone[stack[--stack_size]].end_time = now;
+    skipped_zones = 0;
+
+    /* close the current framestep */
+    frame[current_frame].end_time = now;
+    if(frame[current_frame].start_time > 0.0)
+        frame_count = min(frame_count + 1, PROFILER_FRAMES);
+
+    /* start a new framestep */
+    current_frame = (current_frame + 1) % PROFILER_FRAMES;
+    frame[current_frame].start_time = now;
+    frame[current_frame].end_time = now;
+    frame[current_frame].zone_count = 0;
+}
+
+/*
+ * profiler_toggle()
+ * Starts or stops profiling. Returns true if profiling
+ */
+bool profiler_toggle()
+{
+    if(frame == NULL)
+        return false;
+
+    is_enabled = !is_enabled;
+    logfile_message("The profiler is %s", is_enabled ? "enabled" : "disabled");
+
+    /* measure GPU time while profiling */
+    gputimer_enable(is_enabled);
+
+    if(is_enabled)
+        clear_frames();
+
+    return is_enabled;
+}
+
+/*
+ * profiler_is_enabled()
+ * Are we profiling?
+ */
+bool profiler_is_enabled()
+{
+    return is_enabled;
+}
+
+/*
+ * profiler_render()
+ * Renders the zones of the last complete framestep as flame bars,
+ * in window space. The width of the display corresponds to two
+ * target frame times
+ */
+void profiler_render()
+{
+    const float bar_height = 12.0f;
+    const float margin = 4.0f;
+
+    if(!is_enabled || frame_count == 0)
+        return;
+
+    ALLEGRO_BITMAP* target = al_get_target_bitmap();
+    float width = al_get_bitmap_width(target) - 2.0f * margin;
+    float scale = width / (2.0 * TARGET_FRAME_TIME); /* pixels per second */
+    const profilerframe_t* f = &frame[(current_frame + PROFILER_FRAMES - 1) % PROFILER_FRAMES];
+
+    /* create the font */
+    if(font == NULL)
+        font = al_create_builtin_font();
+
+    /* background */
+    al_draw_filled_rectangle(margin, margin, margin + width, margin + bar_height * PROFILER_MAX_DEPTH / 2, al_map_rgba(0, 0, 0, 160));
+
+    /* zones */
+    for(int i = 0; i < f->zone_count; i++) {
+        const profilerzone_t* zone = &f->zone[i];
+        float x1 = margin + (zone->start_time - f->start_time) * scale;
+        float x2 = margin + (zone->end_time - f->start_time) * scale;
+        float y1 = margin + zone->depth * bar_height;
+        float y2 = y1 + bar_height - 1.0f;
+
+        if(x1 >= margin + width)
+            continue;
+        x2 = min(max(x2, x1 + 1.0f), margin + width);
+
+        al_draw_filled_rectangle(x1, y1, x2, y2, zone_color(zone->name));
+        if(font != NULL && x2 - x1 > 8.0f * (float)strlen(zone->name))
+            al_draw_text(font, al_map_rgb(255, 255, 255), x1 + 2.0f, y1 + 2.0f, ALLEGRO_ALIGN_INTEGER, zone->name);
+    }
+
+    /* the target frame time */
+    float x = margin + TARGET_FRAME_TIME * scale;
+    al_draw_line(x, margin, x, margin + bar_height * PROFILER_MAX_DEPTH / 2, al_map_rgb(255, 0, 0), 1.0f);
+
+    /* frame time */
+    if(font != NULL) {
+        al_draw_textf(font, al_map_rgb(255, 255, 255), margin, margin + bar_height * PROFILER_MAX_DEPTH / 2 + 2.0f, ALLEGRO_ALIGN_INTEGER,
+            "frame: %.2f ms", 1000.0 * (f->end_time - f->start_time));
+    }
+
+    /* GPU time, measured a few frames ago */
+    if(font != NULL && gputimer_is_enabled()) {
+        float y = margin + bar_height * PROFILER_MAX_DEPTH / 2 + 2.0f;
+        for(int i = 0; i < gputimer_zone_count(); i++) {
+            y += bar_height;
+            al_draw_textf(font, al_map_rgb(255, 255, 0), margin, y, ALLEGRO_ALIGN_INTEGER,
+                "gpu %s: %.2f ms", gputimer_zone_name(i), gputimer_zone_time(i));
+        }
+    }
+
+    /* memory usage of the resources */
+    if(font != NULL) {
+        float y = margin + bar_height * PROFILER_MAX_DEPTH / 2 + 2.0f;
+        for(resourcetype_t type = 0; type < RESOURCE_TYPE_COUNT; type++) {
+            y += bar_height;
+            al_draw_textf(font, al_map_rgb(255, 255, 255), margin + width, y, ALLEGRO_ALIGN_RIGHT | ALLEGRO_ALIGN_INTEGER,
+                "%s: %.1f MB (peak %.1f MB)",
+                resourcemanager_type_name(type),
+                resourcemanager_memory_usage(type) / 1048576.0,
+                resourcemanager_peak_memory_usage(type) / 1048576.0
+            );
+        }
+    }
+}
+
+/*
+ * profiler_export()
+ * Exports the captured framesteps to a JSON file in the Chrome trace
+ * event format. Open it with chrome://tracing or with Perfetto.
+ * filepath is in the virtual filesystem. Returns true on success
+ */
+bool profiler_export(const char* filepath)
+{
+    ALLEGRO_FILE* fp;
+    bool first = true;
+
+    if(frame == NULL || frame_count == 0)
+        return false;
+
+    if(NULL == (fp = al_fopen(filepath, "w"))) {
+        logfile_message("Can't export the profile to \"%s\"", filepath);
+        return false;
+    }
+
+    al_fputs(fp, "{\"traceEvents\":[\n");
+
+    /* for each complete framestep, from the oldest to the newest */
+    for(int k = frame_count; k >= 1; k--) {
+        const profilerframe_t* f = &frame[(current_frame + PROFILER_FRAMES - k) % PROFILER_FRAMES];
+
+        al_fprintf(fp, "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+            first ? "" : ",\n", 1e6 * f->start_time, 1e6 * (f->end_time - f->start_time));
+        first = false;
+
+        for(int i = 0; i < f->zone_count; i++) {
+            const profilerzone_t* zone = &f->zone[i];
+            al_fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                zone->name, 1e6 * zone->start_time, 1e6 * (zone->end_time - zone->start_time));
+        }
+    }
+
+    al_fputs(fp, "\n]}\n");
+    al_fclose(fp);
+
+    logfile_message("Exported %d frames to \"%s\"", frame_count, filepath);
+    return true;
+}
+
+
+
+/* private stuff */
+
+/* clears the ring buffer */
+void clear_frames()
+{
+    for(int i = 0; i < PROFILER_FRAMES; i++) {
+        frame[i].start_time = frame[i].end_time = 0.0;
+        frame[i].zone_count = 0;
+    }
+
+    current_frame = 0;
+    frame_count = 0;
+    stack_size = 0;
+    skipped_zones = 0;
+}
+
+/* a color for a zone, based on its name */
+ALLEGRO_COLOR zone_color(const char* name)
+{
+    uint32_t h = 2166136261u; /* FNV-1a */
+    while(*name)
+        h = (h ^ (unsigned char)(*name++)) * 16777619u;
+
+    return al_map_rgb(64 + (h & 127), 64 + ((h >> 8) & 127), 64 + ((h >> 16) & 127));
+}
@@ -0,0 +1,41 @@
+/*
+ * Open Surge Engine
+ * profiler.h - a lightweight frame profiler
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <stdbool.h>
+
+/* initialization */
+void profiler_init();
+void profiler_release();
+
+/* zones: pass a string literal to profiler_begin() and pair it with profiler_end() */
+void profiler_begin(const char* zone_name);
+void profiler_end();
+void profiler_frame(); /* call at the beginning of each framestep */
+
+/* utilities */
+bool profiler_toggle(); /* start/stop profiling; returns true if profiling */
+bool profiler_is_enabled();
+void profiler_render(); /* render the flame bars in window space */
+bool profiler_export(const char* filepath); /* export the captured frames to Chrome trace JSON */
+
+#endif
@@ -35,6 +35,33 @@ static HASHTABLE(sound_t, samples);
 static HASHTABLE(music_t, musics);
 static bool is_valid = false; /* validity flag */
 
+/* incremental garbage collection */
+static const int SWEEP_BUCKETS = 4; /* buckets of each table visited per call; a full sweep takes ~3 seconds at 60 fps */
+static const int SWEEP_GRACE = 2; /* unreferenced resources survive this many full sweeps, so that they aren't reloaded if they're quickly referenced again (e.g., level restarts) */
+
+/* memory usage telemetry. This is updated in the main thread only */
+static size_t memory_usage[RESOURCE_TYPE_COUNT] = { 0 };
+static size_t peak_memory_usage[RESOURCE_TYPE_COUNT] = { 0 };
+static const char* RESOURCE_TYPE_NAME[] = {
+    [RESOURCE_IMAGE] = "images",
+    [RESOURCE_SAMPLE] = "samples",
+    [RESOURCE_MUSIC] = "musics",
+    [RESOURCE_SPRITE] = "sprites",
+    [RESOURCE_COLLISIONMASK] = "collision masks",
+    [RESOURCE_IMAGE_POOL] = "image pool"
+};
+
+/* texture format of the images, per platform. Compressed textures are
+   only used if the GPU supports them and if the game ships them */
+#if defined(__EMSCRIPTEN__)
+static textureformat_t texture_format = TEXTUREFORMAT_UNCOMPRESSED; /* WebGL exposes S3TC under a different name */
+#else
+static textureformat_t texture_format = TEXTUREFORMAT_BC;
+#endif
+
+/* level of detail of the large images. Selected at startup */
+static texturedetail_t texture_detail = TEXTUREDETAIL_FULL;
+
 
 /* public methods */
 
@@ -68,6 +95,15 @@ void resourcemanager_release_unused_resources()
     }
 }
 
+void resourcemanager_sweep_unused_resources()
+{
+    if(is_valid) {
+        hashtable_image_t_sweep_unreferenced_entries(images, SWEEP_BUCKETS, SWEEP_GRACE);
+        hashtable_sound_t_sweep_unreferenced_entries(samples, SWEEP_BUCKETS, SWEEP_GRACE);
+        hashtable_music_t_sweep_unreferenced_entries(musics, SWEEP_BUCKETS, SWEEP_GRACE);
+    }
+}
+
 bool resourcemanager_is_initialized()
 {
     return is_valid;
@@ -158,3 +194,77 @@ int resourcemanager_unref_sample(const char *key)
 {
     return is_valid ? hashtable_sound_t_unref(samples, key) : 0;
 }
+
+
+
+/* ------- memory usage telemetry ------- */
+void resourcemanager_track_memory(resourcetype_t type, int64_t bytes)
+{
+    if(bytes >= 0) {
+        memory_usage[type] += (size_t)bytes;
+        if(memory_usage[type] > peak_memory_usage[type])
+            peak_memory_usage[type] = memory_usage[type];
+    }
+    else if((size_t)(-bytes) <= memory_usage[type])
+        memory_usage[type] -= (size_t)(-bytes);
+    else
+        memory_usage[type] = 0; /* this shouldn't happen */
+}
+
+size_t resourcemanager_memory_usage(resourcetype_t type)
+{
+    return memory_usage[type];
+}
+
+size_t resourcemanager_peak_memory_usage(resourcetype_t type)
+{
+    return peak_memory_usage[type];
+}
+
+void resourcemanager_reset_peak_memory_usage()
+{
+    for(int i = 0; i < RESOURCE_TYPE_COUNT; i++)
+        peak_memory_usage[i] = memory_usage[i];
+}
+
+void resourcemanager_log_memory_usage(const char* context)
+{
+    size_t total = 0, total_peak = 0;
+
+    logfile_message("Memory usage of the resources (%s):", context);
+    for(int i = 0; i < RESOURCE_TYPE_COUNT; i++) {
+        logfile_message("    %-16s %8.1f KB (peak: %8.1f KB)", RESOURCE_TYPE_NAME[i], memory_usage[i] / 1024.0, peak_memory_usage[i] / 1024.0);
+        total += memory_usage[i];
+        total_peak += peak_memory_usage[i];
+    }
+    logfile_message("    %-16s %8.1f KB (sum of peaks: %8.1f KB)", "total", total / 1024.0, total_peak / 1024.0);
+}
+
+const char* resourcemanager_type_name(resourcetype_t type)
+{
+    return RESOURCE_TYPE_NAME[type];
+}
+
+/* ------ texture format -------- */
+
+void resourcemanager_set_texture_format(textureformat_t format)
+{
+    texture_format = format;
+}
+
+textureformat_t resourcemanager_texture_format()
+{
+    return texture_format;
+}
+
+/* ------ texture detail -------- */
+
+void resourcemanager_set_texture_detail(texturedetail_t detail)
+{
+    texture_detail = detail;
+}
+
+texturedetail_t resourcemanager_texture_detail()
+{
+    return texture_detail;
+}
@@ -22,6 +22,8 @@
 #define _RESOURCEMANAGER_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /* forward declarations */
 struct image_t;
@@ -32,6 +34,7 @@ struct music_t;
 void resourcemanager_init(); /* initializes the resource manager */
 void resourcemanager_release(); /* releases the resource manager */
 void resourcemanager_release_unused_resources(); /* memory optimization: reference counting */
+void resourcemanager_sweep_unused_resources(); /* incremental version of the above: call it every frame */
 bool resourcemanager_is_initialized(); /* is the resource manager initialized? */
 
 /* data handling */
@@ -51,4 +54,41 @@ struct sound_t* resourcemanager_find_sample(const char *key);
 int resourcemanager_ref_sample(const char *key);
 int resourcemanager_unref_sample(const char *key);
 
+/* memory usage telemetry */
+typedef enum resourcetype_t {
+    RESOURCE_IMAGE,             /* pixel data of images and texture atlas pages */
+    RESOURCE_SAMPLE,            /* PCM data of sound effects */
+    RESOURCE_MUSIC,             /* buffers of streamed musics */
+    RESOURCE_SPRITE,            /* sprite metadata (the pixel data is accounted as images) */
+    RESOURCE_COLLISIONMASK,     /* collision masks, integral masks and ground maps */
+    RESOURCE_IMAGE_POOL,        /* render targets kept for recycling (see image_create()) */
+
+    RESOURCE_TYPE_COUNT
+} resourcetype_t;
+
+void resourcemanager_track_memory(resourcetype_t type, int64_t bytes); /* bytes > 0: allocation; bytes < 0: deallocation */
+size_t resourcemanager_memory_usage(resourcetype_t type); /* in bytes */
+size_t resourcemanager_peak_memory_usage(resourcetype_t type); /* in bytes */
+void resourcemanager_reset_peak_memory_usage(); /* peak := current */
+void resourcemanager_log_memory_usage(const char* context); /* prints a summary */
+const char* resourcemanager_type_name(resourcetype_t type);
+
+/* texture format of the images */
+typedef enum textureformat_t {
+    TEXTUREFORMAT_UNCOMPRESSED, /* decode the images into 32-bit RGBA textures */
+    TEXTUREFORMAT_BC            /* use BC1/BC3 (DXT) compressed textures where available */
+} textureformat_t;
+
+void resourcemanager_set_texture_format(textureformat_t format); /* affects the images loaded afterwards */
+textureformat_t resourcemanager_texture_format();
+
+/* level of detail of the large images */
+typedef enum texturedetail_t {
+    TEXTUREDETAIL_FULL,         /* use the images at their original resolution */
+    TEXTUREDETAIL_HALF          /* use half-resolution variants of the large images (low-end devices) */
+} texturedetail_t;
+
+void resourcemanager_set_texture_detail(texturedetail_t detail); /* affects the images loaded afterwards */
+texturedetail_t resourcemanager_texture_detail();
+
 #endif
@@ -18,20 +18,72 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_physfs.h>
 #include <stdio.h>
+#include <string.h>
 #include "screenshot.h"
 #include "asset.h"
 #include "logfile.h"
 #include "image.h"
 #include "video.h"
 #include "input.h"
+#include "../util/util.h"
+#include "../util/stringutil.h"
+
+/*
+
+Screenshots and captured frames are read back from the GPU in the main thread
+and placed in a ring of frame buffers. A worker thread encodes the screenshots
+to PNG and streams the captured frames to a file, so that the game doesn't
+freeze. If the worker falls behind, captured frames are dropped.
+
+The captured frames are raw RGBA data at the size of the screen. Convert them
+with ffmpeg -f rawvideo -pixel_format rgba -video_size WxH -framerate 60 -i ...
+
+*/
+
+/* a frame waiting to be processed by the worker */
+typedef enum framejobtype_t framejobtype_t;
+enum framejobtype_t {
+    JOB_SCREENSHOT, /* encode to PNG */
+    JOB_CAPTURE     /* append to the capture file */
+};
+
+typedef struct framejob_t framejob_t;
+struct framejob_t {
+    framejobtype_t type;
+    unsigned char* pixels; /* width * height * 4 bytes */
+    int width, height;
+    size_t capacity; /* size of the pixels buffer, in bytes */
+    char fullpath[1024]; /* screenshots only */
+};
 
 /* private data */
+#define RING_SIZE 8 /* number of frame buffers */
 static const char* screenshot_filename(int screenshot_id);
+static const char* capture_filename(int capture_id);
 static const int MAX_SCREENSHOTS = 1000000;
 static int next_screenshot_id = 0;
+static int next_capture_id = 0;
 static input_t *in;
 
+/* worker */
+static ALLEGRO_THREAD* worker = NULL;
+static ALLEGRO_MUTEX* mutex = NULL; /* protects the ring and the capture file */
+static ALLEGRO_COND* cond = NULL;
+static framejob_t ring[RING_SIZE];
+static int ring_head = 0; /* next job to be processed */
+static int ring_count = 0; /* number of queued jobs */
+static ALLEGRO_FILE* capture_file = NULL; /* written by the worker */
+static bool is_capturing = false;
+static int captured_frames = 0;
+static int dropped_frames = 0;
+static void* work(ALLEGRO_THREAD* thread, void* arg);
+static bool enqueue(framejobtype_t type, const char* fullpath);
+static void save_screenshot(const framejob_t* job);
+static void wait_for_worker();
+
 /*
  * screenshot_init()
  * Initializes the screenshot module
@@ -44,26 +96,50 @@ void screenshot_init()
     /* What's the next screenshot? */
     while(asset_exists(screenshot_filename(next_screenshot_id)) &&
     ++next_screenshot_id < MAX_SCREENSHOTS);
+
+    /* What's the next capture? */
+    while(asset_exists(capture_filename(next_capture_id)) &&
+    ++next_capture_id < MAX_SCREENSHOTS);
+
+    /* Start the worker */
+    memset(ring, 0, sizeof(ring));
+    ring_head = ring_count = 0;
+
+    if(NULL == (mutex = al_create_mutex()))
+        fatal_error("Can't create a mutex for the screenshots");
+    if(NULL == (cond = al_create_cond()))
+        fatal_error("Can't create a condition variable for the screenshots");
+    if(NULL == (worker = al_create_thread(work, NULL)))
+        fatal_error("Can't create a thread for the screenshots");
+
+    al_start_thread(worker);
 }
 
 
 /*
  * screenshot_update()
  * Checks if the user wants to take a snapshot, and if
- * he/she does, we must do it.
+ * he/she does, we must do it. Call it after rendering a frame.
  */
 void screenshot_update()
 {
-    image_t* snapshot;
-
     /* take the snapshot */
     if(input_button_pressed(in, IB_FIRE1) || input_button_pressed(in, IB_FIRE2)) {
         const char *filename = screenshot_filename(next_screenshot_id++);
         logfile_message("New screenshot: \"%s\"", filename);
-        snapshot = video_take_snapshot();
-        image_save(snapshot, filename);
-        image_destroy(snapshot);
-        video_showmessage("New screenshot: %s", filename);
+
+        if(enqueue(JOB_SCREENSHOT, asset_path(filename)))
+            video_showmessage("New screenshot: %s", filename);
+        else
+            video_showmessage("Can't take a screenshot");
+    }
+
+    /* capture the frame */
+    if(is_capturing) {
+        if(enqueue(JOB_CAPTURE, NULL))
+            captured_frames++;
+        else
+            dropped_frames++;
     }
 }
 
@@ -74,11 +150,90 @@ void screenshot_update()
  */
 void screenshot_release()
 {
+    /* Finish the pending jobs */
+    if(is_capturing)
+        screenshot_toggle_capture();
+    wait_for_worker();
+
+    /* Stop the worker */
+    al_lock_mutex(mutex);
+    al_set_thread_should_stop(worker);
+    al_broadcast_cond(cond);
+    al_unlock_mutex(mutex);
+
+    al_join_thread(worker, NULL);
+    al_destroy_thread(worker);
+    al_destroy_cond(cond);
+    al_destroy_mutex(mutex);
+    worker = NULL;
+
+    /* Release the frame buffers */
+    for(int i = 0; i < RING_SIZE; i++)
+        free(ring[i].pixels);
+    memset(ring, 0, sizeof(ring));
+
     /* We're done with the input object */
     input_destroy(in);
 }
 
 
+/*
+ * screenshot_toggle_capture()
+ * Starts or stops capturing frames to a file. Returns true if capturing
+ */
+bool screenshot_toggle_capture()
+{
+    if(!is_capturing) {
+        const char* filename = capture_filename(next_capture_id++);
+        const char* fullpath = asset_path(filename);
+        ALLEGRO_FILE* fp = al_fopen(fullpath, "wb");
+        int width = 0, height = 0;
+
+        if(fp == NULL) {
+            logfile_message("Can't capture frames to \"%s\"", fullpath);
+            video_showmessage("Can't capture frames");
+            return false;
+        }
+
+        video_read_snapshot(NULL, &width, &height);
+        logfile_message("Capturing %dx%d RGBA frames to \"%s\"", width, height, fullpath);
+        video_showmessage("Capturing frames to %s", filename);
+
+        al_lock_mutex(mutex);
+        capture_file = fp;
+        al_unlock_mutex(mutex);
+
+        captured_frames = dropped_frames = 0;
+        is_capturing = true;
+    }
+    else {
+        /* write the remaining frames and close the file */
+        is_capturing = false;
+        wait_for_worker();
+
+        al_lock_mutex(mutex);
+        al_fclose(capture_file);
+        capture_file = NULL;
+        al_unlock_mutex(mutex);
+
+        logfile_message("Captured %d frames (%d dropped)", captured_frames, dropped_frames);
+        video_showmessage("Captured %d frames (%d dropped)", captured_frames, dropped_frames);
+    }
+
+    return is_capturing;
+}
+
+
+/*
+ * screenshot_is_capturing()
+ * Are we capturing frames?
+ */
+bool screenshot_is_capturing()
+{
+    return is_capturing;
+}
+
+
 
 
 
@@ -89,4 +244,135 @@ const char* screenshot_filename(int screenshot_id)
     static char filename[32];
     snprintf(filename, sizeof(filename), "screenshots/s%03d.png", screenshot_id);
     return filename;
-}
\ No newline at end of file
+}
+
+const char* capture_filename(int capture_id)
+{
+    static char filename[32];
+    snprintf(filename, sizeof(filename), "screenshots/c%03d.rgba", capture_id);
+    return filename;
+}
+
+/* reads back the last frame into a free frame buffer and queues it.
+   Returns false if there is no free frame buffer or in case of error */
+bool enqueue(framejobtype_t type, const char* fullpath)
+{
+    framejob_t* job;
+    int width = 0, height = 0;
+
+    /* find a free frame buffer */
+    al_lock_mutex(mutex);
+    if(ring_count == RING_SIZE) {
+        al_unlock_mutex(mutex);
+        return false;
+    }
+    job = &ring[(ring_head + ring_count) % RING_SIZE];
+    al_unlock_mutex(mutex);
+
+    /* read the pixels. The worker doesn't touch this buffer until it's queued */
+    video_read_snapshot(NULL, &width, &height);
+    size_t size = (size_t)width * (size_t)height * 4;
+    if(size > job->capacity) {
+        free(job->pixels);
+        job->pixels = mallocx(size);
+        job->capacity = size;
+    }
+
+    if(!video_read_snapshot(job->pixels, &width, &height))
+        return false;
+
+    job->type = type;
+    job->width = width;
+    job->height = height;
+    if(fullpath != NULL)
+        str_cpy(job->fullpath, fullpath, sizeof(job->fullpath));
+
+    /* queue the job */
+    al_lock_mutex(mutex);
+    ring_count++;
+    al_broadcast_cond(cond);
+    al_unlock_mutex(mutex);
+
+    return true;
+}
+
+/* waits until all queued jobs are processed */
+void wait_for_worker()
+{
+    al_lock_mutex(mutex);
+    while(ring_count > 0)
+        al_wait_cond(cond, mutex);
+    al_unlock_mutex(mutex);
+}
+
+/* processes the queued frames in the background */
+void* work(ALLEGRO_THREAD* thread, void* arg)
+{
+    /* use the physfs file interface in this thread */
+    al_set_physfs_file_interface();
+
+    al_lock_mutex(mutex);
+    for(;;) {
+        /* wait for a job */
+        if(ring_count == 0) {
+            if(al_get_thread_should_stop(thread))
+                break;
+
+            al_wait_cond(cond, mutex);
+            continue;
+        }
+
+        framejob_t* job = &ring[ring_head];
+        ALLEGRO_FILE* fp = capture_file;
+
+        /* process the job without holding the lock. The main thread
+           doesn't close the capture file while there are queued jobs */
+        al_unlock_mutex(mutex);
+        if(job->type == JOB_SCREENSHOT)
+            save_screenshot(job);
+        else if(fp != NULL)
+            al_fwrite(fp, job->pixels, (size_t)job->width * (size_t)job->height * 4);
+        al_lock_mutex(mutex);
+
+        /* release the frame buffer */
+        ring_head = (ring_head + 1) % RING_SIZE;
+        ring_count--;
+        al_broadcast_cond(cond);
+    }
+    al_unlock_mutex(mutex);
+
+    (void)arg;
+    return NULL;
+}
+
+/* encodes a screenshot. Call from the worker thread */
+void save_screenshot(const framejob_t* job)
+{
+    ALLEGRO_STATE state;
+    ALLEGRO_BITMAP* bitmap;
+    ALLEGRO_LOCKED_REGION* region;
+    bool success = false;
+
+    /* create a memory bitmap with the pixels of the screenshot */
+    al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+    al_set_new_bitmap_flags((al_get_new_bitmap_flags() & ~ALLEGRO_VIDEO_BITMAP) | ALLEGRO_MEMORY_BITMAP);
+    bitmap = al_create_bitmap(job->width, job->height);
+    al_restore_state(&state);
+
+    if(bitmap != NULL) {
+        if(NULL != (region = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY))) {
+            for(int y = 0; y < job->height; y++)
+                memcpy((unsigned char*)region->data + y * region->pitch, job->pixels + y * (job->width * 4), job->width * 4);
+
+            al_unlock_bitmap(bitmap);
+            success = al_save_bitmap(job->fullpath, bitmap);
+        }
+
+        al_destroy_bitmap(bitmap);
+    }
+
+    if(success)
+        logfile_message("Saved image to \"%s\"", job->fullpath);
+    else
+        logfile_message("Failed to save image to \"%s\"", job->fullpath);
+}
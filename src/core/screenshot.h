@@ -21,9 +21,13 @@
 #ifndef _SCREENSHOT_H
 #define _SCREENSHOT_H
 
+#include <stdbool.h>
+
 /* public functions */
 void screenshot_init();
 void screenshot_update();
 void screenshot_release();
+bool screenshot_toggle_capture(); /* start/stop capturing frames; returns true if capturing */
+bool screenshot_is_capturing();
 
 #endif
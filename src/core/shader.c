@@ -19,9 +19,14 @@
  */
 
 #include <allegro5/allegro.h>
+#include <allegro5/allegro_opengl.h>
+#include <stdio.h>
+#include <string.h>
 #include "shader.h"
+#include "../core/asset.h"
 #include "../util/dictionary.h"
 #include "../util/iterator.h"
+#include "../util/darray.h"
 #include "../util/util.h"
 #include "../util/stringutil.h"
 #include "../util/numeric.h"
@@ -34,7 +39,9 @@ struct shader_t
     ALLEGRO_SHADER* shader; /* the first field */
     char* fs;
     char* vs;
-    dictionary_t* uniforms;
+    dictionary_t* uniforms; /* owns the uniforms, indexed by name */
+    DARRAY(struct shader_uniform_t*, uniform); /* the same uniforms, indexed by handle */
+    unsigned generation; /* incremented whenever the GLSL program is recreated */
     int next_texture_unit;
 };
 
@@ -45,6 +52,8 @@ typedef enum shader_uniformtype_t shader_uniformtype_t;
 
 enum shader_uniformtype_t
 {
+    TYPE_UNDEFINED, /* resolved, but not yet set */
+
     TYPE_FLOAT,
     TYPE_INT,
     TYPE_BOOL,
@@ -75,6 +84,8 @@ struct shader_uniform_t
 {
     shader_uniformtype_t type;
     char name[1 + UNIFORM_NAME_MAXLEN];
+    shaderuniform_t handle; /* index in the array of uniforms of the shader */
+    unsigned generation; /* the generation of the program the value was last uploaded to; 0 if dirty */
     union {
         float f;
         int i;
@@ -87,6 +98,8 @@ struct shader_uniform_t
 static shader_uniform_t* create_uniform(shader_uniformtype_t type, const char* var_name);
 static void destroy_uniform(shader_uniform_t* uniform);
 static bool set_uniform(const shader_uniform_t* uniform);
+static shader_uniform_t* get_uniform(shader_t* shader, shaderuniform_t handle, shader_uniformtype_t type);
+static inline bool is_sampler(shader_uniformtype_t type);
 static void uniform_dtor(void *uniform, void* ctx) { destroy_uniform((shader_uniform_t*)uniform); (void)ctx; }
 
 /* default vertex shader */
@@ -157,6 +170,33 @@ static shader_t* default_shader = NULL;
 static const shader_t* active_shader = NULL;
 static dictionary_t* registry = NULL;
 
+/* program binary cache: OpenGL 4.1+ and OpenGL ES 3.0+ */
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#define PROGRAM_BINARY_CACHE_DIR "shaders/" /* inside the application cache */
+#define PROGRAM_BINARY_MAGIC "OSPB" /* 4 characters */
+#define PROGRAM_BINARY_MAXSIZE (16 * 1024 * 1024) /* in bytes */
+ALLEGRO_DEFINE_PROC_TYPE(void, fun_glgetprogrambinary_t, (GLuint, GLsizei, GLsizei*, GLenum*, void*));
+ALLEGRO_DEFINE_PROC_TYPE(void, fun_glprogrambinary_t, (GLuint, GLenum, const void*, GLsizei));
+ALLEGRO_DEFINE_PROC_TYPE(void, fun_glgetprogramiv_t, (GLuint, GLenum, GLint*));
+ALLEGRO_DEFINE_PROC_TYPE(void, fun_glgetintegerv_t, (GLenum, GLint*));
+ALLEGRO_DEFINE_PROC_TYPE(const GLubyte*, fun_glgetstring_t, (GLenum));
+static fun_glgetprogrambinary_t _glGetProgramBinary = NULL;
+static fun_glprogrambinary_t _glProgramBinary = NULL;
+static fun_glgetprogramiv_t _glGetProgramiv = NULL;
+static bool is_binary_cache_available = false;
+static uint64_t driver_hash = 0; /* identifies the graphics driver */
+static void init_binary_cache();
+static uint64_t program_hash(const char* fs_glsl, const char* vs_glsl);
+static ALLEGRO_SHADER* load_program_binary(uint64_t hash);
+static void save_program_binary(uint64_t hash, ALLEGRO_SHADER* shader);
+static const char* binary_cache_path(uint64_t hash, char* buffer, size_t buffer_size);
+static uint64_t hash_string(uint64_t hash, const char* str);
+
 
 
 /*
@@ -172,6 +212,9 @@ void shader_init()
     /* initialize the registry of shaders */
     registry = dictionary_create(false, destroy_shader_callback, NULL);
 
+    /* initialize the program binary cache */
+    init_binary_cache();
+
     /* create the default shader */
     default_shader = shader_create_ex(DEFAULT_SHADER_NAME, default_fs_glsl, default_vs_glsl);
 
@@ -213,14 +256,11 @@ void shader_discard_all()
     al_use_shader(NULL);
 
     /* discard all shaders */
-    iterator_t* it = dictionary_values(registry);
-
-    while(iterator_has_next(it)) {
-        shader_t* shader = iterator_next(it);
-        discard_shader(shader);
-    }
+    int count = dictionary_count(registry);
+    void* const* shaders = dictionary_value_array(registry);
 
-    iterator_destroy(it);
+    for(int i = 0; i < count; i++)
+        discard_shader((shader_t*)shaders[i]);
 }
 
 /*
@@ -232,14 +272,11 @@ void shader_recreate_all()
     LOG("Recreating all shaders...");
 
     /* recreate all shaders */
-    iterator_t* it = dictionary_values(registry);
+    int count = dictionary_count(registry);
+    void* const* shaders = dictionary_value_array(registry);
 
-    while(iterator_has_next(it)) {
-        shader_t* shader = iterator_next(it);
-        recreate_shader(shader);
-    }
-
-    iterator_destroy(it);
+    for(int i = 0; i < count; i++)
+        recreate_shader((shader_t*)shaders[i]);
 }
 
 
@@ -303,6 +340,8 @@ shader_t* shader_create_ex(const char* name, const char* fs_glsl, const char* vs
 
     /* create the dictionary of uniforms */
     shader->uniforms = dictionary_create(true, uniform_dtor, NULL);
+    darray_init(shader->uniform);
+    shader->generation = 1;
 
     /* set the next texture unit */
     shader->next_texture_unit = 1; /* unit 0 is used by Allegro */
@@ -330,14 +369,20 @@ bool shader_set_active(const shader_t* shader)
     /* use the shader */
     bool success = al_use_shader(shader->shader);
 
-    /* set uniform variables */
+    /* set uniform variables. The program keeps the values of its uniforms
+       between activations, so we only upload the ones that have changed.
+       Samplers are always set, because the texture units are shared */
     if(success) {
-        iterator_t* it = dictionary_values(shader->uniforms);
-        while(iterator_has_next(it)) {
-            const shader_uniform_t* uniform = iterator_next(it);
-            set_uniform(uniform);
+        for(int i = 0; i < darray_length(shader->uniform); i++) {
+            shader_uniform_t* uniform = shader->uniform[i];
+
+            if(uniform->type == TYPE_UNDEFINED)
+                continue;
+            else if(uniform->generation != shader->generation || is_sampler(uniform->type)) {
+                set_uniform(uniform);
+                uniform->generation = shader->generation;
+            }
         }
-        iterator_destroy(it);
     }
 
     /* update active shader */
@@ -374,19 +419,7 @@ const shader_t* shader_get_default()
  */
 void shader_set_float(shader_t* shader, const char* var_name, float value)
 {
-    shader_uniform_t* stored_uniform = dictionary_get(shader->uniforms, var_name);
-
-    if(stored_uniform == NULL) {
-        /* add new uniform */
-        stored_uniform = create_uniform(TYPE_FLOAT, var_name);
-        stored_uniform->value.f = value;
-        dictionary_put(shader->uniforms, var_name, stored_uniform);
-    }
-    else {
-        /* update uniform */
-        assertx(stored_uniform->type == TYPE_FLOAT, "Can't change uniform type");
-        stored_uniform->value.f = value;
-    }
+    shader_set_uniform_float(shader, shader_uniform(shader, var_name), value);
 }
 
 /*
@@ -395,19 +428,7 @@ void shader_set_float(shader_t* shader, const char* var_name, float value)
  */
 void shader_set_int(shader_t* shader, const char* var_name, int value)
 {
-    shader_uniform_t* stored_uniform = dictionary_get(shader->uniforms, var_name);
-
-    if(stored_uniform == NULL) {
-        /* add new uniform */
-        stored_uniform = create_uniform(TYPE_INT, var_name);
-        stored_uniform->value.i = value;
-        dictionary_put(shader->uniforms, var_name, stored_uniform);
-    }
-    else {
-        /* update uniform */
-        assertx(stored_uniform->type == TYPE_INT, "Can't change uniform type");
-        stored_uniform->value.i = value;
-    }
+    shader_set_uniform_int(shader, shader_uniform(shader, var_name), value);
 }
 
 /*
@@ -415,67 +436,127 @@ void shader_set_int(shader_t* shader, const char* var_name, int value)
  * Set the value of a boolean uniform variable
  */
 void shader_set_bool(shader_t* shader, const char* var_name, bool value)
+{
+    shader_set_uniform_bool(shader, shader_uniform(shader, var_name), value);
+}
+
+/*
+ * shader_set_float_vector()
+ * Set the value of a floating-point vector of the given number of components
+ */
+void shader_set_float_vector(shader_t* shader, const char* var_name, int num_components, const float* value)
+{
+    shader_set_uniform_float_vector(shader, shader_uniform(shader, var_name), num_components, value);
+}
+
+/*
+ * shader_set_sampler()
+ * Set a texture sampler
+ */
+void shader_set_sampler(shader_t* shader, const char* var_name, const image_t* image)
+{
+    shader_set_uniform_sampler(shader, shader_uniform(shader, var_name), image);
+}
+
+/*
+ * shader_uniform()
+ * Get a handle to a uniform variable of the shader, so that it can be set
+ * without looking up its name. The type of the uniform is defined by the
+ * first setter that is called with the handle
+ */
+shaderuniform_t shader_uniform(shader_t* shader, const char* var_name)
 {
     shader_uniform_t* stored_uniform = dictionary_get(shader->uniforms, var_name);
 
     if(stored_uniform == NULL) {
         /* add new uniform */
-        stored_uniform = create_uniform(TYPE_BOOL, var_name);
-        stored_uniform->value.b = value;
+        stored_uniform = create_uniform(TYPE_UNDEFINED, var_name);
         dictionary_put(shader->uniforms, var_name, stored_uniform);
+        darray_push(shader->uniform, stored_uniform);
+        stored_uniform->handle = darray_length(shader->uniform) - 1;
     }
-    else {
-        /* update uniform */
-        assertx(stored_uniform->type == TYPE_BOOL, "Can't change uniform type");
+
+    return stored_uniform->handle;
+}
+
+/*
+ * shader_set_uniform_float()
+ * Set the value of a floating-point uniform variable given its handle
+ */
+void shader_set_uniform_float(shader_t* shader, shaderuniform_t uniform, float value)
+{
+    shader_uniform_t* stored_uniform = get_uniform(shader, uniform, TYPE_FLOAT);
+
+    if(stored_uniform->value.f != value) {
+        stored_uniform->value.f = value;
+        stored_uniform->generation = 0;
+    }
+}
+
+/*
+ * shader_set_uniform_int()
+ * Set the value of an integer uniform variable given its handle
+ */
+void shader_set_uniform_int(shader_t* shader, shaderuniform_t uniform, int value)
+{
+    shader_uniform_t* stored_uniform = get_uniform(shader, uniform, TYPE_INT);
+
+    if(stored_uniform->value.i != value) {
+        stored_uniform->value.i = value;
+        stored_uniform->generation = 0;
+    }
+}
+
+/*
+ * shader_set_uniform_bool()
+ * Set the value of a boolean uniform variable given its handle
+ */
+void shader_set_uniform_bool(shader_t* shader, shaderuniform_t uniform, bool value)
+{
+    shader_uniform_t* stored_uniform = get_uniform(shader, uniform, TYPE_BOOL);
+
+    if(stored_uniform->value.b != value) {
         stored_uniform->value.b = value;
+        stored_uniform->generation = 0;
     }
 }
 
 /*
- * shader_set_float_vector()
- * Set the value of a floating-point vector of the given number of components
+ * shader_set_uniform_float_vector()
+ * Set the value of a floating-point vector of the given number of
+ * components given the handle of its uniform variable
  */
-void shader_set_float_vector(shader_t* shader, const char* var_name, int num_components, const float* value)
+void shader_set_uniform_float_vector(shader_t* shader, shaderuniform_t uniform, int num_components, const float* value)
 {
     assertx(num_components >= 2 && num_components <= 4);
-    shader_uniform_t* stored_uniform = dictionary_get(shader->uniforms, var_name);
+    shader_uniform_t* stored_uniform = get_uniform(shader, uniform, TYPE_FLOAT2 + (num_components-2));
 
-    if(stored_uniform == NULL) {
-        /* add new uniform */
-        stored_uniform = create_uniform(TYPE_FLOAT2 + (num_components-2), var_name);
-        memcpy(stored_uniform->value.fvec, value, num_components * sizeof(*value));
-        dictionary_put(shader->uniforms, var_name, stored_uniform);
-    }
-    else {
-        /* update uniform */
-        assertx(stored_uniform->type == TYPE_FLOAT2 + (num_components-2), "Can't change uniform type");
+    if(memcmp(stored_uniform->value.fvec, value, num_components * sizeof(*value)) != 0) {
         memcpy(stored_uniform->value.fvec, value, num_components * sizeof(*value));
+        stored_uniform->generation = 0;
     }
 }
 
 /*
- * shader_set_sampler()
- * Set a texture sampler
+ * shader_set_uniform_sampler()
+ * Set a texture sampler given its handle
  */
-void shader_set_sampler(shader_t* shader, const char* var_name, const image_t* image)
+void shader_set_uniform_sampler(shader_t* shader, shaderuniform_t uniform, const image_t* image)
 {
-    shader_uniform_t* stored_uniform = dictionary_get(shader->uniforms, var_name);
+    assertx(uniform >= 0 && uniform < darray_length(shader->uniform));
+    shader_uniform_t* stored_uniform = shader->uniform[uniform];
 
     /* set the texture unit */
-    int unit = (stored_uniform == NULL) ? shader->next_texture_unit++ : (int)stored_uniform->type - TYPE_SAMPLER_0;
-    assertx(unit >= 0 && unit <= 15);
-
-    if(stored_uniform == NULL) {
-        /* add new uniform */
-        stored_uniform = create_uniform(TYPE_SAMPLER_0 + unit, var_name);
-        stored_uniform->value.tex = image;
-        dictionary_put(shader->uniforms, var_name, stored_uniform);
-    }
-    else {
-        /* update uniform */
-        assertx(stored_uniform->type >= TYPE_SAMPLER_0 && stored_uniform->type <= TYPE_SAMPLER_15, "Can't change uniform type");
-        stored_uniform->value.tex = image;
+    if(stored_uniform->type == TYPE_UNDEFINED) {
+        int unit = shader->next_texture_unit++;
+        assertx(unit >= 0 && unit <= 15);
+        stored_uniform->type = TYPE_SAMPLER_0 + unit;
+        stored_uniform->generation = 0;
     }
+
+    /* update uniform */
+    assertx(is_sampler(stored_uniform->type), "Can't change uniform type");
+    stored_uniform->value.tex = image;
 }
 
 
@@ -490,7 +571,15 @@ void shader_set_sampler(shader_t* shader, const char* var_name, const image_t* i
 /* create a GLSL shader. On error, returns NULL and sets an error string */
 ALLEGRO_SHADER* create_glsl_shader(const char* fs_glsl, const char* vs_glsl, char* error_string, size_t error_string_size)
 {
-    ALLEGRO_SHADER* sh = al_create_shader(ALLEGRO_SHADER_GLSL);
+    uint64_t hash = program_hash(fs_glsl, vs_glsl);
+
+    /* skip the compilation if the program is in the binary cache */
+    ALLEGRO_SHADER* sh = load_program_binary(hash);
+    if(sh != NULL)
+        return sh;
+
+    /* compile the shader */
+    sh = al_create_shader(ALLEGRO_SHADER_GLSL);
 
     if(sh == NULL) {
         snprintf(error_string, error_string_size, "Can't create GLSL shader");
@@ -510,6 +599,8 @@ ALLEGRO_SHADER* create_glsl_shader(const char* fs_glsl, const char* vs_glsl, cha
         al_destroy_shader(sh);
         sh = NULL;
     }
+    else
+        save_program_binary(hash, sh);
 
     return sh;
 }
@@ -531,7 +622,8 @@ void destroy_shader_callback(void* shader, void* context)
 /* destroy a shader instance */
 void destroy_shader(shader_t* shader)
 {
-    /* release the dictionary of uniforms */
+    /* release the uniforms */
+    darray_release(shader->uniform);
     dictionary_destroy(shader->uniforms);
 
     /* release the source code */
@@ -564,6 +656,10 @@ void recreate_shader(shader_t* shader)
         LOG("Can't recreate shader!");
         FATAL("%s", error);
     }
+
+    /* the uniforms of the new program must be uploaded again */
+    if(++shader->generation == 0)
+        shader->generation = 1;
 }
 
 /* create a uniform sturct */
@@ -597,6 +693,9 @@ void destroy_uniform(shader_uniform_t* uniform)
 bool set_uniform(const shader_uniform_t* uniform)
 {
     switch(uniform->type) {
+        case TYPE_UNDEFINED:
+            return false;
+
         case TYPE_FLOAT:
             return al_set_shader_float(uniform->name, uniform->value.f);
 
@@ -635,4 +734,223 @@ bool set_uniform(const shader_uniform_t* uniform)
     }
 
     return false;
-}
\ No newline at end of file
+}
+
+/* get a uniform by its handle, defining its type if it's not yet defined */
+shader_uniform_t* get_uniform(shader_t* shader, shaderuniform_t handle, shader_uniformtype_t type)
+{
+    assertx(handle >= 0 && handle < darray_length(shader->uniform));
+    shader_uniform_t* uniform = shader->uniform[handle];
+
+    if(uniform->type == TYPE_UNDEFINED) {
+        uniform->type = type;
+        uniform->generation = 0; /* dirty */
+    }
+
+    assertx(uniform->type == type, "Can't change uniform type");
+    return uniform;
+}
+
+/* is it a type of texture sampler? */
+bool is_sampler(shader_uniformtype_t type)
+{
+    return type >= TYPE_SAMPLER_0 && type <= TYPE_SAMPLER_15;
+}
+
+/* check if program binaries can be cached */
+void init_binary_cache()
+{
+    fun_glgetintegerv_t _glGetIntegerv = (fun_glgetintegerv_t)al_get_opengl_proc_address("glGetIntegerv");
+    fun_glgetstring_t _glGetString = (fun_glgetstring_t)al_get_opengl_proc_address("glGetString");
+    GLint num_formats = 0;
+
+    _glGetProgramBinary = (fun_glgetprogrambinary_t)al_get_opengl_proc_address("glGetProgramBinary");
+    _glProgramBinary = (fun_glprogrambinary_t)al_get_opengl_proc_address("glProgramBinary");
+    _glGetProgramiv = (fun_glgetprogramiv_t)al_get_opengl_proc_address("glGetProgramiv");
+
+    is_binary_cache_available = false;
+    if(_glGetProgramBinary == NULL || _glProgramBinary == NULL || _glGetProgramiv == NULL || _glGetIntegerv == NULL || _glGetString == NULL) {
+        LOG("Program binaries are not supported");
+        return;
+    }
+
+    /* the driver must support at least one binary format */
+    _glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    if(num_formats <= 0) {
+        LOG("No program binary formats are available");
+        return;
+    }
+
+    /* binaries are invalidated when the driver changes */
+    const GLenum info[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    driver_hash = 5381;
+    for(int i = 0; i < sizeof(info) / sizeof(info[0]); i++) {
+        const char* str = (const char*)_glGetString(info[i]);
+        driver_hash = hash_string(driver_hash, str != NULL ? str : "");
+    }
+
+    LOG("Using the program binary cache");
+    is_binary_cache_available = true;
+}
+
+/* a hash of the program, given its source code and the graphics driver */
+uint64_t program_hash(const char* fs_glsl, const char* vs_glsl)
+{
+    uint64_t hash = driver_hash;
+
+    hash = hash_string(hash, vs_glsl);
+    hash = hash_string(hash, "\n");
+    hash = hash_string(hash, fs_glsl);
+
+    return hash;
+}
+
+/* create a shader from a cached program binary. Returns NULL if there is no valid binary */
+ALLEGRO_SHADER* load_program_binary(uint64_t hash)
+{
+    /* The binary replaces the program of an Allegro shader built with trivial
+       stages, which compile quickly. Allegro looks up the locations of its
+       variables whenever the shader is used, so it works with the binary. */
+    static const char stub_vs_glsl[] = SHADER_GLSL_PREFIX
+        "void main() { gl_Position = vec4(0.0); }\n";
+    static const char stub_fs_glsl[] = SHADER_GLSL_PREFIX
+        "precision lowp float;\n"
+        "out lowp vec4 color;\n"
+        "void main() { color = vec4(0.0); }\n";
+
+    char filepath[1024];
+    char magic[4];
+    uint32_t format = 0, size = 0;
+    void* data = NULL;
+    ALLEGRO_SHADER* sh = NULL;
+    FILE* fp;
+
+    if(!is_binary_cache_available)
+        return NULL;
+
+    /* read the cached binary */
+    if(*binary_cache_path(hash, filepath, sizeof(filepath)) == '\0')
+        return NULL;
+    else if(NULL == (fp = fopen_utf8(filepath, "rb")))
+        return NULL;
+
+    if(
+        fread(magic, sizeof(magic), 1, fp) == 1 && memcmp(magic, PROGRAM_BINARY_MAGIC, sizeof(magic)) == 0 &&
+        fread(&format, sizeof(format), 1, fp) == 1 &&
+        fread(&size, sizeof(size), 1, fp) == 1 &&
+        size > 0 && size <= PROGRAM_BINARY_MAXSIZE
+    ) {
+        data = mallocx(size);
+        if(fread(data, size, 1, fp) != 1) {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    fclose(fp);
+
+    if(data == NULL) {
+        LOG("Discarding an invalid program binary: %s", filepath);
+        al_remove_filename(filepath);
+        return NULL;
+    }
+
+    /* create the shader from the binary */
+    sh = al_create_shader(ALLEGRO_SHADER_GLSL);
+    if(sh != NULL) {
+        if(
+            al_attach_shader_source(sh, ALLEGRO_VERTEX_SHADER, stub_vs_glsl) &&
+            al_attach_shader_source(sh, ALLEGRO_PIXEL_SHADER, stub_fs_glsl) &&
+            al_build_shader(sh)
+        ) {
+            GLuint program = al_get_opengl_program_object(sh);
+            GLint link_status = GL_FALSE;
+
+            _glProgramBinary(program, (GLenum)format, data, (GLsizei)size);
+            _glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+
+            if(link_status != GL_TRUE) {
+                /* the driver rejected the binary, possibly after an update */
+                al_destroy_shader(sh);
+                sh = NULL;
+            }
+        }
+        else {
+            al_destroy_shader(sh);
+            sh = NULL;
+        }
+    }
+
+    free(data);
+
+    /* the binary is stale; we'll compile the GLSL code and replace it */
+    if(sh == NULL)
+        al_remove_filename(filepath);
+
+    return sh;
+}
+
+/* store the program binary of a newly built shader in the cache */
+void save_program_binary(uint64_t hash, ALLEGRO_SHADER* shader)
+{
+    char filepath[1024];
+    GLuint program;
+    GLint length = 0;
+    GLsizei size = 0;
+    GLenum format = 0;
+    FILE* fp;
+
+    if(!is_binary_cache_available)
+        return;
+
+    /* get the binary */
+    program = al_get_opengl_program_object(shader);
+    _glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0 || length > PROGRAM_BINARY_MAXSIZE)
+        return;
+
+    void* data = mallocx(length);
+    _glGetProgramBinary(program, length, &size, &format, data);
+
+    /* write it to the cache */
+    if(size > 0 && *binary_cache_path(hash, filepath, sizeof(filepath)) != '\0') {
+        if(NULL != (fp = fopen_utf8(filepath, "wb"))) {
+            uint32_t u32_format = format, u32_size = size;
+            bool success =
+                fwrite(PROGRAM_BINARY_MAGIC, 4, 1, fp) == 1 &&
+                fwrite(&u32_format, sizeof(u32_format), 1, fp) == 1 &&
+                fwrite(&u32_size, sizeof(u32_size), 1, fp) == 1 &&
+                fwrite(data, size, 1, fp) == 1;
+
+            fclose(fp);
+
+            /* don't keep partial files */
+            if(!success) {
+                LOG("Can't write the program binary %s", filepath);
+                al_remove_filename(filepath);
+            }
+        }
+    }
+
+    free(data);
+}
+
+/* the absolute path of a program binary in the cache. Returns an empty string on error */
+const char* binary_cache_path(uint64_t hash, char* buffer, size_t buffer_size)
+{
+    char relative_path[64];
+
+    snprintf(relative_path, sizeof(relative_path), PROGRAM_BINARY_CACHE_DIR "%016llx.bin", (unsigned long long)hash);
+    return asset_cache_path(relative_path, buffer, buffer_size);
+}
+
+/* update a djb2 hash with the characters of a string */
+uint64_t hash_string(uint64_t hash, const char* str)
+{
+    int c;
+
+    while((c = *((unsigned char*)(str++))))
+        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+
+    return hash;
+}
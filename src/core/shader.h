@@ -24,6 +24,7 @@
 #include <allegro5/allegro.h>
 
 typedef struct shader_t shader_t;
+typedef int shaderuniform_t; /* a handle to a uniform variable of a shader */
 struct image_t;
 
 void shader_init();
@@ -46,6 +47,13 @@ void shader_set_bool(shader_t* shader, const char* var_name, bool value);
 void shader_set_float_vector(shader_t* shader, const char* var_name, int num_components, const float* value);
 void shader_set_sampler(shader_t* shader, const char* var_name, const struct image_t* image);
 
+shaderuniform_t shader_uniform(shader_t* shader, const char* var_name); /* resolve a uniform once, then use the setters below */
+void shader_set_uniform_float(shader_t* shader, shaderuniform_t uniform, float value);
+void shader_set_uniform_int(shader_t* shader, shaderuniform_t uniform, int value);
+void shader_set_uniform_bool(shader_t* shader, shaderuniform_t uniform, bool value);
+void shader_set_uniform_float_vector(shader_t* shader, shaderuniform_t uniform, int num_components, const float* value);
+void shader_set_uniform_sampler(shader_t* shader, shaderuniform_t uniform, const struct image_t* image);
+
 #if !defined(__ANDROID__)
 #define SHADER_GLSL_PREFIX "#version 330 core\n"
 #else
@@ -62,7 +70,7 @@ void shader_set_sampler(shader_t* shader, const char* var_name, const struct ima
     "precision " default_precision " float;\n" \
     \
     "in highp vec2 v_texcoord;\n" \
-    "in lowp vec4 v_color;\n" /* tint color */ \
+    "in mediump vec4 v_color;\n" /* tint color; may exceed 1.0 (see image_draw_lit) */ \
     "out lowp vec4 color;\n" /* fragment color */ \
     ""
 
@@ -25,6 +25,7 @@
 #include "logfile.h"
 #include "asset.h"
 #include "resourcemanager.h"
+#include "startuptrace.h"
 #include "nanoparser.h"
 #include "keyframes.h"
 #include "../util/v2d.h"
@@ -63,9 +64,13 @@ struct spriteinfo_t {
     DARRAY(animtransition_t*, preprocessed_transition); /* transitions without "any" sorted by from_id and then by to_id */
     int* transition_from; /* transition_from[i] is the first index of preprocessed_transition having from_id == i, if it exists */
     int transition_from_length; /* length of transition_from[] */
+    const animation_t** transition_matrix; /* transition_matrix[from_id * transition_matrix_width + to_id] is a transition animation or NULL; possibly NULL itself */
+    int transition_matrix_width; /* one plus the largest animation ID */
 
     dictionary_t* prog_anims; /* keyframe-based animations */
     dictionary_t* user_properties; /* user-defined properties */
+
+    size_t memory; /* estimated memory usage of the metadata, in bytes */
 };
 
 /* transitions are animations that play between two other animations */
@@ -79,6 +84,7 @@ struct animtransition_t
 
 static animtransition_t *transition_new(int anim_id, int from_id, int to_id); /* creates a transition */
 static animtransition_t *transition_delete(animtransition_t *transition); /* deletes transition */
+static size_t estimate_memory(const spriteinfo_t* sprite); /* estimates the memory usage of the metadata */
 
 /* user-defined properties */
 struct userproperty_t
@@ -102,6 +108,9 @@ static const char OVERRIDE_PREFIX[] = "sprites/overrides/"; /* sprites defined i
 static const int OVERRIDE_PREFIX_LENGTH = sizeof(OVERRIDE_PREFIX) - 1;
 static const int TRANSITION_ANY_ANIM = -1; /* special value representing a transition to/from any animation */
 static const int MAX_FRAMES = 4096; /* maximum number of frames in a spritesheet */
+static const int MAX_TRANSITION_MATRIX_WIDTH = 96; /* sprites with larger animation IDs search for transitions instead of using a dense matrix */
+static const int TRIM_MIN_AREA = 64 * 64; /* frames at least this large are trimmed */
+static const float TRIM_MAX_COVERAGE = 0.75f; /* trim a frame only if its visible pixels cover at most this fraction of its area */
 
 /* private functions */
 static void validate_sprite(spriteinfo_t *spr); /* validates the sprite */
@@ -112,8 +121,11 @@ static int transition_cmp(const void *t1, const void *t2); /* comparison functio
 static void validate_transitions(const spriteinfo_t *sprite);
 static void preprocess_transitions(spriteinfo_t *sprite);
 static void load_sprite_images(spriteinfo_t *spr); /* loads the sprite by reading the spritesheet */
+static void trim_sprite_images(spriteinfo_t *spr); /* trims the transparent borders of large frames */
 static int scanfile(const char* vpath, void* param); /* file system callback */
 static int traverse(const parsetree_statement_t *stmt, void *vpath);
+static int traverse_sprite(const parsetree_statement_t *stmt, void *spritequery);
+static const spriteinfo_t* find_sprite(const char* sprite_name);
 static int traverse_sprite_attributes(const parsetree_statement_t *stmt, void *spriteinfo);
 static int traverse_user_properties(const parsetree_statement_t *stmt, void *dict);
 static void inspect_transitions(const spriteinfo_t* sprite);
@@ -124,6 +136,24 @@ static void destroy_userproperty(void* element, void* context);
 HASHTABLE_GENERATE_CODE(spriteinfo_t, spriteinfo_destroy);
 static HASHTABLE(spriteinfo_t, sprites);
 
+/* sprites are indexed at startup, but they are only parsed and
+   their images are only loaded when they are first requested */
+typedef struct spritesource_t spritesource_t;
+struct spritesource_t {
+    char* vpath; /* the .spr file that defines the sprite */
+};
+
+typedef struct spritequery_t spritequery_t;
+struct spritequery_t {
+    const char* sprite_name; /* the sprite we want to load */
+    spriteinfo_t* result; /* the loaded sprite */
+};
+
+static spritesource_t* spritesource_create(const char* vpath);
+static void spritesource_destroy(spritesource_t* source);
+HASHTABLE_GENERATE_CODE(spritesource_t, spritesource_destroy);
+static HASHTABLE(spritesource_t, sprite_index); /* sprite name -> .spr file */
+
 
 
 
@@ -135,13 +165,14 @@ static HASHTABLE(spriteinfo_t, sprites);
  */
 void sprite_init()
 {
-    logfile_message("Loading sprites...");
+    logfile_message("Indexing sprites...");
     sprites = hashtable_spriteinfo_t_create();
+    sprite_index = hashtable_spritesource_t_create();
 
     /* scan the sprites/ folder */
     asset_foreach_file("sprites", ".spr", scanfile, NULL, true);
 
-    logfile_message("All sprites have been loaded!");
+    logfile_message("All sprites have been indexed!");
 }
 
 
@@ -152,6 +183,7 @@ void sprite_init()
 void sprite_release()
 {
     logfile_message("Releasing sprites...");
+    sprite_index = hashtable_spritesource_t_destroy(sprite_index);
     sprites = hashtable_spriteinfo_t_destroy(sprites);
 }
 
@@ -172,7 +204,7 @@ const animation_t *sprite_get_animation(const char *sprite_name, int anim_id)
         return sprite_get_animation(DEFAULT_SPRITE, DEFAULT_ANIM);
 
     /* find the corresponding spriteinfo_t* instance */
-    sprite = hashtable_spriteinfo_t_find(sprites, sprite_name);
+    sprite = find_sprite(sprite_name);
     if(sprite != NULL) {
         if(anim_id >= 0 && anim_id < sprite->animation_count) {
             if(sprite->animation_data[anim_id] != NULL)
@@ -195,7 +227,7 @@ const animation_t *sprite_get_animation(const char *sprite_name, int anim_id)
  */
 bool sprite_animation_exists(const char* sprite_name, int anim_id)
 {
-    const spriteinfo_t *info = hashtable_spriteinfo_t_find(sprites, sprite_name);
+    const spriteinfo_t *info = find_sprite(sprite_name);
 
     return info != NULL && (
         anim_id >= 0 && anim_id < info->animation_count &&
@@ -218,6 +250,9 @@ spriteinfo_t* spriteinfo_create(const parsetree_program_t *tree)
     preprocess_transitions(sprite);
     load_sprite_images(sprite);
 
+    sprite->memory = estimate_memory(sprite);
+    resourcemanager_track_memory(RESOURCE_SPRITE, sprite->memory);
+
     (void)inspect_transitions;
     return sprite;
 }
@@ -270,6 +305,16 @@ const animation_t* spriteinfo_find_transition_animation(const spriteinfo_t* info
     if(darray_length(info->transition) == 0)
         return NULL;
 
+    /* constant-time lookup */
+    if(info->transition_matrix != NULL) {
+        int width = info->transition_matrix_width;
+
+        if(from_id < 0 || from_id >= width || to_id < 0 || to_id >= width)
+            return NULL;
+
+        return info->transition_matrix[from_id * width + to_id];
+    }
+
     /* perform a linear search on the set of all transition animations from
        (from->id). Find a transition to (to->id). This set is typically very
        small, UNLESS a declaration such as "transition any to x" is present in
@@ -382,6 +427,31 @@ int spriteinfo_frame_height(const spriteinfo_t* info)
     return info->frame_h;
 }
 
+/*
+ * spriteinfo_is_opaque()
+ * Checks if all the pixels of all the frames of the sprite are fully opaque
+ */
+bool spriteinfo_is_opaque(const spriteinfo_t* info)
+{
+    image_t* spritesheet = (image_t*)info->spritesheet;
+    int w = min(info->rect_w, image_width(spritesheet) - info->rect_x);
+    int h = min(info->rect_h, image_height(spritesheet) - info->rect_y);
+    bool is_opaque = true;
+    uint8_t r, g, b, a;
+
+    /* lock the entire spritesheet, as in spriteinfo_to_collisionmask() */
+    image_lock(spritesheet, "r");
+    for(int y = 0; y < h && is_opaque; y++) {
+        for(int x = 0; x < w && is_opaque; x++) {
+            color_unmap(image_getpixel(spritesheet, info->rect_x + x, info->rect_y + y), &r, &g, &b, &a);
+            is_opaque = (a == 255);
+        }
+    }
+    image_unlock(spritesheet);
+
+    return is_opaque;
+}
+
 /*
  * spriteinfo_to_collisionmask()
  * Create a collision mask from a frame of the spritesheet
@@ -426,16 +496,73 @@ collisionmask_t* spriteinfo_to_collisionmask(const spriteinfo_t* info, int frame
 int scanfile(const char *vpath, void *param)
 {
     const char* fullpath = asset_path(vpath);
+    double start_time = startuptrace_clock();
 
-    /* read the .spr file */
+    /* index the sprites of the .spr file */
     parsetree_program_t* p = nanoparser_construct_tree(fullpath);
     nanoparser_traverse_program_ex(p, (void*)vpath, traverse);
     nanoparser_deconstruct_tree(p);
+    startuptrace_add_asset("sprite", vpath, start_time);
 
     /* done! */
     return 0;
 }
 
+/*
+ * find_sprite()
+ * Finds a sprite, loading it on first use.
+ * Returns NULL if there is no such sprite
+ */
+const spriteinfo_t* find_sprite(const char* sprite_name)
+{
+    const spriteinfo_t* sprite;
+    const spritesource_t* source;
+
+    /* the sprite has already been loaded */
+    if(NULL != (sprite = hashtable_spriteinfo_t_find(sprites, sprite_name)))
+        return sprite;
+
+    /* the sprite doesn't exist */
+    if(NULL == (source = hashtable_spritesource_t_find(sprite_index, sprite_name)))
+        return NULL;
+
+    /* read the .spr file that defines the sprite */
+    spritequery_t query = { .sprite_name = sprite_name, .result = NULL };
+    parsetree_program_t* p = nanoparser_construct_tree(asset_path(source->vpath));
+    nanoparser_traverse_program_ex(p, (void*)&query, traverse_sprite);
+    nanoparser_deconstruct_tree(p);
+
+    /* register the sprite */
+    if(query.result == NULL) {
+        logfile_message("Can't find sprite \"%s\" in \"%s\"", sprite_name, source->vpath);
+        return NULL;
+    }
+
+    hashtable_spriteinfo_t_add(sprites, sprite_name, query.result);
+    return query.result;
+}
+
+/*
+ * spritesource_create()
+ * Creates an entry of the index of sprites
+ */
+spritesource_t* spritesource_create(const char* vpath)
+{
+    spritesource_t* source = mallocx(sizeof *source);
+    source->vpath = str_dup(vpath);
+    return source;
+}
+
+/*
+ * spritesource_destroy()
+ * Destroys an entry of the index of sprites
+ */
+void spritesource_destroy(spritesource_t* source)
+{
+    free(source->vpath);
+    free(source);
+}
+
 /*
  * spriteinfo_new()
  * Creates a new empty spriteinfo_t instance
@@ -465,10 +592,14 @@ spriteinfo_t *spriteinfo_new()
     darray_init(sprite->preprocessed_transition);
     sprite->transition_from = NULL; /* lazy allocation */
     sprite->transition_from_length = 0;
+    sprite->transition_matrix = NULL; /* lazy allocation */
+    sprite->transition_matrix_width = 0;
 
     sprite->prog_anims = dictionary_create(true, destroy_proganim, sprite);
     sprite->user_properties = dictionary_create(true, destroy_userproperty, sprite);
 
+    sprite->memory = 0;
+
     return sprite;
 }
 
@@ -480,6 +611,9 @@ spriteinfo_t *spriteinfo_delete(spriteinfo_t *sprite)
 {
     extern animation_t *animation_destroy(animation_t *anim);
 
+    /* memory usage */
+    resourcemanager_track_memory(RESOURCE_SPRITE, -(int64_t)sprite->memory);
+
     /* delete user-defined properties */
     dictionary_destroy(sprite->user_properties);
 
@@ -490,6 +624,10 @@ spriteinfo_t *spriteinfo_delete(spriteinfo_t *sprite)
     if(sprite->transition_from != NULL)
         free(sprite->transition_from);
 
+    /* delete the transition matrix */
+    if(sprite->transition_matrix != NULL)
+        free(sprite->transition_matrix);
+
     /* delete the preprocessed transitions */
     for(int i = 0; i < darray_length(sprite->preprocessed_transition); i++)
         transition_delete(sprite->preprocessed_transition[i]);
@@ -536,6 +674,38 @@ spriteinfo_t *spriteinfo_delete(spriteinfo_t *sprite)
     return NULL;
 }
 
+/*
+ * estimate_memory()
+ * Estimates the memory used by the metadata of a sprite, in bytes.
+ * The pixel data is accounted as images
+ */
+size_t estimate_memory(const spriteinfo_t* sprite)
+{
+    const size_t IMAGE_OVERHEAD = 64; /* image_t + ALLEGRO_BITMAP of a sub-image */
+    const size_t ANIMATION_OVERHEAD = 128; /* animation_t */
+    size_t memory = sizeof(*sprite);
+
+    /* frames */
+    memory += sprite->frame_count * (sizeof(image_t*) + IMAGE_OVERHEAD);
+
+    /* animations */
+    memory += sprite->animation_count * sizeof(animation_t*);
+    for(int i = 0; i < sprite->animation_count; i++) {
+        const animation_t* anim = sprite->animation_data[i];
+        if(anim != NULL)
+            memory += ANIMATION_OVERHEAD + animation_frame_count(anim) * sizeof(int);
+    }
+
+    /* transitions */
+    memory += darray_length(sprite->transition) * (sizeof(animtransition_t*) + sizeof(animtransition_t));
+    memory += darray_length(sprite->preprocessed_transition) * (sizeof(animtransition_t*) + sizeof(animtransition_t));
+    memory += sprite->transition_from_length * sizeof(int);
+    if(sprite->transition_matrix != NULL)
+        memory += sprite->transition_matrix_width * sprite->transition_matrix_width * sizeof(const animation_t*);
+
+    return memory;
+}
+
 /*
  * allocate_sprite_anim()
  * Allocate an animation ID in a spriteinfo_t instance
@@ -774,6 +944,23 @@ void preprocess_transitions(spriteinfo_t *sprite)
         if(sprite->transition_from[i] == -1)
             sprite->transition_from[i] = sprite->transition_from[i+1]; /* one minus the other (count) is zero */
     }
+
+    /* build a dense transition matrix, unless it would be too large. A
+       character with 40 animations needs 1600 entries. If there are many
+       transitions from x to y, the first one in the sorted order wins */
+    if(sup_anim_id <= MAX_TRANSITION_MATRIX_WIDTH) {
+        assertx(sprite->transition_matrix == NULL);
+        sprite->transition_matrix_width = sup_anim_id;
+        sprite->transition_matrix = mallocx(sup_anim_id * sup_anim_id * sizeof(const animation_t*));
+        for(int i = sup_anim_id * sup_anim_id - 1; i >= 0; i--)
+            sprite->transition_matrix[i] = NULL;
+
+        for(int i = n-1; i >= 0; i--) {
+            const animtransition_t* transition = sprite->preprocessed_transition[i];
+            if(transition->to_id >= 0 && transition->to_id < sup_anim_id)
+                sprite->transition_matrix[transition->from_id * sup_anim_id + transition->to_id] = sprite->animation_data[transition->anim_id];
+        }
+    }
 }
 
 
@@ -915,15 +1102,13 @@ void validate_sprite(spriteinfo_t *spr)
 
     /* validate individual keyframe-based animations */
     extern void proganim_validate(proganim_t* prog_anim);
-    iterator_t* it = dictionary_keys(spr->prog_anims);
-    while(iterator_has_next(it)) {
-        const char* name = iterator_next(it);
+    for(int i = 0; i < dictionary_count(spr->prog_anims); i++) {
+        const char* name = dictionary_key_at(spr->prog_anims, i);
         logfile_message("Validating keyframe-based animation \"%s\"...", name);
 
-        proganim_t* prog_anim = dictionary_get(spr->prog_anims, name);
+        proganim_t* prog_anim = dictionary_value_at(spr->prog_anims, i);
         proganim_validate(prog_anim);
     }
-    iterator_destroy(it);
 }
 
 
@@ -951,6 +1136,65 @@ void load_sprite_images(spriteinfo_t *spr)
             cur_y += spr->frame_h;
         }
     }
+
+    /* large frames are often mostly transparent */
+    trim_sprite_images(spr);
+}
+
+/*
+ * trim_sprite_images()
+ * Computes the bounds of the visible pixels of each large frame, so that
+ * drawing it skips its transparent borders and saves fill rate
+ */
+void trim_sprite_images(spriteinfo_t *spr)
+{
+    image_t* spritesheet = (image_t*)spr->spritesheet;
+    int sheet_w = image_width(spritesheet), sheet_h = image_height(spritesheet);
+    int columns = spr->rect_w / spr->frame_w;
+
+    if(spr->frame_w * spr->frame_h < TRIM_MIN_AREA)
+        return;
+
+    /* lock the entire spritesheet, as in spriteinfo_to_collisionmask() */
+    image_lock(spritesheet, "r");
+    for(int i = 0; i < spr->frame_count; i++) {
+        int frame_x = spr->rect_x + (i % columns) * spr->frame_w;
+        int frame_y = spr->rect_y + (i / columns) * spr->frame_h;
+        int w = min(spr->frame_w, sheet_w - frame_x);
+        int h = min(spr->frame_h, sheet_h - frame_y);
+        int x1 = w, y1 = h, x2 = -1, y2 = -1;
+        uint8_t r, g, b, a;
+
+        /* find the bounds of the pixels that aren't fully transparent */
+        for(int y = 0; y < h; y++) {
+            for(int x = 0; x < w; x++) {
+                color_unmap(image_getpixel(spritesheet, frame_x + x, frame_y + y), &r, &g, &b, &a);
+                if(a != 0) {
+                    x1 = min(x1, x);
+                    y1 = min(y1, y);
+                    x2 = max(x2, x);
+                    y2 = max(y2, y);
+                }
+            }
+        }
+
+        /* blank frame: keep a single transparent pixel */
+        if(x2 < 0)
+            x1 = y1 = x2 = y2 = 0;
+
+        /* keep a transparent border, so that linear filtering
+           and scaling produce the same results at the edges */
+        x1 = max(0, x1 - 1);
+        y1 = max(0, y1 - 1);
+        x2 = min(w - 1, x2 + 1);
+        y2 = min(h - 1, y2 + 1);
+
+        /* trim the frame if it's worth it */
+        int trimmed_area = (x2 - x1 + 1) * (y2 - y1 + 1);
+        if(trimmed_area <= TRIM_MAX_COVERAGE * (spr->frame_w * spr->frame_h))
+            image_trim(spr->frame_data[i], x1, y1, x2 - x1 + 1, y2 - y1 + 1);
+    }
+    image_unlock(spritesheet);
 }
 
 
@@ -994,7 +1238,7 @@ int traverse(const parsetree_statement_t *stmt, void *vpath)
     const char *identifier, *sprite_name;
     const parsetree_parameter_t *param_list;
     const parsetree_parameter_t *p1, *p2;
-    const spriteinfo_t *sprite;
+    const spritesource_t *source;
 
     identifier = nanoparser_get_identifier(stmt);
     param_list = nanoparser_get_parameter_list(stmt);
@@ -1007,12 +1251,11 @@ int traverse(const parsetree_statement_t *stmt, void *vpath)
         nanoparser_expect_program(p2, "Must provide sprite attributes");
 
         sprite_name = nanoparser_get_string(p1);
-        nanoparser_warn(stmt, "Loading sprite \"%s\"", sprite_name);
 
-        if(NULL == (sprite = hashtable_spriteinfo_t_find(sprites, sprite_name))) {
+        if(NULL == (source = hashtable_spritesource_t_find(sprite_index, sprite_name))) {
             /* register a new sprite */
-            spriteinfo_t *new_sprite = spriteinfo_create(nanoparser_get_program(p2));
-            hashtable_spriteinfo_t_add(sprites, sprite_name, new_sprite);
+            spritesource_t *new_source = spritesource_create((const char*)vpath);
+            hashtable_spritesource_t_add(sprite_index, sprite_name, new_source);
         }
         else {
             /* solve conflicting definitions for the same sprite */
@@ -1021,12 +1264,12 @@ int traverse(const parsetree_statement_t *stmt, void *vpath)
             if(must_override) {
                 nanoparser_warn(stmt, "OVERRIDE: redefining sprite \"%s\"", sprite_name);
 
-                spriteinfo_t *new_sprite = spriteinfo_create(nanoparser_get_program(p2));
-                if(hashtable_spriteinfo_t_replace(sprites, sprite_name, new_sprite))
+                spritesource_t *new_source = spritesource_create((const char*)vpath);
+                if(hashtable_spritesource_t_replace(sprite_index, sprite_name, new_source))
                     return 0; /* the sprite has been successfully redefined */
 
                 nanoparser_warn(stmt, "Can't override sprite \"%s\"", sprite_name); /* shouldn't happen */
-                spriteinfo_destroy(new_sprite);
+                spritesource_destroy(new_source);
             }
             else
                 nanoparser_warn(stmt, "Can't redefine sprite \"%s\"", sprite_name);
@@ -1038,6 +1281,38 @@ int traverse(const parsetree_statement_t *stmt, void *vpath)
     return 0;
 }
 
+/*
+ * traverse_sprite()
+ * Loads a particular sprite of a .spr file
+ */
+int traverse_sprite(const parsetree_statement_t *stmt, void *spritequery)
+{
+    spritequery_t *query = (spritequery_t*)spritequery;
+    const char *identifier, *sprite_name;
+    const parsetree_parameter_t *param_list;
+    const parsetree_parameter_t *p1, *p2;
+
+    identifier = nanoparser_get_identifier(stmt);
+    param_list = nanoparser_get_parameter_list(stmt);
+
+    /* the .spr file has been validated when indexing */
+    if(str_icmp(identifier, "sprite") != 0)
+        return 0;
+
+    p1 = nanoparser_get_nth_parameter(param_list, 1); /* first parameter = sprite name */
+    p2 = nanoparser_get_nth_parameter(param_list, 2); /* second parameter = block */
+    sprite_name = nanoparser_get_string(p1);
+
+    /* only the first definition of the sprite in the file is considered */
+    if(str_icmp(sprite_name, query->sprite_name) == 0) {
+        nanoparser_warn(stmt, "Loading sprite \"%s\"", sprite_name);
+        query->result = spriteinfo_create(nanoparser_get_program(p2));
+        return 1; /* stop the traversal */
+    }
+
+    return 0;
+}
+
 
 /*
  * traverse_sprite_attributes()
@@ -90,6 +90,9 @@ int spriteinfo_frame_width(const spriteinfo_t* info);
 /* the height of a frame of the sprite */
 int spriteinfo_frame_height(const spriteinfo_t* info);
 
+/* checks if all the pixels of all the frames of the sprite are fully opaque */
+bool spriteinfo_is_opaque(const spriteinfo_t* info);
+
 /* create a collision mask from a frame of the spritesheet */
 struct collisionmask_t* spriteinfo_to_collisionmask(const spriteinfo_t* info, int frame_index);
 
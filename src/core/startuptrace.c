@@ -0,0 +1,386 @@
+/*
+ * Open Surge Engine
+ * startuptrace.c - loading-time breakdown of the startup
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <allegro5/allegro.h>
+#include <string.h>
+#include "startuptrace.h"
+#include "logfile.h"
+#include "../util/util.h"
+#include "../util/stringutil.h"
+
+/*
+
+The startup trace records the nested phases of the initialization of the
+engine, delimited by startuptrace_begin() and startuptrace_end(), as well
+as the time taken to load each asset. Only the slowest assets are kept.
+Assets and background phases may be added from any thread.
+
+When the trace is stopped, a breakdown is written to the logfile and, if
+requested, to a JSON file in the Chrome trace event format.
+
+*/
+
+#define MAX_PHASES              64  /* maximum number of recorded phases */
+#define MAX_DEPTH               8   /* maximum nesting depth */
+#define MAX_ASSET_KINDS         8   /* images, samples, scripts... */
+#define SLOWEST_ASSETS          16  /* number of assets kept in the trace */
+#define ASSET_PATHMAX           256
+
+/* a phase of the startup */
+typedef struct startupphase_t startupphase_t;
+struct startupphase_t {
+    const char* name; /* a string literal */
+    double start_time; /* in seconds */
+    double end_time;
+    int depth;
+    bool background; /* done in another thread? */
+};
+
+/* a loaded asset */
+typedef struct startupasset_t startupasset_t;
+struct startupasset_t {
+    const char* kind; /* a string literal */
+    char filepath[ASSET_PATHMAX];
+    double start_time; /* in seconds */
+    double elapsed_time;
+};
+
+/* statistics of a kind of asset */
+typedef struct startupassetkind_t startupassetkind_t;
+struct startupassetkind_t {
+    const char* kind; /* a string literal */
+    int count;
+    double elapsed_time;
+};
+
+/* trace state */
+static bool is_enabled = false;
+static double trace_start_time = 0.0;
+static double trace_end_time = 0.0;
+static ALLEGRO_MUTEX* mutex = NULL; /* protects the data below */
+static startupphase_t phase[MAX_PHASES];
+static int phase_count = 0;
+static int stack[MAX_DEPTH]; /* indices of the open phases */
+static int stack_size = 0;
+static startupasset_t slowest[SLOWEST_ASSETS]; /* sorted by elapsed time, in descending order */
+static int slowest_count = 0;
+static startupassetkind_t asset_kind[MAX_ASSET_KINDS];
+static int asset_kind_count = 0;
+
+static void add_phase(const char* phase_name, double start_time, double end_time, int depth, bool background);
+static void log_trace();
+static bool export_trace(const char* filepath);
+static void write_json_string(ALLEGRO_FILE* fp, const char* str);
+
+
+
+/*
+ * startuptrace_start()
+ * Starts tracing the startup. Allegro must be initialized
+ */
+void startuptrace_start()
+{
+    if(mutex == NULL)
+        mutex = al_create_mutex();
+
+    phase_count = 0;
+    stack_size = 0;
+    slowest_count = 0;
+    asset_kind_count = 0;
+
+    trace_start_time = trace_end_time = al_get_time();
+    is_enabled = true;
+}
+
+/*
+ * startuptrace_stop()
+ * Stops tracing the startup, writes the trace to the logfile and,
+ * if json_filepath is not NULL, exports it to a file in the virtual
+ * filesystem. Other threads must no longer add anything to the trace
+ */
+void startuptrace_stop(const char* json_filepath)
+{
+    if(!is_enabled)
+        return;
+
+    /* close the phases that are still open */
+    trace_end_time = al_get_time();
+    while(stack_size > 0)
+        startuptrace_end();
+
+    is_enabled = false;
+
+    /* report */
+    log_trace();
+    if(json_filepath != NULL)
+        export_trace(json_filepath);
+
+    /* release the mutex */
+    al_destroy_mutex(mutex);
+    mutex = NULL;
+}
+
+/*
+ * startuptrace_is_enabled()
+ * Are we tracing the startup?
+ */
+bool startuptrace_is_enabled()
+{
+    return is_enabled;
+}
+
+/*
+ * startuptrace_begin()
+ * Opens a phase of the startup. Call it from the main thread only
+ */
+void startuptrace_begin(const char* phase_name)
+{
+    if(!is_enabled)
+        return;
+
+    if(stack_size >= MAX_DEPTH) {
+        stack_size++; /* keep the calls to startuptrace_end() paired */
+        return;
+    }
+
+    al_lock_mutex(mutex);
+    stack[stack_size] = phase_count;
+    add_phase(phase_name, al_get_time(), 0.0, stack_size, false);
+    stack_size++;
+    al_unlock_mutex(mutex);
+}
+
+/*
+ * startuptrace_end()
+ * Closes the phase opened by the last call to startuptrace_begin()
+ */
+void startuptrace_end()
+{
+    if(!is_enabled || stack_size == 0)
+        return;
+
+    if(--stack_size >= MAX_DEPTH)
+        return;
+
+    al_lock_mutex(mutex);
+    if(stack[stack_size] < phase_count)
+        phase[stack[stack_size]].end_time = al_get_time();
+    al_unlock_mutex(mutex);
+}
+
+/*
+ * startuptrace_clock()
+ * The current time, in seconds. Pass it to startuptrace_add_asset()
+ * after loading an asset. Returns zero if the trace is disabled
+ */
+double startuptrace_clock()
+{
+    return is_enabled ? al_get_time() : 0.0;
+}
+
+/*
+ * startuptrace_add_asset()
+ * Adds an asset, loaded from start_time till now, to the trace.
+ * kind must be a string literal such as "image"
+ */
+void startuptrace_add_asset(const char* kind, const char* filepath, double start_time)
+{
+    if(!is_enabled)
+        return;
+
+    double elapsed_time = al_get_time() - start_time;
+
+    al_lock_mutex(mutex);
+
+    /* update the statistics of this kind of asset */
+    int k = 0;
+    while(k < asset_kind_count && strcmp(asset_kind[k].kind, kind) != 0)
+        k++;
+
+    if(k < MAX_ASSET_KINDS) {
+        if(k == asset_kind_count) {
+            asset_kind[k].kind = kind;
+            asset_kind[k].count = 0;
+            asset_kind[k].elapsed_time = 0.0;
+            asset_kind_count++;
+        }
+
+        asset_kind[k].count++;
+        asset_kind[k].elapsed_time += elapsed_time;
+    }
+
+    /* keep the slowest assets only */
+    if(slowest_count < SLOWEST_ASSETS || elapsed_time > slowest[slowest_count - 1].elapsed_time) {
+        int i = (slowest_count < SLOWEST_ASSETS) ? slowest_count++ : slowest_count - 1;
+
+        /* insertion sort */
+        for(; i > 0 && slowest[i-1].elapsed_time < elapsed_time; i--)
+            slowest[i] = slowest[i-1];
+
+        slowest[i].kind = kind;
+        slowest[i].start_time = start_time;
+        slowest[i].elapsed_time = elapsed_time;
+        str_cpy(slowest[i].filepath, filepath, sizeof(slowest[i].filepath));
+    }
+
+    al_unlock_mutex(mutex);
+}
+
+/*
+ * startuptrace_add_background_phase()
+ * Adds a phase, performed from start_time till now in another thread,
+ * to the trace. phase_name must be a string literal
+ */
+void startuptrace_add_background_phase(const char* phase_name, double start_time)
+{
+    if(!is_enabled)
+        return;
+
+    al_lock_mutex(mutex);
+    add_phase(phase_name, start_time, al_get_time(), 0, true);
+    al_unlock_mutex(mutex);
+}
+
+
+
+/* private stuff */
+
+/* adds a phase to the trace. Lock the mutex before calling this */
+void add_phase(const char* phase_name, double start_time, double end_time, int depth, bool background)
+{
+    if(phase_count >= MAX_PHASES)
+        return;
+
+    startupphase_t* p = &phase[phase_count++];
+    p->name = phase_name;
+    p->start_time = start_time;
+    p->end_time = end_time;
+    p->depth = depth;
+    p->background = background;
+}
+
+/* writes the trace to the logfile */
+void log_trace()
+{
+    double total_time = trace_end_time - trace_start_time;
+
+    logfile_message("Startup trace: %.3f seconds", total_time);
+
+    /* phases */
+    for(int i = 0; i < phase_count; i++) {
+        const startupphase_t* p = &phase[i];
+        double elapsed_time = p->end_time - p->start_time;
+        int indent = 2 * p->depth;
+
+        logfile_message("    %*s%-*s %10.3f ms %6.1f%%%s",
+            indent, "", 36 - indent, p->name,
+            1000.0 * elapsed_time,
+            total_time > 0.0 ? 100.0 * elapsed_time / total_time : 0.0,
+            p->background ? " (background)" : ""
+        );
+    }
+
+    /* kinds of assets */
+    for(int k = 0; k < asset_kind_count; k++) {
+        logfile_message("    %d %s file(s) loaded in %.3f ms",
+            asset_kind[k].count, asset_kind[k].kind,
+            1000.0 * asset_kind[k].elapsed_time
+        );
+    }
+
+    /* slowest assets */
+    if(slowest_count > 0) {
+        logfile_message("    Slowest assets:");
+        for(int i = 0; i < slowest_count; i++) {
+            logfile_message("    %10.3f ms  %-8s %s",
+                1000.0 * slowest[i].elapsed_time, slowest[i].kind, slowest[i].filepath
+            );
+        }
+    }
+}
+
+/* exports the trace to a JSON file in the Chrome trace event format */
+bool export_trace(const char* filepath)
+{
+    ALLEGRO_FILE* fp;
+
+    if(NULL == (fp = al_fopen(filepath, "w"))) {
+        logfile_message("Can't export the startup trace to \"%s\"", filepath);
+        return false;
+    }
+
+    al_fputs(fp, "{\"traceEvents\":[\n");
+
+    /* the startup */
+    al_fprintf(fp, "{\"name\":\"startup\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":0.000,\"dur\":%.3f}",
+        1e6 * (trace_end_time - trace_start_time));
+
+    /* the phases: the main thread is tid 1 and other threads are tid 2 */
+    for(int i = 0; i < phase_count; i++) {
+        const startupphase_t* p = &phase[i];
+        al_fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+            p->name, p->background ? 2 : 1,
+            1e6 * (p->start_time - trace_start_time), 1e6 * (p->end_time - p->start_time));
+    }
+
+    /* the slowest assets: tid 3 */
+    for(int i = 0; i < slowest_count; i++) {
+        al_fputs(fp, ",\n{\"name\":");
+        write_json_string(fp, slowest[i].filepath);
+        al_fprintf(fp, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":3,\"ts\":%.3f,\"dur\":%.3f}",
+            slowest[i].kind,
+            1e6 * (slowest[i].start_time - trace_start_time), 1e6 * slowest[i].elapsed_time);
+    }
+
+    /* the statistics of the assets */
+    al_fputs(fp, "\n],\"assets\":{");
+    for(int k = 0; k < asset_kind_count; k++) {
+        al_fprintf(fp, "%s\"%s\":{\"count\":%d,\"ms\":%.3f}",
+            k > 0 ? "," : "", asset_kind[k].kind,
+            asset_kind[k].count, 1000.0 * asset_kind[k].elapsed_time);
+    }
+    al_fputs(fp, "}}\n");
+
+    al_fclose(fp);
+
+    logfile_message("Exported the startup trace to \"%s\"", filepath);
+    return true;
+}
+
+/* writes a quoted & escaped string to a JSON file */
+void write_json_string(ALLEGRO_FILE* fp, const char* str)
+{
+    al_fputc(fp, '"');
+
+    for(; *str; str++) {
+        unsigned char c = (unsigned char)(*str);
+
+        if(c == '"' || c == '\\') {
+            al_fputc(fp, '\\');
+            al_fputc(fp, c);
+        }
+        else if(c < 0x20)
+            al_fprintf(fp, "\\u%04x", c);
+        else
+            al_fputc(fp, c);
+    }
+
+    al_fputc(fp, '"');
+}
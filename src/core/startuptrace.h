@@ -0,0 +1,40 @@
+/*
+ * Open Surge Engine
+ * startuptrace.h - loading-time breakdown of the startup
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STARTUPTRACE_H
+#define _STARTUPTRACE_H
+
+#include <stdbool.h>
+
+/* start & stop the trace */
+void startuptrace_start(); /* call after al_init() */
+void startuptrace_stop(const char* json_filepath); /* logs the trace and optionally exports it (json_filepath may be NULL) */
+bool startuptrace_is_enabled();
+
+/* phases: pass a string literal to startuptrace_begin() and pair it with startuptrace_end(). Main thread only */
+void startuptrace_begin(const char* phase_name);
+void startuptrace_end();
+
+/* assets & background work (thread-safe) */
+double startuptrace_clock(); /* pass the returned value to one of the functions below */
+void startuptrace_add_asset(const char* kind, const char* filepath, double start_time); /* kind is a string literal */
+void startuptrace_add_background_phase(const char* phase_name, double start_time); /* work done in another thread */
+
+#endif
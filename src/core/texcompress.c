@@ -0,0 +1,428 @@
+/*
+ * Open Surge Engine
+ * texcompress.c - compressed textures
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_opengl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "texcompress.h"
+#include "asset.h"
+#include "logfile.h"
+#include "../util/util.h"
+#include "../util/stringutil.h"
+
+/*
+
+COMPRESSED TEXTURES
+-------------------
+
+An uncompressed image takes 4 bytes per pixel of GPU memory. A compressed
+texture in the BC1 (DXT1) format takes half a byte per pixel; in the BC3
+(DXT5) format, which has an alpha channel, it takes one byte per pixel.
+
+The converter writes a DDS file next to each large PNG image of the game
+(e.g., images/foo.png -> images/foo.dds) in the user space. Opaque images
+are stored as BC1; others, as BC3. The pixels are stored with pre-multiplied
+alpha, as the engine expects. The files may then be shipped with the game.
+
+Allegro loads DDS files with BC1, BC2 or BC3 data straight into compressed
+textures. image_load() uses the compressed variant of an image if it exists,
+if the resource manager asks for compressed textures and if the GPU supports
+them. Otherwise, the original image is decoded as usual.
+
+ETC2 and ASTC, common on mobile GPUs, are not supported: Allegro can't load
+them into its bitmaps.
+
+*/
+
+#define COMPRESSED_EXTENSION    ".dds"
+#define MIN_COMPRESSED_SIZE     256 /* smaller images are packed into the (uncompressed) texture atlas. See image.c */
+
+/* DDS file format */
+#define DDS_MAGIC               0x20534444 /* "DDS " */
+#define DDS_HEADER_SIZE         124
+#define DDS_PIXELFORMAT_SIZE    32
+#define DDSD_CAPS               0x1
+#define DDSD_HEIGHT             0x2
+#define DDSD_WIDTH              0x4
+#define DDSD_PIXELFORMAT        0x1000
+#define DDSD_LINEARSIZE         0x80000
+#define DDPF_FOURCC             0x4
+#define DDSCAPS_TEXTURE         0x1000
+#define FOURCC(a, b, c, d)      ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+static int convert_image(const char* vpath, void* data);
+static bool is_opaque(const uint8_t* pixels, int width, int height, int pitch);
+static void encode_image(const uint8_t* pixels, int width, int height, int pitch, bool with_alpha, uint8_t* out);
+static void encode_color_block(const uint8_t block[16][4], uint8_t* out);
+static void encode_alpha_block(const uint8_t block[16][4], uint8_t* out);
+static bool write_dds(const char* vpath, const uint8_t* data, size_t size, int width, int height, bool with_alpha);
+static inline uint16_t pack_rgb565(int r, int g, int b);
+static inline void unpack_rgb565(uint16_t c, int* r, int* g, int* b);
+
+
+
+/*
+ * texcompress_is_supported()
+ * Checks if the GPU can sample the compressed textures. Call it after
+ * creating the display
+ */
+bool texcompress_is_supported()
+{
+    static int is_supported = -1;
+
+    if(is_supported < 0)
+        is_supported = al_have_opengl_extension("GL_EXT_texture_compression_s3tc") ? 1 : 0;
+
+    return is_supported != 0;
+}
+
+/*
+ * texcompress_path()
+ * The virtual path of the compressed variant of an image
+ */
+const char* texcompress_path(const char* image_path, char* buffer, size_t buffer_size)
+{
+    const char* dot = strrchr(image_path, '.');
+    const char* slash = strrchr(image_path, '/');
+    size_t length = (dot != NULL && (slash == NULL || dot > slash)) ? (size_t)(dot - image_path) : strlen(image_path);
+
+    if(buffer_size == 0)
+        return buffer;
+
+    length = min(length, buffer_size - 1);
+    memcpy(buffer, image_path, length);
+    buffer[length] = '\0';
+
+    return strncat(buffer, COMPRESSED_EXTENSION, buffer_size - length - 1);
+}
+
+/*
+ * texcompress_convert()
+ * Writes the compressed variant of an image. Returns true on success
+ */
+bool texcompress_convert(const char* image_path)
+{
+    ALLEGRO_STATE state;
+    ALLEGRO_BITMAP* bitmap;
+    ALLEGRO_LOCKED_REGION* region;
+    char dds_path[1024];
+    bool success = false;
+
+    /* decode the image into a memory bitmap. Allegro pre-multiplies alpha */
+    al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+    al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+    bitmap = al_load_bitmap(asset_path(image_path));
+    al_restore_state(&state);
+
+    if(bitmap == NULL) {
+        logfile_message("Can't compress \"%s\": the image can't be loaded", image_path);
+        return false;
+    }
+
+    /* the blocks of the compressed formats are 4x4 pixels */
+    int width = al_get_bitmap_width(bitmap);
+    int height = al_get_bitmap_height(bitmap);
+    if(width % 4 != 0 || height % 4 != 0) {
+        logfile_message("Can't compress \"%s\": its size, %dx%d, is not a multiple of 4", image_path, width, height);
+        al_destroy_bitmap(bitmap);
+        return false;
+    }
+
+    /* encode the image */
+    if(NULL != (region = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY))) {
+        const uint8_t* pixels = (const uint8_t*)region->data;
+        bool with_alpha = !is_opaque(pixels, width, height, region->pitch);
+        size_t block_size = with_alpha ? 16 : 8;
+        size_t size = (size_t)(width / 4) * (size_t)(height / 4) * block_size;
+        uint8_t* data = mallocx(size);
+
+        encode_image(pixels, width, height, region->pitch, with_alpha, data);
+        al_unlock_bitmap(bitmap);
+
+        texcompress_path(image_path, dds_path, sizeof(dds_path));
+        success = write_dds(dds_path, data, size, width, height, with_alpha);
+        if(success)
+            logfile_message("Compressed \"%s\" (%dx%d, %s) to \"%s\"", image_path, width, height, with_alpha ? "BC3" : "BC1", dds_path);
+
+        free(data);
+    }
+    else
+        logfile_message("Can't compress \"%s\": the image can't be locked", image_path);
+
+    al_destroy_bitmap(bitmap);
+    return success;
+}
+
+/*
+ * texcompress_convert_all()
+ * Converts the large PNG images of the game to compressed textures.
+ * Returns the number of converted images
+ */
+int texcompress_convert_all()
+{
+    int count = 0;
+
+    logfile_message("Converting images to compressed textures...");
+    asset_foreach_file("images", ".png", convert_image, &count, true);
+    asset_invalidate_index(); /* we have created files */
+    logfile_message("Converted %d image%s to compressed textures", count, count != 1 ? "s" : "");
+
+    return count;
+}
+
+
+
+/* private stuff */
+
+/* asset_foreach_file() callback: converts a large image */
+int convert_image(const char* vpath, void* data)
+{
+    int* count = (int*)data;
+    int width = 0, height = 0;
+    ALLEGRO_FILE* fp;
+
+    /* read the size of the image from its PNG header */
+    if(NULL != (fp = al_fopen(asset_path(vpath), "rb"))) {
+        uint8_t header[24];
+        if(al_fread(fp, header, sizeof(header)) == sizeof(header) && memcmp(header + 12, "IHDR", 4) == 0) {
+            width = (header[16] << 24) | (header[17] << 16) | (header[18] << 8) | header[19];
+            height = (header[20] << 24) | (header[21] << 16) | (header[22] << 8) | header[23];
+        }
+        al_fclose(fp);
+    }
+
+    /* small images are packed into the texture atlas */
+    if(width <= MIN_COMPRESSED_SIZE && height <= MIN_COMPRESSED_SIZE)
+        return 0;
+
+    if(texcompress_convert(vpath))
+        (*count)++;
+
+    return 0;
+}
+
+/* checks if all pixels of an image are fully opaque */
+bool is_opaque(const uint8_t* pixels, int width, int height, int pitch)
+{
+    for(int y = 0; y < height; y++) {
+        const uint8_t* row = pixels + y * pitch;
+        for(int x = 0; x < width; x++) {
+            if(row[4 * x + 3] != 255)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/* encodes an RGBA image in BC3 (with alpha) or BC1 format. Its size must be a multiple of 4 */
+void encode_image(const uint8_t* pixels, int width, int height, int pitch, bool with_alpha, uint8_t* out)
+{
+    uint8_t block[16][4];
+
+    for(int by = 0; by < height; by += 4) {
+        for(int bx = 0; bx < width; bx += 4) {
+
+            /* read a 4x4 block */
+            for(int y = 0; y < 4; y++) {
+                const uint8_t* row = pixels + (by + y) * pitch + 4 * bx;
+                memcpy(block[4 * y], row, 16);
+            }
+
+            /* encode it */
+            if(with_alpha) {
+                encode_alpha_block(block, out);
+                out += 8;
+            }
+
+            encode_color_block(block, out);
+            out += 8;
+
+        }
+    }
+}
+
+/* encodes the colors of a 4x4 block (8 bytes) */
+void encode_color_block(const uint8_t block[16][4], uint8_t* out)
+{
+    int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+    int palette[4][3];
+    uint32_t indices = 0;
+
+    /* find the bounding box of the colors, slightly inset */
+    for(int i = 0; i < 16; i++) {
+        for(int c = 0; c < 3; c++) {
+            lo[c] = min(lo[c], block[i][c]);
+            hi[c] = max(hi[c], block[i][c]);
+        }
+    }
+
+    for(int c = 0; c < 3; c++) {
+        int inset = (hi[c] - lo[c]) / 16;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+
+    /* the endpoints: c0 > c1 selects the 4-color mode */
+    uint16_t c0 = pack_rgb565(hi[0], hi[1], hi[2]);
+    uint16_t c1 = pack_rgb565(lo[0], lo[1], lo[2]);
+    if(c0 < c1) {
+        uint16_t tmp = c0;
+        c0 = c1;
+        c1 = tmp;
+    }
+
+    /* compute the palette and pick the nearest color of each pixel */
+    if(c0 != c1) {
+        unpack_rgb565(c0, &palette[0][0], &palette[0][1], &palette[0][2]);
+        unpack_rgb565(c1, &palette[1][0], &palette[1][1], &palette[1][2]);
+        for(int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for(int i = 15; i >= 0; i--) {
+            int best = 0, best_distance = INT32_MAX;
+
+            for(int k = 0; k < 4; k++) {
+                int dr = block[i][0] - palette[k][0];
+                int dg = block[i][1] - palette[k][1];
+                int db = block[i][2] - palette[k][2];
+                int distance = dr * dr + dg * dg + db * db;
+
+                if(distance < best_distance) {
+                    best_distance = distance;
+                    best = k;
+                }
+            }
+
+            indices = (indices << 2) | (uint32_t)best;
+        }
+    }
+
+    /* write the block (little-endian) */
+    out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+    out[4] = indices & 0xFF; out[5] = (indices >> 8) & 0xFF;
+    out[6] = (indices >> 16) & 0xFF; out[7] = indices >> 24;
+}
+
+/* encodes the alpha channel of a 4x4 block (8 bytes) */
+void encode_alpha_block(const uint8_t block[16][4], uint8_t* out)
+{
+    int a0 = 0, a1 = 255;
+    uint64_t indices = 0;
+
+    /* the endpoints: a0 > a1 selects the 8-value mode */
+    for(int i = 0; i < 16; i++) {
+        a0 = max(a0, block[i][3]);
+        a1 = min(a1, block[i][3]);
+    }
+
+    /* pick the nearest value of each pixel */
+    if(a0 > a1) {
+        int palette[8] = { a0, a1 };
+        for(int k = 1; k <= 6; k++)
+            palette[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+
+        for(int i = 15; i >= 0; i--) {
+            int best = 0, best_distance = 256;
+
+            for(int k = 0; k < 8; k++) {
+                int distance = abs(block[i][3] - palette[k]);
+
+                if(distance < best_distance) {
+                    best_distance = distance;
+                    best = k;
+                }
+            }
+
+            indices = (indices << 3) | (uint64_t)best;
+        }
+    }
+
+    /* write the block (little-endian) */
+    out[0] = (uint8_t)a0;
+    out[1] = (uint8_t)a1;
+    for(int j = 0; j < 6; j++)
+        out[2 + j] = (indices >> (8 * j)) & 0xFF;
+}
+
+/* writes compressed data to a DDS file */
+bool write_dds(const char* vpath, const uint8_t* data, size_t size, int width, int height, bool with_alpha)
+{
+    ALLEGRO_FILE* fp;
+
+    if(NULL == (fp = al_fopen(asset_path(vpath), "wb"))) {
+        logfile_message("Can't write \"%s\"", vpath);
+        return false;
+    }
+
+    /* header */
+    al_fwrite32le(fp, DDS_MAGIC);
+    al_fwrite32le(fp, DDS_HEADER_SIZE);
+    al_fwrite32le(fp, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE);
+    al_fwrite32le(fp, height);
+    al_fwrite32le(fp, width);
+    al_fwrite32le(fp, (int32_t)size); /* linear size */
+    al_fwrite32le(fp, 0); /* depth */
+    al_fwrite32le(fp, 0); /* mipmap count */
+    for(int i = 0; i < 11; i++)
+        al_fwrite32le(fp, 0); /* reserved */
+
+    /* pixel format */
+    al_fwrite32le(fp, DDS_PIXELFORMAT_SIZE);
+    al_fwrite32le(fp, DDPF_FOURCC);
+    al_fwrite32le(fp, with_alpha ? FOURCC('D', 'X', 'T', '5') : FOURCC('D', 'X', 'T', '1'));
+    for(int i = 0; i < 5; i++)
+        al_fwrite32le(fp, 0); /* bit count & masks */
+
+    /* caps */
+    al_fwrite32le(fp, DDSCAPS_TEXTURE);
+    for(int i = 0; i < 4; i++)
+        al_fwrite32le(fp, 0); /* caps2, caps3, caps4, reserved */
+
+    /* data */
+    bool success = (al_fwrite(fp, data, size) == size);
+    al_fclose(fp);
+
+    if(!success)
+        logfile_message("Can't write \"%s\"", vpath);
+
+    return success;
+}
+
+/* packs a color in the RGB565 format */
+uint16_t pack_rgb565(int r, int g, int b)
+{
+    return (uint16_t)((((r * 31 + 127) / 255) << 11) | (((g * 63 + 127) / 255) << 5) | ((b * 31 + 127) / 255));
+}
+
+/* unpacks a color in the RGB565 format */
+void unpack_rgb565(uint16_t c, int* r, int* g, int* b)
+{
+    int r5 = (c >> 11) & 31, g6 = (c >> 5) & 63, b5 = c & 31;
+
+    *r = (r5 << 3) | (r5 >> 2);
+    *g = (g6 << 2) | (g6 >> 4);
+    *b = (b5 << 3) | (b5 >> 2);
+}
@@ -0,0 +1,35 @@
+/*
+ * Open Surge Engine
+ * texcompress.h - compressed textures
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEXCOMPRESS_H
+#define _TEXCOMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* loading */
+bool texcompress_is_supported(); /* can the GPU sample compressed textures? Call after creating the display */
+const char* texcompress_path(const char* image_path, char* buffer, size_t buffer_size); /* the virtual path of the compressed variant of an image */
+
+/* offline conversion */
+bool texcompress_convert(const char* image_path); /* writes the compressed variant of an image */
+int texcompress_convert_all(); /* converts the images of the game; returns the number of converted images */
+
+#endif
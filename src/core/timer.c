@@ -30,6 +30,8 @@ static double previous_time = 0.0;
 static double delta_time = 0.0;
 static double smooth_delta_time = 0.0;
 static int64_t frames = 0;
+static double fixed_delta = 0.0; /* fixed timestep, if positive */
+static float interpolation = 1.0f; /* interpolation factor used when rendering */
 
 static bool is_paused = false;
 static double pause_duration = 0.0;
@@ -89,7 +91,10 @@ void timer_update()
     }
 
     /* read the time at the beginning of this framestep */
-    current_time = timer_get_now();
+    if(fixed_delta > 0.0)
+        current_time = previous_time + fixed_delta;
+    else
+        current_time = timer_get_now();
 
     /* compute the delta time */
     delta_time = current_time > previous_time ? current_time - previous_time : 0.0;
@@ -113,6 +118,65 @@ void timer_update()
 }
 
 
+/*
+ * timer_set_fixed_delta()
+ * Makes the time advance by a fixed timestep at each framestep,
+ * regardless of the wall-clock time. Pass zero to disable
+ */
+void timer_set_fixed_delta(double delta)
+{
+    fixed_delta = max(delta, 0.0);
+}
+
+
+/*
+ * timer_set_interpolation()
+ * Sets the factor used to interpolate the previous and the current
+ * simulation states when rendering: 0.0 means the previous state and
+ * 1.0 (the default) means the current state
+ */
+void timer_set_interpolation(float alpha)
+{
+    interpolation = clip01(alpha);
+}
+
+
+/*
+ * timer_get_interpolation()
+ * The interpolation factor of the rendering, in [0,1]. This is 1.0
+ * unless we are rendering in between two simulation steps
+ */
+float timer_get_interpolation()
+{
+    return interpolation;
+}
+
+
+/*
+ * timer_get_framestep()
+ * Gets the measured times of the current framestep, in seconds
+ */
+void timer_get_framestep(double* elapsed, double* delta, double* smooth_delta)
+{
+    *elapsed = current_time;
+    *delta = delta_time;
+    *smooth_delta = smooth_delta_time;
+}
+
+
+/*
+ * timer_replay_framestep()
+ * Overrides the measured times of the current framestep with
+ * recorded ones. Call it after timer_update()
+ */
+void timer_replay_framestep(double elapsed, double delta, double smooth_delta)
+{
+    current_time = previous_time = elapsed;
+    delta_time = delta;
+    smooth_delta_time = smooth_delta;
+}
+
+
 /*
  * timer_get_delta()
  * Returns the time interval, in seconds, between the last two cycles of the main loop
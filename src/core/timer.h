@@ -34,6 +34,15 @@ float timer_get_smooth_delta();
 double timer_get_elapsed();
 double timer_get_now();
 int64_t timer_get_frames();
+void timer_set_fixed_delta(double delta); /* used in benchmark mode and in fixed timestep mode */
+
+/* interpolated rendering */
+void timer_set_interpolation(float alpha);
+float timer_get_interpolation();
+
+/* input replays */
+void timer_get_framestep(double* elapsed, double* delta, double* smooth_delta);
+void timer_replay_framestep(double elapsed, double delta, double smooth_delta); /* overrides the measured times of the current framestep */
 
 /* pause & resume */
 void timer_pause();
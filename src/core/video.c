@@ -41,6 +41,8 @@
 #include "engine.h"
 #include "timer.h"
 #include "logfile.h"
+#include "profiler.h"
+#include "gputimer.h"
 #include "global.h"
 #include "font.h"
 #include "lang.h"
@@ -89,6 +91,11 @@ static fun_glclearcolor_t _glClearColor = NULL;
 static fun_glcleardepth_t _glClearDepth = NULL;
 static void import_opengl_symbols();
 
+/* pipelined rendering */
+static bool is_pipelined = false; /* defer the flip of the display to the next frame? */
+static bool has_pending_flip = false;
+static void flip_display();
+
 
 /* FPS counter */
 #define TARGET_FPS 60
@@ -101,11 +108,47 @@ static int index_of_next_fps_sample = 0;
 static int fps_frames = 0;
 static double fps_counted = 0.0;
 static double fps_last_update = 0.0;
+static double input_latency = 0.0; /* in seconds */
 static void init_fps();
 static void update_fps();
-static void render_fps();
+static void render_fps(const char* fps_text);
 static int sort_fps_samples(const void* a, const void* b);
 
+/* Quality governor: the distribution of the frame times is evaluated in
+   windows of frames. The governor takes the next step of the quality ladder
+   (see videoqualitystep_t) when a window is slow or when the device is hot,
+   and it takes a step back after a few consecutive fast windows. A step back
+   that is quickly undone doubles the wait before the next one, so that the
+   quality doesn't oscillate. Dynamic resolution is the end of the ladder: it
+   lowers the resolution of full-screen effects */
+#define GOVERNOR_WINDOW NUMBER_OF_FPS_SAMPLES /* in frames */
+#define GOVERNOR_PERCENTILE 0.9 /* of the frame times of a window; the median hides stutters */
+#define RENDER_SCALE_STEP 0.25f
+#define THERMAL_STATUS_MODERATE 2 /* see PowerManager.getCurrentThermalStatus() on Android */
+#define THERMAL_STATUS_SEVERE 3
+static const double SLOW_FRAME_TIME = 1.15 / TARGET_FPS; /* in seconds */
+static const double FAST_FRAME_TIME = 1.05 / TARGET_FPS;
+static const int MIN_WINDOWS_BEFORE_RAISING = 5; /* consecutive fast windows */
+static const int MAX_WINDOWS_BEFORE_RAISING = 80;
+static const double THERMAL_POLL_INTERVAL = 5.0; /* in seconds */
+static struct {
+    videoqualitystep_t step; /* the last step taken */
+    double frame_time[GOVERNOR_WINDOW];
+    int frame_count; /* frames of the current window */
+    int fast_windows; /* consecutive fast windows */
+    int windows_before_raising;
+    int windows_since_raising;
+    int thermal_status;
+    double last_thermal_poll;
+} governor;
+static float render_scale = 1.0f;
+static void reset_governor();
+static void update_governor(double frame_time);
+static bool lower_quality();
+static bool raise_quality();
+static void set_quality_step(videoqualitystep_t step);
+static bool is_quality_step_enabled(videoqualitystep_t step);
+
 
 /* Video settings */
 static struct {
@@ -128,6 +171,12 @@ static struct {
     /* should we display the FPS counter? */
     bool is_fps_visible;
 
+    /* is dynamic resolution enabled? */
+    bool is_dynamic_resolution;
+
+    /* is adaptive quality enabled? */
+    bool is_adaptive_quality;
+
 } settings = {
     .resolution = VIDEORESOLUTION_1X,
     .mode = VIDEOMODE_DEFAULT,
@@ -135,6 +184,13 @@ static struct {
     .is_fullscreen = false,
     .is_immersive = false,
     .is_fps_visible = false,
+#if defined(__ANDROID__)
+    .is_dynamic_resolution = true, /* mobile GPUs are limited by fill rate */
+    .is_adaptive_quality = true, /* sustained sessions heat up mobile devices */
+#else
+    .is_dynamic_resolution = false,
+    .is_adaptive_quality = false,
+#endif
 };
 
 
@@ -153,17 +209,49 @@ static struct {
     /* index of the first empty entry */
     int head;
 
+    /* incremented whenever a message is printed */
+    unsigned version;
+
     /* font */
     ALLEGRO_FONT* font;
 
 } console = {
     .head = 0,
+    .version = 0,
     .font = NULL
 };
 static void init_console();
 static void release_console();
 static void print_to_console(const char* message);
 static void render_console();
+static int count_console_entries();
+
+
+/* Overlay: the built-in texts (FPS counter & console) are cached in an
+   offscreen image that is redrawn only when their contents change */
+#define FPS_TEXT_MAXSIZE          32
+static struct {
+
+    /* cached texts in window space; possibly NULL */
+    image_t* image;
+
+    /* what is currently rendered on the image */
+    char fps_text[FPS_TEXT_MAXSIZE];
+    unsigned console_version;
+    int console_entries;
+    bool is_valid;
+
+    /* only these strips of the image are used: top (FPS), bottom (console) */
+    int top_height, bottom_height;
+
+} overlay = {
+    .image = NULL,
+    .is_valid = false,
+    .top_height = 0,
+    .bottom_height = 0
+};
+static bool update_overlay(const char* fps_text, int console_entries);
+static void destroy_overlay();
 
 
 /* Loading screen */
@@ -254,6 +342,7 @@ void video_init()
 
     /* initialize the FPS counter */
     init_fps();
+    reset_governor();
 
     /* create the display */
     if(!create_display(game_screen_width, game_screen_height))
@@ -271,6 +360,9 @@ void video_init()
     if(!use_default_shader())
         FATAL("Failed to use the default shader");
 
+    /* initialize the GPU timer */
+    gputimer_init();
+
     /* initialize the console */
     init_console();
 }
@@ -284,12 +376,17 @@ void video_release()
     LOG("Releasing the video manager...");
 
     /* release the console */
+    destroy_overlay();
     release_console();
 
+    /* release the GPU timer */
+    gputimer_release();
+
     /* release the shader system */
     shader_release();
 
     /* destroy the backbuffer */
+    has_pending_flip = false;
     destroy_backbuffer();
 
     /* destroy the display */
@@ -306,6 +403,13 @@ void video_render(void (*render_overlay)())
     ALLEGRO_TRANSFORM display_transform;
     ALLEGRO_TRANSFORM identity_transform;
 
+    profiler_begin("video_render");
+
+    /* pipelined rendering: present the previous frame. We have updated the
+       current frame while the driver was busy with the previous one */
+    if(has_pending_flip)
+        video_present();
+
     /* compute an appropriate transform */
     al_identity_transform(&identity_transform);
     compute_display_transform(&display_transform);
@@ -322,6 +426,7 @@ void video_render(void (*render_overlay)())
     /* copy our backbuffer to the display backbuffer */
     al_set_target_bitmap(al_get_backbuffer(display));
     al_use_transform(&display_transform);
+    gputimer_begin("blit");
 #if USE_ROUNDROBIN_BACKBUFFER
 #if 1
         /* render the current frame */
@@ -333,6 +438,7 @@ void video_render(void (*render_overlay)())
 #else
         al_draw_bitmap(IMAGE2BITMAP(backbuffer[backbuffer_index]), 0.0f, 0.0f, 0);
 #endif
+    gputimer_end();
     al_use_transform(&identity_transform);
 
     /* render stuff in window space */
@@ -341,23 +447,10 @@ void video_render(void (*render_overlay)())
     render_texts();
 
     /* flip display */
-    al_flip_display();
-
-    /* compute the framerate */
-    update_fps();
-
-    /* OpenGL: clear values */
-    if(_glClearColor != NULL)
-        _glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    if(_glClearDepth != NULL)
-        _glClearDepth(1.0);
-
-    /* clearing just after flipping may provide a slight performance increase
-       in some drivers */
-    if(_glClear != NULL)
-        _glClear(GL_COLOR_BUFFER_BIT);
+    if(!is_pipelined)
+        flip_display();
     else
-        al_clear_to_color(al_map_rgba_f(0.0f, 0.0f, 0.0f, 0.0f));
+        has_pending_flip = true; /* flip later */
 
 #if USE_ROUNDROBIN_BACKBUFFER
     /* use a round-robin scheme for a (possible) performance improvement,
@@ -386,6 +479,67 @@ void video_render(void (*render_overlay)())
     https://community.arm.com/arm-community-blogs/b/graphics-gaming-and-vr-blog/posts/mali-performance-2-how-to-correctly-handle-framebuffers
 
     */
+
+    /* collect the GPU times of a previous frame */
+    gputimer_frame();
+
+    profiler_end();
+}
+
+/*
+ * video_present()
+ * Flips the display if there is a frame pending presentation. This is
+ * only needed when rendering is pipelined; video_render() calls it
+ */
+void video_present()
+{
+    ALLEGRO_BITMAP* target;
+
+    if(!has_pending_flip)
+        return;
+
+    target = al_get_target_bitmap();
+    al_set_target_bitmap(al_get_backbuffer(display));
+    flip_display();
+    al_set_target_bitmap(target);
+
+    has_pending_flip = false;
+}
+
+/*
+ * video_set_pipelined()
+ * Enables or disables pipelined rendering. When enabled, the display
+ * is flipped just before rendering the next frame, so that the game
+ * logic of the next frame is updated while the graphics driver
+ * processes the current frame. This adds one frame of latency.
+ */
+void video_set_pipelined(bool pipelined)
+{
+    LOG("%s pipelined rendering", pipelined ? "Enabling" : "Disabling");
+
+    video_present();
+    is_pipelined = pipelined;
+}
+
+/*
+ * video_is_pipelined()
+ * Is pipelined rendering enabled?
+ */
+bool video_is_pipelined()
+{
+    return is_pipelined;
+}
+
+/*
+ * video_get_refresh_rate()
+ * The refresh rate of the display, in Hz, or 0 if unknown
+ */
+int video_get_refresh_rate()
+{
+    if(display == NULL)
+        return 0;
+
+    return al_get_display_refresh_rate(display);
 }
 
 /*
@@ -599,6 +753,81 @@ int video_fps()
     return fps;
 }
 
+/*
+ * video_set_dynamic_resolution()
+ * Enables or disables dynamic resolution. When enabled, the render scale
+ * is lowered in heavy scenes in order to keep the target framerate
+ */
+void video_set_dynamic_resolution(bool enabled)
+{
+    LOG("%s dynamic resolution", enabled ? "Enabling" : "Disabling");
+    settings.is_dynamic_resolution = enabled;
+
+    reset_governor();
+}
+
+/*
+ * video_is_dynamic_resolution_enabled()
+ * Is dynamic resolution enabled?
+ */
+bool video_is_dynamic_resolution_enabled()
+{
+    return settings.is_dynamic_resolution;
+}
+
+/*
+ * video_get_render_scale()
+ * The scale, in [0.5, 1], at which expensive full-screen effects should be
+ * rendered and then upsampled. It's always 1 without dynamic resolution
+ */
+float video_get_render_scale()
+{
+    return render_scale;
+}
+
+/*
+ * video_set_adaptive_quality()
+ * Enables or disables adaptive quality. When enabled, a governor steps
+ * through a quality ladder in order to keep the target framerate in heavy
+ * scenes and in hot devices. Dynamic resolution is part of the ladder
+ */
+void video_set_adaptive_quality(bool enabled)
+{
+    LOG("%s adaptive quality", enabled ? "Enabling" : "Disabling");
+    settings.is_adaptive_quality = enabled;
+
+    reset_governor();
+}
+
+/*
+ * video_is_adaptive_quality_enabled()
+ * Is adaptive quality enabled?
+ */
+bool video_is_adaptive_quality_enabled()
+{
+    return settings.is_adaptive_quality;
+}
+
+/*
+ * video_is_quality_step_taken()
+ * Has the quality governor taken the given step of the quality ladder?
+ * Taking a step implies taking the previous (enabled) ones
+ */
+bool video_is_quality_step_taken(videoqualitystep_t step)
+{
+    return step != VIDEOQUALITYSTEP_NONE && step <= governor.step && is_quality_step_enabled(step);
+}
+
+/*
+ * video_set_input_latency()
+ * Sets the measured input latency, in seconds, which is displayed
+ * next to the FPS counter. Pass zero to hide it
+ */
+void video_set_input_latency(double seconds)
+{
+    input_latency = max(seconds, 0.0);
+}
+
 /*
  * video_get_screen_size()
  * Returns the size of the backbuffer
@@ -706,6 +935,7 @@ void video_display_loading_screen_ex(double progress)
 
     /* render the backbuffer to the screen */
     video_render(NULL);
+    video_present(); /* don't defer */
 
     /* cleanup */
     font_destroy(fnt);
@@ -753,6 +983,48 @@ image_t* video_take_snapshot()
     return image_clone(snapshot);
 }
 
+/*
+ * video_read_snapshot()
+ * Copies the pixels of the last rendered frame to memory, row by row, with
+ * 4 bytes per pixel in RGBA order. If pixels is NULL, only the size of the
+ * frame is written to width and height. Otherwise, pixels must hold
+ * (*width) * (*height) * 4 bytes, as given by a previous call.
+ * Returns true on success
+ */
+bool video_read_snapshot(unsigned char* pixels, int* width, int* height)
+{
+#if USE_ROUNDROBIN_BACKBUFFER
+    int index = 1 - backbuffer_index;
+#else
+    int index = backbuffer_index;
+#endif
+    ALLEGRO_BITMAP* bitmap = IMAGE2BITMAP(backbuffer[index]);
+    int w = al_get_bitmap_width(bitmap);
+    int h = al_get_bitmap_height(bitmap);
+    ALLEGRO_LOCKED_REGION* region;
+
+    /* just the size */
+    if(pixels == NULL) {
+        *width = w;
+        *height = h;
+        return true;
+    }
+
+    /* the size has changed */
+    if(w != *width || h != *height)
+        return false;
+
+    /* read the pixels */
+    if(NULL == (region = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY)))
+        return false;
+
+    for(int y = 0; y < h; y++)
+        memcpy(pixels + y * (w * 4), (const unsigned char*)region->data + y * region->pitch, w * 4);
+
+    al_unlock_bitmap(bitmap);
+    return true;
+}
+
 /*
  * video_use_default_shader()
  * Use the default shader. THIS IS NOT MEANT TO BE USED IN A LOOP.
@@ -878,7 +1150,9 @@ void destroy_display()
     display = NULL;
 }
 
-/* Reconfigure the display according to the current settings */
+/* Reconfigure the display according to the current settings. The display
+   is changed in place: the OpenGL context and the textures are kept. Only
+   what differs from the current configuration is changed */
 void reconfigure_display()
 {
 #if !defined(__ANDROID__)
@@ -887,13 +1161,16 @@ void reconfigure_display()
     int new_display_height = game_screen_height * multiplier;
     int delta_width = new_display_width - al_get_display_width(display);
     int delta_height = new_display_height - al_get_display_height(display);
+    bool is_fullscreen = (al_get_display_flags(display) & ALLEGRO_FULLSCREEN_WINDOW) != 0;
 
     /* toggle fullscreen */
-    if(!al_set_display_flag(display, ALLEGRO_FULLSCREEN_WINDOW, settings.is_fullscreen))
-        LOG("Can't toggle fullscreen mode");
+    if(is_fullscreen != settings.is_fullscreen) {
+        if(!al_set_display_flag(display, ALLEGRO_FULLSCREEN_WINDOW, settings.is_fullscreen))
+            LOG("Can't toggle fullscreen mode");
+    }
 
     /* resize the window */
-    if(!(al_get_display_flags(display) & ALLEGRO_FULLSCREEN_WINDOW)) {
+    if(!(al_get_display_flags(display) & ALLEGRO_FULLSCREEN_WINDOW) && (delta_width != 0 || delta_height != 0)) {
         if(al_resize_display(display, new_display_width, new_display_height)) {
 
             /* reposition the window */
@@ -966,6 +1243,29 @@ void set_display_icon(ALLEGRO_DISPLAY* display)
     al_fclose(f);
 }
 
+/* flip the display. The target bitmap must be the backbuffer of the display */
+void flip_display()
+{
+    /* flip display */
+    al_flip_display();
+
+    /* compute the framerate */
+    update_fps();
+
+    /* OpenGL: clear values */
+    if(_glClearColor != NULL)
+        _glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    if(_glClearDepth != NULL)
+        _glClearDepth(1.0);
+
+    /* clearing just after flipping may provide a slight performance increase
+       in some drivers */
+    if(_glClear != NULL)
+        _glClear(GL_COLOR_BUFFER_BIT);
+    else
+        al_clear_to_color(al_map_rgba_f(0.0f, 0.0f, 0.0f, 0.0f));
+}
+
 /* handle a video event from Allegro */
 void a5_handle_video_event(const ALLEGRO_EVENT* event, void* data)
 {
@@ -993,8 +1293,11 @@ void a5_handle_video_event(const ALLEGRO_EVENT* event, void* data)
 
         case ALLEGRO_EVENT_DISPLAY_HALT_DRAWING:
             al_acknowledge_drawing_halt(event->display.source);
+            has_pending_flip = false; /* discard the pipelined frame */
             destroy_backbuffer(); /* the backbuffer has the ALLEGRO_NO_PRESERVE_TEXTURE flag enabled */
+            destroy_overlay(); /* it will be recreated when needed */
             shader_discard_all();
+            gputimer_discard();
             was_immersive = video_is_immersive();
             break;
 
@@ -1004,10 +1307,12 @@ void a5_handle_video_event(const ALLEGRO_EVENT* event, void* data)
             if(!create_backbuffer())
                 FATAL("Can't create backbuffer after al_acknowledge_drawing_resume()");
 
-            shader_recreate_all();
+            shader_recreate_all(); /* from the cache of program binaries */
             if(!use_default_shader())
                 LOG("Can't set the default shader");
 
+            image_restore_all(); /* images loaded from files are restored progressively */
+
             video_set_immersive(was_immersive);
             break;
     }
@@ -1081,17 +1386,27 @@ void destroy_backbuffer()
     }
 }
 
-/* Reconfigure the backbuffer according to the current settings */
+/* Reconfigure the backbuffer according to the current settings. The
+   backbuffer is recreated only if its size changes; the display transform
+   is computed when presenting the frame, so nothing else needs to change */
 void reconfigure_backbuffer()
 {
+    int screen_width = game_screen_width;
+    int screen_height = game_screen_height;
+
     /* validate */
     if(backbuffer[0] == NULL) {
         FATAL("Can't reconfigure the backbuffer: no backbuffer");
         return;
     }
 
+    /* keep the backbuffer if its size doesn't change */
+    compute_screen_size(settings.mode, &screen_width, &screen_height);
+    if(screen_width == image_width(backbuffer[0]) && screen_height == image_height(backbuffer[0]))
+        return;
+
     /* destroy the old */
-    LOG("Will reconfigure the backbuffer...");
+    LOG("Will resize the backbuffer to %dx%d...", screen_width, screen_height);
     destroy_backbuffer();
 
     /* create the new */
@@ -1216,6 +1531,21 @@ void print_to_console(const char* message)
 
     /* advance the head */
     console.head = (console.head + 1) % CONSOLE_MAX_ENTRIES;
+
+    /* the console has changed */
+    console.version++;
+}
+
+/* Count the messages of the console that haven't expired */
+int count_console_entries()
+{
+    double elapsed = timer_get_elapsed();
+    int count = 0;
+
+    for(int i = 0; i < CONSOLE_MAX_ENTRIES; i++)
+        count += (elapsed < console.entry[i].expire_time);
+
+    return count;
 }
 
 /* Render the messages of the console */
@@ -1312,6 +1642,10 @@ void update_fps()
     /* collect a sample of the framerate */
     fps_sample[index_of_next_fps_sample++] = 1.0 / delta_time;
 
+    /* adjust the quality */
+    if(settings.is_adaptive_quality || settings.is_dynamic_resolution)
+        update_governor(delta_time);
+
     /* Compare the two methods of determining the framerate. If their results
        are very similar, take the median of the samples. If they are not, the
        dataset has outliers. Let's take the counted method in this case. */
@@ -1321,8 +1655,121 @@ void update_fps()
         fps = fps_counted; /* usually 59, 60, 61 */
 }
 
+/* reset the quality governor to full quality */
+void reset_governor()
+{
+    governor.step = VIDEOQUALITYSTEP_NONE;
+    governor.frame_count = 0;
+    governor.fast_windows = 0;
+    governor.windows_before_raising = MIN_WINDOWS_BEFORE_RAISING;
+    governor.windows_since_raising = MAX_WINDOWS_BEFORE_RAISING;
+    governor.thermal_status = 0;
+    governor.last_thermal_poll = -THERMAL_POLL_INTERVAL;
+
+    render_scale = 1.0f;
+}
+
+/* collect the time taken by the last frame and step through the quality ladder */
+void update_governor(double frame_time)
+{
+    /* collect the frame times of a window */
+    governor.frame_time[governor.frame_count++] = frame_time;
+    if(governor.frame_count < GOVERNOR_WINDOW)
+        return;
+    governor.frame_count = 0;
+
+    /* poll the thermal status of the device; it's a slow query */
+    double now = timer_get_elapsed();
+    if(now >= governor.last_thermal_poll + THERMAL_POLL_INTERVAL) {
+        governor.last_thermal_poll = now;
+        governor.thermal_status = thermal_status();
+    }
+
+    /* classify the window */
+    qsort(governor.frame_time, GOVERNOR_WINDOW, sizeof(*governor.frame_time), sort_fps_samples);
+    double slow_time = governor.frame_time[(int)(GOVERNOR_PERCENTILE * (GOVERNOR_WINDOW - 1))];
+    bool is_slow = (slow_time > SLOW_FRAME_TIME) || (governor.thermal_status >= THERMAL_STATUS_SEVERE);
+    bool is_fast = (slow_time < FAST_FRAME_TIME) && (governor.thermal_status < THERMAL_STATUS_MODERATE);
+
+    if(governor.windows_since_raising < MAX_WINDOWS_BEFORE_RAISING)
+        governor.windows_since_raising++;
+
+    /* lower the quality quickly and raise it slowly to avoid oscillations */
+    if(is_slow) {
+        governor.fast_windows = 0;
+
+        if(lower_quality()) {
+            /* the last step back was undone quickly */
+            if(governor.windows_since_raising <= MIN_WINDOWS_BEFORE_RAISING)
+                governor.windows_before_raising = min(2 * governor.windows_before_raising, MAX_WINDOWS_BEFORE_RAISING);
+
+            governor.windows_since_raising = MAX_WINDOWS_BEFORE_RAISING;
+        }
+    }
+    else if(is_fast) {
+        if(++governor.fast_windows >= governor.windows_before_raising) {
+            governor.fast_windows = 0;
+
+            if(raise_quality())
+                governor.windows_since_raising = 0;
+        }
+    }
+    else
+        governor.fast_windows = 0;
+}
+
+/* take the next enabled step of the quality ladder */
+bool lower_quality()
+{
+    for(int step = governor.step + 1; step <= VIDEOQUALITYSTEP_LOWEST_RESOLUTION; step++) {
+        if(is_quality_step_enabled((videoqualitystep_t)step)) {
+            LOG("Lowering the quality");
+            set_quality_step((videoqualitystep_t)step);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* take a step back in the quality ladder */
+bool raise_quality()
+{
+    if(governor.step == VIDEOQUALITYSTEP_NONE)
+        return false;
+
+    /* go back to the previous enabled step */
+    int step = governor.step - 1;
+    while(step > VIDEOQUALITYSTEP_NONE && !is_quality_step_enabled((videoqualitystep_t)step))
+        step--;
+
+    LOG("Raising the quality");
+    set_quality_step((videoqualitystep_t)step);
+    return true;
+}
+
+/* set the last step taken in the quality ladder */
+void set_quality_step(videoqualitystep_t step)
+{
+    int resolution_steps = max(0, (int)step - (int)VIDEOQUALITYSTEP_NO_FOREGROUND);
+
+    governor.step = step;
+    render_scale = 1.0f - RENDER_SCALE_STEP * resolution_steps;
+
+    LOG("Quality step: %d, render scale: %.2f", (int)step, render_scale);
+}
+
+/* dynamic resolution and adaptive quality may be enabled independently */
+bool is_quality_step_enabled(videoqualitystep_t step)
+{
+    if(step >= VIDEOQUALITYSTEP_LOWER_RESOLUTION)
+        return settings.is_dynamic_resolution;
+    else
+        return settings.is_adaptive_quality;
+}
+
 /* render the FPS counter */
-void render_fps()
+void render_fps(const char* fps_text)
 {
 #if !defined(__ANDROID__)
     int font_scale = FONT_SCALE();
@@ -1350,7 +1797,7 @@ void render_fps()
     al_translate_transform(&transform, xpos, 0.0f);
 
     al_use_transform(&transform);
-        DRAW_TEXT(0.0f, 0.0f, ALLEGRO_ALIGN_RIGHT, "%.1lf", fps);
+        DRAW_TEXT(0.0f, 0.0f, ALLEGRO_ALIGN_RIGHT, "%s", fps_text);
     al_restore_state(&state);
 }
 
@@ -1365,16 +1812,120 @@ void render_fps()
 /* render texts with Allegro's built-in font */
 void render_texts()
 {
+    char fps_text[FPS_TEXT_MAXSIZE] = "";
+    int console_entries = count_console_entries();
+
+    if(settings.is_fps_visible) {
+        if(input_latency > 0.0)
+            snprintf(fps_text, sizeof(fps_text), "%.1lf ms | %.1lf", 1000.0 * input_latency, fps);
+        else
+            snprintf(fps_text, sizeof(fps_text), "%.1lf", fps);
+    }
+
+    /* nothing to render */
+    if(console_entries == 0 && *fps_text == '\0')
+        return;
+
+    /* render the cached overlay */
+    if(update_overlay(fps_text, console_entries)) {
+        /* blit only the strips that are used, not the entire window */
+        ALLEGRO_BITMAP* bitmap = IMAGE2BITMAP(overlay.image);
+        int width = image_width(overlay.image), height = image_height(overlay.image);
+        int top = min(overlay.top_height, height);
+        int bottom = min(overlay.bottom_height, height - top);
+
+        if(top > 0)
+            al_draw_bitmap_region(bitmap, 0.0f, 0.0f, width, top, 0.0f, 0.0f, 0);
+        if(bottom > 0)
+            al_draw_bitmap_region(bitmap, 0.0f, height - bottom, width, bottom, 0.0f, height - bottom, 0);
+
+        return;
+    }
+
+    /* we can't use the overlay; render the texts directly */
     al_hold_bitmap_drawing(true);
 
-    if(settings.is_fps_visible)
-        render_fps();
+    if(*fps_text != '\0')
+        render_fps(fps_text);
 
     render_console();
 
     al_hold_bitmap_drawing(false);
 }
 
+/* redraw the overlay if its contents have changed. Returns false if the overlay is unavailable */
+bool update_overlay(const char* fps_text, int console_entries)
+{
+    int display_width = al_get_display_width(display);
+    int display_height = al_get_display_height(display);
+
+    /* recreate the overlay if the size of the display has changed */
+    if(overlay.image != NULL && (image_width(overlay.image) != display_width || image_height(overlay.image) != display_height))
+        destroy_overlay();
+
+    /* create the overlay */
+    if(overlay.image == NULL) {
+        if(NULL == (overlay.image = image_create_backbuffer(display_width, display_height, false)))
+            return false;
+
+        overlay.is_valid = false;
+    }
+
+    /* no need to redraw? */
+    if(
+        overlay.is_valid &&
+        overlay.console_version == console.version &&
+        overlay.console_entries == console_entries &&
+        0 == strcmp(overlay.fps_text, fps_text)
+    )
+        return true;
+
+    /* redraw the overlay */
+    ALLEGRO_STATE state;
+    al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_TRANSFORM);
+    al_set_target_bitmap(IMAGE2BITMAP(overlay.image));
+    al_clear_to_color(al_map_rgba_f(0.0f, 0.0f, 0.0f, 0.0f));
+
+    al_hold_bitmap_drawing(true);
+
+    if(*fps_text != '\0')
+        render_fps(fps_text);
+
+    render_console();
+
+    al_hold_bitmap_drawing(false);
+    al_restore_state(&state);
+
+    /* remember what we have rendered */
+    str_cpy(overlay.fps_text, fps_text, sizeof(overlay.fps_text));
+    overlay.console_version = console.version;
+    overlay.console_entries = console_entries;
+    overlay.is_valid = true;
+
+    /* the text has a shadow that is 1 pixel below it */
+    int line_height = al_get_font_line_height(console.font) + 1;
+#if !defined(__ANDROID__)
+    overlay.top_height = (*fps_text != '\0') ? line_height * FONT_SCALE() : 0;
+#else
+    overlay.top_height = (*fps_text != '\0') ? line_height * 2 : 0;
+#endif
+    overlay.bottom_height = console_entries * line_height * FONT_SCALE();
+
+    /* done */
+    return true;
+}
+
+/* destroy the overlay */
+void destroy_overlay()
+{
+    if(overlay.image != NULL) {
+        image_destroy(overlay.image);
+        overlay.image = NULL;
+    }
+
+    overlay.is_valid = false;
+}
+
 /* import OpenGL symbols */
 void import_opengl_symbols()
 {
@@ -31,6 +31,7 @@ struct image_t;
 void video_init();
 void video_release();
 void video_render(void (*render_overlay)());
+void video_present(); /* flip a pending frame when rendering is pipelined */
 
 /* backbuffer */
 #define VIDEO_SCREEN_W ((int)(video_get_screen_size().x))
@@ -50,6 +51,7 @@ void video_set_resolution(videoresolution_t resolution);
 videoresolution_t video_get_resolution();
 videoresolution_t video_best_fit_resolution();
 v2d_t video_get_window_size();
+int video_get_refresh_rate(); /* in Hz; 0 if unknown */
 
 /* video mode: controls the size of the screen / backbuffer */
 typedef enum videomode_t {
@@ -85,6 +87,31 @@ bool video_is_immersive();
 void video_set_fps_visible(bool visible);
 bool video_is_fps_visible();
 int video_fps(); /* the FPS rate */
+void video_set_input_latency(double seconds); /* displayed next to the FPS counter if positive */
+
+/* dynamic resolution: lower the resolution of full-screen effects under GPU load */
+void video_set_dynamic_resolution(bool enabled);
+bool video_is_dynamic_resolution_enabled();
+float video_get_render_scale(); /* in [0.5, 1] */
+
+/* adaptive quality: the steps of the quality ladder, taken in order when frames are too slow */
+typedef enum videoqualitystep_t {
+    VIDEOQUALITYSTEP_NONE,                  /* full quality */
+    VIDEOQUALITYSTEP_FASTER_WATER,          /* a cheaper tier of the water effect */
+    VIDEOQUALITYSTEP_NEAREST_FILTERING,     /* no linear filtering */
+    VIDEOQUALITYSTEP_FEWER_PARTICLES,       /* lower caps of particles */
+    VIDEOQUALITYSTEP_NO_FOREGROUND,         /* skip the foreground layers of the background */
+    VIDEOQUALITYSTEP_LOWER_RESOLUTION,      /* dynamic resolution only: 0.75 render scale */
+    VIDEOQUALITYSTEP_LOWEST_RESOLUTION      /* dynamic resolution only: 0.5 render scale */
+} videoqualitystep_t;
+
+void video_set_adaptive_quality(bool enabled);
+bool video_is_adaptive_quality_enabled();
+bool video_is_quality_step_taken(videoqualitystep_t step); /* has the governor taken this step of the ladder? */
+
+/* pipelined rendering: update the next frame while the driver processes the current one */
+void video_set_pipelined(bool pipelined);
+bool video_is_pipelined();
 
 /* built-in console */
 void video_showmessage(const char *fmt, ...);
@@ -96,6 +123,7 @@ void video_display_loading_screen_ex(double progress);
 const char* video_get_window_title();
 v2d_t video_convert_window_to_screen(v2d_t window_coordinates);
 struct image_t* video_take_snapshot();
+bool video_read_snapshot(unsigned char* pixels, int* width, int* height); /* copy the last frame to memory (RGBA) */
 bool video_use_default_shader();
 
 #endif
@@ -24,6 +24,7 @@
 #include "brick.h"
 #include "../util/numeric.h"
 #include "../util/util.h"
+#include "../util/pool.h"
 #include "../util/transform.h"
 #include "../core/global.h"
 #include "../core/input.h"
@@ -31,12 +32,16 @@
 #include "../core/video.h"
 #include "../core/timer.h"
 #include "../physics/obstacle.h"
+#include "../scenes/level.h"
 
 
 /* private stuff */
+static pool_t* pool = NULL; /* actors are created and destroyed often */
 static void update_animation(actor_t *act);
 static bool can_be_clipped_out(const actor_t* act, v2d_t topleft);
 static void actor_transform(ALLEGRO_TRANSFORM* transform, const actor_t* act, v2d_t topleft);
+static bool has_translation_only(const actor_t* act);
+static v2d_t interpolated_position(const actor_t* act);
 
 
 /*
@@ -45,16 +50,25 @@ static void actor_transform(ALLEGRO_TRANSFORM* transform, const actor_t* act, v2
  */
 actor_t* actor_create()
 {
-    actor_t *act = mallocx(sizeof *act);
+    actor_t *act;
+
+    if(pool == NULL)
+        pool = pool_create();
+
+    act = pool_alloc(pool, sizeof *act);
 
     act->spawn_point = v2d_new(0, 0);
     act->position = act->spawn_point;
     act->speed = v2d_new(0,0);
     act->input = NULL;
 
+    act->previous_position = act->position;
+    act->previous_position_frame = -1;
+
     act->animation = NULL;
     act->next_animation = NULL;
     act->animation_timer = 0.0;
+    act->animation_frame = 0;
     act->animation_speed_factor = 1.0f;
     act->synchronized_animation = false;
 
@@ -78,7 +92,11 @@ void actor_destroy(actor_t *act)
     if(act->input != NULL)
         input_destroy(act->input);
 
-    free(act);
+    pool_free(pool, act);
+
+    /* release the pool when there are no actors left */
+    if(pool_count(pool) == 0)
+        pool = pool_destroy(pool);
 }
 
 
@@ -102,7 +120,23 @@ void actor_render(actor_t *act, v2d_t camera_position)
             }
         }
 
-        if(!clip_out) {
+        if(!clip_out && has_translation_only(act)) {
+            /* fast path: the transform of the actor is a translation by an
+               integer offset, so we draw it at that offset using the current
+               transform. al_use_transform() recomputes the projection-view
+               matrix and uploads it to the GPU; we skip two such calls per
+               actor, and the actor is still batched by the render queue */
+            v2d_t world_position = interpolated_position(act);
+            int x = (int)floorf(world_position.x - topleft.x) - (int)act->hot_spot.x;
+            int y = (int)floorf(world_position.y - topleft.y) - (int)act->hot_spot.y;
+
+            /* render */
+            if(nearly_equal(act->alpha, 1.0f))
+                image_draw(img, x, y, act->mirror);
+            else
+                image_draw_trans(img, x, y, act->alpha, act->mirror);
+        }
+        else if(!clip_out) {
             /* set transform */
             ALLEGRO_TRANSFORM transform, prev_transform;
             al_copy_transform(&prev_transform, al_get_current_transform());
@@ -132,6 +166,19 @@ void actor_render(actor_t *act, v2d_t camera_position)
 
 
 
+/*
+ * actor_save_position()
+ * Saves the position of the actor at the beginning of a framestep,
+ * so that rendering can interpolate between framesteps
+ */
+void actor_save_position(actor_t *act)
+{
+    act->previous_position = act->position;
+    act->previous_position_frame = timer_get_frames();
+}
+
+
+
 /*
  * actor_change_animation()
  * Changes the animation of an actor
@@ -187,6 +234,7 @@ void actor_change_animation(actor_t *act, const animation_t *anim)
     act->animation = anim;
     act->hot_spot = animation_hot_spot(anim);
     act->animation_timer = 0.0;
+    act->animation_frame = 0;
     act->animation_speed_factor = 1.0f;
     act->synchronized_animation = false;
 }
@@ -208,6 +256,7 @@ void actor_change_animation_frame(actor_t *act, int frame)
 
     /* change the frame */
     act->animation_timer = animation_start_time_of_frame(act->animation, frame);
+    act->animation_frame = animation_frame_at_time(act->animation, act->animation_timer);
 }
 
 
@@ -252,6 +301,24 @@ bool actor_is_transition_animation_playing(const actor_t *act)
 }
 
 
+/*
+ * actor_is_still()
+ * Returns true if the image of the actor won't change over time
+ * unless the actor is modified (i.e., its animation is static or over)
+ */
+bool actor_is_still(const actor_t *act)
+{
+    if(act->animation == NULL || !act->visible)
+        return true;
+    else if(animation_is_transition(act->animation))
+        return false;
+    else if(animation_frame_count(act->animation) <= 1 && !animation_has_keyframes(act->animation))
+        return true;
+
+    return animation_is_over(act->animation, act->animation_timer);
+}
+
+
 
 /*
  * actor_synchronize_animation()
@@ -273,7 +340,7 @@ int actor_animation_frame(const actor_t* act)
     if(act->animation == NULL)
         return 0;
 
-    return animation_frame_at_time(act->animation, act->animation_timer);
+    return act->animation_frame;
 }
 
 
@@ -288,7 +355,7 @@ const image_t* actor_image(const actor_t *act)
         return NULL;
     }
 
-    return animation_image_at_time(act->animation, act->animation_timer);
+    return animation_image(act->animation, act->animation_frame);
 }
 
 /*
@@ -359,10 +426,12 @@ void update_animation(actor_t *act)
     }
 
     /* update the animation time */
-    if(act->synchronized_animation)
+    if(act->synchronized_animation) {
         act->animation_timer = timer_get_elapsed() * act->animation_speed_factor;
+        act->animation_frame = animation_frame_at_time(act->animation, act->animation_timer);
+    }
     else
-        act->animation_timer += timer_get_delta() * act->animation_speed_factor;
+        act->animation_frame = animation_advance(act->animation, &act->animation_timer, timer_get_delta() * act->animation_speed_factor);
 }
 
 /* Checks if the actor can be clipped out (rendering) */
@@ -382,13 +451,40 @@ bool can_be_clipped_out(const actor_t* act, v2d_t topleft)
     return (x + w <= 0 || x >= sw || y + h <= 0 || y >= sh);
 }
 
+/* checks if the transform of the actor (see actor_transform) is a translation by an integer offset */
+bool has_translation_only(const actor_t* act)
+{
+    return
+        nearly_zero(act->angle) &&
+        nearly_equal(act->scale.x, 1.0f) && nearly_equal(act->scale.y, 1.0f) &&
+        act->hot_spot.x == floorf(act->hot_spot.x) && act->hot_spot.y == floorf(act->hot_spot.y) &&
+        !animation_has_keyframes(act->animation)
+    ;
+}
+
+/* the position of the actor, interpolated between framesteps when rendering */
+v2d_t interpolated_position(const actor_t* act)
+{
+    const float max_distance = 64.0f; /* don't interpolate teleports */
+    float alpha = timer_get_interpolation();
+
+    if(alpha < 1.0f && act->previous_position_frame == timer_get_frames()) {
+        v2d_t ds = v2d_subtract(act->position, act->previous_position);
+        if(fabsf(ds.x) + fabsf(ds.y) < max_distance)
+            return v2d_lerp(act->previous_position, act->position, alpha);
+    }
+
+    return act->position;
+}
+
 /* set a transform for an actor */
 void actor_transform(ALLEGRO_TRANSFORM* transform, const actor_t* act, v2d_t topleft)
 {
     /* find the position of the actor in screen space */
+    v2d_t world_position = interpolated_position(act);
     v2d_t position = v2d_new(
-        floorf(act->position.x - topleft.x),
-        floorf(act->position.y - topleft.y)
+        floorf(world_position.x - topleft.x),
+        floorf(world_position.y - topleft.y)
     );
 
     /* build the transform */
@@ -412,7 +508,7 @@ void actor_transform(ALLEGRO_TRANSFORM* transform, const actor_t* act, v2d_t top
                  legacy code
    =========================================== */
 static const float MAGIC_DIFF = -2;  /* platform movement & collision detectors magic */
-static brick_t* brick_at(const brick_list_t *list, v2d_t spot);
+static brick_t* brick_at(v2d_t spot);
 static void calculate_rotated_boundingbox(const actor_t *act, v2d_t spot[4]);
 static void sensors_ex(actor_t *act, v2d_t vup, v2d_t vupright, v2d_t vright, v2d_t vdownright, v2d_t vdown, v2d_t vdownleft, v2d_t vleft, v2d_t vupleft, struct brick_list_t *brick_list, struct brick_t **up, struct brick_t **upright, struct brick_t **right, struct brick_t **downright, struct brick_t **down, struct brick_t **downleft, struct brick_t **left, struct brick_t **upleft);
 
@@ -495,53 +591,59 @@ void actor_sensors(actor_t *act, brick_list_t *brick_list, brick_t **up, brick_t
  */
 const brick_t* actor_brick_at(actor_t *act, const brick_list_t *brick_list, v2d_t offset)
 {
-    return brick_at(brick_list, v2d_add(act->position, offset));
+    (void)brick_list;
+    return brick_at(v2d_add(act->position, offset));
 }
 
 
 /* private stuff */
 
-/* brick_at(): given a list of bricks, returns
- * one that collides with the given spot
+/* brick_at(): returns an active brick
+ * that collides with the given spot
  * PS: this code ignores the bricks that are
  * not obstacles */
 /* NOTE: this is old (deprecated) code -- see obstaclemap.c */
-brick_t* brick_at(const brick_list_t *list, v2d_t spot)
+brick_t* brick_at(v2d_t spot)
 {
-    const brick_list_t *p;
     const obstacle_t* obstacle;
     brick_t *ret = NULL;
+    int count;
+
+    /* query the bricks at the spot instead of walking the list of all
+       active bricks. Traverse them backwards, like the legacy list */
+    brick_t* const* brick = level_legacy_bricks_in_rect(spot.x, spot.y, 1, 1, &count);
 
     /* main algorithm */
-    for(p=list; p; p=p->next) {
+    for(int i = count - 1; i >= 0; i--) {
+        brick_t* b = brick[i];
 
         /* ignore passable bricks */
-        if(brick_type(p->data) == BRK_PASSABLE)
+        if(brick_type(b) == BRK_PASSABLE)
             continue;
 
         /* I don't want clouds. */
-        if(brick_type(p->data) == BRK_CLOUD && (ret && brick_type(ret) == BRK_SOLID))
+        if(brick_type(b) == BRK_CLOUD && (ret && brick_type(ret) == BRK_SOLID))
             continue;
 
         /* I don't want moving platforms */
-        if(brick_behavior(p->data) == BRB_CIRCULAR && (ret && brick_behavior(ret) != BRB_CIRCULAR) && brick_position(p->data).y >= brick_position(ret).y)
+        if(brick_behavior(b) == BRB_CIRCULAR && (ret && brick_behavior(ret) != BRB_CIRCULAR) && brick_position(b).y >= brick_position(ret).y)
             continue;
             
         /* Check for collision */
-        if(NULL != (obstacle = brick_obstacle(p->data))) {
+        if(NULL != (obstacle = brick_obstacle(b))) {
             if(obstacle_got_collision(obstacle, spot.x, spot.y, spot.x, spot.y)) {
-                if(brick_behavior(p->data) != BRB_CIRCULAR && (ret && brick_behavior(ret) == BRB_CIRCULAR) && brick_position(p->data).y <= brick_position(ret).y) {
-                    ret = p->data; /* No moving platforms. Let's grab a regular platform instead. */
+                if(brick_behavior(b) != BRB_CIRCULAR && (ret && brick_behavior(ret) == BRB_CIRCULAR) && brick_position(b).y <= brick_position(ret).y) {
+                    ret = b; /* No moving platforms. Let's grab a regular platform instead. */
                 }
-                else if(brick_type(p->data) == BRK_SOLID && (ret && brick_type(ret) == BRK_CLOUD)) {
-                    ret = p->data; /* No clouds. Let's grab an obstacle instead. */
+                else if(brick_type(b) == BRK_SOLID && (ret && brick_type(ret) == BRK_CLOUD)) {
+                    ret = b; /* No clouds. Let's grab an obstacle instead. */
                 }
-                else if(brick_type(p->data) == BRK_CLOUD && (ret && brick_type(ret) == BRK_CLOUD)) {
-                    if(brick_position(p->data).y > brick_position(ret).y) /* two conflicting clouds */
-                        ret = p->data;
+                else if(brick_type(b) == BRK_CLOUD && (ret && brick_type(ret) == BRK_CLOUD)) {
+                    if(brick_position(b).y > brick_position(ret).y) /* two conflicting clouds */
+                        ret = b;
                 }
                 else if(!ret)
-                    ret = p->data;
+                    ret = b;
             }
         }
     }
@@ -586,14 +688,16 @@ void sensors_ex(actor_t *act, v2d_t vup, v2d_t vupright, v2d_t vright, v2d_t vdo
     brick_t **cloud_off[5] = { up, upright, right, left, upleft };
     int i;
 
-    if(up) *up = brick_at(brick_list, vup);
-    if(down) *down = brick_at(brick_list, vdown);
-    if(left) *left = brick_at(brick_list, vleft);
-    if(right) *right = brick_at(brick_list, vright);
-    if(upleft) *upleft = brick_at(brick_list, vupleft);
-    if(upright) *upright = brick_at(brick_list, vupright);
-    if(downleft) *downleft = brick_at(brick_list, vdownleft);
-    if(downright) *downright = brick_at(brick_list, vdownright);
+    (void)brick_list; /* bricks are queried spatially */
+
+    if(up) *up = brick_at(vup);
+    if(down) *down = brick_at(vdown);
+    if(left) *left = brick_at(vleft);
+    if(right) *right = brick_at(vright);
+    if(upleft) *upleft = brick_at(vupleft);
+    if(upright) *upright = brick_at(vupright);
+    if(downleft) *downleft = brick_at(vdownleft);
+    if(downright) *downright = brick_at(vdownright);
 
 
     /* handle clouds */
@@ -42,10 +42,15 @@ typedef struct actor_t {
     v2d_t speed;
     input_t *input; /* NULL by default (no input) */
 
+    /* interpolated rendering */
+    v2d_t previous_position; /* position at the beginning of a framestep */
+    int64_t previous_position_frame; /* the framestep in which previous_position was saved */
+
     /* animation */
     const animation_t* animation; /* current animation; possibly NULL */
     const animation_t* next_animation; /* used by transitions; possibly NULL */
     double animation_timer; /* given in seconds */
+    int animation_frame; /* current frame number, updated with the timer */
     float animation_speed_factor; /* default value: 1.0 */
     bool synchronized_animation; /* synchronized animation? */
 
@@ -67,6 +72,7 @@ void actor_destroy(actor_t *act);
 /* rendering */
 const image_t* actor_image(const actor_t *act);
 void actor_render(actor_t *act, v2d_t camera_position);
+void actor_save_position(actor_t *act); /* call at the beginning of a framestep to interpolate rendering */
 
 /* animation */
 void actor_change_animation(actor_t *act, const animation_t *anim);
@@ -74,6 +80,7 @@ void actor_change_animation_frame(actor_t *act, int frame);
 void actor_change_animation_speed_factor(actor_t *act, float factor); /* default factor: 1.0 */
 bool actor_animation_finished(const actor_t *act); /* true if the current animation has finished */
 bool actor_is_transition_animation_playing(const actor_t *act); /* true if a transition animation is playing */
+bool actor_is_still(const actor_t *act); /* true if the image of the actor doesn't change over time */
 void actor_synchronize_animation(actor_t *act, bool sync); /* should I use a shared animation frame? */
 int actor_animation_frame(const actor_t* act);
 v2d_t actor_action_spot(const actor_t* act); /* action spot appropriately flipped */
@@ -83,8 +90,8 @@ struct transform_t* actor_interpolated_transform(const actor_t* act, struct tran
 /* legacy */
 int actor_collision(const actor_t *a, const actor_t *b); /* tests bounding-box collision between a and b */
 int actor_brick_collision(const actor_t *act, const struct brick_t *brk); /* tests bounding-box collision with a brick */
-void actor_sensors(actor_t *act, struct brick_list_t *brick_list, struct brick_t **up, struct brick_t **upright, struct brick_t **right, struct brick_t **downright, struct brick_t **down, struct brick_t **downleft, struct brick_t **left, struct brick_t **upleft); /* get obstacle bricks around the actor */
-const struct brick_t* actor_brick_at(actor_t *act, const struct brick_list_t *brick_list, v2d_t offset);
+void actor_sensors(actor_t *act, struct brick_list_t *brick_list, struct brick_t **up, struct brick_t **upright, struct brick_t **right, struct brick_t **downright, struct brick_t **down, struct brick_t **downleft, struct brick_t **left, struct brick_t **upleft); /* get obstacle bricks around the actor; brick_list is unused (the active bricks of the level are queried) */
+const struct brick_t* actor_brick_at(actor_t *act, const struct brick_list_t *brick_list, v2d_t offset); /* brick_list is unused, as above */
 
 
 #endif
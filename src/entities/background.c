@@ -28,6 +28,7 @@
 #include "../core/asset.h"
 #include "../core/logfile.h"
 #include "../core/timer.h"
+#include "../core/gputimer.h"
 #include "../core/nanoparser.h"
 #include "../util/numeric.h"
 #include "../util/rect.h"
@@ -38,6 +39,7 @@
 #define WANT_FAST_DRAW 1
 #if WANT_FAST_DRAW
 #include "../third_party/fast_draw.h"
+#define INITIAL_DRAW_CACHE_SIZE 64 /* number of quads */
 #endif
 
 /* forward declarations */
@@ -55,8 +57,9 @@ struct bgtheme_t {
     int foreground_count; /* number of foreground layers */
     char* filepath; /* filepath of the background */
     double animation_time; /* animation time, in seconds */
+    double behavior_time; /* time of the behaviors of the layers, in seconds */
 #if WANT_FAST_DRAW
-    int draw_count; /* number of draws */
+    FAST_DRAW_CACHE* draw_cache; /* reused across frames */
 #endif
 };
 
@@ -72,6 +75,7 @@ struct bglayer_t {
 
     bgbehavior_t *behavior; /* behavior */
     int group_index; /* for deferred drawing */
+    bool is_opaque; /* are all the pixels of the layer fully opaque? */
 };
 static bglayer_t *bglayer_new(); /* constructor */
 static bglayer_t *bglayer_delete(bglayer_t *layer); /* destructor */
@@ -82,13 +86,13 @@ static bglayer_t *bglayer_delete(bglayer_t *layer); /* destructor */
 
 /* behaviors of layers */
 
-/* abstract behavior */
+/* abstract behavior: the offset of a layer is a closed-form function of
+   time, so that it's computed only when the layer is rendered */
 struct bgbehavior_t {
-    v2d_t offset; /* given in pixels */
-    void (*update)(bgbehavior_t*); /* update function */
+    v2d_t (*offset)(const bgbehavior_t*,double); /* offset at a given time, in pixels */
     bgbehavior_t* (*delete)(bgbehavior_t*); /* destructor */
 };
-static void bgbehavior_update(bgbehavior_t *behavior); /* update behavior */
+static v2d_t bgbehavior_offset(const bgbehavior_t *behavior, double time); /* offset of the behavior */
 static bgbehavior_t *bgbehavior_delete(bgbehavior_t *behavior); /* class destructor */
 
 /* default behavior */
@@ -97,19 +101,18 @@ struct bgbehavior_default_t {
 };
 static bgbehavior_t *bgbehavior_default_new(); /* constructor */
 static bgbehavior_t* bgbehavior_default_delete(bgbehavior_t *behavior); /* destructor */
-static void bgbehavior_default_update(bgbehavior_t *behavior); /* private method */
+static v2d_t bgbehavior_default_offset(const bgbehavior_t *behavior, double time); /* private method */
 
 /* circular strategy (elliptical trajectory) */
 struct bgbehavior_circular_t {
     bgbehavior_t base; /* base class */
-    float elapsed_time; /* in seconds */
     v2d_t amplitude; /* in pixels */
     v2d_t angular_speed; /* in radians per second */
     v2d_t initial_phase; /* in radians */
 };
 static bgbehavior_t *bgbehavior_circular_new(float amplitude_x, float amplitude_y, float angularspeed_x, float angularspeed_y, float initialphase_x, float initialphase_y); /* constructor */
 static bgbehavior_t* bgbehavior_circular_delete(bgbehavior_t *behavior); /* destructor */
-static void bgbehavior_circular_update(bgbehavior_t *behavior); /* private method */
+static v2d_t bgbehavior_circular_offset(const bgbehavior_t *behavior, double time); /* private method */
 
 /* linear strategy */
 struct bgbehavior_linear_t {
@@ -118,7 +121,7 @@ struct bgbehavior_linear_t {
 };
 static bgbehavior_t *bgbehavior_linear_new(float speed_x, float speed_y); /* constructor */
 static bgbehavior_t* bgbehavior_linear_delete(bgbehavior_t *behavior); /* destructor */
-static void bgbehavior_linear_update(bgbehavior_t *behavior); /* private method */
+static v2d_t bgbehavior_linear_offset(const bgbehavior_t *behavior, double time); /* private method */
 
 
 
@@ -131,10 +134,13 @@ static void sort_layers(bgtheme_t *bgtheme);
 static int sort_cmp(const void *a, const void *b);
 static void split_layers(bgtheme_t *bgtheme);
 static void group_layers(bgtheme_t *bgtheme);
+static void find_opaque_layers(bgtheme_t *bgtheme);
 
 /* rendering */
 typedef void (*renderstrategy_t)(const image_t*,v2d_t,void*);
-static void render_layers(bglayer_t* const *layers, int layer_count, v2d_t camera_position, double animation_time, void* data, renderstrategy_t render_image);
+static void render_layers(bglayer_t* const *layers, int layer_count, v2d_t camera_position, double animation_time, double behavior_time, void* data, renderstrategy_t render_image);
+static v2d_t layer_position(const bglayer_t* layer, v2d_t topleft, v2d_t screen_size, double behavior_time, int* rows, int* cols);
+static bool layer_covers_screen(const bglayer_t* layer, v2d_t position, v2d_t screen_size);
 static void render_without_cache(const image_t* image, v2d_t position, void* data);
 static void render_with_cache(const image_t* image, v2d_t position, void* data);
 
@@ -170,8 +176,9 @@ bgtheme_t* background_load(const char *filepath)
     bgtheme->background_count = 0;
     bgtheme->foreground_count = 0;
     bgtheme->animation_time = 0.0;
+    bgtheme->behavior_time = 0.0;
 #if WANT_FAST_DRAW
-    bgtheme->draw_count = 1;
+    bgtheme->draw_cache = fd_create_cache(INITIAL_DRAW_CACHE_SIZE, true, false); /* may be NULL */
 #endif
 
     /* read the .bg file */
@@ -184,6 +191,7 @@ bgtheme_t* background_load(const char *filepath)
     sort_layers(bgtheme);
     split_layers(bgtheme);
     group_layers(bgtheme);
+    find_opaque_layers(bgtheme);
 
     /* done! */
     return bgtheme;
@@ -204,6 +212,10 @@ bgtheme_t* background_unload(bgtheme_t *bgtheme)
         free(bgtheme->layer);
     }
 
+#if WANT_FAST_DRAW
+    fd_destroy_cache(bgtheme->draw_cache);
+#endif
+
     free(bgtheme->filepath);
     free(bgtheme);
     return NULL;
@@ -215,11 +227,9 @@ bgtheme_t* background_unload(bgtheme_t *bgtheme)
  */
 void background_update(bgtheme_t *bgtheme)
 {
-    /* update layers */
-    for(int i = 0; i < bgtheme->layer_count; i++) {
-        const bglayer_t *layer = bgtheme->layer[i];
-        bgbehavior_update(layer->behavior);
-    }
+    /* the layers are positioned at render time. Layers that
+       are off-screen or occluded are not computed at all */
+    bgtheme->behavior_time += timer_get_smooth_delta();
 
     /* update animation time */
     bgtheme->animation_time += timer_get_delta();
@@ -234,18 +244,22 @@ void background_render_bg(bgtheme_t *bgtheme, v2d_t camera_position)
     bglayer_t** layers = bgtheme->layer;
     int layer_count = bgtheme->background_count;
     double animation_time = bgtheme->animation_time;
+    double behavior_time = bgtheme->behavior_time;
+
+    gputimer_begin("background");
 
 #if WANT_FAST_DRAW
-    FAST_DRAW_CACHE* cache = fd_create_cache(bgtheme->draw_count, true, false);
-    int draw_count = 0;
+    FAST_DRAW_CACHE* cache = bgtheme->draw_cache;
 
+    /* the storage of the cache grows as needed and is kept across frames */
     if(cache != NULL) {
-        render_layers(layers, layer_count, camera_position, animation_time, (void*[]){ cache, &draw_count }, render_with_cache);
-        if(draw_count > bgtheme->draw_count)
-            bgtheme->draw_count = draw_count;
-
+        render_layers(layers, layer_count, camera_position, animation_time, behavior_time, cache, render_with_cache);
         fd_flush_cache(cache); /* invokes al_draw_indexed_prim() */
-        fd_destroy_cache(cache);
+    }
+    else {
+        image_hold_drawing(true);
+        render_layers(layers, layer_count, camera_position, animation_time, behavior_time, NULL, render_without_cache);
+        image_hold_drawing(false);
     }
 
     /*
@@ -259,11 +273,13 @@ void background_render_bg(bgtheme_t *bgtheme, v2d_t camera_position)
     */
 #else
     image_hold_drawing(true);
-    render_layers(layers, layer_count, camera_position, animation_time, NULL, render_without_cache);
+    render_layers(layers, layer_count, camera_position, animation_time, behavior_time, NULL, render_without_cache);
     image_hold_drawing(false);
 
     (void)render_with_cache;
 #endif
+
+    gputimer_end();
 }
 
 /*
@@ -275,11 +291,51 @@ void background_render_fg(bgtheme_t *bgtheme, v2d_t camera_position)
     bglayer_t** layers = bgtheme->layer + bgtheme->background_count;
     int layer_count = bgtheme->foreground_count;
     double animation_time = bgtheme->animation_time;
+    double behavior_time = bgtheme->behavior_time;
+
+    /* adaptive quality: the foreground layers are decorative and they
+       cover the screen with translucent pixels. Skip them under load */
+    if(video_is_quality_step_taken(VIDEOQUALITYSTEP_NO_FOREGROUND))
+        return;
+
+    gputimer_begin("background");
+
+#if WANT_FAST_DRAW
+    /* the cache is shared with the background; it's flushed after each use */
+    FAST_DRAW_CACHE* cache = bgtheme->draw_cache;
+
+    if(cache != NULL) {
+        render_layers(layers, layer_count, camera_position, animation_time, behavior_time, cache, render_with_cache);
+        fd_flush_cache(cache);
+        gputimer_end();
+        return;
+    }
+#endif
 
     /* foregrounds typically have few layers */
     image_hold_drawing(true);
-    render_layers(layers, layer_count, camera_position, animation_time, NULL, render_without_cache);
+    render_layers(layers, layer_count, camera_position, animation_time, behavior_time, NULL, render_without_cache);
     image_hold_drawing(false);
+
+    gputimer_end();
+}
+
+/*
+ * background_is_static()
+ * Checks if the background looks the same over time given a fixed camera
+ */
+bool background_is_static(const bgtheme_t *bgtheme)
+{
+    for(int i = 0; i < bgtheme->layer_count; i++) {
+        const bglayer_t *layer = bgtheme->layer[i];
+
+        if(layer->behavior->offset != bgbehavior_default_offset)
+            return false;
+        else if(animation_frame_count(layer->animation) > 1 || animation_has_keyframes(layer->animation))
+            return false;
+    }
+
+    return true;
 }
 
 /*
@@ -329,6 +385,7 @@ bglayer_t *bglayer_new()
     layer->zindex = 0.0f;
     layer->behavior = bgbehavior_default_new(layer);
     layer->group_index = 0;
+    layer->is_opaque = false;
 
     return layer;
 }
@@ -358,9 +415,9 @@ bgbehavior_t *bgbehavior_delete(bgbehavior_t *behavior)
     return behavior->delete(behavior);
 }
 
-void bgbehavior_update(bgbehavior_t *behavior)
+v2d_t bgbehavior_offset(const bgbehavior_t *behavior, double time)
 {
-    behavior->update(behavior);
+    return behavior->offset(behavior, time);
 }
 
 
@@ -371,8 +428,7 @@ bgbehavior_t *bgbehavior_default_new()
     bgbehavior_default_t *me = mallocx(sizeof *me);
     bgbehavior_t *base = (bgbehavior_t*)me;
 
-    base->offset = v2d_new(0.0f, 0.0f);
-    base->update = bgbehavior_default_update;
+    base->offset = bgbehavior_default_offset;
     base->delete = bgbehavior_default_delete;
 
     return base;
@@ -384,10 +440,13 @@ bgbehavior_t *bgbehavior_default_delete(bgbehavior_t *behavior)
     return NULL;
 }
 
-void bgbehavior_default_update(bgbehavior_t *behavior)
+v2d_t bgbehavior_default_offset(const bgbehavior_t *behavior, double time)
 {
-    /* do nothing */
+    /* no movement */
     (void)behavior;
+    (void)time;
+
+    return v2d_new(0.0f, 0.0f);
 }
 
 
@@ -399,11 +458,9 @@ bgbehavior_t *bgbehavior_circular_new(float amplitude_x, float amplitude_y, floa
     bgbehavior_circular_t *me = mallocx(sizeof *me);
     bgbehavior_t *base = (bgbehavior_t*)me;
 
-    base->offset = v2d_new(0.0f, 0.0f);
-    base->update = bgbehavior_circular_update;
+    base->offset = bgbehavior_circular_offset;
     base->delete = bgbehavior_circular_delete;
 
-    me->elapsed_time = 0.0f;
     me->amplitude = v2d_new(amplitude_x, amplitude_y);
     me->angular_speed = v2d_multiply(v2d_new(angularspeed_x, angularspeed_y), TWO_PI);
     me->initial_phase = v2d_multiply(v2d_new(initialphase_x, initialphase_y), DEG2RAD);
@@ -417,19 +474,18 @@ bgbehavior_t *bgbehavior_circular_delete(bgbehavior_t *behavior)
     return NULL;
 }
 
-void bgbehavior_circular_update(bgbehavior_t *behavior)
+v2d_t bgbehavior_circular_offset(const bgbehavior_t *behavior, double time)
 {
-    bgbehavior_circular_t *me = (bgbehavior_circular_t*)behavior;
-    float dt = timer_get_smooth_delta();
-    float t, s, c;
+    const bgbehavior_circular_t *me = (const bgbehavior_circular_t*)behavior;
+    double phase_x = me->angular_speed.x * time + me->initial_phase.x;
+    double phase_y = me->angular_speed.y * time + me->initial_phase.y;
 
-    t = (me->elapsed_time += dt);
-    s = sinf(me->angular_speed.y * t + me->initial_phase.y);
-    c = cosf(me->angular_speed.x * t + me->initial_phase.x);
-
-    /* elliptical trajectory */
-    behavior->offset.x += me->amplitude.x * (me->angular_speed.x * c) * dt;
-    behavior->offset.y += me->amplitude.y * (me->angular_speed.y * s) * dt;
+    /* elliptical trajectory: the integral of the velocity
+       (A w cos(w t + p), A w sin(w t + p)) from zero to time */
+    return v2d_new(
+        me->amplitude.x * (sin(phase_x) - sin(me->initial_phase.x)),
+        me->amplitude.y * (cos(me->initial_phase.y) - cos(phase_y))
+    );
 }
 
 
@@ -441,8 +497,7 @@ bgbehavior_t *bgbehavior_linear_new(float speed_x, float speed_y)
     bgbehavior_linear_t *me = mallocx(sizeof *me);
     bgbehavior_t *base = (bgbehavior_t*)me;
 
-    base->offset = v2d_new(0.0f, 0.0f);
-    base->update = bgbehavior_linear_update;
+    base->offset = bgbehavior_linear_offset;
     base->delete = bgbehavior_linear_delete;
 
     me->speed = v2d_new(speed_x, speed_y);
@@ -456,14 +511,12 @@ bgbehavior_t *bgbehavior_linear_delete(bgbehavior_t *behavior)
     return NULL;
 }
 
-void bgbehavior_linear_update(bgbehavior_t *behavior)
+v2d_t bgbehavior_linear_offset(const bgbehavior_t *behavior, double time)
 {
-    bgbehavior_linear_t *me = (bgbehavior_linear_t*)behavior;
-    float dt = timer_get_smooth_delta();
+    const bgbehavior_linear_t *me = (const bgbehavior_linear_t*)behavior;
 
     /* linear movement */
-    behavior->offset.x += me->speed.x * dt;
-    behavior->offset.y += me->speed.y * dt;
+    return v2d_new(me->speed.x * time, me->speed.y * time);
 }
 
 
@@ -475,36 +528,34 @@ void bgbehavior_linear_update(bgbehavior_t *behavior)
 /* rendering */
 
 /* render layers of the background or of the foreground */
-void render_layers(bglayer_t* const *layers, int layer_count, v2d_t camera_position, double animation_time, void* data, renderstrategy_t render_image)
+void render_layers(bglayer_t* const *layers, int layer_count, v2d_t camera_position, double animation_time, double behavior_time, void* data, renderstrategy_t render_image)
 {
     v2d_t screen_size = video_get_screen_size();
     v2d_t half_screen_size = v2d_multiply(screen_size, 0.5f);
     v2d_t topleft = v2d_subtract(camera_position, half_screen_size);
     rect_t screen_rect = rect_new(0, 0, screen_size.x, screen_size.y);
+    int first = 0, rows, cols;
+
+    /* skip the layers hidden behind an opaque layer that covers the screen.
+       Layers are sorted back-to-front */
+    for(int i = layer_count - 1; i > 0; i--) {
+        if(layers[i]->is_opaque) {
+            v2d_t position = layer_position(layers[i], topleft, screen_size, behavior_time, &rows, &cols);
+            if(layer_covers_screen(layers[i], position, screen_size)) {
+                first = i;
+                break;
+            }
+        }
+    }
 
-    for(int i = 0; i < layer_count; i++) {
+    for(int i = first; i < layer_count; i++) {
         const bglayer_t* layer = layers[i];
         const animation_t* animation = layer->animation;
         float frame_width = animation_frame_width(animation);
         float frame_height = animation_frame_height(animation);
 
         /* compute the position the layer in screen space */
-        v2d_t scroll = v2d_compmult(layer->scroll_speed, topleft);
-        v2d_t offset = v2d_add(layer->behavior->offset, scroll);
-        v2d_t position = v2d_add(layer->initial_position, offset);
-        position.x = floorf(0.5 + position.x); /* round to nearest integer */
-        position.y = floorf(0.5 + position.y);
-
-        /* tiled rendering? */
-        int rows = 1, cols = 1;
-        if(layer->repeat_x) {
-            position.x = fmodf(position.x, frame_width) - frame_width;
-            cols = 3 + (int)(screen_size.x / frame_width);
-        }
-        if(layer->repeat_y) {
-            position.y = fmodf(position.y, frame_height) - frame_height;
-            rows = 3 + (int)(screen_size.y / frame_height);
-        }
+        v2d_t position = layer_position(layer, topleft, screen_size, behavior_time, &rows, &cols);
 
         /* render */
         const image_t* image = animation_image_at_time(animation, animation_time);
@@ -520,6 +571,45 @@ void render_layers(bglayer_t* const *layers, int layer_count, v2d_t camera_posit
     }
 }
 
+/* compute the position of a layer in screen space and how many times it's tiled */
+v2d_t layer_position(const bglayer_t* layer, v2d_t topleft, v2d_t screen_size, double behavior_time, int* rows, int* cols)
+{
+    float frame_width = animation_frame_width(layer->animation);
+    float frame_height = animation_frame_height(layer->animation);
+
+    v2d_t scroll = v2d_compmult(layer->scroll_speed, topleft);
+    v2d_t offset = v2d_add(bgbehavior_offset(layer->behavior, behavior_time), scroll);
+    v2d_t position = v2d_add(layer->initial_position, offset);
+    position.x = floorf(0.5 + position.x); /* round to nearest integer */
+    position.y = floorf(0.5 + position.y);
+
+    /* tiled rendering? */
+    *rows = *cols = 1;
+    if(layer->repeat_x) {
+        position.x = fmodf(position.x, frame_width) - frame_width;
+        *cols = 3 + (int)(screen_size.x / frame_width);
+    }
+    if(layer->repeat_y) {
+        position.y = fmodf(position.y, frame_height) - frame_height;
+        *rows = 3 + (int)(screen_size.y / frame_height);
+    }
+
+    return position;
+}
+
+/* checks if a layer, at a position in screen space, covers the entire screen */
+bool layer_covers_screen(const bglayer_t* layer, v2d_t position, v2d_t screen_size)
+{
+    float frame_width = animation_frame_width(layer->animation);
+    float frame_height = animation_frame_height(layer->animation);
+
+    /* tiled layers cover the screen along the axis in which they repeat */
+    bool covers_x = layer->repeat_x || (position.x <= 0.0f && position.x + frame_width >= screen_size.x);
+    bool covers_y = layer->repeat_y || (position.y <= 0.0f && position.y + frame_height >= screen_size.y);
+
+    return covers_x && covers_y;
+}
+
 /* render an image */
 void render_without_cache(const image_t* image, v2d_t position, void* data)
 {
@@ -530,11 +620,15 @@ void render_without_cache(const image_t* image, v2d_t position, void* data)
 void render_with_cache(const image_t* image, v2d_t position, void* data)
 {
 #if WANT_FAST_DRAW
-    FAST_DRAW_CACHE* cache = (FAST_DRAW_CACHE*)(((void**)data)[0]);
-    int* draw_count = (int*)(((void**)data)[1]);
+    FAST_DRAW_CACHE* cache = (FAST_DRAW_CACHE*)data;
+    ALLEGRO_BITMAP* bmp = IMAGE2BITMAP(image);
+    int width = al_get_bitmap_width(bmp), height = al_get_bitmap_height(bmp);
 
-    fd_draw_bitmap(cache, IMAGE2BITMAP(image), position.x, position.y);
-    ++(*draw_count);
+    /* downscaled images are drawn with their size in image space */
+    if(width == image_width(image) && height == image_height(image))
+        fd_draw_bitmap(cache, bmp, position.x, position.y);
+    else
+        fd_draw_scaled_bitmap(cache, bmp, 0, 0, width, height, position.x, position.y, image_width(image), image_height(image));
 #endif
 }
 
@@ -627,6 +721,16 @@ void group_layers(bgtheme_t *bgtheme)
     #undef layer_image
 }
 
+/* find the layers whose pixels are all fully opaque. If such a layer
+   covers the screen, we can skip the layers behind it */
+void find_opaque_layers(bgtheme_t *bgtheme)
+{
+    for(int i = 0; i < bgtheme->layer_count; i++) {
+        bglayer_t* layer = bgtheme->layer[i];
+        layer->is_opaque = spriteinfo_is_opaque(layer->data);
+    }
+}
+
 
 
 
@@ -21,6 +21,7 @@
 #ifndef _BACKGROUND_H
 #define _BACKGROUND_H
 
+#include <stdbool.h>
 #include "../util/v2d.h"
 
 typedef struct bgtheme_t bgtheme_t;
@@ -33,6 +34,7 @@ void background_render_bg(bgtheme_t *bgtheme, v2d_t camera_position); /* renders
 void background_render_fg(bgtheme_t *bgtheme, v2d_t camera_position); /* renders the foreground */
 
 const char* background_filepath(const bgtheme_t *bgtheme); /* get the filepath of the background */
+bool background_is_static(const bgtheme_t *bgtheme); /* does the background look the same over time, given a fixed camera? */
 int background_number_of_bg_layers(const bgtheme_t* bgtheme); /* number of background layers */
 int background_number_of_fg_layers(const bgtheme_t* bgtheme); /* number of foreground layers */
 
@@ -19,6 +19,7 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <math.h>
 #include "brick.h"
 #include "player.h"
@@ -43,15 +44,18 @@
 #include "../physics/obstacle.h"
 #include "../physics/physicsactor.h"
 #include "../scenes/level.h"
+#include "../scripting/scripting.h"
 
 /* constants */
 #define BRKDATA_MAX             16384 /* up to BRKDATA_MAX bricks per theme are supported */
 #define BRICK_MAXVALUES         1
 #define BRICKBEHAVIOR_MAXARGS   5
+#define PACKED_MASK_MINAREA     (1024 * 1024) /* collision masks at least this large (in pixels) are packed to save memory */
 
 /* types */
 typedef enum brickstate_t brickstate_t;
 typedef struct brickdata_t brickdata_t;
+typedef struct brickmotion_t brickmotion_t;
 typedef struct maskdetails_t maskdetails_t;
 
 /* brick state */
@@ -67,6 +71,10 @@ struct brickdata_t {
     spriteinfo_t *data; /* this is not stored in the main hash */
     const image_t *image; /* pointer to a brick image in the animation */
     int image_width, image_height; /* cached image size */
+    const animation_t *anim; /* the animation of the brick (may be NULL) */
+    const image_t *anim_image; /* current image of the animation, shared by all bricks of this type */
+    double anim_time; /* the time at which anim_image was computed */
+    bool animated; /* does the image change over time? */
     char* maskfile; /* collision mask file (may be NULL) */
     collisionmask_t *mask; /* collision mask (may be NULL) */
     image_t* maskimg; /* mask image for rendering (may be NULL) */
@@ -77,16 +85,19 @@ struct brickdata_t {
 };
 
 /* brick instances */
-struct brick_t { /* a real, concrete brick */
+struct brick_t { /* a real, concrete brick. Most bricks are static; we keep this compact */
     const brickdata_t *brick_ref; /* brick metadata */
+    obstacle_t* obstacle; /* used by the physics system */
+    brickmotion_t* motion; /* state of bricks that move or fall; NULL for the other bricks */
     int x, y; /* current position */
+    uint8_t state; /* brick state: BRS_* */
+    uint8_t layer; /* loop system: BRL_* */
+    uint8_t flip; /* flip bitwise flags */
+};
+
+struct brickmotion_t { /* side table of the bricks with a behavior state */
     int sx, sy; /* spawn point */
-    brickstate_t state; /* brick state: BRS_* */
     float value[BRICK_MAXVALUES]; /* alterable values */
-    bricklayer_t layer; /* loop system: BRL_* */
-    brickflip_t flip; /* flip bitwise flags */
-    obstacle_t* obstacle; /* used by the physics system */
-    const image_t *image; /* pointer to the current brick image in the animation */
 };
 
 /* collision mask (parsed data) */
@@ -97,6 +108,8 @@ struct maskdetails_t {
 
 /* private stuff */
 static void animate_brick(brick_t *brk);
+static void update_animation(brickdata_t *obj, double time);
+static void find_animated_bricks();
 static brickdata_t *brickdata_get(int id);
 static brickdata_t* brickdata_new(int brick_id);
 static brickdata_t* brickdata_delete(brickdata_t *obj);
@@ -106,6 +119,7 @@ static int traverse_brick_attributes(const parsetree_statement_t *stmt, void *br
 static int traverse_collisionmask(const parsetree_statement_t *stmt, void *maskdetails);
 static collisionmask_t *read_collisionmask(const parsetree_program_t *block);
 static void create_collisionmasks();
+static void create_collisionmask_batch(const collisionmask_request_t* request, collisionmask_t** batch, const int* batch_brick, int batch_size);
 static obstacle_t* create_obstacle(const brick_t* brick);
 static obstacle_t* destroy_obstacle(obstacle_t* obstacle);
 static inline int get_obstacle_flags(const brick_t* brick);
@@ -113,16 +127,24 @@ static inline obstaclelayer_t get_obstacle_layer(const brick_t* brick);
 static inline int get_image_flags(const brick_t* brick);
 static bool is_player_standing_on_platform(const player_t *player, const brick_t *brk);
 static bool can_be_clipped_out(const brick_t* brick, v2d_t topleft);
-static surgescript_object_t* create_particle(const brick_t* brick, int source_x, int source_y, int width, int height, v2d_t position, v2d_t velocity);
+static bool has_motion(const brickdata_t* brick_ref);
+static surgescript_object_t* create_particle_emitter(const brick_t* brick);
+static void create_particle(surgescript_object_t* emitter, int source_x, int source_y, int width, int height, v2d_t position, v2d_t velocity);
 static int brickdata_count = 0; /* size of brickdata[] */
 static brickdata_t* brickdata[BRKDATA_MAX]; /* brick data */
+static int animated_count = 0; /* size of animated_brick[] */
+static int animated_brick[BRKDATA_MAX]; /* IDs of the animated bricks */
+static unsigned death_count = 0; /* how many bricks have been killed? */
 
 /* utilities */
 #define ROUND(x)   (int)(((x)>=0.0f)?((x)+0.5f):((x)-0.5f))
+#define spawn_x(brk) ((brk)->motion != NULL ? (brk)->motion->sx : (brk)->x) /* static bricks don't move */
+#define spawn_y(brk) ((brk)->motion != NULL ? (brk)->motion->sy : (brk)->y)
 static const float BRICK_FALL_TTL = 1.0f; /* time in seconds before a BRB_FALL gets destroyed */
 static const float BRICK_FLOAT_AMPLITUDE = 8.0f; /* if a player touches a floating brick, how deep in pixels should it go? */
 static const float BRICK_FLOAT_TIME = 0.25f; /* time in seconds before a floating brick reaches full amplitude */
 static const float BRICK_FLOAT_TTL = 0.75f; /* time to live: seconds before a floating brick falls down (if it falls) */
+static const int BRICK_INTERACTION_MARGIN = 32; /* in pixels; players farther than this from a brick don't interact with it */
 
 
 
@@ -161,6 +183,7 @@ void brickset_load(const char* filename)
 
     logfile_message("Creating collision masks...");
     create_collisionmasks();
+    find_animated_bricks();
 
     logfile_message("The brickset has been loaded.");
 }
@@ -180,6 +203,7 @@ void brickset_unload()
     for(i = 0; i < brickdata_count; i++)
         brickdata[i] = brickdata_delete(brickdata[i]);
     brickdata_count = 0;
+    animated_count = 0;
 
     logfile_message("The brickset has been unloaded.");
 }
@@ -203,6 +227,20 @@ int brickset_loaded()
     return brickset_size() > 0;
 }
 
+/*
+ * brickset_animate()
+ * Computes the current image of each animated brick of the brickset.
+ * All bricks with the same ID display the same frame at any given time,
+ * so we do this once per brick type per frame, not once per brick
+ */
+void brickset_animate()
+{
+    double time = timer_get_elapsed();
+
+    for(int i = 0; i < animated_count; i++)
+        update_animation(brickdata[animated_brick[i]], time);
+}
+
 
 
 
@@ -215,23 +253,28 @@ int brickset_loaded()
 brick_t* brick_create(int id, v2d_t position, bricklayer_t layer, brickflip_t flip_flags)
 {
     brick_t *b = mallocx(sizeof *b);
-    int i;
 
     b->brick_ref = brickdata_get(id);
     if(b->brick_ref == NULL)
         fatal_error("Can't create brick %d: brick not found.", id);
 
-    b->x = b->sx = (int)position.x;
-    b->y = b->sy = (int)position.y;
+    b->x = (int)position.x;
+    b->y = (int)position.y;
     b->state = BRS_IDLE;
     b->layer = layer;
     b->flip = flip_flags;
-    b->image = b->brick_ref->image;
-    b->obstacle = create_obstacle(b);
-
-    for(i=0; i<BRICK_MAXVALUES; i++)
-        b->value[i] = 0.0f;
+    b->motion = NULL;
+
+    /* only the bricks that move or fall keep a behavior state */
+    if(has_motion(b->brick_ref)) {
+        b->motion = mallocx(sizeof *(b->motion));
+        b->motion->sx = b->x;
+        b->motion->sy = b->y;
+        for(int i = 0; i < BRICK_MAXVALUES; i++)
+            b->motion->value[i] = 0.0f;
+    }
 
+    b->obstacle = create_obstacle(b);
     return b;
 }
 
@@ -243,6 +286,8 @@ brick_t* brick_create(int id, v2d_t position, bricklayer_t layer, brickflip_t fl
 brick_t* brick_destroy(brick_t *brk)
 {
     destroy_obstacle(brk->obstacle);
+    if(brk->motion != NULL)
+        free(brk->motion);
     free(brk);
     return NULL;
 }
@@ -288,6 +333,7 @@ void brick_update(brick_t *brk, player_t** team, int team_size)
                         float dx = player_position(team[i]).x - brk->x;
 
                         /* create particles */
+                        surgescript_object_t* emitter = create_particle_emitter(brk);
                         for(int bi=0; bi<bw; bi++) {
                             for(int bj=0; bj<bh; bj++) {
                                 v2d_t brk_pos = v2d_new(brk->x + (bi*brk_width)/bw, brk->y + (bj*brk_height)/bh);
@@ -297,7 +343,7 @@ void brick_update(brick_t *brk, player_t** team, int team_size)
                                 );
 
                                 create_particle(
-                                    brk,
+                                    emitter,
                                     (bi * brk_width) / bw,
                                     (bj * brk_height) / bh,
                                     brk_width / bw,
@@ -310,7 +356,7 @@ void brick_update(brick_t *brk, player_t** team, int team_size)
 
                         /* destroy brick */
                         sound_play(SFX_BREAK);
-                        brk->state = BRS_DEAD;
+                        brick_kill(brk);
                     }
                 }
             }
@@ -332,19 +378,20 @@ void brick_update(brick_t *brk, player_t** team, int team_size)
             if(brk->state == BRS_IDLE && collision)
                 brk->state = BRS_ACTIVE;
 
-            if((brk->state == BRS_ACTIVE) && ((brk->value[0] += timer_get_delta()) >= BRICK_FALL_TTL)) {
+            if((brk->state == BRS_ACTIVE) && ((brk->motion->value[0] += timer_get_delta()) >= BRICK_FALL_TTL)) {
                 int bw = clip(brk->brick_ref->behavior_arg[0], 1, max_bw);
                 int bh = clip(brk->brick_ref->behavior_arg[1], 1, max_bh);
                 int right_oriented = ((int)brk->brick_ref->behavior_arg[2] >= 0);
 
                 /* create particles */
+                surgescript_object_t* emitter = create_particle_emitter(brk);
                 for(int bi=0; bi<bw; bi++) {
                     for(int bj=0; bj<bh; bj++) {
                         v2d_t piece_pos = v2d_new(brk->x + (bi*brk_width)/bw, brk->y + (bj*brk_height)/bh);
                         v2d_t piece_speed = v2d_new(0, (1+bj)*15 + (right_oriented?bi:bw-bi)*15);
 
                         create_particle(
-                            brk,
+                            emitter,
                             (bi * brk_width) / bw,
                             (bj * brk_height) / bh,
                             brk_width / bw,
@@ -357,7 +404,7 @@ void brick_update(brick_t *brk, player_t** team, int team_size)
 
                 /* destroy brick */
                 sound_play(SFX_BREAK);
-                brk->state = BRS_DEAD;
+                brick_kill(brk);
             }
 
             break;
@@ -368,7 +415,7 @@ void brick_update(brick_t *brk, player_t** team, int team_size)
             int dx, dy, old_x, old_y;
 
             /* get the parameters */
-            float t = (brk->value[0] = level_time()); /* elapsed time */
+            float t = (brk->motion->value[0] = level_time()); /* elapsed time */
             float rx = max(brk->brick_ref->behavior_arg[0], 0.0f); /* x-dist */
             float ry = max(brk->brick_ref->behavior_arg[1], 0.0f); /* y-dist */
             float sx = TWO_PI * brk->brick_ref->behavior_arg[2]; /* x-speed */
@@ -377,8 +424,8 @@ void brick_update(brick_t *brk, player_t** team, int team_size)
 
             /* compute the position */
             old_x = brk->x; old_y = brk->y;
-            brk->x = brk->sx + ROUND(rx * cosf(sx * t + ph));
-            brk->y = brk->sy + ROUND(ry * sinf(sy * t + ph));
+            brk->x = spawn_x(brk) + ROUND(rx * cosf(sx * t + ph));
+            brk->y = spawn_y(brk) + ROUND(ry * sinf(sy * t + ph));
             dx = brk->x - old_x; dy = brk->y - old_y;
 
             /* passable bricks do not affect the player */
@@ -413,7 +460,7 @@ void brick_update(brick_t *brk, player_t** team, int team_size)
             int dx, dy, old_x, old_y;
 
             /* get the parameters */
-            float t = (brk->value[0] = level_time()); /* elapsed time */
+            float t = (brk->motion->value[0] = level_time()); /* elapsed time */
             float r = max(brk->brick_ref->behavior_arg[0], 0.0f); /* radius */
             float f = TWO_PI * brk->brick_ref->behavior_arg[1]; /* cycles per second */
             float ph = DEG2RAD * brk->brick_ref->behavior_arg[2]; /* initial phase */
@@ -425,8 +472,8 @@ void brick_update(brick_t *brk, player_t** team, int team_size)
 
             /* compute the position */
             old_x = brk->x; old_y = brk->y;
-            brk->x = brk->sx + ROUND(r * cosf(ang));
-            brk->y = brk->sy + ROUND(r * sinf(ang));
+            brk->x = spawn_x(brk) + ROUND(r * cosf(ang));
+            brk->y = spawn_y(brk) + ROUND(r * sinf(ang));
             dx = brk->x - old_x; dy = brk->y - old_y;
 
             /* passable bricks do not affect the player */
@@ -481,6 +528,7 @@ void brick_update(brick_t *brk, player_t** team, int team_size)
                     player_overlaps(team[i], brk->x, brk->y - 10, brk_width, min(8, brk_height))
                 ) {
                     /* create particles */
+                    surgescript_object_t* emitter = create_particle_emitter(brk);
                     int bw = clip(brk->brick_ref->behavior_arg[0], 1, max_bw);
                     int bh = clip(brk->brick_ref->behavior_arg[1], 1, max_bh);
 
@@ -493,7 +541,7 @@ void brick_update(brick_t *brk, player_t** team, int team_size)
                             );
 
                             create_particle(
-                                brk,
+                                emitter,
                                 (bi * brk_width) / bw,
                                 (bj * brk_height) / bh,
                                 brk_width / bw,
@@ -512,7 +560,7 @@ void brick_update(brick_t *brk, player_t** team, int team_size)
 
                     /* destroy brick */
                     sound_play(SFX_BREAK);
-                    brk->state = BRS_DEAD;
+                    brick_kill(brk);
                 }
             }
             break;
@@ -550,7 +598,7 @@ void brick_update(brick_t *brk, player_t** team, int team_size)
             if(brk->state == BRS_ACTIVE && !player) {
                 if(!isfinite(seconds_til_fall)) {
                     brk->state = BRS_IDLE;
-                    brk->value[0] = min(BRICK_FLOAT_TIME, brk->value[0]);
+                    brk->motion->value[0] = min(BRICK_FLOAT_TIME, brk->motion->value[0]);
                 }
             }
             else if(brk->state == BRS_IDLE && player)
@@ -558,17 +606,17 @@ void brick_update(brick_t *brk, player_t** team, int team_size)
 
             /* time logic */
             if(brk->state == BRS_ACTIVE)
-                brk->value[0] += timer_get_delta();
+                brk->motion->value[0] += timer_get_delta();
             else if(brk->state == BRS_IDLE) {
-                brk->value[0] -= timer_get_delta();
-                if(brk->value[0] < 0.0f)
-                    brk->value[0] = 0.0f;
+                brk->motion->value[0] -= timer_get_delta();
+                if(brk->motion->value[0] < 0.0f)
+                    brk->motion->value[0] = 0.0f;
             }
 
             /* compute the position */
             old_y = brk->y;
-            brk->y = brk->sy + BRICK_FLOAT_AMPLITUDE * sinf(
-                min(BRICK_FLOAT_TIME, brk->value[0]) * (ninety / BRICK_FLOAT_TIME)
+            brk->y = spawn_y(brk) + BRICK_FLOAT_AMPLITUDE * sinf(
+                min(BRICK_FLOAT_TIME, brk->motion->value[0]) * (ninety / BRICK_FLOAT_TIME)
             );
             dy = brk->y - old_y;
 
@@ -584,23 +632,24 @@ void brick_update(brick_t *brk, player_t** team, int team_size)
             }
 
             /* should the brick fall? */
-            if(brk->state == BRS_ACTIVE && brk->value[0] >= seconds_til_fall) {
+            if(brk->state == BRS_ACTIVE && brk->motion->value[0] >= seconds_til_fall) {
                 /* create particle */
+                surgescript_object_t* emitter = create_particle_emitter(brk);
                 v2d_t brk_pos = v2d_new(brk->x, brk->y);
                 v2d_t brk_vel = v2d_new(0, 120);
 
                 create_particle(
-                    brk,
+                    emitter,
                     0,
                     0,
-                    image_width(brk->image),
-                    image_height(brk->image),
+                    image_width(brick_image(brk)),
+                    image_height(brick_image(brk)),
                     brk_pos,
                     brk_vel
                 );
 
                 /* destroy brick */
-                brk->state = BRS_DEAD;
+                brick_kill(brk);
             }
             
             /* done */
@@ -625,7 +674,7 @@ void brick_render(brick_t *brk, v2d_t camera_position)
 
         if(!can_be_clipped_out(brk, topleft)) {
             animate_brick(brk);
-            image_draw(brk->image, brk->x - (int)topleft.x, brk->y - (int)topleft.y, get_image_flags(brk));
+            image_draw(brick_image(brk), brk->x - (int)topleft.x, brk->y - (int)topleft.y, get_image_flags(brk));
         }
     }
 }
@@ -642,9 +691,9 @@ void brick_render_debug(brick_t *brk, v2d_t camera_position)
         animate_brick(brk);
 
         if(brk->layer != BRL_DEFAULT)
-            image_draw_lit(brk->image, brk->x - (int)topleft.x, brk->y - (int)topleft.y, brick_util_layercolor(brk->layer), get_image_flags(brk));
+            image_draw_lit(brick_image(brk), brk->x - (int)topleft.x, brk->y - (int)topleft.y, brick_util_layercolor(brk->layer), get_image_flags(brk));
         else
-            image_draw(brk->image, brk->x - (int)topleft.x, brk->y - (int)topleft.y, get_image_flags(brk));
+            image_draw(brick_image(brk), brk->x - (int)topleft.x, brk->y - (int)topleft.y, get_image_flags(brk));
     }
 }
 
@@ -679,17 +728,17 @@ void brick_render_path(const brick_t *brk, v2d_t camera_position)
             float rx = fabs(brk->brick_ref->behavior_arg[0]); /* x-dist */
             float ry = fabs(brk->brick_ref->behavior_arg[1]); /* y-dist */
             if(rx < 1)
-                image_line(brk->sx - topleft.x + w/2, brk->sy - topleft.y - ry + h/2, brk->sx - topleft.x + w/2, brk->sy - topleft.y + ry + h/2, color);
+                image_line(spawn_x(brk) - topleft.x + w/2, spawn_y(brk) - topleft.y - ry + h/2, spawn_x(brk) - topleft.x + w/2, spawn_y(brk) - topleft.y + ry + h/2, color);
             else if(ry < 1)
-                image_line(brk->sx - topleft.x - rx + w/2, brk->sy - topleft.y + h/2, brk->sx - topleft.x + rx + w/2, brk->sy - topleft.y + h/2, color);
+                image_line(spawn_x(brk) - topleft.x - rx + w/2, spawn_y(brk) - topleft.y + h/2, spawn_x(brk) - topleft.x + rx + w/2, spawn_y(brk) - topleft.y + h/2, color);
             else
-                image_ellipse(brk->sx - topleft.x + w/2, brk->sy - topleft.y + h/2, rx, ry, color);
+                image_ellipse(spawn_x(brk) - topleft.x + w/2, spawn_y(brk) - topleft.y + h/2, rx, ry, color);
             break;
         }
 
         case BRB_PENDULAR: {
             float r = fabs(brk->brick_ref->behavior_arg[0]); /* radius */
-            image_ellipse(brk->sx - topleft.x + w/2, brk->sy - topleft.y + h/2, r, r, color);
+            image_ellipse(spawn_x(brk) - topleft.x + w/2, spawn_y(brk) - topleft.y + h/2, r, r, color);
             break;
         }
 
@@ -759,7 +808,8 @@ brickflip_t brick_flip(const brick_t* brk)
  */
 const image_t *brick_image(const brick_t *brk)
 {
-    return brk->image;
+    /* bricks of the same type share their current image */
+    return brk->brick_ref->anim_image;
 }
 
 /*
@@ -803,7 +853,7 @@ v2d_t brick_position(const brick_t* brk)
  */
 v2d_t brick_spawnpoint(const brick_t* brk)
 {
-    return v2d_new(brk->sx, brk->sy);
+    return v2d_new(spawn_x(brk), spawn_y(brk));
 }
 
 /*
@@ -815,13 +865,74 @@ v2d_t brick_size(const brick_t* brk)
     return brk->brick_ref ? v2d_new(brk->brick_ref->image_width, brk->brick_ref->image_height) : v2d_new(0, 0);
 }
 
+/*
+ * brick_interaction_area()
+ * A rectangle in world space enclosing the region in which a brick may
+ * interact with the players. Players whose bounding boxes don't overlap
+ * this rectangle are not affected by the brick in the current frame
+ */
+rect_t brick_interaction_area(const brick_t* brk)
+{
+    int w = brk->brick_ref->image_width;
+    int h = brk->brick_ref->image_height;
+    int left = brk->x, top = brk->y;
+    int right = brk->x + w, bottom = brk->y + h;
+
+    /* moving bricks carry the players along with them;
+       we take their entire path into account */
+    switch(brk->brick_ref->behavior) {
+        case BRB_CIRCULAR: {
+            int rx = (int)ceilf(max(brk->brick_ref->behavior_arg[0], 0.0f));
+            int ry = (int)ceilf(max(brk->brick_ref->behavior_arg[1], 0.0f));
+            left = spawn_x(brk) - rx; right = spawn_x(brk) + rx + w;
+            top = spawn_y(brk) - ry; bottom = spawn_y(brk) + ry + h;
+            break;
+        }
+
+        case BRB_PENDULAR: {
+            int r = (int)ceilf(max(brk->brick_ref->behavior_arg[0], 0.0f));
+            left = spawn_x(brk) - r; right = spawn_x(brk) + r + w;
+            top = spawn_y(brk) - r; bottom = spawn_y(brk) + r + h;
+            break;
+        }
+
+        case BRB_FLOAT:
+            top = min(top, spawn_y(brk));
+            bottom = max(bottom, spawn_y(brk) + h + (int)ceilf(BRICK_FLOAT_AMPLITUDE));
+            break;
+
+        default:
+            break;
+    }
+
+    return rect_new(
+        left - BRICK_INTERACTION_MARGIN,
+        top - BRICK_INTERACTION_MARGIN,
+        (right - left) + 2 * BRICK_INTERACTION_MARGIN,
+        (bottom - top) + 2 * BRICK_INTERACTION_MARGIN
+    );
+}
+
 /*
  * brick_kill()
  * Kills a brick
  */
 void brick_kill(brick_t* brk)
 {
-    brk->state = BRS_DEAD;
+    if(brk->state != BRS_DEAD) {
+        brk->state = BRS_DEAD;
+        death_count++;
+    }
+}
+
+/*
+ * brick_death_count()
+ * The number of bricks that have been killed since the program started.
+ * If this number hasn't changed, no brick has died in the meantime
+ */
+unsigned brick_death_count()
+{
+    return death_count;
 }
 
 /*
@@ -857,6 +968,15 @@ bool brick_has_mask(const brick_t* brk)
         return false;
 }
 
+/*
+ * brick_is_animated()
+ * Checks if the image of a brick changes over time
+ */
+bool brick_is_animated(const brick_t* brk)
+{
+    return brk->brick_ref != NULL && brk->brick_ref->animated;
+}
+
 /*
  * brick_util_typename()
  * Returns the name of a given brick type
@@ -1048,15 +1168,34 @@ float brick_zindex_preview(int id)
 /* Animates a brick */
 void animate_brick(brick_t *brk)
 {
-    const spriteinfo_t *sprite = brk->brick_ref->data;
+    const brickdata_t *ref = brk->brick_ref;
 
     /* fake brick? */
-    if(sprite == NULL)
+    if(ref->data == NULL)
         return;
 
-    /* animate */
-    const animation_t* anim = spriteinfo_get_animation(sprite, 0);
-    brk->image = animation_image_at_time(anim, timer_get_elapsed());
+    /* brickset_animate() may not have been called in this frame (e.g., the level is paused).
+       The updated image is shared by all bricks of this type; see brick_image() */
+    if(ref->animated && ref->anim_time != timer_get_elapsed())
+        update_animation(brickdata[ref->id], timer_get_elapsed());
+}
+
+/* Computes the image of an animated brick at a given time */
+void update_animation(brickdata_t *obj, double time)
+{
+    obj->anim_image = animation_image_at_time(obj->anim, time);
+    obj->anim_time = time;
+}
+
+/* Lists the animated bricks of the brickset */
+void find_animated_bricks()
+{
+    animated_count = 0;
+
+    for(int i = 0; i < brickdata_count; i++) {
+        if(brickdata[i] != NULL && brickdata[i]->animated)
+            animated_brick[animated_count++] = i;
+    }
 }
 
 /* Checks if the player is standing on top of a platform */
@@ -1074,7 +1213,7 @@ bool can_be_clipped_out(const brick_t* brick, v2d_t topleft)
     int x = brick->x - (int)topleft.x;
     int y = brick->y - (int)topleft.y;
 
-    const image_t* img = brick->image;
+    const image_t* img = brick_image(brick);
     int w = image_width(img);
     int h = image_height(img);
 
@@ -1085,54 +1224,20 @@ bool can_be_clipped_out(const brick_t* brick, v2d_t topleft)
     return (x + w <= 0 || x >= sw || y + h <= 0 || y >= sh);
 }
 
-/* create a brick particle */
-surgescript_object_t* create_particle(const brick_t* brick, int source_x, int source_y, int width, int height, v2d_t position, v2d_t velocity)
+/* create a particle emitter for the pieces of a brick */
+surgescript_object_t* create_particle_emitter(const brick_t* brick)
 {
-    /* create the particle */
-    surgescript_object_t* particle = level_create_object("BrickParticle", position);
-
-    /* create auxiliary variables */
-    surgescript_var_t* id = surgescript_var_create();
-    surgescript_var_t* x = surgescript_var_create();
-    surgescript_var_t* y = surgescript_var_create();
-    surgescript_var_t* w = surgescript_var_create();
-    surgescript_var_t* h = surgescript_var_create();
-
-    /* call particle.setBrick(brick_id, source_x, source_y, width, height) */
-    const surgescript_var_t* args1[] = {
-        surgescript_var_set_number(id, brick_id(brick)),
-        surgescript_var_set_number(x, source_x),
-        surgescript_var_set_number(y, source_y),
-        surgescript_var_set_number(w, width),
-        surgescript_var_set_number(h, height)
-    };
-    surgescript_object_call_function(particle, "setBrick", args1, 5, NULL);
+    v2d_t position = v2d_new(brick->x, brick->y);
+    surgescript_object_t* emitter = level_create_object("BrickParticle", position);
 
-    /* call particle.setVelocity(xvel, yvel) */
-    const surgescript_var_t* args2[] = {
-        surgescript_var_set_number(x, velocity.x),
-        surgescript_var_set_number(y, velocity.y)
-    };
-    surgescript_object_call_function(particle, "setVelocity", args2, 2, NULL);
-
-    /* call particle.set_zindex(zindex) */
-    /*
-    // the zindex of the brick is already set by setBrick()
-    const surgescript_var_t* args3[] = {
-        surgescript_var_set_number(x, 1.0)
-    };
-    surgescript_object_call_function(particle, "set_zindex", args3, 1, NULL);
-    */
-
-    /* release auxiliary variables */
-    surgescript_var_destroy(h);
-    surgescript_var_destroy(w);
-    surgescript_var_destroy(y);
-    surgescript_var_destroy(x);
-    surgescript_var_destroy(id);
+    scripting_brickparticle_setbrick(emitter, brick_id(brick));
+    return emitter;
+}
 
-    /* return the particle */
-    return particle;
+/* create a brick particle (a piece of the brick) */
+void create_particle(surgescript_object_t* emitter, int source_x, int source_y, int width, int height, v2d_t position, v2d_t velocity)
+{
+    scripting_brickparticle_add(emitter, source_x, source_y, width, height, position, velocity);
 }
 
 
@@ -1147,6 +1252,10 @@ brickdata_t* brickdata_new(int brick_id)
     obj->image = NULL;
     obj->image_width = 0;
     obj->image_height = 0;
+    obj->anim = NULL;
+    obj->anim_image = NULL;
+    obj->anim_time = 0.0;
+    obj->animated = false;
     obj->mask = NULL;
     obj->maskfile = NULL;
     obj->maskimg = NULL;
@@ -1271,6 +1380,11 @@ int traverse(const parsetree_statement_t *stmt)
         anim = spriteinfo_get_animation(brickdata[brick_id]->data, 0);
         brickdata[brick_id]->image = animation_image(anim, 0);
 
+        /* setup animation */
+        brickdata[brick_id]->anim = anim;
+        brickdata[brick_id]->anim_image = brickdata[brick_id]->image;
+        brickdata[brick_id]->animated = (animation_frame_count(anim) > 1);
+
         /* cache preview image size */
         brickdata[brick_id]->image_width = image_width(brickdata[brick_id]->image);
         brickdata[brick_id]->image_height = image_height(brickdata[brick_id]->image);
@@ -1432,6 +1546,15 @@ collisionmask_t *read_collisionmask(const parsetree_program_t *block)
     return mask;
 }
 
+/* creates the collision masks of a batch of bricks */
+void create_collisionmask_batch(const collisionmask_request_t* request, collisionmask_t** batch, const int* batch_brick, int batch_size)
+{
+    collisionmask_create_batch(request, batch_size, batch);
+
+    for(int j = 0; j < batch_size; j++)
+        brickdata[batch_brick[j]]->mask = batch[j];
+}
+
 /* creates the collision masks of all bricks */
 void create_collisionmasks()
 {
@@ -1439,6 +1562,13 @@ void create_collisionmasks()
     image_t* mask = NULL;
     const char* prev_maskfile = "";
 
+    /* the masks of consecutive bricks that share the same image
+       are created in a batch, while the image is locked */
+    collisionmask_request_t* request = mallocx((brickdata_count + 1) * sizeof(*request));
+    collisionmask_t** batch = mallocx((brickdata_count + 1) * sizeof(*batch));
+    int* batch_brick = mallocx((brickdata_count + 1) * sizeof(*batch_brick));
+    int batch_size = 0;
+
     /* creates the collision masks */
     for(i = 0; i < brickdata_count; i++) {
         if(brickdata[i] != NULL && brickdata[i]->type != BRK_PASSABLE && brickdata[i]->mask == NULL) {
@@ -1449,8 +1579,15 @@ void create_collisionmasks()
             int frame_height = spriteinfo_frame_height(sprite);
             int flags = (brickdata[i]->type == BRK_CLOUD) ? CMF_CLOUDIFY : 0;
 
+            /* large masks are packed */
+            if(frame_width * frame_height >= PACKED_MASK_MINAREA)
+                flags |= CMF_PACKED;
+
             if(mask == NULL || 0 != str_icmp(prev_maskfile, maskfile)) {
                 if(mask != NULL) {
+                    create_collisionmask_batch(request, batch, batch_brick, batch_size);
+                    batch_size = 0;
+
                     image_unlock(mask);
                     image_unload(mask);
                 }
@@ -1459,22 +1596,29 @@ void create_collisionmasks()
                 prev_maskfile = maskfile;
             }
 
-            brickdata[i]->mask = collisionmask_create(
-                mask,
-                source_rect.x,
-                source_rect.y,
-                frame_width,
-                frame_height,
-                flags
-            );
+            request[batch_size] = (collisionmask_request_t){
+                .image = mask,
+                .x = source_rect.x,
+                .y = source_rect.y,
+                .width = frame_width,
+                .height = frame_height,
+                .flags = flags
+            };
+            batch_brick[batch_size++] = i;
         }
     }
 
     if(mask != NULL) {
+        create_collisionmask_batch(request, batch, batch_brick, batch_size);
+
         image_unlock(mask);
         image_unload(mask);
     }
 
+    free(batch_brick);
+    free(batch);
+    free(request);
+
     /* creates the images of the masks */
     for(i = 0; i < brickdata_count; i++) {
         if(brickdata[i] != NULL && brickdata[i]->mask != NULL) {
@@ -1483,4 +1627,19 @@ void create_collisionmasks()
             brickdata[i]->maskimg = collisionmask_to_image(brickdata[i]->mask, color);
         }
     }
-}
\ No newline at end of file
+}
+
+/* do the bricks of this type keep a behavior state? */
+bool has_motion(const brickdata_t* brick_ref)
+{
+    switch(brick_ref->behavior) {
+        case BRB_CIRCULAR:
+        case BRB_PENDULAR:
+        case BRB_FLOAT:
+        case BRB_FALL:
+            return true;
+
+        default:
+            return false;
+    }
+}
@@ -22,6 +22,7 @@
 #define _BRICK_H
 
 #include "../util/v2d.h"
+#include "../util/rect.h"
 #include "../core/color.h"
 
 /* brick type */
@@ -86,6 +87,7 @@ void brickset_load(const char *filename); /* loads a brickset */
 void brickset_unload(); /* unloads the current brickset */
 int brickset_size(); /* number of bricks */
 int brickset_loaded(); /* is a brickset loaded? */
+void brickset_animate(); /* updates the animations of the bricks; call once per frame */
 
 /* brick interface */
 brick_t* brick_create(int id, v2d_t position, bricklayer_t layer, brickflip_t flip_flags); /* creates a new brick */
@@ -108,10 +110,13 @@ float brick_zindex(const brick_t* brk); /* brick zindex */
 v2d_t brick_position(const brick_t* brk); /* brick position */
 v2d_t brick_spawnpoint(const brick_t* brk); /* brick spawn point */
 v2d_t brick_size(const brick_t* brk); /* brick size, in pixels */
+rect_t brick_interaction_area(const brick_t* brk); /* players outside this rectangle in world space are not affected by the brick */
 void brick_kill(brick_t* brk); /* kills a brick */
 int brick_is_alive(const brick_t* brk); /* checks if a brick is alive */
+unsigned brick_death_count(); /* how many bricks have been killed so far? */
 bool brick_has_movement_path(const brick_t* brk); /* checks if a brick has a movement path */
 bool brick_has_mask(const brick_t* brk); /* checks if a brick has a collision mask */
+bool brick_is_animated(const brick_t* brk); /* checks if the image of a brick changes over time */
 
 /* brick utilities */
 int brick_exists(int id); /* does a brick with the given id exist in the brickset? */
@@ -0,0 +1,678 @@
+/*
+ * Open Surge Engine
+ * brickcache.c - static bricks baked into chunk textures
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <allegro5/allegro.h>
+#include <string.h>
+#include "brickcache.h"
+#include "brickmanager.h"
+#include "renderqueue.h"
+#include "../core/image.h"
+#include "../core/color.h"
+#include "../core/video.h"
+#include "../core/shader.h"
+#include "../core/logfile.h"
+#include "../util/util.h"
+#include "../util/darray.h"
+
+/*
+
+BRICK CACHE
+-----------
+
+Static bricks that are not animated look the same on every frame. Instead of
+rendering them one by one, we bake them into textures. The world is divided
+into square cells of CHUNK_SIZE pixels. Each cell holds one chunk per group of
+bricks that share the same zindex, type and layer, since these determine the
+order in which bricks are rendered relative to other entities. Each visible
+chunk is then rendered with a single draw call.
+
+Cells are baked lazily as they become visible and are evicted with a LRU
+policy. All cells are discarded whenever static bricks are added or removed.
+Cells that are about to become visible may be baked in advance, at a limited
+rate, so that fast scrolling doesn't bake many cells in a single frame.
+
+TILEMAPS
+--------
+
+Many levels are made mostly of grid-aligned bricks of the same size that are
+cut from the same sheet. A group of such bricks is encoded as a tilemap instead
+of being baked: we create a tiny tile-index texture with one texel per tile of
+the chunk, and a shader draws the chunk as a single quad, sampling the sheet
+at the locations given by the index. A tilemap is much cheaper to create than
+a baked chunk and uses a lot less video memory, so tilemaps don't count towards
+MAX_TEXTURES.
+
+Each texel of the index stores the position of a tile in the texture of the
+sheet (14 bits per coordinate), its flip flags and whether or not the tile is
+present. Bricks qualify if they have the same size, are aligned to a grid of
+that size, don't overlap and are stored in the same texture, at the same scale.
+Otherwise we bake the group as usual.
+
+*/
+
+typedef struct brickcell_t brickcell_t;
+
+/* a chunk of baked bricks */
+struct brickchunk_t
+{
+    image_t* image; /* the baked bricks or a tile-index texture */
+    int x, y; /* top-left position in world space */
+
+    /* tilemaps only: the texture of the tiles is that of tileset */
+    const image_t* tileset; /* NULL if the bricks are baked */
+    shader_t* shader; /* the tilemap shader */
+    int tile_width, tile_height; /* size of a tile in world space */
+    float tile_texels[2]; /* size of a tile in the texture of the tileset */
+
+    /* the attributes shared by the baked bricks */
+    float zindex;
+    bricktype_t type;
+    bricklayer_t layer;
+};
+
+/* a cell of the world holding zero or more chunks */
+struct brickcell_t
+{
+    int cx, cy; /* grid coordinates */
+    DARRAY(brickchunk_t, chunk);
+    unsigned last_used; /* frame number */
+};
+
+/* the brick cache */
+struct brickcache_t
+{
+    DARRAY(brickcell_t*, cell);
+    DARRAY(brick_t*, bakeable); /* auxiliary buffer */
+    DARRAY(color_t, tile); /* auxiliary buffer: the texels of a tile-index texture */
+    shader_t* tilemap_shader; /* renders tilemaps */
+    int texture_count; /* number of allocated chunk textures, except tile-index textures */
+    unsigned layout_version; /* see brickmanager_static_bricks_layout_version() */
+    unsigned frame; /* incremented on each call to brickcache_render() */
+};
+
+/* parameters */
+#define CHUNK_SIZE          512 /* width and height of a cell, in pixels */
+#define MAX_CELLS           64 /* maximum number of cached cells, including empty ones */
+#define MAX_TEXTURES        32 /* maximum number of chunk textures, unless more are visible */
+#define MAX_PREFETCHED_CELLS 1 /* maximum number of cells baked in advance per frame */
+#define MIN_TILES           4 /* minimum number of bricks of a tilemap */
+#define MAX_TILE_TEXEL      16383 /* maximum coordinate of a tile in the texture of a tileset (14 bits) */
+
+/* utilities */
+#define LOG(...)            logfile_message("Brick cache - " __VA_ARGS__)
+static brickcell_t* find_cell(const brickcache_t* cache, int cx, int cy);
+static brickcell_t* create_cell(brickcache_t* cache, int cx, int cy, struct brickmanager_t* manager);
+static brickcell_t* destroy_cell(brickcache_t* cache, brickcell_t* cell);
+static void evict_cells(brickcache_t* cache);
+static int cmp_bricks(const void* a, const void* b);
+static inline bool same_group(const brick_t* a, const brick_t* b);
+static inline int floor_div(int a, int b);
+static void find_visible_cells(v2d_t camera_position, int* left, int* top, int* right, int* bottom);
+static bool encode_tilemap(brickcache_t* cache, brickchunk_t* chunk, int first, int last);
+static color_t encode_tile(int texel_x, int texel_y, int flags);
+
+/* tilemap shader */
+static const char fs_glsl_tilemap[] = ""
+    FRAGMENT_SHADER_GLSL_PREFIX("highp")
+
+    "uniform sampler2D tex;\n" /* the tile-index texture */
+    "uniform sampler2D tileset;\n"
+    "uniform vec2 tile_texels;\n" /* size of a tile in the texture of the tileset */
+
+    "const vec3 MASK_COLOR = vec3(1.0, 0.0, 1.0);\n" /* magenta */
+
+    "void main()\n"
+    "{\n"
+        /* find the tile. Each texel of the index is stretched over a tile */
+    "   vec2 t = texcoord * vec2(textureSize(tex, 0));\n"
+    "   uvec4 e = uvec4(texelFetch(tex, ivec2(t), 0) * 255.0 + 0.5);\n"
+    "   if(e.a < 128u)\n" /* no tile */
+    "       discard;\n"
+
+        /* decode the tile. f is measured from the bottom-left, like texels */
+    "   vec2 origin = vec2(float(e.r | ((e.g & 63u) << 8u)), float(e.b | ((e.a & 63u) << 8u)));\n"
+    "   vec2 f = fract(t);\n"
+    "   if((e.g & 64u) != 0u)\n" /* horizontal flip */
+    "       f.x = 1.0 - f.x;\n"
+    "   if((e.g & 128u) != 0u)\n" /* vertical flip */
+    "       f.y = 1.0 - f.y;\n"
+
+        /* sample the tileset */
+    "   vec4 p = texture(tileset, (origin + f * tile_texels) / vec2(textureSize(tileset, 0)));\n"
+    "   p *= float(p.rgb != MASK_COLOR);\n"
+
+        /* alpha test, as in the render queue */
+    "   if(p.a == 0.0)\n"
+    "       discard;\n"
+
+    "   color = v_color * p;\n"
+    "}\n"
+"";
+
+
+
+/*
+ * public API
+ */
+
+/*
+ * brickcache_create()
+ * Creates a new brick cache
+ */
+brickcache_t* brickcache_create()
+{
+    brickcache_t* cache = mallocx(sizeof *cache);
+
+    darray_init(cache->cell);
+    darray_init(cache->bakeable);
+    darray_init(cache->tile);
+    cache->texture_count = 0;
+
+    /* the tilemap shader is shared by all brick caches */
+    if(shader_exists("brick tilemap"))
+        cache->tilemap_shader = shader_get("brick tilemap");
+    else
+        cache->tilemap_shader = shader_create("brick tilemap", fs_glsl_tilemap);
+    cache->layout_version = 0;
+    cache->frame = 0;
+
+    return cache;
+}
+
+/*
+ * brickcache_destroy()
+ * Destroys a brick cache
+ */
+brickcache_t* brickcache_destroy(brickcache_t* cache)
+{
+    brickcache_clear(cache);
+
+    darray_release(cache->tile);
+    darray_release(cache->bakeable);
+    darray_release(cache->cell);
+    free(cache);
+
+    return NULL;
+}
+
+/*
+ * brickcache_clear()
+ * Discards all chunks
+ */
+void brickcache_clear(brickcache_t* cache)
+{
+    for(int i = 0; i < darray_length(cache->cell); i++)
+        destroy_cell(cache, cache->cell[i]);
+
+    darray_clear(cache->cell);
+}
+
+/*
+ * brickcache_render()
+ * Enqueues the chunks that intersect the screen, baking them as needed.
+ * Bakeable bricks should not be enqueued individually
+ */
+void brickcache_render(brickcache_t* cache, struct brickmanager_t* manager, v2d_t camera_position)
+{
+    int left, top, right, bottom;
+    find_visible_cells(camera_position, &left, &top, &right, &bottom);
+
+    /* discard everything if static bricks have been added or removed */
+    unsigned layout_version = brickmanager_static_bricks_layout_version(manager);
+    if(layout_version != cache->layout_version) {
+        brickcache_clear(cache);
+        cache->layout_version = layout_version;
+    }
+
+    /* a new frame */
+    cache->frame++;
+
+    /* find or bake the visible cells */
+    for(int cy = top; cy <= bottom; cy++) {
+        for(int cx = left; cx <= right; cx++) {
+            brickcell_t* cell = find_cell(cache, cx, cy);
+
+            if(cell == NULL) {
+                cell = create_cell(cache, cx, cy, manager);
+                darray_push(cache->cell, cell);
+            }
+
+            cell->last_used = cache->frame;
+        }
+    }
+
+    /* evict the cells that aren't visible. We do this before enqueueing,
+       because the render queue keeps references to the chunks */
+    evict_cells(cache);
+
+    /* enqueue the chunks of the visible cells */
+    for(int i = 0; i < darray_length(cache->cell); i++) {
+        const brickcell_t* cell = cache->cell[i];
+
+        if(cell->last_used == cache->frame) {
+            for(int j = 0; j < darray_length(cell->chunk); j++)
+                renderqueue_enqueue_brick_chunk(&cell->chunk[j]);
+        }
+    }
+}
+
+/*
+ * brickcache_prefetch()
+ * Bakes in advance a few of the cells that would be visible if the camera
+ * were at the given position, typically where it's expected to be in the
+ * near future. Call it after brickcache_render()
+ */
+void brickcache_prefetch(brickcache_t* cache, struct brickmanager_t* manager, v2d_t predicted_camera_position)
+{
+    int left, top, right, bottom;
+    int baked_cells = 0;
+
+    /* the cache must be up-to-date with the layout of the static bricks */
+    if(brickmanager_static_bricks_layout_version(manager) != cache->layout_version)
+        return;
+
+    /* bake a few of the missing cells */
+    find_visible_cells(predicted_camera_position, &left, &top, &right, &bottom);
+    for(int cy = top; cy <= bottom && baked_cells < MAX_PREFETCHED_CELLS; cy++) {
+        for(int cx = left; cx <= right && baked_cells < MAX_PREFETCHED_CELLS; cx++) {
+            if(find_cell(cache, cx, cy) == NULL) {
+                brickcell_t* cell = create_cell(cache, cx, cy, manager); /* recently used */
+                darray_push(cache->cell, cell);
+                baked_cells++;
+            }
+        }
+    }
+}
+
+/*
+ * brickcache_is_bakeable()
+ * Checks if a brick is rendered by the cache
+ */
+bool brickcache_is_bakeable(const brick_t* brick)
+{
+    return brick_behavior(brick) == BRB_DEFAULT &&
+           !brick_has_movement_path(brick) &&
+           !brick_is_animated(brick) &&
+           brick_is_alive(brick);
+}
+
+
+
+/*
+ * chunks
+ */
+
+/*
+ * brickchunk_image()
+ * The baked image of a chunk
+ */
+const image_t* brickchunk_image(const brickchunk_t* chunk)
+{
+    return chunk->image;
+}
+
+/*
+ * brickchunk_render()
+ * Renders a chunk at the given position of the drawing target
+ */
+void brickchunk_render(const brickchunk_t* chunk, int x, int y)
+{
+    /* baked bricks */
+    if(chunk->tileset == NULL) {
+        image_draw(chunk->image, x, y, IF_NONE);
+        return;
+    }
+
+    /* tilemap */
+    const shader_t* prev_shader = shader_get_active();
+
+    shader_set_sampler(chunk->shader, "tileset", chunk->tileset);
+    shader_set_float_vector(chunk->shader, "tile_texels", 2, chunk->tile_texels);
+    shader_set_active(chunk->shader);
+
+    image_draw_scaled(chunk->image, x, y, v2d_new(chunk->tile_width, chunk->tile_height), IF_NONE);
+
+    shader_set_active(prev_shader);
+}
+
+/*
+ * brickchunk_position()
+ * The top-left position of a chunk in world space
+ */
+v2d_t brickchunk_position(const brickchunk_t* chunk)
+{
+    return v2d_new(chunk->x, chunk->y);
+}
+
+/*
+ * brickchunk_zindex()
+ * The zindex of the bricks baked into the chunk
+ */
+float brickchunk_zindex(const brickchunk_t* chunk)
+{
+    return chunk->zindex;
+}
+
+/*
+ * brickchunk_type()
+ * The type of the bricks baked into the chunk
+ */
+bricktype_t brickchunk_type(const brickchunk_t* chunk)
+{
+    return chunk->type;
+}
+
+/*
+ * brickchunk_layer()
+ * The layer of the bricks baked into the chunk
+ */
+bricklayer_t brickchunk_layer(const brickchunk_t* chunk)
+{
+    return chunk->layer;
+}
+
+
+
+/*
+ * private
+ */
+
+/* finds a cached cell */
+brickcell_t* find_cell(const brickcache_t* cache, int cx, int cy)
+{
+    for(int i = 0; i < darray_length(cache->cell); i++) {
+        if(cache->cell[i]->cx == cx && cache->cell[i]->cy == cy)
+            return cache->cell[i];
+    }
+
+    return NULL;
+}
+
+/* creates a new cell, baking its chunks */
+brickcell_t* create_cell(brickcache_t* cache, int cx, int cy, struct brickmanager_t* manager)
+{
+    brickcell_t* cell = mallocx(sizeof *cell);
+    rect_t rect = { .x = cx * CHUNK_SIZE, .y = cy * CHUNK_SIZE, .width = CHUNK_SIZE, .height = CHUNK_SIZE };
+    int brick_count = 0;
+
+    cell->cx = cx;
+    cell->cy = cy;
+    cell->last_used = cache->frame;
+    darray_init(cell->chunk);
+
+    /* collect the bakeable bricks that intersect the cell */
+    brick_t* const* brick = brickmanager_retrieve_static_bricks_in_rect_span(manager, rect, &brick_count);
+    darray_clear(cache->bakeable);
+    for(int i = 0; i < brick_count; i++) {
+        if(brickcache_is_bakeable(brick[i]) && brick_image(brick[i]) != NULL)
+            darray_push(cache->bakeable, brick[i]);
+    }
+
+    /* nothing to bake */
+    int n = darray_length(cache->bakeable);
+    if(n == 0)
+        return cell;
+
+    /* group the bricks and sort them in rendering order (stable sorting) */
+    merge_sort(cache->bakeable, n, sizeof(*(cache->bakeable)), cmp_bricks);
+
+    /* bake one chunk per group */
+    image_t* prev_target = image_drawing_target();
+    const shader_t* prev_shader = shader_get_active();
+    for(int first = 0, last = 0; first < n; first = last) {
+        const brick_t* b = cache->bakeable[first];
+        brickchunk_t chunk = {
+            .image = NULL,
+            .x = rect.x,
+            .y = rect.y,
+            .tileset = NULL,
+            .shader = NULL,
+            .zindex = brick_zindex(b),
+            .type = brick_type(b),
+            .layer = brick_layer(b)
+        };
+
+        /* find the end of the group */
+        for(last = first + 1; last < n && same_group(b, cache->bakeable[last]); last++);
+
+        /* encode the group as a tilemap if possible */
+        if(encode_tilemap(cache, &chunk, first, last)) {
+            darray_push(cell->chunk, chunk);
+            continue;
+        }
+
+        /* can't create the texture */
+        if(NULL == (chunk.image = image_create(CHUNK_SIZE, CHUNK_SIZE))) {
+            LOG("can't bake cell (%d,%d)", cx, cy);
+            continue;
+        }
+
+        /* the default shader converts the mask color to transparency */
+        image_set_drawing_target(chunk.image);
+        shader_set_active(shader_get_default());
+        image_clear(color_rgba(0, 0, 0, 0));
+
+        /* render the bricks */
+        for(int i = first; i < last; i++) {
+            const brick_t* brk = cache->bakeable[i];
+            v2d_t position = brick_position(brk);
+
+            image_draw(
+                brick_image(brk),
+                (int)position.x - rect.x,
+                (int)position.y - rect.y,
+                brick_image_flags(brick_flip(brk))
+            );
+        }
+
+        /* store the chunk */
+        darray_push(cell->chunk, chunk);
+        cache->texture_count++;
+    }
+    image_set_drawing_target(prev_target);
+    shader_set_active(prev_shader);
+
+    /* done */
+    return cell;
+}
+
+/* destroys a cell and its chunks */
+brickcell_t* destroy_cell(brickcache_t* cache, brickcell_t* cell)
+{
+    for(int j = 0; j < darray_length(cell->chunk); j++) {
+        if(cell->chunk[j].tileset == NULL)
+            cache->texture_count--;
+
+        image_destroy(cell->chunk[j].image);
+    }
+
+    darray_release(cell->chunk);
+    free(cell);
+
+    return NULL;
+}
+
+/* evicts the least recently used cells that aren't visible in the current frame */
+void evict_cells(brickcache_t* cache)
+{
+    while(darray_length(cache->cell) > MAX_CELLS || cache->texture_count > MAX_TEXTURES) {
+        int lru = -1;
+
+        /* find the least recently used cell */
+        for(int i = 0; i < darray_length(cache->cell); i++) {
+            const brickcell_t* cell = cache->cell[i];
+
+            if(cell->last_used != cache->frame) {
+                if(lru < 0 || cell->last_used < cache->cell[lru]->last_used)
+                    lru = i;
+            }
+        }
+
+        /* all cells are visible */
+        if(lru < 0)
+            break;
+
+        /* evict it */
+        destroy_cell(cache, cache->cell[lru]);
+        darray_remove_unordered(cache->cell, lru); /* the order of the cells is irrelevant */
+    }
+}
+
+/* sort bricks by group and then by ypos, matching the render queue */
+int cmp_bricks(const void* a, const void* b)
+{
+    const brick_t* p = *((const brick_t**)a);
+    const brick_t* q = *((const brick_t**)b);
+    float zp = brick_zindex(p), zq = brick_zindex(q);
+
+    if(zp != zq)
+        return (zp > zq) - (zp < zq);
+    else if(brick_type(p) != brick_type(q))
+        return (int)brick_type(p) - (int)brick_type(q);
+    else if(brick_layer(p) != brick_layer(q))
+        return (int)brick_layer(p) - (int)brick_layer(q);
+    else
+        return (int)brick_position(p).y - (int)brick_position(q).y;
+}
+
+/* checks if two bricks belong to the same chunk of a cell */
+bool same_group(const brick_t* a, const brick_t* b)
+{
+    return brick_zindex(a) == brick_zindex(b) &&
+           brick_type(a) == brick_type(b) &&
+           brick_layer(a) == brick_layer(b);
+}
+
+/* encodes a group of bricks, cache->bakeable[first..last-1], as a tilemap.
+   Returns false if the bricks don't qualify */
+bool encode_tilemap(brickcache_t* cache, brickchunk_t* chunk, int first, int last)
+{
+    const image_t* tileset = brick_image(cache->bakeable[first]);
+    v2d_t tile_size = brick_size(cache->bakeable[first]);
+    int tile_width = tile_size.x, tile_height = tile_size.y;
+    int texel_x, texel_y, texel_width, texel_height;
+
+    /* not worth it */
+    if(last - first < MIN_TILES)
+        return false;
+
+    /* the tiles must fit the chunk exactly */
+    if(tile_width <= 0 || tile_height <= 0 || CHUNK_SIZE % tile_width != 0 || CHUNK_SIZE % tile_height != 0)
+        return false;
+
+    int columns = CHUNK_SIZE / tile_width;
+    int rows = CHUNK_SIZE / tile_height;
+    texturehandle_t texture = image_texture(tileset);
+    image_texture_region(tileset, &texel_x, &texel_y, &texel_width, &texel_height);
+
+    /* clear the index */
+    darray_resize(cache->tile, columns * rows);
+    for(int k = 0; k < columns * rows; k++)
+        cache->tile[k] = color_rgba(0, 0, 0, 0);
+
+    /* place the tiles. Bricks are aligned to the grid of the world, so
+       they don't cross the boundaries of the chunk */
+    for(int i = first; i < last; i++) {
+        const brick_t* brick = cache->bakeable[i];
+        const image_t* image = brick_image(brick);
+        v2d_t size = brick_size(brick);
+        v2d_t position = brick_position(brick);
+        int x = (int)position.x - chunk->x;
+        int y = (int)position.y - chunk->y;
+        int w, h;
+
+        /* same size, aligned to the grid */
+        if((int)size.x != tile_width || (int)size.y != tile_height)
+            return false;
+        else if(x < 0 || y < 0 || x % tile_width != 0 || y % tile_height != 0)
+            return false;
+
+        /* same texture, same scale */
+        image_texture_region(image, &texel_x, &texel_y, &w, &h);
+        if(image_texture(image) != texture || w != texel_width || h != texel_height)
+            return false;
+        else if(texel_x > MAX_TILE_TEXEL || texel_y > MAX_TILE_TEXEL)
+            return false;
+
+        /* no overlaps */
+        int k = (y / tile_height) * columns + (x / tile_width);
+        if(!color_equals(cache->tile[k], color_rgba(0, 0, 0, 0)))
+            return false;
+
+        cache->tile[k] = encode_tile(texel_x, texel_y, brick_image_flags(brick_flip(brick)));
+    }
+
+    /* create the tile-index texture */
+    image_t* index = image_create(columns, rows);
+    if(index == NULL)
+        return false;
+
+    image_t* prev_target = image_drawing_target();
+    image_set_drawing_target(index);
+    image_lock(index, "w");
+
+    for(int row = 0; row < rows; row++) {
+        for(int col = 0; col < columns; col++)
+            image_putpixel(col, row, cache->tile[row * columns + col]);
+    }
+
+    image_unlock(index);
+    image_set_drawing_target(prev_target);
+
+    /* done */
+    chunk->image = index;
+    chunk->tileset = tileset;
+    chunk->shader = cache->tilemap_shader;
+    chunk->tile_width = tile_width;
+    chunk->tile_height = tile_height;
+    chunk->tile_texels[0] = texel_width;
+    chunk->tile_texels[1] = texel_height;
+    return true;
+}
+
+/* encodes a texel of a tile-index texture: R = x (low byte), G = x (high 6 bits),
+   horizontal flip, vertical flip; B = y (low byte), A = y (high 6 bits), presence */
+color_t encode_tile(int texel_x, int texel_y, int flags)
+{
+    return color_rgba(
+        texel_x & 0xFF,
+        ((texel_x >> 8) & 0x3F) | ((flags & IF_HFLIP) ? 0x40 : 0) | ((flags & IF_VFLIP) ? 0x80 : 0),
+        texel_y & 0xFF,
+        ((texel_y >> 8) & 0x3F) | 0x80
+    );
+}
+
+/* finds the cells that intersect the screen, given the position of the camera */
+void find_visible_cells(v2d_t camera_position, int* left, int* top, int* right, int* bottom)
+{
+    v2d_t screen_size = video_get_screen_size();
+    v2d_t topleft = v2d_subtract(camera_position, v2d_multiply(screen_size, 0.5f));
+
+    *left = floor_div((int)topleft.x, CHUNK_SIZE);
+    *top = floor_div((int)topleft.y, CHUNK_SIZE);
+    *right = floor_div((int)topleft.x + (int)screen_size.x - 1, CHUNK_SIZE);
+    *bottom = floor_div((int)topleft.y + (int)screen_size.y - 1, CHUNK_SIZE);
+}
+
+/* integer division rounding towards negative infinity */
+int floor_div(int a, int b)
+{
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
@@ -0,0 +1,50 @@
+/*
+ * Open Surge Engine
+ * brickcache.h - static bricks baked into chunk textures
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BRICKCACHE_H
+#define _BRICKCACHE_H
+
+#include <stdbool.h>
+#include "brick.h"
+#include "../util/v2d.h"
+
+/* forward declarations */
+typedef struct brickcache_t brickcache_t;
+typedef struct brickchunk_t brickchunk_t;
+struct brickmanager_t;
+struct image_t;
+
+/* public API */
+brickcache_t* brickcache_create();
+brickcache_t* brickcache_destroy(brickcache_t* cache);
+void brickcache_clear(brickcache_t* cache); /* discard all chunks */
+void brickcache_render(brickcache_t* cache, struct brickmanager_t* manager, v2d_t camera_position); /* enqueue the visible chunks, baking them as needed */
+void brickcache_prefetch(brickcache_t* cache, struct brickmanager_t* manager, v2d_t predicted_camera_position); /* bake a few chunks that will soon be visible; call after brickcache_render() */
+bool brickcache_is_bakeable(const brick_t* brick); /* bakeable bricks are rendered by the cache */
+
+/* chunks */
+void brickchunk_render(const brickchunk_t* chunk, int x, int y); /* render at a position of the drawing target */
+const struct image_t* brickchunk_image(const brickchunk_t* chunk); /* the baked image or the tile-index texture of a tilemap */
+v2d_t brickchunk_position(const brickchunk_t* chunk); /* top-left position in world space */
+float brickchunk_zindex(const brickchunk_t* chunk); /* the zindex of the baked bricks */
+bricktype_t brickchunk_type(const brickchunk_t* chunk); /* the type of the baked bricks */
+bricklayer_t brickchunk_layer(const brickchunk_t* chunk); /* the layer of the baked bricks */
+
+#endif
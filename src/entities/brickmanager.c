@@ -25,6 +25,7 @@
 #include "../util/util.h"
 #include "../util/darray.h"
 #include "../util/iterator.h"
+#include "../util/arena.h"
 #include "../scripting/scripting.h"
 
 #define FASTHASH_INLINE
@@ -34,6 +35,7 @@ typedef struct brickrect_t brickrect_t;
 typedef struct heightsampler_t heightsampler_t;
 typedef struct brickbucket_t brickbucket_t;
 typedef struct brickiteratorstate_t brickiteratorstate_t;
+typedef struct brickkey_t brickkey_t;
 
 /* A rectangle in world space */
 struct brickrect_t
@@ -54,6 +56,11 @@ struct heightsampler_t
     /* smooth_height_at[j] = smooth_height_at[j-1] if j >= 1 and height_at[j] == 0 (no sampling data)
                              height_at[j]          otherwise */
     DARRAY(int, smooth_height_at);
+
+    /* a segment tree for range-max queries of smooth_height_at[]:
+       tree[1] is the root and tree[leaf_count + j] = smooth_height_at[j] */
+    DARRAY(int, tree);
+    int leaf_count; /* a power of two >= darray_length(smooth_height_at) */
 };
 
 /* A bucket of bricks */
@@ -62,6 +69,10 @@ struct brickbucket_t
     /* a vector of bricks */
     DARRAY(brick_t*, brick);
 
+    /* bounds[i] is the bounding box of brick[i] at its spawn point.
+       These are stored contiguously for cache-friendly ROI tests */
+    DARRAY(brickrect_t, bounds);
+
     /* a destructor of individual bricks */
     brick_t* (*brick_dtor)(brick_t*);
 };
@@ -81,8 +92,35 @@ struct brickmanager_t
     /* references to all allocated buckets (for quick access) */
     DARRAY(const brickbucket_t*, bucket_ref);
 
-    /* current region of interest */
-    brickrect_t roi;
+    /* current regions of interest (there is at least one). Separate ROIs,
+       e.g., one per camera, are cheaper than a large ROI enclosing them */
+    brickrect_t roi[BRICKMANAGER_MAX_ROIS];
+    int roi_count;
+
+    /* cells of the spatial hash that intersect each ROI, in grid coordinates */
+    brickrect_t roi_cells[BRICKMANAGER_MAX_ROIS];
+
+    /* references to all allocated buckets that correspond to roi_cells
+       (possibly empty), without repetition. This is updated only when
+       roi_cells changes */
+    DARRAY(const brickbucket_t*, roi_bucket);
+
+    /* a buffer used by span-style retrieval */
+    DARRAY(brick_t*, span);
+
+    /* we wash the buckets only if there are dead bricks */
+    int dead_brick_count; /* an estimate of the number of dead bricks in the buckets */
+    unsigned death_count; /* last known value of brick_death_count() */
+
+    /* incremented whenever the static bricks of roi_bucket may have changed */
+    unsigned static_version;
+
+    /* incremented whenever static bricks are added or removed, regardless of the ROI */
+    unsigned layout_version;
+
+    /* size of the largest static brick, used to query arbitrary rectangles */
+    int max_static_brick_width;
+    int max_static_brick_height;
 
     /* how many bricks are there? */
     int brick_count;
@@ -111,6 +149,14 @@ struct brickiteratorstate_t
     brickbucket_t* own_bucket;
 };
 
+/* A brick paired with the key of its cell, used in bulk insertion */
+struct brickkey_t
+{
+    uint64_t key;
+    brick_t* brick;
+    int index; /* makes sorting stable */
+};
+
 /* Utilities */
 #define GRID_SIZE 256 /* width and height of a cell of the spatial hash; this impacts the number of fasthash queries per frame (quadratically), as well as the number of returned bricks */
 #define SAMPLER_WIDTH 128 /* width of the fixed-size intervals of the height sampler */
@@ -118,12 +164,21 @@ struct brickiteratorstate_t
 
 static inline uint64_t position_to_hash(int x, int y);
 static inline uint64_t brick2hash(const brick_t* brick);
+static inline brickrect_t roi_to_cells(const brickrect_t* roi);
+static inline bool is_cell_inside(int cell_x, int cell_y, const brickrect_t* cells);
+static void update_roi_buckets(brickmanager_t* manager, bool force);
+static bool is_cell_inside_rois(const brickmanager_t* manager, int cell_x, int cell_y, int roi_count);
+static brickrect_t clip_roi(const brickmanager_t* manager, rect_t roi);
 
 static brickbucket_t* bucket_ctor(brick_t* (*brick_dtor)(brick_t*));
 static brickbucket_t* bucket_dtor(brickbucket_t* bucket);
 static void bucket_dtor_adapter(void* bucket);
 static inline void bucket_add(brickbucket_t* bucket, brick_t* brick);
+static void bucket_reserve(brickbucket_t* bucket, int additional_bricks);
+static brickbucket_t* get_or_create_bucket(brickmanager_t* manager, uint64_t key);
+static int brickkey_cmp(const void* a, const void* b);
 static int bucket_wash(brickbucket_t* bucket);
+static int bucket_remove_in_rect(brickbucket_t* bucket, const rect_t* rect, void (*callback)(const brick_t*,void*), void* data);
 static void bucket_clear(brickbucket_t* bucket);
 static inline bool bucket_is_empty(const brickbucket_t* bucket);
 
@@ -139,6 +194,8 @@ static int sampler_query(heightsampler_t* sampler, int left, int right);
 static void sampler_add(heightsampler_t* sampler, v2d_t topleft_position, v2d_t size);
 static void sampler_add_brick(heightsampler_t* sampler, const brick_t* brick);
 static void sampler_add_bricklike_object(heightsampler_t* sampler, const surgescript_object_t* bricklike_object);
+static void sampler_rebuild_tree(heightsampler_t* sampler);
+static void sampler_update_tree(heightsampler_t* sampler, int first, int last);
 
 static void update_world_size(brickmanager_t* manager, v2d_t topleft_position, v2d_t size);
 static void update_world_size_with_brick(brickmanager_t* manager, const brick_t* brick);
@@ -148,12 +205,16 @@ static void acknowledge_bricklike_objects(brickmanager_t* manager);
 static void acknowledge_bricklike_object(brickmanager_t* manager, const surgescript_object_t* bricklike_object);
 
 static bool is_brick_inside_roi(const brick_t* brick, const brickrect_t* roi);
-static void filter_bricks_inside_roi(brickbucket_t* out_bucket, const brickbucket_t* in_bucket, const brickrect_t* roi);
+static inline bool is_rect_inside_roi(const brickrect_t* rect, const brickrect_t* roi);
+static inline brickrect_t brick_bounds(const brick_t* brick);
+static bool is_brick_inside_rois(const brickmanager_t* manager, const brick_t* brick);
+static bool is_rect_inside_rois(const brickmanager_t* manager, const brickrect_t* rect);
+static void filter_bricks_inside_rois(brickbucket_t* out_bucket, const brickbucket_t* in_bucket, const brickmanager_t* manager);
 static void filter_non_default_bricks(brickbucket_t* out_bucket, const brickbucket_t* in_bucket);
 
 static brick_t* brick_fake_destroy(brick_t* brick);
 
-static brick_list_t* add_to_list(brick_list_t* list, brick_t* brick);
+static brick_list_t* add_to_list(brick_list_t* list, brick_t* brick, arena_t* arena);
 static brick_list_t* release_list(brick_list_t* list);
 
 
@@ -179,11 +240,25 @@ brickmanager_t* brickmanager_create()
     darray_push(manager->bucket_ref, manager->awake_bucket);
     manager->sampler = sampler_ctor();
 
-    manager->roi = (brickrect_t){ 0, 0, 0, 0 };
+    for(int r = 0; r < BRICKMANAGER_MAX_ROIS; r++)
+        manager->roi[r] = manager->roi_cells[r] = (brickrect_t){ 0, 0, 0, 0 };
+    manager->roi_count = 1;
     manager->brick_count = 0;
     manager->world_width = 1;
     manager->world_height = 1;
 
+    manager->dead_brick_count = 0;
+    manager->death_count = brick_death_count();
+    manager->static_version = 0;
+    manager->layout_version = 0;
+    manager->max_static_brick_width = 0;
+    manager->max_static_brick_height = 0;
+
+    darray_init(manager->roi_bucket);
+    update_roi_buckets(manager, true);
+
+    darray_init(manager->span);
+
     return manager;
 }
 
@@ -194,6 +269,8 @@ brickmanager_t* brickmanager_create()
 brickmanager_t* brickmanager_destroy(brickmanager_t* manager)
 {
     sampler_dtor(manager->sampler);
+    darray_release(manager->span); /* a vector of references only */
+    darray_release(manager->roi_bucket); /* a vector of references only */
     darray_release(manager->bucket_ref); /* a vector of references only */
     bucket_dtor(manager->awake_bucket);
     fasthash_destroy(manager->hashtable);
@@ -216,14 +293,16 @@ void brickmanager_add_brick(brickmanager_t* manager, struct brick_t* brick)
 
         /* find the appropriate bucket for the brick */
         uint64_t key = brick2hash(brick);
-        bucket = fasthash_get(manager->hashtable, key);
+        bucket = get_or_create_bucket(manager, key);
 
-        /* lazily allocate a new bucket if one doesn't exist */
-        if(bucket == NULL) {
-            bucket = bucket_ctor(brick_destroy);
-            fasthash_put(manager->hashtable, key, bucket);
-            darray_push(manager->bucket_ref, bucket);
-        }
+        /* keep track of the size of the largest static brick */
+        v2d_t size = brick_size(brick);
+        manager->max_static_brick_width = max(manager->max_static_brick_width, (int)size.x);
+        manager->max_static_brick_height = max(manager->max_static_brick_height, (int)size.y);
+
+        /* the static bricks may have changed */
+        manager->static_version++;
+        manager->layout_version++;
 
     }
     else {
@@ -246,6 +325,72 @@ void brickmanager_add_brick(brickmanager_t* manager, struct brick_t* brick)
     sampler_add_brick(manager->sampler, brick);
 }
 
+/*
+ * brickmanager_add_bricks()
+ * Adds existing bricks to the Brick Manager in bulk. This is
+ * faster than calling brickmanager_add_brick() for each brick
+ */
+void brickmanager_add_bricks(brickmanager_t* manager, struct brick_t** bricks, int brick_count)
+{
+    brickkey_t* keys;
+    int key_count = 0;
+
+    if(brick_count <= 0)
+        return;
+
+    /* counting pass: compute the cell of each static brick */
+    keys = mallocx(brick_count * sizeof *keys);
+    for(int i = 0; i < brick_count; i++) {
+        brick_t* brick = bricks[i];
+
+        if(!brick_has_movement_path(brick)) {
+            keys[key_count].key = brick2hash(brick);
+            keys[key_count].brick = brick;
+            keys[key_count].index = key_count;
+            key_count++;
+
+            /* keep track of the size of the largest static brick */
+            v2d_t size = brick_size(brick);
+            manager->max_static_brick_width = max(manager->max_static_brick_width, (int)size.x);
+            manager->max_static_brick_height = max(manager->max_static_brick_height, (int)size.y);
+        }
+        else {
+            /* we add moving bricks to the awake bucket */
+            bucket_add(manager->awake_bucket, brick);
+        }
+
+        /* update the size of the world and the height sampler */
+        update_world_size_with_brick(manager, brick);
+        sampler_add_brick(manager->sampler, brick);
+    }
+
+    /* group the static bricks by cell, preserving their order */
+    qsort(keys, key_count, sizeof *keys, brickkey_cmp);
+
+    /* fill the buckets: a single lookup per cell */
+    for(int i = 0, j; i < key_count; i = j) {
+        uint64_t key = keys[i].key;
+        for(j = i + 1; j < key_count && keys[j].key == key; j++);
+
+        brickbucket_t* bucket = get_or_create_bucket(manager, key);
+        bucket_reserve(bucket, j - i);
+        for(int k = i; k < j; k++)
+            bucket_add(bucket, keys[k].brick);
+    }
+
+    /* the static bricks may have changed */
+    if(key_count > 0) {
+        manager->static_version++;
+        manager->layout_version++;
+    }
+
+    /* increment the brick count */
+    manager->brick_count += brick_count;
+
+    /* done */
+    free(keys);
+}
+
 /*
  * brickmanager_remove_all_bricks()
  * Removes all bricks
@@ -264,42 +409,100 @@ void brickmanager_remove_all_bricks(brickmanager_t* manager)
     manager->world_width = 1;
     manager->world_height = 1;
 
+    /* all dead bricks have been released */
+    manager->dead_brick_count = 0;
+    manager->death_count = brick_death_count();
+    manager->static_version++;
+    manager->layout_version++;
+    manager->max_static_brick_width = 0;
+    manager->max_static_brick_height = 0;
+
     /* acknowledge brick-like objects */
     /*acknowledge_bricklike_objects(manager);*/
 }
 
 /*
- * brickmanager_update()
- * Updates the Brick Manager
+ * brickmanager_remove_bricks_in_rect()
+ * Removes the bricks whose spawn point is inside a rectangle in world space.
+ * If callback isn't NULL, it's called for each removed brick that is still
+ * alive, before it's destroyed. The world size and the height sampler are
+ * kept as they are
  */
-void brickmanager_update(brickmanager_t* manager)
+void brickmanager_remove_bricks_in_rect(brickmanager_t* manager, rect_t rect, void (*callback)(const struct brick_t*,void*), void* data)
 {
-    /* remove dead bricks inside (any bucket that intersects with) the ROI */
-    int cnt = 0; /* we'll count the number of removed bricks */
-    int left = manager->roi.left;
-    int top = manager->roi.top;
-    int right = manager->roi.right;
-    int bottom = manager->roi.bottom;
+    int count = 0;
+
+    if(rect.width <= 0 || rect.height <= 0)
+        return;
 
-    right += GRID_SIZE - 1;
-    bottom += GRID_SIZE - 1;
+    /* static bricks are hashed by their center, which is to the
+       bottom-right of their spawn point, at most half a brick away */
+    int left = max(0, rect.x) / GRID_SIZE;
+    int top = max(0, rect.y) / GRID_SIZE;
+    int right = max(0, rect.x + rect.width - 1 + manager->max_static_brick_width) / GRID_SIZE;
+    int bottom = max(0, rect.y + rect.height - 1 + manager->max_static_brick_height) / GRID_SIZE;
 
-    for(int y = top; y <= bottom; y += GRID_SIZE) {
-        for(int x = left; x <= right; x += GRID_SIZE) {
-            uint64_t key = position_to_hash(x, y);
+    for(int y = top; y <= bottom; y++) {
+        for(int x = left; x <= right; x++) {
+            uint64_t key = (((uint64_t)x) << 32) | ((uint64_t)y);
             brickbucket_t* bucket = fasthash_get(manager->hashtable, key);
 
-            /* wash the bucket if it exists */
             if(bucket != NULL)
-                cnt += bucket_wash(bucket);
+                count += bucket_remove_in_rect(bucket, &rect, callback, data);
         }
     }
 
-    /* remove dead bricks stored in the awake bucket */
-    cnt += bucket_wash(manager->awake_bucket);
+    /* moving bricks are stored in the awake bucket */
+    count += bucket_remove_in_rect(manager->awake_bucket, &rect, callback, data);
 
     /* update the brick count */
-    manager->brick_count -= cnt;
+    manager->brick_count -= count;
+
+    /* the static bricks may have changed */
+    if(count > 0) {
+        manager->static_version++;
+        manager->layout_version++;
+    }
+}
+
+/*
+ * brickmanager_update()
+ * Updates the Brick Manager
+ */
+void brickmanager_update(brickmanager_t* manager)
+{
+    /* animate the bricks of the brickset. Individual bricks will read the shared images */
+    brickset_animate();
+
+    /* have any bricks been killed since the last update? */
+    unsigned death_count = brick_death_count();
+    manager->dead_brick_count += (int)(death_count - manager->death_count);
+    manager->death_count = death_count;
+
+    /* remove dead bricks inside (any bucket that intersects with) the ROI.
+       There is nothing to do if there are no dead bricks */
+    if(manager->dead_brick_count > 0) {
+        int cnt = 0; /* we'll count the number of removed bricks */
+
+        /* wash the buckets of the ROI */
+        for(int i = 0; i < darray_length(manager->roi_bucket); i++)
+            cnt += bucket_wash((brickbucket_t*)manager->roi_bucket[i]);
+
+        /* remove dead bricks stored in the awake bucket */
+        cnt += bucket_wash(manager->awake_bucket);
+
+        /* update the brick count */
+        manager->brick_count -= cnt;
+
+        /* dead bricks that are outside the ROI will be removed later */
+        manager->dead_brick_count = max(0, manager->dead_brick_count - cnt);
+
+        /* the static bricks may have changed */
+        if(cnt > 0) {
+            manager->static_version++;
+            manager->layout_version++;
+        }
+    }
 
     /* we don't update the sampler nor the world size with the bricks: why bother?
        it doesn't matter much, since dead bricks are very few with special behavior
@@ -382,6 +585,21 @@ void brickmanager_recalculate_world_size(brickmanager_t* manager)
     acknowledge_bricklike_objects(manager);
 }
 
+/*
+ * brickmanager_extend_world_size()
+ * Accounts for an area of the world that holds bricks that aren't stored in
+ * the Brick Manager, e.g., bricks of a level that is streamed. The world size
+ * and the height sampler take the area into account until they're recalculated
+ */
+void brickmanager_extend_world_size(brickmanager_t* manager, rect_t area)
+{
+    v2d_t topleft = v2d_new(area.x, area.y);
+    v2d_t size = v2d_new(area.width, area.height);
+
+    update_world_size(manager, topleft, size);
+    sampler_add(manager->sampler, topleft, size);
+}
+
 /*
  * brickmanager_set_roi()
  * Sets the current Region Of Interest (ROI) in world space.
@@ -389,52 +607,31 @@ void brickmanager_recalculate_world_size(brickmanager_t* manager)
  */
 void brickmanager_set_roi(brickmanager_t* manager, rect_t roi)
 {
-    int x = roi.x;
-    int y = roi.y;
-    int width = roi.width;
-    int height = roi.height;
-    int world_width = manager->world_width;
-    int world_height = manager->world_height;
-
-    /*
-    
-    clip values:
-
-    0 <= x <= world_width - 1
-    0 <= y <= world_height - 1
-    1 <= width <= world_width - x
-    1 <= height <= world_height - y
-
-    a unrealistically large ROI could cause unnecessary slowdowns,
-    so we clip it.
-    
-    */
-
-    if(x < 0)
-        x = 0;
-    if(x > world_width - 1)
-        x = world_width - 1;
-
-    if(y < 0)
-        y = 0;
-    if(y > world_height - 1)
-        y = world_height - 1;
+    brickmanager_set_rois(manager, &roi, 1);
+}
 
-    if(width < 1)
-        width = 1;
-    if(x + width > world_width)
-        width = world_width - x;
+/*
+ * brickmanager_set_rois()
+ * Sets multiple Regions Of Interest (ROIs) in world space, e.g., one per
+ * camera. Bricks are retrieved if they are inside any of the ROIs, and
+ * bricks of overlapping ROIs are retrieved only once. Up to
+ * BRICKMANAGER_MAX_ROIS ROIs are considered. Coordinates are inclusive.
+ */
+void brickmanager_set_rois(brickmanager_t* manager, const rect_t* roi, int roi_count)
+{
+    roi_count = clip(roi_count, 1, BRICKMANAGER_MAX_ROIS);
 
-    if(height < 1)
-        height = 1;
-    if(y + height > world_height)
-        height = world_height - y;
+    /* update the ROIs */
+    for(int r = 0; r < roi_count; r++)
+        manager->roi[r] = clip_roi(manager, roi[r]);
 
-    /* update the ROI */
-    manager->roi.left = x;
-    manager->roi.top = y;
-    manager->roi.right = x + width - 1;
-    manager->roi.bottom = y + height - 1;
+    /* update the buckets of the ROIs only if we've moved to different cells */
+    if(roi_count != manager->roi_count) {
+        manager->roi_count = roi_count;
+        update_roi_buckets(manager, true);
+    }
+    else
+        update_roi_buckets(manager, false);
 }
 
 /*
@@ -448,31 +645,17 @@ iterator_t* brickmanager_retrieve_active_bricks(const brickmanager_t* manager)
     state.own_bucket = bucket_ctor(brick_fake_destroy); /* a bucket of references only */
     darray_init(state.bucket);
 
-    /* get the ROI */
-    const brickrect_t* roi = &(manager->roi);
-
     /* for each bucket inside the ROI */
-    int left = roi->left;
-    int top = roi->top;
-    int right = roi->right;
-    int bottom = roi->bottom;
+    for(int i = 0; i < darray_length(manager->roi_bucket); i++) {
+        const brickbucket_t* bucket = manager->roi_bucket[i];
 
-    right += GRID_SIZE - 1;
-    bottom += GRID_SIZE - 1;
-
-    for(int y = top; y <= bottom; y += GRID_SIZE) {
-        for(int x = left; x <= right; x += GRID_SIZE) {
-            uint64_t key = position_to_hash(x, y);
-            const brickbucket_t* bucket = fasthash_get(manager->hashtable, key);
-
-            /* add the bucket if it exists and if it's not empty */
-            if(bucket != NULL && !bucket_is_empty(bucket))
-                darray_push(state.bucket, bucket);
-        }
+        /* add the bucket if it's not empty */
+        if(!bucket_is_empty(bucket))
+            darray_push(state.bucket, bucket);
     }
 
     /* individually filter the awake bricks inside the ROI */
-    filter_bricks_inside_roi(state.own_bucket, manager->awake_bucket, roi);
+    filter_bricks_inside_rois(state.own_bucket, manager->awake_bucket, manager);
     if(!bucket_is_empty(state.own_bucket))
         darray_push(state.bucket, state.own_bucket);
 
@@ -486,6 +669,260 @@ iterator_t* brickmanager_retrieve_active_bricks(const brickmanager_t* manager)
     );
 }
 
+/*
+ * brickmanager_retrieve_active_bricks_span()
+ * Retrieves the bricks inside the current Region Of Interest (ROI) as an
+ * array of brick_count elements, without creating an iterator. Unlike
+ * brickmanager_retrieve_active_bricks(), each brick is tested against the
+ * ROI. The array is owned by the manager and is valid until the next
+ * span-style retrieval
+ */
+brick_t* const* brickmanager_retrieve_active_bricks_span(brickmanager_t* manager, int* brick_count)
+{
+    /* reuse the buffer */
+    darray_clear(manager->span);
+
+    /* filter the static bricks of the buckets inside the ROI */
+    for(int b = 0; b < darray_length(manager->roi_bucket); b++) {
+        const brickbucket_t* bucket = manager->roi_bucket[b];
+        int n = darray_length(bucket->brick);
+
+        for(int i = 0; i < n; i++) {
+            if(is_rect_inside_rois(manager, &bucket->bounds[i]))
+                darray_push(manager->span, bucket->brick[i]);
+        }
+    }
+
+    /* filter the awake bricks, which may have moved since they were added */
+    for(int i = 0; i < darray_length(manager->awake_bucket->brick); i++) {
+        brick_t* brick = manager->awake_bucket->brick[i];
+
+        if(is_brick_inside_rois(manager, brick))
+            darray_push(manager->span, brick);
+    }
+
+    /* done */
+    *brick_count = darray_length(manager->span);
+    return manager->span;
+}
+
+/*
+ * brickmanager_retrieve_active_moving_bricks_span()
+ * Retrieves the moving bricks inside the current Region Of Interest (ROI)
+ * as an array of brick_count elements, without creating an iterator. Bricks
+ * with non-default behavior are considered to be "moving". The array is owned
+ * by the manager and is valid until the next span-style retrieval
+ */
+brick_t* const* brickmanager_retrieve_active_moving_bricks_span(brickmanager_t* manager, int* brick_count)
+{
+    /* reuse the buffer */
+    darray_clear(manager->span);
+
+    /* filter the bricks with non-default behavior of the buckets inside the ROI */
+    for(int b = 0; b < darray_length(manager->roi_bucket); b++) {
+        const brickbucket_t* bucket = manager->roi_bucket[b];
+        int n = darray_length(bucket->brick);
+
+        for(int i = 0; i < n; i++) {
+            if(is_rect_inside_rois(manager, &bucket->bounds[i]) && brick_behavior(bucket->brick[i]) != BRB_DEFAULT)
+                darray_push(manager->span, bucket->brick[i]);
+        }
+    }
+
+    /* filter the awake bricks */
+    for(int i = 0; i < darray_length(manager->awake_bucket->brick); i++) {
+        brick_t* brick = manager->awake_bucket->brick[i];
+
+        if(is_brick_inside_rois(manager, brick))
+            darray_push(manager->span, brick);
+    }
+
+    /* done */
+    *brick_count = darray_length(manager->span);
+    return manager->span;
+}
+
+/*
+ * brickmanager_retrieve_static_bricks_span()
+ * Retrieves the static bricks of the cells of the spatial hash that intersect
+ * the current Region Of Interest (ROI), without testing them individually.
+ * This set changes rarely (see brickmanager_static_bricks_version()). The
+ * array is owned by the manager and is valid until the next span-style retrieval
+ */
+brick_t* const* brickmanager_retrieve_static_bricks_span(brickmanager_t* manager, int* brick_count)
+{
+    /* reuse the buffer */
+    darray_clear(manager->span);
+
+    /* add the bricks of the buckets of the ROI */
+    for(int b = 0; b < darray_length(manager->roi_bucket); b++) {
+        const brickbucket_t* bucket = manager->roi_bucket[b];
+
+        for(int i = 0; i < darray_length(bucket->brick); i++)
+            darray_push(manager->span, bucket->brick[i]);
+    }
+
+    /* done */
+    *brick_count = darray_length(manager->span);
+    return manager->span;
+}
+
+/*
+ * brickmanager_retrieve_active_awake_bricks_span()
+ * Retrieves the bricks with a movement path inside the current Region Of
+ * Interest (ROI). These are not included in brickmanager_retrieve_static_bricks_span().
+ * The array is owned by the manager and is valid until the next span-style retrieval
+ */
+brick_t* const* brickmanager_retrieve_active_awake_bricks_span(brickmanager_t* manager, int* brick_count)
+{
+    /* reuse the buffer */
+    darray_clear(manager->span);
+
+    /* filter the awake bricks */
+    for(int i = 0; i < darray_length(manager->awake_bucket->brick); i++) {
+        brick_t* brick = manager->awake_bucket->brick[i];
+
+        if(is_brick_inside_rois(manager, brick))
+            darray_push(manager->span, brick);
+    }
+
+    /* done */
+    *brick_count = darray_length(manager->span);
+    return manager->span;
+}
+
+/*
+ * brickmanager_static_bricks_version()
+ * Returns a number that changes whenever the static bricks of the cells that
+ * intersect the ROI may have changed, i.e., when bricks are added or removed,
+ * when bricks are killed, or when the ROI moves to different cells
+ */
+unsigned brickmanager_static_bricks_version(const brickmanager_t* manager)
+{
+    /* both terms only increase, so their sum changes whenever either one does */
+    return manager->static_version + brick_death_count();
+}
+
+/*
+ * brickmanager_static_bricks_layout_version()
+ * Returns a number that changes whenever static bricks may have been added
+ * or removed anywhere in the world. Unlike brickmanager_static_bricks_version(),
+ * it does not change when the ROI moves
+ */
+unsigned brickmanager_static_bricks_layout_version(const brickmanager_t* manager)
+{
+    return manager->layout_version + brick_death_count();
+}
+
+/*
+ * brickmanager_retrieve_static_bricks_in_rect_span()
+ * Retrieves the static bricks that intersect a rectangle given in world
+ * space, regardless of the ROI. Dead bricks that haven't been removed yet
+ * may be included. The array is owned by the manager and is valid until the
+ * next span-style retrieval
+ */
+brick_t* const* brickmanager_retrieve_static_bricks_in_rect_span(brickmanager_t* manager, rect_t rect, int* brick_count)
+{
+    brickrect_t r = {
+        .top = rect.y,
+        .left = rect.x,
+        .bottom = rect.y + max(1, rect.height) - 1,
+        .right = rect.x + max(1, rect.width) - 1
+    };
+
+    /* a static brick is stored in the cell of its center. Expand the
+       rectangle by half the size of the largest static brick, so that
+       we scan all cells that may store an intersecting brick */
+    int half_width = (manager->max_static_brick_width + 1) / 2;
+    int half_height = (manager->max_static_brick_height + 1) / 2;
+    int left = max(0, r.left - half_width) / GRID_SIZE;
+    int top = max(0, r.top - half_height) / GRID_SIZE;
+    int right = max(0, r.right + half_width) / GRID_SIZE;
+    int bottom = max(0, r.bottom + half_height) / GRID_SIZE;
+
+    /* reuse the buffer */
+    darray_clear(manager->span);
+
+    /* filter the bricks of the scanned cells */
+    for(int y = top; y <= bottom; y++) {
+        for(int x = left; x <= right; x++) {
+            uint64_t key = (((uint64_t)x) << 32) | ((uint64_t)y);
+            const brickbucket_t* bucket = fasthash_get(manager->hashtable, key);
+
+            if(bucket == NULL)
+                continue;
+
+            for(int i = 0; i < darray_length(bucket->brick); i++) {
+                if(is_rect_inside_roi(&bucket->bounds[i], &r))
+                    darray_push(manager->span, bucket->brick[i]);
+            }
+        }
+    }
+
+    /* done */
+    *brick_count = darray_length(manager->span);
+    return manager->span;
+}
+
+/*
+ * brickmanager_retrieve_active_bricks_in_rect_span()
+ * Retrieves the bricks of brickmanager_retrieve_active_bricks_as_list() that
+ * intersect a rectangle in world space, without building the list: the static
+ * bricks stored in the cells of the ROI and the awake bricks inside the ROI.
+ * Only the cells that may store an intersecting brick are scanned. The array
+ * is owned by the manager and is valid until the next span-style retrieval
+ */
+brick_t* const* brickmanager_retrieve_active_bricks_in_rect_span(brickmanager_t* manager, rect_t rect, int* brick_count)
+{
+    brickrect_t r = {
+        .top = rect.y,
+        .left = rect.x,
+        .bottom = rect.y + max(1, rect.height) - 1,
+        .right = rect.x + max(1, rect.width) - 1
+    };
+
+    /* see brickmanager_retrieve_static_bricks_in_rect_span() */
+    int half_width = (manager->max_static_brick_width + 1) / 2;
+    int half_height = (manager->max_static_brick_height + 1) / 2;
+    int left = max(0, r.left - half_width) / GRID_SIZE;
+    int top = max(0, r.top - half_height) / GRID_SIZE;
+    int right = max(0, r.right + half_width) / GRID_SIZE;
+    int bottom = max(0, r.bottom + half_height) / GRID_SIZE;
+
+    /* reuse the buffer */
+    darray_clear(manager->span);
+
+    /* filter the static bricks of the scanned cells of the ROI */
+    for(int y = top; y <= bottom; y++) {
+        for(int x = left; x <= right; x++) {
+            uint64_t key = (((uint64_t)x) << 32) | ((uint64_t)y);
+            const brickbucket_t* bucket;
+
+            if(!is_cell_inside_rois(manager, x, y, manager->roi_count))
+                continue;
+            else if(NULL == (bucket = fasthash_get(manager->hashtable, key)))
+                continue;
+
+            for(int i = 0; i < darray_length(bucket->brick); i++) {
+                if(is_rect_inside_roi(&bucket->bounds[i], &r))
+                    darray_push(manager->span, bucket->brick[i]);
+            }
+        }
+    }
+
+    /* filter the awake bricks, which may have moved since they were added */
+    for(int i = 0; i < darray_length(manager->awake_bucket->brick); i++) {
+        brick_t* brick = manager->awake_bucket->brick[i];
+
+        if(is_brick_inside_roi(brick, &r) && is_brick_inside_rois(manager, brick))
+            darray_push(manager->span, brick);
+    }
+
+    /* done */
+    *brick_count = darray_length(manager->span);
+    return manager->span;
+}
+
 /*
  * brickmanager_retrieve_active_moving_bricks()
  * Efficiently retrieve moving bricks inside the current Region Of Interest (ROI)
@@ -497,32 +934,17 @@ iterator_t* brickmanager_retrieve_active_moving_bricks(const brickmanager_t* man
     state.own_bucket = bucket_ctor(brick_fake_destroy); /* a bucket of references only */
     darray_init(state.bucket);
 
-    /* get the ROI */
-    const brickrect_t* roi = &(manager->roi);
-
     /* for each bucket inside the ROI */
-    int left = roi->left;
-    int top = roi->top;
-    int right = roi->right;
-    int bottom = roi->bottom;
-
-    right += GRID_SIZE - 1;
-    bottom += GRID_SIZE - 1;
-
-    for(int y = top; y <= bottom; y += GRID_SIZE) {
-        for(int x = left; x <= right; x += GRID_SIZE) {
-            uint64_t key = position_to_hash(x, y);
-            const brickbucket_t* bucket = fasthash_get(manager->hashtable, key);
+    for(int i = 0; i < darray_length(manager->roi_bucket); i++) {
+        const brickbucket_t* bucket = manager->roi_bucket[i];
 
-            /* we must consider bricks with non-default behavior as "moving" */
-            /* we add the bucket if it exists and if it's not empty */
-            if(bucket != NULL && !bucket_is_empty(bucket))
-                filter_non_default_bricks(state.own_bucket, bucket);
-        }
+        /* we must consider bricks with non-default behavior as "moving" */
+        if(!bucket_is_empty(bucket))
+            filter_non_default_bricks(state.own_bucket, bucket);
     }
 
     /* individually filter the awake bricks inside the ROI */
-    filter_bricks_inside_roi(state.own_bucket, manager->awake_bucket, roi);
+    filter_bricks_inside_rois(state.own_bucket, manager->awake_bucket, manager);
 
     /* add own_bucket if it's not empty */
     if(!bucket_is_empty(state.own_bucket))
@@ -576,7 +998,7 @@ brick_list_t* brickmanager_retrieve_all_bricks_as_list(const brickmanager_t* man
 
     while(iterator_has_next(it)) {
         brick_t* brick = iterator_next(it);
-        list = add_to_list(list, brick);
+        list = add_to_list(list, brick, NULL);
     }
 
     iterator_destroy(it);
@@ -594,13 +1016,42 @@ brick_list_t* brickmanager_retrieve_active_bricks_as_list(const brickmanager_t*
 
     while(iterator_has_next(it)) {
         brick_t* brick = iterator_next(it);
-        list = add_to_list(list, brick);
+        list = add_to_list(list, brick, NULL);
     }
 
     iterator_destroy(it);
     return list;
 }
 
+/*
+ * brickmanager_retrieve_active_bricks_as_list_ex()
+ * Retrieves bricks inside the ROI as a brick list stored in the given arena.
+ * The returned list must not be released; it goes away when the arena is reset.
+ * The bricks are the same as those of brickmanager_retrieve_active_bricks_as_list()
+ */
+brick_list_t* brickmanager_retrieve_active_bricks_as_list_ex(const brickmanager_t* manager, arena_t* arena)
+{
+    brick_list_t* list = NULL;
+
+    /* add the bricks of the buckets inside the ROI */
+    for(int b = 0; b < darray_length(manager->roi_bucket); b++) {
+        const brickbucket_t* bucket = manager->roi_bucket[b];
+
+        for(int i = 0; i < darray_length(bucket->brick); i++)
+            list = add_to_list(list, bucket->brick[i], arena);
+    }
+
+    /* add the awake bricks inside the ROI */
+    for(int i = 0; i < darray_length(manager->awake_bucket->brick); i++) {
+        brick_t* brick = manager->awake_bucket->brick[i];
+
+        if(is_brick_inside_rois(manager, brick))
+            list = add_to_list(list, brick, arena);
+    }
+
+    return list;
+}
+
 /*
  * brickmanager_release_list()
  * Releases a brick list
@@ -648,6 +1099,125 @@ uint64_t brick2hash(const brick_t* brick)
     return position_to_hash(center_x, center_y);
 }
 
+/* the cells of the spatial hash that we scan when querying the ROI */
+brickrect_t roi_to_cells(const brickrect_t* roi)
+{
+    /* this matches scanning the ROI with a step of GRID_SIZE pixels
+       from its top-left corner up to (right, bottom) + GRID_SIZE - 1 */
+    int left = max(0, roi->left) / GRID_SIZE;
+    int top = max(0, roi->top) / GRID_SIZE;
+    int right = left + max(0, roi->right - roi->left + GRID_SIZE - 1) / GRID_SIZE;
+    int bottom = top + max(0, roi->bottom - roi->top + GRID_SIZE - 1) / GRID_SIZE;
+
+    return (brickrect_t){ .top = top, .left = left, .bottom = bottom, .right = right };
+}
+
+/* checks if a cell (given in grid coordinates) is inside a rectangle of cells */
+bool is_cell_inside(int cell_x, int cell_y, const brickrect_t* cells)
+{
+    return cell_x >= cells->left && cell_x <= cells->right &&
+           cell_y >= cells->top && cell_y <= cells->bottom;
+}
+
+/* clips a ROI given in world space to the limits of the world */
+brickrect_t clip_roi(const brickmanager_t* manager, rect_t roi)
+{
+    int x = roi.x;
+    int y = roi.y;
+    int width = roi.width;
+    int height = roi.height;
+    int world_width = manager->world_width;
+    int world_height = manager->world_height;
+
+    /*
+    
+    clip values:
+
+    0 <= x <= world_width - 1
+    0 <= y <= world_height - 1
+    1 <= width <= world_width - x
+    1 <= height <= world_height - y
+
+    a unrealistically large ROI could cause unnecessary slowdowns,
+    so we clip it.
+    
+    */
+
+    if(x < 0)
+        x = 0;
+    if(x > world_width - 1)
+        x = world_width - 1;
+
+    if(y < 0)
+        y = 0;
+    if(y > world_height - 1)
+        y = world_height - 1;
+
+    if(width < 1)
+        width = 1;
+    if(x + width > world_width)
+        width = world_width - x;
+
+    if(height < 1)
+        height = 1;
+    if(y + height > world_height)
+        height = world_height - y;
+
+    /* done */
+    return (brickrect_t){ .top = y, .left = x, .bottom = y + height - 1, .right = x + width - 1 };
+}
+
+/* checks if a cell (given in grid coordinates) is inside the cells of any of the first roi_count ROIs */
+bool is_cell_inside_rois(const brickmanager_t* manager, int cell_x, int cell_y, int roi_count)
+{
+    for(int r = 0; r < roi_count; r++) {
+        if(is_cell_inside(cell_x, cell_y, &manager->roi_cells[r]))
+            return true;
+    }
+
+    return false;
+}
+
+/* recompute the buckets of the ROI if the cells of the ROI have changed */
+void update_roi_buckets(brickmanager_t* manager, bool force)
+{
+    bool changed = force;
+
+    /* find the cells of the ROIs */
+    for(int r = 0; r < manager->roi_count; r++) {
+        brickrect_t cells = roi_to_cells(&manager->roi[r]);
+        brickrect_t* roi_cells = &manager->roi_cells[r];
+
+        if(cells.left != roi_cells->left || cells.top != roi_cells->top || cells.right != roi_cells->right || cells.bottom != roi_cells->bottom) {
+            *roi_cells = cells;
+            changed = true;
+        }
+    }
+
+    /* nothing to do */
+    if(!changed)
+        return;
+
+    /* collect the allocated buckets. A cell shared by multiple ROIs is
+       collected only once: for the first ROI that contains it */
+    darray_clear(manager->roi_bucket);
+    for(int r = 0; r < manager->roi_count; r++) {
+        const brickrect_t* cells = &manager->roi_cells[r];
+
+        for(int y = cells->top; y <= cells->bottom; y++) {
+            for(int x = cells->left; x <= cells->right; x++) {
+                uint64_t key = (((uint64_t)x) << 32) | ((uint64_t)y);
+                const brickbucket_t* bucket = fasthash_get(manager->hashtable, key);
+
+                if(bucket != NULL && !is_cell_inside_rois(manager, x, y, r))
+                    darray_push(manager->roi_bucket, bucket);
+            }
+        }
+    }
+
+    manager->static_version++;
+}
+
 
 
 
@@ -658,6 +1228,7 @@ brickbucket_t* bucket_ctor(brick_t* (*brick_dtor)(brick_t*))
     brickbucket_t* bucket = mallocx(sizeof *bucket);
 
     darray_init(bucket->brick);
+    darray_init(bucket->bounds);
     bucket->brick_dtor = brick_dtor;
 
     return bucket;
@@ -670,6 +1241,7 @@ brickbucket_t* bucket_dtor(brickbucket_t* bucket)
         bucket->brick_dtor(bucket->brick[i]);
 
     /* release the bucket */
+    darray_release(bucket->bounds);
     darray_release(bucket->brick);
     free(bucket);
 
@@ -685,6 +1257,44 @@ void bucket_dtor_adapter(void* bucket)
 void bucket_add(brickbucket_t* bucket, brick_t* brick)
 {
     darray_push(bucket->brick, brick);
+    darray_push(bucket->bounds, brick_bounds(brick));
+}
+
+brickbucket_t* get_or_create_bucket(brickmanager_t* manager, uint64_t key)
+{
+    brickbucket_t* bucket = fasthash_get(manager->hashtable, key);
+
+    /* lazily allocate a new bucket if one doesn't exist */
+    if(bucket == NULL) {
+        bucket = bucket_ctor(brick_destroy);
+        fasthash_put(manager->hashtable, key, bucket);
+        darray_push(manager->bucket_ref, bucket);
+
+        /* keep the buckets of the ROI up to date */
+        if(is_cell_inside_rois(manager, (int)(key >> 32), (int)(key & 0xFFFFFFFF), manager->roi_count))
+            darray_push(manager->roi_bucket, bucket);
+    }
+
+    return bucket;
+}
+
+int brickkey_cmp(const void* a, const void* b)
+{
+    const brickkey_t* x = (const brickkey_t*)a;
+    const brickkey_t* y = (const brickkey_t*)b;
+
+    if(x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    else
+        return x->index - y->index;
+}
+
+void bucket_reserve(brickbucket_t* bucket, int additional_bricks)
+{
+    size_t n = darray_length(bucket->brick) + additional_bricks;
+
+    darray_reserve(bucket->brick, n);
+    darray_reserve(bucket->bounds, n);
 }
 
 int bucket_wash(brickbucket_t* bucket)
@@ -696,6 +1306,28 @@ int bucket_wash(brickbucket_t* bucket)
         if(!brick_is_alive(bucket->brick[i])) {
             bucket->brick_dtor(bucket->brick[i]);
             darray_remove(bucket->brick, i);
+            darray_remove(bucket->bounds, i);
+            count++;
+        }
+    }
+
+    /* return the number of removed bricks */
+    return count;
+}
+
+int bucket_remove_in_rect(brickbucket_t* bucket, const rect_t* rect, void (*callback)(const brick_t*,void*), void* data)
+{
+    int count = 0;
+
+    /* remove the bricks spawned inside the rectangle */
+    for(int i = darray_length(bucket->brick) - 1; i >= 0; i--) {
+        if(rect_contains(*rect, brick_spawnpoint(bucket->brick[i]))) {
+            if(callback != NULL && brick_is_alive(bucket->brick[i]))
+                callback(bucket->brick[i], data);
+
+            bucket->brick_dtor(bucket->brick[i]);
+            darray_remove(bucket->brick, i);
+            darray_remove(bucket->bounds, i);
             count++;
         }
     }
@@ -709,6 +1341,7 @@ void bucket_clear(brickbucket_t* bucket)
     for(int i = darray_length(bucket->brick) - 1; i >= 0 ; i--)
         bucket->brick_dtor(bucket->brick[i]);
 
+    darray_clear(bucket->bounds);
     darray_clear(bucket->brick);
 }
 
@@ -823,15 +1456,18 @@ heightsampler_t* sampler_ctor()
 
     darray_init(sampler->height_at);
     darray_init(sampler->smooth_height_at);
+    darray_init(sampler->tree);
 
     darray_push(sampler->height_at, 0);
     darray_push(sampler->smooth_height_at, 0);
+    sampler_rebuild_tree(sampler);
 
     return sampler;
 }
 
 heightsampler_t* sampler_dtor(heightsampler_t* sampler)
 {
+    darray_release(sampler->tree);
     darray_release(sampler->smooth_height_at);
     darray_release(sampler->height_at);
     free(sampler);
@@ -846,6 +1482,7 @@ void sampler_clear(heightsampler_t* sampler)
 
     darray_push(sampler->height_at, 0);
     darray_push(sampler->smooth_height_at, 0);
+    sampler_rebuild_tree(sampler);
 }
 
 int sampler_query(heightsampler_t* sampler, int left, int right)
@@ -871,12 +1508,19 @@ int sampler_query(heightsampler_t* sampler, int left, int right)
 
     /* now we have 0 <= l, r <= m */
 
-    /* query the height at the given interval
+    /* query the height at the given interval using the segment tree
        method: clamp to edge */
     int max_height = 0;
-    for(int i = l; i <= r; i++) {
-        if(sampler->smooth_height_at[i] > max_height)
-            max_height = sampler->smooth_height_at[i];
+    for(l += sampler->leaf_count, r += sampler->leaf_count + 1; l < r; l >>= 1, r >>= 1) {
+        if(l & 1) {
+            max_height = max(max_height, sampler->tree[l]);
+            l++;
+        }
+
+        if(r & 1) {
+            r--;
+            max_height = max(max_height, sampler->tree[r]);
+        }
     }
 
     /* done */
@@ -905,6 +1549,9 @@ void sampler_add(heightsampler_t* sampler, v2d_t topleft_position, v2d_t size)
         darray_push(sampler->smooth_height_at, 0);
     }
 
+    if(darray_length(sampler->smooth_height_at) > sampler->leaf_count)
+        sampler_rebuild_tree(sampler);
+
     /* update height_at[] */
     if(bottom > sampler->height_at[index])
         sampler->height_at[index] = bottom;
@@ -914,12 +1561,53 @@ void sampler_add(heightsampler_t* sampler, v2d_t topleft_position, v2d_t size)
         sampler->smooth_height_at[index] = sampler->height_at[index];
 
     /* fill smooth_height_at[] */
+    int last = index;
     for(int j = index+1; j < darray_length(sampler->smooth_height_at); j++) {
         if(sampler->height_at[j] == 0)
-            sampler->smooth_height_at[j] = sampler->smooth_height_at[j-1]; /* j >= 1 always */
+            sampler->smooth_height_at[(last = j)] = sampler->smooth_height_at[j-1]; /* j >= 1 always */
         else
             break;
     }
+
+    /* update the segment tree */
+    sampler_update_tree(sampler, index, last);
+}
+
+/* rebuild the segment tree, growing it to fit smooth_height_at[] */
+void sampler_rebuild_tree(heightsampler_t* sampler)
+{
+    int length = darray_length(sampler->smooth_height_at);
+    int n = 1;
+
+    /* the number of leaves doubles as needed: amortized O(1) per sample */
+    while(n < length)
+        n *= 2;
+
+    sampler->leaf_count = n;
+    darray_resize(sampler->tree, 2 * n);
+
+    for(int j = 0; j < n; j++)
+        sampler->tree[n + j] = (j < length) ? sampler->smooth_height_at[j] : 0;
+
+    for(int i = n - 1; i >= 1; i--)
+        sampler->tree[i] = max(sampler->tree[2*i], sampler->tree[2*i+1]);
+
+    sampler->tree[0] = 0; /* unused */
+}
+
+/* update the segment tree after changing smooth_height_at[first..last]
+   in O(k + log n), where k = last - first + 1 */
+void sampler_update_tree(heightsampler_t* sampler, int first, int last)
+{
+    int n = sampler->leaf_count;
+
+    for(int j = first; j <= last; j++)
+        sampler->tree[n + j] = sampler->smooth_height_at[j];
+
+    for(first = (n + first) / 2, last = (n + last) / 2; first >= 1; first /= 2, last /= 2) {
+        for(int i = first; i <= last; i++)
+            sampler->tree[i] = max(sampler->tree[2*i], sampler->tree[2*i+1]);
+    }
 }
 
 void sampler_add_brick(heightsampler_t* sampler, const brick_t* brick)
@@ -987,7 +1675,8 @@ void acknowledge_bricklike_objects(brickmanager_t* manager)
     surgescript_objectmanager_t* object_manager = surgescript_object_manager(level);
 
     /* acknowledge each brick-like object */
-    iterator_t* bricklike_iterator = entitymanager_bricklike_iterator(entity_manager);
+    iteratorstorage_t storage;
+    iterator_t* bricklike_iterator = entitymanager_bricklike_iterator_inplace(entity_manager, &storage);
     while(iterator_has_next(bricklike_iterator)) {
         surgescript_objecthandle_t* bricklike_handle = iterator_next(bricklike_iterator);
 
@@ -1034,12 +1723,54 @@ bool is_brick_inside_roi(const brick_t* brick, const brickrect_t* roi)
     );
 }
 
-void filter_bricks_inside_roi(brickbucket_t* out_bucket, const brickbucket_t* in_bucket, const brickrect_t* roi)
+bool is_rect_inside_roi(const brickrect_t* rect, const brickrect_t* roi)
+{
+    return !(
+        rect->right < roi->left || rect->left > roi->right ||
+        rect->bottom < roi->top || rect->top > roi->bottom
+    );
+}
+
+brickrect_t brick_bounds(const brick_t* brick)
+{
+    /* we use the spawn point, which does not change */
+    v2d_t spawn_point = brick_spawnpoint(brick);
+    v2d_t size = brick_size(brick);
+
+    return (brickrect_t){
+        .top = spawn_point.y,
+        .left = spawn_point.x,
+        .bottom = spawn_point.y + size.y - 1.0f,
+        .right = spawn_point.x + size.x - 1.0f
+    };
+}
+
+bool is_brick_inside_rois(const brickmanager_t* manager, const brick_t* brick)
+{
+    for(int r = 0; r < manager->roi_count; r++) {
+        if(is_brick_inside_roi(brick, &manager->roi[r]))
+            return true;
+    }
+
+    return false;
+}
+
+bool is_rect_inside_rois(const brickmanager_t* manager, const brickrect_t* rect)
+{
+    for(int r = 0; r < manager->roi_count; r++) {
+        if(is_rect_inside_roi(rect, &manager->roi[r]))
+            return true;
+    }
+
+    return false;
+}
+
+void filter_bricks_inside_rois(brickbucket_t* out_bucket, const brickbucket_t* in_bucket, const brickmanager_t* manager)
 {
     for(int i = 0; i < darray_length(in_bucket->brick); i++) {
         brick_t* brick = in_bucket->brick[i];
 
-        if(is_brick_inside_roi(brick, roi))
+        if(is_brick_inside_rois(manager, brick))
             bucket_add(out_bucket, brick); /* add a reference to the output bucket */
     }
 }
@@ -1070,11 +1801,11 @@ brick_t* brick_fake_destroy(brick_t* brick)
 
 /* legacy brick list routines for backwards compatibility */
 
-brick_list_t* add_to_list(brick_list_t* list, brick_t* brick)
+brick_list_t* add_to_list(brick_list_t* list, brick_t* brick, arena_t* arena)
 {
     /* add quickly to the linked list */
     /* note that we're adding in reverse order */
-    brick_list_t* node = mallocx(sizeof *node);
+    brick_list_t* node = (arena != NULL) ? arena_alloc(arena, sizeof *node) : mallocx(sizeof *node);
     node->data = brick;
     node->next = list;
     return node;
@@ -29,6 +29,10 @@ struct brickmanager_t;
 struct brick_list_t;
 struct brick_t;
 struct iterator_t;
+struct arena_t;
+
+/* maximum number of simultaneous regions of interest */
+#define BRICKMANAGER_MAX_ROIS 8
 
 /* public API */
 brickmanager_t* brickmanager_create();
@@ -37,23 +41,38 @@ void brickmanager_update(brickmanager_t* manager);
 
 /* storage */
 void brickmanager_add_brick(brickmanager_t* manager, struct brick_t* brick);
+void brickmanager_add_bricks(brickmanager_t* manager, struct brick_t** bricks, int brick_count); /* bulk insertion */
 void brickmanager_remove_all_bricks(brickmanager_t* manager);
+void brickmanager_remove_bricks_in_rect(brickmanager_t* manager, rect_t rect, void (*callback)(const struct brick_t*,void*), void* data); /* removes the bricks spawned inside a rectangle in world space; callback is called for each one that is alive */
 int brickmanager_number_of_bricks(const brickmanager_t* manager);
 
 /* retrieval */
 void brickmanager_set_roi(brickmanager_t* manager, rect_t roi); /* set region of interest (ROI) */
+void brickmanager_set_rois(brickmanager_t* manager, const rect_t* roi, int roi_count); /* set multiple ROIs, e.g., one per camera; bricks inside any of them are retrieved once */
 struct iterator_t* brickmanager_retrieve_active_bricks(const brickmanager_t* manager); /* efficient retrieval based on a ROI */
+struct brick_t* const* brickmanager_retrieve_active_bricks_span(brickmanager_t* manager, int* brick_count); /* retrieve bricks inside the ROI as an array owned by the manager */
+struct brick_t* const* brickmanager_retrieve_active_moving_bricks_span(brickmanager_t* manager, int* brick_count); /* retrieve moving bricks inside the ROI as an array owned by the manager */
 struct iterator_t* brickmanager_retrieve_active_moving_bricks(const brickmanager_t* manager); /* retrieve moving bricks within the ROI */
 struct iterator_t* brickmanager_retrieve_all_bricks(const brickmanager_t* manager);
 
+/* incremental retrieval */
+struct brick_t* const* brickmanager_retrieve_static_bricks_span(brickmanager_t* manager, int* brick_count); /* retrieve the static bricks of the cells that intersect the ROI (coarse) */
+struct brick_t* const* brickmanager_retrieve_active_awake_bricks_span(brickmanager_t* manager, int* brick_count); /* retrieve the bricks with a movement path inside the ROI */
+unsigned brickmanager_static_bricks_version(const brickmanager_t* manager); /* changes whenever the static bricks of the cells that intersect the ROI may have changed */
+unsigned brickmanager_static_bricks_layout_version(const brickmanager_t* manager); /* changes whenever static bricks may have been added or removed anywhere */
+struct brick_t* const* brickmanager_retrieve_static_bricks_in_rect_span(brickmanager_t* manager, rect_t rect, int* brick_count); /* retrieve the static bricks that intersect a rectangle in world space, regardless of the ROI */
+struct brick_t* const* brickmanager_retrieve_active_bricks_in_rect_span(brickmanager_t* manager, rect_t rect, int* brick_count); /* retrieve the bricks of the legacy list of active bricks that intersect a rectangle in world space */
+
 /* world size */
 void brickmanager_world_size(const brickmanager_t* manager, int* world_width, int* world_height);
 int brickmanager_world_height_at_interval(const brickmanager_t* manager, int left_xpos, int right_xpos); /* coordinates are inclusive */
 void brickmanager_recalculate_world_size(brickmanager_t* manager);
+void brickmanager_extend_world_size(brickmanager_t* manager, rect_t area); /* account for an area of the world that holds bricks that aren't stored, until recalculated */
 
 /* legacy brick list for backwards compatibility */
 struct brick_list_t* brickmanager_retrieve_all_bricks_as_list(const brickmanager_t* manager);
 struct brick_list_t* brickmanager_retrieve_active_bricks_as_list(const brickmanager_t* manager);
+struct brick_list_t* brickmanager_retrieve_active_bricks_as_list_ex(const brickmanager_t* manager, struct arena_t* arena); /* the list is stored in the arena and must not be released */
 struct brick_list_t* brickmanager_release_list(struct brick_list_t* list);
 
 #endif
\ No newline at end of file
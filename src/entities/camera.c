@@ -30,6 +30,8 @@ typedef struct camera_t camera_t;
 struct camera_t {
     /* the camera is represented by a point in 2D space */
     v2d_t position; /* current position, mapped to the center of the screen */
+    v2d_t previous_position; /* position at the beginning of the current framestep */
+    int64_t previous_position_frame; /* the framestep in which previous_position was saved */
     v2d_t target; /* the target position is used to make things smooth */
     float speed; /* the camera will move from position to target in speed px/s */
 
@@ -37,8 +39,15 @@ struct camera_t {
     struct {
         float x1, y1, x2, y2; /* x1 <= x2, y1 <= y2 */
         bool enabled; /* without boundaries, the camera travels through infinity */
+        v2d_t level_size; /* size of the level when the boundaries were reset */
     } boundaries;
 
+    /* the visible playfield: the boundaries expanded by half the screen.
+       Precomputed whenever the boundaries change */
+    struct {
+        float x1, y1, x2, y2;
+    } span;
+
     /* locking the camera */
     bool is_locked; /* is the camera locked or can it move freely? */
 };
@@ -51,6 +60,7 @@ static inline void enable_boundaries();
 static inline void disable_boundaries();
 static inline v2d_t clip_to_boundaries(v2d_t position);
 static v2d_t clip_position(v2d_t position, float x1, float y1, float x2, float y2);
+static inline bool has_level_size_changed();
 
 
 
@@ -65,10 +75,23 @@ void camera_init()
     camera.is_locked = false;
     reset_boundaries();
     camera.position = v2d_new(camera.boundaries.x1, camera.boundaries.y1);
+    camera.previous_position = camera.position;
+    camera.previous_position_frame = -1;
     camera.target = camera.position;
     camera.speed = 0.0f;
 }
 
+/*
+ * camera_save_position()
+ * Saves the position of the camera at the beginning of a framestep,
+ * so that rendering can interpolate between framesteps
+ */
+void camera_save_position()
+{
+    camera.previous_position = camera.position;
+    camera.previous_position_frame = timer_get_frames();
+}
+
 /*
  * camera_update()
  * updates the camera
@@ -82,7 +105,7 @@ void camera_update()
     /* updating the boundaries */
     if(level_editmode() || level_is_in_debug_mode()) /* no boundaries in the editor */
         disable_boundaries();
-    else if(!camera.is_locked) /* the level size may have changed since the last frame */
+    else if(!camera.is_locked && has_level_size_changed()) /* the level size may have changed since the last frame */
         reset_boundaries();
     else
         enable_boundaries();
@@ -167,6 +190,7 @@ void camera_lock(int x1, int y1, int x2, int y2)
 void camera_unlock()
 {
     camera.is_locked = false;
+    camera.boundaries.level_size = v2d_new(-1.0f, -1.0f); /* reset the boundaries in the next update */
 }
 
 /*
@@ -175,7 +199,18 @@ void camera_unlock()
  */
 v2d_t camera_get_position()
 {
-    return v2d_new(floorf(camera.position.x), floorf(camera.position.y));
+    const float max_distance = 64.0f; /* don't interpolate jumps */
+    float alpha = timer_get_interpolation();
+    v2d_t position = camera.position;
+
+    /* interpolate between framesteps when rendering */
+    if(alpha < 1.0f && camera.previous_position_frame == timer_get_frames()) {
+        v2d_t ds = v2d_subtract(camera.position, camera.previous_position);
+        if(fabsf(ds.x) + fabsf(ds.y) < max_distance)
+            position = v2d_lerp(camera.previous_position, camera.position, alpha);
+    }
+
+    return v2d_new(floorf(position.x), floorf(position.y));
 }
 
 /*
@@ -202,14 +237,8 @@ bool camera_is_locked()
  */
 v2d_t camera_clip(v2d_t position)
 {
-    if(camera.boundaries.enabled) {
-        return clip_position(position,
-            camera.boundaries.x1 - VIDEO_SCREEN_W / 2,
-            camera.boundaries.y1 - VIDEO_SCREEN_H / 2,
-            camera.boundaries.x2 + VIDEO_SCREEN_W / 2,
-            camera.boundaries.y2 + VIDEO_SCREEN_H / 2
-        );
-    }
+    if(camera.boundaries.enabled)
+        return clip_position(position, camera.span.x1, camera.span.y1, camera.span.x2, camera.span.y2);
     else
         return position;
 }
@@ -224,6 +253,55 @@ bool camera_clip_test(v2d_t position)
     return v2d_magnitude(v2d_subtract(position, clipped)) < 1.0f;
 }
 
+/*
+ * camera_visible_area()
+ * The area seen by the camera, in world coordinates, expanded by a
+ * margin in pixels. If the camera is locked, the area is also limited
+ * to the visible playfield
+ */
+rect_t camera_visible_area(int margin)
+{
+    v2d_t position = camera_get_position();
+    int x1 = position.x - VIDEO_SCREEN_W / 2 - margin;
+    int y1 = position.y - VIDEO_SCREEN_H / 2 - margin;
+    int x2 = position.x + VIDEO_SCREEN_W / 2 + margin;
+    int y2 = position.y + VIDEO_SCREEN_H / 2 + margin;
+
+    if(camera.is_locked && camera.boundaries.enabled) {
+        x1 = max(x1, (int)floorf(camera.span.x1) - margin);
+        y1 = max(y1, (int)floorf(camera.span.y1) - margin);
+        x2 = min(x2, (int)ceilf(camera.span.x2) + margin);
+        y2 = min(y2, (int)ceilf(camera.span.y2) + margin);
+    }
+
+    return rect_new(x1, y1, max(x2 - x1, 0), max(y2 - y1, 0));
+}
+
+/*
+ * camera_cull()
+ * Given an array of count rects in world space, writes the indices of
+ * the ones that overlap the visible area (expanded by a margin) to
+ * out_index, which must have room for count elements. Returns the number
+ * of visible rects
+ */
+int camera_cull(const rect_t* rect, int count, int margin, int* out_index)
+{
+    rect_t area = camera_visible_area(margin);
+    int x1 = area.x, y1 = area.y;
+    int x2 = area.x + area.width, y2 = area.y + area.height;
+    int visible = 0;
+
+    for(int i = 0; i < count; i++) {
+        const rect_t* r = &rect[i];
+
+        /* same test as level_inside_screen() */
+        if(r->x < x2 && r->x + r->width > x1 && r->y < y2 && r->y + r->height > y1)
+            out_index[visible++] = i;
+    }
+
+    return visible;
+}
+
 /* private methods */
 void define_boundaries(float x1, float y1, float x2, float y2)
 {
@@ -241,6 +319,7 @@ void reset_boundaries()
     camera.boundaries.y1 = 0.0f;
     camera.boundaries.x2 = INFINITY;
     camera.boundaries.y2 = INFINITY;
+    camera.boundaries.level_size = level_size();
     sanitize_boundaries();
     enable_boundaries();
 }
@@ -277,6 +356,12 @@ void sanitize_boundaries()
     camera.boundaries.y1 = y1;
     camera.boundaries.x2 = x2;
     camera.boundaries.y2 = y2;
+
+    /* precompute the visible playfield */
+    camera.span.x1 = x1 - VIDEO_SCREEN_W / 2;
+    camera.span.y1 = y1 - VIDEO_SCREEN_H / 2;
+    camera.span.x2 = x2 + VIDEO_SCREEN_W / 2;
+    camera.span.y2 = y2 + VIDEO_SCREEN_H / 2;
 }
 
 v2d_t clip_to_boundaries(v2d_t position)
@@ -305,4 +390,10 @@ v2d_t clip_position(v2d_t position, float x1, float y1, float x2, float y2)
         position.y = max_y;
 
     return position;
-}
\ No newline at end of file
+}
+
+bool has_level_size_changed()
+{
+    v2d_t size = level_size();
+    return size.x != camera.boundaries.level_size.x || size.y != camera.boundaries.level_size.y;
+}
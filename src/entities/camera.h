@@ -23,6 +23,7 @@
 
 #include <stdbool.h>
 #include "../util/v2d.h"
+#include "../util/rect.h"
 
 /* initializes the camera */
 void camera_init();
@@ -48,6 +49,9 @@ bool camera_is_locked();
 /* returns the position of the camera */
 v2d_t camera_get_position();
 
+/* saves the position at the beginning of a framestep (for interpolated rendering) */
+void camera_save_position();
+
 /* sets a new position */
 void camera_set_position(v2d_t position);
 
@@ -57,4 +61,10 @@ v2d_t camera_clip(v2d_t position);
 /* is the position inside the visible playfield? */
 bool camera_clip_test(v2d_t position);
 
+/* the area seen by the camera, in world coordinates, expanded by a margin (in pixels) */
+rect_t camera_visible_area(int margin);
+
+/* culls the world rects that can't be seen; writes the indices of the visible ones to out_index and returns their number */
+int camera_cull(const rect_t* rect, int count, int margin, int* out_index);
+
 #endif
@@ -24,6 +24,7 @@
 #include "enemy.h"
 #include "object_vm.h"
 #include "object_compiler.h"
+#include "entitymanager.h"
 #include "nanocalc/nanocalcext.h"
 #include "../actor.h"
 #include "../player.h"
@@ -41,6 +42,7 @@
 #include "../../util/stringutil.h"
 #include "../../util/hashtable.h"
 #include "../../physics/collisionmask.h"
+#include "../../physics/obstacle.h"
 #include "../../scenes/level.h"
 
 /* private stuff */
@@ -208,13 +210,15 @@ enemy_t *enemy_destroy(enemy_t *enemy)
         free(enemy->category);
 
     /* destroy my collision mask (if any) */
+    if(enemy->mask_obstacle != NULL)
+        obstacle_destroy(enemy->mask_obstacle);
     if(enemy->mask != NULL)
         collisionmask_destroy(enemy->mask);
 
     /* destroy me */
     actor_destroy(enemy->actor);
     free(enemy->name);
-    free(enemy);
+    entitymanager_free(enemy);
 
     /* success */
     return NULL;
@@ -227,10 +231,9 @@ enemy_t *enemy_destroy(enemy_t *enemy)
  */
 void enemy_update(enemy_t *enemy, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, enemy_list_t *object_list)
 {
-    objectmachine_t *machine = *(objectvm_get_reference_to_current_state(enemy->vm));
     if(enemy->state == ES_DEAD) return;
     nanocalcext_set_target_object((object_t*)enemy, brick_list, item_list, object_list);
-    machine->update(machine, team, team_size, brick_list, item_list, object_list);
+    objectvm_update(enemy->vm, team, team_size, brick_list, item_list, object_list);
 }
 
 
@@ -241,17 +244,40 @@ void enemy_update(enemy_t *enemy, player_t **team, int team_size, brick_list_t *
  */
 void enemy_render(enemy_t *enemy, v2d_t camera_position)
 {
-    objectmachine_t *machine = *(objectvm_get_reference_to_current_state(enemy->vm));
     if(enemy->state == ES_DEAD) return;
     if(!enemy->hide_unless_in_editor_mode || (enemy->hide_unless_in_editor_mode && level_editmode())) {
         if(!enemy->detach_from_camera || (enemy->detach_from_camera && level_editmode()))
-            machine->render(machine, camera_position);
+            objectvm_render(enemy->vm, camera_position);
         else
-            machine->render(machine, v2d_new(VIDEO_SCREEN_W/2, VIDEO_SCREEN_H/2));
+            objectvm_render(enemy->vm, v2d_new(VIDEO_SCREEN_W/2, VIDEO_SCREEN_H/2));
     }
 }
 
 
+/*
+ * enemy_obstacle()
+ * Returns the obstacle associated with this object, or NULL if the object
+ * is not an obstacle. The obstacle is kept until the collision mask changes;
+ * only its position is updated
+ */
+const obstacle_t* enemy_obstacle(enemy_t *enemy)
+{
+    v2d_t position;
+
+    if(!enemy->obstacle || enemy->mask == NULL)
+        return NULL;
+
+    position = v2d_subtract(enemy->actor->position, enemy->actor->hot_spot);
+    if(enemy->mask_obstacle == NULL)
+        enemy->mask_obstacle = obstacle_create(enemy->mask, point2d_new(position.x, position.y), OL_DEFAULT, OF_NONSTATIC);
+    else
+        obstacle_set_position(enemy->mask_obstacle, point2d_new(position.x, position.y));
+
+    return enemy->mask_obstacle;
+}
+
+
+
 /*
  * enemy_get_parent()
  * Finds the parent of this object
@@ -372,7 +398,7 @@ int enemy_exists(const char* object_name)
 
 enemy_t* create_from_script(const char *object_name)
 {
-    enemy_t* e = mallocx(sizeof *e);
+    enemy_t* e = entitymanager_alloc(sizeof *e);
     objectcode_t *object_code;
 
     /* setup the object */
@@ -391,6 +417,7 @@ enemy_t* create_from_script(const char *object_name)
     e->hide_unless_in_editor_mode = FALSE;
     e->detach_from_camera = FALSE;
     e->mask = NULL;
+    e->mask_obstacle = NULL;
     e->vm = objectvm_create(e);
     e->created_from_editor = TRUE;
     e->parent = NULL;
@@ -28,6 +28,7 @@
 struct actor_t;
 struct player_t;
 struct collisionmask_t;
+struct obstacle_t;
 struct brick_list_t;
 struct item_list_t;
 struct objectvm_t;
@@ -61,6 +62,7 @@ struct enemy_t {
     int hide_unless_in_editor_mode; /* this object will be displayed only in the level editor */
     int detach_from_camera; /* this object will not be affected by the camera (scrolling) */
     struct collisionmask_t *mask; /* collision mask */
+    struct obstacle_t *mask_obstacle; /* obstacle built from the collision mask (cached); destroy it if the mask changes */
     
     struct objectvm_t *vm; /* virtual machine (programming related to objects) */
     const char *annotation; /* optional annotation (example: "This is a soccer ball") */
@@ -113,6 +115,9 @@ void enemy_update(enemy_t *enemy, struct player_t **team, int team_size, struct
 /* renders an enemy */
 void enemy_render(enemy_t *enemy, v2d_t camera_position);
 
+/* the obstacle of this object, or NULL if it's not an obstacle */
+const struct obstacle_t* enemy_obstacle(enemy_t *enemy);
+
 
 
 
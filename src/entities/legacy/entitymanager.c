@@ -26,6 +26,7 @@
 #include "enemy.h"
 #include "spatialhash.h"
 #include "../../util/util.h"
+#include "../../util/pool.h"
 
 /* defining the spatial hashes */
 SPATIALHASH_GENERATE_CODE(brick_t)
@@ -46,6 +47,8 @@ static int active_rectangle_ypos;
 static int active_rectangle_width;
 static int active_rectangle_height;
 
+static pool_t *pool = NULL; /* memory of the entities */
+
 static int brick_count;
 static int item_count;
 static int object_count;
@@ -59,6 +62,8 @@ static int retrieve_bricks(brick_t *brick, void *ref_to_brick_list);
 static int retrieve_items(item_t *item, void *ref_to_item_list);
 static int retrieve_objects(enemy_t *object, void *ref_to_object_list);
 
+static float item_distance(item_t *item, void *query);
+
 static int get_brick_xpos(const brick_t *brick);
 static int get_brick_ypos(const brick_t *brick);
 static int get_brick_width(const brick_t *brick);
@@ -74,6 +79,13 @@ static int get_object_height(const enemy_t *object);
 
 #define IS_MOVING_BRICK(brick) (brick_has_movement_path(brick))
 
+/* a proximity query */
+typedef struct itemquery_t itemquery_t;
+struct itemquery_t {
+    v2d_t position;
+    int type;
+};
+
 /* public methods */
 void entitymanager_init()
 {
@@ -112,6 +124,12 @@ void entitymanager_release()
     logfile_message("releasing custom objects...");
     objects = spatialhash_enemy_t_destroy(objects);
     object_count = 0;
+
+    if(pool != NULL) {
+        if(pool_count(pool) > 0)
+            logfile_message("releasing %d pooled blocks...", pool_count(pool));
+        pool = pool_destroy(pool);
+    }
 }
 
 void entitymanager_store_brick(brick_t *brick)
@@ -132,6 +150,18 @@ void entitymanager_store_object(enemy_t *object)
     object_count++;
 }
 
+void entitymanager_set_world_size(int world_width, int world_height)
+{
+    if(bricks != NULL)
+        spatialhash_brick_t_resize(bricks, world_width, world_height);
+
+    if(items != NULL)
+        spatialhash_item_t_resize(items, world_width, world_height);
+
+    if(objects != NULL)
+        spatialhash_enemy_t_resize(objects, world_width, world_height);
+}
+
 void entitymanager_set_active_region(rect_t roi)
 {
     active_rectangle_xpos = roi.x;
@@ -194,6 +224,30 @@ enemy_list_t* entitymanager_retrieve_active_objects()
     return list;
 }
 
+item_t* entitymanager_find_closest_item(v2d_t position, int type, float *distance)
+{
+    itemquery_t query = { .position = position, .type = type };
+
+    if(items == NULL || item_count == 0) {
+        if(distance != NULL)
+            *distance = INFINITY;
+        return NULL;
+    }
+
+    return spatialhash_item_t_find_nearest(
+        items,
+        (int)position.x,
+        (int)position.y,
+        active_rectangle_xpos,
+        active_rectangle_ypos,
+        active_rectangle_width,
+        active_rectangle_height,
+        (void*)(&query),
+        item_distance,
+        distance
+    );
+}
+
 brick_list_t* entitymanager_retrieve_all_bricks()
 {
     brick_list_t *list = NULL;
@@ -257,6 +311,20 @@ enemy_list_t* entitymanager_release_retrieved_object_list(enemy_list_t *list)
     return NULL;
 }
 
+void* entitymanager_alloc(size_t bytes)
+{
+    if(pool == NULL)
+        pool = pool_create();
+
+    return pool_alloc(pool, bytes);
+}
+
+void entitymanager_free(void* ptr)
+{
+    if(ptr != NULL)
+        pool_free(pool, ptr);
+}
+
 int entitymanager_get_number_of_bricks()
 {
     return brick_count;
@@ -441,6 +509,16 @@ int retrieve_objects(enemy_t *object, void *ref_to_object_list)
     return 0;
 }
 
+float item_distance(item_t *item, void *query)
+{
+    const itemquery_t *q = (const itemquery_t*)query;
+
+    if(item->type != q->type)
+        return INFINITY;
+
+    return v2d_magnitude(v2d_subtract(item->actor->position, q->position));
+}
+
 void add_to_dead_bricks_list(brick_t *brick)
 {
     brick_list_t *it, *prev, *node;
@@ -22,7 +22,9 @@
 #ifndef _ENTITYMANAGER_H
 #define _ENTITYMANAGER_H
 
+#include <stddef.h>
 #include "../../util/rect.h"
+#include "../../util/v2d.h"
 
 /* forward declarations */
 struct brick_t;
@@ -42,12 +44,16 @@ void entitymanager_store_item(struct item_t *item);
 void entitymanager_store_object(struct enemy_t *object);
 
 /* retrieving active entities efficiently */
+void entitymanager_set_world_size(int world_width, int world_height); /* sizes the spatial grid from the bounds of the level */
 void entitymanager_set_active_region(rect_t roi);
 struct brick_list_t* entitymanager_retrieve_active_bricks();
 struct brick_list_t* entitymanager_retrieve_active_unmoving_bricks();
 struct item_list_t* entitymanager_retrieve_active_items();
 struct enemy_list_t* entitymanager_retrieve_active_objects();
 
+/* proximity queries among the active entities */
+struct item_t* entitymanager_find_closest_item(v2d_t position, int type, float *distance); /* type is an IT_* constant; distance may be NULL */
+
 /* retrieving all entities */
 struct brick_list_t* entitymanager_retrieve_all_bricks();
 struct item_list_t* entitymanager_retrieve_all_items();
@@ -63,6 +69,10 @@ void entitymanager_remove_dead_bricks();
 void entitymanager_remove_dead_items();
 void entitymanager_remove_dead_objects();
 
+/* memory of the legacy entities: pooled and released at once by entitymanager_release() */
+void* entitymanager_alloc(size_t bytes);
+void entitymanager_free(void* ptr);
+
 /* other utilities */
 int entitymanager_get_number_of_bricks();
 int entitymanager_get_number_of_items();
@@ -24,6 +24,7 @@
 
 #include "item.h"
 #include "enemy.h"
+#include "entitymanager.h"
 #include "../player.h"
 #include "../brick.h"
 #include "../actor.h"
@@ -49,7 +50,7 @@
 #include "../../physics/obstacle.h"
 
 /* private utilities */
-static item_t* find_closest_item(item_t *me, item_list_t *list, int desired_type, float *distance);
+static item_t* find_closest_item(item_t *me, int desired_type, float *distance);
 
 /* item functions */
 static item_t* animal_create();
@@ -557,6 +558,7 @@ item_t *item_create(int type)
             image_width(actor_image(item->actor)),
             image_height(actor_image(item->actor))
         ) : NULL;
+        item->mask_obstacle = NULL;
     }
     else
         fatal_error("Can't create item %d: item not found", type);
@@ -572,16 +574,42 @@ item_t *item_create(int type)
  */
 item_t* item_destroy(item_t *item)
 {
+    if(item->mask_obstacle != NULL)
+        obstacle_destroy(item->mask_obstacle);
     if(item->mask != NULL)
         collisionmask_destroy(item->mask);
     item->release(item);
-    free(item);
+    entitymanager_free(item);
     return NULL;
 }
 
 
 
 
+/*
+ * item_obstacle()
+ * Returns the obstacle associated with this item, or NULL if the item is
+ * not an obstacle. The obstacle is created once; only its position is
+ * updated afterwards
+ */
+const obstacle_t* item_obstacle(item_t *item)
+{
+    v2d_t position;
+
+    if(!item->obstacle || item->mask == NULL)
+        return NULL;
+
+    position = v2d_subtract(item->actor->position, item->actor->hot_spot);
+    if(item->mask_obstacle == NULL)
+        item->mask_obstacle = obstacle_create(item->mask, point2d_new(position.x, position.y), OL_DEFAULT, OF_NONSTATIC);
+    else
+        obstacle_set_position(item->mask_obstacle, point2d_new(position.x, position.y));
+
+    return item->mask_obstacle;
+}
+
+
+
 /*
  * item_render()
  * Renders an item
@@ -607,31 +635,14 @@ void item_update(item_t *item, player_t **team, int team_size, brick_list_t *bri
 
 /*
  * find_closest_item()
- * Finds the closest item (minimal distance) of
- * a given type relative to 'me'. Returns NULL
+ * Finds the closest active item (minimal distance)
+ * of a given type relative to 'me'. Returns NULL
  * if nothing nice is found.
  */
-item_t *find_closest_item(item_t *me, item_list_t *list, int desired_type, float *distance)
+item_t *find_closest_item(item_t *me, int desired_type, float *distance)
 {
-    float min_dist = INFINITY;
-    item_list_t *it;
-    item_t *ret = NULL;
-    v2d_t v;
-
-    for(it=list; it; it=it->next) { /* this list must be small enough */
-        if(it->data->type == desired_type) {
-            v = v2d_subtract(it->data->actor->position, me->actor->position);
-            if(v2d_magnitude(v) < min_dist) {
-                ret = it->data;
-                min_dist = v2d_magnitude(v);
-            }
-        }
-    }
-
-    if(distance)
-        *distance = min_dist;
-
-    return ret;
+    /* only the nearby cells of the spatial hash are scanned */
+    return entitymanager_find_closest_item(me->actor->position, desired_type, distance);
 }
 
 
@@ -656,7 +667,7 @@ static void animal_render(item_t* item, v2d_t camera_position);
 /* public methods */
 item_t* animal_create()
 {
-    item_t *item = mallocx(sizeof(animal_t));
+    item_t *item = entitymanager_alloc(sizeof(animal_t));
 
     item->init = animal_init;
     item->release = animal_release;
@@ -705,7 +716,8 @@ void animal_update(item_t* item, player_t** team, int team_size, brick_list_t* b
        we adopt this simplified platform system */
     int rx, ry, rw, rh, bx, by, bw, bh, j;
     const image_t *ri;
-    brick_list_t *it;
+    brick_t* const* brick;
+    int k, brick_count;
     enum { NONE, FLOOR, RIGHTWALL, CEILING, LEFTWALL } bounce = NONE;
     const obstacle_t* bo;
 
@@ -716,13 +728,14 @@ void animal_update(item_t* item, player_t** team, int team_size, brick_list_t* b
     rh = image_height(ri);
 
     /* check for collisions */
-    for(it = brick_list; it != NULL && bounce == NONE; it = it->next) {
-        bo = brick_obstacle(it->data);
-        if(bo && brick_type(it->data) != BRK_PASSABLE) {
-            bx = brick_position(it->data).x;
-            by = brick_position(it->data).y;
-            bw = brick_size(it->data).x;
-            bh = brick_size(it->data).y;
+    brick = level_legacy_bricks_in_rect(rx, ry, rw, rh, &brick_count);
+    for(k = brick_count - 1; k >= 0 && bounce == NONE; k--) {
+        bo = brick_obstacle(brick[k]);
+        if(bo && brick_type(brick[k]) != BRK_PASSABLE) {
+            bx = brick_position(brick[k]).x;
+            by = brick_position(brick[k]).y;
+            bw = brick_size(brick[k]).x;
+            bh = brick_size(brick[k]).y;
 
             if(rx<bx+bw && rx+rw>bx && ry<by+bh && ry+rh>by) {
                 if(obstacle_got_collision(bo, rx, ry+rh/2, rx, ry+rh/2)) {
@@ -896,7 +909,7 @@ static int animalprison_got_hit_by_player(item_t *item, player_t *player);
 /* public methods */
 item_t* animalprison_create()
 {
-    item_t *item = mallocx(sizeof(animalprison_t));
+    item_t *item = entitymanager_alloc(sizeof(animalprison_t));
     animalprison_t *me = (animalprison_t*)item;
 
     item->init = animalprison_init;
@@ -1112,7 +1125,7 @@ static void bigring_render(item_t* item, v2d_t camera_position);
 /* public methods */
 item_t* bigring_create()
 {
-    item_t *item = mallocx(sizeof(bigring_t));
+    item_t *item = entitymanager_alloc(sizeof(bigring_t));
 
     item->init = bigring_init;
     item->release = bigring_release;
@@ -1185,7 +1198,7 @@ static void bouncingcollectible_render(item_t* item, v2d_t camera_position);
 /* public methods */
 item_t* bouncingcollectible_create()
 {
-    item_t *item = mallocx(sizeof(bouncingcollectible_t));
+    item_t *item = entitymanager_alloc(sizeof(bouncingcollectible_t));
 
     item->init = bouncingcollectible_init;
     item->release = bouncingcollectible_release;
@@ -1267,7 +1280,8 @@ void bouncingcollectible_update(item_t* item, player_t** team, int team_size, br
            we adopt this simplified platform system */
         int rx, ry, rw, rh, bx, by, bw, bh, j;
         const image_t *ri;
-        brick_list_t *it;
+        brick_t* const* brick;
+        int k, brick_count;
         enum { NONE, FLOOR, RIGHTWALL, CEILING, LEFTWALL } bounce = NONE;
         const obstacle_t* bo;
 
@@ -1282,13 +1296,14 @@ void bouncingcollectible_update(item_t* item, player_t** team, int team_size, br
             item->state = IS_DEAD;
 
         /* check for collisions */
-        for(it = brick_list; it != NULL && bounce == NONE; it = it->next) {
-            bo = brick_obstacle(it->data);
-            if(bo && brick_type(it->data) != BRK_PASSABLE) {
-                bx = brick_position(it->data).x;
-                by = brick_position(it->data).y;
-                bw = brick_size(it->data).x;
-                bh = brick_size(it->data).y;
+        brick = level_legacy_bricks_in_rect(rx, ry, rw, rh, &brick_count);
+        for(k = brick_count - 1; k >= 0 && bounce == NONE; k--) {
+            bo = brick_obstacle(brick[k]);
+            if(bo && brick_type(brick[k]) != BRK_PASSABLE) {
+                bx = brick_position(brick[k]).x;
+                by = brick_position(brick[k]).y;
+                bw = brick_size(brick[k]).x;
+                bh = brick_size(brick[k]).y;
 
                 if(rx<bx+bw && rx+rw>bx && ry<by+bh && ry+rh>by) {
                     if(obstacle_got_collision(bo, rx, ry+rh/2, rx, ry+rh/2)) {
@@ -1396,7 +1411,7 @@ static void bump(item_t *bumper, player_t *player);
 /* public methods */
 item_t* bumper_create()
 {
-    item_t *item = mallocx(sizeof(bumper_t));
+    item_t *item = entitymanager_alloc(sizeof(bumper_t));
 
     item->init = bumper_init;
     item->release = bumper_release;
@@ -1530,7 +1545,7 @@ static void checkpointorb_render(item_t* item, v2d_t camera_position);
 /* public methods */
 item_t* checkpointorb_create()
 {
-    item_t *item = mallocx(sizeof(checkpointorb_t));
+    item_t *item = entitymanager_alloc(sizeof(checkpointorb_t));
 
     item->init = checkpointorb_init;
     item->release = checkpointorb_release;
@@ -1615,7 +1630,7 @@ static void collectible_render(item_t* item, v2d_t camera_position);
 /* public methods */
 item_t* collectible_create()
 {
-    item_t *item = mallocx(sizeof(collectible_t));
+    item_t *item = entitymanager_alloc(sizeof(collectible_t));
 
     item->init = collectible_init;
     item->release = collectible_release;
@@ -1733,7 +1748,7 @@ static void crushedbox_render(item_t* item, v2d_t camera_position);
 /* public methods */
 item_t* crushedbox_create()
 {
-    item_t *item = mallocx(sizeof(crushedbox_t));
+    item_t *item = entitymanager_alloc(sizeof(crushedbox_t));
 
     item->init = crushedbox_init;
     item->release = crushedbox_release;
@@ -1821,7 +1836,7 @@ item_t* verticalfiredanger_create()
 /* private methods */
 item_t* danger_create(const char *sprite_name, int (*player_is_vulnerable)(player_t*))
 {
-    item_t *item = mallocx(sizeof(danger_t));
+    item_t *item = entitymanager_alloc(sizeof(danger_t));
     danger_t *me = (danger_t*)item;
 
     item->init = danger_init;
@@ -1947,7 +1962,7 @@ item_t* charge_horizontal_dnadoor_create()
 /* private methods */
 item_t* dnadoor_create(const char *authorized_player_name, int is_vertical_door)
 {
-    item_t *item = mallocx(sizeof(dnadoor_t));
+    item_t *item = entitymanager_alloc(sizeof(dnadoor_t));
     dnadoor_t *me = (dnadoor_t*)item;
 
     item->init = dnadoor_init;
@@ -2107,7 +2122,7 @@ static void door_render(item_t* item, v2d_t camera_position);
 /* public methods */
 item_t* door_create()
 {
-    item_t *item = mallocx(sizeof(door_t));
+    item_t *item = entitymanager_alloc(sizeof(door_t));
 
     item->init = door_init;
     item->release = door_release;
@@ -2194,7 +2209,7 @@ static void endsign_render(item_t* item, v2d_t camera_position);
 /* public methods */
 item_t* endsign_create()
 {
-    item_t *item = mallocx(sizeof(endsign_t));
+    item_t *item = entitymanager_alloc(sizeof(endsign_t));
 
     item->init = endsign_init;
     item->release = endsign_release;
@@ -2291,7 +2306,7 @@ static void explosion_render(item_t* item, v2d_t camera_position);
 /* public methods */
 item_t* explosion_create()
 {
-    item_t *item = mallocx(sizeof(explosion_t));
+    item_t *item = entitymanager_alloc(sizeof(explosion_t));
 
     item->init = explosion_init;
     item->release = explosion_release;
@@ -2356,7 +2371,7 @@ static void flyingtext_render(item_t* item, v2d_t camera_position);
 /* public methods */
 item_t* flyingtext_create()
 {
-    item_t *item = mallocx(sizeof(flyingtext_t));
+    item_t *item = entitymanager_alloc(sizeof(flyingtext_t));
 
     item->init = flyingtext_init;
     item->release = flyingtext_release;
@@ -2449,7 +2464,7 @@ static void goalsign_render(item_t* item, v2d_t camera_position);
 /* public methods */
 item_t* goalsign_create()
 {
-    item_t *item = mallocx(sizeof(goalsign_t));
+    item_t *item = entitymanager_alloc(sizeof(goalsign_t));
 
     item->init = goalsign_init;
     item->release = goalsign_release;
@@ -2486,7 +2501,7 @@ void goalsign_update(item_t* item, player_t** team, int team_size, brick_list_t*
     item_t *endsign;
     int anim;
 
-    endsign = find_closest_item(item, item_list, IT_ENDSIGN, NULL);
+    endsign = find_closest_item(item, IT_ENDSIGN, NULL);
     if(endsign != NULL) {
         if(endsign->actor->position.x > item->actor->position.x)
             anim = 0;
@@ -2524,7 +2539,7 @@ static void icon_render(item_t* item, v2d_t camera_position);
 /* public methods */
 item_t* icon_create()
 {
-    item_t *item = mallocx(sizeof(icon_t));
+    item_t *item = entitymanager_alloc(sizeof(icon_t));
 
     item->init = icon_init;
     item->release = icon_release;
@@ -2656,11 +2671,13 @@ item_t* collectiblebox_create()
 
 item_t* starbox_create()
 {
+    music_prefetch("musics/invincible.ogg"); /* avoid a hitch when the box is broken */
     return itembox_create(starbox_strategy, 4);
 }
 
 item_t* speedbox_create()
 { 
+   music_prefetch("musics/speed.ogg");
    return itembox_create(speedbox_strategy, 5);
 }
 
@@ -2801,7 +2818,7 @@ void emptybox_strategy(item_t *item, player_t *player)
 /* private methods */
 item_t* itembox_create(void (*on_destroy)(item_t*,player_t*), int anim_id)
 {
-    item_t *item = mallocx(sizeof(itembox_t));
+    item_t *item = entitymanager_alloc(sizeof(itembox_t));
     itembox_t *me = (itembox_t*)item;
 
     item->init = itembox_init;
@@ -2917,7 +2934,7 @@ item_t* loopyellow_create()
 /* private methods */
 item_t* loop_create(const char *sprite_name, bricklayer_t layer_to_be_activated)
 {
-    loop_t *me = mallocx(sizeof *me);
+    loop_t *me = entitymanager_alloc(sizeof *me);
     item_t *item = (item_t*)me;
 
     item->init = loop_init;
@@ -3103,7 +3120,7 @@ void loopfloortop_strategy(player_t *player)
 /* private methods */
 item_t* oldloop_create(void (*strategy)(player_t*), const char *sprite_name)
 {
-    item_t *item = mallocx(sizeof(oldloop_t));
+    item_t *item = entitymanager_alloc(sizeof(oldloop_t));
     oldloop_t *me = (oldloop_t*)item;
 
     item->init = oldloop_init;
@@ -3220,7 +3237,7 @@ item_t* periodic_rightwallspikes_create()
 /* private methods */
 item_t* spikes_create(int (*collision)(item_t*,player_t*), int anim_id, float cycle_length)
 {
-    item_t *item = mallocx(sizeof(spikes_t));
+    item_t *item = entitymanager_alloc(sizeof(spikes_t));
     spikes_t *me = (spikes_t*)item;
 
     item->init = spikes_init;
@@ -3545,7 +3562,7 @@ void classicspring_strategy(item_t *item, player_t *player)
 /* private methods */
 item_t* spring_create(void (*strategy)(item_t*,player_t*), const char *sprite_name, v2d_t strength)
 {
-    item_t *item = mallocx(sizeof(spring_t));
+    item_t *item = entitymanager_alloc(sizeof(spring_t));
     spring_t *me = (spring_t*)item;
 
     item->init = spring_init;
@@ -3729,7 +3746,7 @@ static void supercollectible_render(item_t* item, v2d_t camera_position);
 /* public methods */
 item_t* supercollectible_create()
 {
-    item_t *item = mallocx(sizeof(supercollectible_t));
+    item_t *item = entitymanager_alloc(sizeof(supercollectible_t));
 
     item->init = supercollectible_init;
     item->release = supercollectible_release;
@@ -3826,7 +3843,7 @@ static void stepout_teleporter(item_t *teleporter);
 /* public methods */
 item_t* switch_create()
 {
-    item_t *item = mallocx(sizeof(switch_t));
+    item_t *item = entitymanager_alloc(sizeof(switch_t));
 
     item->init = switch_init;
     item->release = switch_release;
@@ -3872,8 +3889,8 @@ void switch_update(item_t* item, player_t** team, int team_size, brick_list_t* b
     me->partner = NULL;
 
     /* figuring out who is my partner */
-    door = find_closest_item(item, item_list, IT_DOOR, &d1);
-    teleporter = find_closest_item(item, item_list, IT_TELEPORTER, &d2);
+    door = find_closest_item(item, IT_DOOR, &d1);
+    teleporter = find_closest_item(item, IT_TELEPORTER, &d2);
     if(door != NULL && d1 < d2)
         me->partner = door;
     if(teleporter != NULL && d2 < d1)
@@ -4011,7 +4028,7 @@ static void teleport_player_to(player_t *player, v2d_t position);
 /* public methods */
 item_t* teleporter_create()
 {
-    item_t *item = mallocx(sizeof(teleporter_t));
+    item_t *item = entitymanager_alloc(sizeof(teleporter_t));
 
     item->init = teleporter_init;
     item->release = teleporter_release;
@@ -115,6 +115,7 @@
 struct actor_t;
 struct player_t;
 struct collisionmask_t;
+struct obstacle_t;
 struct brick_list_t;
 struct item_list_t;
 struct enemy_list_t;
@@ -145,6 +146,7 @@ struct item_t {
     int bring_to_back; /* TODO: z-index?? */
     int always_active; /* always active? */
     struct collisionmask_t* mask; /* collision mask */
+    struct obstacle_t* mask_obstacle; /* obstacle built from the collision mask (cached) */
 };
 
 /* linked list of items */
@@ -158,6 +160,7 @@ item_t *item_create(int type); /* this is an item factory; type is an IT_* const
 item_t* item_destroy(item_t *item);
 void item_update(item_t *item, struct player_t** team, int team_size, struct brick_list_t *brick_list, struct item_list_t *item_list, struct enemy_list_t *enemy_list);
 void item_render(item_t *item, v2d_t camera_position);
+const struct obstacle_t* item_obstacle(item_t *item); /* the obstacle of this item, or NULL if it's not an obstacle */
 
 /* item-specific functions (legacy stuff) */
 void bouncingcollectible_set_velocity(item_t *item, v2d_t velocity);
@@ -40,6 +40,7 @@ static void (*error_fun)(const char*) = NULL;
 static void* malloc_x(size_t bytes); /* our version of malloc */
 static char* str_dup(const char *s); /* our version of strdup: duplicates s */
 static void float2string(float f, char *buf, size_t buf_size);
+static size_t interpolate(const char *str, symboltable_t *symbol_table, char *buf, size_t buf_size);
 
 char* str_dup(const char *s)
 {
@@ -72,17 +73,30 @@ void float2string(float f, char *buf, size_t buf_size)
    by their values. You need to free() the string returned by this function */
 char *nanocalc_interpolate_string(const char *str, symboltable_t *symbol_table)
 {
-    char *result = malloc_x(sizeof(char) * 10241), *r;
+    char *result = malloc_x(sizeof(char) * 10241);
+    interpolate(str, symbol_table, result, 10241);
+    return (char*)realloc(result, sizeof(char) * (1+strlen(result)));
+}
+
+/* interpolates the given string into a buffer of buf_size bytes (truncating
+   it if necessary), without allocating memory. Returns buf */
+char *nanocalc_interpolate_string_buffer(const char *str, symboltable_t *symbol_table, char *buf, size_t buf_size)
+{
+    interpolate(str, symbol_table, buf, buf_size);
+    return buf;
+}
+
+/* writes the interpolated string (truncated if necessary) into buf and returns
+   its full length, not counting the terminating null character (like snprintf) */
+size_t interpolate(const char *str, symboltable_t *symbol_table, char *buf, size_t buf_size)
+{
     char varname[65], varvalue[65];
     const char *p, *q;
-    int i, j;
-
-    /* initializing... */
-    *result = 0;
-    r = result;
+    size_t j = 0;
+    int i;
 
     /* looking for variables */
-    for(p=str, j=0; *p && j<10240; ) {
+    for(p=str; *p; ) {
         if(*p == '$') {
             if(isalpha((unsigned char)*(p+1)) || (*(p+1) == '_')) {
                 varname[0] = *p;
@@ -92,28 +106,35 @@ char *nanocalc_interpolate_string(const char *str, symboltable_t *symbol_table)
 
                 if(symboltable_is_defined(symbol_table, varname)) {
                     float2string(symboltable_get(symbol_table, varname), varvalue, sizeof(varvalue));
-                    for(q=varvalue; *q && j++<10240; )
-                        *(r++) = *(q++);
+                    for(q=varvalue; *q; j++, q++) {
+                        if(j+1 < buf_size)
+                            buf[j] = *q;
+                    }
                     p += strlen(varname);
                     continue;
                 }
             }
         }
 
-        *(r++) = *(p++);
-        j++;
+        if(j+1 < buf_size)
+            buf[j] = *p;
+        p++; j++;
     }
 
     /* ok */
-    *r = 0;
-    return (char*)realloc(result, sizeof(char) * (1+strlen(result)));
+    if(buf_size > 0)
+        buf[j < buf_size ? j : buf_size-1] = 0;
+
+    return j;
 }
 
 
 
 /* ============ SYMBOL TABLE ============== */
 
-/* data structure: variables are stored in a linked list */
+/* data structure: variables referenced by compiled expressions are stored
+   in slots, which are resolved at compile time. Other variables (dynamic
+   names) are stored in a linked list. A variable is stored in one place only */
 /* we estimate that each symbol table in an object will hold a small number of variables */
 typedef struct association_t association_t;
 struct association_t {
@@ -122,25 +143,47 @@ struct association_t {
     association_t *next;
 };
 
+typedef struct symbolslot_t symbolslot_t;
+struct symbolslot_t {
+    char *key; /* kept when the symbol table is cleared */
+    float value;
+    int defined;
+};
+
 struct symboltable_t {
-    association_t *data;
+    association_t *data; /* dynamic names */
+    symbolslot_t *slot; /* resolved names */
+    int slot_count, slot_capacity;
+    unsigned version; /* incremented whenever the table is modified */
 };
 
 static symboltable_t* global_st = NULL; /* fixed, global symbol table */
 #define IS_GLOBAL_VARIABLE(varname) (*((varname)+1) == '_') /* vars starting with '_' are global */
+static int symboltable_find_slot(const symboltable_t *st, const char *key);
+static int symboltable_resolve(symboltable_t *st, const char *key);
 
 /* creates a new symbol table */
 symboltable_t *symboltable_new()
 {
     symboltable_t *st = malloc_x(sizeof *st);
     st->data = NULL;
+    st->slot = NULL;
+    st->slot_count = st->slot_capacity = 0;
+    st->version = 0;
     return st;
 }
 
 /* destroys an existing symbol table */
 void symboltable_destroy(symboltable_t *st)
 {
+    int i;
+
     symboltable_clear(st);
+
+    for(i=0; i<st->slot_count; i++)
+        free(st->slot[i].key);
+    free(st->slot);
+
     free(st);
 }
 
@@ -148,6 +191,7 @@ void symboltable_destroy(symboltable_t *st)
 void symboltable_clear(symboltable_t *st)
 {
     association_t *node, *next;
+    int i;
 
     for(node=st->data; node!=NULL; node=next) {
         next = node->next;
@@ -156,17 +200,33 @@ void symboltable_clear(symboltable_t *st)
     }
 
     st->data = NULL;
+    st->version++;
+
+    /* compiled expressions still refer to the slots */
+    for(i=0; i<st->slot_count; i++) {
+        st->slot[i].value = 0.0f;
+        st->slot[i].defined = 0;
+    }
 }
 
 /* adds or updates an association */
 void symboltable_set(symboltable_t *st, const char *key, float value)
 {
     association_t *node, *prev = NULL;
+    int i;
 
     /* global variable? */
     if(IS_GLOBAL_VARIABLE(key))
         st = symboltable_get_global_table();
     if(!st) return;
+    st->version++;
+
+    /* resolved name? */
+    if((i = symboltable_find_slot(st, key)) >= 0) {
+        st->slot[i].value = value;
+        st->slot[i].defined = 1;
+        return;
+    }
 
     /* searching... */
     for(node=st->data; node!=NULL; node=node->next) {
@@ -192,12 +252,17 @@ void symboltable_set(symboltable_t *st, const char *key, float value)
 float symboltable_get(symboltable_t *st, const char *key)
 {
     association_t *node;
+    int i;
 
     /* global variable? */
     if(IS_GLOBAL_VARIABLE(key))
         st = symboltable_get_global_table();
     if(!st) return 0.0f;
 
+    /* resolved name? */
+    if((i = symboltable_find_slot(st, key)) >= 0)
+        return st->slot[i].value;
+
     /* searching... */
     if(!IS_GLOBAL_VARIABLE(key)) {
         /* linear search */
@@ -232,12 +297,17 @@ float symboltable_get(symboltable_t *st, const char *key)
 int symboltable_is_defined(symboltable_t *st, const char *key)
 {
     association_t *node;
+    int i;
 
     /* global variable? */
     if(IS_GLOBAL_VARIABLE(key))
         st = symboltable_get_global_table();
     if(!st) return 0;
 
+    /* resolved name? */
+    if((i = symboltable_find_slot(st, key)) >= 0)
+        return st->slot[i].defined;
+
     /* searching... */
     for(node=st->data; node!=NULL; node=node->next) {
         if(strcmp(node->key, key) == 0)
@@ -253,6 +323,77 @@ symboltable_t *symboltable_get_global_table()
     return global_st;
 }
 
+/* a counter that changes whenever the symbol table is modified */
+unsigned symboltable_version(const symboltable_t *st)
+{
+    return st->version;
+}
+
+/* finds the slot of a resolved name, returning -1 if there is none */
+int symboltable_find_slot(const symboltable_t *st, const char *key)
+{
+    int i;
+
+    for(i=0; i<st->slot_count; i++) {
+        if(strcmp(st->slot[i].key, key) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+/* resolves a name to a fixed slot index, moving it out of the linked list if needed */
+int symboltable_resolve(symboltable_t *st, const char *key)
+{
+    association_t *node, *prev = NULL;
+    symbolslot_t *slot;
+    int i;
+
+    /* already resolved? */
+    if((i = symboltable_find_slot(st, key)) >= 0)
+        return i;
+
+    /* grow the array of slots */
+    if(st->slot_count >= st->slot_capacity) {
+        int capacity = st->slot_capacity > 0 ? 2 * st->slot_capacity : 8;
+        symbolslot_t *new_slot = realloc(st->slot, capacity * sizeof *new_slot);
+        if(new_slot == NULL) {
+            error(__FILE__ ": Out of memory");
+            exit(1);
+        }
+
+        st->slot = new_slot;
+        st->slot_capacity = capacity;
+    }
+
+    /* create a new slot */
+    i = st->slot_count++;
+    slot = &st->slot[i];
+    slot->key = str_dup(key);
+    slot->value = 0.0f;
+    slot->defined = 0;
+
+    /* the variable may have been defined already */
+    for(node=st->data; node!=NULL; node=node->next) {
+        if(strcmp(node->key, key) == 0) {
+            slot->value = node->value;
+            slot->defined = 1;
+
+            if(prev != NULL)
+                prev->next = node->next;
+            else
+                st->data = node->next;
+
+            free(node->key);
+            free(node);
+            break;
+        }
+        prev = node;
+    }
+
+    return i;
+}
+
 
 
 
@@ -437,15 +578,32 @@ typedef struct exprtree_variable_t exprtree_variable_t;
 struct exprtree_variable_t {
     exprtree_t base;
     char *variable_name;
-    symboltable_t *symbol_table; /* pointer to the symbol table */
+    symboltable_t *symbol_table; /* pointer to the symbol table (the global one for global variables) */
+    int slot; /* resolved at compile time; -1 if there is no symbol table */
 };
 
 static float exprtree_variable_eval(exprtree_t *tree)
 {
     exprtree_variable_t *node = (exprtree_variable_t*)tree;
+
+    if(node->slot >= 0)
+        return node->symbol_table->slot[node->slot].value;
+
     return symboltable_get(node->symbol_table, node->variable_name);
 }
 
+static void exprtree_variable_assign(exprtree_variable_t *node, float value)
+{
+    if(node->slot >= 0) {
+        symbolslot_t *slot = &(node->symbol_table->slot[node->slot]);
+        slot->value = value;
+        slot->defined = 1;
+        node->symbol_table->version++;
+    }
+    else
+        symboltable_set(node->symbol_table, node->variable_name, value);
+}
+
 static void exprtree_variable_delete(exprtree_t *tree)
 {
     free(((exprtree_variable_t*)tree)->variable_name);
@@ -456,7 +614,13 @@ static exprtree_t *exprtree_variable_new(const char *variable_name, symboltable_
 {
     exprtree_variable_t *node = malloc_x(sizeof *node);
     node->variable_name = str_dup(variable_name);
+
+    /* resolve the variable to a slot */
+    if(IS_GLOBAL_VARIABLE(variable_name))
+        symbol_table = symboltable_get_global_table();
     node->symbol_table = symbol_table;
+    node->slot = (symbol_table != NULL) ? symboltable_resolve(symbol_table, variable_name) : -1;
+
     ((exprtree_t*)node)->eval = exprtree_variable_eval;
     ((exprtree_t*)node)->del = exprtree_variable_delete;
     return (exprtree_t*)node;
@@ -633,7 +797,7 @@ static float exprtree_assignmentop_eval(exprtree_t *tree)
     else
         error("Can't evaluate expression: invalid assignment operator '%s'", op);
 
-    symboltable_set(var_derived->symbol_table, var_derived->variable_name, value);
+    exprtree_variable_assign(var_derived, value);
     return value;
 }
 
@@ -777,6 +941,379 @@ static exprtree_t* exprtree_function_arity4_new(float (*fun)(float,float,float,f
 
 
 
+/* =============== BYTECODE ============================ */
+/* expression trees are compiled into postfix bytecode, which is evaluated by a stack machine */
+#define BYTECODE_MAX_STACK 64 /* deeper expressions are evaluated using the tree */
+
+typedef enum {
+    OP_CONST,               /* push a constant */
+    OP_LOAD,                /* push a resolved variable */
+    OP_STORE,               /* store the top of the stack in a resolved variable */
+    OP_LOAD_NAME,           /* push a variable by name */
+    OP_STORE_NAME,          /* store the top of the stack in a variable by name */
+    OP_POP,                 /* discard the top of the stack */
+    OP_SWAP,                /* swap the two values at the top of the stack */
+    OP_NEG,                 /* unary operators */
+    OP_NOT,
+    OP_TRUTH,               /* convert to a boolean (0 or 1) */
+    OP_AND,                 /* short-circuit: if false, replace by 0 and jump; otherwise pop */
+    OP_OR,                  /* short-circuit: if true, replace by 1 and jump; otherwise pop */
+    OP_ADD,                 /* binary operators */
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+    OP_POW,
+    OP_SIGNED_POW,          /* used by ^= */
+    OP_EQ,
+    OP_NE,
+    OP_GT,
+    OP_LT,
+    OP_GE,
+    OP_LE,
+    OP_CALL0,               /* built-in function calls */
+    OP_CALL1,
+    OP_CALL2,
+    OP_CALL3,
+    OP_CALL4
+} opcode_t;
+
+typedef struct instruction_t instruction_t;
+struct instruction_t {
+    opcode_t opcode;
+    union {
+        float value; /* OP_CONST */
+        struct { symboltable_t *st; int slot; } var; /* OP_LOAD, OP_STORE */
+        exprtree_variable_t *node; /* OP_LOAD_NAME, OP_STORE_NAME */
+        int target; /* OP_AND, OP_OR: index of the instruction we jump to */
+        bif_t fun; /* OP_CALL* */
+    } arg;
+};
+
+typedef struct bytecode_t bytecode_t;
+struct bytecode_t {
+    instruction_t *code;
+    int length, capacity;
+    int depth, max_depth; /* stack depth */
+};
+
+static int bytecode_emit(bytecode_t *bc, opcode_t opcode, int stack_effect)
+{
+    instruction_t *in;
+
+    if(bc->length >= bc->capacity) {
+        int capacity = bc->capacity > 0 ? 2 * bc->capacity : 8;
+        instruction_t *code = realloc(bc->code, capacity * sizeof *code);
+        if(code == NULL) {
+            error(__FILE__ ": Out of memory");
+            exit(1);
+        }
+
+        bc->code = code;
+        bc->capacity = capacity;
+    }
+
+    bc->depth += stack_effect;
+    if(bc->depth > bc->max_depth)
+        bc->max_depth = bc->depth;
+
+    in = &(bc->code[bc->length]);
+    in->opcode = opcode;
+    return bc->length++;
+}
+
+static void bytecode_emit_const(bytecode_t *bc, float value)
+{
+    int i = bytecode_emit(bc, OP_CONST, +1);
+    bc->code[i].arg.value = value;
+}
+
+static void bytecode_emit_variable(bytecode_t *bc, exprtree_variable_t *node, int store)
+{
+    int i;
+
+    if(node->slot >= 0) {
+        i = bytecode_emit(bc, store ? OP_STORE : OP_LOAD, store ? 0 : +1);
+        bc->code[i].arg.var.st = node->symbol_table;
+        bc->code[i].arg.var.slot = node->slot;
+    }
+    else {
+        i = bytecode_emit(bc, store ? OP_STORE_NAME : OP_LOAD_NAME, store ? 0 : +1);
+        bc->code[i].arg.node = node;
+    }
+}
+
+/* a tree is constant if it has no variables and no function calls (which may not be pure) */
+static int exprtree_is_constant(exprtree_t *tree)
+{
+    if(tree->eval == exprtree_number_eval)
+        return 1;
+    else if(tree->eval == exprtree_unaryop_eval)
+        return exprtree_is_constant(((exprtree_unaryop_t*)tree)->expression);
+    else if(tree->eval == exprtree_binaryop_eval)
+        return exprtree_is_constant(((exprtree_binaryop_t*)tree)->left_expr) &&
+               exprtree_is_constant(((exprtree_binaryop_t*)tree)->right_expr);
+    else
+        return 0;
+}
+
+static opcode_t binaryop_opcode(const char *op)
+{
+    if(strcmp(op, "+") == 0)
+        return OP_ADD;
+    else if(strcmp(op, "-") == 0)
+        return OP_SUB;
+    else if(strcmp(op, "*") == 0)
+        return OP_MUL;
+    else if(strcmp(op, "/") == 0)
+        return OP_DIV;
+    else if(strcmp(op, "mod") == 0)
+        return OP_MOD;
+    else if(strcmp(op, "^") == 0)
+        return OP_POW;
+    else if(strcmp(op, "==") == 0)
+        return OP_EQ;
+    else if(strcmp(op, "<>") == 0)
+        return OP_NE;
+    else if(strcmp(op, ">") == 0)
+        return OP_GT;
+    else if(strcmp(op, "<") == 0)
+        return OP_LT;
+    else if(strcmp(op, ">=") == 0)
+        return OP_GE;
+    else if(strcmp(op, "<=") == 0)
+        return OP_LE;
+
+    error("Can't compile expression: invalid binary operator '%s'", op);
+    return OP_ADD;
+}
+
+/* compiles a tree, leaving its value on the stack */
+static void bytecode_compile(bytecode_t *bc, exprtree_t *tree)
+{
+    int i;
+
+    /* constant folding */
+    if(exprtree_is_constant(tree)) {
+        bytecode_emit_const(bc, tree->eval(tree));
+        return;
+    }
+
+    /* variable */
+    if(tree->eval == exprtree_variable_eval) {
+        bytecode_emit_variable(bc, (exprtree_variable_t*)tree, 0);
+    }
+
+    /* unary operator */
+    else if(tree->eval == exprtree_unaryop_eval) {
+        exprtree_unaryop_t *node = (exprtree_unaryop_t*)tree;
+        bytecode_compile(bc, node->expression);
+
+        if(strcmp(node->operator, "-") == 0)
+            bytecode_emit(bc, OP_NEG, 0);
+        else if(strcmp(node->operator, "not") == 0)
+            bytecode_emit(bc, OP_NOT, 0);
+        else
+            error("Can't compile expression: invalid unary operator '%s'", node->operator);
+    }
+
+    /* binary operator */
+    else if(tree->eval == exprtree_binaryop_eval) {
+        exprtree_binaryop_t *node = (exprtree_binaryop_t*)tree;
+        const char *op = node->operator;
+
+        bytecode_compile(bc, node->left_expr);
+        if(strcmp(op, "and") == 0 || strcmp(op, "or") == 0) {
+            i = bytecode_emit(bc, (*op == 'a') ? OP_AND : OP_OR, -1);
+            bytecode_compile(bc, node->right_expr);
+            bytecode_emit(bc, OP_TRUTH, 0);
+            bc->code[i].arg.target = bc->length;
+        }
+        else if(strcmp(op, ",") == 0) {
+            bytecode_emit(bc, OP_POP, -1);
+            bytecode_compile(bc, node->right_expr);
+        }
+        else {
+            bytecode_compile(bc, node->right_expr);
+            bytecode_emit(bc, binaryop_opcode(op), -1);
+        }
+    }
+
+    /* assignment operator */
+    else if(tree->eval == exprtree_assignmentop_eval) {
+        exprtree_assignmentop_t *node = (exprtree_assignmentop_t*)tree;
+        const char *op = node->operator;
+
+        if(strcmp(op, "=") == 0) {
+            bytecode_compile(bc, node->right_expr);
+        }
+        else if(strcmp(op, "+=") == 0 || strcmp(op, "-=") == 0 || strcmp(op, "*=") == 0) {
+            bytecode_emit_variable(bc, node->left_expr, 0);
+            bytecode_compile(bc, node->right_expr);
+            bytecode_emit(bc, (*op == '+') ? OP_ADD : ((*op == '-') ? OP_SUB : OP_MUL), -1);
+        }
+        else if(strcmp(op, "/=") == 0 || strcmp(op, "^=") == 0) {
+            /* the right side is evaluated first */
+            bytecode_compile(bc, node->right_expr);
+            bytecode_emit_variable(bc, node->left_expr, 0);
+            bytecode_emit(bc, OP_SWAP, 0);
+            bytecode_emit(bc, (*op == '/') ? OP_DIV : OP_SIGNED_POW, -1);
+        }
+        else
+            error("Can't compile expression: invalid assignment operator '%s'", op);
+
+        bytecode_emit_variable(bc, node->left_expr, 1);
+    }
+
+    /* built-in function call */
+    else if(tree->eval == exprtree_function_eval) {
+        exprtree_function_t *node = (exprtree_function_t*)tree;
+        int arity = node->fun.arity;
+
+        for(i=0; i<arity; i++)
+            bytecode_compile(bc, node->param[i]);
+
+        i = bytecode_emit(bc, (opcode_t)(OP_CALL0 + arity), 1 - arity);
+        bc->code[i].arg.fun = node->fun;
+    }
+
+    /* unknown node */
+    else
+        bytecode_emit_const(bc, tree->eval(tree));
+}
+
+/* runs the bytecode */
+static float bytecode_run(const bytecode_t *bc)
+{
+    const instruction_t *code = bc->code, *in;
+    float stack[BYTECODE_MAX_STACK];
+    int pc = 0, sp = 0; /* sp is the number of values in the stack */
+    symbolslot_t *slot;
+    float x, y;
+
+    while(pc < bc->length) {
+        in = &code[pc++];
+
+        switch(in->opcode) {
+        case OP_CONST:
+            stack[sp++] = in->arg.value;
+            break;
+
+        case OP_LOAD:
+            stack[sp++] = in->arg.var.st->slot[in->arg.var.slot].value;
+            break;
+
+        case OP_STORE:
+            slot = &(in->arg.var.st->slot[in->arg.var.slot]);
+            slot->value = stack[sp-1];
+            slot->defined = 1;
+            in->arg.var.st->version++;
+            break;
+
+        case OP_LOAD_NAME:
+            stack[sp++] = symboltable_get(in->arg.node->symbol_table, in->arg.node->variable_name);
+            break;
+
+        case OP_STORE_NAME:
+            exprtree_variable_assign(in->arg.node, stack[sp-1]);
+            break;
+
+        case OP_POP:
+            sp--;
+            break;
+
+        case OP_SWAP:
+            x = stack[sp-1];
+            stack[sp-1] = stack[sp-2];
+            stack[sp-2] = x;
+            break;
+
+        case OP_NEG:
+            stack[sp-1] = -stack[sp-1];
+            break;
+
+        case OP_NOT:
+            stack[sp-1] = fabs(stack[sp-1]) > 1e-5 ? 0.0f : 1.0f;
+            break;
+
+        case OP_TRUTH:
+            stack[sp-1] = fabs(stack[sp-1]) > 1e-5 ? 1.0f : 0.0f;
+            break;
+
+        case OP_AND:
+            if(fabs(stack[sp-1]) <= 1e-5) {
+                stack[sp-1] = 0.0f;
+                pc = in->arg.target;
+            }
+            else
+                sp--;
+            break;
+
+        case OP_OR:
+            if(fabs(stack[sp-1]) > 1e-5) {
+                stack[sp-1] = 1.0f;
+                pc = in->arg.target;
+            }
+            else
+                sp--;
+            break;
+
+        case OP_CALL0:
+            stack[sp++] = in->arg.fun.call.arity0();
+            break;
+
+        case OP_CALL1:
+            stack[sp-1] = in->arg.fun.call.arity1(stack[sp-1]);
+            break;
+
+        case OP_CALL2:
+            sp -= 1;
+            stack[sp-1] = in->arg.fun.call.arity2(stack[sp-1], stack[sp]);
+            break;
+
+        case OP_CALL3:
+            sp -= 2;
+            stack[sp-1] = in->arg.fun.call.arity3(stack[sp-1], stack[sp], stack[sp+1]);
+            break;
+
+        case OP_CALL4:
+            sp -= 3;
+            stack[sp-1] = in->arg.fun.call.arity4(stack[sp-1], stack[sp], stack[sp+1], stack[sp+2]);
+            break;
+
+        default:
+            /* binary operators */
+            y = stack[--sp];
+            x = stack[sp-1];
+
+            switch(in->opcode) {
+            case OP_ADD:        x = x + y; break;
+            case OP_SUB:        x = x - y; break;
+            case OP_MUL:        x = x * y; break;
+            case OP_DIV:        x = fabs(y) > 1e-5 ? x / y : 1.0f; break;
+            case OP_MOD:        x = fabs(y) > 1e-5 ? fmod(x, y) : 0.0f; break;
+            case OP_POW:        x = pow(x, y); break;
+            case OP_SIGNED_POW: x = x >= 0.0f ? pow(x, y) : -pow(-x, y); break;
+            case OP_EQ:         x = fabs(x-y) <= 1e-5 ? 1.0f : 0.0f; break;
+            case OP_NE:         x = fabs(x-y) > 1e-5 ? 1.0f : 0.0f; break;
+            case OP_GT:         x = x > y ? 1.0f : 0.0f; break;
+            case OP_LT:         x = x < y ? 1.0f : 0.0f; break;
+            case OP_GE:         x = x >= y ? 1.0f : 0.0f; break;
+            case OP_LE:         x = x <= y ? 1.0f : 0.0f; break;
+            default:            break;
+            }
+
+            stack[sp-1] = x;
+            break;
+        }
+    }
+
+    return sp > 0 ? stack[sp-1] : 0.0f;
+}
+
+
+
+
 
 
 /* =============== LEXICAL ANALYSIS ============================ */
@@ -1328,7 +1865,8 @@ static exprtree_t* parse(const char *expression_string, symboltable_t *symbol_ta
 
 /* expression data structure */
 struct expression_t {
-    exprtree_t *root;
+    exprtree_t *root; /* the parse tree (the bytecode refers to its variables) */
+    bytecode_t bytecode; /* empty if the expression is too deep */
 };
 
 /* creates a new expression */
@@ -1336,13 +1874,30 @@ expression_t *expression_new(const char *expression_string, symboltable_t *symbo
 {
     expression_t *expr = malloc_x(sizeof *expr);
     symboltable_t *st = (symbol_table == NULL) ? symboltable_get_global_table() : symbol_table;
+    bytecode_t *bc = &(expr->bytecode);
+
+    /* parse */
     expr->root = parse(expression_string, st);
+
+    /* compile */
+    bc->code = NULL;
+    bc->length = bc->capacity = 0;
+    bc->depth = bc->max_depth = 0;
+    bytecode_compile(bc, expr->root);
+
+    if(bc->max_depth > BYTECODE_MAX_STACK) {
+        free(bc->code);
+        bc->code = NULL;
+        bc->length = bc->capacity = 0;
+    }
+
     return expr;
 }
 
 /* destroys an existing expression object */
 void expression_destroy(expression_t *expr)
 {
+    free(expr->bytecode.code);
     expr->root->del(expr->root);
     free(expr);
 }
@@ -1350,12 +1905,95 @@ void expression_destroy(expression_t *expr)
 /* evaluates an expression */
 float expression_evaluate(expression_t *expr)
 {
+    const bytecode_t *bc = &(expr->bytecode);
+
+    /* constants and single variables are the most common expressions */
+    if(bc->length == 1) {
+        if(bc->code[0].opcode == OP_CONST)
+            return bc->code[0].arg.value;
+        else if(bc->code[0].opcode == OP_LOAD)
+            return bc->code[0].arg.var.st->slot[bc->code[0].arg.var.slot].value;
+    }
+
+    /* run the bytecode */
+    if(bc->length > 0)
+        return bytecode_run(bc);
+
+    /* the expression is too deep */
     return expr->root->eval(expr->root);
 }
 
 
 
 
+/* =============== INTERPOLATED STRINGS ============================ */
+
+/* an interpolated string is re-interpolated only if its symbol tables change */
+struct interpolation_t {
+    char *str; /* the string with $variables */
+    symboltable_t *symbol_table;
+    char *result; /* the cached interpolated string */
+    size_t result_size;
+    unsigned version, global_version; /* versions of the symbol tables used to compute the result */
+    int valid; /* is the result valid? */
+};
+
+/* creates a new interpolated string */
+/* if symbol_table == NULL, only global variables will be interpolated */
+interpolation_t *interpolation_new(const char *str, symboltable_t *symbol_table)
+{
+    interpolation_t *interp = malloc_x(sizeof *interp);
+
+    interp->str = str_dup(str);
+    interp->symbol_table = symbol_table;
+    interp->result_size = 1 + strlen(str);
+    interp->result = malloc_x(sizeof(char) * interp->result_size);
+    interp->version = interp->global_version = 0;
+    interp->valid = 0;
+
+    return interp;
+}
+
+/* destroys an existing interpolated string */
+void interpolation_destroy(interpolation_t *interp)
+{
+    free(interp->result);
+    free(interp->str);
+    free(interp);
+}
+
+/* gets the interpolated string, which is valid until the next call to this function */
+const char *interpolation_evaluate(interpolation_t *interp)
+{
+    symboltable_t *st = (interp->symbol_table != NULL) ? interp->symbol_table : symboltable_get_global_table();
+    symboltable_t *global = symboltable_get_global_table();
+    unsigned version = (st != NULL) ? st->version : 0;
+    unsigned global_version = (global != NULL) ? global->version : 0;
+    size_t length;
+
+    /* nothing has changed */
+    if(interp->valid && interp->version == version && interp->global_version == global_version)
+        return interp->result;
+
+    /* re-interpolate, growing the buffer if needed */
+    length = interpolate(interp->str, st, interp->result, interp->result_size);
+    if(length >= interp->result_size) {
+        free(interp->result);
+        interp->result_size = 1 + length;
+        interp->result = malloc_x(sizeof(char) * interp->result_size);
+        interpolate(interp->str, st, interp->result, interp->result_size);
+    }
+
+    interp->version = version;
+    interp->global_version = global_version;
+    interp->valid = 1;
+    return interp->result;
+}
+
+
+
+
+
 /* ============ NANOCALC INTERFACE ============== */
 
 /* initializes this module. Call this in the beginning of your program */
@@ -87,6 +87,8 @@ III) Output:
 #ifndef _NANOCALC_H
 #define _NANOCALC_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -143,6 +145,9 @@ void symboltable_clear(symboltable_t *st);
 /* returns a fixed, global symbol table */
 symboltable_t *symboltable_get_global_table();
 
+/* a counter that changes whenever the symbol table is modified */
+unsigned symboltable_version(const symboltable_t *st);
+
 
 
 /* ============== EXPRESSION FACTORY ================= */
@@ -168,6 +173,23 @@ float expression_evaluate(expression_t *expr);
    by their values. You need to free() the string returned by this function */
 char *nanocalc_interpolate_string(const char *str, symboltable_t *symbol_table);
 
+/* interpolates the given string into a buffer of buf_size bytes (truncating
+   it if necessary), without allocating memory. Returns buf */
+char *nanocalc_interpolate_string_buffer(const char *str, symboltable_t *symbol_table, char *buf, size_t buf_size);
+
+/* interpolated string: re-interpolated only when its variables may have changed */
+typedef struct interpolation_t interpolation_t;
+
+/* creates a new interpolated string */
+/* if symbol_table == NULL, only global variables will be interpolated */
+interpolation_t *interpolation_new(const char *str, symboltable_t *symbol_table);
+
+/* destroys an existing interpolated string */
+void interpolation_destroy(interpolation_t *interp);
+
+/* gets the interpolated string, which is valid until the next call to interpolation_evaluate() */
+const char *interpolation_evaluate(interpolation_t *interp);
+
 
 #ifdef __cplusplus
 }
@@ -22,6 +22,7 @@
 #include <string.h>
 #include "object_decorators.h"
 #include "object_vm.h"
+#include "entitymanager.h"
 #include "nanocalc/nanocalc.h"
 #include "nanocalc/nanocalc_addons.h"
 #include "nanocalc/nanocalcext.h"
@@ -64,6 +65,13 @@ object_t* objectdecorator_get_object_instance(objectmachine_t *obj)
     return decorated_machine->get_object_instance(decorated_machine);
 }
 
+/* given an object machine, get the machine it decorates */
+objectmachine_t* objectdecorator_get_decorated_machine(objectmachine_t *obj)
+{
+    objectdecorator_t *me = (objectdecorator_t*)obj;
+    return me->decorated_machine;
+}
+
 
 
 /* ----- COMMANDS ----- */
@@ -78,8 +86,8 @@ struct objectdecorator_addcollectibles_t {
 /* private methods */
 static void addcollectibles_init(objectmachine_t *obj);
 static void addcollectibles_release(objectmachine_t *obj);
-static void addcollectibles_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void addcollectibles_render(objectmachine_t *obj, v2d_t camera_position);
+static bool addcollectibles_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool addcollectibles_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -88,7 +96,7 @@ static void addcollectibles_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_addcollectibles_new(objectmachine_t *decorated_machine, expression_t *collectibles)
 {
-    objectdecorator_addcollectibles_t *me = mallocx(sizeof *me);
+    objectdecorator_addcollectibles_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -97,6 +105,7 @@ objectmachine_t* objectdecorator_addcollectibles_new(objectmachine_t *decorated_
     obj->update = addcollectibles_update;
     obj->render = addcollectibles_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->collectibles = collectibles;
 
@@ -126,28 +135,23 @@ void addcollectibles_release(objectmachine_t *obj)
     expression_destroy(me->collectibles);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void addcollectibles_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool addcollectibles_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_addcollectibles_t *me = (objectdecorator_addcollectibles_t*)obj;
 
     player_set_collectibles( player_get_collectibles() + (int)expression_evaluate(me->collectibles) );
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void addcollectibles_render(objectmachine_t *obj, v2d_t camera_position)
+bool addcollectibles_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_addlives_t class */
@@ -160,8 +164,8 @@ struct objectdecorator_addlives_t {
 /* private methods */
 static void addlives_init(objectmachine_t *obj);
 static void addlives_release(objectmachine_t *obj);
-static void addlives_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void addlives_render(objectmachine_t *obj, v2d_t camera_position);
+static bool addlives_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool addlives_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -170,7 +174,7 @@ static void addlives_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_addlives_new(objectmachine_t *decorated_machine, expression_t *lives)
 {
-    objectdecorator_addlives_t *me = mallocx(sizeof *me);
+    objectdecorator_addlives_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -179,6 +183,7 @@ objectmachine_t* objectdecorator_addlives_new(objectmachine_t *decorated_machine
     obj->update = addlives_update;
     obj->render = addlives_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->lives = lives;
 
@@ -208,28 +213,23 @@ void addlives_release(objectmachine_t *obj)
     expression_destroy(me->lives);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void addlives_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool addlives_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_addlives_t *me = (objectdecorator_addlives_t*)obj;
 
     player_set_lives( player_get_lives() + (int)expression_evaluate(me->lives) );
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void addlives_render(objectmachine_t *obj, v2d_t camera_position)
+bool addlives_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_addtoscore_t class */
@@ -242,8 +242,8 @@ struct objectdecorator_addtoscore_t {
 /* private methods */
 static void addtoscore_init(objectmachine_t *obj);
 static void addtoscore_release(objectmachine_t *obj);
-static void addtoscore_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void addtoscore_render(objectmachine_t *obj, v2d_t camera_position);
+static bool addtoscore_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool addtoscore_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 /* public methods */
@@ -251,7 +251,7 @@ static void addtoscore_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_addtoscore_new(objectmachine_t *decorated_machine, expression_t *score)
 {
-    objectdecorator_addtoscore_t *me = mallocx(sizeof *me);
+    objectdecorator_addtoscore_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -260,6 +260,7 @@ objectmachine_t* objectdecorator_addtoscore_new(objectmachine_t *decorated_machi
     obj->update = addtoscore_update;
     obj->render = addtoscore_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->score = score;
 
@@ -289,28 +290,23 @@ void addtoscore_release(objectmachine_t *obj)
     expression_destroy(me->score);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void addtoscore_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool addtoscore_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_addtoscore_t *me = (objectdecorator_addtoscore_t*)obj;
 
     level_add_to_score( (int)expression_evaluate(me->score) );
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void addtoscore_render(objectmachine_t *obj, v2d_t camera_position)
+bool addtoscore_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_asktoleave_t class */
@@ -322,8 +318,8 @@ struct objectdecorator_asktoleave_t {
 /* private methods */
 static void asktoleave_init(objectmachine_t *obj);
 static void asktoleave_release(objectmachine_t *obj);
-static void asktoleave_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void asktoleave_render(objectmachine_t *obj, v2d_t camera_position);
+static bool asktoleave_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool asktoleave_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -332,7 +328,7 @@ static void asktoleave_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_asktoleave_new(objectmachine_t *decorated_machine)
 {
-    objectdecorator_asktoleave_t *me = mallocx(sizeof *me);
+    objectdecorator_asktoleave_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -341,6 +337,7 @@ objectmachine_t* objectdecorator_asktoleave_new(objectmachine_t *decorated_machi
     obj->update = asktoleave_update;
     obj->render = asktoleave_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     return obj;
@@ -368,27 +365,21 @@ void asktoleave_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void asktoleave_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool asktoleave_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     level_ask_to_leave();
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void asktoleave_render(objectmachine_t *obj, v2d_t camera_position)
+bool asktoleave_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 
@@ -402,8 +393,8 @@ struct objectdecorator_attachtoplayer_t {
 /* private methods */
 static void attachtoplayer_init(objectmachine_t *obj);
 static void attachtoplayer_release(objectmachine_t *obj);
-static void attachtoplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void attachtoplayer_render(objectmachine_t *obj, v2d_t camera_position);
+static bool attachtoplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool attachtoplayer_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -414,7 +405,7 @@ static void attachtoplayer_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_attachtoplayer_new(objectmachine_t *decorated_machine, expression_t *offset_x, expression_t *offset_y)
 {
-    objectdecorator_attachtoplayer_t *me = mallocx(sizeof *me);
+    objectdecorator_attachtoplayer_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -423,6 +414,7 @@ objectmachine_t* objectdecorator_attachtoplayer_new(objectmachine_t *decorated_m
     obj->update = attachtoplayer_update;
     obj->render = attachtoplayer_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->offset_x = offset_x;
     me->offset_y = offset_y;
@@ -455,13 +447,11 @@ void attachtoplayer_release(objectmachine_t *obj)
     expression_destroy(me->offset_y);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void attachtoplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool attachtoplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_attachtoplayer_t *me = (objectdecorator_attachtoplayer_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     player_t *player = enemy_get_observed_player(object);
@@ -472,17 +462,14 @@ void attachtoplayer_update(objectmachine_t *obj, player_t **team, int team_size,
     object->attached_to_player_offset = v2d_rotate(offset, -player->actor->angle);
     object->actor->position = v2d_add(player->actor->position, object->attached_to_player_offset);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void attachtoplayer_render(objectmachine_t *obj, v2d_t camera_position)
+bool attachtoplayer_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 typedef struct objectdecorator_audio_t objectdecorator_audio_t;
@@ -560,8 +547,8 @@ static void stopsamplestrategy_release(audiostrategy_t *s);
 /* private methods */
 static void audiocommand_init(objectmachine_t *obj);
 static void audiocommand_release(objectmachine_t *obj);
-static void audiocommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void audiocommand_render(objectmachine_t *obj, v2d_t camera_position);
+static bool audiocommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool audiocommand_render(objectmachine_t *obj, v2d_t camera_position);
 
 static objectmachine_t* audiocommand_make_decorator(objectmachine_t *decorated_machine, audiostrategy_t *strategy);
 
@@ -618,28 +605,23 @@ void audiocommand_release(objectmachine_t *obj)
     free(me->strategy);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void audiocommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool audiocommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_audio_t *me = (objectdecorator_audio_t*)obj;
 
     me->strategy->update(me->strategy);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void audiocommand_render(objectmachine_t *obj, v2d_t camera_position)
+bool audiocommand_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 
@@ -650,7 +632,7 @@ void audiocommand_render(objectmachine_t *obj, v2d_t camera_position)
 /* private stuff */
 objectmachine_t* audiocommand_make_decorator(objectmachine_t *decorated_machine, audiostrategy_t *strategy)
 {
-    objectdecorator_audio_t *me = mallocx(sizeof *me);
+    objectdecorator_audio_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -659,6 +641,7 @@ objectmachine_t* audiocommand_make_decorator(objectmachine_t *decorated_machine,
     obj->update = audiocommand_update;
     obj->render = audiocommand_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->strategy = strategy;
 
@@ -843,8 +826,8 @@ struct objectdecorator_bounceplayer_t {
 /* private methods */
 static void bounceplayer_init(objectmachine_t *obj);
 static void bounceplayer_release(objectmachine_t *obj);
-static void bounceplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void bounceplayer_render(objectmachine_t *obj, v2d_t camera_position);
+static bool bounceplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool bounceplayer_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -853,7 +836,7 @@ static void bounceplayer_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_bounceplayer_new(objectmachine_t *decorated_machine)
 {
-    objectdecorator_bounceplayer_t *me = mallocx(sizeof *me);
+    objectdecorator_bounceplayer_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -862,6 +845,7 @@ objectmachine_t* objectdecorator_bounceplayer_new(objectmachine_t *decorated_mac
     obj->update = bounceplayer_update;
     obj->render = bounceplayer_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     return obj;
@@ -889,29 +873,24 @@ void bounceplayer_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void bounceplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool bounceplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     object_t *object = obj->get_object_instance(obj);
     player_t *player = enemy_get_observed_player(obj->get_object_instance(obj));
 
     player_bounce_ex(player, object->actor, FALSE);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void bounceplayer_render(objectmachine_t *obj, v2d_t camera_position)
+bool bounceplayer_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 
@@ -925,8 +904,8 @@ struct objectdecorator_bullettrajectory_t {
 /* private methods */
 static void bullettrajectory_init(objectmachine_t *obj);
 static void bullettrajectory_release(objectmachine_t *obj);
-static void bullettrajectory_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void bullettrajectory_render(objectmachine_t *obj, v2d_t camera_position);
+static bool bullettrajectory_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool bullettrajectory_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -937,7 +916,7 @@ static void bullettrajectory_render(objectmachine_t *obj, v2d_t camera_position)
 /* class constructor */
 objectmachine_t* objectdecorator_bullettrajectory_new(objectmachine_t *decorated_machine, expression_t *speed_x, expression_t *speed_y)
 {
-    objectdecorator_bullettrajectory_t *me = mallocx(sizeof *me);
+    objectdecorator_bullettrajectory_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -946,6 +925,7 @@ objectmachine_t* objectdecorator_bullettrajectory_new(objectmachine_t *decorated
     obj->update = bullettrajectory_update;
     obj->render = bullettrajectory_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->speed_x = speed_x;
     me->speed_y = speed_y;
@@ -978,13 +958,11 @@ void bullettrajectory_release(objectmachine_t *obj)
     expression_destroy(me->speed_y);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void bullettrajectory_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool bullettrajectory_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_bullettrajectory_t *me = (objectdecorator_bullettrajectory_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     float dt = timer_get_delta();
@@ -994,17 +972,14 @@ void bullettrajectory_update(objectmachine_t *obj, player_t **team, int team_siz
     ds = v2d_multiply(speed, dt);
     object->actor->position = v2d_add(object->actor->position, ds);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void bullettrajectory_render(objectmachine_t *obj, v2d_t camera_position)
+bool bullettrajectory_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 
@@ -1018,8 +993,8 @@ struct objectdecorator_camerafocus_t {
 /* private methods */
 static void camerafocus_init(objectmachine_t *obj);
 static void camerafocus_release(objectmachine_t *obj);
-static void camerafocus_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void camerafocus_render(objectmachine_t *obj, v2d_t camera_position);
+static bool camerafocus_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool camerafocus_render(objectmachine_t *obj, v2d_t camera_position);
 
 static objectmachine_t* camerafocus_make_decorator(objectmachine_t *decorated_machine, void (*strategy)(objectmachine_t*));
 
@@ -1044,7 +1019,7 @@ objectmachine_t* objectdecorator_dropcamerafocus_new(objectmachine_t *decorated_
 
 objectmachine_t* camerafocus_make_decorator(objectmachine_t *decorated_machine, void (*strategy)(objectmachine_t*))
 {
-    objectdecorator_camerafocus_t *me = mallocx(sizeof *me);
+    objectdecorator_camerafocus_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -1053,6 +1028,7 @@ objectmachine_t* camerafocus_make_decorator(objectmachine_t *decorated_machine,
     obj->update = camerafocus_update;
     obj->render = camerafocus_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->strategy = strategy;
 
@@ -1081,28 +1057,23 @@ void camerafocus_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void camerafocus_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool camerafocus_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_camerafocus_t *me = (objectdecorator_camerafocus_t*)obj;
 
     me->strategy(obj);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void camerafocus_render(objectmachine_t *obj, v2d_t camera_position)
+bool camerafocus_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 
@@ -1129,8 +1100,8 @@ struct objectdecorator_changeclosestobjectstate_t {
 /* private methods */
 static void changeclosestobjectstate_init(objectmachine_t *obj);
 static void changeclosestobjectstate_release(objectmachine_t *obj);
-static void changeclosestobjectstate_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void changeclosestobjectstate_render(objectmachine_t *obj, v2d_t camera_position);
+static bool changeclosestobjectstate_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool changeclosestobjectstate_render(objectmachine_t *obj, v2d_t camera_position);
 
 static object_t *find_closest_object(object_t *me, object_list_t *list, const char* desired_name, float *distance);
 
@@ -1139,7 +1110,7 @@ static object_t *find_closest_object(object_t *me, object_list_t *list, const ch
 /* public methods */
 objectmachine_t* objectdecorator_changeclosestobjectstate_new(objectmachine_t *decorated_machine, const char *object_name, const char *new_state_name)
 {
-    objectdecorator_changeclosestobjectstate_t *me = mallocx(sizeof *me);
+    objectdecorator_changeclosestobjectstate_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -1148,6 +1119,7 @@ objectmachine_t* objectdecorator_changeclosestobjectstate_new(objectmachine_t *d
     obj->update = changeclosestobjectstate_update;
     obj->render = changeclosestobjectstate_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     me->object_name = str_dup(object_name);
@@ -1178,14 +1150,12 @@ void changeclosestobjectstate_release(objectmachine_t *obj)
     free(me->new_state_name);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void changeclosestobjectstate_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool changeclosestobjectstate_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
     objectdecorator_changeclosestobjectstate_t *me = (objectdecorator_changeclosestobjectstate_t*)obj;
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     object_t *object = obj->get_object_instance(obj);
     object_t *target = find_closest_object(object, object_list, me->object_name, NULL);
 
@@ -1195,17 +1165,14 @@ void changeclosestobjectstate_update(objectmachine_t *obj, player_t **team, int
         nanocalcext_set_target_object(object, brick_list, item_list, object_list); /* restore nanocalc's target object */
     }
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void changeclosestobjectstate_render(objectmachine_t *obj, v2d_t camera_position)
+bool changeclosestobjectstate_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 object_t *find_closest_object(object_t *me, object_list_t *list, const char* desired_name, float *distance)
@@ -1252,8 +1219,8 @@ static void changeparentstate_strategy(objectdecorator_children_t *me, player_t
 /* private methods */
 static void childrencommand_init(objectmachine_t *obj);
 static void childrencommand_release(objectmachine_t *obj);
-static void childrencommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void childrencommand_render(objectmachine_t *obj, v2d_t camera_position);
+static bool childrencommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool childrencommand_render(objectmachine_t *obj, v2d_t camera_position);
 
 static objectmachine_t *childrencommand_make_decorator(objectmachine_t *decorated_machine, childrenstrategy_t strategy, expression_t *offset_x, expression_t *offset_y, const char *object_name, const char *child_name, const char *new_state_name);
 
@@ -1279,7 +1246,7 @@ objectmachine_t* objectdecorator_changeparentstate_new(objectmachine_t *decorate
 /* make a decorator... */
 objectmachine_t *childrencommand_make_decorator(objectmachine_t *decorated_machine, childrenstrategy_t strategy, expression_t *offset_x, expression_t *offset_y, const char *object_name, const char *child_name, const char *new_state_name)
 {
-    objectdecorator_children_t *me = mallocx(sizeof *me);
+    objectdecorator_children_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -1288,6 +1255,7 @@ objectmachine_t *childrencommand_make_decorator(objectmachine_t *decorated_machi
     obj->update = childrencommand_update;
     obj->render = childrencommand_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     me->strategy = strategy;
@@ -1334,28 +1302,23 @@ void childrencommand_release(objectmachine_t *obj)
         expression_destroy(me->offset_y);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void childrencommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool childrencommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
     objectdecorator_children_t *me = (objectdecorator_children_t*)obj;
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
 
     me->strategy(me, team, team_size, brick_list, item_list, object_list);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void childrencommand_render(objectmachine_t *obj, v2d_t camera_position)
+bool childrencommand_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 
@@ -1415,8 +1378,8 @@ struct objectdecorator_clearlevel_t {
 /* private methods */
 static void clearlevel_init(objectmachine_t *obj);
 static void clearlevel_release(objectmachine_t *obj);
-static void clearlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void clearlevel_render(objectmachine_t *obj, v2d_t camera_position);
+static bool clearlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool clearlevel_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -1425,7 +1388,7 @@ static void clearlevel_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_clearlevel_new(objectmachine_t *decorated_machine)
 {
-    objectdecorator_clearlevel_t *me = mallocx(sizeof *me);
+    objectdecorator_clearlevel_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -1434,6 +1397,7 @@ objectmachine_t* objectdecorator_clearlevel_new(objectmachine_t *decorated_machi
     obj->update = clearlevel_update;
     obj->render = clearlevel_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     return obj;
@@ -1461,28 +1425,23 @@ void clearlevel_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void clearlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool clearlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     object_t *object = obj->get_object_instance(obj);
 
     level_clear(object->actor);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void clearlevel_render(objectmachine_t *obj, v2d_t camera_position)
+bool clearlevel_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_createitem_t class */
@@ -1496,15 +1455,15 @@ struct objectdecorator_createitem_t {
 /* private methods */
 static void createitem_init(objectmachine_t *obj);
 static void createitem_release(objectmachine_t *obj);
-static void createitem_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void createitem_render(objectmachine_t *obj, v2d_t camera_position);
+static bool createitem_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool createitem_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
 /* public methods */
 objectmachine_t* objectdecorator_createitem_new(objectmachine_t *decorated_machine, expression_t *item_id, expression_t *offset_x, expression_t *offset_y)
 {
-    objectdecorator_createitem_t *me = mallocx(sizeof *me);
+    objectdecorator_createitem_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -1513,6 +1472,7 @@ objectmachine_t* objectdecorator_createitem_new(objectmachine_t *decorated_machi
     obj->update = createitem_update;
     obj->render = createitem_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->item_id = item_id;
     me->offset_x = offset_x;
@@ -1543,14 +1503,12 @@ void createitem_release(objectmachine_t *obj)
     expression_destroy(me->offset_y);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void createitem_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool createitem_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
     objectdecorator_createitem_t *me = (objectdecorator_createitem_t*)obj;
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     object_t *object = obj->get_object_instance(obj);
     int item_id;
     v2d_t offset;
@@ -1561,17 +1519,14 @@ void createitem_update(objectmachine_t *obj, player_t **team, int team_size, bri
 
     level_create_legacy_item(item_id, v2d_add(object->actor->position, offset));
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void createitem_render(objectmachine_t *obj, v2d_t camera_position)
+bool createitem_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_destroy_t class */
@@ -1583,8 +1538,8 @@ struct objectdecorator_destroy_t {
 /* private methods */
 static void destroy_init(objectmachine_t *obj);
 static void destroy_release(objectmachine_t *obj);
-static void destroy_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void destroy_render(objectmachine_t *obj, v2d_t camera_position);
+static bool destroy_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool destroy_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -1595,7 +1550,7 @@ static void destroy_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_destroy_new(objectmachine_t *decorated_machine)
 {
-    objectdecorator_destroy_t *me = mallocx(sizeof *me);
+    objectdecorator_destroy_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -1604,6 +1559,7 @@ objectmachine_t* objectdecorator_destroy_new(objectmachine_t *decorated_machine)
     obj->update = destroy_update;
     obj->render = destroy_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     return obj;
@@ -1632,30 +1588,22 @@ void destroy_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void destroy_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool destroy_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    /*objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;*/
-
     object_t *object = obj->get_object_instance(obj);
     object->state = ES_DEAD;
 
-    /* suspend the execution */
-    /*decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);*/
+    return false; /* suspend the execution */
 }
 
-void destroy_render(objectmachine_t *obj, v2d_t camera_position)
+bool destroy_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    /*objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;*/
-
     ; /* empty */
 
-    /* suspend the execution */
-    /*decorated_machine->render(decorated_machine, camera_position);*/
+    return false; /* suspend the execution */
 }
 
 /* objectdecorator_dialogbox_t class */
@@ -1670,8 +1618,8 @@ struct objectdecorator_dialogbox_t {
 /* private methods */
 static void dialogbox_init(objectmachine_t *obj);
 static void dialogbox_release(objectmachine_t *obj);
-static void dialogbox_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void dialogbox_render(objectmachine_t *obj, v2d_t camera_position);
+static bool dialogbox_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool dialogbox_render(objectmachine_t *obj, v2d_t camera_position);
 
 static objectmachine_t* dialogbox_make_decorator(objectmachine_t *decorated_machine, const char *title, const char *message, void (*strategy)());
 
@@ -1696,7 +1644,7 @@ objectmachine_t* objectdecorator_hidedialogbox_new(objectmachine_t *decorated_ma
 /* private methods */
 objectmachine_t* dialogbox_make_decorator(objectmachine_t *decorated_machine, const char *title, const char *message, void (*strategy)())
 {
-    objectdecorator_dialogbox_t *me = mallocx(sizeof *me);
+    objectdecorator_dialogbox_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -1705,6 +1653,7 @@ objectmachine_t* dialogbox_make_decorator(objectmachine_t *decorated_machine, co
     obj->update = dialogbox_update;
     obj->render = dialogbox_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->title = str_dup(title);
     me->message = str_dup(message);
@@ -1733,28 +1682,23 @@ void dialogbox_release(objectmachine_t *obj)
     free(me->message);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void dialogbox_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool dialogbox_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_dialogbox_t *me = (objectdecorator_dialogbox_t*)obj;
 
     me->strategy(me);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void dialogbox_render(objectmachine_t *obj, v2d_t camera_position)
+bool dialogbox_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 void show_dialog_box(objectdecorator_dialogbox_t *me)
@@ -1780,8 +1724,8 @@ struct objectdecorator_ellipticaltrajectory_t {
 /* private methods */
 static void ellipticaltrajectory_init(objectmachine_t *obj);
 static void ellipticaltrajectory_release(objectmachine_t *obj);
-static void ellipticaltrajectory_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void ellipticaltrajectory_render(objectmachine_t *obj, v2d_t camera_position);
+static bool ellipticaltrajectory_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool ellipticaltrajectory_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -1790,7 +1734,7 @@ static void ellipticaltrajectory_render(objectmachine_t *obj, v2d_t camera_posit
 /* class constructor */
 objectmachine_t* objectdecorator_ellipticaltrajectory_new(objectmachine_t *decorated_machine, expression_t *amplitude_x, expression_t *amplitude_y, expression_t *angularspeed_x, expression_t *angularspeed_y, expression_t *initialphase_x, expression_t *initialphase_y)
 {
-    objectdecorator_ellipticaltrajectory_t *me = mallocx(sizeof *me);
+    objectdecorator_ellipticaltrajectory_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -1799,6 +1743,7 @@ objectmachine_t* objectdecorator_ellipticaltrajectory_new(objectmachine_t *decor
     obj->update = ellipticaltrajectory_update;
     obj->render = ellipticaltrajectory_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->amplitude_x = amplitude_x;
     me->amplitude_y = amplitude_y;
@@ -1839,13 +1784,11 @@ void ellipticaltrajectory_release(objectmachine_t *obj)
     expression_destroy(me->initialphase_y);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void ellipticaltrajectory_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool ellipticaltrajectory_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_ellipticaltrajectory_t *me = (objectdecorator_ellipticaltrajectory_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     actor_t *act = object->actor;
@@ -1916,17 +1859,14 @@ void ellipticaltrajectory_update(objectmachine_t *obj, player_t **team, int team
     }
 
     /* decorator pattern */
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void ellipticaltrajectory_render(objectmachine_t *obj, v2d_t camera_position)
+bool ellipticaltrajectory_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_enemy_t class */
@@ -1939,8 +1879,8 @@ struct objectdecorator_enemy_t {
 /* private methods */
 static void enemydecorator_init(objectmachine_t *obj);
 static void enemydecorator_release(objectmachine_t *obj);
-static void enemydecorator_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void enemydecorator_render(objectmachine_t *obj, v2d_t camera_position);
+static bool enemydecorator_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool enemydecorator_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -1949,7 +1889,7 @@ static void enemydecorator_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_enemy_new(objectmachine_t *decorated_machine, expression_t *score)
 {
-    objectdecorator_enemy_t *me = mallocx(sizeof *me);
+    objectdecorator_enemy_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -1958,6 +1898,7 @@ objectmachine_t* objectdecorator_enemy_new(objectmachine_t *decorated_machine, e
     obj->update = enemydecorator_update;
     obj->render = enemydecorator_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     me->score = score;
@@ -1988,14 +1929,12 @@ void enemydecorator_release(objectmachine_t *obj)
     expression_destroy(me->score);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void enemydecorator_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool enemydecorator_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
     objectdecorator_enemy_t *me = (objectdecorator_enemy_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     object_t *object = obj->get_object_instance(obj);
     int i, score;
 
@@ -2021,17 +1960,14 @@ void enemydecorator_update(objectmachine_t *obj, player_t **team, int team_size,
         }
     }
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void enemydecorator_render(objectmachine_t *obj, v2d_t camera_position)
+bool enemydecorator_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_executebase_t class */
@@ -2092,15 +2028,15 @@ static void objectdecorator_executefor_destructor(objectdecorator_executebase_t
 /* private methods */
 static void executecommand_init(objectmachine_t *obj);
 static void executecommand_release(objectmachine_t *obj);
-static void executecommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void executecommand_render(objectmachine_t *obj, v2d_t camera_position);
+static bool executecommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool executecommand_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
 /* public methods */
 objectmachine_t* objectdecorator_execute_new(objectmachine_t *decorated_machine, const char *state_name)
 {
-    objectdecorator_execute_t *me = mallocx(sizeof *me);
+    objectdecorator_execute_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
     objectdecorator_executebase_t *_me = (objectdecorator_executebase_t*)me;
@@ -2110,6 +2046,7 @@ objectmachine_t* objectdecorator_execute_new(objectmachine_t *decorated_machine,
     obj->update = executecommand_update;
     obj->render = executecommand_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     _me->state_name = str_dup(state_name);
@@ -2122,7 +2059,7 @@ objectmachine_t* objectdecorator_execute_new(objectmachine_t *decorated_machine,
 
 objectmachine_t* objectdecorator_executeif_new(objectmachine_t *decorated_machine, const char *state_name, expression_t* condition)
 {
-    objectdecorator_executeif_t *me = mallocx(sizeof *me);
+    objectdecorator_executeif_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
     objectdecorator_executebase_t *_me = (objectdecorator_executebase_t*)me;
@@ -2132,6 +2069,7 @@ objectmachine_t* objectdecorator_executeif_new(objectmachine_t *decorated_machin
     obj->update = executecommand_update;
     obj->render = executecommand_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     _me->state_name = str_dup(state_name);
@@ -2145,7 +2083,7 @@ objectmachine_t* objectdecorator_executeif_new(objectmachine_t *decorated_machin
 
 objectmachine_t* objectdecorator_executeunless_new(objectmachine_t *decorated_machine, const char *state_name, expression_t* condition)
 {
-    objectdecorator_executeunless_t *me = mallocx(sizeof *me);
+    objectdecorator_executeunless_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
     objectdecorator_executebase_t *_me = (objectdecorator_executebase_t*)me;
@@ -2155,6 +2093,7 @@ objectmachine_t* objectdecorator_executeunless_new(objectmachine_t *decorated_ma
     obj->update = executecommand_update;
     obj->render = executecommand_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     _me->state_name = str_dup(state_name);
@@ -2168,7 +2107,7 @@ objectmachine_t* objectdecorator_executeunless_new(objectmachine_t *decorated_ma
 
 objectmachine_t* objectdecorator_executewhile_new(objectmachine_t *decorated_machine, const char *state_name, expression_t* condition)
 {
-    objectdecorator_executewhile_t *me = mallocx(sizeof *me);
+    objectdecorator_executewhile_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
     objectdecorator_executebase_t *_me = (objectdecorator_executebase_t*)me;
@@ -2178,6 +2117,7 @@ objectmachine_t* objectdecorator_executewhile_new(objectmachine_t *decorated_mac
     obj->update = executecommand_update;
     obj->render = executecommand_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     _me->state_name = str_dup(state_name);
@@ -2191,7 +2131,7 @@ objectmachine_t* objectdecorator_executewhile_new(objectmachine_t *decorated_mac
 
 objectmachine_t* objectdecorator_executefor_new(objectmachine_t *decorated_machine, const char *state_name, expression_t* executecommand_initial, expression_t* condition, expression_t* iteration)
 {
-    objectdecorator_executefor_t *me = mallocx(sizeof *me);
+    objectdecorator_executefor_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
     objectdecorator_executebase_t *_me = (objectdecorator_executebase_t*)me;
@@ -2201,6 +2141,7 @@ objectmachine_t* objectdecorator_executefor_new(objectmachine_t *decorated_machi
     obj->update = executecommand_update;
     obj->render = executecommand_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     _me->state_name = str_dup(state_name);
@@ -2236,44 +2177,40 @@ void executecommand_release(objectmachine_t *obj)
     free(me->state_name);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void executecommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool executecommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
     objectdecorator_executebase_t *me = (objectdecorator_executebase_t*)obj;
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     object_t *object = obj->get_object_instance(obj);
 
     me->update(me, object, team, team_size, brick_list, item_list, object_list);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void executecommand_render(objectmachine_t *obj, v2d_t camera_position)
+bool executecommand_render(objectmachine_t *obj, v2d_t camera_position)
 {
     objectdecorator_executebase_t *me = (objectdecorator_executebase_t*)obj;
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     object_t *object = obj->get_object_instance(obj);
 
     me->render(me, object, camera_position);
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* private */
 void objectdecorator_execute_update(objectdecorator_executebase_t *ex, object_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectmachine_t *other_state = objectvm_get_state_by_name(obj->vm, ex->state_name);
-    other_state->update(other_state, team, team_size, brick_list, item_list, object_list);
+    objectprogram_t *other_state = objectvm_get_program_by_name(obj->vm, ex->state_name);
+    objectprogram_update(other_state, team, team_size, brick_list, item_list, object_list);
 }
 
 void objectdecorator_execute_render(objectdecorator_executebase_t *ex, object_t *obj, v2d_t camera_position)
 {
-    objectmachine_t *other_state = objectvm_get_state_by_name(obj->vm, ex->state_name);
-    other_state->render(other_state, camera_position);
+    objectprogram_t *other_state = objectvm_get_program_by_name(obj->vm, ex->state_name);
+    objectprogram_render(other_state, camera_position);
 }
 
 void objectdecorator_execute_destructor(objectdecorator_executebase_t *ex)
@@ -2284,10 +2221,10 @@ void objectdecorator_execute_destructor(objectdecorator_executebase_t *ex)
 void objectdecorator_executeif_update(objectdecorator_executebase_t *ex, object_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
     objectdecorator_executeif_t *me = (objectdecorator_executeif_t*)ex;
-    objectmachine_t *other_state = objectvm_get_state_by_name(obj->vm, ex->state_name);
+    objectprogram_t *other_state = objectvm_get_program_by_name(obj->vm, ex->state_name);
 
     if(fabs(expression_evaluate(me->condition)) >= 1e-5)
-        other_state->update(other_state, team, team_size, brick_list, item_list, object_list);
+        objectprogram_update(other_state, team, team_size, brick_list, item_list, object_list);
 }
 
 void objectdecorator_executeif_render(objectdecorator_executebase_t *ex, object_t *obj, v2d_t camera_position)
@@ -2304,10 +2241,10 @@ void objectdecorator_executeif_destructor(objectdecorator_executebase_t *ex)
 void objectdecorator_executeunless_update(objectdecorator_executebase_t *ex, object_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
     objectdecorator_executeunless_t *me = (objectdecorator_executeunless_t*)ex;
-    objectmachine_t *other_state = objectvm_get_state_by_name(obj->vm, ex->state_name);
+    objectprogram_t *other_state = objectvm_get_program_by_name(obj->vm, ex->state_name);
 
     if(!(fabs(expression_evaluate(me->condition)) >= 1e-5))
-        other_state->update(other_state, team, team_size, brick_list, item_list, object_list);
+        objectprogram_update(other_state, team, team_size, brick_list, item_list, object_list);
 }
 
 void objectdecorator_executeunless_render(objectdecorator_executebase_t *ex, object_t *obj, v2d_t camera_position)
@@ -2324,11 +2261,11 @@ void objectdecorator_executeunless_destructor(objectdecorator_executebase_t *ex)
 void objectdecorator_executewhile_update(objectdecorator_executebase_t *ex, object_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
     objectdecorator_executewhile_t *me = (objectdecorator_executewhile_t*)ex;
-    objectmachine_t *other_state = objectvm_get_state_by_name(obj->vm, ex->state_name);
+    objectprogram_t *other_state = objectvm_get_program_by_name(obj->vm, ex->state_name);
     objectmachine_t *this_state = *(objectvm_get_reference_to_current_state(obj->vm));
 
     while(fabs(expression_evaluate(me->condition)) >= 1e-5) {
-        other_state->update(other_state, team, team_size, brick_list, item_list, object_list);
+        objectprogram_update(other_state, team, team_size, brick_list, item_list, object_list);
         if(this_state != *(objectvm_get_reference_to_current_state(obj->vm)))
             break;
     }
@@ -2348,12 +2285,12 @@ void objectdecorator_executewhile_destructor(objectdecorator_executebase_t *ex)
 void objectdecorator_executefor_update(objectdecorator_executebase_t *ex, object_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
     objectdecorator_executefor_t *me = (objectdecorator_executefor_t*)ex;
-    objectmachine_t *other_state = objectvm_get_state_by_name(obj->vm, ex->state_name);
+    objectprogram_t *other_state = objectvm_get_program_by_name(obj->vm, ex->state_name);
     objectmachine_t *this_state = *(objectvm_get_reference_to_current_state(obj->vm));
 
     expression_evaluate(me->initial);
     while(fabs(expression_evaluate(me->condition)) >= 1e-5) {
-        other_state->update(other_state, team, team_size, brick_list, item_list, object_list);
+        objectprogram_update(other_state, team, team_size, brick_list, item_list, object_list);
         if(this_state != *(objectvm_get_reference_to_current_state(obj->vm)))
             break;
         expression_evaluate(me->iteration);
@@ -2382,8 +2319,8 @@ struct objectdecorator_gravity_t {
 /* private methods */
 static void gravity_init(objectmachine_t *obj);
 static void gravity_release(objectmachine_t *obj);
-static void gravity_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void gravity_render(objectmachine_t *obj, v2d_t camera_position);
+static bool gravity_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool gravity_render(objectmachine_t *obj, v2d_t camera_position);
 
 static int hit_test(const brick_t* brk, int x, int y);
 static int sticky_test(const actor_t *act, const brick_list_t *brick_list);
@@ -2394,7 +2331,7 @@ static int sticky_test(const actor_t *act, const brick_list_t *brick_list);
 /* class constructor */
 objectmachine_t* objectdecorator_gravity_new(objectmachine_t *decorated_machine)
 {
-    objectdecorator_gravity_t *me = mallocx(sizeof *me);
+    objectdecorator_gravity_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -2403,6 +2340,7 @@ objectmachine_t* objectdecorator_gravity_new(objectmachine_t *decorated_machine)
     obj->update = gravity_update;
     obj->render = gravity_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     return obj;
@@ -2430,13 +2368,11 @@ void gravity_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void gravity_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool gravity_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     object_t *object = obj->get_object_instance(obj);
     actor_t *act = object->actor;
     float dt = timer_get_delta(), g = level_gravity();
@@ -2447,7 +2383,8 @@ void gravity_update(objectmachine_t *obj, player_t **team, int team_size, brick_
        we adopt this simplified platform system */
     int rx, ry, rw, rh, bx, by, bw, bh;
     const image_t *ri;
-    brick_list_t *it;
+    brick_t* const* brick;
+    int k, brick_count;
     enum { NONE, FLOOR, CEILING } collided = NONE;
     int i, j, sticky_max_offset = 3;
     const obstacle_t* bo;
@@ -2459,13 +2396,14 @@ void gravity_update(objectmachine_t *obj, player_t **team, int team_size, brick_
     rh = image_height(ri);
 
     /* check for collisions */
-    for(it = brick_list; it != NULL && collided == NONE; it = it->next) {
-        bo = brick_obstacle(it->data);
-        if(bo && brick_type(it->data) != BRK_PASSABLE) {
-            bx = brick_position(it->data).x;
-            by = brick_position(it->data).y;
-            bw = brick_size(it->data).x;
-            bh = brick_size(it->data).y;
+    brick = level_legacy_bricks_in_rect(rx, ry, rw, rh, &brick_count);
+    for(k = brick_count - 1; k >= 0 && collided == NONE; k--) {
+        bo = brick_obstacle(brick[k]);
+        if(bo && brick_type(brick[k]) != BRK_PASSABLE) {
+            bx = brick_position(brick[k]).x;
+            by = brick_position(brick[k]).y;
+            bw = brick_size(brick[k]).x;
+            bh = brick_size(brick[k]).y;
 
             if(rx<bx+bw && rx+rw>bx && ry<by+bh && ry+rh>by) {
                 if(obstacle_got_collision(bo, rx+rw/2, ry, rx+rw/2, ry)) {
@@ -2527,17 +2465,14 @@ void gravity_update(objectmachine_t *obj, player_t **team, int team_size, brick_
 
     /* --------------------------- */
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void gravity_render(objectmachine_t *obj, v2d_t camera_position)
+bool gravity_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 
@@ -2557,10 +2492,10 @@ int hit_test(const brick_t* brk, int x, int y)
 /* act collides with some brick? */
 int sticky_test(const actor_t *act, const brick_list_t *brick_list)
 {
-    const brick_list_t *it;
+    brick_t* const* brick;
     const brick_t *b;
     const image_t *ri;
-    int rx, ry, rw, rh;
+    int rx, ry, rw, rh, k, brick_count;
 
     ri = actor_image(act);
     rx = (int)(act->position.x - act->hot_spot.x);
@@ -2568,8 +2503,11 @@ int sticky_test(const actor_t *act, const brick_list_t *brick_list)
     rw = image_width(ri);
     rh = image_height(ri);
 
-    for(it = brick_list; it; it = it->next) {
-        b = it->data;
+    /* brick_list is unused: query the bricks at the hit spot */
+    (void)brick_list;
+    brick = level_legacy_bricks_in_rect(rx+rw/2, ry+rh-1, 1, 1, &brick_count);
+    for(k = brick_count - 1; k >= 0; k--) {
+        b = brick[k];
         if(brick_type(b) != BRK_PASSABLE) {
             if(hit_test(b, rx+rw/2, ry+rh-1))
                 return TRUE;
@@ -2595,8 +2533,8 @@ static int acid_strategy(player_t *p);
 /* private methods */
 static void hitplayer_init(objectmachine_t *obj);
 static void hitplayer_release(objectmachine_t *obj);
-static void hitplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void hitplayer_render(objectmachine_t *obj, v2d_t camera_position);
+static bool hitplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool hitplayer_render(objectmachine_t *obj, v2d_t camera_position);
 static objectmachine_t *hitplayer_make_decorator(objectmachine_t *decorated_machine, int (*strategy)(player_t*));
 
 
@@ -2629,7 +2567,7 @@ objectmachine_t* objectdecorator_acidplayer_new(objectmachine_t *decorated_machi
 /* builder */
 objectmachine_t *hitplayer_make_decorator(objectmachine_t *decorated_machine, int (*strategy)(player_t*))
 {
-    objectdecorator_hitplayer_t *me = mallocx(sizeof *me);
+    objectdecorator_hitplayer_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -2638,6 +2576,7 @@ objectmachine_t *hitplayer_make_decorator(objectmachine_t *decorated_machine, in
     obj->update = hitplayer_update;
     obj->render = hitplayer_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->should_hit_the_player = strategy;
 
@@ -2662,13 +2601,11 @@ void hitplayer_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void hitplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool hitplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_hitplayer_t *me = (objectdecorator_hitplayer_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     player_t *player = enemy_get_observed_player(obj->get_object_instance(obj));
@@ -2676,17 +2613,14 @@ void hitplayer_update(objectmachine_t *obj, player_t **team, int team_size, bric
     if(!player_is_invincible(player) && me->should_hit_the_player(player))
         player_hit_ex(player, object->actor);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void hitplayer_render(objectmachine_t *obj, v2d_t camera_position)
+bool hitplayer_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* private strategies */
@@ -2720,8 +2654,8 @@ struct objectdecorator_jump_t {
 /* private methods */
 static void jump_init(objectmachine_t *obj);
 static void jump_release(objectmachine_t *obj);
-static void jump_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void jump_render(objectmachine_t *obj, v2d_t camera_position);
+static bool jump_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool jump_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -2730,7 +2664,7 @@ static void jump_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_jump_new(objectmachine_t *decorated_machine, expression_t *jump_strength)
 {
-    objectdecorator_jump_t *me = mallocx(sizeof *me);
+    objectdecorator_jump_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -2739,6 +2673,7 @@ objectmachine_t* objectdecorator_jump_new(objectmachine_t *decorated_machine, ex
     obj->update = jump_update;
     obj->render = jump_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->jump_strength = jump_strength;
 
@@ -2768,13 +2703,11 @@ void jump_release(objectmachine_t *obj)
     expression_destroy(me->jump_strength);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void jump_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool jump_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_jump_t *me = (objectdecorator_jump_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     actor_t *act = object->actor;
@@ -2792,17 +2725,14 @@ void jump_update(objectmachine_t *obj, player_t **team, int team_size, brick_lis
     /*act->jump_strength = jump_strength;
     input_simulate_button_down(act->input, IB_FIRE1);*/
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void jump_render(objectmachine_t *obj, v2d_t camera_position)
+bool jump_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_killplayer_t class */
@@ -2814,8 +2744,8 @@ struct objectdecorator_killplayer_t {
 /* private methods */
 static void killplayer_init(objectmachine_t *obj);
 static void killplayer_release(objectmachine_t *obj);
-static void killplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void killplayer_render(objectmachine_t *obj, v2d_t camera_position);
+static bool killplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool killplayer_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -2826,7 +2756,7 @@ static void killplayer_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_killplayer_new(objectmachine_t *decorated_machine)
 {
-    objectdecorator_killplayer_t *me = mallocx(sizeof *me);
+    objectdecorator_killplayer_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -2835,6 +2765,7 @@ objectmachine_t* objectdecorator_killplayer_new(objectmachine_t *decorated_machi
     obj->update = killplayer_update;
     obj->render = killplayer_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     return obj;
@@ -2863,28 +2794,23 @@ void killplayer_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void killplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool killplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     player_t *player = enemy_get_observed_player(obj->get_object_instance(obj));
 
     player_kill(player);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void killplayer_render(objectmachine_t *obj, v2d_t camera_position)
+bool killplayer_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_launchurl_t class */
@@ -2897,8 +2823,8 @@ struct objectdecorator_launchurl_t {
 /* private methods */
 static void launchurl_init(objectmachine_t *obj);
 static void launchurl_release(objectmachine_t *obj);
-static void launchurl_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void launchurl_render(objectmachine_t *obj, v2d_t camera_position);
+static bool launchurl_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool launchurl_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -2909,7 +2835,7 @@ static void launchurl_render(objectmachine_t *obj, v2d_t camera_position);
 
 objectmachine_t* objectdecorator_launchurl_new(objectmachine_t *decorated_machine, const char *url)
 {
-    objectdecorator_launchurl_t *me = mallocx(sizeof *me);
+    objectdecorator_launchurl_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -2918,6 +2844,7 @@ objectmachine_t* objectdecorator_launchurl_new(objectmachine_t *decorated_machin
     obj->update = launchurl_update;
     obj->render = launchurl_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     me->url = str_dup(url);
@@ -2947,29 +2874,24 @@ void launchurl_release(objectmachine_t *obj)
     free(me->url);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void launchurl_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool launchurl_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_launchurl_t *me = (objectdecorator_launchurl_t*)obj;
 
     if(!launch_url(me->url))
         video_showmessage("Can't open URL.");
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void launchurl_render(objectmachine_t *obj, v2d_t camera_position)
+bool launchurl_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_loadlevel_t class */
@@ -2982,8 +2904,8 @@ struct objectdecorator_loadlevel_t {
 /* private methods */
 static void loadlevel_init(objectmachine_t *obj);
 static void loadlevel_release(objectmachine_t *obj);
-static void loadlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void loadlevel_render(objectmachine_t *obj, v2d_t camera_position);
+static bool loadlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool loadlevel_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -2994,7 +2916,7 @@ static void loadlevel_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_loadlevel_new(objectmachine_t *decorated_machine, const char *level_path)
 {
-    objectdecorator_loadlevel_t *me = mallocx(sizeof *me);
+    objectdecorator_loadlevel_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -3003,6 +2925,7 @@ objectmachine_t* objectdecorator_loadlevel_new(objectmachine_t *decorated_machin
     obj->update = loadlevel_update;
     obj->render = loadlevel_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->level_path = str_dup(level_path);
 
@@ -3033,28 +2956,23 @@ void loadlevel_release(objectmachine_t *obj)
     free(me->level_path);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void loadlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool loadlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    /*objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;*/
     objectdecorator_loadlevel_t *me = (objectdecorator_loadlevel_t*)obj;
 
     level_change(me->level_path);
 
-    /*decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);*/
+    return false; /* suspend the execution */
 }
 
-void loadlevel_render(objectmachine_t *obj, v2d_t camera_position)
+bool loadlevel_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    /*objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;*/
-
     ; /* empty */
 
-    /*decorated_machine->render(decorated_machine, camera_position);*/
+    return false; /* suspend the execution */
 }
 
 
@@ -3070,8 +2988,8 @@ struct objectdecorator_lockcamera_t {
 /* private methods */
 static void lockcamera_init(objectmachine_t *obj);
 static void lockcamera_release(objectmachine_t *obj);
-static void lockcamera_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void lockcamera_render(objectmachine_t *obj, v2d_t camera_position);
+static bool lockcamera_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool lockcamera_render(objectmachine_t *obj, v2d_t camera_position);
 
 static void get_rectangle_coordinates(objectdecorator_lockcamera_t *me, int *x1, int *y1, int *x2, int *y2);
 static void update_rectangle_coordinates(objectdecorator_lockcamera_t *me, int x1, int y1, int x2, int y2);
@@ -3082,7 +3000,7 @@ static void update_rectangle_coordinates(objectdecorator_lockcamera_t *me, int x
 /* class constructor */
 objectmachine_t* objectdecorator_lockcamera_new(objectmachine_t *decorated_machine, expression_t *x1, expression_t *y1, expression_t *x2, expression_t *y2)
 {
-    objectdecorator_lockcamera_t *me = mallocx(sizeof *me);
+    objectdecorator_lockcamera_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -3091,6 +3009,7 @@ objectmachine_t* objectdecorator_lockcamera_new(objectmachine_t *decorated_machi
     obj->update = lockcamera_update;
     obj->render = lockcamera_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     me->x1 = x1;
@@ -3135,13 +3054,11 @@ void lockcamera_release(objectmachine_t *obj)
     expression_destroy(me->y2);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void lockcamera_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool lockcamera_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     object_t *object = obj->get_object_instance(obj);
     player_t *player = enemy_get_observed_player(object);
     objectdecorator_lockcamera_t *me = (objectdecorator_lockcamera_t*)obj;
@@ -3215,14 +3132,11 @@ void lockcamera_update(objectmachine_t *obj, player_t **team, int team_size, bri
         player_set_ypos(player, clip(ta->position.y, ry, ry + rh));
     }
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void lockcamera_render(objectmachine_t *obj, v2d_t camera_position)
+bool lockcamera_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     if(level_editmode()) {
         objectdecorator_lockcamera_t *me = (objectdecorator_lockcamera_t*)obj;
         actor_t *act = obj->get_object_instance(obj)->actor;
@@ -3237,7 +3151,7 @@ void lockcamera_render(objectmachine_t *obj, v2d_t camera_position)
         image_rect(x1, y1, x2, y2, color);
     }
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 
@@ -3286,8 +3200,8 @@ struct objectdecorator_look_t {
 static objectmachine_t* objectdecorator_look_new(objectmachine_t *decorated_machine, void (*look_strategy)(objectdecorator_look_t*));
 static void look_init(objectmachine_t *obj);
 static void look_release(objectmachine_t *obj);
-static void look_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void look_render(objectmachine_t *obj, v2d_t camera_position);
+static bool look_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool look_render(objectmachine_t *obj, v2d_t camera_position);
 
 /* private strategies */
 static void look_left(objectdecorator_look_t *me);
@@ -3328,7 +3242,7 @@ objectmachine_t* objectdecorator_lookatwalkingdirection_new(objectmachine_t *dec
 /* private methods */
 objectmachine_t* objectdecorator_look_new(objectmachine_t *decorated_machine, void (*look_strategy)(objectdecorator_look_t*))
 {
-    objectdecorator_look_t *me = mallocx(sizeof *me);
+    objectdecorator_look_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -3337,6 +3251,7 @@ objectmachine_t* objectdecorator_look_new(objectmachine_t *decorated_machine, vo
     obj->update = look_update;
     obj->render = look_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->look_strategy = look_strategy;
 
@@ -3362,28 +3277,23 @@ void look_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void look_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool look_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_look_t *me = (objectdecorator_look_t*)obj;
 
     me->look_strategy(me);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void look_render(objectmachine_t *obj, v2d_t camera_position)
+bool look_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 
@@ -3440,8 +3350,8 @@ struct objectdecorator_mosquitomovement_t {
 /* private methods */
 static void mosquitomovement_init(objectmachine_t *obj);
 static void mosquitomovement_release(objectmachine_t *obj);
-static void mosquitomovement_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void mosquitomovement_render(objectmachine_t *obj, v2d_t camera_position);
+static bool mosquitomovement_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool mosquitomovement_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -3452,7 +3362,7 @@ static void mosquitomovement_render(objectmachine_t *obj, v2d_t camera_position)
 /* class constructor */
 objectmachine_t* objectdecorator_mosquitomovement_new(objectmachine_t *decorated_machine, expression_t *speed)
 {
-    objectdecorator_mosquitomovement_t *me = mallocx(sizeof *me);
+    objectdecorator_mosquitomovement_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -3461,6 +3371,7 @@ objectmachine_t* objectdecorator_mosquitomovement_new(objectmachine_t *decorated
     obj->update = mosquitomovement_update;
     obj->render = mosquitomovement_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->speed = speed;
 
@@ -3491,13 +3402,11 @@ void mosquitomovement_release(objectmachine_t *obj)
     expression_destroy(me->speed);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void mosquitomovement_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool mosquitomovement_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_mosquitomovement_t *me = (objectdecorator_mosquitomovement_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     player_t *player = enemy_get_observed_player(object);
@@ -3511,17 +3420,14 @@ void mosquitomovement_update(objectmachine_t *obj, player_t **team, int team_siz
         object->actor->position = v2d_add(object->actor->position, ds);
     }
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void mosquitomovement_render(objectmachine_t *obj, v2d_t camera_position)
+bool mosquitomovement_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_moveplayer_t class */
@@ -3534,8 +3440,8 @@ struct objectdecorator_moveplayer_t {
 /* private methods */
 static void moveplayer_init(objectmachine_t *obj);
 static void moveplayer_release(objectmachine_t *obj);
-static void moveplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void moveplayer_render(objectmachine_t *obj, v2d_t camera_position);
+static bool moveplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool moveplayer_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -3546,7 +3452,7 @@ static void moveplayer_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_moveplayer_new(objectmachine_t *decorated_machine, expression_t *speed_x, expression_t *speed_y)
 {
-    objectdecorator_moveplayer_t *me = mallocx(sizeof *me);
+    objectdecorator_moveplayer_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -3555,6 +3461,7 @@ objectmachine_t* objectdecorator_moveplayer_new(objectmachine_t *decorated_machi
     obj->update = moveplayer_update;
     obj->render = moveplayer_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->speed_x = speed_x;
     me->speed_y = speed_y;
@@ -3587,13 +3494,11 @@ void moveplayer_release(objectmachine_t *obj)
     expression_destroy(me->speed_y);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void moveplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool moveplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_moveplayer_t *me = (objectdecorator_moveplayer_t*)obj;
     float dt = timer_get_delta();
     v2d_t speed = v2d_new(expression_evaluate(me->speed_x), expression_evaluate(me->speed_y));
@@ -3604,17 +3509,14 @@ void moveplayer_update(objectmachine_t *obj, player_t **team, int team_size, bri
     v2d_t new_pos = v2d_add(prev_pos, ds);
     player_set_position(player, new_pos);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void moveplayer_render(objectmachine_t *obj, v2d_t camera_position)
+bool moveplayer_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_nextlevel_t class */
@@ -3626,8 +3528,8 @@ struct objectdecorator_nextlevel_t {
 /* private methods */
 static void nextlevel_init(objectmachine_t *obj);
 static void nextlevel_release(objectmachine_t *obj);
-static void nextlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void nextlevel_render(objectmachine_t *obj, v2d_t camera_position);
+static bool nextlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool nextlevel_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -3636,7 +3538,7 @@ static void nextlevel_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_nextlevel_new(objectmachine_t *decorated_machine)
 {
-    objectdecorator_nextlevel_t *me = mallocx(sizeof *me);
+    objectdecorator_nextlevel_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -3645,6 +3547,7 @@ objectmachine_t* objectdecorator_nextlevel_new(objectmachine_t *decorated_machin
     obj->update = nextlevel_update;
     obj->render = nextlevel_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     return obj;
@@ -3672,27 +3575,21 @@ void nextlevel_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void nextlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool nextlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     level_jump_to_next_stage();
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void nextlevel_render(objectmachine_t *obj, v2d_t camera_position)
+bool nextlevel_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 typedef struct objectdecorator_observeplayer_t objectdecorator_observeplayer_t;
@@ -3714,8 +3611,8 @@ struct observeplayerstrategy_t {
 /* private methods */
 static void observeplayer_init(objectmachine_t *obj);
 static void observeplayer_release(objectmachine_t *obj);
-static void observeplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void observeplayer_render(objectmachine_t *obj, v2d_t camera_position);
+static bool observeplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool observeplayer_render(objectmachine_t *obj, v2d_t camera_position);
 
 static objectmachine_t* observeplayer_make_decorator(objectmachine_t *decorated_machine, observeplayerstrategy_t *strategy);
 static observeplayerstrategy_t* observeplayer_make_strategy(const char *player_name, object_t *object, void (*run_func)(observeplayerstrategy_t*,player_t**,int));
@@ -3758,7 +3655,7 @@ objectmachine_t* objectdecorator_observeallplayers_new(objectmachine_t *decorate
 /* private methods */
 objectmachine_t* observeplayer_make_decorator(objectmachine_t *decorated_machine, observeplayerstrategy_t *strategy)
 {
-    objectdecorator_observeplayer_t *me = mallocx(sizeof *me);
+    objectdecorator_observeplayer_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -3767,6 +3664,7 @@ objectmachine_t* observeplayer_make_decorator(objectmachine_t *decorated_machine
     obj->update = observeplayer_update;
     obj->render = observeplayer_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->strategy = strategy;
 
@@ -3804,28 +3702,23 @@ void observeplayer_release(objectmachine_t *obj)
     free(me->strategy);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void observeplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool observeplayer_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_observeplayer_t *me = (objectdecorator_observeplayer_t*)obj;
 
     me->strategy->run(me->strategy, team, team_size);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void observeplayer_render(objectmachine_t *obj, v2d_t camera_position)
+bool observeplayer_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 void observe_player(observeplayerstrategy_t *strategy, player_t **team, int team_size)
@@ -4142,8 +4035,8 @@ static int onmusicplay_should_trigger_event(eventstrategy_t *event, object_t *ob
 static objectmachine_t *onevent_make_decorator(objectmachine_t *decorated_machine, const char *new_state_name, eventstrategy_t *strategy);
 static void onevent_init(objectmachine_t *obj);
 static void onevent_release(objectmachine_t *obj);
-static void onevent_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void onevent_render(objectmachine_t *obj, v2d_t camera_position);
+static bool onevent_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool onevent_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -4417,7 +4310,7 @@ objectmachine_t* objectdecorator_oncameralock_new(objectmachine_t *decorated_mac
 
 objectmachine_t *onevent_make_decorator(objectmachine_t *decorated_machine, const char *new_state_name, eventstrategy_t *strategy)
 {
-    objectdecorator_onevent_t *me = mallocx(sizeof *me);
+    objectdecorator_onevent_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -4426,6 +4319,7 @@ objectmachine_t *onevent_make_decorator(objectmachine_t *decorated_machine, cons
     obj->update = onevent_update;
     obj->render = onevent_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->new_state_name = str_dup(new_state_name);
     me->strategy = strategy;
@@ -4455,30 +4349,27 @@ void onevent_release(objectmachine_t *obj)
     free(me->new_state_name);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void onevent_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool onevent_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_onevent_t *me = (objectdecorator_onevent_t*)obj;
     object_t *object = obj->get_object_instance(obj);
 
-    if(me->strategy->should_trigger_event(me->strategy, object, team, team_size, brick_list, item_list, object_list))
+    if(me->strategy->should_trigger_event(me->strategy, object, team, team_size, brick_list, item_list, object_list)) {
         objectvm_set_current_state(object->vm, me->new_state_name);
-    else
-        decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+        return false; /* the state has changed */
+    }
+
+    return true;
 }
 
-void onevent_render(objectmachine_t *obj, v2d_t camera_position)
+bool onevent_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 
@@ -5258,8 +5149,8 @@ struct objectdecorator_pause_t {
 /* private methods */
 static void pause_init(objectmachine_t *obj);
 static void pause_release(objectmachine_t *obj);
-static void pause_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void pause_render(objectmachine_t *obj, v2d_t camera_position);
+static bool pause_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool pause_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -5268,7 +5159,7 @@ static void pause_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_pause_new(objectmachine_t *decorated_machine)
 {
-    objectdecorator_pause_t *me = mallocx(sizeof *me);
+    objectdecorator_pause_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -5277,6 +5168,7 @@ objectmachine_t* objectdecorator_pause_new(objectmachine_t *decorated_machine)
     obj->update = pause_update;
     obj->render = pause_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     return obj;
@@ -5304,27 +5196,21 @@ void pause_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void pause_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool pause_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     level_pause();
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void pause_render(objectmachine_t *obj, v2d_t camera_position)
+bool pause_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_playeraction_t class */
@@ -5337,8 +5223,8 @@ struct objectdecorator_playeraction_t {
 /* private methods */
 static void playeraction_init(objectmachine_t *obj);
 static void playeraction_release(objectmachine_t *obj);
-static void playeraction_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void playeraction_render(objectmachine_t *obj, v2d_t camera_position);
+static bool playeraction_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool playeraction_render(objectmachine_t *obj, v2d_t camera_position);
 
 static objectmachine_t *playeraction_make_decorator(objectmachine_t *decorated_machine, void (*update_strategy)(player_t*));
 
@@ -5423,7 +5309,7 @@ objectmachine_t* objectdecorator_playerresetunderwatertimer_new(objectmachine_t
 
 objectmachine_t* playeraction_make_decorator(objectmachine_t *decorated_machine, void (*update_strategy)(player_t*))
 {
-    objectdecorator_playeraction_t *me = mallocx(sizeof *me);
+    objectdecorator_playeraction_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -5432,6 +5318,7 @@ objectmachine_t* playeraction_make_decorator(objectmachine_t *decorated_machine,
     obj->update = playeraction_update;
     obj->render = playeraction_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->update = update_strategy;
 
@@ -5457,29 +5344,24 @@ void playeraction_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void playeraction_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool playeraction_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_playeraction_t *me = (objectdecorator_playeraction_t*)obj;
     player_t *player = enemy_get_observed_player(obj->get_object_instance(obj));
 
     me->update(player);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void playeraction_render(objectmachine_t *obj, v2d_t camera_position)
+bool playeraction_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* private strategies */
@@ -5549,8 +5431,8 @@ struct objectdecorator_playermovement_t {
 /* private methods */
 static void playermovement_init(objectmachine_t *obj);
 static void playermovement_release(objectmachine_t *obj);
-static void playermovement_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void playermovement_render(objectmachine_t *obj, v2d_t camera_position);
+static bool playermovement_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool playermovement_render(objectmachine_t *obj, v2d_t camera_position);
 
 static objectmachine_t *playermovement_make_decorator(objectmachine_t *decorated_machine, int enable);
 
@@ -5578,7 +5460,7 @@ objectmachine_t* objectdecorator_disableplayermovement_new(objectmachine_t *deco
 
 objectmachine_t* playermovement_make_decorator(objectmachine_t *decorated_machine, int enable)
 {
-    objectdecorator_playermovement_t *me = mallocx(sizeof *me);
+    objectdecorator_playermovement_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -5587,6 +5469,7 @@ objectmachine_t* playermovement_make_decorator(objectmachine_t *decorated_machin
     obj->update = playermovement_update;
     obj->render = playermovement_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->enable = enable;
 
@@ -5612,29 +5495,24 @@ void playermovement_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void playermovement_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool playermovement_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_playermovement_t *me = (objectdecorator_playermovement_t*)obj;
     player_t *player = enemy_get_observed_player(obj->get_object_instance(obj));
 
     player_set_frozen(player, !me->enable);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void playermovement_render(objectmachine_t *obj, v2d_t camera_position)
+bool playermovement_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_quest_t class */
@@ -5658,8 +5536,8 @@ struct objectdecorator_popquest_t {
 /* private methods */
 static void questcommand_init(objectmachine_t *obj);
 static void questcommand_release(objectmachine_t *obj);
-static void questcommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void questcommand_render(objectmachine_t *obj, v2d_t camera_position);
+static bool questcommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool questcommand_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 static objectmachine_t* setup_decorator(objectdecorator_quest_t *me, objectmachine_t *decorated_machine, void (*update_fun)(objectdecorator_quest_t*));
@@ -5675,14 +5553,14 @@ static void popquest(objectdecorator_quest_t *q);
 /* class constructor */
 objectmachine_t* objectdecorator_pushquest_new(objectmachine_t *decorated_machine, const char *path_to_qst_file)
 {
-    objectdecorator_pushquest_t *me = mallocx(sizeof *me);
+    objectdecorator_pushquest_t *me = entitymanager_alloc(sizeof *me);
     str_cpy(me->filepath,  path_to_qst_file, sizeof(me->filepath));
     return setup_decorator((objectdecorator_quest_t*)me, decorated_machine, pushquest);
 }
 
 objectmachine_t* objectdecorator_popquest_new(objectmachine_t *decorated_machine)
 {
-    objectdecorator_popquest_t *me = mallocx(sizeof *me);
+    objectdecorator_popquest_t *me = entitymanager_alloc(sizeof *me);
     return setup_decorator((objectdecorator_quest_t*)me, decorated_machine, popquest);
 }
 
@@ -5699,6 +5577,7 @@ objectmachine_t* setup_decorator(objectdecorator_quest_t *me, objectmachine_t *d
     obj->update = questcommand_update;
     obj->render = questcommand_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     me->update = update_fun;
@@ -5724,28 +5603,23 @@ void questcommand_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void questcommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool questcommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
     objectdecorator_quest_t *me = (objectdecorator_quest_t*)obj;
-    /*objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;*/
 
     me->update(me);
 
-    /*decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);*/
+    return false; /* suspend the execution */
 }
 
-void questcommand_render(objectmachine_t *obj, v2d_t camera_position)
+bool questcommand_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    /*objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;*/
-
     /* empty */
 
-    /*decorated_machine->render(decorated_machine, camera_position);*/
+    return false; /* suspend the execution */
 }
 
 
@@ -5772,8 +5646,8 @@ struct objectdecorator_resetglobals_t {
 /* private methods */
 static void resetglobals_init(objectmachine_t *obj);
 static void resetglobals_release(objectmachine_t *obj);
-static void resetglobals_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void resetglobals_render(objectmachine_t *obj, v2d_t camera_position);
+static bool resetglobals_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool resetglobals_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -5782,7 +5656,7 @@ static void resetglobals_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_resetglobals_new(objectmachine_t *decorated_machine)
 {
-    objectdecorator_resetglobals_t *me = mallocx(sizeof *me);
+    objectdecorator_resetglobals_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -5791,6 +5665,7 @@ objectmachine_t* objectdecorator_resetglobals_new(objectmachine_t *decorated_mac
     obj->update = resetglobals_update;
     obj->render = resetglobals_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     return obj;
@@ -5818,31 +5693,25 @@ void resetglobals_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void resetglobals_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool resetglobals_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     /* reset globals */
     symboltable_clear(symboltable_get_global_table());
 
     /* reset arrays */
     nanocalc_addons_resetarrays();
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void resetglobals_render(objectmachine_t *obj, v2d_t camera_position)
+bool resetglobals_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_restartlevel_t class */
@@ -5854,8 +5723,8 @@ struct objectdecorator_restartlevel_t {
 /* private methods */
 static void restartlevel_init(objectmachine_t *obj);
 static void restartlevel_release(objectmachine_t *obj);
-static void restartlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void restartlevel_render(objectmachine_t *obj, v2d_t camera_position);
+static bool restartlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool restartlevel_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -5866,7 +5735,7 @@ static void restartlevel_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_restartlevel_new(objectmachine_t *decorated_machine)
 {
-    objectdecorator_restartlevel_t *me = mallocx(sizeof *me);
+    objectdecorator_restartlevel_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -5875,6 +5744,7 @@ objectmachine_t* objectdecorator_restartlevel_new(objectmachine_t *decorated_mac
     obj->update = restartlevel_update;
     obj->render = restartlevel_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     return obj;
@@ -5903,27 +5773,21 @@ void restartlevel_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void restartlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool restartlevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    /*objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;*/
-
     level_restart();
 
-    /*decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);*/
+    return false; /* suspend the execution */
 }
 
-void restartlevel_render(objectmachine_t *obj, v2d_t camera_position)
+bool restartlevel_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_returntopreviousstate_t class */
@@ -5935,8 +5799,8 @@ struct objectdecorator_returntopreviousstate_t {
 /* private methods */
 static void returntopreviousstate_init(objectmachine_t *obj);
 static void returntopreviousstate_release(objectmachine_t *obj);
-static void returntopreviousstate_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void returntopreviousstate_render(objectmachine_t *obj, v2d_t camera_position);
+static bool returntopreviousstate_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool returntopreviousstate_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -5945,7 +5809,7 @@ static void returntopreviousstate_render(objectmachine_t *obj, v2d_t camera_posi
 /* class constructor */
 objectmachine_t* objectdecorator_returntopreviousstate_new(objectmachine_t *decorated_machine)
 {
-    objectdecorator_returntopreviousstate_t *me = mallocx(sizeof *me);
+    objectdecorator_returntopreviousstate_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -5954,6 +5818,7 @@ objectmachine_t* objectdecorator_returntopreviousstate_new(objectmachine_t *deco
     obj->update = returntopreviousstate_update;
     obj->render = returntopreviousstate_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     return obj;
@@ -5981,28 +5846,22 @@ void returntopreviousstate_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void returntopreviousstate_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool returntopreviousstate_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    /*objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;*/
-
     object_t *object = obj->get_object_instance(obj);
     objectvm_return_to_previous_state(object->vm);
 
-    /*decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);*/
+    return false; /* suspend the execution */
 }
 
-void returntopreviousstate_render(objectmachine_t *obj, v2d_t camera_position)
+bool returntopreviousstate_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_savelevel_t class */
@@ -6014,8 +5873,8 @@ struct objectdecorator_savelevel_t {
 /* private methods */
 static void savelevel_init(objectmachine_t *obj);
 static void savelevel_release(objectmachine_t *obj);
-static void savelevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void savelevel_render(objectmachine_t *obj, v2d_t camera_position);
+static bool savelevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool savelevel_render(objectmachine_t *obj, v2d_t camera_position);
 static void fix_objects(object_t *obj, void *any_data); /* will fix obj and its children (ie, set ptr->created_from_editor to TRUE) */
 static void unfix_objects(object_t *obj, void *any_data); /* will undo whatever fix_objects() did */
 
@@ -6028,7 +5887,7 @@ static void unfix_objects(object_t *obj, void *any_data); /* will undo whatever
 /* class constructor */
 objectmachine_t* objectdecorator_savelevel_new(objectmachine_t *decorated_machine)
 {
-    objectdecorator_savelevel_t *me = mallocx(sizeof *me);
+    objectdecorator_savelevel_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -6037,6 +5896,7 @@ objectmachine_t* objectdecorator_savelevel_new(objectmachine_t *decorated_machin
     obj->update = savelevel_update;
     obj->render = savelevel_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     return obj;
@@ -6065,30 +5925,25 @@ void savelevel_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void savelevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool savelevel_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     object_t *o = obj->get_object_instance(obj);
 
     fix_objects(o, NULL);
     level_persist();
     unfix_objects(o, NULL);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void savelevel_render(objectmachine_t *obj, v2d_t camera_position)
+bool savelevel_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* ---------------------------- */
@@ -6115,8 +5970,8 @@ struct objectdecorator_setabsoluteposition_t {
 /* private methods */
 static void setabsoluteposition_init(objectmachine_t *obj);
 static void setabsoluteposition_release(objectmachine_t *obj);
-static void setabsoluteposition_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void setabsoluteposition_render(objectmachine_t *obj, v2d_t camera_position);
+static bool setabsoluteposition_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool setabsoluteposition_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -6127,7 +5982,7 @@ static void setabsoluteposition_render(objectmachine_t *obj, v2d_t camera_positi
 /* class constructor */
 objectmachine_t* objectdecorator_setabsoluteposition_new(objectmachine_t *decorated_machine, expression_t *xpos, expression_t *ypos)
 {
-    objectdecorator_setabsoluteposition_t *me = mallocx(sizeof *me);
+    objectdecorator_setabsoluteposition_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -6136,6 +5991,7 @@ objectmachine_t* objectdecorator_setabsoluteposition_new(objectmachine_t *decora
     obj->update = setabsoluteposition_update;
     obj->render = setabsoluteposition_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->pos_x = xpos;
     me->pos_y = ypos;
@@ -6168,30 +6024,25 @@ void setabsoluteposition_release(objectmachine_t *obj)
     expression_destroy(me->pos_y);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void setabsoluteposition_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool setabsoluteposition_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_setabsoluteposition_t *me = (objectdecorator_setabsoluteposition_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     v2d_t pos = v2d_new(expression_evaluate(me->pos_x), expression_evaluate(me->pos_y));
 
     object->actor->position = pos;
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void setabsoluteposition_render(objectmachine_t *obj, v2d_t camera_position)
+bool setabsoluteposition_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_setalpha_t class */
@@ -6204,8 +6055,8 @@ struct objectdecorator_setalpha_t {
 /* private methods */
 static void setalpha_init(objectmachine_t *obj);
 static void setalpha_release(objectmachine_t *obj);
-static void setalpha_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void setalpha_render(objectmachine_t *obj, v2d_t camera_position);
+static bool setalpha_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool setalpha_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -6216,7 +6067,7 @@ static void setalpha_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_setalpha_new(objectmachine_t *decorated_machine, expression_t *alpha)
 {
-    objectdecorator_setalpha_t *me = mallocx(sizeof *me);
+    objectdecorator_setalpha_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -6225,6 +6076,7 @@ objectmachine_t* objectdecorator_setalpha_new(objectmachine_t *decorated_machine
     obj->update = setalpha_update;
     obj->render = setalpha_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->alpha = alpha;
 
@@ -6255,30 +6107,25 @@ void setalpha_release(objectmachine_t *obj)
     expression_destroy(me->alpha);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void setalpha_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool setalpha_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_setalpha_t *me = (objectdecorator_setalpha_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     float alpha = clip01(expression_evaluate(me->alpha));
 
     object->actor->alpha = alpha;
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void setalpha_render(objectmachine_t *obj, v2d_t camera_position)
+bool setalpha_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_setangle_t class */
@@ -6291,8 +6138,8 @@ struct objectdecorator_setangle_t {
 /* private methods */
 static void setangle_init(objectmachine_t *obj);
 static void setangle_release(objectmachine_t *obj);
-static void setangle_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void setangle_render(objectmachine_t *obj, v2d_t camera_position);
+static bool setangle_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool setangle_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -6303,7 +6150,7 @@ static void setangle_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_setangle_new(objectmachine_t *decorated_machine, expression_t *angle)
 {
-    objectdecorator_setangle_t *me = mallocx(sizeof *me);
+    objectdecorator_setangle_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -6312,6 +6159,7 @@ objectmachine_t* objectdecorator_setangle_new(objectmachine_t *decorated_machine
     obj->update = setangle_update;
     obj->render = setangle_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->angle = angle;
 
@@ -6342,30 +6190,25 @@ void setangle_release(objectmachine_t *obj)
     expression_destroy(me->angle);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void setangle_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool setangle_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_setangle_t *me = (objectdecorator_setangle_t*)obj;
     object_t *object = obj->get_object_instance(obj);
 
     float angle = expression_evaluate(me->angle);
     object->actor->angle = angle * PI / 180.0f;
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void setangle_render(objectmachine_t *obj, v2d_t camera_position)
+bool setangle_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* strategy pattern */
@@ -6425,8 +6268,8 @@ struct objectdecorator_setanimation_t {
 /* private methods */
 static void setanimation_init(objectmachine_t *obj);
 static void setanimation_release(objectmachine_t *obj);
-static void setanimation_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void setanimation_render(objectmachine_t *obj, v2d_t camera_position);
+static bool setanimation_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool setanimation_render(objectmachine_t *obj, v2d_t camera_position);
 
 static objectmachine_t* setanimation_make_decorator(objectdecorator_setanimationstrategy_t *strategy, objectmachine_t *decorated_machine);
 static void change_the_animation(objectmachine_t *obj);
@@ -6477,28 +6320,23 @@ void setanimation_release(objectmachine_t *obj)
     me->strategy->release(obj);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void setanimation_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool setanimation_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_setanimation_t *me = (objectdecorator_setanimation_t*)obj;
 
     me->strategy->update(obj);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void setanimation_render(objectmachine_t *obj, v2d_t camera_position)
+bool setanimation_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 
@@ -6639,7 +6477,7 @@ void change_the_animation(objectmachine_t *obj)
 /* instantiates a decorator */
 objectmachine_t* setanimation_make_decorator(objectdecorator_setanimationstrategy_t *strategy, objectmachine_t *decorated_machine)
 {
-    objectdecorator_setanimation_t *me = mallocx(sizeof *me);
+    objectdecorator_setanimation_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -6648,6 +6486,7 @@ objectmachine_t* setanimation_make_decorator(objectdecorator_setanimationstrateg
     obj->update = setanimation_update;
     obj->render = setanimation_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     me->strategy = strategy;
@@ -6666,8 +6505,8 @@ struct objectdecorator_setobstacle_t {
 /* private methods */
 static void setobstacle_init(objectmachine_t *obj);
 static void setobstacle_release(objectmachine_t *obj);
-static void setobstacle_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void setobstacle_render(objectmachine_t *obj, v2d_t camera_position);
+static bool setobstacle_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool setobstacle_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -6678,7 +6517,7 @@ static void setobstacle_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_setobstacle_new(objectmachine_t *decorated_machine, int is_obstacle, expression_t *angle)
 {
-    objectdecorator_setobstacle_t *me = mallocx(sizeof *me);
+    objectdecorator_setobstacle_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -6687,6 +6526,7 @@ objectmachine_t* objectdecorator_setobstacle_new(objectmachine_t *decorated_mach
     obj->update = setobstacle_update;
     obj->render = setobstacle_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->is_obstacle = is_obstacle;
     me->angle = angle;
@@ -6718,19 +6558,19 @@ void setobstacle_release(objectmachine_t *obj)
     expression_destroy(me->angle);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void setobstacle_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool setobstacle_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_setobstacle_t *me = (objectdecorator_setobstacle_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     /*float angle = expression_evaluate(me->angle);*/ /* deprecated */
 
     /* update collision mask */
     if(object->obstacle != me->is_obstacle) {
+        if(object->mask_obstacle != NULL)
+            object->mask_obstacle = obstacle_destroy(object->mask_obstacle);
         if(object->mask != NULL)
             object->mask = collisionmask_destroy(object->mask);
         if(me->is_obstacle)
@@ -6744,17 +6584,14 @@ void setobstacle_update(objectmachine_t *obj, player_t **team, int team_size, br
     object->obstacle = me->is_obstacle;
 
     /* done */
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void setobstacle_render(objectmachine_t *obj, v2d_t camera_position)
+bool setobstacle_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_setplayeranimation_t class */
@@ -6768,8 +6605,8 @@ struct objectdecorator_setplayeranimation_t {
 /* private methods */
 static void setplayeranimation_init(objectmachine_t *obj);
 static void setplayeranimation_release(objectmachine_t *obj);
-static void setplayeranimation_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void setplayeranimation_render(objectmachine_t *obj, v2d_t camera_position);
+static bool setplayeranimation_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool setplayeranimation_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -6780,7 +6617,7 @@ static void setplayeranimation_render(objectmachine_t *obj, v2d_t camera_positio
 /* class constructor */
 objectmachine_t* objectdecorator_setplayeranimation_new(objectmachine_t *decorated_machine, const char *sprite_name, expression_t *animation_id)
 {
-    objectdecorator_setplayeranimation_t *me = mallocx(sizeof *me);
+    objectdecorator_setplayeranimation_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -6789,6 +6626,7 @@ objectmachine_t* objectdecorator_setplayeranimation_new(objectmachine_t *decorat
     obj->update = setplayeranimation_update;
     obj->render = setplayeranimation_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->sprite_name = str_dup(sprite_name);
     me->animation_id = animation_id;
@@ -6821,30 +6659,25 @@ void setplayeranimation_release(objectmachine_t *obj)
     expression_destroy(me->animation_id);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void setplayeranimation_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool setplayeranimation_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_setplayeranimation_t *me = (objectdecorator_setplayeranimation_t*)obj;
     player_t *player = enemy_get_observed_player(obj->get_object_instance(obj));
     int animation_id = (int)expression_evaluate(me->animation_id);
 
     player_override_animation(player, sprite_get_animation(me->sprite_name, animation_id));
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void setplayeranimation_render(objectmachine_t *obj, v2d_t camera_position)
+bool setplayeranimation_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_setplayerinputmap_t class */
@@ -6857,8 +6690,8 @@ struct objectdecorator_setplayerinputmap_t {
 /* private methods */
 static void setplayerinputmap_init(objectmachine_t *obj);
 static void setplayerinputmap_release(objectmachine_t *obj);
-static void setplayerinputmap_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void setplayerinputmap_render(objectmachine_t *obj, v2d_t camera_position);
+static bool setplayerinputmap_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool setplayerinputmap_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -6867,7 +6700,7 @@ static void setplayerinputmap_render(objectmachine_t *obj, v2d_t camera_position
 /* class constructor */
 objectmachine_t* objectdecorator_setplayerinputmap_new(objectmachine_t *decorated_machine, const char *inputmap_name)
 {
-    objectdecorator_setplayerinputmap_t *me = mallocx(sizeof *me);
+    objectdecorator_setplayerinputmap_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -6876,6 +6709,7 @@ objectmachine_t* objectdecorator_setplayerinputmap_new(objectmachine_t *decorate
     obj->update = setplayerinputmap_update;
     obj->render = setplayerinputmap_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->inputmap_name = str_dup(inputmap_name);
 
@@ -6905,13 +6739,11 @@ void setplayerinputmap_release(objectmachine_t *obj)
     free(me->inputmap_name);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void setplayerinputmap_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool setplayerinputmap_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_setplayerinputmap_t *me = (objectdecorator_setplayerinputmap_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     player_t *player = enemy_get_observed_player(object);
@@ -6920,17 +6752,14 @@ void setplayerinputmap_update(objectmachine_t *obj, player_t **team, int team_si
     /* I'm sure 'in' is an inputuserdefined_t* */
     input_change_mapping((inputuserdefined_t*)in, me->inputmap_name);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void setplayerinputmap_render(objectmachine_t *obj, v2d_t camera_position)
+bool setplayerinputmap_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_setplayerposition_t class */
@@ -6943,8 +6772,8 @@ struct objectdecorator_setplayerposition_t {
 /* private methods */
 static void setplayerposition_init(objectmachine_t *obj);
 static void setplayerposition_release(objectmachine_t *obj);
-static void setplayerposition_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void setplayerposition_render(objectmachine_t *obj, v2d_t camera_position);
+static bool setplayerposition_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool setplayerposition_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -6955,7 +6784,7 @@ static void setplayerposition_render(objectmachine_t *obj, v2d_t camera_position
 /* class constructor */
 objectmachine_t* objectdecorator_setplayerposition_new(objectmachine_t *decorated_machine, expression_t *xpos, expression_t *ypos)
 {
-    objectdecorator_setplayerposition_t *me = mallocx(sizeof *me);
+    objectdecorator_setplayerposition_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -6964,6 +6793,7 @@ objectmachine_t* objectdecorator_setplayerposition_new(objectmachine_t *decorate
     obj->update = setplayerposition_update;
     obj->render = setplayerposition_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->offset_x = xpos;
     me->offset_y = ypos;
@@ -6996,13 +6826,11 @@ void setplayerposition_release(objectmachine_t *obj)
     expression_destroy(me->offset_y);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void setplayerposition_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool setplayerposition_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_setplayerposition_t *me = (objectdecorator_setplayerposition_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     player_t *player = enemy_get_observed_player(object);
@@ -7011,17 +6839,14 @@ void setplayerposition_update(objectmachine_t *obj, player_t **team, int team_si
     v2d_t new_pos = v2d_add(object->actor->position, offset);
     player_set_position(player, new_pos);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void setplayerposition_render(objectmachine_t *obj, v2d_t camera_position)
+bool setplayerposition_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_setplayerspeed_t class */
@@ -7035,8 +6860,8 @@ struct objectdecorator_setplayerspeed_t {
 /* private methods */
 static void setplayerspeed_init(objectmachine_t *obj);
 static void setplayerspeed_release(objectmachine_t *obj);
-static void setplayerspeed_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void setplayerspeed_render(objectmachine_t *obj, v2d_t camera_position);
+static bool setplayerspeed_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool setplayerspeed_render(objectmachine_t *obj, v2d_t camera_position);
 
 static objectmachine_t* setplayerspeed_make_decorator(objectmachine_t *decorated_machine, expression_t *speed, void (*strategy)(player_t*,expression_t*));
 
@@ -7065,7 +6890,7 @@ objectmachine_t* objectdecorator_setplayeryspeed_new(objectmachine_t *decorated_
 /* private methods */
 objectmachine_t* setplayerspeed_make_decorator(objectmachine_t *decorated_machine, expression_t *speed, void (*strategy)(player_t*,expression_t*))
 {
-    objectdecorator_setplayerspeed_t *me = mallocx(sizeof *me);
+    objectdecorator_setplayerspeed_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -7074,6 +6899,7 @@ objectmachine_t* setplayerspeed_make_decorator(objectmachine_t *decorated_machin
     obj->update = setplayerspeed_update;
     obj->render = setplayerspeed_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->speed = speed;
     me->strategy = strategy;
@@ -7101,29 +6927,24 @@ void setplayerspeed_release(objectmachine_t *obj)
     expression_destroy(me->speed);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void setplayerspeed_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool setplayerspeed_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_setplayerspeed_t *me = (objectdecorator_setplayerspeed_t*)obj;
     player_t *player = enemy_get_observed_player(obj->get_object_instance(obj));
 
     me->strategy(player, me->speed);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void setplayerspeed_render(objectmachine_t *obj, v2d_t camera_position)
+bool setplayerspeed_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* private strategies */
@@ -7149,8 +6970,8 @@ struct objectdecorator_setscale_t {
 /* private methods */
 static void setscale_init(objectmachine_t *obj);
 static void setscale_release(objectmachine_t *obj);
-static void setscale_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void setscale_render(objectmachine_t *obj, v2d_t camera_position);
+static bool setscale_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool setscale_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -7161,7 +6982,7 @@ static void setscale_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_setscale_new(objectmachine_t *decorated_machine, expression_t *scale_x, expression_t *scale_y)
 {
-    objectdecorator_setscale_t *me = mallocx(sizeof *me);
+    objectdecorator_setscale_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -7170,6 +6991,7 @@ objectmachine_t* objectdecorator_setscale_new(objectmachine_t *decorated_machine
     obj->update = setscale_update;
     obj->render = setscale_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->scale_x = scale_x;
     me->scale_y = scale_y;
@@ -7202,13 +7024,11 @@ void setscale_release(objectmachine_t *obj)
     expression_destroy(me->scale_y);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void setscale_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool setscale_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_setscale_t *me = (objectdecorator_setscale_t*)obj;
     object_t *object = obj->get_object_instance(obj);
 
@@ -7216,17 +7036,14 @@ void setscale_update(objectmachine_t *obj, player_t **team, int team_size, brick
     float scale_y = max(0.0f, expression_evaluate(me->scale_y));
     object->actor->scale = v2d_new(scale_x, scale_y);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void setscale_render(objectmachine_t *obj, v2d_t camera_position)
+bool setscale_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_setzindex_t class */
@@ -7239,8 +7056,8 @@ struct objectdecorator_setzindex_t {
 /* private methods */
 static void setzindex_init(objectmachine_t *obj);
 static void setzindex_release(objectmachine_t *obj);
-static void setzindex_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void setzindex_render(objectmachine_t *obj, v2d_t camera_position);
+static bool setzindex_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool setzindex_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -7249,7 +7066,7 @@ static void setzindex_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_setzindex_new(objectmachine_t *decorated_machine, expression_t *zindex)
 {
-    objectdecorator_setzindex_t *me = mallocx(sizeof *me);
+    objectdecorator_setzindex_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -7258,6 +7075,7 @@ objectmachine_t* objectdecorator_setzindex_new(objectmachine_t *decorated_machin
     obj->update = setzindex_update;
     obj->render = setzindex_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->zindex = zindex;
 
@@ -7287,13 +7105,11 @@ void setzindex_release(objectmachine_t *obj)
     expression_destroy(me->zindex);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void setzindex_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool setzindex_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_setzindex_t *me = (objectdecorator_setzindex_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     float zindex = expression_evaluate(me->zindex); /* no clip() */
@@ -7302,17 +7118,14 @@ void setzindex_update(objectmachine_t *obj, player_t **team, int team_size, bric
     object->zindex = zindex;
 
     /* decorator pattern */
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void setzindex_render(objectmachine_t *obj, v2d_t camera_position)
+bool setzindex_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_showhide_t class */
@@ -7325,8 +7138,8 @@ struct objectdecorator_showhide_t {
 /* private methods */
 static void showhide_init(objectmachine_t *obj);
 static void showhide_release(objectmachine_t *obj);
-static void showhide_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void showhide_render(objectmachine_t *obj, v2d_t camera_position);
+static bool showhide_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool showhide_render(objectmachine_t *obj, v2d_t camera_position);
 
 static objectmachine_t* showhide_make_decorator(objectmachine_t *decorated_machine, int show);
 
@@ -7348,7 +7161,7 @@ objectmachine_t* objectdecorator_hide_new(objectmachine_t *decorated_machine)
 /* make decorator */
 static objectmachine_t* showhide_make_decorator(objectmachine_t *decorated_machine, int show)
 {
-    objectdecorator_showhide_t *me = mallocx(sizeof *me);
+    objectdecorator_showhide_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -7357,6 +7170,7 @@ static objectmachine_t* showhide_make_decorator(objectmachine_t *decorated_machi
     obj->update = showhide_update;
     obj->render = showhide_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     me->show = show;
@@ -7386,29 +7200,25 @@ void showhide_release(objectmachine_t *obj)
     /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void showhide_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool showhide_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
     object_t *object = obj->get_object_instance(obj);
     objectdecorator_t *dec = (objectdecorator_t*)obj;
     objectdecorator_showhide_t *me = (objectdecorator_showhide_t*)dec;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
 
     object->actor->visible = me->show;
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void showhide_render(objectmachine_t *obj, v2d_t camera_position)
+bool showhide_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_simulatebutton_t class */
@@ -7422,8 +7232,8 @@ struct objectdecorator_simulatebutton_t {
 /* private methods */
 static void simulatebutton_init(objectmachine_t *obj);
 static void simulatebutton_release(objectmachine_t *obj);
-static void simulatebutton_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void simulatebutton_render(objectmachine_t *obj, v2d_t camera_position);
+static bool simulatebutton_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool simulatebutton_render(objectmachine_t *obj, v2d_t camera_position);
 
 static objectmachine_t* simulatebutton_make_decorator(objectmachine_t *decorated_machine, const char *button_name, void (*callback)(input_t*,inputbutton_t));
 
@@ -7444,7 +7254,7 @@ objectmachine_t* objectdecorator_simulatebuttonup_new(objectmachine_t *decorated
 
 objectmachine_t* simulatebutton_make_decorator(objectmachine_t *decorated_machine, const char *button_name, void (*callback)(input_t*,inputbutton_t))
 {
-    objectdecorator_simulatebutton_t *me = mallocx(sizeof *me);
+    objectdecorator_simulatebutton_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -7453,6 +7263,7 @@ objectmachine_t* simulatebutton_make_decorator(objectmachine_t *decorated_machin
     obj->update = simulatebutton_update;
     obj->render = simulatebutton_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->callback = callback;
     me->button = IB_UP;
@@ -7509,13 +7320,11 @@ void simulatebutton_release(objectmachine_t *obj)
     ; /* empty */
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void simulatebutton_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool simulatebutton_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_simulatebutton_t *me = (objectdecorator_simulatebutton_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     player_t *player = enemy_get_observed_player(object);
@@ -7523,17 +7332,14 @@ void simulatebutton_update(objectmachine_t *obj, player_t **team, int team_size,
     input_enable(player->actor->input); /* so that non-active players will respond to this command */
     me->callback(player->actor->input, me->button);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void simulatebutton_render(objectmachine_t *obj, v2d_t camera_position)
+bool simulatebutton_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_switchcharacter_t class */
@@ -7547,8 +7353,8 @@ struct objectdecorator_switchcharacter_t {
 /* private methods */
 static void switchcharacter_init(objectmachine_t *obj);
 static void switchcharacter_release(objectmachine_t *obj);
-static void switchcharacter_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void switchcharacter_render(objectmachine_t *obj, v2d_t camera_position);
+static bool switchcharacter_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool switchcharacter_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -7557,7 +7363,7 @@ static void switchcharacter_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_switchcharacter_new(objectmachine_t *decorated_machine, const char *name, int force_switch)
 {
-    objectdecorator_switchcharacter_t *me = mallocx(sizeof *me);
+    objectdecorator_switchcharacter_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -7566,6 +7372,7 @@ objectmachine_t* objectdecorator_switchcharacter_new(objectmachine_t *decorated_
     obj->update = switchcharacter_update;
     obj->render = switchcharacter_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     me->name = (name != NULL && *name != 0) ? str_dup(name) : NULL;
@@ -7598,13 +7405,11 @@ void switchcharacter_release(objectmachine_t *obj)
         free(me->name);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void switchcharacter_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool switchcharacter_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_switchcharacter_t *me = (objectdecorator_switchcharacter_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     player_t *player = level_player(); /* active player */
@@ -7637,17 +7442,14 @@ void switchcharacter_update(objectmachine_t *obj, player_t **team, int team_size
     else
         fatal_error("Can't switch character: player '%s' does not exist!", me->name);
 
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void switchcharacter_render(objectmachine_t *obj, v2d_t camera_position)
+bool switchcharacter_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 typedef enum { TEXTOUT_LEFT, TEXTOUT_CENTRE, TEXTOUT_RIGHT } textoutstyle_t;
@@ -7668,8 +7470,8 @@ struct objectdecorator_textout_t {
 /* private methods */
 static void textout_init(objectmachine_t *obj);
 static void textout_release(objectmachine_t *obj);
-static void textout_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void textout_render(objectmachine_t *obj, v2d_t camera_position);
+static bool textout_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool textout_render(objectmachine_t *obj, v2d_t camera_position);
 
 objectmachine_t* textout_make_decorator(objectmachine_t *decorated_machine, textoutstyle_t style, const char *font_name, expression_t *xpos, expression_t *ypos, const char *text, expression_t *max_width, expression_t *index_of_first_char, expression_t *length);
 
@@ -7722,13 +7524,11 @@ void textout_release(objectmachine_t *obj)
     free(me->text);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void textout_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool textout_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_textout_t *me = (objectdecorator_textout_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     symboltable_t *st = objectvm_get_symbol_table(object->vm);
@@ -7767,26 +7567,24 @@ void textout_update(objectmachine_t *obj, player_t **team, int team_size, brick_
     font_set_position(me->fnt, v2d_add(object->actor->position, pos));
 
     /* done! */
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void textout_render(objectmachine_t *obj, v2d_t camera_position)
+bool textout_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_textout_t *me = (objectdecorator_textout_t*)obj;
 
     /* textout_render */
     font_render(me->fnt, camera_position);
 
     /* done! */
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 
 objectmachine_t* textout_make_decorator(objectmachine_t *decorated_machine, textoutstyle_t style, const char *font_name, expression_t *xpos, expression_t *ypos, const char *text, expression_t *max_width, expression_t *index_of_first_char, expression_t *length)
 {
-    objectdecorator_textout_t *me = mallocx(sizeof *me);
+    objectdecorator_textout_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -7795,6 +7593,7 @@ objectmachine_t* textout_make_decorator(objectmachine_t *decorated_machine, text
     obj->update = textout_update;
     obj->render = textout_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     me->style = style;
@@ -7837,8 +7636,8 @@ struct objectdecorator_variables_t {
 /* private methods */
 static void varcommand_init(objectmachine_t *obj);
 static void varcommand_release(objectmachine_t *obj);
-static void varcommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void varcommand_render(objectmachine_t *obj, v2d_t camera_position);
+static bool varcommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool varcommand_render(objectmachine_t *obj, v2d_t camera_position);
 
 /* private strategies */
 static int let_strategy(float expr_result) { return FALSE; }
@@ -7853,7 +7652,7 @@ static int unless_strategy(float expr_result) { return fabs(expr_result) < 1e-5;
 /* class constructor */
 objectmachine_t* objectdecorator_let_new(objectmachine_t *decorated_machine, expression_t *expr)
 {
-    objectdecorator_variables_t *me = mallocx(sizeof *me);
+    objectdecorator_variables_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -7862,6 +7661,7 @@ objectmachine_t* objectdecorator_let_new(objectmachine_t *decorated_machine, exp
     obj->update = varcommand_update;
     obj->render = varcommand_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     me->expr = expr;
@@ -7873,7 +7673,7 @@ objectmachine_t* objectdecorator_let_new(objectmachine_t *decorated_machine, exp
 
 objectmachine_t* objectdecorator_if_new(objectmachine_t *decorated_machine, expression_t *expr, const char *new_state_name)
 {
-    objectdecorator_variables_t *me = mallocx(sizeof *me);
+    objectdecorator_variables_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -7882,6 +7682,7 @@ objectmachine_t* objectdecorator_if_new(objectmachine_t *decorated_machine, expr
     obj->update = varcommand_update;
     obj->render = varcommand_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     me->expr = expr;
@@ -7893,7 +7694,7 @@ objectmachine_t* objectdecorator_if_new(objectmachine_t *decorated_machine, expr
 
 objectmachine_t* objectdecorator_unless_new(objectmachine_t *decorated_machine, expression_t *expr, const char *new_state_name)
 {
-    objectdecorator_variables_t *me = mallocx(sizeof *me);
+    objectdecorator_variables_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -7902,6 +7703,7 @@ objectmachine_t* objectdecorator_unless_new(objectmachine_t *decorated_machine,
     obj->update = varcommand_update;
     obj->render = varcommand_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
 
     me->expr = expr;
@@ -7935,31 +7737,28 @@ void varcommand_release(objectmachine_t *obj)
         free(me->new_state_name);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void varcommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool varcommand_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_variables_t *me = (objectdecorator_variables_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     float result = expression_evaluate(me->expr);
 
-    if(me->must_change_state(result))
+    if(me->must_change_state(result)) {
         objectvm_set_current_state(object->vm, me->new_state_name);
-    else
-        decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+        return false; /* the state has changed */
+    }
+
+    return true;
 }
 
-void varcommand_render(objectmachine_t *obj, v2d_t camera_position)
+bool varcommand_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
 /* objectdecorator_walk_t class */
@@ -7973,8 +7772,8 @@ struct objectdecorator_walk_t {
 /* private methods */
 static void walk_init(objectmachine_t *obj);
 static void walk_release(objectmachine_t *obj);
-static void walk_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void walk_render(objectmachine_t *obj, v2d_t camera_position);
+static bool walk_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool walk_render(objectmachine_t *obj, v2d_t camera_position);
 
 
 
@@ -7983,7 +7782,7 @@ static void walk_render(objectmachine_t *obj, v2d_t camera_position);
 /* class constructor */
 objectmachine_t* objectdecorator_walk_new(objectmachine_t *decorated_machine, expression_t *speed)
 {
-    objectdecorator_walk_t *me = mallocx(sizeof *me);
+    objectdecorator_walk_t *me = entitymanager_alloc(sizeof *me);
     objectdecorator_t *dec = (objectdecorator_t*)me;
     objectmachine_t *obj = (objectmachine_t*)dec;
 
@@ -7992,6 +7791,7 @@ objectmachine_t* objectdecorator_walk_new(objectmachine_t *decorated_machine, ex
     obj->update = walk_update;
     obj->render = walk_render;
     obj->get_object_instance = objectdecorator_get_object_instance; /* inherits from superclass */
+    obj->get_decorated_machine = objectdecorator_get_decorated_machine; /* inherits from superclass */
     dec->decorated_machine = decorated_machine;
     me->speed = speed;
 
@@ -8022,13 +7822,11 @@ void walk_release(objectmachine_t *obj)
     expression_destroy(me->speed);
 
     decorated_machine->release(decorated_machine);
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void walk_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool walk_update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
     objectdecorator_walk_t *me = (objectdecorator_walk_t*)obj;
     object_t *object = obj->get_object_instance(obj);
     actor_t *act = object->actor;
@@ -8067,16 +7865,13 @@ void walk_update(objectmachine_t *obj, player_t **team, int team_size, brick_lis
     }
 
     /* decorator pattern */
-    decorated_machine->update(decorated_machine, team, team_size, brick_list, item_list, object_list);
+    return true;
 }
 
-void walk_render(objectmachine_t *obj, v2d_t camera_position)
+bool walk_render(objectmachine_t *obj, v2d_t camera_position)
 {
-    objectdecorator_t *dec = (objectdecorator_t*)obj;
-    objectmachine_t *decorated_machine = dec->decorated_machine;
-
     ; /* empty */
 
-    decorated_machine->render(decorated_machine, camera_position);
+    return true;
 }
 
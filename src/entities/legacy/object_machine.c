@@ -19,6 +19,7 @@
  */
 
 #include "object_machine.h"
+#include "entitymanager.h"
 #include "../../util/util.h"
 #include "../../scenes/level.h"
 
@@ -29,12 +30,26 @@ struct objectbasicmachine_t {
     object_t *object; /* I'm attached to this object */
 };
 
+/* object program: an array of operations */
+typedef struct objectop_t objectop_t;
+struct objectop_t {
+    objectmachine_t *machine;
+    bool (*update)(objectmachine_t*, player_t**, int, brick_list_t*, item_list_t*, object_list_t*);
+    bool (*render)(objectmachine_t*, v2d_t);
+};
+
+struct objectprogram_t {
+    int length; /* number of operations */
+    objectop_t op[]; /* from the outermost machine to the basic machine */
+};
+
 /* private methods */
 static void init(objectmachine_t *obj);
 static void release(objectmachine_t *obj);
-static void update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
-static void render(objectmachine_t *obj, v2d_t camera_position);
+static bool update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list);
+static bool render(objectmachine_t *obj, v2d_t camera_position);
 static object_t* get_object_instance(objectmachine_t *obj);
+static objectmachine_t* get_decorated_machine(objectmachine_t *obj);
 
 
 
@@ -44,7 +59,7 @@ static object_t* get_object_instance(objectmachine_t *obj);
 /* empty machine - constructor */
 objectmachine_t* objectbasicmachine_new(object_t *object)
 {
-    objectbasicmachine_t *me = mallocx(sizeof *me);
+    objectbasicmachine_t *me = entitymanager_alloc(sizeof *me);
     objectmachine_t *obj = (objectmachine_t*)me;
 
     obj->init = init;
@@ -52,11 +67,66 @@ objectmachine_t* objectbasicmachine_new(object_t *object)
     obj->update = update;
     obj->render = render;
     obj->get_object_instance = get_object_instance;
+    obj->get_decorated_machine = get_decorated_machine;
     me->object = object;
 
     return obj;
 }
 
+/* compiles a machine: the chain of decorators is flattened into an array */
+objectprogram_t* objectprogram_compile(objectmachine_t *machine)
+{
+    objectprogram_t *program;
+    objectmachine_t *m;
+    int length = 0;
+
+    for(m = machine; m != NULL; m = m->get_decorated_machine(m))
+        length++;
+
+    program = entitymanager_alloc(sizeof(objectprogram_t) + length * sizeof(objectop_t));
+    program->length = length;
+
+    length = 0;
+    for(m = machine; m != NULL; m = m->get_decorated_machine(m)) {
+        objectop_t *op = &(program->op[length++]);
+        op->machine = m;
+        op->update = m->update;
+        op->render = m->render;
+    }
+
+    return program;
+}
+
+/* destroys a program (the machines are not released) */
+objectprogram_t* objectprogram_destroy(objectprogram_t *program)
+{
+    entitymanager_free(program);
+    return NULL;
+}
+
+/* runs the update cycle of the program. A decorator may suspend the
+   execution of the machines it decorates (e.g., if it changes the state) */
+void objectprogram_update(const objectprogram_t *program, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+{
+    const objectop_t *op = program->op, *end = op + program->length;
+
+    for(; op != end; op++) {
+        if(!op->update(op->machine, team, team_size, brick_list, item_list, object_list))
+            break;
+    }
+}
+
+/* runs the render cycle of the program */
+void objectprogram_render(const objectprogram_t *program, v2d_t camera_position)
+{
+    const objectop_t *op = program->op, *end = op + program->length;
+
+    for(; op != end; op++) {
+        if(!op->render(op->machine, camera_position))
+            break;
+    }
+}
+
 
 /* private methods */
 void init(objectmachine_t *obj)
@@ -66,15 +136,16 @@ void init(objectmachine_t *obj)
 
 void release(objectmachine_t *obj)
 {
-    free(obj);
+    entitymanager_free(obj);
 }
 
-void update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
+bool update(objectmachine_t *obj, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list)
 {
     ; /* empty */
+    return true;
 }
 
-void render(objectmachine_t *obj, v2d_t camera_position)
+bool render(objectmachine_t *obj, v2d_t camera_position)
 {
     actor_t *act = ((objectbasicmachine_t*)obj)->object->actor; /*obj->get_object_instance(obj)->actor;*/
     v2d_t p = act->position;
@@ -83,6 +154,8 @@ void render(objectmachine_t *obj, v2d_t camera_position)
     act->position.y = (int)act->position.y;
     actor_render(act, camera_position);
     act->position = p;
+
+    return true;
 }
 
 object_t* get_object_instance(objectmachine_t *obj)
@@ -91,3 +164,8 @@ object_t* get_object_instance(objectmachine_t *obj)
     return me->object;
 }
 
+objectmachine_t* get_decorated_machine(objectmachine_t *obj)
+{
+    return NULL; /* I'm not a decorator */
+}
+
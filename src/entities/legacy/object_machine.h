@@ -33,12 +33,22 @@ typedef struct objectmachine_t objectmachine_t;
 struct objectmachine_t {
     void (*init)(objectmachine_t*); /* initializes the object */
     void (*release)(objectmachine_t*); /* releases the object */
-    void (*update)(objectmachine_t*, player_t**, int, brick_list_t*, item_list_t*, object_list_t*); /* updates the object (runs every frame) */
-    void (*render)(objectmachine_t*, v2d_t); /* renders the object */
+    bool (*update)(objectmachine_t*, player_t**, int, brick_list_t*, item_list_t*, object_list_t*); /* updates the object (runs every frame); returns false to suspend the execution of the decorated machine */
+    bool (*render)(objectmachine_t*, v2d_t); /* renders the object; returns false to suspend the execution of the decorated machine */
     object_t* (*get_object_instance)(objectmachine_t*);
+    objectmachine_t* (*get_decorated_machine)(objectmachine_t*); /* the machine wrapped by this one, or NULL */
 };
 
 objectmachine_t* objectbasicmachine_new(object_t *object); /* constructs a basic, empty machine */
 
+/* object program: the compiled form of a state. The chain of decorated
+   machines is flattened into an array that is run in a single loop */
+typedef struct objectprogram_t objectprogram_t;
+
+objectprogram_t* objectprogram_compile(objectmachine_t *machine); /* compiles a (decorated) machine */
+objectprogram_t* objectprogram_destroy(objectprogram_t *program); /* destroys a program */
+void objectprogram_update(const objectprogram_t *program, player_t **team, int team_size, brick_list_t *brick_list, item_list_t *item_list, object_list_t *object_list); /* updates the machines of the program, from the outermost to the innermost */
+void objectprogram_render(const objectprogram_t *program, v2d_t camera_position); /* renders the machines of the program */
+
 #endif
 
@@ -19,6 +19,7 @@
  */
 
 #include "object_vm.h"
+#include "entitymanager.h"
 #include "../../util/util.h"
 #include "../../util/stringutil.h"
 
@@ -31,7 +32,7 @@ struct objectvm_t
 {
     enemy_t* owner; /* who owns this VM? */
     objectmachine_list_t* state_list; /* list of states */
-    objectmachine_t** reference_to_current_state; /* reference to the current state */
+    objectmachine_list_t* current_state; /* a node of state_list */
     symboltable_t* symbol_table; /* object's private symbol table (stores its variables) */
     objectmachine_stack_t* history; /* stores previous states */
 };
@@ -40,13 +41,14 @@ struct objectvm_t
 struct objectmachine_list_t {
     char *name;
     objectmachine_t *data;
+    objectprogram_t *program; /* compiled form of data; compiled when first needed */
     objectmachine_list_t *next;
 };
 
 static objectmachine_list_t* objectmachine_list_new(objectmachine_list_t* list, const char *name, enemy_t* owner);
 static objectmachine_list_t* objectmachine_list_delete(objectmachine_list_t* list);
 static objectmachine_list_t* objectmachine_list_find(objectmachine_list_t* list, const char *name);
-static objectmachine_list_t* objectmachine_list_findmachine(objectmachine_list_t* list, objectmachine_t* machine);
+static objectprogram_t* objectmachine_list_program(objectmachine_list_t* list_node);
 
 /* stack of object machines */
 #define OBJECTMACHINE_STACK_CAPACITY 5 /* return_to_previous_state history */
@@ -67,10 +69,10 @@ static void objectmachine_stack_clear(objectmachine_stack_t* stack);
 
 objectvm_t* objectvm_create(enemy_t* owner)
 {
-    objectvm_t *vm = mallocx(sizeof *vm);
+    objectvm_t *vm = entitymanager_alloc(sizeof *vm);
     vm->owner = owner;
     vm->state_list = NULL;
-    vm->reference_to_current_state = NULL;
+    vm->current_state = NULL;
     vm->history = objectmachine_stack_new();
     vm->symbol_table = symboltable_new();
     return vm;
@@ -81,15 +83,27 @@ objectvm_t* objectvm_destroy(objectvm_t* vm)
     symboltable_destroy(vm->symbol_table);
     vm->history = objectmachine_stack_delete(vm->history);
     vm->state_list = objectmachine_list_delete(vm->state_list);
-    vm->reference_to_current_state = NULL;
+    vm->current_state = NULL;
     vm->owner = NULL;
-    free(vm);
+    entitymanager_free(vm);
     return NULL;
 }
 
 objectmachine_t** objectvm_get_reference_to_current_state(objectvm_t* vm)
 {
-    return vm->reference_to_current_state;
+    return vm->current_state != NULL ? &(vm->current_state->data) : NULL;
+}
+
+void objectvm_update(objectvm_t* vm, player_t** team, int team_size, brick_list_t* brick_list, item_list_t* item_list, object_list_t* object_list)
+{
+    objectprogram_t *program = objectmachine_list_program(vm->current_state);
+    objectprogram_update(program, team, team_size, brick_list, item_list, object_list);
+}
+
+void objectvm_render(objectvm_t* vm, v2d_t camera_position)
+{
+    objectprogram_t *program = objectmachine_list_program(vm->current_state);
+    objectprogram_render(program, camera_position);
 }
 
 symboltable_t* objectvm_get_symbol_table(objectvm_t *vm)
@@ -108,7 +122,7 @@ void objectvm_create_state(objectvm_t* vm, const char *name)
 
 const char* objectvm_get_current_state(objectvm_t* vm)
 {
-    objectmachine_list_t *m = objectmachine_list_findmachine(vm->state_list, *(vm->reference_to_current_state));
+    objectmachine_list_t *m = vm->current_state;
 
     if(m == NULL) {
         fatal_error("Object script error: can't get current state name in object \"%s\". This shouldn't happen.", vm->owner->name);
@@ -123,8 +137,8 @@ void objectvm_set_current_state(objectvm_t* vm, const char *name)
     objectmachine_list_t *m = objectmachine_list_find(vm->state_list, name);
 
     if(m != NULL) {
-        if(vm->reference_to_current_state != &(m->data)) {
-            vm->reference_to_current_state = &(m->data);
+        if(vm->current_state != m) {
+            vm->current_state = m;
             objectmachine_stack_push(vm->history, m);
         }
     }
@@ -140,7 +154,7 @@ void objectvm_return_to_previous_state(objectvm_t *vm)
     m = objectmachine_stack_pop(vm->history); /* previous state */
 
     if(m != NULL) {
-        vm->reference_to_current_state = &(m->data);
+        vm->current_state = m;
         objectmachine_stack_push(vm->history, m);
     }
     else
@@ -164,6 +178,18 @@ objectmachine_t* objectvm_get_state_by_name(objectvm_t* vm, const char *name)
         return m->data;
 }
 
+objectprogram_t* objectvm_get_program_by_name(objectvm_t* vm, const char *name)
+{
+    objectmachine_list_t *m = objectmachine_list_find(vm->state_list, name);
+
+    if(m == NULL) {
+        fatal_error("Object script error: can't find state \"%s\" in object \"%s\".", name, vm->owner->name);
+        return NULL;
+    }
+    else
+        return objectmachine_list_program(m);
+}
+
 /* objectmachine_list_t: private methods */
 
 objectmachine_list_t* objectmachine_list_new(objectmachine_list_t* list, const char *name, enemy_t *owner)
@@ -171,6 +197,7 @@ objectmachine_list_t* objectmachine_list_new(objectmachine_list_t* list, const c
     objectmachine_list_t *l = mallocx(sizeof *l);
     l->name = str_dup(name);
     l->data = objectbasicmachine_new(owner);
+    l->program = NULL;
     l->next = list;
     return l;
 }
@@ -180,6 +207,8 @@ objectmachine_list_t* objectmachine_list_delete(objectmachine_list_t* list)
     if(list != NULL) {
         objectmachine_t *machine = list->data;
         objectmachine_list_delete(list->next);
+        if(list->program != NULL)
+            list->program = objectprogram_destroy(list->program);
         free(list->name);
         machine->release(machine);
         free(list);
@@ -200,16 +229,14 @@ objectmachine_list_t* objectmachine_list_find(objectmachine_list_t* list, const
         return NULL;
 }
 
-objectmachine_list_t* objectmachine_list_findmachine(objectmachine_list_t* list, objectmachine_t* machine)
+objectprogram_t* objectmachine_list_program(objectmachine_list_t* list_node)
 {
-     if(list != NULL) {
-        if(list->data != machine)
-            return objectmachine_list_findmachine(list->next, machine);
-        else
-            return list;
-    }
-    else
-        return NULL;   
+    /* the decorators of a state are set up by the object compiler
+       before the state ever runs, so the program is compiled once */
+    if(list_node->program == NULL)
+        list_node->program = objectprogram_compile(list_node->data);
+
+    return list_node->program;
 }
 
 /* objectmachine_stack_t: private methods */
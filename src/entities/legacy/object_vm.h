@@ -36,6 +36,8 @@ typedef struct objectvm_t objectvm_t;
 objectvm_t* objectvm_create(enemy_t* owner); /* creates a new virtual machine */
 objectvm_t* objectvm_destroy(objectvm_t* vm); /* destroys an existing VM */
 objectmachine_t** objectvm_get_reference_to_current_state(objectvm_t* vm); /* returns a reference to the current state */
+void objectvm_update(objectvm_t* vm, player_t** team, int team_size, brick_list_t* brick_list, item_list_t* item_list, object_list_t* object_list); /* runs the update cycle of the current state */
+void objectvm_render(objectvm_t* vm, v2d_t camera_position); /* runs the render cycle of the current state */
 symboltable_t* objectvm_get_symbol_table(objectvm_t *vm); /* returns my symbol table (variables support; nanocalc stuff...) */
 void objectvm_create_state(objectvm_t* vm, const char *name); /* you have to create a state before you can use it */
 const char* objectvm_get_current_state(objectvm_t* vm); /* gets the current state */
@@ -43,5 +45,6 @@ void objectvm_set_current_state(objectvm_t* vm, const char *name); /* sets the c
 void objectvm_return_to_previous_state(objectvm_t *vm); /* returns to the previous state */
 void objectvm_reset_history(objectvm_t *vm); /* resets the history of states (can't return to previous state anymore) */
 objectmachine_t* objectvm_get_state_by_name(objectvm_t* vm, const char *name); /* retrieves a specific state by name */
+objectprogram_t* objectvm_get_program_by_name(objectvm_t* vm, const char *name); /* retrieves the compiled form of a specific state */
 
 #endif
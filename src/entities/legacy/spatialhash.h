@@ -22,24 +22,36 @@
 #define _SPATIALHASH_H
 
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "../../core/global.h"
 #include "../../core/logfile.h"
 #include "../../util/util.h"
+#include "../../util/darray.h"
 
 /* utilities */
-#define SPATIALHASH_GRID_WIDTH      64
-#define SPATIALHASH_GRID_HEIGHT     32
-#define DEFAULT_WORLD_WIDTH         50048 /* max. estimates; multiples of the grid size */
+#define SPATIALHASH_CELL_SIZE       256 /* preferred size of a cell, in pixels */
+#define SPATIALHASH_MAX_GRID_SIZE   1024 /* maximum number of cells in each axis */
+#define DEFAULT_WORLD_WIDTH         50048 /* max. estimates, used until the size of the world is known */
 #define DEFAULT_WORLD_HEIGHT        15008
 
 /* spatialhash_<typename> class: pretty much like C++ templates */
+/* The grid is sized from the dimensions of the world. Each cell stores its
+   elements in a contiguous array that only grows, so that no memory is
+   allocated as elements are added or moved at steady state */
 #define SPATIALHASH_GENERATE_CODE(T) \
 typedef struct spatialhash_##T spatialhash_##T; \
-typedef struct spatialhash_list_##T spatialhash_list_##T; \
+typedef struct spatialhash_cell_##T spatialhash_cell_##T; \
+struct spatialhash_cell_##T { \
+    DARRAY(T*, element) /* lazily initialized */ \
+}; \
 struct spatialhash_##T { \
-    spatialhash_list_##T *bucket[SPATIALHASH_GRID_HEIGHT][SPATIALHASH_GRID_WIDTH]; /* regular elements */ \
-    spatialhash_list_##T *persistent_elements; /* persistent elements */  \
-    int cell_width, cell_height; /* a cell is an element of a SPATIALHASH_GRID_WIDTH x SPATIALHASH_GRID_HEIGHT grid, also known as the bucket */ \
+    spatialhash_cell_##T *cell; /* regular elements: a grid_width x grid_height grid, stored in row-major order */ \
+    int grid_width, grid_height; /* number of cells */ \
+    int cell_width, cell_height; /* size of a cell, in pixels */ \
+    DARRAY(T*, persistent_element) /* persistent elements */ \
+    DARRAY(T*, moved_element) /* scratch: elements that have moved to another cell */ \
     int largest_element_width, largest_element_height; \
     int (*xpos)(const T*); \
     int (*ypos)(const T*); \
@@ -47,17 +59,58 @@ struct spatialhash_##T { \
     int (*height)(const T*); \
     T* (*destroy_element)(T*); \
 }; \
-struct spatialhash_list_##T { \
-    T *data; \
-    spatialhash_list_##T *next; \
-}; \
+/* computes the dimensions of the grid */ \
+static void spatialhash_##T##_compute_grid(int world_size, int *grid_size, int *cell_size) \
+{ \
+    world_size = max(1, world_size); \
+    *grid_size = clip((world_size + SPATIALHASH_CELL_SIZE - 1) / SPATIALHASH_CELL_SIZE, 1, SPATIALHASH_MAX_GRID_SIZE); \
+    *cell_size = max(SPATIALHASH_CELL_SIZE, (world_size + *grid_size - 1) / *grid_size); \
+} \
+/* allocates an empty grid */ \
+static void spatialhash_##T##_create_grid(spatialhash_##T *sh, int world_width, int world_height) \
+{ \
+    int i, n; \
+    spatialhash_##T##_compute_grid(world_width, &sh->grid_width, &sh->cell_width); \
+    spatialhash_##T##_compute_grid(world_height, &sh->grid_height, &sh->cell_height); \
+    n = sh->grid_width * sh->grid_height; \
+    sh->cell = mallocx(n * sizeof *(sh->cell)); \
+    for(i = 0; i < n; i++) { \
+        sh->cell[i].element = NULL; \
+        sh->cell[i].element_len = sh->cell[i].element_cap = 0; \
+    } \
+} \
+/* releases the grid, but not the elements */ \
+static void spatialhash_##T##_destroy_grid(spatialhash_##T *sh) \
+{ \
+    int i, n = sh->grid_width * sh->grid_height; \
+    for(i = 0; i < n; i++) { \
+        if(sh->cell[i].element != NULL) \
+            darray_release(sh->cell[i].element); \
+    } \
+    free(sh->cell); \
+    sh->cell = NULL; \
+} \
+/* the cell of an element */ \
+static spatialhash_cell_##T* spatialhash_##T##_cell_of(spatialhash_##T *sh, const T *element) \
+{ \
+    int col = clip(sh->xpos(element) / sh->cell_width, 0, sh->grid_width-1); \
+    int row = clip(sh->ypos(element) / sh->cell_height, 0, sh->grid_height-1); \
+    return &(sh->cell[row * sh->grid_width + col]); \
+} \
+/* inserts an element into a cell (no checks) */ \
+static void spatialhash_##T##_insert(spatialhash_cell_##T *cell, T *element) \
+{ \
+    if(cell->element == NULL) \
+        darray_init(cell->element); \
+    darray_push(cell->element, element); \
+} \
 spatialhash_##T* spatialhash_##T##_create_ex(T* (*destroy_element_strategy)(T*), int (*get_element_xpos)(const T*), int (*get_element_ypos)(const T*), int (*get_element_width)(const T*), int (*get_element_height)(const T*), int estimated_world_width, int estimated_world_height) /* destroy_element_strategy may be NULL */ \
 { \
-    int i, j; \
     spatialhash_##T *sh = mallocx(sizeof *sh); \
     logfile_message("spatialhash_" #T "_create_ex(%d, %d)", estimated_world_width, estimated_world_height); \
-    sh->cell_width = max(1, estimated_world_width / SPATIALHASH_GRID_WIDTH); \
-    sh->cell_height = max(1, estimated_world_height / SPATIALHASH_GRID_HEIGHT); \
+    spatialhash_##T##_create_grid(sh, estimated_world_width, estimated_world_height); \
+    darray_init(sh->persistent_element); \
+    darray_init(sh->moved_element); \
     sh->largest_element_width = 0; \
     sh->largest_element_height = 0; \
     sh->xpos = get_element_xpos; \
@@ -65,11 +118,6 @@ spatialhash_##T* spatialhash_##T##_create_ex(T* (*destroy_element_strategy)(T*),
     sh->width = get_element_width; \
     sh->height = get_element_height; \
     sh->destroy_element = destroy_element_strategy; \
-    for(i=0; i<SPATIALHASH_GRID_HEIGHT; i++) { \
-        for(j=0; j<SPATIALHASH_GRID_WIDTH; j++) \
-            sh->bucket[i][j] = NULL; \
-    } \
-    sh->persistent_elements = NULL; \
     return sh; \
 } \
 /* creates a new spatial hash */ \
@@ -80,159 +128,130 @@ spatialhash_##T* spatialhash_##T##_create(T* (*destroy_element_strategy)(T*), in
 /* destroys an existing spatial hash */ \
 spatialhash_##T* spatialhash_##T##_destroy(spatialhash_##T *sh) \
 { \
-    int i, j; \
-    spatialhash_list_##T *p, *q; \
+    int i, j, n = sh->grid_width * sh->grid_height; \
     logfile_message("spatialhash_" #T "_destroy()"); \
-    for(i=0; i<SPATIALHASH_GRID_HEIGHT; i++) { \
-        for(j=0; j<SPATIALHASH_GRID_WIDTH; j++) { \
-            p = sh->bucket[i][j]; \
-            while(p != NULL) { \
-                q = p->next; \
-                if(sh->destroy_element != NULL) \
-                    p->data = sh->destroy_element(p->data); \
-                free(p); \
-                p = q; \
-            } \
+    if(sh->destroy_element != NULL) { \
+        for(i = 0; i < n; i++) { \
+            for(j = 0; j < (int)darray_length(sh->cell[i].element); j++) \
+                sh->destroy_element(sh->cell[i].element[j]); \
         } \
+        for(j = 0; j < (int)darray_length(sh->persistent_element); j++) \
+            sh->destroy_element(sh->persistent_element[j]); \
     } \
-    p = sh->persistent_elements; \
-    while(p != NULL) { \
-        q = p->next; \
-        if(sh->destroy_element != NULL) \
-            p->data = sh->destroy_element(p->data); \
-        free(p); \
-        p = q; \
-    } \
+    spatialhash_##T##_destroy_grid(sh); \
+    darray_release(sh->moved_element); \
+    darray_release(sh->persistent_element); \
     free(sh); \
     logfile_message("spatialhash_" #T "_destroy() - success!"); \
     return NULL; \
 } \
-/* adds an element to the spatial hash */ \
-void spatialhash_##T##_add(spatialhash_##T *sh, T *element) \
+/* resizes the grid according to the dimensions of the world */ \
+void spatialhash_##T##_resize(spatialhash_##T *sh, int world_width, int world_height) \
 { \
-    int row, col; \
-    spatialhash_list_##T *p; \
+    int i, j, n = sh->grid_width * sh->grid_height; \
+    int grid_width, grid_height, cell_width, cell_height; \
     \
-    col = sh->xpos(element) / sh->cell_width; \
-    row = sh->ypos(element) / sh->cell_height; \
-    col = clip(col, 0, SPATIALHASH_GRID_WIDTH-1); \
-    row = clip(row, 0, SPATIALHASH_GRID_HEIGHT-1); \
+    spatialhash_##T##_compute_grid(world_width, &grid_width, &cell_width); \
+    spatialhash_##T##_compute_grid(world_height, &grid_height, &cell_height); \
+    if(grid_width == sh->grid_width && grid_height == sh->grid_height && cell_width == sh->cell_width && cell_height == sh->cell_height) \
+        return; \
     \
-    for(p = sh->bucket[row][col]; p != NULL; p = p->next) { \
-        if(p->data == element) { \
-            logfile_message("spatialhash_" #T "_add(): element '%p' already exists! It won't be added.", element); \
-            return; \
-        } \
-    } \
+    logfile_message("spatialhash_" #T "_resize(%d, %d): %dx%d grid", world_width, world_height, grid_width, grid_height); \
     \
-    /*logfile_message("spatialhash_" #T "_add(): adding '%p'...", element);*/ \
+    darray_clear(sh->moved_element); \
+    for(i = 0; i < n; i++) { \
+        for(j = 0; j < (int)darray_length(sh->cell[i].element); j++) \
+            darray_push(sh->moved_element, sh->cell[i].element[j]); \
+    } \
     \
-    p = mallocx(sizeof *p); \
-    p->data = element; \
-    p->next = sh->bucket[row][col]; \
-    sh->bucket[row][col] = p; \
+    spatialhash_##T##_destroy_grid(sh); \
+    spatialhash_##T##_create_grid(sh, world_width, world_height); \
     \
-    sh->largest_element_width = max(sh->largest_element_width, sh->width(element)); \
-    sh->largest_element_height = max(sh->largest_element_height, sh->height(element)); \
+    for(j = 0; j < (int)darray_length(sh->moved_element); j++) \
+        spatialhash_##T##_insert(spatialhash_##T##_cell_of(sh, sh->moved_element[j]), sh->moved_element[j]); \
+    darray_clear(sh->moved_element); \
 } \
-/* adds a persistent element to the spatial hash */ \
-void spatialhash_##T##_add_persistent(spatialhash_##T *sh, T *element) \
+/* adds an element to the spatial hash */ \
+void spatialhash_##T##_add(spatialhash_##T *sh, T *element) \
 { \
-    spatialhash_list_##T *p; \
+    spatialhash_cell_##T *cell = spatialhash_##T##_cell_of(sh, element); \
+    int i; \
     \
-    for(p = sh->persistent_elements; p != NULL; p = p->next) { \
-        if(p->data == element) { \
-            logfile_message("spatialhash_" #T "_add_persistent(): element '%p' already exists! It won't be added.", element); \
+    for(i = 0; i < (int)darray_length(cell->element); i++) { \
+        if(cell->element[i] == element) { \
+            logfile_message("spatialhash_" #T "_add(): element '%p' already exists! It won't be added.", element); \
             return; \
         } \
     } \
     \
-    /*logfile_message("spatialhash_" #T "_add_persistent(): adding '%p'...", element);*/ \
+    spatialhash_##T##_insert(cell, element); \
     \
-    p = mallocx(sizeof *p); \
-    p->data = element; \
-    p->next = sh->persistent_elements; \
-    sh->persistent_elements = p; \
+    sh->largest_element_width = max(sh->largest_element_width, sh->width(element)); \
+    sh->largest_element_height = max(sh->largest_element_height, sh->height(element)); \
 } \
 /* checks if an element of the spatial hash is persistent */ \
 bool spatialhash_##T##_is_persistent(spatialhash_##T *sh, T *element) \
 { \
-    spatialhash_list_##T *p; \
+    int i; \
     \
-    for(p = sh->persistent_elements; p != NULL; p = p->next) { \
-        if(p->data == element) \
+    for(i = 0; i < (int)darray_length(sh->persistent_element); i++) { \
+        if(sh->persistent_element[i] == element) \
             return true; \
     } \
     \
     return false; \
 } \
+/* adds a persistent element to the spatial hash */ \
+void spatialhash_##T##_add_persistent(spatialhash_##T *sh, T *element) \
+{ \
+    if(spatialhash_##T##_is_persistent(sh, element)) { \
+        logfile_message("spatialhash_" #T "_add_persistent(): element '%p' already exists! It won't be added.", element); \
+        return; \
+    } \
+    \
+    darray_push(sh->persistent_element, element); \
+} \
 /* removes an element from the spatial hash */ \
 void spatialhash_##T##_remove(spatialhash_##T *sh, T *element) \
 { \
-    int row, col; \
-    spatialhash_list_##T *p, *prev; \
-    \
-    col = sh->xpos(element) / sh->cell_width; \
-    row = sh->ypos(element) / sh->cell_height; \
-    col = clip(col, 0, SPATIALHASH_GRID_WIDTH-1); \
-    row = clip(row, 0, SPATIALHASH_GRID_HEIGHT-1); \
+    spatialhash_cell_##T *cell = spatialhash_##T##_cell_of(sh, element); \
+    int i, n; \
     \
     /* is it a regular element? */ \
-    for(prev = NULL, p = sh->bucket[row][col]; p != NULL; prev = p, p = p->next) { \
-        if(p->data == element) { \
-            if(prev != NULL) \
-                prev->next = p->next; \
-            else \
-                sh->bucket[row][col] = p->next; \
-            \
-            if(sh->destroy_element != NULL) \
-                p->data = sh->destroy_element(p->data); \
-            \
-            free(p); \
-            return; \
-        } \
+    for(i = 0; i < (int)darray_length(cell->element); i++) { \
+        if(cell->element[i] == element) \
+            goto found; \
     } \
     \
     /* is it a persistent element? */ \
-    for(prev = NULL, p = sh->persistent_elements; p != NULL; prev = p, p = p->next) { \
-        if(p->data == element) { \
-            if(prev != NULL) \
-                prev->next = p->next; \
-            else \
-                sh->persistent_elements = p->next; \
-            \
+    for(i = 0; i < (int)darray_length(sh->persistent_element); i++) { \
+        if(sh->persistent_element[i] == element) { \
+            darray_remove(sh->persistent_element, i); \
             if(sh->destroy_element != NULL) \
-                p->data = sh->destroy_element(p->data); \
-            \
-            free(p); \
+                sh->destroy_element(element); \
             return; \
         } \
     } \
     \
-    /* FIXME looking in the entire table to see if we find the element (this is BAD) */ \
-    for(row = 0; row < SPATIALHASH_GRID_HEIGHT; row++) { \
-        for(col = 0; col < SPATIALHASH_GRID_WIDTH; col++) { \
-            for(prev = NULL, p = sh->bucket[row][col]; p != NULL; prev = p, p = p->next) { \
-                if(p->data == element) { \
-                    logfile_message("spatialhash_" #T "_remove(): trouble on removing '%p'... I had to look for it in the entire table", element); \
-                    \
-                    if(prev != NULL) \
-                        prev->next = p->next; \
-                    else \
-                        sh->bucket[row][col] = p->next; \
-                    \
-                    if(sh->destroy_element != NULL) \
-                        p->data = sh->destroy_element(p->data); \
-                    \
-                    free(p); \
-                    return; \
-                } \
+    /* looking in the entire table to see if we find the element */ \
+    for(n = 0; n < sh->grid_width * sh->grid_height; n++) { \
+        cell = &(sh->cell[n]); \
+        for(i = 0; i < (int)darray_length(cell->element); i++) { \
+            if(cell->element[i] == element) { \
+                logfile_message("spatialhash_" #T "_remove(): trouble on removing '%p'... I had to look for it in the entire table", element); \
+                goto found; \
             } \
         } \
     } \
     \
     /* aargh! it's 3:00 AM and we found nothing! */ \
     logfile_message("spatialhash_" #T "_remove(): element '%p' was not found.", element); \
+    return; \
+    \
+found: \
+    cell->element[i] = cell->element[--cell->element_len]; /* the order of the cell doesn't matter */ \
+    if(sh->destroy_element != NULL) \
+        sh->destroy_element(element); \
 } \
 /* for each element X in the given rectangle, calls callback_function(X,some_user_data), */ \
 /* where some_user_data, a void pointer, may be anything you need. */ \
@@ -244,82 +263,152 @@ void spatialhash_##T##_foreach(spatialhash_##T *sh, int rectangle_xpos, int rect
 { \
     int r_x1, r_y1, r_x2, r_y2, e_x1, e_y1, e_x2, e_y2; \
     int row, col, first_row, first_col, last_row, last_col; \
-    int stop_iteration = FALSE; \
-    spatialhash_list_##T *p, *prev; \
+    int i, stop_iteration = FALSE; \
     \
     r_x1 = rectangle_xpos - sh->largest_element_width; \
     r_y1 = rectangle_ypos - sh->largest_element_height; \
     r_x2 = rectangle_xpos + sh->largest_element_width + rectangle_width; \
     r_y2 = rectangle_ypos + sh->largest_element_height + rectangle_height; \
     \
-    first_col = r_x1 / sh->cell_width; \
-    first_row = r_y1 / sh->cell_height; \
-    last_col = r_x2 / sh->cell_width; \
-    last_row = r_y2 / sh->cell_height; \
-    \
-    first_col = clip(first_col, 0, SPATIALHASH_GRID_WIDTH-1); \
-    first_row = clip(first_row, 0, SPATIALHASH_GRID_HEIGHT-1); \
-    last_col = clip(last_col, 0, SPATIALHASH_GRID_WIDTH-1); \
-    last_row = clip(last_row, 0, SPATIALHASH_GRID_HEIGHT-1); \
+    first_col = clip(r_x1 / sh->cell_width, 0, sh->grid_width-1); \
+    first_row = clip(r_y1 / sh->cell_height, 0, sh->grid_height-1); \
+    last_col = clip(r_x2 / sh->cell_width, 0, sh->grid_width-1); \
+    last_row = clip(r_y2 / sh->cell_height, 0, sh->grid_height-1); \
     \
-    /* scanning persistent elements */ \
-    for(p = sh->persistent_elements; p != NULL && !stop_iteration; p = p->next) { \
-        if(0 != callback_function(p->data, some_user_data)) \
+    /* scanning persistent elements (newest first) */ \
+    for(i = (int)darray_length(sh->persistent_element) - 1; i >= 0 && !stop_iteration; i--) { \
+        if(0 != callback_function(sh->persistent_element[i], some_user_data)) \
             stop_iteration = TRUE; \
     } \
     \
     /* scanning regular elements */ \
-    stop_iteration = !((rectangle_width > 0) && (rectangle_height > 0)); \
-    for(row=first_row; row<=last_row; row++) { \
-        for(col=first_col; col<=last_col; col++) { \
-            prev = NULL; \
-            p = sh->bucket[row][col]; \
+    if(!((rectangle_width > 0) && (rectangle_height > 0))) \
+        return; \
+    \
+    darray_clear(sh->moved_element); \
+    for(row = first_row; row <= last_row && !stop_iteration; row++) { \
+        for(col = first_col; col <= last_col && !stop_iteration; col++) { \
+            spatialhash_cell_##T *cell = &(sh->cell[row * sh->grid_width + col]); \
             \
-            while(p != NULL && !stop_iteration) { \
+            /* iterate backwards, so that we can swap-remove the moved elements */ \
+            for(i = (int)darray_length(cell->element) - 1; i >= 0 && !stop_iteration; i--) { \
+                T *e = cell->element[i]; \
                 int cx, cy; \
-                e_x1 = sh->xpos(p->data); \
-                e_y1 = sh->ypos(p->data); \
-                e_x2 = e_x1 + sh->width(p->data); \
-                e_y2 = e_y1 + sh->height(p->data); \
+                \
+                e_x1 = sh->xpos(e); \
+                e_y1 = sh->ypos(e); \
+                e_x2 = e_x1 + sh->width(e); \
+                e_y2 = e_y1 + sh->height(e); \
                 sh->largest_element_width = max(sh->largest_element_width, e_x2 - e_x1); \
                 sh->largest_element_height = max(sh->largest_element_height, e_y2 - e_y1); \
                 \
-                cx = e_x1 / sh->cell_width; \
-                cy = e_y1 / sh->cell_height; \
-                cx = clip(cx, 0, SPATIALHASH_GRID_WIDTH-1); \
-                cy = clip(cy, 0, SPATIALHASH_GRID_HEIGHT-1); \
+                cx = clip(e_x1 / sh->cell_width, 0, sh->grid_width-1); \
+                cy = clip(e_y1 / sh->cell_height, 0, sh->grid_height-1); \
                 \
                 if(cx >= first_col && cx <= last_col && cy >= first_row && cy <= last_row) { \
-                    /* is p->data inside the given rectangle? (bounding box check) */ \
+                    /* is e inside the given rectangle? (bounding box check) */ \
                     if((e_x1 <= r_x2 && e_x2 >= r_x1) && (e_y1 <= r_y2 && e_y2 >= r_y1)) { \
-                        if((!stop_iteration) && (0 != callback_function(p->data, some_user_data))) \
+                        if(0 != callback_function(e, some_user_data)) \
                             stop_iteration = TRUE; \
                     } \
                 } \
                 \
                 if(!(cx == col && cy == row)) { \
-                    /* do we need to move p->data to some other bucket? */ \
-                    T *e = p->data; \
-                    if(prev != NULL) { \
-                        prev->next = p->next; \
-                        free(p); \
-                        p = prev; \
-                        spatialhash_##T##_add(sh, e); \
-                    } \
-                    else { \
-                        sh->bucket[row][col] = p->next; \
-                        free(p); \
-                        p = sh->bucket[row][col]; \
-                        spatialhash_##T##_add(sh, e); \
-                        continue; \
-                    } \
+                    /* e has moved to some other cell; relocate it after the scan */ \
+                    cell->element[i] = cell->element[--cell->element_len]; \
+                    darray_push(sh->moved_element, e); \
                 } \
+            } \
+        } \
+    } \
+    \
+    /* relocate the elements that have moved */ \
+    for(i = 0; i < (int)darray_length(sh->moved_element); i++) \
+        spatialhash_##T##_insert(spatialhash_##T##_cell_of(sh, sh->moved_element[i]), sh->moved_element[i]); \
+    darray_clear(sh->moved_element); \
+} \
+/* finds the element X that minimizes distance_function(X,some_user_data) among the elements */ \
+/* that spatialhash_##T##_foreach would enumerate for the given rectangle, searching the cells */ \
+/* around (xpos,ypos) from the nearest to the farthest. distance_function must return a distance */ \
+/* not smaller than the distance between (xpos,ypos) and the position of X (minus a pixel), or */ \
+/* INFINITY to reject X. Returns NULL if there is no such element. distance may be NULL */ \
+T* spatialhash_##T##_find_nearest(spatialhash_##T *sh, int xpos, int ypos, int rectangle_xpos, int rectangle_ypos, int rectangle_width, int rectangle_height, void *some_user_data, float (*distance_function)(T*,void*), float *distance) \
+{ \
+    int r_x1, r_y1, r_x2, r_y2, e_x1, e_y1, e_x2, e_y2; \
+    int row, col, first_row, first_col, last_row, last_col; \
+    int center_row, center_col, ring, max_ring, min_cell_size; \
+    float best_distance = INFINITY, d; \
+    T *best = NULL; \
+    int i; \
+    \
+    /* persistent elements */ \
+    for(i = (int)darray_length(sh->persistent_element) - 1; i >= 0; i--) { \
+        if((d = distance_function(sh->persistent_element[i], some_user_data)) < best_distance) { \
+            best_distance = d; \
+            best = sh->persistent_element[i]; \
+        } \
+    } \
+    \
+    /* regular elements */ \
+    if(!((rectangle_width > 0) && (rectangle_height > 0))) \
+        goto done; \
+    \
+    r_x1 = rectangle_xpos - sh->largest_element_width; \
+    r_y1 = rectangle_ypos - sh->largest_element_height; \
+    r_x2 = rectangle_xpos + sh->largest_element_width + rectangle_width; \
+    r_y2 = rectangle_ypos + sh->largest_element_height + rectangle_height; \
+    \
+    first_col = clip(r_x1 / sh->cell_width, 0, sh->grid_width-1); \
+    first_row = clip(r_y1 / sh->cell_height, 0, sh->grid_height-1); \
+    last_col = clip(r_x2 / sh->cell_width, 0, sh->grid_width-1); \
+    last_row = clip(r_y2 / sh->cell_height, 0, sh->grid_height-1); \
+    \
+    center_col = clip(xpos / sh->cell_width, 0, sh->grid_width-1); \
+    center_row = clip(ypos / sh->cell_height, 0, sh->grid_height-1); \
+    max_ring = max( \
+        max(abs(center_col - first_col), abs(center_col - last_col)), \
+        max(abs(center_row - first_row), abs(center_row - last_row)) \
+    ); \
+    min_cell_size = min(sh->cell_width, sh->cell_height); \
+    \
+    /* scan the rings of cells around the center */ \
+    for(ring = 0; ring <= max_ring; ring++) { \
+        /* the elements of this ring are at least that far */ \
+        if(ring > 0 && (float)((ring - 1) * min_cell_size - 1) >= best_distance) \
+            break; \
+        \
+        for(row = max(first_row, center_row - ring); row <= min(last_row, center_row + ring); row++) { \
+            int step = (row == center_row - ring || row == center_row + ring) ? 1 : max(1, 2 * ring); \
+            for(col = center_col - ring; col <= center_col + ring; col += step) { \
+                spatialhash_cell_##T *cell; \
+                if(col < first_col || col > last_col) \
+                    continue; \
                 \
-                prev = p; \
-                p = p->next; \
+                cell = &(sh->cell[row * sh->grid_width + col]); \
+                for(i = (int)darray_length(cell->element) - 1; i >= 0; i--) { \
+                    T *e = cell->element[i]; \
+                    e_x1 = sh->xpos(e); \
+                    e_y1 = sh->ypos(e); \
+                    e_x2 = e_x1 + sh->width(e); \
+                    e_y2 = e_y1 + sh->height(e); \
+                    \
+                    /* is e inside the given rectangle? (bounding box check) */ \
+                    if((e_x1 <= r_x2 && e_x2 >= r_x1) && (e_y1 <= r_y2 && e_y2 >= r_y1)) { \
+                        if((d = distance_function(e, some_user_data)) < best_distance) { \
+                            best_distance = d; \
+                            best = e; \
+                        } \
+                    } \
+                } \
             } \
         } \
     } \
+    \
+done: \
+    if(distance != NULL) \
+        *distance = best_distance; \
+    \
+    return best; \
 } \
 /* similar to spatialhash_##T##_foreach, but this one retrieves all the elements stored in the spatial hash */ \
 void spatialhash_##T##_forall(spatialhash_##T *sh, void *some_user_data, int (*callback_function)(T*,void*)) \
@@ -27,6 +27,7 @@
 #include "../core/logfile.h"
 #include "../core/video.h"
 #include "../core/timer.h"
+#include "../core/shader.h"
 #include "../util/v2d.h"
 #include "../util/numeric.h"
 #include "../util/util.h"
@@ -191,6 +192,9 @@ static bool is_available = false;
 /* is the mobile gamepad visible? */
 static bool is_visible = true;
 
+/* are the images of the actors filtered linearly? */
+static bool is_filtered = false;
+
 /* alpha value used for fading in and fading out the mobile gamepad */
 static float alpha = 1.0f;
 
@@ -214,15 +218,42 @@ static actor_t* actor[] = {
 /* indicates the pressing of the back button or the performing of a back gesture on a smartphone */
 static bool back_pressed = false;
 
+/* the scale of the actors, computed from the size of the window */
+static float current_scale = 1.0f;
+
+/* is the dpad stick at the center of the dpad? */
+static bool is_stick_centered = true;
+
+/* pre-rendered idle controls: most of the time nothing is pressed, so we draw
+   the idle animation of each control from a texture pre-rendered at the current
+   scale, with a plain translation, instead of rendering the actor with a transform */
+typedef struct idlecontrol_t idlecontrol_t;
+struct idlecontrol_t {
+    image_t* image; /* NULL if not available */
+    const animation_t* animation; /* the animation that was pre-rendered */
+    float scale; /* the scale of the pre-rendered image */
+    v2d_t hot_spot; /* the hot spot of the pre-rendered image */
+    bool is_bakeable; /* can the idle animation be pre-rendered? */
+};
+
+static idlecontrol_t idle_control[] = {
+    [DPAD] = { .image = NULL, .animation = NULL },
+    [DPAD_STICK] = { .image = NULL, .animation = NULL },
+    [ACTION_BUTTON] = { .image = NULL, .animation = NULL }
+};
+
 /* misc */
 static void trigger(int control, v2d_t offset);
 static void animate_actors();
 static void update_actors();
 static void render_actors();
 static void handle_fade_effect();
-static void enable_linear_filtering();
+static void set_linear_filtering(bool enabled);
 static v2d_t dpad_stick_offset(float scale);
 static void a5_handle_back_event(const ALLEGRO_EVENT* event, void* data);
+static bool is_idle(int control);
+static const idlecontrol_t* get_idle_control(int control);
+static void discard_idle_controls();
 
 
 
@@ -289,7 +320,7 @@ void mobilegamepad_init(int _flags)
     for(int i = 0; i < NUM_CONTROLS; i++)
         actor[i] = actor_create();
 
-    enable_linear_filtering();
+    set_linear_filtering(true);
 
     /* make it visible */
     is_visible = true;
@@ -306,6 +337,9 @@ void mobilegamepad_init(int _flags)
  */
 void mobilegamepad_release()
 {
+    /* destroy the pre-rendered controls */
+    discard_idle_controls();
+
     /* destroy the actors */
     for(int i = NUM_CONTROLS - 1; i >= 0; i--) {
         if(actor[i] != NULL) {
@@ -413,8 +447,14 @@ void mobilegamepad_render()
     /* fading in and fading out */
     handle_fade_effect();
 
-    /* render mobile gamepad */
-    render_actors();
+    /* adaptive quality: no linear filtering under load */
+    bool want_filtering = !video_is_quality_step_taken(VIDEOQUALITYSTEP_NEAREST_FILTERING);
+    if(want_filtering != is_filtered)
+        set_linear_filtering(want_filtering);
+
+    /* render mobile gamepad, unless it's fully transparent */
+    if(alpha * user_opacity > 0.0f)
+        render_actors();
 
     /* render the mouse cursor */
     if(flags & MOBILEGAMEPAD_WANT_MOUSE_INPUT) {
@@ -446,6 +486,18 @@ bool mobilegamepad_is_visible()
     return is_visible;
 }
 
+/*
+ * mobilegamepad_is_fading()
+ * Checks if the mobile gamepad is fading in or out
+ */
+bool mobilegamepad_is_fading()
+{
+    if(!is_available)
+        return false;
+
+    return is_visible ? (alpha < 1.0f) : (alpha > 0.0f);
+}
+
 /*
  * mobilegamepad_get_state()
  * Reads the current state of the mobile gamepad
@@ -553,6 +605,7 @@ void update_actors()
     v2d_t window_size = video_get_window_size();
     v2d_t window_scale = v2d_new(window_size.x / REFERENCE_RESOLUTION.x, window_size.y / REFERENCE_RESOLUTION.y);
     float scale = max(window_scale.x, window_scale.y);
+    current_scale = scale;
 
     /* animate the actors */
     animate_actors();
@@ -581,6 +634,7 @@ void update_actors()
     v2d_t stick_offset = dpad_stick_offset(scale);
     actor[DPAD_STICK]->position.x += stick_offset.x;
     actor[DPAD_STICK]->position.y += stick_offset.y;
+    is_stick_centered = (stick_offset.x == 0.0f && stick_offset.y == 0.0f);
 }
 
 void render_actors()
@@ -588,8 +642,22 @@ void render_actors()
     v2d_t camera = v2d_multiply(video_get_screen_size(), 0.5f);
 
     /* render the mobile controls in screen space */
-    for(int i = 0; i < NUM_CONTROLS; i++)
-        actor_render(actor[i], camera);
+    for(int i = 0; i < NUM_CONTROLS; i++) {
+        const idlecontrol_t* idle = is_idle(i) ? get_idle_control(i) : NULL;
+
+        /* render the pressed or tilted controls */
+        if(idle == NULL) {
+            actor_render(actor[i], camera);
+            continue;
+        }
+
+        /* render the pre-rendered idle control */
+        if(actor[i]->visible) {
+            int x = (int)floorf(actor[i]->position.x - idle->hot_spot.x);
+            int y = (int)floorf(actor[i]->position.y - idle->hot_spot.y);
+            image_draw_trans(idle->image, x, y, actor[i]->alpha, IF_NONE);
+        }
+    }
 }
 
 void handle_fade_effect()
@@ -602,14 +670,20 @@ void handle_fade_effect()
         alpha = max(0.0f, alpha - da);
 }
 
-void enable_linear_filtering()
+void set_linear_filtering(bool enabled)
 {
     animate_actors(); /* set up images */
 
     for(int i = 0; i < NUM_CONTROLS; i++) {
         const image_t* image = actor_image(actor[i]);
-        image_enable_linear_filtering((image_t*)image);
+
+        if(enabled)
+            image_enable_linear_filtering((image_t*)image);
+        else
+            image_disable_linear_filtering((image_t*)image);
     }
+
+    is_filtered = enabled;
 }
 
 /* handle a keyboard ALLEGRO_KEY_BACK event */
@@ -628,6 +702,93 @@ void a5_handle_back_event(const ALLEGRO_EVENT* event, void* data)
     (void)data;
 }
 
+/* is the given control idle, i.e., displaying its idle animation at its resting position? */
+bool is_idle(int control)
+{
+    switch(control) {
+        case DPAD:
+            return current_state.dpad == MOBILEGAMEPAD_DPAD_CENTER;
+
+        case DPAD_STICK:
+            return current_state.dpad == MOBILEGAMEPAD_DPAD_CENTER && is_stick_centered;
+
+        case ACTION_BUTTON:
+            return !(current_state.buttons & MOBILEGAMEPAD_BUTTON_ACTION);
+
+        default:
+            return false;
+    }
+}
+
+/* get the pre-rendered idle control, pre-rendering it if needed.
+   Returns NULL if it's not available; render the actor in that case */
+const idlecontrol_t* get_idle_control(int control)
+{
+    idlecontrol_t* idle = &idle_control[control];
+    const animation_t* anim = actor[control]->animation;
+    float scale = current_scale;
+
+    /* the actor must be displaying its idle animation (e.g., not a transition) */
+    if(anim == NULL || anim != sprite_get_animation(SPRITE_NAME[control], 0) || actor[control]->mirror != IF_NONE)
+        return NULL;
+
+    /* reuse the pre-rendered image */
+    if(idle->animation == anim && idle->scale == scale)
+        return idle->is_bakeable ? idle : NULL;
+
+    /* discard the previous image */
+    if(idle->image != NULL) {
+        image_destroy(idle->image);
+        idle->image = NULL;
+    }
+
+    idle->animation = anim;
+    idle->scale = scale;
+    idle->is_bakeable = false;
+
+    /* we can only pre-render static animations */
+    if(animation_frame_count(anim) != 1 || animation_has_keyframes(anim) || animation_is_transition(anim))
+        return NULL;
+
+    /* create the image */
+    const image_t* frame = actor_image(actor[control]);
+    int width = (int)ceilf(image_width(frame) * scale);
+    int height = (int)ceilf(image_height(frame) * scale);
+    if(width <= 0 || height <= 0 || NULL == (idle->image = image_create(width, height))) {
+        LOG("Can't pre-render control %d", control);
+        return NULL;
+    }
+
+    /* render the scaled frame */
+    image_t* prev_target = image_drawing_target();
+    const shader_t* prev_shader = shader_get_active();
+
+    image_set_drawing_target(idle->image);
+    shader_set_active(shader_get_default());
+    image_clear(color_rgba(0, 0, 0, 0));
+    image_draw_scaled(frame, 0, 0, v2d_new(scale, scale), IF_NONE);
+
+    image_set_drawing_target(prev_target);
+    shader_set_active(prev_shader);
+
+    /* done */
+    idle->hot_spot = v2d_multiply(actor[control]->hot_spot, scale);
+    idle->is_bakeable = true;
+    return idle;
+}
+
+/* destroy the pre-rendered idle controls */
+void discard_idle_controls()
+{
+    for(int i = 0; i < NUM_CONTROLS; i++) {
+        if(idle_control[i].image != NULL)
+            image_destroy(idle_control[i].image);
+
+        idle_control[i].image = NULL;
+        idle_control[i].animation = NULL;
+    }
+}
+
 /* compute the current offset of the dpad stick
    (relative to the center of the dpad) */
 v2d_t dpad_stick_offset(float scale)
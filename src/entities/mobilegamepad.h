@@ -72,6 +72,7 @@ void mobilegamepad_render();
 
 bool mobilegamepad_is_available();
 bool mobilegamepad_is_visible();
+bool mobilegamepad_is_fading();
 void mobilegamepad_get_state(mobilegamepad_state_t* state);
 
 int mobilegamepad_opacity();
@@ -40,6 +40,7 @@
 #include "../core/input.h"
 #include "../core/sprite.h"
 #include "../core/fadefx.h"
+#include "../core/benchmark.h"
 #include "../scenes/level.h"
 #include "../util/darray.h"
 #include "../util/numeric.h"
@@ -63,6 +64,7 @@ static const float PLAYER_UNDERWATER_TIME = 30.0f;    /* how long can the player
 static const float PLAYER_TURBOCHARGE_TIME = 20.0f;   /* turbocharge time, in seconds */
 static const float PLAYER_INVINCIBILITY_TIME = 20.0f; /* invincibility time, in seconds */
 static const float PLAYER_DEAD_RESTART_TIME = 2.5f;   /* time to restart the level when the player is killed */
+#define PHYSICS_BATCH_SIZE 16                         /* how many physics actors are stepped together */
 
 /* private data */
 static int collectibles = 0;                /* shared collectibles */
@@ -70,11 +72,15 @@ static int lives = PLAYER_INITIAL_LIVES;    /* shared lives */
 static int score = 0;                       /* shared score */
 
 /* misc */
+static void update_physics(player_t **players, int count, const obstaclemap_t* obstaclemap);
+static void update_status(player_t *player);
+static void update_effects(player_t *player);
 static void update_shield(player_t *player);
 static void update_animation(player_t *player);
 static void update_animation_speed(player_t *player);
 static void update_underwater_status(player_t* player);
-static void physics_adapter(player_t *player, const obstaclemap_t* obstaclemap);
+static void prepare_physics(player_t *player);
+static void apply_physics(player_t *player);
 static float smooth_angle(const physicsactor_t* pa, float current_angle);
 static bool require_angle_to_be_zero(physicsactorstate_t state, movmode_t movmode);
 static inline float delta_angle(float alpha, float beta);
@@ -204,171 +210,28 @@ player_t* player_destroy(player_t *player)
  */
 void player_update(player_t *player, const obstaclemap_t* obstaclemap)
 {
-    actor_t *act = player->actor;
-    physicsactor_t *pa = player->pa;
-    float padding = 16.0f, eps = 1e-5;
-    float dt = timer_get_delta();
-
-    /* if the player movement is enabled... */
-    if(!player->disable_movement) {
-
-        /* run physics simulation */
-        physics_adapter(player, obstaclemap);
-
-        /* read new position */
-        v2d_t position = player_position(player);
-
-        /* enter / leave water */
-        update_underwater_status(player);
-
-        /* underwater logic */
-        if(player_is_underwater(player)) {
-            /* disable turbo */
-            player_set_turbocharged(player, FALSE);
-
-            /* disable some shields */
-            if(player->shield_type == SH_FIRESHIELD || player->shield_type == SH_THUNDERSHIELD) {
-                if(!player_is_invincible(player))
-                    player_hit(player, 0.0f);
-                else
-                    player->shield_type = SH_NONE;
-            }
-
-            /* timer countdown */
-            if(player->shield_type != SH_WATERSHIELD && !player_is_winning(player) && (
-                player_is_forcibly_underwater(player) || /* forcibly underwater via scripting OR... */
-                is_head_underwater(player)               /* the head of the player is underwater */
-            ))
-                player->underwater_timer += dt;
-            else
-                player->underwater_timer = 0.0f;
-
-            /* drowning */
-            if(player_seconds_remaining_to_drown(player) <= 0.0f)
-                player_drown(player);
-        }
-
-        /* the player is blinking */
-        if(player->blinking) {
-            player->blink_timer += dt;
-
-            if(player->blink_timer >= player->blink_visibility_timer + 0.06f) {
-                player->blink_visibility_timer = player->blink_timer;
-                act->visible = !act->visible;
-            }
-
-            if(player->blink_timer >= PLAYER_MAX_BLINK)
-                player_set_blinking(player, FALSE);
-        }
-
-        /* invincibility stars */
-        if(player->invincible) {
-            /* update timer & finish */
-            player->invincibility_timer += dt;
-            if(player->invincibility_timer >= PLAYER_INVINCIBILITY_TIME)
-                player_set_invincible(player, FALSE);
-        }
-
-        /* turbo speed */
-        if(player->turbocharged) {
-            /* update timer & finish */
-            player->turbocharged_timer += dt;
-            if(player->turbocharged_timer >= PLAYER_TURBOCHARGE_TIME)
-                player_set_turbocharged(player, FALSE);
-        }
-
-        /* pitfalls */
-        if(position.y >= level_height_at(position.x)) {
-            if(!player_is_dying(player))
-                logfile_message("Player \"%s\" fell into a pit!", player_name(player));
-            player_kill(player);
-        }
-
-        /* winning pose */
-        if(level_has_been_cleared())
-            physicsactor_enable_winning_pose(pa);
-        else if(player_is_winning(player))
-            physicsactor_disable_winning_pose(pa); /* level_undo_clear() was called */
-
-        /* rolling misc */
-        if(!player_is_midair(player))
-            player->thrown_while_rolling = FALSE;
-        else if(player_ysp(player) < 0.0f && player_is_rolling(player))
-            player->thrown_while_rolling = TRUE;
-
-        /* misc */
-        player->on_movable_platform = FALSE;
-
-        /* the focused player can't get off the boundaries of the camera
-           (when boundaries are enabled) */
-        if(player_has_focus(player)) {
-            v2d_t cam_topleft = camera_clip(v2d_new(0, 0));
-            v2d_t cam_bottomright = camera_clip(level_size());
-
-            /* lock horizontally */
-            if(position.x > cam_bottomright.x - padding + eps) {
-                player_set_speed(player, player_speed(player) * 0.5f);
-                player_set_xpos(player, cam_bottomright.x - padding);
-                position = player_position(player); /* update position */
-            }
-            else if(position.x < cam_topleft.x + padding - eps) {
-                player_set_speed(player, player_speed(player) * 0.5f);
-                player_set_xpos(player, cam_topleft.x + padding);
-                position = player_position(player);
-            }
-
-            /* lock on top; won't prevent pits */
-            if(!player_is_dying(player)) {
-                if(position.y < cam_topleft.y + padding - eps) {
-                    player_set_ysp(player, player_ysp(player) * 0.5f);
-                    player_set_ypos(player, cam_topleft.y + padding);
-                    position = player_position(player);
-                }
-            }
-        }
-
-        /* am I hurt? Gotta have the focus */
-        if(player_is_getting_hit(player) || player_is_dying(player))
-            player_focus(player);
-
-    }
-#if 0
-    else {
-        /* if the player is frozen...? */
-    }
-#endif
-
-    /* can't leave the world */
-    v2d_t position = player_position(player);
-
-    if(position.x < padding - eps) {
-        player_set_speed(player, player_speed(player) * 0.5f);
-        player_set_xpos(player, padding);
-        position = player_position(player); /* update position */
-    }
-    else if(position.x > level_size().x - padding + eps) {
-        player_set_speed(player, player_speed(player) * 0.5f);
-        player_set_xpos(player, level_size().x - padding);
-        position = player_position(player);
-    }
+    player_update_team(&player, 1, obstaclemap);
+}
 
-    if(position.y < padding - eps) {
-        player_set_ysp(player, player_ysp(player) * 0.5f);
-        player_set_ypos(player, padding);
-        position = player_position(player);
-    }
 
-    /* invincibility stars */
-    if(player->invincible)
-        animate_invincibility_stars(player);
+/*
+ * player_update_team()
+ * Updates multiple players in phases: first the physics of all players,
+ * then their status, then their visual effects. This groups similar work
+ * and keeps the data of each phase hot in the cache
+ */
+void player_update_team(player_t **players, int count, const obstaclemap_t* obstaclemap)
+{
+    /* physics */
+    update_physics(players, count, obstaclemap);
 
-    /* shield */
-    if(player->shield_type != SH_NONE)
-        update_shield(player);
+    /* status: water, timers, boundaries... */
+    for(int i = 0; i < count; i++)
+        update_status(players[i]);
 
-    /* restart the level if dead */
-    if(player_is_dying(player))
-        run_dying_logic(player);
+    /* visual effects */
+    for(int i = 0; i < count; i++)
+        update_effects(players[i]);
 }
 
 
@@ -418,6 +281,10 @@ void player_render(player_t *player, v2d_t camera_position)
     /* hotspot "gambiarra" */
     hotspot_magic(player);
 
+    /* defer drawing, so that the sprite, the shield and the stars
+       are batched together if they share a texture */
+    image_hold_drawing(true);
+
     /* render the player */
     actor_render(act, camera_position);
 
@@ -431,6 +298,9 @@ void player_render(player_t *player, v2d_t camera_position)
             actor_render(player->star[i], camera_position);
     }
 
+    /* flush */
+    image_hold_drawing(false);
+
     /* restore hot spot */
     act->hot_spot = hot_spot;
 }
@@ -1700,6 +1570,211 @@ void player_set_score(int value)
 
 /* private functions */
 
+/* runs the physics simulation of the players */
+void update_physics(player_t **players, int count, const obstaclemap_t* obstaclemap)
+{
+    player_t* moving[PHYSICS_BATCH_SIZE];
+    physicsactor_t* batch[PHYSICS_BATCH_SIZE];
+
+    /* the physics actors of the players are stepped together - in parallel
+       if enabled - and their events are notified afterwards, in order */
+    for(int first = 0; first < count; first += PHYSICS_BATCH_SIZE) {
+        int last = min(count, first + PHYSICS_BATCH_SIZE);
+        int n = 0;
+
+        for(int i = first; i < last; i++) {
+            /* save the state of the previous frame for interpolated rendering */
+            actor_save_position(players[i]->actor);
+
+            /* if the player movement is enabled... */
+            if(!players[i]->disable_movement) {
+                prepare_physics(players[i]);
+                moving[n] = players[i];
+                batch[n++] = players[i]->pa;
+            }
+        }
+
+        /* physics update */
+        benchmark_begin(BENCHMARK_PHYSICS);
+        physicsactor_update_batch(batch, n, obstaclemap);
+        benchmark_end(BENCHMARK_PHYSICS);
+
+        for(int j = 0; j < n; j++)
+            apply_physics(moving[j]);
+    }
+}
+
+/* updates the status of the player after the physics simulation */
+void update_status(player_t *player)
+{
+    actor_t *act = player->actor;
+    physicsactor_t *pa = player->pa;
+    float padding = 16.0f, eps = 1e-5;
+    float dt = timer_get_delta();
+
+    /* if the player movement is enabled... */
+    if(!player->disable_movement) {
+
+        /* read new position */
+        v2d_t position = player_position(player);
+
+        /* enter / leave water */
+        update_underwater_status(player);
+
+        /* underwater logic */
+        if(player_is_underwater(player)) {
+            /* disable turbo */
+            player_set_turbocharged(player, FALSE);
+
+            /* disable some shields */
+            if(player->shield_type == SH_FIRESHIELD || player->shield_type == SH_THUNDERSHIELD) {
+                if(!player_is_invincible(player))
+                    player_hit(player, 0.0f);
+                else
+                    player->shield_type = SH_NONE;
+            }
+
+            /* timer countdown */
+            if(player->shield_type != SH_WATERSHIELD && !player_is_winning(player) && (
+                player_is_forcibly_underwater(player) || /* forcibly underwater via scripting OR... */
+                is_head_underwater(player)               /* the head of the player is underwater */
+            ))
+                player->underwater_timer += dt;
+            else
+                player->underwater_timer = 0.0f;
+
+            /* drowning */
+            if(player_seconds_remaining_to_drown(player) <= 0.0f)
+                player_drown(player);
+        }
+
+        /* the player is blinking */
+        if(player->blinking) {
+            player->blink_timer += dt;
+
+            if(player->blink_timer >= player->blink_visibility_timer + 0.06f) {
+                player->blink_visibility_timer = player->blink_timer;
+                act->visible = !act->visible;
+            }
+
+            if(player->blink_timer >= PLAYER_MAX_BLINK)
+                player_set_blinking(player, FALSE);
+        }
+
+        /* invincibility stars */
+        if(player->invincible) {
+            /* update timer & finish */
+            player->invincibility_timer += dt;
+            if(player->invincibility_timer >= PLAYER_INVINCIBILITY_TIME)
+                player_set_invincible(player, FALSE);
+        }
+
+        /* turbo speed */
+        if(player->turbocharged) {
+            /* update timer & finish */
+            player->turbocharged_timer += dt;
+            if(player->turbocharged_timer >= PLAYER_TURBOCHARGE_TIME)
+                player_set_turbocharged(player, FALSE);
+        }
+
+        /* pitfalls */
+        if(position.y >= level_height_at(position.x)) {
+            if(!player_is_dying(player))
+                logfile_message("Player \"%s\" fell into a pit!", player_name(player));
+            player_kill(player);
+        }
+
+        /* winning pose */
+        if(level_has_been_cleared())
+            physicsactor_enable_winning_pose(pa);
+        else if(player_is_winning(player))
+            physicsactor_disable_winning_pose(pa); /* level_undo_clear() was called */
+
+        /* rolling misc */
+        if(!player_is_midair(player))
+            player->thrown_while_rolling = FALSE;
+        else if(player_ysp(player) < 0.0f && player_is_rolling(player))
+            player->thrown_while_rolling = TRUE;
+
+        /* misc */
+        player->on_movable_platform = FALSE;
+
+        /* the focused player can't get off the boundaries of the camera
+           (when boundaries are enabled) */
+        if(player_has_focus(player)) {
+            v2d_t cam_topleft = camera_clip(v2d_new(0, 0));
+            v2d_t cam_bottomright = camera_clip(level_size());
+
+            /* lock horizontally */
+            if(position.x > cam_bottomright.x - padding + eps) {
+                player_set_speed(player, player_speed(player) * 0.5f);
+                player_set_xpos(player, cam_bottomright.x - padding);
+                position = player_position(player); /* update position */
+            }
+            else if(position.x < cam_topleft.x + padding - eps) {
+                player_set_speed(player, player_speed(player) * 0.5f);
+                player_set_xpos(player, cam_topleft.x + padding);
+                position = player_position(player);
+            }
+
+            /* lock on top; won't prevent pits */
+            if(!player_is_dying(player)) {
+                if(position.y < cam_topleft.y + padding - eps) {
+                    player_set_ysp(player, player_ysp(player) * 0.5f);
+                    player_set_ypos(player, cam_topleft.y + padding);
+                    position = player_position(player);
+                }
+            }
+        }
+
+        /* am I hurt? Gotta have the focus */
+        if(player_is_getting_hit(player) || player_is_dying(player))
+            player_focus(player);
+
+    }
+#if 0
+    else {
+        /* if the player is frozen...? */
+    }
+#endif
+
+    /* can't leave the world */
+    v2d_t position = player_position(player);
+
+    if(position.x < padding - eps) {
+        player_set_speed(player, player_speed(player) * 0.5f);
+        player_set_xpos(player, padding);
+        position = player_position(player); /* update position */
+    }
+    else if(position.x > level_size().x - padding + eps) {
+        player_set_speed(player, player_speed(player) * 0.5f);
+        player_set_xpos(player, level_size().x - padding);
+        position = player_position(player);
+    }
+
+    if(position.y < padding - eps) {
+        player_set_ysp(player, player_ysp(player) * 0.5f);
+        player_set_ypos(player, padding);
+        position = player_position(player);
+    }
+}
+
+/* updates the visual effects of the player */
+void update_effects(player_t *player)
+{
+    /* invincibility stars */
+    if(player->invincible)
+        animate_invincibility_stars(player);
+
+    /* shield */
+    if(player->shield_type != SH_NONE)
+        update_shield(player);
+
+    /* restart the level if dead */
+    if(player_is_dying(player))
+        run_dying_logic(player);
+}
+
 /* updates the current shield */
 void update_shield(player_t *player)
 {
@@ -1845,8 +1920,8 @@ void update_underwater_status(player_t* player)
     }
 }
 
-/* the interface between player_t and physicsactor_t */
-void physics_adapter(player_t *player, const obstaclemap_t* obstaclemap)
+/* the interface between player_t and physicsactor_t: prepares the physics actor to be updated */
+void prepare_physics(player_t *player)
 {
     physicsactor_t *pa = player->pa;
     actor_t *act = player->actor;
@@ -1861,9 +1936,13 @@ void physics_adapter(player_t *player, const obstaclemap_t* obstaclemap)
         physicsactor_set_layer(pa, OL_YELLOW);
     else
         physicsactor_set_layer(pa, OL_DEFAULT);
+}
 
-    /* physics update */
-    physicsactor_update(pa, obstaclemap);
+/* reads the state of the physics actor after it has been updated */
+void apply_physics(player_t *player)
+{
+    physicsactor_t *pa = player->pa;
+    actor_t *act = player->actor;
 
     /* update position */
     act->position = physicsactor_get_position(pa);
@@ -25,6 +25,7 @@
 #include "renderqueue.h"
 #include "player.h"
 #include "brick.h"
+#include "brickcache.h"
 #include "actor.h"
 #include "background.h"
 #include "waterfx.h"
@@ -34,10 +35,14 @@
 #include "../core/video.h"
 #include "../core/image.h"
 #include "../core/shader.h"
+#include "../core/profiler.h"
+#include "../core/gputimer.h"
+#include "../core/metrics.h"
 #include "../util/util.h"
 #include "../util/stringutil.h"
 #include "../scenes/level.h"
 #include "../scripting/scripting.h"
+#include "../scripting/util/classprofiler.h"
 
 
 
@@ -49,6 +54,7 @@ enum {
     TYPE_BRICK_MASK,
     TYPE_BRICK_DEBUG,
     TYPE_BRICK_PATH,
+    TYPE_BRICK_CHUNK,
 
     TYPE_SSOBJECT,
     TYPE_SSOBJECT_GIZMO,
@@ -67,6 +73,7 @@ typedef union renderable_t renderable_t;
 union renderable_t {
     player_t* player;
     brick_t* brick;
+    const brickchunk_t* chunk;
     item_t* item;
     object_t* object; /* legacy object */
     surgescript_object_t* ssobject;
@@ -102,6 +109,7 @@ struct renderqueue_entry_t {
         int ypos;
         texturehandle_t texture;
         bool is_translucent;
+        uint64_t sort_key; /* packs zindex, type and ypos */
     } cached;
 
 #if defined(__GNUC__)
@@ -110,6 +118,14 @@ struct renderqueue_entry_t {
 };
 #endif
 
+/* an item of the sorted render queue: a sort key and the index of an entry
+   of the buffer. Sorting moves the items, not the (much larger) entries */
+typedef struct renderqueue_item_t renderqueue_item_t;
+struct renderqueue_item_t {
+    uint64_t key;
+    int index;
+};
+
 /* vtables */
 static float zindex_player(renderable_t r);
 static float zindex_item(renderable_t r);
@@ -118,6 +134,7 @@ static float zindex_brick(renderable_t r);
 static float zindex_brick_mask(renderable_t r);
 static float zindex_brick_debug(renderable_t r);
 static float zindex_brick_path(renderable_t r);
+static float zindex_brick_chunk(renderable_t r);
 static float zindex_ssobject(renderable_t r);
 static float zindex_ssobject_gizmo(renderable_t r);
 static float zindex_ssobject_debug(renderable_t r);
@@ -132,6 +149,7 @@ static void render_brick(renderable_t r, v2d_t camera_position);
 static void render_brick_mask(renderable_t r, v2d_t camera_position);
 static void render_brick_debug(renderable_t r, v2d_t camera_position);
 static void render_brick_path(renderable_t r, v2d_t camera_position);
+static void render_brick_chunk(renderable_t r, v2d_t camera_position);
 static void render_ssobject(renderable_t r, v2d_t camera_position);
 static void render_ssobject_gizmo(renderable_t r, v2d_t camera_position);
 static void render_ssobject_debug(renderable_t r, v2d_t camera_position);
@@ -146,6 +164,7 @@ static int ypos_brick(renderable_t r);
 static int ypos_brick_mask(renderable_t r);
 static int ypos_brick_debug(renderable_t r);
 static int ypos_brick_path(renderable_t r);
+static int ypos_brick_chunk(renderable_t r);
 static int ypos_ssobject(renderable_t r);
 static int ypos_ssobject_gizmo(renderable_t r);
 static int ypos_ssobject_debug(renderable_t r);
@@ -160,6 +179,7 @@ static texturehandle_t texture_brick(renderable_t r);
 static texturehandle_t texture_brick_mask(renderable_t r);
 static texturehandle_t texture_brick_debug(renderable_t r);
 static texturehandle_t texture_brick_path(renderable_t r);
+static texturehandle_t texture_brick_chunk(renderable_t r);
 static texturehandle_t texture_ssobject(renderable_t r);
 static texturehandle_t texture_ssobject_gizmo(renderable_t r);
 static texturehandle_t texture_ssobject_debug(renderable_t r);
@@ -174,6 +194,7 @@ static const char* path_brick(renderable_t r, char* dest, size_t dest_size);
 static const char* path_brick_mask(renderable_t r, char* dest, size_t dest_size);
 static const char* path_brick_debug(renderable_t r, char* dest, size_t dest_size);
 static const char* path_brick_path(renderable_t r, char* dest, size_t dest_size);
+static const char* path_brick_chunk(renderable_t r, char* dest, size_t dest_size);
 static const char* path_ssobject(renderable_t r, char* dest, size_t dest_size);
 static const char* path_ssobject_gizmo(renderable_t r, char* dest, size_t dest_size);
 static const char* path_ssobject_debug(renderable_t r, char* dest, size_t dest_size);
@@ -188,6 +209,7 @@ static int type_brick(renderable_t r);
 static int type_brick_mask(renderable_t r);
 static int type_brick_debug(renderable_t r);
 static int type_brick_path(renderable_t r);
+static int type_brick_chunk(renderable_t r);
 static int type_ssobject(renderable_t r);
 static int type_ssobject_gizmo(renderable_t r);
 static int type_ssobject_debug(renderable_t r);
@@ -202,6 +224,7 @@ static bool is_translucent_brick(renderable_t r);
 static bool is_translucent_brick_mask(renderable_t r);
 static bool is_translucent_brick_debug(renderable_t r);
 static bool is_translucent_brick_path(renderable_t r);
+static bool is_translucent_brick_chunk(renderable_t r);
 static bool is_translucent_ssobject(renderable_t r);
 static bool is_translucent_ssobject_gizmo(renderable_t r);
 static bool is_translucent_ssobject_debug(renderable_t r);
@@ -209,6 +232,10 @@ static bool is_translucent_background(renderable_t r);
 static bool is_translucent_foreground(renderable_t r);
 static bool is_translucent_water(renderable_t r);
 
+static texturehandle_t texture_of_actor(const actor_t* act);
+static bool is_translucent_actor(const actor_t* act);
+static const char* path_of_actor(const actor_t* act, const char* fallback, char* dest, size_t dest_size);
+
 static const renderable_vtable_t VTABLE[] = {
     [TYPE_BRICK] = {
         .zindex = zindex_brick,
@@ -250,6 +277,16 @@ static const renderable_vtable_t VTABLE[] = {
         .is_translucent = is_translucent_brick_path
     },
 
+    [TYPE_BRICK_CHUNK] = {
+        .zindex = zindex_brick_chunk,
+        .render = render_brick_chunk,
+        .ypos = ypos_brick_chunk,
+        .texture = texture_brick_chunk,
+        .path = path_brick_chunk,
+        .type = type_brick_chunk,
+        .is_translucent = is_translucent_brick_chunk
+    },
+
     [TYPE_ITEM] = {
         .zindex = zindex_item,
         .render = render_item,
@@ -381,24 +418,44 @@ static bool want_report = false;
 #define ZINDEX_OFFSET(n)          (0.000001f * (float)(n)) /* ZINDEX_OFFSET(1) is the mininum zindex offset */
 #define ZINDEX_LARGE              99999.0f /* will be displayed in front of others */
 #define INITIAL_BUFFER_CAPACITY   256
+#define HIGH_WATER_DECAY          128 /* the high-water mark decays by 1/HIGH_WATER_DECAY per frame */
+#define SORTED_ENTRY(j)           (&buffer[sorted_buffer[j].index]) /* the j-th entry of the sorted queue */
 #define LOG(...)                  logfile_message("Render queue - " __VA_ARGS__)
 static const texturehandle_t NO_TEXTURE = ~0u;
-static int cmp_fun(const void* i, const void* j);
-static int cmp_zbuf_fun(const void* i, const void* j);
+static uint64_t make_sort_key(float zindex, int type, int ypos);
+static void compute_zbuf_keys();
+static void radix_sort(renderqueue_item_t* arr, int n);
+static int sort_buffer();
+static bool is_same_as_last_frame();
+static bool repair_last_order();
+static void remember_order(int* order);
 static inline float brick_zindex_offset(const brick_t *brick);
+static float zindex_offset(bricktype_t type, bricklayer_t layer, brickbehavior_t behavior);
 static void enqueue(const renderqueue_entry_t* entry);
+static void reserve(int capacity);
+static bool draws_primitives(int j);
+static void render_entry(int j, bool* holds_primitives);
 static const char* random_path(char prefix);
 
 /* internal data */
 static bool use_depth_buffer = false;
 static shader_t* internal_shader = NULL;
 static renderqueue_entry_t* buffer = NULL; /* storage */
-static int* sorted_indices = NULL; /* a permutation of 0, 1, ... n-1, where n = buffer_size */
-static renderqueue_entry_t** sorted_buffer = NULL; /* sorted indirection to buffer[] */
+static renderqueue_item_t* sorted_buffer = NULL; /* sorted indirection to buffer[] */
+static renderqueue_item_t* scratch_buffer = NULL; /* auxiliary storage for sorting */
 static int buffer_size = 0;
 static int buffer_capacity = 0;
+static int buffer_high_water = 0; /* decaying maximum of buffer_size over the last frames */
 static v2d_t camera;
 
+/* frame-to-frame coherence */
+enum { SORT_FULL, SORT_REPAIRED, SORT_REUSED };
+static renderqueue_entry_t* last_buffer = NULL; /* the buffer of the last rendered frame */
+static int* last_painter_order = NULL; /* indices of last_buffer[] sorted back-to-front */
+static int* last_render_order = NULL; /* indices of last_buffer[] in the order they were rendered */
+static int last_buffer_size = 0;
+static int sort_stats[3] = { 0, 0, 0 }; /* indexed by SORT_* */
+
 
 
 /*
@@ -453,6 +510,48 @@ https://liballeg.org/a5docs/trunk/graphics.html#deferred-drawing
 #define USE_DEFERRED_DRAWING 1
 
 
+
+/*
+
+OPTIMIZATION: FRAME-TO-FRAME COHERENCE
+--------------------------------------
+
+Most frames enqueue almost the same entries in the same order. We keep the
+buffer of the last rendered frame together with its sorted orders.
+
+If the sort keys, the textures and the translucency flags of all entries
+match the ones of the last frame, then both the sorted order and the batching
+decisions (group_index[] and z-orders) are reused as they are.
+
+Otherwise, we start from the sorted (back-to-front) order of the last frame
+and repair it with an insertion sort. Ties are broken by the index of the
+entries in buffer[], so the result is the same as the one produced by the
+stable radix sort. If the repair takes too many moves, we give up and sort
+from scratch.
+
+*/
+#define USE_COHERENT_SORTING 1
+#define MAX_REPAIR_MOVES(n)       ((n) + 64) /* insertion sort is no longer worth it */
+
+
+
+/*
+
+OPTIMIZATION: PRE-RESERVED CAPACITY
+-----------------------------------
+
+The buffers grow as needed when enqueueing, but growing them in the middle of
+a frame - say, during a burst of particles - is expensive: all of them are
+reallocated at once. We keep a high-water mark of the number of entries that
+decays slowly over the frames, and we reserve capacity for it with some slack
+when beginning a frame. The buffers shrink only when they're much larger than
+the high-water mark, e.g., after leaving a crowded level.
+
+*/
+#define RESERVE_SLACK(n)          ((n) / 2) /* extra capacity reserved beyond the high-water mark */
+#define SHRINK_FACTOR             4 /* shrink the buffers if they're this many times larger than needed */
+
+
 /* ----- public interface -----*/
 
 
@@ -476,10 +575,11 @@ void renderqueue_init(bool want_depth_buffer)
 
     /* allocate buffers */
     buffer_size = 0;
-    buffer_capacity = INITIAL_BUFFER_CAPACITY;
-    buffer = mallocx(buffer_capacity * sizeof(*buffer));
-    sorted_buffer = mallocx(buffer_capacity * sizeof(*sorted_buffer));
-    sorted_indices = mallocx(buffer_capacity * sizeof(*sorted_indices));
+    buffer_capacity = 0;
+    buffer_high_water = 0;
+    last_buffer_size = 0;
+    reserve(INITIAL_BUFFER_CAPACITY);
+    sort_stats[SORT_FULL] = sort_stats[SORT_REPAIRED] = sort_stats[SORT_REUSED] = 0;
 
     /* setup the internal shader of the renderqueue */
     if(use_depth_buffer) {
@@ -509,8 +609,18 @@ void renderqueue_release()
 
     video_use_default_shader();
 
-    free(sorted_indices);
-    sorted_indices = NULL;
+    free(last_render_order);
+    last_render_order = NULL;
+
+    free(last_painter_order);
+    last_painter_order = NULL;
+
+    free(last_buffer);
+    last_buffer = NULL;
+    last_buffer_size = 0;
+
+    free(scratch_buffer);
+    scratch_buffer = NULL;
 
     free(sorted_buffer);
     sorted_buffer = NULL;
@@ -520,9 +630,11 @@ void renderqueue_release()
 
     buffer_capacity = 0;
     buffer_size = 0;
+    buffer_high_water = 0;
 
     if(want_report) {
         want_report = false;
+        gputimer_enable(false);
         REPORT_CLEAR();
     }
 
@@ -538,8 +650,15 @@ void renderqueue_release()
  */
 void renderqueue_begin(v2d_t camera_position)
 {
+    int wanted_capacity = max(INITIAL_BUFFER_CAPACITY, buffer_high_water + RESERVE_SLACK(buffer_high_water));
+
     camera = camera_position;
     buffer_size = 0;
+
+    /* reserve capacity for the expected number of entries,
+       keeping the entries of the last frame */
+    if(buffer_capacity < wanted_capacity || buffer_capacity > SHRINK_FACTOR * wanted_capacity)
+        reserve(max(wanted_capacity, last_buffer_size));
 }
 
 /*
@@ -548,20 +667,33 @@ void renderqueue_begin(v2d_t camera_position)
  */
 void renderqueue_end()
 {
+    static const char* SORT_NAME[] = { "full", "repaired", "reused" };
     int batch_count = 0;
+    int sort_type;
+
+    /* update the high-water mark */
+    buffer_high_water = max(buffer_size, buffer_high_water - (buffer_high_water + HIGH_WATER_DECAY - 1) / HIGH_WATER_DECAY);
 
     /* skip if the buffer is empty */
-    if(buffer_size == 0)
+    metrics_count(METRIC_RENDER_ENTRIES, buffer_size);
+    if(buffer_size == 0) {
+        metrics_count(METRIC_RENDER_BATCHES, 0);
         return;
+    }
+
+    profiler_begin("renderqueue_end");
 
     /* quickly sort the buffer (stable sorting) */
-    merge_sort(sorted_buffer, buffer_size, sizeof(*sorted_buffer), cmp_fun);
+    sort_type = sort_buffer();
+    sort_stats[sort_type]++;
 
     /* start reporting */
     REPORT_BEGIN();
     REPORT("Batching stats");
     REPORT("--------------");
     REPORT("Depth test: % 3s", use_depth_buffer ? "yes" : "no");
+    REPORT("Sorting   : %s", SORT_NAME[sort_type]);
+    REPORT("Coherence : %d reused, %d repaired, %d full", sort_stats[SORT_REUSED], sort_stats[SORT_REPAIRED], sort_stats[SORT_FULL]);
 
     /* clear the screen */
     al_clear_to_color(al_map_rgb_f(0.0f, 0.0f, 0.0f));
@@ -591,17 +723,23 @@ void renderqueue_end()
         /* initialize the z-transform */
         al_identity_transform(&ztransform);
 
-        /* set the z-order of each entry */
-        for(int i = 0; i < buffer_size; i++)
-            sorted_buffer[i]->zorder = i;
+        /* the z-orders and the batching order are reused if nothing has changed */
+        if(sort_type != SORT_REUSED) {
 
-        /* sort by source image for batching
-           no need of stable sorting here */
-        qsort(sorted_buffer, buffer_size, sizeof(*sorted_buffer), cmp_zbuf_fun);
+            /* set the z-order of each entry */
+            for(int i = 0; i < buffer_size; i++)
+                SORTED_ENTRY(i)->zorder = i;
+
+            /* sort by source image for batching. Ties are
+               broken by the z-order, as radix sort is stable */
+            compute_zbuf_keys();
+            radix_sort(sorted_buffer, buffer_size);
+
+        }
 
         /* after sorting, partition the buffer into opaque and translucent objects */
         for(int i = buffer_size - 1; i >= 0; i--) {
-            if(sorted_buffer[i]->cached.is_translucent)
+            if(SORTED_ENTRY(i)->cached.is_translucent)
                 translucent_start = i;
             else
                 break;
@@ -609,27 +747,32 @@ void renderqueue_end()
 
     }
 
-    /* fill the group_index[] array */
-    sorted_buffer[buffer_size - 1]->group_index = 1;
-    for(int i = buffer_size - 2; i >= 0; i--) {
-
-        /* same texture? */
-        if(
-            sorted_buffer[i]->cached.texture != NO_TEXTURE && /* won't group if NO_TEXTURE */
-            sorted_buffer[i]->cached.texture == sorted_buffer[i+1]->cached.texture
-        )
-            sorted_buffer[i]->group_index = 1 + sorted_buffer[i+1]->group_index;
-        else
-            sorted_buffer[i]->group_index = 1;
+    /* fill the group_index[] array, unless it's reused from the last frame */
+    if(sort_type != SORT_REUSED) {
+        SORTED_ENTRY(buffer_size - 1)->group_index = 1;
+        for(int i = buffer_size - 2; i >= 0; i--) {
+
+            /* same texture? */
+            if(
+                SORTED_ENTRY(i)->cached.texture != NO_TEXTURE && /* won't group if NO_TEXTURE */
+                SORTED_ENTRY(i)->cached.texture == SORTED_ENTRY(i+1)->cached.texture
+            )
+                SORTED_ENTRY(i)->group_index = 1 + SORTED_ENTRY(i+1)->group_index;
+            else
+                SORTED_ENTRY(i)->group_index = 1;
 
+        }
     }
 
     /* render the entries */
-    bool held = false;
+    bool held = false, holds_primitives = false;
+    int overdraw_count = 0, opaque_count = 0;
+    int backmost_zorder = buffer_size; /* the z-order of the backmost opaque entry rendered so far */
+    gputimer_begin("renderqueue");
     for(int j = 0; j < buffer_size; j++) {
 
-        int curr = sorted_buffer[j]->group_index;
-        int prev = sorted_buffer[(j + (buffer_size - 1)) % buffer_size]->group_index;
+        int curr = SORTED_ENTRY(j)->group_index;
+        int prev = SORTED_ENTRY((j + (buffer_size - 1)) % buffer_size)->group_index;
 
         /* enable deferred drawing */
         if(curr > prev) {
@@ -642,8 +785,8 @@ void renderqueue_end()
             ++batch_count;
             if(want_report) {
                 char c = (curr == prev) ? '+' : ' '; /* curr == prev only if group_index == 1 */
-                sorted_buffer[j]->vtable->path(sorted_buffer[j]->renderable, entry_path, sizeof(entry_path));
-                REPORT("Batch size:%c%3d %s", c, sorted_buffer[j]->group_index, entry_path);
+                SORTED_ENTRY(j)->vtable->path(SORTED_ENTRY(j)->renderable, entry_path, sizeof(entry_path));
+                REPORT("Batch size:%c%3d %s", c, SORTED_ENTRY(j)->group_index, entry_path);
             }
         }
 
@@ -655,8 +798,22 @@ void renderqueue_end()
             if(j == translucent_start)
                 al_set_render_state(ALLEGRO_WRITE_MASK, ALLEGRO_MASK_RGBA);
 
+            /* estimate overdraw: an opaque entry rendered after an opaque
+               entry behind it may paint over its pixels, as the depth test
+               can't reject them. Translucent entries always paint over */
+            if(want_report) {
+                int zorder = SORTED_ENTRY(j)->zorder;
+                if(j < translucent_start) {
+                    overdraw_count += (zorder > backmost_zorder);
+                    backmost_zorder = min(backmost_zorder, zorder);
+                    opaque_count++;
+                }
+                else
+                    overdraw_count++;
+            }
+
             /* set z to a value in [0,1] according to the z-order of the entry */
-            float z = 1.0f - (float)sorted_buffer[j]->zorder / (float)(buffer_size - 1);
+            float z = 1.0f - (float)SORTED_ENTRY(j)->zorder / (float)(buffer_size - 1);
 
             /* map z from [0,1] to [-1,1], the range of the default
                orthographic projection set by Allegro */
@@ -668,18 +825,22 @@ void renderqueue_end()
         }
 
         /* render the j-th entry */
-        sorted_buffer[j]->vtable->render(sorted_buffer[j]->renderable, camera);
+        render_entry(j, &holds_primitives);
 
         /* disable deferred drawing */
-        if(held && sorted_buffer[j]->group_index == 1) {
+        if(held && SORTED_ENTRY(j)->group_index == 1) {
             image_hold_drawing(false);
             held = false;
         }
 
     }
+    gputimer_end();
 
     if(use_depth_buffer) {
 
+        /* report the estimated overdraw */
+        REPORT("Overdraw  : %3d of %3d (%d opaque)", overdraw_count, buffer_size, opaque_count);
+
         /* reset the z-transform */
         al_identity_transform(&ztransform);
         al_use_transform(&ztransform);
@@ -692,13 +853,16 @@ void renderqueue_end()
 #else
 
     /* render the entries without deferred drawing */
+    bool holds_primitives = false;
+    gputimer_begin("renderqueue");
     for(int j = 0; j < buffer_size; j++) {
-        sorted_buffer[j]->vtable->render(sorted_buffer[j]->renderable, camera);
+        render_entry(j, &holds_primitives);
         ++batch_count; /* will be equal to buffer_size */
     }
+    gputimer_end();
 
     REPORT("No batching!");
-    (void)cmp_zbuf_fun;
+    (void)compute_zbuf_keys;
 
 #endif
 
@@ -706,14 +870,30 @@ void renderqueue_end()
     float savings = 1.0f - (float)batch_count / (float)buffer_size;
     REPORT("Total     :=%3d", buffer_size);
     REPORT("Batches   : %3d %.2f", batch_count, 100.0f * savings);
+    if(gputimer_is_enabled()) {
+        /* measured a few frames ago */
+        for(int i = 0; i < gputimer_zone_count(); i++)
+            REPORT("GPU time  : %6.3f ms %s", gputimer_zone_time(i), gputimer_zone_name(i));
+    }
+    else
+        REPORT("GPU time  : unavailable");
     REPORT_END();
+    metrics_count(METRIC_RENDER_BATCHES, batch_count);
 
     /* go back to the default shader */
     if(internal_shader != NULL)
         shader_set_active(shader_get_default());
 
+    /* remember this frame */
+    remember_order(last_render_order);
+    renderqueue_entry_t* tmp = last_buffer;
+    last_buffer = buffer;
+    last_buffer_size = buffer_size;
+    buffer = tmp;
+
     /* clean up */
     buffer_size = 0;
+    profiler_end();
 }
 
 
@@ -813,6 +993,21 @@ void renderqueue_enqueue_brick_path(brick_t *brick)
     enqueue(&entry);
 }
 
+/*
+ * renderqueue_enqueue_brick_chunk()
+ * Enqueues a chunk of baked bricks
+ */
+void renderqueue_enqueue_brick_chunk(const brickchunk_t* chunk)
+{
+    renderqueue_entry_t entry = {
+        .renderable.chunk = chunk,
+        .vtable = &VTABLE[TYPE_BRICK_CHUNK]
+    };
+
+    /* enqueue */
+    enqueue(&entry);
+}
+
 
 
 /*
@@ -873,15 +1068,8 @@ void renderqueue_enqueue_ssobject(surgescript_object_t* object)
         return;
 
     /* don't enqueue invisible renderables */
-    if(surgescript_object_has_function(object, "get_visible")) {
-        surgescript_var_t* ret = surgescript_var_create();
-        surgescript_object_call_function(object, "get_visible", NULL, 0, ret);
-        bool is_visible = surgescript_var_get_bool(ret);
-        surgescript_var_destroy(ret);
-
-        if(!is_visible)
-            return;
-    }
+    if(!scripting_util_object_is_visible(object))
+        return;
 
 #if 0
     /* clip out the renderables */
@@ -1008,6 +1196,9 @@ bool renderqueue_toggle_stats_report()
     want_report = !want_report;
     LOG("Stats report is %s", want_report ? "enabled" : "disabled");
 
+    /* measure GPU time while reporting */
+    gputimer_enable(want_report);
+
     /* clear messages */
     if(!want_report)
         REPORT_CLEAR();
@@ -1023,23 +1214,14 @@ bool renderqueue_toggle_stats_report()
 /* enqueues an entry */
 void enqueue(const renderqueue_entry_t* entry)
 {
-    /* grow the buffer if necessary */
-    if(buffer_size == buffer_capacity) {
-        buffer_capacity *= 2;
-        buffer = reallocx(buffer, buffer_capacity * sizeof(*buffer));
-        sorted_buffer = reallocx(sorted_buffer, buffer_capacity * sizeof(*sorted_buffer));
-        sorted_indices = reallocx(sorted_indices, buffer_capacity * sizeof(*sorted_indices));
-
-        /* sorted_buffer[] is invalidated because we have realloc'd buffer[] */
-        for(int i = 0; i < buffer_size; i++)
-            sorted_buffer[i] = &buffer[sorted_indices[i]];
-    }
+    /* grow the buffer if necessary (this should be rare; see renderqueue_begin) */
+    if(buffer_size == buffer_capacity)
+        reserve(2 * buffer_capacity);
 
     /* add the entry to the buffer */
     renderqueue_entry_t* e = &buffer[buffer_size];
     memcpy(e, entry, sizeof(*entry));
-    sorted_buffer[buffer_size] = e;
-    sorted_indices[buffer_size] = buffer_size;
+    sorted_buffer[buffer_size].index = buffer_size;
     buffer_size++;
 
     /* cache the values of the new entry for purposes of comparison to other entries */
@@ -1048,91 +1230,323 @@ void enqueue(const renderqueue_entry_t* entry)
     e->cached.ypos = e->vtable->ypos(e->renderable);
     e->cached.texture = e->vtable->texture(e->renderable);
     e->cached.is_translucent = e->vtable->is_translucent(e->renderable);
+    e->cached.sort_key = make_sort_key(e->cached.zindex, e->cached.type, e->cached.ypos);
+    sorted_buffer[buffer_size - 1].key = e->cached.sort_key;
+}
+
+/* resizes all buffers to the given capacity, which must not be smaller
+   than the number of entries of the current and of the last frame */
+void reserve(int capacity)
+{
+    assertx(capacity >= buffer_size && capacity >= last_buffer_size);
+
+    buffer_capacity = capacity;
+    buffer = reallocx(buffer, buffer_capacity * sizeof(*buffer));
+    sorted_buffer = reallocx(sorted_buffer, buffer_capacity * sizeof(*sorted_buffer));
+    scratch_buffer = reallocx(scratch_buffer, buffer_capacity * sizeof(*scratch_buffer));
+    last_buffer = reallocx(last_buffer, buffer_capacity * sizeof(*last_buffer));
+    last_painter_order = reallocx(last_painter_order, buffer_capacity * sizeof(*last_painter_order));
+    last_render_order = reallocx(last_render_order, buffer_capacity * sizeof(*last_render_order));
 }
 
-/* compares two entries of the render queue */
-int cmp_fun(const void* i, const void* j)
+/* does the j-th entry of the sorted queue draw only lines, rectangles and ellipses? */
+bool draws_primitives(int j)
 {
-    const renderqueue_entry_t* a = *((const renderqueue_entry_t**)i);
-    const renderqueue_entry_t* b = *((const renderqueue_entry_t**)j);
-
-    /* zindex check */
-    float za = a->cached.zindex;
-    float zb = b->cached.zindex;
-
-    /* approximately same z-index? */
-    if(fabs(za - zb) * 10.0f < ZINDEX_OFFSET(1)) {
-        /* sort by type */
-        int ta = a->cached.type;
-        int tb = b->cached.type;
-
-        if(ta == tb) {
-            /* sort by ypos */
-            return a->cached.ypos - b->cached.ypos;
+    const renderable_vtable_t* vtable = SORTED_ENTRY(j)->vtable;
+    return vtable == &VTABLE[TYPE_SSOBJECT_GIZMO] || vtable == &VTABLE[TYPE_BRICK_PATH];
+}
+
+/* renders the j-th entry of the sorted queue. The primitives of consecutive
+   gizmos are accumulated and drawn in bulk (see image_hold_primitives()) */
+void render_entry(int j, bool* holds_primitives)
+{
+    if(!*holds_primitives && draws_primitives(j)) {
+        image_hold_primitives(true);
+        *holds_primitives = true;
+    }
+
+    SORTED_ENTRY(j)->vtable->render(SORTED_ENTRY(j)->renderable, camera);
+
+    if(*holds_primitives && (j + 1 == buffer_size || !draws_primitives(j + 1))) {
+        image_hold_primitives(false);
+        *holds_primitives = false;
+    }
+}
+
+/*
+
+SORT KEYS
+---------
+
+Entries are sorted with a stable LSD radix sort on 64-bit keys. The key that
+determines the rendering order (back-to-front) is computed when enqueueing:
+
+    bits 63..32: zindex, mapped to an unsigned integer that preserves order
+    bits 31..28: rank of the type of the entry (players come last)
+    bits 27..0 : ypos, biased and clipped
+
+The rank of a type matches the order in which the level enqueues its
+renderables. Entries of different types that share the same zindex are kept
+in the order in which they were enqueued; only entries of the same type are
+sorted by ypos.
+
+When using the depth buffer, we sort again for batching. Opaque entries are
+sorted by texture and then front-to-back; translucent entries come last and
+are sorted back-to-front and then by texture. See compute_zbuf_keys().
+
+*/
+#define SORTKEY_TYPE_BITS         4
+#define SORTKEY_YPOS_BITS         28
+#define SORTKEY_YPOS_BIAS         (1 << (SORTKEY_YPOS_BITS - 1))
+#define RADIX_BITS                8
+#define RADIX_BUCKETS             (1 << RADIX_BITS)
+#define RADIX_PASSES              (64 / RADIX_BITS)
+
+/* the rank of each type of renderable */
+static const uint8_t TYPE_RANK[] = {
+    [TYPE_BACKGROUND] = 0,
+    [TYPE_BRICK] = 1,
+    [TYPE_BRICK_DEBUG] = 2,
+    [TYPE_BRICK_PATH] = 3,
+    [TYPE_BRICK_CHUNK] = 1, /* chunks are rendered as bricks */
+    [TYPE_BRICK_MASK] = 4,
+    [TYPE_SSOBJECT] = 5,
+    [TYPE_SSOBJECT_GIZMO] = 6,
+    [TYPE_SSOBJECT_DEBUG] = 7,
+    [TYPE_WATER] = 8,
+    [TYPE_FOREGROUND] = 9,
+    [TYPE_ITEM] = 10,
+    [TYPE_OBJECT] = 11,
+    [TYPE_PLAYER] = 15 /* render the players in front of the other entries if all else is equal */
+};
+
+/* computes the sort key of an entry of the render queue */
+uint64_t make_sort_key(float zindex, int type, int ypos)
+{
+    union { float f; uint32_t u; } z;
+    uint32_t rank, y;
+
+    /* map the zindex to an unsigned integer, so that the order is preserved */
+    z.f = zindex + 0.0f; /* -0.0f becomes +0.0f */
+    z.u ^= (z.u & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u;
+
+    /* type rank */
+    rank = TYPE_RANK[type] & ((1u << SORTKEY_TYPE_BITS) - 1);
+
+    /* ypos */
+    y = (uint32_t)clip(ypos, -SORTKEY_YPOS_BIAS, SORTKEY_YPOS_BIAS - 1) + SORTKEY_YPOS_BIAS;
+
+    /* pack the key */
+    return ((uint64_t)z.u << 32) | ((uint64_t)rank << SORTKEY_YPOS_BITS) | (uint64_t)y;
+}
+
+/* compute the sort keys used for batching with the depth buffer; the
+   buffer must be sorted back-to-front and the z-orders must be set */
+void compute_zbuf_keys()
+{
+    const uint32_t max_rank = 0x7FFFFFFFu;
+    uint32_t zrank = 0; /* dense rank of the zindex */
+
+    for(int i = 0; i < buffer_size; i++) {
+        const renderqueue_entry_t* e = SORTED_ENTRY(i);
+
+        if(i > 0 && e->cached.zindex != SORTED_ENTRY(i-1)->cached.zindex)
+            zrank++;
+
+        if(!e->cached.is_translucent) {
+            /* opaque entries: sort by texture, for optimal batching. If
+               the entries share the same texture, sort front-to-back by
+               z-order, so that early depth testing can discard pixels even
+               among entries with the same zindex. The z-order is unique
+               and the depth test keeps the result correct */
+            sorted_buffer[i].key = ((uint64_t)e->cached.texture << 31) | (uint64_t)(max_rank - (uint32_t)e->zorder);
         }
         else {
-            /* render the players in front of the other entries if all else is equal */
-            return (ta == TYPE_PLAYER) - (tb == TYPE_PLAYER);
+            /* translucent entries: put them last and sort back-to-front.
+               We'll render them separately. Sort by texture if the
+               z-index is the same */
+            sorted_buffer[i].key = (UINT64_C(1) << 63) | ((uint64_t)zrank << 32) | (uint64_t)e->cached.texture;
+        }
+    }
+}
+
+/* stable LSD radix sort of the items of the render queue by their keys */
+void radix_sort(renderqueue_item_t* arr, int n)
+{
+    static int count[RADIX_PASSES][RADIX_BUCKETS];
+    renderqueue_item_t* src = arr;
+    renderqueue_item_t* dst = scratch_buffer;
+
+    if(n <= 1)
+        return;
+
+    /* compute the histograms of all passes at once */
+    memset(count, 0, sizeof(count));
+    for(int i = 0; i < n; i++) {
+        uint64_t key = arr[i].key;
+        for(int p = 0; p < RADIX_PASSES; p++)
+            count[p][(key >> (p * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+
+    /* sort digit by digit */
+    for(int p = 0; p < RADIX_PASSES; p++) {
+        int shift = p * RADIX_BITS;
+        int offset = 0;
+
+        /* skip the pass if all keys share the same digit */
+        uint64_t first = src[0].key;
+        if(count[p][(first >> shift) & (RADIX_BUCKETS - 1)] == n)
+            continue;
+
+        /* prefix sums */
+        for(int d = 0; d < RADIX_BUCKETS; d++) {
+            int c = count[p][d];
+            count[p][d] = offset;
+            offset += c;
         }
+
+        /* scatter */
+        for(int i = 0; i < n; i++) {
+            uint64_t key = src[i].key;
+            dst[count[p][(key >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+        }
+
+        /* swap */
+        renderqueue_item_t* tmp = src;
+        src = dst;
+        dst = tmp;
     }
 
-    /* sort back-to-front */
-    return (za > zb) - (za < zb);
+    /* the output must be stored in arr[] */
+    if(src != arr)
+        memcpy(arr, src, n * sizeof(*arr));
 }
 
-/* sort the render queue while taking the depth buffer into consideration */
-int cmp_zbuf_fun(const void* i, const void* j)
+/* sorts the buffer back-to-front, taking advantage of the last frame if possible */
+int sort_buffer()
 {
-    const renderqueue_entry_t* a = *((const renderqueue_entry_t**)i);
-    const renderqueue_entry_t* b = *((const renderqueue_entry_t**)j);
-
-    /* put opaque objects first */
-    int la = (int)a->cached.is_translucent;
-    int lb = (int)b->cached.is_translucent;
-    if(la != lb)
-        return la - lb;
-
-    /* read z-index */
-    float za = a->cached.zindex;
-    float zb = b->cached.zindex;
-    int dz = (za > zb) - (za < zb);
-
-    /* sort by texture, for optimal batching */
-    if(!la || dz == 0) {
-        texturehandle_t ta = a->cached.texture;
-        texturehandle_t tb = b->cached.texture;
-        if(ta != tb)
-            return (ta > tb) - (ta < tb); /* compare unsigned integers */
+#if USE_COHERENT_SORTING
+    /* nothing has changed: reuse the sorted order and the batching */
+    if(is_same_as_last_frame()) {
+        for(int i = 0; i < buffer_size; i++) {
+            buffer[i].zorder = last_buffer[i].zorder;
+            buffer[i].group_index = last_buffer[i].group_index;
+        }
+
+        for(int j = 0; j < buffer_size; j++)
+            sorted_buffer[j].index = last_render_order[j];
+
+        return SORT_REUSED;
     }
 
-    /* if the entries share the same texture, sort
-       front-to-back, so that the depth testing can
-       discard pixels.
+    /* only a few entries have changed: repair the last order */
+    if(repair_last_order()) {
+        remember_order(last_painter_order);
+        return SORT_REPAIRED;
+    }
 
-       if both entries are translucent, then sort
-       back-to-front. We'll render them separately. */
+    /* undo the failed repair */
+    for(int i = 0; i < buffer_size; i++)
+        sorted_buffer[i] = (renderqueue_item_t){ .key = buffer[i].cached.sort_key, .index = i };
+#endif
 
-    if(dz == 0)
-        return a->zorder - b->zorder; /* keep relative z-order */
-    else if(!la)
-        return -dz; /* front-to-back */
-    else
-        return dz; /* back-to-front */
+    /* sort from scratch */
+    radix_sort(sorted_buffer, buffer_size);
+    remember_order(last_painter_order);
+    return SORT_FULL;
+}
+
+/* checks if the sort keys and the batching data of all entries match the last frame */
+bool is_same_as_last_frame()
+{
+    if(buffer_size != last_buffer_size)
+        return false;
+
+    for(int i = 0; i < buffer_size; i++) {
+        const renderqueue_entry_t* e = &buffer[i];
+        const renderqueue_entry_t* f = &last_buffer[i];
+
+        if(
+            e->cached.sort_key != f->cached.sort_key ||
+            e->cached.texture != f->cached.texture ||
+            e->cached.is_translucent != f->cached.is_translucent
+        )
+            return false;
+    }
+
+    return true;
+}
+
+/* repairs the back-to-front order of the last frame with an insertion sort.
+   Returns false if the repair takes too many moves */
+bool repair_last_order()
+{
+    int max_moves = MAX_REPAIR_MOVES(buffer_size);
+    int moves = 0, k = 0;
+
+    /* there's nothing to repair */
+    if(last_buffer_size == 0)
+        return false;
+
+    /* start from the last order. Entries that didn't exist
+       in the last frame are placed at the end */
+    for(int j = 0; j < last_buffer_size; j++) {
+        int index = last_painter_order[j];
+        if(index < buffer_size)
+            sorted_buffer[k++] = (renderqueue_item_t){ .key = buffer[index].cached.sort_key, .index = index };
+    }
+    for(int i = last_buffer_size; i < buffer_size; i++)
+        sorted_buffer[k++] = (renderqueue_item_t){ .key = buffer[i].cached.sort_key, .index = i };
+
+    /* insertion sort. The index in buffer[] breaks ties,
+       so that we keep the enqueueing order (stable sorting) */
+    for(int j = 1; j < buffer_size; j++) {
+        renderqueue_item_t e = sorted_buffer[j];
+        int i = j - 1;
+
+        while(i >= 0 && (
+            sorted_buffer[i].key > e.key ||
+            (sorted_buffer[i].key == e.key && sorted_buffer[i].index > e.index)
+        )) {
+            sorted_buffer[i+1] = sorted_buffer[i];
+            i--;
+
+            if(++moves > max_moves)
+                return false;
+        }
+
+        sorted_buffer[i+1] = e;
+    }
+
+    return true;
+}
+
+/* stores the current order of sorted_buffer[] as indices of buffer[] */
+void remember_order(int* order)
+{
+    for(int j = 0; j < buffer_size; j++)
+        order[j] = sorted_buffer[j].index;
 }
 
 /* compute a tiny zindex offset for a brick depending on its type, layer and behavior */
 float brick_zindex_offset(const brick_t *brick)
+{
+    return zindex_offset(brick_type(brick), brick_layer(brick), brick_behavior(brick));
+}
+
+/* the zindex offset of a brick given its type, layer and behavior */
+float zindex_offset(bricktype_t type, bricklayer_t layer, brickbehavior_t behavior)
 {
     float s = 0.0f;
 
     /* a hackish solution... */
-    switch(brick_type(brick)) {
+    switch(type) {
         case BRK_PASSABLE:  s -= ZINDEX_OFFSET(20); break;
         case BRK_CLOUD:     s -= ZINDEX_OFFSET(10); break;
         case BRK_SOLID:     break;
     }
 
-    switch(brick_layer(brick)) {
+    switch(layer) {
         case BRL_YELLOW:    s -= ZINDEX_OFFSET(50); break;
         case BRL_GREEN:     s += ZINDEX_OFFSET(50); break; /* |layer offset| > max |type offset| */
         case BRL_DEFAULT:   break;
@@ -1140,7 +1554,7 @@ float brick_zindex_offset(const brick_t *brick)
 
     /* static bricks should appear behind moving bricks
        if they share the same zindex, type and layer */
-    if(brick_behavior(brick) == BRB_DEFAULT)
+    if(behavior == BRB_DEFAULT)
         s -= ZINDEX_OFFSET(1);
     
     /* done */
@@ -1183,6 +1597,7 @@ int type_brick(renderable_t r) { return TYPE_BRICK; }
 int type_brick_mask(renderable_t r) { return TYPE_BRICK_MASK; }
 int type_brick_debug(renderable_t r) { return TYPE_BRICK_DEBUG; }
 int type_brick_path(renderable_t r) { return TYPE_BRICK_PATH; }
+int type_brick_chunk(renderable_t r) { return TYPE_BRICK_CHUNK; }
 int type_ssobject(renderable_t r) { return TYPE_SSOBJECT; }
 int type_ssobject_debug(renderable_t r) { return TYPE_SSOBJECT_DEBUG; }
 int type_ssobject_gizmo(renderable_t r) { return TYPE_SSOBJECT_GIZMO; }
@@ -1197,6 +1612,7 @@ float zindex_brick(renderable_t r) { return brick_zindex(r.brick) + brick_zindex
 float zindex_brick_mask(renderable_t r) { return ZINDEX_LARGE + brick_zindex_offset(r.brick); }
 float zindex_brick_debug(renderable_t r) { return zindex_brick(r); }
 float zindex_brick_path(renderable_t r) { return zindex_brick_mask(r) + 1.0f; }
+float zindex_brick_chunk(renderable_t r) { return brickchunk_zindex(r.chunk) + zindex_offset(brickchunk_type(r.chunk), brickchunk_layer(r.chunk), BRB_DEFAULT); }
 float zindex_ssobject(renderable_t r) { return scripting_util_object_zindex(r.ssobject); }
 float zindex_ssobject_debug(renderable_t r) { return zindex_ssobject(r); } /* TODO: check children */
 float zindex_ssobject_gizmo(renderable_t r) { return ZINDEX_LARGE + zindex_ssobject(r); }
@@ -1211,6 +1627,7 @@ int ypos_brick(renderable_t r) { return brick_position(r.brick).y; }
 int ypos_brick_mask(renderable_t r) { return ypos_brick(r); }
 int ypos_brick_debug(renderable_t r) { return ypos_brick(r); }
 int ypos_brick_path(renderable_t r) { return ypos_brick(r); }
+int ypos_brick_chunk(renderable_t r) { return brickchunk_position(r.chunk).y; }
 int ypos_ssobject(renderable_t r) { return 0; } /* TODO (not needed?) */
 int ypos_ssobject_debug(renderable_t r) { return ypos_ssobject(r); }
 int ypos_ssobject_gizmo(renderable_t r) { return ypos_ssobject(r); }
@@ -1219,12 +1636,13 @@ int ypos_foreground(renderable_t r) { return 0; } /* preserve relative indexes *
 int ypos_water(renderable_t r) { return 0; } /* not needed */
 
 bool is_translucent_player(renderable_t r) { return true; /* invincibility stars, shields, maybe even the sprite itself... */ }
-bool is_translucent_item(renderable_t r) { return false; }
-bool is_translucent_object(renderable_t r) { return false; }
+bool is_translucent_item(renderable_t r) { return is_translucent_actor(r.item->actor); }
+bool is_translucent_object(renderable_t r) { return is_translucent_actor(r.object->actor); }
 bool is_translucent_brick(renderable_t r) { return false; }
 bool is_translucent_brick_mask(renderable_t r) { return false; }
 bool is_translucent_brick_debug(renderable_t r) { return false; }
 bool is_translucent_brick_path(renderable_t r) { return false; }
+bool is_translucent_brick_chunk(renderable_t r) { return false; }
 bool is_translucent_background(renderable_t r) { return false; }
 bool is_translucent_foreground(renderable_t r) { return false; }
 
@@ -1233,41 +1651,25 @@ bool is_translucent_ssobject_gizmo(renderable_t r) { return false; }
 bool is_translucent_ssobject_debug(renderable_t r) { return false; /*is_translucent_ssobject(r);*/ /* no state changes within SurgeScript */ }
 bool is_translucent_ssobject(renderable_t r)
 {
-    if(surgescript_object_has_function(r.ssobject, "get___isTranslucent")) {
-        surgescript_var_t* ret = surgescript_var_create();
-
-        surgescript_object_call_function(r.ssobject, "get___isTranslucent", NULL, 0, ret);
-        bool is_translucent = surgescript_var_get_bool(ret);
-
-        surgescript_var_destroy(ret);
-        return is_translucent;
-    }
-
-    return false;
+    return scripting_util_object_is_translucent(r.ssobject);
 }
 
 const char* path_player(renderable_t r, char* dest, size_t dest_size) { return str_cpy(dest, image_filepath(actor_image(r.player->actor)), dest_size); }
-const char* path_item(renderable_t r, char* dest, size_t dest_size) { return str_cpy(dest, "<legacy-item>", dest_size); }
-const char* path_object(renderable_t r, char* dest, size_t dest_size) { return str_cpy(dest, "<legacy-object>", dest_size); }
+const char* path_item(renderable_t r, char* dest, size_t dest_size) { return path_of_actor(r.item->actor, "<legacy-item>", dest, dest_size); }
+const char* path_object(renderable_t r, char* dest, size_t dest_size) { return path_of_actor(r.object->actor, "<legacy-object>", dest, dest_size); }
 const char* path_brick(renderable_t r, char* dest, size_t dest_size) { return str_cpy(dest, image_filepath(brick_image(r.brick)), dest_size); }
 const char* path_brick_mask(renderable_t r, char* dest, size_t dest_size) { return str_cpy(dest, random_path('M'), dest_size); }
 const char* path_brick_debug(renderable_t r, char* dest, size_t dest_size) { return path_brick(r, dest, dest_size); }
 const char* path_brick_path(renderable_t r, char* dest, size_t dest_size) { return str_cpy(dest, random_path('P'), dest_size); }
+const char* path_brick_chunk(renderable_t r, char* dest, size_t dest_size) { return str_cpy(dest, "<brick chunk>", dest_size); }
 const char* path_background(renderable_t r, char* dest, size_t dest_size) { return str_cpy(dest, "<background>", dest_size); }
 const char* path_foreground(renderable_t r, char* dest, size_t dest_size) { return str_cpy(dest, "<foreground>", dest_size); }
 const char* path_water(renderable_t r, char* dest, size_t dest_size) { return str_cpy(dest, "<water>", dest_size); }
 
 const char* path_ssobject(renderable_t r, char* dest, size_t dest_size)
 {
-    if(surgescript_object_has_function(r.ssobject, "get___filepathOfRenderable")) {
-        surgescript_var_t* ret = surgescript_var_create();
-
-        surgescript_object_call_function(r.ssobject, "get___filepathOfRenderable", NULL, 0, ret);
-        str_cpy(dest, surgescript_var_fast_get_string(ret), dest_size);
-
-        surgescript_var_destroy(ret);
+    if(scripting_util_object_filepath(r.ssobject, dest, dest_size) != NULL)
         return dest;
-    }
 
     /*str_cpy(dest, surgescript_object_name(r.ssobject), dest_size);*/
     return str_cpy(dest, random_path('S'), dest_size);
@@ -1288,11 +1690,12 @@ const char* path_ssobject_gizmo(renderable_t r, char* dest, size_t dest_size)
     return str_cpy(dest, random_path('G'), dest_size);
 }
 
-texturehandle_t texture_player(renderable_t r) { return NO_TEXTURE; /* TODO? */ }
-texturehandle_t texture_item(renderable_t r) { return NO_TEXTURE; /* legacy TODO: remove */ }
-texturehandle_t texture_object(renderable_t r) { return NO_TEXTURE; /* legacy TODO: remove */ }
+texturehandle_t texture_player(renderable_t r) { return image_texture(actor_image(r.player->actor)); /* players that share a texture are batched */ }
+texturehandle_t texture_item(renderable_t r) { return texture_of_actor(r.item->actor); }
+texturehandle_t texture_object(renderable_t r) { return texture_of_actor(r.object->actor); }
 texturehandle_t texture_brick_mask(renderable_t r) { return NO_TEXTURE; }
 texturehandle_t texture_brick_path(renderable_t r) { return NO_TEXTURE; }
+texturehandle_t texture_brick_chunk(renderable_t r) { return image_texture(brickchunk_image(r.chunk)); }
 texturehandle_t texture_ssobject_gizmo(renderable_t r) { return NO_TEXTURE; }
 texturehandle_t texture_background(renderable_t r) { return NO_TEXTURE; }
 texturehandle_t texture_foreground(renderable_t r) { return NO_TEXTURE; }
@@ -1325,17 +1728,35 @@ texturehandle_t texture_ssobject(renderable_t r)
 {
     texturehandle_t tex = NO_TEXTURE;
 
-    if(surgescript_object_has_function(r.ssobject, "get___textureHandle")) {
-        surgescript_var_t* ret = surgescript_var_create();
+    if(!scripting_util_object_texture(r.ssobject, &tex))
+        return NO_TEXTURE;
 
-        surgescript_object_call_function(r.ssobject, "get___textureHandle", NULL, 0, ret);
-        if(!surgescript_var_is_null(ret)) /* is there a texture handle? */
-            tex = surgescript_var_get_rawbits(ret);
+    return tex;
+}
 
-        surgescript_var_destroy(ret);
-    }
 
-    return tex;
+/* the texture of the current image of a legacy entity */
+texturehandle_t texture_of_actor(const actor_t* act)
+{
+    if(act->animation == NULL)
+        return NO_TEXTURE;
+
+    return image_texture(actor_image(act));
+}
+
+/* a legacy entity is translucent if its actor is */
+bool is_translucent_actor(const actor_t* act)
+{
+    return act->alpha < 1.0f || (act->animation != NULL && animation_has_keyframes(act->animation));
+}
+
+/* the path of the current image of a legacy entity, for reporting */
+const char* path_of_actor(const actor_t* act, const char* fallback, char* dest, size_t dest_size)
+{
+    if(act->animation == NULL)
+        return str_cpy(dest, fallback, dest_size);
+
+    return str_cpy(dest, image_filepath(actor_image(act)), dest_size);
 }
 
 
@@ -1377,12 +1798,20 @@ void render_brick_path(renderable_t r, v2d_t camera_position)
     brick_render_path(r.brick, camera_position);
 }
 
+void render_brick_chunk(renderable_t r, v2d_t camera_position)
+{
+    v2d_t topleft = v2d_subtract(camera_position, v2d_multiply(video_get_screen_size(), 0.5f));
+    v2d_t position = brickchunk_position(r.chunk);
+
+    brickchunk_render(r.chunk, (int)position.x - (int)topleft.x, (int)position.y - (int)topleft.y);
+}
+
 void render_ssobject(renderable_t r, v2d_t camera_position)
 {
     surgescript_var_t* cam_x = surgescript_var_set_number(surgescript_var_create(), camera_position.x);
     surgescript_var_t* cam_y = surgescript_var_set_number(surgescript_var_create(), camera_position.y);
 
-    surgescript_object_call_function(r.ssobject, "onRender", (const surgescript_var_t*[]){ cam_x, cam_y }, 2, NULL);
+    classprofiler_call(r.ssobject, "onRender", (const surgescript_var_t*[]){ cam_x, cam_y }, 2, NULL);
 
     surgescript_var_destroy(cam_y);
     surgescript_var_destroy(cam_x);
@@ -26,6 +26,7 @@
 
 /* forward declarations */
 struct brick_t;
+struct brickchunk_t;
 struct item_t;
 struct enemy_t;
 struct player_t;
@@ -45,6 +46,7 @@ void renderqueue_enqueue_brick(struct brick_t* brick);
 void renderqueue_enqueue_brick_mask(struct brick_t* brick);
 void renderqueue_enqueue_brick_debug(struct brick_t* brick);
 void renderqueue_enqueue_brick_path(struct brick_t* brick);
+void renderqueue_enqueue_brick_chunk(const struct brickchunk_t* chunk);
 void renderqueue_enqueue_item(struct item_t* item);
 void renderqueue_enqueue_object(struct enemy_t* object);
 void renderqueue_enqueue_player(struct player_t* player);
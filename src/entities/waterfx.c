@@ -25,6 +25,7 @@
 #include "../core/shader.h"
 #include "../core/timer.h"
 #include "../core/logfile.h"
+#include "../core/gputimer.h"
 #include "../core/engine.h"
 #include "../entities/player.h"
 #include "../scenes/level.h"
@@ -94,9 +95,51 @@ static const char watershader_glsl[] = ""
     "}\n"
 ;
 
+/* a cheaper version of the shader with a single texture read per pixel */
+static const char watershader_fast_glsl[] = ""
+    FRAGMENT_SHADER_GLSL_PREFIX("lowp")
+
+    "uniform lowp sampler2D tex;\n"
+    "uniform lowp vec4 watercolor;\n"
+    "uniform highp float scroll_y;\n"
+    "uniform highp float texel_scale;\n" /* size of a texel in screen pixels */
+
+    "void main()\n"
+    "{\n"
+    "   highp vec2 texture_size = vec2(textureSize(tex, 0));\n"
+    "   highp float screen_y = (texture_size.y - texcoord.y * texture_size.y) * texel_scale;\n"
+    "   highp float world_y = screen_y + scroll_y;\n" /* from screen space to world space */
+    "   highp int wanted_y = int(abs(world_y));\n"
+
+        /* same waveform as above (k = 0, 1, 2), but we sample only the wanted pixel */
+    "   int w = wanted_y & 63;\n"
+    "   int k = int(w >= 20) + int(w >= 32) * int(w <= 51);\n"
+    "   highp vec2 dx = vec2(1.0 / texture_size.x, 0.0);\n"
+    "   vec4 wanted_pixel = texture(tex, texcoord + float(k - 1) * dx);\n"
+
+#if defined(__ANDROID__)
+    /* see the comment above */
+    "   if(k == 2 && all(equal(wanted_pixel, vec4(0.0))))\n"
+    "       wanted_pixel = texture(tex, texcoord - dx);\n"
+#endif
+
+    "   vec3 blended_pixel = mix(wanted_pixel.rgb, watercolor.rgb, watercolor.a);\n"
+    "   color = vec4(blended_pixel, 1.0);\n"
+    "}\n"
+;
+
+/* quality tiers of the default effect */
+typedef enum watertier_t watertier_t;
+enum watertier_t {
+    WATERTIER_FULL,             /* full resolution, reference shader */
+    WATERTIER_FAST,             /* full resolution, fewer texture reads */
+    WATERTIER_HALF_RES          /* half resolution, fewer texture reads, upsampled */
+};
+
 /* backbuffers for post-processing */
 #define NUMBER_OF_BACKBUFFERS   2 /* bg, fg */
 static image_t* backbuffer[NUMBER_OF_BACKBUFFERS] = { NULL, NULL };
+static image_t* half_backbuffer[NUMBER_OF_BACKBUFFERS][2] = { { NULL, NULL }, { NULL, NULL } }; /* input, output */
 static int backbuffer_index = 0;
 static bool create_backbuffers();
 static void destroy_backbuffers();
@@ -109,8 +152,11 @@ static int waterlevel = DEFAULT_WATERLEVEL;
 static color_t watercolor;
 static float internal_timer;
 static shader_t* watershader;
+static shader_t* watershader_fast;
+static watertier_t current_tier();
 static void render_simple_effect(int y, color_t color);
 static void render_default_effect(int y, float camera_y, float offset, float timer, float speed, color_t color);
+static void render_half_res_effect(int y, float scroll_y, color_t color);
 static float* color_to_vec4(color_t color, float* vec4);
 static color_t premultiply_alpha(color_t color);
 
@@ -130,8 +176,9 @@ void waterfx_init()
     waterlevel = DEFAULT_WATERLEVEL;
     watercolor = DEFAULT_WATERCOLOR();
 
-    /* create the shader */
+    /* create the shaders */
     watershader = shader_create("waterfx", watershader_glsl);
+    watershader_fast = shader_create("waterfx_fast", watershader_fast_glsl);
 
     /* create the backbuffers used for post-processing */
     backbuffer_index = 0;
@@ -185,6 +232,9 @@ void waterfx_render_fg(v2d_t camera_position)
     /* adjust y */
     y = max(0, y);
 
+    /* measure the GPU time of the water pass */
+    gputimer_begin("water");
+
     /* if the active player is too fast,
        maybe a simple effect will look better? */
     const player_t* player = level_player();
@@ -195,6 +245,7 @@ void waterfx_render_fg(v2d_t camera_position)
         if(disabled_effect || abs_ysp >= 270.0f) {
             disabled_effect = (abs_ysp > 180.0f);
             render_simple_effect(y, watercolor);
+            gputimer_end();
             return;
         }
     }
@@ -204,6 +255,8 @@ void waterfx_render_fg(v2d_t camera_position)
         render_default_effect(y, topleft.y, 0.0f, internal_timer, 32.0f, watercolor);
     else
         render_simple_effect(y, watercolor);
+
+    gputimer_end();
 }
 
 /*
@@ -303,6 +356,15 @@ bool create_backbuffers()
             return false;
     }
 
+    /* the half resolution buffers are optional */
+    for(int i = 0; i < NUMBER_OF_BACKBUFFERS; i++) {
+        for(int j = 0; j < 2; j++) {
+            half_backbuffer[i][j] = image_create_ex(max(1, VIDEO_SCREEN_W / 2), max(1, VIDEO_SCREEN_H / 2), IC_BACKBUFFER | IC_WRAP_MIRROR);
+            if(half_backbuffer[i][j] == NULL)
+                LOG("Can't create the half resolution backbuffers");
+        }
+    }
+
     return true;
 }
 
@@ -310,6 +372,13 @@ bool create_backbuffers()
 void destroy_backbuffers()
 {
     for(int i = NUMBER_OF_BACKBUFFERS - 1; i >= 0; i--) {
+        for(int j = 1; j >= 0; j--) {
+            if(half_backbuffer[i][j] != NULL) {
+                image_destroy(half_backbuffer[i][j]);
+                half_backbuffer[i][j] = NULL;
+            }
+        }
+
         if(backbuffer[i] != NULL) {
             image_destroy(backbuffer[i]);
             backbuffer[i] = NULL;
@@ -332,6 +401,40 @@ void handle_video_event(const ALLEGRO_EVENT* event, void* context)
     }
 }
 
+/* pick a quality tier for the default effect based on the video quality
+   (the simple effect is used if the quality is low), on the render scale
+   and on the quality governor */
+watertier_t current_tier()
+{
+    float render_scale = video_get_render_scale();
+
+    /* dynamic resolution */
+    if(render_scale <= 0.5f)
+        return WATERTIER_HALF_RES;
+
+    /* adaptive quality: use a cheaper tier */
+    if(video_is_quality_step_taken(VIDEOQUALITYSTEP_FASTER_WATER)) {
+#if defined(__ANDROID__)
+        return WATERTIER_HALF_RES;
+#else
+        return video_get_quality() == VIDEOQUALITY_HIGH && render_scale >= 1.0f ? WATERTIER_FAST : WATERTIER_HALF_RES;
+#endif
+    }
+
+    switch(video_get_quality()) {
+        case VIDEOQUALITY_HIGH:
+            return render_scale < 1.0f ? WATERTIER_FAST : WATERTIER_FULL;
+
+        default:
+#if defined(__ANDROID__)
+            /* mobile GPUs are limited by fill rate */
+            return WATERTIER_HALF_RES;
+#else
+            return render_scale < 1.0f ? WATERTIER_HALF_RES : WATERTIER_FAST;
+#endif
+    }
+}
+
 /* render a simple water effect
    y >= 0 is given in screen space */
 void render_simple_effect(int y, color_t color)
@@ -349,6 +452,18 @@ void render_default_effect(int y, float camera_y, float offset, float timer, flo
         return;
     }
 
+    /* scrolling */
+    float world_scroll_y = speed * timer + offset;
+    float scroll_y = world_scroll_y + camera_y;
+
+    /* reduce the fill rate */
+    watertier_t tier = current_tier();
+    if(tier == WATERTIER_HALF_RES && half_backbuffer[backbuffer_index][1] != NULL) {
+        render_half_res_effect(y, scroll_y, color);
+        backbuffer_index = (1 + backbuffer_index) % NUMBER_OF_BACKBUFFERS;
+        return;
+    }
+
     /* copy the backbuffer */
     /* possibly expensive on mobile platforms because we trigger a pipeline
        flush when unbinding a partially rendered FBO, but we mitigate the cost
@@ -361,18 +476,21 @@ void render_default_effect(int y, float camera_y, float offset, float timer, flo
     }
     image_set_drawing_target(target);
 
+    /* select the shader */
+    shader_t* shader = (tier == WATERTIER_FULL) ? watershader : watershader_fast;
+    if(shader == watershader_fast)
+        shader_set_float(shader, "texel_scale", 1.0f);
+
     /* scrolling */
-    float world_scroll_y = speed * timer + offset;
-    float scroll_y = world_scroll_y + camera_y;
-    shader_set_float(watershader, "scroll_y", scroll_y);
+    shader_set_float(shader, "scroll_y", scroll_y);
 
     /* watercolor */
     float vec4[4];
-    shader_set_float_vector(watershader, "watercolor", 4, color_to_vec4(color, vec4));
+    shader_set_float_vector(shader, "watercolor", 4, color_to_vec4(color, vec4));
 
     /* render */
     const shader_t* prev = shader_get_active();
-    shader_set_active(watershader);
+    shader_set_active(shader);
     {
         v2d_t screen_size = video_get_screen_size();
         image_blit(backbuffer[backbuffer_index], 0, y, 0, y, screen_size.x, screen_size.y);
@@ -383,6 +501,45 @@ void render_default_effect(int y, float camera_y, float offset, float timer, flo
     backbuffer_index = (1 + backbuffer_index) % NUMBER_OF_BACKBUFFERS;
 }
 
+/* render the default water effect at half resolution and upsample it.
+   The shader runs on a quarter of the pixels of the full resolution
+   version and the full-screen copy of the backbuffer becomes a downsample. */
+void render_half_res_effect(int y, float scroll_y, color_t color)
+{
+    image_t* input = half_backbuffer[backbuffer_index][0];
+    image_t* output = half_backbuffer[backbuffer_index][1];
+    image_t* target = image_drawing_target();
+    int width = image_width(input), height = image_height(input);
+    int half_y = min(y / 2, height);
+    v2d_t screen_size = video_get_screen_size();
+
+    /* downsample the backbuffer */
+    image_set_drawing_target(input);
+    {
+        image_clear(color_rgba(0, 0, 0, 0));
+        image_draw_scaled(video_get_backbuffer(), 0, 0, v2d_new(0.5f, 0.5f), IF_NONE);
+    }
+
+    /* apply the effect at half resolution */
+    image_set_drawing_target(output);
+    {
+        float vec4[4];
+        const shader_t* prev = shader_get_active();
+
+        shader_set_float(watershader_fast, "texel_scale", 2.0f);
+        shader_set_float(watershader_fast, "scroll_y", scroll_y);
+        shader_set_float_vector(watershader_fast, "watercolor", 4, color_to_vec4(color, vec4));
+
+        shader_set_active(watershader_fast);
+        image_blit(input, 0, half_y, 0, half_y, width, height - half_y);
+        shader_set_active(prev);
+    }
+
+    /* upsample */
+    image_set_drawing_target(target);
+    image_blit_scaled(output, 0, half_y, width, height - half_y, 0, 2 * half_y, screen_size.x, screen_size.y - 2 * half_y);
+}
+
 /* convert a RGBA color to a vec4 in [0,1]^4 */
 float* color_to_vec4(color_t color, float* vec4)
 {
@@ -52,5 +52,5 @@ int main(int argc, char **argv)
         engine_release();
     } while(engine_must_restart(&cmd));
 
-    return 0;
+    return engine_exit_status();
 }
@@ -0,0 +1,688 @@
+/*
+ * Open Surge Engine
+ * microbench.c - micro-benchmarks of the data structures and of the physics kernels
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+
+MICRO-BENCHMARKS
+----------------
+
+This is a standalone program that runs synthetic workloads on the data
+structures of src/util and on the kernels of src/physics and reports the
+time spent per operation. Build it with -DWANT_MICROBENCHMARKS=ON and run:
+
+    ./microbench [filter]
+
+Only the benchmarks whose names contain the (optional) filter are run.
+
+The units are linked without Allegro, PhysFS and SurgeScript. The few engine
+functions that they reference are replaced by the minimal implementations at
+the bottom of this file. Collision masks are created from a procedural image.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "../util/util.h"
+#include "../util/darray.h"
+#include "../util/fasthash.h"
+#include "../util/dictionary.h"
+#include "../util/hashtable.h"
+#include "../util/iterator.h"
+#include "../util/stringutil.h"
+#include "../util/point2d.h"
+#include "../core/color.h"
+#include "../core/image.h"
+#include "../core/logfile.h"
+#include "../core/resourcemanager.h"
+#include "../physics/collisionmask.h"
+#include "../physics/obstacle.h"
+#include "../physics/obstaclemap.h"
+#include "../physics/physicsactor.h"
+
+/* benchmark runner */
+typedef struct benchmark_t benchmark_t;
+struct benchmark_t {
+    const char* name;
+    void (*setup)();
+    void (*run)(int ops); /* perform ops operations */
+    void (*teardown)();
+    int ops; /* operations per run */
+};
+
+#define RUNS 5 /* we report the fastest run */
+static double now();
+static void run_benchmark(const benchmark_t* benchmark);
+static volatile uintptr_t sink = 0; /* prevent the compiler from optimizing the workloads away */
+
+/* pseudo-random numbers (reproducible) */
+static uint32_t rng_state = 0x2545F491;
+static inline uint32_t rng();
+static inline int rng_range(int min, int max); /* [min,max] */
+
+/* workloads: data structures */
+#define KEY_COUNT 4096
+#define KEY_MAXSIZE 32
+static char key[KEY_COUNT][KEY_MAXSIZE];
+static char missing_key[KEY_COUNT][KEY_MAXSIZE];
+static void setup_keys();
+
+static fasthash_t* fasthash = NULL;
+static void setup_fasthash();
+static void run_fasthash_get(int ops);
+static void run_fasthash_put_delete(int ops);
+static void teardown_fasthash();
+
+static dictionary_t* dictionary = NULL;
+static void setup_dictionary();
+static void run_dictionary_get(int ops);
+static void run_dictionary_iterate(int ops);
+static void run_dictionary_scan(int ops);
+static void teardown_dictionary();
+
+typedef struct benchitem_t benchitem_t;
+struct benchitem_t { int value; };
+static void benchitem_destroy(benchitem_t* item) { free(item); }
+HASHTABLE_GENERATE_CODE(benchitem_t, benchitem_destroy);
+static HASHTABLE(benchitem_t, hashtable);
+static void setup_hashtable();
+static void run_hashtable_find(int ops);
+static void teardown_hashtable();
+
+STATIC_DARRAY(int, integers);
+static void setup_darray();
+static void run_darray_push(int ops);
+static void run_darray_iterator(int ops);
+static void teardown_darray();
+
+static void run_str_icmp(int ops);
+static void run_str_to_lower(int ops);
+
+/* workloads: physics */
+#define TERRAIN_WIDTH       1024
+#define TERRAIN_HEIGHT      256
+#define BRICK_SIZE          64
+#define ROI_WIDTH           1024 /* region of interest */
+#define ROI_HEIGHT          512
+static collisionmask_t* terrain_mask = NULL;
+static collisionmask_t* packed_terrain_mask = NULL;
+static collisionmask_t* brick_mask[2] = { NULL, NULL }; /* box & slope */
+static obstacle_t** obstacle = NULL;
+static int obstacle_count = 0;
+static obstaclemap_t* obstaclemap = NULL;
+static void setup_masks();
+static void teardown_masks();
+static void run_area_test(int ops);
+static void run_packed_area_test(int ops);
+static void run_locate_ground(int ops);
+static void run_packed_locate_ground(int ops);
+static void setup_obstaclemap();
+static void teardown_obstaclemap();
+static void run_obstaclemap_build(int ops);
+static void run_best_obstacle_at(int ops);
+static void run_sensor_sweep(int ops);
+
+/* procedural image used to create collision masks */
+struct image_t {
+    int width, height;
+    int (*ground)(int x, int width, int height); /* ground height at x */
+};
+static int terrain_ground(int x, int width, int height);
+static int slope_ground(int x, int width, int height);
+
+/* the benchmarks */
+static const benchmark_t benchmarks[] = {
+    { "fasthash_get", setup_fasthash, run_fasthash_get, teardown_fasthash, 1000000 },
+    { "fasthash_put_delete", setup_fasthash, run_fasthash_put_delete, teardown_fasthash, 1000000 },
+    { "dictionary_get", setup_dictionary, run_dictionary_get, teardown_dictionary, 1000000 },
+    { "dictionary_iterate", setup_dictionary, run_dictionary_iterate, teardown_dictionary, 1000000 },
+    { "dictionary_scan", setup_dictionary, run_dictionary_scan, teardown_dictionary, 1000000 },
+    { "hashtable_find", setup_hashtable, run_hashtable_find, teardown_hashtable, 1000000 },
+    { "darray_push", setup_darray, run_darray_push, teardown_darray, 10000000 },
+    { "darray_iterator", setup_darray, run_darray_iterator, teardown_darray, 10000000 },
+    { "str_icmp", setup_keys, run_str_icmp, NULL, 1000000 },
+    { "str_to_lower", setup_keys, run_str_to_lower, NULL, 1000000 },
+    { "collisionmask_area_test", setup_masks, run_area_test, teardown_masks, 1000000 },
+    { "collisionmask_area_test_packed", setup_masks, run_packed_area_test, teardown_masks, 1000000 },
+    { "collisionmask_locate_ground", setup_masks, run_locate_ground, teardown_masks, 1000000 },
+    { "collisionmask_locate_ground_packed", setup_masks, run_packed_locate_ground, teardown_masks, 1000000 },
+    { "obstaclemap_build", setup_obstaclemap, run_obstaclemap_build, teardown_obstaclemap, 100 },
+    { "obstaclemap_get_best_obstacle_at", setup_obstaclemap, run_best_obstacle_at, teardown_obstaclemap, 1000000 },
+    { "obstaclemap_sensor_sweep", setup_obstaclemap, run_sensor_sweep, teardown_obstaclemap, 100000 },
+};
+
+
+
+/*
+ * main()
+ * Runs the micro-benchmarks
+ */
+int main(int argc, char** argv)
+{
+    const char* filter = argc > 1 ? argv[1] : "";
+    int count = 0;
+
+    printf("%-40s %14s %14s\n", "benchmark", "ns/op", "ops/s");
+    for(int i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        if(strstr(benchmarks[i].name, filter) != NULL) {
+            run_benchmark(&benchmarks[i]);
+            count++;
+        }
+    }
+
+    if(count == 0) {
+        fprintf(stderr, "No benchmark matches \"%s\"\n", filter);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+
+/* benchmark runner */
+
+/* the current time, in seconds */
+double now()
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* runs a benchmark and prints the time per operation of its fastest run */
+void run_benchmark(const benchmark_t* benchmark)
+{
+    double best = INFINITY;
+
+    rng_state = 0x2545F491;
+    if(benchmark->setup != NULL)
+        benchmark->setup();
+
+    /* warm up */
+    benchmark->run(benchmark->ops / 10 + 1);
+
+    /* measure */
+    for(int i = 0; i < RUNS; i++) {
+        double start = now();
+        benchmark->run(benchmark->ops);
+        double elapsed = now() - start;
+
+        if(elapsed < best)
+            best = elapsed;
+    }
+
+    if(benchmark->teardown != NULL)
+        benchmark->teardown();
+
+    double ns_per_op = 1e9 * best / benchmark->ops;
+    printf("%-40s %14.2f %14.0f\n", benchmark->name, ns_per_op, ns_per_op > 0.0 ? 1e9 / ns_per_op : 0.0);
+    fflush(stdout);
+}
+
+/* xorshift32 */
+uint32_t rng()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+int rng_range(int min, int max)
+{
+    return min + (int)(rng() % (uint32_t)(max - min + 1));
+}
+
+
+
+/* data structures */
+
+/* generate keys similar to the paths of the assets */
+void setup_keys()
+{
+    static const char* folder[] = { "images", "sprites", "samples", "Scripts", "levels" };
+
+    for(int i = 0; i < KEY_COUNT; i++) {
+        snprintf(key[i], KEY_MAXSIZE, "%s/Item_%04d.png", folder[i % 5], i);
+        snprintf(missing_key[i], KEY_MAXSIZE, "%s/Missing_%04d.png", folder[i % 5], i);
+    }
+}
+
+void setup_fasthash()
+{
+    fasthash = fasthash_create(NULL, 10);
+    for(uint64_t i = 0; i < KEY_COUNT; i++)
+        fasthash_put(fasthash, i * 2654435761u, (void*)(uintptr_t)(i + 1));
+}
+
+void run_fasthash_get(int ops)
+{
+    for(int i = 0; i < ops; i++) {
+        uint64_t k = (uint64_t)(rng() % (2 * KEY_COUNT)) * 2654435761u; /* about half are misses */
+        sink += (uintptr_t)fasthash_get(fasthash, k);
+    }
+}
+
+void run_fasthash_put_delete(int ops)
+{
+    for(int i = 0; i < ops; i++) {
+        uint64_t k = (uint64_t)(KEY_COUNT + (rng() % KEY_COUNT)) * 2654435761u;
+        if(i & 1)
+            fasthash_put(fasthash, k, (void*)(uintptr_t)k);
+        else
+            sink += fasthash_delete(fasthash, k);
+    }
+}
+
+void teardown_fasthash()
+{
+    fasthash = fasthash_destroy(fasthash);
+}
+
+void setup_dictionary()
+{
+    setup_keys();
+    dictionary = dictionary_create(false, NULL, NULL);
+    for(int i = 0; i < KEY_COUNT; i++)
+        dictionary_put(dictionary, key[i], (void*)(uintptr_t)(i + 1));
+}
+
+void run_dictionary_get(int ops)
+{
+    for(int i = 0; i < ops; i++) {
+        int j = rng() % KEY_COUNT;
+        sink += (uintptr_t)dictionary_get(dictionary, (i & 1) ? key[j] : missing_key[j]);
+    }
+}
+
+void run_dictionary_iterate(int ops)
+{
+    /* ops is the number of visited elements */
+    while(ops > 0) {
+        iterator_t* it = dictionary_values(dictionary);
+        while(iterator_has_next(it) && ops-- > 0)
+            sink += (uintptr_t)iterator_next(it);
+        iterator_destroy(it);
+    }
+}
+
+void run_dictionary_scan(int ops)
+{
+    /* ops is the number of visited elements */
+    while(ops > 0) {
+        int count = dictionary_count(dictionary);
+        void* const* value = dictionary_value_array(dictionary);
+        for(int i = 0; i < count && ops-- > 0; i++)
+            sink += (uintptr_t)value[i];
+    }
+}
+
+void teardown_dictionary()
+{
+    dictionary = dictionary_destroy(dictionary);
+}
+
+void setup_hashtable()
+{
+    setup_keys();
+    hashtable = hashtable_benchitem_t_create();
+    for(int i = 0; i < KEY_COUNT; i++) {
+        benchitem_t* item = mallocx(sizeof *item);
+        item->value = i;
+        hashtable_benchitem_t_add(hashtable, key[i], item);
+    }
+}
+
+void run_hashtable_find(int ops)
+{
+    for(int i = 0; i < ops; i++) {
+        int j = rng() % KEY_COUNT;
+        sink += (uintptr_t)hashtable_benchitem_t_find(hashtable, (i & 1) ? key[j] : missing_key[j]);
+    }
+}
+
+void teardown_hashtable()
+{
+    hashtable = hashtable_benchitem_t_destroy(hashtable);
+}
+
+void setup_darray()
+{
+    darray_init(integers);
+}
+
+void run_darray_push(int ops)
+{
+    darray_clear(integers);
+    for(int i = 0; i < ops; i++)
+        darray_push(integers, i);
+    sink += darray_length(integers);
+}
+
+void run_darray_iterator(int ops)
+{
+    /* ops is the number of visited elements */
+    if(darray_length(integers) < ops) {
+        darray_clear(integers);
+        for(int i = 0; i < ops; i++)
+            darray_push(integers, i);
+    }
+
+    iterator_t* it = darray_iterator(integers);
+    for(int i = 0; i < ops && iterator_has_next(it); i++)
+        sink += *((int*)iterator_next(it));
+    iterator_destroy(it);
+}
+
+void teardown_darray()
+{
+    darray_release(integers);
+}
+
+void run_str_icmp(int ops)
+{
+    for(int i = 0; i < ops; i++) {
+        int j = rng() % KEY_COUNT;
+        sink += str_icmp(key[j], (i & 1) ? key[(j + 1) % KEY_COUNT] : key[j]);
+    }
+}
+
+void run_str_to_lower(int ops)
+{
+    char buffer[KEY_MAXSIZE];
+
+    for(int i = 0; i < ops; i++) {
+        int j = rng() % KEY_COUNT;
+        sink += (uintptr_t)str_to_lower(key[j], buffer, sizeof(buffer))[0];
+    }
+}
+
+
+
+/* physics */
+
+/* a hilly terrain with a few holes */
+int terrain_ground(int x, int width, int height)
+{
+    if((x / 96) % 7 == 6)
+        return height; /* hole */
+
+    return height / 2 + (int)(height / 4 * sin(x * 0.02) + height / 8 * sin(x * 0.07));
+}
+
+/* a 45-degree slope */
+int slope_ground(int x, int width, int height)
+{
+    return height - 1 - (x * height) / width;
+}
+
+void setup_masks()
+{
+    image_t terrain = { TERRAIN_WIDTH, TERRAIN_HEIGHT, terrain_ground };
+
+    terrain_mask = collisionmask_create(&terrain, 0, 0, TERRAIN_WIDTH, TERRAIN_HEIGHT, 0);
+    packed_terrain_mask = collisionmask_create(&terrain, 0, 0, TERRAIN_WIDTH, TERRAIN_HEIGHT, CMF_PACKED);
+}
+
+void teardown_masks()
+{
+    terrain_mask = collisionmask_destroy(terrain_mask);
+    packed_terrain_mask = collisionmask_destroy(packed_terrain_mask);
+}
+
+static void area_test(const collisionmask_t* mask, int ops)
+{
+    /* rectangles of the size of sensors and hitboxes */
+    for(int i = 0; i < ops; i++) {
+        int w = rng_range(1, 32), h = rng_range(1, 32);
+        int x = rng_range(0, TERRAIN_WIDTH - w), y = rng_range(0, TERRAIN_HEIGHT - h);
+        sink += collisionmask_area_test(mask, x, y, x + w - 1, y + h - 1);
+    }
+}
+
+void run_area_test(int ops)
+{
+    area_test(terrain_mask, ops);
+}
+
+void run_packed_area_test(int ops)
+{
+    area_test(packed_terrain_mask, ops);
+}
+
+static void locate_ground(const collisionmask_t* mask, int ops)
+{
+    for(int i = 0; i < ops; i++) {
+        int x = rng_range(0, TERRAIN_WIDTH - 1), y = rng_range(0, TERRAIN_HEIGHT - 1);
+        sink += collisionmask_locate_ground(mask, x, y, (grounddir_t)(i & 3));
+    }
+}
+
+void run_locate_ground(int ops)
+{
+    locate_ground(terrain_mask, ops);
+}
+
+void run_packed_locate_ground(int ops)
+{
+    locate_ground(packed_terrain_mask, ops);
+}
+
+/* a brick-dense region of interest: a grid of boxes and slopes with a few gaps */
+void setup_obstaclemap()
+{
+    image_t slope = { BRICK_SIZE, BRICK_SIZE, slope_ground };
+    int cols = ROI_WIDTH / BRICK_SIZE, rows = ROI_HEIGHT / BRICK_SIZE;
+
+    brick_mask[0] = collisionmask_create_box(BRICK_SIZE, BRICK_SIZE);
+    brick_mask[1] = collisionmask_create(&slope, 0, 0, BRICK_SIZE, BRICK_SIZE, 0);
+
+    obstacle = mallocx(cols * rows * sizeof(*obstacle));
+    obstacle_count = 0;
+    for(int row = rows / 2; row < rows; row++) {
+        for(int col = 0; col < cols; col++) {
+            if(rng() % 8 == 0)
+                continue;
+
+            const collisionmask_t* mask = brick_mask[rng() % 2];
+            point2d_t position = point2d_new(col * BRICK_SIZE, row * BRICK_SIZE);
+            int flags = (rng() % 4 == 0) ? OF_CLOUD : 0;
+            obstacle[obstacle_count++] = obstacle_create(mask, position, OL_DEFAULT, flags);
+        }
+    }
+
+    obstaclemap = obstaclemap_create();
+    for(int i = 0; i < obstacle_count; i++)
+        obstaclemap_add(obstaclemap, obstacle[i]);
+    obstaclemap_build(obstaclemap);
+}
+
+void teardown_obstaclemap()
+{
+    obstaclemap = obstaclemap_destroy(obstaclemap);
+
+    for(int i = 0; i < obstacle_count; i++)
+        obstacle_destroy(obstacle[i]);
+    free(obstacle);
+    obstacle = NULL;
+    obstacle_count = 0;
+
+    brick_mask[0] = collisionmask_destroy(brick_mask[0]);
+    brick_mask[1] = collisionmask_destroy(brick_mask[1]);
+}
+
+void run_obstaclemap_build(int ops)
+{
+    /* rebuild the map as done once per frame */
+    for(int i = 0; i < ops; i++) {
+        obstaclemap_clear(obstaclemap);
+        for(int j = 0; j < obstacle_count; j++)
+            obstaclemap_add(obstaclemap, obstacle[j]);
+        obstaclemap_build(obstaclemap);
+    }
+}
+
+void run_best_obstacle_at(int ops)
+{
+    /* vertical sensors of the size of those of the player */
+    for(int i = 0; i < ops; i++) {
+        int x = rng_range(0, ROI_WIDTH - 1), y = rng_range(0, ROI_HEIGHT - 24);
+        sink += (uintptr_t)obstaclemap_get_best_obstacle_at(obstaclemap, x, y, x + 1, y + 20, MM_FLOOR, OL_DEFAULT);
+    }
+}
+
+void run_sensor_sweep(int ops)
+{
+    /* a player-like batch of sensors sweeping the region of interest.
+       ops is the number of batches */
+    obstaclequery_t query[6];
+
+    for(int i = 0; i < ops; i++) {
+        int x = (i * 3) % (ROI_WIDTH - 32), y = ROI_HEIGHT / 2 - 16 + (i % 64);
+
+        query[0] = (obstaclequery_t){ x + 0, y + 0, x + 1, y + 36, true, NULL }; /* A */
+        query[1] = (obstaclequery_t){ x + 18, y + 0, x + 19, y + 36, true, NULL }; /* B */
+        query[2] = (obstaclequery_t){ x + 0, y - 24, x + 1, y - 4, true, NULL }; /* C */
+        query[3] = (obstaclequery_t){ x + 18, y - 24, x + 19, y - 4, true, NULL }; /* D */
+        query[4] = (obstaclequery_t){ x - 2, y + 4, x + 0, y + 5, true, NULL }; /* M */
+        query[5] = (obstaclequery_t){ x + 19, y + 4, x + 21, y + 5, true, NULL }; /* N */
+
+        obstaclemap_query_sensors(obstaclemap, query, 6, MM_FLOOR, OL_DEFAULT);
+        sink += (uintptr_t)query[0].best + (uintptr_t)query[1].best;
+    }
+}
+
+
+
+/*
+ * minimal implementations of the engine functions referenced by the units
+ */
+
+void* __mallocx(size_t bytes, const char* location, int line)
+{
+    void* ptr = malloc(bytes);
+    if(ptr == NULL && bytes > 0) {
+        fprintf(stderr, "Out of memory in %s:%d\n", location, line);
+        exit(1);
+    }
+    return ptr;
+}
+
+void* __reallocx(void* ptr, size_t bytes, const char* location, int line)
+{
+    void* new_ptr = realloc(ptr, bytes);
+    if(new_ptr == NULL && bytes > 0) {
+        fprintf(stderr, "Out of memory in %s:%d\n", location, line);
+        exit(1);
+    }
+    return new_ptr;
+}
+
+void fatal_error(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+void logfile_message(const char* fmt, ...)
+{
+    /* silence */
+    (void)fmt;
+}
+
+void resourcemanager_track_memory(resourcetype_t type, int64_t bytes)
+{
+    (void)type;
+    (void)bytes;
+}
+
+int image_width(const image_t* img)
+{
+    return img->width;
+}
+
+int image_height(const image_t* img)
+{
+    return img->height;
+}
+
+bool image_is_locked(const image_t* img)
+{
+    return true;
+}
+
+const char* image_filepath(const image_t* img)
+{
+    return "";
+}
+
+color_t image_getpixel(const image_t* img, int x, int y)
+{
+    bool solid = (y >= img->ground(x, img->width, img->height));
+    return (color_t){ ._color = { 1.0f, 1.0f, 1.0f, solid ? 1.0f : 0.0f } };
+}
+
+bool color_is_transparent(color_t color)
+{
+    return color._color.a == 0.0f;
+}
+
+bool image_read_opaque_row(const image_t* img, int x, int y, int width, uint8_t* out)
+{
+    for(int i = 0; i < width; i++)
+        out[i] = (y >= img->ground(x + i, img->width, img->height));
+    return true;
+}
+
+/* collision masks are built in the calling thread */
+ALLEGRO_THREAD* al_create_thread(void* (*proc)(ALLEGRO_THREAD* thread, void* arg), void* arg) { return NULL; }
+void al_start_thread(ALLEGRO_THREAD* thread) { fatal_error("%s is not available", __func__); }
+void al_join_thread(ALLEGRO_THREAD* thread, void** ret_value) { fatal_error("%s is not available", __func__); }
+void al_destroy_thread(ALLEGRO_THREAD* thread) { fatal_error("%s is not available", __func__); }
+
+/* collisionmask_to_image() is not benchmarked */
+image_t* image_create(int width, int height) { fatal_error("%s is not available", __func__); return NULL; }
+image_t* image_drawing_target() { fatal_error("%s is not available", __func__); return NULL; }
+void image_set_drawing_target(image_t* new_target) { fatal_error("%s is not available", __func__); }
+void image_lock(image_t* img, const char* mode) { fatal_error("%s is not available", __func__); }
+void image_unlock(image_t* img) { fatal_error("%s is not available", __func__); }
+void image_putpixel(int x, int y, color_t color) { fatal_error("%s is not available", __func__); }
+void image_clear(color_t color) { fatal_error("%s is not available", __func__); }
+color_t color_rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a) { fatal_error("%s is not available", __func__); return (color_t){ 0 }; }
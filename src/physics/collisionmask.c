@@ -18,12 +18,18 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <allegro5/allegro.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include "collisionmask.h"
 #include "../core/video.h"
 #include "../core/image.h"
+#include "../core/jobs.h"
 #include "../core/logfile.h"
+#include "../core/resourcemanager.h"
 #include "../util/util.h"
+#include "../util/stringutil.h"
+#include "../util/hashtable.h"
 
 
 
@@ -42,22 +48,74 @@ struct collisionmask_t {
     /* ground maps for each ground direction */
     uint16_t* gmap[4];
 
+    /* ground profiles indexed by grounddir_t: the ground position of each
+       column (GD_DOWN, GD_UP) or row (GD_RIGHT, GD_LEFT), valid for all of
+       its pixels. Only plain masks have a profile (it may be NULL) */
+    uint16_t* profile[4];
+
+    /* packed representation (CMF_PACKED) with 1 bit per pixel, stored both
+       row-wise and column-wise. If it's used, the mask data, the integral
+       mask and the ground maps are NULL (and the pitch is zero) */
+    uint64_t* packed_rows; /* bit x of row y is bit x%64 of packed_rows[y * words_per_row + x/64] */
+    uint64_t* packed_cols; /* bit y of column x is bit y%64 of packed_cols[x * words_per_col + y/64] */
+    int words_per_row;
+    int words_per_col;
+
+    /* sharing: collision masks are immutable, so clones are references */
+    int reference_count;
+    char* key; /* key of the mask in the cache, or NULL if it isn't cached */
+
+};
+
+/* process-wide cache of the collision masks created from image files.
+   Masks of the same tiles are shared by bricks, sprites, etc. */
+HASHTABLE_GENERATE_CODE(collisionmask_t, NULL);
+static HASHTABLE(collisionmask_t, mask_cache);
+#define MASK_KEY_MAXLEN 1024
+static bool make_key(char* key, const struct image_t* image, int x, int y, int width, int height, int flags);
+static collisionmask_t* create_mask(const image_t *image, int x, int y, int width, int height, int flags);
+static collisionmask_t* new_mask(const image_t *image, int width, int height);
+static void build_mask(collisionmask_t* mask, const image_t *image, int x, int y, int flags);
+
+/* masks of a batch are built in parallel by the job system */
+#define MIN_MASKS_PER_BUILDER 32 /* don't split the work for a few masks */
+typedef struct maskbuilder_t maskbuilder_t;
+struct maskbuilder_t {
+    const collisionmask_request_t* request;
+    collisionmask_t** mask;
+    const int* pending; /* indices of the requests whose masks must be built */
 };
+static void build_masks(int first, int last, void* arg);
 
 /* cloudify */
 static const int CLOUD_HEIGHT = 16 + 8; /* give it some slack for steep slopes & very high speeds */
 static void cloudify_mask(collisionmask_t* mask);
 
 /* ground maps */
-static uint16_t* create_groundmap(const collisionmask_t* mask, grounddir_t ground_direction);
-static inline uint16_t* clone_groundmap(uint16_t* gmap, int width, int height, grounddir_t ground_direction);
+static void create_lookup_tables(collisionmask_t* mask);
 static inline uint16_t* destroy_groundmap(uint16_t* gmap);
 
+/* ground profiles */
+static void create_profiles(collisionmask_t* mask);
+static void destroy_profiles(collisionmask_t* mask);
+static uint16_t* create_profile(const collisionmask_t* mask, grounddir_t ground_direction);
+static inline size_t profile_size(const collisionmask_t* mask);
+
 /* integral masks */
-static uint32_t* create_integral_mask(const collisionmask_t* mask);
-static uint32_t* clone_integral_mask(uint32_t* integral_mask, int width, int height);
 static inline uint32_t* destroy_integral_mask(uint32_t* integral_mask);
 
+/* packed masks */
+static void pack_mask(collisionmask_t* mask);
+static inline bool packed_pixel_test(const collisionmask_t* mask, int x, int y);
+static bool packed_area_test(const collisionmask_t* mask, int left, int top, int right, int bottom);
+static int packed_locate_ground(const collisionmask_t* mask, int x, int y, grounddir_t ground_direction);
+static inline bool any_bit_in_range(const uint64_t* words, int first, int last);
+static inline int find_next_bit(const uint64_t* words, int length, int first, bool value);
+static inline int find_prev_bit(const uint64_t* words, int last, bool value);
+static inline size_t unpacked_size(int width, int height);
+static inline size_t packed_size(int width, int height);
+static inline int64_t memory_usage(const collisionmask_t* mask);
+
 /*
 
 INTEGRAL MASKS
@@ -194,12 +252,108 @@ typedef char _mask_assert[ !!(IS_POWER_OF_TWO(MEM_ALIGNMENT)) * 2 - 1 ]; /* is M
  * collisionmask_create()
  * Creates a new collision mask using the rectangle
  * [ x, x + width - 1 ] x [ y, y + height - 1 ]
- * of the given image, which should be locked
+ * of the given image, which should be locked. If a mask of the same
+ * rectangle of the same image file already exists, it's shared
  */
 collisionmask_t *collisionmask_create(const image_t *image, int x, int y, int width, int height, int flags)
+{
+    char key[MASK_KEY_MAXLEN];
+    collisionmask_t* mask;
+
+    /* uncached mask */
+    if(!make_key(key, image, x, y, width, height, flags))
+        return create_mask(image, x, y, width, height, flags);
+
+    /* reuse a cached mask */
+    if(mask_cache != NULL && NULL != (mask = hashtable_collisionmask_t_find(mask_cache, key))) {
+        mask->reference_count++;
+        return mask;
+    }
+
+    /* create and cache a new mask */
+    if(mask_cache == NULL)
+        mask_cache = hashtable_collisionmask_t_create();
+
+    mask = create_mask(image, x, y, width, height, flags);
+    mask->key = str_dup(key);
+    hashtable_collisionmask_t_add(mask_cache, key, mask);
+
+    return mask;
+}
+
+/*
+ * collisionmask_create_batch()
+ * Creates count collision masks at once, as if calling collisionmask_create()
+ * for each request, and writes them to out_mask[]. The masks are built in
+ * parallel. The images must be locked and must not change meanwhile
+ */
+void collisionmask_create_batch(const collisionmask_request_t* request, int count, collisionmask_t** out_mask)
+{
+    int* pending = mallocx((count + 1) * sizeof(*pending));
+    int pending_count = 0;
+    char key[MASK_KEY_MAXLEN];
+
+    /* create the masks in this thread, reusing the cached ones. Masks of
+       the same rectangle of the same image file are shared even within the
+       batch, because new masks are cached before they're built */
+    for(int i = 0; i < count; i++) {
+        const collisionmask_request_t* r = &request[i];
+        collisionmask_t* mask;
+
+        if(!make_key(key, r->image, r->x, r->y, r->width, r->height, r->flags)) {
+            out_mask[i] = new_mask(r->image, r->width, r->height);
+            pending[pending_count++] = i;
+            continue;
+        }
+
+        if(mask_cache != NULL && NULL != (mask = hashtable_collisionmask_t_find(mask_cache, key))) {
+            mask->reference_count++;
+            out_mask[i] = mask;
+            continue;
+        }
+
+        if(mask_cache == NULL)
+            mask_cache = hashtable_collisionmask_t_create();
+
+        mask = new_mask(r->image, r->width, r->height);
+        mask->key = str_dup(key);
+        hashtable_collisionmask_t_add(mask_cache, key, mask);
+        out_mask[i] = mask;
+        pending[pending_count++] = i;
+    }
+
+    /* build the new masks in parallel. Building a mask only reads
+       the pixels of its image and writes to the mask itself */
+    maskbuilder_t builder = { .request = request, .mask = out_mask, .pending = pending };
+    jobs_parallel_for(pending_count, MIN_MASKS_PER_BUILDER, build_masks, &builder);
+
+    /* track the memory of the new masks */
+    for(int j = 0; j < pending_count; j++)
+        resourcemanager_track_memory(RESOURCE_COLLISIONMASK, memory_usage(out_mask[pending[j]]));
+
+    free(pending);
+}
+
+/* creates a new collision mask (see collisionmask_create) */
+collisionmask_t* create_mask(const image_t *image, int x, int y, int width, int height, int flags)
+{
+    collisionmask_t *mask = new_mask(image, width, height);
+
+    build_mask(mask, image, x, y, flags);
+    resourcemanager_track_memory(RESOURCE_COLLISIONMASK, memory_usage(mask));
+
+    return mask;
+}
+
+/* allocates a collision mask that has not been built yet */
+collisionmask_t* new_mask(const image_t *image, int width, int height)
 {
     collisionmask_t *mask = mallocx(sizeof *mask);
 
+    /* sharing */
+    mask->reference_count = 1;
+    mask->key = NULL;
+
     /* basic params */
     mask->width = clip(width, 1, image_width(image));
     mask->height = clip(height, 1, image_height(image));
@@ -218,12 +372,24 @@ collisionmask_t *collisionmask_create(const image_t *image, int x, int y, int wi
         logfile_message("%s: image \"%s\" is not locked", __func__, image_filepath(image));
     }
 
+    return mask;
+}
+
+/* builds the data of a new collision mask. This is thread-safe:
+   it only reads the pixels of the image and writes to the mask */
+void build_mask(collisionmask_t* mask, const image_t *image, int x, int y, int flags)
+{
     /* create the collision mask */
     size_t mask_size = (mask->pitch * mask->height) * sizeof(*(mask->mask));
     mask->mask = mallocx(mask_size);
     memset(mask->mask, 0, mask_size);
 
     for(int j = 0, jp = 0; j < mask->height; j++, jp += mask->pitch) {
+        /* read an entire row of the locked image, if possible */
+        if(image_read_opaque_row(image, x, y + j, mask->width, mask->mask + jp))
+            continue;
+
+        /* fallback */
         for(int i = 0; i < mask->width; i++) {
             if(!color_is_transparent(image_getpixel(image, x + i, y + j)))
                 mask->mask[jp + i] = 1;
@@ -234,17 +400,43 @@ collisionmask_t *collisionmask_create(const image_t *image, int x, int y, int wi
     if(flags & CMF_CLOUDIFY)
         cloudify_mask(mask);
 
-    /* create the integral mask */
-    mask->integral_mask = create_integral_mask(mask);
+    /* create the ground profiles before packing */
+    create_profiles(mask);
 
-    /* create the ground maps */
-    mask->gmap[0] = create_groundmap(mask, GD_DOWN);
-    mask->gmap[1] = create_groundmap(mask, GD_LEFT);
-    mask->gmap[2] = create_groundmap(mask, GD_UP);
-    mask->gmap[3] = create_groundmap(mask, GD_RIGHT);
+    /* pack the mask, if requested */
+    if(flags & CMF_PACKED) {
+        pack_mask(mask);
 
-    /* done! */
-    return mask;
+        logfile_message("Packed a %dx%d collision mask: %lu KB instead of %lu KB",
+            mask->width, mask->height,
+            (unsigned long)(packed_size(mask->width, mask->height) / 1024),
+            (unsigned long)(unpacked_size(mask->width, mask->height) / 1024)
+        );
+
+        return;
+    }
+
+    /* not packed */
+    mask->packed_rows = NULL;
+    mask->packed_cols = NULL;
+    mask->words_per_row = 0;
+    mask->words_per_col = 0;
+
+    /* create the integral mask and the ground maps */
+    create_lookup_tables(mask);
+}
+
+/* builds the pending masks [first, last) of a batch in a job */
+void build_masks(int first, int last, void* arg)
+{
+    const maskbuilder_t* builder = (const maskbuilder_t*)arg;
+
+    for(int j = first; j < last; j++) {
+        int i = builder->pending[j];
+        const collisionmask_request_t* r = &builder->request[i];
+
+        build_mask(builder->mask[i], r->image, r->x, r->y, r->flags);
+    }
 }
 
 /*
@@ -256,6 +448,10 @@ collisionmask_t *collisionmask_create_box(int width, int height)
 {
     collisionmask_t *mask = mallocx(sizeof *mask);
 
+    /* sharing */
+    mask->reference_count = 1;
+    mask->key = NULL;
+
     /* basic params */
     mask->width = clip(width, 1, MASK_MAXSIZE);
     mask->height = clip(height, 1, MASK_MAXSIZE);
@@ -266,44 +462,33 @@ collisionmask_t *collisionmask_create_box(int width, int height)
     mask->mask = mallocx(mask_size);
     memset(mask->mask, 1, mask_size);
 
-    /* create the integral mask */
-    mask->integral_mask = create_integral_mask(mask);
+    /* create the ground profiles */
+    create_profiles(mask);
+
+    /* not packed */
+    mask->packed_rows = NULL;
+    mask->packed_cols = NULL;
+    mask->words_per_row = 0;
+    mask->words_per_col = 0;
 
-    /* create the ground maps */
-    mask->gmap[0] = create_groundmap(mask, GD_DOWN);
-    mask->gmap[1] = create_groundmap(mask, GD_LEFT);
-    mask->gmap[2] = create_groundmap(mask, GD_UP);
-    mask->gmap[3] = create_groundmap(mask, GD_RIGHT);
+    /* create the integral mask and the ground maps */
+    create_lookup_tables(mask);
 
     /* done! */
+    resourcemanager_track_memory(RESOURCE_COLLISIONMASK, memory_usage(mask));
     return mask;
 }
 
 /*
  * collisionmask_clone()
- * Clones a collision mask
+ * Clones a collision mask. Masks are immutable, so the clone is
+ * a reference to the same data. Destroy it as usual
  */
 collisionmask_t* collisionmask_clone(const collisionmask_t* mask)
 {
-    /* clone the fields */
-    collisionmask_t* clone = mallocx(sizeof *clone);
-    memcpy(clone, mask, sizeof(*clone));
+    collisionmask_t* clone = (collisionmask_t*)mask;
 
-    /* clone the mask data */
-    size_t mask_size = (mask->pitch * mask->height) * sizeof(*(mask->mask));
-    clone->mask = mallocx(mask_size);
-    memcpy(clone->mask, mask->mask, mask_size);
-
-    /* clone the integral mask */
-    clone->integral_mask = clone_integral_mask(mask->integral_mask, mask->width, mask->height);
-
-    /* clone the ground maps */
-    clone->gmap[0] = clone_groundmap(mask->gmap[0], mask->width, mask->height, GD_DOWN);
-    clone->gmap[1] = clone_groundmap(mask->gmap[1], mask->width, mask->height, GD_LEFT);
-    clone->gmap[2] = clone_groundmap(mask->gmap[2], mask->width, mask->height, GD_UP);
-    clone->gmap[3] = clone_groundmap(mask->gmap[3], mask->width, mask->height, GD_RIGHT);
-
-    /* done! */
+    clone->reference_count++;
     return clone;
 }
 
@@ -317,6 +502,25 @@ collisionmask_t *collisionmask_destroy(collisionmask_t *mask)
     if(!mask)
         return NULL;
 
+    /* the mask is still shared */
+    if(--(mask->reference_count) > 0)
+        return NULL;
+
+    /* remove it from the cache */
+    if(mask->key != NULL) {
+        hashtable_collisionmask_t_remove(mask_cache, mask->key);
+        free(mask->key);
+
+        if(mask_cache->count == 0)
+            mask_cache = hashtable_collisionmask_t_destroy(mask_cache);
+    }
+
+    /* memory usage */
+    resourcemanager_track_memory(RESOURCE_COLLISIONMASK, -memory_usage(mask));
+
+    /* release the ground profiles */
+    destroy_profiles(mask);
+
     /* release the ground maps */
     destroy_groundmap(mask->gmap[3]);
     destroy_groundmap(mask->gmap[2]);
@@ -326,6 +530,10 @@ collisionmask_t *collisionmask_destroy(collisionmask_t *mask)
     /* release the integral mask */
     destroy_integral_mask(mask->integral_mask);
 
+    /* release the packed data */
+    free(mask->packed_cols);
+    free(mask->packed_rows);
+
     /* release the mask data & struct */
     free(mask->mask);
     free(mask);
@@ -368,7 +576,7 @@ int collisionmask_pitch(const collisionmask_t* mask)
 bool collisionmask_pixel_test(const collisionmask_t* mask, int x, int y)
 {
     if(mask && x >= 0 && x < mask->width && y >= 0 && y < mask->height)
-        return collisionmask_at(mask, x, y, mask->pitch);
+        return mask->packed_rows == NULL ? collisionmask_at(mask, x, y, mask->pitch) : packed_pixel_test(mask, x, y);
     else
         return false;
 }
@@ -401,6 +609,10 @@ bool collisionmask_area_test(const collisionmask_t* mask, int left, int top, int
     if(bottom > b)
         bottom = b;
 
+    /* packed masks are scanned */
+    if(mask->packed_rows != NULL)
+        return packed_area_test(mask, left, top, right, bottom);
+
     /* super fast area test */
     int p = MASK_ALIGN(mask->width + 1); /* pitch of the integral mask */
     const uint32_t* s = mask->integral_mask;
@@ -424,6 +636,17 @@ int collisionmask_locate_ground(const collisionmask_t* mask, int x, int y, groun
     if(!mask)
         return 0;
 
+    /* plain masks have a ground profile: a single array read */
+    const uint16_t* profile = mask->profile[ground_direction];
+    if(profile != NULL) {
+        if(ground_direction == GD_DOWN || ground_direction == GD_UP) {
+            if(x >= 0 && x < mask->width)
+                return profile[x];
+        }
+        else if(y >= 0 && y < mask->height)
+            return profile[y];
+    }
+
     /* out of bounds check */
     if(x < 0 || x >= mask->width) {
         /* minimum level */
@@ -453,6 +676,10 @@ int collisionmask_locate_ground(const collisionmask_t* mask, int x, int y, groun
             y = mask->height - 1;
     }
 
+    /* packed masks are scanned */
+    if(mask->packed_rows != NULL)
+        return packed_locate_ground(mask, x, y, ground_direction);
+
     /* this is very fast */
     switch(ground_direction) {
         case GD_DOWN:
@@ -493,7 +720,7 @@ image_t* collisionmask_to_image(const collisionmask_t* mask, color_t color)
 
     for(int y = 0; y < mask->height; y++) {
         for(int x = 0; x < mask->width; x++) {
-            if(collisionmask_at(mask, x, y, mask->pitch))
+            if(collisionmask_pixel_test(mask, x, y))
                 image_putpixel(x, y, color);
         }
     }
@@ -536,123 +763,141 @@ void cloudify_mask(collisionmask_t* mask)
  */
 
 
-/* Creates a new ground map */
-uint16_t* create_groundmap(const collisionmask_t* mask, grounddir_t ground_direction)
+/*
+ * Creates the integral mask and the ground maps of an unpacked mask.
+ *
+ * Considering GD_DOWN, the ground map is given by:
+ *
+ *                  y                        if mask(x,y) = 1 and mask(x,y-1) = 0
+ * gmap(x,y)   =    gmap(x,y-1)              if mask(x,y) = 1 and mask(x,y-1) = 1
+ *                  gmap(x,y+1)              if mask(x,y) = 0 and y < h-1
+ *                  y                        if mask(x,y) = 0 and y = h-1
+ *
+ * The other directions are analogous. The solid pixels of GD_DOWN and the
+ * non-solid pixels of GD_UP depend on the rows above them, whereas the other
+ * pixels of these maps depend on the rows below them. A non-solid pixel of
+ * GD_UP just below a solid pixel takes the position of the solid pixel. So we compute all of
+ * the tables in two passes over the rows of the mask: from top to bottom and
+ * from bottom to top. GD_LEFT and GD_RIGHT depend only on the current row.
+ * Rows are scanned in memory order, which is much faster than scanning each
+ * column of the mask for each map.
+ */
+void create_lookup_tables(collisionmask_t* mask)
 {
     int w = mask->width, h = mask->height;
     int pitch = mask->pitch;
-    uint16_t* gmap = NULL;
-    int x, y, p;
-
-    /* compute the position of the ground */
-    switch(ground_direction)
-    {
-        /*
-         * the ground is "down": (gravity -> "down")
-         *
-         *                  y                        if mask(x,y) = 1 and mask(x,y-1) = 0
-         * gmap(x,y)   =    gmap(x,y-1)              if mask(x,y) = 1 and mask(x,y-1) = 1
-         *                  gmap(x,y+1)              if mask(x,y) = 0 and y < h-1
-         *                  y                        if mask(x,y) = 0 and y = h-1
-         */
-        case GD_DOWN:
-            p = MASK_ALIGN(mask->width);
-            gmap = mallocx((p * h) * sizeof(*gmap));
-            for(x = 0; x < w; x++) {
-                if(collisionmask_at(mask, x, 0, pitch))
-                    gmap[x] = 0;
-                for(y = 1; y < h; y++) {
-                    if(collisionmask_at(mask, x, y, pitch)) {
-                        if(collisionmask_at(mask, x, y-1, pitch))
-                            gmap[p * y + x] = gmap[p * (y-1) + x];
-                        else
-                            gmap[p * y + x] = y;
-                    }
-                }
-                if(!collisionmask_at(mask, x, h-1, pitch))
-                    gmap[p * (h-1) + x] = h-1;
-                for(y = h-2; y >= 0; y--) {
-                    if(!collisionmask_at(mask, x, y, pitch))
-                        gmap[p * y + x] = gmap[p * (y+1) + x];
-                }
-            }
-            break;
+    int p = MASK_ALIGN(w); /* pitch of GD_DOWN and GD_UP */
+    int q = MASK_ALIGN(h); /* pitch of GD_LEFT and GD_RIGHT */
+    int ip = MASK_ALIGN(w + 1); /* pitch of the integral mask */
+    uint16_t* down = mallocx((p * h) * sizeof(*down));
+    uint16_t* up = mallocx((p * h) * sizeof(*up));
+    uint16_t* left = mallocx((q * w) * sizeof(*left));
+    uint16_t* right = mallocx((q * w) * sizeof(*right));
+    uint32_t* integral_mask = mallocx((ip * (h + 1)) * sizeof(*integral_mask));
+    uint16_t* row_left = mallocx(w * sizeof(*row_left));
+    uint16_t* row_right = mallocx(w * sizeof(*row_right));
+
+    /* the first row and the first column of the integral mask are zero */
+    memset(integral_mask, 0, (w + 1) * sizeof(*integral_mask));
+
+    /* top to bottom */
+    for(int y = 0; y < h; y++) {
+        const uint8_t* m = mask->mask + y * pitch;
+        const uint8_t* m_above = m - pitch; /* valid if y > 0 */
+        const uint32_t* s_above = integral_mask + y * ip;
+        uint32_t* s = integral_mask + (y + 1) * ip;
+        uint16_t* d = down + y * p;
+        uint16_t* u = up + y * p;
+        uint32_t row_sum = 0;
+
+        /* integral mask */
+        s[0] = 0;
+        for(int x = 0; x < w; x++) {
+            row_sum += m[x]; /* will not overflow */
+            s[x + 1] = s_above[x + 1] + row_sum;
+        }
 
-        /* the ground is "to the left" */
-        case GD_LEFT:
-            p = MASK_ALIGN(mask->height);
-            gmap = mallocx((p *  w) * sizeof(*gmap));
-            for(y = 0; y < h; y++) {
-                if(collisionmask_at(mask, w-1, y, pitch))
-                    gmap[p * (w-1) + y] = w-1;
-                for(x = w-2; x >= 0; x--) {
-                    if(collisionmask_at(mask, x, y, pitch)) {
-                        if(collisionmask_at(mask, x+1, y, pitch))
-                            gmap[p * x + y] = gmap[p * (x+1) + y];
-                        else
-                            gmap[p * x + y] = x;
-                    }
-                }
-                if(!collisionmask_at(mask, 0, y, pitch))
-                    gmap[y] = 0;
-                for(x = 1; x < w; x++) {
-                    if(!collisionmask_at(mask, x, y, pitch))
-                        gmap[p * x + y] = gmap[p * (x-1) + y];
-                }
+        /* GD_DOWN (solid pixels) and GD_UP (non-solid pixels) */
+        if(y == 0) {
+            for(int x = 0; x < w; x++) {
+                d[x] = 0;
+                u[x] = 0;
             }
-            break;
-
-        /* the ground is upwards */
-        case GD_UP:
-            p = MASK_ALIGN(mask->width);
-            gmap = mallocx((p * h) * sizeof(*gmap));
-            for(x = 0; x < w; x++) {
-                if(collisionmask_at(mask, x, h-1, pitch))
-                    gmap[p * (h-1) + x] = h-1;
-                for(y = h-2; y >= 0; y--) {
-                    if(collisionmask_at(mask, x, y, pitch)) {
-                        if(collisionmask_at(mask, x, y+1, pitch))
-                            gmap[p * y + x] = gmap[p * (y+1) + x];
-                        else
-                            gmap[p * y + x] = y;
-                    }
-                }
-                if(!collisionmask_at(mask, x, 0, pitch))
-                    gmap[x] = 0;
-                for(y = 1; y < h; y++) {
-                    if(!collisionmask_at(mask, x, y, pitch))
-                        gmap[p * y + x] = gmap[p * (y-1) + x];
-                }
+        }
+        else {
+            for(int x = 0; x < w; x++) {
+                d[x] = (m[x] && m_above[x]) ? d[x - p] : y;
+                u[x] = m[x] ? y : (m_above[x] ? y-1 : u[x - p]);
             }
-            break;
+        }
 
-        /* the ground is "to the right" */
-        case GD_RIGHT:
-            p = MASK_ALIGN(mask->height);
-            gmap = mallocx((p * w) * sizeof(*gmap));
-            for(y = 0; y < h; y++) {
-                if(collisionmask_at(mask, 0, y, pitch))
-                    gmap[y] = 0;
-                for(x = 1; x < w; x++) {
-                    if(collisionmask_at(mask, x, y, pitch)) {
-                        if(collisionmask_at(mask, x-1, y, pitch))
-                            gmap[p * x + y] = gmap[p * (x-1) + y];
-                        else
-                            gmap[p * x + y] = x;
-                    }
-                }
-                if(!collisionmask_at(mask, w-1, y, pitch))
-                    gmap[p * (w-1) + y] = w-1;
-                for(x = w-2; x >=0; x--) {
-                    if(!collisionmask_at(mask, x, y, pitch))
-                        gmap[p * x + y] = gmap[p * (x+1) + y];
-                }
+        /* GD_RIGHT */
+        row_right[0] = 0;
+        for(int x = 1; x < w; x++) {
+            if(m[x])
+                row_right[x] = m[x-1] ? row_right[x-1] : x;
+        }
+        if(!m[w-1])
+            row_right[w-1] = w-1;
+        for(int x = w-2; x >= 0; x--) {
+            if(!m[x])
+                row_right[x] = row_right[x+1];
+        }
+
+        /* GD_LEFT */
+        row_left[w-1] = w-1;
+        for(int x = w-2; x >= 0; x--) {
+            if(m[x])
+                row_left[x] = m[x+1] ? row_left[x+1] : x;
+        }
+        if(!m[0])
+            row_left[0] = 0;
+        for(int x = 1; x < w; x++) {
+            if(!m[x])
+                row_left[x] = row_left[x-1];
+        }
+
+        /* GD_LEFT and GD_RIGHT are stored column-wise */
+        for(int x = 0; x < w; x++) {
+            left[q * x + y] = row_left[x];
+            right[q * x + y] = row_right[x];
+        }
+    }
+
+    /* bottom to top: GD_DOWN (non-solid pixels) and GD_UP (solid pixels) */
+    for(int y = h-1; y >= 0; y--) {
+        const uint8_t* m = mask->mask + y * pitch;
+        const uint8_t* m_below = m + pitch; /* valid if y < h-1 */
+        uint16_t* d = down + y * p;
+        uint16_t* u = up + y * p;
+
+        if(y == h-1) {
+            for(int x = 0; x < w; x++) {
+                if(!m[x])
+                    d[x] = y;
+                else
+                    u[x] = y;
+            }
+        }
+        else {
+            for(int x = 0; x < w; x++) {
+                if(!m[x])
+                    d[x] = d[x + p];
+                else
+                    u[x] = m_below[x] ? u[x + p] : y;
             }
-            break;
+        }
     }
 
     /* done */
-    return gmap;
+    free(row_right);
+    free(row_left);
+
+    mask->integral_mask = integral_mask;
+    mask->gmap[0] = down;
+    mask->gmap[1] = left;
+    mask->gmap[2] = up;
+    mask->gmap[3] = right;
 }
 
 /* Destroys an existing ground map */
@@ -663,91 +908,319 @@ uint16_t* destroy_groundmap(uint16_t* gmap)
     return NULL;
 }
 
-/* Clones an existing ground map */
-uint16_t* clone_groundmap(uint16_t* gmap, int width, int height, grounddir_t ground_direction)
+
+
+
+/*
+ * ground profiles
+ */
+
+
+/* Creates the ground profiles of an unpacked mask */
+void create_profiles(collisionmask_t* mask)
+{
+    mask->profile[GD_DOWN] = create_profile(mask, GD_DOWN);
+    mask->profile[GD_RIGHT] = create_profile(mask, GD_RIGHT);
+    mask->profile[GD_UP] = create_profile(mask, GD_UP);
+    mask->profile[GD_LEFT] = create_profile(mask, GD_LEFT);
+}
+
+/* Destroys the ground profiles of a mask */
+void destroy_profiles(collisionmask_t* mask)
+{
+    for(int i = 0; i < 4; i++) {
+        free(mask->profile[i]);
+        mask->profile[i] = NULL;
+    }
+}
+
+/*
+ * Creates a ground profile, or returns NULL if the mask isn't plain.
+ *
+ * Considering GD_DOWN, a mask is plain if the solid pixels of each of its
+ * columns form a single run that ends at the bottom of the mask, as in a
+ * regular floor. The ground position of any pixel of such a column is the
+ * top of the run, or h-1 if the column is empty. This matches the ground
+ * map. The other directions are analogous.
+ */
+uint16_t* create_profile(const collisionmask_t* mask, grounddir_t ground_direction)
+{
+    bool is_vertical = (ground_direction == GD_DOWN || ground_direction == GD_UP);
+    int length = is_vertical ? mask->width : mask->height; /* number of lines */
+    int depth = is_vertical ? mask->height : mask->width; /* number of pixels per line */
+    int pitch = mask->pitch;
+    uint16_t* profile = mallocx(length * sizeof(*profile));
+
+    for(int i = 0; i < length; i++) {
+        int edge = -1; /* the first solid pixel, scanning the line towards the ground */
+        bool is_plain = true;
+
+        for(int j = 0; j < depth; j++) {
+            int k = (ground_direction == GD_DOWN || ground_direction == GD_RIGHT) ? j : (depth - 1 - j);
+            bool solid = is_vertical ? collisionmask_at(mask, i, k, pitch) : collisionmask_at(mask, k, i, pitch);
+
+            if(solid && edge < 0)
+                edge = k;
+            else if(!solid && edge >= 0) {
+                is_plain = false; /* a hole or a run that doesn't reach the border */
+                break;
+            }
+        }
+
+        if(!is_plain) {
+            free(profile);
+            return NULL;
+        }
+        else if(edge < 0)
+            profile[i] = (ground_direction == GD_DOWN || ground_direction == GD_RIGHT) ? depth - 1 : 0; /* empty line */
+        else
+            profile[i] = edge;
+    }
+
+    return profile;
+}
+
+/* memory used by the ground profiles of a mask */
+size_t profile_size(const collisionmask_t* mask)
 {
-    uint16_t* clone = NULL;
     size_t size = 0;
-    int pitch = 0;
 
-    switch(ground_direction)
-    {
+    if(mask->profile[GD_DOWN] != NULL)
+        size += mask->width * sizeof(uint16_t);
+    if(mask->profile[GD_UP] != NULL)
+        size += mask->width * sizeof(uint16_t);
+    if(mask->profile[GD_RIGHT] != NULL)
+        size += mask->height * sizeof(uint16_t);
+    if(mask->profile[GD_LEFT] != NULL)
+        size += mask->height * sizeof(uint16_t);
+
+    return size;
+}
+
+
+
+
+/*
+ * Integral masks
+ */
+
+/* Destroys an integral mask */
+uint32_t* destroy_integral_mask(uint32_t* integral_mask)
+{
+    if(integral_mask != NULL)
+        free(integral_mask);
+
+    return NULL;
+}
+
+
+
+
+/*
+ * Packed masks
+ */
+
+/* count trailing / leading zeros of a non-zero 64-bit word */
+#if defined(__GNUC__)
+#define ctz64(word) __builtin_ctzll(word)
+#define clz64(word) __builtin_clzll(word)
+#else
+static inline int ctz64(uint64_t word) { int n = 0; while(!(word & 1)) { word >>= 1; n++; } return n; }
+static inline int clz64(uint64_t word) { int n = 0; while(!(word & UINT64_C(0x8000000000000000))) { word <<= 1; n++; } return n; }
+#endif
+
+/* Packs the data of an unpacked collision mask (without its integral mask
+   and ground maps) and releases the unpacked data */
+void pack_mask(collisionmask_t* mask)
+{
+    int w = mask->width, h = mask->height;
+    int pitch = mask->pitch;
+
+    mask->words_per_row = (w + 63) / 64;
+    mask->words_per_col = (h + 63) / 64;
+    mask->packed_rows = mallocx((mask->words_per_row * h) * sizeof(*(mask->packed_rows)));
+    mask->packed_cols = mallocx((mask->words_per_col * w) * sizeof(*(mask->packed_cols)));
+    memset(mask->packed_rows, 0, (mask->words_per_row * h) * sizeof(*(mask->packed_rows)));
+    memset(mask->packed_cols, 0, (mask->words_per_col * w) * sizeof(*(mask->packed_cols)));
+
+    for(int y = 0; y < h; y++) {
+        for(int x = 0; x < w; x++) {
+            if(collisionmask_at(mask, x, y, pitch)) {
+                mask->packed_rows[y * mask->words_per_row + (x >> 6)] |= UINT64_C(1) << (x & 63);
+                mask->packed_cols[x * mask->words_per_col + (y >> 6)] |= UINT64_C(1) << (y & 63);
+            }
+        }
+    }
+
+    /* release the unpacked data */
+    free(mask->mask);
+    mask->mask = NULL;
+    mask->pitch = 0;
+    mask->integral_mask = NULL;
+    for(int i = 0; i < 4; i++)
+        mask->gmap[i] = NULL;
+}
+
+/* pixel test of a packed mask with no boundary checking */
+bool packed_pixel_test(const collisionmask_t* mask, int x, int y)
+{
+    return (mask->packed_rows[y * mask->words_per_row + (x >> 6)] >> (x & 63)) & 1;
+}
+
+/* area test of a packed mask. The rectangle is assumed to be within the mask */
+bool packed_area_test(const collisionmask_t* mask, int left, int top, int right, int bottom)
+{
+    /* sensors are vertical or horizontal lines: scan the shortest
+       direction and test 64 pixels at a time in the other one */
+    if(right - left <= bottom - top) {
+        for(int x = left; x <= right; x++) {
+            if(any_bit_in_range(mask->packed_cols + x * mask->words_per_col, top, bottom))
+                return true;
+        }
+    }
+    else {
+        for(int y = top; y <= bottom; y++) {
+            if(any_bit_in_range(mask->packed_rows + y * mask->words_per_row, left, right))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+/* locates the ground of a packed mask, producing the same results as the
+   ground maps. (x,y) is assumed to be within the mask */
+int packed_locate_ground(const collisionmask_t* mask, int x, int y, grounddir_t ground_direction)
+{
+    const uint64_t* col = mask->packed_cols + x * mask->words_per_col;
+    const uint64_t* row = mask->packed_rows + y * mask->words_per_row;
+    int w = mask->width, h = mask->height;
+    int k;
+
+    switch(ground_direction) {
         case GD_DOWN:
+            /* solid: the top of the solid run; non-solid: the first solid pixel below */
+            if(packed_pixel_test(mask, x, y))
+                return ((k = find_prev_bit(col, y, false)) >= 0) ? k + 1 : 0;
+            else
+                return ((k = find_next_bit(col, h, y, true)) >= 0) ? k : h - 1;
+
         case GD_UP:
-            pitch = MASK_ALIGN(width);
-            size = (pitch * height) * sizeof(*clone);
-            break;
+            /* solid: the bottom of the solid run; non-solid: the first solid pixel above */
+            if(packed_pixel_test(mask, x, y))
+                return ((k = find_next_bit(col, h, y, false)) >= 0) ? k - 1 : h - 1;
+            else
+                return ((k = find_prev_bit(col, y, true)) >= 0) ? k : 0;
 
         case GD_LEFT:
+            /* solid: the right end of the solid run; non-solid: the first solid pixel to the left */
+            if(packed_pixel_test(mask, x, y))
+                return ((k = find_next_bit(row, w, x, false)) >= 0) ? k - 1 : w - 1;
+            else
+                return ((k = find_prev_bit(row, x, true)) >= 0) ? k : 0;
+
         case GD_RIGHT:
-            pitch = MASK_ALIGN(height);
-            size = (pitch *  width) * sizeof(*clone);
-            break;
+            /* solid: the left end of the solid run; non-solid: the first solid pixel to the right */
+            if(packed_pixel_test(mask, x, y))
+                return ((k = find_prev_bit(row, x, false)) >= 0) ? k + 1 : 0;
+            else
+                return ((k = find_next_bit(row, w, x, true)) >= 0) ? k : w - 1;
     }
 
-    clone = mallocx(size);
-    memcpy(clone, gmap, size);
-    return clone;
+    return 0;
 }
 
+/* checks if any bit in the range [first, last] of a bit array is set */
+bool any_bit_in_range(const uint64_t* words, int first, int last)
+{
+    int first_word = first >> 6, last_word = last >> 6;
+    uint64_t first_mask = ~UINT64_C(0) << (first & 63);
+    uint64_t last_mask = ~UINT64_C(0) >> (63 - (last & 63));
 
+    if(first_word == last_word)
+        return (words[first_word] & first_mask & last_mask) != 0;
 
+    /* the words in between are tested with a single OR each */
+    uint64_t bits = (words[first_word] & first_mask) | (words[last_word] & last_mask);
+    for(int i = first_word + 1; i < last_word; i++)
+        bits |= words[i];
 
-/*
- * Integral masks
- */
+    return bits != 0;
+}
 
-/* Creates an integral mask based on a collision mask */
-uint32_t* create_integral_mask(const collisionmask_t* mask)
+/* finds the smallest index k in [first, length) of a bit array such that
+   bit k is equal to value. Returns -1 if there is no such index */
+int find_next_bit(const uint64_t* words, int length, int first, bool value)
 {
-    int width = mask->width;
-    int height = mask->height;
-    int pitch = mask->pitch;
+    uint64_t flip = value ? 0 : ~UINT64_C(0);
+    int last_word = (length - 1) >> 6;
 
-    int p = MASK_ALIGN(width + 1); /* pitch of the integral mask */
-    uint32_t* integral_mask = NULL;
-    size_t integral_mask_size = (p * (height + 1)) * sizeof(*integral_mask);
-    integral_mask = mallocx(integral_mask_size);
-
-    /* initialize the first row */
-    for(int x = 0; x <= width; x++)
-        integral_mask[x] = 0;
-
-    /* initialize the first column */
-    for(int y = 0; y <= height; y++)
-        integral_mask[y*p] = 0;
-
-    /* compute the integral mask */
-    for(int y = 1; y <= height; y++) {
-        for(int x = 1; x <= width; x++) {
-            /* will not overflow */
-            integral_mask[y*p + x] = integral_mask[y*p + (x-1)] +
-                                     (integral_mask[(y-1)*p + x] - integral_mask[(y-1)*p + (x-1)]) +
-                                     (uint32_t)(collisionmask_at(mask, x-1, y-1, pitch));
+    for(int i = first >> 6; i <= last_word; i++) {
+        uint64_t word = words[i] ^ flip;
+
+        if(i == (first >> 6))
+            word &= ~UINT64_C(0) << (first & 63);
+
+        if(word != 0) {
+            int k = (i << 6) + ctz64(word);
+            return k < length ? k : -1; /* the padding bits are zero */
         }
     }
 
-    /* done */
-    return integral_mask;
+    return -1;
 }
 
-/* Clones an integral mask */
-uint32_t* clone_integral_mask(uint32_t* integral_mask, int width, int height)
+/* finds the largest index k in [0, last] of a bit array such that bit k
+   is equal to value. Returns -1 if there is no such index */
+int find_prev_bit(const uint64_t* words, int last, bool value)
 {
-    int pitch = MASK_ALIGN(width + 1);
-    size_t clone_size = (pitch * (height + 1)) * sizeof(*integral_mask);
-    uint32_t* clone = mallocx(clone_size);
+    uint64_t flip = value ? 0 : ~UINT64_C(0);
 
-    memcpy(clone, integral_mask, clone_size);
+    for(int i = last >> 6; i >= 0; i--) {
+        uint64_t word = words[i] ^ flip;
 
-    return clone;
+        if(i == (last >> 6))
+            word &= ~UINT64_C(0) >> (63 - (last & 63));
+
+        if(word != 0)
+            return (i << 6) + (63 - clz64(word));
+    }
+
+    return -1;
 }
 
-/* Destroys an integral mask */
-uint32_t* destroy_integral_mask(uint32_t* integral_mask)
+/* memory used by an unpacked mask: mask data, integral mask and ground maps */
+size_t unpacked_size(int width, int height)
 {
-    if(integral_mask != NULL)
-        free(integral_mask);
+    return (size_t)width * height * sizeof(uint8_t) +
+           (size_t)(width + 1) * (height + 1) * sizeof(uint32_t) +
+           (size_t)width * height * sizeof(uint16_t) * 4;
+}
 
-    return NULL;
-}
\ No newline at end of file
+/* memory used by a collision mask */
+int64_t memory_usage(const collisionmask_t* mask)
+{
+    size_t size = (mask->packed_rows != NULL) ? packed_size(mask->width, mask->height) : unpacked_size(mask->width, mask->height);
+    return (int64_t)(size + profile_size(mask) + sizeof(*mask));
+}
+
+/* memory used by a packed mask */
+size_t packed_size(int width, int height)
+{
+    return (size_t)((width + 63) / 64) * height * sizeof(uint64_t) +
+           (size_t)((height + 63) / 64) * width * sizeof(uint64_t);
+}
+
+/* computes the key of a collision mask in the cache. Returns false if the
+   mask can't be cached, i.e., if the image doesn't come from a file */
+bool make_key(char* key, const image_t* image, int x, int y, int width, int height, int flags)
+{
+    const char* path = image_filepath(image);
+    int length;
+
+    if(*path == '\0')
+        return false;
+
+    length = snprintf(key, MASK_KEY_MAXLEN, "%d,%d,%d,%d,%d:%s", x, y, width, height, flags, path);
+    return length > 0 && length < MASK_KEY_MAXLEN;
+}
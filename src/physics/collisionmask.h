@@ -31,7 +31,8 @@ typedef struct collisionmask_t collisionmask_t;
 
 /* collision mask flags */
 enum {
-    CMF_CLOUDIFY = 0x1 /* make the collision mask solid only from the top */
+    CMF_CLOUDIFY = 0x1, /* make the collision mask solid only from the top */
+    CMF_PACKED = 0x2 /* store 1 bit per pixel; saves lots of memory with large masks, but tests take time proportional to their length */
 };
 
 /* create and destroy a collision mask */
@@ -40,13 +41,22 @@ collisionmask_t* collisionmask_create_box(int width, int height);
 collisionmask_t* collisionmask_destroy(collisionmask_t *mask);
 collisionmask_t* collisionmask_clone(const collisionmask_t* mask);
 
+/* create many collision masks at once, in parallel */
+typedef struct collisionmask_request_t collisionmask_request_t;
+struct collisionmask_request_t {
+    const struct image_t* image; /* must be locked */
+    int x, y, width, height; /* the rectangle of the image */
+    int flags;
+};
+void collisionmask_create_batch(const collisionmask_request_t* request, int count, collisionmask_t** out_mask);
+
 /* retrieve dimensions */
 int collisionmask_width(const collisionmask_t* mask);
 int collisionmask_height(const collisionmask_t* mask);
-int collisionmask_pitch(const collisionmask_t* mask);
+int collisionmask_pitch(const collisionmask_t* mask); /* zero if the mask is packed */
 
 /* collision checking */
-#define collisionmask_at(mask, x, y, pitch) (*(*((const uint8_t**)(mask)) + (y) * (pitch) + (x))) /* fast pixel test with no boundary checking and no (mask == NULL) checking!! */
+#define collisionmask_at(mask, x, y, pitch) (*(*((const uint8_t**)(mask)) + (y) * (pitch) + (x))) /* fast pixel test with no boundary checking and no (mask == NULL) checking!! not for packed masks */
 bool collisionmask_pixel_test(const collisionmask_t* mask, int x, int y); /* slower pixel test with boundary checking */
 bool collisionmask_area_test(const collisionmask_t* mask, int left, int top, int right, int bottom); /* fast area test */
 
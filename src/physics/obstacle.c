@@ -22,6 +22,7 @@
 #include "obstacle.h"
 #include "collisionmask.h"
 #include "../util/util.h"
+#include "../util/arena.h"
 
 /* obstacle struct */
 struct obstacle_t
@@ -38,8 +39,12 @@ struct obstacle_t
 
     void (*dtor)(void*); /* optional destructor */
     void *dtor_userdata;
+
+    bool is_in_arena; /* is the memory owned by an arena? */
 };
 
+static obstacle_t* init_obstacle(obstacle_t* o, const collisionmask_t* mask, point2d_t position, obstaclelayer_t layer, int flags, void (*dtor)(void*), void *dtor_userdata);
+
 /* FLIP macro: x, y are input/output parameters */
 #define FLIP(obstacle, x, y) do { \
     if((obstacle)->flags & OF_HFLIP) \
@@ -60,20 +65,18 @@ obstacle_t* obstacle_create_ex(const collisionmask_t* mask, point2d_t position,
 {
     obstacle_t *o = mallocx(sizeof *o);
 
-    o->position = position;
-
-    o->layer = layer;
-    o->flags = flags;
+    init_obstacle(o, mask, position, layer, flags, dtor, dtor_userdata);
+    o->is_in_arena = false;
 
-    o->mask = mask;
-    o->width = collisionmask_width(mask);
-    o->height = collisionmask_height(mask);
+    return o;
+}
 
-    o->dtor = dtor;
-    o->dtor_userdata = dtor_userdata;
+obstacle_t* obstacle_create_in_arena(arena_t* arena, const collisionmask_t* mask, point2d_t position, obstaclelayer_t layer, int flags, void (*dtor)(void*), void *dtor_userdata)
+{
+    obstacle_t *o = arena_alloc(arena, sizeof *o);
 
-    if(o->mask == NULL || o->width == 0 || o->height == 0)
-        fatal_error("Obstacle with no mask / zero area"); /* this must never happen */
+    init_obstacle(o, mask, position, layer, flags, dtor, dtor_userdata);
+    o->is_in_arena = true;
 
     return o;
 }
@@ -83,7 +86,10 @@ obstacle_t* obstacle_destroy(obstacle_t *obstacle)
     if(obstacle->dtor != NULL)
         obstacle->dtor(obstacle->dtor_userdata);
 
-    free(obstacle);
+    /* obstacles stored in an arena are released when the arena is reset */
+    if(!obstacle->is_in_arena)
+        free(obstacle);
+
     return NULL;
 }
 
@@ -224,7 +230,10 @@ bool obstacle_got_collision(const obstacle_t *obstacle, int x1, int y1, int x2,
             int _y = y1 - o_y1;
 
             FLIP(obstacle, _x, _y);
-            return collisionmask_at(mask, _x, _y, pitch) != 0;
+            if(pitch > 0)
+                return collisionmask_at(mask, _x, _y, pitch) != 0;
+            else
+                return collisionmask_pixel_test(mask, _x, _y); /* packed mask */
         }
     }
 
@@ -236,4 +245,27 @@ bool obstacle_got_collision(const obstacle_t *obstacle, int x1, int y1, int x2,
 bool obstacle_point_collision(const obstacle_t *obstacle, point2d_t point)
 {
     return obstacle_got_collision(obstacle, point.x, point.y, point.x, point.y);
-}
\ No newline at end of file
+}
+
+
+
+/* private */
+obstacle_t* init_obstacle(obstacle_t* o, const collisionmask_t* mask, point2d_t position, obstaclelayer_t layer, int flags, void (*dtor)(void*), void *dtor_userdata)
+{
+    o->position = position;
+
+    o->layer = layer;
+    o->flags = flags;
+
+    o->mask = mask;
+    o->width = collisionmask_width(mask);
+    o->height = collisionmask_height(mask);
+
+    o->dtor = dtor;
+    o->dtor_userdata = dtor_userdata;
+
+    if(o->mask == NULL || o->width == 0 || o->height == 0)
+        fatal_error("Obstacle with no mask / zero area"); /* this must never happen */
+
+    return o;
+}
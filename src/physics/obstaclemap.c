@@ -29,13 +29,30 @@
 
 An obstacle map is a set of obstacles
 
-Obstacles are placed in buckets distributed throughout the x-axis for efficient
-access. Any particular obstacle may be placed in one or more buckets, depending
-on its size. Buckets have fixed length. They are used to partition space. When
-detecting collisions, we just inspect the obstacles of the relevant buckets.
+Obstacles are placed in buckets for efficient access. Buckets are the cells of
+a uniform grid that partitions space. Any particular obstacle may be placed in
+one or more buckets, depending on its size. When detecting collisions, we just
+inspect the obstacles of the relevant buckets.
+
+The size of the cells is picked whenever we partition space, based on the
+density of the obstacles. A two-dimensional grid keeps bucket usage sensible
+even if the obstacles are spread over distinct clusters (e.g., with multiple
+players or split cameras), in which case a partition of the x-axis alone would
+gather unrelated obstacles in the same buckets.
+
+There are two sets of partitions: one for persistent obstacles and another one
+for transient obstacles. Transient obstacles are added on every frame. Persistent
+obstacles are kept across frames, and their partitions are rebuilt only when the
+set of persistent obstacles changes. Persistent obstacles must not move.
+
+Each set has one partition per obstacle layer. A query with a layer filter only
+visits the partitions of the default layer and of the filtered layer, so we
+don't spend time rejecting the obstacles of the other layers one by one. This
+matters in levels with many loops and layer switchers.
 
 */
-struct obstaclemap_t
+typedef struct obstaclepartition_t obstaclepartition_t;
+struct obstaclepartition_t
 {
     /* obstacles */
     DARRAY(const obstacle_t*, obstacle);
@@ -46,14 +63,17 @@ struct obstaclemap_t
     /* cumulative sum of helper.bucket_count[] */
     DARRAY(int, bucket_start);
 
-    /* number of buckets */
+    /* number of buckets; bucket (col, row) has index row * number_of_columns + col */
     int number_of_buckets;
+    int number_of_columns;
+    int number_of_rows;
 
-    /* min limit of the obstacle map in the x-axis */
-    int min_x;
+    /* width and height of a bucket, in pixels */
+    int bucket_length;
 
-    /* the obstacle map will be locked once we partition space */
-    bool is_locked;
+    /* min limits of the partition */
+    int min_x;
+    int min_y;
 
     /* helpers for the partitioning scheme with Counting Sort */
     struct {
@@ -70,27 +90,50 @@ struct obstaclemap_t
     } helper;
 };
 
+#define NUMBER_OF_LAYERS 3 /* OL_DEFAULT, OL_GREEN, OL_YELLOW */
+#define MAX_PARTITIONS_PER_QUERY (2 * NUMBER_OF_LAYERS)
+
+struct obstaclemap_t
+{
+    /* obstacles that are kept across frames, indexed by obstaclelayer_t */
+    obstaclepartition_t persistent[NUMBER_OF_LAYERS];
+
+    /* obstacles that are added on every frame, indexed by obstaclelayer_t */
+    obstaclepartition_t transient[NUMBER_OF_LAYERS];
+
+    /* do we need to rebuild the partitions of the persistent obstacles? */
+    bool is_persistent_dirty[NUMBER_OF_LAYERS];
+
+    /* the obstacle map will be locked once we partition space */
+    bool is_locked;
+};
+
 /*
 
 The length of a bucket, in pixels
 
-If you pick a number that is too large, the performance of the partitioning
-scheme will be no better than that of brute force, because most or all
-obstacles will be placed in the same bucket.
+If the buckets are too large, the performance of the partitioning scheme will
+be no better than that of brute force, because most or all obstacles will be
+placed in the same bucket.
 
-If you pick a number that is too small, obstacles will be repeated throughout
-the buckets and we'll be inspecting them over and over again when detecting
-collisions. The number of buckets will increase, and it should not exceed the
-number of obstacles "too much" because of our building routine which relies on
-Counting Sort, O(n+b). For example, the width of a typical sensor is too small.
+If the buckets are too small, obstacles will be repeated throughout the buckets
+and we'll be inspecting them over and over again when detecting collisions. The
+number of buckets will increase, and it should not exceed the number of
+obstacles "too much" because of our building routine which relies on Counting
+Sort, O(n+b). For example, the width of a typical sensor is too small.
 
-I pick a reasonable size for a brick. That leads to a sensible partition and to
-increased performance. It's a good idea to experiment with different values and
-see the number of iterations performed by the collision detection routine, as
-well as the number of buckets required by the partition.
+We pick the side of a square that holds, on average, OBSTACLES_PER_BUCKET
+obstacles of the bounding box of the partition, and then clip it. The minimum
+is a reasonable size for a brick. The old fixed length of 64 pixels along the
+x-axis led to a huge speedup compared to brute force. It's a good idea to
+experiment with different values and see the number of iterations performed by
+the collision detection routine, as well as the number of buckets required by
+the partition (see WANT_PERFORMANCE_REPORT).
 
 */
-static const int BUCKET_LENGTH = 64; /* leads to a huge speedup compared to brute force (the actual factor also depends on the number of incoming obstacles, which depends on the settings of the Brick Manager) */
+static const int MIN_BUCKET_LENGTH = 64;
+static const int MAX_BUCKET_LENGTH = 1024;
+static const double OBSTACLES_PER_BUCKET = 2.0;
 #define WANT_PERFORMANCE_REPORT 0 /* for testing only */
 
 /*
@@ -99,30 +142,32 @@ Maximum number of buckets
 
 The number of buckets at any given time is expected to be small and should not
 exceed "too much" the number of obstacles. A maximum number of buckets is set
-to limit memory usage and processing time.
+to limit memory usage and processing time. If the grid would need more buckets,
+we increase their length.
 
-The present method may not work as efficiently with disjoint and distant Region
-of Interests (i.e., distinct clusters of objects), because many buckets will
-end up empty and the algorithm will not give special treatment to such a sparse
-setting. At the time of this writing, this is never the case: we stick to a
-single rectangular ROI. Still, I'm documenting this for future reference.
-
-Even with a sparse setting, the algorithm will perform better than simple brute
-force. If we pick a large enough MAX_ROI_WIDTH that takes into account all
-disjoint ROIs, but not too large so that MAX_BUCKETS explodes (relative to the
-typical number of obstacles), we'll still get good performance, despite the
-sparsity.
+With disjoint and distant Regions of Interest (i.e., distinct clusters of
+objects), many buckets will end up empty. Empty buckets cost O(1) each when
+building the partition and nothing when detecting collisions, since a query
+only inspects the buckets it overlaps.
 
 */
-static const int MAX_ROI_WIDTH = 16384; /* far beyond what's needed */
-static const int MAX_BUCKETS = MAX_ROI_WIDTH / BUCKET_LENGTH;
+static const int MAX_BUCKETS = 4096;
 
 /* private stuff */
 static const int WORLD_LIMIT = LARGE_INT;
 static const obstacle_t* pick_best_obstacle(const obstacle_t *a, const obstacle_t *b, int x1, int y1, int x2, int y2, movmode_t mm);
-static inline bool ignore_obstacle(const obstacle_t *obstacle, obstaclelayer_t layer_filter);
-static bool find_partition_limits(const obstaclemap_t* obstaclemap, int x1, int x2, int* begin, int* end);
+static int pick_partitions(const obstaclemap_t* obstaclemap, obstaclelayer_t layer_filter, const obstaclepartition_t** partition);
+static inline int layer_index(const obstacle_t* obstacle);
+static bool find_partition_limits(const obstaclepartition_t* partition, int x1, int y1, int x2, int y2, int* first_col, int* last_col, int* first_row, int* last_row);
+static void init_partition(obstaclepartition_t* partition);
+static void release_partition(obstaclepartition_t* partition);
+static void clear_partition(obstaclepartition_t* partition);
+static void add_to_partition(obstaclepartition_t* partition, const obstacle_t* obstacle);
+static void build_partition(obstaclepartition_t* partition);
+static int pick_bucket_length(const obstaclepartition_t* partition, int width, int height);
+static inline bool is_valid_query(const obstaclequery_t* query);
 static const obstacle_t* pick_tallest_ground(const obstacle_t* a, const obstacle_t* b, int x1, int y1, int x2, int y2, grounddir_t ground_direction, int* out_gnd);
+static inline int segment_offset(int delta, int i, int steps);
 
 
 
@@ -141,18 +186,14 @@ obstaclemap_t* obstaclemap_create()
 {
     obstaclemap_t *obstaclemap = mallocx(sizeof *obstaclemap);
 
-    darray_init(obstaclemap->obstacle);
-    darray_init(obstaclemap->sorted_obstacle);
-    darray_init_ex(obstaclemap->bucket_start, MAX_BUCKETS + 1);
+    for(int l = 0; l < NUMBER_OF_LAYERS; l++) {
+        init_partition(&obstaclemap->persistent[l]);
+        init_partition(&obstaclemap->transient[l]);
+        obstaclemap->is_persistent_dirty[l] = false;
+    }
 
-    obstaclemap->number_of_buckets = 0;
-    obstaclemap->min_x = WORLD_LIMIT;
     obstaclemap->is_locked = false;
 
-    darray_init(obstaclemap->helper.obstacle_index);
-    darray_init(obstaclemap->helper.bucket_index);
-    darray_init_ex(obstaclemap->helper.bucket_count, MAX_BUCKETS);
-
     return obstaclemap;
 }
 
@@ -162,13 +203,10 @@ obstaclemap_t* obstaclemap_create()
  */
 obstaclemap_t* obstaclemap_destroy(obstaclemap_t *obstaclemap)
 {
-    darray_release(obstaclemap->helper.bucket_count);
-    darray_release(obstaclemap->helper.bucket_index);
-    darray_release(obstaclemap->helper.obstacle_index);
-
-    darray_release(obstaclemap->bucket_start);
-    darray_release(obstaclemap->sorted_obstacle);
-    darray_release(obstaclemap->obstacle);
+    for(int l = NUMBER_OF_LAYERS - 1; l >= 0; l--) {
+        release_partition(&obstaclemap->transient[l]);
+        release_partition(&obstaclemap->persistent[l]);
+    }
 
     free(obstaclemap);
     return NULL;
@@ -176,7 +214,7 @@ obstaclemap_t* obstaclemap_destroy(obstaclemap_t *obstaclemap)
 
 /*
  * obstaclemap_add()
- * Adds an obstacle to the obstacle map
+ * Adds a transient obstacle to the obstacle map
  */
 void obstaclemap_add(obstaclemap_t *obstaclemap, const obstacle_t *obstacle)
 {
@@ -187,31 +225,55 @@ void obstaclemap_add(obstaclemap_t *obstaclemap, const obstacle_t *obstacle)
     }
 
     /* store the obstacle */
-    darray_push(obstaclemap->obstacle, obstacle);
+    add_to_partition(&obstaclemap->transient[layer_index(obstacle)], obstacle);
+}
+
+/*
+ * obstaclemap_add_persistent()
+ * Adds a persistent obstacle to the obstacle map
+ */
+void obstaclemap_add_persistent(obstaclemap_t *obstaclemap, const obstacle_t *obstacle)
+{
+    /* can't add if locked */
+    if(obstaclemap->is_locked) {
+        fatal_error("Obstacle map is locked");
+        return;
+    }
 
-    /* update limit */
-    int min_x = obstacle_get_position(obstacle).x;
-    if(min_x < obstaclemap->min_x)
-        obstaclemap->min_x = min_x;
+    /* store the obstacle */
+    int l = layer_index(obstacle);
+    add_to_partition(&obstaclemap->persistent[l], obstacle);
+    obstaclemap->is_persistent_dirty[l] = true;
 }
 
 /*
  * obstaclemap_clear()
- * Removes all obstacles from the obstacle map
+ * Removes all transient obstacles from the obstacle map
  */
 void obstaclemap_clear(obstaclemap_t* obstaclemap)
 {
-    darray_clear(obstaclemap->obstacle);
-    darray_clear(obstaclemap->sorted_obstacle);
-    darray_clear(obstaclemap->bucket_start);
+    for(int l = 0; l < NUMBER_OF_LAYERS; l++)
+        clear_partition(&obstaclemap->transient[l]);
 
-    obstaclemap->number_of_buckets = 0;
-    obstaclemap->min_x = WORLD_LIMIT;
     obstaclemap->is_locked = false; /* unlock */
+}
+
+/*
+ * obstaclemap_clear_persistent()
+ * Removes all persistent obstacles from the obstacle map
+ */
+void obstaclemap_clear_persistent(obstaclemap_t* obstaclemap)
+{
+    /* can't remove if locked */
+    if(obstaclemap->is_locked) {
+        fatal_error("Obstacle map is locked");
+        return;
+    }
 
-    darray_clear(obstaclemap->helper.obstacle_index);
-    darray_clear(obstaclemap->helper.bucket_index);
-    darray_clear(obstaclemap->helper.bucket_count);
+    for(int l = 0; l < NUMBER_OF_LAYERS; l++) {
+        clear_partition(&obstaclemap->persistent[l]);
+        obstaclemap->is_persistent_dirty[l] = true;
+    }
 }
 
 /*
@@ -220,88 +282,20 @@ void obstaclemap_clear(obstaclemap_t* obstaclemap)
  */
 void obstaclemap_build(obstaclemap_t* obstaclemap)
 {
-    /*
+    for(int l = 0; l < NUMBER_OF_LAYERS; l++) {
 
-    We sort obstacles by increasing bucket index and in linear time using
-    Counting Sort. This routine must be fast, as it runs on every frame.
-
-    */
-    int number_of_buckets = 0;
-    int min_x = obstaclemap->min_x;
-
-    /* quickly clear the arrays, just to be sure */
-    darray_clear(obstaclemap->sorted_obstacle);
-    darray_clear(obstaclemap->bucket_start);
-    darray_clear(obstaclemap->helper.obstacle_index);
-    darray_clear(obstaclemap->helper.bucket_index);
-    darray_clear(obstaclemap->helper.bucket_count);
-
-    /* for each obstacle j, normalize its x-position and find all relevant buckets */
-    for(int j = 0; j < darray_length(obstaclemap->obstacle); j++) {
-        const obstacle_t* obstacle = obstaclemap->obstacle[j];
-        int x = obstacle_get_position(obstacle).x;
-        int width = obstacle_get_width(obstacle);
-
-        int normalized_x1 = x - min_x; /* never negative because min_x <= x */
-        int normalized_x2 = (x + width - 1) - min_x; /* width >= 1 */
-
-        int first_bucket = normalized_x1 / BUCKET_LENGTH;
-        int last_bucket = normalized_x2 / BUCKET_LENGTH;
-
-        /* checks and balances, just to be safe
-           we should never need this for a typical Region of Interest */
-        if(last_bucket > MAX_BUCKETS - 1)
-            last_bucket = MAX_BUCKETS - 1;
-
-        /* update the number of buckets
-           we expect this to be a small integer
-           the initial bucket of the obstacle map is zero */
-        if(last_bucket + 1 > number_of_buckets)
-            number_of_buckets = last_bucket + 1;
-
-        /* associate obstacle j with buckets in { b | first_bucket <= b <= last_bucket } */
-        for(int b = first_bucket; b <= last_bucket; b++) {
-            darray_push(obstaclemap->helper.obstacle_index, j);
-            darray_push(obstaclemap->helper.bucket_index, b);
+        /* rebuild a persistent partition only if needed */
+        if(obstaclemap->is_persistent_dirty[l]) {
+            build_partition(&obstaclemap->persistent[l]);
+            obstaclemap->is_persistent_dirty[l] = false;
         }
-    }
 
-    /* initialize bucket_count[] with zeros */
-    for(int b = 0; b < number_of_buckets; b++)
-        darray_push(obstaclemap->helper.bucket_count, 0);
-
-    /* initialize sorted_obstacle[] */
-    for(int i = 0; i < darray_length(obstaclemap->helper.obstacle_index); i++)
-        darray_push(obstaclemap->sorted_obstacle, NULL);
-
-    /* count the number of obstacles in each bucket */
-    for(int i = 0; i < darray_length(obstaclemap->helper.bucket_index); i++) {
-        int b = obstaclemap->helper.bucket_index[i];
-        obstaclemap->helper.bucket_count[b]++;
-    }
-
-    /* compute the cumulative sum of bucket_count[] in-place
-       we no longer need the original values */
-    for(int b = 1; b < number_of_buckets; b++)
-        obstaclemap->helper.bucket_count[b] += obstaclemap->helper.bucket_count[b-1];
-
-    /* copy that cumulative sum to bucket_start[] for later use
-       we make sure that the first entry is zero for convenience */
-    darray_push(obstaclemap->bucket_start, 0);
-    for(int b = 0; b < number_of_buckets; b++)
-        darray_push(obstaclemap->bucket_start, obstaclemap->helper.bucket_count[b]);
+        /* build a transient partition */
+        build_partition(&obstaclemap->transient[l]);
 
-    /* fill sorted_obstacle[] with Counting Sort */
-    for(int i = darray_length(obstaclemap->helper.obstacle_index) - 1; i >= 0; i--) {
-        int j = obstaclemap->helper.obstacle_index[i];
-        int b = obstaclemap->helper.bucket_index[i];
-        int k = --obstaclemap->helper.bucket_count[b];
-        obstaclemap->sorted_obstacle[k] = obstaclemap->obstacle[j];
     }
 
-    /* update the number of buckets in the structure
-       and lock the obstacle map */
-    obstaclemap->number_of_buckets = number_of_buckets;
+    /* lock the obstacle map */
     obstaclemap->is_locked = true;
 }
 
@@ -318,47 +312,122 @@ const obstacle_t* obstaclemap_get_best_obstacle_at(const obstaclemap_t *obstacle
     *** This routine is highly demanded and must be fast !!! ***
     ************************************************************
     */
-    int begin, end;
+    const obstaclepartition_t* partition[MAX_PARTITIONS_PER_QUERY];
+    int number_of_partitions = pick_partitions(obstaclemap, layer_filter, partition);
     const obstacle_t *best = NULL;
+    int first_col, last_col, first_row, last_row;
 
     /* validate the input */
     if(x1 > x2 || y1 > y2)
         return NULL;
 
-    /* find the limits of the partition */
-    if(!find_partition_limits(obstaclemap, x1, x2, &begin, &end))
-        return NULL; /* invalid partition */
+    for(int p = 0; p < number_of_partitions; p++) {
+
+        /* find the limits of the partition */
+        if(!find_partition_limits(partition[p], x1, y1, x2, y2, &first_col, &last_col, &first_row, &last_row))
+            continue; /* invalid partition */
+
+        /* find the best obstacle. The buckets of a row are contiguous */
+        for(int row = first_row; row <= last_row; row++) {
+            int begin = partition[p]->bucket_start[row * partition[p]->number_of_columns + first_col];
+            int end = partition[p]->bucket_start[row * partition[p]->number_of_columns + last_col + 1];
 
-    /* find the best obstacle */
-    for(int j = begin; j < end; j++) { /* so simple and efficient!!! ;) */
-        const obstacle_t *obstacle = obstaclemap->sorted_obstacle[j];
+            for(int j = begin; j < end; j++) { /* so simple and efficient!!! ;) */
+                const obstacle_t *obstacle = partition[p]->sorted_obstacle[j];
+
+                if(obstacle_got_collision(obstacle, x1, y1, x2, y2))
+                    best = pick_best_obstacle(obstacle, best, x1, y1, x2, y2, mm);
+            }
+        }
 
-        if(!ignore_obstacle(obstacle, layer_filter) && obstacle_got_collision(obstacle, x1, y1, x2, y2))
-            best = pick_best_obstacle(obstacle, best, x1, y1, x2, y2, mm);
     }
 
     /* done! */
     return best;
 }
 
+/*
+ * obstaclemap_query_sensors()
+ * Gets the "best" obstacle that hits each sensor of a batch, given a movmode_t
+ * and a layer. The result is the same as that of obstaclemap_get_best_obstacle_at()
+ * for each query, but we look up the partition and walk the candidate obstacles
+ * only once. This is meant to be used with the sensors of a physics actor, which
+ * are close to each other. This routine assumes that the obstacle map is built
+ */
+void obstaclemap_query_sensors(const obstaclemap_t *obstaclemap, obstaclequery_t* query, int query_count, movmode_t mm, obstaclelayer_t layer_filter)
+{
+    const obstaclepartition_t* partition[MAX_PARTITIONS_PER_QUERY];
+    int number_of_partitions = pick_partitions(obstaclemap, layer_filter, partition);
+    int x1 = WORLD_LIMIT, y1 = WORLD_LIMIT, x2 = -WORLD_LIMIT, y2 = -WORLD_LIMIT;
+    int first_col, last_col, first_row, last_row;
+
+    /* find the bounding box of the valid queries */
+    for(int q = 0; q < query_count; q++) {
+        query[q].best = NULL;
+
+        if(is_valid_query(&query[q])) {
+            x1 = min(x1, query[q].x1);
+            y1 = min(y1, query[q].y1);
+            x2 = max(x2, query[q].x2);
+            y2 = max(y2, query[q].y2);
+        }
+    }
+
+    /* nothing to do */
+    if(x1 > x2 || y1 > y2)
+        return;
+
+    for(int p = 0; p < number_of_partitions; p++) {
+
+        /* find the limits of the partition */
+        if(!find_partition_limits(partition[p], x1, y1, x2, y2, &first_col, &last_col, &first_row, &last_row))
+            continue; /* invalid partition */
+
+        /* walk the candidate obstacles once and test them against each sensor */
+        for(int row = first_row; row <= last_row; row++) {
+            int begin = partition[p]->bucket_start[row * partition[p]->number_of_columns + first_col];
+            int end = partition[p]->bucket_start[row * partition[p]->number_of_columns + last_col + 1];
+
+            for(int j = begin; j < end; j++) {
+                const obstacle_t *obstacle = partition[p]->sorted_obstacle[j];
+
+                for(int q = 0; q < query_count; q++) {
+                    obstaclequery_t* s = &query[q];
+
+                    if(is_valid_query(s) && obstacle_got_collision(obstacle, s->x1, s->y1, s->x2, s->y2))
+                        s->best = pick_best_obstacle(obstacle, s->best, s->x1, s->y1, s->x2, s->y2, mm);
+                }
+            }
+        }
+
+    }
+}
+
 /*
  * obstaclemap_obstacle_exists()
  * Checks if an obstacle exists at (x,y)
  */
 bool obstaclemap_obstacle_exists(const obstaclemap_t* obstaclemap, int x, int y, obstaclelayer_t layer_filter)
 {
-    int begin, end;
+    const obstaclepartition_t* partition[MAX_PARTITIONS_PER_QUERY];
+    int number_of_partitions = pick_partitions(obstaclemap, layer_filter, partition);
+    int col, row;
 
-    /* find the limits of the partition */
-    if(!find_partition_limits(obstaclemap, x, x, &begin, &end))
-        return false; /* invalid partition */
+    for(int p = 0; p < number_of_partitions; p++) {
 
-    /* search for an obstacle */
-    for(int j = begin; j < end; j++) {
-        const obstacle_t *obstacle = obstaclemap->sorted_obstacle[j];
+        /* find the bucket */
+        if(!find_partition_limits(partition[p], x, y, x, y, &col, &col, &row, &row)) /* a single bucket */
+            continue; /* invalid partition */
+
+        /* search for an obstacle */
+        int bucket = row * partition[p]->number_of_columns + col;
+        for(int j = partition[p]->bucket_start[bucket]; j < partition[p]->bucket_start[bucket + 1]; j++) {
+            const obstacle_t *obstacle = partition[p]->sorted_obstacle[j];
+
+            if(obstacle_got_collision(obstacle, x, y, x, y))
+                return true;
+        }
 
-        if(!ignore_obstacle(obstacle, layer_filter) && obstacle_got_collision(obstacle, x, y, x, y))
-            return true;
     }
 
     /* not found */
@@ -371,24 +440,111 @@ bool obstaclemap_obstacle_exists(const obstaclemap_t* obstaclemap, int x, int y,
  */
 bool obstaclemap_solid_exists(const obstaclemap_t* obstaclemap, int x, int y, obstaclelayer_t layer_filter)
 {
-    int begin, end;
+    const obstaclepartition_t* partition[MAX_PARTITIONS_PER_QUERY];
+    int number_of_partitions = pick_partitions(obstaclemap, layer_filter, partition);
+    int col, row;
 
-    /* find the limits of the partition */
-    if(!find_partition_limits(obstaclemap, x, x, &begin, &end))
-        return false; /* invalid partition */
+    for(int p = 0; p < number_of_partitions; p++) {
 
-    /* search for a solid obstacle */
-    for(int j = begin; j < end; j++) {
-        const obstacle_t *obstacle = obstaclemap->sorted_obstacle[j];
+        /* find the bucket */
+        if(!find_partition_limits(partition[p], x, y, x, y, &col, &col, &row, &row)) /* a single bucket */
+            continue; /* invalid partition */
+
+        /* search for a solid obstacle */
+        int bucket = row * partition[p]->number_of_columns + col;
+        for(int j = partition[p]->bucket_start[bucket]; j < partition[p]->bucket_start[bucket + 1]; j++) {
+            const obstacle_t *obstacle = partition[p]->sorted_obstacle[j];
+
+            if(obstacle_got_collision(obstacle, x, y, x, y) && obstacle_is_solid(obstacle))
+                return true;
+        }
 
-        if(!ignore_obstacle(obstacle, layer_filter) && obstacle_got_collision(obstacle, x, y, x, y) && obstacle_is_solid(obstacle))
-            return true;
     }
 
     /* not found */
     return false;
 }
 
+/*
+ * obstaclemap_sweep()
+ * Walks the segment from (x1,y1) to (x2,y2), pixel by pixel, and finds the
+ * first solid obstacle it hits. Solid obstacles that already overlap (x1,y1)
+ * are ignored. (*out_x, *out_y) is set to the last point of the segment that
+ * precedes the hit, or to (x2,y2) if nothing is hit. This is meant to keep
+ * fast-moving actors from tunneling through thin obstacles. The obstacle map
+ * is assumed to be built. Returns NULL if no obstacle is hit
+ */
+const obstacle_t* obstaclemap_sweep(const obstaclemap_t *obstaclemap, int x1, int y1, int x2, int y2, obstaclelayer_t layer_filter, int* out_x, int* out_y)
+{
+    const obstaclepartition_t* partition[MAX_PARTITIONS_PER_QUERY];
+    int number_of_partitions = pick_partitions(obstaclemap, layer_filter, partition);
+    const obstacle_t *hit = NULL;
+    int first_col, last_col, first_row, last_row;
+
+    /* the segment is walked in steps of one pixel along its major axis */
+    int dx = x2 - x1, dy = y2 - y1;
+    int steps = max(abs(dx), abs(dy));
+    int first_hit = steps + 1; /* index of the first point of the segment that hits an obstacle */
+
+    /* the bounding box of the segment */
+    int bx1 = min(x1, x2), by1 = min(y1, y2);
+    int bx2 = max(x1, x2), by2 = max(y1, y2);
+
+    for(int p = 0; p < number_of_partitions; p++) {
+
+        /* find the limits of the partition */
+        if(!find_partition_limits(partition[p], bx1, by1, bx2, by2, &first_col, &last_col, &first_row, &last_row))
+            continue; /* invalid partition */
+
+        /* test the candidate obstacles against the points of the segment that
+           precede the first hit found so far */
+        for(int row = first_row; row <= last_row; row++) {
+            int begin = partition[p]->bucket_start[row * partition[p]->number_of_columns + first_col];
+            int end = partition[p]->bucket_start[row * partition[p]->number_of_columns + last_col + 1];
+
+            for(int j = begin; j < end; j++) {
+                const obstacle_t *obstacle = partition[p]->sorted_obstacle[j];
+                point2d_t position = obstacle_get_position(obstacle);
+
+                /* skip clouds */
+                if(!obstacle_is_solid(obstacle))
+                    continue;
+
+                /* skip the obstacles that are off the bounding box of the segment */
+                if(bx1 >= position.x + obstacle_get_width(obstacle) || bx2 < position.x || by1 >= position.y + obstacle_get_height(obstacle) || by2 < position.y)
+                    continue;
+
+                /* skip the obstacles that we are already in */
+                if(obstacle_got_collision(obstacle, x1, y1, x1, y1))
+                    continue;
+
+                /* find the first point of the segment that hits the obstacle */
+                for(int i = 1; i < first_hit; i++) {
+                    int x = x1 + segment_offset(dx, i, steps);
+                    int y = y1 + segment_offset(dy, i, steps);
+
+                    if(obstacle_got_collision(obstacle, x, y, x, y)) {
+                        first_hit = i;
+                        hit = obstacle;
+                        break;
+                    }
+                }
+            }
+        }
+
+    }
+
+    /* the last point before the hit */
+    int i = first_hit - 1;
+    if(out_x != NULL)
+        *out_x = x1 + segment_offset(dx, i, steps);
+    if(out_y != NULL)
+        *out_y = y1 + segment_offset(dy, i, steps);
+
+    /* done! */
+    return hit;
+}
+
 /*
  * obstaclemap_find_ground()
  * Find the tallest ground based on the specified parameters
@@ -397,23 +553,34 @@ bool obstaclemap_solid_exists(const obstaclemap_t* obstaclemap, int x, int y, ob
  */
 const obstacle_t* obstaclemap_find_ground(const obstaclemap_t *obstaclemap, int x1, int y1, int x2, int y2, obstaclelayer_t layer_filter, grounddir_t ground_direction, int* out_ground_position)
 {
-    int begin, end;
+    const obstaclepartition_t* partition[MAX_PARTITIONS_PER_QUERY];
+    int number_of_partitions = pick_partitions(obstaclemap, layer_filter, partition);
     const obstacle_t *tallest_ground = NULL;
+    int first_col, last_col, first_row, last_row;
 
     /* validate the input */
     if(x1 > x2 || y1 > y2)
         return NULL;
 
-    /* find the limits of the partition */
-    if(!find_partition_limits(obstaclemap, x1, x2, &begin, &end))
-        return NULL;
+    for(int p = 0; p < number_of_partitions; p++) {
+
+        /* find the limits of the partition */
+        if(!find_partition_limits(partition[p], x1, y1, x2, y2, &first_col, &last_col, &first_row, &last_row))
+            continue;
+
+        /* find the tallest ground. The buckets of a row are contiguous */
+        for(int row = first_row; row <= last_row; row++) {
+            int begin = partition[p]->bucket_start[row * partition[p]->number_of_columns + first_col];
+            int end = partition[p]->bucket_start[row * partition[p]->number_of_columns + last_col + 1];
 
-    /* find the tallest ground */
-    for(int j = begin; j < end; j++) {
-        const obstacle_t *obstacle = obstaclemap->sorted_obstacle[j];
+            for(int j = begin; j < end; j++) {
+                const obstacle_t *obstacle = partition[p]->sorted_obstacle[j];
+
+                if(obstacle_got_collision(obstacle, x1, y1, x2, y2))
+                    tallest_ground = pick_tallest_ground(obstacle, tallest_ground, x1, y1, x2, y2, ground_direction, out_ground_position);
+            }
+        }
 
-        if(!ignore_obstacle(obstacle, layer_filter) && obstacle_got_collision(obstacle, x1, y1, x2, y2))
-            tallest_ground = pick_tallest_ground(obstacle, tallest_ground, x1, y1, x2, y2, ground_direction, out_ground_position);
     }
 
     /* done! */
@@ -424,76 +591,117 @@ const obstacle_t* obstaclemap_find_ground(const obstaclemap_t *obstaclemap, int
 
 /* private methods */
 
-/* given an interval I = [x1,x2], find maximal indices begin and end of sorted_obstacle[] such that
-   sorted_obstacle[j] intersects with I for all j | begin <= j < end. Returns true on success. */
-bool find_partition_limits(const obstaclemap_t* obstaclemap, int x1, int x2, int* begin, int* end)
+/* given a rectangle R = [x1,x2] x [y1,y2], find the columns and the rows of the
+   buckets of the partition that intersect R, so that sorted_obstacle[j]
+   intersects R only if it's stored in one of these buckets. Returns true on success */
+bool find_partition_limits(const obstaclepartition_t* partition, int x1, int y1, int x2, int y2, int* first_col, int* last_col, int* first_row, int* last_row)
 {
-    int min_x = obstaclemap->min_x;
-    int number_of_buckets = obstaclemap->number_of_buckets;
+    int number_of_columns = partition->number_of_columns;
+    int number_of_rows = partition->number_of_rows;
+    int bucket_length = partition->bucket_length;
+
+    /* nothing to do */
+    if(partition->number_of_buckets == 0)
+        return false;
+
+    /* the rectangle is entirely out of the partition */
+    if(x2 < partition->min_x || y2 < partition->min_y)
+        return false;
 
     /* find the bucket range */
-    int normalized_x1 = x1 - min_x;
-    int normalized_x2 = x2 - min_x;
+    int normalized_x1 = x1 - partition->min_x;
+    int normalized_x2 = x2 - partition->min_x;
+    int normalized_y1 = y1 - partition->min_y;
+    int normalized_y2 = y2 - partition->min_y;
 
-    int first_bucket = normalized_x1 / BUCKET_LENGTH;
-    int last_bucket = normalized_x2 / BUCKET_LENGTH;
+    int col1 = max(0, normalized_x1) / bucket_length;
+    int col2 = normalized_x2 / bucket_length;
+    int row1 = max(0, normalized_y1) / bucket_length;
+    int row2 = normalized_y2 / bucket_length;
 
     /* clip */
-    if(first_bucket < 0)
-        first_bucket = 0;
-    if(last_bucket >= number_of_buckets)
-        last_bucket = number_of_buckets - 1;
+    if(col2 >= number_of_columns)
+        col2 = number_of_columns - 1;
+    if(row2 >= number_of_rows)
+        row2 = number_of_rows - 1;
 
     /* validate */
-    if(first_bucket > last_bucket)
-        return false; /* invalid [x1,x2] interval or number_of_buckets == 0 */
+    if(col1 > col2 || row1 > row2)
+        return false; /* invalid rectangle or out of the partition */
 
     /*
 
-    Now that we have 0 <= first_bucket <= last_bucket < number_of_buckets,
-    we find the relevant indices of sorted_obstacle[].
+    Now that we have 0 <= col1 <= col2 < number_of_columns and
+    0 <= row1 <= row2 < number_of_rows, the relevant indices of
+    sorted_obstacle[] of each row r are given by
+
+    bucket_start[r * number_of_columns + col1] <= j < bucket_start[r * number_of_columns + col2 + 1]
 
     Reminder: bucket_start[] has (number_of_buckets + 1) elements
               the first element is always zero!
 
     */
-    *begin = obstaclemap->bucket_start[first_bucket];
-    *end = obstaclemap->bucket_start[last_bucket + 1];
+    *first_col = col1;
+    *last_col = col2;
+    *first_row = row1;
+    *last_row = row2;
 
 #if WANT_PERFORMANCE_REPORT
     /*
 
     how to tune performance:
 
-    - change BUCKET_LENGTH
+    - change MIN_BUCKET_LENGTH, MAX_BUCKET_LENGTH and OBSTACLES_PER_BUCKET
     - increase the speedup and decrease the bucket ratio
     - take into account the commentary about MAX_BUCKETS above
 
+    we compare the number of iterations of the grid with those of brute force
+    and with those of a partition of the x-axis alone with the same length
+    (i.e., the scheme we used before; its buckets are the columns of the grid)
+
     */
 
-    /* number of iterations with partitioning vs brute force */
-    int partition = (*end) - (*begin);
-    int brute_force = darray_length(obstaclemap->obstacle); /* test all obstacles */
+    /* number of iterations with the grid */
+    int partition_count = 0;
+    for(int r = row1; r <= row2; r++)
+        partition_count += partition->bucket_start[r * number_of_columns + col2 + 1] - partition->bucket_start[r * number_of_columns + col1];
+
+    /* number of iterations with columns only: each obstacle is counted once per column */
+    int column_count = 0;
+    for(int j = 0; j < darray_length(partition->obstacle); j++) {
+        int x = obstacle_get_position(partition->obstacle[j]).x - partition->min_x;
+        int w = obstacle_get_width(partition->obstacle[j]);
+        int c1 = x / bucket_length, c2 = (x + w - 1) / bucket_length;
+        column_count += max(0, min(c2, col2) - max(c1, col1) + 1);
+    }
+
+    /* number of iterations with brute force: test all obstacles */
+    int brute_force = darray_length(partition->obstacle);
 
     /* compute stats */
-    float fraction = brute_force > 0 ? (float)partition / (float)brute_force : 0.0f;
-    float bucket_ratio = brute_force > 0 ? (float)number_of_buckets / (float)brute_force : 0.0f;
+    float bucket_ratio = brute_force > 0 ? (float)partition->number_of_buckets / (float)brute_force : 0.0f;
     static const float alpha = 0.99f;
-    static float smooth_fraction = 1.0f;
-    smooth_fraction = smooth_fraction * alpha + (1.0f - alpha) * fraction;
+    static float smooth_fraction = 1.0f, smooth_column_fraction = 1.0f;
+    smooth_fraction = smooth_fraction * alpha + (1.0f - alpha) * (brute_force > 0 ? (float)partition_count / (float)brute_force : 0.0f);
+    smooth_column_fraction = smooth_column_fraction * alpha + (1.0f - alpha) * (brute_force > 0 ? (float)column_count / (float)brute_force : 0.0f);
 
     /* this speedup calculation does NOT measure how efficient it is to build
        the partition, which is dependent on the number of buckets, as well as
        on the number of obstacles */
     float speedup = smooth_fraction > 0.0f ? (1.0f / smooth_fraction) : 0.0f;
+    float column_speedup = smooth_column_fraction > 0.0f ? (1.0f / smooth_column_fraction) : 0.0f;
 
     /* report on screen */
     video_showmessage(
-        "part=%d vs brute=%d | speedup=%.1fx | buckets=%d %.0f%%",
-        partition,
+        "grid=%d vs 1d=%d vs brute=%d | speedup=%.1fx vs %.1fx | buckets=%dx%d of %dpx %.0f%%",
+        partition_count,
+        column_count,
         brute_force,
         speedup,
-        number_of_buckets,
+        column_speedup,
+        number_of_columns,
+        number_of_rows,
+        bucket_length,
         100.0f * bucket_ratio
     );
 #endif
@@ -628,9 +836,237 @@ const obstacle_t* pick_tallest_ground(const obstacle_t* a, const obstacle_t* b,
     return *out_gnd == ha ? a : b;
 }
 
-/* whether or not the given obstacle should be ignored, given a layer filter */
-bool ignore_obstacle(const obstacle_t *obstacle, obstaclelayer_t layer_filter)
+/* picks the partitions visited by a query, given a layer filter: the partitions
+   of the default layer and of the filtered layer, or all partitions if there is
+   no filter. Returns the number of partitions, at most MAX_PARTITIONS_PER_QUERY */
+int pick_partitions(const obstaclemap_t* obstaclemap, obstaclelayer_t layer_filter, const obstaclepartition_t** partition)
+{
+    int n = 0;
+
+    for(int l = 0; l < NUMBER_OF_LAYERS; l++) {
+        if(layer_filter == OL_DEFAULT || l == OL_DEFAULT || l == (int)layer_filter)
+            partition[n++] = &obstaclemap->persistent[l];
+    }
+
+    for(int l = 0; l < NUMBER_OF_LAYERS; l++) {
+        if(layer_filter == OL_DEFAULT || l == OL_DEFAULT || l == (int)layer_filter)
+            partition[n++] = &obstaclemap->transient[l];
+    }
+
+    return n;
+}
+
+/* the index of the partition of an obstacle, given its layer */
+int layer_index(const obstacle_t* obstacle)
+{
+    int layer = (int)obstacle_get_layer(obstacle);
+    return (layer >= 0 && layer < NUMBER_OF_LAYERS) ? layer : OL_DEFAULT;
+}
+
+/* initializes a partition */
+void init_partition(obstaclepartition_t* partition)
+{
+    darray_init(partition->obstacle);
+    darray_init(partition->sorted_obstacle);
+    darray_init_ex(partition->bucket_start, MAX_BUCKETS + 1);
+
+    partition->number_of_buckets = 0;
+    partition->number_of_columns = 0;
+    partition->number_of_rows = 0;
+    partition->bucket_length = MIN_BUCKET_LENGTH;
+    partition->min_x = WORLD_LIMIT;
+    partition->min_y = WORLD_LIMIT;
+
+    darray_init(partition->helper.obstacle_index);
+    darray_init(partition->helper.bucket_index);
+    darray_init_ex(partition->helper.bucket_count, MAX_BUCKETS);
+}
+
+/* releases a partition */
+void release_partition(obstaclepartition_t* partition)
+{
+    darray_release(partition->helper.bucket_count);
+    darray_release(partition->helper.bucket_index);
+    darray_release(partition->helper.obstacle_index);
+
+    darray_release(partition->bucket_start);
+    darray_release(partition->sorted_obstacle);
+    darray_release(partition->obstacle);
+}
+
+/* removes all obstacles from a partition */
+void clear_partition(obstaclepartition_t* partition)
+{
+    darray_clear(partition->obstacle);
+    darray_clear(partition->sorted_obstacle);
+    darray_clear(partition->bucket_start);
+
+    partition->number_of_buckets = 0;
+    partition->number_of_columns = 0;
+    partition->number_of_rows = 0;
+    partition->min_x = WORLD_LIMIT;
+    partition->min_y = WORLD_LIMIT;
+
+    darray_clear(partition->helper.obstacle_index);
+    darray_clear(partition->helper.bucket_index);
+    darray_clear(partition->helper.bucket_count);
+}
+
+/* adds an obstacle to a partition */
+void add_to_partition(obstaclepartition_t* partition, const obstacle_t* obstacle)
+{
+    /* store the obstacle */
+    darray_push(partition->obstacle, obstacle);
+
+    /* update limits */
+    point2d_t position = obstacle_get_position(obstacle);
+    if(position.x < partition->min_x)
+        partition->min_x = position.x;
+    if(position.y < partition->min_y)
+        partition->min_y = position.y;
+}
+
+/* builds the internal data structure of a partition */
+void build_partition(obstaclepartition_t* partition)
+{
+    /*
+
+    We sort obstacles by increasing bucket index and in linear time using
+    Counting Sort. This routine must be fast, as it may run on every frame.
+
+    */
+    int number_of_obstacles = darray_length(partition->obstacle);
+    int min_x = partition->min_x;
+    int min_y = partition->min_y;
+    int width = 1, height = 1;
+
+    /* quickly clear the arrays, just to be sure */
+    darray_clear(partition->sorted_obstacle);
+    darray_clear(partition->bucket_start);
+    darray_clear(partition->helper.obstacle_index);
+    darray_clear(partition->helper.bucket_index);
+    darray_clear(partition->helper.bucket_count);
+
+    /* nothing to do */
+    if(number_of_obstacles == 0) {
+        partition->number_of_buckets = 0;
+        partition->number_of_columns = 0;
+        partition->number_of_rows = 0;
+        return;
+    }
+
+    /* find the size of the bounding box of the obstacles */
+    for(int j = 0; j < number_of_obstacles; j++) {
+        const obstacle_t* obstacle = partition->obstacle[j];
+        point2d_t position = obstacle_get_position(obstacle);
+
+        width = max(width, (position.x + obstacle_get_width(obstacle)) - min_x);
+        height = max(height, (position.y + obstacle_get_height(obstacle)) - min_y);
+    }
+
+    /* pick the length of the buckets based on the density of the obstacles */
+    int bucket_length = pick_bucket_length(partition, width, height);
+    int number_of_columns = (width - 1) / bucket_length + 1;
+    int number_of_rows = (height - 1) / bucket_length + 1;
+    int number_of_buckets = number_of_columns * number_of_rows; /* <= MAX_BUCKETS */
+
+    /* for each obstacle j, normalize its position and find all relevant buckets */
+    for(int j = 0; j < number_of_obstacles; j++) {
+        const obstacle_t* obstacle = partition->obstacle[j];
+        point2d_t position = obstacle_get_position(obstacle);
+
+        int normalized_x1 = position.x - min_x; /* never negative because min_x <= x */
+        int normalized_x2 = (position.x + obstacle_get_width(obstacle) - 1) - min_x; /* width >= 1 */
+        int normalized_y1 = position.y - min_y; /* never negative because min_y <= y */
+        int normalized_y2 = (position.y + obstacle_get_height(obstacle) - 1) - min_y; /* height >= 1 */
+
+        int first_col = normalized_x1 / bucket_length;
+        int last_col = normalized_x2 / bucket_length; /* < number_of_columns */
+        int first_row = normalized_y1 / bucket_length;
+        int last_row = normalized_y2 / bucket_length; /* < number_of_rows */
+
+        /* associate obstacle j with the buckets of the rectangle of cells */
+        for(int row = first_row; row <= last_row; row++) {
+            for(int col = first_col; col <= last_col; col++) {
+                darray_push(partition->helper.obstacle_index, j);
+                darray_push(partition->helper.bucket_index, row * number_of_columns + col);
+            }
+        }
+    }
+
+    /* initialize bucket_count[] with zeros */
+    for(int b = 0; b < number_of_buckets; b++)
+        darray_push(partition->helper.bucket_count, 0);
+
+    /* initialize sorted_obstacle[] */
+    for(int i = 0; i < darray_length(partition->helper.obstacle_index); i++)
+        darray_push(partition->sorted_obstacle, NULL);
+
+    /* count the number of obstacles in each bucket */
+    for(int i = 0; i < darray_length(partition->helper.bucket_index); i++) {
+        int b = partition->helper.bucket_index[i];
+        partition->helper.bucket_count[b]++;
+    }
+
+    /* compute the cumulative sum of bucket_count[] in-place
+       we no longer need the original values */
+    for(int b = 1; b < number_of_buckets; b++)
+        partition->helper.bucket_count[b] += partition->helper.bucket_count[b-1];
+
+    /* copy that cumulative sum to bucket_start[] for later use
+       we make sure that the first entry is zero for convenience */
+    darray_push(partition->bucket_start, 0);
+    for(int b = 0; b < number_of_buckets; b++)
+        darray_push(partition->bucket_start, partition->helper.bucket_count[b]);
+
+    /* fill sorted_obstacle[] with Counting Sort */
+    for(int i = darray_length(partition->helper.obstacle_index) - 1; i >= 0; i--) {
+        int j = partition->helper.obstacle_index[i];
+        int b = partition->helper.bucket_index[i];
+        int k = --partition->helper.bucket_count[b];
+        partition->sorted_obstacle[k] = partition->obstacle[j];
+    }
+
+    /* update the grid */
+    partition->number_of_buckets = number_of_buckets;
+    partition->number_of_columns = number_of_columns;
+    partition->number_of_rows = number_of_rows;
+    partition->bucket_length = bucket_length;
+}
+
+/* picks the length of the buckets of a partition whose obstacles fit in a
+   bounding box of the given size, so that each bucket holds a few obstacles
+   on average and the number of buckets does not exceed MAX_BUCKETS */
+int pick_bucket_length(const obstaclepartition_t* partition, int width, int height)
+{
+    int number_of_obstacles = darray_length(partition->obstacle); /* > 0 */
+    double area_per_bucket = ((double)width * (double)height) * OBSTACLES_PER_BUCKET / (double)number_of_obstacles;
+    int bucket_length = (int)ceil(sqrt(area_per_bucket));
+
+    /* clip */
+    bucket_length = clip(bucket_length, MIN_BUCKET_LENGTH, MAX_BUCKET_LENGTH);
+
+    /* limit the number of buckets */
+    while((int64_t)((width - 1) / bucket_length + 1) * (int64_t)((height - 1) / bucket_length + 1) > MAX_BUCKETS)
+        bucket_length *= 2;
+
+    /* done */
+    return bucket_length;
+}
+
+/* the offset of the i-th point, 0 <= i <= steps, of a segment of the given delta along an axis */
+int segment_offset(int delta, int i, int steps)
+{
+    if(steps == 0)
+        return 0;
+
+    /* round to the nearest integer */
+    int n = delta * i;
+    return (n >= 0) ? (n + steps / 2) / steps : -((-n + steps / 2) / steps);
+}
+
+/* checks if a query of obstaclemap_query_sensors() should look for obstacles */
+bool is_valid_query(const obstaclequery_t* query)
 {
-    obstaclelayer_t obstacle_layer = obstacle_get_layer(obstacle);
-    return layer_filter != OL_DEFAULT && obstacle_layer != OL_DEFAULT && obstacle_layer != layer_filter;
+    return query->enabled && query->x1 <= query->x2 && query->y1 <= query->y2;
 }
\ No newline at end of file
@@ -29,6 +29,11 @@
  */
 typedef struct obstaclemap_t obstaclemap_t;
 
+/*
+ * a query of a batch of sensors (see obstaclemap_query_sensors)
+ */
+typedef struct obstaclequery_t obstaclequery_t;
+
 /* forward declarations */
 struct obstacle_t;
 enum obstaclelayer_t;
@@ -40,14 +45,34 @@ obstaclemap_t* obstaclemap_create();
 obstaclemap_t* obstaclemap_destroy(obstaclemap_t *obstaclemap);
 
 /* building & clearing */
-void obstaclemap_add(obstaclemap_t *obstaclemap, const struct obstacle_t *obstacle); /* adds an obstacle to the map (you have to release it) */
+void obstaclemap_add(obstaclemap_t *obstaclemap, const struct obstacle_t *obstacle); /* adds a transient obstacle to the map (you have to release it) */
 void obstaclemap_build(obstaclemap_t* obstaclemap); /* builds the internal data structure after adding all obstacles */
-void obstaclemap_clear(obstaclemap_t* obstaclemap); /* removes all obstacles from the obstacle map */
+void obstaclemap_clear(obstaclemap_t* obstaclemap); /* removes all transient obstacles from the obstacle map */
+
+/* persistent obstacles are kept across frames; change them only after clearing
+   the obstacle map and before building it again */
+void obstaclemap_add_persistent(obstaclemap_t *obstaclemap, const struct obstacle_t *obstacle); /* adds a persistent obstacle to the map (you have to release it) */
+void obstaclemap_clear_persistent(obstaclemap_t* obstaclemap); /* removes all persistent obstacles from the obstacle map */
 
 /* collision detection */
 bool obstaclemap_obstacle_exists(const obstaclemap_t* obstaclemap, int x, int y, enum obstaclelayer_t layer_filter); /* checks if an obstacle exists at (x,y) */
 bool obstaclemap_solid_exists(const obstaclemap_t* obstaclemap, int x, int y, enum obstaclelayer_t layer_filter); /* checks if a solid obstacle exists at (x,y) */
 const struct obstacle_t* obstaclemap_get_best_obstacle_at(const obstaclemap_t *obstaclemap, int x1, int y1, int x2, int y2, enum movmode_t mm, enum obstaclelayer_t layer_filter); /* x2 > x1 && y2 > y1; NULL may be returned */
+void obstaclemap_query_sensors(const obstaclemap_t *obstaclemap, obstaclequery_t* query, int query_count, enum movmode_t mm, enum obstaclelayer_t layer_filter); /* same as obstaclemap_get_best_obstacle_at() for each query, but faster */
 const struct obstacle_t* obstaclemap_find_ground(const obstaclemap_t *obstaclemap, int x1, int y1, int x2, int y2, enum obstaclelayer_t layer_filter, enum grounddir_t ground_direction, int* out_ground_position); /* x2 > x1 && y2 > y1; returns NULL if there is no ground */
+const struct obstacle_t* obstaclemap_sweep(const obstaclemap_t *obstaclemap, int x1, int y1, int x2, int y2, enum obstaclelayer_t layer_filter, int* out_x, int* out_y); /* finds the first solid obstacle along the segment from (x1,y1) to (x2,y2); returns NULL if there is none */
+
+/* a query of a batch of sensors */
+struct obstaclequery_t
+{
+    /* input: segment of the sensor in world coordinates (x1 <= x2, y1 <= y2) */
+    int x1, y1, x2, y2;
+
+    /* input: disabled sensors do not look for obstacles */
+    bool enabled;
+
+    /* output: the best obstacle that hits the sensor (may be NULL) */
+    const struct obstacle_t* best;
+};
 
 #endif
@@ -19,6 +19,8 @@
  */
 
 #include <math.h>
+#include <stdint.h>
+#include <string.h>
 #include "physicsactor.h"
 #include "sensor.h"
 #include "obstaclemap.h"
@@ -30,8 +32,13 @@
 #include "../core/timer.h"
 #include "../core/engine.h"
 #include "../core/global.h"
+#include "../core/profiler.h"
+#include "../core/jobs.h"
+#include "../core/logfile.h"
 #include "../util/numeric.h"
+#include "../util/darray.h"
 #include "../util/util.h"
+#include <allegro5/allegro.h>
 
 typedef struct physicsactorobserverlist_t physicsactorobserverlist_t;
 
@@ -104,6 +111,8 @@ struct physicsactor_t
     obstaclelayer_t layer; /* current layer */
     input_t* input; /* input device */
     physicsactorobserverlist_t* observers; /* observers */
+    bool defer_events; /* queue the events instead of notifying the observers? */
+    DARRAY(physicsactorevent_t, deferred_event); /* events queued during a parallel step */
 
     sensor_t* A_normal; /* sensors */
     sensor_t* B_normal;
@@ -144,6 +153,43 @@ struct physicsactorobserverlist_t
 static physicsactorobserverlist_t* create_observer(void (*callback)(physicsactor_t*,physicsactorevent_t,void*), void* context, physicsactorobserverlist_t* next);
 static physicsactorobserverlist_t* destroy_observers(physicsactorobserverlist_t* list);
 static void notify_observers(physicsactor_t* pa, physicsactorevent_t event);
+static void flush_events(physicsactor_t* pa);
+
+
+/* a world of physics actors */
+struct physicsactorworld_t
+{
+    /* the actors of the world (not owned) */
+    DARRAY(physicsactor_t*, actor);
+
+    /* the state of the actors, in contiguous arrays indexed like actor[] */
+    DARRAY(v2d_t, position);
+    DARRAY(double, xsp);
+    DARRAY(double, ysp);
+    DARRAY(double, gsp);
+    DARRAY(int, angle);
+    DARRAY(movmode_t, movmode);
+    DARRAY(physicsactorstate_t, state);
+};
+
+static void sync_world(physicsactorworld_t* world);
+
+
+/* parallel simulation: the actors of a batch are stepped by the job
+   system. The obstacle map is read-only during the step and each actor
+   writes only to itself. Its events are queued and then notified in the
+   calling thread, in the order of the batch, so that the observers run
+   the game logic in the main thread as before */
+#define MIN_ACTORS_PER_BATCH 2 /* don't wake up the workers for a single actor */
+typedef struct physicsbatch_t physicsbatch_t;
+struct physicsbatch_t {
+    physicsactor_t** actor;
+    const obstaclemap_t* obstaclemap;
+    double dt;
+};
+static bool is_parallel = false;
+static void run_batch(physicsactor_t** actor, int count, const obstaclemap_t* obstaclemap, double dt);
+static void step_actors(int first, int last, void* arg);
 
 
 /* helpers */
@@ -161,6 +207,8 @@ static inline int distance_between_angle_sensors(const physicsactor_t* pa);
 static inline int delta_angle(int alpha, int beta);
 static int interpolate_angle(int alpha, int beta, float t);
 static int extrapolate_angle(int curr_angle, int prev_angle, float t);
+static inline int64_t fixed_from_int(int x);
+static inline int fixed_to_int(int64_t x);
 
 static const grounddir_t _MM_TO_GD[4] = {
     [MM_FLOOR] = GD_DOWN,
@@ -177,9 +225,12 @@ static const grounddir_t _MM_TO_GD[4] = {
 #define CLOUD_HEIGHT            16
 #define TARGET_FPS              60.0 /* target framerate of the simulation */
 #define HARD_CAPSPEED           (24.0 * TARGET_FPS)
+#define SWEEP_THRESHOLD         8.0 /* sweep the movement if it's longer than this, in pixels per step of the simulation */
 
+static void simulate(physicsactor_t *pa, const obstaclemap_t *obstaclemap, double dt);
 static void fixed_update(physicsactor_t *pa, const obstaclemap_t *obstaclemap, double dt);
 static void update_movmode(physicsactor_t* pa);
+static void move(physicsactor_t* pa, const obstaclemap_t* obstaclemap, double dx, double dy);
 static void update_sensors(physicsactor_t* pa, const obstaclemap_t* obstaclemap, obstacle_t const** const at_A, obstacle_t const** const at_B, obstacle_t const** const at_C, obstacle_t const** const at_D, obstacle_t const** const at_M, obstacle_t const** const at_N);
 
 static void handle_walls(physicsactor_t* pa, const obstaclemap_t* obstaclemap, obstacle_t const** const at_A, obstacle_t const** const at_B, obstacle_t const** const at_C, obstacle_t const** const at_D, obstacle_t const** const at_M, obstacle_t const** const at_N);
@@ -303,6 +354,46 @@ static const double cos_table[256] = {
      0.995184726672197,  0.997290456678690,  0.998795456205172,  0.999698818696204
 };
 
+/* fixed-point sine/cosine table: the values of cos_table[] in Q16 format
+   (65536 is 1.0). Integer math gives the same results on all platforms */
+#define FIXED_ONE 65536
+#define FIXED_SIN(a) fixed_cos_table[((a) + 0x40) & 0xFF]
+#define FIXED_COS(a) fixed_cos_table[(a) & 0xFF]
+static const int32_t fixed_cos_table[256] = {
+     65536,  65516,  65457,  65358,  65220,  65043,  64827,  64571,
+     64277,  63944,  63572,  63162,  62714,  62228,  61705,  61145,
+     60547,  59914,  59244,  58538,  57798,  57022,  56212,  55368,
+     54491,  53581,  52639,  51665,  50660,  49624,  48559,  47464,
+     46341,  45190,  44011,  42806,  41576,  40320,  39040,  37736,
+     36410,  35062,  33692,  32303,  30893,  29466,  28020,  26558,
+     25080,  23586,  22078,  20557,  19024,  17479,  15924,  14359,
+     12785,  11204,   9616,   8022,   6424,   4821,   3216,   1608,
+         0,  -1608,  -3216,  -4821,  -6424,  -8022,  -9616, -11204,
+    -12785, -14359, -15924, -17479, -19024, -20557, -22078, -23586,
+    -25080, -26558, -28020, -29466, -30893, -32303, -33692, -35062,
+    -36410, -37736, -39040, -40320, -41576, -42806, -44011, -45190,
+    -46341, -47464, -48559, -49624, -50660, -51665, -52639, -53581,
+    -54491, -55368, -56212, -57022, -57798, -58538, -59244, -59914,
+    -60547, -61145, -61705, -62228, -62714, -63162, -63572, -63944,
+    -64277, -64571, -64827, -65043, -65220, -65358, -65457, -65516,
+    -65536, -65516, -65457, -65358, -65220, -65043, -64827, -64571,
+    -64277, -63944, -63572, -63162, -62714, -62228, -61705, -61145,
+    -60547, -59914, -59244, -58538, -57798, -57022, -56212, -55368,
+    -54491, -53581, -52639, -51665, -50660, -49624, -48559, -47464,
+    -46341, -45190, -44011, -42806, -41576, -40320, -39040, -37736,
+    -36410, -35062, -33692, -32303, -30893, -29466, -28020, -26558,
+    -25080, -23586, -22078, -20557, -19024, -17479, -15924, -14359,
+    -12785, -11204,  -9616,  -8022,  -6424,  -4821,  -3216,  -1608,
+         0,   1608,   3216,   4821,   6424,   8022,   9616,  11204,
+     12785,  14359,  15924,  17479,  19024,  20557,  22078,  23586,
+     25080,  26558,  28020,  29466,  30893,  32303,  33692,  35062,
+     36410,  37736,  39040,  40320,  41576,  42806,  44011,  45190,
+     46341,  47464,  48559,  49624,  50660,  51665,  52639,  53581,
+     54491,  55368,  56212,  57022,  57798,  58538,  59244,  59914,
+     60547,  61145,  61705,  62228,  62714,  63162,  63572,  63944,
+     64277,  64571,  64827,  65043,  65220,  65358,  65457,  65516
+};
+
 /* slope table: stored angles */
 /* SLOPE(y,x) is the angle of the (y,x) slope, where -SLOPE_LIMIT <= y,x <= SLOPE_LIMIT */
 #define SLOPE_LIMIT 11
@@ -365,6 +456,8 @@ physicsactor_t* physicsactor_create(v2d_t position)
 
     pa->input = input_create_computer();
     pa->observers = NULL;
+    pa->defer_events = false;
+    darray_init(pa->deferred_event);
 
     pa->midair = true;
     pa->was_midair = true;
@@ -459,6 +552,7 @@ physicsactor_t* physicsactor_destroy(physicsactor_t *pa)
     sensor_destroy(pa->M_rollflatgnd);
     sensor_destroy(pa->N_rollflatgnd);
 
+    darray_release(pa->deferred_event);
     destroy_observers(pa->observers);
     input_destroy(pa->input);
     free(pa);
@@ -515,75 +609,138 @@ void physicsactor_reset_model_parameters(physicsactor_t* pa)
 
 void physicsactor_update(physicsactor_t *pa, const obstaclemap_t *obstaclemap)
 {
-    /* we run the simulation with a fixed timestep for better accuracy and consistency */
-    const double FIXED_TIMESTEP = 1.0 / TARGET_FPS;
-#if 1
-    /* advance the reference time */
-    double dt = timer_get_delta();
-    pa->reference_time += dt;
+    profiler_begin("physicsactor_update");
+    simulate(pa, obstaclemap, timer_get_delta());
+    profiler_end();
+}
 
-    /* frame skipping */
-    bool skip_frame = (pa->fixed_time > pa->reference_time);
-    if(skip_frame) {
-#if 1
-        /* Don't skip a frame, even though the engine is running faster than
-           required by the simulation. Frame skipping generates jittering.
+void physicsactor_update_batch(physicsactor_t** pa, int count, const obstaclemap_t *obstaclemap)
+{
+    profiler_begin("physicsactor_update_batch");
+    run_batch(pa, count, obstaclemap, timer_get_delta());
+    profiler_end();
+}
 
-           Suppose that the player is running at a very high speed, say 1200
-           px/s. That's 20 pixels per frame at 60 fps. If we skip a frame, the
-           player will not move by that distance in that frame, but will move
-           in the "adjacent" frames in time. A camera script, unaware of the
-           frame skipping, will catch up with the player and cause jitter.
+void physicsactor_set_parallel(bool parallel)
+{
+    is_parallel = parallel;
+}
 
-           If the target framerate of the physics simulation is equal to the
-           target framerate of the engine, then frame skipping will seldom
-           happen. It is acceptable to process an additional step of the
-           simulation instead of skipping a frame in this case. The result is
-           visually smooth. The differences in distances/speeds, compared to
-           what would be if the target framerate of the simulation was strictly
-           enforced, are negligible: proportional to a small FIXED_TIMESTEP and
-           happening only occasionally compared to the total number of frames. */
-        pa->reference_time = pa->fixed_time + FIXED_TIMESTEP * 0.5;
-#else
-        /* skip a frame if the engine is rendering more frames per second than
-           required by the simulation. If jump is first pressed, we save that
-           information and restore it when we decide not to skip a frame. */
-        pa->delayed_jump = pa->delayed_jump || input_button_pressed(pa->input, IB_FIRE1);
-    }
-    else if(pa->delayed_jump) {
-        /* simulate that the jump button is first pressed. We won't skip a frame now. */
-        input_simulate_button_press(pa->input, IB_FIRE1);
-        pa->delayed_jump = false;
-#endif
+bool physicsactor_is_parallel()
+{
+    return is_parallel;
+}
+
+physicsactorworld_t* physicsactor_world_create()
+{
+    physicsactorworld_t* world = mallocx(sizeof *world);
+
+    darray_init(world->actor);
+    darray_init(world->position);
+    darray_init(world->xsp);
+    darray_init(world->ysp);
+    darray_init(world->gsp);
+    darray_init(world->angle);
+    darray_init(world->movmode);
+    darray_init(world->state);
+
+    return world;
+}
+
+physicsactorworld_t* physicsactor_world_destroy(physicsactorworld_t* world)
+{
+    darray_release(world->state);
+    darray_release(world->movmode);
+    darray_release(world->angle);
+    darray_release(world->gsp);
+    darray_release(world->ysp);
+    darray_release(world->xsp);
+    darray_release(world->position);
+    darray_release(world->actor);
+
+    free(world);
+    return NULL;
+}
+
+void physicsactor_world_add(physicsactorworld_t* world, physicsactor_t* pa)
+{
+    /* an actor is added only once */
+    for(int i = 0; i < darray_length(world->actor); i++) {
+        if(world->actor[i] == pa)
+            return;
     }
 
-    /* run the simulation */
-    int counter = 0;
-    while(pa->fixed_time <= pa->reference_time) {
-        if(0 == counter++) {
-            /* run at most once per framestep in order to avoid jittering when
-               the engine framerate drops below TARGET_FPS. The simulation will
-               seem slower in this case. */
-            fixed_update(pa, obstaclemap, FIXED_TIMESTEP);
-        }
+    darray_push(world->actor, pa);
+    sync_world(world);
+}
 
-        /* advance the fixed time */
-        pa->fixed_time += FIXED_TIMESTEP;
+void physicsactor_world_remove(physicsactorworld_t* world, const physicsactor_t* pa)
+{
+    for(int i = 0; i < darray_length(world->actor); i++) {
+        if(world->actor[i] == pa) {
+            darray_remove(world->actor, i);
+            sync_world(world);
+            return;
+        }
     }
+}
 
-#if WANT_DEBUG
-    /* testing */
-    if(skip_frame)
-        video_showmessage("frame skip %lf", pa->reference_time);
-    else if(counter > 1)
-        video_showmessage("going slow (%d) %lf", counter, pa->reference_time);
-#endif
+void physicsactor_world_update(physicsactorworld_t* world, const obstaclemap_t *obstaclemap)
+{
+    /* the actors share the obstacle map and the delta time. Their
+       observers are notified in the main thread, in the order of the
+       world, even if the actors are stepped in parallel */
+    profiler_begin("physicsactor_world_update");
+    run_batch(world->actor, darray_length(world->actor), obstaclemap, timer_get_delta());
+    profiler_end();
 
-#else
-    /* running the simulation at most once per framestep and with no frame
-       skipping is equivalent to running the simulation once per framestep */
-    fixed_update(pa, obstaclemap, FIXED_TIMESTEP);
-#endif
+    /* store the state of the actors in contiguous arrays */
+    sync_world(world);
+}
+
+int physicsactor_world_count(const physicsactorworld_t* world)
+{
+    return darray_length(world->actor);
+}
+
+physicsactor_t* physicsactor_world_get(const physicsactorworld_t* world, int index)
+{
+    return (index >= 0 && index < darray_length(world->actor)) ? world->actor[index] : NULL;
+}
+
+const v2d_t* physicsactor_world_positions(const physicsactorworld_t* world)
+{
+    return world->position;
+}
+
+const double* physicsactor_world_xsps(const physicsactorworld_t* world)
+{
+    return world->xsp;
+}
+
+const double* physicsactor_world_ysps(const physicsactorworld_t* world)
+{
+    return world->ysp;
+}
+
+const double* physicsactor_world_gsps(const physicsactorworld_t* world)
+{
+    return world->gsp;
+}
+
+const int* physicsactor_world_angles(const physicsactorworld_t* world)
+{
+    return world->angle;
+}
+
+const movmode_t* physicsactor_world_movmodes(const physicsactorworld_t* world)
+{
+    return world->movmode;
+}
+
+const physicsactorstate_t* physicsactor_world_states(const physicsactorworld_t* world)
+{
+    return world->state;
 }
 
 void physicsactor_render_sensors(const physicsactor_t *pa, v2d_t camera_position)
@@ -1056,6 +1213,105 @@ bool physicsactor_is_standing_on_platform(const physicsactor_t *pa, const obstac
  */
 
 /* physics simulation */
+/* copies the state of the actors of the world to its contiguous arrays */
+void sync_world(physicsactorworld_t* world)
+{
+    int count = darray_length(world->actor);
+
+    darray_clear(world->position);
+    darray_clear(world->xsp);
+    darray_clear(world->ysp);
+    darray_clear(world->gsp);
+    darray_clear(world->angle);
+    darray_clear(world->movmode);
+    darray_clear(world->state);
+
+    for(int i = 0; i < count; i++) {
+        const physicsactor_t* pa = world->actor[i];
+
+        darray_push(world->position, physicsactor_get_position(pa));
+        darray_push(world->xsp, pa->xsp);
+        darray_push(world->ysp, pa->ysp);
+        darray_push(world->gsp, pa->gsp);
+        darray_push(world->angle, physicsactor_get_angle(pa));
+        darray_push(world->movmode, pa->movmode);
+        darray_push(world->state, pa->state);
+    }
+}
+
+/* advances the simulation of the physics actor by dt seconds */
+void simulate(physicsactor_t *pa, const obstaclemap_t *obstaclemap, double dt)
+{
+    /* we run the simulation with a fixed timestep for better accuracy and consistency */
+    const double FIXED_TIMESTEP = 1.0 / TARGET_FPS;
+#if 1
+    /* advance the reference time */
+    pa->reference_time += dt;
+
+    /* frame skipping */
+    bool skip_frame = (pa->fixed_time > pa->reference_time);
+    if(skip_frame) {
+#if 1
+        /* Don't skip a frame, even though the engine is running faster than
+           required by the simulation. Frame skipping generates jittering.
+
+           Suppose that the player is running at a very high speed, say 1200
+           px/s. That's 20 pixels per frame at 60 fps. If we skip a frame, the
+           player will not move by that distance in that frame, but will move
+           in the "adjacent" frames in time. A camera script, unaware of the
+           frame skipping, will catch up with the player and cause jitter.
+
+           If the target framerate of the physics simulation is equal to the
+           target framerate of the engine, then frame skipping will seldom
+           happen. It is acceptable to process an additional step of the
+           simulation instead of skipping a frame in this case. The result is
+           visually smooth. The differences in distances/speeds, compared to
+           what would be if the target framerate of the simulation was strictly
+           enforced, are negligible: proportional to a small FIXED_TIMESTEP and
+           happening only occasionally compared to the total number of frames. */
+        pa->reference_time = pa->fixed_time + FIXED_TIMESTEP * 0.5;
+#else
+        /* skip a frame if the engine is rendering more frames per second than
+           required by the simulation. If jump is first pressed, we save that
+           information and restore it when we decide not to skip a frame. */
+        pa->delayed_jump = pa->delayed_jump || input_button_pressed(pa->input, IB_FIRE1);
+    }
+    else if(pa->delayed_jump) {
+        /* simulate that the jump button is first pressed. We won't skip a frame now. */
+        input_simulate_button_press(pa->input, IB_FIRE1);
+        pa->delayed_jump = false;
+#endif
+    }
+
+    /* run the simulation */
+    int counter = 0;
+    while(pa->fixed_time <= pa->reference_time) {
+        if(0 == counter++) {
+            /* run at most once per framestep in order to avoid jittering when
+               the engine framerate drops below TARGET_FPS. The simulation will
+               seem slower in this case. */
+            fixed_update(pa, obstaclemap, FIXED_TIMESTEP);
+        }
+
+        /* advance the fixed time */
+        pa->fixed_time += FIXED_TIMESTEP;
+    }
+
+#if WANT_DEBUG
+    /* testing */
+    if(skip_frame)
+        video_showmessage("frame skip %lf", pa->reference_time);
+    else if(counter > 1)
+        video_showmessage("going slow (%d) %lf", counter, pa->reference_time);
+#endif
+
+#else
+    /* running the simulation at most once per framestep and with no frame
+       skipping is equivalent to running the simulation once per framestep */
+    fixed_update(pa, obstaclemap, FIXED_TIMESTEP);
+#endif
+}
+
 void fixed_update(physicsactor_t *pa, const obstaclemap_t *obstaclemap, double dt)
 {
     const obstacle_t *at_A = NULL, *at_B = NULL, *at_C = NULL, *at_D = NULL, *at_M = NULL, *at_N = NULL;
@@ -1578,8 +1834,7 @@ void fixed_update(physicsactor_t *pa, const obstaclemap_t *obstaclemap, double d
      */
 
     /* update the position */
-    pa->xpos += pa->xsp * dt;
-    pa->ypos += pa->ysp * dt;
+    move(pa, obstaclemap, pa->xsp * dt, pa->ysp * dt);
     update_sensors(pa, obstaclemap, &at_A, &at_B, &at_C, &at_D, &at_M, &at_N);
 
     /*
@@ -1783,14 +2038,27 @@ void update_sensors(physicsactor_t* pa, const obstaclemap_t* obstaclemap, obstac
 #endif
     }
 
-    /* read sensors */
+    /* read sensors with a single query to the obstacle map */
     v2d_t position = physicsactor_get_position(pa);
-    *at_A = sensor_check(a, position, pa->movmode, pa->layer, obstaclemap);
-    *at_B = sensor_check(b, position, pa->movmode, pa->layer, obstaclemap);
-    *at_C = sensor_check(c, position, pa->movmode, pa->layer, obstaclemap);
-    *at_D = sensor_check(d, position, pa->movmode, pa->layer, obstaclemap);
-    *at_M = sensor_check(m, position, pa->movmode, pa->layer, obstaclemap);
-    *at_N = sensor_check(n, position, pa->movmode, pa->layer, obstaclemap);
+    const sensor_t* sensor[] = { a, b, c, d, m, n };
+    obstaclequery_t query[6];
+    for(int i = 0; i < 6; i++) {
+        int x1, y1, x2, y2;
+        sensor_worldpos(sensor[i], position, pa->movmode, &x1, &y1, &x2, &y2);
+
+        query[i].x1 = min(x1, x2);
+        query[i].y1 = min(y1, y2);
+        query[i].x2 = max(x1, x2);
+        query[i].y2 = max(y1, y2);
+        query[i].enabled = sensor_is_enabled(sensor[i]);
+    }
+    obstaclemap_query_sensors(obstaclemap, query, 6, pa->movmode, pa->layer);
+    *at_A = query[0].best;
+    *at_B = query[1].best;
+    *at_C = query[2].best;
+    *at_D = query[3].best;
+    *at_M = query[4].best;
+    *at_N = query[5].best;
 
     /* C, D, M, N: ignore clouds */
     *at_C = (*at_C != NULL && obstacle_is_solid(*at_C)) ? *at_C : NULL;
@@ -1909,6 +2177,30 @@ void update_sensors(physicsactor_t* pa, const obstaclemap_t* obstaclemap, obstac
        repeating when rolling inside a tube is undesirable (leads to instability) */
 }
 
+/* moves the physics actor by (dx,dy). Long movements are swept, so that the
+   actor won't tunnel through thin obstacles; it's stopped right before the
+   first solid obstacle along the way, and then the sensors reposition it */
+void move(physicsactor_t* pa, const obstaclemap_t* obstaclemap, double dx, double dy)
+{
+    double new_xpos = pa->xpos + dx;
+    double new_ypos = pa->ypos + dy;
+
+    /* a short movement can't skip an obstacle that the sensors would detect */
+    if(dx * dx + dy * dy > SWEEP_THRESHOLD * SWEEP_THRESHOLD) {
+        int x1 = (int)floor(pa->xpos), y1 = (int)floor(pa->ypos);
+        int x2 = (int)floor(new_xpos), y2 = (int)floor(new_ypos);
+        int x, y;
+
+        if(obstaclemap_sweep(obstaclemap, x1, y1, x2, y2, pa->layer, &x, &y) != NULL) {
+            new_xpos = x;
+            new_ypos = y;
+        }
+    }
+
+    pa->xpos = new_xpos;
+    pa->ypos = new_ypos;
+}
+
 /* call update_movmode() whenever you update pa->angle */
 void update_movmode(physicsactor_t* pa)
 {
@@ -2473,14 +2765,20 @@ void update_angle_step(physicsactor_t* pa, const obstaclemap_t* obstaclemap, int
     bool found_a = false, found_b = false;
     int xa, ya, xb, yb;
 
+    /* we use fixed-point arithmetic for speed and for determinism */
+    const int32_t sin_angle = FIXED_SIN(guess_angle);
+    const int32_t cos_angle = FIXED_COS(guess_angle);
+    const int64_t base_x = fixed_from_int(floor(curr_position.x)) + FIXED_ONE / 2;
+    const int64_t base_y = fixed_from_int(floor(curr_position.y)) + FIXED_ONE / 2;
+
     for(int i = 0; i < max_iterations && !(found_a && found_b); i++) {
-        float h = search_base + i;
-        float x = floorf(curr_position.x) + h * SIN(guess_angle) + 0.5f;
-        float y = floorf(curr_position.y) + h * COS(guess_angle) + 0.5f;
+        int64_t h = search_base + i;
+        int64_t x = base_x + h * sin_angle;
+        int64_t y = base_y + h * cos_angle;
 
         if(!found_a) {
-            xa = x - hoff * COS(guess_angle);
-            ya = y + hoff * SIN(guess_angle);
+            xa = fixed_to_int(x - hoff * cos_angle);
+            ya = fixed_to_int(y + hoff * sin_angle);
             gnd = obstaclemap_get_best_obstacle_at(obstaclemap, xa, ya, xa, ya, pa->movmode, pa->layer);
             found_a = (gnd != NULL && (obstacle_is_solid(gnd) || (
                 (pa->movmode == MM_FLOOR && ya < obstacle_ground_position(gnd, xa, ya, GD_DOWN) + CLOUD_HEIGHT) ||
@@ -2491,8 +2789,8 @@ void update_angle_step(physicsactor_t* pa, const obstaclemap_t* obstaclemap, int
         }
 
         if(!found_b) {
-            xb = x + hoff * COS(guess_angle);
-            yb = y - hoff * SIN(guess_angle);
+            xb = fixed_to_int(x + hoff * cos_angle);
+            yb = fixed_to_int(y - hoff * sin_angle);
             gnd = obstaclemap_get_best_obstacle_at(obstaclemap, xb, yb, xb, yb, pa->movmode, pa->layer);
             found_b = (gnd != NULL && (obstacle_is_solid(gnd) || (
                 (pa->movmode == MM_FLOOR && yb < obstacle_ground_position(gnd, xb, yb, GD_DOWN) + CLOUD_HEIGHT) ||
@@ -2851,6 +3149,18 @@ int interpolate_angle(int alpha, int beta, float t)
     return (alpha + delta) & 0xFF;
 }
 
+/* converts an integer to a fixed-point number in Q16 format */
+int64_t fixed_from_int(int x)
+{
+    return (int64_t)x * FIXED_ONE;
+}
+
+/* converts a fixed-point number in Q16 format to an integer, rounding towards zero */
+int fixed_to_int(int64_t x)
+{
+    return (int)(x / FIXED_ONE);
+}
+
 /* angle extrapolation; t in [0,1] */
 int extrapolate_angle(int curr_angle, int prev_angle, float t)
 {
@@ -2863,6 +3173,46 @@ int extrapolate_angle(int curr_angle, int prev_angle, float t)
 
 
 
+/*
+ *
+ * Parallel simulation
+ *
+ */
+
+/* advances the simulation of multiple actors by dt seconds */
+void run_batch(physicsactor_t** actor, int count, const obstaclemap_t* obstaclemap, double dt)
+{
+    /* step the actors in sequence */
+    if(!is_parallel || jobs_worker_count() == 0 || count < MIN_ACTORS_PER_BATCH) {
+        for(int i = 0; i < count; i++)
+            simulate(actor[i], obstaclemap, dt);
+        return;
+    }
+
+    /* step the actors in parallel. The observers must not be notified in the jobs */
+    for(int i = 0; i < count; i++)
+        actor[i]->defer_events = true;
+
+    physicsbatch_t batch = { .actor = actor, .obstaclemap = obstaclemap, .dt = dt };
+    jobs_parallel_for(count, 1, step_actors, &batch);
+
+    /* notify the observers in a deterministic order */
+    for(int i = 0; i < count; i++)
+        flush_events(actor[i]);
+}
+
+/* steps the actors [first, last) of a batch in a job */
+void step_actors(int first, int last, void* arg)
+{
+    const physicsbatch_t* batch = (const physicsbatch_t*)arg;
+
+    for(int i = first; i < last; i++)
+        simulate(batch->actor[i], batch->obstaclemap, batch->dt);
+}
+
+
+
+
 /*
  *
  * Observers
@@ -2874,12 +3224,29 @@ void notify_observers(physicsactor_t* pa, physicsactorevent_t event)
 {
     physicsactorobserverlist_t* observer = pa->observers;
 
+    /* queue the event during a parallel step */
+    if(pa->defer_events) {
+        darray_push(pa->deferred_event, event);
+        return;
+    }
+
     while(observer != NULL) {
         observer->callback(pa, event, observer->context);
         observer = observer->next;
     }
 }
 
+/* notify the observers of the events queued during a parallel step */
+void flush_events(physicsactor_t* pa)
+{
+    pa->defer_events = false;
+
+    for(int i = 0; i < darray_length(pa->deferred_event); i++)
+        notify_observers(pa, pa->deferred_event[i]);
+
+    darray_clear(pa->deferred_event);
+}
+
 /* create an observer */
 physicsactorobserverlist_t* create_observer(void (*callback)(physicsactor_t*,physicsactorevent_t,void*), void* context, physicsactorobserverlist_t* next)
 {
@@ -30,6 +30,12 @@
  */
 typedef struct physicsactor_t physicsactor_t;
 
+/*
+ * a world of physics actors is a set of physics
+ * actors that are updated together
+ */
+typedef struct physicsactorworld_t physicsactorworld_t;
+
 /*
  * a physics actor may be in one of the following states:
  */
@@ -192,4 +198,28 @@ void physicsactor_set_airdragthreshold(physicsactor_t *pa, double value);
 double physicsactor_get_waittime(const physicsactor_t *pa); /* wait time in seconds */
 void physicsactor_set_waittime(physicsactor_t *pa, double value);
 
+/* parallel simulation */
+void physicsactor_update_batch(physicsactor_t** pa, int count, const struct obstaclemap_t *obstaclemap); /* updates count actors; their observers are notified afterwards, in order. Call physicsactor_capture_input() before */
+void physicsactor_set_parallel(bool parallel); /* step the actors of a batch on the job system? */
+bool physicsactor_is_parallel();
+
+/* worlds of physics actors */
+physicsactorworld_t* physicsactor_world_create();
+physicsactorworld_t* physicsactor_world_destroy(physicsactorworld_t* world); /* the actors are not destroyed */
+void physicsactor_world_add(physicsactorworld_t* world, physicsactor_t* pa);
+void physicsactor_world_remove(physicsactorworld_t* world, const physicsactor_t* pa);
+void physicsactor_world_update(physicsactorworld_t* world, const struct obstaclemap_t *obstaclemap); /* updates all actors of the world; call physicsactor_capture_input() before */
+int physicsactor_world_count(const physicsactorworld_t* world); /* number of actors */
+physicsactor_t* physicsactor_world_get(const physicsactorworld_t* world, int index); /* 0 <= index < count */
+
+/* the state of the actors of a world after the last update, in contiguous
+   arrays of physicsactor_world_count() elements indexed like physicsactor_world_get() */
+const v2d_t* physicsactor_world_positions(const physicsactorworld_t* world);
+const double* physicsactor_world_xsps(const physicsactorworld_t* world);
+const double* physicsactor_world_ysps(const physicsactorworld_t* world);
+const double* physicsactor_world_gsps(const physicsactorworld_t* world);
+const int* physicsactor_world_angles(const physicsactorworld_t* world); /* in degrees */
+const movmode_t* physicsactor_world_movmodes(const physicsactorworld_t* world);
+const physicsactorstate_t* physicsactor_world_states(const physicsactorworld_t* world);
+
 #endif
@@ -18,6 +18,9 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <allegro5/allegro.h>
+#include <stdint.h>
+#include <string.h>
 #include "editorpal.h"
 #include "../util/util.h"
 #include "../core/font.h"
@@ -31,6 +34,8 @@
 #include "../core/input.h"
 #include "../core/lang.h"
 #include "../core/global.h"
+#include "../core/asset.h"
+#include "../core/logfile.h"
 #include "../entities/brick.h"
 #include "../entities/sfx.h"
 
@@ -59,6 +64,45 @@ static bool is_scrolling;
 static int item_at(v2d_t position);
 static void draw_item(int item_number, v2d_t center);
 
+/*
+
+THUMBNAIL ATLAS
+---------------
+
+Scaling hundreds of previews every frame is wasteful, so the previews are
+rendered once into the thumbnails of an atlas. The atlas is split into pages
+of THUMBNAILS_PER_PAGE thumbnails of THUMBNAIL_SIZE x THUMBNAIL_SIZE pixels,
+arranged in the order of the items. A page is made resident when one of its
+items becomes visible. At most MAX_RESIDENT_PAGES pages are kept in memory;
+the least recently used page is evicted first.
+
+Pages are stored in the application cache. Their file names depend on a hash
+of the palette: the items, the rectangles of their previews and the stamps of
+the files of the previews. When the brickset or the sprites are modified, the
+hash changes and stale pages are not used.
+
+*/
+#define THUMBNAIL_SIZE              ITEM_SPRITE_MAXSIZE
+#define THUMBNAILS_PER_ROW          8 /* of a page */
+#define THUMBNAILS_PER_PAGE         (THUMBNAILS_PER_ROW * THUMBNAILS_PER_ROW)
+#define MAX_RESIDENT_PAGES          8
+#define THUMBNAIL_CACHE_DIR         "thumbnails/" /* inside the application cache */
+static image_t** page; /* NULL if not resident */
+static uint32_t* page_last_used;
+static int page_count;
+static int resident_page_count;
+static image_t** thumbnail; /* sub-images of the pages; NULL if not resident */
+static uint64_t palette_hash;
+static uint32_t frame_counter;
+static void init_atlas();
+static void release_atlas();
+static void make_resident(int page_number);
+static void evict_page(int page_number);
+static image_t* build_page(int page_number);
+static const char* page_cache_path(int page_number, char* buffer, size_t buffer_size);
+static uint64_t hash_palette();
+static inline uint64_t hash_mix(uint64_t hash, uint64_t value);
+
 
 
 /*
@@ -97,6 +141,7 @@ void editorpal_init(void *config_ptr)
         item_count = 0;
         item = NULL;
     }
+    init_atlas();
 
     /* configure the mouse cursor */
     cursor_image = animation_image(sprite_get_animation(CURSOR_SPRITE, 0), 0);
@@ -133,6 +178,7 @@ void editorpal_release()
     input_destroy(pal_input);
 
     /* release the items */
+    release_atlas();
     if(item != NULL)
         free(item);
 }
@@ -232,6 +278,7 @@ void editorpal_render()
     v2d_t cam = v2d_new(VIDEO_SCREEN_W / 2, VIDEO_SCREEN_H / 2);
     int w = (VIDEO_SCREEN_W - SCROLLBAR_WIDTH) / ITEM_BOX_SIZE;
     int base = w * (scroll_y / ITEM_BOX_SIZE);
+    int end = min(item_count, base + w * (1 + VIDEO_SCREEN_H / ITEM_BOX_SIZE));
     int i, x, y, active_item = NO_ITEM;
 
     /* render the background */
@@ -246,12 +293,21 @@ void editorpal_render()
         image_rectfill(x, y, x + ITEM_BOX_SIZE - 1, y + ITEM_BOX_SIZE - 1, color_rgb(72, 74, 79));
     }
 
-    /* render the items */
-    for(i = 0; i < item_count; i++) {
+    /* render the visible items. Their pages are made resident
+       before holding the drawing, as building them changes the
+       drawing target */
+    frame_counter++;
+    for(i = base; i < end; i += THUMBNAILS_PER_PAGE - i % THUMBNAILS_PER_PAGE)
+        make_resident(i / THUMBNAILS_PER_PAGE);
+    make_resident((end - 1) / THUMBNAILS_PER_PAGE);
+
+    image_hold_drawing(true);
+    for(i = base; i < end; i++) {
         x = ((i - base) % w) * ITEM_BOX_SIZE + ITEM_BOX_SIZE / 2;
         y = ((i - base) / w) * ITEM_BOX_SIZE + ITEM_BOX_SIZE / 2;
         draw_item(i, v2d_new(x, y));
     }
+    image_hold_drawing(false);
 
     /* render the scrollbar */
     if(scroll_max > 0) {
@@ -303,15 +359,221 @@ int item_at(v2d_t position)
         return NO_ITEM;
 }
 
-/* draws the given item centered at the specified position */
+/* draws the thumbnail of the given item centered at the specified position */
 void draw_item(int item_number, v2d_t center)
 {
-    if(item_number >= 0 && item_number < item_count) {
-        const image_t* image = item[item_number];
+    if(item_number >= 0 && item_number < item_count && thumbnail[item_number] != NULL)
+        image_draw(thumbnail[item_number], center.x - THUMBNAIL_SIZE / 2, center.y - THUMBNAIL_SIZE / 2, IF_NONE);
+}
+
+/* sets up the thumbnail atlas of the items. No page is resident yet */
+void init_atlas()
+{
+    page_count = (item_count + THUMBNAILS_PER_PAGE - 1) / THUMBNAILS_PER_PAGE;
+    page = NULL;
+    page_last_used = NULL;
+    thumbnail = NULL;
+    resident_page_count = 0;
+    frame_counter = 0;
+
+    if(item_count == 0)
+        return;
+
+    page = mallocx(page_count * sizeof(*page));
+    page_last_used = mallocx(page_count * sizeof(*page_last_used));
+    for(int i = 0; i < page_count; i++) {
+        page[i] = NULL;
+        page_last_used[i] = 0;
+    }
+
+    thumbnail = mallocx(item_count * sizeof(*thumbnail));
+    for(int i = 0; i < item_count; i++)
+        thumbnail[i] = NULL;
+
+    palette_hash = hash_palette();
+}
+
+/* releases the thumbnail atlas */
+void release_atlas()
+{
+    for(int i = 0; i < page_count; i++)
+        evict_page(i);
+
+    if(thumbnail != NULL)
+        free(thumbnail);
+
+    if(page_last_used != NULL)
+        free(page_last_used);
+
+    if(page != NULL)
+        free(page);
+
+    thumbnail = NULL;
+    page_last_used = NULL;
+    page = NULL;
+    page_count = 0;
+}
+
+/* makes a page of the atlas resident, loading it from the
+   application cache or building it, evicting another page if needed */
+void make_resident(int page_number)
+{
+    char path[64];
+
+    if(page_number < 0 || page_number >= page_count)
+        return;
+
+    page_last_used[page_number] = frame_counter;
+    if(page[page_number] != NULL)
+        return;
+
+    /* evict the least recently used page */
+    if(resident_page_count >= MAX_RESIDENT_PAGES) {
+        int lru = NO_ITEM;
+        for(int i = 0; i < page_count; i++) {
+            if(page[i] != NULL && (lru == NO_ITEM || page_last_used[i] < page_last_used[lru]))
+                lru = i;
+        }
+        evict_page(lru);
+    }
+
+    /* the thumbnails of the page */
+    int first = page_number * THUMBNAILS_PER_PAGE;
+    int count = min(item_count - first, THUMBNAILS_PER_PAGE);
+    int width = THUMBNAIL_SIZE * THUMBNAILS_PER_ROW;
+    int height = THUMBNAIL_SIZE * ((count + THUMBNAILS_PER_ROW - 1) / THUMBNAILS_PER_ROW);
+
+    /* load the page from the application cache */
+    image_t* img = image_load_cached(page_cache_path(page_number, path, sizeof(path)));
+    if(img != NULL && (image_width(img) != width || image_height(img) != height)) {
+        image_destroy(img);
+        img = NULL;
+    }
+
+    /* build the page if it isn't cached */
+    if(img == NULL) {
+        img = build_page(page_number);
+        image_save_cached(img, path);
+    }
+
+    /* slice the thumbnails */
+    for(int j = 0; j < count; j++) {
+        int x = (j % THUMBNAILS_PER_ROW) * THUMBNAIL_SIZE;
+        int y = (j / THUMBNAILS_PER_ROW) * THUMBNAIL_SIZE;
+        thumbnail[first + j] = image_create_shared(img, x, y, THUMBNAIL_SIZE, THUMBNAIL_SIZE);
+    }
+
+    page[page_number] = img;
+    resident_page_count++;
+}
+
+/* evicts a page of the atlas from memory */
+void evict_page(int page_number)
+{
+    if(page_number < 0 || page_number >= page_count || page[page_number] == NULL)
+        return;
+
+    /* destroy the sub-images before their parent */
+    int first = page_number * THUMBNAILS_PER_PAGE;
+    int count = min(item_count - first, THUMBNAILS_PER_PAGE);
+    for(int j = 0; j < count; j++) {
+        image_destroy(thumbnail[first + j]);
+        thumbnail[first + j] = NULL;
+    }
+
+    image_destroy(page[page_number]);
+    page[page_number] = NULL;
+    resident_page_count--;
+}
+
+/* renders the previews of the items of a page into a new image */
+image_t* build_page(int page_number)
+{
+    int first = page_number * THUMBNAILS_PER_PAGE;
+    int count = min(item_count - first, THUMBNAILS_PER_PAGE);
+    int rows = (count + THUMBNAILS_PER_ROW - 1) / THUMBNAILS_PER_ROW;
+    image_t* img = image_create(THUMBNAIL_SIZE * THUMBNAILS_PER_ROW, THUMBNAIL_SIZE * rows);
+    image_t* prev_target = image_drawing_target();
+
+    image_set_drawing_target(img);
+    image_clear(color_rgba(0, 0, 0, 0));
+
+    for(int j = 0; j < count; j++) {
+        const image_t* image = item[first + j];
         int width = image_width(image);
         int height = image_height(image);
         float factor = min((float)ITEM_SPRITE_MAXSIZE / max(width, height), ITEM_MAX_ZOOM);
         v2d_t scale = v2d_new(factor, factor);
+        v2d_t center = v2d_new(
+            (j % THUMBNAILS_PER_ROW) * THUMBNAIL_SIZE + THUMBNAIL_SIZE / 2,
+            (j / THUMBNAILS_PER_ROW) * THUMBNAIL_SIZE + THUMBNAIL_SIZE / 2
+        );
         image_draw_scaled(image, center.x - width * scale.x / 2, center.y - height * scale.y / 2, scale, IF_NONE);
     }
+
+    image_set_drawing_target(prev_target);
+    logfile_message("Built page %d of the thumbnails of the editor palette", page_number);
+    return img;
+}
+
+/* the path of a page of the atlas, relative to the application cache */
+const char* page_cache_path(int page_number, char* buffer, size_t buffer_size)
+{
+    snprintf(buffer, buffer_size, THUMBNAIL_CACHE_DIR "%016llx-%d.png", (unsigned long long)palette_hash, page_number);
+    return buffer;
+}
+
+/* computes a hash of the palette. It depends on the items, on the rectangles
+   of their previews and on the stamps of the files of the previews */
+uint64_t hash_palette()
+{
+    uint64_t hash = 5381;
+    const char* prev_filepath = "";
+
+    hash = hash_mix(hash, (uint64_t)config.type);
+    hash = hash_mix(hash, (uint64_t)item_count);
+
+    for(int i = 0; i < item_count; i++) {
+        const char* filepath = image_filepath(item[i]);
+        int x, y, width, height;
+
+        /* the item */
+        if(config.type == EDITORPAL_BRICK)
+            hash = hash_mix(hash, (uint64_t)config.brick.id[i]);
+        else if(config.type == EDITORPAL_SSOBJ) {
+            for(const char* p = config.ssobj.name[i]; *p; p++)
+                hash = hash_mix(hash, (unsigned char)(*p));
+        }
+
+        /* its preview */
+        image_texture_region(item[i], &x, &y, &width, &height);
+        hash = hash_mix(hash, (uint64_t)image_width(item[i]));
+        hash = hash_mix(hash, (uint64_t)image_height(item[i]));
+        hash = hash_mix(hash, (uint64_t)x);
+        hash = hash_mix(hash, (uint64_t)y);
+
+        /* the file of the preview; consecutive items usually share it */
+        if(filepath == NULL || strcmp(filepath, prev_filepath) == 0)
+            continue;
+
+        for(const char* p = filepath; *p; p++)
+            hash = hash_mix(hash, (unsigned char)(*p));
+
+        ALLEGRO_FS_ENTRY* entry = al_create_fs_entry(asset_path(filepath));
+        if(entry != NULL) {
+            hash = hash_mix(hash, (uint64_t)al_get_fs_entry_mtime(entry));
+            hash = hash_mix(hash, (uint64_t)al_get_fs_entry_size(entry));
+            al_destroy_fs_entry(entry);
+        }
+
+        prev_filepath = filepath;
+    }
+
+    return hash;
+}
+
+/* djb2 */
+uint64_t hash_mix(uint64_t hash, uint64_t value)
+{
+    return ((hash << 5) + hash) ^ value;
 }
@@ -32,6 +32,8 @@
 #include "pause.h"
 #include "quest.h"
 #include "util/levparser.h"
+#include "util/levwriter.h"
+#include "util/levpreload.h"
 #include "util/editorgrp.h"
 #include "util/editorcmd.h"
 #include "../core/engine.h"
@@ -50,16 +52,23 @@
 #include "../core/nanoparser.h"
 #include "../core/font.h"
 #include "../core/prefs.h"
+#include "../core/quest.h"
+#include "../core/benchmark.h"
+#include "../core/metrics.h"
+#include "../core/profiler.h"
+#include "../core/resourcemanager.h"
 #include "../util/darray.h"
 #include "../util/numeric.h"
 #include "../util/rect.h"
 #include "../util/util.h"
 #include "../util/stringutil.h"
 #include "../util/iterator.h"
+#include "../util/arena.h"
 #include "../entities/mobilegamepad.h"
 #include "../entities/actor.h"
 #include "../entities/brick.h"
 #include "../entities/brickmanager.h"
+#include "../entities/brickcache.h"
 #include "../entities/player.h"
 #include "../entities/camera.h"
 #include "../entities/waterfx.h"
@@ -72,6 +81,7 @@
 #include "../physics/obstacle.h"
 #include "../physics/obstaclemap.h"
 #include "../scripting/scripting.h"
+#include "../scripting/util/framebudget.h"
 #include "../scenes/editorpal.h"
 
 /* ------------------------
@@ -122,6 +132,7 @@ static bool is_setup_object(const char* object_name);
 #define PATH_MAXLEN             1024
 #define LINE_MAXLEN             1024
 #define MAX_ACT_NUMBER          99
+#define WANT_BRICK_CACHE        1 /* bake static bricks into chunk textures */
 
 /* water */
 #define DEFAULT_WATERLEVEL()    waterfx_default_ypos()
@@ -162,6 +173,93 @@ static void save_level_state(levelstate_t* state);
 static void restore_level_state(const levelstate_t* state);
 static void clear_level_state(levelstate_t* state);
 
+/* level snapshot: the spawn tables of the level in a compact form, so that it can be restarted quickly */
+typedef enum levelspawntype_t levelspawntype_t;
+enum levelspawntype_t {
+    SPAWN_BRICK,
+    SPAWN_ENTITY,
+    SPAWN_LEGACYOBJECT,
+    SPAWN_LEGACYITEM
+};
+
+typedef struct levelspawn_t levelspawn_t;
+struct levelspawn_t {
+    levelspawntype_t type;
+    int x, y; /* spawn point */
+    int id; /* brick id or legacy item type */
+    bricklayer_t layer; /* bricks only */
+    brickflip_t flip; /* bricks only */
+    int name; /* entities and legacy objects: offset of the name in the string pool */
+    bool has_entity_id; /* entities only */
+    uint64_t entity_id;
+};
+
+typedef struct levelsnapshot_t levelsnapshot_t;
+struct levelsnapshot_t {
+    bool is_valid;
+    char file[PATH_MAXLEN]; /* the .lev file */
+    DARRAY(levelspawn_t, spawn); /* in the order of the .lev file */
+    DARRAY(char, string); /* string pool */
+};
+static levelsnapshot_t snapshot = { .is_valid = false, .spawn = NULL, .string = NULL };
+static bool wants_snapshot = false; /* restore the level from the snapshot on the next load */
+static void init_snapshot(levelsnapshot_t* snapshot, const char* filepath);
+static void release_snapshot(levelsnapshot_t* snapshot);
+static void add_to_snapshot(levelsnapshot_t* snapshot, levelspawn_t spawn, const char* name);
+static surgescript_object_t* spawn_from_snapshot(const levelsnapshot_t* snapshot, const levelspawn_t* spawn);
+
+/* level streaming: the bricks & the entities of the snapshot are split into
+   spatial chunks that are paged in and out around the (predicted) region of
+   interest, so that memory stays bounded regardless of the size of the level */
+#define STREAM_CHUNK_SIZE 1024 /* width and height of a chunk, in pixels */
+static const int STREAM_MARGIN_PAGEIN = 512; /* chunks this close to the ROI are paged in... */
+static const int STREAM_MARGIN_PAGEOUT = 1536; /* ...and chunks farther than this are paged out */
+
+typedef struct levelstreamentry_t levelstreamentry_t;
+struct levelstreamentry_t {
+    int spawn; /* index in the spawn table of the snapshot */
+    uint64_t entity_id; /* entities only: zero until the entity is first spawned */
+    bool is_gone; /* destroyed in the game or handed over to the level: don't spawn it again */
+};
+
+typedef struct levelbrickkey_t levelbrickkey_t;
+struct levelbrickkey_t {
+    int id, x, y; /* a brick of the level */
+};
+
+typedef struct levelchunk_t levelchunk_t;
+struct levelchunk_t {
+    int x, y; /* chunk coordinates */
+    int first_entry; /* the entries of the chunk are contiguous, in the order of the .lev file */
+    int entry_count;
+    bool is_resident;
+};
+
+typedef struct levelstream_t levelstream_t;
+struct levelstream_t {
+    bool is_enabled;
+    DARRAY(levelchunk_t, chunk); /* non-empty chunks sorted by (y, x) */
+    DARRAY(levelstreamentry_t, entry);
+    DARRAY(int, resident); /* indices of the resident chunks */
+    DARRAY(levelbrickkey_t, alive_brick); /* scratch: the paged out bricks that are alive */
+    int brick_margin; /* size of the largest brick: bricks belong to the chunk of their spawn point */
+};
+static levelstream_t stream = { .is_enabled = false, .chunk = NULL };
+static bool wants_streaming = false; /* stream the levels that are loaded from now on? */
+static void init_stream(const levelsnapshot_t* snapshot);
+static void release_stream();
+static void update_stream(v2d_t camera, v2d_t predicted_camera);
+static void finish_stream();
+static void page_in_chunk(levelchunk_t* chunk);
+static void page_out_chunk(levelchunk_t* chunk);
+static void collect_alive_brick(const brick_t* brick, void* data);
+static levelchunk_t* find_chunk(int x, int y);
+static rect_t chunk_area(const levelchunk_t* chunk);
+static inline int chunk_coordinate(int world_coordinate);
+static inline bool is_streamable(const levelspawn_t* spawn);
+static int streamentry_cmp(const void* a, const void* b);
+static int brickkey_cmp(const void* a, const void* b);
+
 /* region of interest */
 static rect_t create_roi(v2d_t camera, int margin);
 static const int ROI_MARGIN_UPDATE_ENTITY = 256;
@@ -171,12 +269,22 @@ static const int ROI_MARGIN_RENDER_ENTITY = ROI_MARGIN_UPDATE_ENTITY; /* use the
 static const int ROI_MARGIN_RENDER_BRICK = 128;
 static const int ROI_MARGIN_EDITOR = 128;
 
+/* camera prediction: used to do some work in advance when scrolling fast */
+static const float CAMERA_PREDICTION_TIME = 0.5f; /* how far ahead we predict the position of the camera, in seconds */
+static v2d_t camera_velocity; /* smoothed velocity of the camera, in pixels per second */
+static v2d_t prev_camera_position;
+static void reset_camera_prediction();
+static void update_camera_prediction();
+static v2d_t predicted_camera_position();
+
 /* internal data */
 static float level_timer;
 static music_t *music;
 static bgtheme_t *backgroundtheme;
 static image_t *quit_level_img;
 static brickmanager_t* brick_manager;
+static brickcache_t* brick_cache; /* static bricks baked into textures */
+static arena_t* frame_arena; /* transient data; reset once per update */
 static int quit_level;
 static int must_load_another_level;
 static int must_restart_this_level;
@@ -208,6 +316,8 @@ static int level_save(const char *filepath);
 static bool level_interpret_header_line(const char *filepath, int fileline, levparser_command_t command, const char *command_name, int param_count, const char** param, void *data);
 static bool level_interpret_body_line(const char *filepath, int fileline, levparser_command_t command, const char *command_name, int param_count, const char** param, void *data);
 static bool level_save_ssobject(surgescript_object_t* object, void* param);
+STATIC_DARRAY(brick_t*, pending_bricks); /* bricks read from the .lev file, added to the brick manager in bulk */
+static void add_pending_bricks();
 
 /* internal methods */
 static int inside_screen(int x, int y, int w, int h, int margin);
@@ -227,13 +337,15 @@ static void reconfigure_players_input_devices();
 /* obstacle map */
 static obstaclemap_t* obstaclemap = NULL; /* obstacle map near the camera */
 static bool is_obstaclemap_dirty = false;
+static bool are_persistent_obstacles_valid = false; /* persistent obstacles are kept across frames */
+static unsigned persistent_obstacles_version = 0; /* version of the static bricks of the persistent obstacles */
+STATIC_DARRAY(const obstacle_t*, floating_obstacles); /* obstacles of static bricks that move (they can't be persistent) */
 STATIC_DARRAY(obstacle_t*, mock_obstacles); /* dynamically generated obstacles */
+static arena_t* mock_obstacle_arena = NULL; /* memory of the mock obstacles; reset when the obstacle map is cleared */
 static void create_obstaclemap();
 static void destroy_obstaclemap();
 static void clear_obstaclemap();
 static void update_obstaclemap(const item_list_t* item_list, const object_list_t* object_list);
-static obstacle_t* item2obstacle(const item_t* item);
-static obstacle_t* object2obstacle(const object_t* object);
 static obstacle_t* bricklike2obstacle(const surgescript_object_t* object);
 static collisionmask_t* create_collisionmask_of_bricklike_object(const surgescript_object_t* object);
 static void destroy_collisionmask_of_bricklike_object(void* mask);
@@ -244,11 +356,13 @@ static surgescript_object_t* cached_entity_manager = NULL;
 
 static inline surgescript_object_t* level_ssobject();
 static inline surgescript_object_t* entitymanager_ssobject();
+static void early_update_ssobjects();
 static void update_ssobjects();
 static void late_update_ssobjects();
 static void render_ssobjects();
 static void set_entitymanager_roi(rect_t roi);
 static surgescript_object_t* spawn_ssobject(const char* object_name, v2d_t spawn_point);
+static surgescript_object_t* spawn_entity(const char* entity_name, v2d_t spawn_point);
 static void notify_ssobjects(const char* fun_name);
 
 static bool entity_info_exists(const surgescript_object_t* object);
@@ -355,6 +469,12 @@ static int editor_ssobj_index(const char* entity_name); /* an index k such that
 static const char* editor_ssobj_name(int entity_index); /* the inverse of editor_ssobj_index() */
 static void editor_remove_entity(uint64_t entity_id);
 static void editor_pick_entity(surgescript_object_t* object, surgescript_object_t** best_candidate);
+static const animation_t* editor_entity_animation(const char* entity_name);
+static void editor_pick_brick(const brick_t* brick, const float cursor[4], const brick_t** best_candidate, bool* candidate_got_collision);
+
+/* editor: a cache of the animations used to find the bounding boxes of the entities */
+#define EDITOR_ANIMATION_CACHE_SIZE 64 /* a power of two */
+static struct { const char* name; const animation_t* anim; } editor_animation_cache[EDITOR_ANIMATION_CACHE_SIZE];
 
 /* editor: bricks */
 static int* editor_brick; /* an array of all valid brick numbers */
@@ -372,6 +492,7 @@ static int editor_brick_id(int index); /* the index-th valid brick - at editor_b
 
 /* editor: grid */
 static int editor_grid_size = 1;
+static image_t* editor_grid_image = NULL; /* the dots of the grid are cached in an image */
 static void editor_grid_init();
 static void editor_grid_release();
 static void editor_grid_update();
@@ -433,19 +554,22 @@ static editor_action_t editor_action_entity_new(int is_new_object, enum editor_e
 static editor_action_t editor_action_spawnpoint_new(int is_changing, v2d_t obj_position, v2d_t obj_old_position);
 static editor_action_t editor_action_waterlevel_new(int is_changing, int new_waterlevel, int old_waterlevel);
 
-/* linked list */
-typedef struct editor_action_list_t {
-    editor_action_t action; /* node data */
-    int in_group; /* is this element part of a group? */
-    uint32_t group_key; /* internal use (used only if in_group is true) */
-    struct editor_action_list_t *prev, *next; /* linked list: pointers */
-} editor_action_list_t;
+/* history: the actions are stored contiguously. The actions registered
+ * together, such as the entities of a group, share a group key and are
+ * undone & redone together. Painting hundreds of bricks or placing large
+ * groups creates lots of actions, so the oldest ones are forgotten once
+ * the history is full */
+typedef struct editor_action_record_t {
+    editor_action_t action;
+    uint32_t group_key; /* zero if the action is not part of a group */
+} editor_action_record_t;
+
+#define EDITOR_ACTION_MAX_RECORDS 32768 /* bounds the memory used by the history */
 
 /* data */
-editor_action_list_t *editor_action_buffer;
-editor_action_list_t *editor_action_buffer_head; /* sentinel */
-editor_action_list_t *editor_action_buffer_cursor;
-    
+STATIC_DARRAY(editor_action_record_t, editor_action_history);
+static int editor_action_cursor; /* how many actions of the history are done */
+
 /* methods */
 static void editor_action_init();
 static void editor_action_release();
@@ -453,7 +577,8 @@ static void editor_action_undo();
 static void editor_action_redo();
 static editor_action_t editor_action_commit(editor_action_t action);
 static void editor_action_register(editor_action_t action); /* internal */
-static editor_action_list_t* editor_action_delete_list(editor_action_list_t *list); /* internal */
+static bool editor_action_coalesce(const editor_action_t* action); /* internal */
+static void editor_action_forget_oldest(); /* internal */
 
 
 
@@ -475,6 +600,7 @@ static editor_action_list_t* editor_action_delete_list(editor_action_list_t *lis
 void level_load(const char *filepath)
 {
     logfile_message("Loading level \"%s\"...", filepath);
+    resourcemanager_reset_peak_memory_usage(); /* measure the peaks of this level */
 
     /* initialize fields with default values */
     str_cpy(file, filepath, sizeof(file)); /* we want the relative filepath */
@@ -510,9 +636,16 @@ void level_load(const char *filepath)
     surgescript_object_t* level_manager = scripting_util_surgeengine_component(surgescript_vm(), "LevelManager");
     surgescript_object_call_function(level_manager, "onLevelLoad", NULL, 0, NULL);
 
+    /* are we restarting the level? We don't need to read it again */
+    bool restoring = wants_snapshot && snapshot.is_valid && 0 == strcmp(snapshot.file, filepath);
+    wants_snapshot = false;
+
     /* read the header of the level file */
-    if(!levparser_parse(filepath, NULL, level_interpret_header_line))
-        fatal_error("Can\'t open level file \"%s\".", filepath);
+    if(!restoring || !levparser_replay(filepath, NULL, level_interpret_header_line)) {
+        restoring = false;
+        if(!levparser_parse(filepath, NULL, level_interpret_header_line))
+            fatal_error("Can\'t open level file \"%s\".", filepath);
+    }
 
     /* load the music */
     music_stop(); /* stop any music that's playing */
@@ -531,9 +664,30 @@ void level_load(const char *filepath)
     camera_set_position(player_position(player));
     surgescript_object_call_function(scripting_util_surgeengine_component(surgescript_vm(), "Player"), "__spawnPlayers", NULL, 0, NULL);
 
-    /* read the body of the level file;
-       load bricks & entities */
-    levparser_parse(filepath, NULL, level_interpret_body_line);
+    /* read the body of the level file */
+    if(!restoring) {
+        init_snapshot(&snapshot, filepath);
+        levparser_parse(filepath, &snapshot, level_interpret_body_line);
+        snapshot.is_valid = true;
+    }
+
+    /* load bricks & entities. Entities are spawned in bulk */
+    stream.is_enabled = wants_streaming;
+    darray_init(pending_bricks);
+    entitymanager_begin_bulk_spawn(entitymanager_ssobject(), darray_length(snapshot.spawn));
+    for(int i = 0; i < darray_length(snapshot.spawn); i++) {
+        if(!stream.is_enabled || !is_streamable(&snapshot.spawn[i]))
+            spawn_from_snapshot(&snapshot, &snapshot.spawn[i]);
+    }
+    add_pending_bricks();
+    entitymanager_end_bulk_spawn(entitymanager_ssobject());
+    darray_release(pending_bricks);
+
+    /* streaming: page in the chunks near the spawn point */
+    if(stream.is_enabled) {
+        init_stream(&snapshot);
+        update_stream(camera_get_position(), camera_get_position());
+    }
 
     /* recompute the level size */
     update_level_size();
@@ -553,6 +707,7 @@ void level_load(const char *filepath)
 void level_unload()
 {
     logfile_message("Unloading the level...");
+    resourcemanager_log_memory_usage(file);
 
     /* scripting */
     if(surgescript_vm_is_active(surgescript_vm())) {
@@ -582,6 +737,7 @@ void level_unload()
     /* remove all bricks */
     logfile_message("Removing all bricks...");
     brickmanager_remove_all_bricks(brick_manager);
+    release_stream();
 
     /* unload the brickset */
     logfile_message("Unloading the brickset...");
@@ -604,7 +760,7 @@ void level_unload()
 int level_save(const char *filepath)
 {
     const char* fullpath = asset_path(filepath);
-    ALLEGRO_FILE *fp;
+    levwriter_t* writer;
 
     /* skip if the readonly flag is set
        should this be moved to the scripting layer instead? */
@@ -619,16 +775,15 @@ int level_save(const char *filepath)
         return FALSE;
     }
 
-    /* open file for writing */
+    /* the whole level must be in memory */
+    finish_stream();
+
+    /* compose the file in memory */
     logfile_message("level_save(\"%s\")", fullpath);
-    if(NULL == (fp = al_fopen(fullpath, "w"))) {
-        logfile_message("Warning: could not open \"%s\" for writing.", fullpath);
-        video_showmessage("Could not open \"%s\" for writing.", fullpath);
-        return FALSE;
-    }
+    writer = levwriter_create();
 
     /* level header */
-    al_fprintf(fp,
+    levwriter_printf(writer,
     "// ------------------------------------------------------------\n"
     "// %s %s level\n"
     "// This file was generated automatically.\n"
@@ -637,18 +792,18 @@ int level_save(const char *filepath)
     GAME_TITLE, GAME_VERSION_STRING, GAME_WEBSITE);
 
     /* header */
-    al_fprintf(fp,
+    levwriter_printf(writer,
     "// header\n"
     "name \"%s\"\n",
     str_addslashes(name, NULL, 0));
 
     /* author */
-    al_fprintf(fp, "author \"%s\"\n", str_addslashes(author, NULL, 0));
+    levwriter_printf(writer, "author \"%s\"\n", str_addslashes(author, NULL, 0));
     if(strcmp(license, "") != 0)
-        al_fprintf(fp, "license \"%s\"\n", str_addslashes(license, NULL, 0));
+        levwriter_printf(writer, "license \"%s\"\n", str_addslashes(license, NULL, 0));
 
     /* level attributes */
-    al_fprintf(fp,
+    levwriter_printf(writer,
     "version \"%s\"\n"
     "requires \"%d.%d.%d\"\n"
     "act %d\n"
@@ -662,49 +817,49 @@ int level_save(const char *filepath)
 
     /* music? */
     if(strcmp(musicfile, "") != 0)
-        al_fprintf(fp, "music \"%s\"\n", musicfile);
+        levwriter_printf(writer, "music \"%s\"\n", musicfile);
 
     /* grouptheme? */
     if(strcmp(grouptheme, "") != 0)
-        al_fprintf(fp, "grouptheme \"%s\"\n", grouptheme);
+        levwriter_printf(writer, "grouptheme \"%s\"\n", grouptheme);
 
     /* setup objects? */
     iterator_t* setup_iterator = scripting_level_setupobjects_iterator(level_ssobject());
     if(iterator_has_next(setup_iterator)) {
-        al_fprintf(fp, "setup");
+        levwriter_printf(writer, "setup");
         while(iterator_has_next(setup_iterator)) {
             const char** object_name = iterator_next(setup_iterator);
-            al_fprintf(fp, " \"%s\"", str_addslashes(*object_name, NULL, 0));
+            levwriter_printf(writer, " \"%s\"", str_addslashes(*object_name, NULL, 0));
         }
-        al_fprintf(fp, "\n");
+        levwriter_printf(writer, "\n");
     }
     iterator_destroy(setup_iterator);
 
     /* players */
-    al_fprintf(fp, "players");
+    levwriter_printf(writer, "players");
     for(int i = 0; i < team_size; i++)
-        al_fprintf(fp, " \"%s\"", str_addslashes(player_name(team[i]), NULL, 0));
-    al_fprintf(fp, "\n");
+        levwriter_printf(writer, " \"%s\"", str_addslashes(player_name(team[i]), NULL, 0));
+    levwriter_printf(writer, "\n");
 
     /* read only? */
     if(readonly)
-        al_fprintf(fp, "readonly\n");
+        levwriter_printf(writer, "readonly\n");
 
     /* water */
     if(level_waterlevel() != DEFAULT_WATERLEVEL())
-        al_fprintf(fp, "waterlevel %d\n", level_waterlevel());
+        levwriter_printf(writer, "waterlevel %d\n", level_waterlevel());
     if(!color_equals(level_watercolor(), DEFAULT_WATERCOLOR())) {
         uint8_t r, g, b, a;
         color_unmap(level_watercolor(), &r, &g, &b, &a);
-        al_fprintf(fp, "watercolor %d %d %d %d\n", r, g, b, a);
+        levwriter_printf(writer, "watercolor %d %d %d %d\n", r, g, b, a);
     }
 
     /* dialog regions */
     if(dialogregion_size > 0) {
-        al_fprintf(fp, "\n// dialogs\n");
+        levwriter_printf(writer, "\n// dialogs\n");
         for(int i = 0; i < dialogregion_size; i++) {
             char title[256], message[1024];
-            al_fprintf(fp,
+            levwriter_printf(writer,
                 "dialogbox %d %d %d %d \"%s\" \"%s\"\n",
                 dialogregion[i].rect_x,
                 dialogregion[i].rect_y,
@@ -717,7 +872,7 @@ int level_save(const char *filepath)
     }
 
     /* brick list */
-    al_fprintf(fp, "\n// bricks\n");
+    levwriter_printf(writer, "\n// bricks\n");
     iterator_t* brick_iterator = brickmanager_retrieve_all_bricks(brick_manager);
     while(iterator_has_next(brick_iterator)) {
         const brick_t* brick = iterator_next(brick_iterator);
@@ -725,7 +880,7 @@ int level_save(const char *filepath)
         bricklayer_t layer = brick_layer(brick);
         brickflip_t flip = brick_flip(brick);
 
-        al_fprintf(fp,
+        levwriter_printf(writer,
             "brick %d %d %d%s%s%s%s\n",
 
             brick_id(brick),
@@ -741,16 +896,16 @@ int level_save(const char *filepath)
     iterator_destroy(brick_iterator);
 
     /* SurgeScript entity list */
-    al_fprintf(fp, "\n// entities\n");
-    surgescript_object_traverse_tree_ex(level_ssobject(), fp, level_save_ssobject);
+    levwriter_printf(writer, "\n// entities\n");
+    surgescript_object_traverse_tree_ex(level_ssobject(), writer, level_save_ssobject);
 
     /* item list */
     item_list_t* item_list = entitymanager_retrieve_all_items();
     if(item_list) {
-        al_fprintf(fp, "\n// legacy items\n");
+        levwriter_printf(writer, "\n// legacy items\n");
         for(item_list_t* iti = item_list; iti != NULL; iti = iti->next) {
             if(iti->data->state != IS_DEAD)
-                al_fprintf(fp, "item %d %d %d\n", iti->data->type, (int)iti->data->actor->spawn_point.x, (int)iti->data->actor->spawn_point.y);
+                levwriter_printf(writer, "item %d %d %d\n", iti->data->type, (int)iti->data->actor->spawn_point.x, (int)iti->data->actor->spawn_point.y);
         }
     }
     item_list = entitymanager_release_retrieved_item_list(item_list);
@@ -758,17 +913,26 @@ int level_save(const char *filepath)
     /* legacy object list */
     enemy_list_t* object_list = entitymanager_retrieve_all_objects();
     if(object_list) {
-        al_fprintf(fp, "\n// legacy objects\n");
+        levwriter_printf(writer, "\n// legacy objects\n");
         for(enemy_list_t* ite = object_list; ite != NULL; ite = ite->next) {
             if(ite->data->created_from_editor && ite->data->state != ES_DEAD)
-                al_fprintf(fp, "object \"%s\" %d %d\n", str_addslashes(ite->data->name, NULL, 0), (int)ite->data->actor->spawn_point.x, (int)ite->data->actor->spawn_point.y);
+                levwriter_printf(writer, "object \"%s\" %d %d\n", str_addslashes(ite->data->name, NULL, 0), (int)ite->data->actor->spawn_point.x, (int)ite->data->actor->spawn_point.y);
         }
     }
     object_list = entitymanager_release_retrieved_object_list(object_list);
 
     /* end of file */
-    al_fprintf(fp, "\n// EOF");
-    al_fclose(fp);
+    levwriter_printf(writer, "\n// EOF");
+
+    /* write the file in the background */
+    if(!levwriter_commit(writer, fullpath)) {
+        logfile_message("Warning: could not open \"%s\" for writing.", fullpath);
+        video_showmessage("Could not open \"%s\" for writing.", fullpath);
+        return FALSE;
+    }
+
+    /* the snapshot is outdated */
+    snapshot.is_valid = false;
 
     /* done! */
     logfile_message("level_save() ok");
@@ -1023,27 +1187,29 @@ bool level_interpret_header_line(const char* filepath, int fileline, levparser_c
  */
 bool level_interpret_body_line(const char* filepath, int fileline, levparser_command_t command, const char* command_name, int param_count, const char** param, void* data)
 {
+    levelsnapshot_t* snapshot = (levelsnapshot_t*)data;
+
     switch(command) {
     case LEVCOMMAND_BRICK: {
         if(param_count >= 3 && param_count <= 5) {
             if(*theme != '\0') {
-                bricklayer_t layer = BRL_DEFAULT;
-                brickflip_t flip = BRF_NOFLIP;
-                int id = atoi(param[0]);
-                int x = atoi(param[1]);
-                int y = atoi(param[2]);
+                levelspawn_t spawn = {
+                    .type = SPAWN_BRICK,
+                    .id = atoi(param[0]),
+                    .x = atoi(param[1]),
+                    .y = atoi(param[2]),
+                    .layer = BRL_DEFAULT,
+                    .flip = BRF_NOFLIP
+                };
 
                 for(int j = 3; j < param_count; j++) {
-                    if(layer == BRL_DEFAULT && brick_util_layercode(param[j]) != BRL_DEFAULT)
-                        layer = brick_util_layercode(param[j]);
-                    else if(flip == BRF_NOFLIP && brick_util_flipcode(param[j]) != BRF_NOFLIP)
-                        flip = brick_util_flipcode(param[j]);
+                    if(spawn.layer == BRL_DEFAULT && brick_util_layercode(param[j]) != BRL_DEFAULT)
+                        spawn.layer = brick_util_layercode(param[j]);
+                    else if(spawn.flip == BRF_NOFLIP && brick_util_flipcode(param[j]) != BRF_NOFLIP)
+                        spawn.flip = brick_util_flipcode(param[j]);
                 }
 
-                if(brick_exists(id))
-                    level_create_brick(id, v2d_new(x,y), layer, flip);
-                else
-                    logfile_message("Level loader - invalid brick: %d", id);
+                add_to_snapshot(snapshot, spawn, NULL);
             }
             else
                 logfile_message("Level loader - warning: cannot create a new brick if the theme is not defined");
@@ -1056,22 +1222,15 @@ bool level_interpret_body_line(const char* filepath, int fileline, levparser_com
 
     case LEVCOMMAND_ENTITY: {
         if(param_count == 3 || param_count == 4) {
-            const char* name = param[0];
-            int x = atoi(param[1]);
-            int y = atoi(param[2]);
-            if(!is_setup_object(name)) {
-                surgescript_object_t* obj = level_create_object(name, v2d_new(x, y));
-                if(obj != NULL) {
-                    if(!surgescript_object_has_tag(obj, "entity"))
-                        fatal_error("Level loader - can't spawn \"%s\": object is not an entity", name);
-                    else if(param_count > 3 && entity_info_exists(obj))
-                        entity_info_set_id(obj, str_to_x64(param[3]));
-                }
-                else {
-                    logfile_message("Level loader - can't spawn \"%s\": entity doesn't exist", name);
-                    video_showmessage("Entity \"%s\" doesn't exist!", name);
-                }
-            }
+            levelspawn_t spawn = {
+                .type = SPAWN_ENTITY,
+                .x = atoi(param[1]),
+                .y = atoi(param[2]),
+                .has_entity_id = (param_count > 3),
+                .entity_id = (param_count > 3) ? str_to_x64(param[3]) : 0
+            };
+
+            add_to_snapshot(snapshot, spawn, param[0]);
         }
         else
             logfile_message("Level loader - command '%s' expects three or four parameters: name, xpos, ypos [, id]", command_name);
@@ -1081,24 +1240,13 @@ bool level_interpret_body_line(const char* filepath, int fileline, levparser_com
 
     case LEVCOMMAND_LEGACYOBJECT: {
         if(param_count == 3) {
-            const char* name = param[0];
-            int x = atoi(param[1]);
-            int y = atoi(param[2]);
-            if(!is_setup_object(name)) {
-                surgescript_object_t* obj = level_create_object(name, v2d_new(x, y));
-                if(obj != NULL) {
-                    if(!surgescript_object_has_tag(obj, "entity"))
-                        fatal_error("Level loader - can't spawn \"%s\": object is not an entity", name);
-                }
-                else if(enemy_exists(name)) {
-                    enemy_t* e = level_create_legacy_object(name, v2d_new(x, y)); /* old API */
-                    e->created_from_editor = TRUE;
-                }
-                else {
-                    logfile_message("Level loader - can't spawn \"%s\": object doesn't exist", name);
-                    video_showmessage("Entity \"%s\" doesn't exist!", name);
-                }
-            }
+            levelspawn_t spawn = {
+                .type = SPAWN_LEGACYOBJECT,
+                .x = atoi(param[1]),
+                .y = atoi(param[2])
+            };
+
+            add_to_snapshot(snapshot, spawn, param[0]);
         }
         else
             logfile_message("Level loader - command '%s' expects three parameters: name, xpos, ypos", command_name);
@@ -1108,17 +1256,14 @@ bool level_interpret_body_line(const char* filepath, int fileline, levparser_com
 
     case LEVCOMMAND_LEGACYITEM: {
         if(param_count == 3) {
-            int type = atoi(param[0]);
-            int x = atoi(param[1]);
-            int y = atoi(param[2]);
-            surgescript_object_t* object = NULL;
-            const char* object_name = item2surgescript(type); /* legacy item ported to SurgeScript? */
-            if(object_name != NULL && (object = level_create_object(object_name, v2d_new(x, y))) != NULL) {
-                /* force this flag, so the port gets persisted */
-                entity_info_set_persistent(object, true);
-            }
-            else
-                level_create_legacy_item(type, v2d_new(x, y)); /* no; create legacy item */
+            levelspawn_t spawn = {
+                .type = SPAWN_LEGACYITEM,
+                .id = atoi(param[0]),
+                .x = atoi(param[1]),
+                .y = atoi(param[2])
+            };
+
+            add_to_snapshot(snapshot, spawn, NULL);
         }
         else
             logfile_message("Level loader - command '%s' expects three parameters: type, xpos, ypos", command_name);
@@ -1141,7 +1286,7 @@ bool level_interpret_body_line(const char* filepath, int fileline, levparser_com
  */
 bool level_save_ssobject(surgescript_object_t* object, void* param)
 {
-    ALLEGRO_FILE* fp = (ALLEGRO_FILE*)param;
+    levwriter_t* writer = (levwriter_t*)param;
 
     if(surgescript_object_is_killed(object))
         return false;
@@ -1152,7 +1297,7 @@ bool level_save_ssobject(surgescript_object_t* object, void* param)
             v2d_t spawn_point = entity_info_spawnpoint(object);
             uint64_t entity_id = entity_info_id(object);
 
-            al_fprintf(fp, "entity \"%s\" %d %d \"%s\"\n", str_addslashes(object_name, NULL, 0), (int)spawn_point.x, (int)spawn_point.y, x64_to_str(entity_id, NULL, 0));
+            levwriter_printf(writer, "entity \"%s\" %d %d \"%s\"\n", str_addslashes(object_name, NULL, 0), (int)spawn_point.x, (int)spawn_point.y, x64_to_str(entity_id, NULL, 0));
         }
     }
 
@@ -1201,6 +1346,10 @@ void level_init(void *path_to_lev_file)
 
     /* create the brick manager */
     brick_manager = brickmanager_create();
+    brick_cache = brickcache_create();
+
+    /* memory for transient data */
+    frame_arena = arena_create(0);
 
     /* dialog box */
     dlgbox_active = FALSE;
@@ -1220,11 +1369,13 @@ void level_init(void *path_to_lev_file)
     mobilegamepad_fadein();
 
     camera_init();
+    reset_camera_prediction();
     entitymanager_init();
     create_obstaclemap();
 
     /* load level file */
     level_load(filepath);
+    levpreload_finish();
 
     /* editor */
     editor_init();
@@ -1252,7 +1403,7 @@ void level_release()
 
     /* save prefs */
     extern prefs_t* prefs;
-    prefs_save(prefs);
+    prefs_flush(prefs);
 
     /* immersive mode */
     video_set_immersive(was_immersive);
@@ -1264,6 +1415,9 @@ void level_release()
     /* release the editor */
     editor_release();
 
+    /* finish saving the level, if needed */
+    levwriter_wait();
+
     /* unload the level and its scripts */
     level_unload();
 
@@ -1274,8 +1428,12 @@ void level_release()
 
     /* release the brick manager and all bricks */
     logfile_message("Releasing the brick manager...");
+    brick_cache = brickcache_destroy(brick_cache);
     brick_manager = brickmanager_destroy(brick_manager);
 
+    /* release the memory for transient data */
+    frame_arena = arena_destroy(frame_arena);
+
     /* quit level img */
     if(quit_level_img != NULL)
         image_destroy(quit_level_img);
@@ -1290,6 +1448,10 @@ void level_release()
 
     clear_level_state(&saved_state);
 
+    /* keep the snapshot only if we're restarting the level */
+    if(!wants_snapshot)
+        release_snapshot(&snapshot);
+
     /* render queue */
     renderqueue_release();
 
@@ -1330,10 +1492,23 @@ void level_update()
     v2d_t cam = level_editmode() ? editor_camera : camera_get_position();
     (void)dt;
 
+    /* release the transient data of the previous frame */
+    arena_reset(frame_arena);
+
+    /* save the state of the previous frame for interpolated rendering */
+    camera_save_position();
+
+    /* preload the next level of the quest, if any */
+    levpreload_update();
+
+    /* clean up a finished level save, if any */
+    levwriter_is_writing();
+
     /* legacy: release entities */
     entitymanager_remove_dead_bricks();
     entitymanager_remove_dead_items();
     entitymanager_remove_dead_objects();
+    clear_obstaclemap(); /* it may refer to the cached obstacles of the released entities */
 
     /* next stage in the quest... */
     if(jump_to_next_stage) {
@@ -1475,6 +1650,9 @@ void level_update()
             camera_move_to(camera_focus->position, 0.0f); /* the camera will be locked on its focus (usually, the player) */
     }
 
+    /* page the chunks of the level in and out */
+    update_stream(cam, predicted_camera_position());
+
     /* getting the major entities */
     rect_t brick_roi = create_roi(cam, ROI_MARGIN_UPDATE_BRICK);
     rect_t entity_roi = create_roi(cam, ROI_MARGIN_UPDATE_ENTITY);
@@ -1485,7 +1663,7 @@ void level_update()
 
     major_enemies = entitymanager_retrieve_active_objects();
     major_items = entitymanager_retrieve_active_items();
-    major_bricks = major_enemies != NULL || major_items != NULL ? brickmanager_retrieve_active_bricks_as_list(brick_manager) : NULL; /* for backwards compatibility only */
+    major_bricks = NULL; /* legacy entities query the bricks with level_legacy_bricks_in_rect() */
 
     /* update legacy items */
     for(inode = major_items; inode != NULL; inode = inode->next) {
@@ -1532,14 +1710,32 @@ void level_update()
     }
 
     /* update bricks */
-    iterator_t* brick_iterator = brickmanager_retrieve_active_moving_bricks(brick_manager);
-    while(iterator_has_next(brick_iterator)) {
-        /* no need to update static bricks.
-           We won't even retrieve them! */
-        brick_t* brick = iterator_next(brick_iterator);
-        brick_update(brick, team, team_size);
+    int moving_brick_count = 0;
+    brick_t* const* moving_brick = brickmanager_retrieve_active_moving_bricks_span(brick_manager, &moving_brick_count);
+    if(moving_brick_count > 0) {
+        rect_t player_area[TEAM_MAX];
+        player_t* nearby_player[TEAM_MAX];
+
+        /* compute the bounding boxes of the players once. Moving bricks may
+           displace the players a bit, but the interaction areas have margins */
+        for(i = 0; i < team_size; i++)
+            player_area[i] = player_bounding_box(team[i]);
+
+        for(i = 0; i < moving_brick_count; i++) {
+            /* no need to update static bricks.
+               We won't even retrieve them! */
+            rect_t area = brick_interaction_area(moving_brick[i]);
+            int nearby_count = 0;
+
+            /* the player-dependent logic of a brick only considers the players nearby */
+            for(int j = 0; j < team_size; j++) {
+                if(rect_overlaps(area, player_area[j]))
+                    nearby_player[nearby_count++] = team[j];
+            }
+
+            brick_update(moving_brick[i], nearby_player, nearby_count);
+        }
     }
-    iterator_destroy(brick_iterator);
 
     /* early update: players */
     if(brickmanager_number_of_bricks(brick_manager) > 0) {
@@ -1549,8 +1745,11 @@ void level_update()
 
     /* update the obstacle map */
     update_obstaclemap(major_items, major_enemies);
+    metrics_count(METRIC_BRICKS, brickmanager_number_of_bricks(brick_manager));
 
     /* update scripts */
+    framebudget_begin();
+    early_update_ssobjects();
     update_ssobjects();
 
     /* update the obstacle map again after updating the scripts */
@@ -1559,8 +1758,14 @@ void level_update()
         is_obstaclemap_dirty = false;
     }
 
+    /* check the collisions of the sensors of the scripts */
+    scripting_sensor_update_batch();
+
     /* update players */
     if(brickmanager_number_of_bricks(brick_manager) > 0) {
+        player_t* active_player[TEAM_MAX];
+        int active_count = 0;
+
         for(i = 0; i < team_size; i++) {
             v2d_t cam = camera_get_position();
             v2d_t pos = player_position(team[i]);
@@ -1570,9 +1775,11 @@ void level_update()
             /* updating... */
             if(rect_overlaps(roi, box) || player_is_dying(team[i]) || pos.y < 0) {
                 if(!got_dying_player || player_is_dying(team[i]) || player_is_getting_hit(team[i]))
-                    player_update(team[i], obstaclemap);
+                    active_player[active_count++] = team[i];
             }
         }
+
+        player_update_team(active_player, active_count, obstaclemap);
     }
 
     /* some objects are attached to the player... */
@@ -1595,9 +1802,12 @@ void level_update()
 
     /* update camera */
     camera_update();
+    update_camera_prediction();
+    audio_set_listener(camera_get_position());
 
     /* scripting: late update */
     late_update_ssobjects();
+    framebudget_end();
 
     /* update dialog box */
     update_dialogregions();
@@ -1608,7 +1818,6 @@ void level_update()
         level_timer += timer_get_delta();
 
     /* release major entities */
-    major_bricks = brickmanager_release_list(major_bricks);
     major_items = entitymanager_release_retrieved_item_list(major_items);
     major_enemies = entitymanager_release_retrieved_object_list(major_enemies);
 }
@@ -1754,6 +1963,26 @@ int level_persist()
     return level_save(file);
 }
 
+/*
+ * level_set_streaming()
+ * Enables or disables the streaming of the levels that are loaded from now
+ * on. The bricks & the entities of a streamed level are paged in and out
+ * around the camera, so that memory stays bounded in very large levels
+ */
+void level_set_streaming(bool streaming)
+{
+    wants_streaming = streaming;
+}
+
+/*
+ * level_is_streaming()
+ * Is the current level being streamed?
+ */
+bool level_is_streaming()
+{
+    return stream.is_enabled;
+}
+
 /*
  * level_change()
  * Changes the level.
@@ -1973,6 +2202,17 @@ void level_set_obstaclemap_dirty()
     is_obstaclemap_dirty = true;
 }
 
+/*
+ * level_legacy_bricks_in_rect()
+ * The active bricks that intersect a rectangle in world space. Legacy
+ * entities query the bricks around them instead of walking a list of all
+ * active bricks. The array is valid until the next call
+ */
+brick_t* const* level_legacy_bricks_in_rect(int x, int y, int width, int height, int* brick_count)
+{
+    return brickmanager_retrieve_active_bricks_in_rect_span(brick_manager, rect_new(x, y, width, height), brick_count);
+}
+
 
 /*
  * level_add_to_score()
@@ -2108,6 +2348,14 @@ void level_clear(actor_t *end_sign)
 
     /* success! */
     level_cleared = TRUE;
+
+    /* preload the next level while the current one ends */
+    const quest_t* quest = quest_current();
+    if(quest != NULL) {
+        int next = quest_next_level();
+        if(next < quest_entry_count(quest) && quest_entry_is_level(quest, next))
+            levpreload_start(quest_entry_path(quest, next));
+    }
 }
 
 
@@ -2171,6 +2419,32 @@ int level_inside_screen(int x, int y, int w, int h)
 }
 
 
+/*
+ * level_visibility_epoch()
+ * A non-zero number that changes whenever the results of level_inside_screen()
+ * may change, i.e., on each new frame and whenever the camera moves. This
+ * lets us test the visibility of an object once per frame and camera
+ */
+uint32_t level_visibility_epoch()
+{
+    static uint32_t epoch = 0;
+    static int64_t epoch_frame = -1;
+    static v2d_t epoch_camera;
+    v2d_t cam = level_editmode() ? editor_camera : camera_get_position();
+    int64_t frame = timer_get_frames();
+
+    if(frame != epoch_frame || cam.x != epoch_camera.x || cam.y != epoch_camera.y) {
+        if(++epoch == 0)
+            epoch = 1;
+
+        epoch_frame = frame;
+        epoch_camera = cam;
+    }
+
+    return epoch;
+}
+
+
 /*
  * level_has_been_cleared()
  * Has this level been cleared?
@@ -2465,10 +2739,34 @@ int inside_screen(int x, int y, int w, int h, int margin)
 }
 
 
+/* adds the bricks read from the .lev file to the brick manager */
+void add_pending_bricks()
+{
+    brickmanager_add_bricks(brick_manager, pending_bricks, darray_length(pending_bricks));
+    darray_clear(pending_bricks);
+}
+
 /* recalculates the size of the current level */
 void update_level_size()
 {
+    v2d_t size;
+
     brickmanager_recalculate_world_size(brick_manager);
+
+    /* account for the bricks that are paged out */
+    if(stream.is_enabled) {
+        for(int j = 0; j < darray_length(stream.entry); j++) {
+            const levelspawn_t* spawn = &snapshot.spawn[stream.entry[j].spawn];
+
+            if(spawn->type == SPAWN_BRICK) {
+                const image_t* img = brick_image_preview(spawn->id);
+                brickmanager_extend_world_size(brick_manager, rect_new(spawn->x, spawn->y, image_width(img), image_height(img)));
+            }
+        }
+    }
+
+    size = level_size();
+    entitymanager_set_world_size((int)size.x, (int)size.y); /* legacy */
 }
 
 
@@ -2482,6 +2780,9 @@ void restart(int preserve_level_state)
     /* copy the filepath before the level fields are cleared */
     str_cpy(path, file, sizeof(path));
 
+    /* restore the level from memory if it's the same */
+    wants_snapshot = preserve_level_state;
+
     /* restart the scene */
     scenestack_pop();
     scenestack_push(
@@ -2513,16 +2814,23 @@ void update_music()
 /* renders the bricks */
 void render_bricks()
 {
-    iterator_t* it = brickmanager_retrieve_active_bricks(brick_manager);
-    while(iterator_has_next(it)) {
-        brick_t* brick = iterator_next(it);
+    int brick_count = 0;
+    brick_t* const* brick = brickmanager_retrieve_active_bricks_span(brick_manager, &brick_count);
 
-        renderqueue_enqueue_brick(brick);
+    for(int i = 0; i < brick_count; i++) {
+        /* bakeable bricks are rendered by the brick cache */
+        if(!WANT_BRICK_CACHE || !brickcache_is_bakeable(brick[i]))
+            renderqueue_enqueue_brick(brick[i]);
 
         if(must_render_brick_masks)
-            renderqueue_enqueue_brick_mask(brick);
+            renderqueue_enqueue_brick_mask(brick[i]);
+    }
+
+    /* render the chunks of baked bricks. This invalidates the span */
+    if(WANT_BRICK_CACHE) {
+        brickcache_render(brick_cache, brick_manager, camera_get_position());
+        brickcache_prefetch(brick_cache, brick_manager, predicted_camera_position());
     }
-    iterator_destroy(it);
 }
 
 
@@ -2780,6 +3088,442 @@ void clear_level_state(levelstate_t* state)
 
 
 
+/* level snapshot */
+
+/* start recording the spawn tables of a level */
+void init_snapshot(levelsnapshot_t* snapshot, const char* filepath)
+{
+    if(snapshot->spawn == NULL) {
+        darray_init(snapshot->spawn);
+        darray_init(snapshot->string);
+    }
+    else {
+        darray_clear(snapshot->spawn);
+        darray_clear(snapshot->string);
+    }
+
+    str_cpy(snapshot->file, filepath, sizeof(snapshot->file));
+    snapshot->is_valid = false;
+}
+
+/* release the snapshot */
+void release_snapshot(levelsnapshot_t* snapshot)
+{
+    if(snapshot->spawn != NULL) {
+        darray_release(snapshot->string);
+        darray_release(snapshot->spawn);
+    }
+
+    snapshot->is_valid = false;
+}
+
+/* record a spawn and carry it out */
+void add_to_snapshot(levelsnapshot_t* snapshot, levelspawn_t spawn, const char* name)
+{
+    /* store the name in the string pool */
+    if(name != NULL) {
+        spawn.name = darray_length(snapshot->string);
+        for(const char* p = name; *p; p++)
+            darray_push(snapshot->string, *p);
+        darray_push(snapshot->string, '\0');
+    }
+
+    /* the spawns are carried out after the level file is read */
+    darray_push(snapshot->spawn, spawn);
+}
+
+/* spawn a brick or an entity of the level. Returns the spawned
+   SurgeScript entity, if it's of type SPAWN_ENTITY, or NULL */
+surgescript_object_t* spawn_from_snapshot(const levelsnapshot_t* snapshot, const levelspawn_t* spawn)
+{
+    v2d_t position = v2d_new(spawn->x, spawn->y);
+    surgescript_object_t* entity = NULL;
+
+    /* entities may expect the bricks spawned so far to exist */
+    if(spawn->type != SPAWN_BRICK)
+        add_pending_bricks();
+
+    switch(spawn->type) {
+        case SPAWN_BRICK: {
+            if(brick_exists(spawn->id))
+                darray_push(pending_bricks, brick_create(spawn->id, position, spawn->layer, spawn->flip));
+            else
+                logfile_message("Level loader - invalid brick: %d", spawn->id);
+
+            break;
+        }
+
+        case SPAWN_ENTITY: {
+            const char* name = snapshot->string + spawn->name;
+            if(!is_setup_object(name)) {
+                surgescript_object_t* obj = spawn_entity(name, position);
+                if(obj != NULL) {
+                    if(!surgescript_object_has_tag(obj, "entity"))
+                        fatal_error("Level loader - can't spawn \"%s\": object is not an entity", name);
+                    else if(spawn->has_entity_id && entity_info_exists(obj))
+                        entity_info_set_id(obj, spawn->entity_id);
+
+                    entity = obj;
+                }
+                else {
+                    logfile_message("Level loader - can't spawn \"%s\": entity doesn't exist", name);
+                    video_showmessage("Entity \"%s\" doesn't exist!", name);
+                }
+            }
+
+            break;
+        }
+
+        case SPAWN_LEGACYOBJECT: {
+            const char* name = snapshot->string + spawn->name;
+            if(!is_setup_object(name)) {
+                surgescript_object_t* obj = level_create_object(name, position);
+                if(obj != NULL) {
+                    if(!surgescript_object_has_tag(obj, "entity"))
+                        fatal_error("Level loader - can't spawn \"%s\": object is not an entity", name);
+                }
+                else if(enemy_exists(name)) {
+                    enemy_t* e = level_create_legacy_object(name, position); /* old API */
+                    e->created_from_editor = TRUE;
+                }
+                else {
+                    logfile_message("Level loader - can't spawn \"%s\": object doesn't exist", name);
+                    video_showmessage("Entity \"%s\" doesn't exist!", name);
+                }
+            }
+
+            break;
+        }
+
+        case SPAWN_LEGACYITEM: {
+            surgescript_object_t* object = NULL;
+            const char* object_name = item2surgescript(spawn->id); /* legacy item ported to SurgeScript? */
+            if(object_name != NULL && (object = level_create_object(object_name, position)) != NULL) {
+                /* force this flag, so the port gets persisted */
+                entity_info_set_persistent(object, true);
+            }
+            else
+                level_create_legacy_item(spawn->id, position); /* no; create legacy item */
+
+            break;
+        }
+    }
+
+    return entity;
+}
+
+
+
+/* level streaming */
+
+/* split the bricks & the entities of the snapshot into chunks */
+void init_stream(const levelsnapshot_t* snapshot)
+{
+    darray_init(stream.chunk);
+    darray_init(stream.entry);
+    darray_init(stream.resident);
+    darray_init(stream.alive_brick);
+    stream.brick_margin = 0;
+
+    /* collect the streamable spawns */
+    for(int i = 0; i < darray_length(snapshot->spawn); i++) {
+        const levelspawn_t* spawn = &snapshot->spawn[i];
+        if(!is_streamable(spawn))
+            continue;
+
+        /* invalid bricks are skipped */
+        if(spawn->type == SPAWN_BRICK) {
+            if(!brick_exists(spawn->id)) {
+                logfile_message("Level loader - invalid brick: %d", spawn->id);
+                continue;
+            }
+
+            const image_t* img = brick_image_preview(spawn->id);
+            stream.brick_margin = max(stream.brick_margin, max(image_width(img), image_height(img)));
+        }
+
+        levelstreamentry_t entry = { .spawn = i, .entity_id = 0, .is_gone = false };
+        darray_push(stream.entry, entry);
+    }
+
+    /* group the entries by chunk, keeping the order of the .lev file */
+    qsort(stream.entry, darray_length(stream.entry), sizeof(levelstreamentry_t), streamentry_cmp);
+
+    for(int i = 0; i < darray_length(stream.entry); i++) {
+        const levelspawn_t* spawn = &snapshot->spawn[stream.entry[i].spawn];
+        int x = chunk_coordinate(spawn->x), y = chunk_coordinate(spawn->y);
+        levelchunk_t* last = darray_length(stream.chunk) > 0 ? &stream.chunk[darray_length(stream.chunk) - 1] : NULL;
+
+        if(last != NULL && last->x == x && last->y == y) {
+            last->entry_count++;
+            continue;
+        }
+
+        levelchunk_t chunk = { .x = x, .y = y, .first_entry = i, .entry_count = 1, .is_resident = false };
+        darray_push(stream.chunk, chunk);
+    }
+
+    logfile_message("Streaming the level: %d spawns in %d chunks", darray_length(stream.entry), darray_length(stream.chunk));
+}
+
+/* release the data of the stream. The resident chunks are not paged out */
+void release_stream()
+{
+    if(stream.chunk != NULL) {
+        darray_release(stream.alive_brick);
+        darray_release(stream.resident);
+        darray_release(stream.entry);
+        darray_release(stream.chunk);
+    }
+
+    stream.is_enabled = false;
+}
+
+/* page in the chunks near the region of interest and its prediction,
+   and page out the chunks that are far from them */
+void update_stream(v2d_t camera, v2d_t predicted_camera)
+{
+    if(!stream.is_enabled)
+        return;
+
+    /* the area of interest */
+    rect_t roi = create_roi(camera, ROI_MARGIN_UPDATE_BRICK);
+    rect_t predicted_roi = create_roi(predicted_camera, ROI_MARGIN_UPDATE_BRICK);
+    int left = min(roi.x, predicted_roi.x);
+    int top = min(roi.y, predicted_roi.y);
+    int right = max(roi.x + roi.width, predicted_roi.x + predicted_roi.width);
+    int bottom = max(roi.y + roi.height, predicted_roi.y + predicted_roi.height);
+
+    /* page out the chunks that are far away */
+    rect_t keep = rect_new(
+        left - STREAM_MARGIN_PAGEOUT, top - STREAM_MARGIN_PAGEOUT,
+        (right - left) + 2 * STREAM_MARGIN_PAGEOUT, (bottom - top) + 2 * STREAM_MARGIN_PAGEOUT
+    );
+
+    for(int i = darray_length(stream.resident) - 1; i >= 0; i--) {
+        levelchunk_t* chunk = &stream.chunk[stream.resident[i]];
+
+        if(!rect_overlaps(chunk_area(chunk), keep)) {
+            page_out_chunk(chunk);
+            darray_remove_unordered(stream.resident, i);
+        }
+    }
+
+    /* page in the chunks that are near. A chunk holds bricks
+       that extend up to brick_margin pixels beyond its area */
+    rect_t want = rect_new(
+        left - STREAM_MARGIN_PAGEIN, top - STREAM_MARGIN_PAGEIN,
+        (right - left) + 2 * STREAM_MARGIN_PAGEIN, (bottom - top) + 2 * STREAM_MARGIN_PAGEIN
+    );
+
+    int first_x = chunk_coordinate(want.x - stream.brick_margin);
+    int first_y = chunk_coordinate(want.y - stream.brick_margin);
+    int last_x = chunk_coordinate(want.x + want.width - 1);
+    int last_y = chunk_coordinate(want.y + want.height - 1);
+
+    for(int y = first_y; y <= last_y; y++) {
+        for(int x = first_x; x <= last_x; x++) {
+            levelchunk_t* chunk = find_chunk(x, y);
+
+            if(chunk != NULL && !chunk->is_resident && rect_overlaps(chunk_area(chunk), want)) {
+                page_in_chunk(chunk);
+                darray_push(stream.resident, (int)(chunk - stream.chunk));
+            }
+        }
+    }
+}
+
+/* page in all chunks and stop streaming the level, e.g., before editing it */
+void finish_stream()
+{
+    if(!stream.is_enabled)
+        return;
+
+    logfile_message("Paging in the whole level");
+
+    for(int i = 0; i < darray_length(stream.chunk); i++) {
+        if(!stream.chunk[i].is_resident)
+            page_in_chunk(&stream.chunk[i]);
+    }
+
+    release_stream();
+    update_level_size();
+}
+
+/* spawn the bricks & the entities of a chunk */
+void page_in_chunk(levelchunk_t* chunk)
+{
+    darray_init(pending_bricks);
+    entitymanager_begin_bulk_spawn(entitymanager_ssobject(), chunk->entry_count);
+
+    for(int j = 0; j < chunk->entry_count; j++) {
+        levelstreamentry_t* entry = &stream.entry[chunk->first_entry + j];
+        if(entry->is_gone)
+            continue;
+
+        /* an entity keeps its ID across page-ins */
+        levelspawn_t spawn = snapshot.spawn[entry->spawn];
+        if(spawn.type == SPAWN_ENTITY && entry->entity_id != 0) {
+            spawn.has_entity_id = true;
+            spawn.entity_id = entry->entity_id;
+        }
+
+        surgescript_object_t* entity = spawn_from_snapshot(&snapshot, &spawn);
+        if(spawn.type == SPAWN_ENTITY) {
+            if(entity != NULL && entity_info_exists(entity))
+                entry->entity_id = entity_info_id(entity);
+            else
+                entry->is_gone = true;
+        }
+    }
+
+    add_pending_bricks();
+    entitymanager_end_bulk_spawn(entitymanager_ssobject());
+    darray_release(pending_bricks);
+
+    chunk->is_resident = true;
+}
+
+/* remove the bricks & the entities of a chunk, saving their state: bricks
+   and entities that have been destroyed in the game are not spawned again */
+void page_out_chunk(levelchunk_t* chunk)
+{
+    surgescript_object_t* entity_manager = entitymanager_ssobject();
+    surgescript_objectmanager_t* manager = surgescript_vm_objectmanager(surgescript_vm());
+    rect_t area = rect_new(chunk->x * STREAM_CHUNK_SIZE, chunk->y * STREAM_CHUNK_SIZE, STREAM_CHUNK_SIZE, STREAM_CHUNK_SIZE);
+
+    /* remove the bricks, collecting the ones that are alive */
+    darray_clear(stream.alive_brick);
+    brickmanager_remove_bricks_in_rect(brick_manager, area, collect_alive_brick, NULL);
+    qsort(stream.alive_brick, darray_length(stream.alive_brick), sizeof(levelbrickkey_t), brickkey_cmp);
+
+    for(int j = 0; j < chunk->entry_count; j++) {
+        levelstreamentry_t* entry = &stream.entry[chunk->first_entry + j];
+        const levelspawn_t* spawn = &snapshot.spawn[entry->spawn];
+        if(entry->is_gone)
+            continue;
+
+        /* was the brick broken? */
+        if(spawn->type == SPAWN_BRICK) {
+            levelbrickkey_t key = { .id = spawn->id, .x = spawn->x, .y = spawn->y };
+            entry->is_gone = (NULL == bsearch(&key, stream.alive_brick, darray_length(stream.alive_brick), sizeof(levelbrickkey_t), brickkey_cmp));
+            continue;
+        }
+
+        /* was the entity destroyed? */
+        surgescript_objecthandle_t handle = entitymanager_find_entity_by_id(entity_manager, entry->entity_id);
+        if(!surgescript_objectmanager_exists(manager, handle)) {
+            entry->is_gone = true;
+            continue;
+        }
+
+        /* entities that are active or that are meant to be active are handed
+           over to the level: they stay in memory and aren't spawned again */
+        surgescript_object_t* entity = surgescript_objectmanager_get(manager, handle);
+        bool is_detached = false;
+        entitymanager_is_entity_effectively_detached(entity_manager, handle, &is_detached);
+        if(is_detached || surgescript_object_has_tag(entity, "awake") || !entitymanager_is_entity_sleeping(entity_manager, handle)) {
+            entry->is_gone = true;
+            continue;
+        }
+
+        /* page out the entity */
+        surgescript_object_kill(entity);
+    }
+
+    chunk->is_resident = false;
+}
+
+/* collects the bricks that are alive */
+void collect_alive_brick(const brick_t* brick, void* data)
+{
+    v2d_t spawn_point = brick_spawnpoint(brick);
+    levelbrickkey_t key = { .id = brick_id(brick), .x = (int)spawn_point.x, .y = (int)spawn_point.y };
+
+    darray_push(stream.alive_brick, key);
+    (void)data;
+}
+
+/* find a non-empty chunk given its coordinates */
+levelchunk_t* find_chunk(int x, int y)
+{
+    int lo = 0, hi = darray_length(stream.chunk) - 1;
+
+    while(lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        levelchunk_t* chunk = &stream.chunk[mid];
+
+        if(chunk->y < y || (chunk->y == y && chunk->x < x))
+            lo = mid + 1;
+        else if(chunk->y > y || (chunk->y == y && chunk->x > x))
+            hi = mid - 1;
+        else
+            return chunk;
+    }
+
+    return NULL;
+}
+
+/* the area in world space that may be covered by the bricks of a chunk */
+rect_t chunk_area(const levelchunk_t* chunk)
+{
+    return rect_new(
+        chunk->x * STREAM_CHUNK_SIZE,
+        chunk->y * STREAM_CHUNK_SIZE,
+        STREAM_CHUNK_SIZE + stream.brick_margin,
+        STREAM_CHUNK_SIZE + stream.brick_margin
+    );
+}
+
+/* converts a world coordinate to a chunk coordinate, rounding down */
+int chunk_coordinate(int world_coordinate)
+{
+    if(world_coordinate >= 0)
+        return world_coordinate / STREAM_CHUNK_SIZE;
+    else
+        return -1 - (-1 - world_coordinate) / STREAM_CHUNK_SIZE;
+}
+
+/* bricks and entities are streamed. Legacy objects & items stay in memory */
+bool is_streamable(const levelspawn_t* spawn)
+{
+    return spawn->type == SPAWN_BRICK || spawn->type == SPAWN_ENTITY;
+}
+
+/* sorts stream entries by chunk (y, x), then by their order in the .lev file */
+int streamentry_cmp(const void* a, const void* b)
+{
+    const levelspawn_t* sa = &snapshot.spawn[((const levelstreamentry_t*)a)->spawn];
+    const levelspawn_t* sb = &snapshot.spawn[((const levelstreamentry_t*)b)->spawn];
+    int ya = chunk_coordinate(sa->y), yb = chunk_coordinate(sb->y);
+    int xa = chunk_coordinate(sa->x), xb = chunk_coordinate(sb->x);
+
+    if(ya != yb)
+        return ya < yb ? -1 : 1;
+    else if(xa != xb)
+        return xa < xb ? -1 : 1;
+
+    return ((const levelstreamentry_t*)a)->spawn - ((const levelstreamentry_t*)b)->spawn;
+}
+
+/* compares bricks of the level */
+int brickkey_cmp(const void* a, const void* b)
+{
+    const levelbrickkey_t* ka = (const levelbrickkey_t*)a;
+    const levelbrickkey_t* kb = (const levelbrickkey_t*)b;
+
+    if(ka->y != kb->y)
+        return ka->y < kb->y ? -1 : 1;
+    else if(ka->x != kb->x)
+        return ka->x < kb->x ? -1 : 1;
+    else if(ka->id != kb->id)
+        return ka->id < kb->id ? -1 : 1;
+
+    return 0;
+}
+
+
+
 /* region of interest */
 
 /* create a region of interest */
@@ -2798,14 +3542,56 @@ rect_t create_roi(v2d_t camera, int margin)
 }
 
 
+
+/* camera prediction */
+
+/* resets the prediction of the position of the camera */
+void reset_camera_prediction()
+{
+    prev_camera_position = camera_get_position();
+    camera_velocity = v2d_new(0.0f, 0.0f);
+}
+
+/* estimates the velocity of the camera. Call once per frame, after updating the camera */
+void update_camera_prediction()
+{
+    const float smoothing = 0.25f; /* weight of the current frame */
+    v2d_t camera_position = camera_get_position();
+    v2d_t delta = v2d_subtract(camera_position, prev_camera_position);
+    v2d_t screen_size = video_get_screen_size();
+    float dt = timer_get_delta();
+
+    prev_camera_position = camera_position;
+
+    /* the camera has been teleported: don't predict anything */
+    if(fabsf(delta.x) >= screen_size.x || fabsf(delta.y) >= screen_size.y) {
+        camera_velocity = v2d_new(0.0f, 0.0f);
+        return;
+    }
+
+    /* smooth the velocity */
+    if(dt > 0.0f)
+        camera_velocity = v2d_lerp(camera_velocity, v2d_multiply(delta, 1.0f / dt), smoothing);
+}
+
+/* the position of the camera in the near future */
+v2d_t predicted_camera_position()
+{
+    return v2d_add(camera_get_position(), v2d_multiply(camera_velocity, CAMERA_PREDICTION_TIME));
+}
+
+
 /* obstacle map */
 
 /* create the obstacle map */
 void create_obstaclemap()
 {
     is_obstaclemap_dirty = false;
+    are_persistent_obstacles_valid = false;
     obstaclemap = obstaclemap_create();
     darray_init(mock_obstacles);
+    darray_init(floating_obstacles);
+    mock_obstacle_arena = arena_create(0);
 }
 
 /* destroy the obstacle map */
@@ -2814,6 +3600,8 @@ void destroy_obstaclemap()
     for(int i = 0; i < darray_length(mock_obstacles); i++)
         obstacle_destroy(mock_obstacles[i]);
     darray_release(mock_obstacles);
+    mock_obstacle_arena = arena_destroy(mock_obstacle_arena);
+    darray_release(floating_obstacles);
 
     obstaclemap_destroy(obstaclemap);
     obstaclemap = NULL;
@@ -2821,7 +3609,7 @@ void destroy_obstaclemap()
     is_obstaclemap_dirty = false;
 }
 
-/* clear the obstacle map */
+/* clear the obstacle map, except for the persistent obstacles */
 void clear_obstaclemap()
 {
     obstaclemap_clear(obstaclemap);
@@ -2829,29 +3617,60 @@ void clear_obstaclemap()
     for(int i = 0; i < darray_length(mock_obstacles); i++)
         obstacle_destroy(mock_obstacles[i]);
     darray_clear(mock_obstacles);
+    arena_reset(mock_obstacle_arena);
 }
 
 /* update the obstacle map */
 void update_obstaclemap(const item_list_t* item_list, const object_list_t* object_list)
 {
     const surgescript_objectmanager_t* manager = surgescript_object_manager(level_ssobject());
+    profiler_begin("update_obstaclemap");
 
     /* clear the obstacle map */
     clear_obstaclemap();
 
-    /* add bricks */
-    iterator_t* brick_iterator = brickmanager_retrieve_active_bricks(brick_manager);
-    while(iterator_has_next(brick_iterator)) {
-        const brick_t* brick = iterator_next(brick_iterator);
-        const obstacle_t* obstacle = brick_obstacle(brick);
+    /* add static bricks as persistent obstacles. We do this only if they have
+       changed, i.e., if they have entered or left the ROI or if they have been
+       killed. The obstacle map will not be partitioned again if they haven't */
+    unsigned static_bricks_version = brickmanager_static_bricks_version(brick_manager);
+    if(!are_persistent_obstacles_valid || static_bricks_version != persistent_obstacles_version) {
+        int static_brick_count = 0;
+        brick_t* const* static_brick = brickmanager_retrieve_static_bricks_span(brick_manager, &static_brick_count);
+
+        obstaclemap_clear_persistent(obstaclemap);
+        darray_clear(floating_obstacles);
+        for(int i = 0; i < static_brick_count; i++) {
+            const obstacle_t* obstacle = brick_obstacle(static_brick[i]);
+
+            if(obstacle == NULL)
+                continue;
+            else if(brick_behavior(static_brick[i]) == BRB_FLOAT) /* moves vertically */
+                darray_push(floating_obstacles, obstacle);
+            else
+                obstaclemap_add_persistent(obstaclemap, obstacle);
+        }
+
+        persistent_obstacles_version = static_bricks_version;
+        are_persistent_obstacles_valid = true;
+    }
+
+    /* add floating bricks */
+    for(int i = 0; i < darray_length(floating_obstacles); i++)
+        obstaclemap_add(obstaclemap, floating_obstacles[i]);
+
+    /* add moving bricks */
+    int brick_count = 0;
+    brick_t* const* brick = brickmanager_retrieve_active_awake_bricks_span(brick_manager, &brick_count);
+    for(int i = 0; i < brick_count; i++) {
+        const obstacle_t* obstacle = brick_obstacle(brick[i]);
 
         if(obstacle != NULL)
             obstaclemap_add(obstaclemap, obstacle);
     }
-    iterator_destroy(brick_iterator);
 
     /* add brick-like objects */
-    iterator_t* bricklike_iterator = entitymanager_bricklike_iterator(entitymanager_ssobject());
+    iteratorstorage_t storage;
+    iterator_t* bricklike_iterator = entitymanager_bricklike_iterator_inplace(entitymanager_ssobject(), &storage);
     while(iterator_has_next(bricklike_iterator)) {
         surgescript_objecthandle_t* bricklike_handle = iterator_next(bricklike_iterator);
 
@@ -2868,48 +3687,25 @@ void update_obstaclemap(const item_list_t* item_list, const object_list_t* objec
     }
     iterator_destroy(bricklike_iterator);
 
-    /* add legacy items */
+    /* add legacy items. Their obstacles are cached */
     for(; item_list; item_list = item_list->next) {
-        const item_t* item = item_list->data;
+        const obstacle_t* obstacle = item_obstacle(item_list->data);
 
-        if(item->obstacle && item->mask) {
-            obstacle_t* mock_obstacle = item2obstacle(item);
-
-            darray_push(mock_obstacles, mock_obstacle);
-            obstaclemap_add(obstaclemap, mock_obstacle);
-        }
+        if(obstacle != NULL)
+            obstaclemap_add(obstaclemap, obstacle);
     }
 
     /* add legacy objects */
     for(; object_list; object_list = object_list->next) {
-        const object_t* object = object_list->data;
-
-        if(object->obstacle && object->mask) {
-            obstacle_t* mock_obstacle = object2obstacle(object);
+        const obstacle_t* obstacle = enemy_obstacle(object_list->data);
 
-            darray_push(mock_obstacles, mock_obstacle);
-            obstaclemap_add(obstaclemap, mock_obstacle);
-        }
+        if(obstacle != NULL)
+            obstaclemap_add(obstaclemap, obstacle);
     }
 
     /* build the obstacle map */
     obstaclemap_build(obstaclemap);
-}
-
-/* converts a legacy item to an obstacle */
-obstacle_t* item2obstacle(const item_t* item)
-{
-    const collisionmask_t* mask = item->mask;
-    v2d_t position = v2d_subtract(item->actor->position, item->actor->hot_spot);
-    return obstacle_create(mask, point2d_new(position.x, position.y), OL_DEFAULT, OF_NONSTATIC);
-}
-
-/* converts a legacy object to an obstacle */
-obstacle_t* object2obstacle(const object_t* object)
-{
-    const collisionmask_t* mask = object->mask;
-    v2d_t position = v2d_subtract(object->actor->position, object->actor->hot_spot);
-    return obstacle_create(mask, point2d_new(position.x, position.y), OL_DEFAULT, OF_NONSTATIC);
+    profiler_end();
 }
 
 /* converts a brick-like SurgeScript object to an obstacle */
@@ -2924,7 +3720,8 @@ obstacle_t* bricklike2obstacle(const surgescript_object_t* object)
         flags |= OF_CLOUD;
 
     collisionmask_t* clone = create_collisionmask_of_bricklike_object(object);
-    return obstacle_create_ex(
+    return obstacle_create_in_arena(
+        mock_obstacle_arena,
         clone,
         point2d_new(position.x, position.y),
         layer, flags,
@@ -2938,7 +3735,7 @@ collisionmask_t* create_collisionmask_of_bricklike_object(const surgescript_obje
     /* the following pointer is guaranteed to be valid during the lifetime of the obstacle_t,
        regardless of what happens with the brick-like object (i.e., it may get destroyed) */
     const collisionmask_t* mask = scripting_brick_mask(object); /* assumed to be valid */
-    return collisionmask_clone(mask); /* not very efficient, though */
+    return collisionmask_clone(mask); /* a cheap reference to the shared mask */
 }
 
 /* destroys a collision mask created for a brick-like SurgeScript object */
@@ -2970,13 +3767,32 @@ surgescript_object_t* entitymanager_ssobject()
     return cached_entity_manager;
 }
 
-/* update SurgeScript */
+/* update SurgeScript. The update runs in the main thread: the SurgeScript VM
+   is not reentrant (the object manager, the heaps, the garbage collector and
+   the call stacks are shared by all objects), so the state:main of different
+   entities can't run concurrently. Reducing the update cost of entities that
+   are away from the camera is done via "drowsy" entities instead */
 void update_ssobjects()
 {
     surgescript_vm_t* vm = surgescript_vm();
 
     if(surgescript_vm_is_active(vm)) {
+        profiler_begin("update_ssobjects");
+        benchmark_begin(BENCHMARK_SCRIPTING);
         surgescript_vm_update(vm);
+        benchmark_end(BENCHMARK_SCRIPTING);
+        profiler_end();
+    }
+}
+
+/* call earlyUpdate() for each SurgeScript entity that implements it */
+void early_update_ssobjects()
+{
+    surgescript_vm_t* vm = surgescript_vm();
+
+    if(surgescript_vm_is_active(vm)) {
+        surgescript_object_t* entity_manager = entitymanager_ssobject();
+        surgescript_object_call_function(entity_manager, "earlyUpdate", NULL, 0, NULL);
     }
 }
 
@@ -3072,6 +3888,21 @@ surgescript_object_t* spawn_ssobject(const char* object_name, v2d_t spawn_point)
     return surgescript_objectmanager_get(manager, new_object_handle);
 }
 
+/* spawns an entity of the level file, bypassing Level.spawnEntity()
+   if possible. Returns NULL if the entity doesn't exist */
+surgescript_object_t* spawn_entity(const char* entity_name, v2d_t spawn_point)
+{
+    surgescript_object_t* entity_manager = entitymanager_ssobject();
+    surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
+    surgescript_objecthandle_t handle = entitymanager_spawn_entity(entity_manager, entity_name, spawn_point);
+
+    /* the regular path reports errors */
+    if(handle == surgescript_objectmanager_null(manager))
+        return spawn_ssobject(entity_name, spawn_point);
+
+    return surgescript_objectmanager_get(manager, handle);
+}
+
 /* notifies all SurgeScript entities of the level */
 void notify_ssobjects(const char* fun_name)
 {
@@ -3219,6 +4050,7 @@ void editor_init()
     /* intializing... */
     editor_enabled = false;
     editor_item_list_size = -1;
+    memset(editor_animation_cache, 0, sizeof(editor_animation_cache));
     while(editor_item_list[++editor_item_list_size] >= 0);
     editor_cursor_entity_type = EDT_BRICK;
     editor_cursor_entity_id = 0;
@@ -3339,7 +4171,7 @@ void editor_update()
 
         editor_disable();
         scenestack_pop();
-        scripting_reload();
+        scripting_reload_changed();
         scenestack_push(
             storyboard_get_scene(SCENE_LEVEL),
             path
@@ -3412,7 +4244,7 @@ void editor_update()
     /* get legacy entities */
     major_enemies = entitymanager_retrieve_active_objects();
     major_items = entitymanager_retrieve_active_items();
-    major_bricks = major_enemies != NULL || major_items != NULL ? brickmanager_retrieve_active_bricks_as_list(brick_manager) : NULL; /* for backwards compatibility only */
+    major_bricks = NULL; /* legacy entities query the bricks with level_legacy_bricks_in_rect() */
 
     /* update items */
     for(item_list_t* it=major_items; it!=NULL; it=it->next)
@@ -3515,34 +4347,23 @@ void editor_update()
             case EDT_BRICK: {
                 const brick_t* candidate = NULL;
                 bool candidate_got_collision = false;
-
-                iterator_t* it = brickmanager_retrieve_active_bricks(brick_manager);
-                while(iterator_has_next(it)) {
-                    const brick_t* brick = iterator_next(it);
-                    v2d_t brk_topleft = brick_position(brick);
-                    v2d_t brk_bottomright = v2d_add(brk_topleft, brick_size(brick));
-                    float a[4] = { brk_topleft.x, brk_topleft.y, brk_bottomright.x, brk_bottomright.y };
-                    float b[4] = { editor_cursor.x+topleft.x , editor_cursor.y+topleft.y , editor_cursor.x+topleft.x , editor_cursor.y+topleft.y };
-
-                    if(bounding_box(a,b)) {
-                        const obstacle_t* obstacle = brick_obstacle(brick);
-
-                        /* pick the best brick that is in front of the others */
-                        if(
-                            (candidate == NULL) ||
-                            (obstacle == NULL && !candidate_got_collision && (
-                                brick_obstacle(candidate) != NULL || brick_zindex(brick) >= brick_zindex(candidate)
-                            )) ||
-                            (obstacle != NULL && obstacle_got_collision(obstacle, b[0], b[1], b[2], b[3]) && (
-                                !candidate_got_collision || brick_zindex(brick) >= brick_zindex(candidate)
-                            ))
-                        ) {
-                            candidate = brick;
-                            candidate_got_collision = (obstacle != NULL) && obstacle_got_collision(obstacle, b[0], b[1], b[2], b[3]);
-                        }
-                    }
+                float b[4] = { editor_cursor.x+topleft.x , editor_cursor.y+topleft.y , editor_cursor.x+topleft.x , editor_cursor.y+topleft.y };
+                rect_t cursor_rect = rect_new((int)b[0] - 1, (int)b[1] - 1, 3, 3);
+                brick_t* const* brick;
+                int brick_count;
+
+                /* query the spatial index of the brick manager instead of
+                   scanning all bricks of the ROI. Static bricks are found
+                   by position; bricks with a movement path are few */
+                brick = brickmanager_retrieve_static_bricks_in_rect_span(brick_manager, cursor_rect, &brick_count);
+                for(int i = 0; i < brick_count; i++) {
+                    if(brick_is_alive(brick[i]))
+                        editor_pick_brick(brick[i], b, &candidate, &candidate_got_collision);
                 }
-                iterator_destroy(it);
+
+                brick = brickmanager_retrieve_active_awake_bricks_span(brick_manager, &brick_count);
+                for(int i = 0; i < brick_count; i++)
+                    editor_pick_brick(brick[i], b, &candidate, &candidate_got_collision);
 
                 if(candidate != NULL) {
                     if(pick_object) {
@@ -3707,7 +4528,6 @@ void editor_update()
     font_set_text(editor_properties_font, "$EDITOR_UI_TOOL");
 
     /* release major entities */
-    major_bricks = brickmanager_release_list(major_bricks);
     major_items = entitymanager_release_retrieved_item_list(major_items);
     major_enemies = entitymanager_release_retrieved_object_list(major_enemies);
 }
@@ -3781,6 +4601,9 @@ void editor_enable()
 {
     logfile_message("Entering the level editor");
 
+    /* the editor works with the whole level */
+    finish_stream();
+
     /* pause the SurgeScript VM */
     scripting_pause_vm();
 
@@ -4554,11 +5377,16 @@ int editor_brick_id(int index)
 void editor_grid_init()
 {
     editor_grid_size = 16;
+    editor_grid_image = NULL; /* created lazily */
 }
 
 /* releases the grid module */
 void editor_grid_release()
 {
+    if(editor_grid_image != NULL) {
+        image_destroy(editor_grid_image);
+        editor_grid_image = NULL;
+    }
 }
 
 /* updates the grid module */
@@ -4591,18 +5419,36 @@ void editor_grid_render()
     v2d_t topleft = v2d_subtract(editor_camera, v2d_new(VIDEO_SCREEN_W/2, VIDEO_SCREEN_H/2));
     const color_t color = color_rgb(255, 255, 255);
     const int grid_size = 128;
+    int width = VIDEO_SCREEN_W + grid_size;
+    int height = VIDEO_SCREEN_H + grid_size;
 
     /* no grid */
     if(!editor_grid_is_enabled())
         return;
 
-    /* render */
-    for(int x = 0; x < VIDEO_SCREEN_W + grid_size; x += grid_size) {
-        for(int y = 0; y < VIDEO_SCREEN_H + grid_size; y += grid_size) {
-            v2d_t grid = v2d_subtract(editor_grid_snap_ex(v2d_new(x, y), grid_size, grid_size), topleft);
-            image_rectfill(grid.x, grid.y, grid.x + 1, grid.y + 1, color);
+    /* the dots of the grid are drawn once to an image, which is then
+       rendered with a single draw call at an offset given by the camera */
+    if(editor_grid_image == NULL || image_width(editor_grid_image) != width || image_height(editor_grid_image) != height) {
+        image_t* prev_target = image_drawing_target();
+
+        if(editor_grid_image != NULL)
+            image_destroy(editor_grid_image);
+        editor_grid_image = image_create(width, height);
+
+        image_set_drawing_target(editor_grid_image);
+        image_clear(color_premul_rgba(0, 0, 0, 0));
+        for(int x = 0; x < width; x += grid_size) {
+            for(int y = 0; y < height; y += grid_size)
+                image_rectfill(x, y, x + 1, y + 1, color);
         }
+        image_set_drawing_target(prev_target);
+        video_use_default_shader();
     }
+
+    /* render. See editor_grid_snap_ex() */
+    int cx = (int)topleft.x % grid_size;
+    int cy = (int)topleft.y % grid_size;
+    image_draw(editor_grid_image, -cx, -cy, IF_NONE);
 }
 
 /* aligns position to a cell in the grid */
@@ -4928,22 +5774,15 @@ editor_action_t editor_action_waterlevel_new(int is_changing, int new_waterlevel
 /* initializes the editor_action module */
 void editor_action_init()
 {
-    /* linked list */
-    editor_action_buffer_head = mallocx(sizeof *editor_action_buffer_head);
-    editor_action_buffer_head->in_group = FALSE;
-    editor_action_buffer_head->prev = NULL;
-    editor_action_buffer_head->next = NULL;
-    editor_action_buffer = editor_action_buffer_head;
-    editor_action_buffer_cursor = editor_action_buffer_head;
+    darray_init(editor_action_history);
+    editor_action_cursor = 0;
 }
 
 /* releases the editor_action module */
 void editor_action_release()
 {
-    /* linked list */
-    editor_action_buffer_head = editor_action_delete_list(editor_action_buffer_head);
-    editor_action_buffer = NULL;
-    editor_action_buffer_cursor = NULL;
+    darray_release(editor_action_history);
+    editor_action_cursor = 0;
 }
 
 /* registers a new editor_action */
@@ -4955,30 +5794,24 @@ void editor_action_register(editor_action_t action)
     static uint32_t group_key;
 
     if(action.obj_type != EDT_GROUP) {
-        editor_action_list_t *c, *it, *node;
-
-        /* creating new node */
-        node = mallocx(sizeof *node);
-        node->action = action;
-        node->in_group = registering_group;
-        if(node->in_group)
-            node->group_key = group_key;
-
-        /* cursor */
-        c = editor_action_buffer_cursor;
-        if(c != NULL)
-            c->next = editor_action_delete_list(c->next);
-
-        /* inserting the node into the linked list */
-        it = editor_action_buffer;
-        while(it->next != NULL)
-            it = it->next;
-        it->next = node;
-        node->prev = it;
-        node->next = NULL;
-
-        /* updating the cursor */
-        editor_action_buffer_cursor = node;
+        editor_action_record_t record;
+
+        /* forget the actions that have been undone */
+        darray_resize(editor_action_history, editor_action_cursor);
+
+        /* merge consecutive changes of the same kind */
+        if(!registering_group && editor_action_coalesce(&action))
+            return;
+
+        /* add the action to the history */
+        record.action = action;
+        record.group_key = registering_group ? group_key : 0;
+        darray_push(editor_action_history, record);
+        editor_action_cursor = darray_length(editor_action_history);
+
+        /* bound the memory */
+        if(editor_action_cursor > EDITOR_ACTION_MAX_RECORDS && !registering_group)
+            editor_action_forget_oldest();
     }
     else {
         static uint32_t auto_increment = 0xbeef; /* dummy value */
@@ -4987,6 +5820,8 @@ void editor_action_register(editor_action_t action)
         /* registering a group of objects */
         registering_group = TRUE;
         group_key = auto_increment++;
+        if(group_key == 0)
+            group_key = auto_increment++;
         list = editorgrp_get_group(action.obj_id);
         for(it=list; it; it=it->next) {
             editor_action_t a;
@@ -4996,50 +5831,74 @@ void editor_action_register(editor_action_t action)
             editor_action_register(a);
         }
         registering_group = FALSE;
+
+        /* bound the memory */
+        if(editor_action_cursor > EDITOR_ACTION_MAX_RECORDS)
+            editor_action_forget_oldest();
     }
 }
 
-/* deletes an editor_action list */
-editor_action_list_t* editor_action_delete_list(editor_action_list_t *list)
+/* merges a change of the spawn point or of the waterlevel into
+   the last registered action, if it's a change of the same kind.
+   Returns true if the action has been merged */
+bool editor_action_coalesce(const editor_action_t* action)
 {
-    editor_action_list_t *p, *next;
+    editor_action_record_t* last;
 
-    p = list;
-    while(p != NULL) {
-        next = p->next;
-        free(p);
-        p = next;
-    }
+    if(action->type != EDA_CHANGESPAWN && action->type != EDA_CHANGEWATER)
+        return false;
+    else if(editor_action_cursor == 0)
+        return false;
 
-    return NULL;
+    last = &editor_action_history[editor_action_cursor - 1];
+    if(last->group_key != 0 || last->action.type != action->type)
+        return false;
+
+    /* undoing the merged action restores the oldest value */
+    last->action.obj_position = action->obj_position;
+    return true;
+}
+
+/* forgets the oldest actions of the history, in bulk */
+void editor_action_forget_oldest()
+{
+    int length = darray_length(editor_action_history);
+    int n = EDITOR_ACTION_MAX_RECORDS / 4;
+
+    /* don't split a group */
+    while(n < length && editor_action_history[n].group_key != 0 && editor_action_history[n].group_key == editor_action_history[n-1].group_key)
+        n++;
+
+    memmove(editor_action_history, editor_action_history + n, (length - n) * sizeof(*editor_action_history));
+    darray_resize(editor_action_history, length - n);
+    editor_action_cursor = max(0, editor_action_cursor - n);
 }
 
 /* undo */
 void editor_action_undo()
 {
-    editor_action_list_t *p;
     editor_action_t a;
-
-    if(editor_action_buffer_cursor != editor_action_buffer_head) {
-        /* moving the cursor */
-        p = editor_action_buffer_cursor;
-        editor_action_buffer_cursor = editor_action_buffer_cursor->prev;
-
-        /* UNDOing a group? */
-        if(p->in_group && p->prev && p->prev->in_group && p->group_key == p->prev->group_key)
-            editor_action_undo();
-
-        /* undo */
-        a = p->action;
-        a.type = /* reverse of a.type ??? */
-        (a.type == EDA_NEWOBJECT) ? EDA_DELETEOBJECT :
-        (a.type == EDA_DELETEOBJECT) ? EDA_NEWOBJECT :
-        (a.type == EDA_CHANGESPAWN) ? EDA_RESTORESPAWN :
-        (a.type == EDA_RESTORESPAWN) ? EDA_CHANGESPAWN :
-        (a.type == EDA_CHANGEWATER) ? EDA_RESTOREWATER :
-        (a.type == EDA_RESTOREWATER) ? EDA_CHANGEWATER :
-        a.type;
-        editor_action_commit(a);
+    uint32_t group_key;
+
+    if(editor_action_cursor > 0) {
+        group_key = editor_action_history[editor_action_cursor - 1].group_key;
+
+        /* UNDOing a group: undo all of its actions */
+        do {
+            /* moving the cursor */
+            a = editor_action_history[--editor_action_cursor].action;
+
+            /* undo */
+            a.type = /* reverse of a.type ??? */
+            (a.type == EDA_NEWOBJECT) ? EDA_DELETEOBJECT :
+            (a.type == EDA_DELETEOBJECT) ? EDA_NEWOBJECT :
+            (a.type == EDA_CHANGESPAWN) ? EDA_RESTORESPAWN :
+            (a.type == EDA_RESTORESPAWN) ? EDA_CHANGESPAWN :
+            (a.type == EDA_CHANGEWATER) ? EDA_RESTOREWATER :
+            (a.type == EDA_RESTOREWATER) ? EDA_CHANGEWATER :
+            a.type;
+            editor_action_commit(a);
+        } while(group_key != 0 && editor_action_cursor > 0 && editor_action_history[editor_action_cursor - 1].group_key == group_key);
     }
     else
         editor_status_display("$EDITOR_MESSAGE_UNDOERROR", 0, NULL);
@@ -5049,21 +5908,21 @@ void editor_action_undo()
 /* redo */
 void editor_action_redo()
 {
-    editor_action_list_t *p;
+    int length = darray_length(editor_action_history);
     editor_action_t a;
+    uint32_t group_key;
+
+    if(editor_action_cursor < length) {
+        group_key = editor_action_history[editor_action_cursor].group_key;
 
-    if(editor_action_buffer_cursor->next != NULL) {
-        /* moving the cursor */
-        editor_action_buffer_cursor = editor_action_buffer_cursor->next;
-        p = editor_action_buffer_cursor;
+        /* REDOing a group: redo all of its actions */
+        do {
+            /* moving the cursor */
+            a = editor_action_history[editor_action_cursor++].action;
 
-        /* REDOing a group? */
-        if(p->in_group && p->next && p->next->in_group && p->group_key == p->next->group_key)
-            editor_action_redo();
-        
-        /* redo */
-        a = p->action;
-        editor_action_commit(a);
+            /* redo */
+            editor_action_commit(a);
+        } while(group_key != 0 && editor_action_cursor < length && editor_action_history[editor_action_cursor].group_key == group_key);
     }
     else
         editor_status_display("$EDITOR_MESSAGE_REDOERROR", 0, NULL);
@@ -5257,7 +6116,7 @@ void editor_pick_entity(surgescript_object_t* object, surgescript_object_t** bes
 
         /* find the bounding box of the entity */
         const char* name = surgescript_object_name(object);
-        const animation_t* anim = sprite_animation_exists(name, 0) ? sprite_get_animation(name, 0) : sprite_get_animation(NULL, 0);
+        const animation_t* anim = editor_entity_animation(name);
         const image_t* img = animation_image(anim, 0);
         v2d_t worldpos = scripting_util_world_position(object);
         v2d_t hot_spot = animation_hot_spot(anim);
@@ -5273,3 +6132,50 @@ void editor_pick_entity(surgescript_object_t* object, surgescript_object_t** bes
         }
     }
 }
+
+/* the animation used to find the bounding box of an entity with the given name.
+   We cache the animations, as looking up sprites by name is relatively costly */
+const animation_t* editor_entity_animation(const char* entity_name)
+{
+    /* object names are shared by the objects of the same class */
+    uintptr_t key = (uintptr_t)entity_name;
+    int index = (int)((key ^ (key >> 7)) & (EDITOR_ANIMATION_CACHE_SIZE - 1));
+
+    /* cache hit */
+    if(editor_animation_cache[index].name != NULL && strcmp(editor_animation_cache[index].name, entity_name) == 0)
+        return editor_animation_cache[index].anim;
+
+    /* cache miss */
+    const animation_t* anim = sprite_animation_exists(entity_name, 0) ? sprite_get_animation(entity_name, 0) : sprite_get_animation(NULL, 0);
+    editor_animation_cache[index].name = entity_name;
+    editor_animation_cache[index].anim = anim;
+    return anim;
+}
+
+/* considers a brick when picking a brick under the cursor, given as a bounding box */
+void editor_pick_brick(const brick_t* brick, const float cursor[4], const brick_t** best_candidate, bool* candidate_got_collision)
+{
+    const brick_t* candidate = *best_candidate;
+    v2d_t brk_topleft = brick_position(brick);
+    v2d_t brk_bottomright = v2d_add(brk_topleft, brick_size(brick));
+    float a[4] = { brk_topleft.x, brk_topleft.y, brk_bottomright.x, brk_bottomright.y };
+    const float* b = cursor;
+
+    if(bounding_box(a,b)) {
+        const obstacle_t* obstacle = brick_obstacle(brick);
+
+        /* pick the best brick that is in front of the others */
+        if(
+            (candidate == NULL) ||
+            (obstacle == NULL && !*candidate_got_collision && (
+                brick_obstacle(candidate) != NULL || brick_zindex(brick) >= brick_zindex(candidate)
+            )) ||
+            (obstacle != NULL && obstacle_got_collision(obstacle, b[0], b[1], b[2], b[3]) && (
+                !*candidate_got_collision || brick_zindex(brick) >= brick_zindex(candidate)
+            ))
+        ) {
+            *best_candidate = brick;
+            *candidate_got_collision = (obstacle != NULL) && obstacle_got_collision(obstacle, b[0], b[1], b[2], b[3]);
+        }
+    }
+}
@@ -23,6 +23,7 @@
 
 #include <surgescript.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "../core/color.h"
 #include "../util/v2d.h"
 #include "../entities/brick.h"
@@ -76,11 +77,13 @@ surgescript_object_t* level_child_object(const char* object_name);
 bool level_is_setup_object(const char* object_name);
 const struct obstaclemap_t* level_obstaclemap();
 void level_set_obstaclemap_dirty();
+struct brick_t* const* level_legacy_bricks_in_rect(int x, int y, int width, int height, int* brick_count); /* active bricks intersecting a rectangle, for legacy entities; the array is valid until the next call */
 
 /* camera */
 void level_set_camera_focus(struct actor_t *act);
 struct actor_t* level_get_camera_focus();
 int level_inside_screen(int x, int y, int w, int h);
+uint32_t level_visibility_epoch(); /* changes whenever the results of level_inside_screen() may change */
 
 /* music */
 struct music_t* level_music();
@@ -98,6 +101,8 @@ void level_restart();
 void level_abort();
 void level_push_quest(const char* path_to_qst_file);
 void level_quit_with_gameover();
+void level_set_streaming(bool streaming); /* page the chunks of the levels loaded from now on in and out around the camera? */
+bool level_is_streaming(); /* is the current level being streamed? */
 
 /* level state */
 void level_save_state();
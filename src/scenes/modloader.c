@@ -25,7 +25,9 @@
 #include <allegro5/allegro.h>
 #include <allegro5/allegro_android.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #endif
 
@@ -53,6 +55,30 @@ static const char* url_encoded_basename(const char* url);
 static bool download_to_cache(ALLEGRO_FILE* f, const char* destination_path, void (*on_progress)(double,void*), void* context);
 static bool need_to_download_to_cache(ALLEGRO_FILE* f, const char* destination_path);
 static void show_download_progress(double percentage, void* context);
+static const char* mount_directly(const char* content_uri);
+static void* copy_in_background(ALLEGRO_THREAD* thread, void* arg);
+static bool quick_hash(ALLEGRO_FILE* f, uint64_t* hash);
+static uint64_t fnv1a(uint64_t hash, const uint8_t* data, size_t size);
+static char* sidecar_path(const char* cache_path, char* buffer, size_t buffer_size);
+
+/* a copy of a mod to the application cache, made in a background thread */
+typedef struct cachecopy_t cachecopy_t;
+struct cachecopy_t {
+    ALLEGRO_FILE* src;
+    FILE* dest;
+    uint8_t* buffer;
+    size_t buffer_size;
+    ALLEGRO_MUTEX* mutex; /* protects the fields below */
+    int64_t copied_bytes;
+    uint64_t hash; /* FNV-1a hash of the copied bytes */
+    bool done;
+    bool error;
+};
+
+#define COPY_BUFFER_SIZE    (4 * 1048576) /* large reads are faster on slow storage */
+#define COPY_ALIGNMENT      4096 /* page-aligned buffer */
+#define QUICK_HASH_SIZE     1048576 /* the quick hash of a mod covers its first and last megabytes */
+#define FNV1A_OFFSET        UINT64_C(14695981039346656037)
 #endif
 
 
@@ -173,6 +199,10 @@ const char* find_absolute_filepath(const char* content_uri)
     assertx(0 == strcmp(relative_path + len, filename), "filename too long");
     cache_path[0] = '\0';
 
+    /* mount the file directly, if possible */
+    if(NULL != (path_to_game = mount_directly(content_uri)))
+        return path_to_game;
+
     if(!open_file_at_uri(content_uri, &f)) {
         /* can't open the file */
         sound_play(SFX_DENY);
@@ -220,6 +250,10 @@ const char* find_absolute_filepath(const char* content_uri)
             const char* err = strerror(errno);
             logfile_message("Error deleting file from cache. %s", err);
         }
+        else {
+            char sidecar[1024];
+            remove(sidecar_path(path_to_game, sidecar, sizeof(sidecar)));
+        }
 
         /* not a valid gamedir */
         path_to_game = NULL;
@@ -261,47 +295,72 @@ const char* url_encoded_basename(const char* url)
     return url; /* XXX is (*url == '\0') possible? */
 }
 
-/* copy an open file stream f to the application cache */
+/* copy an open file stream f to the application cache. The copy is made
+   in a background thread, so that the progress is shown smoothly */
 bool download_to_cache(ALLEGRO_FILE* f, const char* destination_path, void (*on_progress)(double,void*), void* context)
 {
     /* since we're operating on the application cache, we have
        write permissions to open the destination path for writing */
-    enum { BUFFER_SIZE = 4096, MEGABYTE = 1048576, PROGRESS_CHUNK = 1 * MEGABYTE };
-    typedef char __chunksize_assertion[-1 + 2 * (!!(PROGRESS_CHUNK % BUFFER_SIZE == 0))];
-
-    uint8_t buffer[BUFFER_SIZE];
-    size_t n;
+    cachecopy_t copy = { .src = f, .buffer_size = COPY_BUFFER_SIZE };
+    char sidecar[1024];
+    uint64_t qhash = 0;
     bool error;
-    FILE* f_copy;
-    int64_t total_bytes;
-    int64_t bytes_written;
+
+    /* compute the quick hash before copying; it moves the file pointer */
+    bool has_quick_hash = quick_hash(f, &qhash);
 
     /* open filepath for writing */
-    if(NULL == (f_copy = fopen(destination_path, "wb"))) {
+    if(NULL == (copy.dest = fopen(destination_path, "wb"))) {
         const char* err = strerror(errno);
         sound_play(SFX_DENY);
         alert("%s %s", "Can't write a cached copy!", err);
         return false;
     }
 
-    /* copy the file */
-    total_bytes = al_fsize(f);
-    bytes_written = 0;
-    error = false;
+    /* allocate a large aligned buffer, falling back to a small one */
+    void* buffer = NULL;
+    if(0 != posix_memalign(&buffer, COPY_ALIGNMENT, copy.buffer_size)) {
+        copy.buffer_size = 4096;
+        buffer = mallocx(copy.buffer_size);
+    }
+    copy.buffer = buffer;
 
+    /* copy the file */
+    int64_t total_bytes = al_fsize(f);
+    ALLEGRO_THREAD* thread = NULL;
     on_progress(0.0, context);
-    while(!error && 0 < (n = al_fread(f, buffer, sizeof(buffer)))) {
-        error = (n != fwrite(buffer, 1, n, f_copy));
 
-        /* show progress */
-        if(0 == ((bytes_written += n) % PROGRESS_CHUNK)) {
-            int64_t fraction = (bytes_written << 10) / total_bytes;
-            double percentage = (double)fraction / 1024.0;
+    if(NULL != (copy.mutex = al_create_mutex()) && NULL != (thread = al_create_thread(copy_in_background, &copy))) {
+        al_start_thread(thread);
+
+        /* show the progress while the worker copies the file */
+        for(bool done = false; !done; ) {
+            al_lock_mutex(copy.mutex);
+            int64_t copied_bytes = copy.copied_bytes;
+            done = copy.done;
+            al_unlock_mutex(copy.mutex);
+
+            if(total_bytes > 0)
+                on_progress((double)copied_bytes / (double)total_bytes, context);
 
-            on_progress(percentage, context);
+            if(!done)
+                al_rest(1.0 / 60.0);
         }
+
+        al_join_thread(thread, NULL);
+        al_destroy_thread(thread);
+    }
+    else {
+        /* copy the file in this thread */
+        copy_in_background(NULL, &copy);
     }
+
     on_progress(1.0, context);
+    error = copy.error;
+
+    if(copy.mutex != NULL)
+        al_destroy_mutex(copy.mutex);
+    free(buffer);
 
     /* error checking */
     if(error) {
@@ -311,26 +370,68 @@ bool download_to_cache(ALLEGRO_FILE* f, const char* destination_path, void (*on_
         if(al_ferror(f) != 0)
             alert("READ ERROR: %s", al_ferrmsg(f));
 
-        if(ferror(f_copy) != 0)
-            alert("WRITE ERROR: %d", ferror(f_copy));
+        if(ferror(copy.dest) != 0)
+            alert("WRITE ERROR: %d", ferror(copy.dest));
     }
 
     /* close the copy */
-    fclose(f_copy);
+    if(0 != fclose(copy.dest))
+        error = true;
+
+    /* write the content-hash sidecar: size, quick hash and full hash */
+    sidecar_path(destination_path, sidecar, sizeof(sidecar));
+    remove(sidecar);
+    if(!error && has_quick_hash) {
+        FILE* fp = fopen(sidecar, "w");
+        if(fp != NULL) {
+            fprintf(fp, "%lld %016llx %016llx\n", (long long)total_bytes, (unsigned long long)qhash, (unsigned long long)copy.hash);
+            fclose(fp);
+        }
+    }
 
     /* done! */
     return !error;
 }
 
+/* copies a mod to the application cache (in a background thread, if thread isn't NULL) */
+void* copy_in_background(ALLEGRO_THREAD* thread, void* arg)
+{
+    cachecopy_t* copy = (cachecopy_t*)arg;
+    uint64_t hash = FNV1A_OFFSET;
+    bool error = false;
+    size_t n;
+
+    while(!error && 0 < (n = al_fread(copy->src, copy->buffer, copy->buffer_size))) {
+        error = (n != fwrite(copy->buffer, 1, n, copy->dest));
+        hash = fnv1a(hash, copy->buffer, n);
+
+        if(copy->mutex != NULL)
+            al_lock_mutex(copy->mutex);
+        copy->copied_bytes += n;
+        if(copy->mutex != NULL)
+            al_unlock_mutex(copy->mutex);
+    }
+
+    if(al_ferror(copy->src) != 0)
+        error = true;
+
+    if(copy->mutex != NULL)
+        al_lock_mutex(copy->mutex);
+    copy->hash = hash;
+    copy->error = error;
+    copy->done = true;
+    if(copy->mutex != NULL)
+        al_unlock_mutex(copy->mutex);
+
+    (void)thread;
+    return NULL;
+}
+
 /* do we need to download file f to destination_path at the application cache? */
 bool need_to_download_to_cache(ALLEGRO_FILE* f, const char* destination_path)
 {
-#if 1
-    /* Simple heuristic: compare the size of the files. This is not always
-       correct, but it is probably correct. We want this routine to be fast.
-       Computing a checksum takes time; the file is expected to have a size of
-       hundreds of megabytes. Users can clear the cache to force new downloads. */
     struct stat buf;
+    char sidecar[1024];
 
     if(0 != stat(destination_path, &buf)) {
         const char* err = strerror(errno);
@@ -340,12 +441,116 @@ bool need_to_download_to_cache(ALLEGRO_FILE* f, const char* destination_path)
 
     int64_t f_size = al_fsize(f);
     int64_t d_size = buf.st_size;
+    if(f_size != d_size)
+        return true;
+
+    /* compare the content-hash sidecar with the quick hash of the file. The
+       quick hash covers the beginning and the end of the file, where the
+       directory of a zip archive is, so it's fast even for large mods */
+    FILE* fp = fopen(sidecar_path(destination_path, sidecar, sizeof(sidecar)), "r");
+    if(fp != NULL) {
+        long long size = -1;
+        unsigned long long cached_qhash = 0, cached_hash = 0;
+        uint64_t qhash = 0;
+        bool valid = (3 == fscanf(fp, "%lld %llx %llx", &size, &cached_qhash, &cached_hash));
+        fclose(fp);
+
+        if(valid && size == d_size && quick_hash(f, &qhash))
+            return qhash != cached_qhash;
+
+        return true;
+    }
 
-    return (f_size != d_size);
-#else
-    /* always download to cache */
-    return true;
-#endif
+    /* Caches without a sidecar: compare the size of the files. This is not
+       always correct, but it is probably correct. Users can clear the cache
+       to force new downloads. */
+    return false;
+}
+
+/* computes a hash of the first and of the last megabytes of a file, leaving
+   the file pointer at the beginning of the file */
+bool quick_hash(ALLEGRO_FILE* f, uint64_t* hash)
+{
+    int64_t size = al_fsize(f);
+    uint8_t* buffer = mallocx(QUICK_HASH_SIZE);
+    bool success = (size >= 0);
+    size_t n;
+
+    *hash = fnv1a(FNV1A_OFFSET, (const uint8_t*)&size, sizeof(size));
+
+    /* first megabyte */
+    if(success && al_fseek(f, 0, ALLEGRO_SEEK_SET)) {
+        n = al_fread(f, buffer, QUICK_HASH_SIZE);
+        *hash = fnv1a(*hash, buffer, n);
+    }
+    else
+        success = false;
+
+    /* last megabyte */
+    if(success && size > QUICK_HASH_SIZE && al_fseek(f, size - QUICK_HASH_SIZE, ALLEGRO_SEEK_SET)) {
+        n = al_fread(f, buffer, QUICK_HASH_SIZE);
+        *hash = fnv1a(*hash, buffer, n);
+    }
+    else if(size > QUICK_HASH_SIZE)
+        success = false;
+
+    /* rewind */
+    success = al_fseek(f, 0, ALLEGRO_SEEK_SET) && success && !al_ferror(f);
+
+    free(buffer);
+    return success;
+}
+
+/* FNV-1a hash */
+uint64_t fnv1a(uint64_t hash, const uint8_t* data, size_t size)
+{
+    for(size_t i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * UINT64_C(1099511628211);
+
+    return hash;
+}
+
+/* the path of the content-hash sidecar of a cached mod */
+char* sidecar_path(const char* cache_path, char* buffer, size_t buffer_size)
+{
+    snprintf(buffer, buffer_size, "%s.hash", cache_path);
+    return buffer;
+}
+
+/* try to mount a document directly, without copying it to the cache. This
+   works if its file descriptor is seekable, as with local documents. The
+   descriptor is kept open while the mod is in use. Returns a statically
+   allocated path on success or NULL otherwise */
+const char* mount_directly(const char* content_uri)
+{
+    static int mounted_fd = -1;
+    static char path[64];
+
+    int fd = al_android_open_fd(content_uri, "r");
+    if(fd < 0)
+        return NULL;
+
+    /* pipes and sockets can't be mounted */
+    if(lseek(fd, 0, SEEK_END) < 0 || lseek(fd, 0, SEEK_SET) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    if(!asset_is_valid_gamedir(path, NULL)) {
+        logfile_message("Can't mount \"%s\" directly", content_uri);
+        close(fd);
+        return NULL;
+    }
+
+    /* release the previously mounted document */
+    if(mounted_fd >= 0)
+        close(mounted_fd);
+    mounted_fd = fd;
+
+    logfile_message("Mounting the game directly at \"%s\"", path);
+    show_download_progress(1.0, video_display_loading_screen_ex);
+    return path;
 }
 
 /* show download progress */
@@ -31,6 +31,7 @@
 #include "../core/sprite.h"
 #include "../core/audio.h"
 #include "../core/timer.h"
+#include "../core/engine.h"
 #include "../core/font.h"
 #include "../core/asset.h"
 #include "../core/logfile.h"
@@ -66,6 +67,8 @@ static void (*update_fn[])() = {
     [STATE_DISAPPEARING] = update_disappearing
 };
 
+static bool is_static_frame(pause_state_t previous_state, int previous_option);
+
 
 
 
@@ -506,6 +509,9 @@ void pause_release()
  */
 void pause_update()
 {
+    pause_state_t previous_state = state;
+    int previous_option = option;
+
     /* legacy mode? */
     if(legacy_mode) {
         legacy_update();
@@ -546,6 +552,10 @@ void pause_update()
 
     #undef COLORIZE_OPTION
     #undef COLORIZE_TEXT
+
+    /* save power if nothing changes */
+    if(is_static_frame(previous_state, previous_option))
+        engine_hint_static_frame();
 }
 
 
@@ -583,6 +593,23 @@ void pause_render()
 
 /* private */
 
+/* checks if the pause menu looks the same as in the previous frame */
+bool is_static_frame(pause_state_t previous_state, int previous_option)
+{
+    if(state != STATE_IDLE || state != previous_state || (int)option != previous_option)
+        return false;
+
+    if(want_overlay())
+        return false;
+
+    for(int i = 0; i < SPRITE_COUNT; i++) {
+        if(!actor_is_still(actor[i]))
+            return false;
+    }
+
+    return true;
+}
+
 /* update logic: appearing state */
 void update_appearing()
 {
@@ -380,6 +380,7 @@ static void update_music();
 static void handle_controls();
 static bool handle_fading();
 static void update_camera();
+static bool is_static_frame(int previous_setting, float previous_camera_ypos);
 static void save_preferences();
 static const char* create_url(const char* path);
 static bool is_base_game();
@@ -453,6 +454,9 @@ void settings_release()
  */
 void settings_update()
 {
+    int previous_setting = index_of_highlighted_setting;
+    float previous_camera_ypos = camera.y;
+
     mobilegamepad_fadein(); /* display the mobile gamepad */
     background_update(background);
     update_music();
@@ -463,6 +467,10 @@ void settings_update()
     handle_controls();
     update_entries();
     update_camera();
+
+    /* save power if nothing changes */
+    if(is_static_frame(previous_setting, previous_camera_ypos))
+        engine_hint_static_frame();
 }
 
 /*
@@ -735,6 +743,23 @@ void update_camera()
     camera.y = lerp(camera.y, target_ypos, 0.25f);
 }
 
+/* checks if the scene looks the same as in the previous frame */
+bool is_static_frame(int previous_setting, float previous_camera_ypos)
+{
+    if(fade_in || fade_out || index_of_highlighted_setting != previous_setting)
+        return false;
+
+    if(fabsf(camera.y - previous_camera_ypos) >= 0.5f)
+        return false;
+
+    for(inputbutton_t button = 0; button < IB_MAX; button++) {
+        if(input_button_down(input, button))
+            return false;
+    }
+
+    return actor_is_still(cursor_icon) && actor_is_still(flag_icon) && background_is_static(background);
+}
+
 /* saves the user preferences */
 void save_preferences()
 {
@@ -18,6 +18,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <allegro5/allegro.h>
 #include <string.h>
 #include <math.h>
 #include <ctype.h>
@@ -43,6 +44,7 @@
 #include "../util/numeric.h"
 #include "../util/util.h"
 #include "../util/stringutil.h"
+#include "../util/hashtable.h"
 #include "../entities/actor.h"
 #include "../entities/background.h"
 #include "../entities/player.h"
@@ -59,6 +61,9 @@ typedef struct {
     char name[256]; /* stage name */
     int act; /* zone number */
     bool is_quest; /* is this entry a quest file (.qst)? */
+    bool is_pending; /* we haven't read the header of the level file yet */
+    int64_t mtime; /* modification time of the level file */
+    int64_t size; /* size of the level file */
 } stagedata_t;
 
 static stagedata_t* stagedata_load(const char *filename, bool is_quest);
@@ -67,6 +72,50 @@ static bool interpret_level_line(const char *filepath, int fileline, levparser_c
 
 
 
+/*
+
+STAGE METADATA CACHE
+
+Reading the header of a level means opening and parsing its .lev file, which
+blocks the menu when a game has hundreds of levels. We keep the name and the
+act of each level in a cache stored in the application cache, keyed by the
+path, the modification time and the size of the level file.
+
+Levels that aren't in the cache are listed right away with a provisional name.
+Their headers are read progressively, within a time budget in each frame, and
+the list is sorted again as it fills in.
+
+*/
+#define METADATA_CACHE_FILE      "stageselect.cache" /* inside the application cache */
+#define METADATA_CACHE_VERSION   "#stageselect 1"
+#define METADATA_SCAN_BUDGET     0.004 /* time budget for reading level headers, in seconds per frame */
+
+typedef struct {
+    char* filepath; /* relative path of the level file */
+    char name[256]; /* stage name */
+    int act; /* zone number */
+    int64_t mtime; /* modification time of the level file */
+    int64_t size; /* size of the level file */
+    bool is_used; /* is this entry used by the current stage list? */
+} stagemeta_t;
+
+static stagemeta_t* stagemeta_create(const char* filepath);
+static void stagemeta_destroy(stagemeta_t* m);
+HASHTABLE_GENERATE_CODE(stagemeta_t, stagemeta_destroy);
+static HASHTABLE(stagemeta_t, metadata_cache);
+static bool is_metadata_cache_dirty = false;
+static int pending_count = 0; /* number of stages whose headers haven't been read yet */
+
+static void load_metadata_cache();
+static void save_metadata_cache();
+static void write_metadata(stagemeta_t* m, void* file);
+static bool read_file_stamp(const char* filepath, int64_t* mtime, int64_t* size);
+static void scan_pending_stages(double time_budget);
+static void remove_stage(int index);
+static void sort_stage_list();
+
+
+
 /* private data */
 #define STAGE_BGFILE             "themes/scenes/levelselect.bg"
 #define STAGE_MAXPERPAGE         (VIDEO_SCREEN_H / 30)
@@ -182,6 +231,10 @@ void stageselect_update()
     char pagestr[2][33];
     scene_time += dt;
 
+    /* read the headers of the level files progressively */
+    if(pending_count > 0)
+        scan_pending_stages(METADATA_SCAN_BUDGET);
+
     /* background movement */
     background_update(bgtheme);
 
@@ -350,19 +403,18 @@ void load_stage_list()
 
     /* loading data */
     stage_count = 0;
+    pending_count = 0;
+    load_metadata_cache();
     asset_foreach_file("levels", ".lev", dirfill, "L", enable_debug);
-    if(enable_debug) {
+    if(enable_debug)
         asset_foreach_file("quests", ".qst", dirfill, "Q", true);
-        qsort(stage_data, stage_count, sizeof(stagedata_t*), debug_sort_cmp);
-    }
-    else
-        qsort(stage_data, stage_count, sizeof(stagedata_t*), sort_cmp);
+    sort_stage_list();
 
     /* fatal error */
     if(stage_count == 0)
         fatal_error("FATAL ERROR: no level files were found! Please reinstall the game.");
     else
-        logfile_message("%d levels found.", stage_count);
+        logfile_message("%d levels found (%d not cached).", stage_count, pending_count);
 
     /* other stuff */
     stage_label = mallocx(stage_count * sizeof(font_t**));
@@ -386,6 +438,10 @@ void unload_stage_list()
 
     free(stage_label);
     stage_count = 0;
+    pending_count = 0;
+
+    save_metadata_cache();
+    metadata_cache = hashtable_stagemeta_t_destroy(metadata_cache);
 }
 
 
@@ -438,6 +494,9 @@ stagedata_t* stagedata_load(const char *filename, bool is_quest)
     s->act = 0;
     s->filepath = str_normalize_slashes(str_dup(filename));
     s->is_quest = is_quest;
+    s->is_pending = false;
+    s->mtime = 0;
+    s->size = 0;
 
     /* fill in the fields */
     if(enable_debug) {
@@ -447,11 +506,22 @@ stagedata_t* stagedata_load(const char *filename, bool is_quest)
         snprintf(s->name, sizeof(s->name), "%s", s->filepath + (skip_prefix ? PREFIX_LENGTH : 0));
     }
     else if(!is_quest) {
-        /* read the .lev file */
-        if(!levparser_parse(s->filepath, s, interpret_level_line)) {
-            logfile_message("Level select: can't parse level file \"%s\"", s->filepath);
-            stagedata_unload(s);
-            return NULL;
+        /* look for the header of the .lev file in the cache */
+        stagemeta_t* m = hashtable_stagemeta_t_find(metadata_cache, s->filepath);
+        bool has_stamp = read_file_stamp(s->filepath, &s->mtime, &s->size);
+
+        if(m != NULL && has_stamp && m->mtime == s->mtime && m->size == s->size) {
+            str_cpy(s->name, m->name, sizeof(s->name));
+            s->act = m->act;
+            m->is_used = true;
+        }
+        else {
+            /* read the .lev file later; use a provisional name */
+            const int PREFIX_LENGTH = 7; /* == strlen("levels/") */
+            bool skip_prefix = (0 == str_incmp(s->filepath, "levels/", PREFIX_LENGTH));
+            snprintf(s->name, sizeof(s->name), "%s", s->filepath + (skip_prefix ? PREFIX_LENGTH : 0));
+            s->is_pending = true;
+            pending_count++;
         }
     }
 
@@ -494,6 +564,234 @@ bool interpret_level_line(const char *filepath, int fileline, levparser_command_
     return true;
 }
 
+/* read the headers of the pending level files within a time budget */
+void scan_pending_stages(double time_budget)
+{
+    double start_time = timer_get_now();
+    bool has_changed = false;
+
+    for(int i = 0; i < stage_count && pending_count > 0; i++) {
+        stagedata_t* s = stage_data[i];
+
+        if(!s->is_pending)
+            continue;
+
+        /* read the .lev file */
+        s->is_pending = false;
+        pending_count--;
+        has_changed = true;
+        if(!levparser_parse(s->filepath, s, interpret_level_line)) {
+            logfile_message("Level select: can't parse level file \"%s\"", s->filepath);
+            remove_stage(i--);
+            continue;
+        }
+
+        /* cache the header */
+        stagemeta_t* m = hashtable_stagemeta_t_find(metadata_cache, s->filepath);
+        if(m == NULL) {
+            m = stagemeta_create(s->filepath);
+            hashtable_stagemeta_t_add(metadata_cache, s->filepath, m);
+        }
+        str_cpy(m->name, s->name, sizeof(m->name));
+        m->act = s->act;
+        m->mtime = s->mtime;
+        m->size = s->size;
+        m->is_used = true;
+        is_metadata_cache_dirty = true;
+
+        /* we're out of time */
+        if(timer_get_now() - start_time >= time_budget)
+            break;
+    }
+
+    /* no valid levels */
+    if(stage_count == 0)
+        fatal_error("FATAL ERROR: no level files were found! Please reinstall the game.");
+
+    /* sort the list again */
+    if(has_changed)
+        sort_stage_list();
+
+    /* save the cache when we're done */
+    if(pending_count == 0)
+        save_metadata_cache();
+}
+
+/* remove an invalid entry from the stage list */
+void remove_stage(int index)
+{
+    stagedata_unload(stage_data[index]);
+    for(int i = index; i < stage_count - 1; i++)
+        stage_data[i] = stage_data[i+1];
+
+    /* the labels are positioned by index */
+    font_destroy(stage_label[--stage_count]);
+
+    if(option >= stage_count)
+        option = max(0, stage_count - 1);
+}
+
+/* sort the stage list, keeping the selected entry */
+void sort_stage_list()
+{
+    const stagedata_t* selected = (option >= 0 && option < stage_count) ? stage_data[option] : NULL;
+
+    if(enable_debug)
+        qsort(stage_data, stage_count, sizeof(stagedata_t*), debug_sort_cmp);
+    else
+        qsort(stage_data, stage_count, sizeof(stagedata_t*), sort_cmp);
+
+    for(int i = 0; i < stage_count && selected != NULL; i++) {
+        if(stage_data[i] == selected) {
+            option = i;
+            break;
+        }
+    }
+}
+
+/* read the modification time and the size of a file */
+bool read_file_stamp(const char* filepath, int64_t* mtime, int64_t* size)
+{
+    ALLEGRO_FS_ENTRY* entry = al_create_fs_entry(asset_path(filepath));
+
+    if(entry == NULL)
+        return false;
+
+    *mtime = (int64_t)al_get_fs_entry_mtime(entry);
+    *size = (int64_t)al_get_fs_entry_size(entry);
+    al_destroy_fs_entry(entry);
+
+    return true;
+}
+
+/* read the metadata cache from the application cache */
+void load_metadata_cache()
+{
+    char path[1024], line[1024];
+    ALLEGRO_STATE state;
+    ALLEGRO_FILE* fp;
+
+    metadata_cache = hashtable_stagemeta_t_create();
+    is_metadata_cache_dirty = false;
+
+    /* no application cache */
+    if(*asset_cache_path(METADATA_CACHE_FILE, path, sizeof(path)) == '\0')
+        return;
+
+    /* the cache is an absolute path */
+    al_store_state(&state, ALLEGRO_STATE_NEW_FILE_INTERFACE);
+    al_set_standard_file_interface();
+
+    if(NULL != (fp = al_fopen(path, "r"))) {
+        /* check the version of the cache */
+        if(al_fgets(fp, line, sizeof(line)) != NULL && 0 == strncmp(line, METADATA_CACHE_VERSION, strlen(METADATA_CACHE_VERSION))) {
+
+            /* each line is: mtime <TAB> size <TAB> act <TAB> filepath <TAB> name */
+            while(al_fgets(fp, line, sizeof(line)) != NULL) {
+                char* field[5] = { line };
+                int n = 1;
+
+                /* split the fields */
+                for(char* p = line; *p && *p != '\n' && *p != '\r'; p++) {
+                    if(*p == '\t' && n < 5) {
+                        *p = '\0';
+                        field[n++] = p + 1;
+                    }
+                }
+                if(n < 5)
+                    continue;
+                field[4][strcspn(field[4], "\r\n")] = '\0';
+
+                /* add the entry */
+                if(NULL == hashtable_stagemeta_t_find(metadata_cache, field[3])) {
+                    stagemeta_t* m = stagemeta_create(field[3]);
+                    m->mtime = atoll(field[0]);
+                    m->size = atoll(field[1]);
+                    m->act = atoi(field[2]);
+                    str_cpy(m->name, field[4], sizeof(m->name));
+                    hashtable_stagemeta_t_add(metadata_cache, field[3], m);
+                }
+            }
+
+        }
+
+        al_fclose(fp);
+    }
+
+    al_restore_state(&state);
+}
+
+/* write the metadata cache to the application cache, if it has changed */
+void save_metadata_cache()
+{
+    char path[1024];
+    ALLEGRO_STATE state;
+    ALLEGRO_FILE* fp;
+
+    if(!is_metadata_cache_dirty)
+        return;
+
+    is_metadata_cache_dirty = false;
+    if(*asset_cache_path(METADATA_CACHE_FILE, path, sizeof(path)) == '\0')
+        return;
+
+    al_store_state(&state, ALLEGRO_STATE_NEW_FILE_INTERFACE);
+    al_set_standard_file_interface();
+
+    if(NULL != (fp = al_fopen(path, "w"))) {
+        al_fputs(fp, METADATA_CACHE_VERSION "\n");
+        hashtable_stagemeta_t_foreach(metadata_cache, fp, write_metadata);
+        al_fclose(fp);
+        logfile_message("Level select: saved the metadata cache at \"%s\"", path);
+    }
+    else
+        logfile_message("Level select: can't write the metadata cache at \"%s\"", path);
+
+    al_restore_state(&state);
+}
+
+/* write an entry of the metadata cache; drop the entries of levels that no longer exist */
+void write_metadata(stagemeta_t* m, void* file)
+{
+    ALLEGRO_FILE* fp = (ALLEGRO_FILE*)file;
+    char line[1024], name[256];
+
+    if(!m->is_used)
+        return;
+
+    /* the fields are separated by tabs */
+    str_cpy(name, m->name, sizeof(name));
+    for(char* p = name; *p; p++) {
+        if(*p == '\t' || *p == '\n' || *p == '\r')
+            *p = ' ';
+    }
+
+    snprintf(line, sizeof(line), "%lld\t%lld\t%d\t%s\t%s\n", (long long)m->mtime, (long long)m->size, m->act, m->filepath, name);
+    al_fputs(fp, line);
+}
+
+/* stagemeta_t constructor */
+stagemeta_t* stagemeta_create(const char* filepath)
+{
+    stagemeta_t* m = mallocx(sizeof *m);
+
+    m->filepath = str_dup(filepath);
+    m->name[0] = '\0';
+    m->act = 0;
+    m->mtime = 0;
+    m->size = 0;
+    m->is_used = false;
+
+    return m;
+}
+
+/* stagemeta_t destructor */
+void stagemeta_destroy(stagemeta_t* m)
+{
+    free(m->filepath);
+    free(m);
+}
+
 /* load a level that was previously selected by the user */
 int load_selection()
 {
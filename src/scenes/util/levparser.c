@@ -19,21 +19,83 @@
  */
 
 #include <allegro5/allegro.h>
+#include <allegro5/allegro_physfs.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdint.h>
 #include "levparser.h"
 #include "../../core/asset.h"
+#include "../../core/logfile.h"
 #include "../../util/util.h"
 #include "../../util/stringutil.h"
+#include "../../util/darray.h"
 #include "../../util/djb2.h"
 
 /* helpers */
-#define LINE_MAXLEN 1024
 #define MAX_PARAMS 16
-static bool parse_line(const char* filepath, int fileline, char* line, void* data, levparser_callback_t callback);
+typedef struct levtokens_t levtokens_t;
+static char* read_file(const char* fullpath, size_t* size);
+static void tokenize_file(levtokens_t* tokens, char* text);
+static char* tokenize_line(levtokens_t* tokens, int fileline, char* line);
 static inline levparser_command_t find_command(const char* command_name);
 
+/*
+
+A level file is typically read more than once: the header and the body are
+read in different passes, and levels are read again when restarted. The
+tokenized contents of the last file are kept in memory, so that we can skip
+tokenizing it again if its checksum hasn't changed.
+
+*/
+typedef struct levrecord_t levrecord_t;
+struct levrecord_t {
+    levparser_command_t command;
+    const char* command_name;
+    int fileline;
+    int param_count;
+    int first_param; /* index of the first parameter in the param[] array */
+};
+
+struct levtokens_t {
+    char* path; /* full path of the file */
+    char* text; /* tokenized in place */
+    size_t size;
+    uint64_t checksum;
+    DARRAY(levrecord_t, record);
+    DARRAY(const char*, param);
+};
+
+static levtokens_t cache = { .path = NULL }; /* the tokenized contents of the last file */
+static void clear_tokens(levtokens_t* tokens);
+static void interpret_tokens(const levtokens_t* tokens, void* data, levparser_callback_t callback);
+
+/*
+
+A level file that is about to be parsed, such as the next level of a quest, may
+be preloaded: a worker thread reads and tokenizes the file while the current
+level is ending. Its tokens replace the cache when the file is parsed.
+
+*/
+#if defined(__EMSCRIPTEN__)
+#define WANT_PRELOADING 0 /* no threads */
+#else
+#define WANT_PRELOADING 1
+#endif
+
+typedef struct levpreload_t levpreload_t;
+struct levpreload_t {
+    ALLEGRO_THREAD* thread; /* worker thread */
+    ALLEGRO_MUTEX* mutex; /* protects is_done */
+    bool is_done; /* has the worker finished? */
+    bool success; /* has the file been read successfully? */
+    levtokens_t tokens; /* the path is set before the worker starts */
+};
+
+static levpreload_t* preload = NULL;
+static void* preload_worker(ALLEGRO_THREAD* thread, void* arg);
+static bool adopt_preloaded_file(const char* fullpath);
+static void discard_preloaded_file();
+
 /* identifiers */
 #define NAME        DJB2_CONST('n','a','m','e')
 #define AUTHOR      DJB2_CONST('a','u','t','h','o','r')
@@ -72,30 +134,126 @@ static inline levparser_command_t find_command(const char* command_name);
 bool levparser_parse(const char* path_to_lev_file, void* data, levparser_callback_t callback)
 {
     const char* fullpath = asset_path(path_to_lev_file);
-    char line[LINE_MAXLEN];
-    int ln = 0;
+    size_t size = 0;
+    char* text;
+
+    /* use the preloaded file, if available */
+    if(!adopt_preloaded_file(fullpath)) {
+
+        /* read the level file at once */
+        if(NULL == (text = read_file(fullpath, &size)))
+            return false; /* error */
+
+        /* tokenize the file, unless it's the same as the last one */
+        uint64_t checksum = djb2(text);
+        if(cache.path != NULL && size == cache.size && checksum == cache.checksum && 0 == strcmp(fullpath, cache.path)) {
+            free(text);
+        }
+        else {
+            clear_tokens(&cache);
+            cache.path = str_dup(fullpath);
+            cache.size = size;
+            cache.checksum = checksum;
+            tokenize_file(&cache, text);
+        }
 
-    /* open the level file */
-    ALLEGRO_FILE* fp = al_fopen(fullpath, "r");
-    if(!fp)
-        return false; /* error */
+    }
 
-    /* read and parse */
-    while(al_fgets(fp, line, sizeof(line))) {
+    /* interpret the lines */
+    interpret_tokens(&cache, data, callback);
 
-        /* line has a '\n' at the end, which we keep */
-        if(!parse_line(fullpath, ++ln, line, data, callback))
-            break;
+    /* success! */
+    return true;
+}
 
-    }
+/*
+ * levparser_replay()
+ * Interprets the last parsed file again without reading it. This is
+ * useful when restarting a level. Returns false if the file isn't in
+ * memory; call levparser_parse() in that case
+ */
+bool levparser_replay(const char* path_to_lev_file, void* data, levparser_callback_t callback)
+{
+    const char* fullpath = asset_path(path_to_lev_file);
 
-    /* close the level file */
-    al_fclose(fp);
+    /* the file isn't in memory */
+    if(cache.path == NULL || 0 != strcmp(fullpath, cache.path))
+        return false;
 
-    /* success! */
+    /* interpret the lines */
+    interpret_tokens(&cache, data, callback);
     return true;
 }
 
+/*
+ * levparser_release()
+ * Releases the tokenized contents of the last parsed file
+ */
+void levparser_release()
+{
+    discard_preloaded_file();
+    clear_tokens(&cache);
+}
+
+/*
+ * levparser_preload()
+ * Reads and tokenizes a level file in the background,
+ * so that a subsequent levparser_parse() of it is fast
+ */
+void levparser_preload(const char* path_to_lev_file)
+{
+#if WANT_PRELOADING
+    const char* fullpath = asset_path(path_to_lev_file);
+
+    /* nothing to do */
+    if(cache.path != NULL && 0 == strcmp(fullpath, cache.path))
+        return;
+    else if(preload != NULL && 0 == strcmp(fullpath, preload->tokens.path))
+        return;
+
+    /* we preload one file at a time */
+    discard_preloaded_file();
+
+    /* create a preload job */
+    preload = mallocx(sizeof *preload);
+    preload->is_done = false;
+    preload->success = false;
+    preload->tokens = (levtokens_t){ .path = str_dup(fullpath) };
+
+    if(NULL == (preload->mutex = al_create_mutex()) || NULL == (preload->thread = al_create_thread(preload_worker, preload))) {
+        logfile_message("Can't preload level file \"%s\"", path_to_lev_file);
+        if(preload->mutex != NULL)
+            al_destroy_mutex(preload->mutex);
+        free(preload->tokens.path);
+        free(preload);
+        preload = NULL;
+        return;
+    }
+
+    logfile_message("Preloading level file \"%s\"...", path_to_lev_file);
+    al_start_thread(preload->thread);
+#else
+    (void)path_to_lev_file;
+#endif
+}
+
+/*
+ * levparser_is_preloading()
+ * Checks if a level file is being preloaded
+ */
+bool levparser_is_preloading()
+{
+    bool is_done = true;
+
+    if(preload != NULL) {
+        al_lock_mutex(preload->mutex);
+        is_done = preload->is_done;
+        al_unlock_mutex(preload->mutex);
+    }
+
+    return !is_done;
+}
+
 
 
 
@@ -105,15 +263,94 @@ bool levparser_parse(const char* path_to_lev_file, void* data, levparser_callbac
  *
  */
 
-/* parse a line from the .lev file */
-bool parse_line(const char* filepath, int fileline, char* line, void* data, levparser_callback_t callback)
+/* reads a file at once. Returns NULL on error */
+char* read_file(const char* fullpath, size_t* size)
+{
+    const size_t BUFSIZE = 4096;
+    size_t read_chars = 0, data_size = 0;
+    char* data = NULL;
+
+    /* open the file in binary mode; '\r' is a space */
+    ALLEGRO_FILE* fp = al_fopen(fullpath, "rb");
+    if(!fp)
+        return NULL;
+
+    int64_t file_size = al_fsize(fp);
+    if(file_size >= 0) {
+        /* we know the size of the file; read it at once */
+        data = mallocx(file_size + 1);
+        read_chars = al_fread(fp, data, file_size);
+        data[read_chars] = '\0';
+    }
+    else {
+        /* the size of the file is unknown; read it in chunks */
+        do {
+            data_size += BUFSIZE;
+            data = reallocx(data, data_size + 1);
+            read_chars += al_fread(fp, data + read_chars, BUFSIZE);
+            data[read_chars] = '\0';
+        } while(read_chars == data_size);
+    }
+    al_fclose(fp);
+
+    *size = read_chars;
+    return data;
+}
+
+/* releases tokenized contents */
+void clear_tokens(levtokens_t* tokens)
+{
+    if(tokens->path == NULL)
+        return;
+
+    free(tokens->path);
+    free(tokens->text);
+    if(tokens->record != NULL) {
+        darray_release(tokens->param);
+        darray_release(tokens->record);
+    }
+
+    *tokens = (levtokens_t){ .path = NULL };
+}
+
+/* call the callback for each tokenized line, until it returns false */
+void interpret_tokens(const levtokens_t* tokens, void* data, levparser_callback_t callback)
 {
-    char *p, *identifier, *param[MAX_PARAMS];
+    for(int i = 0; i < darray_length(tokens->record); i++) {
+        const levrecord_t* r = &tokens->record[i];
+        if(!callback(tokens->path, r->fileline, r->command, r->command_name, r->param_count, tokens->param + r->first_param, data))
+            break;
+    }
+}
+
+/* tokenize the text of a .lev file in place; the tokens take ownership of the text */
+void tokenize_file(levtokens_t* tokens, char* text)
+{
+    int ln = 0;
+
+    tokens->text = text;
+    for(char* line = text; line != NULL; line = tokenize_line(tokens, ++ln, line));
+}
+
+/* tokenize a line of the .lev file in place. Returns the next line, or NULL if there is none */
+char* tokenize_line(levtokens_t* tokens, int fileline, char* line)
+{
+    char *p, *identifier, *next_line;
+
+    /* find the end of the line */
+    if(NULL != (next_line = strchr(line, '\n')))
+        *(next_line++) = '\0';
+
+    /* lazy initialization */
+    if(tokens->record == NULL) {
+        darray_init(tokens->record);
+        darray_init(tokens->param);
+    }
 
     /* skip spaces */
     for(p = line; *p && isspace((int)*p); p++);
     if(*p == '\0')
-        return true; /* the line is an empty string */
+        return next_line; /* the line is an empty string */
 
     /* reading the identifier */
     for(identifier = p; *p && !isspace((int)*p); p++);
@@ -121,13 +358,14 @@ bool parse_line(const char* filepath, int fileline, char* line, void* data, levp
         *(p++) = '\0';
 
     if((identifier[0] == '/' && identifier[1] == '/') || identifier[0] == '#')
-        return true; /* the line is a comment */
+        return next_line; /* the line is a comment */
 
     /* skip spaces */
     for(; *p && isspace((int)*p); p++);
 
     /* read the arguments */
     int param_count = 0;
+    int first_param = darray_length(tokens->param);
     while(*p && param_count < MAX_PARAMS) {
         /* read an argument */
         bool quotes = (*p == '"') && (p++); /* advance p if *p is '"' */
@@ -149,14 +387,84 @@ bool parse_line(const char* filepath, int fileline, char* line, void* data, levp
         #endif
 
         /* store the argument */
-        param[param_count++] = arg;
+        darray_push(tokens->param, (const char*)arg);
+        param_count++;
 
         /* skip spaces */
         for(; *p && isspace((int)*p); p++);
     }
 
-    /* interpret the line */
-    return callback(filepath, fileline, find_command(identifier), identifier, param_count, (const char**)param, data);
+    /* store the line */
+    levrecord_t r = {
+        .command = find_command(identifier),
+        .command_name = identifier,
+        .fileline = fileline,
+        .param_count = param_count,
+        .first_param = first_param
+    };
+    darray_push(tokens->record, r);
+
+    return next_line;
+}
+
+/* reads and tokenizes a level file in a worker thread */
+void* preload_worker(ALLEGRO_THREAD* thread, void* arg)
+{
+    levpreload_t* job = (levpreload_t*)arg;
+    size_t size = 0;
+    char* text;
+
+    /* use the physfs file interface in this thread */
+    al_set_physfs_file_interface();
+
+    /* read and tokenize the file */
+    if(NULL != (text = read_file(job->tokens.path, &size))) {
+        job->tokens.size = size;
+        job->tokens.checksum = djb2(text);
+        tokenize_file(&job->tokens, text);
+        job->success = true;
+    }
+
+    /* done */
+    al_lock_mutex(job->mutex);
+    job->is_done = true;
+    al_unlock_mutex(job->mutex);
+    return NULL;
+}
+
+/* replace the cache by the tokens of the preloaded file, if it's the given one.
+   Waits for the worker thread if necessary */
+bool adopt_preloaded_file(const char* fullpath)
+{
+    bool success;
+
+    if(preload == NULL || 0 != strcmp(fullpath, preload->tokens.path))
+        return false;
+
+    al_join_thread(preload->thread, NULL);
+    if((success = preload->success)) {
+        clear_tokens(&cache);
+        cache = preload->tokens;
+        preload->tokens = (levtokens_t){ .path = NULL };
+    }
+
+    discard_preloaded_file();
+    return success;
+}
+
+/* discard the preloaded file, if any. Waits for the worker thread if necessary */
+void discard_preloaded_file()
+{
+    if(preload == NULL)
+        return;
+
+    al_join_thread(preload->thread, NULL);
+    al_destroy_thread(preload->thread);
+    al_destroy_mutex(preload->mutex);
+
+    clear_tokens(&preload->tokens);
+    free(preload);
+    preload = NULL;
 }
 
 /* map a command string to a command enum */
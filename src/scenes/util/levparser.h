@@ -27,6 +27,12 @@ typedef enum levparser_command_t levparser_command_t;
 typedef bool (*levparser_callback_t)(const char *filepath, int fileline, levparser_command_t command, const char *command_name, int param_count, const char **param, void* data);
 
 bool levparser_parse(const char* path_to_lev_file, void* data, levparser_callback_t callback);
+bool levparser_replay(const char* path_to_lev_file, void* data, levparser_callback_t callback); /* interprets the last parsed file again without reading it; returns false if it's not in memory */
+void levparser_release();
+
+/* preloading: read and tokenize a level file in the background, so that a subsequent levparser_parse() of it is fast */
+void levparser_preload(const char* path_to_lev_file);
+bool levparser_is_preloading(); /* is a level file being preloaded? */
 
 enum levparser_command_t
 {
@@ -0,0 +1,263 @@
+/*
+ * Open Surge Engine
+ * levpreload.c - preload the assets of the next level
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "levpreload.h"
+#include "levparser.h"
+#include "../../core/image.h"
+#include "../../core/audio.h"
+#include "../../core/asset.h"
+#include "../../core/logfile.h"
+#include "../../core/nanoparser.h"
+#include "../../util/util.h"
+#include "../../util/stringutil.h"
+#include "../../util/darray.h"
+
+/*
+
+LEVEL PRELOADING
+
+When a level is cleared, its ending sequence and the fade-out effect take a few
+seconds. We use that time to preload the next level of the quest, one step per
+frame, so that the transition is close to instantaneous:
+
+1. a worker thread reads and tokenizes the .lev file (see levparser_preload)
+2. we read the header of the level and prefetch its music in the background
+3. we decode the images of the brickset and of the background asynchronously
+
+The preloaded assets are kept in the resource manager, referenced by us, until
+the next level is loaded and references them on its own. Scripts are compiled
+when the engine starts, so there is nothing to preload for them.
+
+*/
+typedef enum levpreloadstep_t levpreloadstep_t;
+enum levpreloadstep_t {
+    PRELOAD_IDLE,
+    PRELOAD_TOKENIZING,
+    PRELOAD_HEADER,
+    PRELOAD_BRICKSET,
+    PRELOAD_BACKGROUND,
+    PRELOAD_DONE
+};
+
+static levpreloadstep_t step = PRELOAD_IDLE;
+static char* level_path = NULL; /* the level being preloaded */
+static char theme[1024] = ""; /* path to the brickset */
+static char bgtheme[1024] = ""; /* path to the background */
+STATIC_DARRAY(image_t*, preloaded_image); /* images referenced by the preloader */
+
+static bool read_header_line(const char *filepath, int fileline, levparser_command_t command, const char *command_name, int param_count, const char** param, void* data);
+static void preload_images(const char* path_to_script);
+static int traverse_images(const parsetree_statement_t* stmt);
+static void release_preloaded_images();
+
+
+
+/*
+ * levpreload_start()
+ * Starts preloading a level. Call while the current level is ending
+ */
+void levpreload_start(const char* path_to_lev_file)
+{
+    /* already preloading this level */
+    if(level_path != NULL && 0 == strcmp(level_path, path_to_lev_file))
+        return;
+
+    /* the level doesn't exist; let the level loader report it */
+    if(!asset_exists(path_to_lev_file))
+        return;
+
+    logfile_message("Preloading level \"%s\"...", path_to_lev_file);
+
+    /* keep the previously preloaded images until the next level is loaded */
+    if(preloaded_image == NULL)
+        darray_init(preloaded_image);
+
+    free(level_path);
+    level_path = str_dup(path_to_lev_file);
+    *theme = *bgtheme = '\0';
+
+    /* read and tokenize the level file in the background */
+    levparser_preload(level_path);
+    step = PRELOAD_TOKENIZING;
+}
+
+/*
+ * levpreload_update()
+ * Advances the preloading of a level by one step. Call every frame
+ */
+void levpreload_update()
+{
+    switch(step) {
+        case PRELOAD_IDLE:
+        case PRELOAD_DONE:
+            break;
+
+        case PRELOAD_TOKENIZING:
+            if(!levparser_is_preloading())
+                step = PRELOAD_HEADER;
+            break;
+
+        case PRELOAD_HEADER: {
+            char musicfile[1024] = "";
+
+            /* the level file has been tokenized already */
+            if(!levparser_parse(level_path, musicfile, read_header_line)) {
+                logfile_message("Can't preload level \"%s\"", level_path);
+                step = PRELOAD_DONE;
+                break;
+            }
+
+            /* open the music in the background */
+            if(*musicfile != '\0')
+                music_prefetch(musicfile);
+
+            step = PRELOAD_BRICKSET;
+            break;
+        }
+
+        case PRELOAD_BRICKSET:
+            if(*theme != '\0')
+                preload_images(theme);
+            step = PRELOAD_BACKGROUND;
+            break;
+
+        case PRELOAD_BACKGROUND:
+            if(*bgtheme != '\0')
+                preload_images(bgtheme);
+            logfile_message("Level \"%s\" has been preloaded", level_path);
+            step = PRELOAD_DONE;
+            break;
+    }
+}
+
+/*
+ * levpreload_finish()
+ * Releases the references to the preloaded assets. Call after loading
+ * a level: the assets it uses are referenced by it by now
+ */
+void levpreload_finish()
+{
+    release_preloaded_images();
+
+    free(level_path);
+    level_path = NULL;
+    step = PRELOAD_IDLE;
+}
+
+/*
+ * levpreload_release()
+ * Releases the preloader
+ */
+void levpreload_release()
+{
+    levpreload_finish();
+
+    if(preloaded_image != NULL)
+        darray_release(preloaded_image);
+}
+
+
+
+/* private */
+
+/* read a line of the header of the level file */
+bool read_header_line(const char *filepath, int fileline, levparser_command_t command, const char *command_name, int param_count, const char** param, void* data)
+{
+    char* musicfile = (char*)data;
+
+    switch(command) {
+        case LEVCOMMAND_THEME:
+            if(param_count == 1)
+                str_cpy(theme, param[0], sizeof(theme));
+            break;
+
+        case LEVCOMMAND_BGTHEME:
+            if(param_count == 1)
+                str_cpy(bgtheme, param[0], sizeof(bgtheme));
+            break;
+
+        case LEVCOMMAND_MUSIC:
+            if(param_count == 1)
+                str_cpy(musicfile, param[0], 1024);
+            break;
+
+        case LEVCOMMAND_BRICK:
+        case LEVCOMMAND_ENTITY:
+            return false; /* stop the enumeration after reading the header */
+
+        default:
+            break;
+    }
+
+    return true;
+}
+
+/* decode in the background the images referenced by the sprites of a script (.brk, .bg) */
+void preload_images(const char* path_to_script)
+{
+    if(!asset_exists(path_to_script))
+        return;
+
+    parsetree_program_t* tree = nanoparser_construct_tree(asset_path(path_to_script));
+    nanoparser_traverse_program(tree, traverse_images);
+    tree = nanoparser_deconstruct_tree(tree);
+}
+
+/* look for source_file statements, recursively */
+int traverse_images(const parsetree_statement_t* stmt)
+{
+    const char* identifier = nanoparser_get_identifier(stmt);
+    const parsetree_parameter_t* param_list = nanoparser_get_parameter_list(stmt);
+    int n = nanoparser_get_number_of_parameters(param_list);
+
+    /* found an image */
+    if(str_icmp(identifier, "source_file") == 0) {
+        const char* path = n >= 1 ? nanoparser_get_string(nanoparser_get_nth_parameter(param_list, 1)) : NULL;
+
+        if(path != NULL && asset_exists(path)) {
+            image_t* img = image_load_async(path);
+            darray_push(preloaded_image, img);
+        }
+
+        return 0;
+    }
+
+    /* look into the blocks */
+    for(int i = 1; i <= n; i++) {
+        const parsetree_program_t* block = nanoparser_get_program(nanoparser_get_nth_parameter(param_list, i));
+        if(block != NULL)
+            nanoparser_traverse_program(block, traverse_images);
+    }
+
+    return 0;
+}
+
+/* release the references to the preloaded images */
+void release_preloaded_images()
+{
+    if(preloaded_image == NULL)
+        return;
+
+    for(int i = 0; i < darray_length(preloaded_image); i++)
+        image_unload(preloaded_image[i]);
+
+    darray_clear(preloaded_image);
+}
@@ -0,0 +1,29 @@
+/*
+ * Open Surge Engine
+ * levpreload.h - preload the assets of the next level
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LEVPRELOAD_H
+#define _LEVPRELOAD_H
+
+void levpreload_start(const char* path_to_lev_file); /* call while the current level is ending */
+void levpreload_update(); /* call every frame */
+void levpreload_finish(); /* call after loading a level */
+void levpreload_release();
+
+#endif
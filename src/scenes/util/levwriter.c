@@ -0,0 +1,380 @@
+/*
+ * Open Surge Engine
+ * levwriter.c - writer for level files (.lev)
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <allegro5/allegro.h>
+#include <physfs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include "levwriter.h"
+#include "../../core/asset.h"
+#include "../../core/logfile.h"
+#include "../../util/util.h"
+#include "../../util/darray.h"
+
+/* OS-specific includes */
+#if defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+/*
+
+Saving a large level used to stall the editor, as each line was written to the
+disk as soon as it was formatted. Now the contents of the file are composed in
+memory, which is quick, and a worker thread writes them to a temporary file that
+then replaces the level file. Level files are never left half-written.
+
+*/
+#if defined(__EMSCRIPTEN__)
+#define WANT_BACKGROUND_WRITES 0 /* no threads */
+#else
+#define WANT_BACKGROUND_WRITES 1
+#endif
+
+/* the contents of a level file */
+struct levwriter_t {
+    DARRAY(char, text); /* not NUL-terminated */
+};
+
+/* a write in progress */
+typedef struct levjob_t levjob_t;
+struct levjob_t {
+    char* text; /* contents of the file */
+    size_t size; /* size of text, in bytes */
+    char* fullpath; /* absolute path of the level file */
+    char* tmppath; /* absolute path of the temporary file */
+    FILE* fp; /* the temporary file, opened for writing */
+    bool success; /* has the file been written successfully? */
+#if WANT_BACKGROUND_WRITES
+    ALLEGRO_THREAD* thread;
+    ALLEGRO_MUTEX* mutex; /* protects done */
+    bool done;
+#endif
+};
+
+static levjob_t* job = NULL;
+static char* writedir_path(const char* virtual_path);
+static bool write_to_physfs(const char* virtual_path, const char* text, size_t size);
+static void write_atomically(levjob_t* job);
+static void finish_job();
+#if WANT_BACKGROUND_WRITES
+static void* writer_thread(ALLEGRO_THREAD* thread, void* arg);
+#endif
+
+
+
+/*
+ * levwriter_create()
+ * Creates an empty level file in memory
+ */
+levwriter_t* levwriter_create()
+{
+    levwriter_t* writer = mallocx(sizeof *writer);
+    darray_init_ex(writer->text, 64 * 1024);
+    return writer;
+}
+
+/*
+ * levwriter_destroy()
+ * Destroys a level file in memory without writing it
+ */
+levwriter_t* levwriter_destroy(levwriter_t* writer)
+{
+    darray_release(writer->text);
+    free(writer);
+    return NULL;
+}
+
+/*
+ * levwriter_printf()
+ * Appends formatted text to a level file in memory
+ */
+void levwriter_printf(levwriter_t* writer, const char* format, ...)
+{
+    size_t length = darray_length(writer->text);
+    size_t available = darray_capacity(writer->text) - length;
+    va_list args;
+    int n;
+
+    /* try to format the text in the space that is available */
+    va_start(args, format);
+    n = vsnprintf(writer->text + length, available, format, args);
+    va_end(args);
+
+    if(n < 0)
+        return;
+
+    /* not enough space; vsnprintf() needs room for the '\0' */
+    if((size_t)n >= available) {
+        darray_reserve(writer->text, length + n + 1);
+
+        va_start(args, format);
+        vsnprintf(writer->text + length, n + 1, format, args);
+        va_end(args);
+    }
+
+    darray_resize(writer->text, length + n);
+}
+
+/*
+ * levwriter_commit()
+ * Writes a level file to the disk, in the background if possible.
+ * Takes ownership of the writer. Returns false if the file can't be written
+ */
+bool levwriter_commit(levwriter_t* writer, const char* path_to_lev_file)
+{
+    size_t size = darray_length(writer->text);
+    char* text = writer->text; /* take ownership of the text */
+    char* fullpath;
+
+    free(writer);
+
+    /* we write one file at a time */
+    levwriter_wait();
+
+    /* can't write outside of the virtual filesystem */
+    if(NULL == (fullpath = writedir_path(path_to_lev_file))) {
+        bool success = write_to_physfs(path_to_lev_file, text, size);
+        free(text);
+        return success;
+    }
+
+    /* create a write job */
+    job = mallocx(sizeof *job);
+    job->text = text;
+    job->size = size;
+    job->fullpath = fullpath;
+    job->tmppath = mallocx(strlen(fullpath) + 5);
+    job->success = false;
+    strcpy(job->tmppath, fullpath);
+    strcat(job->tmppath, ".tmp");
+
+    /* open the temporary file now, so that we can report errors */
+    if(NULL == (job->fp = fopen(job->tmppath, "wb"))) {
+        logfile_message("Can't open \"%s\" for writing: %s", job->tmppath, strerror(errno));
+        free(job->tmppath);
+        free(job->fullpath);
+        free(job->text);
+        free(job);
+        job = NULL;
+        return false;
+    }
+
+#if WANT_BACKGROUND_WRITES
+    /* write the file in a worker thread */
+    job->done = false;
+    job->mutex = al_create_mutex();
+    job->thread = al_create_thread(writer_thread, job);
+    if(job->mutex != NULL && job->thread != NULL) {
+        logfile_message("Writing level file \"%s\" in the background...", job->fullpath);
+        al_start_thread(job->thread);
+        return true;
+    }
+
+    /* can't create a thread; write now */
+    logfile_message("Can't create the level writer thread");
+    if(job->thread != NULL) {
+        al_destroy_thread(job->thread);
+        job->thread = NULL;
+    }
+    job->done = true;
+#endif
+
+    write_atomically(job);
+
+    bool success = job->success;
+    finish_job();
+    return success;
+}
+
+/*
+ * levwriter_is_writing()
+ * Checks if a level file is being written. Finished writes are cleaned up
+ */
+bool levwriter_is_writing()
+{
+    if(job == NULL)
+        return false;
+
+#if WANT_BACKGROUND_WRITES
+    bool done;
+    al_lock_mutex(job->mutex);
+    done = job->done;
+    al_unlock_mutex(job->mutex);
+
+    if(!done)
+        return true;
+#endif
+
+    finish_job();
+    return false;
+}
+
+/*
+ * levwriter_wait()
+ * Waits for the pending write, if any
+ */
+void levwriter_wait()
+{
+    if(job != NULL)
+        finish_job();
+}
+
+
+
+
+/*
+ * private
+ */
+
+/* the absolute path of a file in the write dir, or NULL if there is none.
+   The returned string must be freed */
+char* writedir_path(const char* virtual_path)
+{
+    const char* writedir = PHYSFS_getWriteDir();
+    if(writedir == NULL)
+        return NULL;
+
+    /* create the parent directory in the write dir, if it doesn't exist */
+    const char* slash = strrchr(virtual_path, '/');
+    if(slash != NULL && slash != virtual_path) {
+        char* dirpath = mallocx(slash - virtual_path + 1);
+        memcpy(dirpath, virtual_path, slash - virtual_path);
+        dirpath[slash - virtual_path] = '\0';
+        PHYSFS_mkdir(dirpath);
+        free(dirpath);
+    }
+
+    /* join the paths */
+    const char* separator = PHYSFS_getDirSeparator();
+    size_t writedir_length = strlen(writedir);
+    size_t separator_length = strlen(separator);
+    size_t path_length = strlen(virtual_path);
+    char* fullpath = mallocx(writedir_length + separator_length + path_length + 1);
+
+    while(*virtual_path == '/') {
+        virtual_path++;
+        path_length--;
+    }
+
+    memcpy(fullpath, writedir, writedir_length);
+    if(writedir_length < separator_length || 0 != strcmp(writedir + writedir_length - separator_length, separator)) {
+        memcpy(fullpath + writedir_length, separator, separator_length);
+        writedir_length += separator_length;
+    }
+    memcpy(fullpath + writedir_length, virtual_path, path_length + 1);
+
+    return fullpath;
+}
+
+/* write a file using the file interface of the current thread */
+bool write_to_physfs(const char* virtual_path, const char* text, size_t size)
+{
+    ALLEGRO_FILE* fp = al_fopen(virtual_path, "w");
+    bool success = false;
+
+    if(fp != NULL) {
+        success = (size == al_fwrite(fp, text, size));
+        success = al_fclose(fp) && success;
+    }
+
+    if(!success)
+        logfile_message("Can't write level file \"%s\"", virtual_path);
+    else
+        asset_invalidate_index();
+
+    return success;
+}
+
+/* write the temporary file and then replace the level file with it.
+   This is thread-safe */
+void write_atomically(levjob_t* job)
+{
+    bool success;
+
+    /* write the temporary file */
+    success = (job->size == fwrite(job->text, 1, job->size, job->fp));
+    success = (0 == fflush(job->fp)) && success;
+#if defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__))
+    success = (0 == fsync(fileno(job->fp))) && success;
+#endif
+    success = (0 == fclose(job->fp)) && success;
+    job->fp = NULL;
+
+    /* replace the level file */
+    if(success) {
+#if defined(_WIN32)
+        success = (0 != MoveFileExA(job->tmppath, job->fullpath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH));
+#else
+        success = (0 == rename(job->tmppath, job->fullpath));
+#endif
+    }
+
+    /* error? */
+    if(!success)
+        remove(job->tmppath);
+
+    job->success = success;
+}
+
+/* wait for the write job to finish and destroy it */
+void finish_job()
+{
+#if WANT_BACKGROUND_WRITES
+    if(job->thread != NULL)
+        al_destroy_thread(job->thread); /* joins the thread */
+    if(job->mutex != NULL)
+        al_destroy_mutex(job->mutex);
+#endif
+
+    /* report the result on the main thread */
+    if(job->success) {
+        logfile_message("Level file \"%s\" has been written", job->fullpath);
+        asset_invalidate_index(); /* the file may be new */
+    }
+    else
+        logfile_message("Can't write level file \"%s\"", job->fullpath);
+
+    free(job->tmppath);
+    free(job->fullpath);
+    free(job->text);
+    free(job);
+    job = NULL;
+}
+
+#if WANT_BACKGROUND_WRITES
+/* the writer thread */
+void* writer_thread(ALLEGRO_THREAD* thread, void* arg)
+{
+    levjob_t* job = (levjob_t*)arg;
+
+    write_atomically(job);
+
+    al_lock_mutex(job->mutex);
+    job->done = true;
+    al_unlock_mutex(job->mutex);
+
+    return NULL;
+}
+#endif
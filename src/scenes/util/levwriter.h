@@ -0,0 +1,38 @@
+/*
+ * Open Surge Engine
+ * levwriter.h - writer for level files (.lev)
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LEVWRITER_H
+#define _LEVWRITER_H
+
+#include <stdbool.h>
+
+/* the contents of a level file are composed in memory and then written to the disk in the background */
+typedef struct levwriter_t levwriter_t;
+
+levwriter_t* levwriter_create();
+levwriter_t* levwriter_destroy(levwriter_t* writer);
+void levwriter_printf(levwriter_t* writer, const char* format, ...);
+
+/* writing: the file is replaced atomically. levwriter_commit() takes ownership of the writer */
+bool levwriter_commit(levwriter_t* writer, const char* path_to_lev_file); /* returns false if the file can't be written */
+bool levwriter_is_writing(); /* is a level file being written? Call regularly to clean up finished writes */
+void levwriter_wait(); /* waits for the pending write, if any */
+
+#endif
@@ -73,6 +73,20 @@ static const surgescript_heapptr_t OFFSET_ADDR = 4;
 static const double DEFAULT_ZINDEX = 0.5;
 static inline surgescript_object_t* get_animation(surgescript_object_t* object);
 
+/* render metadata, read directly by the render queue */
+static float renderable_zindex(surgescript_object_t* object);
+static bool renderable_is_visible(surgescript_object_t* object);
+static bool renderable_is_translucent(surgescript_object_t* object);
+static bool renderable_texture(surgescript_object_t* object, texturehandle_t* texture);
+static const char* renderable_filepath(surgescript_object_t* object);
+static const scripting_renderable_t RENDERABLE = {
+    .zindex = renderable_zindex,
+    .is_visible = renderable_is_visible,
+    .is_translucent = renderable_is_translucent,
+    .texture = renderable_texture,
+    .filepath = renderable_filepath
+};
+
 /*
  * scripting_register_actor()
  * Register this component
@@ -119,6 +133,9 @@ void scripting_register_actor(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "Actor", "get_actionSpot", fun_getactionspot, 0);
     surgescript_vm_bind(vm, "Actor", "get_actionOffset", fun_getactionoffset, 0);
     surgescript_vm_bind(vm, "Actor", "onAnimationChange", fun_onanimationchange, 1);
+
+    /* render metadata */
+    scripting_util_register_renderable("Actor", &RENDERABLE);
 }
 
 /*
@@ -245,19 +262,14 @@ surgescript_var_t* fun_canbeclippedout(surgescript_object_t* object, const surge
 /* the filepath of this renderable (used by the render queue) */
 surgescript_var_t* fun_getfilepathofrenderable(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    const actor_t* actor = scripting_actor_ptr(object);
-    const image_t* image = actor_image(actor);
-    const char* filepath = image_filepath(image);
-
-    return surgescript_var_set_string(surgescript_var_create(), filepath);
+    return surgescript_var_set_string(surgescript_var_create(), renderable_filepath(object));
 }
 
 /* the texture handle of this renderable (used by the render queue) */
 surgescript_var_t* fun_gettexturehandle(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    const actor_t* actor = scripting_actor_ptr(object);
-    const image_t* image = actor_image(actor);
-    texturehandle_t tex = image_texture(image);
+    texturehandle_t tex;
+    renderable_texture(object, &tex);
 
     return surgescript_var_set_rawbits(surgescript_var_create(), tex);
 }
@@ -265,18 +277,7 @@ surgescript_var_t* fun_gettexturehandle(surgescript_object_t* object, const surg
 /* is this renderable translucent? (used by the render queue) */
 surgescript_var_t* fun_getistranslucent(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    actor_t* actor = scripting_actor_ptr(object);
-    bool is_translucent = (actor->alpha < 1.0f); /* doesn't take individual pixels into account */
-
-    if(!is_translucent) {
-        const surgescript_object_t* animation = get_animation(object);
-        const animation_t* anim = scripting_animation_ptr(animation);
-
-        if(animation_has_keyframes(anim)) /* FIXME should be has_keyframes_with_changed_opacity or similar */
-            is_translucent = true;
-    }
-
-    return surgescript_var_set_bool(surgescript_var_create(), is_translucent);
+    return surgescript_var_set_bool(surgescript_var_create(), renderable_is_translucent(object));
 }
 
 /* __init: set sprite name */
@@ -300,8 +301,7 @@ surgescript_var_t* fun_setzindex(surgescript_object_t* object, const surgescript
 /* get zindex (defaults to DEFAULT_ZINDEX) */
 surgescript_var_t* fun_getzindex(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    surgescript_heap_t* heap = surgescript_object_heap(object);
-    return surgescript_var_clone(surgescript_heap_at(heap, ZINDEX_ADDR));
+    return surgescript_var_set_number(surgescript_var_create(), renderable_zindex(object));
 }
 
 /* set animation number */
@@ -393,8 +393,7 @@ surgescript_var_t* fun_setalpha(surgescript_object_t* object, const surgescript_
 /* is this actor visible? */
 surgescript_var_t* fun_getvisible(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    actor_t* actor = scripting_actor_ptr(object);
-    return surgescript_var_set_bool(surgescript_var_create(), actor->visible);
+    return surgescript_var_set_bool(surgescript_var_create(), renderable_is_visible(object));
 }
 
 /* set actor visibility */
@@ -472,6 +471,7 @@ surgescript_var_t* fun_setoffset(surgescript_object_t* object, const surgescript
     surgescript_object_t* v2 = surgescript_objectmanager_get(manager, v2h);
     scripting_vector2_read(v2, &x, &y);
     surgescript_transform_setposition2d(transform, x, y);
+    scripting_transform_invalidate();
 
     return NULL;
 }
@@ -538,3 +538,57 @@ surgescript_object_t* get_animation(surgescript_object_t* object)
     surgescript_object_t* animation = surgescript_objectmanager_get(manager, animation_handle);
     return animation;
 }
+
+
+
+/* render metadata */
+
+/* zindex */
+float renderable_zindex(surgescript_object_t* object)
+{
+    surgescript_heap_t* heap = surgescript_object_heap(object);
+    return surgescript_var_get_number(surgescript_heap_at(heap, ZINDEX_ADDR));
+}
+
+/* is the actor visible? */
+bool renderable_is_visible(surgescript_object_t* object)
+{
+    const actor_t* actor = scripting_actor_ptr(object);
+    return actor->visible;
+}
+
+/* is this renderable translucent? */
+bool renderable_is_translucent(surgescript_object_t* object)
+{
+    const actor_t* actor = scripting_actor_ptr(object);
+    bool is_translucent = (actor->alpha < 1.0f); /* doesn't take individual pixels into account */
+
+    if(!is_translucent) {
+        const surgescript_object_t* animation = get_animation(object);
+        const animation_t* anim = scripting_animation_ptr(animation);
+
+        if(animation_has_keyframes(anim)) /* FIXME should be has_keyframes_with_changed_opacity or similar */
+            is_translucent = true;
+    }
+
+    return is_translucent;
+}
+
+/* the texture of the current frame */
+bool renderable_texture(surgescript_object_t* object, texturehandle_t* texture)
+{
+    const actor_t* actor = scripting_actor_ptr(object);
+    const image_t* image = actor_image(actor);
+
+    *texture = image_texture(image);
+    return true;
+}
+
+/* the filepath of the image of the current frame */
+const char* renderable_filepath(surgescript_object_t* object)
+{
+    const actor_t* actor = scripting_actor_ptr(object);
+    const image_t* image = actor_image(actor);
+
+    return image_filepath(image);
+}
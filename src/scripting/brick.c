@@ -296,7 +296,8 @@ surgescript_var_t* fun_destructor(surgescript_object_t* object, const surgescrip
     /* this block of code would crash the application, as it would
        invalidate pointers from a valid obstacle map. However, we
        clone the collision mask of this brick-like object and use
-       the clone in the obstacle map instead. */
+       the clone in the obstacle map instead. Collision masks are
+       reference counted, so the clone keeps the mask alive. */
     if(data->mask != NULL) {
         collisionmask_destroy(data->mask);
         if(data->maskimg != NULL)
@@ -479,6 +480,7 @@ surgescript_var_t* fun_setoffset(surgescript_object_t* object, const surgescript
     surgescript_object_t* v2 = surgescript_objectmanager_get(manager, v2h);
     scripting_vector2_read(v2, &x, &y);
     surgescript_transform_setposition2d(transform, x, y);
+    scripting_transform_invalidate();
 
     return NULL;
 }
@@ -25,22 +25,48 @@
 #include "../core/video.h"
 #include "../util/v2d.h"
 #include "../util/util.h"
+#include "../util/darray.h"
 #include "../entities/brick.h"
 #include "../entities/camera.h"
 #include "../scenes/level.h"
 
+/*
+
+A BrickParticle is an emitter: a single SurgeScript object that simulates
+and renders all the pieces of a brick that has been broken. The pieces are
+stored in a contiguous native array and rendered with deferred drawing, so
+that we don't pay the cost of one object per piece.
+
+*/
+
+/* a piece of a brick */
+typedef struct particle_t particle_t;
+struct particle_t
+{
+    v2d_t position; /* in world space */
+    v2d_t velocity; /* in px/s */
+    int src_x, src_y, width, height; /* region of the brick image */
+};
+
 /* brick particle data */
 typedef struct particledata_t particledata_t;
 struct particledata_t
 {
     const image_t* image; /* possibly NULL */
-    int src_x, src_y, width, height;
     double zindex;
-    v2d_t velocity;
+    DARRAY(particle_t, particle);
 };
 
 /* constants */
 static const double DEFAULT_ZINDEX = 0.5;
+#define MAX_PARTICLES 1024 /* per emitter */
+#define MAX_PARTICLES_UNDER_LOAD 256 /* per emitter, when the quality governor asks for fewer particles */
+
+/* recycling: bricks are broken often, so the data of destroyed
+   emitters is kept and reused, including the memory of the pieces */
+#define MAX_RECYCLED_EMITTERS 16
+static particledata_t* recycled_particledata[MAX_RECYCLED_EMITTERS];
+static int recycled_count = 0;
 
 /* SurgeScript functions */
 static surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
@@ -57,6 +83,20 @@ static surgescript_var_t* fun_setvelocity(surgescript_object_t* object, const su
 static inline particledata_t* get_particledata(const surgescript_object_t* object);
 static particledata_t* create_particledata();
 static particledata_t* destroy_particledata(particledata_t* pd);
+static bool set_brick(particledata_t* pd, int brick_id);
+static void add_particle(particledata_t* pd, int src_x, int src_y, int width, int height, v2d_t position, v2d_t velocity);
+
+/* render metadata, read directly by the render queue */
+static float renderable_zindex(surgescript_object_t* object);
+static bool renderable_is_translucent(surgescript_object_t* object);
+static bool renderable_texture(surgescript_object_t* object, texturehandle_t* texture);
+static const char* renderable_filepath(surgescript_object_t* object);
+static const scripting_renderable_t RENDERABLE = {
+    .zindex = renderable_zindex,
+    .is_translucent = renderable_is_translucent,
+    .texture = renderable_texture,
+    .filepath = renderable_filepath
+};
 
 
 
@@ -90,6 +130,47 @@ void scripting_register_brickparticle(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "BrickParticle", "get___textureHandle", fun_gettexturehandle, 0);
     surgescript_vm_bind(vm, "BrickParticle", "get___isTranslucent", fun_getistranslucent, 0);
     surgescript_vm_bind(vm, "BrickParticle", "onRender", fun_onrender, 2);
+
+    /* render metadata */
+    scripting_util_register_renderable("BrickParticle", &RENDERABLE);
+}
+
+/*
+ * scripting_brickparticle_setbrick()
+ * Sets the brick whose pieces will be emitted by a BrickParticle object
+ */
+bool scripting_brickparticle_setbrick(surgescript_object_t* object, int brick_id)
+{
+    particledata_t* pd = get_particledata(object);
+    return set_brick(pd, brick_id);
+}
+
+/*
+ * scripting_brickparticle_add()
+ * Adds a piece of the brick to a BrickParticle object. The source
+ * rectangle is given in brick space; position is given in world space
+ */
+void scripting_brickparticle_add(surgescript_object_t* object, int src_x, int src_y, int width, int height, v2d_t position, v2d_t velocity)
+{
+    particledata_t* pd = get_particledata(object);
+    add_particle(pd, src_x, src_y, width, height, position, velocity);
+}
+
+
+
+
+/*
+ * scripting_brickparticle_release()
+ * Releases the recycled data of destroyed BrickParticle objects.
+ * Call after destroying the VM
+ */
+void scripting_brickparticle_release()
+{
+    while(recycled_count > 0) {
+        particledata_t* pd = recycled_particledata[--recycled_count];
+        darray_release(pd->particle);
+        free(pd);
+    }
 }
 
 
@@ -104,18 +185,35 @@ SurgeScript functions
 /* main state */
 surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    surgescript_transform_t* transform = surgescript_object_transform(object);
     particledata_t* pd = get_particledata(object);
+    int count = darray_length(pd->particle);
     float dt = timer_get_delta();
-
-    /* update velocity */
     float grv = level_gravity();
-    pd->velocity.y += grv * dt;
+    v2d_t centroid = v2d_new(0.0f, 0.0f);
+
+    /* nothing to do? */
+    if(count == 0)
+        return NULL;
+
+    /* update the particles */
+    for(int i = 0; i < count; i++) {
+        particle_t* p = &(pd->particle[i]);
+
+        /* update velocity */
+        p->velocity.y += grv * dt;
 
-    /* update position */
-    float dx = pd->velocity.x * dt;
-    float dy = pd->velocity.y * dt;
-    surgescript_transform_translate2d(transform, dx, dy);
+        /* update position */
+        p->position.x += p->velocity.x * dt;
+        p->position.y += p->velocity.y * dt;
+
+        /* accumulate */
+        centroid.x += p->position.x;
+        centroid.y += p->position.y;
+    }
+
+    /* move the emitter to the centroid of the particles */
+    centroid = v2d_multiply(centroid, 1.0f / (float)count);
+    scripting_util_set_world_position(object, centroid);
 
     /* this disposable entity will be removed automatically by the Entity Manager */
 
@@ -129,32 +227,34 @@ surgescript_var_t* fun_onrender(surgescript_object_t* object, const surgescript_
     double camera_x = surgescript_var_get_number(param[0]);
     double camera_y = surgescript_var_get_number(param[1]);
     v2d_t camera = v2d_new(camera_x, camera_y);
-    v2d_t position = v2d_new(0.0f, 0.0f);
 
     /* nothing to do? */
     const particledata_t* pd = get_particledata(object);
     if(pd->image == NULL)
         return NULL; /* image not yet set */
 
-    /* get position in world space */
-    const surgescript_transform_t* transform = surgescript_object_transform(object);
-    surgescript_transform_getposition2d(transform, &position.x, &position.y);
-
-    /* convert position to screen space */
-    v2d_t center_of_screen = v2d_multiply(video_get_screen_size(), 0.5f);
+    /* find the top-left of the screen */
+    v2d_t screen_size = video_get_screen_size();
+    v2d_t center_of_screen = v2d_multiply(screen_size, 0.5f);
     v2d_t topleft_of_screen = v2d_subtract(camera, center_of_screen);
-    position = v2d_subtract(position, topleft_of_screen);
-
-    /* render */
-    image_blit(
-        pd->image,
-        pd->src_x,
-        pd->src_y,
-        (int)position.x,
-        (int)position.y,
-        pd->width,
-        pd->height
-    );
+
+    /* render all particles at once; they share the same texture */
+    image_hold_drawing(true);
+    for(int i = 0; i < darray_length(pd->particle); i++) {
+        const particle_t* p = &(pd->particle[i]);
+
+        /* convert position to screen space */
+        v2d_t position = v2d_subtract(p->position, topleft_of_screen);
+        int x = (int)position.x, y = (int)position.y;
+
+        /* clip out */
+        if(x + p->width <= 0 || x >= (int)screen_size.x || y + p->height <= 0 || y >= (int)screen_size.y)
+            continue;
+
+        /* render */
+        image_blit(pd->image, p->src_x, p->src_y, x, y, p->width, p->height);
+    }
+    image_hold_drawing(false);
 
     /* done */
     return NULL;
@@ -192,7 +292,7 @@ surgescript_var_t* fun_destructor(surgescript_object_t* object, const surgescrip
     return NULL;
 }
 
-/* set brick */
+/* set brick: emits a single piece of the brick at the position of the object */
 surgescript_var_t* fun_setbrick(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
     int brick_id = surgescript_var_get_number(param[0]);
@@ -201,32 +301,25 @@ surgescript_var_t* fun_setbrick(surgescript_object_t* object, const surgescript_
     int width = surgescript_var_get_number(param[3]);
     int height = surgescript_var_get_number(param[4]);
 
-    if(brick_exists(brick_id)) {
-        const image_t* brick_image = brick_image_preview(brick_id);
-        int brick_width = image_width(brick_image);
-        int brick_height = image_height(brick_image);
-        float zindex = brick_zindex_preview(brick_id);
-
-        particledata_t* pd = get_particledata(object);
-        pd->image = brick_image;
-        pd->width = clip(width, 0, brick_width);
-        pd->height = clip(height, 0, brick_height);
-        pd->src_x = clip(src_x, 0, brick_width - pd->width);
-        pd->src_y = clip(src_y, 0, brick_height - pd->height);
-        pd->zindex = max(0.0f, zindex);
+    particledata_t* pd = get_particledata(object);
+    if(set_brick(pd, brick_id)) {
+        v2d_t position = scripting_util_world_position(object);
+        add_particle(pd, src_x, src_y, width, height, position, v2d_new(0.0f, 0.0f));
     }
 
     return NULL;
 }
 
-/* set velocity */
+/* set velocity: sets the velocity of the most recently emitted piece */
 surgescript_var_t* fun_setvelocity(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
     double xvel = surgescript_var_get_number(param[0]);
     double yvel = surgescript_var_get_number(param[1]);
 
     particledata_t* pd = get_particledata(object);
-    pd->velocity = v2d_new(xvel, yvel);
+    int count = darray_length(pd->particle);
+    if(count > 0)
+        pd->particle[count - 1].velocity = v2d_new(xvel, yvel);
 
     return NULL;
 }
@@ -245,37 +338,23 @@ surgescript_var_t* fun_setzindex(surgescript_object_t* object, const surgescript
 /* get zindex */
 surgescript_var_t* fun_getzindex(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    const particledata_t* pd = get_particledata(object);
-    return surgescript_var_set_number(surgescript_var_create(), pd->zindex);
+    return surgescript_var_set_number(surgescript_var_create(), renderable_zindex(object));
 }
 
 /* the filepath of this renderable (used by the render queue) */
 surgescript_var_t* fun_getfilepathofrenderable(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    const particledata_t* pd = get_particledata(object);
-    const image_t* image = pd->image;
-
-    /* image already set? */
-    if(image != NULL) {
-        const char* filepath = image_filepath(image);
-        return surgescript_var_set_string(surgescript_var_create(), filepath);
-    }
-
-    /* image not yet set */
-    return surgescript_var_set_string(surgescript_var_create(), "<brick-particle>");
+    return surgescript_var_set_string(surgescript_var_create(), renderable_filepath(object));
 }
 
 /* the texture handle of this renderable (used by the render queue) */
 surgescript_var_t* fun_gettexturehandle(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    const particledata_t* pd = get_particledata(object);
-    const image_t* image = pd->image;
+    texturehandle_t tex;
 
     /* image already set? */
-    if(image != NULL) {
-        texturehandle_t tex = image_texture(image);
+    if(renderable_texture(object, &tex))
         return surgescript_var_set_rawbits(surgescript_var_create(), tex);
-    }
 
     /* image not yet set */
     return surgescript_var_set_null(surgescript_var_create());
@@ -284,8 +363,7 @@ surgescript_var_t* fun_gettexturehandle(surgescript_object_t* object, const surg
 /* is this renderable translucent? (used by the render queue) */
 surgescript_var_t* fun_getistranslucent(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    bool is_translucent = false;
-    return surgescript_var_set_bool(surgescript_var_create(), is_translucent);
+    return surgescript_var_set_bool(surgescript_var_create(), renderable_is_translucent(object));
 }
 
 
@@ -305,20 +383,121 @@ particledata_t* get_particledata(const surgescript_object_t* object)
 /* create particle data */
 particledata_t* create_particledata()
 {
-    particledata_t* pd = mallocx(sizeof *pd);
+    particledata_t* pd;
+
+    if(recycled_count > 0) {
+        pd = recycled_particledata[--recycled_count];
+        darray_clear(pd->particle);
+    }
+    else {
+        pd = mallocx(sizeof *pd);
+        darray_init_ex(pd->particle, 16);
+    }
 
     pd->image = NULL;
-    pd->src_x = pd->src_y = 0;
-    pd->width = pd->height = 0;
     pd->zindex = DEFAULT_ZINDEX;
-    pd->velocity = v2d_new(0.0f, 0.0f);
 
     return pd;
 }
 
-/* destroy particle data */
+/* destroy particle data, keeping it for reuse if possible */
 particledata_t* destroy_particledata(particledata_t* pd)
 {
+    /* recycle */
+    if(recycled_count < MAX_RECYCLED_EMITTERS) {
+        if(darray_capacity(pd->particle) > 64) {
+            darray_clear(pd->particle);
+            darray_shrink(pd->particle);
+        }
+
+        recycled_particledata[recycled_count++] = pd;
+        return NULL;
+    }
+
+    /* release */
+    darray_release(pd->particle);
     free(pd);
     return NULL;
-}
\ No newline at end of file
+}
+
+/* set the brick of the emitter. Returns true on success */
+bool set_brick(particledata_t* pd, int brick_id)
+{
+    if(!brick_exists(brick_id))
+        return false;
+
+    /* the pieces of all particles come from the same image */
+    pd->image = brick_image_preview(brick_id);
+    pd->zindex = max(0.0f, brick_zindex_preview(brick_id));
+
+    return true;
+}
+
+/* add a particle to the emitter */
+void add_particle(particledata_t* pd, int src_x, int src_y, int width, int height, v2d_t position, v2d_t velocity)
+{
+    /* brick not set? */
+    if(pd->image == NULL)
+        return;
+
+    /* too many particles? */
+    int max_particles = video_is_quality_step_taken(VIDEOQUALITYSTEP_FEWER_PARTICLES) ? MAX_PARTICLES_UNDER_LOAD : MAX_PARTICLES;
+    if(darray_length(pd->particle) >= max_particles)
+        return;
+
+    /* add particle */
+    int brick_width = image_width(pd->image);
+    int brick_height = image_height(pd->image);
+    particle_t p;
+
+    p.position = position;
+    p.velocity = velocity;
+    p.width = clip(width, 0, brick_width);
+    p.height = clip(height, 0, brick_height);
+    p.src_x = clip(src_x, 0, brick_width - p.width);
+    p.src_y = clip(src_y, 0, brick_height - p.height);
+
+    darray_push(pd->particle, p);
+}
+
+
+
+/* render metadata */
+
+/* zindex */
+float renderable_zindex(surgescript_object_t* object)
+{
+    const particledata_t* pd = get_particledata(object);
+    return pd->zindex;
+}
+
+/* brick particles are opaque */
+bool renderable_is_translucent(surgescript_object_t* object)
+{
+    return false;
+}
+
+/* the texture of the brick */
+bool renderable_texture(surgescript_object_t* object, texturehandle_t* texture)
+{
+    const particledata_t* pd = get_particledata(object);
+
+    /* image not yet set */
+    if(pd->image == NULL)
+        return false;
+
+    *texture = image_texture(pd->image);
+    return true;
+}
+
+/* the filepath of the image of the brick */
+const char* renderable_filepath(surgescript_object_t* object)
+{
+    const particledata_t* pd = get_particledata(object);
+
+    /* image not yet set */
+    if(pd->image == NULL)
+        return "<brick-particle>";
+
+    return image_filepath(pd->image);
+}
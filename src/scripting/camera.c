@@ -20,8 +20,10 @@
 
 #include <surgescript.h>
 #include "scripting.h"
+#include "util/iterators.h"
 #include "../core/video.h"
 #include "../entities/camera.h"
+#include "../util/darray.h"
 
 /* private */
 static surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
@@ -35,6 +37,7 @@ static surgescript_var_t* fun_lock(surgescript_object_t* object, const surgescri
 static surgescript_var_t* fun_unlock(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_screentoworld(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_worldtoscreen(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_cull(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static const surgescript_heapptr_t POSITION_ADDR = 0;
 
 /*
@@ -54,6 +57,7 @@ void scripting_register_camera(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "Camera", "unlock", fun_unlock, 0);
     surgescript_vm_bind(vm, "Camera", "screenToWorld", fun_screentoworld, 1);
     surgescript_vm_bind(vm, "Camera", "worldToScreen", fun_worldtoscreen, 1);
+    surgescript_vm_bind(vm, "Camera", "cull", fun_cull, 3);
 }
 
 /* constructor */
@@ -179,4 +183,64 @@ surgescript_var_t* fun_worldtoscreen(surgescript_object_t* object, const surgesc
     );
 
     return surgescript_var_set_objecthandle(surgescript_var_create(), new_handle);
-}
\ No newline at end of file
+}
+
+/* cull(objects, output, margin): given an Array of objects, push to the output Array the ones
+   whose world position is inside the visible area of the camera, expanded by a margin in pixels */
+surgescript_var_t* fun_cull(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(object);
+    surgescript_objecthandle_t objects_handle = surgescript_var_get_objecthandle(param[0]);
+    surgescript_objecthandle_t output_handle = surgescript_var_get_objecthandle(param[1]);
+    int margin = surgescript_var_get_number(param[2]);
+
+    if(!surgescript_objectmanager_exists(manager, objects_handle) || !surgescript_objectmanager_exists(manager, output_handle))
+        return NULL;
+
+    surgescript_object_t* objects = surgescript_objectmanager_get(manager, objects_handle);
+    surgescript_object_t* output = surgescript_objectmanager_get(manager, output_handle);
+    DARRAY(surgescript_objecthandle_t, handle);
+    DARRAY(rect_t, rect);
+
+    darray_init(handle);
+    darray_init(rect);
+
+    /* read the world positions of the objects */
+    iterator_t* it = iterator_create_from_surgescript_array(objects);
+    while(iterator_has_next(it)) {
+        surgescript_var_t** var = iterator_next(it);
+        if(!surgescript_var_is_objecthandle(*var))
+            continue;
+
+        surgescript_objecthandle_t h = surgescript_var_get_objecthandle(*var);
+        if(!surgescript_objectmanager_exists(manager, h))
+            continue;
+
+        v2d_t position = scripting_util_world_position(surgescript_objectmanager_get(manager, h));
+        darray_push(handle, h);
+        darray_push(rect, rect_new(position.x, position.y, 0, 0));
+    }
+    iterator_destroy(it);
+
+    /* cull them all at once */
+    int count = darray_length(rect);
+    if(count > 0) {
+        int* visible = mallocx(count * sizeof(*visible));
+        int visible_count = camera_cull(rect, count, margin, visible);
+        surgescript_var_t* arg = surgescript_var_create();
+        const surgescript_var_t* args[] = { arg };
+
+        for(int i = 0; i < visible_count; i++) {
+            surgescript_var_set_objecthandle(arg, handle[visible[i]]);
+            surgescript_object_call_function(output, "push", args, 1, NULL);
+        }
+
+        surgescript_var_destroy(arg);
+        free(visible);
+    }
+
+    /* done */
+    darray_release(rect);
+    darray_release(handle);
+    return NULL;
+}
@@ -21,8 +21,10 @@
 #include <surgescript.h>
 #include <stdint.h>
 #include "scripting.h"
+#include "util/classprofiler.h"
 #include "../core/image.h"
 #include "../core/video.h"
+#include "../core/metrics.h"
 #include "../util/darray.h"
 #include "../util/v2d.h"
 
@@ -57,24 +59,67 @@ struct ballcollider_t
     double radius; /* in pixels */
 };
 
+typedef struct broadphaseentry_t broadphaseentry_t;
+struct broadphaseentry_t
+{
+    double left, top, right, bottom; /* bounding box in world space */
+    int index; /* index of the collider in colmgr->colliders */
+};
+
+typedef struct collisionpair_t collisionpair_t;
+struct collisionpair_t
+{
+    int i, j; /* indices of two colliders, j < i */
+};
+
 typedef struct collisionmanager_t collisionmanager_t;
 struct collisionmanager_t
 {
     DARRAY(surgescript_objecthandle_t, colliders);
+
+    /* broadphase: these are rebuilt every frame (we keep the memory) */
+    DARRAY(broadphaseentry_t, entries);
+    DARRAY(int, active);
+    DARRAY(collisionpair_t, pairs);
+
+    /* scratch variables reused every frame */
+    surgescript_var_t* tmp;
+    surgescript_var_t* ret;
+    surgescript_var_t* notify_args[2];
 };
 
 #define COLLIDER_FLAG_ISVISIBLE             0x1
 #define COLLIDER_FLAG_NOTIFYONCOLLISION     0x2
 #define COLLIDER_FLAG_NOTIFYONOVERLAP       0x4
 #define COLLIDER_FLAG_ISDISABLED            0x8
+#define COLLIDER_FLAG_NOTIFYONCOLLISIONEX   0x10
+#define COLLIDER_FLAG_NOTIFYONOVERLAPEX     0x20
+#define COLLIDER_FLAG_NOTIFY                (COLLIDER_FLAG_NOTIFYONCOLLISION | COLLIDER_FLAG_NOTIFYONOVERLAP | COLLIDER_FLAG_NOTIFYONCOLLISIONEX | COLLIDER_FLAG_NOTIFYONOVERLAPEX)
 #define COLLIDER_COLOR(flags)               (color_premul_rgba(255, 255, 0, (flags) & COLLIDER_FLAG_ISDISABLED ? 63 : 127))
 static const surgescript_heapptr_t CENTER_ADDR = 0;
 static const surgescript_heapptr_t ANCHOR_ADDR = 1;
 #define unsafe_get_collider(object) ((collider_t*)surgescript_object_userdata(object))
 static inline collider_t* safe_get_collider(surgescript_object_t* object);
 static inline bool is_collider(const surgescript_object_t* object);
+static inline collisionmanager_t* get_collision_manager(const collider_t* collider, surgescript_objectmanager_t* manager);
 static inline bool quick_bounding_box_test(const collider_t* a, const collider_t* b);
 static inline void quickly_get_bounding_box(const collider_t* collider, double* left, double* top, double* right, double* bottom);
+static void broadphase(collisionmanager_t* colmgr, surgescript_objectmanager_t* manager);
+static int broadphase_entry_cmp(const void* a, const void* b);
+static int broadphase_pair_cmp(const void* a, const void* b);
+static int handle_cmp(const void* a, const void* b);
+static inline bool was_colliding(const collider_t* collider, surgescript_objecthandle_t other_collider);
+static inline uint8_t notification_flags(const surgescript_object_t* entity);
+
+/* recycling: colliders are spawned and destroyed often, e.g., along with
+   projectiles and collectibles. The userdata of destroyed colliders is kept
+   and reused, including the memory of its lists of collisions */
+#define MAX_RECYCLED_COLLIDERS 256
+typedef union anycollider_t { boxcollider_t box; ballcollider_t ball; } anycollider_t;
+static collider_t* recycled_collider[MAX_RECYCLED_COLLIDERS];
+static int recycled_collider_count = 0;
+static collider_t* new_collider();
+static void delete_collider(collider_t* collider);
 
 static surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_destructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
@@ -195,6 +240,21 @@ void scripting_register_collisions(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "CollisionManager", "__notify", fun_manager_notify, 1);
 }
 
+/*
+ * scripting_collisions_release()
+ * Releases the recycled data of destroyed colliders.
+ * Call after destroying the VM
+ */
+void scripting_collisions_release()
+{
+    while(recycled_collider_count > 0) {
+        collider_t* collider = recycled_collider[--recycled_collider_count];
+        darray_release(collider->curr_collisions);
+        darray_release(collider->prev_collisions);
+        free(collider);
+    }
+}
+
 /* checks if an object is a collider */
 bool is_collider(const surgescript_object_t* object)
 {
@@ -203,6 +263,16 @@ bool is_collider(const surgescript_object_t* object)
     return (0 == strcmp(name, "CollisionBox") || 0 == strcmp(name, "CollisionBall"));
 }
 
+/* Returns the collision manager of the given collider, or NULL if there is none */
+collisionmanager_t* get_collision_manager(const collider_t* collider, surgescript_objectmanager_t* manager)
+{
+    surgescript_object_t* object = surgescript_objectmanager_get(manager, collider->colmgr);
+    if(0 == strcmp(surgescript_object_name(object), "CollisionManager"))
+        return surgescript_object_userdata(object);
+
+    return NULL;
+}
+
 /* Returns the collider structure if the given object is a collider,
    or a crash if it isn't */
 collider_t* safe_get_collider(surgescript_object_t* object)
@@ -267,6 +337,183 @@ bool quick_bounding_box_test(const collider_t* a, const collider_t* b)
     );
 }
 
+/*
+ * Broadphase: sort and sweep
+ *
+ * Computes the pairs of colliders whose bounding boxes overlap, writing
+ * them to colmgr->pairs. The colliders are sorted by the left side of
+ * their bounding boxes and swept from left to right. Only the colliders
+ * whose horizontal extents intersect are tested against each other. The
+ * test is conservative: quick_bounding_box_test() must still be applied.
+ *
+ * The resulting pairs are sorted by (i, j), where j < i
+ */
+void broadphase(collisionmanager_t* colmgr, surgescript_objectmanager_t* manager)
+{
+    int n = darray_length(colmgr->colliders);
+
+    darray_clear(colmgr->entries);
+    darray_clear(colmgr->active);
+    darray_clear(colmgr->pairs);
+
+    /* compute the bounding boxes */
+    for(int i = 0; i < n; i++) {
+        surgescript_object_t* object = surgescript_objectmanager_get(manager, colmgr->colliders[i]);
+        broadphaseentry_t entry = { .index = i };
+
+        quickly_get_bounding_box(unsafe_get_collider(object), &entry.left, &entry.top, &entry.right, &entry.bottom);
+        darray_push(colmgr->entries, entry);
+    }
+
+    /* sort by the left side of the bounding boxes */
+    qsort(colmgr->entries, darray_length(colmgr->entries), sizeof(broadphaseentry_t), broadphase_entry_cmp);
+
+    /* sweep */
+    for(int k = 0; k < darray_length(colmgr->entries); k++) {
+        const broadphaseentry_t* entry = &colmgr->entries[k];
+
+        /* remove the entries that end before this one starts.
+           They won't overlap with any of the entries to come */
+        for(int a = darray_length(colmgr->active) - 1; a >= 0; a--) {
+            const broadphaseentry_t* other = &colmgr->entries[colmgr->active[a]];
+            if(other->right < entry->left) {
+                int last = 0;
+                darray_pop(colmgr->active, last);
+                if(a < darray_length(colmgr->active))
+                    colmgr->active[a] = last;
+            }
+        }
+
+        /* test the vertical extents */
+        for(int a = 0; a < darray_length(colmgr->active); a++) {
+            const broadphaseentry_t* other = &colmgr->entries[colmgr->active[a]];
+            if(other->top <= entry->bottom && entry->top <= other->bottom) {
+                collisionpair_t pair = {
+                    .i = max(entry->index, other->index),
+                    .j = min(entry->index, other->index)
+                };
+                darray_push(colmgr->pairs, pair);
+            }
+        }
+
+        /* this entry is now active */
+        darray_push(colmgr->active, k);
+    }
+
+    /* sort the pairs for a deterministic notification order */
+    qsort(colmgr->pairs, darray_length(colmgr->pairs), sizeof(collisionpair_t), broadphase_pair_cmp);
+}
+
+/* compare broadphase entries by the left side of their bounding boxes */
+int broadphase_entry_cmp(const void* a, const void* b)
+{
+    const broadphaseentry_t* x = (const broadphaseentry_t*)a;
+    const broadphaseentry_t* y = (const broadphaseentry_t*)b;
+
+    if(x->left < y->left)
+        return -1;
+    else if(x->left > y->left)
+        return 1;
+    else
+        return x->index - y->index;
+}
+
+/* compare collision pairs lexicographically */
+int broadphase_pair_cmp(const void* a, const void* b)
+{
+    const collisionpair_t* x = (const collisionpair_t*)a;
+    const collisionpair_t* y = (const collisionpair_t*)b;
+
+    if(x->i != y->i)
+        return x->i - y->i;
+    else
+        return x->j - y->j;
+}
+
+/* compare object handles */
+int handle_cmp(const void* a, const void* b)
+{
+    surgescript_objecthandle_t x = *((const surgescript_objecthandle_t*)a);
+    surgescript_objecthandle_t y = *((const surgescript_objecthandle_t*)b);
+    return (x > y) - (x < y);
+}
+
+/* checks if a collider was colliding with another collider in the previous frame.
+   prev_collisions is sorted, so we use binary search */
+bool was_colliding(const collider_t* collider, surgescript_objecthandle_t other_collider)
+{
+    return NULL != bsearch(
+        &other_collider,
+        collider->prev_collisions,
+        darray_length(collider->prev_collisions),
+        sizeof(surgescript_objecthandle_t),
+        handle_cmp
+    );
+}
+
+/* which notifications should be sent to the entity? */
+uint8_t notification_flags(const surgescript_object_t* entity)
+{
+    uint8_t flags = 0;
+
+    if(surgescript_object_has_function(entity, "onCollision"))
+        flags |= COLLIDER_FLAG_NOTIFYONCOLLISION;
+    if(surgescript_object_has_function(entity, "onOverlap"))
+        flags |= COLLIDER_FLAG_NOTIFYONOVERLAP;
+    if(surgescript_object_has_function(entity, "onCollisionEx"))
+        flags |= COLLIDER_FLAG_NOTIFYONCOLLISIONEX;
+    if(surgescript_object_has_function(entity, "onOverlapEx"))
+        flags |= COLLIDER_FLAG_NOTIFYONOVERLAPEX;
+
+    return flags;
+}
+
+/* allocates the userdata of a collider, reusing a recycled one if possible.
+   The lists of collisions are empty; the other fields must be initialized */
+collider_t* new_collider()
+{
+    collider_t* collider;
+
+    if(recycled_collider_count > 0) {
+        collider = recycled_collider[--recycled_collider_count];
+        darray_clear(collider->prev_collisions);
+        darray_clear(collider->curr_collisions);
+    }
+    else {
+        collider = mallocx(sizeof(anycollider_t));
+        darray_init(collider->prev_collisions);
+        darray_init(collider->curr_collisions);
+    }
+
+    return collider;
+}
+
+/* releases the userdata of a collider, keeping it for reuse if possible */
+void delete_collider(collider_t* collider)
+{
+    const size_t MAX_KEPT_CAPACITY = 64; /* don't keep large lists around */
+
+    /* recycle */
+    if(recycled_collider_count < MAX_RECYCLED_COLLIDERS) {
+        if(darray_capacity(collider->prev_collisions) > MAX_KEPT_CAPACITY) {
+            darray_clear(collider->prev_collisions);
+            darray_shrink(collider->prev_collisions);
+        }
+        if(darray_capacity(collider->curr_collisions) > MAX_KEPT_CAPACITY) {
+            darray_clear(collider->curr_collisions);
+            darray_shrink(collider->curr_collisions);
+        }
+
+        recycled_collider[recycled_collider_count++] = collider;
+        return;
+    }
+
+    /* release */
+    darray_release(collider->curr_collisions);
+    darray_release(collider->prev_collisions);
+    free(collider);
+}
+
 
 
 /* ----------------------- CollisionManager --------------------------------- */
@@ -276,41 +523,42 @@ surgescript_var_t* fun_manager_main(surgescript_object_t* object, const surgescr
 {
     surgescript_objectmanager_t* manager = surgescript_object_manager(object);
     collisionmanager_t* colmgr = surgescript_object_userdata(object);
-    surgescript_var_t* tmp = surgescript_var_create();
-    surgescript_var_t* ret = surgescript_var_create();
+    surgescript_var_t* tmp = colmgr->tmp;
+    surgescript_var_t* ret = colmgr->ret;
     const surgescript_var_t* p[] = { tmp };
 
-    /*
-     * TODO: make this faster?
-     * simple, quadratic algorithm
-     */
-    for(int i = 1; i < darray_length(colmgr->colliders); i++) {
+    /* find the pairs of colliders that may be colliding */
+    broadphase(colmgr, manager);
+    metrics_count(METRIC_COLLIDERS, darray_length(colmgr->colliders));
+    metrics_count(METRIC_COLLISION_PAIRS, darray_length(colmgr->pairs));
+
+    /* test the candidate pairs. They are sorted, so colliders
+       are notified in the same order as in an all-pairs test */
+    for(int k = 0; k < darray_length(colmgr->pairs); k++) {
+        int i = colmgr->pairs[k].i, j = colmgr->pairs[k].j;
         surgescript_object_t* collider = surgescript_objectmanager_get(manager, colmgr->colliders[i]);
-        for(int j = 0; j < i; j++) {
-            surgescript_object_t* other_collider = surgescript_objectmanager_get(manager, colmgr->colliders[j]);
-
-            /* quickly discard a collision test */
-            if(!quick_bounding_box_test(
-                unsafe_get_collider(collider),
-                unsafe_get_collider(other_collider)
-            ))
-                continue;
-
-            /* perform a collision test */
-            surgescript_var_set_objecthandle(tmp, colmgr->colliders[j]);
-            surgescript_object_call_function(collider, "collidesWith", p, 1, ret);
-            if(surgescript_var_get_bool(ret)) {
-                /* notify the colliders */
-                surgescript_object_call_function(collider, "__notify", p, 1, NULL);
-                surgescript_var_set_objecthandle(tmp, colmgr->colliders[i]);
-                surgescript_object_call_function(other_collider, "__notify", p, 1, NULL);
-            }
+        surgescript_object_t* other_collider = surgescript_objectmanager_get(manager, colmgr->colliders[j]);
+
+        /* quickly discard a collision test */
+        if(!quick_bounding_box_test(
+            unsafe_get_collider(collider),
+            unsafe_get_collider(other_collider)
+        ))
+            continue;
+
+        /* perform a collision test */
+        surgescript_var_set_objecthandle(tmp, colmgr->colliders[j]);
+        surgescript_object_call_function(collider, "collidesWith", p, 1, ret);
+        if(surgescript_var_get_bool(ret)) {
+            /* notify the colliders */
+            surgescript_object_call_function(collider, "__notify", p, 1, NULL);
+            surgescript_var_set_objecthandle(tmp, colmgr->colliders[i]);
+            surgescript_object_call_function(other_collider, "__notify", p, 1, NULL);
         }
     }
 
+    darray_clear(colmgr->pairs);
     darray_clear(colmgr->colliders);
-    surgescript_var_destroy(ret);
-    surgescript_var_destroy(tmp);
     return NULL;
 }
 
@@ -319,6 +567,13 @@ surgescript_var_t* fun_manager_constructor(surgescript_object_t* object, const s
 {
     collisionmanager_t* colmgr = mallocx(sizeof *colmgr);
     darray_init(colmgr->colliders);
+    darray_init(colmgr->entries);
+    darray_init(colmgr->active);
+    darray_init(colmgr->pairs);
+    colmgr->tmp = surgescript_var_create();
+    colmgr->ret = surgescript_var_create();
+    colmgr->notify_args[0] = surgescript_var_create();
+    colmgr->notify_args[1] = surgescript_var_create();
     surgescript_object_set_userdata(object, colmgr);
     return NULL;
 }
@@ -327,6 +582,13 @@ surgescript_var_t* fun_manager_constructor(surgescript_object_t* object, const s
 surgescript_var_t* fun_manager_destructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
     collisionmanager_t* colmgr = surgescript_object_userdata(object);
+    surgescript_var_destroy(colmgr->notify_args[1]);
+    surgescript_var_destroy(colmgr->notify_args[0]);
+    surgescript_var_destroy(colmgr->ret);
+    surgescript_var_destroy(colmgr->tmp);
+    darray_release(colmgr->pairs);
+    darray_release(colmgr->active);
+    darray_release(colmgr->entries);
     darray_release(colmgr->colliders);
     free(colmgr);
     return NULL;
@@ -362,9 +624,7 @@ surgescript_var_t* fun_manager_notify(surgescript_object_t* object, const surges
 surgescript_var_t* fun_destructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
     collider_t* collider = unsafe_get_collider(object);
-    darray_release(collider->curr_collisions);
-    darray_release(collider->prev_collisions);
-    free(collider);
+    delete_collider(collider);
     return NULL;
 }
 
@@ -378,26 +638,17 @@ surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_
     /* if the collider is active, notify the collision manager */
     if(!(collider->flags & COLLIDER_FLAG_ISDISABLED)) {
         surgescript_objectmanager_t* manager = surgescript_object_manager(object);
-        surgescript_var_t* tmp = surgescript_var_create();
-        const surgescript_var_t* p[] = { tmp };
-        int i;
+        collisionmanager_t* colmgr = get_collision_manager(collider, manager);
 
-        /* update collisions */
-        darray_clear(collider->prev_collisions);
-        for(i = 0; i < darray_length(collider->curr_collisions); i++)
-            darray_push(collider->prev_collisions, collider->curr_collisions[i]);
+        /* update collisions. We keep prev_collisions sorted for fast lookups */
+        darray_swap(collider->prev_collisions, collider->curr_collisions);
         darray_clear(collider->curr_collisions);
+        qsort(collider->prev_collisions, darray_length(collider->prev_collisions), sizeof(surgescript_objecthandle_t), handle_cmp);
 
-        /* notify the collision manager: I am active! */
-        surgescript_var_set_objecthandle(tmp, surgescript_object_handle(object));
-        surgescript_object_call_function(
-            surgescript_objectmanager_get(manager, collider->colmgr),
-            "__notify",
-            p, 1, NULL
-        );
-
-        /* release resources */
-        surgescript_var_destroy(tmp);
+        /* notify the collision manager: I am active!
+           We push the handle directly, skipping a SurgeScript call */
+        if(colmgr != NULL)
+            darray_push(colmgr->colliders, surgescript_object_handle(object));
     }
     else {
         /* the collider is disabled */
@@ -464,42 +715,35 @@ surgescript_var_t* fun_notify(surgescript_object_t* object, const surgescript_va
     collider_t* collider = unsafe_get_collider(object);
     surgescript_objecthandle_t other_collider = surgescript_var_get_objecthandle(param[0]);
 
-    darray_push(collider->curr_collisions, other_collider);
-    if(collider->flags & (COLLIDER_FLAG_NOTIFYONCOLLISION | COLLIDER_FLAG_NOTIFYONOVERLAP)) {
-        surgescript_objectmanager_t* manager = surgescript_object_manager(object);
-        surgescript_var_t* tmp = surgescript_var_create();
-        const surgescript_var_t* p[] = { tmp };
+    surgescript_objectmanager_t* manager = surgescript_object_manager(object);
+    collisionmanager_t* colmgr = get_collision_manager(collider, manager);
 
-        /* call entity.onCollision(otherCollider) */
-        if(collider->flags & COLLIDER_FLAG_NOTIFYONCOLLISION) {
-            bool skip = false;
+    darray_push(collider->curr_collisions, other_collider);
+    if((collider->flags & COLLIDER_FLAG_NOTIFY) && colmgr != NULL) {
+        surgescript_object_t* entity = surgescript_objectmanager_get(manager, collider->entity);
+        surgescript_var_t** tmp = colmgr->notify_args; /* reused */
+        const surgescript_var_t* p[] = { tmp[0], tmp[1] };
+        bool is_new_collision = !was_colliding(collider, other_collider);
 
-            /* skip if other_collider is in prev_collisions */
-            for(int i = 0; i < darray_length(collider->prev_collisions) && !skip; i++) {
-                if(collider->prev_collisions[i] == other_collider)
-                    skip = true;
-            }
+        /* p = (otherCollider, thisCollider) */
+        surgescript_var_set_objecthandle(tmp[0], other_collider);
+        surgescript_var_set_objecthandle(tmp[1], surgescript_object_handle(object));
 
-            /* call entity.onCollision(otherCollider) */
-            if(!skip) {
-                surgescript_object_t* entity = surgescript_objectmanager_get(manager, collider->entity);
-                surgescript_var_set_objecthandle(tmp, other_collider);
-                surgescript_object_call_function(entity, "onCollision", p, 1, NULL);
-            }
-        }
+        /* call entity.onCollision(otherCollider) */
+        if((collider->flags & COLLIDER_FLAG_NOTIFYONCOLLISION) && is_new_collision)
+            classprofiler_call(entity, "onCollision", p, 1, NULL);
 
         /* call entity.onOverlap(otherCollider) */
-        if(collider->flags & COLLIDER_FLAG_NOTIFYONOVERLAP) {
-            surgescript_object_t* entity = surgescript_objectmanager_get(manager, collider->entity);
-            surgescript_var_set_objecthandle(tmp, other_collider);
-            surgescript_object_call_function(entity, "onOverlap", p, 1, NULL);
-        }
+        if(collider->flags & COLLIDER_FLAG_NOTIFYONOVERLAP)
+            classprofiler_call(entity, "onOverlap", p, 1, NULL);
 
-        /* TODO call entity.onCollisionEx(otherCollider, thisCollider) */
-        /* TODO call entity.onOverlapEx(otherCollider, thisCollider) */
+        /* call entity.onCollisionEx(otherCollider, thisCollider) */
+        if((collider->flags & COLLIDER_FLAG_NOTIFYONCOLLISIONEX) && is_new_collision)
+            classprofiler_call(entity, "onCollisionEx", p, 2, NULL);
 
-        /* done */
-        surgescript_var_destroy(tmp);
+        /* call entity.onOverlapEx(otherCollider, thisCollider) */
+        if(collider->flags & COLLIDER_FLAG_NOTIFYONOVERLAPEX)
+            classprofiler_call(entity, "onOverlapEx", p, 2, NULL);
     }
 
     /* done */
@@ -589,7 +833,7 @@ surgescript_var_t* fun_setanchor(surgescript_object_t* object, const surgescript
 /* box constructor */
 surgescript_var_t* fun_collisionbox_constructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    collider_t* collider = mallocx(sizeof(boxcollider_t));
+    collider_t* collider = new_collider();
     surgescript_heap_t* heap = surgescript_object_heap(object);
     surgescript_objectmanager_t* manager = surgescript_object_manager(object);
     surgescript_objecthandle_t root = surgescript_objectmanager_root(manager);
@@ -603,8 +847,6 @@ surgescript_var_t* fun_collisionbox_constructor(surgescript_object_t* object, co
     collider->worldpos = v2d_new(0.0f, 0.0f); /* the center of the collider in world coordinates */
     collider->anchor = v2d_new(0.5f, 0.5f); /* default anchor: at the center of the collider */
     collider->flags = 0;
-    darray_init(collider->prev_collisions);
-    darray_init(collider->curr_collisions);
     ((boxcollider_t*)collider)->width = 0.0;
     ((boxcollider_t*)collider)->height = 0.0;
     surgescript_object_set_userdata(object, collider);
@@ -642,10 +884,7 @@ surgescript_var_t* fun_collisionbox_constructor(surgescript_object_t* object, co
     }
 
     /* collision flags */
-    if(surgescript_object_has_function(entity, "onCollision"))
-        collider->flags |= COLLIDER_FLAG_NOTIFYONCOLLISION;
-    if(surgescript_object_has_function(entity, "onOverlap"))
-        collider->flags |= COLLIDER_FLAG_NOTIFYONOVERLAP;
+    collider->flags |= notification_flags(entity);
 
     /* done */
     return NULL;
@@ -677,6 +916,7 @@ surgescript_var_t* fun_collisionbox_setanchor(surgescript_object_t* object, cons
     double x = surgescript_var_get_number(param[0]);
     double y = surgescript_var_get_number(param[1]);
     surgescript_transform_setposition2d(transform, (0.5 - x) * width, (0.5 - y) * height);
+    scripting_transform_invalidate();
     ((collider_t*)collider)->worldpos = scripting_util_world_position(object); /* update worldpos */
     ((collider_t*)collider)->anchor = v2d_new(x, y);
 
@@ -857,7 +1097,7 @@ surgescript_var_t* fun_collisionbox_zindex(surgescript_object_t* object, const s
 /* ball constructor */
 surgescript_var_t* fun_collisionball_constructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    collider_t* collider = mallocx(sizeof(ballcollider_t));
+    collider_t* collider = new_collider();
     surgescript_heap_t* heap = surgescript_object_heap(object);
     surgescript_objectmanager_t* manager = surgescript_object_manager(object);
     surgescript_objecthandle_t root = surgescript_objectmanager_root(manager);
@@ -871,8 +1111,6 @@ surgescript_var_t* fun_collisionball_constructor(surgescript_object_t* object, c
     collider->worldpos = v2d_new(0.0f, 0.0f); /* the center of the collider in world coordinates */
     collider->anchor = v2d_new(0.5f, 0.5f); /* default anchor: at the center of the collider */
     collider->flags = 0;
-    darray_init(collider->prev_collisions);
-    darray_init(collider->curr_collisions);
     ((ballcollider_t*)collider)->radius = 0.0;
     surgescript_object_set_userdata(object, collider);
 
@@ -909,10 +1147,7 @@ surgescript_var_t* fun_collisionball_constructor(surgescript_object_t* object, c
     }
 
     /* collision flags */
-    if(surgescript_object_has_function(entity, "onCollision"))
-        collider->flags |= COLLIDER_FLAG_NOTIFYONCOLLISION;
-    if(surgescript_object_has_function(entity, "onOverlap"))
-        collider->flags |= COLLIDER_FLAG_NOTIFYONOVERLAP;
+    collider->flags |= notification_flags(entity);
 
     /* done */
     return NULL;
@@ -998,6 +1233,7 @@ surgescript_var_t* fun_collisionball_setanchor(surgescript_object_t* object, con
     double x = surgescript_var_get_number(param[0]);
     double y = surgescript_var_get_number(param[1]);
     surgescript_transform_setposition2d(transform, (0.5 - x) * size, (0.5 - y) * size);
+    scripting_transform_invalidate();
     ((collider_t*)collider)->worldpos = scripting_util_world_position(object); /* update worldpos */
     ((collider_t*)collider)->anchor = v2d_new(x, y);
 
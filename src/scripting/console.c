@@ -20,12 +20,14 @@
 
 #include <surgescript.h>
 #include "../core/video.h"
+#include "util/classprofiler.h"
 
 /* private */
 static surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_print(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_write(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_readline(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_dumpprofile(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 
 /*
  * scripting_register_console()
@@ -37,6 +39,7 @@ void scripting_register_console(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "Console", "print", fun_print, 1);
     surgescript_vm_bind(vm, "Console", "write", fun_write, 1);
     surgescript_vm_bind(vm, "Console", "readline", fun_readline, 0);
+    surgescript_vm_bind(vm, "Console", "dumpProfile", fun_dumpprofile, 0);
 }
 
 /* Console routines */
@@ -68,4 +71,15 @@ surgescript_var_t* fun_write(surgescript_object_t* object, const surgescript_var
 surgescript_var_t* fun_readline(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
     return NULL;
-}
\ No newline at end of file
+}
+
+/* prints the object classes that take the most CPU time */
+surgescript_var_t* fun_dumpprofile(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+#if defined(WANT_SCRIPT_PROFILER)
+    classprofiler_dump();
+#else
+    video_showmessage("The script profiler is not available in this build");
+#endif
+    return NULL;
+}
@@ -21,6 +21,7 @@
 #include <surgescript.h>
 #include <string.h>
 #include "scripting.h"
+#include "util/classprofiler.h"
 #include "../util/numeric.h"
 #include "../util/util.h"
 #include "../core/video.h"
@@ -66,7 +67,7 @@ static inline iterator_t* levelobjectcontainer_iterator(const surgescript_object
 static surgescript_objecthandle_t get_level_handle(const surgescript_object_t* entity_container);
 static bool render_subtree_faster(surgescript_object_t* object, void* data);
 static bool render_subtree(surgescript_object_t* object, void* data);
-static bool add_to_late_update_queue(surgescript_object_t* entity_or_component, void* data);
+static bool add_to_update_queues(surgescript_object_t* entity_or_component, void* data);
 static bool notify_entity(surgescript_object_t* entity_or_component, void* data);
 static inline v2d_t entity_position(surgescript_object_t* entity);
 static inline bool is_entity_inside_roi(surgescript_object_t* entity_manager, surgescript_object_t* entity);
@@ -74,6 +75,36 @@ static inline bool is_entity_inside_screen(surgescript_object_t* entity_manager,
 static bool is_entity_position_inside_screen(surgescript_object_t* entity_manager, surgescript_object_t* entity, v2d_t entity_position);
 static bool is_sprite_inside_screen(v2d_t camera_position, const char* sprite_name, v2d_t sprite_position, float sprite_rotation, v2d_t sprite_scale);
 
+/* native vtables */
+static const entitycontainervtable_t VTABLE[] = {
+    [ENTITYCONTAINER_UNAWAKE] = {
+        .select_active_entities = fun_selectactiveentities,
+        .notify_entities = fun_notifyentities,
+        .render = fun_render,
+        .bubble_up_entities = fun_bubbleupentities,
+        .pause = fun_pause,
+        .resume = fun_resume
+    },
+
+    [ENTITYCONTAINER_AWAKE] = {
+        .select_active_entities = fun_awake_selectactiveentities,
+        .notify_entities = fun_notifyentities,
+        .render = fun_render,
+        .bubble_up_entities = NULL,
+        .pause = fun_pause,
+        .resume = fun_resume
+    },
+
+    [ENTITYCONTAINER_DEBUG] = {
+        .select_active_entities = fun_awake_selectactiveentities,
+        .notify_entities = fun_notifyentities,
+        .render = fun_debug_render,
+        .bubble_up_entities = NULL,
+        .pause = fun_pause,
+        .resume = fun_resume
+    }
+};
+
 
 /*
  * scripting_register_entitycontainer()
@@ -152,6 +183,30 @@ void scripting_register_entitycontainer(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "DebugEntityContainer", "get_debugMode", fun_debug_getdebugmode, 0);
 }
 
+/*
+ * entitycontainer_vtable()
+ * The native vtable of a type of entity container. The EntityManager
+ * uses it to call the functions of its containers without going
+ * through the SurgeScript call stack
+ */
+const entitycontainervtable_t* entitycontainer_vtable(entitycontainertype_t type)
+{
+    return &VTABLE[type];
+}
+
+/*
+ * entitycontainer_is_empty()
+ * Checks if there are no entities stored in the given container
+ */
+bool entitycontainer_is_empty(const surgescript_object_t* entity_container)
+{
+    iterator_t* it = levelobjectcontainer_iterator(entity_container);
+    bool is_empty = !iterator_has_next(it);
+    iterator_destroy(it);
+
+    return is_empty;
+}
+
 /* constructor */
 surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
@@ -211,8 +266,19 @@ surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_
             /* the entity is not sleeping */
             entitymanager_set_entity_sleeping(entity_manager, entity_handle, false);
 
-            /* does this entity or its descendants implement lateUpdate() ? */
-            surgescript_object_traverse_tree_ex(entity, data, add_to_late_update_queue);
+            /* does this entity or its descendants implement phased updates? */
+            surgescript_object_traverse_tree_ex(entity, data, add_to_update_queues);
+
+        }
+        else if(entitymanager_is_entity_drowsy(entity_manager, entity_handle, entity_position(entity))) {
+
+            /* drowsy entities near the region of interest are updated at a reduced rate */
+            bool is_ticking = entitymanager_tick_drowsy_entity(entity_manager, entity_handle, entity_position(entity));
+            surgescript_object_set_active(entity, is_ticking);
+
+            /* does this entity or its descendants implement phased updates? */
+            if(is_ticking)
+                surgescript_object_traverse_tree_ex(entity, data, add_to_update_queues);
 
         }
         else if(!surgescript_object_has_tag(entity, "disposable")) {
@@ -231,6 +297,7 @@ surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_
                     /* move it back to its spawn point */
                     surgescript_transform_t* transform = surgescript_object_transform(entity);
                     surgescript_transform_setposition2d(transform, spawn_point.x, spawn_point.y);
+                    scripting_transform_invalidate();
 
                     /* notify the entity and its descendants */
                     surgescript_object_traverse_tree_ex(entity, "onReset", notify_entity);
@@ -481,7 +548,7 @@ surgescript_var_t* fun_bubbleupentities(surgescript_object_t* object, const surg
 
         /* call sector.bubbleUp(entity) */
         surgescript_var_set_objecthandle(arg, entity_handle);
-        surgescript_object_call_function(sector, "bubbleUp", args, 1, NULL);
+        surgescript_var_destroy(entitytree_bubble_up(sector, args, 1));
     }
     iterator_destroy(it);
 
@@ -583,8 +650,8 @@ surgescript_var_t* fun_awake_main(surgescript_object_t* object, const surgescrip
         entitymanager_set_entity_sleeping(entity_manager, entity_handle, false);
 #endif
 
-        /* does this entity or its descendants implement lateUpdate() ? */
-        surgescript_object_traverse_tree_ex(entity, data, add_to_late_update_queue);
+        /* does this entity or its descendants implement phased updates? */
+        surgescript_object_traverse_tree_ex(entity, data, add_to_update_queues);
     }
     iterator_destroy(it);
 
@@ -879,7 +946,7 @@ bool render_subtree(surgescript_object_t* object, void* data)
     return true;
 }
 
-bool add_to_late_update_queue(surgescript_object_t* entity_or_component, void* data)
+bool add_to_update_queues(surgescript_object_t* entity_or_component, void* data)
 {
     /* skip if the object is not an entity */
     if(!surgescript_object_has_tag(entity_or_component, "entity"))
@@ -888,20 +955,10 @@ bool add_to_late_update_queue(surgescript_object_t* entity_or_component, void* d
     /* the object is an entity */
     const surgescript_object_t* entity = entity_or_component;
 
-    /* does this entity implement lateUpdate() ? */
-    if(surgescript_object_has_function(entity, "lateUpdate")) {
-
-        /* get data */
-        surgescript_object_t* entity_manager = (surgescript_object_t*)(((void**)data)[0]);
-        surgescript_var_t* arg = (surgescript_var_t*)(((void**)data)[1]);
-        const surgescript_var_t* args[] = { arg };
-
-        /* add entity to the late update queue */
-        surgescript_objecthandle_t entity_handle = surgescript_object_handle(entity);
-        surgescript_var_set_objecthandle(arg, entity_handle);
-        surgescript_object_call_function(entity_manager, "addToLateUpdateQueue", args, 1, NULL);
-
-    }
+    /* add the entity to the queues of the update phases it implements,
+       e.g., earlyUpdate(), lateUpdate() */
+    surgescript_object_t* entity_manager = (surgescript_object_t*)(((void**)data)[0]);
+    entitymanager_enqueue_entity(entity_manager, entity);
 
     /* continue iteration */
     return true;
@@ -918,7 +975,7 @@ bool notify_entity(surgescript_object_t* entity_or_component, void* data)
     /* notify the entity if there is such a function */
     surgescript_object_t* entity = entity_or_component;
     if(surgescript_object_has_function(entity, fun_name))
-        surgescript_object_call_function(entity, fun_name, NULL, 0, NULL);
+        classprofiler_call(entity, fun_name, NULL, 0, NULL);
 
     /* continue iteration */
     return true;
@@ -937,8 +994,8 @@ v2d_t entity_position(surgescript_object_t* entity)
 
 bool is_entity_inside_roi(surgescript_object_t* entity_manager, surgescript_object_t* entity)
 {
-    /* ROI test */
-    return entitymanager_is_inside_roi(entity_manager, entity_position(entity));
+    /* ROI test with hysteresis */
+    return entitymanager_is_entity_inside_roi(entity_manager, surgescript_object_handle(entity), entity_position(entity));
 }
 
 bool is_entity_inside_screen(surgescript_object_t* entity_manager, surgescript_object_t* entity)
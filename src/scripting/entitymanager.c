@@ -42,9 +42,14 @@
 
 #include <surgescript.h>
 #include <string.h>
+#include <stdlib.h>
 #include "scripting.h"
+#include "util/classprofiler.h"
+#include "util/framebudget.h"
 #include "../core/logfile.h"
 #include "../core/video.h"
+#include "../core/metrics.h"
+#include "../core/timer.h"
 #include "../util/v2d.h"
 #include "../util/darray.h"
 #include "../util/util.h"
@@ -59,6 +64,49 @@ struct entityinfo_t {
     v2d_t spawn_point; /* spawn point */
     bool is_persistent; /* usually placed via level editor; will be saved in the .lev file */
     bool is_sleeping; /* sleeping / inactive? */
+    bool is_drowsy; /* updated at a reduced rate near the region of interest? */
+    bool is_effectively_detached; /* memoized: objects can't be reparented and tags are set before spawning */
+    bool is_inside_roi; /* the result of the ROI test with hysteresis */
+    uint32_t roi_frame; /* the frame in which is_inside_roi last changed */
+};
+
+typedef enum entityphase_t entityphase_t;
+enum entityphase_t {
+    ENTITYPHASE_EARLY_UPDATE,       /* earlyUpdate(): before state:main */
+    ENTITYPHASE_LATE_UPDATE,        /* lateUpdate(): after state:main and after the camera */
+    ENTITYPHASE_PRE_RENDER,         /* preRender(): before the entities are rendered */
+
+    ENTITYPHASE_COUNT
+};
+
+static const char* PHASE_FUNCTION[] = {
+    [ENTITYPHASE_EARLY_UPDATE] = "earlyUpdate",
+    [ENTITYPHASE_LATE_UPDATE] = "lateUpdate",
+    [ENTITYPHASE_PRE_RENDER] = "preRender"
+};
+
+typedef struct phaseentry_t phaseentry_t;
+struct phaseentry_t {
+    surgescript_objecthandle_t handle;
+    int index; /* position in the queue */
+};
+
+/* a class of entities, resolved once per bulk spawn */
+typedef struct entityclass_t entityclass_t;
+struct entityclass_t {
+    bool is_valid; /* the class exists, it's tagged "entity" and it passes the sanity checks */
+    bool is_awake; /* tagged "awake" or "detached" */
+    bool is_detached;
+    bool is_private;
+    bool is_drowsy;
+    bool is_setup_object;
+};
+
+/* an entity whose spawning was deferred to a later framestep */
+typedef struct deferredspawn_t deferredspawn_t;
+struct deferredspawn_t {
+    const char* entity_name; /* interned */
+    v2d_t spawn_point;
 };
 
 typedef struct entitydb_t entitydb_t;
@@ -70,12 +118,14 @@ struct entitydb_t {
     } roi;
 
     /* entity info */
-    fasthash_t* info;
+    DARRAY(entityinfo_t, info); /* dense table indexed by object handle; unused entries have a null handle */
     fasthash_t* id_to_handle;
-    entityinfo_t* cached_query;
 
-    /* late update queue */
-    DARRAY(surgescript_objecthandle_t, late_update_queue);
+    /* update queues, one per phase */
+    struct {
+        DARRAY(surgescript_objecthandle_t, entity);
+    } phase_queue[ENTITYPHASE_COUNT];
+    DARRAY(phaseentry_t, phase_scratch); /* used for deduplication */
 
     /* brick-like objects */
     DARRAY(surgescript_objecthandle_t, bricklike_objects);
@@ -83,11 +133,33 @@ struct entitydb_t {
     /* space partitioning flag */
     bool dirty_partition;
 
+    /* bulk spawning */
+    bool is_bulk_spawning;
+    fasthash_t* bulk_class; /* resolved classes, keyed by the id of the interned name */
+    DARRAY(surgescript_objecthandle_t, bulk_unawake); /* stored in the EntityTree at the end */
+
+    /* spawning within the frame budget */
+    DARRAY(deferredspawn_t, deferred_spawn); /* a FIFO queue */
+    int deferred_spawn_head; /* index of the next entity to be spawned */
+
+    /* drowsy entities */
+    int entity_count; /* number of entities in the level */
+    int drowsy_count; /* number of drowsy entities in the level */
+    int drowsy_budget; /* how many drowsy entities may still be updated in this frame */
+    uint32_t frame; /* frame counter */
+
+    /* scratch variables of the native calls that run every frame or
+       on every spawn. SurgeScript copies the arguments when a function
+       is called, so these may be overwritten by reentrant calls */
+    surgescript_var_t* tmp_ret; /* receives return values; read right after the call */
+    surgescript_var_t* tmp_spawn; /* argument of the spawn path */
+    surgescript_var_t* tmp_render; /* rendering flags */
+    surgescript_var_t* tmp_select; /* skip_inactive_objects */
+    surgescript_var_t* tmp_tree[5]; /* arguments of the EntityTree */
+
 };
 
-static entityinfo_t NULL_ENTRY = { .handle = 0, .id = 0 };
-static entityinfo_t* entityinfo_ctor(entityinfo_t info) { return (entityinfo_t*)memcpy(mallocx(sizeof(info)), &info, sizeof(info)); }
-static void entityinfo_dtor(void* entry) { free(entry); }
+static const entityinfo_t NULL_ENTRY = { .handle = 0, .id = 0 };
 
 static surgescript_objecthandle_t* handle_ctor(surgescript_objecthandle_t handle) { return (surgescript_objecthandle_t*)memcpy(mallocx(sizeof(handle)), &handle, sizeof(handle)); }
 static void handle_dtor(void* handle) { free(handle); }
@@ -102,21 +174,32 @@ v2d_t entitymanager_get_entity_spawn_point(surgescript_object_t* entity_manager,
 bool entitymanager_is_entity_persistent(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle);
 void entitymanager_set_entity_persistent(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, bool is_persistent);
 bool entitymanager_is_entity_sleeping(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle);
+bool entitymanager_is_entity_effectively_detached(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, bool* is_detached);
 void entitymanager_set_entity_sleeping(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, bool is_sleeping);
+void entitymanager_enqueue_entity(surgescript_object_t* entity_manager, const surgescript_object_t* entity);
+surgescript_objecthandle_t entitymanager_spawn_entity(surgescript_object_t* entity_manager, const char* entity_name, v2d_t spawn_point);
+void entitymanager_begin_bulk_spawn(surgescript_object_t* entity_manager, int expected_count);
+void entitymanager_end_bulk_spawn(surgescript_object_t* entity_manager);
 bool entitymanager_is_inside_roi(surgescript_object_t* entity_manager, v2d_t position);
+bool entitymanager_is_entity_inside_roi(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, v2d_t position);
+bool entitymanager_is_entity_drowsy(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, v2d_t position);
+bool entitymanager_tick_drowsy_entity(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, v2d_t position);
 void entitymanager_get_roi(surgescript_object_t* entity_manager, int* top, int* left, int* bottom, int* right);
 arrayiterator_t* entitymanager_bricklike_iterator(surgescript_object_t* entity_manager);
+arrayiterator_t* entitymanager_bricklike_iterator_inplace(surgescript_object_t* entity_manager, iteratorstorage_t* storage);
 ssarrayiterator_t* entitymanager_activeentities_iterator(surgescript_object_t* entity_manager);
 
 /* SurgeScript API */
 static surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_render(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_earlyupdate(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_lateupdate(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_destructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_destroy(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_spawn(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_spawnentity(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_spawnentitylater(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_entity(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_entityid(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_findentity(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
@@ -144,16 +227,33 @@ static const surgescript_heapptr_t NOTGARBAGECONTAINER_ADDR = 5;
 #define WANT_SPACE_PARTITIONING         1 /* whether or not to optimize unawake entities with space partitioning */
 #define generate_entity_id()            (random64() & UINT64_C(0xFFFFFFFF)) /* in Open Surge 0.6.0.x and 0.5.x, we used all 64 bits */
 #define get_db(entity_manager)          ((entitydb_t*)surgescript_object_userdata(entity_manager))
-#define get_info(db, entity_handle)     ((entityinfo_t*)fasthash_get((db)->info, (entity_handle)))
+#define UNAWAKE_VT                      (entitycontainer_vtable(ENTITYCONTAINER_UNAWAKE))
+#define AWAKE_VT                        (entitycontainer_vtable(ENTITYCONTAINER_AWAKE))
+#define DEBUG_VT                        (entitycontainer_vtable(ENTITYCONTAINER_DEBUG))
+#define DROWSY_NEAR_MARGIN              512 /* drowsy entities this close to the ROI are updated every DROWSY_NEAR_INTERVAL frames */
+#define DROWSY_FAR_MARGIN               2048 /* drowsy entities this close to the ROI are updated every DROWSY_FAR_INTERVAL frames */
+#define DROWSY_NEAR_INTERVAL            2
+#define DROWSY_FAR_INTERVAL             8
+#define DROWSY_BUDGET                   64 /* maximum number of drowsy entities updated per frame */
+#define ROI_EXIT_MARGIN                 128 /* entities inside the ROI leave it only when they're this far from it */
+#define ROI_MIN_WAKE_FRAMES             30 /* entities that enter the ROI stay inside it for at least this number of frames */
+#define ROI_MIN_SLEEP_FRAMES            8 /* entities that leave the ROI stay outside of it for at least this number of frames */
+#define MIN_DEFERRED_SPAWNS             1 /* deferred entities spawned per frame even if the scripts are over budget */
 static inline entityinfo_t* quick_lookup(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle);
-static void foreach_unawake_container_inside_roi(surgescript_object_t* entity_manager, const char* fun_name, const surgescript_var_t** param, int num_params);
-static void foreach_unawake_container(surgescript_object_t* entity_manager, const char* fun_name, const surgescript_var_t** param, int num_params);
+static inline void call_native(entitycontainerfun_t fun, surgescript_object_t* container, const surgescript_var_t** param, int num_params);
+static void foreach_unawake_container_inside_roi(surgescript_object_t* entity_manager, entitycontainerfun_t fun, const surgescript_var_t** param, int num_params);
+static void foreach_unawake_container(surgescript_object_t* entity_manager, entitycontainerfun_t fun, const surgescript_var_t** param, int num_params);
 static void foreach_unawake_container_callback(surgescript_objecthandle_t container_handle, void* data);
 static void pause_containers(surgescript_object_t* entity_manager, bool pause);
 static bool is_in_debug_mode(surgescript_object_t* entity_manager);
 static void refresh_entity_tree(surgescript_object_t* entity_manager);
+static void run_phase(surgescript_object_t* entity_manager, entityphase_t phase);
+static int phase_entry_cmp(const void* a, const void* b);
 static bool inspect_subtree(const surgescript_object_t* root, bool is_root_entity, const surgescript_objectmanager_t* manager, surgescript_tagsystem_t* tag_system, int depth);
 static void prevent_garbage_collection(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle);
+static void resolve_class(surgescript_object_t* entity_manager, const char* entity_name, entityclass_t* class);
+static surgescript_objecthandle_t spawn_entity(surgescript_object_t* entity_manager, const char* entity_name, v2d_t spawn_point, const entityclass_t* class);
+static void spawn_deferred_entities(surgescript_object_t* entity_manager);
 
 
 
@@ -169,6 +269,7 @@ void scripting_register_entitymanager(surgescript_vm_t* vm)
 
     surgescript_vm_bind(vm, "EntityManager", "state:main", fun_main, 0);
     surgescript_vm_bind(vm, "EntityManager", "render", fun_render, 0);
+    surgescript_vm_bind(vm, "EntityManager", "earlyUpdate", fun_earlyupdate, 0);
     surgescript_vm_bind(vm, "EntityManager", "lateUpdate", fun_lateupdate, 0);
     surgescript_vm_bind(vm, "EntityManager", "addToLateUpdateQueue", fun_addtolateupdatequeue, 1);
     surgescript_vm_bind(vm, "EntityManager", "addBricklikeObject", fun_addbricklikeobject, 1);
@@ -176,6 +277,7 @@ void scripting_register_entitymanager(surgescript_vm_t* vm)
 
     surgescript_vm_bind(vm, "EntityManager", "spawn", fun_spawn, 1);
     surgescript_vm_bind(vm, "EntityManager", "spawnEntity", fun_spawnentity, 2);
+    surgescript_vm_bind(vm, "EntityManager", "spawnEntityLater", fun_spawnentitylater, 2);
     surgescript_vm_bind(vm, "EntityManager", "entity", fun_entity, 1);
     surgescript_vm_bind(vm, "EntityManager", "entityId", fun_entityid, 1);
     surgescript_vm_bind(vm, "EntityManager", "findEntity", fun_findentity, 1);
@@ -202,8 +304,13 @@ surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_
 {
     entitydb_t* db = get_db(object);
 
-    /* clear the late update queue */
-    darray_clear(db->late_update_queue);
+    /* clear the update queues */
+    for(int i = 0; i < ENTITYPHASE_COUNT; i++)
+        darray_clear(db->phase_queue[i].entity);
+
+    /* a new frame begins for drowsy entities */
+    db->drowsy_budget = DROWSY_BUDGET;
+    db->frame++;
 
     /* clear the brick-like object list */
     darray_clear(db->bricklike_objects);
@@ -232,19 +339,39 @@ surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescri
     entitydb_t* db = mallocx(sizeof *db);
 
     int lg2_cap = 15;
-    db->info = fasthash_create(entityinfo_dtor, lg2_cap);
+    darray_init_ex(db->info, 1 << lg2_cap);
     db->id_to_handle = fasthash_create(handle_dtor, lg2_cap);
-    db->cached_query = &NULL_ENTRY;
 
-    darray_init(db->late_update_queue);
+    for(int i = 0; i < ENTITYPHASE_COUNT; i++)
+        darray_init(db->phase_queue[i].entity);
+    darray_init(db->phase_scratch);
     darray_init(db->bricklike_objects);
     db->dirty_partition = false;
 
+    db->is_bulk_spawning = false;
+    db->bulk_class = NULL;
+    darray_init(db->bulk_unawake);
+
+    darray_init(db->deferred_spawn);
+    db->deferred_spawn_head = 0;
+
+    db->entity_count = 0;
+    db->drowsy_count = 0;
+    db->drowsy_budget = DROWSY_BUDGET;
+    db->frame = 0;
+
     db->roi.left = 0;
     db->roi.top = 0;
     db->roi.right = 0;
     db->roi.bottom = 0;
 
+    db->tmp_ret = surgescript_var_create();
+    db->tmp_spawn = surgescript_var_create();
+    db->tmp_render = surgescript_var_create();
+    db->tmp_select = surgescript_var_create();
+    for(int i = 0; i < 5; i++)
+        db->tmp_tree[i] = surgescript_var_create();
+
     surgescript_object_set_userdata(object, db);
 
     /* allocate variables */
@@ -293,11 +420,31 @@ surgescript_var_t* fun_destructor(surgescript_object_t* object, const surgescrip
     /* release the database */
     entitydb_t* db = get_db(object);
 
+    for(int i = 4; i >= 0; i--)
+        surgescript_var_destroy(db->tmp_tree[i]);
+    surgescript_var_destroy(db->tmp_select);
+    surgescript_var_destroy(db->tmp_render);
+    surgescript_var_destroy(db->tmp_spawn);
+    surgescript_var_destroy(db->tmp_ret);
+
+    if(db->deferred_spawn_head < darray_length(db->deferred_spawn))
+        logfile_message("EntityManager: %d deferred entities were not spawned", darray_length(db->deferred_spawn) - db->deferred_spawn_head);
+    darray_release(db->deferred_spawn);
+
+    darray_release(db->bulk_unawake);
+    if(db->bulk_class != NULL)
+        fasthash_destroy(db->bulk_class);
+
     darray_release(db->bricklike_objects);
-    darray_release(db->late_update_queue);
+    darray_release(db->phase_scratch);
+    for(int i = 0; i < ENTITYPHASE_COUNT; i++)
+        darray_release(db->phase_queue[i].entity);
 
+    fasthash_stats_t stats;
+    fasthash_stats(db->id_to_handle, &stats);
+    logfile_message("EntityManager: the ID table had %d elements, %d tombstones (%.0f%%) and %d entries. Probe length: %.2f average, %d max.", stats.length, stats.tombstones, 100.0 * stats.tombstone_ratio, stats.capacity, stats.average_probe_length, stats.max_probe_length);
     fasthash_destroy(db->id_to_handle);
-    fasthash_destroy(db->info);
+    darray_release(db->info);
 
     free(db);
 
@@ -346,7 +493,6 @@ surgescript_var_t* fun_spawn(surgescript_object_t* object, const surgescript_var
 /* spawn an entity at a position in world space */
 surgescript_var_t* fun_spawnentity(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    surgescript_heap_t* heap = surgescript_object_heap(object);
     surgescript_objectmanager_t* manager = surgescript_object_manager(object);
     const char* entity_name = surgescript_var_fast_get_string(param[0]);
     surgescript_objecthandle_t position_handle = surgescript_var_get_objecthandle(param[1]);
@@ -373,108 +519,65 @@ surgescript_var_t* fun_spawnentity(surgescript_object_t* object, const surgescri
         surgescript_tagsystem_add_tag(tag_system, entity_name, "private");
     }
 
-    /* get the Level object */
-    surgescript_objecthandle_t level_handle = surgescript_object_parent(object);
-    surgescript_object_t* level = surgescript_objectmanager_get(manager, level_handle);
-
-    /* spawn the entity */
-    surgescript_objecthandle_t entity_parent = level_handle;
-    surgescript_objecthandle_t entity_handle = surgescript_objectmanager_spawn(manager, entity_parent, entity_name, NULL);
-    surgescript_object_t* entity = surgescript_objectmanager_get(manager, entity_handle);
-
     /* read the spawn point */
     double spawn_x = 0.0, spawn_y = 0.0;
     surgescript_object_t* position = surgescript_objectmanager_get(manager, position_handle);
     scripting_vector2_read(position, &spawn_x, &spawn_y);
     v2d_t spawn_point = v2d_new(spawn_x, spawn_y);
 
-    /* position the entity */
-    surgescript_transform_t* transform = surgescript_object_transform(entity);
-    surgescript_transform_setposition2d(transform, spawn_x, spawn_y); /* already in world space */
+    /* spawn the entity, charging the time to its class */
+    double start_time = timer_get_now();
+    entityclass_t class;
+    resolve_class(object, entity_name, &class);
+    surgescript_objecthandle_t entity_handle = spawn_entity(object, entity_name, spawn_point, &class);
+    framebudget_charge(entity_name, timer_get_now() - start_time);
 
-    /* generate entity info */
-    entityinfo_t* info = entityinfo_ctor((entityinfo_t) {
-        .handle = entity_handle,
-        .id = generate_entity_id(),
-        .spawn_point = spawn_point,
-        .is_sleeping = !(
-            surgescript_object_has_tag(entity, "awake") ||
-            surgescript_object_has_tag(entity, "detached")
-        ),
-        .is_persistent = !(
-            surgescript_object_has_tag(entity, "private") ||
-            /*surgescript_object_has_tag(entity, "detached") ||*/ /* if it's detached, it's private - see above */
-            scripting_level_issetupobjectname(level, entity_name)
-        )
-    });
+    /* return the handle to the spawned entity */
+    return surgescript_var_set_objecthandle(surgescript_var_create(), entity_handle);
+}
 
-    /* store entity info */
+/* spawn an entity at a position in world space if the scripts are within
+   the budget of the framestep. Otherwise, defer the spawning to a later
+   framestep. Returns the spawned entity, or null if it was deferred */
+surgescript_var_t* fun_spawnentitylater(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(object);
+    const char* entity_name = surgescript_var_fast_get_string(param[0]);
+    surgescript_objecthandle_t position_handle = surgescript_var_get_objecthandle(param[1]);
     entitydb_t* db = get_db(object);
-    fasthash_put(db->info, info->handle, info);
-    fasthash_put(db->id_to_handle, info->id, handle_ctor(info->handle));
-
-    /* decide the entity container: is the new entity awake or not? */
-    bool is_awake = (
-        surgescript_tagsystem_has_tag(tag_system, entity_name, "awake") ||
-        surgescript_tagsystem_has_tag(tag_system, entity_name, "detached")
-    );
-    surgescript_objecthandle_t entity_container_handle = surgescript_var_get_objecthandle(
-        is_awake ?
-        surgescript_heap_at(heap, AWAKEENTITYCONTAINER_ADDR) :
-        surgescript_heap_at(heap, UNAWAKEENTITYCONTAINER_ADDR)
-    );
-    surgescript_object_t* entity_container = surgescript_objectmanager_get(manager, entity_container_handle);
-
-#if WANT_SPACE_PARTITIONING
-    if(!is_awake) {
-        /* store the entity in a container of the EntityTree if unawake */
-        surgescript_var_t* entity_tree_var = surgescript_heap_at(heap, ENTITYTREE_ADDR);
-        surgescript_objecthandle_t entity_tree_handle = surgescript_var_get_objecthandle(entity_tree_var);
-        surgescript_object_t* entity_tree = surgescript_objectmanager_get(manager, entity_tree_handle);
-        surgescript_var_t* entity_var = surgescript_var_create();
-        const surgescript_var_t* args[] = { entity_var };
-
-        /* call entityTree.bubbleDown(entity) */
-        surgescript_var_set_objecthandle(entity_var, entity_handle);
-        surgescript_object_call_function(entity_tree, "bubbleDown", args, 1, NULL);
 
-        surgescript_var_destroy(entity_var);
+    /* within budget: spawn the entity now. Entities deferred
+       previously come first, so we keep the order of the calls */
+    if(db->deferred_spawn_head == darray_length(db->deferred_spawn) && !framebudget_is_exhausted())
+        return fun_spawnentity(object, param, num_params);
 
-        /* new subsectors may have been allocated;
-           mark the space partition as dirty */
-        db->dirty_partition = true;
+    /* validate: does the object exist? */
+    if(!surgescript_objectmanager_class_exists(manager, entity_name)) {
+        scripting_error(object, "Can't spawn entity: object \"%s\" doesn't exist!", entity_name);
+        return NULL;
     }
-    else {
-        /* store the entity in the awake container */
-        surgescript_var_t* arg = surgescript_var_create();
-        const surgescript_var_t* args[] = { arg };
 
-        /* call entityContainer.storeEntity(entity) */
-        surgescript_var_set_objecthandle(arg, entity_handle);
-        surgescript_object_call_function(entity_container, "storeEntity", args, 1, NULL);
-
-        surgescript_var_destroy(arg);
+    /* validate: accept only entities */
+    surgescript_tagsystem_t* tag_system = surgescript_objectmanager_tagsystem(manager);
+    if(!surgescript_tagsystem_has_tag(tag_system, entity_name, "entity")) {
+        scripting_error(object, "Can't spawn entity: object \"%s\" isn't tagged \"entity\"!", entity_name);
+        return NULL;
     }
-#else
-    /* store the entity in the selected entity container */
-    surgescript_var_t* arg = surgescript_var_create();
-    const surgescript_var_t* args[] = { arg };
-
-    /* call entityContainer.storeEntity(entity) */
-    surgescript_var_set_objecthandle(arg, entity_handle);
-    surgescript_object_call_function(entity_container, "storeEntity", args, 1, NULL);
 
-    surgescript_var_destroy(arg);
-#endif
-
-    /* prevent garbage collection */
-    prevent_garbage_collection(object, entity_handle);
+    /* read the spawn point */
+    double spawn_x = 0.0, spawn_y = 0.0;
+    surgescript_object_t* position = surgescript_objectmanager_get(manager, position_handle);
+    scripting_vector2_read(position, &spawn_x, &spawn_y);
 
-    /* apply backwards-compatibility fix */
-    inspect_subtree(entity, true, manager, tag_system, 0);
+    /* defer the spawning */
+    deferredspawn_t deferred = {
+        .entity_name = str_intern(entity_name),
+        .spawn_point = v2d_new(spawn_x, spawn_y)
+    };
+    darray_push(db->deferred_spawn, deferred);
 
-    /* return the handle to the spawned entity */
-    return surgescript_var_set_objecthandle(surgescript_var_create(), entity_handle);
+    /* return null */
+    return surgescript_var_set_null(surgescript_var_create());
 }
 
 /* get the entity with the given id */
@@ -523,16 +626,19 @@ surgescript_var_t* fun_findentity(surgescript_object_t* object, const surgescrip
     if(surgescript_tagsystem_has_tag(tag_system, object_name, "entity")) {
         /*
          * TODO: develop a faster data structure?
-         * We just call Level.child() here
+         * We just look for a child of the Level here
          */
 
         /* get the Level object */
         surgescript_objecthandle_t level_handle = surgescript_object_parent(object);
         surgescript_object_t* level = surgescript_objectmanager_get(manager, level_handle);
 
-        /* find the entity */
-        surgescript_object_call_function(level, "child", param, 1, ret);
-        return ret; /* will be null if no entity is found */
+        /* find the entity, bypassing the SurgeScript call stack */
+        surgescript_objecthandle_t entity_handle = surgescript_object_child(level, object_name);
+        if(entity_handle == surgescript_objectmanager_null(manager))
+            return surgescript_var_set_null(ret); /* no entity is found */
+
+        return surgescript_var_set_objecthandle(ret, entity_handle);
     }
     else {
         /* the object doesn't exist or is not an entity */
@@ -581,28 +687,27 @@ surgescript_var_t* fun_activeentities(surgescript_object_t* object, const surges
     bool skip_inactive_objects = !(level_editmode() || is_in_debug_mode(object));
     surgescript_objecthandle_t array_handle = surgescript_objectmanager_spawn_array(manager);
     surgescript_var_t* array_var = surgescript_var_set_objecthandle(surgescript_var_create(), array_handle);
-    surgescript_var_t* skip_inactive_var = surgescript_var_set_bool(surgescript_var_create(), skip_inactive_objects);
+    surgescript_var_t* skip_inactive_var = surgescript_var_set_bool(get_db(object)->tmp_select, skip_inactive_objects); /* reused */
     const surgescript_var_t* args[] = { array_var, skip_inactive_var };
 
     /* get awake entities */
     surgescript_var_t* awake_container_var = surgescript_heap_at(heap, AWAKEENTITYCONTAINER_ADDR);
     surgescript_objecthandle_t awake_container_handle = surgescript_var_get_objecthandle(awake_container_var);
     surgescript_object_t* awake_container = surgescript_objectmanager_get(manager, awake_container_handle);
-    surgescript_object_call_function(awake_container, "selectActiveEntities", args, 2, NULL);
+    call_native(AWAKE_VT->select_active_entities, awake_container, args, 2);
 
 #if WANT_SPACE_PARTITIONING
     /* get unawakened active entities */
-    foreach_unawake_container_inside_roi(object, "selectActiveEntities", args, 2);
+    foreach_unawake_container_inside_roi(object, UNAWAKE_VT->select_active_entities, args, 2);
 #else
     /* get unawakened active entities */
     surgescript_var_t* unawake_container_var = surgescript_heap_at(heap, UNAWAKEENTITYCONTAINER_ADDR);
     surgescript_objecthandle_t unawake_container_handle = surgescript_var_get_objecthandle(unawake_container_var);
     surgescript_object_t* unawake_container = surgescript_objectmanager_get(manager, unawake_container_handle);
-    surgescript_object_call_function(unawake_container, "selectActiveEntities", args, 2, NULL);
+    call_native(UNAWAKE_VT->select_active_entities, unawake_container, args, 2);
 #endif
 
     /* done */
-    surgescript_var_destroy(skip_inactive_var);
     return array_var;
 }
 
@@ -650,7 +755,7 @@ surgescript_var_t* fun_addtolateupdatequeue(surgescript_object_t* object, const
     entitydb_t* db = get_db(object);
     surgescript_objecthandle_t handle = surgescript_var_get_objecthandle(param[0]);
 
-    darray_push(db->late_update_queue, handle);
+    darray_push(db->phase_queue[ENTITYPHASE_LATE_UPDATE].entity, handle);
 
     return NULL;
 }
@@ -675,24 +780,20 @@ surgescript_var_t* fun_addbricklikeobject(surgescript_object_t* object, const su
     return NULL;
 }
 
+/* early update: called before the SurgeScript VM is updated. The queue
+   was filled in the previous frame; it will be cleared in state:main */
+surgescript_var_t* fun_earlyupdate(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    spawn_deferred_entities(object);
+    run_phase(object, ENTITYPHASE_EARLY_UPDATE);
+    return NULL;
+}
+
 /* late update */
 surgescript_var_t* fun_lateupdate(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    const surgescript_objectmanager_t* manager = surgescript_object_manager(object);
-    const entitydb_t* db = get_db(object);
-
-    /* for each entity in the late update queue, call entity.lateUpdate() */
-    for(int i = 0; i < darray_length(db->late_update_queue); i++) {
-        surgescript_objecthandle_t entity_handle = db->late_update_queue[i];
-        if(surgescript_objectmanager_exists(manager, entity_handle)) { /* validity check */
-            surgescript_object_t* entity = surgescript_objectmanager_get(manager, entity_handle);
-            if(!surgescript_object_is_killed(entity)) {
-                surgescript_object_call_function(entity, "lateUpdate", NULL, 0, NULL);
-            }
-        }
-    }
-
-    /* done! */
+    run_phase(object, ENTITYPHASE_LATE_UPDATE);
+    metrics_count(METRIC_ENTITIES, get_db(object)->entity_count);
     return NULL;
 }
 
@@ -706,23 +807,23 @@ surgescript_var_t* fun_notifyentities(surgescript_object_t* object, const surges
     surgescript_var_t* debug_container_var = surgescript_heap_at(heap, DEBUGENTITYCONTAINER_ADDR);
     surgescript_objecthandle_t debug_container_handle = surgescript_var_get_objecthandle(debug_container_var);
     surgescript_object_t* debug_container = surgescript_objectmanager_get(manager, debug_container_handle);
-    surgescript_object_call_function(debug_container, "notifyEntities", param, num_params, NULL);
+    call_native(DEBUG_VT->notify_entities, debug_container, param, num_params);
 
     /* notify entities of the awake container */
     surgescript_var_t* awake_container_var = surgescript_heap_at(heap, AWAKEENTITYCONTAINER_ADDR);
     surgescript_objecthandle_t awake_container_handle = surgescript_var_get_objecthandle(awake_container_var);
     surgescript_object_t* awake_container = surgescript_objectmanager_get(manager, awake_container_handle);
-    surgescript_object_call_function(awake_container, "notifyEntities", param, num_params, NULL);
+    call_native(AWAKE_VT->notify_entities, awake_container, param, num_params);
 
 #if WANT_SPACE_PARTITIONING
     /* notify entities of all unawake containers */
-    foreach_unawake_container(object, "notifyEntities", param, num_params);
+    foreach_unawake_container(object, UNAWAKE_VT->notify_entities, param, num_params);
 #else
     /* notify entities of the unawake container */
     surgescript_var_t* unawake_container_var = surgescript_heap_at(heap, UNAWAKEENTITYCONTAINER_ADDR);
     surgescript_objecthandle_t unawake_container_handle = surgescript_var_get_objecthandle(unawake_container_var);
     surgescript_object_t* unawake_container = surgescript_objectmanager_get(manager, unawake_container_handle);
-    surgescript_object_call_function(unawake_container, "notifyEntities", param, num_params, NULL);
+    call_native(UNAWAKE_VT->notify_entities, unawake_container, param, num_params);
 #endif
 
     /* done! */
@@ -734,9 +835,13 @@ surgescript_var_t* fun_render(surgescript_object_t* object, const surgescript_va
 {
     const surgescript_objectmanager_t* manager = surgescript_object_manager(object);
     const surgescript_heap_t* heap = surgescript_object_heap(object);
-    surgescript_var_t* arg = surgescript_var_create();
+    surgescript_var_t* arg = get_db(object)->tmp_render; /* reused */
     const surgescript_var_t* args[] = { arg };
 
+    /* call preRender() only once per frame */
+    run_phase(object, ENTITYPHASE_PRE_RENDER);
+    darray_clear(get_db(object)->phase_queue[ENTITYPHASE_PRE_RENDER].entity);
+
     /* set the rendering flags */
     int flags = 0;
     flags |= (level_editmode() || is_in_debug_mode(object)) ? 0x1 : 0;
@@ -747,27 +852,26 @@ surgescript_var_t* fun_render(surgescript_object_t* object, const surgescript_va
     surgescript_var_t* debug_container_var = surgescript_heap_at(heap, DEBUGENTITYCONTAINER_ADDR);
     surgescript_objecthandle_t debug_container_handle = surgescript_var_get_objecthandle(debug_container_var);
     surgescript_object_t* debug_container = surgescript_objectmanager_get(manager, debug_container_handle);
-    surgescript_object_call_function(debug_container, "render", args, 1, NULL);
+    call_native(DEBUG_VT->render, debug_container, args, 1);
 
     /* render entities of the awake container */
     surgescript_var_t* awake_container_var = surgescript_heap_at(heap, AWAKEENTITYCONTAINER_ADDR);
     surgescript_objecthandle_t awake_container_handle = surgescript_var_get_objecthandle(awake_container_var);
     surgescript_object_t* awake_container = surgescript_objectmanager_get(manager, awake_container_handle);
-    surgescript_object_call_function(awake_container, "render", args, 1, NULL);
+    call_native(AWAKE_VT->render, awake_container, args, 1);
 
 #if WANT_SPACE_PARTITIONING
     /* render entities of the unawake containers */
-    foreach_unawake_container_inside_roi(object, "render", args, 1);
+    foreach_unawake_container_inside_roi(object, UNAWAKE_VT->render, args, 1);
 #else
     /* render entities of the unawake container */
     surgescript_var_t* unawake_container_var = surgescript_heap_at(heap, UNAWAKEENTITYCONTAINER_ADDR);
     surgescript_objecthandle_t unawake_container_handle = surgescript_var_get_objecthandle(unawake_container_var);
     surgescript_object_t* unawake_container = surgescript_objectmanager_get(manager, unawake_container_handle);
-    surgescript_object_call_function(unawake_container, "render", args, 1, NULL);
+    call_native(UNAWAKE_VT->render, unawake_container, args, 1);
 #endif
 
     /* done */
-    surgescript_var_destroy(arg);
     return NULL;
 }
 
@@ -890,8 +994,12 @@ void entitymanager_remove_entity_info(surgescript_object_t* entity_manager, surg
         entitydb_t* db = get_db(entity_manager);
         uint64_t entity_id = info->id;
 
+        if(info->is_drowsy)
+            db->drowsy_count--;
+        db->entity_count--;
+
         fasthash_delete(db->id_to_handle, entity_id);
-        fasthash_delete(db->info, entity_handle);
+        *info = NULL_ENTRY;
     }
 }
 
@@ -948,6 +1056,18 @@ bool entitymanager_is_entity_sleeping(surgescript_object_t* entity_manager, surg
     return info != NULL ? info->is_sleeping : true;
 }
 
+/* is the entity effectively detached? Returns false if there is no info about the entity */
+bool entitymanager_is_entity_effectively_detached(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, bool* is_detached)
+{
+    entityinfo_t* info = quick_lookup(entity_manager, entity_handle);
+
+    if(info == NULL)
+        return false;
+
+    *is_detached = info->is_effectively_detached;
+    return true;
+}
+
 /* change the sleeping flag of an entity */
 void entitymanager_set_entity_sleeping(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, bool is_sleeping)
 {
@@ -956,6 +1076,96 @@ void entitymanager_set_entity_sleeping(surgescript_object_t* entity_manager, sur
         info->is_sleeping = is_sleeping;
 }
 
+/* add an entity to the update queues of the phases it implements */
+void entitymanager_enqueue_entity(surgescript_object_t* entity_manager, const surgescript_object_t* entity)
+{
+    entitydb_t* db = get_db(entity_manager);
+    surgescript_objecthandle_t entity_handle = surgescript_object_handle(entity);
+
+    for(int i = 0; i < ENTITYPHASE_COUNT; i++) {
+        if(surgescript_object_has_function(entity, PHASE_FUNCTION[i]))
+            darray_push(db->phase_queue[i].entity, entity_handle);
+    }
+}
+
+/* spawn an entity at a position in world space, bypassing the SurgeScript
+   call stack. Returns a null handle if the entity can't be spawned this way;
+   Level.spawnEntity() will then report the error */
+surgescript_objecthandle_t entitymanager_spawn_entity(surgescript_object_t* entity_manager, const char* entity_name, v2d_t spawn_point)
+{
+    entitydb_t* db = get_db(entity_manager);
+    surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
+    entityclass_t class;
+
+    /* resolve the class once per bulk spawn */
+    if(db->is_bulk_spawning) {
+        uint64_t key = (uint64_t)str_intern_id(str_intern(entity_name));
+        entityclass_t* cached_class = fasthash_get(db->bulk_class, key);
+
+        if(cached_class == NULL) {
+            cached_class = mallocx(sizeof *cached_class);
+            resolve_class(entity_manager, entity_name, cached_class);
+            fasthash_put(db->bulk_class, key, cached_class);
+        }
+
+        class = *cached_class;
+    }
+    else
+        resolve_class(entity_manager, entity_name, &class);
+
+    /* spawn the entity */
+    if(!class.is_valid)
+        return surgescript_objectmanager_null(manager);
+
+    return spawn_entity(entity_manager, entity_name, spawn_point, &class);
+}
+
+/* start spawning entities in bulk (e.g., when loading a level). Classes
+   are resolved once and unawake entities are stored in the EntityTree
+   in a single pass by entitymanager_end_bulk_spawn() */
+void entitymanager_begin_bulk_spawn(surgescript_object_t* entity_manager, int expected_count)
+{
+    entitydb_t* db = get_db(entity_manager);
+
+    if(!db->is_bulk_spawning) {
+        db->is_bulk_spawning = true;
+        db->bulk_class = fasthash_create(free, 6);
+    }
+
+    /* pre-size the storage */
+    expected_count = max(0, expected_count);
+    darray_reserve(db->info, darray_length(db->info) + expected_count);
+    darray_reserve(db->bulk_unawake, darray_length(db->bulk_unawake) + expected_count);
+    fasthash_reserve(db->id_to_handle, db->entity_count + expected_count);
+}
+
+/* finish spawning entities in bulk */
+void entitymanager_end_bulk_spawn(surgescript_object_t* entity_manager)
+{
+    entitydb_t* db = get_db(entity_manager);
+    surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
+    const surgescript_heap_t* heap = surgescript_object_heap(entity_manager);
+
+    if(!db->is_bulk_spawning)
+        return;
+
+    /* store the unawake entities in the EntityTree */
+    if(darray_length(db->bulk_unawake) > 0) {
+        surgescript_var_t* entity_tree_var = surgescript_heap_at(heap, ENTITYTREE_ADDR);
+        surgescript_objecthandle_t entity_tree_handle = surgescript_var_get_objecthandle(entity_tree_var);
+        surgescript_object_t* entity_tree = surgescript_objectmanager_get(manager, entity_tree_handle);
+
+        entitytree_store(entity_tree, db->bulk_unawake, darray_length(db->bulk_unawake));
+        db->dirty_partition = true; /* new subsectors may have been allocated */
+
+        darray_clear(db->bulk_unawake);
+    }
+
+    /* done */
+    db->bulk_class = fasthash_destroy(db->bulk_class);
+    db->is_bulk_spawning = false;
+}
+
 /* find entity by ID. This may return a null handle! */
 surgescript_objecthandle_t entitymanager_find_entity_by_id(surgescript_object_t* entity_manager, uint64_t entity_id)
 {
@@ -987,6 +1197,93 @@ bool entitymanager_is_inside_roi(surgescript_object_t* entity_manager, v2d_t pos
     return x >= db->roi.left && x <= db->roi.right && y >= db->roi.top && y <= db->roi.bottom;
 }
 
+/* is the entity inside the region of interest? Unlike entitymanager_is_inside_roi(),
+   this test has hysteresis: entities enter the ROI when they're inside it, but
+   leave it only when they're ROI_EXIT_MARGIN pixels away from it. Besides, an
+   entity keeps its state for a minimum number of frames. Entities that hover
+   around the boundary of the ROI are no longer reset and deactivated repeatedly */
+bool entitymanager_is_entity_inside_roi(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, v2d_t position)
+{
+    const entitydb_t* db = get_db(entity_manager);
+    int x = position.x, y = position.y;
+
+    /* no info? use the regular test */
+    entityinfo_t* info = quick_lookup(entity_manager, entity_handle);
+    if(info == NULL)
+        return entitymanager_is_inside_roi(entity_manager, position);
+
+    /* where should the entity be? */
+    bool want_inside;
+    if(info->is_inside_roi) {
+        want_inside = (
+            x >= db->roi.left - ROI_EXIT_MARGIN && x <= db->roi.right + ROI_EXIT_MARGIN &&
+            y >= db->roi.top - ROI_EXIT_MARGIN && y <= db->roi.bottom + ROI_EXIT_MARGIN
+        );
+    }
+    else
+        want_inside = entitymanager_is_inside_roi(entity_manager, position);
+
+    /* change the state after the minimum time */
+    if(want_inside != info->is_inside_roi) {
+        uint32_t min_frames = info->is_inside_roi ? ROI_MIN_WAKE_FRAMES : ROI_MIN_SLEEP_FRAMES;
+
+        if(db->frame - info->roi_frame >= min_frames) {
+            info->is_inside_roi = want_inside;
+            info->roi_frame = db->frame;
+        }
+    }
+
+    return info->is_inside_roi;
+}
+
+/* is the entity drowsy and close enough to the region of interest to be updated from time to time? */
+bool entitymanager_is_entity_drowsy(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, v2d_t position)
+{
+    const entitydb_t* db = get_db(entity_manager);
+    int x = position.x, y = position.y;
+
+    if(db->drowsy_count == 0)
+        return false;
+
+    const entityinfo_t* info = quick_lookup(entity_manager, entity_handle);
+    if(info == NULL || !info->is_drowsy)
+        return false;
+
+    return x >= db->roi.left - DROWSY_FAR_MARGIN && x <= db->roi.right + DROWSY_FAR_MARGIN &&
+           y >= db->roi.top - DROWSY_FAR_MARGIN && y <= db->roi.bottom + DROWSY_FAR_MARGIN;
+}
+
+/* should a drowsy entity outside the region of interest be updated in this frame?
+   Drowsy entities are updated at a reduced rate depending on their distance to
+   the ROI. Their updates are staggered and limited to a budget per frame */
+bool entitymanager_tick_drowsy_entity(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, v2d_t position)
+{
+    entitydb_t* db = get_db(entity_manager);
+    int x = position.x, y = position.y;
+
+    /* this must be a drowsy entity */
+    if(!entitymanager_is_entity_drowsy(entity_manager, entity_handle, position))
+        return false;
+
+    /* the update rate depends on the distance to the ROI */
+    bool is_near = (
+        x >= db->roi.left - DROWSY_NEAR_MARGIN && x <= db->roi.right + DROWSY_NEAR_MARGIN &&
+        y >= db->roi.top - DROWSY_NEAR_MARGIN && y <= db->roi.bottom + DROWSY_NEAR_MARGIN
+    );
+    uint32_t interval = is_near ? DROWSY_NEAR_INTERVAL : DROWSY_FAR_INTERVAL;
+
+    /* stagger the updates, so that not all drowsy entities are updated in the same frame */
+    if((db->frame + (uint32_t)entity_handle) % interval != 0)
+        return false;
+
+    /* is there enough budget left? */
+    if(db->drowsy_budget <= 0)
+        return false;
+
+    db->drowsy_budget--;
+    return true;
+}
+
 /* get the (inclusive) coordinates of the region of interest */
 void entitymanager_get_roi(surgescript_object_t* entity_manager, int* top, int* left, int* bottom, int* right)
 {
@@ -1010,6 +1307,19 @@ iterator_t* entitymanager_bricklike_iterator(surgescript_object_t* entity_manage
     );
 }
 
+/* create an in-place iterator for iterating over the collection of (handles of) brick-like objects */
+iterator_t* entitymanager_bricklike_iterator_inplace(surgescript_object_t* entity_manager, iteratorstorage_t* storage)
+{
+    entitydb_t* db = get_db(entity_manager);
+
+    return iterator_create_from_array_inplace(
+        storage,
+        db->bricklike_objects,
+        darray_length(db->bricklike_objects),
+        sizeof *(db->bricklike_objects)
+    );
+}
+
 /* create an iterator for iterating over the collection of (handles of) active entities
    (i.e., awake, inside the ROI...) */
 iterator_t* entitymanager_activeentities_iterator(surgescript_object_t* entity_manager)
@@ -1017,10 +1327,9 @@ iterator_t* entitymanager_activeentities_iterator(surgescript_object_t* entity_m
     surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
 
     /* call entityManager.activeEntities(), which returns a temporary SurgeScript Array */
-    surgescript_var_t* ret = surgescript_var_create();
+    surgescript_var_t* ret = get_db(entity_manager)->tmp_ret; /* reused */
     surgescript_object_call_function(entity_manager, "activeEntities", NULL, 0, ret);
     surgescript_objecthandle_t array_handle = surgescript_var_get_objecthandle(ret);
-    surgescript_var_destroy(ret);
 
     /* sanity check */
     if(!surgescript_objectmanager_exists(manager, array_handle))
@@ -1045,19 +1354,25 @@ entityinfo_t* quick_lookup(surgescript_object_t* entity_manager, surgescript_obj
     /* this gotta be fast! */
     entitydb_t* db = get_db(entity_manager);
 
-    /* the rationale for caching is that we tend to make multiple
-       queries related to the same entity sequentially in time */
-    if(db->cached_query->handle != entity_handle) {
-        entityinfo_t* info = get_info(db, entity_handle); /* NULL if not found */
-        return info != NULL ? (db->cached_query = info) : NULL;
-    }
+    /* SurgeScript handles are small integers; we index the table directly */
+    if(entity_handle < darray_length(db->info) && db->info[entity_handle].handle == entity_handle && entity_handle != NULL_ENTRY.handle)
+        return &(db->info[entity_handle]);
+
+    /* not found */
+    return NULL;
+}
+
+/* calls a native function of a container or of the entity tree, bypassing the SurgeScript call stack */
+void call_native(entitycontainerfun_t fun, surgescript_object_t* container, const surgescript_var_t** param, int num_params)
+{
+    surgescript_var_t* ret = fun(container, param, num_params);
 
-    /* the entry was cached */
-    return db->cached_query;
+    if(ret != NULL)
+        surgescript_var_destroy(ret);
 }
 
 /* calls a function on each unawake container inside the region of interest */
-void foreach_unawake_container_inside_roi(surgescript_object_t* entity_manager, const char* fun_name, const surgescript_var_t** param, int num_params)
+void foreach_unawake_container_inside_roi(surgescript_object_t* entity_manager, entitycontainerfun_t fun, const surgescript_var_t** param, int num_params)
 {
     surgescript_heap_t* heap = surgescript_object_heap(entity_manager);
     surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
@@ -1075,13 +1390,13 @@ void foreach_unawake_container_inside_roi(surgescript_object_t* entity_manager,
         surgescript_object_t* container = surgescript_objectmanager_get(manager, container_handle);
 
         /* call function */
-        surgescript_object_call_function(container, fun_name, param, num_params, NULL);
+        call_native(fun, container, param, num_params);
     }
     iterator_destroy(it);
 }
 
 /* calls a function on all unawake containers */
-void foreach_unawake_container(surgescript_object_t* entity_manager, const char* fun_name, const surgescript_var_t** param, int num_params)
+void foreach_unawake_container(surgescript_object_t* entity_manager, entitycontainerfun_t fun, const surgescript_var_t** param, int num_params)
 {
     surgescript_heap_t* heap = surgescript_object_heap(entity_manager);
     surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
@@ -1092,7 +1407,7 @@ void foreach_unawake_container(surgescript_object_t* entity_manager, const char*
     surgescript_object_t* entity_tree = surgescript_objectmanager_get(manager, entity_tree_handle);
 
     /* for each unawake container in the EntityTree */
-    void* pack[] = { manager, (char*)fun_name, param, &num_params };
+    void* pack[] = { manager, &fun, param, &num_params };
     surgescript_object_find_descendants(entity_tree, "EntityContainer", pack, foreach_unawake_container_callback);
     /* ^ slow!!! */
 }
@@ -1103,7 +1418,7 @@ void foreach_unawake_container_callback(surgescript_objecthandle_t container_han
     void** pack = (void**)data;
 
     surgescript_objectmanager_t* manager = pack[0];
-    char* fun_name = pack[1];
+    entitycontainerfun_t* fun = pack[1];
     const surgescript_var_t** param = pack[2];
     int* num_params = pack[3];
 
@@ -1111,7 +1426,7 @@ void foreach_unawake_container_callback(surgescript_objecthandle_t container_han
     surgescript_object_t* container = surgescript_objectmanager_get(manager, container_handle);
 
     /* call function */
-    surgescript_object_call_function(container, fun_name, param, *num_params, NULL);
+    call_native(*fun, container, param, *num_params);
 }
 
 /* pause containers */
@@ -1119,19 +1434,20 @@ void pause_containers(surgescript_object_t* entity_manager, bool pause)
 {
     surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
     surgescript_heap_t* heap = surgescript_object_heap(entity_manager);
-    const char* fun_name = pause ? "pause" : "resume";
+    entitycontainerfun_t awake_fun = pause ? AWAKE_VT->pause : AWAKE_VT->resume;
+    entitycontainerfun_t unawake_fun = pause ? UNAWAKE_VT->pause : UNAWAKE_VT->resume;
 
     /* pause the awake container */
     surgescript_var_t* awake_container_var = surgescript_heap_at(heap, AWAKEENTITYCONTAINER_ADDR);
     surgescript_objecthandle_t awake_container_handle = surgescript_var_get_objecthandle(awake_container_var);
     surgescript_object_t* awake_container = surgescript_objectmanager_get(manager, awake_container_handle);
-    surgescript_object_call_function(awake_container, fun_name, NULL, 0, NULL);
+    call_native(awake_fun, awake_container, NULL, 0);
 
     /* pause the unawake container */
     surgescript_var_t* unawake_container_var = surgescript_heap_at(heap, UNAWAKEENTITYCONTAINER_ADDR);
     surgescript_objecthandle_t unawake_container_handle = surgescript_var_get_objecthandle(unawake_container_var);
     surgescript_object_t* unawake_container = surgescript_objectmanager_get(manager, unawake_container_handle);
-    surgescript_object_call_function(unawake_container, fun_name, NULL, 0, NULL);
+    call_native(unawake_fun, unawake_container, NULL, 0);
 
 #if WANT_SPACE_PARTITIONING
     /* pause the EntityTree */
@@ -1148,13 +1464,10 @@ void pause_containers(surgescript_object_t* entity_manager, bool pause)
 /* are we in the Debug Mode? */
 bool is_in_debug_mode(surgescript_object_t* entity_manager)
 {
-    surgescript_var_t* ret = surgescript_var_create();
+    surgescript_var_t* ret = get_db(entity_manager)->tmp_ret; /* reused */
 
     surgescript_object_call_function(entity_manager, "isInDebugMode", NULL, 0, ret);
-    bool value = surgescript_var_get_bool(ret);
-
-    surgescript_var_destroy(ret);
-    return value;
+    return surgescript_var_get_bool(ret);
 }
 
 /* refresh the entity tree: partition the space and update the unawake entity container array */
@@ -1182,48 +1495,45 @@ void refresh_entity_tree(surgescript_object_t* entity_manager)
         surgescript_objecthandle_t unawake_container_handle = surgescript_var_get_objecthandle(*unawake_container_var);
         surgescript_object_t* unawake_container = surgescript_objectmanager_get(manager, unawake_container_handle);
 
-        surgescript_object_call_function(unawake_container, "bubbleUpEntities", NULL, 0, NULL);
+        call_native(UNAWAKE_VT->bubble_up_entities, unawake_container, NULL, 0);
     }
     iterator_destroy(it);
 
+    /* relocate the entities that have moved, in a single pass */
+    entitytree_flush(entity_tree);
+
     /* update the size of the world */
     v2d_t world_size = level_size();
-    surgescript_var_t* world_width_var = surgescript_var_set_number(surgescript_var_create(), world_size.x);
-    surgescript_var_t* world_height_var = surgescript_var_set_number(surgescript_var_create(), world_size.y);
-    surgescript_var_t* world_size_has_changed = surgescript_var_create();
+    surgescript_var_t* world_width_var = surgescript_var_set_number(db->tmp_tree[0], world_size.x);
+    surgescript_var_t* world_height_var = surgescript_var_set_number(db->tmp_tree[1], world_size.y);
 
     const surgescript_var_t* world_size_args[] = { world_width_var, world_height_var };
-    surgescript_object_call_function(entity_tree, "updateWorldSize", world_size_args, 2, world_size_has_changed);
+    surgescript_var_t* world_size_has_changed = entitytree_update_world_size(entity_tree, world_size_args, 2);
 
     if(surgescript_var_get_bool(world_size_has_changed)) {
         /* if the world size has changed, then we must
            relocate all entities of all containers */
         logfile_message("EntityManager: world size has changed. Relocating all entities...");
-        foreach_unawake_container(entity_manager, "bubbleUpEntities", NULL, 0);
+        foreach_unawake_container(entity_manager, UNAWAKE_VT->bubble_up_entities, NULL, 0);
+        entitytree_flush(entity_tree);
     }
 
     surgescript_var_destroy(world_size_has_changed);
-    surgescript_var_destroy(world_height_var);
-    surgescript_var_destroy(world_width_var);
 
     /* clear the unawake entity container array */
     surgescript_object_call_function(unawake_container_array, "clear", NULL, 0, NULL);
 
     /* update the ROI of the entity tree, as well as the unawake container array */
-    surgescript_var_t* output_array_var = surgescript_var_clone(unawake_container_array_var);
-    surgescript_var_t* top_var = surgescript_var_set_number(surgescript_var_create(), db->roi.top);
-    surgescript_var_t* left_var = surgescript_var_set_number(surgescript_var_create(), db->roi.left);
-    surgescript_var_t* bottom_var = surgescript_var_set_number(surgescript_var_create(), db->roi.bottom);
-    surgescript_var_t* right_var = surgescript_var_set_number(surgescript_var_create(), db->roi.right);
+    surgescript_var_t* output_array_var = db->tmp_tree[0];
+    surgescript_var_copy(output_array_var, unawake_container_array_var);
+    int margin = db->drowsy_count > 0 ? DROWSY_FAR_MARGIN : ROI_EXIT_MARGIN; /* wake up the sectors of the drowsy entities and of the entities that are leaving the ROI */
+    surgescript_var_t* top_var = surgescript_var_set_number(db->tmp_tree[1], db->roi.top - margin);
+    surgescript_var_t* left_var = surgescript_var_set_number(db->tmp_tree[2], db->roi.left - margin);
+    surgescript_var_t* bottom_var = surgescript_var_set_number(db->tmp_tree[3], db->roi.bottom + margin);
+    surgescript_var_t* right_var = surgescript_var_set_number(db->tmp_tree[4], db->roi.right + margin);
 
     const surgescript_var_t* args[] = { output_array_var, top_var, left_var, bottom_var, right_var };
-    surgescript_object_call_function(entity_tree, "updateROI", args, 5, NULL);
-
-    surgescript_var_destroy(right_var);
-    surgescript_var_destroy(bottom_var);
-    surgescript_var_destroy(left_var);
-    surgescript_var_destroy(top_var);
-    surgescript_var_destroy(output_array_var);
+    call_native(entitytree_update_roi, entity_tree, args, 5);
 
     /* the space partition is clean again, i.e.,
        the unawake entity container array has the correct entries */
@@ -1238,6 +1548,57 @@ void refresh_entity_tree(surgescript_object_t* entity_manager)
 #endif
 }
 
+/* call the function of an update phase in the entities of its queue.
+   An entity that has been queued more than once is called only once,
+   in the order in which it was first queued */
+void run_phase(surgescript_object_t* entity_manager, entityphase_t phase)
+{
+    const surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
+    entitydb_t* db = get_db(entity_manager);
+    surgescript_objecthandle_t null_handle = surgescript_objectmanager_null(manager);
+    int n = darray_length(db->phase_queue[phase].entity);
+
+    /* deduplicate the queue */
+    if(n > 1) {
+        surgescript_objecthandle_t* queue = db->phase_queue[phase].entity;
+
+        darray_clear(db->phase_scratch);
+        for(int i = 0; i < n; i++)
+            darray_push(db->phase_scratch, ((phaseentry_t){ .handle = queue[i], .index = i }));
+
+        qsort(db->phase_scratch, n, sizeof(phaseentry_t), phase_entry_cmp);
+
+        for(int i = 1; i < n; i++) {
+            if(db->phase_scratch[i].handle == db->phase_scratch[i-1].handle)
+                queue[db->phase_scratch[i].index] = null_handle;
+        }
+    }
+
+    /* for each entity in the queue, call the function of the phase.
+       The queue may grow while we iterate, so we read its length again */
+    for(int i = 0; i < darray_length(db->phase_queue[phase].entity); i++) {
+        surgescript_objecthandle_t entity_handle = db->phase_queue[phase].entity[i];
+        if(entity_handle != null_handle && surgescript_objectmanager_exists(manager, entity_handle)) { /* validity check */
+            surgescript_object_t* entity = surgescript_objectmanager_get(manager, entity_handle);
+            if(!surgescript_object_is_killed(entity)) {
+                framebudget_call(entity, PHASE_FUNCTION[phase], NULL, 0, NULL);
+            }
+        }
+    }
+}
+
+/* compare phase entries by handle, then by position in the queue */
+int phase_entry_cmp(const void* a, const void* b)
+{
+    const phaseentry_t* x = (const phaseentry_t*)a;
+    const phaseentry_t* y = (const phaseentry_t*)b;
+
+    if(x->handle != y->handle)
+        return x->handle < y->handle ? -1 : 1;
+    else
+        return x->index - y->index;
+}
+
 /* Check if the subtree whose root is "root" has any descendants tagged
    "entity" that are not direct children of "root". If so, tag them as a
    temporary fix, for backwards compatibility with Open Surge 0.6.0.x or
@@ -1326,7 +1687,167 @@ void prevent_garbage_collection(surgescript_object_t* entity_manager, surgescrip
     surgescript_objecthandle_t container_handle = surgescript_var_get_objecthandle(container_var);
     surgescript_object_t* container = surgescript_objectmanager_get(manager, container_handle);
 
-    surgescript_var_t* param = surgescript_var_set_objecthandle(surgescript_var_create(), entity_handle);
+    surgescript_var_t* param = surgescript_var_set_objecthandle(get_db(entity_manager)->tmp_spawn, entity_handle); /* reused */
     surgescript_object_call_function(container, "addObject", (const surgescript_var_t*[]){ param }, 1, NULL);
-    surgescript_var_destroy(param);
-}
\ No newline at end of file
+}
+/* spawn the entities deferred by spawnEntityLater() in the order of the calls,
+   while the scripts are within budget. A few are spawned regardless, so that
+   the queue is eventually emptied */
+void spawn_deferred_entities(surgescript_object_t* entity_manager)
+{
+    entitydb_t* db = get_db(entity_manager);
+    int spawned_count = 0;
+
+    while(db->deferred_spawn_head < darray_length(db->deferred_spawn)) {
+        if(spawned_count >= MIN_DEFERRED_SPAWNS && framebudget_is_exhausted())
+            break;
+
+        /* entitymanager_spawn_entity() may push to the queue if an entity spawns
+           another in its constructor, so we copy the entry before spawning */
+        deferredspawn_t deferred = db->deferred_spawn[db->deferred_spawn_head++];
+
+        double start_time = timer_get_now();
+        entitymanager_spawn_entity(entity_manager, deferred.entity_name, deferred.spawn_point);
+        framebudget_charge(deferred.entity_name, timer_get_now() - start_time);
+        spawned_count++;
+    }
+
+    /* the queue is empty */
+    if(db->deferred_spawn_head == darray_length(db->deferred_spawn)) {
+        darray_clear(db->deferred_spawn);
+        db->deferred_spawn_head = 0;
+    }
+}
+
+/* resolve the tags of a class of entities */
+void resolve_class(surgescript_object_t* entity_manager, const char* entity_name, entityclass_t* class)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
+    surgescript_tagsystem_t* tag_system = surgescript_objectmanager_tagsystem(manager);
+    surgescript_objecthandle_t level_handle = surgescript_object_parent(entity_manager);
+    surgescript_object_t* level = surgescript_objectmanager_get(manager, level_handle);
+
+    memset(class, 0, sizeof(*class));
+
+    /* accept only entities */
+    if(!surgescript_objectmanager_class_exists(manager, entity_name))
+        return;
+    else if(!surgescript_tagsystem_has_tag(tag_system, entity_name, "entity"))
+        return;
+
+    /* read the tags */
+    class->is_detached = surgescript_tagsystem_has_tag(tag_system, entity_name, "detached");
+    class->is_private = surgescript_tagsystem_has_tag(tag_system, entity_name, "private");
+    class->is_awake = class->is_detached || surgescript_tagsystem_has_tag(tag_system, entity_name, "awake");
+    class->is_drowsy = !class->is_awake && surgescript_tagsystem_has_tag(tag_system, entity_name, "drowsy");
+    class->is_setup_object = scripting_level_issetupobjectname(level, entity_name);
+
+    /* see the sanity check of fun_spawnentity() */
+    class->is_valid = !(class->is_detached && !class->is_private);
+}
+
+/* spawn an entity of a resolved class at a position in world space */
+surgescript_objecthandle_t spawn_entity(surgescript_object_t* entity_manager, const char* entity_name, v2d_t spawn_point, const entityclass_t* class)
+{
+    surgescript_heap_t* heap = surgescript_object_heap(entity_manager);
+    surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
+    surgescript_tagsystem_t* tag_system = surgescript_objectmanager_tagsystem(manager);
+    entitydb_t* db = get_db(entity_manager);
+
+    /* spawn the entity as a child of Level */
+    surgescript_objecthandle_t entity_parent = surgescript_object_parent(entity_manager);
+    surgescript_objecthandle_t entity_handle = surgescript_objectmanager_spawn(manager, entity_parent, entity_name, NULL);
+    surgescript_object_t* entity = surgescript_objectmanager_get(manager, entity_handle);
+
+    /* position the entity */
+    surgescript_transform_t* transform = surgescript_object_transform(entity);
+    surgescript_transform_setposition2d(transform, spawn_point.x, spawn_point.y); /* already in world space */
+    scripting_transform_invalidate();
+
+    /* generate entity info */
+    entityinfo_t new_info = {
+        .handle = entity_handle,
+        .id = generate_entity_id(),
+        .spawn_point = spawn_point,
+        .is_sleeping = !class->is_awake,
+        .is_persistent = !(
+            class->is_private ||
+            /*class->is_detached ||*/ /* if it's detached, it's private - see fun_spawnentity() */
+            class->is_setup_object
+        ),
+        .is_drowsy = class->is_drowsy,
+        .is_effectively_detached = class->is_detached /* the parent is the Level */
+    };
+
+    /* store entity info */
+    while(darray_length(db->info) <= entity_handle)
+        darray_push(db->info, NULL_ENTRY);
+    db->info[entity_handle] = new_info;
+    db->info[entity_handle].roi_frame = db->frame - ROI_MIN_SLEEP_FRAMES; /* may enter the ROI immediately */
+    const entityinfo_t* info = &(db->info[entity_handle]);
+    fasthash_put(db->id_to_handle, info->id, handle_ctor(info->handle));
+    db->entity_count++;
+
+    /* the entity tree looks further away from the ROI if there are drowsy entities */
+    if(info->is_drowsy && db->drowsy_count++ == 0)
+        db->dirty_partition = true;
+
+    /* decide the entity container: is the new entity awake or not? */
+    bool is_awake = class->is_awake;
+    surgescript_objecthandle_t entity_container_handle = surgescript_var_get_objecthandle(
+        is_awake ?
+        surgescript_heap_at(heap, AWAKEENTITYCONTAINER_ADDR) :
+        surgescript_heap_at(heap, UNAWAKEENTITYCONTAINER_ADDR)
+    );
+    surgescript_object_t* entity_container = surgescript_objectmanager_get(manager, entity_container_handle);
+
+#if WANT_SPACE_PARTITIONING
+    if(!is_awake && db->is_bulk_spawning) {
+        /* the EntityTree will store the entity in a single pass */
+        darray_push(db->bulk_unawake, entity_handle);
+        (void)entity_container;
+    }
+    else if(!is_awake) {
+        /* store the entity in a container of the EntityTree if unawake */
+        surgescript_var_t* entity_tree_var = surgescript_heap_at(heap, ENTITYTREE_ADDR);
+        surgescript_objecthandle_t entity_tree_handle = surgescript_var_get_objecthandle(entity_tree_var);
+        surgescript_object_t* entity_tree = surgescript_objectmanager_get(manager, entity_tree_handle);
+        surgescript_var_t* entity_var = db->tmp_spawn; /* reused */
+        const surgescript_var_t* args[] = { entity_var };
+
+        /* call entityTree.bubbleDown(entity) */
+        surgescript_var_set_objecthandle(entity_var, entity_handle);
+        surgescript_object_call_function(entity_tree, "bubbleDown", args, 1, NULL);
+
+        /* new subsectors may have been allocated;
+           mark the space partition as dirty */
+        db->dirty_partition = true;
+    }
+    else {
+        /* store the entity in the awake container */
+        surgescript_var_t* arg = db->tmp_spawn; /* reused */
+        const surgescript_var_t* args[] = { arg };
+
+        /* call entityContainer.storeEntity(entity) */
+        surgescript_var_set_objecthandle(arg, entity_handle);
+        surgescript_object_call_function(entity_container, "storeEntity", args, 1, NULL);
+    }
+#else
+    /* store the entity in the selected entity container */
+    surgescript_var_t* arg = db->tmp_spawn; /* reused */
+    const surgescript_var_t* args[] = { arg };
+
+    /* call entityContainer.storeEntity(entity) */
+    surgescript_var_set_objecthandle(arg, entity_handle);
+    surgescript_object_call_function(entity_container, "storeEntity", args, 1, NULL);
+#endif
+
+    /* prevent garbage collection */
+    prevent_garbage_collection(entity_manager, entity_handle);
+
+    /* apply backwards-compatibility fix */
+    inspect_subtree(entity, true, manager, tag_system, 0);
+
+    /* done */
+    return entity_handle;
+}
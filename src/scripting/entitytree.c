@@ -352,6 +352,10 @@
  * for a while (and non-leaf sectors as well if possible) in order to save
  * memory and processing time.
  * 
+ * We currently keep empty sectors allocated for reuse, but we flag them as
+ * empty when updating the ROI. Since entities only get into a subtree via
+ * bubbleDown, which clears the flag, empty subtrees can be safely skipped.
+ * 
  * 
  * 
  * Finding entities in a region of interest
@@ -423,9 +427,11 @@
 #include <surgescript.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include "scripting.h"
 #include "../util/util.h"
+#include "../util/darray.h"
 
 /* the height of the quaternary tree - must be greater than zero
    the number of nodes in the tree grows exponentially (we allocate lazily) */
@@ -451,6 +457,8 @@ typedef struct sector_t sector_t;
 typedef struct sectoraddr_t sectoraddr_t;
 typedef struct sectorrect_t sectorrect_t;
 typedef struct sectorvtable_t sectorvtable_t;
+typedef struct dirtyentity_t dirtyentity_t;
+typedef struct dirtylist_t dirtylist_t;
 typedef enum sectorquadrant_t sectorquadrant_t;
 typedef surgescript_var_t* (*sectorfun_t)(surgescript_object_t*,const surgescript_var_t**,int);
 
@@ -491,6 +499,20 @@ struct sectorvtable_t
     sectorfun_t update_world_size;
 };
 
+/* an entity that no longer belongs to its leaf sector */
+struct dirtyentity_t
+{
+    surgescript_objecthandle_t entity;
+    surgescript_objecthandle_t source_leaf;
+    surgescript_objecthandle_t target_leaf; /* computed when flushing */
+};
+
+/* entities to be relocated in a single pass */
+struct dirtylist_t
+{
+    DARRAY(dirtyentity_t, entry);
+};
+
 /* sector struct */
 struct sector_t
 {
@@ -510,11 +532,15 @@ struct sector_t
         sectoraddr_t addr;
         sectorrect_t cached_rect;
     } child[4];
+
+    /* moved entities of the tree (root only; NULL otherwise) */
+    dirtylist_t* dirty_list;
 };
 
 /* sector flags */
 #define SECTOR_HAS_SUBSECTOR(quadrant)  (1 << (quadrant)) /* quadrant = 0, 1, 2, 3 */
 #define SECTOR_IS_LEAF                  (1 << 4)
+#define SECTOR_IS_EMPTY                 (1 << 5) /* no entities in the subtree as of the last ROI update */
 
 /* sector helpers */
 static sector_t* sector_ctor(int index, int world_width, int world_height);
@@ -553,6 +579,10 @@ static const surgescript_heapptr_t CHILD_ADDR[] = { /* non-leaf nodes only */
 #define unsafe_get_sector(tree_node) ((sector_t*)surgescript_object_userdata(tree_node))
 static inline sector_t* safe_get_sector(surgescript_object_t* tree_node);
 static surgescript_objecthandle_t spawn_child(surgescript_object_t* object, sectorquadrant_t quadrant);
+static surgescript_object_t* find_root(surgescript_object_t* tree_node);
+static surgescript_object_t* locate_leaf(surgescript_object_t* tree_node, v2d_t position);
+static surgescript_object_t* get_container(surgescript_object_t* leaf);
+static int dirty_entity_cmp(const void* a, const void* b);
 static v2d_t get_clipped_position(surgescript_object_t* entity, float world_width, float world_height);
 
 static const sectorvtable_t LEAF_VTABLE = {
@@ -602,6 +632,166 @@ void scripting_register_entitytree(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "EntityTreeLeaf", "updateWorldSize", fun_leaf_updateworldsize, 2);
 }
 
+/*
+ * entitytree_update_roi()
+ * Native version of EntityTree.updateROI(), called on the root of the tree
+ */
+surgescript_var_t* entitytree_update_roi(surgescript_object_t* entity_tree, const surgescript_var_t** param, int num_params)
+{
+    sector_t* sector = unsafe_get_sector(entity_tree);
+    return sector->vt->update_roi(entity_tree, param, num_params);
+}
+
+/*
+ * entitytree_bubble_up()
+ * Native version of bubbleUp(), called on a leaf sector of the tree. Entities
+ * that have moved to other sectors are relocated by entitytree_flush()
+ */
+surgescript_var_t* entitytree_bubble_up(surgescript_object_t* tree_node, const surgescript_var_t** param, int num_params)
+{
+    sector_t* sector = unsafe_get_sector(tree_node);
+    return sector->vt->bubble_up(tree_node, param, num_params);
+}
+
+/*
+ * entitytree_flush()
+ * Relocate, in a single pass, all entities that have left their leaf sectors
+ * since the last flush. Entities are grouped by their target leaf sectors.
+ * This must be called on the root of the tree
+ */
+void entitytree_flush(surgescript_object_t* entity_tree)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(entity_tree);
+    sector_t* root_sector = unsafe_get_sector(entity_tree);
+    dirtylist_t* list = root_sector->dirty_list;
+    int n = darray_length(list->entry);
+
+    /* nothing to do */
+    if(n == 0)
+        return;
+
+    /* find the target leaf sectors */
+    for(int i = 0; i < n; i++) {
+        dirtyentity_t* e = &(list->entry[i]);
+        e->target_leaf = surgescript_objectmanager_null(manager);
+
+        if(!surgescript_objectmanager_exists(manager, e->entity) || !surgescript_objectmanager_exists(manager, e->source_leaf))
+            continue; /* the entity or its sector no longer exist */
+
+        surgescript_object_t* entity = surgescript_objectmanager_get(manager, e->entity);
+        surgescript_object_t* source_leaf = surgescript_objectmanager_get(manager, e->source_leaf);
+        v2d_t position = get_clipped_position(entity, root_sector->cached_world_width, root_sector->cached_world_height);
+
+        e->target_leaf = surgescript_object_handle(locate_leaf(source_leaf, position));
+    }
+
+    /* group the entities by target leaf */
+    qsort(list->entry, n, sizeof(dirtyentity_t), dirty_entity_cmp);
+
+    /* relocate the entities */
+    surgescript_var_t* arg = surgescript_var_create();
+    const surgescript_var_t* args[] = { arg };
+    surgescript_object_t* target_container = NULL;
+
+    for(int i = 0; i < n; i++) {
+        const dirtyentity_t* e = &(list->entry[i]);
+
+        /* skip invalid and duplicate entries */
+        if(e->target_leaf == surgescript_objectmanager_null(manager))
+            continue;
+        else if(i > 0 && e->entity == list->entry[i-1].entity && e->target_leaf == list->entry[i-1].target_leaf)
+            continue;
+
+        /* get the container of the target leaf once per group */
+        if(i == 0 || e->target_leaf != list->entry[i-1].target_leaf)
+            target_container = get_container(surgescript_objectmanager_get(manager, e->target_leaf));
+
+        /* move the entity to its new container */
+        surgescript_object_t* source_container = get_container(surgescript_objectmanager_get(manager, e->source_leaf));
+        surgescript_var_set_objecthandle(arg, e->entity);
+        surgescript_object_call_function(source_container, "removeEntity", args, 1, NULL);
+        surgescript_object_call_function(target_container, "storeEntity", args, 1, NULL);
+    }
+
+    surgescript_var_destroy(arg);
+
+    /* done */
+    darray_clear(list->entry);
+}
+
+/*
+ * entitytree_store()
+ * Store, in a single pass, entities that are not in the tree. It's the bulk
+ * version of bubbleDown. Entities are grouped by their leaf sectors. This
+ * must be called on the root of the tree
+ */
+void entitytree_store(surgescript_object_t* entity_tree, const surgescript_objecthandle_t* entity_handle, int entity_count)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(entity_tree);
+    sector_t* root_sector = unsafe_get_sector(entity_tree);
+    DARRAY(dirtyentity_t, entry);
+
+    /* nothing to do */
+    if(entity_count == 0)
+        return;
+
+    /* find the leaf sectors */
+    darray_init_ex(entry, entity_count);
+    for(int i = 0; i < entity_count; i++) {
+        if(!surgescript_objectmanager_exists(manager, entity_handle[i]))
+            continue; /* the entity no longer exists */
+
+        surgescript_object_t* entity = surgescript_objectmanager_get(manager, entity_handle[i]);
+        v2d_t position = get_clipped_position(entity, root_sector->cached_world_width, root_sector->cached_world_height);
+        surgescript_object_t* leaf = locate_leaf(entity_tree, position);
+
+        dirtyentity_t e = {
+            .entity = entity_handle[i],
+            .source_leaf = surgescript_objectmanager_null(manager), /* unused */
+            .target_leaf = surgescript_object_handle(leaf)
+        };
+
+        unsafe_get_sector(leaf)->flags &= ~SECTOR_IS_EMPTY; /* the leaf is now populated */
+        darray_push(entry, e);
+    }
+
+    /* group the entities by leaf */
+    qsort(entry, darray_length(entry), sizeof(dirtyentity_t), dirty_entity_cmp);
+
+    /* store the entities */
+    surgescript_var_t* arg = surgescript_var_create();
+    const surgescript_var_t* args[] = { arg };
+    surgescript_object_t* container = NULL;
+
+    for(int i = 0; i < darray_length(entry); i++) {
+        const dirtyentity_t* e = &(entry[i]);
+
+        /* skip duplicate entries */
+        if(i > 0 && e->entity == entry[i-1].entity)
+            continue;
+
+        /* get the container of the leaf once per group */
+        if(i == 0 || e->target_leaf != entry[i-1].target_leaf)
+            container = get_container(surgescript_objectmanager_get(manager, e->target_leaf));
+
+        surgescript_var_set_objecthandle(arg, e->entity);
+        surgescript_object_call_function(container, "storeEntity", args, 1, NULL);
+    }
+
+    surgescript_var_destroy(arg);
+    darray_release(entry);
+}
+
+/*
+ * entitytree_update_world_size()
+ * Native version of EntityTree.updateWorldSize(), called on the root of the tree
+ */
+surgescript_var_t* entitytree_update_world_size(surgescript_object_t* entity_tree, const surgescript_var_t** param, int num_params)
+{
+    sector_t* sector = unsafe_get_sector(entity_tree);
+    return sector->vt->update_world_size(entity_tree, param, num_params);
+}
+
 /* constructor of a non-leaf node */
 surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
@@ -611,6 +801,8 @@ surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescri
     /* allocate root data */
     if(sector == NULL) {
         sector_t* root_sector = sector_ctor(0, DEFAULT_WORLD_WIDTH, DEFAULT_WORLD_HEIGHT);
+        root_sector->dirty_list = mallocx(sizeof *(root_sector->dirty_list));
+        darray_init(root_sector->dirty_list->entry);
         surgescript_object_set_userdata(object, root_sector);
     }
 
@@ -741,25 +933,18 @@ surgescript_var_t* fun_leaf_bubbleup(surgescript_object_t* object, const surgesc
     v2d_t entity_position = get_clipped_position(entity, world_width, world_height);
     if(!point_belongs_to_rect(sector->cached_rect, entity_position.x, entity_position.y)) {
 
-        /* get the entity container of this leaf sector */
-        surgescript_heap_t* heap = surgescript_object_heap(object);
-        surgescript_var_t* container_var = surgescript_heap_at(heap, ENTITYCONTAINER_ADDR);
-        surgescript_objecthandle_t container_handle = surgescript_var_get_objecthandle(container_var);
-        surgescript_object_t* container = surgescript_objectmanager_get(manager, container_handle);
-
-        /* remove this entity from its present container */
-        surgescript_var_t* arg = surgescript_var_create();
-        const surgescript_var_t* args[] = { arg };
-        surgescript_var_set_objecthandle(arg, entity_handle);
-        surgescript_object_call_function(container, "removeEntity", args, 1, NULL);
-        surgescript_var_destroy(arg);
+        /* we don't move the entity right away. Instead, we mark it as dirty
+           and relocate all dirty entities in a single pass when flushing */
+        surgescript_object_t* root = find_root(object);
+        dirtylist_t* list = unsafe_get_sector(root)->dirty_list;
 
-        /* call parent.bubbleUp(entity) */
-        surgescript_objecthandle_t parent_handle = surgescript_object_parent(object);
-        surgescript_object_t* parent = surgescript_objectmanager_get(manager, parent_handle);
-        sector_t* parent_sector = safe_get_sector(parent);
+        dirtyentity_t e = {
+            .entity = entity_handle,
+            .source_leaf = surgescript_object_handle(object),
+            .target_leaf = surgescript_objectmanager_null(manager)
+        };
 
-        return parent_sector->vt->bubble_up(parent, param, num_params);
+        darray_push(list->entry, e);
 
     }
 
@@ -806,6 +991,7 @@ surgescript_var_t* fun_leaf_bubbledown(surgescript_object_t* object, const surge
     /* get the entity */
     surgescript_objectmanager_t* manager = surgescript_object_manager(object);
     surgescript_objecthandle_t entity_handle = surgescript_var_get_objecthandle(param[0]);
+    sector_t* sector = unsafe_get_sector(object);
 
     /* get the entity container of this leaf sector */
     surgescript_heap_t* heap = surgescript_object_heap(object);
@@ -813,6 +999,9 @@ surgescript_var_t* fun_leaf_bubbledown(surgescript_object_t* object, const surge
     surgescript_objecthandle_t container_handle = surgescript_var_get_objecthandle(container_var);
     surgescript_object_t* container = surgescript_objectmanager_get(manager, container_handle);
 
+    /* this sector is now populated */
+    sector->flags &= ~SECTOR_IS_EMPTY;
+
     /* store the entity in the container of this sector */
     surgescript_var_t* arg = surgescript_var_create();
     const surgescript_var_t* args[] = { arg };
@@ -841,13 +1030,18 @@ surgescript_var_t* fun_bubbledown(surgescript_object_t* object, const surgescrip
     /* get the position of the entity */
     v2d_t entity_position = get_clipped_position(entity, world_width, world_height);
 
+    /* this subtree is now populated */
+    sector->flags &= ~SECTOR_IS_EMPTY;
+
     /* for each subsector */
     for(int j = 0; j < 4; j++) {
 
         /* does the entity belong to the j-th subsector? */
         if(point_belongs_to_rect(sector->child[j].cached_rect, entity_position.x, entity_position.y)) {
 
-            /* lazily allocate the subsector */
+            /* lazily allocate the subsector. Sectors that become empty are
+               never destroyed: we keep them for reuse, and updateROI skips
+               them until an entity bubbles down into them again */
             surgescript_var_t* child_var = surgescript_heap_at(heap, CHILD_ADDR[j]);
             if(surgescript_var_is_null(child_var)) {
                 surgescript_objecthandle_t child_handle = spawn_child(object, j);
@@ -876,7 +1070,7 @@ surgescript_var_t* fun_bubbledown(surgescript_object_t* object, const surgescrip
     return NULL;
 }
 
-/* non-leaf-variant of updateROI: find intersecting leaf sectors and put nodes to sleep */
+/* non-leaf-variant of updateROI: find intersecting populated leaf sectors and put nodes to sleep */
 surgescript_var_t* fun_updateroi(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
     surgescript_heap_t* heap = surgescript_object_heap(object);
@@ -887,6 +1081,7 @@ surgescript_var_t* fun_updateroi(surgescript_object_t* object, const surgescript
     double bottom = surgescript_var_get_number(param[3]);
     double right = surgescript_var_get_number(param[4]);
     sector_t* sector = unsafe_get_sector(object);
+    bool is_populated = false;
 
     sectorrect_t roi = {
         .top = top,
@@ -910,20 +1105,33 @@ surgescript_var_t* fun_updateroi(surgescript_object_t* object, const surgescript
         surgescript_objecthandle_t child_handle = surgescript_var_get_objecthandle(child_var); /* not null, because the subsector is allocated */
         ssassert(surgescript_objectmanager_exists(manager, child_handle));
         surgescript_object_t* child = surgescript_objectmanager_get(manager, child_handle);
+        sector_t* child_sector = unsafe_get_sector(child);
+
+        /* is the subsector empty? (entities only get into it via bubbleDown) */
+        if(child_sector->flags & SECTOR_IS_EMPTY) {
+            surgescript_object_set_active(child, false); /* put it to sleep */
+            continue; /* skip */
+        }
 
         /* does the subsector intersect with the ROI? */
         if(disjoint_rects(sector->child[j].cached_rect, roi)) {
             /* no, it doesn't */
             surgescript_object_set_active(child, false); /* put it to sleep */
+            is_populated = true; /* as far as we know */
             continue; /* skip */
         }
 
         /* recursion */
-        sector_t* child_sector = unsafe_get_sector(child);
         child_sector->vt->update_roi(child, param, num_params);
+        if(!(child_sector->flags & SECTOR_IS_EMPTY))
+            is_populated = true;
 
     }
 
+    /* mark this sector as empty if none of its subsectors hold entities */
+    if(!is_populated)
+        sector->flags |= SECTOR_IS_EMPTY;
+
     /* done */
     return NULL;
 }
@@ -934,14 +1142,23 @@ surgescript_var_t* fun_leaf_updateroi(surgescript_object_t* object, const surges
     surgescript_objectmanager_t* manager = surgescript_object_manager(object);
     surgescript_objecthandle_t array_handle = surgescript_var_get_objecthandle(param[0]);
     surgescript_object_t* array = surgescript_objectmanager_get(manager, array_handle);
-
-    /* awaken this sector */
-    surgescript_object_set_active(object, true);
+    sector_t* sector = unsafe_get_sector(object);
 
     /* get the entity container of this leaf sector */
     surgescript_heap_t* heap = surgescript_object_heap(object);
     surgescript_var_t* container_var = surgescript_heap_at(heap, ENTITYCONTAINER_ADDR);
     surgescript_objecthandle_t container_handle = surgescript_var_get_objecthandle(container_var);
+    surgescript_object_t* container = surgescript_objectmanager_get(manager, container_handle);
+
+    /* there is nothing to process if this sector is empty */
+    if(entitycontainer_is_empty(container)) {
+        sector->flags |= SECTOR_IS_EMPTY;
+        surgescript_object_set_active(object, false);
+        return NULL;
+    }
+
+    /* awaken this sector */
+    surgescript_object_set_active(object, true);
 
     /* add the entity container of this leaf sector to the output array */
     surgescript_var_t* arg = surgescript_var_create();
@@ -1078,6 +1295,7 @@ sector_t* sector_ctor(int index, int world_width, int world_height)
     sector->cached_world_width = 0;
     sector->cached_world_height = 0;
     sector->cached_rect = (sectorrect_t){ 0, 0, 0, 0 };
+    sector->dirty_list = NULL;
 
     if(!is_leaf) {
         for(int j = 0; j < 4; j++) {
@@ -1102,6 +1320,11 @@ sector_t* sector_ctor(int index, int world_width, int world_height)
 
 sector_t* sector_dtor(sector_t* sector)
 {
+    if(sector->dirty_list != NULL) {
+        darray_release(sector->dirty_list->entry);
+        free(sector->dirty_list);
+    }
+
     free(sector);
     return NULL;
 }
@@ -1165,6 +1388,79 @@ surgescript_objecthandle_t spawn_child(surgescript_object_t* parent, sectorquadr
     return child_handle;
 }
 
+surgescript_object_t* find_root(surgescript_object_t* tree_node)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(tree_node);
+
+    while(unsafe_get_sector(tree_node)->index != 0) {
+        surgescript_objecthandle_t parent_handle = surgescript_object_parent(tree_node);
+        tree_node = surgescript_objectmanager_get(manager, parent_handle);
+    }
+
+    return tree_node;
+}
+
+surgescript_object_t* locate_leaf(surgescript_object_t* tree_node, v2d_t position)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(tree_node);
+    sector_t* sector = unsafe_get_sector(tree_node);
+
+    /* move up the tree until we find a sector to which the position belongs.
+       The root encompasses the whole world, so this loop ends */
+    while(sector->index != 0 && !point_belongs_to_rect(sector->cached_rect, position.x, position.y)) {
+        surgescript_objecthandle_t parent_handle = surgescript_object_parent(tree_node);
+        tree_node = surgescript_objectmanager_get(manager, parent_handle);
+        sector = unsafe_get_sector(tree_node);
+    }
+
+    /* move down the tree, lazily allocating subsectors */
+    while(!(sector->flags & SECTOR_IS_LEAF)) {
+        surgescript_heap_t* heap = surgescript_object_heap(tree_node);
+        int j;
+
+        for(j = 0; j < 3; j++) { /* the last subsector is the remaining option */
+            if(point_belongs_to_rect(sector->child[j].cached_rect, position.x, position.y))
+                break;
+        }
+
+        surgescript_var_t* child_var = surgescript_heap_at(heap, CHILD_ADDR[j]);
+        if(surgescript_var_is_null(child_var)) {
+            surgescript_objecthandle_t child_handle = spawn_child(tree_node, j);
+            surgescript_var_set_objecthandle(child_var, child_handle);
+            sector->flags |= SECTOR_HAS_SUBSECTOR(j);
+        }
+
+        sector->flags &= ~SECTOR_IS_EMPTY; /* this subtree will be populated */
+        tree_node = surgescript_objectmanager_get(manager, surgescript_var_get_objecthandle(child_var));
+        sector = unsafe_get_sector(tree_node);
+    }
+
+    return tree_node;
+}
+
+surgescript_object_t* get_container(surgescript_object_t* leaf)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(leaf);
+    surgescript_heap_t* heap = surgescript_object_heap(leaf);
+    surgescript_var_t* container_var = surgescript_heap_at(heap, ENTITYCONTAINER_ADDR);
+    surgescript_objecthandle_t container_handle = surgescript_var_get_objecthandle(container_var);
+
+    return surgescript_objectmanager_get(manager, container_handle);
+}
+
+int dirty_entity_cmp(const void* a, const void* b)
+{
+    const dirtyentity_t* x = (const dirtyentity_t*)a;
+    const dirtyentity_t* y = (const dirtyentity_t*)b;
+
+    if(x->target_leaf != y->target_leaf)
+        return x->target_leaf < y->target_leaf ? -1 : 1;
+    else if(x->entity != y->entity)
+        return x->entity < y->entity ? -1 : 1;
+    else
+        return 0;
+}
+
 v2d_t get_clipped_position(surgescript_object_t* entity, float world_width, float world_height)
 {
     float x, y;
@@ -21,6 +21,7 @@
 #include <surgescript.h>
 #include <string.h>
 #include "scripting.h"
+#include "util/framebudget.h"
 #include "../core/logfile.h"
 #include "../core/audio.h"
 #include "../core/video.h"
@@ -39,6 +40,8 @@ static surgescript_var_t* fun_destructor(surgescript_object_t* object, const sur
 static surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_spawn(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_spawnentity(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_spawnentitylater(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_getframebudget(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_destroy(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_getwaterlevel(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_setwaterlevel(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
@@ -138,6 +141,8 @@ void scripting_register_level(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "Level", "destructor", fun_destructor, 0);
     surgescript_vm_bind(vm, "Level", "spawn", fun_spawn, 1);
     surgescript_vm_bind(vm, "Level", "spawnEntity", fun_spawnentity, 2);
+    surgescript_vm_bind(vm, "Level", "spawnEntityLater", fun_spawnentitylater, 2);
+    surgescript_vm_bind(vm, "Level", "get_frameBudget", fun_getframebudget, 0);
     surgescript_vm_bind(vm, "Level", "destroy", fun_destroy, 0);
     surgescript_vm_bind(vm, "Level", "get_name", fun_getname, 0);
     surgescript_vm_bind(vm, "Level", "get_act", fun_getact, 0);
@@ -476,6 +481,27 @@ surgescript_var_t* fun_spawnentity(surgescript_object_t* object, const surgescri
     return new_entity_var;
 }
 
+/* spawn an entity at a certain position in world coordinates if the scripts
+   are within the budget of the framestep; otherwise, spawn it later. Returns
+   the new entity, or null if the spawning was deferred */
+surgescript_var_t* fun_spawnentitylater(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_var_t* new_entity_var = surgescript_var_create();
+
+    /* delegate to entityManager.spawnEntityLater() */
+    surgescript_object_t* entity_manager = get_entity_manager(object);
+    surgescript_object_call_function(entity_manager, "spawnEntityLater", param, 2, new_entity_var);
+
+    /* done! */
+    return new_entity_var;
+}
+
+/* the time remaining in the CPU budget of the scripts in the current framestep, in seconds */
+surgescript_var_t* fun_getframebudget(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    return surgescript_var_set_number(surgescript_var_create(), framebudget_remaining());
+}
+
 /* can't destroy this object */
 surgescript_var_t* fun_destroy(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
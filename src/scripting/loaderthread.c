@@ -25,6 +25,7 @@
 #include <stdbool.h>
 #include "scripting.h"
 #include "../core/logfile.h"
+#include "../core/startuptrace.h"
 #include "../util/util.h"
 #include "../util/stringutil.h"
 
@@ -114,6 +115,7 @@ ALLEGRO_THREAD* surgescriptloaderthread_destroy(ALLEGRO_THREAD* thread)
 void* load_surgescript(ALLEGRO_THREAD* thread, void* arg)
 {
     volatile ssthreadcontext_t* ctx = (ssthreadcontext_t*)arg;
+    double start_time = startuptrace_clock();
 
     /* use the physfs file interface in this thread */
     al_set_physfs_file_interface();
@@ -136,6 +138,9 @@ void* load_surgescript(ALLEGRO_THREAD* thread, void* arg)
     surgescript_util_set_log_function(log_fn, NULL);
     surgescript_util_set_crash_function(crash_fn, NULL);
 
+    /* trace the startup */
+    startuptrace_add_background_phase("load scripts", start_time);
+
     /* done */
     return (void*)ctx;
 }
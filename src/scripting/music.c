@@ -31,6 +31,7 @@ static surgescript_var_t* fun_destructor(surgescript_object_t* object, const sur
 static surgescript_var_t* fun_play(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_stop(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_pause(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_crossfade(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_setvolume(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_getvolume(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_getplaying(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
@@ -52,6 +53,7 @@ void scripting_register_music(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "Music", "play", fun_play, 0);
     surgescript_vm_bind(vm, "Music", "stop", fun_stop, 0);
     surgescript_vm_bind(vm, "Music", "pause", fun_pause, 0);
+    surgescript_vm_bind(vm, "Music", "crossfade", fun_crossfade, 1);
     surgescript_vm_bind(vm, "Music", "set_volume", fun_setvolume, 1);
     surgescript_vm_bind(vm, "Music", "get_volume", fun_getvolume, 0);
     surgescript_vm_bind(vm, "Music", "get_playing", fun_getplaying, 0);
@@ -167,6 +169,21 @@ surgescript_var_t* fun_pause(surgescript_object_t* object, const surgescript_var
     return NULL;
 }
 
+/* plays the music (once) while the current music fades out. Pass the duration of the fade, in seconds */
+surgescript_var_t* fun_crossfade(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    music_t* music = get_music(object);
+    double seconds = surgescript_var_get_number(param[0]);
+    double volume = get_volume(object);
+
+    if(music != NULL && music_current() != music) {
+        music_crossfade(music, false, seconds);
+        music_set_volume(volume);
+    }
+
+    return NULL;
+}
+
 /* is this music playing? */
 surgescript_var_t* fun_getplaying(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
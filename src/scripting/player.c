@@ -1846,6 +1846,7 @@ void update_transform(surgescript_object_t* object, v2d_t position, float angle,
     surgescript_transform_setposition2d(transform, position.x, position.y); /* assuming local position == world position */
     surgescript_transform_setrotation2d(transform, angle); /* in degrees */
     surgescript_transform_setscale2d(transform, scale.x, scale.y);
+    scripting_transform_invalidate();
 }
 
 /* read the player transform */
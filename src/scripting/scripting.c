@@ -19,13 +19,23 @@
  */
 
 #include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <allegro5/allegro.h>
+#include <physfs.h>
 #include "scripting.h"
+#include "util/classprofiler.h"
+#include "util/framebudget.h"
 #include "../core/global.h"
 #include "../core/asset.h"
 #include "../core/video.h"
+#include "../core/startuptrace.h"
+#include "../core/jobs.h"
 #include "../util/v2d.h"
 #include "../util/util.h"
+#include "../util/darray.h"
 #include "../util/stringutil.h"
+#include "../util/hashtable.h"
 #include "../scenes/level.h"
 
 /* private area */
@@ -34,9 +44,156 @@ static char** vm_argv = NULL;
 static int vm_argc = 0;
 static bool test_mode = false;
 static int pause_counter = 0;
+
+/* cache of the components of SurgeEngine, resolved once per VM */
+#define MAX_CACHED_COMPONENTS 32
+static struct {
+    char name[32];
+    surgescript_objecthandle_t handle;
+} component_cache[MAX_CACHED_COMPONENTS];
+static int component_cache_size = 0;
+static surgescript_objecthandle_t surgeengine_handle = 0;
+static void clear_component_cache();
+static bool is_cacheable_component(const char* component_name);
+
+/*
+
+RENDER METADATA
+
+The render queue asks each renderable for its zindex, visibility, texture and so
+on every frame. Checking whether an object class implements a getter requires a
+lookup in the program pool, and calling it requires a round trip through the VM
+with temporary variables.
+
+We cache, per object class, which getters are implemented. Native renderables
+(Actor, Text, ...) store their metadata in native storage that is updated only
+when it changes, and they register accessors that read it directly. Populating
+the render queue with native renderables issues no VM calls. Scripted renderables
+that implement the getters still get called through the VM.
+
+*/
+enum {
+    HAS_ZINDEX = 1 << 0,
+    HAS_VISIBLE = 1 << 1,
+    HAS_TRANSLUCENT = 1 << 2,
+    HAS_TEXTURE = 1 << 3,
+    HAS_FILEPATH = 1 << 4
+};
+
+typedef struct renderclass_t renderclass_t;
+struct renderclass_t {
+    char* name; /* case-sensitive */
+    int capabilities; /* HAS_* flags */
+    scripting_renderable_t native; /* native accessors */
+};
+
+#define MAX_NATIVE_RENDERABLES 16
+static struct {
+    char name[32];
+    scripting_renderable_t renderable;
+} native_renderable[MAX_NATIVE_RENDERABLES];
+static int native_renderable_count = 0;
+
+/* receives the return values of the accessors; read it right after each call */
+static surgescript_var_t* tmp_ret = NULL;
+
+static renderclass_t* renderclass_create(const surgescript_object_t* object);
+static void renderclass_destroy(renderclass_t* rc);
+HASHTABLE_GENERATE_CODE(renderclass_t, renderclass_destroy);
+static HASHTABLE(renderclass_t, renderclasses);
+static renderclass_t* find_renderclass(const surgescript_object_t* object);
+static void clear_renderclass_cache();
+
+/* visibility tests, cached per frame and camera. Indexed by object handle */
+typedef struct visibility_t visibility_t;
+struct visibility_t {
+    uint32_t epoch; /* see level_visibility_epoch(); zero if unset */
+    bool is_visible;
+};
+STATIC_DARRAY(visibility_t, visibility_cache);
+static void clear_visibility_cache();
 static void compile_scripts(surgescript_vm_t* vm);
-static int compile_script(const char* filepath, void* param);
+static int list_script(const char* filepath, void* param);
+static void read_scripts(int first, int last, void* arg);
 static char* read_file(const char* filepath);
+static char* try_read_file(const char* filepath);
+
+/* script files are read in parallel by the job system and then compiled in order */
+typedef struct scriptfile_t scriptfile_t;
+struct scriptfile_t {
+    char* path; /* actual path */
+    char* virtual_path;
+    int64_t mtime; /* last modification time; -1 if unknown */
+    int64_t size; /* size of the file in bytes; -1 if unknown */
+    char* source; /* contents of the file; NULL if not read */
+};
+
+typedef struct scriptlist_t scriptlist_t;
+struct scriptlist_t {
+    DARRAY(scriptfile_t, file);
+};
+
+#define MIN_SCRIPTS_PER_READER 16 /* don't split the work for a few files */
+
+/*
+
+SCRIPT BUNDLE
+
+The state of the SurgeScript VM can't be saved: its programs and objects hold
+native pointers and SurgeScript has no means to serialize them. What we can
+skip on later launches is opening and reading the scripts one by one. Opening
+a file is expensive on some platforms (on Android, the game data is stored in
+a compressed package), and a game may have hundreds of scripts.
+
+After reading all scripts, we store their source code in a single file of the
+application cache. The bundle is keyed by the version of the engine, the
+version of SurgeScript and the paths, sizes and modification times of the
+scripts. If the key matches on a later launch, we read the sources of all
+scripts from the bundle in one go. Compilation still takes place as usual.
+
+*/
+#define BUNDLE_FILE "vm/scripts.bin" /* inside the application cache */
+#define BUNDLE_MAGIC "OSSB" /* 4 characters */
+#define BUNDLE_VERSION 1 /* increment when changing the file format */
+#define BUNDLE_MAXSIZE (64 * 1024 * 1024) /* in bytes */
+static uint64_t bundle_key(const scriptlist_t* list);
+static bool read_bundle(scriptlist_t* list, uint64_t key);
+static void write_bundle(const scriptlist_t* list, uint64_t key);
+/*
+
+INCREMENTAL RELOAD
+
+Resetting the VM and compiling all scripts again takes a while on large
+projects. We keep a record of each compiled file: its modification time, a
+hash of its source code and the names of the objects it declares. When asked
+to reload only the changed scripts, we compare the files with their records
+and discard the programs of the objects declared in the files that have
+changed or have been removed. Then we compile the changed files again. The VM
+keeps running, and so do the existing objects.
+
+An object whose programs are replaced must have no instances, because its
+instances were built with the old programs (the layout of their variables
+may differ). If there are any, we fall back to a full reload.
+
+*/
+typedef struct scriptrecord_t scriptrecord_t;
+struct scriptrecord_t {
+    char* virtual_path;
+    int64_t mtime;
+    uint64_t hash; /* hash of the source code */
+    DARRAY(char*, object); /* names of the objects declared in the file */
+    bool found; /* used while comparing */
+};
+
+STATIC_DARRAY(scriptrecord_t, script_record);
+static void add_script_record(const scriptfile_t* file);
+static void clear_script_records();
+static scriptrecord_t* find_script_record(const char* virtual_path);
+static void destroy_script_record(scriptrecord_t* record);
+static uint64_t hash_source(const char* source);
+static void list_declared_objects(const char* source, scriptrecord_t* record);
+static int count_instances(surgescript_objectmanager_t* manager, char** object_name, int count, bool include_killed);
+
 static bool found_test_script(const surgescript_vm_t* vm);
 static void check_if_compatible();
 static void parse_surgescript_options(surgescript_vm_t* vm, int argc, char** argv);
@@ -53,6 +210,8 @@ extern void scripting_register_brickparticle(surgescript_vm_t* vm);
 extern void scripting_register_camera(surgescript_vm_t* vm);
 extern void scripting_register_collisions(surgescript_vm_t* vm);
 extern void scripting_register_console(surgescript_vm_t* vm);
+extern void scripting_brickparticle_release();
+extern void scripting_collisions_release();
 extern void scripting_register_entitycontainer(surgescript_vm_t* vm);
 extern void scripting_register_entitymanager(surgescript_vm_t* vm);
 extern void scripting_register_entitytree(surgescript_vm_t* vm);
@@ -91,6 +250,7 @@ void scripting_init(int argc, const char** argv)
     /* create VM */
     check_if_compatible();
     vm = surgescript_vm_create();
+    tmp_ret = surgescript_var_create();
 
     /* copy command line arguments */
     vm_argv = mallocx((vm_argc = argc) * sizeof(*vm_argv));
@@ -105,6 +265,10 @@ void scripting_init(int argc, const char** argv)
 
     /* compile scripts */
     compile_scripts(vm);
+
+    /* measure the CPU time of the object classes */
+    classprofiler_init();
+    framebudget_init();
 }
 
 /*
@@ -129,6 +293,16 @@ void scripting_release()
 
     /* destroy VM */
     vm = surgescript_vm_destroy(vm);
+    clear_script_records();
+    surgescript_var_destroy(tmp_ret);
+    tmp_ret = NULL;
+    scripting_collisions_release();
+    scripting_brickparticle_release();
+    clear_component_cache();
+    clear_renderclass_cache();
+    clear_visibility_cache();
+    framebudget_release();
+    classprofiler_release();
 }
 
 /*
@@ -171,6 +345,9 @@ void scripting_reload()
     surgescript_util_log("Reloading scripts...");
 
     /* reset the SurgeScript VM */
+    clear_component_cache();
+    clear_renderclass_cache();
+    scripting_transform_invalidate();
     if(!surgescript_vm_reset(vm)) {
         surgescript_util_log("Failed to reload the scripts");
         return;
@@ -192,6 +369,132 @@ void scripting_reload()
     surgescript_util_log("The scripts have been reloaded!");
 }
 
+/*
+ * scripting_reload_changed()
+ * Compiles again only the scripts that have changed since they were
+ * compiled, keeping the VM and the existing objects. Falls back to
+ * scripting_reload() if the changed objects have instances
+ */
+void scripting_reload_changed()
+{
+    surgescript_programpool_t* pool = surgescript_vm_programpool(vm);
+    surgescript_objectmanager_t* manager = surgescript_vm_objectmanager(vm);
+    DARRAY(char*, stale_object); /* declared in files that have changed or have been removed */
+    scriptlist_t list;
+    int changed_count = 0, removed_count = 0;
+    bool want_full_reload = false;
+
+    surgescript_util_log("Reloading the changed scripts...");
+
+    /* list scripts, including the new ones */
+    asset_invalidate_index();
+    darray_init(list.file);
+    asset_foreach_file("scripts", ".ss", list_script, &list, true);
+    darray_init(stale_object);
+
+    /* compare the files with their records */
+    for(size_t i = 0; i < darray_length(script_record); i++)
+        script_record[i].found = false;
+
+    for(size_t i = 0; i < darray_length(list.file); i++) {
+        scriptfile_t* file = &list.file[i];
+        scriptrecord_t* record = find_script_record(file->virtual_path);
+
+        /* unchanged file */
+        if(record != NULL && record->mtime == file->mtime && file->mtime >= 0) {
+            record->found = true;
+            continue;
+        }
+
+        /* read the file. It may have been touched without being modified */
+        if(NULL == (file->source = read_file(file->path)))
+            continue;
+
+        if(record != NULL) {
+            record->found = true;
+            if(record->hash == hash_source(file->source)) {
+                record->mtime = file->mtime;
+                free(file->source);
+                file->source = NULL;
+                continue;
+            }
+
+            for(size_t j = 0; j < darray_length(record->object); j++)
+                darray_push(stale_object, record->object[j]);
+        }
+
+        changed_count++;
+    }
+
+    for(size_t i = 0; i < darray_length(script_record); i++) {
+        if(!script_record[i].found) {
+            for(size_t j = 0; j < darray_length(script_record[i].object); j++)
+                darray_push(stale_object, script_record[i].object[j]);
+            removed_count++;
+        }
+    }
+
+    /* killed instances are destroyed in the next update of the VM */
+    if(count_instances(manager, stale_object, darray_length(stale_object), true) > 0)
+        surgescript_vm_update(vm);
+
+    /* nothing to do */
+    if(changed_count == 0 && removed_count == 0) {
+        surgescript_util_log("No scripts have changed");
+    }
+
+    /* the programs of the changed objects can't be replaced */
+    else if(count_instances(manager, stale_object, darray_length(stale_object), false) > 0) {
+        surgescript_util_log("The changed objects have instances");
+        want_full_reload = true;
+    }
+
+    /* replace the programs of the changed objects */
+    else {
+        clear_renderclass_cache();
+
+        for(size_t i = 0; i < darray_length(stale_object); i++)
+            surgescript_programpool_purge(pool, stale_object[i]);
+
+        for(int i = (int)darray_length(script_record) - 1; i >= 0; i--) {
+            if(!script_record[i].found) {
+                destroy_script_record(&script_record[i]);
+                darray_remove(script_record, i);
+            }
+        }
+
+        for(size_t i = 0; i < darray_length(list.file); i++) {
+            scriptfile_t* file = &list.file[i];
+            if(file->source == NULL)
+                continue;
+
+            scriptrecord_t* record = find_script_record(file->virtual_path);
+            if(record != NULL) {
+                destroy_script_record(record);
+                darray_remove(script_record, record - script_record);
+            }
+
+            surgescript_vm_compile_virtual_file(vm, file->source, file->path);
+            add_script_record(file);
+        }
+
+        surgescript_util_log("Reloaded %d changed scripts. %d scripts have been removed", changed_count, removed_count);
+    }
+
+    /* release the list */
+    darray_release(stale_object);
+    for(size_t i = 0; i < darray_length(list.file); i++) {
+        free(list.file[i].source);
+        free(list.file[i].virtual_path);
+        free(list.file[i].path);
+    }
+    darray_release(list.file);
+
+    /* fall back to a full reload */
+    if(want_full_reload)
+        scripting_reload();
+}
+
 /*
  * scripting_pause_vm()
  * Pause the SurgeScript VM
@@ -240,33 +543,55 @@ surgescript_objecthandle_t scripting_util_require_component(const surgescript_ob
 v2d_t scripting_util_world_position(const surgescript_object_t* object)
 {
     v2d_t position;
-    surgescript_transform_util_worldposition2d(object, &position.x, &position.y);
+    scripting_transform_world_position(object, &position.x, &position.y);
     return position;
 }
 
 /* compute the world angle of an object */
 float scripting_util_world_angle(const surgescript_object_t* object)
 {
-    return surgescript_transform_util_worldangle2d(object);
+    return scripting_transform_world_angle(object);
 }
 
 /* set the world position of an object (teleport) */
 void scripting_util_set_world_position(surgescript_object_t* object, v2d_t position)
 {
     surgescript_transform_util_setworldposition2d(object, position.x, position.y);
+    scripting_transform_invalidate();
 }
 
 /* set the world angle of an object (in degrees) */
 void scripting_util_set_world_angle(surgescript_object_t* object, float angle)
 {
     surgescript_transform_util_setworldangle2d(object, angle);
+    scripting_transform_invalidate();
 }
 
-/* checks if the object is inside the visible part of the screen */
+/* checks if the object is inside the visible part of the screen. Objects
+   with multiple colliders are tested many times in a frame, so we test
+   each object once per frame and camera and reuse the result */
 bool scripting_util_is_object_inside_screen(const surgescript_object_t* object)
 {
+    surgescript_objecthandle_t handle = surgescript_object_handle(object);
+    uint32_t epoch = level_visibility_epoch();
+
+    /* grow the cache */
+    if(visibility_cache == NULL)
+        darray_init(visibility_cache);
+    while(darray_length(visibility_cache) <= handle)
+        darray_push(visibility_cache, ((visibility_t){ .epoch = 0, .is_visible = false }));
+
+    /* cache hit */
+    visibility_t* entry = &visibility_cache[handle];
+    if(entry->epoch == epoch)
+        return entry->is_visible;
+
+    /* cache miss */
     v2d_t v = scripting_util_world_position(object);
-    return level_inside_screen(v.x, v.y, 0, 0);
+    entry->is_visible = level_inside_screen(v.x, v.y, 0, 0);
+    entry->epoch = epoch;
+
+    return entry->is_visible;
 }
 
 /* checks if an object is an effectively detached entity */
@@ -286,15 +611,28 @@ bool scripting_util_is_effectively_detached_entity(const surgescript_object_t* o
     const surgescript_objectmanager_t* manager = surgescript_object_manager(object);
     surgescript_objecthandle_t root = surgescript_objectmanager_root(manager);
     surgescript_objecthandle_t handle;
+    surgescript_object_t* parent;
 
     do {
         if(!surgescript_object_has_tag(object, "entity"))
             return false;
-        else if(surgescript_object_has_tag(object, "detached"))
-            return true;
 
         handle = surgescript_object_parent(object);
-    } while(handle != root && (object = surgescript_objectmanager_get(manager, handle)));
+        parent = surgescript_objectmanager_get(manager, handle);
+
+        /* the flag of the entities of the Level is memoized by the EntityManager,
+           so we don't need to walk up the tree */
+        if(handle != root && 0 == strcmp(surgescript_object_name(parent), "Level")) {
+            surgescript_object_t* entity_manager = scripting_level_entitymanager(parent);
+            bool is_detached = false;
+
+            if(entitymanager_is_entity_effectively_detached(entity_manager, surgescript_object_handle(object), &is_detached))
+                return is_detached;
+        }
+
+        if(surgescript_object_has_tag(object, "detached"))
+            return true;
+    } while(handle != root && (object = parent));
 
     return false;
 }
@@ -302,21 +640,119 @@ bool scripting_util_is_effectively_detached_entity(const surgescript_object_t* o
 /* get the zindex of an object */
 float scripting_util_object_zindex(surgescript_object_t* object)
 {
-    surgescript_objectmanager_t* manager = surgescript_object_manager(object);
-    surgescript_programpool_t* pool = surgescript_objectmanager_programpool(manager);
-    const char* object_name = surgescript_object_name(object);
+    const renderclass_t* rc = find_renderclass(object);
     float zindex = 0.5f;
 
-    if(surgescript_programpool_exists(pool, object_name, "get_zindex")) {
-        surgescript_var_t* tmp = surgescript_var_create();
+    if(rc->native.zindex != NULL)
+        return rc->native.zindex(object);
+
+    if(rc->capabilities & HAS_ZINDEX) {
+        surgescript_var_t* tmp = tmp_ret; /* reused */
         surgescript_object_call_function(object, "get_zindex", NULL, 0, tmp);
         zindex = surgescript_var_get_number(tmp);
-        surgescript_var_destroy(tmp);
     }
 
     return zindex;
 }
 
+/* is a renderable object visible? */
+bool scripting_util_object_is_visible(surgescript_object_t* object)
+{
+    const renderclass_t* rc = find_renderclass(object);
+    bool is_visible = true;
+
+    if(rc->native.is_visible != NULL)
+        return rc->native.is_visible(object);
+
+    if(rc->capabilities & HAS_VISIBLE) {
+        surgescript_var_t* tmp = tmp_ret; /* reused */
+        surgescript_object_call_function(object, "get_visible", NULL, 0, tmp);
+        is_visible = surgescript_var_get_bool(tmp);
+    }
+
+    return is_visible;
+}
+
+/* is a renderable object translucent? */
+bool scripting_util_object_is_translucent(surgescript_object_t* object)
+{
+    const renderclass_t* rc = find_renderclass(object);
+    bool is_translucent = false;
+
+    if(rc->native.is_translucent != NULL)
+        return rc->native.is_translucent(object);
+
+    if(rc->capabilities & HAS_TRANSLUCENT) {
+        surgescript_var_t* tmp = tmp_ret; /* reused */
+        surgescript_object_call_function(object, "get___isTranslucent", NULL, 0, tmp);
+        is_translucent = surgescript_var_get_bool(tmp);
+    }
+
+    return is_translucent;
+}
+
+/* the texture of a renderable object. Returns false if there is no texture */
+bool scripting_util_object_texture(surgescript_object_t* object, texturehandle_t* texture)
+{
+    const renderclass_t* rc = find_renderclass(object);
+    bool has_texture = false;
+
+    if(rc->native.texture != NULL)
+        return rc->native.texture(object, texture);
+
+    if(rc->capabilities & HAS_TEXTURE) {
+        surgescript_var_t* tmp = tmp_ret; /* reused */
+        surgescript_object_call_function(object, "get___textureHandle", NULL, 0, tmp);
+        if(!surgescript_var_is_null(tmp)) { /* is there a texture handle? */
+            *texture = surgescript_var_get_rawbits(tmp);
+            has_texture = true;
+        }
+    }
+
+    return has_texture;
+}
+
+/* the filepath of a renderable object. Returns NULL if there is no filepath */
+const char* scripting_util_object_filepath(surgescript_object_t* object, char* dest, size_t dest_size)
+{
+    const renderclass_t* rc = find_renderclass(object);
+
+    if(rc->native.filepath != NULL)
+        return str_cpy(dest, rc->native.filepath(object), dest_size);
+
+    if(rc->capabilities & HAS_FILEPATH) {
+        surgescript_var_t* tmp = tmp_ret; /* reused */
+        surgescript_object_call_function(object, "get___filepathOfRenderable", NULL, 0, tmp);
+        str_cpy(dest, surgescript_var_fast_get_string(tmp), dest_size);
+        surgescript_var_set_null(tmp); /* release the string */
+        return dest;
+    }
+
+    return NULL;
+}
+
+/* register the accessors of the render metadata of a native object */
+void scripting_util_register_renderable(const char* object_name, const scripting_renderable_t* renderable)
+{
+    int i;
+
+    /* the builtins are registered again when the VM is reset */
+    for(i = 0; i < native_renderable_count; i++) {
+        if(0 == strcmp(native_renderable[i].name, object_name))
+            break;
+    }
+
+    if(i == native_renderable_count) {
+        if(native_renderable_count >= MAX_NATIVE_RENDERABLES)
+            fatal_error("Can't register more than %d native renderables", MAX_NATIVE_RENDERABLES);
+        str_cpy(native_renderable[i].name, object_name, sizeof(native_renderable[i].name));
+        native_renderable_count++;
+    }
+
+    native_renderable[i].renderable = *renderable;
+    clear_renderclass_cache();
+}
+
 /* the name of the parent object */
 const char* scripting_util_parent_name(const surgescript_object_t* object)
 {
@@ -330,18 +766,43 @@ const char* scripting_util_parent_name(const surgescript_object_t* object)
 surgescript_object_t* scripting_util_surgeengine_object(surgescript_vm_t* vm)
 {
     surgescript_objectmanager_t* manager = surgescript_vm_objectmanager(vm);
-    static surgescript_objecthandle_t cached_ref = 0;
-    
-    if(!cached_ref)
-        cached_ref = surgescript_objectmanager_plugin_object(manager, "SurgeEngine");
 
-    return surgescript_objectmanager_get(manager, cached_ref);
+    if(!surgeengine_handle)
+        surgeengine_handle = surgescript_objectmanager_plugin_object(manager, "SurgeEngine");
+
+    return surgescript_objectmanager_get(manager, surgeengine_handle);
 }
 
 /* get a component of the SurgeEngine object */
 surgescript_object_t* scripting_util_surgeengine_component(surgescript_vm_t* vm, const char* component_name)
 {
-    return scripting_util_get_component(scripting_util_surgeengine_object(vm), component_name);
+    surgescript_objectmanager_t* manager = surgescript_vm_objectmanager(vm);
+    surgescript_object_t* component;
+
+    /* look for the component in the cache */
+    for(int i = 0; i < component_cache_size; i++) {
+        if(0 == strcmp(component_cache[i].name, component_name)) {
+            if(surgescript_objectmanager_exists(manager, component_cache[i].handle))
+                return surgescript_objectmanager_get(manager, component_cache[i].handle);
+
+            /* the cached component no longer exists */
+            component_cache[i] = component_cache[--component_cache_size];
+            break;
+        }
+    }
+
+    /* resolve the component */
+    component = scripting_util_get_component(scripting_util_surgeengine_object(vm), component_name);
+
+    /* cache it */
+    if(component_cache_size < MAX_CACHED_COMPONENTS && is_cacheable_component(component_name)) {
+        str_cpy(component_cache[component_cache_size].name, component_name, sizeof(component_cache[0].name));
+        component_cache[component_cache_size].handle = surgescript_object_handle(component);
+        component_cache_size++;
+    }
+
+    /* done */
+    return component;
 }
 
 /* get a component of an object (returns object.get_component()) */
@@ -349,13 +810,12 @@ surgescript_object_t* scripting_util_get_component(surgescript_object_t* object,
 {
     surgescript_objectmanager_t* manager = surgescript_object_manager(object);
     char* accessor_fun = surgescript_util_accessorfun("get", component_name);
-    surgescript_var_t* ret = surgescript_var_create();
+    surgescript_var_t* ret = tmp_ret; /* reused */
     surgescript_objecthandle_t handle = 0;
 
     surgescript_object_call_function(object, accessor_fun, NULL, 0, ret);
     handle = surgescript_var_get_objecthandle(ret);
 
-    surgescript_var_destroy(ret);
     ssfree(accessor_fun);
     return surgescript_objectmanager_get(manager, handle);
 }
@@ -457,8 +917,58 @@ void setup_surgeengine(surgescript_vm_t* vm)
 /* compiles all .ss scripts from the scripts/ folder */
 void compile_scripts(surgescript_vm_t* vm)
 {
-    /* compile scripts */
-    asset_foreach_file("scripts", ".ss", compile_script, NULL, true);
+    scriptlist_t list;
+
+    /* list scripts */
+    darray_init(list.file);
+    asset_foreach_file("scripts", ".ss", list_script, &list, true);
+    clear_script_records();
+
+    /* read the scripts from the bundle, if it's up to date */
+    int num_files = darray_length(list.file);
+    uint64_t key = bundle_key(&list);
+    bool is_bundled = read_bundle(&list, key);
+
+    /* read scripts in parallel. Reading is independent for each file,
+       but compiling is not: the SurgeScript VM is not thread-safe */
+    if(!is_bundled)
+        jobs_parallel_for(num_files, MIN_SCRIPTS_PER_READER, read_scripts, &list);
+
+    /* if all scripts have been read, update the bundle */
+    if(!is_bundled) {
+        int num_read = 0;
+        for(int i = 0; i < num_files; i++)
+            num_read += (list.file[i].source != NULL || (list.file[i].source = try_read_file(list.file[i].path)) != NULL);
+
+        if(num_read == num_files && num_files > 0)
+            write_bundle(&list, key);
+    }
+
+    /* compile scripts in a deterministic order */
+    for(int i = 0; i < num_files; i++) {
+        scriptfile_t* file = &list.file[i];
+
+        /* read the script if it hasn't been read yet
+           (this will show an error message on failure) */
+        if(file->source == NULL)
+            file->source = read_file(file->path);
+
+        /* compile script */
+        if(file->source != NULL) {
+            double start_time = startuptrace_clock();
+            surgescript_vm_compile_virtual_file(vm, file->source, file->path);
+            startuptrace_add_asset("script", file->path, start_time);
+            add_script_record(file);
+        }
+    }
+
+    /* release the list */
+    for(int i = 0; i < num_files; i++) {
+        free(list.file[i].source);
+        free(list.file[i].virtual_path);
+        free(list.file[i].path);
+    }
+    darray_release(list.file);
 
     /* if no test script is present... */
     if(found_test_script(vm)) {
@@ -471,22 +981,339 @@ void compile_scripts(surgescript_vm_t* vm)
     }
 }
 
-/* compile a .ss script from the scripts/ folder */
-int compile_script(const char* filepath, void* param)
+/* add a .ss script from the scripts/ folder to a list */
+int list_script(const char* filepath, void* param)
 {
-    const char* fullpath = asset_path(filepath);
+    scriptlist_t* list = (scriptlist_t*)param;
+    const char* fullpath = asset_path(filepath); /* not thread-safe */
+    PHYSFS_Stat stat;
+
+    scriptfile_t file = {
+        .path = str_dup(fullpath),
+        .virtual_path = str_dup(filepath),
+        .mtime = -1,
+        .size = -1,
+        .source = NULL
+    };
+
+    if(PHYSFS_stat(filepath, &stat)) {
+        file.mtime = stat.modtime;
+        file.size = stat.filesize;
+    }
 
-    /* read script */
-    char* script = read_file(fullpath);
-    if(script == NULL)
-        return -1;
+    darray_push(list->file, file);
 
-    /* compile script */
-    bool success = surgescript_vm_compile_virtual_file(vm, script, fullpath);
+    return 0;
+}
+
+/* reads the scripts [first, last) of a list in a job */
+void read_scripts(int first, int last, void* arg)
+{
+    scriptlist_t* list = (scriptlist_t*)arg;
 
-    /* done! */
-    free(script);
-    return success ? 0 : -1;
+    /* each reader writes to its own entries of the list */
+    for(int i = first; i < last; i++)
+        list->file[i].source = try_read_file(list->file[i].path);
+}
+
+/* the key of the script bundle: it changes whenever the scripts change */
+uint64_t bundle_key(const scriptlist_t* list)
+{
+    uint64_t hash = UINT64_C(14695981039346656037);
+    int num_files = darray_length(list->file);
+
+    #define HASH_BYTES(data, size) do { \
+        const uint8_t* b = (const uint8_t*)(data); \
+        for(size_t k = 0; k < (size_t)(size); k++) \
+            hash = (hash ^ b[k]) * UINT64_C(1099511628211); \
+    } while(0)
+
+    HASH_BYTES(GAME_VERSION_STRING, strlen(GAME_VERSION_STRING) + 1);
+    HASH_BYTES(surgescript_util_version(), strlen(surgescript_util_version()) + 1);
+    HASH_BYTES(&num_files, sizeof(num_files));
+
+    for(int i = 0; i < num_files; i++) {
+        const scriptfile_t* file = &list->file[i];
+        HASH_BYTES(file->virtual_path, strlen(file->virtual_path) + 1);
+        HASH_BYTES(&file->mtime, sizeof(file->mtime));
+        HASH_BYTES(&file->size, sizeof(file->size));
+    }
+
+    #undef HASH_BYTES
+
+    return hash;
+}
+
+/* reads the sources of the scripts from the bundle. Returns false if it's missing or outdated */
+bool read_bundle(scriptlist_t* list, uint64_t key)
+{
+    char filepath[1024];
+    char magic[4];
+    uint32_t version = 0, file_count = 0;
+    uint64_t stored_key = 0, total_size = 0;
+    int num_files = darray_length(list->file);
+    bool success = false;
+    FILE* fp;
+
+    if(num_files == 0)
+        return false;
+    else if(*asset_cache_path(BUNDLE_FILE, filepath, sizeof(filepath)) == '\0')
+        return false;
+    else if(NULL == (fp = fopen_utf8(filepath, "rb")))
+        return false;
+
+    /* read the header. An outdated bundle is not an error */
+    bool is_valid = (
+        fread(magic, sizeof(magic), 1, fp) == 1 && memcmp(magic, BUNDLE_MAGIC, sizeof(magic)) == 0 &&
+        fread(&version, sizeof(version), 1, fp) == 1 && version == BUNDLE_VERSION
+    );
+    bool is_current = is_valid && (
+        fread(&stored_key, sizeof(stored_key), 1, fp) == 1 && stored_key == key &&
+        fread(&file_count, sizeof(file_count), 1, fp) == 1 && file_count == (uint32_t)num_files
+    );
+
+    /* read the sources in the order of the list */
+    if(is_current) {
+        success = true;
+
+        for(int i = 0; i < num_files && success; i++) {
+            scriptfile_t* file = &list->file[i];
+            uint64_t size = 0;
+
+            success = (
+                fread(&size, sizeof(size), 1, fp) == 1 &&
+                (int64_t)size == file->size &&
+                (total_size += size) <= BUNDLE_MAXSIZE
+            );
+
+            if(success) {
+                file->source = mallocx((size + 1) * sizeof(char));
+                success = (fread(file->source, 1, size, fp) == size);
+                file->source[size] = '\0';
+            }
+        }
+    }
+
+    fclose(fp);
+
+    /* discard invalid or outdated bundles */
+    if(!success) {
+        for(int i = 0; i < num_files; i++) {
+            free(list->file[i].source);
+            list->file[i].source = NULL;
+        }
+
+        if(is_valid && !is_current)
+            surgescript_util_log("The script bundle is outdated");
+        else
+            surgescript_util_log("Discarding an invalid script bundle: %s", filepath);
+
+        al_remove_filename(filepath);
+    }
+
+    return success;
+}
+
+/* stores the sources of the scripts in the bundle */
+void write_bundle(const scriptlist_t* list, uint64_t key)
+{
+    char filepath[1024];
+    uint32_t version = BUNDLE_VERSION;
+    uint32_t file_count = darray_length(list->file);
+    uint64_t total_size = 0;
+    FILE* fp;
+
+    for(uint32_t i = 0; i < file_count; i++)
+        total_size += strlen(list->file[i].source);
+
+    if(total_size > BUNDLE_MAXSIZE)
+        return;
+    else if(*asset_cache_path(BUNDLE_FILE, filepath, sizeof(filepath)) == '\0')
+        return;
+    else if(NULL == (fp = fopen_utf8(filepath, "wb")))
+        return;
+
+    /* write the header */
+    bool success =
+        fwrite(BUNDLE_MAGIC, 4, 1, fp) == 1 &&
+        fwrite(&version, sizeof(version), 1, fp) == 1 &&
+        fwrite(&key, sizeof(key), 1, fp) == 1 &&
+        fwrite(&file_count, sizeof(file_count), 1, fp) == 1;
+
+    /* write the sources. A source with a size that differs from the
+       size of its file (e.g., with a NUL character) outdates the bundle */
+    for(uint32_t i = 0; i < file_count && success; i++) {
+        const char* source = list->file[i].source;
+        uint64_t size = strlen(source);
+
+        success =
+            fwrite(&size, sizeof(size), 1, fp) == 1 &&
+            fwrite(source, 1, size, fp) == size;
+    }
+
+    fclose(fp);
+
+    /* don't keep partial files */
+    if(!success) {
+        surgescript_util_log("Can't write the script bundle %s", filepath);
+        al_remove_filename(filepath);
+    }
+}
+
+/* records a file that has just been compiled */
+void add_script_record(const scriptfile_t* file)
+{
+    scriptrecord_t record = {
+        .virtual_path = str_dup(file->virtual_path),
+        .mtime = file->mtime,
+        .hash = hash_source(file->source),
+        .found = true
+    };
+
+    if(script_record == NULL)
+        darray_init(script_record);
+
+    darray_init(record.object);
+    list_declared_objects(file->source, &record);
+    darray_push(script_record, record);
+}
+
+/* forgets the compiled files */
+void clear_script_records()
+{
+    if(script_record == NULL)
+        return;
+
+    for(size_t i = 0; i < darray_length(script_record); i++)
+        destroy_script_record(&script_record[i]);
+
+    darray_release(script_record);
+}
+
+/* finds the record of a compiled file */
+scriptrecord_t* find_script_record(const char* virtual_path)
+{
+    for(size_t i = 0; i < darray_length(script_record); i++) {
+        if(0 == strcmp(script_record[i].virtual_path, virtual_path))
+            return &script_record[i];
+    }
+
+    return NULL;
+}
+
+/* releases the contents of a record */
+void destroy_script_record(scriptrecord_t* record)
+{
+    for(size_t i = 0; i < darray_length(record->object); i++)
+        free(record->object[i]);
+
+    darray_release(record->object);
+    free(record->virtual_path);
+}
+
+/* FNV-1a hash of the source code of a script */
+uint64_t hash_source(const char* source)
+{
+    uint64_t hash = UINT64_C(14695981039346656037);
+
+    while(*source)
+        hash = (hash ^ (uint8_t)(*source++)) * UINT64_C(1099511628211);
+
+    return hash;
+}
+
+/* finds the names of the objects declared in the source code of a script,
+   i.e., object "Name" at the top level, skipping comments and strings */
+void list_declared_objects(const char* source, scriptrecord_t* record)
+{
+    const char* p = source;
+    int depth = 0;
+
+    while(*p) {
+        /* skip comments */
+        if(p[0] == '/' && p[1] == '/') {
+            while(*p && *p != '\n')
+                p++;
+            continue;
+        }
+        else if(p[0] == '/' && p[1] == '*') {
+            for(p += 2; *p && !(p[0] == '*' && p[1] == '/'); p++);
+            p += (*p != '\0') ? 2 : 0;
+            continue;
+        }
+
+        /* skip strings */
+        if(*p == '"' || *p == '\'') {
+            char quote = *p++;
+            for(; *p && *p != quote; p++)
+                p += (p[0] == '\\' && p[1] != '\0');
+            p += (*p != '\0');
+            continue;
+        }
+
+        /* object "Name" at the top level */
+        if(depth == 0 && 0 == strncmp(p, "object", 6) && (p == source || !(isalnum((unsigned char)p[-1]) || p[-1] == '_'))) {
+            const char* q = p + 6;
+            while(isspace((unsigned char)*q))
+                q++;
+
+            if(*q == '"' && q > p + 6) {
+                const char* end = strchr(++q, '"');
+                if(end != NULL) {
+                    char* name = mallocx(end - q + 1);
+                    memcpy(name, q, end - q);
+                    name[end - q] = '\0';
+                    darray_push(record->object, name);
+                    p = end + 1;
+                    continue;
+                }
+            }
+        }
+
+        /* braces */
+        if(*p == '{')
+            depth++;
+        else if(*p == '}' && depth > 0)
+            depth--;
+
+        p++;
+    }
+}
+
+/* counts the instances of the given objects, traversing the object tree */
+int count_instances(surgescript_objectmanager_t* manager, char** object_name, int count, bool include_killed)
+{
+    DARRAY(surgescript_objecthandle_t, stack);
+    int instances = 0;
+
+    if(count == 0)
+        return 0;
+
+    darray_init(stack);
+    darray_push(stack, surgescript_objectmanager_root(manager));
+
+    while(darray_length(stack) > 0) {
+        surgescript_objecthandle_t handle = 0;
+        darray_pop(stack, handle);
+
+        surgescript_object_t* object = surgescript_objectmanager_get(manager, handle);
+        if(include_killed || !surgescript_object_is_killed(object)) {
+            const char* name = surgescript_object_name(object);
+            for(int i = 0; i < count; i++) {
+                if(0 == strcmp(name, object_name[i])) {
+                    instances++;
+                    break;
+                }
+            }
+        }
+
+        int child_count = surgescript_object_child_count(object);
+        for(int i = child_count - 1; i >= 0; i--)
+            darray_push(stack, surgescript_object_nth_child(object, i));
+    }
+
+    darray_release(stack);
+    return instances;
 }
 
 /* do we have a test script? (that is, did the user write his/her own "Application" object?) */
@@ -496,6 +1323,115 @@ bool found_test_script(const surgescript_vm_t* vm)
     return surgescript_programpool_exists(pool, "Application", "state:main");
 }
 
+/* invalidate the cached components of SurgeEngine */
+void clear_component_cache()
+{
+    component_cache_size = 0;
+    surgeengine_handle = 0;
+}
+
+/* find the cached render metadata of the class of an object */
+renderclass_t* find_renderclass(const surgescript_object_t* object)
+{
+    static renderclass_t* scratch = NULL;
+    const char* object_name = surgescript_object_name(object);
+    renderclass_t* rc;
+
+    if(renderclasses == NULL)
+        renderclasses = hashtable_renderclass_t_create();
+
+    /* cached class */
+    if(NULL != (rc = hashtable_renderclass_t_find(renderclasses, object_name))) {
+        if(0 == strcmp(rc->name, object_name))
+            return rc;
+
+        /* the keys of the hash table are case-insensitive; this is rare */
+        if(scratch == NULL || 0 != strcmp(scratch->name, object_name)) {
+            if(scratch != NULL)
+                renderclass_destroy(scratch);
+            scratch = renderclass_create(object);
+        }
+
+        return scratch;
+    }
+
+    /* new class */
+    rc = renderclass_create(object);
+    hashtable_renderclass_t_add(renderclasses, object_name, rc);
+    return rc;
+}
+
+/* forget the cached render metadata */
+void clear_renderclass_cache()
+{
+    if(renderclasses != NULL)
+        renderclasses = hashtable_renderclass_t_destroy(renderclasses);
+}
+
+/* clear the cached visibility tests */
+void clear_visibility_cache()
+{
+    if(visibility_cache != NULL)
+        darray_release(visibility_cache);
+}
+
+/* inspect the class of an object */
+renderclass_t* renderclass_create(const surgescript_object_t* object)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(object);
+    surgescript_programpool_t* pool = surgescript_objectmanager_programpool(manager);
+    const char* object_name = surgescript_object_name(object);
+    renderclass_t* rc = mallocx(sizeof *rc);
+
+    rc->name = str_dup(object_name);
+    rc->capabilities = 0;
+    rc->native = (scripting_renderable_t){ NULL };
+
+    /* which getters are implemented? */
+    if(surgescript_programpool_exists(pool, object_name, "get_zindex"))
+        rc->capabilities |= HAS_ZINDEX;
+    if(surgescript_programpool_exists(pool, object_name, "get_visible"))
+        rc->capabilities |= HAS_VISIBLE;
+    if(surgescript_programpool_exists(pool, object_name, "get___isTranslucent"))
+        rc->capabilities |= HAS_TRANSLUCENT;
+    if(surgescript_programpool_exists(pool, object_name, "get___textureHandle"))
+        rc->capabilities |= HAS_TEXTURE;
+    if(surgescript_programpool_exists(pool, object_name, "get___filepathOfRenderable"))
+        rc->capabilities |= HAS_FILEPATH;
+
+    /* native accessors */
+    for(int i = 0; i < native_renderable_count; i++) {
+        if(0 == strcmp(native_renderable[i].name, object_name)) {
+            rc->native = native_renderable[i].renderable;
+            break;
+        }
+    }
+
+    return rc;
+}
+
+/* destroy the cached render metadata of a class */
+void renderclass_destroy(renderclass_t* rc)
+{
+    free(rc->name);
+    free(rc);
+}
+
+/* can we cache a component of SurgeEngine? Only the ones that don't change
+   during the lifetime of the VM (i.e., readonly properties) can be cached */
+bool is_cacheable_component(const char* component_name)
+{
+    /* these are computed; e.g., the Level changes when we load a new level */
+    static const char* DYNAMIC_COMPONENTS[] = { "Level", "Player" };
+
+    for(int i = 0; i < sizeof(DYNAMIC_COMPONENTS) / sizeof(DYNAMIC_COMPONENTS[0]); i++) {
+        if(0 == strcmp(component_name, DYNAMIC_COMPONENTS[i]))
+            return false;
+    }
+
+    return strlen(component_name) < sizeof(component_cache[0].name);
+}
+
 /* reads a file using Allegro's File I/O interface */
 char* read_file(const char* filepath)
 {
@@ -512,18 +1448,50 @@ char* read_file(const char* filepath)
 
     /* read file to data[] */
     surgescript_util_log("Reading script %s...", filepath);
-    do {
-        data_size += BUFSIZE;
-        data = reallocx(data, data_size + 1);
-        read_chars += al_fread(fp, data + read_chars, BUFSIZE);
+    int64_t file_size = al_fsize(fp);
+    if(file_size >= 0) {
+        /* we know the size of the file; read it at once */
+        data = mallocx(file_size + 1);
+        read_chars = al_fread(fp, data, file_size);
         data[read_chars] = '\0';
-    } while(read_chars == data_size);
+    }
+    else {
+        /* the size of the file is unknown; read it in chunks */
+        do {
+            data_size += BUFSIZE;
+            data = reallocx(data, data_size + 1);
+            read_chars += al_fread(fp, data + read_chars, BUFSIZE);
+            data[read_chars] = '\0';
+        } while(read_chars == data_size);
+    }
     al_fclose(fp);
 
     /* success! */
     return data;
 }
 
+/* reads a file using Allegro's File I/O interface. Returns NULL on error,
+   without calling the SurgeScript crash function (safe in reader threads) */
+char* try_read_file(const char* filepath)
+{
+    ALLEGRO_FILE* fp = al_fopen(filepath, "rb");
+    if(fp == NULL)
+        return NULL;
+
+    int64_t file_size = al_fsize(fp);
+    if(file_size < 0) {
+        al_fclose(fp);
+        return NULL;
+    }
+
+    char* data = mallocx(file_size + 1);
+    size_t read_chars = al_fread(fp, data, file_size);
+    data[read_chars] = '\0';
+    al_fclose(fp);
+
+    return data;
+}
+
 /* parse special command-line options that affect the SurgeScript runtime */
 void parse_surgescript_options(surgescript_vm_t* vm, int argc, char** argv)
 {
@@ -24,12 +24,14 @@
 #include <surgescript.h>
 #include "util/iterators.h"
 #include "../util/v2d.h"
+#include "../core/image.h"
 #include "../entities/brick.h"
 
 /* scripting API */
 void scripting_init(int argc, const char** argv);
 void scripting_release();
 void scripting_reload();
+void scripting_reload_changed(); /* compiles again only the scripts that have changed */
 
 surgescript_vm_t* surgescript_vm(); /* SurgeScript VM instance */
 void scripting_launch_vm();
@@ -47,6 +49,10 @@ void scripting_util_set_world_angle(surgescript_object_t* object, float angle);
 bool scripting_util_is_object_inside_screen(const surgescript_object_t* object);
 bool scripting_util_is_effectively_detached_entity(const surgescript_object_t* object);
 float scripting_util_object_zindex(surgescript_object_t* object);
+bool scripting_util_object_is_visible(surgescript_object_t* object);
+bool scripting_util_object_is_translucent(surgescript_object_t* object);
+bool scripting_util_object_texture(surgescript_object_t* object, texturehandle_t* texture); /* returns false if there is no texture */
+const char* scripting_util_object_filepath(surgescript_object_t* object, char* dest, size_t dest_size); /* returns NULL if there is no filepath */
 const char* scripting_util_parent_name(const surgescript_object_t* object);
 surgescript_object_t* scripting_util_surgeengine_object(surgescript_vm_t* vm);
 surgescript_object_t* scripting_util_surgeengine_component(surgescript_vm_t* vm, const char* component_name);
@@ -55,6 +61,17 @@ surgescript_object_t* scripting_util_spawn_temp(surgescript_vm_t* vm, const char
 void scripting_error(const surgescript_object_t* object, const char* fmt, ...);
 void scripting_warning(const surgescript_object_t* object, const char* fmt, ...);
 
+/* render metadata: native renderables let the render queue read their metadata without calling the VM */
+typedef struct scripting_renderable_t scripting_renderable_t;
+struct scripting_renderable_t { /* any of these may be NULL */
+    float (*zindex)(surgescript_object_t*);
+    bool (*is_visible)(surgescript_object_t*);
+    bool (*is_translucent)(surgescript_object_t*);
+    bool (*texture)(surgescript_object_t*, texturehandle_t*);
+    const char* (*filepath)(surgescript_object_t*);
+};
+void scripting_util_register_renderable(const char* object_name, const scripting_renderable_t* renderable); /* call when registering a native object */
+
 /* obtain data from objects */
 struct actor_t;
 struct animation_t;
@@ -63,6 +80,10 @@ struct music_t;
 struct player_t;
 struct obstaclemap_t;
 
+extern void scripting_transform_world_position(const surgescript_object_t* object, float* x, float* y);
+extern float scripting_transform_world_angle(const surgescript_object_t* object);
+extern void scripting_transform_invalidate(); /* call after changing a transform directly */
+
 extern void scripting_vector2_update(surgescript_object_t* object, double x, double y);
 extern void scripting_vector2_read(const surgescript_object_t* object, double* x, double* y);
 extern v2d_t scripting_vector2_to_v2d(const surgescript_object_t* object);
@@ -85,9 +106,40 @@ extern v2d_t scripting_brick_position(const surgescript_object_t* object);
 
 extern const struct obstaclemap_t* scripting_obstaclemap_ptr(const surgescript_object_t* object);
 
+extern void scripting_sensor_update_batch();
+
+extern bool scripting_brickparticle_setbrick(surgescript_object_t* object, int brick_id);
+extern void scripting_brickparticle_add(surgescript_object_t* object, int src_x, int src_y, int width, int height, v2d_t position, v2d_t velocity);
+
 extern iterator_t* scripting_levelobjectcontainer_iterator(surgescript_object_t* container);
 extern void* scripting_levelobjectcontainer_token();
 
+typedef enum entitycontainertype_t entitycontainertype_t;
+enum entitycontainertype_t {
+    ENTITYCONTAINER_UNAWAKE, /* EntityContainer */
+    ENTITYCONTAINER_AWAKE, /* AwakeEntityContainer */
+    ENTITYCONTAINER_DEBUG /* DebugEntityContainer */
+};
+typedef surgescript_var_t* (*entitycontainerfun_t)(surgescript_object_t*,const surgescript_var_t**,int);
+typedef struct entitycontainervtable_t entitycontainervtable_t;
+struct entitycontainervtable_t {
+    /* we use this vtable to bypass the SurgeScript call stack */
+    entitycontainerfun_t select_active_entities;
+    entitycontainerfun_t notify_entities;
+    entitycontainerfun_t render;
+    entitycontainerfun_t bubble_up_entities; /* NULL if not applicable */
+    entitycontainerfun_t pause;
+    entitycontainerfun_t resume;
+};
+extern const entitycontainervtable_t* entitycontainer_vtable(entitycontainertype_t type);
+extern bool entitycontainer_is_empty(const surgescript_object_t* entity_container);
+
+extern surgescript_var_t* entitytree_update_roi(surgescript_object_t* entity_tree, const surgescript_var_t** param, int num_params);
+extern surgescript_var_t* entitytree_update_world_size(surgescript_object_t* entity_tree, const surgescript_var_t** param, int num_params);
+extern surgescript_var_t* entitytree_bubble_up(surgescript_object_t* tree_node, const surgescript_var_t** param, int num_params);
+extern void entitytree_flush(surgescript_object_t* entity_tree);
+extern void entitytree_store(surgescript_object_t* entity_tree, const surgescript_objecthandle_t* entity_handle, int entity_count);
+
 extern surgescript_object_t* scripting_level_entitymanager(const surgescript_object_t* level);
 extern iterator_t* scripting_level_setupobjects_iterator(const surgescript_object_t* level);
 extern bool scripting_level_issetupobjectname(const surgescript_object_t* level, const char* object_name);
@@ -101,10 +153,19 @@ extern v2d_t entitymanager_get_entity_spawn_point(surgescript_object_t* entity_m
 extern bool entitymanager_is_entity_persistent(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle);
 extern void entitymanager_set_entity_persistent(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, bool is_persistent);
 extern bool entitymanager_is_entity_sleeping(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle);
+extern bool entitymanager_is_entity_effectively_detached(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, bool* is_detached);
 extern void entitymanager_set_entity_sleeping(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, bool is_sleeping);
 extern bool entitymanager_is_inside_roi(surgescript_object_t* entity_manager, v2d_t position);
+extern bool entitymanager_is_entity_inside_roi(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, v2d_t position);
+extern void entitymanager_enqueue_entity(surgescript_object_t* entity_manager, const surgescript_object_t* entity);
+extern surgescript_objecthandle_t entitymanager_spawn_entity(surgescript_object_t* entity_manager, const char* entity_name, v2d_t spawn_point);
+extern void entitymanager_begin_bulk_spawn(surgescript_object_t* entity_manager, int expected_count);
+extern void entitymanager_end_bulk_spawn(surgescript_object_t* entity_manager);
+extern bool entitymanager_is_entity_drowsy(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, v2d_t position);
+extern bool entitymanager_tick_drowsy_entity(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, v2d_t position);
 extern void entitymanager_get_roi(surgescript_object_t* entity_manager, int* top, int* left, int* bottom, int* right);
 extern iterator_t* entitymanager_bricklike_iterator(surgescript_object_t* entity_manager);
+extern iterator_t* entitymanager_bricklike_iterator_inplace(surgescript_object_t* entity_manager, iteratorstorage_t* storage);
 extern iterator_t* entitymanager_activeentities_iterator(surgescript_object_t* entity_manager);
 
 #endif
\ No newline at end of file
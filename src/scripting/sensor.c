@@ -23,6 +23,7 @@
 #include "scripting.h"
 #include "../util/util.h"
 #include "../util/v2d.h"
+#include "../util/darray.h"
 #include "../core/image.h"
 #include "../entities/camera.h"
 #include "../physics/obstacle.h"
@@ -49,6 +50,15 @@ static surgescript_var_t* fun_ontransformchange(surgescript_object_t* object, co
 static inline const obstaclemap_t* get_obstaclemap(const surgescript_object_t* object);
 static inline sensor_t* get_sensor(const surgescript_object_t* object);
 static inline void update(surgescript_object_t* object);
+static const obstaclemap_t* update_ex(surgescript_object_t* object, const obstaclemap_t* obstaclemap);
+
+/* render metadata, read directly by the render queue */
+static float renderable_zindex(surgescript_object_t* object);
+static bool renderable_is_visible(surgescript_object_t* object);
+static const scripting_renderable_t RENDERABLE = {
+    .zindex = renderable_zindex,
+    .is_visible = renderable_is_visible
+};
 static const surgescript_heapptr_t OBSTACLEMAP_ADDR = 0;
 static const surgescript_heapptr_t VISIBLE_ADDR = 1;
 static const surgescript_heapptr_t STATUS_ADDR = 2;
@@ -56,6 +66,10 @@ static const surgescript_heapptr_t ENABLED_ADDR = 3;
 static const surgescript_heapptr_t LAYER_ADDR = 4;
 #define SENSOR_COLOR() (color_hex("ffff00"))
 
+/* the sensors whose main state has run in this frame. Their collisions
+   are checked in a single pass afterwards */
+STATIC_DARRAY(surgescript_objecthandle_t, batch);
+
 /*
  * scripting_register_sensor()
  * Register this component
@@ -83,6 +97,49 @@ void scripting_register_sensor(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "Sensor", "onTransformChange", fun_ontransformchange, 0);
     surgescript_vm_bind(vm, "Sensor", "onRender", fun_onrender, 2);
     surgescript_vm_bind(vm, "Sensor", "onRenderGizmos", fun_onrendergizmos, 2);
+
+    /* render metadata */
+    scripting_util_register_renderable("Sensor", &RENDERABLE);
+}
+
+/*
+ * scripting_sensor_update_batch()
+ * Checks the collisions of the sensors whose main state has run in this
+ * frame, in a single pass. Call it after updating the SurgeScript VM
+ */
+void scripting_sensor_update_batch()
+{
+    surgescript_objectmanager_t* manager;
+    surgescript_objecthandle_t obstaclemap_handle;
+    const obstaclemap_t* obstaclemap = NULL;
+
+    if(darray_length(batch) == 0)
+        return;
+
+    manager = surgescript_vm_objectmanager(surgescript_vm());
+    obstaclemap_handle = surgescript_objectmanager_null(manager);
+
+    for(int i = 0; i < darray_length(batch); i++) {
+        if(!surgescript_objectmanager_exists(manager, batch[i]))
+            continue;
+
+        /* the handle may have been reused if the sensor has been destroyed */
+        surgescript_object_t* object = surgescript_objectmanager_get(manager, batch[i]);
+        if(surgescript_object_is_killed(object) || 0 != strcmp(surgescript_object_name(object), "Sensor"))
+            continue;
+
+        /* the sensors usually share the same obstacle map */
+        surgescript_heap_t* heap = surgescript_object_heap(object);
+        surgescript_objecthandle_t handle = surgescript_var_get_objecthandle(surgescript_heap_at(heap, OBSTACLEMAP_ADDR));
+        if(handle != obstaclemap_handle) {
+            obstaclemap_handle = handle;
+            obstaclemap = NULL;
+        }
+
+        obstaclemap = update_ex(object, obstaclemap);
+    }
+
+    darray_clear(batch);
 }
 
 
@@ -135,10 +192,14 @@ surgescript_var_t* fun_destructor(surgescript_object_t* object, const surgescrip
     return NULL;
 }
 
-/* main state; will check for collisions automatically once per frame */
+/* main state; will check for collisions automatically once per frame.
+   We just add the sensor to the batch (see scripting_sensor_update_batch) */
 surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    update(object);
+    if(batch == NULL)
+        darray_init(batch);
+
+    darray_push(batch, surgescript_object_handle(object));
     return NULL;
 }
 
@@ -215,7 +276,7 @@ surgescript_var_t* fun_onrendergizmos(surgescript_object_t* object, const surges
 /* get zindex */
 surgescript_var_t* fun_getzindex(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    return surgescript_var_set_number(surgescript_var_create(), LARGE_INT);
+    return surgescript_var_set_number(surgescript_var_create(), renderable_zindex(object));
 }
 
 /* set visibility */
@@ -230,8 +291,7 @@ surgescript_var_t* fun_setvisible(surgescript_object_t* object, const surgescrip
 /* get visibility */
 surgescript_var_t* fun_getvisible(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    surgescript_heap_t* heap = surgescript_object_heap(object);
-    return surgescript_var_clone(surgescript_heap_at(heap, VISIBLE_ADDR));
+    return surgescript_var_set_bool(surgescript_var_create(), renderable_is_visible(object));
 }
 
 /* enable or disable the sensor */
@@ -351,6 +411,13 @@ sensor_t* get_sensor(const surgescript_object_t* object)
 
 /* update the sensor */
 void update(surgescript_object_t* object)
+{
+    update_ex(object, NULL);
+}
+
+/* update the sensor using the given obstacle map, which is the obstacle
+   map of the sensor. If NULL, we'll get it. Returns the obstacle map */
+const obstaclemap_t* update_ex(surgescript_object_t* object, const obstaclemap_t* obstaclemap)
 {
     surgescript_heap_t* heap = surgescript_object_heap(object);
     surgescript_var_t* status = surgescript_heap_at(heap, STATUS_ADDR);
@@ -359,7 +426,9 @@ void update(surgescript_object_t* object)
     if(sensor_is_enabled) {
         sensor_t* sensor = get_sensor(object);
         obstaclelayer_t layer = (obstaclelayer_t)surgescript_var_get_rawbits(surgescript_heap_at(heap, LAYER_ADDR));
-        const obstaclemap_t* obstaclemap = get_obstaclemap(object);
+
+        if(obstaclemap == NULL)
+            obstaclemap = get_obstaclemap(object);
         const obstacle_t* obstacle = sensor_check(sensor, scripting_util_world_position(object), MM_FLOOR, layer, obstaclemap);
 
         if(obstacle != NULL) {
@@ -377,4 +446,23 @@ void update(surgescript_object_t* object)
     }
     else
         surgescript_var_set_null(status);
-}
\ No newline at end of file
+
+    return obstaclemap;
+}
+
+
+
+/* render metadata */
+
+/* sensors are rendered on top of everything else */
+float renderable_zindex(surgescript_object_t* object)
+{
+    return LARGE_INT;
+}
+
+/* is the sensor visible? */
+bool renderable_is_visible(surgescript_object_t* object)
+{
+    surgescript_heap_t* heap = surgescript_object_heap(object);
+    return surgescript_var_get_bool(surgescript_heap_at(heap, VISIBLE_ADDR));
+}
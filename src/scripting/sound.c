@@ -19,6 +19,7 @@
  */
 
 #include <surgescript.h>
+#include "scripting.h"
 #include "../core/audio.h"
 #include "../util/util.h"
 
@@ -28,12 +29,18 @@ static surgescript_var_t* fun_init(surgescript_object_t* object, const surgescri
 static surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_destructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_play(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_playat(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_stop(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_getplaying(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_setvolume(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_getvolume(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_setpriority(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_getpriority(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static inline sound_t* get_sound(const surgescript_object_t* object);
 static const surgescript_heapptr_t VOLUME_ADDR = 0;
+static const surgescript_heapptr_t PLAYING_ADDR = 1; /* has this object started a playback that hasn't been notified as finished? */
+static const char* ONSOUNDEND = "onSoundEnd"; /* fun onSoundEnd(sound) will be called on the parent object */
+static void notify_end(const surgescript_object_t* object);
 static const double DEFAULT_VOLUME = 1.0;
 static inline double get_volume(const surgescript_object_t* object);
 
@@ -48,10 +55,13 @@ void scripting_register_sound(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "Sound", "constructor", fun_constructor, 0);
     surgescript_vm_bind(vm, "Sound", "destructor", fun_destructor, 0);
     surgescript_vm_bind(vm, "Sound", "play", fun_play, 0);
+    surgescript_vm_bind(vm, "Sound", "playAt", fun_playat, 2);
     surgescript_vm_bind(vm, "Sound", "stop", fun_stop, 0);
     surgescript_vm_bind(vm, "Sound", "set_volume", fun_setvolume, 1);
     surgescript_vm_bind(vm, "Sound", "get_volume", fun_getvolume, 0);
     surgescript_vm_bind(vm, "Sound", "get_playing", fun_getplaying, 0);
+    surgescript_vm_bind(vm, "Sound", "set_priority", fun_setpriority, 1);
+    surgescript_vm_bind(vm, "Sound", "get_priority", fun_getpriority, 0);
 }
 
 /*
@@ -67,6 +77,18 @@ sound_t* scripting_sound_ptr(const surgescript_object_t* object)
 /* main state */
 surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
+    surgescript_heap_t* heap = surgescript_object_heap(object);
+    surgescript_var_t* playing = surgescript_heap_at(heap, PLAYING_ADDR);
+
+    /* notify the parent when the sound ends, so that scripts don't need to poll it */
+    if(surgescript_var_get_bool(playing)) {
+        sound_t* sound = get_sound(object);
+        if(sound == NULL || !sound_is_playing(sound)) {
+            surgescript_var_set_bool(playing, false);
+            notify_end(object);
+        }
+    }
+
     return NULL;
 }
 
@@ -75,7 +97,9 @@ surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescri
 {
     surgescript_heap_t* heap = surgescript_object_heap(object);
     ssassert(VOLUME_ADDR == surgescript_heap_malloc(heap));
+    ssassert(PLAYING_ADDR == surgescript_heap_malloc(heap));
     surgescript_var_set_number(surgescript_heap_at(heap, VOLUME_ADDR), DEFAULT_VOLUME);
+    surgescript_var_set_bool(surgescript_heap_at(heap, PLAYING_ADDR), false);
     surgescript_object_set_userdata(object, NULL);
     return NULL;
 }
@@ -119,11 +143,33 @@ surgescript_var_t* fun_destructor(surgescript_object_t* object, const surgescrip
 /* plays the sound */
 surgescript_var_t* fun_play(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
+    surgescript_heap_t* heap = surgescript_object_heap(object);
     sound_t* sound = get_sound(object);
     double volume = get_volume(object);
 
-    if(sound != NULL)
+    if(sound != NULL) {
         sound_play_ex(sound, volume, 0.0f, 1.0f);
+        surgescript_var_set_bool(surgescript_heap_at(heap, PLAYING_ADDR), sound_is_playing(sound));
+    }
+
+    return NULL;
+}
+
+/* plays the sound at a position in world space (Vector2), audible within a range given in pixels */
+surgescript_var_t* fun_playat(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(object);
+    surgescript_heap_t* heap = surgescript_object_heap(object);
+    surgescript_objecthandle_t handle = surgescript_var_get_objecthandle(param[0]);
+    v2d_t position = scripting_vector2_to_v2d(surgescript_objectmanager_get(manager, handle));
+    double range = surgescript_var_get_number(param[1]);
+    sound_t* sound = get_sound(object);
+    double volume = get_volume(object);
+
+    if(sound != NULL) {
+        sound_play_at(sound, position, range, volume);
+        surgescript_var_set_bool(surgescript_heap_at(heap, PLAYING_ADDR), sound_is_playing(sound));
+    }
 
     return NULL;
 }
@@ -131,8 +177,11 @@ surgescript_var_t* fun_play(surgescript_object_t* object, const surgescript_var_
 /* stops the sound */
 surgescript_var_t* fun_stop(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
+    surgescript_heap_t* heap = surgescript_object_heap(object);
     sound_t* sound = get_sound(object);
 
+    /* stopping a sound is not notified */
+    surgescript_var_set_bool(surgescript_heap_at(heap, PLAYING_ADDR), false);
     if(sound != NULL)
         sound_stop(sound);
     
@@ -170,6 +219,25 @@ surgescript_var_t* fun_setvolume(surgescript_object_t* object, const surgescript
     return NULL;
 }
 
+/* get priority: sounds of higher priority steal the voices of others. Shared by the Sound objects of the same file */
+surgescript_var_t* fun_getpriority(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    sound_t* sound = get_sound(object);
+    return surgescript_var_set_number(surgescript_var_create(), sound != NULL ? sound_get_priority(sound) : 0);
+}
+
+/* set priority, an integer (defaults to zero) */
+surgescript_var_t* fun_setpriority(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    sound_t* sound = get_sound(object);
+    int priority = surgescript_var_get_number(param[0]);
+
+    if(sound != NULL)
+        sound_set_priority(sound, priority);
+
+    return NULL;
+}
+
 
 
 /* --- utilities --- */
@@ -180,6 +248,22 @@ sound_t* get_sound(const surgescript_object_t* object)
     return (sound_t*)surgescript_object_userdata(object);
 }
 
+/* notify the parent object that the sound has finished playing */
+void notify_end(const surgescript_object_t* object)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(object);
+    surgescript_objecthandle_t me = surgescript_object_handle(object);
+    surgescript_objecthandle_t parent_handle = surgescript_object_parent(object);
+    surgescript_object_t* parent = surgescript_objectmanager_get(manager, parent_handle);
+
+    if(surgescript_object_has_function(parent, ONSOUNDEND)) {
+        surgescript_var_t* self = surgescript_var_set_objecthandle(surgescript_var_create(), me);
+        const surgescript_var_t* p[] = { self };
+        surgescript_object_call_function(parent, ONSOUNDEND, p, 1, NULL);
+        surgescript_var_destroy(self);
+    }
+}
+
 /* the volume of the sample, a value in [0, 1] */
 double get_volume(const surgescript_object_t* object)
 {
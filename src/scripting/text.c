@@ -54,6 +54,8 @@ static surgescript_var_t* fun_setzindex(surgescript_object_t* object, const surg
 static surgescript_var_t* fun_getoffset(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_setoffset(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_getsize(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_getstatic(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_setstatic(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static const surgescript_heapptr_t FONT_ADDR = 0;
 static const surgescript_heapptr_t TEXT_ADDR = 1;
 static const surgescript_heapptr_t ALIGN_ADDR = 2;
@@ -73,6 +75,20 @@ static inline font_t* get_font(const surgescript_object_t* object);
 static inline fontalign_t str2align(const char* align);
 static inline const char* align2str(fontalign_t align);
 
+/* render metadata, read directly by the render queue */
+static float renderable_zindex(surgescript_object_t* object);
+static bool renderable_is_visible(surgescript_object_t* object);
+static bool renderable_is_translucent(surgescript_object_t* object);
+static bool renderable_texture(surgescript_object_t* object, texturehandle_t* texture);
+static const char* renderable_filepath(surgescript_object_t* object);
+static const scripting_renderable_t RENDERABLE = {
+    .zindex = renderable_zindex,
+    .is_visible = renderable_is_visible,
+    .is_translucent = renderable_is_translucent,
+    .texture = renderable_texture,
+    .filepath = renderable_filepath
+};
+
 /*
  * scripting_register_text()
  * Register the Text object
@@ -104,10 +120,15 @@ void scripting_register_text(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "Text", "get_offset", fun_getoffset, 0);
     surgescript_vm_bind(vm, "Text", "set_offset", fun_setoffset, 1);
     surgescript_vm_bind(vm, "Text", "get_size", fun_getsize, 0);
+    surgescript_vm_bind(vm, "Text", "get_static", fun_getstatic, 0);
+    surgescript_vm_bind(vm, "Text", "set_static", fun_setstatic, 1);
     surgescript_vm_bind(vm, "Text", "onRender", fun_onrender, 2);
     surgescript_vm_bind(vm, "Text", "get___filepathOfRenderable", fun_getfilepathofrenderable, 0);
     surgescript_vm_bind(vm, "Text", "get___textureHandle", fun_gettexturehandle, 0);
     surgescript_vm_bind(vm, "Text", "get___isTranslucent", fun_getistranslucent, 0);
+
+    /* render metadata */
+    scripting_util_register_renderable("Text", &RENDERABLE);
 }
 
 /*
@@ -231,31 +252,17 @@ surgescript_var_t* fun_onrender(surgescript_object_t* object, const surgescript_
 /* the filepath of this renderable (used by the render queue) */
 surgescript_var_t* fun_getfilepathofrenderable(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    const font_t* font = get_font(object);
-
-    /* this should happen only before calling __init() */
-    if(font == NULL)
-        return surgescript_var_set_string(surgescript_var_create(), "");
-
-    const char* filepath = font_get_filepath(font);
-    return surgescript_var_set_string(surgescript_var_create(), filepath);
+    return surgescript_var_set_string(surgescript_var_create(), renderable_filepath(object));
 }
 
 /* the texture handle of this renderable (used by the render queue) */
 surgescript_var_t* fun_gettexturehandle(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    const font_t* font = get_font(object);
+    texturehandle_t tex;
 
-    /* is the font valid? */
-    if(font != NULL) {
-        const image_t* image = font_get_image(font);
-
-        /* is this a bitmap font? */
-        if(image != NULL) {
-            texturehandle_t tex = image_texture(image);
-            return surgescript_var_set_rawbits(surgescript_var_create(), tex);
-        }
-    }
+    /* is this a bitmap font? */
+    if(renderable_texture(object, &tex))
+        return surgescript_var_set_rawbits(surgescript_var_create(), tex);
 
     return surgescript_var_set_null(surgescript_var_create());
 }
@@ -263,12 +270,7 @@ surgescript_var_t* fun_gettexturehandle(surgescript_object_t* object, const surg
 /* is this renderable translucent? (used by the render queue) */
 surgescript_var_t* fun_getistranslucent(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    /* we'll consider this renderable to be translucent if it's not a bitmap font,
-       e.g., a TrueType font (there is likely some antialiasing taking place...) */
-    const font_t* font = get_font(object);
-    bool is_translucent = (font != NULL) && (font_get_image(font) == NULL);
-
-    return surgescript_var_set_bool(surgescript_var_create(), is_translucent);
+    return surgescript_var_set_bool(surgescript_var_create(), renderable_is_translucent(object));
 }
 
 /* set zindex */
@@ -432,6 +434,7 @@ surgescript_var_t* fun_setoffset(surgescript_object_t* object, const surgescript
     surgescript_object_t* v2 = surgescript_objectmanager_get(manager, v2h);
     scripting_vector2_read(v2, &x, &y);
     surgescript_transform_setposition2d(transform, x, y);
+    scripting_transform_invalidate();
 
     return NULL;
 }
@@ -454,6 +457,25 @@ surgescript_var_t* fun_setmaxlength(surgescript_object_t* object, const surgescr
     return NULL;
 }
 
+/* get static: is the text rendered from a cached texture? */
+surgescript_var_t* fun_getstatic(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    font_t* font = get_font(object);
+    return surgescript_var_set_bool(surgescript_var_create(), font != NULL && font_is_static(font));
+}
+
+/* set static: render from a cached texture, updated only when the text changes.
+   Useful for texts that rarely change, such as score counters and dialog boxes */
+surgescript_var_t* fun_setstatic(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    font_t* font = get_font(object);
+    if(font != NULL) {
+        bool is_static = surgescript_var_get_bool(param[0]);
+        font_set_static(font, is_static);
+    }
+    return NULL;
+}
+
 /* get size, in pixels */
 surgescript_var_t* fun_getsize(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
@@ -513,3 +535,60 @@ const char* align2str(fontalign_t align)
         default:               return "left";
     }
 }
+
+
+
+/* render metadata */
+
+/* zindex */
+float renderable_zindex(surgescript_object_t* object)
+{
+    surgescript_heap_t* heap = surgescript_object_heap(object);
+    return surgescript_var_get_number(surgescript_heap_at(heap, ZINDEX_ADDR));
+}
+
+/* is the text visible? */
+bool renderable_is_visible(surgescript_object_t* object)
+{
+    surgescript_heap_t* heap = surgescript_object_heap(object);
+    return surgescript_var_get_bool(surgescript_heap_at(heap, VISIBLE_ADDR));
+}
+
+/* we'll consider this renderable to be translucent if it's not a bitmap font,
+   e.g., a TrueType font (there is likely some antialiasing taking place...) */
+bool renderable_is_translucent(surgescript_object_t* object)
+{
+    const font_t* font = get_font(object);
+    return (font != NULL) && (font_get_image(font) == NULL);
+}
+
+/* the texture of a bitmap font */
+bool renderable_texture(surgescript_object_t* object, texturehandle_t* texture)
+{
+    const font_t* font = get_font(object);
+
+    /* is the font valid? */
+    if(font != NULL) {
+        const image_t* image = font_get_image(font);
+
+        /* is this a bitmap font? */
+        if(image != NULL) {
+            *texture = image_texture(image);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* the filepath of the font */
+const char* renderable_filepath(surgescript_object_t* object)
+{
+    const font_t* font = get_font(object);
+
+    /* this should happen only before calling __init() */
+    if(font == NULL)
+        return "";
+
+    return font_get_filepath(font);
+}
@@ -62,6 +62,40 @@ static const surgescript_heapptr_t LOSSYSCALE_ADDR = 3;
 static const surgescript_heapptr_t RIGHT_ADDR = 4;
 static const surgescript_heapptr_t UP_ADDR = 5;
 
+/*
+
+WORLD TRANSFORM CACHE
+
+The world position and the world angle of an object are computed by composing
+the transforms of all of its ascendants. Collisions, sensors, the render queue
+and the camera query them for each object many times per frame.
+
+We cache the world transform of the queried objects in a table indexed by their
+handles. Changing any transform marks the cache as dirty by advancing a global
+generation counter; a change to a parent may affect its whole subtree, and the
+counter invalidates the subtree without walking it. Between changes, e.g., when
+populating the render queue or checking the collisions in batch, world queries
+are O(1) reads.
+
+Besides the generation, an entry also records the object, its parent and its
+local transform. This protects us from handles that are reused by new objects.
+
+*/
+#define WORLD_CACHE_SIZE 4096 /* a power of two */
+typedef struct worldtransform_t worldtransform_t;
+struct worldtransform_t {
+    unsigned generation; /* zero means invalid */
+    const surgescript_object_t* object;
+    surgescript_objecthandle_t handle;
+    surgescript_objecthandle_t parent;
+    float local_x, local_y, local_angle, local_sx, local_sy;
+    bool has_position, has_angle;
+    float world_x, world_y, world_angle;
+};
+static worldtransform_t world_cache[WORLD_CACHE_SIZE];
+static unsigned world_generation = 1;
+static worldtransform_t* cached_world_transform(const surgescript_object_t* object);
+
 
 
 /*
@@ -101,6 +135,55 @@ void scripting_register_transform(surgescript_vm_t* vm)
 
 
 
+/*
+ * scripting_transform_world_position()
+ * The world position of an object, cached
+ */
+void scripting_transform_world_position(const surgescript_object_t* object, float* x, float* y)
+{
+    worldtransform_t* entry = cached_world_transform(object);
+
+    if(!entry->has_position) {
+        surgescript_transform_util_worldposition2d(object, &entry->world_x, &entry->world_y);
+        entry->has_position = true;
+    }
+
+    *x = entry->world_x;
+    *y = entry->world_y;
+}
+
+/*
+ * scripting_transform_world_angle()
+ * The world angle of an object, in degrees, cached
+ */
+float scripting_transform_world_angle(const surgescript_object_t* object)
+{
+    worldtransform_t* entry = cached_world_transform(object);
+
+    if(!entry->has_angle) {
+        entry->world_angle = surgescript_transform_util_worldangle2d(object);
+        entry->has_angle = true;
+    }
+
+    return entry->world_angle;
+}
+
+/*
+ * scripting_transform_invalidate()
+ * Invalidates the cached world transforms. Call after
+ * changing the transform of an object directly
+ */
+void scripting_transform_invalidate()
+{
+    /* zero is reserved for invalid entries */
+    if(++world_generation == 0) {
+        memset(world_cache, 0, sizeof(world_cache));
+        world_generation = 1;
+    }
+}
+
+
+
 /* main state */
 surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
@@ -235,7 +318,7 @@ surgescript_var_t* fun_getposition(surgescript_object_t* object, const surgescri
     surgescript_object_t* v2 = get_v2(object, WORLDPOSITION_ADDR);
     float world_x = 0.0f, world_y = 0.0f;
 
-    surgescript_transform_util_worldposition2d(target(object), &world_x, &world_y);
+    scripting_transform_world_position(target(object), &world_x, &world_y);
     scripting_vector2_update(v2, world_x, world_y);
 
     return surgescript_var_set_objecthandle(surgescript_var_create(), surgescript_object_handle(v2));
@@ -258,7 +341,7 @@ surgescript_var_t* fun_setposition(surgescript_object_t* object, const surgescri
 /* get world angle (in degrees) */
 surgescript_var_t* fun_getangle(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    double world_angle = surgescript_transform_util_worldangle2d(target(object)); /* in degrees */
+    double world_angle = scripting_transform_world_angle(target(object)); /* in degrees */
     return surgescript_var_set_number(surgescript_var_create(), world_angle);
 }
 
@@ -431,6 +514,9 @@ surgescript_object_t* get_v2(surgescript_object_t* object, surgescript_heapptr_t
 /* notify the target object of a transform change */
 void notify_change(surgescript_object_t* object)
 {
+    /* the world transforms of the subtree have changed */
+    scripting_transform_invalidate();
+
     surgescript_object_t* notifiable_target = (surgescript_object_t*)surgescript_object_userdata(object);
     if(notifiable_target != NULL && notifiable_target == target(object)) { /* safety check */
         surgescript_var_t* transform_handle = surgescript_var_set_objecthandle(surgescript_var_create(), surgescript_object_handle(object));
@@ -438,4 +524,43 @@ void notify_change(surgescript_object_t* object)
         surgescript_object_call_function(notifiable_target, ONCHANGE, p, 1, NULL);
         surgescript_var_destroy(transform_handle);
     }
-}
\ No newline at end of file
+}
+
+/* the entry of the world transform cache of an object, valid but possibly not yet computed */
+worldtransform_t* cached_world_transform(const surgescript_object_t* object)
+{
+    surgescript_objecthandle_t handle = surgescript_object_handle(object);
+    surgescript_objecthandle_t parent = surgescript_object_parent(object);
+    const surgescript_transform_t* transform = surgescript_object_transform((surgescript_object_t*)object);
+    worldtransform_t* entry = &world_cache[handle & (WORLD_CACHE_SIZE - 1)];
+    float x, y, angle, sx, sy;
+
+    /* read the local transform */
+    surgescript_transform_getposition2d(transform, &x, &y);
+    surgescript_transform_getscale2d(transform, &sx, &sy);
+    angle = surgescript_transform_getrotation2d(transform);
+
+    /* cache hit? */
+    if(
+        entry->generation == world_generation &&
+        entry->object == object && entry->handle == handle && entry->parent == parent &&
+        entry->local_x == x && entry->local_y == y && entry->local_angle == angle &&
+        entry->local_sx == sx && entry->local_sy == sy
+    )
+        return entry;
+
+    /* cache miss */
+    entry->generation = world_generation;
+    entry->object = object;
+    entry->handle = handle;
+    entry->parent = parent;
+    entry->local_x = x;
+    entry->local_y = y;
+    entry->local_angle = angle;
+    entry->local_sx = sx;
+    entry->local_sy = sy;
+    entry->has_position = false;
+    entry->has_angle = false;
+
+    return entry;
+}
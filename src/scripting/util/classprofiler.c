@@ -0,0 +1,261 @@
+/*
+ * Open Surge Engine
+ * classprofiler.c - CPU time accounting per SurgeScript object class
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "classprofiler.h"
+
+#if defined(WANT_SCRIPT_PROFILER)
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_font.h>
+#include <string.h>
+#include <stdlib.h>
+#include "../../core/logfile.h"
+#include "../../core/video.h"
+#include "../../core/profiler.h"
+#include "../../util/djb2.h"
+#include "../../util/stringutil.h"
+#include "../../util/util.h"
+
+/* parameters */
+#define MAX_CLASSES             512 /* capacity of the table; a power of two */
+#define TOP_N                   10 /* how many classes we display */
+#define SNAPSHOT_INTERVAL       60 /* in framesteps */
+
+/* the stats of an object class */
+typedef struct classstats_t classstats_t;
+struct classstats_t {
+    char* name; /* NULL if the slot is empty */
+    uint64_t hash;
+
+    double time; /* accumulated CPU time since the last snapshot, in seconds */
+    int calls; /* number of calls since the last snapshot */
+
+    double snapshot_time; /* CPU time measured in the last snapshot */
+    int snapshot_calls;
+};
+
+static classstats_t table[MAX_CLASSES];
+static int class_count = 0;
+static int frames_since_snapshot = 0;
+static int snapshot_frames = 0; /* number of framesteps of the last snapshot */
+static ALLEGRO_FONT* font = NULL;
+
+static classstats_t* find_class(const char* name);
+static void log_top_classes(bool show_messages);
+static int sort_top_classes(classstats_t** top, int n);
+static int compare_stats(const void* a, const void* b);
+
+
+
+/*
+ * classprofiler_init()
+ * Initializes the class profiler
+ */
+void classprofiler_init()
+{
+    logfile_message("Initializing the SurgeScript class profiler...");
+
+    memset(table, 0, sizeof(table));
+    class_count = 0;
+    frames_since_snapshot = 0;
+    snapshot_frames = 0;
+    font = NULL;
+}
+
+/*
+ * classprofiler_release()
+ * Releases the class profiler
+ */
+void classprofiler_release()
+{
+    logfile_message("Releasing the SurgeScript class profiler...");
+    log_top_classes(false);
+
+    if(font != NULL) {
+        al_destroy_font(font);
+        font = NULL;
+    }
+
+    for(int i = 0; i < MAX_CLASSES; i++)
+        free(table[i].name);
+
+    memset(table, 0, sizeof(table));
+    class_count = 0;
+}
+
+/*
+ * classprofiler_frame()
+ * Takes a snapshot of the stats every SNAPSHOT_INTERVAL framesteps
+ */
+void classprofiler_frame()
+{
+    if(++frames_since_snapshot < SNAPSHOT_INTERVAL)
+        return;
+
+    for(int i = 0; i < MAX_CLASSES; i++) {
+        if(table[i].name != NULL) {
+            table[i].snapshot_time = table[i].time;
+            table[i].snapshot_calls = table[i].calls;
+            table[i].time = 0.0;
+            table[i].calls = 0;
+        }
+    }
+
+    snapshot_frames = frames_since_snapshot;
+    frames_since_snapshot = 0;
+}
+
+/*
+ * classprofiler_call()
+ * Calls a function of a SurgeScript object, measuring the time
+ * spent on it and accounting it to the class of the object
+ */
+void classprofiler_call(surgescript_object_t* object, const char* fun_name, const surgescript_var_t** args, int num_args, surgescript_var_t* ret)
+{
+    double start_time = al_get_time();
+    surgescript_object_call_function(object, fun_name, args, num_args, ret);
+    double elapsed_time = al_get_time() - start_time;
+
+    classstats_t* stats = find_class(surgescript_object_name(object));
+    if(stats != NULL) {
+        stats->time += elapsed_time;
+        stats->calls++;
+    }
+}
+
+/*
+ * classprofiler_render()
+ * Renders a table with the hottest object classes in window space.
+ * The table is displayed together with the frame profiler
+ */
+void classprofiler_render()
+{
+    classstats_t* top[TOP_N];
+    const float x = 8.0f, line_height = 10.0f;
+    float y = 128.0f;
+
+    if(!profiler_is_enabled() || snapshot_frames == 0)
+        return;
+
+    if(font == NULL && NULL == (font = al_create_builtin_font()))
+        return;
+
+    int n = sort_top_classes(top, TOP_N);
+    if(n == 0)
+        return;
+
+    al_draw_textf(font, al_map_rgb(255, 255, 0), x, y, ALLEGRO_ALIGN_INTEGER, "%-32s %10s %8s", "object class", "ms/frame", "calls");
+    for(int i = 0; i < n; i++) {
+        y += line_height;
+        al_draw_textf(font, al_map_rgb(255, 255, 255), x, y, ALLEGRO_ALIGN_INTEGER, "%-32.32s %10.3f %8d",
+            top[i]->name,
+            1000.0 * top[i]->snapshot_time / snapshot_frames,
+            top[i]->snapshot_calls / snapshot_frames
+        );
+    }
+}
+
+/*
+ * classprofiler_dump()
+ * Prints the hottest object classes to the log and to the console
+ */
+void classprofiler_dump()
+{
+    log_top_classes(true);
+}
+
+
+
+/* private stuff */
+
+/* prints the hottest object classes */
+void log_top_classes(bool show_messages)
+{
+    classstats_t* top[TOP_N];
+    int n = sort_top_classes(top, TOP_N);
+
+    if(snapshot_frames == 0 || n == 0) {
+        logfile_message("SurgeScript class profiler: no data");
+        return;
+    }
+
+    logfile_message("SurgeScript class profiler: %d classes, %d frames per snapshot", class_count, snapshot_frames);
+    for(int i = 0; i < n; i++) {
+        double ms_per_frame = 1000.0 * top[i]->snapshot_time / snapshot_frames;
+        logfile_message("%2d. %-32s %10.3f ms/frame %8d calls", i+1, top[i]->name, ms_per_frame, top[i]->snapshot_calls);
+        if(show_messages)
+            video_showmessage("%d. %s: %.3f ms/frame", i+1, top[i]->name, ms_per_frame);
+    }
+}
+
+/* finds the stats of a class, adding it to the table if necessary */
+classstats_t* find_class(const char* name)
+{
+    uint64_t hash = djb2(name);
+    int i = hash & (MAX_CLASSES - 1);
+
+    /* linear probing */
+    for(int k = 0; k < MAX_CLASSES; k++, i = (i + 1) & (MAX_CLASSES - 1)) {
+        if(table[i].name == NULL) {
+            /* the table is getting full; don't add more classes */
+            if(class_count >= MAX_CLASSES / 2)
+                return NULL;
+
+            table[i].name = str_dup(name);
+            table[i].hash = hash;
+            class_count++;
+            return &table[i];
+        }
+        else if(table[i].hash == hash && 0 == strcmp(table[i].name, name))
+            return &table[i];
+    }
+
+    return NULL;
+}
+
+/* gets the hottest classes of the last snapshot */
+int sort_top_classes(classstats_t** top, int n)
+{
+    classstats_t* all[MAX_CLASSES];
+    int count = 0;
+
+    for(int i = 0; i < MAX_CLASSES; i++) {
+        if(table[i].name != NULL && table[i].snapshot_calls > 0)
+            all[count++] = &table[i];
+    }
+
+    qsort(all, count, sizeof(*all), compare_stats);
+
+    n = min(n, count);
+    for(int i = 0; i < n; i++)
+        top[i] = all[i];
+
+    return n;
+}
+
+/* sort by descending time */
+int compare_stats(const void* a, const void* b)
+{
+    const classstats_t* x = *((const classstats_t**)a);
+    const classstats_t* y = *((const classstats_t**)b);
+    return (x->snapshot_time < y->snapshot_time) - (x->snapshot_time > y->snapshot_time);
+}
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * Open Surge Engine
+ * classprofiler.h - CPU time accounting per SurgeScript object class
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SCRIPTING_CLASSPROFILER_H
+#define _SCRIPTING_CLASSPROFILER_H
+
+#include <surgescript.h>
+
+/*
+ * The class profiler measures the CPU time spent in the engine-dispatched
+ * callbacks of SurgeScript objects (earlyUpdate, lateUpdate, onRender,
+ * collision callbacks...), grouped by object class. It is compiled in only
+ * if WANT_SCRIPT_PROFILER is defined; otherwise classprofiler_call() is a
+ * plain surgescript_object_call_function() and the rest does nothing.
+ */
+#if defined(WANT_SCRIPT_PROFILER)
+
+void classprofiler_init();
+void classprofiler_release();
+void classprofiler_frame(); /* call at the beginning of each framestep */
+void classprofiler_render(); /* render the top N hottest classes in window space */
+void classprofiler_dump(); /* print the table to the log and to the console */
+void classprofiler_call(surgescript_object_t* object, const char* fun_name, const surgescript_var_t** args, int num_args, surgescript_var_t* ret);
+
+#else
+
+#define classprofiler_init()                    ((void)0)
+#define classprofiler_release()                 ((void)0)
+#define classprofiler_frame()                   ((void)0)
+#define classprofiler_render()                  ((void)0)
+#define classprofiler_dump()                    ((void)0)
+#define classprofiler_call(object, fun_name, ...) \
+    surgescript_object_call_function((object), (fun_name), __VA_ARGS__)
+
+#endif
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * Open Surge Engine
+ * framebudget.c - per-frame CPU budget of the scripts
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <allegro5/allegro.h>
+#include <string.h>
+#include <stdint.h>
+#include "framebudget.h"
+#include "classprofiler.h"
+#include "../../core/logfile.h"
+#include "../../util/djb2.h"
+#include "../../util/stringutil.h"
+#include "../../util/util.h"
+
+/* parameters */
+#define SCRIPT_BUDGET           0.008 /* in seconds, per framestep */
+#define MAX_CLASSES             256 /* capacity of the table of a framestep; a power of two */
+#define TOP_N                   3 /* how many classes we report */
+#define REPORT_INTERVAL         5.0 /* minimum time between reports, in seconds */
+
+/* the time charged to an object class in the current framestep */
+typedef struct classcharge_t classcharge_t;
+struct classcharge_t {
+    char name[64]; /* objects may be destroyed during the framestep, so we copy it */
+    uint64_t hash;
+    uint32_t frame; /* the entry is empty if it's not of the current framestep */
+    double time;
+    int calls;
+};
+
+static classcharge_t table[MAX_CLASSES];
+static int class_count = 0;
+static uint32_t frame = 0;
+static bool is_measuring = false;
+static double start_time = 0.0;
+static double last_report_time = 0.0;
+static int overruns_since_report = 0;
+
+static classcharge_t* find_class(const char* name);
+static void report_overrun(double elapsed_time);
+
+
+
+/*
+ * framebudget_init()
+ * Initializes the frame budget
+ */
+void framebudget_init()
+{
+    memset(table, 0, sizeof(table));
+    class_count = 0;
+    frame = 0;
+    is_measuring = false;
+    last_report_time = -REPORT_INTERVAL;
+    overruns_since_report = 0;
+}
+
+/*
+ * framebudget_release()
+ * Releases the frame budget
+ */
+void framebudget_release()
+{
+    if(overruns_since_report > 0)
+        logfile_message("The scripts went over budget in %d more framesteps", overruns_since_report);
+
+    is_measuring = false;
+}
+
+/*
+ * framebudget_begin()
+ * Starts measuring the scripts of a framestep
+ */
+void framebudget_begin()
+{
+    /* invalidate the entries of the previous framestep */
+    if(++frame == 0) {
+        memset(table, 0, sizeof(table));
+        frame = 1;
+    }
+
+    class_count = 0;
+    start_time = al_get_time();
+    is_measuring = true;
+}
+
+/*
+ * framebudget_end()
+ * Stops measuring the scripts of a framestep and reports an
+ * overrun if they went over budget
+ */
+void framebudget_end()
+{
+    if(!is_measuring)
+        return;
+
+    double elapsed_time = al_get_time() - start_time;
+    is_measuring = false;
+
+    if(elapsed_time > SCRIPT_BUDGET)
+        report_overrun(elapsed_time);
+}
+
+/*
+ * framebudget_remaining()
+ * The time remaining in the budget of the current framestep,
+ * in seconds. Returns zero if the budget is exhausted
+ */
+double framebudget_remaining()
+{
+    if(!is_measuring)
+        return SCRIPT_BUDGET;
+
+    return max(0.0, SCRIPT_BUDGET - (al_get_time() - start_time));
+}
+
+/*
+ * framebudget_is_exhausted()
+ * Have the scripts exhausted the budget of the current framestep?
+ */
+bool framebudget_is_exhausted()
+{
+    return framebudget_remaining() <= 0.0;
+}
+
+/*
+ * framebudget_charge()
+ * Charges time to an object class in the current framestep
+ */
+void framebudget_charge(const char* class_name, double seconds)
+{
+    if(!is_measuring)
+        return;
+
+    classcharge_t* charge = find_class(class_name);
+    if(charge != NULL) {
+        charge->time += seconds;
+        charge->calls++;
+    }
+}
+
+/*
+ * framebudget_call()
+ * Calls a function of a SurgeScript object, charging
+ * the time spent on it to the class of the object
+ */
+void framebudget_call(surgescript_object_t* object, const char* fun_name, const surgescript_var_t** args, int num_args, surgescript_var_t* ret)
+{
+    if(!is_measuring) {
+        classprofiler_call(object, fun_name, args, num_args, ret);
+        return;
+    }
+
+    double call_start_time = al_get_time();
+    classprofiler_call(object, fun_name, args, num_args, ret);
+    framebudget_charge(surgescript_object_name(object), al_get_time() - call_start_time);
+}
+
+
+
+/* private stuff */
+
+/* logs the object classes that took the most time in this framestep.
+   Overruns are reported at most once every REPORT_INTERVAL seconds */
+void report_overrun(double elapsed_time)
+{
+    classcharge_t* top[TOP_N] = { NULL };
+    double now = al_get_time();
+    char text[256];
+    int length;
+
+    if(now - last_report_time < REPORT_INTERVAL) {
+        overruns_since_report++;
+        return;
+    }
+
+    /* find the top classes */
+    for(int i = 0; i < MAX_CLASSES; i++) {
+        if(table[i].frame != frame)
+            continue;
+
+        for(int j = 0; j < TOP_N; j++) {
+            if(top[j] == NULL || table[i].time > top[j]->time) {
+                for(int k = TOP_N - 1; k > j; k--)
+                    top[k] = top[k-1];
+                top[j] = &table[i];
+                break;
+            }
+        }
+    }
+
+    /* report */
+    length = snprintf(text, sizeof(text), "The scripts took %.1f ms in a framestep (budget: %.1f ms).", 1000.0 * elapsed_time, 1000.0 * SCRIPT_BUDGET);
+    for(int j = 0; j < TOP_N && top[j] != NULL && length < (int)sizeof(text); j++)
+        length += snprintf(text + length, sizeof(text) - length, " %s%s: %.1f ms in %d calls", j == 0 ? "Top classes:" : ",", top[j]->name, 1000.0 * top[j]->time, top[j]->calls);
+
+    if(overruns_since_report > 0)
+        logfile_message("%s (%d more overruns since the last report)", text, overruns_since_report);
+    else
+        logfile_message("%s", text);
+
+    last_report_time = now;
+    overruns_since_report = 0;
+}
+
+/* finds the charge of a class in this framestep, adding it to the table if necessary */
+classcharge_t* find_class(const char* name)
+{
+    uint64_t hash = djb2(name);
+    int i = hash & (MAX_CLASSES - 1);
+
+    /* linear probing */
+    for(int k = 0; k < MAX_CLASSES; k++, i = (i + 1) & (MAX_CLASSES - 1)) {
+        if(table[i].frame != frame) {
+            /* the table is getting full; don't add more classes */
+            if(class_count >= MAX_CLASSES / 2)
+                return NULL;
+
+            str_cpy(table[i].name, name, sizeof(table[i].name));
+            table[i].hash = hash;
+            table[i].frame = frame;
+            table[i].time = 0.0;
+            table[i].calls = 0;
+            class_count++;
+            return &table[i];
+        }
+        else if(table[i].hash == hash && 0 == strncmp(table[i].name, name, sizeof(table[i].name) - 1))
+            return &table[i];
+    }
+
+    return NULL;
+}
@@ -0,0 +1,49 @@
+/*
+ * Open Surge Engine
+ * framebudget.h - per-frame CPU budget of the scripts
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SCRIPTING_FRAMEBUDGET_H
+#define _SCRIPTING_FRAMEBUDGET_H
+
+#include <stdbool.h>
+#include <surgescript.h>
+
+/*
+ * The frame budget accounts for the CPU time spent by the scripts of the
+ * level in each framestep. Cooperative scripts may query the remaining time
+ * and defer work to later framesteps. When the scripts go over budget, an
+ * overrun report names the object classes that took the most time.
+ */
+
+void framebudget_init();
+void framebudget_release();
+
+/* accounting: call these around the update of the scripts of the level */
+void framebudget_begin(); /* call before early_update_ssobjects() */
+void framebudget_end(); /* call after late_update_ssobjects(); reports overruns */
+
+/* queries */
+double framebudget_remaining(); /* time remaining in this framestep, in seconds; zero if exhausted */
+bool framebudget_is_exhausted();
+
+/* charging time to object classes */
+void framebudget_charge(const char* class_name, double seconds);
+void framebudget_call(surgescript_object_t* object, const char* fun_name, const surgescript_var_t** args, int num_args, surgescript_var_t* ret); /* calls a function, charging its time to the class of the object */
+
+#endif
@@ -31,7 +31,15 @@ struct ssarrayiterator_state_t
     surgescript_object_t* array;
     bool is_disposable_array;
 
-    /* a copy of the data */
+    /* direct access to the storage of the array */
+    bool is_direct;
+    surgescript_heap_t* heap;
+    size_t heap_size; /* together with the length, this is the version of the array */
+    size_t length;
+    size_t index;
+    surgescript_var_t* element;
+
+    /* a copy of the data (fallback) */
     surgescript_var_t** c_array;
     size_t c_array_length;
 
@@ -39,6 +47,10 @@ struct ssarrayiterator_state_t
     iterator_t* c_array_iterator;
 };
 
+/* layout of a SurgeScript Array */
+static const surgescript_heapptr_t ARRAY_LENGTH_ADDR = 0;
+static const surgescript_heapptr_t ARRAY_BASE_ADDR = 1;
+
 static iterator_state_t* surgescript_arrayiterator_ctor(void* ctor_data);
 static iterator_state_t* surgescript_arrayiterator_ctor_disposable(void* ctor_data);
 static void surgescript_arrayiterator_dtor(iterator_state_t* state);
@@ -48,6 +60,8 @@ static bool surgescript_arrayiterator_has_next(iterator_state_t* state);
 /* helpers */
 static size_t get_surgescript_array_length(surgescript_object_t* array);
 static void get_surgescript_array_element(surgescript_object_t* array, int index, surgescript_var_t* return_value);
+static bool read_direct_length(const surgescript_heap_t* heap, size_t* length);
+static bool can_access_directly(surgescript_object_t* array);
 
 
 
@@ -105,20 +119,39 @@ iterator_state_t* surgescript_arrayiterator_ctor(void* ctor_data)
 {
     /*
 
-    SurgeScript Arrays may change through time or may even be Garbage Collected.
-    We'll copy its values to a temporary storage and iterate over these.
-    Changing them will not affect the SurgeScript Array in any way, and vice-versa.
+    Native code iterates over SurgeScript Arrays very often. We read the
+    elements directly from the heap of the array, without calling any
+    functions of the VM. The elements are read-only.
+
+    The array must not be modified during the iteration. We take its
+    length and the size of its heap as its version and check them on
+    each step. A modified array is a fatal error.
 
-    Issue: okay, but what if the SurgeScript Array is large?
-    Solution: iterate over any iterable SurgeScript Collection without copying any data.
-              ^^^ TODO
+    If the layout of the array isn't the expected one, we fall back to
+    copying its values to a temporary storage with VM calls.
 
     */
     ssarrayiterator_state_t* state = mallocx(sizeof *state);
 
     state->array = (surgescript_object_t*)ctor_data;
     state->is_disposable_array = false;
+    state->is_direct = can_access_directly(state->array);
+    state->heap = surgescript_object_heap(state->array);
+    state->heap_size = surgescript_heap_size(state->heap);
+    state->length = 0;
+    state->index = 0;
+    state->element = NULL;
+    state->c_array = NULL;
+    state->c_array_length = 0;
+    state->c_array_iterator = NULL;
+
+    /* direct access */
+    if(state->is_direct) {
+        read_direct_length(state->heap, &state->length);
+        return state;
+    }
 
+    /* fallback */
     state->c_array_length = get_surgescript_array_length(state->array);
     state->c_array = mallocx(state->c_array_length * sizeof(*(state->c_array)));
 
@@ -150,12 +183,14 @@ void surgescript_arrayiterator_dtor(iterator_state_t* s)
     ssarrayiterator_state_t* state = (ssarrayiterator_state_t*)s;
 
     /* release the iterator of the C array */
-    iterator_destroy(state->c_array_iterator);
+    if(state->c_array_iterator != NULL)
+        iterator_destroy(state->c_array_iterator);
 
     /* release the C array */
     for(int i = state->c_array_length - 1; i >= 0; i--)
         surgescript_var_destroy(state->c_array[i]);
-    free(state->c_array);
+    if(state->c_array != NULL)
+        free(state->c_array);
 
     /* release the SurgeScript Array if it's disposable */
     if(state->is_disposable_array)
@@ -169,14 +204,33 @@ void surgescript_arrayiterator_dtor(iterator_state_t* s)
 void* surgescript_arrayiterator_next(iterator_state_t* s)
 {
     ssarrayiterator_state_t* state = (ssarrayiterator_state_t*)s;
-    return iterator_next(state->c_array_iterator);
+    size_t length = 0;
+
+    if(!state->is_direct)
+        return iterator_next(state->c_array_iterator);
+
+    /* version check */
+    if(!read_direct_length(state->heap, &length) || length != state->length || surgescript_heap_size(state->heap) != state->heap_size)
+        fatal_error("%s: a SurgeScript Array has been modified during its iteration", __func__);
+
+    /* end of the array */
+    if(state->index >= state->length)
+        return NULL;
+
+    /* read the element */
+    state->element = surgescript_heap_at(state->heap, ARRAY_BASE_ADDR + state->index++);
+    return &(state->element);
 }
 
 /* iteration not over? */
 bool surgescript_arrayiterator_has_next(iterator_state_t* s)
 {
     ssarrayiterator_state_t* state = (ssarrayiterator_state_t*)s;
-    return iterator_has_next(state->c_array_iterator);
+
+    if(!state->is_direct)
+        return iterator_has_next(state->c_array_iterator);
+
+    return state->index < state->length;
 }
 
 /* return the length of the array */
@@ -202,4 +256,39 @@ void get_surgescript_array_element(surgescript_object_t* array, int index, surge
     surgescript_object_call_function(array, "get", args, 1, return_value);
 
     surgescript_var_destroy(arg);
-}
\ No newline at end of file
+}
+
+/* read the length of an array directly from its heap */
+bool read_direct_length(const surgescript_heap_t* heap, size_t* length)
+{
+    size_t heap_size = surgescript_heap_size(heap);
+    if(heap_size <= ARRAY_LENGTH_ADDR)
+        return false;
+
+    const surgescript_var_t* length_var = surgescript_heap_at((surgescript_heap_t*)heap, ARRAY_LENGTH_ADDR);
+    if(!surgescript_var_is_number(length_var))
+        return false;
+
+    double value = surgescript_var_get_number(length_var);
+    if(value < 0.0 || value + ARRAY_BASE_ADDR > heap_size)
+        return false;
+
+    *length = (size_t)value;
+    return true;
+}
+
+/* checks if we can access the storage of an array directly. We validate the
+   expected layout against the VM once, since it's private to SurgeScript */
+bool can_access_directly(surgescript_object_t* array)
+{
+    static enum { UNKNOWN, YES, NO } layout_is_valid = UNKNOWN;
+    size_t length = 0;
+
+    if(!read_direct_length(surgescript_object_heap(array), &length))
+        return false;
+
+    if(layout_is_valid == UNKNOWN)
+        layout_is_valid = (length == get_surgescript_array_length(array)) ? YES : NO;
+
+    return layout_is_valid == YES;
+}
@@ -0,0 +1,170 @@
+/*
+ * Open Surge Engine
+ * arena.c - linear arena allocator for transient data
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include "arena.h"
+#include "util.h"
+
+/* a block of memory */
+typedef struct arenablock_t arenablock_t;
+struct arenablock_t
+{
+    arenablock_t* next; /* the next (older) block */
+    size_t capacity; /* size of data[], in bytes */
+    size_t used; /* how many bytes of data[] are in use */
+    uint8_t* data;
+};
+
+/* arena */
+struct arena_t
+{
+    arenablock_t* block; /* the most recent block; allocations take place here */
+    size_t block_size; /* minimum capacity of a block */
+    size_t size; /* number of allocated bytes, including padding */
+};
+
+/* alignment of the allocations, in bytes */
+typedef union { void* p; double d; long long ll; void (*fn)(); } arena_align_t;
+#define ALIGNMENT (sizeof(arena_align_t))
+#define ALIGN(n) (((n) + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1))
+
+/* default size of a block, in bytes */
+static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+static arenablock_t* block_create(size_t capacity, arenablock_t* next);
+static arenablock_t* block_destroy(arenablock_t* block);
+
+
+
+/*
+ * arena_create()
+ * Creates a new arena. If block_size is zero, a default will be used.
+ */
+arena_t* arena_create(size_t block_size)
+{
+    arena_t* arena = mallocx(sizeof *arena);
+
+    arena->block_size = ALIGN(block_size > 0 ? block_size : DEFAULT_BLOCK_SIZE);
+    arena->block = block_create(arena->block_size, NULL);
+    arena->size = 0;
+
+    return arena;
+}
+
+/*
+ * arena_destroy()
+ * Destroys an arena, releasing all of its memory
+ */
+arena_t* arena_destroy(arena_t* arena)
+{
+    while(arena->block != NULL)
+        arena->block = block_destroy(arena->block);
+
+    free(arena);
+    return NULL;
+}
+
+/*
+ * arena_alloc()
+ * Allocates memory in the arena. The returned pointer is suitably aligned
+ * for any type and is valid until the next call to arena_reset()
+ */
+void* arena_alloc(arena_t* arena, size_t bytes)
+{
+    arenablock_t* block = arena->block;
+    void* ptr;
+
+    /* round up the size */
+    bytes = ALIGN(bytes > 0 ? bytes : 1);
+
+    /* create a new block if the current one is full */
+    if(block->used + bytes > block->capacity) {
+        size_t capacity = max(arena->block_size, bytes);
+        block = arena->block = block_create(capacity, block);
+    }
+
+    /* allocate */
+    ptr = block->data + block->used;
+    block->used += bytes;
+    arena->size += bytes;
+
+    return ptr;
+}
+
+/*
+ * arena_reset()
+ * Releases all allocations of the arena at once. If more than one block
+ * was needed, they are merged into a single larger block
+ */
+void arena_reset(arena_t* arena)
+{
+    /* multiple blocks? merge them */
+    if(arena->block->next != NULL) {
+        size_t capacity = 0;
+
+        while(arena->block != NULL) {
+            capacity += arena->block->capacity;
+            arena->block = block_destroy(arena->block);
+        }
+
+        arena->block = block_create(capacity, NULL);
+    }
+
+    /* reset the block */
+    arena->block->used = 0;
+    arena->size = 0;
+}
+
+/*
+ * arena_size()
+ * How many bytes are currently allocated in the arena, including padding
+ */
+size_t arena_size(const arena_t* arena)
+{
+    return arena->size;
+}
+
+
+
+/* private */
+
+/* creates a new block of memory */
+arenablock_t* block_create(size_t capacity, arenablock_t* next)
+{
+    arenablock_t* block = mallocx(sizeof *block);
+
+    block->data = mallocx(capacity);
+    block->capacity = capacity;
+    block->used = 0;
+    block->next = next;
+
+    return block;
+}
+
+/* destroys a block of memory, returning the next one */
+arenablock_t* block_destroy(arenablock_t* block)
+{
+    arenablock_t* next = block->next;
+
+    free(block->data);
+    free(block);
+
+    return next;
+}
@@ -0,0 +1,55 @@
+/*
+ * Open Surge Engine
+ * arena.h - linear arena allocator for transient data
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+/*
+
+An arena is a region of memory used for transient data. Allocations are
+cheap and there is no need to free them individually: all of them are
+released at once when the arena is reset. Usage example:
+
+arena_t* arena = arena_create(0);
+
+for(;;) {
+    arena_reset(arena); // once per frame
+    point2d_t* p = arena_alloc(arena, sizeof *p);
+    ...
+}
+
+arena_destroy(arena);
+
+After a reset, the arena keeps enough memory to fit whatever was allocated
+before, so that it doesn't need to allocate memory again in steady state.
+
+*/
+
+#include <stddef.h>
+
+typedef struct arena_t arena_t;
+
+arena_t* arena_create(size_t block_size); /* creates a new arena; block_size may be zero (use a default) */
+arena_t* arena_destroy(arena_t* arena); /* destroys an arena */
+void* arena_alloc(arena_t* arena, size_t bytes); /* allocates memory in the arena; the returned pointer is suitably aligned for any type */
+void arena_reset(arena_t* arena); /* releases all allocations of the arena at once */
+size_t arena_size(const arena_t* arena); /* how many bytes are currently allocated in the arena? */
+
+#endif
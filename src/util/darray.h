@@ -77,12 +77,55 @@
  #define darray_remove(arr, index)           \
     do { if((index) < arr##_len && (index) >= 0) { memmove((arr) + (index), (arr) + ((index) + 1), (arr##_len - ((index) + 1)) * sizeof(*(arr))); arr##_len--; } } while(0)
 
+/*
+ * darray_remove_unordered()
+ * removes the index-th element from the array in O(1) by moving the last element into its place.
+ * The order of the elements is not preserved
+ */
+#define darray_remove_unordered(arr, index)  \
+    do { if((index) < arr##_len && (index) >= 0) { arr[(index)] = arr[--arr##_len]; } } while(0)
+
 /*
  * darray_length()
  * returns the length of the array
  */
 #define darray_length(arr)                   (+arr##_len)
 
+/*
+ * darray_reserve()
+ * makes room for at least 'n' elements, without changing the length of the array.
+ * The capacity grows geometrically, so that reserving in small steps is amortized O(1)
+ */
+#define darray_reserve(arr, n)               \
+    do { if((size_t)(n) > arr##_cap) { arr##_cap = ((size_t)(n) > 2 * arr##_cap) ? (size_t)(n) : 2 * arr##_cap; arr = darray_realloc(arr, arr##_cap * sizeof(*(arr))); } } while(0)
+
+/*
+ * darray_shrink()
+ * shrinks the capacity of the array to its length (shrink-to-fit)
+ */
+#define darray_shrink(arr)                   \
+    do { size_t _cap = (arr##_len > 4) ? arr##_len : 4; if(_cap < arr##_cap) { arr##_cap = _cap; arr = darray_realloc(arr, arr##_cap * sizeof(*(arr))); } } while(0)
+
+/*
+ * darray_capacity()
+ * returns the capacity of the array
+ */
+#define darray_capacity(arr)                 (+arr##_cap)
+
+/*
+ * darray_swap()
+ * swaps the contents of two arrays of the same type in O(1)
+ */
+#define darray_swap(a, b)                    \
+    do { void* _p = (a); size_t _t; (a) = (b); (b) = _p; _t = a##_len; a##_len = b##_len; b##_len = _t; _t = a##_cap; a##_cap = b##_cap; b##_cap = _t; } while(0)
+
+/*
+ * darray_resize()
+ * sets the length of the array to 'n'; new elements are left uninitialized
+ */
+#define darray_resize(arr, n)                \
+    do { darray_reserve(arr, n); arr##_len = (n); } while(0)
+
 /*
  * darray_clear()
  * sets the length of the array to zero, without freeing any of its contents
@@ -19,34 +19,58 @@
  */
 
 #include <string.h>
+#include <stdint.h>
+#include <ctype.h>
 #include "dictionary.h"
 #include "stringutil.h"
 #include "util.h"
 #include "darray.h"
 #include "iterator.h"
 
-/* dictionary entry */
-typedef struct dictentry_t dictentry_t;
-struct dictentry_t
-{
-    char* key;
-    void* value;
-};
+/*
+
+DICTIONARY LAYOUT
+
+The elements are stored in dense arrays, in insertion order: keys, values and
+the hashes of the keys are kept side by side. Lookups go through an index of
+slots using open addressing with linear probing. Each slot stores the position
+of an entry in the dense arrays or EMPTY_SLOT. The number of slots is a power
+of two and the index is kept at most 3/4 full.
+
+Since the hashes are cached, we compare the keys only when the hashes match.
+Iterating over the dictionary is just a walk over the dense arrays, which
+doesn't allocate memory.
+
+*/
+
+#define EMPTY_SLOT          (-1)
+#define MIN_SLOTS           8
 
 /* dictionary */
 struct dictionary_t
 {
     int (*keycmp)(const char*,const char*);
+    uint32_t (*keyhash)(const char*);
     void (*dtor)(void*,void*);
     void *dtor_context;
 
-    /* entries sorted by key */
-    DARRAY(dictentry_t, entry);
+    /* dense arrays of entries in insertion order */
+    DARRAY(char*, key);
+    DARRAY(void*, value);
+    DARRAY(uint32_t, hash);
+
+    /* index of slots */
+    int* slot;
+    int slot_count; /* a power of two or zero */
 };
 
 /* helpers */
-static int binary_search(const dictionary_t* dict, const char* key);
-static void release_entry(dictionary_t* dict, int entry_index);
+static int find_entry(const dictionary_t* dict, const char* key, uint32_t hash);
+static void insert_slot(dictionary_t* dict, int entry_index);
+static void rebuild_slots(dictionary_t* dict, int slot_count);
+static int slots_for(int count);
+static uint32_t hash_key(const char* key);
+static uint32_t hash_key_icase(const char* key);
 static void null_dtor(void* element, void* dtor_context);
 
 /* DictionaryIterator */
@@ -81,10 +105,16 @@ dictionary_t* dictionary_create(bool want_case_sensitive_keys, void (*element_dt
     dictionary_t* dict = mallocx(sizeof *dict);
 
     dict->keycmp = want_case_sensitive_keys ? strcmp : str_icmp;
+    dict->keyhash = want_case_sensitive_keys ? hash_key : hash_key_icase;
     dict->dtor = element_dtor != NULL ? element_dtor : null_dtor;
     dict->dtor_context = dtor_context;
 
-    darray_init(dict->entry);
+    darray_init(dict->key);
+    darray_init(dict->value);
+    darray_init(dict->hash);
+
+    dict->slot = NULL;
+    dict->slot_count = 0;
 
     return dict;
 }
@@ -96,10 +126,17 @@ dictionary_t* dictionary_create(bool want_case_sensitive_keys, void (*element_dt
  */
 dictionary_t* dictionary_destroy(dictionary_t* dict)
 {
-    for(int i = 0; i < darray_length(dict->entry); i++)
-        release_entry(dict, i);
+    for(int i = 0; i < darray_length(dict->key); i++) {
+        free(dict->key[i]);
+        dict->dtor(dict->value[i], dict->dtor_context);
+    }
+
+    if(dict->slot != NULL)
+        free(dict->slot);
 
-    darray_release(dict->entry);
+    darray_release(dict->hash);
+    darray_release(dict->value);
+    darray_release(dict->key);
     free(dict);
     return NULL;
 }
@@ -111,10 +148,10 @@ dictionary_t* dictionary_destroy(dictionary_t* dict)
  */
 void* dictionary_get(const dictionary_t* dict, const char* key)
 {
-    int index_of_key = binary_search(dict, key);
+    int index_of_key = find_entry(dict, key, dict->keyhash(key));
 
     if(index_of_key >= 0)
-        return dict->entry[index_of_key].value;
+        return dict->value[index_of_key];
 
     return NULL;
 }
@@ -129,35 +166,97 @@ void dictionary_put(dictionary_t* dict, const char* key, void* element)
 {
     assertx(element != NULL);
 
-    /* insert new element */
-    dictentry_t new_entry = { str_dup(key), element };
-    darray_push(dict->entry, new_entry);
-
-    /* insertion sort */
-    int last = darray_length(dict->entry) - 1;
-    for(int i = last; i > 0; i--) {
-        int cmp = dict->keycmp(dict->entry[i].key, dict->entry[i-1].key);
-        if(cmp < 0) {
-            /* swap entries i and i-1 */
-            dictentry_t tmp = dict->entry[i];
-            dict->entry[i] = dict->entry[i-1];
-            dict->entry[i-1] = tmp;
-        }
-        else if(cmp == 0) {
-            /* duplicate key; erase old entry */
-            release_entry(dict, i-1);
-            darray_remove(dict->entry, i-1);
-            break;
-        }
-        else {
-            /* done */
-            break;
-        }
+    /* duplicate key? replace the old element, keeping its position */
+    uint32_t hash = dict->keyhash(key);
+    int index_of_key = find_entry(dict, key, hash);
+    if(index_of_key >= 0) {
+        void* old_element = dict->value[index_of_key];
+        dict->value[index_of_key] = element;
+        if(old_element != element)
+            dict->dtor(old_element, dict->dtor_context);
+        return;
     }
 
-    /* this simple implementation works, but it won't be very efficient for
-       a dictionary with hundreds or thousands of elements UNLESS it is
-       fed in sorted order. */
+    /* grow the index of slots if necessary */
+    int count = darray_length(dict->key) + 1;
+    if(slots_for(count) > dict->slot_count)
+        rebuild_slots(dict, slots_for(count));
+
+    /* insert new element */
+    darray_push(dict->key, str_dup(key));
+    darray_push(dict->value, element);
+    darray_push(dict->hash, hash);
+    insert_slot(dict, count - 1);
+}
+
+/*
+ * dictionary_reserve()
+ * Preallocates memory for a number of elements, so that the dictionary
+ * won't need to grow until it stores more than that
+ */
+void dictionary_reserve(dictionary_t* dict, int count)
+{
+    if(count <= darray_length(dict->key))
+        return;
+
+    darray_reserve(dict->key, count);
+    darray_reserve(dict->value, count);
+    darray_reserve(dict->hash, count);
+
+    if(slots_for(count) > dict->slot_count)
+        rebuild_slots(dict, slots_for(count));
+}
+
+/*
+ * dictionary_count()
+ * The number of elements stored in the dictionary
+ */
+int dictionary_count(const dictionary_t* dict)
+{
+    return darray_length(dict->key);
+}
+
+/*
+ * dictionary_key_at()
+ * The key of the index-th element of the dictionary, in insertion order
+ */
+const char* dictionary_key_at(const dictionary_t* dict, int index)
+{
+    assertx(index >= 0 && index < darray_length(dict->key));
+    return dict->key[index];
+}
+
+/*
+ * dictionary_value_at()
+ * The index-th element of the dictionary, in insertion order
+ */
+void* dictionary_value_at(const dictionary_t* dict, int index)
+{
+    assertx(index >= 0 && index < darray_length(dict->value));
+    return dict->value[index];
+}
+
+/*
+ * dictionary_value_array()
+ * A dense array with the dictionary_count() elements of the dictionary, in
+ * insertion order. The pointer is invalidated when adding new elements
+ */
+void* const* dictionary_value_array(const dictionary_t* dict)
+{
+    return dict->value;
+}
+
+/*
+ * dictionary_foreach()
+ * Calls callback(key, element, data) for each element of the dictionary,
+ * in insertion order. The dictionary must not be modified during the loop
+ */
+void dictionary_foreach(const dictionary_t* dict, void (*callback)(const char*,void*,void*), void* data)
+{
+    int count = darray_length(dict->key);
+
+    for(int i = 0; i < count; i++)
+        callback(dict->key[i], dict->value[i], data);
 }
 
 /*
@@ -197,33 +296,83 @@ iterator_t* dictionary_values(const dictionary_t* dict)
  *
  */
 
-/* finds j >= 0 such that dict->entry[k].key == key;
+/* finds the index j >= 0 of the entry such that dict->key[j] == key;
    returns -1 if not found */
-int binary_search(const dictionary_t* dict, const char* key)
+int find_entry(const dictionary_t* dict, const char* key, uint32_t hash)
 {
-    int l = 0, r = darray_length(dict->entry) - 1;
-
-    while(l <= r) {
-        int m = (l + r) / 2;
-        int cmp = dict->keycmp(key, dict->entry[m].key);
-
-        if(cmp < 0)
-            r = m - 1;
-        else if(cmp > 0)
-            l = m + 1;
-        else
-            return m;
+    if(dict->slot_count == 0)
+        return -1;
+
+    uint32_t mask = (uint32_t)(dict->slot_count - 1);
+    for(uint32_t s = hash & mask; ; s = (s + 1) & mask) {
+        int j = dict->slot[s];
+
+        if(j == EMPTY_SLOT)
+            return -1;
+        else if(dict->hash[j] == hash && dict->keycmp(key, dict->key[j]) == 0)
+            return j;
     }
+}
+
+/* stores the index of an entry in the first free slot of its probe sequence */
+void insert_slot(dictionary_t* dict, int entry_index)
+{
+    uint32_t mask = (uint32_t)(dict->slot_count - 1);
+    uint32_t s = dict->hash[entry_index] & mask;
 
-    return -1;
+    while(dict->slot[s] != EMPTY_SLOT)
+        s = (s + 1) & mask;
+
+    dict->slot[s] = entry_index;
 }
 
-/* releases dict->entry[entry_index] */
-void release_entry(dictionary_t* dict, int entry_index)
+/* recreates the index of slots with a new size; the hashes are cached */
+void rebuild_slots(dictionary_t* dict, int slot_count)
 {
-    free(dict->entry[entry_index].key);
-    dict->dtor(dict->entry[entry_index].value, dict->dtor_context);
-    dict->entry[entry_index] = (dictentry_t){ NULL, NULL };
+    if(dict->slot != NULL)
+        free(dict->slot);
+
+    dict->slot = mallocx(slot_count * sizeof(*(dict->slot)));
+    dict->slot_count = slot_count;
+
+    for(int s = 0; s < slot_count; s++)
+        dict->slot[s] = EMPTY_SLOT;
+
+    for(int i = 0; i < darray_length(dict->key); i++)
+        insert_slot(dict, i);
+}
+
+/* the number of slots needed to store count entries */
+int slots_for(int count)
+{
+    int slot_count = MIN_SLOTS;
+
+    while(slot_count * 3 < count * 4)
+        slot_count *= 2;
+
+    return slot_count;
+}
+
+/* hash function for case-sensitive keys */
+uint32_t hash_key(const char* key)
+{
+    uint32_t hash = 0;
+
+    while(*key)
+        hash = (unsigned char)(*(key++)) + (hash << 6) + (hash << 16) - hash;
+
+    return hash;
+}
+
+/* hash function for case-insensitive keys */
+uint32_t hash_key_icase(const char* key)
+{
+    uint32_t hash = 0;
+
+    while(*key)
+        hash = tolower((unsigned char)(*(key++))) + (hash << 6) + (hash << 16) - hash;
+
+    return hash;
 }
 
 /* an element destructor that does nothing */
@@ -254,10 +403,8 @@ void* dictiterator_next_key(iterator_state_t* state)
     dictiterator_state_t* s = (dictiterator_state_t*)state;
     const dictionary_t* dict = s->dict;
 
-    if(s->current_index < darray_length(dict->entry)) {
-        const dictentry_t* entry = &dict->entry[s->current_index++];
-        return entry->key;
-    }
+    if(s->current_index < darray_length(dict->key))
+        return dict->key[s->current_index++];
 
     return NULL;
 }
@@ -268,10 +415,8 @@ void* dictiterator_next_value(iterator_state_t* state)
     dictiterator_state_t* s = (dictiterator_state_t*)state;
     const dictionary_t* dict = s->dict;
 
-    if(s->current_index < darray_length(dict->entry)) {
-        const dictentry_t* entry = &dict->entry[s->current_index++];
-        return entry->value;
-    }
+    if(s->current_index < darray_length(dict->value))
+        return dict->value[s->current_index++];
 
     return NULL;
 }
@@ -282,5 +427,5 @@ bool dictiterator_has_next(iterator_state_t* state)
     const dictiterator_state_t* s = (dictiterator_state_t*)state;
     const dictionary_t* dict = s->dict;
 
-    return s->current_index < darray_length(dict->entry);
-}
\ No newline at end of file
+    return s->current_index < darray_length(dict->key);
+}
@@ -37,4 +37,14 @@ void dictionary_put(dictionary_t* dict, const char* key, void* element);
 struct iterator_t* dictionary_keys(const dictionary_t* dict);
 struct iterator_t* dictionary_values(const dictionary_t* dict);
 
+/* allocation-free iteration, in insertion order */
+int dictionary_count(const dictionary_t* dict);
+const char* dictionary_key_at(const dictionary_t* dict, int index); /* 0 <= index < dictionary_count(dict) */
+void* dictionary_value_at(const dictionary_t* dict, int index);
+void* const* dictionary_value_array(const dictionary_t* dict); /* a dense array of dictionary_count(dict) elements; invalidated by dictionary_put() */
+void dictionary_foreach(const dictionary_t* dict, void (*callback)(const char*,void*,void*), void* data);
+
+/* memory */
+void dictionary_reserve(dictionary_t* dict, int count); /* preallocate room for count elements */
+
 #endif
\ No newline at end of file
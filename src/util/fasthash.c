@@ -41,7 +41,9 @@ struct fasthash_entry_t
 
 struct fasthash_t
 {
-    int length;
+    int length; /* number of ACTIVE entries */
+    int tombstones; /* number of DELETED entries */
+    int min_capacity; /* the table won't shrink below this */
     int capacity; /* a power of 2 */
     uint64_t cap_mask; /* capacity - 1 */
     fasthash_entry_t* data;
@@ -53,6 +55,8 @@ static const int SPARSITY = 4; /* 1 / load_factor */
 static fasthash_entry_t BLANK_ENTRY = { 0, NULL, BLANK };
 static inline uint64_t hash(uint64_t x);
 static void grow(fasthash_t* hashtable);
+static void rehash(fasthash_t* hashtable, int new_capacity);
+static int capacity_for(int length);
 static void empty_destructor(void* data);
 
 
@@ -72,7 +76,9 @@ fasthash_t* fasthash_create(void (*element_destructor)(void*), int lg2_cap)
     fasthash_t* hashtable = mallocx(sizeof(fasthash_t));
 
     hashtable->length = 0;
+    hashtable->tombstones = 0;
     hashtable->capacity = 1 << clip(lg2_cap, 2, 16); /* no more than 64K */
+    hashtable->min_capacity = hashtable->capacity;
     hashtable->cap_mask = hashtable->capacity - 1;
     hashtable->destructor = element_destructor ? element_destructor : empty_destructor;
     hashtable->data = mallocx(hashtable->capacity * sizeof(fasthash_entry_t));
@@ -104,6 +110,9 @@ fasthash_t* fasthash_destroy(fasthash_t* hashtable)
     (void)fasthash_put;
     (void)fasthash_delete;
     (void)fasthash_find;
+    (void)fasthash_reserve;
+    (void)fasthash_shrink;
+    (void)fasthash_stats;
 
     /* done */
     return NULL;
@@ -154,17 +163,17 @@ void fasthash_put(fasthash_t* hashtable, uint64_t key, void* value)
     if(value == NULL)
         return;
 
-    /* make it sparse */
-    if(hashtable->length < hashtable->capacity / SPARSITY) {
+    /* make it sparse. Tombstones count towards the load factor, since they
+       lengthen the probes just like the active entries do */
+    if(hashtable->length + hashtable->tombstones < hashtable->capacity / SPARSITY) {
         uint32_t k = hash(key) & hashtable->cap_mask;
+        uint32_t marker = hashtable->capacity;
 
         while(hashtable->data[k].state != BLANK) {
             if(hashtable->data[k].state == DELETED) {
-                /* replace deleted element */
-                hashtable->data[k].key = key;
-                hashtable->data[k].value = value;
-                hashtable->data[k].state = ACTIVE;
-                return;
+                /* save first deleted entry */
+                if(marker == hashtable->capacity)
+                    marker = k;
             }
             else if(hashtable->data[k].key == key) {
                 /* replace active element */
@@ -179,6 +188,12 @@ void fasthash_put(fasthash_t* hashtable, uint64_t key, void* value)
             ++k; k &= hashtable->cap_mask;
         }
 
+        /* reuse the first deleted entry of the probe sequence, if any */
+        if(marker < hashtable->capacity) {
+            k = marker;
+            hashtable->tombstones--;
+        }
+
         /* insert new element */
         hashtable->data[k].key = key;
         hashtable->data[k].value = value;
@@ -186,7 +201,7 @@ void fasthash_put(fasthash_t* hashtable, uint64_t key, void* value)
         hashtable->length++;
     }
     else {
-        /* grow the hash table and try again */
+        /* grow or compact the hash table and try again */
         grow(hashtable);
         fasthash_put(hashtable, key, value);
     }
@@ -202,15 +217,13 @@ bool fasthash_delete(fasthash_t* hashtable, uint64_t key)
     uint32_t k = hash(key) & hashtable->cap_mask;
 
     while(hashtable->data[k].state != BLANK) {
-        if(hashtable->data[k].key == key) {
-            if(hashtable->data[k].state == ACTIVE) {
-                /* lazy removal of the entry */
-                hashtable->data[k].state = DELETED;
-                hashtable->destructor(hashtable->data[k].value);
-                return true;
-            }
-            else
-                return false; /* duplicate removal */
+        if(hashtable->data[k].state == ACTIVE && hashtable->data[k].key == key) {
+            /* lazy removal of the entry */
+            hashtable->data[k].state = DELETED;
+            hashtable->length--;
+            hashtable->tombstones++;
+            hashtable->destructor(hashtable->data[k].value);
+            return true;
         }
 
         /* probe */
@@ -242,34 +255,125 @@ void* fasthash_find(fasthash_t* hashtable, bool (*test)(const void*,void*), void
     return NULL;
 }
 
+/*
+ * fasthash_reserve()
+ * Grows the hash table in bulk, so that it can store the given number of
+ * elements without rehashing
+ */
+void fasthash_reserve(fasthash_t* hashtable, int length)
+{
+    int new_capacity = capacity_for(length);
+
+    if(new_capacity > hashtable->capacity)
+        rehash(hashtable, new_capacity);
+}
+
+/*
+ * fasthash_shrink()
+ * Releases unused memory after many deletions. The hash table won't become
+ * smaller than its initial capacity. Tombstones are discarded
+ */
+void fasthash_shrink(fasthash_t* hashtable)
+{
+    int new_capacity = capacity_for(hashtable->length);
+
+    if(new_capacity < hashtable->min_capacity)
+        new_capacity = hashtable->min_capacity;
+
+    if(new_capacity < hashtable->capacity || hashtable->tombstones > 0)
+        rehash(hashtable, new_capacity);
+}
+
+/*
+ * fasthash_stats()
+ * Computes statistics about the hash table, so that we can see how much it
+ * has degraded. This walks the entire table
+ */
+void fasthash_stats(const fasthash_t* hashtable, fasthash_stats_t* stats)
+{
+    int total_probe_length = 0;
+
+    stats->length = hashtable->length;
+    stats->capacity = hashtable->capacity;
+    stats->tombstones = hashtable->tombstones;
+    stats->max_probe_length = 0;
+
+    for(int i = 0; i < hashtable->capacity; i++) {
+        if(hashtable->data[i].state == ACTIVE) {
+            uint32_t home = hash(hashtable->data[i].key) & hashtable->cap_mask;
+            int probe_length = 1 + (int)((i - home) & hashtable->cap_mask);
+
+            total_probe_length += probe_length;
+            if(probe_length > stats->max_probe_length)
+                stats->max_probe_length = probe_length;
+        }
+    }
+
+    stats->average_probe_length = hashtable->length > 0 ? (double)total_probe_length / hashtable->length : 0.0;
+    stats->tombstone_ratio = hashtable->length + hashtable->tombstones > 0 ? (double)hashtable->tombstones / (hashtable->length + hashtable->tombstones) : 0.0;
+}
+
 
 /* ----- private ----- */
 
+/* makes room for a new element */
 void grow(fasthash_t* hashtable)
+{
+    /* if at least half of the used entries are tombstones, compaction
+       alone brings the load factor down to acceptable levels */
+    if(hashtable->tombstones >= hashtable->length)
+        rehash(hashtable, hashtable->capacity);
+    else
+        rehash(hashtable, hashtable->capacity * 2);
+}
+
+/* reinserts all elements into a table with the given capacity (a power of 2),
+   discarding the tombstones */
+void rehash(fasthash_t* hashtable, int new_capacity)
 {
     int old_capacity = hashtable->capacity;
     fasthash_entry_t* old_data = hashtable->data;
 
-    /* double the capacity */
-    hashtable->capacity *= 2;
-    hashtable->cap_mask = (hashtable->cap_mask << 1) | 1;
+    /* allocate the new table */
+    hashtable->capacity = new_capacity;
+    hashtable->cap_mask = new_capacity - 1;
     hashtable->data = mallocx(hashtable->capacity * sizeof(fasthash_entry_t));
 
     /* clear the whole table */
     hashtable->length = 0;
+    hashtable->tombstones = 0;
     for(int i = 0; i < hashtable->capacity; i++)
         hashtable->data[i] = BLANK_ENTRY;
 
-    /* reinsert all elements with a new cap_mask */
+    /* reinsert all elements with a new cap_mask. There are no duplicate keys */
     for(int i = 0; i < old_capacity; i++) {
-        if(old_data[i].state == ACTIVE)
-            fasthash_put(hashtable, old_data[i].key, old_data[i].value);
+        if(old_data[i].state == ACTIVE) {
+            uint32_t k = hash(old_data[i].key) & hashtable->cap_mask;
+
+            while(hashtable->data[k].state != BLANK) {
+                ++k; k &= hashtable->cap_mask;
+            }
+
+            hashtable->data[k] = old_data[i];
+            hashtable->length++;
+        }
     }
 
     /* clear old memory */
     free(old_data);
 }
 
+/* the smallest capacity that accommodates the given number of elements */
+int capacity_for(int length)
+{
+    int capacity = 4;
+
+    while(length >= capacity / SPARSITY)
+        capacity *= 2;
+
+    return capacity;
+}
+
 uint64_t hash(uint64_t x)
 {
     /* splitmix64 */
@@ -36,12 +36,27 @@ No need to compile fasthash.c separately */
 #endif
 
 typedef struct fasthash_t fasthash_t;
+typedef struct fasthash_stats_t fasthash_stats_t;
 FASTHASH_API fasthash_t* fasthash_create(void (*element_destructor)(void*), int lg2_cap);
 FASTHASH_API fasthash_t* fasthash_destroy(fasthash_t* hashtable);
 FASTHASH_API void* fasthash_get(fasthash_t* hashtable, uint64_t key);
 FASTHASH_API void fasthash_put(fasthash_t* hashtable, uint64_t key, void* value);
 FASTHASH_API bool fasthash_delete(fasthash_t* hashtable, uint64_t key);
 FASTHASH_API void* fasthash_find(fasthash_t* hashtable, bool (*predicate)(const void*,void*), void* data);
+FASTHASH_API void fasthash_reserve(fasthash_t* hashtable, int length);
+FASTHASH_API void fasthash_shrink(fasthash_t* hashtable);
+FASTHASH_API void fasthash_stats(const fasthash_t* hashtable, fasthash_stats_t* stats);
+
+/* instrumentation */
+struct fasthash_stats_t
+{
+    int length; /* number of elements */
+    int capacity; /* number of entries of the table */
+    int tombstones; /* number of deleted entries */
+    double tombstone_ratio; /* tombstones / (length + tombstones) */
+    double average_probe_length; /* average number of entries inspected to find an element */
+    int max_probe_length;
+};
 
 #if defined(FASTHASH_INLINE)
 #include "fasthash.c"
@@ -33,8 +33,10 @@
 #include "../core/logfile.h"
 
 /* utilities */
-#define __H_CAPACITY               727 /* prime number */
-#define __H_BUCKET(h, key)         ((h)->hash_function(key) % __H_CAPACITY)
+#define __H_INITIAL_CAPACITY       727 /* prime number */
+#define __H_MAX_LOAD_FACTOR        1 /* grow the table when it has more entries than buckets */
+#define __H_BUCKET(h, hash)        ((hash) % (uint32_t)((h)->capacity))
+#define __H_MATCH(h, q, hash, k)   ((q)->hash == (hash) && (h)->key_compare((q)->key, (k)) == 0) /* compare the cached hashes first */
 #define __H_CONST(KEY_TYPE)        const KEY_TYPE
 
 /* hashtable_<typename> class: pretty much like C++ templates */
@@ -61,19 +63,25 @@ static void __h_unused_##T(); \
 typedef struct hashtable_##T hashtable_##T; \
 typedef struct hashtable_list_##T hashtable_list_##T; \
 struct hashtable_##T { \
-    hashtable_list_##T *data[__H_CAPACITY]; \
+    hashtable_list_##T **data; \
+    int capacity; /* number of buckets */ \
+    int count; /* number of entries */ \
     void (*destructor)(T*); \
     uint32_t (*hash_function)(__H_CONST(KEY_TYPE)); \
     int (*key_compare)(__H_CONST(KEY_TYPE),__H_CONST(KEY_TYPE)); \
     KEY_TYPE (*key_clone)(__H_CONST(KEY_TYPE)); \
     void (*key_delete)(KEY_TYPE); \
+    int sweep_cursor; /* next bucket of the incremental sweep */ \
 }; \
 struct hashtable_list_##T { \
     KEY_TYPE key; \
+    uint32_t hash; /* cached hash of the key */ \
     T *value;\
     int reference_count;\
+    int idle_sweeps; /* how many times the sweep has found this entry unreferenced */ \
     hashtable_list_##T *next; \
 }; \
+static void __h_grow_##T(hashtable_##T *h); \
 static hashtable_##T* hashtable_##T##_create() \
 { \
     int i; \
@@ -92,8 +100,12 @@ static hashtable_##T* hashtable_##T##_create() \
         h->key_clone = __h_default_clone_key_##T; \
     if(h->key_delete == NULL) \
         h->key_delete = __h_default_delete_key_##T; \
-    for(i = 0; i < __H_CAPACITY; i++) \
+    h->capacity = __H_INITIAL_CAPACITY; \
+    h->count = 0; \
+    h->data = mallocx(h->capacity * sizeof *(h->data)); \
+    for(i = 0; i < h->capacity; i++) \
         h->data[i] = NULL; \
+    h->sweep_cursor = 0; \
     return h; \
 } \
 static hashtable_##T* hashtable_##T##_destroy(hashtable_##T *h) \
@@ -101,7 +113,7 @@ static hashtable_##T* hashtable_##T##_destroy(hashtable_##T *h) \
     int i; \
     hashtable_list_##T *p, *q; \
     logfile_message("hashtable_" #T "_destroy()"); \
-    for(i = 0; i < __H_CAPACITY; i++) { \
+    for(i = 0; i < h->capacity; i++) { \
         p = h->data[i]; \
         while(p != NULL) { \
             q = p->next; \
@@ -113,16 +125,18 @@ static hashtable_##T* hashtable_##T##_destroy(hashtable_##T *h) \
             p = q; \
         } \
     } \
+    free(h->data); \
     free(h); \
     __h_unused_##T(); \
     return NULL; \
 } \
 static T* hashtable_##T##_find(const hashtable_##T *h, __H_CONST(KEY_TYPE) key) \
 { \
-    uint32_t k = __H_BUCKET(h, key); \
+    uint32_t hash = h->hash_function(key); \
+    uint32_t k = __H_BUCKET(h, hash); \
     hashtable_list_##T *q = h->data[k]; \
     while(q != NULL) { \
-        if(h->key_compare(q->key, key) == 0) \
+        if(__H_MATCH(h, q, hash, key)) \
             return q->value; \
         else \
             q = q->next; \
@@ -132,25 +146,34 @@ static T* hashtable_##T##_find(const hashtable_##T *h, __H_CONST(KEY_TYPE) key)
 static void hashtable_##T##_add(hashtable_##T *h, __H_CONST(KEY_TYPE) key, T *value) \
 { \
     if(NULL == hashtable_##T##_find(h, key)) { \
-        uint32_t k = __H_BUCKET(h, key); \
+        uint32_t hash = h->hash_function(key); \
+        uint32_t k; \
         hashtable_list_##T *q; \
+        if(h->count >= h->capacity * __H_MAX_LOAD_FACTOR) \
+            __h_grow_##T(h); \
+        k = __H_BUCKET(h, hash); \
         q = mallocx(sizeof *q); \
         q->key = (h->key_clone != NULL) ? h->key_clone(key) : (KEY_TYPE)key; \
+        q->hash = hash; \
         q->value = value; \
         q->reference_count = 0;\
+        q->idle_sweeps = 0; \
         q->next = h->data[k]; \
         h->data[k] = q; \
+        h->count++; \
     } \
 } \
 static void hashtable_##T##_remove(hashtable_##T *h, __H_CONST(KEY_TYPE) key) \
 { \
-    uint32_t k = __H_BUCKET(h, key); \
+    uint32_t hash = h->hash_function(key); \
+    uint32_t k = __H_BUCKET(h, hash); \
     hashtable_list_##T *p, *q; \
     if(h->data[k] != NULL) { \
         p = h->data[k]; \
-        if(h->key_compare(p->key, key) == 0) { \
+        if(__H_MATCH(h, p, hash, key)) { \
             if(p->reference_count <= 0) { \
                 h->data[k] = p->next; \
+                h->count--; \
                 if(h->destructor != NULL) \
                     h->destructor(p->value); \
                 if(h->key_delete != NULL) \
@@ -163,10 +186,11 @@ static void hashtable_##T##_remove(hashtable_##T *h, __H_CONST(KEY_TYPE) key) \
         } \
         else { \
             while(p->next != NULL) { \
-                if(h->key_compare(p->next->key, key) == 0) { \
+                if(__H_MATCH(h, p->next, hash, key)) { \
                     if(p->next->reference_count <= 0) { \
                         q = p->next; \
                         p->next = q->next; \
+                        h->count--; \
                         if(h->destructor != NULL) \
                             h->destructor(q->value); \
                         if(h->key_delete != NULL) \
@@ -184,10 +208,11 @@ static void hashtable_##T##_remove(hashtable_##T *h, __H_CONST(KEY_TYPE) key) \
 } \
 static bool hashtable_##T##_replace(const hashtable_##T *h, __H_CONST(KEY_TYPE) key, T *new_value) \
 { \
-    uint32_t k = __H_BUCKET(h, key); \
+    uint32_t hash = h->hash_function(key); \
+    uint32_t k = __H_BUCKET(h, hash); \
     hashtable_list_##T *q = h->data[k]; \
     while(q != NULL) { \
-        if(h->key_compare(q->key, key) == 0) { \
+        if(__H_MATCH(h, q, hash, key)) { \
             if(q->reference_count <= 0) { \
                 if(h->destructor != NULL) \
                     h->destructor(q->value); \
@@ -208,7 +233,7 @@ static int hashtable_##T##_foreach(hashtable_##T *h, void *data, void (*callback
 { \
     int i, count = 0; \
     hashtable_list_##T *p; \
-    for(i = 0; i < __H_CAPACITY; i++) { \
+    for(i = 0; i < h->capacity; i++) { \
         for(p = h->data[i]; p != NULL; p = p->next) { \
             ++count; \
             callback(p->value, data); \
@@ -219,7 +244,7 @@ static int hashtable_##T##_foreach(hashtable_##T *h, void *data, void (*callback
 static T* hashtable_##T##_findsome(hashtable_##T *h, void *data, bool (*test_fn)(T*,void*)) \
 { \
     hashtable_list_##T *p; \
-    for(int i = 0; i < __H_CAPACITY; i++) { \
+    for(int i = 0; i < h->capacity; i++) { \
         for(p = h->data[i]; p != NULL; p = p->next) { \
             if(test_fn(p->value, data)) \
                 return p->value; \
@@ -229,11 +254,14 @@ static T* hashtable_##T##_findsome(hashtable_##T *h, void *data, bool (*test_fn)
 } \
 static int hashtable_##T##_ref(hashtable_##T *h, __H_CONST(KEY_TYPE) key) \
 { \
-    uint32_t k = __H_BUCKET(h, key); \
+    uint32_t hash = h->hash_function(key); \
+    uint32_t k = __H_BUCKET(h, hash); \
     hashtable_list_##T *q = h->data[k]; \
     while(q != NULL) { \
-        if(h->key_compare(q->key, key) == 0) \
+        if(__H_MATCH(h, q, hash, key)) { \
+            q->idle_sweeps = 0; \
             return ++(q->reference_count); \
+        } \
         else \
             q = q->next; \
     } \
@@ -242,10 +270,11 @@ static int hashtable_##T##_ref(hashtable_##T *h, __H_CONST(KEY_TYPE) key) \
 } \
 static int hashtable_##T##_unref(hashtable_##T *h, __H_CONST(KEY_TYPE) key) \
 { \
-    uint32_t k = __H_BUCKET(h, key); \
+    uint32_t hash = h->hash_function(key); \
+    uint32_t k = __H_BUCKET(h, hash); \
     hashtable_list_##T *q = h->data[k]; \
     while(q != NULL) { \
-        if(h->key_compare(q->key, key) == 0) { \
+        if(__H_MATCH(h, q, hash, key)) { \
             q->reference_count = max(0, q->reference_count - 1); \
             return q->reference_count; \
         } \
@@ -257,10 +286,11 @@ static int hashtable_##T##_unref(hashtable_##T *h, __H_CONST(KEY_TYPE) key) \
 } \
 static int hashtable_##T##_refcount(const hashtable_##T *h, __H_CONST(KEY_TYPE) key) \
 { \
-    uint32_t k = __H_BUCKET(h, key); \
+    uint32_t hash = h->hash_function(key); \
+    uint32_t k = __H_BUCKET(h, hash); \
     const hashtable_list_##T *q = h->data[k]; \
     while(q != NULL) { \
-        if(h->key_compare(q->key, key) == 0) \
+        if(__H_MATCH(h, q, hash, key)) \
             return q->reference_count; \
         else \
             q = q->next; \
@@ -273,7 +303,7 @@ static void hashtable_##T##_release_unreferenced_entries(hashtable_##T *h) \
              to store the unreferenced entries */ \
     int i; \
     hashtable_list_##T *q; \
-    for(i = 0; i < __H_CAPACITY; i++) { \
+    for(i = 0; i < h->capacity; i++) { \
         for(q = h->data[i]; q != NULL; q = q->next) { \
             if(q->reference_count <= 0) { \
                 hashtable_##T##_remove(h, q->key); \
@@ -282,6 +312,54 @@ static void hashtable_##T##_release_unreferenced_entries(hashtable_##T *h) \
         } \
     } \
 } \
+static int hashtable_##T##_sweep_unreferenced_entries(hashtable_##T *h, int bucket_count, int grace) \
+{ \
+    /* visit bucket_count buckets, releasing the entries that have
+       been found unreferenced more than grace times in a row */ \
+    int removed = 0; \
+    for(int n = min(bucket_count, h->capacity); n > 0; n--) { \
+        hashtable_list_##T **p = &(h->data[h->sweep_cursor]); \
+        while(*p != NULL) { \
+            hashtable_list_##T *q = *p; \
+            if(q->reference_count <= 0 && ++(q->idle_sweeps) > grace) { \
+                *p = q->next; \
+                if(h->destructor != NULL) \
+                    h->destructor(q->value); \
+                if(h->key_delete != NULL) \
+                    h->key_delete(q->key); \
+                free(q); \
+                h->count--; \
+                removed++; \
+            } \
+            else \
+                p = &(q->next); \
+        } \
+        h->sweep_cursor = (h->sweep_cursor + 1) % h->capacity; \
+    } \
+    return removed; \
+} \
+static void __h_grow_##T(hashtable_##T *h) \
+{ \
+    /* rehash the entries using the cached hashes */ \
+    int new_capacity = 2 * h->capacity + 1; \
+    hashtable_list_##T **new_data = mallocx(new_capacity * sizeof *new_data); \
+    for(int i = 0; i < new_capacity; i++) \
+        new_data[i] = NULL; \
+    for(int i = 0; i < h->capacity; i++) { \
+        hashtable_list_##T *q = h->data[i]; \
+        while(q != NULL) { \
+            hashtable_list_##T *next = q->next; \
+            uint32_t k = q->hash % (uint32_t)new_capacity; \
+            q->next = new_data[k]; \
+            new_data[k] = q; \
+            q = next; \
+        } \
+    } \
+    free(h->data); \
+    h->data = new_data; \
+    h->capacity = new_capacity; \
+    h->sweep_cursor = 0; \
+} \
 static uint32_t __h_hash_string_##T(const char *key) \
 { \
     uint32_t hash = 0; \
@@ -291,16 +369,18 @@ static uint32_t __h_hash_string_##T(const char *key) \
 } \
 static int __h_compare_string_##T(const char *key1, const char *key2) \
 { \
-    /* case-insensitive comparison */ \
-    return str_icmp(key1, key2); \
+    /* case-insensitive comparison; keys are interned, so callers that pass \
+       a stored key skip the string comparison */ \
+    return key1 == key2 ? 0 : str_icmp(key1, key2); \
 } \
 static char* __h_clone_string_##T(const char *key) \
 { \
-    return strcpy(mallocx((1 + strlen(key)) * sizeof(char)), key); \
+    /* store the keys once; they're shared with other tables */ \
+    return (char*)str_intern(key); \
 } \
 static void __h_delete_string_##T(char *key) \
 { \
-    free(key); \
+    (void)key; /* interned strings are never freed individually */ \
 } \
 static uint32_t __h_default_hash_key_##T(__H_CONST(KEY_TYPE) key) \
 { \
@@ -308,7 +388,7 @@ static uint32_t __h_default_hash_key_##T(__H_CONST(KEY_TYPE) key) \
     const uint8_t* data = (const uint8_t*)key; \
     for(size_t j = 0; j < sizeof *key; j++) \
         hash = (uint32_t)(data[j]) + (hash << 6) + (hash << 16) - hash; \
-    return 0; \
+    return hash; \
 } \
 static int __h_default_compare_key_##T(__H_CONST(KEY_TYPE) key1, __H_CONST(KEY_TYPE) key2) \
 { \
@@ -337,6 +417,8 @@ static void __h_unused_##T() \
     (void)hashtable_##T##_refcount; \
     (void)hashtable_##T##_unref; \
     (void)hashtable_##T##_release_unreferenced_entries; \
+    (void)hashtable_##T##_sweep_unreferenced_entries; \
+    (void)__h_grow_##T; \
     (void)__h_hash_string_##T; \
     (void)__h_compare_string_##T; \
     (void)__h_clone_string_##T; \
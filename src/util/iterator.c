@@ -32,8 +32,13 @@ struct iterator_t
 
     void* (*next)(iterator_state_t*);
     bool (*has_next)(iterator_state_t*);
+
+    bool is_inplace; /* is this an in-place iterator? */
 };
 
+/* the header of the in-place storage must fit an iterator_t */
+typedef char iterator_header_size_check[sizeof(iterator_t) <= sizeof(((iteratorstorage_t*)0)->header) ? 1 : -1];
+
 
 
 /*
@@ -50,6 +55,33 @@ iterator_t* iterator_create(void* ctor_data, iterator_state_t* (*state_ctor)(voi
     it->next = next_fn;
     it->has_next = has_next_fn;
 
+    it->is_inplace = false;
+
+    return it;
+}
+
+/*
+ * iterator_create_inplace()
+ * Creates an in-place iterator, i.e., an iterator stored in the given storage.
+ * Its state is a copy of state_data, which must not exceed
+ * ITERATOR_INPLACE_STATE_SIZE bytes. No memory is allocated.
+ * state_dtor may be NULL; if it's not, it must not free the state itself.
+ */
+iterator_t* iterator_create_inplace(iteratorstorage_t* storage, const void* state_data, size_t state_size, void (*state_dtor)(iterator_state_t*), void* (*next_fn)(iterator_state_t*), bool (*has_next_fn)(iterator_state_t*))
+{
+    iterator_t* it = (iterator_t*)(storage->header);
+
+    if(state_size > sizeof(storage->state))
+        fatal_error("%s: the state of the iterator is too large (%lu bytes)", __func__, (unsigned long)state_size);
+
+    it->state = memcpy(storage->state.bytes, state_data, state_size);
+    it->state_dtor = state_dtor;
+
+    it->next = next_fn;
+    it->has_next = has_next_fn;
+
+    it->is_inplace = true;
+
     return it;
 }
 
@@ -59,6 +91,14 @@ iterator_t* iterator_create(void* ctor_data, iterator_state_t* (*state_ctor)(voi
  */
 iterator_t* iterator_destroy(iterator_t* it)
 {
+    /* in-place iterators don't own their memory */
+    if(it->is_inplace) {
+        if(it->state_dtor != NULL)
+            it->state_dtor(it->state);
+
+        return NULL;
+    }
+
     it->state_dtor(it->state);
     free(it);
 
@@ -142,6 +182,22 @@ iterator_t* iterator_create_from_array(void* array, size_t length, size_t elemen
     return iterator_create(&state, arrayiterator_copy_ctor, arrayiterator_dtor, arrayiterator_next, arrayiterator_has_next);
 }
 
+/*
+ * iterator_create_from_array_inplace()
+ * Creates an in-place iterator suitable for iterating over a fixed-size array
+ */
+iterator_t* iterator_create_from_array_inplace(iteratorstorage_t* storage, void* array, size_t length, size_t element_size_in_bytes)
+{
+    arrayiterator_state_t state = {
+        .array = array,
+        .length = length,
+        .element_size_in_bytes = element_size_in_bytes,
+        .current_index = 0
+    };
+
+    return iterator_create_inplace(storage, &state, sizeof(state), NULL, arrayiterator_next, arrayiterator_has_next);
+}
+
 
 
 
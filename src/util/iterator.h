@@ -39,11 +39,28 @@ iterator_destroy(it);
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 /* opaque type */
 typedef struct iterator_t iterator_t;
 typedef void iterator_state_t;
 
+/* storage for in-place iterators (see below)
+   the fields are private; they are declared here so that the storage may be
+   allocated on the stack */
+#define ITERATOR_INPLACE_STATE_SIZE 64 /* in bytes */
+typedef struct iteratorstorage_t iteratorstorage_t;
+struct iteratorstorage_t
+{
+    void* header[6];
+    union {
+        void* ptr;
+        double dbl;
+        uint64_t u64;
+        unsigned char bytes[ITERATOR_INPLACE_STATE_SIZE];
+    } state;
+};
+
 iterator_t* iterator_create(void* ctor_data, iterator_state_t* (*state_ctor)(void*), void (*state_dtor)(iterator_state_t*), void* (*next_fn)(iterator_state_t*), bool (*has_next_fn)(iterator_state_t*)); /* creates a new general-purpose iterator */
 iterator_t* iterator_destroy(iterator_t* it); /* destroys an iterator */
 
@@ -55,6 +72,25 @@ bool iterator_foreach(iterator_t* it, void* data, bool (*callback)(void* element
 typedef iterator_t arrayiterator_t;
 arrayiterator_t* iterator_create_from_array(void* array, size_t length, size_t element_size_in_bytes); /* creates a new iterator suitable for iterating over a fixed-size array */
 
+/*
+
+In-place iterators are stored in memory provided by the caller and
+do not allocate memory. This is useful in hot paths. Usage example:
+
+iteratorstorage_t storage;
+iterator_t* it = iterator_create_from_array_inplace(&storage, arr, n, sizeof *arr);
+while(iterator_has_next(it)) {
+    int* element = iterator_next(it);
+    printf("%d ", *element);
+}
+iterator_destroy(it);
+
+Calling iterator_destroy() is still required. It will not free the storage.
+
+*/
+iterator_t* iterator_create_inplace(iteratorstorage_t* storage, const void* state_data, size_t state_size, void (*state_dtor)(iterator_state_t*), void* (*next_fn)(iterator_state_t*), bool (*has_next_fn)(iterator_state_t*)); /* creates an in-place iterator whose state is a copy of the given data; state_dtor may be NULL */
+arrayiterator_t* iterator_create_from_array_inplace(iteratorstorage_t* storage, void* array, size_t length, size_t element_size_in_bytes); /* creates an in-place iterator suitable for iterating over a fixed-size array */
+
 /*
 #define ITERATOR_STATE(it) (*((iterator_state_t**)(it)))
 */
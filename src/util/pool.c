@@ -0,0 +1,193 @@
+/*
+ * Open Surge Engine
+ * pool.c - free-list allocator for small objects
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include "pool.h"
+#include "util.h"
+
+/* alignment of the allocations, in bytes */
+typedef union { void* p; double d; long long ll; void (*fn)(); } pool_align_t;
+#define ALIGNMENT (sizeof(pool_align_t))
+#define ALIGN(n) (((n) + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1))
+
+/* size classes: class k holds payloads of up to (k+1) * ALIGNMENT bytes */
+#define NUM_CLASSES             64
+#define LARGE_CLASS             NUM_CLASSES /* larger blocks use the general-purpose allocator */
+#define BLOCKS_PER_CHUNK        32
+
+/* the header of a block precedes its payload */
+typedef union poolheader_t poolheader_t;
+union poolheader_t
+{
+    int size_class;
+    pool_align_t align;
+};
+
+/* a free block stores a pointer to the next free block of its class */
+typedef struct poolfreeblock_t poolfreeblock_t;
+struct poolfreeblock_t
+{
+    poolfreeblock_t* next;
+};
+
+/* a chunk of memory holding BLOCKS_PER_CHUNK blocks of the same class */
+typedef struct poolchunk_t poolchunk_t;
+struct poolchunk_t
+{
+    poolchunk_t* next;
+    uint8_t* data;
+};
+
+/* pool */
+struct pool_t
+{
+    poolfreeblock_t* free_list[NUM_CLASSES]; /* free blocks of each class */
+    poolchunk_t* chunk; /* all chunks */
+    int count; /* number of allocated blocks */
+};
+
+static void add_chunk(pool_t* pool, int size_class);
+
+
+
+/*
+ * pool_create()
+ * Creates a new pool
+ */
+pool_t* pool_create()
+{
+    pool_t* pool = mallocx(sizeof *pool);
+
+    for(int k = 0; k < NUM_CLASSES; k++)
+        pool->free_list[k] = NULL;
+
+    pool->chunk = NULL;
+    pool->count = 0;
+
+    return pool;
+}
+
+/*
+ * pool_destroy()
+ * Destroys a pool, releasing all of its blocks at once. Blocks of the
+ * large class must have been freed with pool_free()
+ */
+pool_t* pool_destroy(pool_t* pool)
+{
+    while(pool->chunk != NULL) {
+        poolchunk_t* next = pool->chunk->next;
+        free(pool->chunk->data);
+        free(pool->chunk);
+        pool->chunk = next;
+    }
+
+    free(pool);
+    return NULL;
+}
+
+/*
+ * pool_alloc()
+ * Allocates a block of memory from the pool. The returned pointer is
+ * suitably aligned for any type and is valid until it's freed with
+ * pool_free() or until the pool is destroyed
+ */
+void* pool_alloc(pool_t* pool, size_t bytes)
+{
+    int size_class = (bytes > 0) ? (int)((ALIGN(bytes) / ALIGNMENT) - 1) : 0;
+    poolheader_t* header;
+
+    /* large block */
+    if(bytes > NUM_CLASSES * ALIGNMENT) {
+        header = mallocx(sizeof(poolheader_t) + bytes);
+        header->size_class = LARGE_CLASS;
+        pool->count++;
+        return header + 1;
+    }
+
+    /* no free blocks of this class? */
+    if(pool->free_list[size_class] == NULL)
+        add_chunk(pool, size_class);
+
+    /* pop a free block */
+    poolfreeblock_t* block = pool->free_list[size_class];
+    pool->free_list[size_class] = block->next;
+    pool->count++;
+
+    return block;
+}
+
+/*
+ * pool_free()
+ * Returns a block of memory, allocated with pool_alloc(), to the pool
+ */
+void pool_free(pool_t* pool, void* ptr)
+{
+    if(ptr == NULL)
+        return;
+
+    poolheader_t* header = (poolheader_t*)ptr - 1;
+    int size_class = header->size_class;
+    pool->count--;
+
+    /* large block */
+    if(size_class == LARGE_CLASS) {
+        free(header);
+        return;
+    }
+
+    /* push it to the free list of its class */
+    poolfreeblock_t* block = ptr;
+    block->next = pool->free_list[size_class];
+    pool->free_list[size_class] = block;
+}
+
+/*
+ * pool_count()
+ * How many blocks are currently allocated?
+ */
+int pool_count(const pool_t* pool)
+{
+    return pool->count;
+}
+
+
+
+/* private */
+
+/* adds a chunk of free blocks of the given class to the pool */
+void add_chunk(pool_t* pool, int size_class)
+{
+    size_t stride = sizeof(poolheader_t) + (size_class + 1) * ALIGNMENT;
+    poolchunk_t* chunk = mallocx(sizeof *chunk);
+
+    chunk->data = mallocx(BLOCKS_PER_CHUNK * stride);
+    chunk->next = pool->chunk;
+    pool->chunk = chunk;
+
+    /* thread the blocks, in address order, into the free list */
+    for(int i = BLOCKS_PER_CHUNK - 1; i >= 0; i--) {
+        poolheader_t* header = (poolheader_t*)(chunk->data + i * stride);
+        poolfreeblock_t* block = (poolfreeblock_t*)(header + 1);
+
+        header->size_class = size_class;
+        block->next = pool->free_list[size_class];
+        pool->free_list[size_class] = block;
+    }
+}
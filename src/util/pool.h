@@ -0,0 +1,52 @@
+/*
+ * Open Surge Engine
+ * pool.h - free-list allocator for small objects
+ * Copyright 2008-2024 Alexandre Martins <alemartf(at)gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _POOL_H
+#define _POOL_H
+
+/*
+
+A pool allocates small objects of many sizes from free lists, one for each
+size class. Freed blocks are reused by later allocations of a similar size,
+so that objects that are created and destroyed often don't go through the
+general-purpose allocator. All blocks are released at once when the pool is
+destroyed. Usage example:
+
+pool_t* pool = pool_create();
+
+item_t* item = pool_alloc(pool, sizeof *item);
+...
+pool_free(pool, item);
+
+pool_destroy(pool); // releases everything, including blocks not yet freed
+
+*/
+
+#include <stddef.h>
+
+typedef struct pool_t pool_t;
+
+pool_t* pool_create(); /* creates a new pool */
+pool_t* pool_destroy(pool_t* pool); /* destroys a pool, releasing all of its blocks at once */
+void* pool_alloc(pool_t* pool, size_t bytes); /* allocates a block; the returned pointer is suitably aligned for any type */
+void pool_free(pool_t* pool, void* ptr); /* returns a block to the pool; ptr may be NULL */
+int pool_count(const pool_t* pool); /* how many blocks are currently allocated? */
+
+#endif
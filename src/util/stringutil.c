@@ -21,8 +21,51 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <stddef.h>
 #include "stringutil.h"
 #include "util.h"
+#include "darray.h"
+#include "arena.h"
+
+/*
+
+STRING INTERNING
+
+Interned strings are stored in an arena, each preceded by a header with its
+precomputed hashes and a stable id. The header is found by pointer arithmetic,
+so the str_intern_*() functions that take an interned string must not be
+given an arbitrary string.
+
+Lookups use an open-addressing table of pointers to the headers, kept at most
+half full. Comparing two interned strings is a pointer comparison; comparing
+them case-insensitively is a comparison of their folded (lowercase) variants,
+which are interned as well.
+
+*/
+
+typedef struct internedstr_t internedstr_t;
+struct internedstr_t
+{
+    uint32_t hash; /* case-sensitive hash */
+    uint32_t folded_hash; /* case-insensitive hash */
+    int id; /* index in the interned[] array */
+    const char* folded; /* interned lowercase variant; NULL until requested */
+    char str[]; /* null-terminated */
+};
+
+#define INTERNED_HEADER(s)           ((internedstr_t*)((char*)(s) - offsetof(internedstr_t, str)))
+#define INTERN_ARENA_BLOCK_SIZE      (16 * 1024) /* in bytes */
+#define INTERN_MIN_SLOTS             256 /* a power of two */
+
+static arena_t* intern_arena = NULL;
+static internedstr_t** intern_slot = NULL;
+static int intern_slot_count = 0; /* a power of two or zero */
+STATIC_DARRAY(internedstr_t*, interned); /* indexed by id */
+
+static int find_interned_slot(const char* str, uint32_t hash);
+static void grow_intern_table();
+static uint32_t str_hash(const char* str);
+static uint32_t str_ihash(const char* str);
 
 /*
  * str_to_upper()
@@ -439,4 +482,197 @@ uint64_t str_to_x64(const char* buf)
         value = (value << 4) | t[*(buf++) & 127];
 
     return value;
-}
\ No newline at end of file
+}
+
+
+
+/*
+ * str_intern()
+ * Returns the interned copy of a string. The same pointer is returned for
+ * identical strings. Interned strings must not be modified or freed.
+ */
+const char* str_intern(const char* str)
+{
+    /* already interned? */
+    uint32_t hash = str_hash(str);
+    int slot = find_interned_slot(str, hash);
+    if(slot >= 0 && intern_slot[slot] != NULL)
+        return intern_slot[slot]->str;
+
+    /* lazy initialization */
+    if(intern_arena == NULL) {
+        intern_arena = arena_create(INTERN_ARENA_BLOCK_SIZE);
+        darray_init(interned);
+    }
+
+    /* keep the table at most half full */
+    if(2 * (darray_length(interned) + 1) > intern_slot_count) {
+        grow_intern_table();
+        slot = find_interned_slot(str, hash);
+    }
+
+    /* intern the string */
+    size_t size = strlen(str) + 1;
+    internedstr_t* entry = arena_alloc(intern_arena, offsetof(internedstr_t, str) + size);
+    memcpy(entry->str, str, size);
+    entry->hash = hash;
+    entry->folded_hash = str_ihash(str);
+    entry->id = darray_length(interned);
+    entry->folded = NULL;
+
+    intern_slot[slot] = entry;
+    darray_push(interned, entry);
+
+    return entry->str;
+}
+
+/*
+ * str_intern_find()
+ * Returns the interned copy of a string, or NULL if the string hasn't been
+ * interned. Unlike str_intern(), this never allocates memory.
+ */
+const char* str_intern_find(const char* str)
+{
+    int slot = find_interned_slot(str, str_hash(str));
+
+    if(slot >= 0 && intern_slot[slot] != NULL)
+        return intern_slot[slot]->str;
+
+    return NULL;
+}
+
+/*
+ * str_intern_id()
+ * A stable id of an interned string
+ */
+int str_intern_id(const char* interned_str)
+{
+    return INTERNED_HEADER(interned_str)->id;
+}
+
+/*
+ * str_intern_by_id()
+ * The interned string with the given id, or NULL if there is no such string
+ */
+const char* str_intern_by_id(int id)
+{
+    if(id >= 0 && id < darray_length(interned))
+        return interned[id]->str;
+
+    return NULL;
+}
+
+/*
+ * str_intern_hash()
+ * The precomputed case-insensitive hash of an interned string
+ */
+uint32_t str_intern_hash(const char* interned_str)
+{
+    return INTERNED_HEADER(interned_str)->folded_hash;
+}
+
+/*
+ * str_intern_folded()
+ * The interned lowercase variant of an interned string. Two interned strings
+ * are equal, ignoring case, if and only if their folded variants are the same
+ * pointer.
+ */
+const char* str_intern_folded(const char* interned_str)
+{
+    internedstr_t* entry = INTERNED_HEADER(interned_str);
+
+    if(entry->folded == NULL) {
+        char buffer[256];
+        size_t size = strlen(interned_str) + 1;
+        char* lowercase = size <= sizeof(buffer) ? buffer : mallocx(size);
+
+        for(size_t i = 0; i < size; i++)
+            lowercase[i] = tolower((unsigned char)interned_str[i]);
+
+        entry->folded = str_intern(lowercase);
+        INTERNED_HEADER(entry->folded)->folded = entry->folded;
+
+        if(lowercase != buffer)
+            free(lowercase);
+    }
+
+    return entry->folded;
+}
+
+/*
+ * str_intern_release()
+ * Releases all interned strings. Call this after everything else.
+ */
+void str_intern_release()
+{
+    if(intern_arena == NULL)
+        return;
+
+    free(intern_slot);
+    intern_slot = NULL;
+    intern_slot_count = 0;
+
+    darray_release(interned);
+    intern_arena = arena_destroy(intern_arena);
+}
+
+/* the slot of the interned string; the slot of the insertion point if not found.
+   Returns -1 if the table is empty */
+int find_interned_slot(const char* str, uint32_t hash)
+{
+    if(intern_slot_count == 0)
+        return -1;
+
+    uint32_t mask = (uint32_t)(intern_slot_count - 1);
+    for(uint32_t k = hash & mask; ; k = (k + 1) & mask) {
+        const internedstr_t* entry = intern_slot[k];
+
+        if(entry == NULL || (entry->hash == hash && strcmp(entry->str, str) == 0))
+            return (int)k;
+    }
+}
+
+/* doubles the capacity of the table of interned strings */
+void grow_intern_table()
+{
+    int new_slot_count = intern_slot_count > 0 ? 2 * intern_slot_count : INTERN_MIN_SLOTS;
+    uint32_t mask = (uint32_t)(new_slot_count - 1);
+
+    free(intern_slot);
+    intern_slot = mallocx(new_slot_count * sizeof(*intern_slot));
+    intern_slot_count = new_slot_count;
+
+    for(int k = 0; k < new_slot_count; k++)
+        intern_slot[k] = NULL;
+
+    for(int i = 0; i < darray_length(interned); i++) {
+        uint32_t k = interned[i]->hash & mask;
+
+        while(intern_slot[k] != NULL)
+            k = (k + 1) & mask;
+
+        intern_slot[k] = interned[i];
+    }
+}
+
+/* case-sensitive hash of a string */
+uint32_t str_hash(const char* str)
+{
+    uint32_t hash = 0;
+
+    while(*str)
+        hash = (unsigned char)(*(str++)) + (hash << 6) + (hash << 16) - hash;
+
+    return hash;
+}
+
+/* case-insensitive hash of a string; the same hash used by the hash tables */
+uint32_t str_ihash(const char* str)
+{
+    uint32_t hash = 0;
+
+    while(*str)
+        hash = tolower(*(str++)) + (hash << 6) + (hash << 16) - hash;
+
+    return hash;
+}
@@ -50,6 +50,16 @@ char* str_basename_without_extension(const char* path, char* buffer, size_t buff
 char* x64_to_str(uint64_t value, char* buf, size_t size); /* converts a 64-bit value to a padded hex-string */
 uint64_t str_to_x64(const char* buf); /* converts a hex-string to a 64-bit value */
 
+/* String interning: an interned string is stored once and lives until str_intern_release().
+   Identical strings share the same pointer. Use these functions in the main thread only */
+const char* str_intern(const char* str); /* returns the interned copy of str */
+const char* str_intern_find(const char* str); /* returns the interned copy of str, or NULL if str hasn't been interned */
+int str_intern_id(const char* interned_str); /* a stable id of an interned string: 0, 1, 2... */
+const char* str_intern_by_id(int id); /* the interned string with the given id, or NULL if there is no such string */
+uint32_t str_intern_hash(const char* interned_str); /* the precomputed case-insensitive hash of an interned string */
+const char* str_intern_folded(const char* interned_str); /* the interned lowercase variant of an interned string */
+void str_intern_release(); /* releases all interned strings */
+
 /* Macros */
 #define atob(str)           (str_icmp((str), "true") == 0)
 
@@ -23,34 +23,11 @@
 #include "transform.h"
 #include "numeric.h"
 
-/*
- * transform_identity()
- * Create an identity transform
- */
-transform_t* transform_identity(transform_t* t)
-{
-    t->m[0] = 1.0f;
-    t->m[1] = 0.0f;
-    t->m[2] = 0.0f;
-    t->m[3] = 0.0f;
-
-    t->m[4] = 0.0f;
-    t->m[5] = 1.0f;
-    t->m[6] = 0.0f;
-    t->m[7] = 0.0f;
-
-    t->m[8] = 0.0f;
-    t->m[9] = 0.0f;
-    t->m[10] = 1.0f;
-    t->m[11] = 0.0f;
-
-    t->m[12] = 0.0f;
-    t->m[13] = 0.0f;
-    t->m[14] = 0.0f;
-    t->m[15] = 1.0f;
-
-    return t;
-}
+/* SIMD */
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define WANT_SSE 1
+#endif
 
 /*
  * transform_build()
@@ -95,43 +72,6 @@ transform_t* transform_build(transform_t* t, v2d_t translation, float rotation,
    return t;
 }
 
-/*
- * transform_copy()
- * Copy src to dest
- */
-transform_t* transform_copy(transform_t* dest, const transform_t* src)
-{
-    *dest = *src;
-    return dest;
-}
-
-/*
- * transform_translate()
- * Translation
- */
-transform_t* transform_translate(transform_t* t, v2d_t offset)
-{
-    /*
-
-    pre-multiply by
-
-    [ 1  .  .  tx ]
-    [ .  1  .  ty ]
-    [ .  .  1  .  ]
-    [ .  .  .  1  ]
-
-    */
-
-    /*float one = t->m[15];
-    t->m[12] += offset.x * one;
-    t->m[13] += offset.y * one;*/
-
-    t->m[12] += offset.x;
-    t->m[13] += offset.y;
-
-    return t;
-}
-
 /*
  * transform_rotate()
  * Rotation
@@ -172,72 +112,36 @@ transform_t* transform_rotate(transform_t* t, float radians)
 }
 
 /*
- * transform_scale()
- * Scale
- */
-transform_t* transform_scale(transform_t* t, v2d_t scale)
-{
-    /*
-
-    pre-multiply by
-
-    [ sx  .  .  . ]
-    [ .  sy  .  . ]
-    [ .   .  1  . ]
-    [ .   .  .  1 ]
-
-    */
-
-    t->m[0] *= scale.x;
-    t->m[1] *= scale.y;
-
-    t->m[4] *= scale.x;
-    t->m[5] *= scale.y;
-
-    t->m[8] *= scale.x;
-    t->m[9] *= scale.y;
-
-    t->m[12] *= scale.x;
-    t->m[13] *= scale.y;
-
-    return t;
-}
-
-/*
- * transform_compose()
- * Pre-multiplies T by A, i.e., T := A * T
+ * transform_compose_all()
+ * Pre-multiplies n transforms by A, i.e., T[i] := A * T[i] for all i
  */
-transform_t* transform_compose(transform_t* t, const transform_t* a)
+void transform_compose_all(transform_t* t, int n, const transform_t* a)
 {
-    #define DOT(row, col) ( \
-        a->m[(row) + 0] * t->m[(col) * 4 + 0] + \
-        a->m[(row) + 4] * t->m[(col) * 4 + 1] + \
-        a->m[(row) + 8] * t->m[(col) * 4 + 2] + \
-        a->m[(row) + 12] * t->m[(col) * 4 + 3] \
-    )
-
-    *t = (const transform_t){ .m = {
-        DOT(0, 0),
-        DOT(1, 0),
-        DOT(2, 0),
-        DOT(3, 0),
-                    DOT(0, 1),
-                    DOT(1, 1),
-                    DOT(2, 1),
-                    DOT(3, 1),
-                                DOT(0, 2),
-                                DOT(1, 2),
-                                DOT(2, 2),
-                                DOT(3, 2),
-                                            DOT(0, 3),
-                                            DOT(1, 3),
-                                            DOT(2, 3),
-                                            DOT(3, 3)
-    }};
-
-    return t;
-
-    #undef DOT
+#if defined(WANT_SSE)
+    /* the columns of A */
+    __m128 a0 = _mm_loadu_ps(a->m + 0);
+    __m128 a1 = _mm_loadu_ps(a->m + 4);
+    __m128 a2 = _mm_loadu_ps(a->m + 8);
+    __m128 a3 = _mm_loadu_ps(a->m + 12);
+
+    /* column j of A * T is a linear combination of the columns of A,
+       weighted by column j of T */
+    for(int i = 0; i < n; i++) {
+        float* m = t[i].m;
+
+        for(int j = 0; j < 16; j += 4) {
+            __m128 col = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(m[j+0])), _mm_mul_ps(a1, _mm_set1_ps(m[j+1]))),
+                _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(m[j+2])), _mm_mul_ps(a3, _mm_set1_ps(m[j+3])))
+            );
+
+            _mm_storeu_ps(m + j, col);
+        }
+    }
+#else
+    for(int i = 0; i < n; i++)
+        transform_compose(&t[i], a);
+#endif
 }
 
 /*
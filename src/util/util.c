@@ -76,6 +76,7 @@
 static void merge_sort_recursive(void *base, size_t size, int (*comparator)(const void*,const void*), int p, int q, uint8_t *tmp, size_t tmp_size);
 static inline void merge_sort_mix(void *base, size_t size, int (*comparator)(const void*,const void*), int p, int q, int m, uint8_t *tmp, size_t tmp_size);
 static int wrapped_mkdir(const char* path, mode_t mode);
+static bool has_message_boxes = true; /* unattended runs must not block on a message box */
 
 
 
@@ -151,6 +152,7 @@ void fatal_error(const char *fmt, ...)
     /* display an error */
     logfile_message("----- crash -----");
     logfile_message("%s", buf);
+    logfile_flush(); /* we're about to exit */
     fprintf(stderr, "%s\n", buf);
 
 #if defined(__ANDROID__)
@@ -159,11 +161,13 @@ void fatal_error(const char *fmt, ...)
 
     /* al_show_native_message_box may be called without Allegro being initialized.
        https://liballeg.org/a5docs/trunk/native_dialog.html#al_show_native_message_box */
-    al_show_native_message_box(al_get_current_display(),
-        "Surgexception Error",
-        "Ooops... Surgexception!",
-        buf,
-    NULL, ALLEGRO_MESSAGEBOX_ERROR);
+    if(has_message_boxes) {
+        al_show_native_message_box(al_get_current_display(),
+            "Surgexception Error",
+            "Ooops... Surgexception!",
+            buf,
+        NULL, ALLEGRO_MESSAGEBOX_ERROR);
+    }
 
     /* clear up resources */
     if(resourcemanager_is_initialized()) {
@@ -204,8 +208,10 @@ void alert(const char* fmt, ...)
     /* show message box */
     /* al_show_native_message_box may be called without Allegro being initialized.
        https://liballeg.org/a5docs/trunk/native_dialog.html#al_show_native_message_box */
-    al_show_native_message_box(al_get_current_display(),
-        GAME_TITLE, GAME_TITLE, buf, NULL, ALLEGRO_MESSAGEBOX_WARN);
+    if(has_message_boxes) {
+        al_show_native_message_box(al_get_current_display(),
+            GAME_TITLE, GAME_TITLE, buf, NULL, ALLEGRO_MESSAGEBOX_WARN);
+    }
 }
 
 /*
@@ -242,7 +248,7 @@ bool confirm(const char* fmt, ...)
     /* show message box */
     /* al_show_native_message_box may be called without Allegro being initialized.
        https://liballeg.org/a5docs/trunk/native_dialog.html#al_show_native_message_box */
-    result = al_show_native_message_box(al_get_current_display(),
+    result = !has_message_boxes ? 0 : al_show_native_message_box(al_get_current_display(),
         GAME_TITLE, GAME_TITLE, buf, *buttons ? buttons : NULL, ALLEGRO_MESSAGEBOX_YES_NO | ALLEGRO_MESSAGEBOX_WARN);
 
     /* log result */
@@ -252,6 +258,17 @@ bool confirm(const char* fmt, ...)
     return 1 == result;
 }
 
+/*
+ * enable_message_boxes()
+ * Enables or disables the message boxes of fatal_error(), alert() and
+ * confirm(). If disabled, the messages are only logged and confirm()
+ * returns false
+ */
+void enable_message_boxes(bool enable)
+{
+    has_message_boxes = enable;
+}
+
 /*
  * random64()
  * xorshift random number generator
@@ -754,5 +771,47 @@ bool is_tv_device()
 
     return false;
 
+#endif
+}
+
+/* The thermal status of the device, as given by
+   PowerManager.getCurrentThermalStatus() on Android */
+int thermal_status()
+{
+#if defined(__ANDROID__)
+
+    JNIEnv* env = al_android_get_jni_env();
+    jobject activity = al_android_get_activity();
+    int status = 0;
+
+    jclass class_id = (*env)->GetObjectClass(env, activity);
+    jmethodID method_id = (*env)->GetMethodID(env, class_id, "getSystemService", "(Ljava/lang/String;)Ljava/lang/Object;");
+
+    jstring jname = (*env)->NewStringUTF(env, "power");
+    jobject power_manager = (*env)->CallObjectMethod(env, activity, method_id, jname);
+    (*env)->DeleteLocalRef(env, jname);
+
+    (*env)->DeleteLocalRef(env, class_id);
+
+    if(power_manager != NULL) {
+        /* getCurrentThermalStatus() requires API level 29 */
+        jclass power_class_id = (*env)->GetObjectClass(env, power_manager);
+        jmethodID status_id = (*env)->GetMethodID(env, power_class_id, "getCurrentThermalStatus", "()I");
+
+        if(status_id != NULL)
+            status = (*env)->CallIntMethod(env, power_manager, status_id);
+        else
+            (*env)->ExceptionClear(env); /* NoSuchMethodError */
+
+        (*env)->DeleteLocalRef(env, power_class_id);
+        (*env)->DeleteLocalRef(env, power_manager);
+    }
+
+    return status;
+
+#else
+
+    return 0;
+
 #endif
 }
\ No newline at end of file
@@ -63,6 +63,7 @@ int game_version_compare(int sup_version, int sub_version, int wip_version); /*
 void fatal_error(const char *fmt, ...); /* crash the program with a message */
 void alert(const char* fmt, ...); /* display a message box with an OK button */
 bool confirm(const char* fmt, ...); /* display a message box with Yes/No buttons */
+void enable_message_boxes(bool enable); /* message boxes are enabled by default */
 void merge_sort(void *base, int num, size_t size, int (*comparator)(const void*,const void*)); /* similar to stdlib's qsort, but merge_sort is a stable sorting algorithm */
 uint64_t random64(); /* pseudo-random 64-bit number */
 FILE* fopen_utf8(const char* filepath, const char* mode); /* fopen() with UTF-8 filename support */
@@ -78,5 +79,6 @@ char* stringify_version_number(int version_code, char* buffer, size_t buffer_siz
 const char* opensurge_game_version(); /* the version of the game / MOD that is being run in the engine */
 const char* opensurge_game_name(); /* the name of the game / MOD that is being run in the engine */
 bool is_tv_device(); /* are we in a Smart TV? */
+int thermal_status(); /* thermal status of the device, from 0 (none) to 6 (shutdown); 0 if unknown */
 
 #endif
\ No newline at end of file
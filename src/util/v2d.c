@@ -23,70 +23,11 @@
 #include "../util/numeric.h"
 #include "../util/util.h"
 
-
-/*
- * v2d_add()
- * Adds two vectors
- */
-v2d_t v2d_add(v2d_t u, v2d_t v)
-{
-    return v2d_new(u.x + v.x , u.y + v.y);
-}
-
-
-/*
- * v2d_subtract()
- * Subtracts two vectors
- */
-v2d_t v2d_subtract(v2d_t u, v2d_t v)
-{
-    return v2d_new(u.x - v.x , u.y - v.y);
-}
-
-
-/*
- * v2d_multiply()
- * Multiplies a vector by a scalar
- */
-v2d_t v2d_multiply(v2d_t u, float h)
-{
-    return v2d_new(h * u.x , h * u.y);
-}
-
-
-/*
- * v2d_magnitude()
- * Returns the length of a vector
- */
-float v2d_magnitude(v2d_t v)
-{
-    return sqrtf(v.x * v.x + v.y * v.y);
-}
-
-
-/*
- * v2d_dot()
- * Returns the dot product between u and v
- */
-float v2d_dot(v2d_t u, v2d_t v)
-{
-    return (u.x * v.x + u.y * v.y);
-}
-
-
-/*
- * v2d_rotate()
- * Rotates a vector by an angle given in radians
- */
-v2d_t v2d_rotate(v2d_t v, float radians)
-{
-    float c = cosf(radians), s = sinf(radians);
-
-    return v2d_new(
-        v.x * c - v.y * s,
-        v.y * c + v.x * s
-    );
-}
+/* SIMD */
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define WANT_SSE 1
+#endif
 
 
 /*
@@ -96,8 +37,23 @@ v2d_t v2d_rotate(v2d_t v, float radians)
 void v2d_rotate_all(v2d_t* v, int n, float radians)
 {
     float c = cosf(radians), s = sinf(radians);
+    int i = 0;
+
+#if defined(WANT_SSE)
+    /* rotate two vectors at a time: (x0, y0, x1, y1) */
+    __m128 cos4 = _mm_set1_ps(c);
+    __m128 sin4 = _mm_setr_ps(-s, s, -s, s);
+
+    for(; i + 1 < n; i += 2) {
+        __m128 p = _mm_loadu_ps(&v[i].x);
+        __m128 q = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 3, 0, 1)); /* (y0, x0, y1, x1) */
+
+        p = _mm_add_ps(_mm_mul_ps(p, cos4), _mm_mul_ps(q, sin4));
+        _mm_storeu_ps(&v[i].x, p);
+    }
+#endif
 
-    for(int i = 0; i < n; i++) {
+    for(; i < n; i++) {
         v[i] = v2d_new(
             v[i].x * c - v[i].y * s,
             v[i].y * c + v[i].x * s
@@ -136,13 +92,3 @@ v2d_t v2d_lerp(v2d_t u, v2d_t v, float t)
     float r = 1.0f - t;
     return v2d_new(r * u.x + t * v.x, r * u.y + t * v.y);
 }
-
-
-/*
- * v2d_compmult()
- * Performs component-wise multiplication
- */
-v2d_t v2d_compmult(v2d_t u, v2d_t v)
-{
-    return v2d_new(u.x * v.x, u.y * v.y);
-}
\ No newline at end of file